@@ -1483,6 +1483,50 @@ int fal_plugin_ip_get_neigh_attrs(unsigned int if_index,
 int fal_plugin_ip_del_neigh(unsigned int if_index,
 			    struct fal_ip_address_t *ipaddr);
 
+/**
+ * @brief An IP neighbor, as identified to the bulk neighbor operations
+ */
+struct fal_ip_neigh_t {
+	unsigned int if_index;
+	struct fal_ip_address_t ipaddr;
+};
+
+/**
+ * @brief Bulk create IP neighbors
+ *
+ * @param[in] neigh_count The number of neighbors
+ * @param[in] neigh_list List of neighbors to create
+ * @param[in] attr_count An array of the count of attributes for each neighbor
+ * @param[in] attr_list An array of the list of attributes for each neighbor
+ * @param[out] results List of results, one for each neighbor
+ *
+ * @return 0 if all were created. Otherwise the negative errno of the
+ * first failure, with all neighbors attempted.
+ *
+ * @note Optional. Without it fal_plugin_ip_new_neigh is used for each.
+ */
+int fal_plugin_ip_new_neighs(uint32_t neigh_count,
+			     const struct fal_ip_neigh_t *neigh_list,
+			     const uint32_t *attr_count,
+			     const struct fal_attribute_t **attr_list,
+			     int *results);
+
+/**
+ * @brief Bulk delete IP neighbors
+ *
+ * @param[in] neigh_count The number of neighbors
+ * @param[in] neigh_list List of neighbors to delete
+ * @param[out] results List of results, one for each neighbor
+ *
+ * @return 0 if all were deleted. Otherwise the negative errno of the
+ * first failure, with all neighbors attempted.
+ *
+ * @note Optional. Without it fal_plugin_ip_del_neigh is used for each.
+ */
+int fal_plugin_ip_del_neighs(uint32_t neigh_count,
+			     const struct fal_ip_neigh_t *neigh_list,
+			     int *results);
+
 /*
  * IP Route operations
  */
@@ -1522,6 +1566,70 @@ int fal_plugin_ip_del_route(unsigned int vrf_id,
 			    uint8_t prefixlen,
 			    uint32_t tableid);
 
+/**
+ * @brief A route, as identified to the bulk route operations
+ */
+struct fal_ip_route_t {
+	unsigned int vrf_id;
+	struct fal_ip_address_t ipaddr;
+	uint8_t prefixlen;
+	uint32_t tableid;
+};
+
+/**
+ * @brief Bulk create routes
+ *
+ * @param[in] route_count The number of routes
+ * @param[in] route_list List of routes to create
+ * @param[in] attr_count An array of the count of attributes for each route
+ * @param[in] attr_list An array of the list of attributes for each route
+ * @param[out] results List of results, one for each route
+ *
+ * @return 0 if all were created. Otherwise the negative errno of the
+ * first failure, with all routes attempted.
+ *
+ * @note Optional. Without it fal_plugin_ip_new_route is used for each.
+ */
+int fal_plugin_ip_new_routes(uint32_t route_count,
+			     const struct fal_ip_route_t *route_list,
+			     const uint32_t *attr_count,
+			     const struct fal_attribute_t **attr_list,
+			     int *results);
+
+/**
+ * @brief Bulk update routes
+ *
+ * @param[in] route_count The number of routes
+ * @param[in] route_list List of routes to update
+ * @param[in] attr_list List of attributes, one to update for each route
+ * @param[out] results List of results, one for each route
+ *
+ * @return 0 if all were updated. Otherwise the negative errno of the
+ * first failure, with all routes attempted.
+ *
+ * @note Optional. Without it fal_plugin_ip_upd_route is used for each.
+ */
+int fal_plugin_ip_upd_routes(uint32_t route_count,
+			     const struct fal_ip_route_t *route_list,
+			     const struct fal_attribute_t *attr_list,
+			     int *results);
+
+/**
+ * @brief Bulk delete routes
+ *
+ * @param[in] route_count The number of routes
+ * @param[in] route_list List of routes to delete
+ * @param[out] results List of results, one for each route
+ *
+ * @return 0 if all were deleted. Otherwise the negative errno of the
+ * first failure, with all routes attempted.
+ *
+ * @note Optional. Without it fal_plugin_ip_del_route is used for each.
+ */
+int fal_plugin_ip_del_routes(uint32_t route_count,
+			     const struct fal_ip_route_t *route_list,
+			     int *results);
+
 /*
  * IP Nexthop Group operations
  */
@@ -1559,6 +1667,44 @@ int fal_plugin_ip_upd_next_hop_group(fal_object_t obj,
  */
 int fal_plugin_ip_del_next_hop_group(fal_object_t obj);
 
+/**
+ * @brief Bulk create next hop group objects
+ *
+ * @param[in] nhg_count The number of next-hop-groups
+ * @param[in] attr_count An array of the count of attributes for each group
+ * @param[in] attr_list An array of the list of attributes for each group
+ * @param[out] obj_list List of object IDs returned, one for each group
+ * @param[out] results List of results, one for each group
+ *
+ * @return 0 if all were created. Otherwise the negative errno of the
+ * first failure, with all groups attempted.
+ *
+ * @note Optional. Without it fal_plugin_ip_new_next_hop_group is used
+ * for each.
+ */
+int fal_plugin_ip_new_next_hop_groups(uint32_t nhg_count,
+				      const uint32_t *attr_count,
+				      const struct fal_attribute_t **attr_list,
+				      fal_object_t *obj_list,
+				      int *results);
+
+/**
+ * @brief Bulk delete next hop group objects
+ *
+ * @param[in] nhg_count The number of next-hop-groups
+ * @param[in] obj_list List of IDs of the groups to be deleted
+ * @param[out] results List of results, one for each group
+ *
+ * @return 0 if all were deleted. Otherwise the negative errno of the
+ * first failure, with all groups attempted.
+ *
+ * @note Optional. Without it fal_plugin_ip_del_next_hop_group is used
+ * for each.
+ */
+int fal_plugin_ip_del_next_hop_groups(uint32_t nhg_count,
+				      const fal_object_t *obj_list,
+				      int *results);
+
 /*
  * IP Nexthop operations
  */
@@ -2628,6 +2774,34 @@ int fal_plugin_qos_get_queue_stats_ext(fal_object_t queue_id,
 				       const uint32_t *counter_ids,
 				       bool read_and_clear, uint64_t *counters);
 
+/**
+ * @brief Bulk get queue statistics counters
+ *
+ * The same counters are read from each queue, in the same way as
+ * fal_plugin_qos_get_queue_stats_ext.
+ *
+ * @param[in] queue_count The number of queues
+ * @param[in] queue_list List of queue ids
+ * @param[in] number_of_counters Number of counters for each queue
+ * @param[in] counter_ids Specifies the array of counter ids
+ * @param[in] read_and_clear Determines the mode of operation
+ * @param[out] counters Array of resulting counter values, those of
+ *             queue i starting at counters[i * number_of_counters]
+ * @param[out] results List of results, one for each queue
+ *
+ * @return 0 if all were read. Otherwise the negative errno of the
+ * first failure, with all queues attempted.
+ *
+ * @note Optional. Without it fal_plugin_qos_get_queue_stats_ext is used
+ * for each.
+ */
+int fal_plugin_qos_get_queues_stats(uint32_t queue_count,
+				    const fal_object_t *queue_list,
+				    uint32_t number_of_counters,
+				    const uint32_t *counter_ids,
+				    bool read_and_clear, uint64_t *counters,
+				    int *results);
+
 /**
  * @brief Clear queue statistics counters.
  *
@@ -4557,4 +4731,96 @@ int fal_plugin_acl_get_counter_attr(fal_object_t counter_id,
 			     struct fal_attribute_t *attr_list);
 /* End of ACL Stuff */
 
+/* Start of flow offload */
+
+/*
+ * A flow entry is an established firewall or NAT session handed to the
+ * plugin to forward without the dataplane seeing its packets.  The flow
+ * is described as seen on the interface the session was created on, in
+ * the direction of the packet that created it.  The plugin forwards
+ * both directions, applying the NAT translation (if any) in the forwards
+ * direction and undoing it in the reverse.
+ *
+ * TCP segments with SYN, FIN or RST set must still be sent to the
+ * dataplane so that it can track the connection state, and so that the
+ * entry is deleted when the connection closes.
+ */
+enum fal_flow_dir_t {
+	FAL_FLOW_DIR_IN,	/* Session created on input */
+	FAL_FLOW_DIR_OUT,	/* Session created on output */
+};
+
+enum fal_flow_nat_type_t {
+	FAL_FLOW_NAT_NONE,
+	FAL_FLOW_NAT_SNAT,
+	FAL_FLOW_NAT_DNAT,
+};
+
+enum fal_flow_entry_attr_t {
+	FAL_FLOW_ENTRY_ATTR_IFINDEX,	/* .u32 */
+	FAL_FLOW_ENTRY_ATTR_VRF_ID,	/* .u32 */
+	FAL_FLOW_ENTRY_ATTR_DIRECTION,	/* .u8, enum fal_flow_dir_t */
+	FAL_FLOW_ENTRY_ATTR_IP_PROTO,	/* .u8 */
+	FAL_FLOW_ENTRY_ATTR_SRC_IP,	/* .ipaddr */
+	FAL_FLOW_ENTRY_ATTR_DST_IP,	/* .ipaddr */
+	/* .u16 in network order, the ICMP id for ICMP echo */
+	FAL_FLOW_ENTRY_ATTR_SRC_PORT,
+	FAL_FLOW_ENTRY_ATTR_DST_PORT,
+	/*
+	 * Optional.  The translation applied in the forwards direction, to
+	 * the source for SNAT and to the destination for DNAT.
+	 */
+	FAL_FLOW_ENTRY_ATTR_NAT_TYPE,	/* .u8, enum fal_flow_nat_type_t */
+	FAL_FLOW_ENTRY_ATTR_NAT_IP,	/* .ipaddr */
+	FAL_FLOW_ENTRY_ATTR_NAT_PORT,	/* .u16 in network order */
+};
+
+enum fal_flow_entry_stat_type {
+	FAL_FLOW_ENTRY_STAT_FORW_PACKETS,
+	FAL_FLOW_ENTRY_STAT_FORW_BYTES,
+	FAL_FLOW_ENTRY_STAT_BACK_PACKETS,
+	FAL_FLOW_ENTRY_STAT_BACK_BYTES,
+	FAL_FLOW_ENTRY_STAT_MAX
+};
+
+/**
+ * @brief Offload a flow
+ *
+ * @param[in] attr_count Number of attributes
+ * @param[in] attr_list A list of attributes and their associated values
+ * @param[out] obj Object identifier of the new flow entry
+ *
+ * @return 0 on success, or a negative errno if the flow can not be
+ *         offloaded, in which case it continues to be forwarded by the
+ *         dataplane.
+ */
+int fal_plugin_flow_create_entry(uint32_t attr_count,
+				 const struct fal_attribute_t *attr_list,
+				 fal_object_t *obj);
+
+/**
+ * @brief Stop offloading a flow
+ *
+ * @param[in] obj Object identifier of the flow entry
+ *
+ * @return 0 on success or failure status.
+ */
+int fal_plugin_flow_delete_entry(fal_object_t obj);
+
+/**
+ * @brief Get the counts of packets forwarded by the plugin.  The counts
+ *        are cumulative from when the entry was created.
+ *
+ * @param[in] obj Object identifier of the flow entry
+ * @param[in] num_counters Number of counters
+ * @param[in] cntr_ids The counters to get
+ * @param[out] cntrs The counter values
+ *
+ * @return 0 on success or failure status.
+ */
+int fal_plugin_flow_get_stats(fal_object_t obj, uint32_t num_counters,
+			      const enum fal_flow_entry_stat_type *cntr_ids,
+			      uint64_t *cntrs);
+/* End of flow offload */
+
 #endif /* FAL_PLUGIN_H */
@@ -25,6 +25,8 @@ struct pl_feature_registration;
 #define PL_NODE_INPUT_MAX 16
 #define PL_NODE_COLL_MAX 128
 #define PL_NODE_STORE_MAX 4
+/* max packets processed together by a node in vector mode */
+#define PL_VEC_MAX 32
 
 enum pl_mode {
 	/*
@@ -62,11 +64,44 @@ enum validation_flags {
 	NEEDS_SLOWPATH  = 0x1,
 };
 
+/*
+ * Why a packet reached a drop node, counted per lcore and per input
+ * interface by the drop nodes.  Set by the node choosing to drop with
+ * pl_drop(); drops with no reason set count as unspecified.
+ *
+ * Add new reasons at the end and give them a name in pl_drop.c.
+ */
+enum pl_drop_reason {
+	PL_DROP_UNSPEC,
+	PL_DROP_L2_HDR,		/* bad or unexpected L2 header */
+	PL_DROP_UNKNOWN_PROTO,	/* unknown ethertype or PPP protocol */
+	PL_DROP_VLAN_MODIFY,
+	PL_DROP_PORTMONITOR,
+	PL_DROP_XCONNECT,
+	PL_DROP_ARP,
+	PL_DROP_IP_HDR,		/* failed IP header validation */
+	PL_DROP_IP_ADDR,	/* address not allowed here */
+	PL_DROP_NOT_FORWARDING,	/* forwarding disabled on the interface */
+	PL_DROP_TTL,
+	PL_DROP_RPF,
+	PL_DROP_NO_ROUTE,
+	PL_DROP_BLACKHOLE,	/* blackhole or reject route */
+	PL_DROP_NH_DOWN,	/* next hop interface down */
+	PL_DROP_FW_IN,
+	PL_DROP_FW_OUT,
+	PL_DROP_ACL_IN,
+	PL_DROP_ACL_OUT,
+	PL_DROP_PBR,
+	PL_DROP_CGNAT,
+	PL_DROP_NPTV6,
+	PL_DROP_L4,
+	PL_DROP_TOO_BIG,	/* needs fragmenting but DF set */
+	PL_DROP_MAX
+};
+
 struct pl_packet {
 	struct rte_mbuf      *mbuf;
 	void                 *l3_hdr;
-	int                   l2_pkt_type;
-	enum validation_flags val_flags;
 	union {
 		struct next_hop *v4;
 		struct next_hop_v6 *v6;
@@ -76,10 +111,34 @@ struct pl_packet {
 	uint32_t              tblid;
 	uint16_t              npf_flags;
 	uint16_t              l2_proto;
-	int                   max_data_used;
+	uint8_t               l2_pkt_type;	/* enum l2_packet_type */
+	uint8_t               val_flags;	/* enum validation_flags */
+	/* nxt already resolved by a vector prepare function */
+	bool                  nxt_resolved;
+	/* rpf_ok already found by a vector prepare function */
+	bool                  rpf_resolved;
+	bool                  rpf_ok;
+	uint8_t               max_data_used;
+	uint8_t               drop_reason;	/* enum pl_drop_reason */
+	/*
+	 * Only valid below max_data_used, so the slots are not touched
+	 * unless a node sets one. Keep the fields above and the first
+	 * slot in one cache line, as a vector holds PL_VEC_MAX of these.
+	 */
 	void                 *data[PL_NODE_STORE_MAX];
 } __rte_cache_aligned;
 
+/*
+ * Note why the packet is being dropped, for a node to return with the
+ * disposition that leads to a drop node.
+ */
+static inline unsigned int
+pl_drop(struct pl_packet *pkt, enum pl_drop_reason reason, unsigned int disp)
+{
+	pkt->drop_reason = reason;
+	return disp;
+}
+
 enum pl_node_feat_action {
 	PL_NODE_FEAT_ADD,
 	PL_NODE_FEAT_REM,
@@ -89,6 +148,15 @@ enum pl_node_feat_action {
 typedef unsigned int
 (pl_proc) (struct pl_packet *p);
 
+/*
+ * optional node vector preparation function, invoked in vector mode
+ * on the whole vector before the handler is run for each packet. For
+ * a feature node it is invoked on the vector reaching its feature
+ * point, before any of the features are run.
+ */
+typedef void
+(pl_proc_vec_prepare) (struct pl_packet **pkts, unsigned int n);
+
 /* node initialization function */
 typedef void
 (pl_init_node) (const struct pl_node *);
@@ -117,6 +185,10 @@ typedef bool
 (pl_node_feat_iterate) (struct pl_node *node, bool first,
 			unsigned int *feature_id, void **context);
 
+/* mask of enabled features, with bit (id - 1) set for each */
+typedef unsigned int
+(pl_node_feat_mask) (struct pl_node *node);
+
 typedef struct pl_node *
 (pl_node_lookup_by_name_fn) (const char *name);
 
@@ -135,8 +207,10 @@ struct pl_node_registration {
 	const char        *name;
 	pl_init_node      *init;
 	pl_proc           *handler;
+	pl_proc_vec_prepare *vec_prepare;
 	pl_node_feat_change *feat_change;
 	pl_node_feat_iterate *feat_iterate;
+	pl_node_feat_mask *feat_mask;
 	pl_node_lookup_by_name_fn *lookup_by_name;
 	enum pl_node_type  type;
 	bool               disable;
@@ -149,6 +223,8 @@ struct pl_node_registration {
 	uint16_t           max_feature_reg_idx;
 	struct pl_feature_registration **feature_regs;
 	struct pl_node_registration **next_nodes;
+	/* fused-mode handler used in vector mode, may be NULL */
+	pl_proc           *fused_handler;
 	/* end internal state */
 
 	const char        *next[];
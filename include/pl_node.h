@@ -78,6 +78,10 @@ pl_node_iter_features(struct pl_node_registration *node_reg,
 bool
 pl_graph_walk(struct pl_node_registration *node_reg, struct pl_packet *pkt);
 
+void
+pl_graph_walk_vec(struct pl_node_registration *node_reg,
+		  struct pl_packet **pkts, unsigned int n);
+
 int
 pl_node_feat_change_u16(uint16_t *bitmask,
 			struct pl_feature_registration *feat,
@@ -87,6 +91,9 @@ bool
 pl_node_feat_iterate_u16(const uint16_t *bitmask, bool first,
 			 unsigned int *feature_id, void **context);
 
+unsigned int
+pl_node_feat_mask_u16(const uint16_t *bitmask);
+
 int
 pl_node_feat_change_u8(uint8_t *bitmask,
 		       struct pl_feature_registration *feat,
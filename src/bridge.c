@@ -29,6 +29,7 @@
 #include <rte_log.h>
 #include <rte_mbuf.h>
 #include <rte_memory.h>
+#include <rte_spinlock.h>
 #include <rte_timer.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -40,12 +41,15 @@
 #include "arp.h"
 #include "bridge.h"
 #include "bridge_flags.h"
+#include "bridge_mactbl.h"
+#include "bridge_mdb.h"
 #include "bridge_vlan_set.h"
 #include "capture.h"
 #include "compat.h"
 #include "config.h"
 #include "control.h"
 #include "dp_event.h"
+#include "dp_mem.h"
 #include "ether.h"
 #include "fal.h"
 #include "fal_plugin.h"
@@ -53,6 +57,7 @@
 #include "if_var.h"
 #include "json_writer.h"
 #include "main.h"
+#include "master.h"
 #include "mstp.h"
 #include "netinet6/nd6_nbr.h"
 #include "netlink.h"
@@ -84,6 +89,39 @@ struct bridge_vlan_set;
 
 #define	BRIDGE_RTABLE_PRUNE_PERIOD 2 /* secs between each expire tick */
 #define	BRIDGE_RTABLE_EXPIRE	(300 / BRIDGE_RTABLE_PRUNE_PERIOD)
+#define	BRIDGE_FLOOD_BURST	32	/* ports cloned for at a time */
+
+/*
+ * New and moved MACs seen by a forwarding lcore are queued on that
+ * lcore's learn ring, and the master thread applies the queued
+ * requests BRIDGE_LEARN_HZ times a second. Allocation and table
+ * updates stay off the forwarding path, and the master thread is the
+ * only writer of the forwarding table. Threads that are not EAL
+ * lcores share one extra ring under a lock.
+ */
+#define	BRIDGE_LEARN_RING_SIZE	512	/* power of two */
+#define	BRIDGE_LEARN_RECENT	64	/* requests checked for repeats */
+#define	BRIDGE_LEARN_HZ		100
+#define	BRIDGE_LEARN_ANY	RTE_MAX_LCORE
+
+struct bridge_learn {
+	struct bridge_key	bl_key;
+	uint32_t		bl_ifindex;	/* port the MAC was seen on */
+	uint32_t		bl_dip;		/* tunnel endpoint, if any */
+	bool			bl_tunnel;
+};
+
+struct bridge_learn_ring {
+	uint32_t		blr_head;	/* written by the lcore */
+	uint32_t		blr_recent[BRIDGE_LEARN_RECENT];
+	uint32_t		blr_tail __rte_cache_aligned; /* by master */
+	struct bridge_learn	blr_ent[BRIDGE_LEARN_RING_SIZE]
+				__rte_cache_aligned;
+};
+
+static struct bridge_learn_ring *bridge_learn_rings[RTE_MAX_LCORE + 1];
+static rte_spinlock_t bridge_learn_any_lock = RTE_SPINLOCK_INITIALIZER;
+static struct rte_timer bridge_learn_timer;
 #define BRIDGE_AGEING_TIME_MIN	10
 #define BRIDGE_AGEING_TIME_MAX	1000000
 
@@ -409,12 +447,20 @@ bridge_rtnode_lookup(struct bridge_softc *sc,
 {
 	struct cds_lfht_iter iter;
 	struct cds_lfht_node *node;
+	struct bridge_mactbl *tbl;
+	struct bridge_rtnode *brt;
 
 	/* Use VLAN id 0 if bridge is not VLAN aware */
 	if (!sc->scbr_vlan_filter)
 		vid = 0;
 
 	struct bridge_key key = { .addr = *addr, .vlan = vid };
+
+	tbl = rcu_dereference(sc->scbr_mactbl);
+	brt = bridge_mactbl_lookup(tbl, &key);
+	if (likely(brt != NULL) || likely(bridge_mactbl_complete(tbl)))
+		return brt;
+
 	cds_lfht_lookup(sc->scbr_rthash,
 		bridge_key_hash(&key),
 		bridge_rtnode_match, &key, &iter);
@@ -430,6 +476,7 @@ bridge_rtnode_lookup(struct bridge_softc *sc,
  * bridge_rtnode_insert:
  *
  *	Insert the specified bridge node into the route table.
+ *	Only called from the master thread.
  */
 static int
 bridge_rtnode_insert(struct bridge_softc *sc, struct bridge_rtnode *brt)
@@ -446,45 +493,33 @@ bridge_rtnode_insert(struct bridge_softc *sc, struct bridge_rtnode *brt)
 				       bridge_key_hash(&brt->brt_key),
 				       bridge_rtnode_match, &brt->brt_key,
 				       &brt->brt_node);
-	return (ret_node != &brt->brt_node) ? EEXIST : 0;
+	if (ret_node != &brt->brt_node)
+		return EEXIST;
+
+	bridge_mactbl_add(&sc->scbr_mactbl, brt);
+	return 0;
 }
 
 /*
- * Update existing forwarding table entry
+ * Learn a MAC seen on a port, creating or moving its entry.
+ * Only called from the master thread.
  */
 static void
-bridge_rtupdate(struct ifnet *ifp,
-	const struct ether_addr *dst,
-	uint16_t vlan)
+bridge_rtlearn(struct bridge_softc *sc, struct ifnet *ifp,
+	       const struct ether_addr *dst, uint16_t vlan)
 {
-	struct bridge_softc *sc =
-		bridge_port_get_bridge(ifp->if_brport)->if_softc;
 	struct bridge_rtnode *brt;
 	/* set attr.state to dynamic ie !NUD_PERMANENT and !NUD_NOARP */
 	struct fal_attribute_t attr = {
 		FAL_BRIDGE_NEIGH_ATTR_STATE, .value.u16 = 0};
 
-	if (ifp->if_type == IFT_TUNNEL_GRE) {
-		/* We shouldn't get in here for tunnels but JIC.
-		 *
-		 * We rely on the GRE tunnel code to update bridging entries as
-		 * it knows about the src IP address of the transport layer.
-		 * This is crucial in case of MP GRE tunnels where the spoke is
-		 * identified by its transport IP address
-		 */
-		DP_DEBUG(BRIDGE, ERR, BRIDGE,
-			 "bridge_rtupdate: Bridge rt notif for tunnel interface %s\n",
-			 ifp->if_name);
-		return;
-	}
-
 	/*
 	 * A route for this destination might already exist.  If so,
 	 * update it.
 	 */
 	brt = bridge_rtnode_lookup(sc, dst, vlan);
 	if (unlikely(brt == NULL)) {
-		brt = zmalloc_aligned(sizeof(*brt));
+		brt = dp_mem_zmalloc(DP_MEM_BRIDGE, sizeof(*brt));
 		if (unlikely(brt == NULL))
 			return;
 
@@ -495,7 +530,7 @@ bridge_rtupdate(struct ifnet *ifp,
 		brt->brt_expire = 0;
 
 		if (unlikely(bridge_rtnode_insert(sc, brt) != 0)) {
-			free(brt);
+			dp_mem_free(DP_MEM_BRIDGE, brt, sizeof(*brt));
 			return;
 		}
 		fal_br_new_neigh(ifp->if_index, vlan, dst, 1, &attr);
@@ -510,10 +545,216 @@ bridge_rtupdate(struct ifnet *ifp,
 	rte_atomic32_clear(&brt->brt_unused);
 }
 
+/*
+ * Learn a MAC seen on a tunnel port from the given endpoint.
+ * Only called from the master thread.
+ */
+static int
+bridge_rtlearn_tunnel(struct bridge_softc *sc, struct ifnet *ifp,
+		      const struct ether_addr *dst, in_addr_t dst_ip,
+		      uint16_t vlan)
+{
+	struct bridge_rtnode *brt;
+	int err;
+
+	brt = bridge_rtnode_lookup(sc, dst, vlan);
+	if (brt) {
+		/* update exist entry */
+		brt->brt_flags = IFBAF_DYNAMIC;
+		brt->brt_difp = ifp;
+		brt->brt_dip = dst_ip;
+		return 0;
+	}
+
+	brt = dp_mem_zmalloc(DP_MEM_BRIDGE, sizeof(*brt));
+	if (!brt) {
+		DP_DEBUG(BRIDGE, ERR, BRIDGE,
+			 "out of memory for forwarding entry\n");
+		return -ENOMEM;
+	}
+
+	brt->brt_difp = ifp;
+	brt->brt_key.addr = *dst;
+	brt->brt_key.vlan = vlan;
+	brt->brt_dip = dst_ip;
+	brt->brt_flags = IFBAF_DYNAMIC;
+	brt->brt_expire = 0;
+
+	err = bridge_rtnode_insert(sc, brt);
+	if (err) {
+		/* already created (race) */
+		dp_mem_free(DP_MEM_BRIDGE, brt, sizeof(*brt));
+		return err;
+	}
+	rte_atomic32_clear(&brt->brt_unused);
+	return 0;
+}
+
+/* Apply a learn request queued by bridge_learn_defer() */
+static void bridge_learn_apply(const struct bridge_learn *bl)
+{
+	struct bridge_port *brport;
+	struct bridge_softc *sc;
+	struct ifnet *ifp;
+
+	ifp = ifnet_byifindex(bl->bl_ifindex);
+	if (!ifp)
+		return;
+
+	/* The port may have left its bridge since */
+	brport = rcu_dereference(ifp->if_brport);
+	if (!brport)
+		return;
+
+	sc = bridge_port_get_bridge(brport)->if_softc;
+	if (bl->bl_tunnel)
+		bridge_rtlearn_tunnel(sc, ifp, &bl->bl_key.addr,
+				      bl->bl_dip, bl->bl_key.vlan);
+	else
+		bridge_rtlearn(sc, ifp, &bl->bl_key.addr, bl->bl_key.vlan);
+}
+
+static inline bool
+bridge_learn_equal(const struct bridge_learn *bl1,
+		   const struct bridge_learn *bl2)
+{
+	return bridge_key_equal(&bl1->bl_key, &bl2->bl_key) &&
+		bl1->bl_ifindex == bl2->bl_ifindex &&
+		bl1->bl_dip == bl2->bl_dip &&
+		bl1->bl_tunnel == bl2->bl_tunnel;
+}
+
+/*
+ * Queue a learn request on a ring. A MAC keeps arriving until the
+ * master thread has learnt it, so a request that is still pending
+ * is not queued again. If the ring is full the request is dropped,
+ * and made again on a later frame.
+ */
+static void bridge_learn_defer(unsigned int id, const struct bridge_learn *bl)
+{
+	struct bridge_learn_ring *blr = bridge_learn_rings[id];
+	uint32_t head, tail, pos;
+	unsigned int r;
+
+	if (unlikely(blr == NULL)) {
+		blr = zmalloc_aligned(sizeof(*blr));
+		if (!blr)
+			return;
+		rcu_assign_pointer(bridge_learn_rings[id], blr);
+	}
+
+	head = blr->blr_head;
+	tail = CMM_LOAD_SHARED(blr->blr_tail);
+
+	r = eth_addr_hash(&bl->bl_key.addr, 32) % BRIDGE_LEARN_RECENT;
+	pos = blr->blr_recent[r];
+	if (pos - tail < head - tail &&
+	    bridge_learn_equal(
+		    &blr->blr_ent[pos % BRIDGE_LEARN_RING_SIZE], bl))
+		return;
+
+	if (head - tail == BRIDGE_LEARN_RING_SIZE)
+		return;
+
+	blr->blr_ent[head % BRIDGE_LEARN_RING_SIZE] = *bl;
+	blr->blr_recent[r] = head;
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(blr->blr_head, head + 1);
+}
+
+static void bridge_learn(const struct bridge_learn *bl)
+{
+	unsigned int lcore = rte_lcore_id();
+
+	if (lcore == rte_get_master_lcore()) {
+		bridge_learn_apply(bl);
+	} else if (lcore >= RTE_MAX_LCORE) {
+		rte_spinlock_lock(&bridge_learn_any_lock);
+		bridge_learn_defer(BRIDGE_LEARN_ANY, bl);
+		rte_spinlock_unlock(&bridge_learn_any_lock);
+	} else {
+		bridge_learn_defer(lcore, bl);
+	}
+}
+
+/* Apply the learn requests queued by the forwarding lcores */
+static void bridge_learn_drain(struct rte_timer *timer __rte_unused,
+			       void *arg __rte_unused)
+{
+	struct bridge_learn_ring *blr;
+	uint32_t head, tail;
+	unsigned int id;
+
+	rcu_read_lock();
+	for (id = 0; id <= BRIDGE_LEARN_ANY; id++) {
+		blr = rcu_dereference(bridge_learn_rings[id]);
+		if (!blr)
+			continue;
+
+		head = CMM_LOAD_SHARED(blr->blr_head);
+		cmm_smp_rmb();
+		for (tail = blr->blr_tail; tail != head; tail++)
+			bridge_learn_apply(
+				&blr->blr_ent[tail % BRIDGE_LEARN_RING_SIZE]);
+
+		/* Done with the entries before the lcore can reuse them */
+		cmm_smp_mb();
+		CMM_STORE_SHARED(blr->blr_tail, tail);
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * Update existing forwarding table entry, or ask for a new or moved
+ * MAC to be learnt.
+ */
+static void
+bridge_rtupdate(struct ifnet *ifp,
+	const struct ether_addr *dst,
+	uint16_t vlan)
+{
+	struct bridge_softc *sc =
+		bridge_port_get_bridge(ifp->if_brport)->if_softc;
+	struct bridge_rtnode *brt;
+
+	if (ifp->if_type == IFT_TUNNEL_GRE) {
+		/* We shouldn't get in here for tunnels but JIC.
+		 *
+		 * We rely on the GRE tunnel code to update bridging entries as
+		 * it knows about the src IP address of the transport layer.
+		 * This is crucial in case of MP GRE tunnels where the spoke is
+		 * identified by its transport IP address
+		 */
+		DP_DEBUG(BRIDGE, ERR, BRIDGE,
+			 "bridge_rtupdate: Bridge rt notif for tunnel interface %s\n",
+			 ifp->if_name);
+		return;
+	}
+
+	brt = bridge_rtnode_lookup(sc, dst, vlan);
+	if (likely(brt != NULL) &&
+	    (likely(brt->brt_difp == ifp) ||
+	     (brt->brt_flags & IFBAF_TYPEMASK) != IFBAF_DYNAMIC)) {
+		/* Entry is marked used, without dirtying it every frame */
+		if (unlikely(rte_atomic32_read(&brt->brt_unused)))
+			rte_atomic32_clear(&brt->brt_unused);
+		return;
+	}
+
+	struct bridge_learn bl = {
+		.bl_key = { .addr = *dst, .vlan = vlan },
+		.bl_ifindex = ifp->if_index,
+	};
+
+	bridge_learn(&bl);
+}
+
 static void
 bridge_rtnode_free(struct rcu_head *head)
 {
-	free(caa_container_of(head, struct bridge_rtnode, brt_rcu));
+	dp_mem_free(DP_MEM_BRIDGE,
+		    caa_container_of(head, struct bridge_rtnode, brt_rcu),
+		    sizeof(struct bridge_rtnode));
 }
 
 /*
@@ -522,10 +763,12 @@ bridge_rtnode_free(struct rcu_head *head)
  *	Destroy a bridge rtnode.
  */
 static void
-bridge_rtnode_destroy(struct cds_lfht *table, struct bridge_rtnode *brt)
+bridge_rtnode_destroy(struct bridge_softc *sc, struct bridge_rtnode *brt)
 {
-	if (!cds_lfht_del(table, &brt->brt_node))
+	if (!cds_lfht_del(sc->scbr_rthash, &brt->brt_node)) {
+		bridge_mactbl_del(sc->scbr_mactbl, brt);
 		call_rcu(&brt->brt_rcu, bridge_rtnode_free);
+	}
 }
 
 /*
@@ -542,6 +785,10 @@ bridge_rtable_init(struct bridge_softc *sc)
 				       NULL);
 	if (sc->scbr_rthash == NULL)
 		rte_panic("Can't allocate rthash\n");
+
+	sc->scbr_mactbl = bridge_mactbl_create();
+	if (sc->scbr_mactbl == NULL)
+		rte_panic("Can't allocate MAC table\n");
 }
 
 int
@@ -552,40 +799,26 @@ bridge_newneigh_tunnel(struct bridge_port *brport, const struct ether_addr *dst,
 	struct ifnet *ifm;
 	struct bridge_softc *sc;
 	struct bridge_rtnode *brt;
-	int err;
 
 	ifm = bridge_port_get_bridge(brport);
 	sc = ifm->if_softc;
+
+	if (rte_lcore_id() == rte_get_master_lcore())
+		return bridge_rtlearn_tunnel(sc, ifp, dst, dst_ip, vlan);
+
 	brt = bridge_rtnode_lookup(sc, dst, vlan);
-	if (brt) {
-		/* update exist entry */
-		brt->brt_flags = IFBAF_DYNAMIC;
-		brt->brt_difp = ifp;
-		brt->brt_dip = dst_ip;
+	if (likely(brt != NULL) && brt->brt_flags == IFBAF_DYNAMIC &&
+	    brt->brt_difp == ifp && brt->brt_dip == dst_ip)
 		return 0;
-	}
 
-	brt = zmalloc_aligned(sizeof(*brt));
-	if (!brt) {
-		DP_DEBUG(BRIDGE, ERR, BRIDGE,
-			 "out of memory for forwarding entry\n");
-		return -ENOMEM;
-	}
-
-	brt->brt_difp = ifp;
-	brt->brt_key.addr = *dst;
-	brt->brt_key.vlan = vlan;
-	brt->brt_dip = dst_ip;
-	brt->brt_flags = IFBAF_DYNAMIC;
-	brt->brt_expire = 0;
+	struct bridge_learn bl = {
+		.bl_key = { .addr = *dst, .vlan = vlan },
+		.bl_ifindex = ifp->if_index,
+		.bl_dip = dst_ip,
+		.bl_tunnel = true,
+	};
 
-	err = bridge_rtnode_insert(sc, brt);
-	if (err) {
-		/* already created (race) */
-		free(brt);
-		return err;
-	}
-	rte_atomic32_clear(&brt->brt_unused);
+	bridge_learn(&bl);
 	return 0;
 }
 
@@ -741,12 +974,17 @@ static int bridge_if_init(struct ifnet *ifp)
 	bridge_rtable_init(sc);
 
 	rte_timer_init(&sc->scbr_timer);
-	rte_timer_reset(&sc->scbr_timer,
-			rte_get_timer_hz() * BRIDGE_RTABLE_PRUNE_PERIOD,
-			PERIODICAL, rte_get_master_lcore(),
-			bridge_timer, sc);
+	master_aging_timer_reset(&sc->scbr_timer,
+				 rte_get_timer_hz() * BRIDGE_RTABLE_PRUNE_PERIOD,
+				 bridge_timer, sc);
 	sc->scbr_ageing_ticks = BRIDGE_RTABLE_EXPIRE;
 
+	if (!rte_timer_pending(&bridge_learn_timer))
+		rte_timer_reset(&bridge_learn_timer,
+				rte_get_timer_hz() / BRIDGE_LEARN_HZ,
+				PERIODICAL, rte_get_master_lcore(),
+				bridge_learn_drain, NULL);
+
 	ifp->if_softc = sc;
 
 	return 0;
@@ -775,6 +1013,8 @@ static void bridge_if_uninit(struct ifnet *ifp)
 
 	rte_timer_stop(&sc->scbr_timer);
 	cds_lfht_destroy(sc->scbr_rthash, NULL);
+	bridge_mactbl_destroy(sc->scbr_mactbl);
+	bridge_mdb_destroy(sc);
 
 	/* make sure all vlan stats storage is cleaned up */
 	for (i = 0; i < VLAN_N_VID; i++) {
@@ -879,7 +1119,7 @@ bridge_fdb_flush(struct ifnet *bridge, struct ifnet *ifp,
 		if ((ifp == NULL || brt->brt_difp == ifp) &&
 		    (vlanid == 0 || brt->brt_key.vlan == vlanid) &&
 		    (brt->brt_flags & fdb_type) != 0)
-			bridge_rtnode_destroy(sc->scbr_rthash, brt);
+			bridge_rtnode_destroy(sc, brt);
 	}
 
 	fal_fdb_flush(bridge->if_index,
@@ -936,6 +1176,7 @@ static void bridge_delport(int ifindex, int ifmaster)
 
 	ifpromisc(ifp, 0);
 	bridge_fdb_flush(ifm, ifp, IFBAF_ALL, 0);
+	bridge_mdb_port_remove(ifm, ifp);
 	fal_br_del_port(ifmaster, ifindex);
 }
 
@@ -1003,7 +1244,7 @@ bridge_forward(struct bridge_softc *sc, struct ifnet *ifp,
 	 * At this point, we're dealing with a unicast frame
 	 * going to a different interface.
 	 */
-	if (bridge_port_get_state_vlan(port, vlan) != STP_IFSTATE_FORWARDING)
+	if (!bridge_port_is_vlan_forwarding(port, vlan))
 		goto drop;
 
 	/*
@@ -1060,12 +1301,65 @@ static void bridge_flood_on_gre_tunnel(struct ifnet *out_if,
 	gre_tunnel_peer_walk(out_if, bridge_gre_clone_and_send, m);
 }
 
-/* Flood packets on locally hosted interfaces belonging to bridge. */
+/*
+ * Send a clone of the packet out of each of the given ports. The
+ * clones for a run of ports are allocated together, and all share the
+ * original's buffer.
+ */
+static void bridge_flood_clones(struct ifnet *br_ifp, struct ifnet *in_ifp,
+				struct rte_mbuf *m, struct ifnet **difs,
+				unsigned int ndif)
+{
+	struct rte_mbuf *clones[BRIDGE_FLOOD_BURST];
+	unsigned int i, n;
+
+	for (i = 0, n = 0; i < ndif; i++) {
+		/*
+		 * Bridging flooding over tunnel interface will make
+		 * the necessary mbuf copy for each peer
+		 */
+		if (difs[i]->if_type == IFT_TUNNEL_GRE)
+			bridge_flood_on_gre_tunnel(difs[i], m);
+		else
+			difs[n++] = difs[i];
+	}
+
+	if (n == 0 ||
+	    unlikely(pktmbuf_clone_bulk(m, m->pool, clones, n) != 0))
+		return;
+
+	for (i = 0; i < n; i++)
+		bridge_tx_frame(br_ifp, in_ifp, difs[i], clones[i]);
+}
+
+static bool bridge_flood_port_ok(struct bridge_port *port, struct ifnet *dif,
+				 struct ifnet *in_ifp, bool input_hw_fwded,
+				 uint16_t vlan, struct rte_mbuf *m)
+{
+	if (in_ifp && dif == in_ifp)
+		return false;
+
+	if (input_hw_fwded && dif->hw_forwarding)
+		return false;
+
+	if (!bridge_port_is_vlan_forwarding(port, vlan))
+		return false;
+
+	return !bridge_pkt_exceeds_mtu(m, dif);
+}
+
+/*
+ * Flood packets on locally hosted interfaces belonging to bridge, or
+ * if mports is given only on those of them.
+ */
 static void bridge_flood_local(struct bridge_softc *sc, struct ifnet *in_ifp,
 			       struct rte_mbuf *m, struct ifnet *br_ifp,
-			       bool is_pvst)
+			       bool is_pvst,
+			       const struct bridge_mdb_ports *mports)
 {
-	struct ifnet *dif, *lastif = NULL;
+	struct ifnet *difs[BRIDGE_FLOOD_BURST];
+	struct ifnet *dif, *lastif;
+	unsigned int i, ndif = 0;
 	struct cds_list_head *entry;
 	struct bridge_port *port;
 	bool input_hw_fwded;
@@ -1085,54 +1379,52 @@ static void bridge_flood_local(struct bridge_softc *sc, struct ifnet *in_ifp,
 
 	uint16_t vlan = bridge_frame_get_vlan(m);
 
-	bridge_for_each_brport(port, entry, sc) {
-		dif = bridge_port_get_interface(port);
-
-		if (in_ifp && dif == in_ifp)
-			continue;
-
-		if (input_hw_fwded && dif->hw_forwarding)
+	for (i = 0; mports && i < mports->count; i++) {
+		dif = mports->ifp[i];
+		port = rcu_dereference(dif->if_brport);
+		if (!port ||
+		    !bridge_flood_port_ok(port, dif, in_ifp, input_hw_fwded,
+					  vlan, m))
 			continue;
 
-		if (bridge_port_get_state_vlan(port, vlan)
-			!= STP_IFSTATE_FORWARDING)
-			continue;
+		/* More ports follow, so these all get clones */
+		if (ndif == BRIDGE_FLOOD_BURST) {
+			bridge_flood_clones(br_ifp, in_ifp, m, difs, ndif);
+			ndif = 0;
+		}
+		difs[ndif++] = dif;
+	}
 
-		if (bridge_pkt_exceeds_mtu(m, dif))
-			continue;
+	if (!mports) {
+		bridge_for_each_brport(port, entry, sc) {
+			dif = bridge_port_get_interface(port);
+			if (!bridge_flood_port_ok(port, dif, in_ifp,
+						  input_hw_fwded, vlan, m))
+				continue;
 
-		if (lastif) {
-			if (lastif->if_type == IFT_TUNNEL_GRE) {
-				/* Bridging flooding over tunnel interface will
-				 * make the necessary mbuf copy while still
-				 * retaining the original mbuf for the last
-				 * interface
-				 */
-				bridge_flood_on_gre_tunnel(lastif, m);
-			} else {
-				struct rte_mbuf *n
-					 = pktmbuf_clone(m, m->pool);
-
-				if (likely(n != NULL))
-					bridge_tx_frame(br_ifp, in_ifp,
-							lastif, n);
+			/* More ports follow, so these all get clones */
+			if (ndif == BRIDGE_FLOOD_BURST) {
+				bridge_flood_clones(br_ifp, in_ifp, m, difs,
+						    ndif);
+				ndif = 0;
 			}
+			difs[ndif++] = dif;
 		}
-
-		lastif = dif;
 	}
 
-	/* original goes to the last port */
-	if (likely(lastif != NULL)) {
-		if (lastif->if_type == IFT_TUNNEL_GRE) {
-			bridge_flood_on_gre_tunnel(lastif, m);
-			/* bridge flood over tunnel always sends a copy */
-			rte_pktmbuf_free(m);
-		} else
-			bridge_tx_frame(br_ifp, in_ifp, lastif, m);
-	} else {
+	if (unlikely(ndif == 0))
 		goto drop;
-	}
+
+	/* original goes to the last port */
+	lastif = difs[--ndif];
+	bridge_flood_clones(br_ifp, in_ifp, m, difs, ndif);
+
+	if (lastif->if_type == IFT_TUNNEL_GRE) {
+		bridge_flood_on_gre_tunnel(lastif, m);
+		/* bridge flood over tunnel always sends a copy */
+		rte_pktmbuf_free(m);
+	} else
+		bridge_tx_frame(br_ifp, in_ifp, lastif, m);
 
 	return;
 
@@ -1142,18 +1434,26 @@ drop:
 
 /*
  * Destination is unknown unicast, flood to all ports in bridge.
+ * Multicast to a snooped group only goes to that group's ports.
  *
  * Last match gets the original, and other entries get a copy.
  */
 static void bridge_flood(struct bridge_softc *sc, struct ifnet *in_ifp,
 			 struct rte_mbuf *m, struct ifnet *brif, bool is_pvst)
 {
+	const struct ether_hdr *eh = rte_pktmbuf_mtod(m, struct ether_hdr *);
+	const struct bridge_mdb_ports *mports = NULL;
+
 	if_incr_out(brif, m);
 
 	if (unlikely(brif->capturing))
 		capture_burst(brif, &m, 1);
 
-	bridge_flood_local(sc, in_ifp, m, brif, is_pvst);
+	if (is_multicast_ether_addr(&eh->d_addr) &&
+	    !is_broadcast_ether_addr(&eh->d_addr))
+		mports = bridge_mdb_lookup(sc, m, bridge_frame_get_vlan(m));
+
+	bridge_flood_local(sc, in_ifp, m, brif, is_pvst, mports);
 }
 
 /* Send a packet out of a bridge interface.
@@ -1200,7 +1500,7 @@ void bridge_output(struct ifnet *ifp, struct rte_mbuf *m,
 	 * At this point, we're dealing with a unicast frame
 	 * going to a different interface.
 	 */
-	if (bridge_port_get_state_vlan(port, vlan) != STP_IFSTATE_FORWARDING)
+	if (!bridge_port_is_vlan_forwarding(port, vlan))
 		goto drop;
 
 	/*
@@ -1304,6 +1604,18 @@ bridge_input_local(struct rte_mbuf *m, struct ifnet *input_if,
  * L2 ports.  If L3 bridge interface is interested in the frame, either handle
  * it here or send on slowpath to kernel.
  */
+/*
+ * Storm control policed in software, for platforms that can't police
+ * broadcast, multicast and unknown unicast in hardware.
+ */
+static inline bool
+bridge_storm_ctl_drop(struct ifnet *ifp, uint16_t vlan, struct rte_mbuf *m,
+		      enum fal_traffic_type tr_type)
+{
+	return unlikely(ifp->sc_info != NULL) &&
+		storm_ctl_police(ifp, vlan, tr_type, rte_pktmbuf_pkt_len(m));
+}
+
 void bridge_input(struct bridge_port *port, struct rte_mbuf *m)
 {
 	struct ifnet *ifp = bridge_port_get_interface(port);
@@ -1341,10 +1653,10 @@ void bridge_input(struct bridge_port *port, struct rte_mbuf *m)
 	if (!(brif->if_flags & IFF_UP))
 		goto drop;
 
-	uint8_t state = bridge_port_get_state_vlan(port, vlan);
+	enum bridge_port_vlan_fwd fwd = bridge_port_get_vlan_fwd(port, vlan);
 
 	/* Port must be up */
-	if (state == STP_IFSTATE_DISABLED)
+	if (fwd == BRIDGE_PORT_VLAN_DISABLED)
 		goto drop;
 
 	/*
@@ -1371,11 +1683,10 @@ void bridge_input(struct bridge_port *port, struct rte_mbuf *m)
 		goto drop;
 
 	/* Learn the source address */
-	if (state == STP_IFSTATE_LEARNING ||
-	    state == STP_IFSTATE_FORWARDING)
+	if (fwd >= BRIDGE_PORT_VLAN_LEARNING)
 		bridge_rtupdate(ifp, &eh->s_addr, bridge_frame_get_vlan(m));
 
-	if (state != STP_IFSTATE_FORWARDING)
+	if (fwd != BRIDGE_PORT_VLAN_FORWARDING)
 		goto drop;
 
 	/* Apply firewall here to match local and forwarded frames */
@@ -1405,8 +1716,15 @@ void bridge_input(struct bridge_port *port, struct rte_mbuf *m)
 
 	/* Check for multicast and broadcast pkts *after* firewall. */
 	if (unlikely(is_multicast_ether_addr(&eh->d_addr))) {
-		struct rte_mbuf *m_local = pktmbuf_copy(m, m->pool);
+		struct rte_mbuf *m_local;
 
+		if (bridge_storm_ctl_drop(ifp, vlan, m,
+					  is_broadcast_ether_addr(&eh->d_addr) ?
+					  FAL_TRAFFIC_BCAST :
+					  FAL_TRAFFIC_MCAST))
+			goto drop;
+
+		m_local = pktmbuf_copy(m, m->pool);
 		if (!m_local)
 			goto errorpath;
 		mcast = true;
@@ -1421,8 +1739,12 @@ void bridge_input(struct bridge_port *port, struct rte_mbuf *m)
 	}
 
 	/* If mcast or no entry in local forwarding table, then flood. */
-	if (mcast || !bridge_forward(sc, ifp, m, brif))
+	if (mcast || !bridge_forward(sc, ifp, m, brif)) {
+		if (!mcast &&
+		    bridge_storm_ctl_drop(ifp, vlan, m, FAL_TRAFFIC_UCAST))
+			goto drop;
 		bridge_flood(sc, ifp, m, brif, is_pvst);
+	}
 
 	return;
 
@@ -1470,7 +1792,7 @@ static void bridge_timer(struct rte_timer *timer __rte_unused,
 	rcu_read_lock();
 	cds_lfht_for_each_entry(sc->scbr_rthash, &iter, brt, brt_node) {
 		if (bridge_rtexpired(brt, sc->scbr_ageing_ticks))
-			bridge_rtnode_destroy(sc->scbr_rthash, brt);
+			bridge_rtnode_destroy(sc, brt);
 	}
 	rcu_read_unlock();
 }
@@ -1616,7 +1938,7 @@ static void bridge_newneigh(int ifindex, const struct ether_addr *dst,
 		return;
 	}
 
-	brt = zmalloc_aligned(sizeof(*brt));
+	brt = dp_mem_zmalloc(DP_MEM_BRIDGE, sizeof(*brt));
 	if (!brt) {
 		DP_DEBUG(BRIDGE, ERR, BRIDGE,
 			"out of memory for forwarding entry\n");
@@ -1633,7 +1955,7 @@ static void bridge_newneigh(int ifindex, const struct ether_addr *dst,
 	err = bridge_rtnode_insert(sc, brt);
 	if (err) {
 		/* already created (race) */
-		free(brt);
+		dp_mem_free(DP_MEM_BRIDGE, brt, sizeof(*brt));
 	}
 	fal_br_new_neigh(ifindex, vlan, dst, 1, attr_list);
 }
@@ -1667,7 +1989,7 @@ static void bridge_delneigh(int ifindex,
 	brt = bridge_rtnode_lookup(sc, dst, vid);
 	if (brt) {
 		fal_br_del_neigh(ifindex, vid, dst);
-		bridge_rtnode_destroy(sc->scbr_rthash, brt);
+		bridge_rtnode_destroy(sc, brt);
 	} else {
 		DP_DEBUG(BRIDGE, NOTICE, BRIDGE,
 			"delneigh for %s but on %s not a in forwarding table\n",
@@ -2340,7 +2662,7 @@ bridge_macs_clear(FILE *f, int argc, char **argv, struct ifnet *bridge)
 		struct bridge_rtnode *brt =
 			bridge_rtnode_lookup(sc, macp, 0);
 		if (brt)
-			bridge_rtnode_destroy(sc->scbr_rthash, brt);
+			bridge_rtnode_destroy(sc, brt);
 
 		fal_fdb_flush_mac(bridge->if_index,
 				  (port == NULL) ? 0 : port->if_index,
@@ -2520,6 +2842,7 @@ static const struct netlink_handler bridge_netlink  = {
 /* Startup initialization */
 static void bridge_init(void)
 {
+	rte_timer_init(&bridge_learn_timer);
 	register_netlink_handler(AF_BRIDGE, &bridge_netlink);
 	int ret = if_register_type(IFT_BRIDGE, &bridge_if_ops);
 	if (ret < 0)
@@ -81,11 +81,15 @@ struct bridge_rtnode {
 	uint32_t		brt_dip;
 };
 
+struct bridge_mactbl;
+struct bridge_mdb;
 struct mstp_bridge;
 
 struct bridge_softc {
 	struct rte_timer	scbr_timer;
 	struct cds_lfht         *scbr_rthash;	/* hash table linkage */
+	struct bridge_mactbl	*scbr_mactbl;	/* lookup index of rthash */
+	struct bridge_mdb	*scbr_mdb;	/* snooped multicast groups */
 	struct cds_list_head	scbr_porthead;	/* tailq of ports */
 	struct rcu_head		scbr_rcu;
 	/* ageing time divided by seconds per tick.  0 == don't age */
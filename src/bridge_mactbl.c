@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Bridge MAC table - bucketized cuckoo hash of forwarding entries
+ *
+ * Writers (the master thread only) never leave a key missing from
+ * both of its buckets while moving it, but a reader can still walk
+ * past a key that is in flight between its two buckets.  Moves are
+ * therefore bracketed by a sequence count, and a reader that misses
+ * while it changed looks again.
+ */
+
+#include <rte_branch_prediction.h>
+#include <rte_ether.h>
+#include <rte_memory.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <urcu/system.h>
+
+#include "bridge.h"
+#include "bridge_mactbl.h"
+#include "ether.h"
+#include "urcu.h"
+#include "util.h"
+
+#define MACTBL_BUCKET_ENTRIES	8	/* keys in a cache line */
+#define MACTBL_MIN_BUCKETS	64
+#define MACTBL_MAX_BUCKETS	8192	/* 64k entries */
+#define MACTBL_MAX_PATH		16	/* entries moved to make room */
+
+/* Keys are the MAC and VLAN packed into 64 bits, 0 marks a free slot */
+#define MACTBL_KEY_VALID	0x8000
+#define MACTBL_ALT_SEED		0x5bd1e9955bd1e995UL
+
+struct mactbl_bucket {
+	uint64_t		key[MACTBL_BUCKET_ENTRIES];
+	struct bridge_rtnode	*node[MACTBL_BUCKET_ENTRIES];
+} __rte_cache_aligned;
+
+struct bridge_mactbl {
+	uint32_t		seq;		/* odd while entries move */
+	uint32_t		mask;		/* number of buckets - 1 */
+	uint32_t		count;
+	uint32_t		overflow;	/* entries that did not fit */
+	struct mactbl_bucket	*buckets;
+	struct rcu_head		rcu;
+};
+
+struct mactbl_slot {
+	uint32_t	bkt;
+	unsigned int	idx;
+};
+
+static inline uint64_t mactbl_key(const struct bridge_key *key)
+{
+	return shift16(*(const uint64_t *) &key->addr) |
+		key->vlan | MACTBL_KEY_VALID;
+}
+
+static inline void
+mactbl_buckets(const struct bridge_mactbl *tbl, uint64_t k,
+	       uint32_t *b1, uint32_t *b2)
+{
+	*b1 = hash64(k, 32) & tbl->mask;
+	*b2 = hash64(k ^ MACTBL_ALT_SEED, 32) & tbl->mask;
+	if (unlikely(*b2 == *b1))
+		*b2 = *b1 ^ 1;
+}
+
+static inline uint32_t
+mactbl_alt_bucket(const struct bridge_mactbl *tbl, uint64_t k, uint32_t b)
+{
+	uint32_t b1, b2;
+
+	mactbl_buckets(tbl, k, &b1, &b2);
+	return b == b1 ? b2 : b1;
+}
+
+static inline struct bridge_rtnode *
+mactbl_bucket_lookup(const struct mactbl_bucket *bkt, uint64_t k)
+{
+	struct bridge_rtnode *brt;
+	unsigned int i;
+
+	for (i = 0; i < MACTBL_BUCKET_ENTRIES; i++) {
+		if (CMM_LOAD_SHARED(bkt->key[i]) != k)
+			continue;
+
+		/* The slot may be reused once the key is read */
+		brt = CMM_LOAD_SHARED(bkt->node[i]);
+		cmm_smp_rmb();
+		if (likely(CMM_LOAD_SHARED(bkt->key[i]) == k))
+			return brt;
+	}
+	return NULL;
+}
+
+struct bridge_rtnode *
+bridge_mactbl_lookup(const struct bridge_mactbl *tbl,
+		     const struct bridge_key *key)
+{
+	uint64_t k = mactbl_key(key);
+	struct bridge_rtnode *brt;
+	uint32_t b1, b2, seq;
+
+	mactbl_buckets(tbl, k, &b1, &b2);
+	do {
+		seq = CMM_LOAD_SHARED(tbl->seq);
+		cmm_smp_rmb();
+
+		brt = mactbl_bucket_lookup(&tbl->buckets[b1], k);
+		if (!brt)
+			brt = mactbl_bucket_lookup(&tbl->buckets[b2], k);
+		if (brt)
+			return brt;
+
+		cmm_smp_rmb();
+	} while (unlikely((seq & 1) || seq != CMM_LOAD_SHARED(tbl->seq)));
+
+	return NULL;
+}
+
+bool bridge_mactbl_complete(const struct bridge_mactbl *tbl)
+{
+	return CMM_LOAD_SHARED(tbl->overflow) == 0;
+}
+
+static int mactbl_free_slot(const struct mactbl_bucket *bkt)
+{
+	unsigned int i;
+
+	for (i = 0; i < MACTBL_BUCKET_ENTRIES; i++)
+		if (bkt->key[i] == 0)
+			return i;
+	return -1;
+}
+
+/* Readers must never see a key with another key's entry */
+static void mactbl_slot_set(struct mactbl_bucket *bkt, unsigned int i,
+			    uint64_t k, struct bridge_rtnode *brt)
+{
+	if (bkt->key[i]) {
+		CMM_STORE_SHARED(bkt->key[i], 0);
+		cmm_smp_wmb();
+	}
+	CMM_STORE_SHARED(bkt->node[i], brt);
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(bkt->key[i], k);
+}
+
+static bool mactbl_on_path(const struct mactbl_slot *path, unsigned int len,
+			   uint32_t bkt, unsigned int idx)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++)
+		if (path[i].bkt == bkt && path[i].idx == idx)
+			return true;
+	return false;
+}
+
+/*
+ * Move the entries on the path each to their other bucket, starting
+ * from the one that has a free slot there, and put the new key in the
+ * slot that frees up at the start of the path.
+ */
+static void mactbl_shift(struct bridge_mactbl *tbl,
+			 const struct mactbl_slot *path, int last,
+			 uint32_t free_bkt, unsigned int free_idx,
+			 uint64_t k, struct bridge_rtnode *brt)
+{
+	struct mactbl_bucket *dst = &tbl->buckets[free_bkt];
+	unsigned int didx = free_idx;
+	int d;
+
+	CMM_STORE_SHARED(tbl->seq, tbl->seq + 1);
+	cmm_smp_wmb();
+
+	for (d = last; d >= 0; d--) {
+		struct mactbl_bucket *src = &tbl->buckets[path[d].bkt];
+		unsigned int sidx = path[d].idx;
+
+		mactbl_slot_set(dst, didx, src->key[sidx], src->node[sidx]);
+		dst = src;
+		didx = sidx;
+	}
+	mactbl_slot_set(dst, didx, k, brt);
+
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(tbl->seq, tbl->seq + 1);
+}
+
+static bool mactbl_insert(struct bridge_mactbl *tbl, uint64_t k,
+			  struct bridge_rtnode *brt)
+{
+	struct mactbl_slot path[MACTBL_MAX_PATH];
+	uint32_t b1, b2, bkt, alt;
+	unsigned int depth, n;
+	int i;
+
+	mactbl_buckets(tbl, k, &b1, &b2);
+
+	i = mactbl_free_slot(&tbl->buckets[b1]);
+	if (i >= 0) {
+		mactbl_slot_set(&tbl->buckets[b1], i, k, brt);
+		goto added;
+	}
+	i = mactbl_free_slot(&tbl->buckets[b2]);
+	if (i >= 0) {
+		mactbl_slot_set(&tbl->buckets[b2], i, k, brt);
+		goto added;
+	}
+
+	/* Look for a chain of entries ending in one with room to move */
+	bkt = b1;
+	for (depth = 0; depth < MACTBL_MAX_PATH; depth++) {
+		unsigned int idx = (tbl->count + depth) % MACTBL_BUCKET_ENTRIES;
+
+		for (n = 0; n < MACTBL_BUCKET_ENTRIES; n++) {
+			if (!mactbl_on_path(path, depth, bkt, idx))
+				break;
+			idx = (idx + 1) % MACTBL_BUCKET_ENTRIES;
+		}
+		if (n == MACTBL_BUCKET_ENTRIES)
+			return false;
+
+		path[depth].bkt = bkt;
+		path[depth].idx = idx;
+
+		alt = mactbl_alt_bucket(tbl, tbl->buckets[bkt].key[idx], bkt);
+		i = mactbl_free_slot(&tbl->buckets[alt]);
+		if (i >= 0) {
+			mactbl_shift(tbl, path, depth, alt, i, k, brt);
+			goto added;
+		}
+		bkt = alt;
+	}
+	return false;
+
+added:
+	tbl->count++;
+	return true;
+}
+
+static struct bridge_mactbl *mactbl_alloc(uint32_t nbuckets)
+{
+	struct bridge_mactbl *tbl;
+
+	tbl = zmalloc_aligned(sizeof(*tbl));
+	if (!tbl)
+		return NULL;
+
+	tbl->buckets = zmalloc_aligned(nbuckets * sizeof(*tbl->buckets));
+	if (!tbl->buckets) {
+		free(tbl);
+		return NULL;
+	}
+	tbl->mask = nbuckets - 1;
+	return tbl;
+}
+
+static void mactbl_free(struct bridge_mactbl *tbl)
+{
+	free(tbl->buckets);
+	free(tbl);
+}
+
+static void mactbl_free_rcu(struct rcu_head *head)
+{
+	mactbl_free(caa_container_of(head, struct bridge_mactbl, rcu));
+}
+
+struct bridge_mactbl *bridge_mactbl_create(void)
+{
+	return mactbl_alloc(MACTBL_MIN_BUCKETS);
+}
+
+void bridge_mactbl_destroy(struct bridge_mactbl *tbl)
+{
+	call_rcu(&tbl->rcu, mactbl_free_rcu);
+}
+
+/* Build a larger copy of the table, not yet visible to readers */
+static struct bridge_mactbl *
+mactbl_grow(const struct bridge_mactbl *old, uint64_t k,
+	    struct bridge_rtnode *brt)
+{
+	uint32_t nbuckets = old->mask + 1;
+	struct bridge_mactbl *tbl;
+	uint32_t b;
+	unsigned int i;
+
+	while ((nbuckets *= 2) <= MACTBL_MAX_BUCKETS) {
+		tbl = mactbl_alloc(nbuckets);
+		if (!tbl)
+			return NULL;
+
+		for (b = 0; b <= old->mask; b++) {
+			const struct mactbl_bucket *bkt = &old->buckets[b];
+
+			for (i = 0; i < MACTBL_BUCKET_ENTRIES; i++)
+				if (bkt->key[i] &&
+				    !mactbl_insert(tbl, bkt->key[i],
+						   bkt->node[i]))
+					goto retry;
+		}
+		if (mactbl_insert(tbl, k, brt)) {
+			tbl->overflow = old->overflow;
+			return tbl;
+		}
+retry:
+		mactbl_free(tbl);
+	}
+	return NULL;
+}
+
+void bridge_mactbl_add(struct bridge_mactbl **tblp, struct bridge_rtnode *brt)
+{
+	struct bridge_mactbl *tbl = *tblp;
+	uint64_t k = mactbl_key(&brt->brt_key);
+	struct bridge_mactbl *ntbl;
+
+	if (likely(mactbl_insert(tbl, k, brt)))
+		return;
+
+	ntbl = mactbl_grow(tbl, k, brt);
+	if (!ntbl) {
+		/* Left to be found in the lfht */
+		CMM_STORE_SHARED(tbl->overflow, tbl->overflow + 1);
+		return;
+	}
+
+	rcu_assign_pointer(*tblp, ntbl);
+	bridge_mactbl_destroy(tbl);
+}
+
+void bridge_mactbl_del(struct bridge_mactbl *tbl,
+		       const struct bridge_rtnode *brt)
+{
+	uint64_t k = mactbl_key(&brt->brt_key);
+	uint32_t bkts[2];
+	unsigned int b, i;
+
+	mactbl_buckets(tbl, k, &bkts[0], &bkts[1]);
+	for (b = 0; b < 2; b++) {
+		struct mactbl_bucket *bkt = &tbl->buckets[bkts[b]];
+
+		for (i = 0; i < MACTBL_BUCKET_ENTRIES; i++) {
+			if (bkt->key[i] == k && bkt->node[i] == brt) {
+				CMM_STORE_SHARED(bkt->key[i], 0);
+				tbl->count--;
+				return;
+			}
+		}
+	}
+
+	if (tbl->overflow)
+		CMM_STORE_SHARED(tbl->overflow, tbl->overflow - 1);
+}
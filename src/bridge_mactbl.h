@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef BRIDGE_MACTBL_H
+#define BRIDGE_MACTBL_H
+
+#include <stdbool.h>
+
+struct bridge_key;
+struct bridge_mactbl;
+struct bridge_rtnode;
+
+/*
+ * Bridge MAC table.
+ *
+ * A compact bucketized cuckoo index over the bridge forwarding
+ * entries, used for the per-frame lookups. Each bucket holds 8 keys
+ * in one cache line and their entries in the next, and a key lives
+ * in one of two buckets, so a lookup touches at most 4 cache lines.
+ *
+ * The cds_lfht in the bridge softc remains the owner of the entries
+ * and is what is walked for ageing, flushing and show. Lookups are
+ * safe from any thread inside an RCU read-side section; changes are
+ * only made by the master thread.
+ */
+
+struct bridge_mactbl *bridge_mactbl_create(void);
+
+/* Free the table after a grace period. The entries are not freed. */
+void bridge_mactbl_destroy(struct bridge_mactbl *tbl);
+
+/*
+ * Find the entry for a key. Returns NULL if not found, in which case
+ * the caller must check bridge_mactbl_complete() before trusting it.
+ */
+struct bridge_rtnode *
+bridge_mactbl_lookup(const struct bridge_mactbl *tbl,
+		     const struct bridge_key *key);
+
+/*
+ * Does the table hold every entry? It does unless an add has failed
+ * because the table had reached its maximum size.
+ */
+bool bridge_mactbl_complete(const struct bridge_mactbl *tbl);
+
+/*
+ * Add an entry, growing the table if needed. If the table is
+ * replaced, the new one is published through tblp and the old one
+ * freed after a grace period.
+ */
+void bridge_mactbl_add(struct bridge_mactbl **tblp, struct bridge_rtnode *brt);
+
+/* Remove an entry added with bridge_mactbl_add() */
+void bridge_mactbl_del(struct bridge_mactbl *tbl,
+		       const struct bridge_rtnode *brt);
+
+#endif /* BRIDGE_MACTBL_H */
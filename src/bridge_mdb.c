@@ -0,0 +1,537 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Bridge multicast database - see bridge_mdb.h.
+ *
+ * Each entry keeps its member ports, which only the master thread
+ * looks at, and the set it forwards to, which is rebuilt from the
+ * members and the router ports and swapped in whenever either
+ * changes.  IPv4 groups are keyed as v4-mapped IPv6 addresses.
+ */
+
+#include <errno.h>
+#include <libmnl/libmnl.h>
+#include <linux/if_bridge.h>
+#include <linux/if_ether.h>
+#include <linux/rtnetlink.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <rte_debug.h>
+#include <rte_ether.h>
+#include <rte_jhash.h>
+#include <rte_log.h>
+#include <rte_mbuf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <urcu/rculfhash.h>
+
+#include "bridge.h"
+#include "bridge_mdb.h"
+#include "bridge_port.h"
+#include "if_var.h"
+#include "urcu.h"
+#include "util.h"
+#include "vplane_debug.h"
+#include "vplane_log.h"
+
+#define BRIDGE_MDB_HASH_MIN	64
+#define BRIDGE_MDB_HASH_MAX	8192
+
+struct bridge_mdb_key {
+	struct in6_addr	grp;
+	uint32_t	vlan;
+};
+
+struct bridge_mdb_entry {
+	struct cds_lfht_node	node;
+	struct bridge_mdb_key	key;
+	struct bridge_mdb_ports	*fwd;		/* members and routers */
+	struct bridge_mdb_ports	*members;	/* master only */
+	struct rcu_head		rcu;
+};
+
+struct bridge_mdb {
+	struct cds_lfht		*hash;
+	struct bridge_mdb_ports	*routers;	/* master only */
+};
+
+static inline unsigned long
+bridge_mdb_hash(const struct bridge_mdb_key *key)
+{
+	return rte_jhash_32b((const uint32_t *)key,
+			     sizeof(*key) / sizeof(uint32_t), 0);
+}
+
+static int
+bridge_mdb_match(struct cds_lfht_node *node, const void *key)
+{
+	const struct bridge_mdb_entry *e =
+		caa_container_of(node, const struct bridge_mdb_entry, node);
+
+	return memcmp(&e->key, key, sizeof(e->key)) == 0;
+}
+
+static bool
+bridge_mdb_pkt_key(struct rte_mbuf *m, uint16_t vlan,
+		   struct bridge_mdb_key *key)
+{
+	const struct ether_vlan_hdr *vh =
+		rte_pktmbuf_mtod(m, const struct ether_vlan_hdr *);
+	uint16_t type = vh->eh.ether_type;
+	uint16_t off = ETHER_HDR_LEN;
+
+	if (type == htons(ETHER_TYPE_VLAN)) {
+		type = vh->vh.eth_proto;
+		off += sizeof(struct vlan_hdr);
+	}
+
+	memset(key, 0, sizeof(*key));
+	key->vlan = vlan;
+
+	if (type == htons(ETHER_TYPE_IPv4)) {
+		const struct ip *ip;
+
+		if (rte_pktmbuf_data_len(m) < off + sizeof(*ip))
+			return false;
+		ip = rte_pktmbuf_mtod_offset(m, const struct ip *, off);
+		key->grp.s6_addr32[2] = htonl(0xffff);
+		key->grp.s6_addr32[3] = ip->ip_dst.s_addr;
+		return true;
+	}
+
+	if (type == htons(ETHER_TYPE_IPv6)) {
+		const struct ip6_hdr *ip6;
+
+		if (rte_pktmbuf_data_len(m) < off + sizeof(*ip6))
+			return false;
+		ip6 = rte_pktmbuf_mtod_offset(m, const struct ip6_hdr *, off);
+		key->grp = ip6->ip6_dst;
+		return true;
+	}
+
+	return false;
+}
+
+const struct bridge_mdb_ports *
+bridge_mdb_lookup(const struct bridge_softc *sc, struct rte_mbuf *m,
+		  uint16_t vlan)
+{
+	const struct bridge_mdb *mdb = rcu_dereference(sc->scbr_mdb);
+	const struct bridge_mdb_entry *e;
+	struct bridge_mdb_key key;
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+
+	if (!mdb)
+		return NULL;
+
+	/* The kernel only keys groups by vlan when filtering on it */
+	if (!bridge_mdb_pkt_key(m, sc->scbr_vlan_filter ? vlan : 0, &key))
+		return NULL;
+
+	cds_lfht_lookup(mdb->hash, bridge_mdb_hash(&key),
+			bridge_mdb_match, &key, &iter);
+	node = cds_lfht_iter_get_node(&iter);
+	if (!node)
+		return NULL;
+
+	e = caa_container_of(node, const struct bridge_mdb_entry, node);
+	return rcu_dereference(e->fwd);
+}
+
+static bool
+bridge_mdb_ports_has(const struct bridge_mdb_ports *ps,
+		     const struct ifnet *ifp)
+{
+	unsigned int i;
+
+	for (i = 0; ps && i < ps->count; i++)
+		if (ps->ifp[i] == ifp)
+			return true;
+	return false;
+}
+
+static struct bridge_mdb_ports *
+bridge_mdb_ports_alloc(unsigned int n)
+{
+	struct bridge_mdb_ports *ps;
+
+	ps = malloc(sizeof(*ps) + n * sizeof(ps->ifp[0]));
+	if (ps)
+		ps->count = 0;
+	return ps;
+}
+
+static void
+bridge_mdb_ports_append(struct bridge_mdb_ports *ps,
+			const struct bridge_mdb_ports *from,
+			const struct ifnet *del)
+{
+	unsigned int i;
+
+	for (i = 0; from && i < from->count; i++)
+		if (from->ifp[i] != del &&
+		    !bridge_mdb_ports_has(ps, from->ifp[i]))
+			ps->ifp[ps->count++] = from->ifp[i];
+}
+
+/* A copy of the set with add added and del removed */
+static struct bridge_mdb_ports *
+bridge_mdb_ports_edit(const struct bridge_mdb_ports *old,
+		      struct ifnet *add, const struct ifnet *del)
+{
+	struct bridge_mdb_ports *ps;
+
+	ps = bridge_mdb_ports_alloc((old ? old->count : 0) + 1);
+	if (!ps)
+		return NULL;
+
+	bridge_mdb_ports_append(ps, old, del);
+	if (add && !bridge_mdb_ports_has(ps, add))
+		ps->ifp[ps->count++] = add;
+	return ps;
+}
+
+static void
+bridge_mdb_ports_free_rcu(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct bridge_mdb_ports, rcu));
+}
+
+static void
+bridge_mdb_entry_free_rcu(struct rcu_head *head)
+{
+	struct bridge_mdb_entry *e =
+		caa_container_of(head, struct bridge_mdb_entry, rcu);
+
+	free(e->fwd);
+	free(e->members);
+	free(e);
+}
+
+/* Rebuild the forwarding set after the members or routers change */
+static void
+bridge_mdb_entry_refresh(struct bridge_mdb *mdb, struct bridge_mdb_entry *e)
+{
+	struct bridge_mdb_ports *fwd, *old;
+
+	fwd = bridge_mdb_ports_alloc(e->members->count +
+				     (mdb->routers ? mdb->routers->count : 0));
+	if (!fwd) {
+		RTE_LOG(ERR, DATAPLANE,
+			"bridge mdb: out of memory for port set\n");
+		return;
+	}
+	bridge_mdb_ports_append(fwd, e->members, NULL);
+	bridge_mdb_ports_append(fwd, mdb->routers, NULL);
+
+	old = rcu_xchg_pointer(&e->fwd, fwd);
+	if (old)
+		call_rcu(&old->rcu, bridge_mdb_ports_free_rcu);
+}
+
+static void
+bridge_mdb_entry_delete(struct bridge_mdb *mdb, struct bridge_mdb_entry *e)
+{
+	if (!cds_lfht_del(mdb->hash, &e->node))
+		call_rcu(&e->rcu, bridge_mdb_entry_free_rcu);
+}
+
+static struct bridge_mdb *
+bridge_mdb_get(struct ifnet *bridge, bool create)
+{
+	struct bridge_softc *sc = bridge->if_softc;
+	struct bridge_mdb *mdb = sc->scbr_mdb;
+
+	if (mdb || !create)
+		return mdb;
+
+	mdb = zmalloc_aligned(sizeof(*mdb));
+	if (!mdb)
+		return NULL;
+
+	mdb->hash = cds_lfht_new(BRIDGE_MDB_HASH_MIN,
+				 BRIDGE_MDB_HASH_MIN,
+				 BRIDGE_MDB_HASH_MAX,
+				 CDS_LFHT_AUTO_RESIZE,
+				 NULL);
+	if (!mdb->hash) {
+		free(mdb);
+		return NULL;
+	}
+
+	rcu_assign_pointer(sc->scbr_mdb, mdb);
+	return mdb;
+}
+
+static struct bridge_mdb_entry *
+bridge_mdb_entry_find(struct bridge_mdb *mdb, const struct bridge_mdb_key *key)
+{
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+
+	cds_lfht_lookup(mdb->hash, bridge_mdb_hash(key),
+			bridge_mdb_match, key, &iter);
+	node = cds_lfht_iter_get_node(&iter);
+
+	return node ? caa_container_of(node, struct bridge_mdb_entry, node)
+		: NULL;
+}
+
+static void
+bridge_mdb_member_add(struct bridge_mdb *mdb,
+		      const struct bridge_mdb_key *key, struct ifnet *port)
+{
+	struct bridge_mdb_entry *e = bridge_mdb_entry_find(mdb, key);
+	struct bridge_mdb_ports *members;
+	bool created = false;
+
+	if (e && bridge_mdb_ports_has(e->members, port))
+		return;
+
+	if (!e) {
+		e = zmalloc_aligned(sizeof(*e));
+		if (!e)
+			goto nomem;
+		e->key = *key;
+		created = true;
+	}
+
+	members = bridge_mdb_ports_edit(e->members, port, NULL);
+	if (!members) {
+		if (created)
+			free(e);
+		goto nomem;
+	}
+	free(e->members);
+	e->members = members;
+
+	bridge_mdb_entry_refresh(mdb, e);
+	if (created) {
+		if (!e->fwd) {
+			bridge_mdb_entry_free_rcu(&e->rcu);
+			return;
+		}
+		cds_lfht_add(mdb->hash, bridge_mdb_hash(key), &e->node);
+	}
+	return;
+
+nomem:
+	RTE_LOG(ERR, DATAPLANE, "bridge mdb: out of memory for %s\n",
+		port->if_name);
+}
+
+static void
+bridge_mdb_member_del(struct bridge_mdb *mdb, struct bridge_mdb_entry *e,
+		      const struct ifnet *port)
+{
+	struct bridge_mdb_ports *members;
+
+	if (!bridge_mdb_ports_has(e->members, port))
+		return;
+
+	if (e->members->count == 1) {
+		bridge_mdb_entry_delete(mdb, e);
+		return;
+	}
+
+	members = bridge_mdb_ports_edit(e->members, NULL, port);
+	if (!members) {
+		/* Keep sending to it rather than lose the other members */
+		RTE_LOG(ERR, DATAPLANE, "bridge mdb: out of memory for %s\n",
+			port->if_name);
+		return;
+	}
+	free(e->members);
+	e->members = members;
+	bridge_mdb_entry_refresh(mdb, e);
+}
+
+static void
+bridge_mdb_router_set(struct bridge_mdb *mdb, struct ifnet *port, bool add)
+{
+	struct bridge_mdb_ports *routers;
+	struct bridge_mdb_entry *e;
+	struct cds_lfht_iter iter;
+
+	if (add == bridge_mdb_ports_has(mdb->routers, port))
+		return;
+
+	routers = bridge_mdb_ports_edit(mdb->routers,
+					add ? port : NULL,
+					add ? NULL : port);
+	if (!routers) {
+		RTE_LOG(ERR, DATAPLANE,
+			"bridge mdb: out of memory for router %s\n",
+			port->if_name);
+		return;
+	}
+	free(mdb->routers);
+	mdb->routers = routers;
+
+	cds_lfht_for_each_entry(mdb->hash, &iter, e, node)
+		bridge_mdb_entry_refresh(mdb, e);
+}
+
+/* A port of this bridge, from a netlink ifindex */
+static struct ifnet *
+bridge_mdb_port(struct ifnet *bridge, uint32_t ifindex,
+		enum cont_src_en cont_src)
+{
+	struct ifnet *ifp = ifnet_byifindex(cont_src_ifindex(cont_src,
+							     ifindex));
+	struct bridge_port *brport;
+
+	if (!ifp)
+		return NULL;
+
+	brport = rcu_dereference(ifp->if_brport);
+	if (!brport || bridge_port_get_bridge(brport) != bridge)
+		return NULL;
+
+	return ifp;
+}
+
+static void
+bridge_mdb_nl_entry(struct ifnet *bridge, const struct nlattr *attr,
+		    bool add, enum cont_src_en cont_src)
+{
+	const struct br_mdb_entry *bme;
+	struct bridge_mdb_entry *e;
+	struct bridge_mdb_key key;
+	struct bridge_mdb *mdb;
+	struct ifnet *port;
+
+	if (mnl_attr_get_type(attr) != MDBA_MDB_ENTRY_INFO ||
+	    mnl_attr_get_payload_len(attr) < sizeof(*bme))
+		return;
+	bme = mnl_attr_get_payload(attr);
+
+	/* Groups joined by the bridge itself get the local copy */
+	port = bridge_mdb_port(bridge, bme->ifindex, cont_src);
+	if (!port)
+		return;
+
+	memset(&key, 0, sizeof(key));
+	key.vlan = bme->vid;
+	if (bme->addr.proto == htons(ETH_P_IP)) {
+		key.grp.s6_addr32[2] = htonl(0xffff);
+		key.grp.s6_addr32[3] = bme->addr.u.ip4;
+	} else if (bme->addr.proto == htons(ETH_P_IPV6)) {
+		memcpy(&key.grp, &bme->addr.u.ip6, sizeof(key.grp));
+	} else
+		return;
+
+	DP_DEBUG(BRIDGE, DEBUG, BRIDGE, "%s mdb %s vlan %u port %s\n",
+		 bridge->if_name, add ? "add" : "del", bme->vid,
+		 port->if_name);
+
+	mdb = bridge_mdb_get(bridge, add);
+	if (!mdb)
+		return;
+
+	if (add) {
+		bridge_mdb_member_add(mdb, &key, port);
+		return;
+	}
+
+	e = bridge_mdb_entry_find(mdb, &key);
+	if (e)
+		bridge_mdb_member_del(mdb, e, port);
+}
+
+static void
+bridge_mdb_nl_router(struct ifnet *bridge, const struct nlattr *attr,
+		     bool add, enum cont_src_en cont_src)
+{
+	struct bridge_mdb *mdb;
+	struct ifnet *port;
+
+	if (mnl_attr_get_type(attr) != MDBA_ROUTER_PORT ||
+	    mnl_attr_get_payload_len(attr) < sizeof(uint32_t))
+		return;
+
+	port = bridge_mdb_port(bridge, mnl_attr_get_u32(attr), cont_src);
+	if (!port)
+		return;
+
+	DP_DEBUG(BRIDGE, DEBUG, BRIDGE, "%s mdb %s router port %s\n",
+		 bridge->if_name, add ? "add" : "del", port->if_name);
+
+	mdb = bridge_mdb_get(bridge, add);
+	if (mdb)
+		bridge_mdb_router_set(mdb, port, add);
+}
+
+int
+bridge_mdb_change(const struct nlmsghdr *nlh, enum cont_src_en cont_src)
+{
+	const struct br_port_msg *bpm = mnl_nlmsg_get_payload(nlh);
+	bool add = nlh->nlmsg_type == RTM_NEWMDB;
+	const struct nlattr *attr, *nest, *info;
+	struct ifnet *bridge;
+
+	bridge = ifnet_byifindex(cont_src_ifindex(cont_src, bpm->ifindex));
+	if (!bridge || !is_bridge(bridge) || !bridge->if_softc)
+		return MNL_CB_OK;
+
+	mnl_attr_for_each(attr, nlh, sizeof(*bpm)) {
+		switch (mnl_attr_get_type(attr)) {
+		case MDBA_MDB:
+			mnl_attr_for_each_nested(nest, attr)
+				if (mnl_attr_get_type(nest) == MDBA_MDB_ENTRY)
+					mnl_attr_for_each_nested(info, nest)
+						bridge_mdb_nl_entry(
+							bridge, info, add,
+							cont_src);
+			break;
+		case MDBA_ROUTER:
+			mnl_attr_for_each_nested(nest, attr)
+				bridge_mdb_nl_router(bridge, nest, add,
+						     cont_src);
+			break;
+		}
+	}
+
+	return MNL_CB_OK;
+}
+
+void
+bridge_mdb_port_remove(struct ifnet *bridge, struct ifnet *port)
+{
+	struct bridge_mdb *mdb = bridge_mdb_get(bridge, false);
+	struct bridge_mdb_entry *e;
+	struct cds_lfht_iter iter;
+
+	if (!mdb)
+		return;
+
+	bridge_mdb_router_set(mdb, port, false);
+	cds_lfht_for_each_entry(mdb->hash, &iter, e, node)
+		bridge_mdb_member_del(mdb, e, port);
+}
+
+void
+bridge_mdb_destroy(struct bridge_softc *sc)
+{
+	struct bridge_mdb *mdb = sc->scbr_mdb;
+	struct bridge_mdb_entry *e;
+	struct cds_lfht_iter iter;
+
+	if (!mdb)
+		return;
+
+	rcu_assign_pointer(sc->scbr_mdb, NULL);
+	cds_lfht_for_each_entry(mdb->hash, &iter, e, node)
+		bridge_mdb_entry_delete(mdb, e);
+
+	cds_lfht_destroy(mdb->hash, NULL);
+	free(mdb->routers);
+	free(mdb);
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef BRIDGE_MDB_H
+#define BRIDGE_MDB_H
+
+#include <linux/netlink.h>
+#include <stdint.h>
+
+#include "control.h"
+#include "urcu.h"
+
+struct bridge_softc;
+struct ifnet;
+struct rte_mbuf;
+
+/*
+ * Bridge multicast database.
+ *
+ * The kernel bridge snoops IGMP and MLD, and its multicast database
+ * (RTM_NEWMDB and RTM_DELMDB) is mirrored here as a hash of (group,
+ * vlan) entries.  Each entry holds the set of ports a frame for that
+ * group is replicated to: the ports with members plus the multicast
+ * router ports.  Frames for groups with no entry are flooded as
+ * before.
+ *
+ * Lookups are safe from any thread inside an RCU read-side section;
+ * changes are only made by the master thread.
+ */
+
+struct bridge_mdb;
+
+struct bridge_mdb_ports {
+	unsigned int	count;
+	struct rcu_head	rcu;
+	struct ifnet	*ifp[];
+};
+
+/*
+ * The ports to send an IP multicast frame on, or NULL if it should be
+ * flooded.
+ */
+const struct bridge_mdb_ports *
+bridge_mdb_lookup(const struct bridge_softc *sc, struct rte_mbuf *m,
+		  uint16_t vlan);
+
+/* Handle RTM_NEWMDB and RTM_DELMDB */
+int bridge_mdb_change(const struct nlmsghdr *nlh,
+		      enum cont_src_en cont_src);
+
+/* Forget a port that has left the bridge */
+void bridge_mdb_port_remove(struct ifnet *bridge, struct ifnet *port);
+
+/* Free the database of a bridge being deleted */
+void bridge_mdb_destroy(struct bridge_softc *sc);
+
+#endif /* BRIDGE_MDB_H */
@@ -71,6 +71,14 @@ struct bridge_port {
 	uint16_t                pvid;
 	uint8_t                 state[MSTP_MSTI_COUNT];
 
+	/*
+	 * The state above, as it applies to each vlan, packed into two
+	 * bits of enum bridge_port_vlan_fwd per vlan so that the forwarding
+	 * path needs neither the bridge's vlan to MSTI map nor this port's
+	 * MSTI states.  Rebuilt whenever either of those changes.
+	 */
+	uint64_t                vlan_fwd[VLAN_N_VID * 2 / 64];
+
 	/* Administrative */
 	struct rcu_head		    rcu;
 };
@@ -129,11 +137,56 @@ bridge_port_destroy(struct bridge_port *port)
 	call_rcu(&port->rcu, bridge_port_rcu_free);
 }
 
+static enum bridge_port_vlan_fwd
+bridge_port_state2fwd(uint8_t state)
+{
+	switch (state) {
+	case STP_IFSTATE_DISABLED:
+		return BRIDGE_PORT_VLAN_DISABLED;
+	case STP_IFSTATE_LEARNING:
+		return BRIDGE_PORT_VLAN_LEARNING;
+	case STP_IFSTATE_FORWARDING:
+		return BRIDGE_PORT_VLAN_FORWARDING;
+	default:
+		return BRIDGE_PORT_VLAN_BLOCKED;
+	}
+}
+
+void
+bridge_port_update_vlan_fwd(struct bridge_port *port)
+{
+	unsigned int word, i;
+	uint16_t vlan = 0;
+
+	for (word = 0; word < ARRAY_SIZE(port->vlan_fwd); word++) {
+		uint64_t bits = 0;
+
+		for (i = 0; i < 64; i += 2, vlan++) {
+			int mstiindex = mstp_vlan2msti_index(port->bridge_ifp,
+							     vlan);
+			uint64_t fwd = bridge_port_state2fwd(
+				port->state[mstiindex]);
+
+			bits |= fwd << i;
+		}
+		CMM_STORE_SHARED(port->vlan_fwd[word], bits);
+	}
+}
+
+enum bridge_port_vlan_fwd
+bridge_port_get_vlan_fwd(struct bridge_port *port, uint16_t vlan)
+{
+	uint64_t bits = CMM_LOAD_SHARED(port->vlan_fwd[vlan / 32]);
+
+	return (bits >> ((vlan % 32) * 2)) & 3;
+}
+
 void
 bridge_port_set_state_msti(struct bridge_port *port, int mstiindex,
 			   uint8_t state)
 {
 	CMM_STORE_SHARED(port->state[mstiindex], state);
+	bridge_port_update_vlan_fwd(port);
 
 	const struct fal_attribute_t attr_list[2] = {
 		{FAL_STP_PORT_ATTR_INSTANCE,
@@ -158,6 +211,7 @@ void
 bridge_port_set_state(struct bridge_port *port, uint8_t state)
 {
 	CMM_STORE_SHARED(port->state[MSTP_MSTI_IST], state);
+	bridge_port_update_vlan_fwd(port);
 
 	const struct fal_attribute_t attr_list[2] = {
 		{FAL_STP_PORT_ATTR_INSTANCE,
@@ -54,6 +54,36 @@ void bridge_port_set_state_msti(struct bridge_port *port, int mstiindex,
  */
 uint8_t bridge_port_get_state_vlan(struct bridge_port *port, uint16_t vlan);
 
+/*
+ * What the STP state of a vlan on this bridge port allows, in order.
+ */
+enum bridge_port_vlan_fwd {
+	BRIDGE_PORT_VLAN_DISABLED,	/* drop everything */
+	BRIDGE_PORT_VLAN_BLOCKED,	/* listening or blocking */
+	BRIDGE_PORT_VLAN_LEARNING,
+	BRIDGE_PORT_VLAN_FORWARDING,
+};
+
+/*
+ * The same as bridge_port_get_state_vlan(), but a single lookup in a
+ * per-port vlan table, for the forwarding path.
+ */
+enum bridge_port_vlan_fwd
+bridge_port_get_vlan_fwd(struct bridge_port *port, uint16_t vlan);
+
+static inline bool
+bridge_port_is_vlan_forwarding(struct bridge_port *port, uint16_t vlan)
+{
+	return bridge_port_get_vlan_fwd(port, vlan) ==
+		BRIDGE_PORT_VLAN_FORWARDING;
+}
+
+/*
+ * Rebuild the per-vlan table after the bridge's vlan to MSTI map
+ * changes.  Port state changes rebuild it themselves.
+ */
+void bridge_port_update_vlan_fwd(struct bridge_port *port);
+
 /*
  * Change the bridge port's STP state
  */
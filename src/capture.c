@@ -31,6 +31,7 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <urcu/uatomic.h>
 #include <zmq.h>
 
 #include "capture.h"
@@ -55,35 +56,77 @@
 
 static struct rte_mempool *capture_pool;
 
-static rte_spinlock_t capture_time_lock;
-static struct timeval capture_tod;
-static uint64_t capture_base;
-static uint64_t capture_hz;
+/*
+ * Each capture thread keeps its own time base, so converting packet
+ * timestamps needs no locking.
+ */
+static void capture_time_resync(struct capture_clock *clk)
+{
+	clk->base = rte_get_timer_cycles();
+	clk->hz = rte_get_timer_hz();
+	gettimeofday(&clk->tod, NULL);
+}
 
-static void capture_time_resync(struct timeval *tod, uint64_t *base,
-				uint64_t *hz)
+static void capture_prefilter_free(struct capture_prefilter *pf)
 {
-	uint64_t new_capture_base = rte_get_timer_cycles();
-	uint64_t new_capture_hz = rte_get_timer_hz();
-	struct timeval new_capture_tod;
+	unsigned int i;
+
+	if (!pf)
+		return;
+
+	for (i = 0; i < pf->count; i++)
+		rte_free(pf->insns[i]);
+	rte_free(pf);
+}
 
-	gettimeofday(&new_capture_tod, NULL);
+/*
+ * Rebuild the filters run by the forwarding threads after a change
+ * to the captures or their filters.
+ */
+static void capture_prefilter_update(struct ifnet *ifp)
+{
+	struct capture_info *cap_info = ifp->cap_info;
+	struct capture_prefilter *pf = NULL, *old;
+	struct capture_filter *cap_filter;
+	uint8_t unfiltered = cap_info->capture_mask;
+	unsigned int count = 0;
+	size_t len;
 
-	/* protect against resync happening in another thread */
-	rte_spinlock_lock(&capture_time_lock);
+	TAILQ_FOREACH(cap_filter, &cap_info->filters, next) {
+		unfiltered &= ~cap_filter->mask;
+		count++;
+	}
 
-	capture_base = new_capture_base;
-	capture_hz = new_capture_hz;
-	capture_tod = new_capture_tod;
+	if (unfiltered || !count)
+		goto publish;
 
-	rte_spinlock_unlock(&capture_time_lock);
+	pf = rte_zmalloc_socket("prefilter",
+				sizeof(*pf) + count * sizeof(pf->insns[0]),
+				RTE_CACHE_LINE_SIZE, ifp->if_socket);
+	if (!pf)
+		goto publish;
 
-	if (tod)
-		*tod = new_capture_tod;
-	if (base)
-		*base = new_capture_base;
-	if (hz)
-		*hz = new_capture_hz;
+	TAILQ_FOREACH(cap_filter, &cap_info->filters, next) {
+		len = sizeof(struct bpf_insn) * cap_filter->filter.bf_len;
+		pf->insns[pf->count] = rte_malloc_socket("prefilter", len, 0,
+							 ifp->if_socket);
+		if (!pf->insns[pf->count]) {
+			capture_prefilter_free(pf);
+			pf = NULL;
+			goto publish;
+		}
+		memcpy(pf->insns[pf->count], cap_filter->filter.bf_insns, len);
+		pf->count++;
+	}
+	pf->capture_mask = cap_info->capture_mask;
+
+publish:
+	old = cap_info->cap_prefilter;
+	rcu_assign_pointer(cap_info->cap_prefilter, pf);
+	if (old) {
+		synchronize_rcu();
+		capture_prefilter_free(old);
+	}
 }
 
 /*
@@ -238,6 +281,9 @@ static int pcapin_handler(zsock_t *sock, struct ifnet *ifp)
 
 		if (!strcmp(type, "STOP")) {
 			int stop = capture_stop(ifp, slotmask);
+
+			if (!stop)
+				capture_prefilter_update(ifp);
 			pcapin_response(sock, type, msg, "OK");
 			return stop;
 		} else if (!strcmp(type, "FILTER")) {
@@ -269,6 +315,7 @@ static int pcapin_handler(zsock_t *sock, struct ifnet *ifp)
 				return -1;
 			}
 			zframe_destroy(&frame);
+			capture_prefilter_update(ifp);
 			pcapin_response(sock, type, msg, "OK");
 		} else {
 			pcapin_response(sock, type, msg,
@@ -286,32 +333,26 @@ static int64_t capture_usec_from_tod_base(uint64_t ts, uint64_t base,
 }
 
 /* Read timestamp from packet and convert it to system time of day format */
-static void capture_get_timestamp(struct rte_mbuf *m, struct timeval *tv)
+static void capture_get_timestamp(struct capture_clock *clk,
+				  struct rte_mbuf *m, struct timeval *tv)
 {
 	uint64_t ts = m->udata64;
 	int64_t us;
-	uint64_t base;
-	uint64_t hz;
 
 	m->udata64 = 0;
 
-	/* protect against resync happening in another thread */
-	rte_spinlock_lock(&capture_time_lock);
-
-	us = capture_usec_from_tod_base(ts, capture_base, capture_hz);
-	*tv = capture_tod;
-
-	rte_spinlock_unlock(&capture_time_lock);
+	us = capture_usec_from_tod_base(ts, clk->base, clk->hz);
 
 	/* Check if we should resync the time base */
 	if (us >= CAPTURE_TIME_RESYNC_USECS) {
-		capture_time_resync(tv, &base, &hz);
-		us = capture_usec_from_tod_base(ts, base, hz);
+		capture_time_resync(clk);
+		us = capture_usec_from_tod_base(ts, clk->base, clk->hz);
 	}
 
+	*tv = clk->tod;
 	tv->tv_sec += us / USEC_PER_SEC;
 	tv->tv_usec += us % USEC_PER_SEC;
-	if (tv->tv_usec > USEC_PER_SEC) {
+	if (tv->tv_usec >= USEC_PER_SEC) {
 		++tv->tv_sec;
 		tv->tv_usec -= USEC_PER_SEC;
 	} else if (tv->tv_usec < 0) {
@@ -331,8 +372,42 @@ static void capture_wakeup(struct capture_info *cap_info)
 			strerror(errno));
 }
 
+/*
+ * Copy a packet, or as much of it as can be captured. A truncated
+ * copy keeps the original length in hash.usr, else that is zero.
+ */
+static struct rte_mbuf *capture_copy_one(struct rte_mbuf *mi,
+					 unsigned int snaplen)
+{
+	struct rte_mbuf *m;
+	char *data;
+
+	if (rte_pktmbuf_pkt_len(mi) <= snaplen ||
+	    snaplen > rte_pktmbuf_data_room_size(capture_pool) -
+		      RTE_PKTMBUF_HEADROOM) {
+		m = pktmbuf_copy(mi, capture_pool);
+		if (m)
+			m->hash.usr = 0;
+		return m;
+	}
+
+	m = pktmbuf_alloc(capture_pool, pktmbuf_get_vrf(mi));
+	if (!m)
+		return NULL;
+
+	data = rte_pktmbuf_append(m, snaplen);
+	if (!data || !memcpy_from_mbuf(data, mi, 0, snaplen)) {
+		rte_pktmbuf_free(m);
+		return NULL;
+	}
+	pktmbuf_copy_meta(m, mi);
+	m->hash.usr = rte_pktmbuf_pkt_len(mi);
+	return m;
+}
+
 /* Make a copy of the packet mbufs */
-static int capture_mbuf_copy(struct rte_mbuf *mbi[], struct rte_mbuf *mbo[],
+static int capture_mbuf_copy(const struct capture_info *cap_info,
+			     struct rte_mbuf *mbi[], struct rte_mbuf *mbo[],
 			     unsigned int n)
 {
 	uint64_t ts = rte_get_timer_cycles();
@@ -340,7 +415,7 @@ static int capture_mbuf_copy(struct rte_mbuf *mbi[], struct rte_mbuf *mbo[],
 	unsigned int i, j;
 
 	for (i = 0; i < n; i++) {
-		m = pktmbuf_copy(mbi[i], capture_pool);
+		m = capture_copy_one(mbi[i], cap_info->snaplen);
 		if (!m)
 			goto nomem;
 
@@ -356,31 +431,71 @@ static int capture_mbuf_copy(struct rte_mbuf *mbi[], struct rte_mbuf *mbo[],
 	return -ENOBUFS;
 }
 
-/* Put clone of mbuf's into ring for capture thread */
+/*
+ * Put clone of mbuf's into ring for capture thread, and wake it
+ * only if it is waiting for packets.
+ */
 static int capture_enqueue(struct capture_info *cap_info,
 			   struct rte_mbuf *pkts[], unsigned int n)
 {
-	int ret;
-
-	ret = rte_ring_mp_enqueue_bulk(cap_info->cap_ring,
-				       (void **)pkts, n, NULL);
-	if (likely(ret > 0))
+	if (unlikely(rte_ring_mp_enqueue_bulk(cap_info->cap_ring,
+					      (void **)pkts, n, NULL) == 0))
+		return -ENOBUFS;
+
+	/* Pairs with the barrier in capture_wait() */
+	cmm_smp_mb();
+	if (CMM_LOAD_SHARED(cap_info->cap_waiting) &&
+	    uatomic_xchg(&cap_info->cap_waiting, 0))
 		capture_wakeup(cap_info);
 
-	return ret;
+	return 0;
+}
+
+/*
+ * Does any capture want the packet? Chained packets are always kept,
+ * as the filters only see the first segment here.
+ */
+static bool capture_prefilter_match(const struct capture_prefilter *pf,
+				    struct rte_mbuf *m)
+{
+	unsigned int i;
+
+	if (!rte_pktmbuf_is_contiguous(m))
+		return true;
+
+	for (i = 0; i < pf->count; i++)
+		if (bpf_filter(pf->insns[i], rte_pktmbuf_mtod(m, u_char *),
+			       rte_pktmbuf_pkt_len(m),
+			       rte_pktmbuf_data_len(m)))
+			return true;
+	return false;
 }
 
 /* Put mbuf(s) in capture ring. */
 void capture_burst(const struct ifnet *ifp,
 		   struct rte_mbuf *pkts[], unsigned int n)
 {
+	struct capture_info *cap_info = ifp->cap_info;
+	const struct capture_prefilter *pf;
+	struct rte_mbuf *want[n];
 	struct rte_mbuf *snap[n];
+	unsigned int i, k;
+
+	/* Leave out what no capture wants, unless a capture was just added */
+	pf = rcu_dereference(cap_info->cap_prefilter);
+	if (pf && pf->capture_mask == CMM_ACCESS_ONCE(cap_info->capture_mask)) {
+		for (i = 0, k = 0; i < n; i++)
+			if (capture_prefilter_match(pf, pkts[i]))
+				want[k++] = pkts[i];
+		pkts = want;
+		n = k;
+	}
 
 	/* may be called with no packets on transmit with bonding interfaces */
-	if (n == 0 || capture_mbuf_copy(pkts, snap, n) < 0)
+	if (n == 0 || capture_mbuf_copy(cap_info, pkts, snap, n) < 0)
 		return;
 
-	if (unlikely(capture_enqueue(ifp->cap_info, snap, n) < 0))
+	if (unlikely(capture_enqueue(cap_info, snap, n) < 0))
 		pktmbuf_free_bulk(snap, n);
 }
 
@@ -405,8 +520,7 @@ static int capture_write(struct rte_mbuf *m, struct ifnet *ifp)
 	zmsg_t *msg;
 	unsigned int space = cap_info->snaplen;
 
-	capture_get_timestamp(m, &pcap.ts);
-	pcap.len = rte_pktmbuf_pkt_len(m);
+	pcap.len = m->hash.usr ? m->hash.usr : rte_pktmbuf_pkt_len(m);
 	if (pcap.len < cap_info->snaplen)
 		pcap.caplen = pcap.len;
 	else
@@ -422,6 +536,8 @@ static int capture_write(struct rte_mbuf *m, struct ifnet *ifp)
 	if (!filtered_mask)
 		return 0;
 
+	capture_get_timestamp(&cap_info->cap_clock, m, &pcap.ts);
+
 	msg = zmsg_new();
 
 	if (!msg)
@@ -530,16 +646,35 @@ static void capture_cleanup(void *arg)
 		ifp->if_name);
 }
 
-/* Max numer of loops processing packets without checking for events */
+/* Max numer of bursts processed without checking for events */
 #define CAPTURE_MAX_LOOPS 100
+#define CAPTURE_DEQ_BURST 32
+
+/*
+ * Ask to be woken for new packets, unless some arrived meanwhile.
+ * Returns the time to wait for events.
+ */
+static int capture_wait(struct capture_info *cap_info)
+{
+	CMM_STORE_SHARED(cap_info->cap_waiting, 1);
+	/* Pairs with the barrier in capture_enqueue() */
+	cmm_smp_mb();
+	if (rte_ring_empty(cap_info->cap_ring))
+		return 10000 * ZMQ_POLL_MSEC;
+
+	CMM_STORE_SHARED(cap_info->cap_waiting, 0);
+	return 0;
+}
 
 /* Main capture loop */
 static void capture_loop(struct ifnet *ifp)
 {
 	struct capture_info *cap_info = ifp->cap_info;
-	struct rte_mbuf *m;
+	struct rte_mbuf *pkts[CAPTURE_DEQ_BURST];
 	struct timespec now;
+	unsigned int i, n;
 	uint loops;
+	int timeout;
 	zmq_pollitem_t items[] = {
 		{ .fd = cap_info->cap_wake,
 		  .events = ZMQ_POLLIN,
@@ -560,33 +695,35 @@ static void capture_loop(struct ifnet *ifp)
 		if (now.tv_sec - cap_info->last_beat.tv_sec > 20)
 			return;
 
-		loops = 0;
-		while (rte_ring_sc_dequeue(cap_info->cap_ring,
-					   (void **) &m) == 0) {
-			int ret;
-
-			ret = capture_write(m, ifp);
+		for (loops = 0; loops < CAPTURE_MAX_LOOPS; loops++) {
+			n = rte_ring_sc_dequeue_burst(cap_info->cap_ring,
+						      (void **)pkts,
+						      CAPTURE_DEQ_BURST,
+						      NULL);
+			if (n == 0)
+				break;
 
-			rte_pktmbuf_free(m);
+			for (i = 0; i < n; i++)
+				if (capture_write(pkts[i], ifp) < 0)
+					break;
 
-			if (ret < 0)
+			pktmbuf_free_bulk(pkts, n);
+			if (i < n)
 				return;
-
-			if (loops++ >= CAPTURE_MAX_LOOPS) {
-				capture_wakeup(cap_info);
-				break;
-			}
 		}
 
 		/*
-		 * Ring is empty or we looped MAX times, wait for new packets.
+		 * Ring is empty, wait for new packets. Otherwise we looped
+		 * MAX times, so just check for requests.
 		 * Timeout at 10s to make sure we check for heartbeats.
 		 */
-		if (zmq_poll(items, 2, 10000 * ZMQ_POLL_MSEC) < 0) {
+		timeout = loops < CAPTURE_MAX_LOOPS ? capture_wait(cap_info) : 0;
+		if (zmq_poll(items, 2, timeout) < 0) {
 			RTE_LOG(ERR, DATAPLANE, "capture poll failed: %s\n",
 				strerror(errno));
 			return;
 		}
+		CMM_STORE_SHARED(cap_info->cap_waiting, 0);
 
 		if (items[0].revents & ZMQ_POLLIN) {
 			uint64_t seqno;
@@ -648,6 +785,7 @@ static void *capture_thread(void *arg)
 
 	pthread_cleanup_pop(1);
 	ifp->cap_info = NULL;
+	capture_prefilter_free(cap_info->cap_prefilter);
 	rte_ring_free(cap_info->cap_ring);
 	rte_free(cap_info);
 	pthread_detach(pthread_self());
@@ -674,6 +812,7 @@ void capture_cancel(struct ifnet *ifp)
 		RTE_LOG(ERR, DATAPLANE,
 			"capture thread join, expected cancel\n");
 	ifp->cap_info = NULL;
+	capture_prefilter_free(cap_info->cap_prefilter);
 	rte_ring_free(cap_info->cap_ring);
 	rte_free(cap_info);
 }
@@ -695,6 +834,7 @@ static struct capture_info *capture_new(FILE *f, const char *addrstr,
 
 	cap_info->is_promisc = is_promisc;
 	cap_info->snaplen = snaplen;
+	capture_time_resync(&cap_info->cap_clock);
 
 	snprintf(rname, RTE_RING_NAMESIZE, "capture_%s", ifp->if_name);
 	cap_info->cap_ring = rte_ring_create(rname, CAPTURE_RING_SZ,
@@ -878,7 +1018,4 @@ void capture_init(uint16_t mbuf_sz)
 					rte_socket_id());
 	if (!capture_pool)
 		rte_panic("can not initialize capture pool\n");
-
-	rte_spinlock_init(&capture_time_lock);
-	capture_time_resync(NULL, NULL, NULL);
 }
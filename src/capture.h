@@ -16,6 +16,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <sys/queue.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
 
@@ -34,6 +35,23 @@ struct capture_filter {
 	uint8_t mask; /* bitmask of capture slots applying this filter */
 };
 
+/* Time base for converting timer cycles to time of day */
+struct capture_clock {
+	struct timeval tod;
+	uint64_t base;
+	uint64_t hz;
+};
+
+/*
+ * Filters as run by the forwarding threads, to skip copying packets
+ * that no capture wants. Only built when every capture has a filter.
+ */
+struct capture_prefilter {
+	uint8_t capture_mask; /* captures the filters were taken from */
+	unsigned int count;
+	struct bpf_insn *insns[]; /* one program per distinct filter */
+};
+
 struct capture_info {
 	int cap_wake;
 	struct rte_ring *cap_ring;
@@ -48,6 +66,9 @@ struct capture_info {
 	struct timespec last_beat;
 	bool is_promisc;
 	unsigned int snaplen;
+	int cap_waiting; /* capture thread is waiting to be woken */
+	struct capture_prefilter *cap_prefilter;
+	struct capture_clock cap_clock; /* only used by the capture thread */
 };
 
 /* This should be expanded to all vplane interface types */
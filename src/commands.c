@@ -52,6 +52,7 @@
 #include "control.h"
 #include "crypto/crypto.h"
 #include "dp_event.h"
+#include "dp_mem.h"
 #include "event.h"
 #include "gre.h"
 #include "if_var.h"
@@ -85,6 +86,7 @@
 #include "vrf_if.h"
 #include "vxlan.h"
 #include "fal.h"
+#include "fwd_latency.h"
 #include "npf/dpi/app_cmds.h"
 #include "storm_ctl.h"
 #include "switch.h"
@@ -878,6 +880,12 @@ static int cmd_ipsec_engine(FILE *f, int argc, char **argv)
 		return rc;
 	}
 
+	if (strcmp(argv[0], "spread") == 0 && argc > 1)
+		return crypto_engine_spread(f, argv[1]);
+
+	if (strcmp(argv[0], "inline") == 0 && argc > 1)
+		return crypto_engine_inline(f, argv[1]);
+
 	fprintf(f, "Invalid IPsec command\n");
 	return -1;
 }
@@ -911,6 +919,9 @@ static int cmd_ipsec(FILE *f, int argc, char **argv)
 	unsigned int run_cmds = 0;
 	vrfid_t vrfid = VRF_DEFAULT_ID;
 
+	if (argc == 3 && strcmp(argv[1], "spi-index") == 0)
+		return crypto_sadb_spi_index(f, argv[2]);
+
 	if (argc < 2 || strcmp(argv[1], "sad") == 0) {
 		run_cmds |= CMD_IPSEC_SA;
 		vrfid = cmd_ipsec_getvrf(f, argc, argv);
@@ -965,6 +976,8 @@ static int cmd_ipsec(FILE *f, int argc, char **argv)
 	if (run_cmds & CMD_IPSEC_COUNTERS)
 		crypto_show_summary(f);
 	if (run_cmds & CMD_IPSEC_CACHE) {
+		if (argc > 3 && strcmp(argv[2], "size") == 0)
+			return crypto_policy_cache_size(f, argv[3]);
 		if (argc > 2)
 			crypto_show_cache(f, argv[2]);
 		else
@@ -1089,6 +1102,7 @@ static int cmd_memory(FILE *f,
 	memzone_summary(wr);
 	rte_malloc_summary(wr);
 	malloc_summary(wr);
+	dp_mem_summary(wr);
 	jsonw_destroy(&wr);
 
 	return 0;
@@ -1129,6 +1143,22 @@ int cmd_affinity_cfg(FILE *f, int argc, char **argv)
 		return -1;
 	}
 
+	if (strcmp(argv[0], "rebalance") == 0) {
+		if (argc < 2) {
+			fprintf(f, "usage: affinity rebalance on|off\n");
+			return -1;
+		}
+		if (strcmp(argv[1], "on") == 0)
+			set_rxq_rebalance(true);
+		else if (strcmp(argv[1], "off") == 0)
+			set_rxq_rebalance(false);
+		else {
+			fprintf(f, "usage: affinity rebalance on|off\n");
+			return -1;
+		}
+		return 0;
+	}
+
 	if (get_unsigned(argv[0], &ifindex) < 0) {
 		fprintf(f, "usage: affinity IFINDEX ...\n");
 		return -1;
@@ -2096,6 +2126,7 @@ static const cmd_t cmd_table[] = {
 	{ 0,	"debug",	cmd_debug,	"Debug logging level" },
 	{ 0,	"ecmp",		cmd_ecmp,	"Show/set ecmp options" },
 	{ 0,	"fal",		cmd_fal,	"FAL debugging commands" },
+	{ 0,	"flow-export",	cmd_flow_export, "Sampled flow export" },
 	{ 0,	"gre",		cmd_gre,	"Show gre information" },
 	{ 0,	"help",		cmd_help,	"This help" },
 	{ 0,	"hotplug",	cmd_hotplug,	"Hotplug event" },
@@ -2106,6 +2137,7 @@ static const cmd_t cmd_table[] = {
 	{ 0,	"ipsec",	cmd_ipsec,	"Show IPsec information" },
 	{ 0,	"l2tpeth",	cmd_l2tp,	"Show l2tp sessions" },
 	{ 0,	"lag",		cmd_lag,	"Show Link Aggregation" },
+	{ 0,	"latency",	cmd_fwd_latency, "Forwarding latency histograms" },
 	{ 0,	"led",		cmd_led,	"Toggle interface LED" },
 	{ 0,	"local",	cmd_local,	"Show local IP addresses" },
 	{ 0,	"log",		cmd_log,	"Show log messages" },
@@ -36,6 +36,7 @@ int cmd_nd6(FILE *f, int argc, char **argv);
 int cmd_qos_cfg(FILE *f, int argc, char **argv);
 int cmd_qos_op(FILE *f, int argc, char **argv);
 int cmd_ecmp(FILE *f, int argc, char **argv);
+int cmd_flow_export(FILE *f, int argc, char **argv);
 int cmd_hotplug(FILE *f, int argc, char **argv);
 int cmd_pipeline(FILE *f, int argc, char **argv);
 int op_pipeline(FILE *f, int argc, char **argv);
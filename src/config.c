@@ -170,6 +170,8 @@ static int parse_entry(void *user, const char *section,
 			return copy_str(&cfg->publish_url, value);
 		else if (strcmp(name, "request") == 0)
 			return copy_str(&cfg->request_url, value);
+		else if (strcmp(name, "publish_shm") == 0)
+			return copy_str(&cfg->publish_shm, value);
 		else if (strcmp(name, "publish_uplink") == 0)
 			return copy_str(&cfg->publish_url_uplink, value);
 		else if (strcmp(name, "request_uplink") == 0)
@@ -200,6 +202,18 @@ static int parse_entry(void *user, const char *section,
 			return copy_str(&cfg->uuid, value);
 		else if (strcmp(name, "dataplane-id") == 0)
 			cfg->dp_index = atoi(value);
+		else if (strcmp(name, "session-shards") == 0)
+			cfg->session_shards = atoi(value);
+		else if (strcmp(name, "slowpath-ring-size") == 0)
+			cfg->slowpath_ring_size = atoi(value);
+		else if (strcmp(name, "mbuf-pool-reserve") == 0)
+			cfg->mbuf_pool_reserve = atoi(value);
+		else if (strcmp(name, "control-rx-queue") == 0)
+			cfg->control_rxq = atoi(value) != 0;
+		else if (strcmp(name, "tunnel-offload") == 0)
+			cfg->tunnel_offload = atoi(value) != 0;
+		else if (strcmp(name, "dpi-cpus") == 0)
+			return bitmask_parse(&cfg->dpi_cpus, value) == 0;
 		else if (strcmp(name, "uplink-mac") == 0)
 			return ether_aton_r(value, &cfg->uplink_addr) != NULL;
 	} else if (strcasecmp(section, "rib") == 0) {
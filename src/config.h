@@ -48,6 +48,7 @@ struct config_param {
 	char *console_url;	 /* console url */
 	char *console_url_bound; /* bound console url */
 	char *publish_url;	 /* publish socket url */
+	char *publish_shm;	 /* shm publish ring, same host only */
 	char *request_url;	 /* snapshot request socket */
 	char *ctrl_intf_name;    /* name of control channel interface */
 	char *console_url_uplink; /* bound console url, uplink only */
@@ -55,6 +56,12 @@ struct config_param {
 	char *publish_url_uplink; /* publish socket url, uplink only */
 	char *request_url_uplink; /* snapshot request socket, uplink only */
 	unsigned int port_update; /* port status update interval (secs) */
+	unsigned int session_shards; /* sentry table shards, 0/1 for none */
+	unsigned int slowpath_ring_size; /* local delivery queue per port */
+	unsigned int mbuf_pool_reserve; /* extra mbufs per NUMA pool */
+	bitmask_t dpi_cpus;	 /* CPUs for DPI threads, none inline */
+	bool control_rxq;	 /* steer control protocols to own rx queue */
+	bool tunnel_offload;	 /* NIC decap of vxlan terminating here */
 	const char *backplane;	 /* interface for vxlan */
 	char *uuid;		 /* UUID of the dataplane */
 	char *vplane_name;	 /* Name used to ID the connected vplane */
@@ -28,6 +28,7 @@
 #include "compiler.h"
 #include "config.h"
 #include "control.h"
+#include "ctrl_shm.h"
 #include "crypto/crypto_policy.h"
 #include "dpmsg.h"
 #include "event.h"
@@ -48,6 +49,7 @@
 #include "vplane_debug.h"
 #include "vplane_log.h"
 #include "vrf.h"
+#include "zmq_dp.h"
 #include "storm_ctl.h"
 #include "backplane.h"
 #include "ptp.h"
@@ -70,6 +72,8 @@ struct cont_src_info_s {
 	zsock_t *csocket; /* Zmq socket to controller */
 	zsock_t *subscriber; /* Receive messages from netlink publisher */
 	uint64_t sub_last_seqno; /* Sequence number of last message seen */
+	uint64_t config_gen; /* Controller config generation, 0 if unknown */
+	bool delta_requested; /* Snapshot in progress is a delta */
 	zsock_t *broker_ctrl_sock;
 	zsock_t *broker_data_sock;
 };
@@ -608,14 +612,59 @@ static void process_snapshot_end(void)
 	npf_cfg_commit_all();
 }
 
-/* Request current snapshot from controller. */
-int controller_snapshot(enum cont_src_en cont_src)
+/*
+ * Request current snapshot from controller.
+ *
+ * A delta carries the generation and seqno we have, and the controller
+ * replays only what followed it.  A controller that can't, because it
+ * restarted or no longer has that history, sends just the end marker
+ * with a different generation, and we fall back to a full snapshot.
+ */
+int controller_snapshot(enum cont_src_en cont_src, bool delta)
 {
+	struct cont_src_info_s *info = &cont_src_info[cont_src];
+	zmsg_t *msg;
+
+	info->delta_requested = delta && info->config_gen;
+	if (!info->delta_requested) {
+		DP_DEBUG(RESYNC, INFO, DATAPLANE,
+			 "master(%s) controller resync started\n",
+			 cont_src_name(cont_src));
+
+		return zstr_send(cont_socket_get(cont_src), "WHATSUP?");
+	}
+
 	DP_DEBUG(RESYNC, INFO, DATAPLANE,
-		 "master(%s) controller resync started\n",
-		 cont_src_name(cont_src));
+		 "master(%s) controller delta resync from [%"PRIu64"]\n",
+		 cont_src_name(cont_src), info->sub_last_seqno);
+
+	msg = zmsg_new();
+	if (!msg)
+		return -ENOMEM;
+
+	if (zmsg_addstr(msg, "WHATSUP?") < 0 ||
+	    zmsg_addmem(msg, &info->config_gen,
+			sizeof(info->config_gen)) < 0 ||
+	    zmsg_addmem(msg, &info->sub_last_seqno,
+			sizeof(info->sub_last_seqno)) < 0) {
+		zmsg_destroy(&msg);
+		return -ENOMEM;
+	}
+
+	return zmsg_send_and_destroy(&msg, cont_socket_get(cont_src));
+}
 
-	return zstr_send(cont_socket_get(cont_src), "WHATSUP?");
+/* Set by a controller that can answer a delta snapshot request */
+bool controller_has_config_gen(enum cont_src_en cont_src)
+{
+	return cont_src_info[cont_src].config_gen != 0;
+}
+
+/* Config was flushed, so only a full snapshot will do */
+void controller_forget_config_gen(enum cont_src_en cont_src)
+{
+	cont_src_info[cont_src].config_gen = 0;
+	cont_src_info[cont_src].delta_requested = false;
 }
 
 /* Process one message out of the snapshot.  Caller responsible for freeing
@@ -625,18 +674,38 @@ int process_snapshot_one(enum cont_src_en cont_src, dpmsg_t *dpmsg, int *eof)
 {
 	int rc = 0;
 	const char *done = "THATSALLFOLKS!";
+	struct cont_src_info_s *info = &cont_src_info[cont_src];
+	uint64_t gen = 0;
 
-	cont_src_info[cont_src].sub_last_seqno = get_seqno(dpmsg);
 	*eof = 0;
 	if (!memcmp(zmq_msg_data(&dpmsg->topic_msg), done,
 			MIN(strlen(done), zmq_msg_size(&dpmsg->topic_msg)))) {
+		/* Older controllers send no generation, so never a delta */
+		if (zmq_msg_size(&dpmsg->data_msg) == sizeof(gen))
+			memcpy(&gen, zmq_msg_data(&dpmsg->data_msg),
+			       sizeof(gen));
+
+		*eof = 1;
+		if (info->delta_requested && gen != info->config_gen) {
+			RTE_LOG(NOTICE, DATAPLANE,
+				"master(%s) delta resync refused, generation %"
+				PRIu64" now %"PRIu64"\n",
+				cont_src_name(cont_src), info->config_gen, gen);
+			controller_forget_config_gen(cont_src);
+			return -ESTALE;
+		}
+
+		info->sub_last_seqno = get_seqno(dpmsg);
+		info->config_gen = gen;
+		info->delta_requested = false;
 		DP_DEBUG(RESYNC, INFO, DATAPLANE,
 			 "master(%s) resync [%"PRIu64"] completed\n",
 			 cont_src_name(cont_src),
-			 cont_src_info[cont_src].sub_last_seqno);
+			 info->sub_last_seqno);
 		process_snapshot_end();
-		*eof = 1;
 	} else {
+		/* A delta that is cut short can resume from here */
+		info->sub_last_seqno = get_seqno(dpmsg);
 		DP_DEBUG(RESYNC, INFO, DATAPLANE,
 			 "master(%s) resync [%"PRIu64"] %.*s\n",
 			 cont_src_name(cont_src),
@@ -659,6 +728,37 @@ int process_snapshot_one(enum cont_src_en cont_src, dpmsg_t *dpmsg, int *eof)
 /* Call back from main poll loop.
  * Only returns error if socket is dead.
  */
+/* Hand a published message to its handler, unless a later one was seen */
+void controller_deliver(enum cont_src_en cont_src, dpmsg_t *dpmsg)
+{
+	struct cont_src_info_s *info = &cont_src_info[cont_src];
+
+	if (get_seqno(dpmsg) > info->sub_last_seqno) {
+		info->sub_last_seqno = get_seqno(dpmsg);
+
+		DP_DEBUG(SUBSCRIBER, DEBUG, DATAPLANE,
+			 "master(%s) sub [%"PRIu64"] %.*s\n",
+			 cont_src_name(cont_src),
+			 get_seqno(dpmsg),
+			 (int)zmq_msg_size(&dpmsg->topic_msg),
+			 (char *)zmq_msg_data(&dpmsg->topic_msg));
+
+		if (process_dpmsg(cont_src, dpmsg) < 0)
+			DP_DEBUG(SUBSCRIBER, NOTICE, DATAPLANE,
+				 "subscription message error handling : %.*s\n",
+				 (int)zmq_msg_size(&dpmsg->topic_msg),
+				 (char *)zmq_msg_data(&dpmsg->topic_msg));
+	} else {
+		DP_DEBUG(SUBSCRIBER, DEBUG, DATAPLANE,
+			 "master(%s) sub ignore [%"PRIu64" < %"PRIu64"] %.*s\n",
+			 cont_src_name(cont_src),
+			 get_seqno(dpmsg),
+			 info->sub_last_seqno,
+			 (int)zmq_msg_size(&dpmsg->topic_msg),
+			 (char *)zmq_msg_data(&dpmsg->topic_msg));
+	}
+}
+
 static int subscriber_recv(void *cont_src_info_arg)
 {
 	struct cont_src_info_s *cont_src_info = cont_src_info_arg;
@@ -673,31 +773,7 @@ static int subscriber_recv(void *cont_src_info_arg)
 		return -1;
 	}
 
-	if (get_seqno(&dpmsg) > cont_src_info->sub_last_seqno) {
-		cont_src_info->sub_last_seqno = get_seqno(&dpmsg);
-
-		DP_DEBUG(SUBSCRIBER, DEBUG, DATAPLANE,
-			 "master(%s) sub [%"PRIu64"] %.*s\n",
-			 cont_src_name(cont_src_info->cont_src),
-			 get_seqno(&dpmsg),
-			 (int)zmq_msg_size(&dpmsg.topic_msg),
-			 (char *)zmq_msg_data(&dpmsg.topic_msg));
-
-		if (process_dpmsg(cont_src_info->cont_src, &dpmsg) < 0)
-			DP_DEBUG(SUBSCRIBER, NOTICE, DATAPLANE,
-				 "subscription message error handling : %.*s\n",
-				 (int)zmq_msg_size(&dpmsg.topic_msg),
-				 (char *)zmq_msg_data(&dpmsg.topic_msg));
-	} else {
-		DP_DEBUG(SUBSCRIBER, DEBUG, DATAPLANE,
-			 "master(%s) sub ignore [%"PRIu64" < %"PRIu64"] %.*s\n",
-			 cont_src_name(cont_src_info->cont_src),
-			 get_seqno(&dpmsg),
-			 cont_src_info->sub_last_seqno,
-			 (int)zmq_msg_size(&dpmsg.topic_msg),
-			 (char *)zmq_msg_data(&dpmsg.topic_msg));
-	}
-
+	controller_deliver(cont_src_info->cont_src, &dpmsg);
 	dpmsg_destroy(&dpmsg);
 
 	return 0;
@@ -717,6 +793,9 @@ void controller_unsubscribe(enum cont_src_en cont_src)
 		unregister_event_socket(zsock_resolve(subscriber));
 		zsock_destroy(&cont_src_info[cont_src].subscriber);
 	}
+
+	if (cont_src == CONT_SRC_MAIN)
+		ctrl_shm_stop();
 }
 
 /* Subscribe to controller publish connection */
@@ -759,6 +838,10 @@ void controller_init(enum cont_src_en cont_src)
 		zsock_set_subscribe(subscriber, h->topic);
 
 	cont_src_info[cont_src].subscriber = subscriber;
+
+	/* Kept across reconnects, so the controller maps it just once */
+	if (cont_src == CONT_SRC_MAIN && config.publish_shm)
+		ctrl_shm_init(config.publish_shm);
 }
 
 /* Enable authentication on the specified socket */
@@ -869,6 +952,9 @@ void controller_init_event_handler(enum cont_src_en cont_src)
 
 	register_event_socket_src(zsock_resolve(subscriber), subscriber_recv,
 				  &cont_src_info[cont_src], cont_src);
+
+	if (cont_src == CONT_SRC_MAIN)
+		ctrl_shm_start();
 }
 
 struct cfg_if_list_entry *
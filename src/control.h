@@ -24,8 +24,12 @@ enum cont_src_en {
 void controller_init(enum cont_src_en cont_src);
 void controller_init_event_handler(enum cont_src_en cont_src);
 void controller_unsubscribe(enum cont_src_en cont_src);
+struct dpmsg;
+void controller_deliver(enum cont_src_en cont_src, struct dpmsg *dpmsg);
 const char *cont_src_name(enum cont_src_en cont_src);
-int controller_snapshot(enum cont_src_en cont_src);
+int controller_snapshot(enum cont_src_en cont_src, bool delta);
+bool controller_has_config_gen(enum cont_src_en cont_src);
+void controller_forget_config_gen(enum cont_src_en cont_src);
 void enable_authentication(zsock_t *socket);
 
 zsock_t *cont_socket_create(enum cont_src_en cont_src);
@@ -25,7 +25,7 @@
 #include <rte_per_lcore.h>
 #include <rte_prefetch.h>
 #include <rte_ring.h>
-#include <rte_timer.h>
+#include <rte_spinlock.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,6 +36,7 @@
 #include "compiler.h"
 #include "crypto.h"
 #include "crypto/crypto_policy_cache.h"
+#include "crypto/crypto_policy_cls.h"
 #include "crypto_internal.h"
 #include "crypto_main.h"
 #include "crypto_policy.h"
@@ -75,7 +76,6 @@ struct cds_list_head;
 
 static struct crypto_dp g_crypto_dp;
 struct crypto_dp *crypto_dp_sp = &g_crypto_dp;
-static struct rte_timer pr_cache_timer;
 
 /* between crypto and master thread */
 static zsock_t *crypto_master_pull;
@@ -138,7 +138,10 @@ static const char * const ipsec_counter_names[] = {
 	[PR_CACHE_HIT] = "hit PR cache",
 	[PR_CACHE_MISS] = "missed PR cache",
 	[DROPPED_NO_BIND] = "dropped feature attachment point missing",
-	[DROPPED_ON_FP_NO_PR] = "dropped on fp but no policy"
+	[DROPPED_ON_FP_NO_PR] = "dropped on fp but no policy",
+	[DROPPED_SPREAD_FULL] = "dropped spread reorder full",
+	[ESP_TAIL_SEG_ALLOC] = "ESP trailer needed a new segment",
+	[INLINE_CRYPTO] = "processed inline on forwarding thread"
 };
 
 unsigned long ipsec_counters[RTE_MAX_LCORE][IPSEC_CNT_MAX] __rte_cache_aligned;
@@ -180,12 +183,51 @@ struct crypto_pkt_ctx {
 	 */
 	uint8_t action;
 	uint8_t in_ifp_port;
-	uint16_t SPARE1;
+	uint8_t spread;
+	uint8_t spread_slot;
 	uint16_t direction;
 	uint8_t orig_family;
 	uint8_t family;
 	xfrm_address_t dst; /* Only used for outbound traffic */
 	vrfid_t vrfid;
+	/*
+	 * These fields are set by the crypto thread for packets
+	 * of a spread SA, see crypto_spread_dispatch().
+	 */
+	struct sadb_sa *sa;
+	uint32_t seq;
+	uint32_t ticket;
+	uint32_t bytes;
+};
+
+/*
+ * An outbound SA spread across several crypto threads.
+ *
+ * All the packets of an SA are queued by the forwarding threads to the
+ * PMD it was allocated, whose thread is the dispatcher.  The dispatcher
+ * reserves the ESP sequence number of each packet and gives it a ticket,
+ * then hands runs of packets to the other PMDs of the SA in turn.  Each
+ * PMD has a slot with its own session, as OpenSSL contexts can not be
+ * shared.  Once processed, packets are put in the reorder ring by
+ * ticket and whichever thread completes the oldest outstanding ticket
+ * sends all those that are then in order.
+ */
+#define CRYPTO_SPREAD_RUN		16
+#define CRYPTO_SPREAD_REORDER_SZ	8192	/* power of 2 */
+#define CRYPTO_SPREAD_REORDER_MASK	(CRYPTO_SPREAD_REORDER_SZ - 1)
+
+struct crypto_sa_spread {
+	unsigned int count;
+	int pmd_dev_id[CRYPTO_SA_SPREAD_MAX];
+	struct crypto_session *session[CRYPTO_SA_SPREAD_MAX];
+	/* Only written by the dispatcher */
+	uint32_t next_ticket;
+	unsigned int slot;
+	unsigned int run;
+	/* Shared by the threads of the SA */
+	rte_spinlock_t lock __rte_cache_aligned;
+	uint32_t drain_ticket;
+	struct crypto_pkt_ctx *reorder[CRYPTO_SPREAD_REORDER_SZ];
 };
 
 static int crypto_vrf_insert(struct crypto_vrf_ctx *vrf_ctx)
@@ -264,6 +306,14 @@ struct crypto_vrf_ctx *crypto_vrf_get(vrfid_t vrfid)
 	if (!vrf_ctx->output_policy_rule_sel_ht)
 		goto vrf_ctx_get_fail;
 
+	vrf_ctx->input_policy_cls = crypto_policy_cls_create();
+	if (!vrf_ctx->input_policy_cls)
+		goto vrf_ctx_get_fail;
+
+	vrf_ctx->output_policy_cls = crypto_policy_cls_create();
+	if (!vrf_ctx->output_policy_cls)
+		goto vrf_ctx_get_fail;
+
 	vrf_ctx->s2s_bind_hash_table =
 		cds_lfht_new(POLICY_RULE_HT_MIN_BUCKETS,
 			     POLICY_RULE_HT_MIN_BUCKETS,
@@ -291,6 +341,8 @@ vrf_ctx_get_fail:
 		cds_lfht_destroy(vrf_ctx->input_policy_rule_sel_ht, NULL);
 	if (vrf_ctx->output_policy_rule_sel_ht)
 		cds_lfht_destroy(vrf_ctx->output_policy_rule_sel_ht, NULL);
+	crypto_policy_cls_destroy(vrf_ctx->input_policy_cls);
+	crypto_policy_cls_destroy(vrf_ctx->output_policy_cls);
 	if (vrf_ctx->s2s_bind_hash_table)
 		cds_lfht_destroy(vrf_ctx->s2s_bind_hash_table, NULL);
 	free(vrf_ctx);
@@ -305,6 +357,8 @@ static inline void crypto_vrf_free(struct rcu_head *head)
 
 	dp_ht_destroy_deferred(vrf_ctx->input_policy_rule_sel_ht);
 	dp_ht_destroy_deferred(vrf_ctx->output_policy_rule_sel_ht);
+	crypto_policy_cls_destroy(vrf_ctx->input_policy_cls);
+	crypto_policy_cls_destroy(vrf_ctx->output_policy_cls);
 	dp_ht_destroy_deferred(vrf_ctx->sadb_hash_table);
 	dp_ht_destroy_deferred(vrf_ctx->spi_out_hash_table);
 	dp_ht_destroy_deferred(vrf_ctx->s2s_bind_hash_table);
@@ -338,38 +392,76 @@ crypto_vrf_check_remove(struct crypto_vrf_ctx *vrf_ctx)
 	}
 }
 
-static struct crypto_pkt_ctx *allocate_crypto_packet_ctx(void)
+/*
+ * Contexts are taken from and returned to the pool in bulk, through a
+ * small per thread stash, so a burst costs one mempool operation.
+ */
+#define CRYPTO_CTX_BULK 32
+#define CRYPTO_CTX_STASH (2 * CRYPTO_CTX_BULK)
+
+struct crypto_ctx_stash {
+	unsigned int count;
+	struct crypto_pkt_ctx *ctx[CRYPTO_CTX_STASH];
+};
+
+static RTE_DEFINE_PER_LCORE(struct crypto_ctx_stash, crypto_ctx_stash);
+
+static int crypto_ctx_pool_get(struct crypto_pkt_ctx **ctx, unsigned int n)
 {
-	struct crypto_pkt_ctx *ctx;
 	struct rte_mempool_cache *cache;
 
 	cache = rte_mempool_default_cache(crypto_dp_sp->pool, rte_lcore_id());
-
-	if (unlikely(rte_mempool_generic_get(crypto_dp_sp->pool, (void *)&ctx,
 #ifdef HAVE_RTE_MEMPOOL_GENERIC_FLAGS
-					     1, cache, 1) != 0)) {
+	return rte_mempool_generic_get(crypto_dp_sp->pool, (void **)ctx, n,
+				       cache, 1);
 #else
-					     1, cache) != 0)) {
+	return rte_mempool_generic_get(crypto_dp_sp->pool, (void **)ctx, n,
+				       cache);
 #endif
-		return NULL;
-	}
-	IPSEC_CNT_INC(CTX_ALLOCATED);
-	return ctx;
 }
 
-static void release_crypto_packet_ctx(struct crypto_pkt_ctx *ctx)
+static void crypto_ctx_pool_put(struct crypto_pkt_ctx **ctx, unsigned int n)
 {
 	struct rte_mempool_cache *cache;
 
 	cache = rte_mempool_default_cache(crypto_dp_sp->pool, rte_lcore_id());
-	IPSEC_CNT_INC(CTX_FREED);
 #ifdef HAVE_RTE_MEMPOOL_GENERIC_FLAGS
-	rte_mempool_generic_put(crypto_dp_sp->pool, (void *)&ctx, 1, cache, 1);
+	rte_mempool_generic_put(crypto_dp_sp->pool, (void **)ctx, n, cache, 1);
 #else
-	rte_mempool_generic_put(crypto_dp_sp->pool, (void *)&ctx, 1, cache);
+	rte_mempool_generic_put(crypto_dp_sp->pool, (void **)ctx, n, cache);
 #endif
 }
 
+static struct crypto_pkt_ctx *allocate_crypto_packet_ctx(void)
+{
+	struct crypto_ctx_stash *stash = &RTE_PER_LCORE(crypto_ctx_stash);
+
+	if (unlikely(stash->count == 0)) {
+		if (crypto_ctx_pool_get(stash->ctx, CRYPTO_CTX_BULK) == 0)
+			stash->count = CRYPTO_CTX_BULK;
+		else if (crypto_ctx_pool_get(stash->ctx, 1) == 0)
+			/* Nearly out, so take what there is */
+			stash->count = 1;
+		else
+			return NULL;
+	}
+	IPSEC_CNT_INC(CTX_ALLOCATED);
+	return stash->ctx[--stash->count];
+}
+
+static void release_crypto_packet_ctx(struct crypto_pkt_ctx *ctx)
+{
+	struct crypto_ctx_stash *stash = &RTE_PER_LCORE(crypto_ctx_stash);
+
+	IPSEC_CNT_INC(CTX_FREED);
+	if (unlikely(stash->count == CRYPTO_CTX_STASH)) {
+		stash->count -= CRYPTO_CTX_BULK;
+		crypto_ctx_pool_put(&stash->ctx[stash->count],
+				    CRYPTO_CTX_BULK);
+	}
+	stash->ctx[stash->count++] = ctx;
+}
+
 static inline const
 xfrm_address_t *crypto_get_src(void *l3hdr, uint32_t family)
 {
@@ -435,42 +527,39 @@ static struct ifnet *crypto_ctx_to_in_ifp(struct crypto_pkt_ctx *ctx,
 }
 
 /*
- * crypto_process_decrypt_packet()
- *
- * Decrypt the packet described by the supplied context.
+ * A packet queued to the cryptodev batch, to be completed once the
+ * batch has ended.  The records are in the order the packets were
+ * queued, which is the index of each result.
  */
-static void crypto_process_decrypt_packet(struct crypto_pkt_ctx *cctx,
-					  struct rte_mbuf *m,
-					  struct sadb_sa *sa,
-					  uint32_t *bytes)
-{
-	int rc;
-	struct ifnet *vti_ifp = NULL;
+struct crypto_pending {
+	struct crypto_pkt_ctx *ctx;
+	struct sadb_sa *sa;
+	struct ifnet *vti_ifp;
+};
 
-	/*
-	 * If this packet has come from a VTI, replace the
-	 * physical input interface with the VTI.  Doing so
-	 * enables both accounting and input features.
-	 */
-	unsigned int mark = crypto_sadb_get_mark_val(sa);
+struct crypto_pending_burst {
+	unsigned int count;
+	struct crypto_pending pkts[MAX_CRYPTO_PKT_BURST];
+};
 
-	if ((mark != 0) &&
-	    (vti_handle_inbound(
-		    crypto_get_src(pktmbuf_mtol3(m, void *),
-				   cctx->family),
-		    cctx->family, mark, m, &vti_ifp) < 0)) {
-		CRYPTO_DATA_ERR("No VTI interface found\n");
-		IPSEC_CNT_INC(NO_VTI);
-		cctx->action = CRYPTO_ACT_DROP;
-		IF_INCR_ERROR(crypto_ctx_to_in_ifp(cctx, m));
-		return;
-	}
+static RTE_DEFINE_PER_LCORE(struct crypto_pending_burst, crypto_pending);
 
-	if (cctx->family == AF_INET)
-		rc = esp_input(m, sa, bytes, &cctx->family);
-	else
-		rc = esp_input6(m, sa, bytes, &cctx->family);
+static void crypto_pending_add(struct crypto_pkt_ctx *cctx,
+			       struct sadb_sa *sa, struct ifnet *vti_ifp)
+{
+	struct crypto_pending_burst *pb = &RTE_PER_LCORE(crypto_pending);
+	struct crypto_pending *p = &pb->pkts[pb->count++];
+
+	p->ctx = cctx;
+	p->sa = sa;
+	p->vti_ifp = vti_ifp;
+}
 
+static void crypto_decrypt_finish(struct crypto_pkt_ctx *cctx,
+				  struct rte_mbuf *m,
+				  struct sadb_sa *sa,
+				  struct ifnet *vti_ifp, int rc)
+{
 	if (rc < 0) {
 		IF_INCR_ERROR(vti_ifp ? vti_ifp :
 			      crypto_ctx_to_in_ifp(cctx, m));
@@ -544,18 +633,63 @@ static void crypto_process_decrypt_packet(struct crypto_pkt_ctx *cctx,
 	}
 }
 
-static void crypto_process_encrypt_packet(struct crypto_pkt_ctx *cctx,
+/*
+ * crypto_process_decrypt_packet()
+ *
+ * Decrypt the packet described by the supplied context.
+ */
+static void crypto_process_decrypt_packet(struct crypto_pkt_ctx *cctx,
 					  struct rte_mbuf *m,
 					  struct sadb_sa *sa,
 					  uint32_t *bytes)
 {
 	int rc;
+	struct ifnet *vti_ifp = NULL;
+
+	/*
+	 * If this packet has come from a VTI, replace the
+	 * physical input interface with the VTI.  Doing so
+	 * enables both accounting and input features.
+	 */
+	unsigned int mark = crypto_sadb_get_mark_val(sa);
+
+	if ((mark != 0) &&
+	    (vti_handle_inbound(
+		    crypto_get_src(pktmbuf_mtol3(m, void *),
+				   cctx->family),
+		    cctx->family, mark, m, &vti_ifp) < 0)) {
+		CRYPTO_DATA_ERR("No VTI interface found\n");
+		IPSEC_CNT_INC(NO_VTI);
+		cctx->action = CRYPTO_ACT_DROP;
+		IF_INCR_ERROR(crypto_ctx_to_in_ifp(cctx, m));
+		return;
+	}
 
 	if (cctx->family == AF_INET)
-		rc = esp_output(m, cctx->orig_family, cctx->l3hdr, sa, bytes);
+		rc = esp_input(m, sa, bytes, &cctx->family);
 	else
-		rc = esp_output6(m, cctx->orig_family, cctx->l3hdr, sa, bytes);
+		rc = esp_input6(m, sa, bytes, &cctx->family);
+
+	if (rc == ESP_PENDING) {
+		crypto_pending_add(cctx, sa, vti_ifp);
+		return;
+	}
+
+	crypto_decrypt_finish(cctx, m, sa, vti_ifp, rc);
+}
+
+static void crypto_decrypt_complete(struct crypto_pending *p, int rc,
+				    uint32_t *bytes)
+{
+	struct rte_mbuf *m = p->ctx->mbuf;
 
+	rc = esp_input_complete(m, p->sa, rc, bytes, &p->ctx->family);
+	crypto_decrypt_finish(p->ctx, m, p->sa, p->vti_ifp, rc);
+}
+
+static void crypto_encrypt_finish(struct crypto_pkt_ctx *cctx,
+				  struct rte_mbuf *m, int rc)
+{
 	if (rc < 0) {
 		IF_INCR_OERROR(cctx->nxt_ifp);
 		CRYPTO_DATA_ERR("ESP Output failed %d\n", rc);
@@ -579,6 +713,46 @@ static void crypto_process_encrypt_packet(struct crypto_pkt_ctx *cctx,
 	}
 }
 
+static void crypto_process_encrypt_packet(struct crypto_pkt_ctx *cctx,
+					  struct rte_mbuf *m,
+					  struct sadb_sa *sa,
+					  uint32_t *bytes)
+{
+	struct esp_out_slot slot, *slotp = NULL;
+	int rc;
+
+	if (unlikely(cctx->spread)) {
+		slot.session = sa->spread->session[cctx->spread_slot];
+		slot.seq = cctx->seq;
+		slotp = &slot;
+	}
+
+	if (cctx->family == AF_INET)
+		rc = esp_output(m, cctx->orig_family, cctx->l3hdr, sa,
+				slotp, bytes);
+	else
+		rc = esp_output6(m, cctx->orig_family, cctx->l3hdr, sa,
+				 slotp, bytes);
+
+	cctx->bytes = *bytes;
+	if (rc == ESP_PENDING) {
+		crypto_pending_add(cctx, sa, NULL);
+		return;
+	}
+
+	crypto_encrypt_finish(cctx, m, rc);
+}
+
+/*
+ * The headers and counters of a batched outbound packet are done, it
+ * only remains to drop it if the op failed.
+ */
+static void crypto_encrypt_complete(struct crypto_pending *p, int rc,
+				    uint32_t *bytes __unused)
+{
+	crypto_encrypt_finish(p->ctx, p->ctx->mbuf, rc == 0 ? 0 : -1);
+}
+
 static void crypto_pkt_ctx_forward_and_free(struct crypto_pkt_ctx *ctx)
 {
 	switch (ctx->action) {
@@ -759,6 +933,7 @@ static int crypto_enqueue_internal(enum crypto_xfrm xfrm,
 	ctx->family    = family;
 	ctx->reqid     = reqid;
 	ctx->action    = CRYPTO_ACT_NONE;
+	ctx->spread    = 0;
 	if (xfrm == CRYPTO_ENCRYPT) {
 		/*
 		 * For a VTI tunnel, do output crypto processing
@@ -940,25 +1115,213 @@ void crypto_enqueue_outbound(struct rte_mbuf *m, uint16_t orig_family,
 		IPSEC_CNT_INC(ENQUEUED_OUTPUT_IPV6);
 }
 
+/*
+ * Take a packet of a spread SA when the dispatcher reads it from the
+ * ring.  Returns 1 if it has been handed to another PMD, -1 if it is
+ * to be dropped, or 0 if it is to be processed here.
+ */
+static int crypto_spread_dispatch(struct crypto_pkt_ctx *ctx,
+				  struct sadb_sa *sa)
+{
+	struct crypto_sa_spread *sp = sa->spread;
+	struct rte_ring *ring;
+	unsigned int slot;
+
+	/* The reorder ring is full, as a PMD has fallen far behind */
+	if (unlikely(sp->next_ticket - CMM_LOAD_SHARED(sp->drain_ticket) >=
+		     CRYPTO_SPREAD_REORDER_SZ)) {
+		IPSEC_CNT_INC(DROPPED_SPREAD_FULL);
+		ctx->action = CRYPTO_ACT_DROP;
+		return -1;
+	}
+
+	ctx->spread = 1;
+	ctx->seq = esp_seq_reserve(sa);
+	ctx->ticket = sp->next_ticket++;
+
+	/* Runs of packets, so each PMD still sees bursts */
+	slot = sp->slot;
+	if (++sp->run == CRYPTO_SPREAD_RUN) {
+		sp->run = 0;
+		sp->slot = (slot + 1) % sp->count;
+	}
+
+	ctx->spread_slot = slot;
+	if (slot == 0)
+		return 0;
+
+	ring = crypto_pmd_get_q(sp->pmd_dev_id[slot], CRYPTO_ENCRYPT);
+	if (likely(ring && rte_ring_mp_enqueue(ring, ctx) == 0))
+		return 1;
+
+	/* Not taken, so do it here with the dispatcher's session */
+	ctx->spread_slot = 0;
+	return 0;
+}
+
+/*
+ * Put a processed packet of a spread SA back in order, and send any
+ * that are now in order.  They are sent with the lock held so that
+ * the threads of the SA can not reorder them again.
+ */
+static void crypto_spread_reorder(struct crypto_pkt_ctx *ctx)
+{
+	struct sadb_sa *sa = ctx->sa;
+	struct crypto_sa_spread *sp = sa->spread;
+	struct crypto_pkt_ctx **next;
+
+	rte_spinlock_lock(&sp->lock);
+	sp->reorder[ctx->ticket & CRYPTO_SPREAD_REORDER_MASK] = ctx;
+
+	for (;;) {
+		next = &sp->reorder[sp->drain_ticket &
+				    CRYPTO_SPREAD_REORDER_MASK];
+		ctx = *next;
+		if (!ctx)
+			break;
+
+		*next = NULL;
+		CMM_STORE_SHARED(sp->drain_ticket, sp->drain_ticket + 1);
+
+		if (ctx->action == CRYPTO_ACT_OUTPUT)
+			crypto_sadb_increment_counters(sa, ctx->bytes, 1);
+		crypto_pkt_ctx_forward_and_free(ctx);
+	}
+	rte_spinlock_unlock(&sp->lock);
+}
+
+void crypto_sa_spread_setup(struct sadb_sa *sa)
+{
+	unsigned int count = crypto_pmd_spread_count();
+	struct crypto_sa_spread *sp;
+	unsigned int i;
+	int dev_id;
+
+	if (count < 2 || sa->dir != CRYPTO_DIR_OUT || !sa->session ||
+	    sa->pmd_dev_id == CRYPTO_PMD_INVALID_ID)
+		return;
+
+	sp = rte_zmalloc("crypto sa spread", sizeof(*sp),
+			 RTE_CACHE_LINE_SIZE);
+	if (!sp) {
+		CRYPTO_ERR("Failed to allocate spread for SA 0x%x\n",
+			   ntohl(sa->spi));
+		return;
+	}
+
+	rte_spinlock_init(&sp->lock);
+	sp->pmd_dev_id[0] = sa->pmd_dev_id;
+	sp->session[0] = sa->session;
+	sp->count = 1;
+
+	/* Stop when there are no more PMDs to be had */
+	while (sp->count < count) {
+		dev_id = crypto_allocate_pmd(CRYPTO_ENCRYPT);
+		if (dev_id == CRYPTO_PMD_INVALID_ID)
+			break;
+
+		for (i = 0; i < sp->count; i++)
+			if (sp->pmd_dev_id[i] == dev_id)
+				break;
+
+		if (i == sp->count)
+			sp->session[i] = crypto_session_clone(sa->session);
+
+		if (i < sp->count || !sp->session[i]) {
+			crypto_remove_sa_from_pmd(dev_id, CRYPTO_ENCRYPT,
+						  false);
+			break;
+		}
+		sp->pmd_dev_id[sp->count++] = dev_id;
+	}
+
+	if (sp->count < 2) {
+		rte_free(sp);
+		return;
+	}
+
+	sa->spread = sp;
+}
+
+/*
+ * Release the other PMDs of an SA that is being deleted.  As with its
+ * own PMD, this is done once the SA can no longer be found.
+ */
+void crypto_sa_spread_release(struct sadb_sa *sa)
+{
+	struct crypto_sa_spread *sp = sa->spread;
+	unsigned int i;
+
+	if (!sp)
+		return;
+
+	for (i = 1; i < sp->count; i++)
+		crypto_remove_sa_from_pmd(sp->pmd_dev_id[i], CRYPTO_ENCRYPT,
+					  false);
+}
+
+/*
+ * Free the spread of an SA, and any packets still waiting for one
+ * lost with a PMD.  Called once no thread can be using the SA.
+ */
+void crypto_sa_spread_destroy(struct sadb_sa *sa)
+{
+	struct crypto_sa_spread *sp = sa->spread;
+	unsigned int i;
+
+	if (!sp)
+		return;
+
+	for (i = 0; i < CRYPTO_SPREAD_REORDER_SZ; i++) {
+		struct crypto_pkt_ctx *ctx = sp->reorder[i];
+
+		if (ctx) {
+			rte_pktmbuf_free(ctx->mbuf);
+			release_crypto_packet_ctx(ctx);
+		}
+	}
+
+	/* Slot 0 is the SA's own session */
+	for (i = 1; i < sp->count; i++)
+		crypto_session_destroy(sp->session[i]);
+
+	rte_free(sp);
+	sa->spread = NULL;
+}
+
 static void crypto_fwd_processed_packets(struct crypto_pkt_ctx **contexts,
 					 unsigned int count)
 {
+	struct crypto_pkt_ctx *ctx;
 	uint32_t i;
 
-	for (i = 0; i < count; i++)
-		crypto_pkt_ctx_forward_and_free(contexts[i]);
+	for (i = 0; i < count; i++) {
+		ctx = contexts[i];
+
+		/* Handed to another PMD of a spread SA */
+		if (!ctx)
+			continue;
+
+		if (unlikely(ctx->spread))
+			crypto_spread_reorder(ctx);
+		else
+			crypto_pkt_ctx_forward_and_free(ctx);
+	}
 }
 
 struct crypto_processing_cb {
 	void (*process)(struct crypto_pkt_ctx *, struct rte_mbuf *,
 			struct sadb_sa *, uint32_t *bytes);
+	void (*complete)(struct crypto_pending *, int rc, uint32_t *bytes);
 	void (*post_process)(struct crypto_pkt_ctx **,  uint32_t);
 };
 
 static const struct crypto_processing_cb crypto_cb[MAX_CRYPTO_XFRM] = {
 	{crypto_process_encrypt_packet,
+	 crypto_encrypt_complete,
 	 crypto_fwd_processed_packets},
 	{crypto_process_decrypt_packet,
+	 crypto_decrypt_complete,
 	 crypto_fwd_processed_packets} };
 
 void crypto_purge_queue(struct rte_ring *pmd_queue)
@@ -1013,12 +1376,14 @@ sadb_lookup_sa(struct rte_mbuf *m __unused, enum crypto_xfrm xfrm,
 }
 
 static inline unsigned int
-crypto_pmd_process_packet(struct crypto_pkt_ctx *contexts,
+crypto_pmd_process_packet(struct crypto_pkt_ctx **ctxp,
 			  enum crypto_xfrm xfrm)
 {
+	struct crypto_pkt_ctx *contexts = *ctxp;
 	struct rte_mbuf *m;
 	unsigned int packet_size = 0;
 	struct sadb_sa *sa;
+	int rc;
 
 	m = contexts->mbuf;
 	if (unlikely(!m)) {
@@ -1030,13 +1395,85 @@ crypto_pmd_process_packet(struct crypto_pkt_ctx *contexts,
 	assert(contexts->direction == xfrm);
 
 	sa = sadb_lookup_sa(m, xfrm, contexts);
-	if (unlikely(!sa))
+	if (unlikely(!sa)) {
+		/* Its SA has gone, and its reorder ring with it */
+		contexts->spread = 0;
 		return 0;
+	}
+
+	if (unlikely(sa->spread != NULL)) {
+		if (!contexts->spread) {
+			rc = crypto_spread_dispatch(contexts, sa);
+			if (rc < 0)
+				return 0;
+			if (rc > 0) {
+				*ctxp = NULL;
+				return 0;
+			}
+		}
+		contexts->sa = sa;
+	}
 
 	crypto_cb[xfrm].process(contexts, m, sa, &packet_size);
 	return packet_size;
 }
 
+/*
+ * Submit the cryptodev batch for the burst, and complete the packets in
+ * it, returning the bytes they add.
+ */
+static unsigned int crypto_pmd_complete_batch(enum crypto_xfrm xfrm)
+{
+	struct crypto_pending_burst *pb = &RTE_PER_LCORE(crypto_pending);
+	int rc[MAX_CRYPTO_PKT_BURST];
+	unsigned int i, n, total_bytes = 0;
+
+	n = crypto_cdev_batch_end(rc);
+	assert(n == pb->count);
+
+	for (i = 0; i < n; i++) {
+		uint32_t packet_size = 0;
+
+		crypto_cb[xfrm].complete(&pb->pkts[i], rc[i], &packet_size);
+		total_bytes += packet_size;
+	}
+
+	pb->count = 0;
+	return total_bytes;
+}
+
+/*
+ * Run crypto on a burst of packets for a PMD, returning the bytes
+ * processed. The caller must own the PMD queue.
+ */
+static unsigned int crypto_process_burst(struct crypto_pkt_ctx **contexts,
+					 unsigned int count,
+					 enum crypto_xfrm xfrm)
+{
+	unsigned int i, total_bytes = 0;
+
+	for (i = 0; i < CRYPTO_PREFETCH_OFFSET && i < count; i++)
+		rte_prefetch0(contexts[i]);
+
+	crypto_cdev_batch_begin();
+
+	/* Process the packets in the burst. */
+	for (i = 0; i + CRYPTO_PREFETCH_OFFSET < count; i++) {
+		rte_prefetch0(contexts[i + CRYPTO_PREFETCH_OFFSET]);
+		rte_prefetch0(contexts[i + CRYPTO_PREFETCH_OFFSET - 1]->mbuf);
+		rte_prefetch0(contexts[i + CRYPTO_PREFETCH_OFFSET - 1]->l3hdr);
+		total_bytes += crypto_pmd_process_packet(&contexts[i], xfrm);
+	}
+
+	/* Process the remaining contexts */
+	for (; i < count; i++)
+		total_bytes += crypto_pmd_process_packet(&contexts[i], xfrm);
+
+	total_bytes += crypto_pmd_complete_batch(xfrm);
+
+	return total_bytes;
+}
+
 /*
  * PMD walker callback passed together with a PMD listhead, and called
  * back for each xfrm queue within each PMD.
@@ -1049,7 +1486,7 @@ static bool crypto_pmd_walk_cb(int pmd_dev_id __unused, enum crypto_xfrm xfrm,
 			       uint32_t *packets)
 {
 	struct crypto_pkt_ctx *contexts[MAX_CRYPTO_PKT_BURST];
-	unsigned int i, count, total_bytes = 0;
+	unsigned int count;
 
 	if (!rte_ring_empty(pmd_queue)) {
 		count = rte_ring_sc_dequeue_burst(pmd_queue,
@@ -1057,34 +1494,53 @@ static bool crypto_pmd_walk_cb(int pmd_dev_id __unused, enum crypto_xfrm xfrm,
 						  MAX_CRYPTO_PKT_BURST,
 						  NULL);
 
-		for (i = 0; i < CRYPTO_PREFETCH_OFFSET && i < count; i++)
-			rte_prefetch0(contexts[i]);
-
-		/* Process the packets in the burst. */
-		for (i = 0; i + CRYPTO_PREFETCH_OFFSET < count; i++) {
-			rte_prefetch0(contexts[i + CRYPTO_PREFETCH_OFFSET]);
-			rte_prefetch0(
-				contexts[i + CRYPTO_PREFETCH_OFFSET - 1]->mbuf);
-			rte_prefetch0(
-			       contexts[i + CRYPTO_PREFETCH_OFFSET - 1]->l3hdr);
-			total_bytes += crypto_pmd_process_packet(contexts[i],
-								 xfrm);
-		}
-
-		/* Process the remaining contexts */
-		for (; i < count; i++) {
-			total_bytes += crypto_pmd_process_packet(contexts[i],
-								 xfrm);
-		}
-
+		*bytes = crypto_process_burst(contexts, count, xfrm);
 		crypto_cb[xfrm].post_process(contexts, count);
 		*packets = count;
-		*bytes = total_bytes;
 	}
 
 	return true;
 }
 
+/*
+ * Flush the queue of packets for a PMD built up by this forwarding
+ * lcore. While the PMD is lightly loaded the packets are processed
+ * here, saving the hop through the ring to the crypto thread.
+ */
+void crypto_send_queue(struct crypto_pkt_buffer *cpb, enum crypto_xfrm xfrm)
+{
+	struct crypto_pkt_ctx *contexts[MAX_CRYPTO_PKT_BURST];
+	int pmd_dev_id = cpb->pmd_dev_id[xfrm];
+	unsigned int count, bytes;
+
+	count = cpb->local_q_count[xfrm];
+	if (!count)
+		return;
+
+	/* Not the fallback buffer, as it is shared */
+	if (cpb != RTE_PER_LCORE(crypto_pkt_buffer) ||
+	    !crypto_pmd_inline_begin(pmd_dev_id, xfrm)) {
+		(void)crypto_send_burst(cpb, xfrm, false);
+		return;
+	}
+
+	memcpy(contexts, cpb->local_crypto_q[xfrm],
+	       count * sizeof(contexts[0]));
+	cpb->local_q_count[xfrm] = 0;
+
+	bytes = crypto_process_burst(contexts, count, xfrm);
+	crypto_pmd_inline_end(pmd_dev_id, xfrm, count, bytes);
+	IPSEC_CNT_INC_BY(INLINE_CRYPTO, count);
+
+	/*
+	 * Forwarding may queue the packets for crypto again, as for a
+	 * tunnel in a tunnel, and these go to the crypto thread.
+	 */
+	crypto_cb[xfrm].post_process(contexts, count);
+	if (cpb->local_q_count[xfrm])
+		(void)crypto_send_burst(cpb, xfrm, false);
+}
+
 /*
  * Main crypto packet processing loop.
  */
@@ -1253,9 +1709,7 @@ void dp_crypto_init(void)
 	crypto_incomplete_init();
 
 	crypto_engine_init();
-	rte_timer_init(&pr_cache_timer);
-	rte_timer_reset(&pr_cache_timer, rte_get_timer_hz(), PERIODICAL,
-			rte_get_master_lcore(), pr_cache_timer_handler, NULL);
+	crypto_cdev_init();
 
 	CRYPTO_INFO("Crypto initialised\n");
 }
@@ -1268,6 +1722,7 @@ void dp_crypto_shutdown(void)
 	zsock_destroy(&rekey_listener);
 	udp_handler_unregister(AF_INET, htons(ESP_PORT));
 	udp_handler_unregister(AF_INET6, htons(ESP_PORT));
+	crypto_cdev_shutdown();
 	crypto_engine_shutdown();
 }
 
@@ -1297,6 +1752,7 @@ void crypto_show_summary(FILE *f)
 
 	for (i = 0; i < IPSEC_CNT_MAX; i++)
 		jsonw_uint_field(wr, ipsec_counter_names[i], agg_counters[i]);
+	crypto_cdev_summary(wr);
 	jsonw_end_object(wr);
 	jsonw_destroy(&wr);
 }
@@ -28,6 +28,7 @@ struct udphdr;
 #define IKE_PORT 500
 
 struct ifnet;
+struct pr_cache_table;
 struct rte_mbuf;
 
 struct crypto_fragment_ctx {
@@ -86,8 +87,12 @@ void crypto_show_pmd(FILE *f);
 void crypto_sadb_show_spi_mapping(FILE *f, vrfid_t vrfid);
 int crypto_engine_set(FILE *f, const char *str);
 int crypto_engine_probe(FILE *f);
+int crypto_engine_spread(FILE *f, const char *str);
+int crypto_engine_inline(FILE *f, const char *str);
+int crypto_sadb_spi_index(FILE *f, const char *str);
 void crypto_show_cache(FILE *f, const char *str);
-struct cds_lfht *pr_cache_init(void);
+int crypto_policy_cache_size(FILE *f, const char *str);
+struct pr_cache_table *pr_cache_init(void);
 unsigned long hash_xfrm_address(const xfrm_address_t *addr,
 				const uint16_t family);
 #endif /* CRYPTO_H */
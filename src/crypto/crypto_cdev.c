@@ -0,0 +1,667 @@
+/*-
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * DPDK cryptodev backend for the crypto engine.
+ *
+ * If a cryptodev (e.g. QAT, AESNI-MB or AESNI-GCM) was probed by the
+ * EAL, ESP payloads are handed to it rather than run through OpenSSL.
+ * Each crypto thread takes a queue pair of its own the first time it
+ * processes a packet, and symmetric sessions are created for an SA the
+ * first time it is used, as that is when its direction is known.
+ *
+ * Anything the device can not do (an algorithm it does not support,
+ * a segmented packet, or more crypto threads than queue pairs) falls
+ * back to OpenSSL.
+ *
+ * While a crypto thread has a batch open, the ops for the packets of a
+ * burst are gathered and then submitted together, so that multi-buffer
+ * devices (AESNI-MB, QAT) can interleave packets, whatever their SA.
+ */
+
+#include <endian.h>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/rand.h>
+#include <rte_atomic.h>
+#include <rte_branch_prediction.h>
+#include <rte_common.h>
+#include <rte_crypto.h>
+#include <rte_cryptodev.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_per_lcore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "crypto_internal.h"
+#include "crypto_main.h"
+#include "json_writer.h"
+#include "vplane_debug.h"
+#include "vplane_log.h"
+
+#define CDEV_MAX_QPS		64
+#define CDEV_QP_DESC		2048
+#define CDEV_SESSIONS		4096	/* Two per SA: header and private */
+#define CDEV_SESSION_CACHE	32
+
+/*
+ * Per op private area: IV, then the AAD for AEAD algorithms, then the
+ * op's index in the batch.
+ */
+#define CDEV_IV_OFFSET		(sizeof(struct rte_crypto_op) +	\
+				 sizeof(struct rte_crypto_sym_op))
+#define CDEV_IV_LEN		16
+#define CDEV_AAD_OFFSET		(CDEV_IV_OFFSET + CDEV_IV_LEN)
+#define CDEV_AAD_LEN		16
+#define CDEV_IDX_OFFSET		(CDEV_AAD_OFFSET + CDEV_AAD_LEN)
+#define CDEV_OP_PRIV_SIZE	(CDEV_IV_LEN + CDEV_AAD_LEN + sizeof(uint32_t))
+
+/* One op for synchronous use, plus a burst's worth for the batch */
+#define CDEV_OPS_PER_QP		(MAX_CRYPTO_PKT_BURST + 1)
+
+/* The ESP header (SPI and sequence number) is the AAD */
+#define CDEV_ESP_AAD_LEN	8
+
+enum {
+	CDEV_QP_UNASSIGNED = -1,
+	CDEV_QP_NONE = -2,
+};
+
+struct cdev_qp_stats {
+	uint64_t ops;
+	uint64_t auth_failed;
+	uint64_t errors;
+	uint64_t fallback;
+} __rte_cache_aligned;
+
+static int cdev_id = -1;
+static uint16_t cdev_nb_qps;
+static rte_atomic32_t cdev_next_qp;
+static struct rte_mempool *cdev_sess_pool;
+static struct rte_mempool *cdev_op_pool;
+static struct cdev_qp_stats *cdev_stats;
+
+struct cdev_batch {
+	bool open;
+	unsigned int count;
+	struct rte_crypto_op *ops[MAX_CRYPTO_PKT_BURST];
+};
+
+static RTE_DEFINE_PER_LCORE(int, cdev_qp) = CDEV_QP_UNASSIGNED;
+static RTE_DEFINE_PER_LCORE(struct rte_crypto_op *, cdev_op);
+static RTE_DEFINE_PER_LCORE(struct cdev_batch, cdev_batch);
+
+struct cdev_auth_algo {
+	const char *name;
+	enum rte_crypto_auth_algorithm algo;
+};
+
+static const struct cdev_auth_algo cdev_auth_algos[] = {
+	{ "hmac(sha1)",		RTE_CRYPTO_AUTH_SHA1_HMAC },
+	{ "hmac(sha256)",	RTE_CRYPTO_AUTH_SHA256_HMAC },
+	{ "hmac(sha384)",	RTE_CRYPTO_AUTH_SHA384_HMAC },
+	{ "hmac(sha512)",	RTE_CRYPTO_AUTH_SHA512_HMAC },
+	{ "hmac(md5)",		RTE_CRYPTO_AUTH_MD5_HMAC },
+};
+
+/*
+ * Take a queue pair for this thread, along with the ops it uses: one
+ * for packets run to completion one at a time, and those of the batch.
+ */
+static int crypto_cdev_qp_get(void)
+{
+	struct rte_crypto_op *ops[CDEV_OPS_PER_QP];
+	int qp = RTE_PER_LCORE(cdev_qp);
+
+	if (likely(qp >= 0) || qp == CDEV_QP_NONE)
+		return qp;
+
+	if (cdev_id < 0)
+		return CDEV_QP_NONE;
+
+	qp = rte_atomic32_add_return(&cdev_next_qp, 1) - 1;
+	if (qp >= cdev_nb_qps) {
+		CRYPTO_ERR("No cryptodev queue pair left for lcore %u\n",
+			   rte_lcore_id());
+		RTE_PER_LCORE(cdev_qp) = CDEV_QP_NONE;
+		return CDEV_QP_NONE;
+	}
+
+	if (rte_crypto_op_bulk_alloc(cdev_op_pool,
+				     RTE_CRYPTO_OP_TYPE_SYMMETRIC,
+				     ops, CDEV_OPS_PER_QP) != CDEV_OPS_PER_QP) {
+		CRYPTO_ERR("No cryptodev ops for queue pair %d\n", qp);
+		RTE_PER_LCORE(cdev_qp) = CDEV_QP_NONE;
+		return CDEV_QP_NONE;
+	}
+
+	RTE_PER_LCORE(cdev_op) = ops[0];
+	memcpy(RTE_PER_LCORE(cdev_batch).ops, &ops[1],
+	       sizeof(RTE_PER_LCORE(cdev_batch).ops));
+	RTE_PER_LCORE(cdev_qp) = qp;
+	return qp;
+}
+
+static int
+crypto_cdev_auth_algo(const struct crypto_session *s,
+		      enum rte_crypto_auth_algorithm *algo)
+{
+	unsigned int i;
+
+	if (!s->md_name)
+		return -1;
+
+	for (i = 0; i < ARRAY_SIZE(cdev_auth_algos); i++)
+		if (!strcmp(cdev_auth_algos[i].name, s->md_name)) {
+			*algo = cdev_auth_algos[i].algo;
+			return 0;
+		}
+
+	return -1;
+}
+
+/*
+ * Build the transforms for a session, returning the head of the chain.
+ * ESP encrypts then authenticates, so decryption verifies first.
+ */
+static struct rte_crypto_sym_xform *
+crypto_cdev_xforms(struct crypto_session *s, bool encrypt,
+		   struct rte_crypto_sym_xform *cipher,
+		   struct rte_crypto_sym_xform *auth)
+{
+	enum rte_crypto_cipher_algorithm calgo;
+	enum rte_crypto_auth_algorithm aalgo;
+
+	if (!s->cipher)
+		return NULL;
+
+	switch (EVP_CIPHER_nid(s->cipher)) {
+	case NID_aes_128_gcm:
+	case NID_aes_256_gcm:
+		if (s->nonce_len + s->iv_len > CDEV_IV_LEN)
+			return NULL;
+		cipher->type = RTE_CRYPTO_SYM_XFORM_AEAD;
+		cipher->aead.op = encrypt ? RTE_CRYPTO_AEAD_OP_ENCRYPT :
+			RTE_CRYPTO_AEAD_OP_DECRYPT;
+		cipher->aead.algo = RTE_CRYPTO_AEAD_AES_GCM;
+		cipher->aead.key.data = s->key;
+		cipher->aead.key.length = s->key_len;
+		cipher->aead.iv.offset = CDEV_IV_OFFSET;
+		cipher->aead.iv.length = s->nonce_len + s->iv_len;
+		cipher->aead.digest_length = s->digest_len;
+		cipher->aead.aad_length = CDEV_ESP_AAD_LEN;
+		return cipher;
+	case NID_aes_128_cbc:
+	case NID_aes_192_cbc:
+	case NID_aes_256_cbc:
+		calgo = RTE_CRYPTO_CIPHER_AES_CBC;
+		break;
+	case NID_des_ede3_cbc:
+		calgo = RTE_CRYPTO_CIPHER_3DES_CBC;
+		break;
+	case NID_undef:
+		calgo = RTE_CRYPTO_CIPHER_NULL;
+		break;
+	default:
+		return NULL;
+	}
+
+	if (s->iv_len > CDEV_IV_LEN)
+		return NULL;
+
+	cipher->type = RTE_CRYPTO_SYM_XFORM_CIPHER;
+	cipher->cipher.op = encrypt ? RTE_CRYPTO_CIPHER_OP_ENCRYPT :
+		RTE_CRYPTO_CIPHER_OP_DECRYPT;
+	cipher->cipher.algo = calgo;
+	cipher->cipher.key.data = s->key;
+	cipher->cipher.key.length = s->key_len;
+	cipher->cipher.iv.offset = CDEV_IV_OFFSET;
+	cipher->cipher.iv.length = s->iv_len;
+
+	if (!s->digest_len)
+		return cipher;
+
+	if (crypto_cdev_auth_algo(s, &aalgo) < 0)
+		return NULL;
+
+	auth->type = RTE_CRYPTO_SYM_XFORM_AUTH;
+	auth->auth.op = encrypt ? RTE_CRYPTO_AUTH_OP_GENERATE :
+		RTE_CRYPTO_AUTH_OP_VERIFY;
+	auth->auth.algo = aalgo;
+	auth->auth.key.data = (uint8_t *)s->auth_alg_key;
+	auth->auth.key.length = s->auth_alg_key_len;
+	auth->auth.digest_length = s->digest_len;
+
+	if (encrypt) {
+		cipher->next = auth;
+		return cipher;
+	}
+	auth->next = cipher;
+	return auth;
+}
+
+/*
+ * Create the session on first use.  Only the crypto thread the SA is
+ * assigned to gets here, so there is no race on the session state.
+ */
+static void crypto_cdev_session_init(struct crypto_session *s, bool encrypt)
+{
+	struct rte_crypto_sym_xform cipher = { .next = NULL };
+	struct rte_crypto_sym_xform auth = { .next = NULL };
+	struct rte_crypto_sym_xform *xform;
+	struct rte_cryptodev_sym_session *sess;
+
+	s->cdev_state = CRYPTO_CDEV_UNSUPPORTED;
+
+	xform = crypto_cdev_xforms(s, encrypt, &cipher, &auth);
+	if (!xform) {
+		CRYPTO_INFO("cryptodev: %s/%s not supported, using openssl\n",
+			    s->cipher_name, s->md_name ? s->md_name : "null");
+		return;
+	}
+
+	sess = rte_cryptodev_sym_session_create(cdev_sess_pool);
+	if (!sess) {
+		CRYPTO_ERR("cryptodev: no session available\n");
+		return;
+	}
+
+	if (rte_cryptodev_sym_session_init(cdev_id, sess, xform,
+					   cdev_sess_pool) < 0) {
+		CRYPTO_INFO("cryptodev: session init failed for %s/%s\n",
+			    s->cipher_name, s->md_name ? s->md_name : "null");
+		rte_cryptodev_sym_session_free(sess);
+		return;
+	}
+
+	s->cdev_sess = sess;
+	s->cdev_state = CRYPTO_CDEV_ACTIVE;
+}
+
+void crypto_cdev_session_destroy(struct crypto_session *s)
+{
+	if (!s->cdev_sess)
+		return;
+
+	rte_cryptodev_sym_session_clear(cdev_id, s->cdev_sess);
+	rte_cryptodev_sym_session_free(s->cdev_sess);
+	s->cdev_sess = NULL;
+	s->cdev_state = CRYPTO_CDEV_UNSUPPORTED;
+}
+
+/*
+ * Can the session's packets go to the device, from this thread?
+ */
+static bool crypto_cdev_usable(struct crypto_session *s,
+			       struct rte_mbuf *m, bool encrypt)
+{
+	int qp = crypto_cdev_qp_get();
+
+	if (qp < 0)
+		return false;
+
+	if (unlikely(s->cdev_state == CRYPTO_CDEV_NONE))
+		crypto_cdev_session_init(s, encrypt);
+
+	if (s->cdev_state != CRYPTO_CDEV_ACTIVE ||
+	    !rte_pktmbuf_is_contiguous(m)) {
+		cdev_stats[qp].fallback++;
+		return false;
+	}
+	return true;
+}
+
+static void
+crypto_cdev_op_prepare(struct rte_crypto_op *op, struct crypto_session *s,
+		       struct rte_mbuf *m, unsigned int esp_off,
+		       const unsigned char *iv, unsigned int text_len,
+		       unsigned int icv_off)
+{
+	unsigned int cipher_off = esp_off + CDEV_ESP_AAD_LEN + s->iv_len;
+	struct rte_crypto_sym_op *sym;
+	uint8_t *op_iv;
+
+	op->status = RTE_CRYPTO_OP_STATUS_NOT_PROCESSED;
+	rte_crypto_op_attach_sym_session(op, s->cdev_sess);
+
+	sym = op->sym;
+	sym->m_src = m;
+	sym->m_dst = NULL;
+
+	op_iv = rte_crypto_op_ctod_offset(op, uint8_t *, CDEV_IV_OFFSET);
+
+	if (s->nonce_len) {
+		uint8_t *aad = rte_crypto_op_ctod_offset(op, uint8_t *,
+							 CDEV_AAD_OFFSET);
+
+		memcpy(op_iv, s->nonce, s->nonce_len);
+		memcpy(op_iv + s->nonce_len, iv, s->iv_len);
+		memcpy(aad, rte_pktmbuf_mtod_offset(m, uint8_t *, esp_off),
+		       CDEV_ESP_AAD_LEN);
+
+		sym->aead.data.offset = cipher_off;
+		sym->aead.data.length = text_len;
+		sym->aead.aad.data = aad;
+		sym->aead.aad.phys_addr =
+			rte_crypto_op_ctophys_offset(op, CDEV_AAD_OFFSET);
+		sym->aead.digest.data =
+			rte_pktmbuf_mtod_offset(m, uint8_t *, icv_off);
+		sym->aead.digest.phys_addr =
+			rte_pktmbuf_mtophys_offset(m, icv_off);
+	} else {
+		memcpy(op_iv, iv, s->iv_len);
+
+		sym->cipher.data.offset = cipher_off;
+		sym->cipher.data.length = text_len;
+		sym->auth.data.offset = esp_off;
+		sym->auth.data.length = cipher_off + text_len - esp_off;
+		sym->auth.digest.data =
+			rte_pktmbuf_mtod_offset(m, uint8_t *, icv_off);
+		sym->auth.digest.phys_addr =
+			rte_pktmbuf_mtophys_offset(m, icv_off);
+	}
+}
+
+static int crypto_cdev_op_status(const struct rte_crypto_op *op,
+				 struct cdev_qp_stats *stats)
+{
+	stats->ops++;
+	if (likely(op->status == RTE_CRYPTO_OP_STATUS_SUCCESS))
+		return 0;
+
+	if (op->status == RTE_CRYPTO_OP_STATUS_AUTH_FAILED)
+		stats->auth_failed++;
+	else
+		stats->errors++;
+	return -1;
+}
+
+int crypto_cdev_process(struct crypto_session *s, struct rte_mbuf *m,
+			bool encrypt, unsigned int esp_off,
+			const unsigned char *iv, unsigned int text_len,
+			unsigned int icv_off)
+{
+	struct rte_crypto_op *op, *done;
+	struct cdev_qp_stats *stats;
+	int qp;
+
+	if (!crypto_cdev_usable(s, m, encrypt))
+		return CRYPTO_CDEV_FALLBACK;
+
+	qp = RTE_PER_LCORE(cdev_qp);
+	stats = &cdev_stats[qp];
+	op = RTE_PER_LCORE(cdev_op);
+	crypto_cdev_op_prepare(op, s, m, esp_off, iv, text_len, icv_off);
+
+	if (unlikely(rte_cryptodev_enqueue_burst(cdev_id, qp, &op, 1) != 1)) {
+		stats->errors++;
+		return CRYPTO_CDEV_FALLBACK;
+	}
+
+	/* The queue pair is ours and holds only this op */
+	while (rte_cryptodev_dequeue_burst(cdev_id, qp, &done, 1) == 0)
+		rte_pause();
+
+	return crypto_cdev_op_status(done, stats);
+}
+
+void crypto_cdev_batch_begin(void)
+{
+	struct cdev_batch *b = &RTE_PER_LCORE(cdev_batch);
+
+	if (crypto_cdev_qp_get() < 0)
+		return;
+
+	b->open = true;
+	b->count = 0;
+}
+
+bool crypto_cdev_batchable(struct crypto_session *s, struct rte_mbuf *m,
+			   bool encrypt)
+{
+	struct cdev_batch *b = &RTE_PER_LCORE(cdev_batch);
+
+	if (!b->open || b->count == MAX_CRYPTO_PKT_BURST)
+		return false;
+
+	return crypto_cdev_usable(s, m, encrypt);
+}
+
+void crypto_cdev_generate_iv(struct crypto_session *s, unsigned char *iv,
+			     uint32_t seq)
+{
+	uint64_t ctr;
+
+	/*
+	 * A GCM IV only has to be unique, so take the sequence number
+	 * and the random IV of the SA (as the Linux seqiv does).  A CBC
+	 * IV must not be predictable, and a batch can not chain from
+	 * the last ciphertext, so take a random one.
+	 */
+	if (s->nonce_len && s->iv_len == sizeof(ctr)) {
+		memcpy(&ctr, s->iv, sizeof(ctr));
+		ctr ^= htobe64(seq);
+		memcpy(iv, &ctr, sizeof(ctr));
+		return;
+	}
+
+	if (RAND_bytes(iv, s->iv_len) != 1)
+		memcpy(iv, s->iv, s->iv_len);
+}
+
+int crypto_cdev_queue(struct crypto_session *s, struct rte_mbuf *m,
+		      unsigned int esp_off, const unsigned char *iv,
+		      unsigned int text_len, unsigned int icv_off)
+{
+	struct cdev_batch *b = &RTE_PER_LCORE(cdev_batch);
+	struct rte_crypto_op *op;
+
+	if (unlikely(!b->open || b->count == MAX_CRYPTO_PKT_BURST))
+		return CRYPTO_CDEV_FALLBACK;
+
+	op = b->ops[b->count];
+	crypto_cdev_op_prepare(op, s, m, esp_off, iv, text_len, icv_off);
+	*rte_crypto_op_ctod_offset(op, uint32_t *, CDEV_IDX_OFFSET) =
+		b->count++;
+	return 0;
+}
+
+unsigned int crypto_cdev_batch_end(int rc[])
+{
+	struct cdev_batch *b = &RTE_PER_LCORE(cdev_batch);
+	struct rte_crypto_op *done[MAX_CRYPTO_PKT_BURST];
+	unsigned int n = b->count, sent = 0, got = 0, i;
+	struct cdev_qp_stats *stats;
+	int qp;
+
+	b->open = false;
+	b->count = 0;
+	if (n == 0)
+		return 0;
+
+	qp = RTE_PER_LCORE(cdev_qp);
+	stats = &cdev_stats[qp];
+
+	/* The queue pair is ours, so all that comes back is the batch */
+	while (got < sent || sent < n) {
+		unsigned int k = 0;
+
+		if (sent < n) {
+			k = rte_cryptodev_enqueue_burst(cdev_id, qp,
+							&b->ops[sent],
+							n - sent);
+			sent += k;
+		}
+		if (got < sent)
+			got += rte_cryptodev_dequeue_burst(cdev_id, qp,
+							   &done[got],
+							   sent - got);
+		else if (k == 0)
+			break;	/* Device refuses ops and has none in flight */
+	}
+
+	for (i = 0; i < got; i++) {
+		uint32_t idx = *rte_crypto_op_ctod_offset(done[i], uint32_t *,
+							  CDEV_IDX_OFFSET);
+
+		rc[idx] = crypto_cdev_op_status(done[i], stats);
+	}
+
+	/* Those not taken by the device are dropped */
+	for (i = sent; i < n; i++) {
+		uint32_t idx = *rte_crypto_op_ctod_offset(b->ops[i], uint32_t *,
+							  CDEV_IDX_OFFSET);
+
+		stats->errors++;
+		rc[idx] = -1;
+	}
+	return n;
+}
+
+void crypto_cdev_init(void)
+{
+	struct rte_cryptodev_qp_conf qp_conf = {
+		.nb_descriptors = CDEV_QP_DESC,
+	};
+	struct rte_cryptodev_config conf = { 0 };
+	struct rte_cryptodev_info info;
+	unsigned int sess_size;
+	uint8_t count, dev;
+	uint16_t qp;
+	int socket;
+
+	count = rte_cryptodev_count();
+	if (count == 0)
+		return;
+
+	/* Prefer a hardware device over a software one */
+	for (dev = 0; dev < count; dev++) {
+		rte_cryptodev_info_get(dev, &info);
+		if (info.feature_flags & RTE_CRYPTODEV_FF_HW_ACCELERATED)
+			break;
+	}
+	if (dev == count)
+		dev = 0;
+
+	rte_cryptodev_info_get(dev, &info);
+	socket = rte_cryptodev_socket_id(dev);
+	if (socket < 0)
+		socket = SOCKET_ID_ANY;
+
+	cdev_nb_qps = RTE_MIN(info.max_nb_queue_pairs, CDEV_MAX_QPS);
+	if (cdev_nb_qps == 0)
+		return;
+
+	sess_size = rte_cryptodev_sym_get_private_session_size(dev);
+	cdev_sess_pool = rte_mempool_create("crypto-cdev-sess", CDEV_SESSIONS,
+					    sess_size, CDEV_SESSION_CACHE, 0,
+					    NULL, NULL, NULL, NULL, socket, 0);
+	if (!cdev_sess_pool) {
+		RTE_LOG(ERR, DATAPLANE,
+			"cryptodev: session pool create failed\n");
+		return;
+	}
+
+	/* The ops of each queue pair are owned by its crypto thread */
+	cdev_op_pool = rte_crypto_op_pool_create("crypto-cdev-ops",
+						 RTE_CRYPTO_OP_TYPE_SYMMETRIC,
+						 cdev_nb_qps * CDEV_OPS_PER_QP,
+						 0,
+						 CDEV_OP_PRIV_SIZE, socket);
+	if (!cdev_op_pool) {
+		RTE_LOG(ERR, DATAPLANE, "cryptodev: op pool create failed\n");
+		goto free_sess;
+	}
+
+	cdev_stats = rte_zmalloc_socket("crypto-cdev-stats",
+					cdev_nb_qps * sizeof(*cdev_stats),
+					RTE_CACHE_LINE_SIZE, socket);
+	if (!cdev_stats)
+		goto free_ops;
+
+	conf.socket_id = socket;
+	conf.nb_queue_pairs = cdev_nb_qps;
+	if (rte_cryptodev_configure(dev, &conf) < 0) {
+		RTE_LOG(ERR, DATAPLANE, "cryptodev: configure of %s failed\n",
+			rte_cryptodev_name_get(dev));
+		goto free_stats;
+	}
+
+	for (qp = 0; qp < cdev_nb_qps; qp++) {
+		if (rte_cryptodev_queue_pair_setup(dev, qp, &qp_conf, socket,
+						   cdev_sess_pool) < 0) {
+			RTE_LOG(ERR, DATAPLANE,
+				"cryptodev: %s queue pair %u setup failed\n",
+				rte_cryptodev_name_get(dev), qp);
+			goto free_stats;
+		}
+	}
+
+	if (rte_cryptodev_start(dev) < 0) {
+		RTE_LOG(ERR, DATAPLANE, "cryptodev: start of %s failed\n",
+			rte_cryptodev_name_get(dev));
+		goto free_stats;
+	}
+
+	rte_atomic32_init(&cdev_next_qp);
+	cdev_id = dev;
+	RTE_LOG(INFO, DATAPLANE, "cryptodev: using %s with %u queue pairs\n",
+		rte_cryptodev_name_get(dev), cdev_nb_qps);
+	return;
+
+free_stats:
+	rte_free(cdev_stats);
+	cdev_stats = NULL;
+free_ops:
+	rte_mempool_free(cdev_op_pool);
+	cdev_op_pool = NULL;
+free_sess:
+	rte_mempool_free(cdev_sess_pool);
+	cdev_sess_pool = NULL;
+}
+
+void crypto_cdev_shutdown(void)
+{
+	if (cdev_id < 0)
+		return;
+
+	rte_cryptodev_stop(cdev_id);
+	cdev_id = -1;
+}
+
+void crypto_cdev_summary(json_writer_t *wr)
+{
+	struct cdev_qp_stats sum = { 0 };
+	uint16_t qp;
+
+	if (cdev_id < 0)
+		return;
+
+	for (qp = 0; qp < cdev_nb_qps; qp++) {
+		sum.ops += cdev_stats[qp].ops;
+		sum.auth_failed += cdev_stats[qp].auth_failed;
+		sum.errors += cdev_stats[qp].errors;
+		sum.fallback += cdev_stats[qp].fallback;
+	}
+
+	jsonw_name(wr, "cryptodev");
+	jsonw_start_object(wr);
+	jsonw_string_field(wr, "device", rte_cryptodev_name_get(cdev_id));
+	jsonw_uint_field(wr, "queue_pairs", cdev_nb_qps);
+	jsonw_uint_field(wr, "queue_pairs_used",
+			 RTE_MIN(rte_atomic32_read(&cdev_next_qp),
+				 (int32_t)cdev_nb_qps));
+	jsonw_uint_field(wr, "ops", sum.ops);
+	jsonw_uint_field(wr, "auth_failed", sum.auth_failed);
+	jsonw_uint_field(wr, "errors", sum.errors);
+	jsonw_uint_field(wr, "fallback", sum.fallback);
+	jsonw_end_object(wr);
+}
@@ -958,11 +958,49 @@ err:
 	return NULL;
 }
 
+/*
+ * Make a copy of an outbound session with the same keys and IV, but
+ * with its own OpenSSL and cryptodev state, so that it can be used at
+ * the same time as the one it was copied from.
+ */
+struct crypto_session *
+crypto_session_clone(const struct crypto_session *orig)
+{
+	struct crypto_session *ctx;
+
+	ctx = malloc(sizeof(*ctx));
+	if (!ctx)
+		return NULL;
+
+	*ctx = *orig;
+	ctx->direction = XFRM_POLICY_OUT;
+	ctx->cipher_init = 0;
+	ctx->ctx = NULL;
+	ctx->hmac_ctx = NULL;
+	ctx->cdev_sess = NULL;
+	ctx->cdev_state = CRYPTO_CDEV_NONE;
+
+	if (orig->hmac_ctx &&
+	    ctx->s_ops->set_auth_key(ctx, orig->auth_alg_key_len,
+				     orig->auth_alg_key) < 0) {
+		free(ctx);
+		return NULL;
+	}
+
+	if (openssl_session_cipher_init(ctx) < 0) {
+		crypto_session_destroy(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
 void crypto_session_destroy(struct crypto_session *ctx)
 {
 	if (!ctx)
 		return;
 
+	crypto_cdev_session_destroy(ctx);
 	if (ctx->hmac_ctx)
 		HMAC_CTX_free(ctx->hmac_ctx);
 	if (ctx->ctx)
@@ -1056,8 +1094,6 @@ int cipher_setup_ctx(const struct xfrm_algo *algo_crypt,
 	}
 
 	sa->seq = 0;
-	sa->replay_bitmap = 0;
-	sa->replay_window = sa_info->replay_window;
 
 	sa->flags = sa_info->flags;
 	sa->extra_flags = extra_flags;
@@ -1154,6 +1190,9 @@ void crypto_engine_summary(json_writer_t *wr, const struct sadb_sa *sa)
 	jsonw_string_field(wr, "digest", sa->session->md_name ?
 			   sa->session->md_name : "null");
 	jsonw_uint_field(wr, "replay_window", sa->replay_window);
+	jsonw_string_field(wr, "engine",
+			   sa->session->cdev_state == CRYPTO_CDEV_ACTIVE ?
+			   "cryptodev" : "openssl");
 }
 
 static int crypto_chain_dump_set_iv(struct crypto_visitor_ctx *ctx,
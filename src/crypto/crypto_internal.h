@@ -9,6 +9,7 @@
 #ifndef CRYPTO_INTERNAL_H
 #define CRYPTO_INTERNAL_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <linux/xfrm.h>
 #include <netinet/ip.h>
@@ -27,6 +28,8 @@
 #include "vplane_log.h"
 #include "vrf.h"
 
+struct crypto_policy_cls;
+
 #define CRYPTO_DATA_ERR(args...)			\
 	DP_DEBUG(CRYPTO_DATA, ERR, CRYPTO, args)
 
@@ -38,6 +41,9 @@
 
 #define PMD_RING_SIZE  4096
 
+/* Most crypto threads an outbound SA can be spread across */
+#define CRYPTO_SA_SPREAD_MAX 8
+
 #define SPI_LEN_IN_HEXCHARS (8+1) /* 32 bit SPI */
 
 static inline void spi_to_hexstr(char *buf, uint32_t spi)
@@ -102,8 +108,17 @@ OPENSSL_init_crypto(uint32_t opts __attribute__ ((__unused__)),
 
 #define CRYPTO_PMD_INVALID_ID -1
 
+struct esp_replay_window;
 struct crypto_session_operations;
 struct crypto_visitor_operations;
+struct rte_cryptodev_sym_session;
+
+/* State of the cryptodev session of a crypto_session */
+enum crypto_cdev_state {
+	CRYPTO_CDEV_NONE = 0,		/* Not tried yet */
+	CRYPTO_CDEV_ACTIVE,
+	CRYPTO_CDEV_UNSUPPORTED,	/* OpenSSL only */
+};
 
 enum crypto_dir {
 	CRYPTO_DIR_IN = 0,
@@ -139,6 +154,9 @@ struct crypto_session {
 	const EVP_MD *md;
 	const char *md_name;
 	const char *cipher_name;
+
+	struct rte_cryptodev_sym_session *cdev_sess;
+	enum crypto_cdev_state cdev_state;
 };
 
 /*
@@ -188,15 +206,17 @@ struct sadb_sa {
 	uint32_t seq_drop;
 	int del_pmd_dev_id;
 	/* Cacheline 3 boundary */
-	uint8_t replay_window;
 	uint8_t pending_del;
-	uint64_t replay_bitmap;
+	uint32_t replay_window;
+	struct esp_replay_window *replay;
 	struct ip6_hdr ip6_hdr;
 	struct ifnet *feat_attach_ifp;
 	vrfid_t overlay_vrf_id;
+	struct crypto_sa_spread *spread;
 };
 
 struct crypto_chain_elem;
+struct crypto_sa_spread;
 
 struct crypto_session_operations {
 	const struct crypto_visitor_operations *decrypt_vops;
@@ -284,6 +304,9 @@ crypto_session_create(const struct xfrm_algo *algo_crypt,
 		      const struct xfrm_algo_auth *algo_auth,
 		      int direction);
 
+struct crypto_session *
+crypto_session_clone(const struct crypto_session *orig);
+
 void crypto_session_destroy(struct crypto_session *ctx);
 
 /*
@@ -394,6 +417,38 @@ void cipher_teardown_ctx(struct sadb_sa *sa);
 
 void crypto_engine_summary(json_writer_t *wr, const struct sadb_sa *sa);
 
+/*
+ * Cryptodev backend, see crypto_cdev.c.  crypto_cdev_process() returns
+ * 0 on success, a negative value if the packet is to be dropped, or
+ * CRYPTO_CDEV_FALLBACK if it is to be processed by OpenSSL instead.
+ */
+#define CRYPTO_CDEV_FALLBACK 1
+
+void crypto_cdev_init(void);
+void crypto_cdev_shutdown(void);
+void crypto_cdev_summary(json_writer_t *wr);
+void crypto_cdev_session_destroy(struct crypto_session *s);
+int crypto_cdev_process(struct crypto_session *s, struct rte_mbuf *m,
+			bool encrypt, unsigned int esp_off,
+			const unsigned char *iv, unsigned int text_len,
+			unsigned int icv_off);
+
+/*
+ * Batched use of the cryptodev, by the crypto thread for each burst.
+ * Packets for which crypto_cdev_batchable() is true are queued and
+ * their results written to rc[], by index in the order queued, when
+ * the batch ends.
+ */
+void crypto_cdev_batch_begin(void);
+bool crypto_cdev_batchable(struct crypto_session *s, struct rte_mbuf *m,
+			   bool encrypt);
+void crypto_cdev_generate_iv(struct crypto_session *s, unsigned char *iv,
+			     uint32_t seq);
+int crypto_cdev_queue(struct crypto_session *s, struct rte_mbuf *m,
+		      unsigned int esp_off, const unsigned char *iv,
+		      unsigned int text_len, unsigned int icv_off);
+unsigned int crypto_cdev_batch_end(int rc[]);
+
 #define IF_INCR_Mx(_ifp, _m, _x)		\
 do {						\
 	if (_ifp)				\
@@ -475,6 +530,9 @@ enum ipsec_cnt_types {
 	PR_CACHE_MISS,
 	DROPPED_NO_BIND,
 	DROPPED_ON_FP_NO_PR,
+	DROPPED_SPREAD_FULL,
+	ESP_TAIL_SEG_ALLOC,
+	INLINE_CRYPTO,
 	IPSEC_CNT_MAX /* this must be last */
 };
 
@@ -484,6 +542,8 @@ enum ipsec_cnt_types {
 struct crypto_vrf_ctx {
 	struct cds_lfht *input_policy_rule_sel_ht;
 	struct cds_lfht *output_policy_rule_sel_ht;
+	struct crypto_policy_cls *input_policy_cls;
+	struct crypto_policy_cls *output_policy_cls;
 	struct cds_lfht *spi_out_hash_table;
 	struct cds_lfht *sadb_hash_table;
 	struct cds_lfht *s2s_bind_hash_table;
@@ -557,6 +617,7 @@ void crypto_delete_queue(struct rte_ring *pmd_queue);
 void crypto_remove_sa_from_pmd(int crypto_dev_id, enum crypto_xfrm xfrm,
 			       bool pending);
 int crypto_allocate_pmd(enum crypto_xfrm xfrm);
+unsigned int crypto_pmd_spread_count(void);
 struct rte_ring *crypto_pmd_get_q(int dev_id, enum crypto_xfrm xfrm);
 typedef bool (*crypto_pmd_walker_cb)(int pmd_dev_id, enum crypto_xfrm,
 				     struct rte_ring *,
@@ -564,6 +625,9 @@ typedef bool (*crypto_pmd_walker_cb)(int pmd_dev_id, enum crypto_xfrm,
 				     uint32_t *packets);
 unsigned int crypto_pmd_walk_per_xfrm(struct cds_list_head *pmd_head,
 					      crypto_pmd_walker_cb cb);
+bool crypto_pmd_inline_begin(int dev_id, enum crypto_xfrm xfrm);
+void crypto_pmd_inline_end(int dev_id, enum crypto_xfrm xfrm,
+			   uint32_t packets, uint64_t bytes);
 void crypto_pmd_inc_pending_del(int pmd_dev_id, enum crypto_xfrm xfrm);
 void crypto_pmd_dec_pending_del(int pmd_dev_id, enum crypto_xfrm xfrm);
 struct crypto_vrf_ctx *crypto_vrf_find(vrfid_t vrfid);
@@ -571,4 +635,11 @@ struct crypto_vrf_ctx *crypto_vrf_find_external(vrfid_t vrfid);
 struct crypto_vrf_ctx *crypto_vrf_get(vrfid_t vrfid);
 void crypto_vrf_check_remove(struct crypto_vrf_ctx *vrf_ctx);
 struct ifnet *crypto_policy_feat_attach_by_reqid(uint32_t reqid);
+
+/*
+ * Spreading of an outbound SA across crypto threads, see crypto.c
+ */
+void crypto_sa_spread_setup(struct sadb_sa *sa);
+void crypto_sa_spread_release(struct sadb_sa *sa);
+void crypto_sa_spread_destroy(struct sadb_sa *sa);
 #endif /* CRYPTO_INTERNAL_H */
@@ -8,6 +8,7 @@
 #ifndef CRYPTO_MAIN_H
 #define CRYPTO_MAIN_H
 
+#include <rte_common.h>
 #include <rte_per_lcore.h>
 #include <rte_ring.h>
 #include <rte_timer.h>
@@ -21,6 +22,14 @@
  */
 #define MAX_CRYPTO_PKT_BURST 64
 
+/*
+ * Worst case ESP trailer: padding to a 16 byte block, pad length and
+ * next header, and a 256 bit ICV. The mbuf pools reserve this much on
+ * top of a full sized frame so that the trailer can always be written
+ * in place, without adding a segment.
+ */
+#define CRYPTO_MAX_TAILROOM RTE_ALIGN(15 + 2 + 32, RTE_CACHE_LINE_MIN_SIZE)
+
 struct crypto_pkt_ctx;
 
 /*
@@ -48,9 +57,8 @@ enum crypto_xfrm {
 struct crypto_pkt_buffer {
 	int pmd_dev_id[MAX_CRYPTO_XFRM];
 	uint32_t local_q_count[MAX_CRYPTO_XFRM];
-	rte_atomic16_t pr_cache_count;
-	char SPARE[6];
-	struct cds_lfht *pr_cache_tbl;
+	char SPARE[8];
+	struct pr_cache_table *pr_cache_tbl;
 	struct crypto_pkt_ctx *local_crypto_q[MAX_CRYPTO_XFRM]
 	[MAX_CRYPTO_PKT_BURST];
 };
@@ -59,6 +67,8 @@ RTE_DECLARE_PER_LCORE(struct crypto_pkt_buffer *, crypto_pkt_buffer);
 
 int crypto_send_burst(struct crypto_pkt_buffer *cpb,
 		      enum crypto_xfrm xfrm, bool drop);
+void crypto_send_queue(struct crypto_pkt_buffer *cpb,
+		       enum crypto_xfrm xfrm);
 
 static inline void crypto_send(struct crypto_pkt_buffer *cpb)
 {
@@ -66,8 +76,7 @@ static inline void crypto_send(struct crypto_pkt_buffer *cpb)
 	for (q = MIN_CRYPTO_XFRM;
 	     q < MAX_CRYPTO_XFRM; q++)
 		if (cpb->local_q_count[q])
-			(void)crypto_send_burst(cpb, (enum crypto_xfrm)q,
-						false);
+			crypto_send_queue(cpb, (enum crypto_xfrm)q);
 }
 
 void dp_crypto_per_lcore_init(unsigned int lcore_id);
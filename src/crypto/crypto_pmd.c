@@ -11,9 +11,11 @@
 #include <rte_malloc.h>
 #include <rte_memory.h>
 #include <rte_ring.h>
+#include <rte_spinlock.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <urcu/list.h>
 #include <urcu/uatomic.h>
 
@@ -34,6 +36,18 @@
  */
 static unsigned int max_pmds;
 
+/*
+ * The number of PMDs, and so crypto threads, each new outbound SA is
+ * spread across.
+ */
+static unsigned int pmd_spread = 1;
+
+/*
+ * Below this packet rate per PMD and direction, forwarding lcores run
+ * crypto themselves rather than queue to the crypto thread. 0 is off.
+ */
+static uint32_t pmd_inline_pps;
+
 /*
  * A per pmd structure that is referenced by dev_id in the forwarding
  * plane It can be attached to either a lcore forwarding thread for
@@ -62,6 +76,11 @@ struct crypto_pmd {
 	 * the other pmd fields are read by the fast path theads
 	 */
 	char *padding[0] __rte_cache_aligned;
+	/*
+	 * Held by whoever is processing the queue: the crypto thread,
+	 * or a forwarding lcore running crypto inline.
+	 */
+	rte_spinlock_t lock[MAX_CRYPTO_XFRM];
 	struct pmd_counters cnt[MAX_CRYPTO_XFRM];
 	struct rate_stats rates[MAX_CRYPTO_XFRM];
 	unsigned int sa_cnt_per_type[MAX_CRYPTO_XFRM];
@@ -207,6 +226,8 @@ crypto_pmd_find_or_create(enum crypto_xfrm xfrm)
 	}
 
 	CDS_INIT_LIST_HEAD(&pmd->next);
+	for (q = MIN_CRYPTO_XFRM; q < MAX_CRYPTO_XFRM; q++)
+		rte_spinlock_init(&pmd->lock[q]);
 
 	pmd->q_pair.q[CRYPTO_ENCRYPT] =
 		crypto_create_ring("pmd-en-q", PMD_RING_SIZE,
@@ -253,6 +274,11 @@ void crypto_pmd_dec_pending_del(int pmd_dev_id, enum crypto_xfrm xfrm)
 		crypto_pmd_devs[pmd_dev_id]->pending_remove[xfrm]--;
 }
 
+unsigned int crypto_pmd_spread_count(void)
+{
+	return pmd_spread;
+}
+
 static int crypto_cpu_describe(FILE *f, unsigned int count,
 			       bool sticky)
 {
@@ -266,6 +292,8 @@ static int crypto_cpu_describe(FILE *f, unsigned int count,
 	jsonw_name(wr, "crypto_cores");
 	jsonw_uint_field(wr, "count", count);
 	jsonw_uint_field(wr, "crypto_sticky", sticky);
+	jsonw_uint_field(wr, "sa_spread", pmd_spread);
+	jsonw_uint_field(wr, "inline_pps", pmd_inline_pps);
 	jsonw_end_object(wr);
 	jsonw_destroy(&wr);
 
@@ -307,6 +335,89 @@ int crypto_engine_set(FILE *f, const char *str)
 
 	return crypto_cpu_describe(f, num, tmp_sticky);
 }
+/*
+ * Set the number of crypto threads that each new outbound SA is spread
+ * across, from 1 (the default, no spreading) to CRYPTO_SA_SPREAD_MAX.
+ * SAs that already exist are left as they are.
+ */
+int crypto_engine_spread(FILE *f, const char *str)
+{
+	unsigned long count;
+	char *end;
+
+	count = strtoul(str, &end, 10);
+	if (*end != '\0' || count < 1 || count > CRYPTO_SA_SPREAD_MAX) {
+		if (f)
+			fprintf(f, "error invalid spread, must be 1-%u\n",
+				CRYPTO_SA_SPREAD_MAX);
+		return -1;
+	}
+
+	pmd_spread = count;
+
+	return f ? crypto_engine_probe(f) : 0;
+}
+
+int crypto_engine_inline(FILE *f, const char *str)
+{
+	unsigned long pps;
+	char *end;
+
+	pps = strtoul(str, &end, 10);
+	if (*end != '\0' || pps > UINT32_MAX) {
+		if (f)
+			fprintf(f, "error invalid inline packet rate\n");
+		return -1;
+	}
+
+	CMM_STORE_SHARED(pmd_inline_pps, pps);
+
+	return f ? crypto_engine_probe(f) : 0;
+}
+
+/*
+ * Try to take over the queue of a PMD to run crypto on the calling
+ * forwarding lcore. Only done while the PMD is lightly loaded, and
+ * while its ring is empty so that the packets cannot overtake any
+ * already queued to the crypto thread.
+ *
+ * On success the PMD is locked until crypto_pmd_inline_end().
+ */
+bool crypto_pmd_inline_begin(int dev_id, enum crypto_xfrm xfrm)
+{
+	uint32_t threshold = CMM_LOAD_SHARED(pmd_inline_pps);
+	struct crypto_pmd *pmd;
+
+	if (likely(!threshold))
+		return false;
+
+	if (unlikely(dev_id < 0 || dev_id >= MAX_CRYPTO_PMD))
+		return false;
+
+	pmd = rcu_dereference(crypto_pmd_devs[dev_id]);
+	if (!pmd || pmd->rates[xfrm].packet_rate >= threshold)
+		return false;
+
+	if (!rte_spinlock_trylock(&pmd->lock[xfrm]))
+		return false;
+
+	if (!rte_ring_empty(pmd->q_pair.q[xfrm])) {
+		rte_spinlock_unlock(&pmd->lock[xfrm]);
+		return false;
+	}
+	return true;
+}
+
+void crypto_pmd_inline_end(int dev_id, enum crypto_xfrm xfrm,
+			   uint32_t packets, uint64_t bytes)
+{
+	struct crypto_pmd *pmd = rcu_dereference(crypto_pmd_devs[dev_id]);
+
+	pmd->cnt[xfrm].packets += packets;
+	pmd->cnt[xfrm].bytes += bytes;
+	rte_spinlock_unlock(&pmd->lock[xfrm]);
+}
+
 /*
  * Return a PMD to be used by the caller, either reusing an
  * existing PMD or create a new one. If a new one is created
@@ -470,10 +581,12 @@ unsigned int crypto_pmd_walk_per_xfrm(struct cds_list_head *pmd_head,
 	cds_list_for_each_entry_rcu(pmd, pmd_head, next) {
 		for (q = MIN_CRYPTO_XFRM; q < MAX_CRYPTO_XFRM; q++) {
 			pkts = bytes = 0;
+			rte_spinlock_lock(&pmd->lock[q]);
 			rc = (cb)(pmd->dev_id, q, pmd->q_pair.q[q],
 				  &bytes, &pkts);
 			pmd->cnt[q].bytes += bytes;
 			pmd->cnt[q].packets += pkts;
+			rte_spinlock_unlock(&pmd->lock[q]);
 			total_pkts += pkts;
 			if (!rc)
 				break;
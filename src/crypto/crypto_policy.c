@@ -13,7 +13,6 @@
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
-#include <rte_atomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -45,6 +44,7 @@
 #include "crypto/crypto_main.h"
 #include "crypto/crypto_policy.h"
 #include "crypto/crypto_policy_cache.h"
+#include "crypto/crypto_policy_cls.h"
 #include "crypto/crypto_sadb.h"
 #include "crypto/esp.h"
 #include "if_var.h"
@@ -147,12 +147,6 @@ struct policy_rule_key {
 	const struct xfrm_mark *mark;
 };
 
-#define PR_CACHE_HASH_MIN  8
-#define PR_CACHE_HASH_MAX  2048
-
-#define PR_CACHE_MAX_COUNT  4096
-#define PR_CACHE_MAX_MARKER  (PR_CACHE_MAX_COUNT + 1)
-
 bool policy_cache_disabled;
 
 /*
@@ -286,34 +280,41 @@ static bool tagmap_section_free(struct tagmap_section *tms, int bit)
 	return false;
 }
 
-/* PR cache management */
-static inline void
-pr_cache_entry_free(struct rcu_head *head)
-{
-	free(caa_container_of(head, struct policy_cache_rule,
-			      policy_cache_rcu));
-}
+/*
+ * PR cache management
+ *
+ * Each lcore caches the result of its IPv4 policy lookups, including
+ * that no policy matched, in a set associative table of its own. A
+ * miss replaces the least recently used entry of the set, and as only
+ * the owning lcore writes its table no locking is needed.
+ *
+ * Rather than flushing every table when the policies change, the
+ * generation is bumped, which leaves all existing entries stale. The
+ * generation is sampled before the policy lookup so a result from the
+ * ruleset being replaced is never cached as current.
+ */
+static uint32_t pr_cache_gen = 1;
+static uint32_t pr_cache_size = POLICY_CACHE_SIZE;
 
-static inline void
-pr_cache_entry_destroy(struct policy_cache_rule *pr_cache)
+static void
+pr_cache_invalidate(void)
 {
-	call_rcu(&pr_cache->policy_cache_rcu, pr_cache_entry_free);
+	uint32_t gen = CMM_LOAD_SHARED(pr_cache_gen) + 1;
+
+	/* Zero is the generation of an entry never used */
+	if (unlikely(gen == 0))
+		gen = 1;
+	CMM_STORE_SHARED(pr_cache_gen, gen);
 }
 
-static inline int
-pr_cache_match(struct cds_lfht_node *node, const void *key)
+static inline bool
+pr_cache_match(const struct policy_cache_rule *pr_cache,
+	       const struct pr_cache_hash_key *pr_cache_key)
 {
-	const struct pr_cache_hash_key *pr_cache_key = key;
-	const struct policy_cache_rule *pr_cache = caa_container_of(
-		node, const struct policy_cache_rule, pr_node);
-
-	if ((pr_cache->key.src != pr_cache_key->src) ||
-	    (pr_cache->key.dst != pr_cache_key->dst) ||
-	    (pr_cache->key.proto != pr_cache_key->proto) ||
-	    (pr_cache->key.vrfid != pr_cache_key->vrfid))
-		return 0;
-
-	return 1;
+	return (pr_cache->key.src == pr_cache_key->src) &&
+		(pr_cache->key.dst == pr_cache_key->dst) &&
+		(pr_cache->key.proto == pr_cache_key->proto) &&
+		(pr_cache->key.vrfid == pr_cache_key->vrfid);
 }
 
 _Static_assert(sizeof(struct pr_cache_hash_key) % 4 == 0,
@@ -325,38 +326,6 @@ pr_cache_hash(const struct pr_cache_hash_key *h_key)
 	return rte_jhash(h_key, sizeof(*h_key) / 4, POLICY_CACHE_HASH_SEED);
 }
 
-static inline void
-pr_cache_entry_remove(struct crypto_pkt_buffer *cpb,
-		      struct cds_lfht *table,
-		      struct policy_cache_rule *pr_cache)
-{
-	/*
-	 * To avoid a race where an entry has been added but the count
-	 * hasn't been bumped
-	 */
-	if (rte_atomic16_read(&cpb->pr_cache_count) == 0)
-		return;
-
-	cds_lfht_del(table, &pr_cache->pr_node);
-	pr_cache_entry_destroy(pr_cache);
-	rte_atomic16_dec(&cpb->pr_cache_count);
-}
-
-static int
-pr_cache_insert(struct cds_lfht *tbl, struct policy_cache_rule *pr_cache,
-		const struct pr_cache_hash_key *h_key)
-{
-	struct cds_lfht_node *ret_node;
-
-	cds_lfht_node_init(&pr_cache->pr_node);
-	uint32_t hash = pr_cache_hash(h_key);
-
-	ret_node = cds_lfht_add_unique(tbl, hash, pr_cache_match, h_key,
-				       &pr_cache->pr_node);
-
-	return (ret_node != &pr_cache->pr_node) ? -1 : 0;
-}
-
 static inline void
 pr_cache_parse_hdr4(struct rte_mbuf *m, struct pr_cache_hash_key *h)
 {
@@ -368,14 +337,29 @@ pr_cache_parse_hdr4(struct rte_mbuf *m, struct pr_cache_hash_key *h)
 	h->vrfid = pktmbuf_get_vrf(m);
 }
 
+/* Move entry i of the set to the front, ahead of those before it */
+static inline struct policy_cache_rule *
+pr_cache_set_promote(struct pr_cache_set *set, unsigned int i)
+{
+	struct policy_cache_rule entry;
+
+	if (likely(i == 0))
+		return &set->way[0];
+
+	entry = set->way[i];
+	memmove(&set->way[1], &set->way[0], i * sizeof(set->way[0]));
+	set->way[0] = entry;
+	return &set->way[0];
+}
+
 static struct policy_cache_rule *
-pr_cache_lookup(struct rte_mbuf *m, bool v4)
+pr_cache_lookup(struct rte_mbuf *m, bool v4, uint32_t gen)
 {
-	struct cds_lfht_iter iter;
-	struct cds_lfht_node *node;
 	struct crypto_pkt_buffer *cpb = RTE_PER_LCORE(crypto_pkt_buffer);
 	struct pr_cache_hash_key h_key;
-	struct cds_lfht *table;
+	struct pr_cache_table *table;
+	struct pr_cache_set *set;
+	unsigned int i;
 
 	/* Any host generated or v6 don't make use of the PR cache table*/
 	if (policy_cache_disabled || !cpb || !v4)
@@ -384,159 +368,155 @@ pr_cache_lookup(struct rte_mbuf *m, bool v4)
 	table = rcu_dereference(cpb->pr_cache_tbl);
 	if (!table)
 		return NULL;
-	pr_cache_parse_hdr4(m, &h_key);
-	cds_lfht_lookup(table, pr_cache_hash(&h_key),
-			pr_cache_match, &h_key,
-			&iter);
 
-	node = cds_lfht_iter_get_node(&iter);
-	if (node)
-		return caa_container_of(node, struct policy_cache_rule,
-					pr_node);
-	else
-		return NULL;
+	pr_cache_parse_hdr4(m, &h_key);
+	set = &table->sets[pr_cache_hash(&h_key) & table->mask];
+	for (i = 0; i < PR_CACHE_WAYS; i++) {
+		if (set->way[i].gen == gen &&
+		    pr_cache_match(&set->way[i], &h_key))
+			return pr_cache_set_promote(set, i);
+	}
+	return NULL;
 }
 
-static int
-pr_cache_add(struct crypto_pkt_buffer *cpb, struct policy_rule *pr,
-	     struct rte_mbuf *m, bool v4, bool seen_by_crypto,
-	     int dir)
+/*
+ * Return the entry for the packet's flow, claiming the first stale or
+ * else the least recently used entry of its set if there is none.
+ */
+static struct policy_cache_rule *
+pr_cache_entry_get(struct crypto_pkt_buffer *cpb, struct rte_mbuf *m,
+		   uint32_t gen)
 {
-	struct policy_cache_rule *pr_cache;
-	int error;
 	struct pr_cache_hash_key h_key;
-	struct cds_lfht *table  = rcu_dereference(cpb->pr_cache_tbl);
+	struct pr_cache_table *table;
+	struct pr_cache_set *set;
+	unsigned int i, victim = PR_CACHE_WAYS - 1;
 
-	/* Any v6 don't make use of the PR cache table */
-	if (!v4 || !table)
-		return -1;
+	table = rcu_dereference(cpb->pr_cache_tbl);
+	if (!table)
+		return NULL;
 
-	/*
-	 * In case this is an input policy match, check to see if the
-	 * cache exists based on a previous output policy match and if so
-	 * update the cache to indicate that the input policy has been checked
-	 * for unencrypted packets
-	 */
-	if (dir == XFRM_POLICY_IN) {
-		pr_cache = pr_cache_lookup(m, v4);
-		if (pr_cache) {
-			pr_cache->in_rule_checked = 1;
-			pr_cache->in_rule_drop =
-				(pr->action == XFRM_POLICY_BLOCK);
-			return 0;
+	pr_cache_parse_hdr4(m, &h_key);
+	set = &table->sets[pr_cache_hash(&h_key) & table->mask];
+	for (i = 0; i < PR_CACHE_WAYS; i++) {
+		if (set->way[i].gen != gen) {
+			if (victim == PR_CACHE_WAYS - 1)
+				victim = i;
+			continue;
 		}
+		if (pr_cache_match(&set->way[i], &h_key))
+			return pr_cache_set_promote(set, i);
 	}
-	pr_cache_parse_hdr4(m, &h_key);
-	pr_cache = malloc_aligned(sizeof(struct policy_cache_rule));
-	if (unlikely(pr_cache == NULL))
-		return -1;
 
-	pr_cache->key = h_key;
-	pr_cache->pr = pr;
+	set->way[victim] = (struct policy_cache_rule) {
+		.key = h_key,
+		.gen = gen,
+	};
+	return pr_cache_set_promote(set, victim);
+}
 
-	error = pr_cache_insert(table, pr_cache, &h_key);
+/* Does the entry hold the result of the output policy check? */
+static inline bool
+pr_cache_out_checked(const struct policy_cache_rule *pr_cache)
+{
+	return pr_cache->pr || pr_cache->out_no_match;
+}
 
-	if (unlikely(error != 0)) {
-		free(pr_cache);
+/*
+ * Cache the result of a policy lookup, pr being the policy found or
+ * NULL if none matches. An input policy found for a flow with a cached
+ * output policy check only adds the input check result.
+ */
+static int
+pr_cache_add(struct crypto_pkt_buffer *cpb, struct policy_rule *pr,
+	     struct rte_mbuf *m, bool seen_by_crypto,
+	     int dir, uint32_t gen)
+{
+	struct policy_cache_rule *pr_cache;
+
+	pr_cache = pr_cache_entry_get(cpb, m, gen);
+	if (unlikely(pr_cache == NULL))
 		return -1;
+
+	if (dir == XFRM_POLICY_OUT || !pr_cache_out_checked(pr_cache)) {
+		pr_cache->pr = pr;
+		pr_cache->out_no_match = (!pr && dir == XFRM_POLICY_OUT);
 	}
 	if (!seen_by_crypto) {
 		pr_cache->in_rule_checked = 1;
-		pr_cache->in_rule_drop = (pr->action == XFRM_POLICY_BLOCK);
+		pr_cache->in_rule_drop =
+			(pr && pr->action == XFRM_POLICY_BLOCK);
 	}
-	rte_atomic16_inc(&cpb->pr_cache_count);
 	return 0;
 }
 
-struct cds_lfht *
-pr_cache_init(void)
+static void
+pr_cache_table_free(struct rcu_head *head)
 {
-	struct cds_lfht *pr_cache_tbl;
-
-	pr_cache_tbl = cds_lfht_new(PR_CACHE_HASH_MIN,
-				    PR_CACHE_HASH_MIN,
-				    PR_CACHE_HASH_MAX,
-				    CDS_LFHT_AUTO_RESIZE,
-				    NULL);
-	if (pr_cache_tbl == NULL)
-		POLICY_ERR("Failed to allocate PR cache table\n");
-
-	return pr_cache_tbl;
+	free(caa_container_of(head, struct pr_cache_table, rcu));
 }
 
-static inline void
-pr_cache_empty_table(struct crypto_pkt_buffer *cpb)
+struct pr_cache_table *
+pr_cache_init(void)
 {
-	struct policy_cache_rule *pr_cache;
-	struct cds_lfht_iter iter;
-	struct cds_lfht *table;
+	uint32_t nsets = CMM_LOAD_SHARED(pr_cache_size) / PR_CACHE_WAYS;
+	struct pr_cache_table *table;
 
-	table = rcu_dereference(cpb->pr_cache_tbl);
-	if (!table)
-		return;
+	table = zmalloc_aligned(sizeof(*table) +
+				nsets * sizeof(table->sets[0]));
+	if (table == NULL) {
+		POLICY_ERR("Failed to allocate PR cache table\n");
+		return NULL;
+	}
+	table->mask = nsets - 1;
 
-	cds_lfht_for_each_entry(table, &iter, pr_cache, pr_node)
-		pr_cache_entry_remove(cpb, table, pr_cache);
+	return table;
 }
 
 /*
- * This may be called in an rcu_callback or in the master thread. In the
- * rcu_callback it must be in clear_only mode.
+ * Set the number of entries in each lcore's cache, replacing the
+ * tables in use. Must be called from the main thread.
  */
-static void
-pr_cache_invalidate(bool disable, bool clear_only)
+int crypto_policy_cache_size(FILE *f, const char *str)
 {
 	unsigned int lcore_id;
-
-	RTE_LCORE_FOREACH(lcore_id) {
-		struct crypto_pkt_buffer *cpb =
-			rcu_dereference(cpbdb[lcore_id]);
-
-		if (unlikely(!cpb))
-			continue;
-
-		if (cpb->pr_cache_tbl) {
-			pr_cache_empty_table(cpb);
-			if (disable && !clear_only) {
-				if (cds_lfht_destroy(cpb->pr_cache_tbl,
-						     NULL))
-					POLICY_ERR(
-						"Cache tbl destroy failed\n");
-
-				rcu_assign_pointer(
-					cpb->pr_cache_tbl, NULL);
-			}
-		} else {
-			if (!disable && !clear_only)
-				cpb->pr_cache_tbl = pr_cache_init();
-		}
+	unsigned long size;
+	char *end;
+
+	size = strtoul(str, &end, 10);
+	if (*end != '\0' || size < PR_CACHE_WAYS ||
+	    size > POLICY_CACHE_SIZE_MAX || !rte_is_power_of_2(size)) {
+		if (f)
+			fprintf(f,
+				"error invalid cache size, must be a power of 2 from %u to %u\n",
+				PR_CACHE_WAYS, POLICY_CACHE_SIZE_MAX);
+		return -1;
 	}
 
-	POLICY_INFO("Crypto policy cache %s\n",
-		    disable && !clear_only ? "disabled" : "invalidated");
-}
-
-void
-pr_cache_timer_handler(struct rte_timer *timer __rte_unused,
-		       void *arg __rte_unused)
-{
-	unsigned int lcore_id;
+	CMM_STORE_SHARED(pr_cache_size, size);
 
 	RTE_LCORE_FOREACH(lcore_id) {
 		struct crypto_pkt_buffer *cpb =
 			rcu_dereference(cpbdb[lcore_id]);
+		struct pr_cache_table *table, *old;
 
 		if (unlikely(!cpb))
 			continue;
 
-		if (cpb->pr_cache_tbl &&
-		    (rte_atomic16_read(&cpb->pr_cache_count) >
-		     PR_CACHE_MAX_COUNT)) {
-			POLICY_INFO("Clearing the cache on core %d: Aged out\n",
-				    lcore_id);
-			pr_cache_empty_table(cpb);
+		table = pr_cache_init();
+		if (!table) {
+			if (f)
+				fprintf(f, "error allocating cache\n");
+			return -1;
 		}
+		old = cpb->pr_cache_tbl;
+		rcu_assign_pointer(cpb->pr_cache_tbl, table);
+		if (old)
+			call_rcu(&old->rcu, pr_cache_table_free);
 	}
+
+	POLICY_INFO("Crypto policy cache size %lu\n", size);
+	return 0;
 }
 
 static unsigned int allocate_tag(struct tagmap *tm)
@@ -990,7 +970,7 @@ static void policy_rule_rcu_invalidate(struct rcu_head *head)
 	 * we need to make sure that the policy rule is no longer in
 	 * any of the pr caches.
 	 */
-	pr_cache_invalidate(true, true);
+	pr_cache_invalidate();
 	/*
 	 * Now the PR is gone from the cache, but other threads
 	 * may still hold references to it, so wait for another
@@ -1174,6 +1154,13 @@ static bool policy_rule_update_npf(struct policy_rule *pr)
 	return true;
 }
 
+static inline struct crypto_policy_cls *
+policy_rule_cls(const struct crypto_vrf_ctx *vrf_ctx, int dir)
+{
+	return dir == XFRM_POLICY_IN ?
+		vrf_ctx->input_policy_cls : vrf_ctx->output_policy_cls;
+}
+
 #define POL_VRF_STRLEN 16
 static bool policy_rule_add_to_npf(struct policy_rule *pr)
 {
@@ -1262,6 +1249,18 @@ static bool policy_rule_add_to_npf(struct policy_rule *pr)
 		     pr->dir == XFRM_POLICY_IN ? "input" : "output",
 		     pr->rule_index, buffer);
 
+	if (crypto_policy_cls_add(policy_rule_cls(vrf_ctx, pr->dir), &pr->sel,
+				  pr->rule_index, pr) < 0) {
+		POLICY_ERR("Failed to classify %s crypto policy tag %d\n",
+			   pr->dir == XFRM_POLICY_IN ? "input" : "output",
+			   pr->tag);
+		npf_cfg_rule_delete(NPF_RULE_CLASS_IPSEC, group_name,
+				    pr->rule_index, NULL);
+		if (attach_group)
+			goto failed_add_rule;
+		return false;
+	}
+
 	if (pr->sel.family == AF_INET) {
 		if (++vrf_ctx->crypto_live_ipv4_policies == 1)
 			pl_node_add_feature_by_inst(&ipv4_ipsec_out_feat,
@@ -1327,6 +1326,9 @@ static void policy_rule_remove_from_npf(struct policy_rule *pr,
 	if (!vrf_ctx)
 		return;
 
+	crypto_policy_cls_del(policy_rule_cls(vrf_ctx, pr->dir), &pr->sel,
+			      rule_index, pr);
+
 	snprintf(vrf_buf, sizeof(vrf_buf), "%d",
 		 vrf_get_external_id(pr->vrfid));
 
@@ -1559,8 +1561,10 @@ static void crypto_npf_cfg_commit_all_timer_handler(
 	void *arg __rte_unused)
 {
 	ASSERT_MASTER();
-	if (crypto_npf_cfg_commit_count)
+	if (crypto_npf_cfg_commit_count) {
 		npf_cfg_commit_all();
+		pr_cache_invalidate();
+	}
 
 	crypto_npf_cfg_commit_count = 0;
 }
@@ -1586,6 +1590,7 @@ static void crypto_npf_cfg_commit_all(struct policy_rule *pr __unused)
 	/* Force the commit if we have batched up too many */
 	if (crypto_npf_cfg_commit_count == CRYPTO_NPF_CFG_COMMIT_FORCE_COUNT) {
 		npf_cfg_commit_all();
+		pr_cache_invalidate();
 		crypto_npf_cfg_commit_count = 0;
 	}
 }
@@ -1674,13 +1679,11 @@ policy_rule_update(struct policy_rule *pr,
 					    old_rule_index);
 
 		crypto_npf_cfg_commit_all(pr);
-		if ((pr->dir == XFRM_POLICY_OUT) &&
-		    (!was_vti_policy || !pr->vti_tunnel_policy))
-			pr_cache_invalidate(policy_cache_disabled, false);
 	} else if (changed) {
 		policy_rule_update_npf(pr);
 		crypto_npf_cfg_commit_all(pr);
 	}
+	pr_cache_invalidate();
 
 	/* Check if this update means we need to rebind */
 	policy_update_pending_vfp_bind(pr->vrfid, pr);
@@ -1733,16 +1736,15 @@ int crypto_policy_add(const struct xfrm_userpolicy_info *usr_policy,
 		return -1;
 	}
 	crypto_npf_cfg_commit_all(pr);
+	pr_cache_invalidate();
 	/*
 	 * Any policy rule added, where the port is specified as part of the
 	 * selection criteria, the cache is disabled.
 	 */
 	if (pr->dir == XFRM_POLICY_OUT) {
-		if (!policy_cache_disabled) {
+		if (!policy_cache_disabled)
 			policy_cache_disabled = ((pr->sel.sport > 0) ||
 						 (pr->sel.dport > 0));
-			pr_cache_invalidate(policy_cache_disabled, false);
-		}
 
 		/*
 		 * There may already be a pending binding to a feature
@@ -1823,10 +1825,8 @@ void crypto_policy_delete(const struct xfrm_userpolicy_id *id,
 		    ((pr->sel.sport > 0) || (pr->sel.dport > 0)) &&
 		    all_other_policies_can_be_cached(pr))
 			policy_cache_disabled = false;
-
-		if (!policy_cache_disabled)
-			pr_cache_invalidate(policy_cache_disabled, false);
 	}
+	pr_cache_invalidate();
 
 	policy_rule_remove_from_hash_tables(pr);
 	policy_rule_destroy(pr);
@@ -2435,57 +2435,70 @@ void crypto_show_cache(FILE *f, const char *str)
 	jsonw_start_array(wr);
 
 	RTE_LCORE_FOREACH(i) {
-		struct policy_cache_rule *pr_cache;
-		struct cds_lfht_iter iter;
-		struct cds_lfht *table;
 		struct crypto_pkt_buffer *cpb = rcu_dereference(cpbdb[i]);
-		bool disabled = false;
+		uint32_t gen = CMM_LOAD_SHARED(pr_cache_gen);
+		struct pr_cache_table *table = NULL;
+		unsigned int set, way, count = 0;
 
 		jsonw_uint_field(wr, "core_id", i);
 
-		if (!cpb) {
-			disabled = true;
-		} else {
+		if (cpb)
 			table = rcu_dereference(cpb->pr_cache_tbl);
-			if (!table)
-				disabled = true;
-		}
-		if (disabled) {
+		if (!table || policy_cache_disabled) {
 			jsonw_string_field(wr, "pr_cache", "disabled");
 			continue;
 		}
+
+		for (set = 0; set <= table->mask; set++)
+			for (way = 0; way < PR_CACHE_WAYS; way++)
+				if (table->sets[set].way[way].gen == gen)
+					count++;
+
 		jsonw_string_field(wr, "pr_cache", "enabled");
 		jsonw_start_object(wr);
-		jsonw_uint_field(wr, "PR_Cache_count",
-				 rte_atomic16_read(&cpb->pr_cache_count));
+		jsonw_uint_field(wr, "PR_Cache_count", count);
+		jsonw_uint_field(wr, "PR_Cache_size",
+				 (table->mask + 1) * PR_CACHE_WAYS);
 		jsonw_end_object(wr);
 		if (!detail)
 			continue;
 
 		jsonw_start_array(wr);
-		cds_lfht_for_each_entry(table, &iter,
-					pr_cache, pr_node) {
-			jsonw_start_object(wr);
-			jsonw_string_field(wr, "dst",
-					   inet_ntop(AF_INET,
-						     &pr_cache->key.dst,
-						     addrbuf,
-						     sizeof(addrbuf)));
-			jsonw_string_field(wr, "src",
-					   inet_ntop(AF_INET,
-						     &pr_cache->key.src,
-						     addrbuf,
-						     sizeof(addrbuf)));
-			jsonw_uint_field(wr, "proto", pr_cache->key.proto);
-			jsonw_uint_field(wr, "PR_index",
-					 pr_cache->pr->rule_index);
-			jsonw_uint_field(wr, "PR_Tag",
-					 pr_cache->pr->tag);
-			jsonw_uint_field(wr, "IN_rule_checked",
-					 pr_cache->in_rule_checked);
-			jsonw_uint_field(wr, "IN_rule_drop",
-					 pr_cache->in_rule_drop);
-			jsonw_end_object(wr);
+		for (set = 0; set <= table->mask; set++) {
+			for (way = 0; way < PR_CACHE_WAYS; way++) {
+				struct policy_cache_rule *pr_cache =
+					&table->sets[set].way[way];
+
+				if (pr_cache->gen != gen)
+					continue;
+
+				jsonw_start_object(wr);
+				jsonw_string_field(wr, "dst",
+						   inet_ntop(AF_INET,
+							     &pr_cache->key.dst,
+							     addrbuf,
+							     sizeof(addrbuf)));
+				jsonw_string_field(wr, "src",
+						   inet_ntop(AF_INET,
+							     &pr_cache->key.src,
+							     addrbuf,
+							     sizeof(addrbuf)));
+				jsonw_uint_field(wr, "proto",
+						 pr_cache->key.proto);
+				if (pr_cache->pr) {
+					jsonw_uint_field(wr, "PR_index",
+						 pr_cache->pr->rule_index);
+					jsonw_uint_field(wr, "PR_Tag",
+						 pr_cache->pr->tag);
+				}
+				jsonw_uint_field(wr, "OUT_no_match",
+						 pr_cache->out_no_match);
+				jsonw_uint_field(wr, "IN_rule_checked",
+						 pr_cache->in_rule_checked);
+				jsonw_uint_field(wr, "IN_rule_drop",
+						 pr_cache->in_rule_drop);
+				jsonw_end_object(wr);
+			}
 		}
 		jsonw_end_array(wr);
 	}
@@ -2538,52 +2551,52 @@ int crypto_policy_init(void)
 	return 0;
 }
 
+/*
+ * The crypto context of a VRF, if it has any policies for the
+ * forwarding path to check.
+ */
+static inline struct crypto_vrf_ctx *crypto_policy_vrf_active(vrfid_t vrfid)
+{
+	struct crypto_vrf_ctx *vrf_ctx = crypto_vrf_find(vrfid);
+
+	if (!vrf_ctx || !(vrf_ctx->crypto_live_ipv4_policies +
+			  vrf_ctx->crypto_live_ipv6_policies))
+		return NULL;
+	return vrf_ctx;
+}
+
 bool crypto_policy_outbound_match(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 				  uint16_t ether)
 {
-	struct npf_config *npf_conf = vrf_get_npf_conf_rcu(in_ifp->if_vrfid);
+	struct crypto_vrf_ctx *vrf_ctx;
 
-	if (!npf_active(npf_conf, NPF_IPSEC))
+	vrf_ctx = crypto_policy_vrf_active(in_ifp->if_vrfid);
+	if (!vrf_ctx)
 		return false;
 
-	const npf_ruleset_t *ruleset
-		= npf_get_ruleset(npf_conf, NPF_RS_IPSEC);
-	npf_result_t result
-		= npf_hook_notrack(ruleset, mbuf, in_ifp, PFIL_OUT, 0, ether);
-
-	return (result.decision != NPF_DECISION_UNMATCHED);
+	return crypto_policy_cls_lookup(vrf_ctx->output_policy_cls, *mbuf,
+					ether == htons(ETHER_TYPE_IPv4));
 }
 
 bool crypto_policy_outbound_active(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 				   uint32_t *af, void **addr, uint16_t eth_type)
 {
-	struct npf_config *npf_conf = vrf_get_npf_conf_rcu(in_ifp->if_vrfid);
+	struct crypto_vrf_ctx *vrf_ctx;
 	struct policy_rule *pr;
-	npf_result_t result;
-
-	if (npf_active(npf_conf, NPF_IPSEC)) {
-		result = npf_hook_notrack(npf_get_ruleset(npf_conf,
-					  NPF_RS_IPSEC), mbuf, in_ifp,
-					  PFIL_OUT, 0, eth_type);
-		if (likely(result.decision == NPF_DECISION_UNMATCHED))
-			return false;
 
-		/* Only in the case of an ALLOW policy do we set a tag */
-		if (unlikely(!result.tag_set)) {
-			*af = 0;
-			return true;
-		}
+	vrf_ctx = crypto_policy_vrf_active(in_ifp->if_vrfid);
+	if (!vrf_ctx)
+		return false;
 
-		pr = policy_rule_find_by_tag(result.tag, XFRM_POLICY_OUT);
-		if (unlikely(!pr))
-			return false;
+	pr = crypto_policy_cls_lookup(vrf_ctx->output_policy_cls, *mbuf,
+				      eth_type == htons(ETHER_TYPE_IPv4));
+	if (likely(!pr))
+		return false;
 
-		*af = pr->output_peer_af;
-		*addr = &pr->output_peer;
+	*af = pr->output_peer_af;
+	*addr = &pr->output_peer;
 
-		return true;
-	}
-	return false;
+	return true;
 }
 
 /*
@@ -2649,17 +2662,20 @@ bool crypto_policy_check_outbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 	vrfid_t vrfid = pktmbuf_get_vrf(*mbuf);
 	bool v4 = (eth_type == htons(ETHER_TYPE_IPv4));
 	bool freed = false;
-	struct npf_config *npf_conf = vrf_get_npf_conf_rcu(vrfid);
+	struct crypto_vrf_ctx *vrf_ctx;
 	bool seen_by_crypto;
+	uint32_t gen;
 
-	if (likely(!npf_active(npf_conf, NPF_IPSEC)))
+	vrf_ctx = crypto_policy_vrf_active(vrfid);
+	if (likely(!vrf_ctx))
 		return false;
 
 	seen_by_crypto = ((*mbuf)->ol_flags & PKT_RX_SEEN_BY_CRYPTO);
 	/*
 	 * Do we have a cached lookup result for this policy?
 	 */
-	pr_cache = pr_cache_lookup(*mbuf, v4);
+	gen = CMM_LOAD_SHARED(pr_cache_gen);
+	pr_cache = pr_cache_lookup(*mbuf, v4, gen);
 
 	/*
 	 * Use the PR cache under following conditions:
@@ -2667,55 +2683,51 @@ bool crypto_policy_check_outbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 	 * - received an UNencrypted packet and we have cached the input
 	 *   policy check result.
 	 */
-	if (pr_cache && pr_cache->pr &&
+	if (pr_cache && pr_cache_out_checked(pr_cache) &&
 	    (seen_by_crypto || pr_cache->in_rule_checked)) {
 		IPSEC_CNT_INC(PR_CACHE_HIT);
 		pr = pr_cache->pr;
+		if (!pr) {
+			if (!seen_by_crypto && pr_cache->in_rule_drop)
+				goto drop;
+			return false;
+		}
 	} else {
 		struct crypto_pkt_buffer *cpb =
 			RTE_PER_LCORE(crypto_pkt_buffer);
-		const npf_ruleset_t *rlset =
-			npf_get_ruleset(npf_conf, NPF_RS_IPSEC);
+		int dir = XFRM_POLICY_OUT;
 
 		/*
 		 * If this packet was received encrypted,  then we don't need to
 		 * check the input policy.  Otherwise check the policy to see if
 		 * it should have been received encrypted,  and so now needs to
 		 * be dropped.
-		 */
-		int dir = PFIL_OUT | (seen_by_crypto ? 0 : PFIL_IN);
-
-		/*
-		 * Packets matching an input policy must be dropped if
-		 * they were not encrypted when originally received,
-		 * and this routine is only called for such unencrypted
-		 * packets.
-		 *
-		 * If no policy matches we find NPF_DECISION_UNMATCHED.
-		 * Otherwise one of NPF_DECISION_PASS (for an ALLOW policy)
-		 * or NPF_DECISION_BLOCK (for a BLOCK policy).
 		 *
-		 * Only block rules are currently used in the input policy.
+		 * Packets matching an input policy must be dropped if
+		 * they were not encrypted when originally received.
+		 * The input policies are checked first, as the NPF
+		 * input group was ahead of the output group.
 		 */
-		npf_result_t result =
-			npf_hook_notrack(rlset, mbuf, in_ifp, dir, 0, eth_type);
+		if (!seen_by_crypto) {
+			pr = crypto_policy_cls_lookup(vrf_ctx->input_policy_cls,
+						      *mbuf, v4);
+			if (pr)
+				dir = XFRM_POLICY_IN;
+		}
+		if (!pr)
+			pr = crypto_policy_cls_lookup(
+				vrf_ctx->output_policy_cls, *mbuf, v4);
 
 		/*
 		 * No input and no output policy matched,  allow normal
 		 * processing
 		 */
-		if (likely(result.decision == NPF_DECISION_UNMATCHED))
+		if (likely(!pr)) {
+			if (cpb && v4 && !policy_cache_disabled &&
+			    pr_cache_add(cpb, NULL, *mbuf, seen_by_crypto,
+					 XFRM_POLICY_OUT, gen) == 0)
+				IPSEC_CNT_INC(PR_CACHE_ADD);
 			return false;
-
-		if (likely(result.tag_set)) {
-			dir = XFRM_POLICY_OUT;
-			pr = policy_rule_find_by_tag(result.tag, dir);
-			if (!pr) {
-				pr = policy_rule_find_by_tag(result.tag,
-							     XFRM_POLICY_IN);
-				if (pr)
-					dir = XFRM_POLICY_IN;
-			}
 		}
 
 		/*
@@ -2735,13 +2747,10 @@ bool crypto_policy_check_outbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 				return false;
 		}
 
-		if (cpb && !policy_cache_disabled && pr &&
-		    (rte_atomic16_read(&cpb->pr_cache_count) <
-		     PR_CACHE_MAX_MARKER)) {
+		if (cpb && v4 && !policy_cache_disabled && pr) {
 			IPSEC_CNT_INC(PR_CACHE_MISS);
-			if (pr_cache_add(cpb, pr, *mbuf, v4,
-					 seen_by_crypto,
-					 dir) != 0)
+			if (pr_cache_add(cpb, pr, *mbuf, seen_by_crypto,
+					 dir, gen) != 0)
 				IPSEC_CNT_INC(PR_CACHE_ADD_FAIL);
 			else
 				IPSEC_CNT_INC(PR_CACHE_ADD);
@@ -2860,9 +2869,11 @@ crypto_policy_check_inbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 	bool v4 = (eth_type == htons(ETHER_TYPE_IPv4));
 	bool freed = false;
 	vrfid_t vrfid = pktmbuf_get_vrf(*mbuf);
-	struct npf_config *npf_conf = vrf_get_npf_conf_rcu(vrfid);
+	struct crypto_vrf_ctx *vrf_ctx;
+	uint32_t gen;
 
-	if (likely(!npf_active(npf_conf, NPF_IPSEC)))
+	vrf_ctx = crypto_policy_vrf_active(vrfid);
+	if (likely(!vrf_ctx))
 		return false;
 
 	if ((*mbuf)->ol_flags & PKT_RX_SEEN_BY_CRYPTO)
@@ -2871,19 +2882,16 @@ crypto_policy_check_inbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 	/*
 	 * Use the PR cache only if we have already cached the input check.
 	 */
-	pr_cache = pr_cache_lookup(*mbuf, v4);
-	if (pr_cache && pr_cache->pr && pr_cache->in_rule_checked) {
+	gen = CMM_LOAD_SHARED(pr_cache_gen);
+	pr_cache = pr_cache_lookup(*mbuf, v4, gen);
+	if (pr_cache && pr_cache->in_rule_checked) {
 		IPSEC_CNT_INC(PR_CACHE_HIT);
-		if (pr_cache->pr->action == XFRM_POLICY_BLOCK)
+		if (pr_cache->in_rule_drop)
 			goto drop;
 
 	} else {
 		struct crypto_pkt_buffer *cpb =
 			RTE_PER_LCORE(crypto_pkt_buffer);
-		const npf_ruleset_t *rlset =
-			npf_get_ruleset(npf_conf, NPF_RS_IPSEC);
-
-		int dir = PFIL_IN;
 
 		/*
 		 * Packets matching an input policy must be dropped if
@@ -2891,57 +2899,43 @@ crypto_policy_check_inbound(struct ifnet *in_ifp, struct rte_mbuf **mbuf,
 		 * and this routine is only called for such unencrypted
 		 * packets.
 		 *
-		 * If no policy matches we find NPF_DECISION_UNMATCHED.
-		 * Otherwise one of NPF_DECISION_PASS (for an ALLOW policy)
-		 * or NPF_DECISION_BLOCK (for a BLOCK policy).
-		 *
 		 * Only block rules are currently used in the input policy.
 		 */
-		npf_result_t result =
-			npf_hook_notrack(rlset, mbuf, in_ifp, dir, 0, eth_type);
+		pr = crypto_policy_cls_lookup(vrf_ctx->input_policy_cls,
+					      *mbuf, v4);
 
 		/* No input policy matched */
-		if (likely(result.decision == NPF_DECISION_UNMATCHED))
+		if (likely(!pr)) {
+			if (cpb && v4 && !policy_cache_disabled &&
+			    pr_cache_add(cpb, NULL, *mbuf, false,
+					 XFRM_POLICY_IN, gen) == 0)
+				IPSEC_CNT_INC(PR_CACHE_ADD);
 			return false;
+		}
 
-		if (likely(result.tag_set)) {
-			pr = policy_rule_find_by_tag(result.tag,
-						     XFRM_POLICY_IN);
-			if (pr) {
-				/*
-				 * We found an input policy. If it has a
-				 * selector with an ifindex set, then
-				 * check we match.
-				 */
-				if (pr->sel.ifindex) {
-					if (pr->sel.ifindex !=
-					    (int)in_ifp->if_index) {
-						/* We don't have a match */
-						return false;
-					}
-				}
-
-				/*
-				 * We found an input policy, add it to the
-				 * PR cache and drop the packet.
-				 */
-				if (cpb && !policy_cache_disabled && pr &&
-				    (rte_atomic16_read(&cpb->pr_cache_count) <
-				     PR_CACHE_MAX_MARKER)) {
-					IPSEC_CNT_INC(PR_CACHE_MISS);
-					if (pr_cache_add(cpb, pr, *mbuf, v4,
-							 false,
-							 XFRM_POLICY_IN) != 0)
-						IPSEC_CNT_INC(
-							PR_CACHE_ADD_FAIL);
-					else
-						IPSEC_CNT_INC(PR_CACHE_ADD);
-				}
-				if (pr->action == XFRM_POLICY_BLOCK)
-					goto drop;
-			}
+		/*
+		 * We found an input policy. If it has a selector with
+		 * an ifindex set, then check we match.
+		 */
+		if (pr->sel.ifindex &&
+		    pr->sel.ifindex != (int)in_ifp->if_index)
+			/* We don't have a match */
+			return false;
 
+		/*
+		 * We found an input policy, add it to the PR cache and
+		 * drop the packet.
+		 */
+		if (cpb && v4 && !policy_cache_disabled) {
+			IPSEC_CNT_INC(PR_CACHE_MISS);
+			if (pr_cache_add(cpb, pr, *mbuf, false,
+					 XFRM_POLICY_IN, gen) != 0)
+				IPSEC_CNT_INC(PR_CACHE_ADD_FAIL);
+			else
+				IPSEC_CNT_INC(PR_CACHE_ADD);
 		}
+		if (pr->action == XFRM_POLICY_BLOCK)
+			goto drop;
 	}
 	return false;
 
@@ -20,10 +20,10 @@ struct rte_mbuf;
 
 /*
  * Policy tag map hash table size parameters. These must be powers of two.
- * Since we expect a small number policies, we keep the initial size of
- * the hash table small.
+ * Most configurations have few policies, so the initial size of the hash
+ * table is small, but it may grow to hold tens of thousands.
  */
-#define POLICY_RULE_HT_MAX_BUCKETS 64
+#define POLICY_RULE_HT_MAX_BUCKETS 65536
 #define POLICY_RULE_HT_MIN_BUCKETS  8
 
 int crypto_policy_add(const struct xfrm_userpolicy_info *usr_policy,
@@ -16,7 +16,12 @@
 
 struct policy_rule;
 
-#define POLICY_CACHE_SIZE 4096
+/* Default and largest number of entries in each lcore's cache */
+#define POLICY_CACHE_SIZE 16384
+#define POLICY_CACHE_SIZE_MAX (1 << 20)
+
+/* Entries per set, the cache is this many way set associative */
+#define PR_CACHE_WAYS 2
 
 #define POLICY_CACHE_HASH_SEED 0xDEAFCAFE
 
@@ -33,18 +38,32 @@ struct pr_cache_hash_key {
 	vrfid_t vrfid;
 };
 
+/*
+ * A cached policy lookup result. A NULL pr is a negative entry,
+ * out_no_match recording that no policy matched on output, and
+ * in_rule_checked without in_rule_drop that none blocks the flow on
+ * input.  An entry whose gen is not the current one is empty.
+ */
 struct policy_cache_rule {
-	struct cds_lfht_node pr_node;
-	struct rcu_head policy_cache_rcu;
-	struct policy_rule *pr;
 	struct pr_cache_hash_key key;
+	struct policy_rule *pr;
+	uint32_t gen;
 	uint8_t in_rule_checked:1,
 		in_rule_drop:1,
-		PR_UNUSED:6;
-	char SPARE[7];
-	char *padding[0]  __rte_cache_aligned;
+		out_no_match:1,
+		PR_UNUSED:5;
+	char SPARE[3];
 };
 
-void pr_cache_timer_handler(struct rte_timer *, void *arg);
+/* The entries of a set are kept most recently used first */
+struct pr_cache_set {
+	struct policy_cache_rule way[PR_CACHE_WAYS];
+} __rte_cache_aligned;
+
+struct pr_cache_table {
+	uint32_t mask;
+	struct rcu_head rcu;
+	struct pr_cache_set sets[] __rte_cache_aligned;
+};
 
 #endif /* CRYPTO_POLICY_CACHE_H */
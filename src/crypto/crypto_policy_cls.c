@@ -0,0 +1,463 @@
+/*-
+ * Copyright (c) 2019, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * IPsec policy selector classifier - see crypto_policy_cls.h
+ */
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <rte_branch_prediction.h>
+#include <rte_jhash.h>
+#include <rte_mbuf.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <urcu/list.h>
+#include <urcu/rculfhash.h>
+#include <urcu/rculist.h>
+
+#include "crypto/crypto_policy_cls.h"
+#include "ip_funcs.h"
+#include "netinet6/ip6_funcs.h"
+#include "pktmbuf.h"
+#include "urcu.h"
+#include "util.h"
+
+#define CPC_HT_MIN_BUCKETS	64
+#define CPC_HT_MAX_BUCKETS	(1 << 20)
+
+/* Prefix lengths 0 to 128 */
+#define CPC_PLENS		129
+
+/* The IPv6 extension headers walked to find the upper layer protocol */
+#define CPC_MAX_EXT_HDRS	8
+
+enum cpc_af {
+	CPC_AF_IPV4,
+	CPC_AF_IPV6,
+	CPC_AF_MAX
+};
+
+struct cpc_key {
+	xfrm_address_t	dst;	/* masked to plen */
+	uint8_t		af;
+	uint8_t		plen;
+};
+
+/* The selectors with the same destination prefix */
+struct cpc_group {
+	struct cds_lfht_node	node;
+	struct cpc_key		key;
+	struct cds_list_head	sels;	/* in rule index order */
+	struct rcu_head		rcu;
+};
+
+struct cpc_sel {
+	struct cds_list_head	list;
+	xfrm_address_t		src;	/* masked to src_plen */
+	uint8_t			src_plen;
+	uint8_t			proto;	/* 0 for any */
+	uint16_t		sport;	/* network order, 0 for any */
+	uint16_t		dport;	/* network order, 0 for any */
+	uint32_t		rule_index;
+	struct policy_rule	*pr;
+	struct rcu_head		rcu;
+};
+
+/* The destination prefix lengths in use, replaced when they change */
+struct cpc_plens {
+	unsigned int	count;
+	uint8_t		len[CPC_PLENS];
+	struct rcu_head	rcu;
+};
+
+struct crypto_policy_cls {
+	struct cds_lfht		*groups;
+	struct cpc_plens	*plens[CPC_AF_MAX];
+	unsigned int		plen_groups[CPC_AF_MAX][CPC_PLENS];
+};
+
+/* What a lookup matches on, from the packet */
+struct cpc_pkt {
+	xfrm_address_t	src;
+	xfrm_address_t	dst;
+	uint8_t		proto;
+	bool		has_ports;
+	uint16_t	sport;
+	uint16_t	dport;
+};
+
+static inline unsigned int cpc_addr_words(enum cpc_af af)
+{
+	return af == CPC_AF_IPV4 ? 1 : 4;
+}
+
+static inline void cpc_mask(xfrm_address_t *to, const xfrm_address_t *from,
+			    unsigned int plen, enum cpc_af af)
+{
+	unsigned int w, bits;
+
+	memset(to, 0, sizeof(*to));
+	for (w = 0; w < cpc_addr_words(af) && plen; w++) {
+		bits = plen < 32 ? plen : 32;
+		to->a6[w] = from->a6[w] & htonl(~0u << (32 - bits));
+		plen -= bits;
+	}
+}
+
+static inline bool cpc_prefix_eq(const xfrm_address_t *addr,
+				 const xfrm_address_t *pfx,
+				 unsigned int plen, enum cpc_af af)
+{
+	xfrm_address_t masked;
+
+	cpc_mask(&masked, addr, plen, af);
+	return !memcmp(&masked, pfx, cpc_addr_words(af) * 4);
+}
+
+static inline unsigned long cpc_key_hash(const struct cpc_key *key)
+{
+	return rte_jhash_32b(key->dst.a6, cpc_addr_words(key->af),
+			     key->af << 8 | key->plen);
+}
+
+static int cpc_group_match(struct cds_lfht_node *node, const void *arg)
+{
+	const struct cpc_group *group =
+		caa_container_of(node, struct cpc_group, node);
+	const struct cpc_key *key = arg;
+
+	return group->key.af == key->af && group->key.plen == key->plen &&
+		!memcmp(&group->key.dst, &key->dst,
+			cpc_addr_words(key->af) * 4);
+}
+
+static struct cpc_group *
+cpc_group_find(const struct crypto_policy_cls *cls, const struct cpc_key *key)
+{
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+
+	cds_lfht_lookup(cls->groups, cpc_key_hash(key), cpc_group_match, key,
+			&iter);
+	node = cds_lfht_iter_get_node(&iter);
+	return node ? caa_container_of(node, struct cpc_group, node) : NULL;
+}
+
+static void cpc_plens_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct cpc_plens, rcu));
+}
+
+/* Publish the lengths in use, longest first */
+static int cpc_plens_update(struct crypto_policy_cls *cls, enum cpc_af af)
+{
+	struct cpc_plens *plens, *old;
+	int len;
+
+	plens = zmalloc_aligned(sizeof(*plens));
+	if (!plens)
+		return -ENOMEM;
+
+	for (len = CPC_PLENS - 1; len >= 0; len--)
+		if (cls->plen_groups[af][len])
+			plens->len[plens->count++] = len;
+
+	old = rcu_xchg_pointer(&cls->plens[af], plens);
+	if (old)
+		call_rcu(&old->rcu, cpc_plens_free);
+	return 0;
+}
+
+struct crypto_policy_cls *crypto_policy_cls_create(void)
+{
+	struct crypto_policy_cls *cls;
+
+	cls = zmalloc_aligned(sizeof(*cls));
+	if (!cls)
+		return NULL;
+
+	cls->groups = cds_lfht_new(CPC_HT_MIN_BUCKETS, CPC_HT_MIN_BUCKETS,
+				   CPC_HT_MAX_BUCKETS,
+				   CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING,
+				   NULL);
+	if (!cls->groups) {
+		free(cls);
+		return NULL;
+	}
+	return cls;
+}
+
+void crypto_policy_cls_destroy(struct crypto_policy_cls *cls)
+{
+	unsigned int af;
+
+	if (!cls)
+		return;
+
+	dp_ht_destroy_deferred(cls->groups);
+	for (af = 0; af < CPC_AF_MAX; af++)
+		free(cls->plens[af]);
+	free(cls);
+}
+
+static void cpc_sel_key(const struct xfrm_selector *sel, struct cpc_key *key)
+{
+	memset(key, 0, sizeof(*key));
+	key->af = sel->family == AF_INET6 ? CPC_AF_IPV6 : CPC_AF_IPV4;
+	key->plen = sel->prefixlen_d;
+	cpc_mask(&key->dst, &sel->daddr, key->plen, key->af);
+}
+
+int crypto_policy_cls_add(struct crypto_policy_cls *cls,
+			  const struct xfrm_selector *sel,
+			  uint32_t rule_index, struct policy_rule *pr)
+{
+	struct cds_lfht_node *node;
+	struct cpc_group *group;
+	struct cpc_sel *cs, *pos;
+	struct cpc_key key;
+
+	if (sel->prefixlen_d >= CPC_PLENS || sel->prefixlen_s >= CPC_PLENS)
+		return -EINVAL;
+
+	cpc_sel_key(sel, &key);
+
+	cs = zmalloc_aligned(sizeof(*cs));
+	if (!cs)
+		return -ENOMEM;
+
+	cs->src_plen = sel->prefixlen_s;
+	cpc_mask(&cs->src, &sel->saddr, cs->src_plen, key.af);
+	cs->proto = sel->proto;
+	cs->sport = sel->sport;
+	cs->dport = sel->dport;
+	cs->rule_index = rule_index;
+	cs->pr = pr;
+
+	group = cpc_group_find(cls, &key);
+	if (!group) {
+		group = zmalloc_aligned(sizeof(*group));
+		if (!group) {
+			free(cs);
+			return -ENOMEM;
+		}
+		group->key = key;
+		CDS_INIT_LIST_HEAD(&group->sels);
+		cds_list_add_rcu(&cs->list, &group->sels);
+
+		node = cds_lfht_add_unique(cls->groups, cpc_key_hash(&key),
+					   cpc_group_match, &key,
+					   &group->node);
+		if (node != &group->node) {
+			free(group);
+			free(cs);
+			return -EEXIST;
+		}
+
+		if (cls->plen_groups[key.af][key.plen]++ == 0 &&
+		    cpc_plens_update(cls, key.af) < 0) {
+			crypto_policy_cls_del(cls, sel, rule_index, pr);
+			return -ENOMEM;
+		}
+		return 0;
+	}
+
+	/* Ahead of the first with a higher index, or at the end */
+	cds_list_for_each_entry(pos, &group->sels, list)
+		if (pos->rule_index > rule_index)
+			break;
+	cds_list_add_tail_rcu(&cs->list, &pos->list);
+	return 0;
+}
+
+static void cpc_sel_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct cpc_sel, rcu));
+}
+
+static void cpc_group_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct cpc_group, rcu));
+}
+
+void crypto_policy_cls_del(struct crypto_policy_cls *cls,
+			   const struct xfrm_selector *sel,
+			   uint32_t rule_index, const struct policy_rule *pr)
+{
+	struct cpc_group *group;
+	struct cpc_sel *cs;
+	struct cpc_key key;
+
+	if (sel->prefixlen_d >= CPC_PLENS)
+		return;
+
+	cpc_sel_key(sel, &key);
+	group = cpc_group_find(cls, &key);
+	if (!group)
+		return;
+
+	cds_list_for_each_entry(cs, &group->sels, list) {
+		if (cs->pr == pr && cs->rule_index == rule_index) {
+			cds_list_del_rcu(&cs->list);
+			call_rcu(&cs->rcu, cpc_sel_free);
+			break;
+		}
+	}
+
+	if (!cds_list_empty(&group->sels))
+		return;
+
+	cds_lfht_del(cls->groups, &group->node);
+	call_rcu(&group->rcu, cpc_group_free);
+
+	/* Keeping a stale length only costs lookups a probe */
+	if (--cls->plen_groups[key.af][key.plen] == 0)
+		cpc_plens_update(cls, key.af);
+}
+
+static inline bool cpc_has_ports(uint8_t proto)
+{
+	return proto == IPPROTO_TCP || proto == IPPROTO_UDP ||
+		proto == IPPROTO_UDPLITE || proto == IPPROTO_SCTP ||
+		proto == IPPROTO_DCCP;
+}
+
+/* Ports of the upper layer header at off, if it is in the first segment */
+static inline void cpc_pkt_ports(struct cpc_pkt *pkt,
+				 const struct rte_mbuf *m, unsigned int off)
+{
+	const uint16_t *ports;
+
+	if (!cpc_has_ports(pkt->proto) ||
+	    rte_pktmbuf_data_len(m) < off + 2 * sizeof(uint16_t))
+		return;
+
+	ports = rte_pktmbuf_mtod_offset(m, const uint16_t *, off);
+	pkt->sport = ports[0];
+	pkt->dport = ports[1];
+	pkt->has_ports = true;
+}
+
+static void cpc_pkt_parse4(struct cpc_pkt *pkt, struct rte_mbuf *m)
+{
+	const struct iphdr *ip = iphdr(m);
+
+	memset(pkt, 0, sizeof(*pkt));
+	pkt->src.a4 = ip->saddr;
+	pkt->dst.a4 = ip->daddr;
+	pkt->proto = ip->protocol;
+
+	/* Later fragments have no ports to match */
+	if (!(ip->frag_off & htons(IP_OFFMASK)))
+		cpc_pkt_ports(pkt, m, pktmbuf_l2_len(m) + ip->ihl * 4);
+}
+
+static void cpc_pkt_parse6(struct cpc_pkt *pkt, struct rte_mbuf *m)
+{
+	const struct ip6_hdr *ip6 = ip6hdr(m);
+	const struct ip6_ext *ext;
+	const struct ip6_frag *frag;
+	unsigned int off, i;
+	uint8_t nxt;
+
+	memset(pkt, 0, sizeof(*pkt));
+	memcpy(&pkt->src.a6, &ip6->ip6_src, sizeof(pkt->src.a6));
+	memcpy(&pkt->dst.a6, &ip6->ip6_dst, sizeof(pkt->dst.a6));
+
+	off = pktmbuf_l2_len(m) + sizeof(*ip6);
+	nxt = ip6->ip6_nxt;
+	for (i = 0; i < CPC_MAX_EXT_HDRS; i++) {
+		if (rte_pktmbuf_data_len(m) < off + sizeof(*ext))
+			break;
+		ext = rte_pktmbuf_mtod_offset(m, const struct ip6_ext *, off);
+
+		if (nxt == IPPROTO_FRAGMENT) {
+			frag = (const struct ip6_frag *)ext;
+			if (rte_pktmbuf_data_len(m) < off + sizeof(*frag))
+				break;
+			if (frag->ip6f_offlg & IP6F_OFF_MASK) {
+				pkt->proto = frag->ip6f_nxt;
+				return;
+			}
+			nxt = frag->ip6f_nxt;
+			off += sizeof(*frag);
+		} else if (nxt == IPPROTO_HOPOPTS || nxt == IPPROTO_ROUTING ||
+			   nxt == IPPROTO_DSTOPTS) {
+			nxt = ext->ip6e_nxt;
+			off += (ext->ip6e_len + 1) * 8;
+		} else {
+			break;
+		}
+	}
+
+	pkt->proto = nxt;
+	cpc_pkt_ports(pkt, m, off);
+}
+
+static inline bool cpc_sel_match(const struct cpc_sel *cs,
+				 const struct cpc_pkt *pkt, enum cpc_af af)
+{
+	if (cs->proto && cs->proto != pkt->proto)
+		return false;
+
+	if (cs->sport || cs->dport) {
+		if (!pkt->has_ports ||
+		    (cs->sport && cs->sport != pkt->sport) ||
+		    (cs->dport && cs->dport != pkt->dport))
+			return false;
+	}
+
+	return cpc_prefix_eq(&pkt->src, &cs->src, cs->src_plen, af);
+}
+
+struct policy_rule *
+crypto_policy_cls_lookup(const struct crypto_policy_cls *cls,
+			 struct rte_mbuf *m, bool v4)
+{
+	enum cpc_af af = v4 ? CPC_AF_IPV4 : CPC_AF_IPV6;
+	const struct cpc_sel *cs, *best = NULL;
+	const struct cpc_plens *plens;
+	const struct cpc_group *group;
+	struct cpc_pkt pkt;
+	struct cpc_key key;
+	unsigned int i;
+
+	if (unlikely(!cls))
+		return NULL;
+
+	plens = rcu_dereference(cls->plens[af]);
+	if (!plens || !plens->count)
+		return NULL;
+
+	if (v4)
+		cpc_pkt_parse4(&pkt, m);
+	else
+		cpc_pkt_parse6(&pkt, m);
+
+	memset(&key, 0, sizeof(key));
+	key.af = af;
+	for (i = 0; i < plens->count; i++) {
+		key.plen = plens->len[i];
+		cpc_mask(&key.dst, &pkt.dst, key.plen, af);
+
+		group = cpc_group_find(cls, &key);
+		if (!group)
+			continue;
+
+		cds_list_for_each_entry_rcu(cs, &group->sels, list) {
+			if (best && cs->rule_index >= best->rule_index)
+				break;
+			if (cpc_sel_match(cs, &pkt, af)) {
+				best = cs;
+				break;
+			}
+		}
+	}
+
+	return best ? best->pr : NULL;
+}
@@ -0,0 +1,47 @@
+/*-
+ * Copyright (c) 2019, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#ifndef CRYPTO_POLICY_CLS_H
+#define CRYPTO_POLICY_CLS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/xfrm.h>
+
+struct crypto_policy_cls;
+struct policy_rule;
+struct rte_mbuf;
+
+/*
+ * Classifier for the IPsec policies of one direction in a VRF, built
+ * directly from their XFRM selectors.
+ *
+ * Selectors are grouped by their destination prefix, in a hash table
+ * for each destination prefix length in use, and each group holds its
+ * selectors in rule index order. A lookup probes one table per length
+ * with the packet's destination, and takes the lowest rule index whose
+ * source prefix, protocol and ports also match, as the NPF ipsec
+ * ruleset would.
+ *
+ * Adds and deletes are from the main thread only, and lookups from
+ * any thread in an RCU read-side critical section.
+ */
+struct crypto_policy_cls *crypto_policy_cls_create(void);
+
+/* Once there are no readers, eg from an RCU callback */
+void crypto_policy_cls_destroy(struct crypto_policy_cls *cls);
+
+int crypto_policy_cls_add(struct crypto_policy_cls *cls,
+			  const struct xfrm_selector *sel,
+			  uint32_t rule_index, struct policy_rule *pr);
+void crypto_policy_cls_del(struct crypto_policy_cls *cls,
+			   const struct xfrm_selector *sel,
+			   uint32_t rule_index, const struct policy_rule *pr);
+
+struct policy_rule *
+crypto_policy_cls_lookup(const struct crypto_policy_cls *cls,
+			 struct rte_mbuf *m, bool v4);
+
+#endif /* CRYPTO_POLICY_CLS_H */
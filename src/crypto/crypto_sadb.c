@@ -120,14 +120,128 @@ static int sadb_spi_in_match(struct cds_lfht_node *node, const void *key)
 	return (sa->spi == *search_spi);
 }
 
+/*
+ * Optional direct indexed table of inbound SAs.
+ *
+ * If the IKE daemon is set up to allocate inbound SPIs whose low
+ * spi_index_bits bits are unique, say by handing them out in sequence,
+ * those bits index a flat array and the rest of the SPI acts as a
+ * generation, so that finding an SA is a single load and a compare of
+ * the whole SPI. An SA whose slot is taken is still in the hash table.
+ */
+#define SADB_SPI_INDEX_BITS_MAX 20
+
+struct sadb_spi_index {
+	uint32_t mask;
+	struct rcu_head rcu;
+	struct sadb_sa *sa[];
+};
+
+static struct sadb_spi_index *spi_index;
+
+static inline uint32_t sadb_spi_index_slot(const struct sadb_spi_index *index,
+					   uint32_t spi)
+{
+	return ntohl(spi) & index->mask;
+}
+
+static void sadb_spi_index_add(struct sadb_sa *sa)
+{
+	struct sadb_spi_index *index = spi_index;
+	uint32_t slot;
+
+	if (!index)
+		return;
+
+	slot = sadb_spi_index_slot(index, sa->spi);
+	if (!index->sa[slot])
+		rcu_assign_pointer(index->sa[slot], sa);
+}
+
+static void sadb_spi_index_del(struct sadb_sa *sa)
+{
+	struct sadb_spi_index *index = spi_index;
+	uint32_t slot;
+
+	if (!index)
+		return;
+
+	slot = sadb_spi_index_slot(index, sa->spi);
+	if (index->sa[slot] == sa)
+		rcu_assign_pointer(index->sa[slot], NULL);
+}
+
+static void sadb_spi_index_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct sadb_spi_index, rcu));
+}
+
+/*
+ * Set the number of SPI bits used to index inbound SAs, zero turning
+ * the table off. Must be called from the main thread.
+ */
+int crypto_sadb_spi_index(FILE *f, const char *str)
+{
+	struct sadb_spi_index *index = NULL, *old;
+	struct cds_lfht_iter iter;
+	unsigned long bits;
+	struct sadb_sa *sa;
+	char *end;
+
+	bits = strtoul(str, &end, 10);
+	if (*end != '\0' || bits > SADB_SPI_INDEX_BITS_MAX) {
+		if (f)
+			fprintf(f, "error invalid SPI index bits, must be 0-%u\n",
+				SADB_SPI_INDEX_BITS_MAX);
+		return -1;
+	}
+
+	if (bits) {
+		index = zmalloc_aligned(sizeof(*index) +
+					(1ul << bits) * sizeof(index->sa[0]));
+		if (!index) {
+			if (f)
+				fprintf(f, "error allocating SPI index\n");
+			return -1;
+		}
+		index->mask = (1u << bits) - 1;
+
+		cds_lfht_for_each_entry(spi_in_hash_table, &iter,
+					sa, spi_ht_node) {
+			uint32_t slot = sadb_spi_index_slot(index, sa->spi);
+
+			if (!index->sa[slot])
+				index->sa[slot] = sa;
+		}
+	}
+
+	old = spi_index;
+	rcu_assign_pointer(spi_index, index);
+	if (old)
+		call_rcu(&old->rcu, sadb_spi_index_free);
+
+	SADB_INFO("SPI index %lu bits\n", bits);
+	return 0;
+}
+
 /*
  * Used by the fast path to lookup an input (decrypt) SA by SPI.
  */
 struct sadb_sa *sadb_lookup_sa_by_spi_in(uint32_t spi)
 {
+	struct sadb_spi_index *index = rcu_dereference(spi_index);
 	struct cds_lfht_node *node;
 	struct cds_lfht_iter iter;
 
+	if (index) {
+		struct sadb_sa *sa;
+
+		sa = rcu_dereference(index->sa[sadb_spi_index_slot(index,
+								    spi)]);
+		if (likely(sa && sa->spi == spi))
+			return sa;
+	}
+
 	cds_lfht_lookup(spi_in_hash_table,
 			sadb_spi_in_hash(&spi),
 			sadb_spi_in_match,
@@ -178,14 +292,17 @@ static bool sadb_add_sa_to_spi_in_hash(struct sadb_sa *sa)
 		SADB_ERR("Failed to add SA to SPI hash table\n");
 		return false;
 	}
+	sadb_spi_index_add(sa);
 
 	return true;
 }
 
 static void sadb_remove_sa_from_spi_in_hash(struct sadb_sa *sa)
 {
-	if (sa->dir == CRYPTO_DIR_IN)
+	if (sa->dir == CRYPTO_DIR_IN) {
+		sadb_spi_index_del(sa);
 		cds_lfht_del(spi_in_hash_table, &sa->spi_ht_node);
+	}
 }
 
 /*
@@ -677,7 +794,9 @@ struct sadb_sa *sadb_lookup_inbound(uint32_t spi)
 
 static void sadb_sa_destroy(struct sadb_sa *sa)
 {
+	crypto_sa_spread_destroy(sa);
 	cipher_teardown_ctx(sa);
+	esp_replay_fini(sa);
 	free(sa);
 }
 
@@ -697,6 +816,7 @@ void crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 			const struct xfrm_algo *crypto_algo,
 			const struct xfrm_algo_auth *auth_algo,
 			const struct xfrm_encap_tmpl *tmpl,
+			uint32_t replay_window,
 			uint32_t mark_val, uint32_t extra_flags,
 			vrfid_t vrf_id)
 {
@@ -753,6 +873,9 @@ void crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 	if (cipher_setup_ctx(crypto_algo, auth_algo, sa_info, tmpl,
 			     sa, extra_flags))
 		sa->blocked = true;
+	else if (sa->dir == CRYPTO_DIR_IN &&
+		 esp_replay_init(sa, replay_window) < 0)
+		sa->blocked = true;
 	/*
 	 * Need to allocate the crypto_pmd before inserting the sa as
 	 * the insertion triggers an update for any registered
@@ -767,6 +890,7 @@ void crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 
 	sa->del_pmd_dev_id = sa->pmd_dev_id =
 		crypto_allocate_pmd(crypto_sa_to_xfrm(sa));
+	crypto_sa_spread_setup(sa);
 	if (sadb_insert_sa(sa, vrf_ctx) < 0) {
 		/*
 		 * Even though the SA insert failed, we know
@@ -775,6 +899,7 @@ void crypto_sadb_new_sa(const struct xfrm_usersa_info *sa_info,
 		 * the  PMD it is attached to.
 		 */
 		SADB_ERR("Failed to insert SA into SADB\n");
+		crypto_sa_spread_release(sa);
 		sadb_sa_destroy(sa);
 		return;
 	}
@@ -855,6 +980,7 @@ void crypto_sadb_del_sa(const struct xfrm_usersa_info *sa_info, vrfid_t vrfid)
 	crypto_remove_sa_from_pmd(sa->del_pmd_dev_id,
 				  crypto_sa_to_xfrm(sa),
 				  sa->pending_del);
+	crypto_sa_spread_release(sa);
 	call_rcu(&sa->sa_rcu, sadb_sa_rcu_free);
 	vrf_ctx->count_of_sas--;
 
@@ -21,11 +21,15 @@
 #include <rte_log.h>
 #include <rte_memcpy.h>
 #include <rte_mbuf.h>
+#include <stdlib.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
 
 #include "compiler.h"
 #include "crypto/crypto_sadb.h"
 #include "in6.h"
 #include "ip_funcs.h"
+#include "util.h"
 #include "vplane_log.h"
 #include "vrf.h"
 
@@ -203,69 +207,151 @@ uint16_t esp_payload_padded_len(const struct crypto_overhead *overhead,
  *   not have been previously checked and accepted [by
  *   esp_replay_advance]
  *
- * we detect previously received sequence numbers using a bitmask. The
- * MSB of the bitmask corresponds to the stored highest sequence
- * number so far received. Less significant bits correspond to
- * sequence numbers S in the range:
- *
- * highest_received >= S > (highest_received - replay_window_size)
- *
+ * The packets of one SA may be decrypted on several lcores at once, so
+ * the window is kept without a lock.  It is an array of 64-bit words,
+ * each covering an aligned block of 32 sequence numbers: the upper half
+ * holds the block number and the lower half a bit per sequence number.
+ * A block's word is found by its number modulo the array size, which is
+ * at least one block more than the window, so a word is only reused for
+ * a newer block once every sequence number of the older one has fallen
+ * out of the window.  A word is updated with a single compare and swap,
+ * and the highest sequence number so far received (sa->seq) is moved
+ * forward with another.
  */
+#define ESP_REPLAY_BLOCK_SHIFT	5
+#define ESP_REPLAY_BLOCK_BITS	(1u << ESP_REPLAY_BLOCK_SHIFT)
+
+struct esp_replay_window {
+	uint32_t mask;
+	uint64_t words[];
+};
+
+static inline uint32_t esp_replay_word_block(uint64_t word)
+{
+	return word >> 32;
+}
+
+int esp_replay_init(struct sadb_sa *sa, uint32_t replay_window)
+{
+	struct esp_replay_window *rw;
+	uint32_t nwords;
+
+	sa->replay_window = 0;
+	sa->replay = NULL;
+
+	if (!replay_window)
+		return 0;
+
+	if (replay_window > ESP_REPLAY_WINDOW_MAX) {
+		ESP_INFO("Replay window %u for SPI 0x%x limited to %u\n",
+			 replay_window, sa->spi, ESP_REPLAY_WINDOW_MAX);
+		replay_window = ESP_REPLAY_WINDOW_MAX;
+	}
+
+	nwords = rte_align32pow2(RTE_ALIGN_CEIL(replay_window,
+						ESP_REPLAY_BLOCK_BITS) /
+				 ESP_REPLAY_BLOCK_BITS + 1);
+	rw = zmalloc_aligned(sizeof(*rw) + nwords * sizeof(rw->words[0]));
+	if (!rw) {
+		ESP_ERR("Failed to allocate replay window\n");
+		return -1;
+	}
+	rw->mask = nwords - 1;
+
+	sa->replay = rw;
+	sa->replay_window = replay_window;
+	return 0;
+}
+
+void esp_replay_fini(struct sadb_sa *sa)
+{
+	free(sa->replay);
+	sa->replay = NULL;
+	sa->replay_window = 0;
+}
+
 int esp_replay_check(const uint8_t *esp,
 		     const struct sadb_sa *sa)
 {
 	const uint32_t replay_window = sa->replay_window;
 	const uint32_t pkt_seq = ntohl(*(const uint32_t *)(esp+4));
-	uint32_t delta;
+	const uint32_t block = pkt_seq >> ESP_REPLAY_BLOCK_SHIFT;
+	uint32_t top = CMM_LOAD_SHARED(sa->seq);
+	uint64_t word;
 
 	if (unlikely(!pkt_seq))
 		return -1; /* Invalid seq in packet. Auditable event? */
 
-	if (likely(pkt_seq > sa->seq))
+	if (likely(pkt_seq > top))
 		return 0;
 
-	delta = sa->seq - pkt_seq;
-
-	if (delta >= replay_window)
+	if (top - pkt_seq >= replay_window)
 		return -2; /* Wrap or replay. Auditable event? */
 
-	if (sa->replay_bitmap & (1U << delta))
+	word = CMM_LOAD_SHARED(sa->replay->words[block & sa->replay->mask]);
+	if (esp_replay_word_block(word) > block)
+		return -2; /* Window has moved on. */
+
+	if (esp_replay_word_block(word) == block &&
+	    (word & (1u << (pkt_seq & (ESP_REPLAY_BLOCK_BITS - 1)))))
 		return -3; /* Replay. Auditable event? */
 
 	return 0;
 }
 
 /*
- * The most significant bit in the mask represents the right hand edge
- * of the sliding window. As the window moves, the bitmask is shifted
- * left. If a packet is received with a sequence number more than
- * replay_window ahead of the current right hand edge, then the
- * bitmask is cleared, and a single bit set to indicate that we've
- * started afresh.
+ * Called once the packet has been authenticated.  The check is repeated
+ * as the window may have moved, or another lcore accepted the same
+ * sequence number, since esp_replay_check().  Only one of several
+ * copies of a packet decrypted concurrently can set its bit.
  */
-void esp_replay_advance(const uint8_t *esp,
-			struct sadb_sa *sa)
+int esp_replay_advance(const uint8_t *esp,
+		       struct sadb_sa *sa)
 {
 	const uint32_t replay_window = sa->replay_window;
-	uint32_t delta;
 
 	if (unlikely(!replay_window))
-		return;
+		return 0;
 
 	const uint32_t pkt_seq = ntohl(*(const uint32_t *)(esp+4));
+	const uint32_t block = pkt_seq >> ESP_REPLAY_BLOCK_SHIFT;
+	const uint32_t bit = 1u << (pkt_seq & (ESP_REPLAY_BLOCK_BITS - 1));
+	uint64_t *slot = &sa->replay->words[block & sa->replay->mask];
+	uint64_t word, prev, new;
+	uint32_t top;
 
-	if (pkt_seq > sa->seq) {
-		delta = pkt_seq - sa->seq;
-		if (delta < replay_window)
-			sa->replay_bitmap =
-				((sa->replay_bitmap) << delta) | 1;
-		else
-			sa->replay_bitmap = 1;
-		sa->seq = pkt_seq;
-	} else {
-		delta = sa->seq - pkt_seq;
-		sa->replay_bitmap |= (1U << delta);
+	top = CMM_LOAD_SHARED(sa->seq);
+	if (pkt_seq <= top && top - pkt_seq >= replay_window)
+		return -2;
+
+	word = CMM_LOAD_SHARED(*slot);
+	for (;;) {
+		if (esp_replay_word_block(word) > block)
+			return -2;
+
+		if (esp_replay_word_block(word) == block) {
+			if (word & bit)
+				return -3;
+			new = word | bit;
+		} else
+			new = ((uint64_t)block << 32) | bit;
+
+		prev = uatomic_cmpxchg(slot, word, new);
+		if (prev == word)
+			break;
+		word = prev;
+	}
+
+	/* Move the right hand edge of the window */
+	while (pkt_seq > top) {
+		uint32_t old = uatomic_cmpxchg(&sa->seq, top, pkt_seq);
+
+		if (old == top)
+			break;
+		top = old;
 	}
+
+	return 0;
 }
 
 static struct rte_mbuf *esp_get_next_seg(struct rte_mbuf *current,
@@ -534,25 +620,51 @@ static int null_icv_cb(struct crypto_chain *chain __rte_unused,
  * esp_generate_chain
  *
  * Generate and process a chain of actions for the crypto engine.
+ * If queue is set the packet is added to the cryptodev batch if it
+ * can be, and ESP_PENDING returned.
  */
 static int esp_generate_chain(struct sadb_sa *sa,
+			      struct crypto_session *session,
 			      struct rte_mbuf *mbuf,
 			      unsigned int l3_hdr_len,
 			      unsigned char *esp,
 			      unsigned char *iv,
-			      uint32_t text_total_len, int8_t encrypt)
+			      uint32_t text_total_len, int8_t encrypt,
+			      bool queue)
 {
 	struct crypto_chain chain;
 	unsigned int esp_len = esp_hdr_len(sa);
-	unsigned int iv_len = crypto_session_iv_len(sa->session);
+	unsigned int iv_len = crypto_session_iv_len(session);
 	unsigned int icv_len = esp_icv_len(sa);
 	struct crypto_visitor_ctx ctx = {
-		.session = sa->session,
+		.session = session,
 	};
+	unsigned int icv_offset;
+	int rc;
+
+	crypto_session_set_direction(session, encrypt);
 
-	crypto_session_set_direction(sa->session, encrypt);
+	icv_offset = pktmbuf_l2_len(mbuf) + l3_hdr_len + text_total_len;
+	if (sa->udp_encap)
+		icv_offset += sizeof(struct udphdr);
+
+	if (queue &&
+	    crypto_cdev_queue(session, mbuf,
+			      esp - rte_pktmbuf_mtod(mbuf, unsigned char *),
+			      iv, text_total_len - esp_len, icv_offset) == 0)
+		return ESP_PENDING;
+
+	if (session->cdev_state != CRYPTO_CDEV_UNSUPPORTED) {
+		rc = crypto_cdev_process(session, mbuf, encrypt,
+					 esp - rte_pktmbuf_mtod(mbuf,
+								unsigned char *),
+					 iv, text_total_len - esp_len,
+					 icv_offset);
+		if (rc != CRYPTO_CDEV_FALLBACK)
+			return rc;
+	}
 
-	if (crypto_chain_init(&chain, sa->session))
+	if (crypto_chain_init(&chain, session))
 		return -1;
 
 	chain.v_ctx = &ctx;
@@ -562,11 +674,7 @@ static int esp_generate_chain(struct sadb_sa *sa,
 		chain.v_ops->set_iv(chain.v_ctx, iv_len, iv);
 
 	/* set ICV and callback */
-	chain.icv_offset = pktmbuf_l2_len(mbuf) + l3_hdr_len +
-		text_total_len;
-
-	if (sa->udp_encap)
-		chain.icv_offset += sizeof(struct udphdr);
+	chain.icv_offset = icv_offset;
 
 	if (!encrypt) {
 		chain.icv_callback = icv_len ? check_icv_cb : null_icv_cb;
@@ -694,29 +802,35 @@ static void esp_input_nat_l4cksum_fixup(struct rte_mbuf *m)
 	}
 }
 
-static int esp_input_inner(int family, struct rte_mbuf *m, void *l3_hdr,
-			   struct sadb_sa *sa, uint32_t *bytes,
-			   uint8_t *new_family)
-{
-	int rc = 0, head_trim  = 0, tail_trim = 0;
-	unsigned int esp_len, ciphertext_len, udp_len = 0;
-	unsigned int iphlen, icv_len, counter_modify = 0;
+/*
+ * The layout of an inbound ESP packet, as found before decryption.
+ */
+struct esp_input_hdr {
+	void *l3_hdr;
+	unsigned char *esp;
 	unsigned int base_len;
-	char next_hdr = 0, padding_size = 0;
-	unsigned char *iv = NULL, *esp = NULL;
+	unsigned int iphlen;
+	unsigned int esp_len;
+	unsigned int udp_len;
+	unsigned int icv_len;
+	unsigned int ciphertext_len;
+	uint16_t prev_off;
+};
+
+static int esp_input_parse(int family, struct rte_mbuf *m, void *l3_hdr,
+			   struct sadb_sa *sa, struct esp_input_hdr *h)
+{
 	unsigned int seg_data_remaining;
-	unsigned int new_total;
-	uint16_t ethertype, prev_off = 0;
-	char *new_l3_hdr;
-	uint8_t post_decrypt_family;
-	void (*tran_fixup)(void *, unsigned int, char, unsigned int);
-	unsigned int (*tunl_fixup)(struct sadb_sa *, void *, void *);
 
 	if (!sa) {
 		ESP_ERR("No SA for the inbound packet\n");
 		return -1;
 	}
 
+	h->l3_hdr = l3_hdr;
+	h->prev_off = 0;
+	h->udp_len = 0;
+
 	if (family == AF_INET) {
 		struct iphdr *ip = l3_hdr;
 
@@ -725,31 +839,31 @@ static int esp_input_inner(int family, struct rte_mbuf *m, void *l3_hdr,
 			return -1;
 		}
 
-		base_len = ntohs(ip->tot_len);
-		iphlen = ip->ihl << 2;
+		h->base_len = ntohs(ip->tot_len);
+		h->iphlen = ip->ihl << 2;
 	} else {
 		struct ip6_hdr *ip6 = l3_hdr;
 
-		base_len = ntohs(ip6->ip6_plen) + sizeof(struct ip6_hdr);
-		iphlen = pktmbuf_l3_len(m);
+		h->base_len = ntohs(ip6->ip6_plen) + sizeof(struct ip6_hdr);
+		h->iphlen = pktmbuf_l3_len(m);
 		if (sa->mode == XFRM_MODE_TRANSPORT)
-			prev_off = ip6_findprevoff(m);
+			h->prev_off = ip6_findprevoff(m);
 	}
 
-	esp =  pktmbuf_mtol4(m, unsigned char *);
+	h->esp =  pktmbuf_mtol4(m, unsigned char *);
 	if (sa->udp_encap) {
-		esp += sizeof(struct udphdr);
-		udp_len = sizeof(struct udphdr);
+		h->esp += sizeof(struct udphdr);
+		h->udp_len = sizeof(struct udphdr);
 	}
 
 	if (unlikely(sa->replay_window &&
-		     esp_replay_check(esp, sa) < 0)) {
+		     esp_replay_check(h->esp, sa) < 0)) {
 		crypto_sadb_seq_drop_inc(sa);
 		ESP_INFO("Replay check failed for SPI 0x%x\n", sa->spi);
 		return -1;
 	}
 
-	esp_len = esp_hdr_len(sa);
+	h->esp_len = esp_hdr_len(sa);
 
 	/*
 	 * Now much data is there left in the segment after the ip/udp
@@ -757,34 +871,57 @@ static int esp_input_inner(int family, struct rte_mbuf *m, void *l3_hdr,
 	 * segment.
 	 */
 	seg_data_remaining = rte_pktmbuf_data_len(m) -
-		(esp - rte_pktmbuf_mtod(m, unsigned char *));
+		(h->esp - rte_pktmbuf_mtod(m, unsigned char *));
 
-	if (seg_data_remaining < esp_len) {
+	if (seg_data_remaining < h->esp_len) {
 		ESP_ERR("ESP not in first buffer\n");
 		return -1;
 	}
 
-	/* iv is after the SPI(4) and the SEQ(4) */
-	iv = esp + 8;
-
 	/* ESP length = SPI(4) + SEQ(4) + IV_LEN */
-	head_trim = esp_len + udp_len;
-	icv_len = esp_icv_len(sa);
-	ciphertext_len = base_len - iphlen - esp_len - udp_len - icv_len;
+	h->icv_len = esp_icv_len(sa);
+	h->ciphertext_len = h->base_len - h->iphlen - h->esp_len -
+		h->udp_len - h->icv_len;
 
-	if (ciphertext_len  % crypto_session_block_size(sa->session)) {
+	if (h->ciphertext_len  % crypto_session_block_size(sa->session)) {
 		ESP_ERR("Invalid ctext len %d block_size %d",
-			ciphertext_len,
+			h->ciphertext_len,
 			crypto_session_block_size(sa->session));
 		return -1;
 	}
 
-	if (unlikely(esp_generate_chain(sa, m, iphlen, esp, iv,
-					ciphertext_len + esp_len,
-					0) != 0))
-		return -1;
+	return 0;
+}
 
-	esp_replay_advance(esp, sa);
+/*
+ * Strip ESP from a packet that has been decrypted and authenticated.
+ */
+static int esp_input_finish(int family, struct rte_mbuf *m,
+			    struct sadb_sa *sa,
+			    const struct esp_input_hdr *h,
+			    uint32_t *bytes, uint8_t *new_family)
+{
+	int rc = 0, head_trim, tail_trim = 0;
+	unsigned int counter_modify = 0;
+	unsigned int esp_len = h->esp_len, udp_len = h->udp_len;
+	unsigned int iphlen = h->iphlen, icv_len = h->icv_len;
+	unsigned char *esp = h->esp;
+	void *l3_hdr = h->l3_hdr;
+	char next_hdr = 0, padding_size = 0;
+	unsigned int new_total;
+	uint16_t ethertype;
+	char *new_l3_hdr;
+	uint8_t post_decrypt_family;
+	void (*tran_fixup)(void *, unsigned int, char, unsigned int);
+	unsigned int (*tunl_fixup)(struct sadb_sa *, void *, void *);
+
+	head_trim = esp_len + udp_len;
+
+	if (unlikely(esp_replay_advance(esp, sa) < 0)) {
+		crypto_sadb_seq_drop_inc(sa);
+		ESP_INFO("Replay check failed for SPI 0x%x\n", sa->spi);
+		return -1;
+	}
 
 	rc = buf_tail_trim(m, icv_len, rc);
 	rc = buf_tail_read_char(m, &next_hdr, rc);
@@ -822,8 +959,8 @@ static int esp_input_inner(int family, struct rte_mbuf *m, void *l3_hdr,
 	if (sa->mode == XFRM_MODE_TRANSPORT) {
 		new_l3_hdr = (char *)((char *)l3_hdr + esp_len + udp_len);
 		memmove(new_l3_hdr, l3_hdr, iphlen);
-		new_total = base_len - esp_len - udp_len - tail_trim;
-		(*tran_fixup)(new_l3_hdr, new_total, next_hdr, prev_off);
+		new_total = h->base_len - esp_len - udp_len - tail_trim;
+		(*tran_fixup)(new_l3_hdr, new_total, next_hdr, h->prev_off);
 
 		counter_modify = iphlen;
 	} else if (sa->mode == XFRM_MODE_TUNNEL) {
@@ -866,6 +1003,50 @@ static int esp_input_inner(int family, struct rte_mbuf *m, void *l3_hdr,
 	return 0;
 }
 
+static int esp_input_inner(int family, struct rte_mbuf *m, void *l3_hdr,
+			   struct sadb_sa *sa, uint32_t *bytes,
+			   uint8_t *new_family)
+{
+	struct esp_input_hdr h;
+	bool queue;
+	int rc;
+
+	if (esp_input_parse(family, m, l3_hdr, sa, &h) < 0)
+		return -1;
+
+	queue = crypto_cdev_batchable(sa->session, m, false);
+
+	/* iv is after the SPI(4) and the SEQ(4) */
+	rc = esp_generate_chain(sa, sa->session, m, h.iphlen, h.esp, h.esp + 8,
+				h.ciphertext_len + h.esp_len, 0, queue);
+	if (rc == ESP_PENDING)
+		return ESP_PENDING;
+	if (unlikely(rc != 0))
+		return -1;
+
+	return esp_input_finish(family, m, sa, &h, bytes, new_family);
+}
+
+int esp_input_complete(struct rte_mbuf *m, struct sadb_sa *sa, int rc,
+		       uint32_t *bytes, uint8_t *new_family)
+{
+	int family = iphdr(m)->version == IPVERSION ? AF_INET : AF_INET6;
+	struct esp_input_hdr h;
+
+	if (rc != 0)
+		return -1;
+
+	/*
+	 * Parse again, the header has not changed.  This repeats the
+	 * replay check, as packets of a batch were checked before any
+	 * of them advanced the window.
+	 */
+	if (esp_input_parse(family, m, pktmbuf_mtol3(m, void *), sa, &h) < 0)
+		return -1;
+
+	return esp_input_finish(family, m, sa, &h, bytes, new_family);
+}
+
 static unsigned int esp_out_new_hdr6(bool transport, uint8_t orig_family,
 				     void *l3hdr, void *new_l3hdr,
 				     unsigned int pre_len,
@@ -1103,13 +1284,49 @@ static void esp_out_hdr_parse4(void *l3hdr, struct esp_hdr_ctx *h,
 	h->tot_len = ntohs(ip->tot_len);
 }
 
+/* RFC 4303 monotonic padding, 1, 2, 3, ... up to a block less one */
+static const uint8_t esp_pad_pattern[] = {
+	1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+	17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31
+};
+
+_Static_assert(sizeof(esp_pad_pattern) == EVP_MAX_BLOCK_LENGTH - 1,
+	       "ESP padding pattern must cover a cipher block");
+
+/*
+ * The outer header, UDP encapsulation, ESP header and IV are pushed
+ * into the headroom in front of the packet.
+ */
+_Static_assert(sizeof(struct ip6_hdr) + sizeof(struct udphdr) +
+	       sizeof(struct ip_esp_hdr) + EVP_MAX_IV_LENGTH <=
+	       RTE_PKTMBUF_HEADROOM,
+	       "ESP headers must fit in the mbuf headroom");
+
+uint32_t esp_seq_reserve(struct sadb_sa *sa)
+{
+	uint32_t seq = ++(sa->seq);
+
+	if (unlikely(seq == ESP_SEQ_SA_REKEY_THRESHOLD)) {
+		crypto_rekey_requests++;
+		crypto_expire_request(sa->spi,
+				      crypto_sadb_get_reqid(sa),
+				      IPPROTO_ESP, 0 /* hard */);
+	}
+	if (unlikely(seq > (ESP_SEQ_SA_BLOCK_LIMIT - 1)))
+		crypto_sadb_mark_as_blocked(sa);
+
+	return seq;
+}
+
 static int esp_output_inner(int new_family, struct sadb_sa *sa,
 			    struct rte_mbuf *m, uint8_t orig_family,
-			    void *l3hdr, uint32_t *bytes)
+			    void *l3hdr, const struct esp_out_slot *slot,
+			    uint32_t *bytes)
 {
+	struct crypto_session *session;
 	int block_size;
 	unsigned int icv_size, tail_len, padding, enc_inc, udp_size = 0;
-	unsigned int i, counter_modify = 0;
+	unsigned int counter_modify = 0;
 	unsigned int esp_size, plaintext_size, plaintext_size_orig;
 	bool transport;
 	unsigned char *plaintext = NULL, *esp_base, *esp_ptr = NULL;
@@ -1119,12 +1336,16 @@ static int esp_output_inner(int new_family, struct sadb_sa *sa,
 	struct ether_hdr *eth_hdr;
 	unsigned char *new_l3hdr;
 	struct esp_hdr_ctx h;
+	bool queue, chained;
+	uint32_t seq;
+	int rc;
 
 	if (!sa) {
 		ESP_ERR("No SA for the outbound pkt\n");
 		return -1;
 	}
 
+	session = slot ? slot->session : sa->session;
 	transport = (sa->mode == XFRM_MODE_TRANSPORT) ? 1 : 0;
 
 	if (orig_family == AF_INET) {
@@ -1174,7 +1395,7 @@ static int esp_output_inner(int new_family, struct sadb_sa *sa,
 	}
 
 	/* The ESP payload block needs to be aligned dependent on AF */
-	block_size = RTE_ALIGN(crypto_session_block_size(sa->session),
+	block_size = RTE_ALIGN(crypto_session_block_size(session),
 			       h.out_align_val);
 	/*
 	 * Workout the padding and tail bytes required, based upon the
@@ -1184,16 +1405,25 @@ static int esp_output_inner(int new_family, struct sadb_sa *sa,
 		(plaintext_size + 2);
 
 	tail_len =  padding + 2 + icv_size;
-	tail = pktmbuf_append_alloc(m, tail_len);
-	if (!tail) {
-		ESP_PKT_ERR("Tail room inc failed (requested %d bytes)\n",
-			    tail_len);
-		return -1;
+
+	/*
+	 * The mbuf pools reserve room for the trailer, so it only needs
+	 * a segment of its own if the packet was built elsewhere.
+	 */
+	tail = rte_pktmbuf_append(m, tail_len);
+	if (unlikely(!tail)) {
+		tail = pktmbuf_append_alloc(m, tail_len);
+		if (!tail) {
+			ESP_PKT_ERR("Tail room inc failed (requested %d bytes)\n",
+				    tail_len);
+			return -1;
+		}
+		IPSEC_CNT_INC(ESP_TAIL_SEG_ALLOC);
 	}
 
 	/* Set the padding using RFC specified pattern */
-	for (i = 1; i <= padding; i++)
-		*tail++ = i;
+	memcpy(tail, esp_pad_pattern, padding);
+	tail += padding;
 	*tail++ = padding;
 	*tail++ = transport ? h.out_proto_nxt : h.proto_ip;
 	plaintext_size += padding + 2;
@@ -1213,47 +1443,56 @@ static int esp_output_inner(int new_family, struct sadb_sa *sa,
 	/* Add Spi, sequence and IV */
 	*(uint32_t *)esp_ptr = (sa->spi);
 	esp_ptr += 4;
-	*(uint32_t *)esp_ptr = htonl(++(sa->seq));
+	seq = slot ? slot->seq : esp_seq_reserve(sa);
+	*(uint32_t *)esp_ptr = htonl(seq);
 	esp_ptr += 4;
 
-	crypto_session_generate_iv(sa->session, (char *)esp_ptr);
-
-	if (unlikely(sa->seq == ESP_SEQ_SA_REKEY_THRESHOLD)) {
-		crypto_rekey_requests++;
-		crypto_expire_request(sa->spi,
-				      crypto_sadb_get_reqid(sa),
-				      IPPROTO_ESP, 0 /* hard */);
-	}
-	if (unlikely(sa->seq > (ESP_SEQ_SA_BLOCK_LIMIT - 1)))
-		crypto_sadb_mark_as_blocked(sa);
-
-	if (unlikely(esp_generate_chain(sa, m, h.out_hdr_len, esp_base, esp_ptr,
-					plaintext_size + esp_size, 1) != 0))
+	/*
+	 * A batched packet can not take its IV from the ciphertext of
+	 * the one before it, as that is not ready yet, nor can the
+	 * packets of an SA spread over several threads.
+	 */
+	queue = crypto_cdev_batchable(session, m, true);
+	chained = !queue && !slot;
+	if (chained)
+		crypto_session_generate_iv(session, (char *)esp_ptr);
+	else
+		crypto_cdev_generate_iv(session, esp_ptr, seq);
+
+	rc = esp_generate_chain(sa, session, m, h.out_hdr_len, esp_base,
+				esp_ptr, plaintext_size + esp_size, 1, queue);
+	if (unlikely(rc < 0))
 		return -1;
 
-	crypto_session_set_iv(sa->session,
-			      crypto_session_iv_len(sa->session),
-			      tail - crypto_session_iv_len(sa->session));
+	if (chained && rc != ESP_PENDING)
+		crypto_session_set_iv(session,
+				      crypto_session_iv_len(session),
+				      tail - crypto_session_iv_len(session));
 
 	eth_hdr = (struct ether_hdr *)hdr;
 	eth_hdr->ether_type = htons(h.out_ethertype);
 
-	crypto_sadb_increment_counters(sa, plaintext_size_orig -
-				       counter_modify, 1);
+	/* A spread SA is counted as its packets are put back in order */
+	if (!slot)
+		crypto_sadb_increment_counters(sa, plaintext_size_orig -
+					       counter_modify, 1);
 	*bytes = plaintext_size_orig - counter_modify;
-	return 0;
+	return rc;
 }
 
 int esp_output(struct rte_mbuf *m, uint8_t orig_family, void *ip,
-	       struct sadb_sa *sa, uint32_t *bytes)
+	       struct sadb_sa *sa, const struct esp_out_slot *slot,
+	       uint32_t *bytes)
 {
-	return esp_output_inner(AF_INET, sa, m, orig_family, ip, bytes);
+	return esp_output_inner(AF_INET, sa, m, orig_family, ip, slot, bytes);
 }
 
 int esp_output6(struct rte_mbuf *m, uint8_t orig_family, void *ip6,
-		struct sadb_sa *sa, uint32_t *bytes)
+		struct sadb_sa *sa, const struct esp_out_slot *slot,
+		uint32_t *bytes)
 {
-	return esp_output_inner(AF_INET6, sa, m, orig_family, ip6, bytes);
+	return esp_output_inner(AF_INET6, sa, m, orig_family, ip6, slot,
+				bytes);
 }
 
 int esp_input(struct rte_mbuf *m, struct sadb_sa *sa,
@@ -18,6 +18,7 @@
 #include "crypto_sadb.h"
 
 struct crypto_overhead;
+struct crypto_session;
 struct rte_mbuf;
 struct sadb_sa;
 struct udphdr;
@@ -28,10 +29,34 @@ int esp_input6(struct rte_mbuf *m, struct sadb_sa *sa, uint32_t *bytes,
 	       uint8_t *new_family);
 
 
+/*
+ * Returned by esp_input and esp_output when the packet has been queued
+ * to the cryptodev batch.  Once the batch has ended, inbound packets
+ * are finished by esp_input_complete, with the result of the op.
+ * Outbound packets have nothing left to do.
+ */
+#define ESP_PENDING 1
+
+int esp_input_complete(struct rte_mbuf *m, struct sadb_sa *sa, int rc,
+		       uint32_t *bytes, uint8_t *new_family);
+
+/*
+ * For a packet of an SA spread over several crypto threads, the
+ * session of the thread processing it and the sequence number that
+ * was reserved for it with esp_seq_reserve().  NULL for other SAs.
+ */
+struct esp_out_slot {
+	struct crypto_session *session;
+	uint32_t seq;
+};
+
 int esp_output(struct rte_mbuf *m,  uint8_t family, void *l3hdr,
-	       struct sadb_sa *sa, uint32_t *bytes);
+	       struct sadb_sa *sa, const struct esp_out_slot *slot,
+	       uint32_t *bytes);
 int esp_output6(struct rte_mbuf *m, uint8_t family, void *l3hdr,
-		struct sadb_sa *sa, uint32_t *bytes);
+		struct sadb_sa *sa, const struct esp_out_slot *slot,
+		uint32_t *bytes);
+uint32_t esp_seq_reserve(struct sadb_sa *sa);
 
 /*
  * RFC 4303 requires the pad length and next header fields to be right aligned
@@ -46,8 +71,13 @@ int esp_output6(struct rte_mbuf *m, uint8_t family, void *l3hdr,
 uint16_t esp_payload_padded_len(const struct crypto_overhead *overhead,
 				uint16_t tot_len);
 
+/* Largest anti-replay window supported, in packets */
+#define ESP_REPLAY_WINDOW_MAX 4096
+
+int esp_replay_init(struct sadb_sa *sa, uint32_t replay_window);
+void esp_replay_fini(struct sadb_sa *sa);
 int esp_replay_check(const uint8_t *esp, const struct sadb_sa *sa);
-void esp_replay_advance(const uint8_t *esp, struct sadb_sa *sa);
+int esp_replay_advance(const uint8_t *esp, struct sadb_sa *sa);
 
 /*
  * Returns true if packet requires crypto processing, false otherwise
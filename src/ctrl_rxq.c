@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Control rx queue - see ctrl_rxq.h.
+ *
+ * Steered packets are still polled by a forwarding lcore and run
+ * the full pipeline, so local firewall, vlan demux and VRF selection
+ * apply to them as before.  Anything a PMD can't steer just stays
+ * on the RSS queues.
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <rte_byteorder.h>
+#include <rte_ethdev.h>
+#include <rte_ether.h>
+#include <rte_flow.h>
+#include <rte_log.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ctrl_rxq.h"
+#include "if_var.h"
+#include "main.h"
+#include "vplane_log.h"
+
+#define CTRL_RXQ_PORT_BGP	179
+#define CTRL_RXQ_PORT_BFD	3784
+#define CTRL_RXQ_PORT_BFD_MHOP	4784
+
+#ifndef IPPROTO_VRRP
+#define IPPROTO_VRRP		112
+#endif
+#ifndef IPPROTO_OSPF
+#define IPPROTO_OSPF		89
+#endif
+
+struct ctrl_rxq_rule {
+	uint16_t	ether_type;
+	uint8_t		proto;		/* IP protocol, or 0 for any */
+	uint16_t	sport;
+	uint16_t	dport;
+};
+
+static const struct ctrl_rxq_rule ctrl_rxq_rules[] = {
+	{ ETHER_TYPE_ARP,  0, 0, 0 },
+	{ ETHER_TYPE_SLOW, 0, 0, 0 },	/* LACP */
+	{ ETHER_TYPE_IPv4, IPPROTO_OSPF, 0, 0 },
+	{ ETHER_TYPE_IPv6, IPPROTO_OSPF, 0, 0 },
+	{ ETHER_TYPE_IPv4, IPPROTO_VRRP, 0, 0 },
+	{ ETHER_TYPE_IPv6, IPPROTO_VRRP, 0, 0 },
+	{ ETHER_TYPE_IPv6, IPPROTO_ICMPV6, 0, 0 },	/* ND */
+	{ ETHER_TYPE_IPv4, IPPROTO_TCP, 0, CTRL_RXQ_PORT_BGP },
+	{ ETHER_TYPE_IPv4, IPPROTO_TCP, CTRL_RXQ_PORT_BGP, 0 },
+	{ ETHER_TYPE_IPv6, IPPROTO_TCP, 0, CTRL_RXQ_PORT_BGP },
+	{ ETHER_TYPE_IPv6, IPPROTO_TCP, CTRL_RXQ_PORT_BGP, 0 },
+	{ ETHER_TYPE_IPv4, IPPROTO_UDP, 0, CTRL_RXQ_PORT_BFD },
+	{ ETHER_TYPE_IPv4, IPPROTO_UDP, 0, CTRL_RXQ_PORT_BFD_MHOP },
+	{ ETHER_TYPE_IPv6, IPPROTO_UDP, 0, CTRL_RXQ_PORT_BFD },
+	{ ETHER_TYPE_IPv6, IPPROTO_UDP, 0, CTRL_RXQ_PORT_BFD_MHOP },
+};
+
+/* Each rule untagged and vlan tagged */
+#define CTRL_RXQ_MAX_FLOWS (2 * RTE_DIM(ctrl_rxq_rules))
+
+static struct rte_flow *
+ctrl_rxq_flows[DATAPLANE_MAX_PORTS][CTRL_RXQ_MAX_FLOWS];
+
+static struct rte_flow *
+ctrl_rxq_flow_create(portid_t port, uint16_t queue,
+		     const struct ctrl_rxq_rule *r, bool vlan)
+{
+	const struct rte_flow_attr attr = { .ingress = 1 };
+	const struct rte_flow_action_queue act_queue = { .index = queue };
+	const struct rte_flow_action actions[] = {
+		{ .type = RTE_FLOW_ACTION_TYPE_QUEUE, .conf = &act_queue },
+		{ .type = RTE_FLOW_ACTION_TYPE_END },
+	};
+	struct rte_flow_item_eth eth_spec, eth_mask;
+	struct rte_flow_item_vlan vlan_spec, vlan_mask;
+	struct rte_flow_item_ipv4 ip4_spec, ip4_mask;
+	struct rte_flow_item_ipv6 ip6_spec, ip6_mask;
+	struct rte_flow_item_tcp tcp_spec, tcp_mask;
+	struct rte_flow_item_udp udp_spec, udp_mask;
+	struct rte_flow_item pattern[5];
+	struct rte_flow_error error;
+	unsigned int n = 0;
+	bool is_ip = r->ether_type == ETHER_TYPE_IPv4 ||
+		r->ether_type == ETHER_TYPE_IPv6;
+
+	memset(pattern, 0, sizeof(pattern));
+	memset(&eth_spec, 0, sizeof(eth_spec));
+	memset(&eth_mask, 0, sizeof(eth_mask));
+	memset(&vlan_spec, 0, sizeof(vlan_spec));
+	memset(&vlan_mask, 0, sizeof(vlan_mask));
+
+	/* The IP items imply the ether type */
+	pattern[n].type = RTE_FLOW_ITEM_TYPE_ETH;
+	if (!is_ip && !vlan) {
+		eth_spec.type = rte_cpu_to_be_16(r->ether_type);
+		eth_mask.type = RTE_BE16(0xffff);
+		pattern[n].spec = &eth_spec;
+		pattern[n].mask = &eth_mask;
+	}
+	n++;
+
+	if (vlan) {
+		pattern[n].type = RTE_FLOW_ITEM_TYPE_VLAN;
+		if (!is_ip) {
+			vlan_spec.inner_type = rte_cpu_to_be_16(r->ether_type);
+			vlan_mask.inner_type = RTE_BE16(0xffff);
+			pattern[n].spec = &vlan_spec;
+			pattern[n].mask = &vlan_mask;
+		}
+		n++;
+	}
+
+	if (r->ether_type == ETHER_TYPE_IPv4) {
+		memset(&ip4_spec, 0, sizeof(ip4_spec));
+		memset(&ip4_mask, 0, sizeof(ip4_mask));
+		ip4_spec.hdr.next_proto_id = r->proto;
+		ip4_mask.hdr.next_proto_id = 0xff;
+		pattern[n].type = RTE_FLOW_ITEM_TYPE_IPV4;
+		pattern[n].spec = &ip4_spec;
+		pattern[n].mask = &ip4_mask;
+		n++;
+	} else if (r->ether_type == ETHER_TYPE_IPv6) {
+		memset(&ip6_spec, 0, sizeof(ip6_spec));
+		memset(&ip6_mask, 0, sizeof(ip6_mask));
+		ip6_spec.hdr.proto = r->proto;
+		ip6_mask.hdr.proto = 0xff;
+		pattern[n].type = RTE_FLOW_ITEM_TYPE_IPV6;
+		pattern[n].spec = &ip6_spec;
+		pattern[n].mask = &ip6_mask;
+		n++;
+	}
+
+	if (r->proto == IPPROTO_TCP) {
+		memset(&tcp_spec, 0, sizeof(tcp_spec));
+		memset(&tcp_mask, 0, sizeof(tcp_mask));
+		tcp_spec.hdr.src_port = rte_cpu_to_be_16(r->sport);
+		tcp_spec.hdr.dst_port = rte_cpu_to_be_16(r->dport);
+		tcp_mask.hdr.src_port = r->sport ? RTE_BE16(0xffff) : 0;
+		tcp_mask.hdr.dst_port = r->dport ? RTE_BE16(0xffff) : 0;
+		pattern[n].type = RTE_FLOW_ITEM_TYPE_TCP;
+		pattern[n].spec = &tcp_spec;
+		pattern[n].mask = &tcp_mask;
+		n++;
+	} else if (r->proto == IPPROTO_UDP) {
+		memset(&udp_spec, 0, sizeof(udp_spec));
+		memset(&udp_mask, 0, sizeof(udp_mask));
+		udp_spec.hdr.src_port = rte_cpu_to_be_16(r->sport);
+		udp_spec.hdr.dst_port = rte_cpu_to_be_16(r->dport);
+		udp_mask.hdr.src_port = r->sport ? RTE_BE16(0xffff) : 0;
+		udp_mask.hdr.dst_port = r->dport ? RTE_BE16(0xffff) : 0;
+		pattern[n].type = RTE_FLOW_ITEM_TYPE_UDP;
+		pattern[n].spec = &udp_spec;
+		pattern[n].mask = &udp_mask;
+		n++;
+	}
+
+	pattern[n].type = RTE_FLOW_ITEM_TYPE_END;
+
+	return rte_flow_create(port, &attr, pattern, actions, &error);
+}
+
+/* Spread RSS over all the queues but the control one */
+static int ctrl_rxq_reta_set(portid_t port, uint16_t nb_rss)
+{
+	struct rte_eth_rss_reta_entry64 reta[ETH_RSS_RETA_SIZE_512 /
+					     RTE_RETA_GROUP_SIZE];
+	struct rte_eth_dev_info dev_info;
+	unsigned int i;
+
+	rte_eth_dev_info_get(port, &dev_info);
+	if (dev_info.reta_size == 0 ||
+	    dev_info.reta_size > ETH_RSS_RETA_SIZE_512)
+		return -ENOTSUP;
+
+	memset(reta, 0, sizeof(reta));
+	for (i = 0; i < dev_info.reta_size; i++) {
+		struct rte_eth_rss_reta_entry64 *e =
+			&reta[i / RTE_RETA_GROUP_SIZE];
+
+		e->mask |= 1ULL << (i % RTE_RETA_GROUP_SIZE);
+		e->reta[i % RTE_RETA_GROUP_SIZE] = i % nb_rss;
+	}
+
+	return rte_eth_dev_rss_reta_update(port, reta, dev_info.reta_size);
+}
+
+void ctrl_rxq_start(portid_t port)
+{
+	struct rte_flow **flows = ctrl_rxq_flows[port];
+	int queue = port_ctrl_rxq(port);
+	unsigned int i, n = 0;
+	int ret;
+
+	if (queue < 0)
+		return;
+
+	/* Without this the control queue still works, as an RSS one */
+	if (queue > 0) {
+		ret = ctrl_rxq_reta_set(port, queue);
+		if (ret < 0)
+			RTE_LOG(NOTICE, DATAPLANE,
+				"port %u: can't keep RSS off control queue: %d\n",
+				port, ret);
+	}
+
+	for (i = 0; i < RTE_DIM(ctrl_rxq_rules); i++) {
+		flows[n] = ctrl_rxq_flow_create(port, queue,
+						&ctrl_rxq_rules[i], false);
+		if (flows[n])
+			n++;
+		flows[n] = ctrl_rxq_flow_create(port, queue,
+						&ctrl_rxq_rules[i], true);
+		if (flows[n])
+			n++;
+	}
+
+	RTE_LOG(INFO, DATAPLANE,
+		"port %u: %u of %zu control steering rules to rx queue %d\n",
+		port, n, CTRL_RXQ_MAX_FLOWS, queue);
+}
+
+void ctrl_rxq_stop(portid_t port)
+{
+	struct rte_flow **flows = ctrl_rxq_flows[port];
+	struct rte_flow_error error;
+	unsigned int i;
+
+	for (i = 0; i < CTRL_RXQ_MAX_FLOWS && flows[i]; i++) {
+		rte_flow_destroy(port, flows[i], &error);
+		flows[i] = NULL;
+	}
+}
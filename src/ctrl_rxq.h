@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Control rx queue - with control-rx-queue set in the config, each
+ * port gets an extra rx queue, which RSS does not use, and rte_flow
+ * rules steer routing and link protocols to it.  Control traffic
+ * then has its own descriptors, and so isn't dropped with the rest
+ * when the RSS queues overflow.
+ */
+#ifndef CTRL_RXQ_H
+#define CTRL_RXQ_H
+
+#include "compat.h"
+
+/* After the port is started, since some PMDs drop flows on stop */
+void ctrl_rxq_start(portid_t port);
+void ctrl_rxq_stop(portid_t port);
+
+#endif /* CTRL_RXQ_H */
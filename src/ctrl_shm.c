@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Shared memory publish channel - see ctrl_shm.h for the ring layout
+ * the controller writes.
+ *
+ * Only the master thread consumes.  Records are handed to the
+ * handlers in place, and tail only moves past them once handled.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <rte_common.h>
+#include <rte_log.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+#include <zmq.h>
+
+#include "control.h"
+#include "ctrl_shm.h"
+#include "dpmsg.h"
+#include "event.h"
+#include "master.h"
+#include "vplane_log.h"
+
+#define CTRL_SHM_SIZE	(8 * 1024 * 1024)
+
+/* Records per wakeup, so a big batch doesn't hold up other events */
+#define CTRL_SHM_BURST	256
+
+static struct {
+	struct ctrl_shm_hdr	*hdr;
+	char			*ring;
+	int			bell_fd;
+	bool			started;
+} cshm = {
+	.bell_fd = -1,
+};
+
+static void ctrl_shm_ring_bell(void)
+{
+	char c = 0;
+
+	if (write(cshm.bell_fd, &c, 1) < 0 && errno != EAGAIN)
+		RTE_LOG(NOTICE, DATAPLANE,
+			"publish shm: doorbell write failed: %s\n",
+			strerror(errno));
+}
+
+static void ctrl_shm_clear_bell(void)
+{
+	char buf[64];
+
+	while (read(cshm.bell_fd, buf, sizeof(buf)) > 0)
+		;
+}
+
+static const struct ctrl_shm_rec *ctrl_shm_rec_get(uint64_t tail)
+{
+	uint32_t off = tail & (cshm.hdr->size - 1);
+	const struct ctrl_shm_rec *rec;
+
+	if (cshm.hdr->size - off < sizeof(*rec))
+		return NULL;
+
+	rec = (const struct ctrl_shm_rec *)(cshm.ring + off);
+	if (rec->len < sizeof(*rec) || rec->len % 8 ||
+	    rec->len > cshm.hdr->size - off)
+		return NULL;
+
+	if (rec->topic_len != CTRL_SHM_PAD &&
+	    (rec->topic_len == 0 ||
+	     rec->topic_len > rec->len - sizeof(*rec)))
+		return NULL;
+
+	return rec;
+}
+
+static int ctrl_shm_deliver(const struct ctrl_shm_rec *rec)
+{
+	size_t data_len = rec->len - sizeof(*rec) - rec->topic_len;
+	dpmsg_t dpmsg;
+
+	/*
+	 * The data length is rounded up to 8, but handlers only take
+	 * protobuf or netlink, which carry their own lengths.
+	 */
+	if (zmq_msg_init_data(&dpmsg.topic_msg, (void *)rec->topic,
+			      rec->topic_len, NULL, NULL))
+		return -1;
+	if (zmq_msg_init_data(&dpmsg.seqno_msg, (void *)&rec->seqno,
+			      sizeof(rec->seqno), NULL, NULL)) {
+		zmq_msg_close(&dpmsg.topic_msg);
+		return -1;
+	}
+	if (zmq_msg_init_data(&dpmsg.data_msg,
+			      (void *)(rec->topic + rec->topic_len),
+			      data_len, NULL, NULL)) {
+		zmq_msg_close(&dpmsg.topic_msg);
+		zmq_msg_close(&dpmsg.seqno_msg);
+		return -1;
+	}
+
+	controller_deliver(CONT_SRC_MAIN, &dpmsg);
+	dpmsg_destroy(&dpmsg);
+	return 0;
+}
+
+static int ctrl_shm_recv(void *arg __rte_unused)
+{
+	uint64_t head, tail;
+	unsigned int n;
+
+	ctrl_shm_clear_bell();
+
+	head = CMM_LOAD_SHARED(cshm.hdr->head);
+	cmm_smp_rmb();
+	tail = cshm.hdr->tail;
+
+	for (n = 0; tail != head && n < CTRL_SHM_BURST; n++) {
+		const struct ctrl_shm_rec *rec = ctrl_shm_rec_get(tail);
+
+		if (!rec || head - tail < rec->len) {
+			RTE_LOG(ERR, DATAPLANE,
+				"publish shm: bad record at %"PRIu64"\n",
+				tail);
+			/* Messages are lost, so start again from a snapshot */
+			CMM_STORE_SHARED(cshm.hdr->tail, head);
+			reset_dataplane(CONT_SRC_MAIN, true);
+			return 0;
+		}
+
+		if (rec->topic_len != CTRL_SHM_PAD &&
+		    ctrl_shm_deliver(rec) < 0)
+			RTE_LOG(NOTICE, DATAPLANE,
+				"publish shm: can't deliver %.*s\n",
+				(int)rec->topic_len, rec->topic);
+
+		tail += rec->len;
+		cmm_smp_mb();
+		CMM_STORE_SHARED(cshm.hdr->tail, tail);
+	}
+
+	/* More left, so come back after other events have had a turn */
+	if (tail != head)
+		ctrl_shm_ring_bell();
+
+	return 0;
+}
+
+void ctrl_shm_start(void)
+{
+	if (!cshm.hdr || cshm.started)
+		return;
+
+	register_event_fd(cshm.bell_fd, ctrl_shm_recv, NULL);
+	cshm.started = true;
+
+	/* Pick up anything published while resyncing */
+	ctrl_shm_ring_bell();
+}
+
+void ctrl_shm_stop(void)
+{
+	if (!cshm.started)
+		return;
+
+	unregister_event_fd(cshm.bell_fd);
+	cshm.started = false;
+}
+
+/*
+ * Without the ring the controller still has the zmq publish socket,
+ * so failures here are not fatal.
+ */
+void ctrl_shm_init(const char *name)
+{
+	size_t data_offset = RTE_ALIGN_CEIL(sizeof(struct ctrl_shm_hdr),
+					    RTE_CACHE_LINE_SIZE);
+	size_t size = data_offset + CTRL_SHM_SIZE;
+	char bell[PATH_MAX];
+	void *base;
+	int fd;
+
+	if (cshm.hdr)
+		return;
+
+	if (name[0] != '/' || strchr(name + 1, '/')) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	snprintf(bell, sizeof(bell), "/dev/shm%s.bell", name);
+	unlink(bell);
+	if (mkfifo(bell, 0600) < 0)
+		goto fail;
+
+	/* Read and write, so the FIFO never sees EOF between writers */
+	cshm.bell_fd = open(bell, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (cshm.bell_fd < 0)
+		goto fail_bell;
+
+	/* A fresh segment, so a previous producer can't write into it */
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+		goto fail_bell;
+
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		goto fail_shm;
+	}
+
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED)
+		goto fail_shm;
+
+	cshm.hdr = base;
+	cshm.ring = (char *)base + data_offset;
+
+	cshm.hdr->version = CTRL_SHM_VERSION;
+	cshm.hdr->size = CTRL_SHM_SIZE;
+	cshm.hdr->data_offset = data_offset;
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(cshm.hdr->magic, CTRL_SHM_MAGIC);
+
+	RTE_LOG(INFO, DATAPLANE, "publish shm %s ready\n", name);
+	return;
+
+fail_shm:
+	shm_unlink(name);
+fail_bell:
+	if (cshm.bell_fd >= 0)
+		close(cshm.bell_fd);
+	cshm.bell_fd = -1;
+	unlink(bell);
+fail:
+	RTE_LOG(NOTICE, DATAPLANE,
+		"publish shm %s unavailable: %s\n", name, strerror(errno));
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Shared memory publish channel - with publish_shm set in the
+ * [Controller] section, a controller on the same host can publish
+ * through a ring in shared memory instead of the zmq publish socket.
+ * The messages are the same topic, seqno and data triples, and go to
+ * the same handlers, but large config batches are not copied through
+ * zmq on the way.  Snapshots and remote controllers still use zmq.
+ *
+ * The dataplane creates the segment, named by publish_shm, and a FIFO
+ * at /dev/shm<publish_shm>.bell.  The ring is ready once magic is set.
+ *
+ * head and tail are free running byte counts; the producer only moves
+ * head and the dataplane only moves tail.  Records are 8 byte aligned
+ * and never wrap: when one won't fit before the end of the ring the
+ * producer writes a CTRL_SHM_PAD record over the rest and starts again
+ * at offset 0.  The producer writes the record, then head with a
+ * release barrier, then a byte to the FIFO.
+ *
+ * The controller must publish on only one of zmq and the ring at a
+ * time, since both share the seqno and an older seqno is discarded.
+ */
+#ifndef CTRL_SHM_H
+#define CTRL_SHM_H
+
+#include <stdint.h>
+
+#define CTRL_SHM_MAGIC		0x56444353	/* "VDCS" */
+#define CTRL_SHM_VERSION	1
+#define CTRL_SHM_PAD		UINT32_MAX
+
+struct ctrl_shm_hdr {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	size;		/* ring bytes, a power of 2 */
+	uint32_t	data_offset;	/* of the ring from the header */
+	uint8_t		pad0[48];
+	uint64_t	head;		/* written by the controller */
+	uint8_t		pad1[56];
+	uint64_t	tail;		/* written by the dataplane */
+	uint8_t		pad2[56];
+};
+
+struct ctrl_shm_rec {
+	uint32_t	len;		/* whole record, multiple of 8 */
+	uint32_t	topic_len;	/* or CTRL_SHM_PAD */
+	uint64_t	seqno;
+	char		topic[];	/* then the data, without padding */
+};
+
+void ctrl_shm_init(const char *name);
+void ctrl_shm_start(void);
+void ctrl_shm_stop(void);
+
+#endif /* CTRL_SHM_H */
@@ -0,0 +1,131 @@
+/*-
+ * Copyright (c) 2019, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Memory accounting by subsystem - see dp_mem.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dp_mem.h"
+#include "json_writer.h"
+#include "util.h"
+
+struct dp_mem_lcore dp_mem_lcore[RTE_MAX_LCORE];
+
+static const char *const dp_mem_names[DP_MEM_TAG_MAX] = {
+	[DP_MEM_SESSION]	= "session",
+	[DP_MEM_CGNAT]		= "cgnat",
+	[DP_MEM_LPM]		= "lpm",
+	[DP_MEM_LPM6]		= "lpm6",
+	[DP_MEM_NEXTHOP]	= "nexthop",
+	[DP_MEM_BRIDGE]		= "bridge",
+};
+
+void *dp_mem_zmalloc(enum dp_mem_tag tag, size_t sz)
+{
+	void *ptr = zmalloc_aligned(sz);
+
+	if (ptr)
+		dp_mem_account_alloc(tag, sz);
+	return ptr;
+}
+
+void dp_mem_free(enum dp_mem_tag tag, void *ptr, size_t sz)
+{
+	if (!ptr)
+		return;
+
+	dp_mem_account_free(tag, sz);
+	free(ptr);
+}
+
+void *dp_mem_huge_alloc(enum dp_mem_tag tag, size_t sz)
+{
+	void *ptr = malloc_huge_aligned(sz);
+
+	if (ptr)
+		dp_mem_account_alloc(tag, sz);
+	return ptr;
+}
+
+void dp_mem_huge_free(enum dp_mem_tag tag, void *ptr, size_t sz)
+{
+	if (!ptr)
+		return;
+
+	dp_mem_account_free(tag, sz);
+	free_huge(ptr, sz);
+}
+
+/* Counted as freed now, rather than after the grace period */
+int dp_mem_huge_defer_free(enum dp_mem_tag tag, void *ptr, size_t sz)
+{
+	int ret = defer_rcu_huge(ptr, sz);
+
+	if (!ret)
+		dp_mem_account_free(tag, sz);
+	return ret;
+}
+
+static void dp_mem_stats_add(struct dp_mem_stats *sum,
+			     const struct dp_mem_stats *s)
+{
+	sum->alloc_bytes += CMM_LOAD_SHARED(s->alloc_bytes);
+	sum->free_bytes += CMM_LOAD_SHARED(s->free_bytes);
+	sum->allocs += CMM_LOAD_SHARED(s->allocs);
+	sum->frees += CMM_LOAD_SHARED(s->frees);
+}
+
+static void dp_mem_stats_dump(json_writer_t *wr, const struct dp_mem_stats *s)
+{
+	jsonw_uint_field(wr, "alloc_bytes", s->alloc_bytes);
+	jsonw_uint_field(wr, "free_bytes", s->free_bytes);
+	jsonw_uint_field(wr, "alloc_count", s->allocs);
+	jsonw_uint_field(wr, "free_count", s->frees);
+}
+
+/*
+ * "subsystems": for each tag the bytes in use, over all lcores, and
+ * the counts of each lcore that has allocated or freed any.
+ */
+void dp_mem_summary(json_writer_t *wr)
+{
+	struct dp_mem_stats sum;
+	const struct dp_mem_stats *s;
+	unsigned int tag, lcore;
+
+	jsonw_name(wr, "subsystems");
+	jsonw_start_object(wr);
+	for (tag = 0; tag < DP_MEM_TAG_MAX; tag++) {
+		memset(&sum, 0, sizeof(sum));
+		FOREACH_DP_LCORE(lcore)
+			dp_mem_stats_add(&sum, &dp_mem_lcore[lcore].tag[tag]);
+
+		jsonw_name(wr, dp_mem_names[tag]);
+		jsonw_start_object(wr);
+		jsonw_uint_field(wr, "bytes",
+				 sum.alloc_bytes > sum.free_bytes ?
+				 sum.alloc_bytes - sum.free_bytes : 0);
+		dp_mem_stats_dump(wr, &sum);
+
+		jsonw_name(wr, "lcores");
+		jsonw_start_array(wr);
+		FOREACH_DP_LCORE(lcore) {
+			s = &dp_mem_lcore[lcore].tag[tag];
+			if (!s->allocs && !s->frees)
+				continue;
+
+			jsonw_start_object(wr);
+			jsonw_uint_field(wr, "lcore", lcore);
+			dp_mem_stats_dump(wr, s);
+			jsonw_end_object(wr);
+		}
+		jsonw_end_array(wr);
+		jsonw_end_object(wr);
+	}
+	jsonw_end_object(wr);
+}
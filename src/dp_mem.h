@@ -0,0 +1,85 @@
+/*-
+ * Copyright (c) 2019, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Memory accounting by subsystem
+ */
+#ifndef DP_MEM_H
+#define DP_MEM_H
+
+#include <rte_common.h>
+#include <rte_config.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <urcu/uatomic.h>
+
+#include "compiler.h"
+#include "json_writer.h"
+#include "util.h"
+
+/*
+ * The larger tables allocate through these wrappers, or account for
+ * what they allocate themselves, against a tag for their subsystem.
+ * Counts are kept per lcore, so that the forwarding threads creating
+ * sessions don't share a cache line; threads other than the
+ * forwarding ones share lcore 0, hence the atomics.
+ *
+ * Memory freed on another lcore than it was allocated on, e.g. from
+ * an RCU callback, is counted against the lcore freeing it, so only
+ * the totals over all lcores give the memory in use.
+ */
+enum dp_mem_tag {
+	DP_MEM_SESSION,
+	DP_MEM_CGNAT,
+	DP_MEM_LPM,
+	DP_MEM_LPM6,
+	DP_MEM_NEXTHOP,
+	DP_MEM_BRIDGE,
+	DP_MEM_TAG_MAX
+};
+
+struct dp_mem_stats {
+	uint64_t	alloc_bytes;
+	uint64_t	free_bytes;
+	uint64_t	allocs;
+	uint64_t	frees;
+};
+
+struct dp_mem_lcore {
+	struct dp_mem_stats	tag[DP_MEM_TAG_MAX];
+} __rte_cache_aligned;
+
+extern struct dp_mem_lcore dp_mem_lcore[RTE_MAX_LCORE];
+
+static ALWAYS_INLINE void
+dp_mem_account_alloc(enum dp_mem_tag tag, size_t sz)
+{
+	struct dp_mem_stats *s = &dp_mem_lcore[dp_lcore_id()].tag[tag];
+
+	uatomic_add(&s->alloc_bytes, sz);
+	uatomic_inc(&s->allocs);
+}
+
+static ALWAYS_INLINE void
+dp_mem_account_free(enum dp_mem_tag tag, size_t sz)
+{
+	struct dp_mem_stats *s = &dp_mem_lcore[dp_lcore_id()].tag[tag];
+
+	uatomic_add(&s->free_bytes, sz);
+	uatomic_inc(&s->frees);
+}
+
+/* Zeroed and cache aligned, from the heap */
+void *dp_mem_zmalloc(enum dp_mem_tag tag, size_t sz);
+void dp_mem_free(enum dp_mem_tag tag, void *ptr, size_t sz);
+
+/* Page mapped, for the big tables, see malloc_huge_aligned() */
+void *dp_mem_huge_alloc(enum dp_mem_tag tag, size_t sz);
+void dp_mem_huge_free(enum dp_mem_tag tag, void *ptr, size_t sz);
+int dp_mem_huge_defer_free(enum dp_mem_tag tag, void *ptr, size_t sz);
+
+void dp_mem_summary(json_writer_t *wr);
+
+#endif /* DP_MEM_H */
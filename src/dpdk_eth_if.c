@@ -6,7 +6,10 @@
  * DPDK port-backed interface implementation
  */
 
+#include <czmq.h>
+#include <pthread.h>
 #include <stdint.h>
+#include <unistd.h>
 #include <rte_ethdev.h>
 #include <rte_eth_bond.h>
 #include <rte_log.h>
@@ -25,14 +28,30 @@
 #include "vplane_debug.h"
 #include "vplane_log.h"
 #include "transceiver.h"
+#include "urcu.h"
 
 #define MODULE_SFF_8436_AX_LEN 640
 
-static inline bool
-is_jumbo_size(uint32_t size)
-{
-	return size > ETHER_MTU;
-}
+/*
+ * Transceiver EEPROMs sit behind I2C and a module can take
+ * milliseconds to read, so they are read by a background thread, one
+ * module per tick, and "show" uses the last copy read.
+ */
+#define XCVR_POLL_TICK_US	(100 * 1000)
+
+struct xcvr_cache {
+	struct rcu_head			rcu;
+	struct rte_eth_dev_module_info	module_info;
+	struct rte_dev_eeprom_info	eeprom_info;
+	uint8_t				data[MODULE_SFF_8436_AX_LEN];
+};
+
+/* Ports to poll, and their last reads, are protected by xcvr_lock */
+static pthread_mutex_t xcvr_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool xcvr_polled[DATAPLANE_MAX_PORTS];
+static struct xcvr_cache *xcvr_cache[DATAPLANE_MAX_PORTS];
+static pthread_t xcvr_thread;
+static bool xcvr_thread_running;
 
 static int dpdk_eth_if_set_mtu(struct ifnet *ifp, uint32_t mtu)
 {
@@ -59,26 +78,15 @@ static int dpdk_eth_if_set_mtu(struct ifnet *ifp, uint32_t mtu)
 	 * and restart it to get QoS to recalculate its token bucket
 	 * size based upon the new MTU.
 	 *
-	 * If it does not have QoS on it then we may have to stop it
-	 * anyway as some drivers always need the port to be stopped (i40)
-	 * for the mtu to be changed. Some drivers need the port to be
-	 * stopped to transition into/outof jumbo range (ixgbe).
-	 * Unfortunately we can't tell this ahead of time, so try to
-	 * set the mtu, and if we get an error then stop the ports and
-	 * try again.
-	 *
-	 * If we are transitioning into/outof jumbo range then we have to
-	 * reconfigure the port to get the correct jumbo settings.
+	 * Otherwise try to set the mtu on the running port, which
+	 * keeps traffic flowing, including into/outof the jumbo range
+	 * where the driver supports it. Some drivers always need the
+	 * port to be stopped (i40) or need it to change the jumbo
+	 * range without scatter (ixgbe). We can't tell this ahead of
+	 * time, so if we get an error then stop the port and try again.
 	 */
-	bool mtu_jumbo_change =
-		(is_jumbo_size(ifp->if_mtu_adjusted) &&
-			!is_jumbo_size(mtu)) ||
-		(is_jumbo_size(mtu) &&
-			!is_jumbo_size(ifp->if_mtu_adjusted));
-
-	/* Try and set it. If we get an error try again with port stopped */
-	if (!mtu_jumbo_change && !ifp->if_qos)
-		err = rte_eth_dev_set_mtu(ifp->if_port, adjusted_mtu);
+	if (!ifp->if_qos)
+		err = set_pkt_len_online(ifp, adjusted_mtu);
 
 	/*
 	 * We must update the interface's adjusted MTU before
@@ -90,12 +98,12 @@ static int dpdk_eth_if_set_mtu(struct ifnet *ifp, uint32_t mtu)
 	ifp->if_mtu_adjusted = adjusted_mtu;
 
 	/* Try again, but this time after changing the port config */
-	if (mtu_jumbo_change || err || ifp->if_qos) {
+	if (err || ifp->if_qos) {
 		RTE_LOG(INFO, DATAPLANE,
 			"reconfiguring %s due to %s\n",
 			ifp->if_name,
-			mtu_jumbo_change ?
-				"jumbo length packet change" :
+			ifp->if_qos ?
+				"QoS on the interface" :
 				"online MTU setting not supported for this interface");
 		err = reconfigure_pkt_len(ifp, adjusted_mtu);
 	}
@@ -239,6 +247,9 @@ static void dpdk_eth_if_uninit(struct ifnet *ifp)
 	rte_timer_stop(&sc->scd_blink_timer);
 	rte_timer_stop(&sc->scd_reset_timer);
 
+	if (if_is_hwport(ifp))
+		xcvr_poll_stop(ifp->if_port);
+
 	rcu_assign_pointer(ifp->if_softc, NULL);
 
 	call_rcu(&sc->scd_rcu, dpdk_eth_if_softc_free_rcu);
@@ -545,48 +556,139 @@ dpdk_eth_if_show_state(struct ifnet *ifp, json_writer_t *wr)
 		jsonw_uint_field(wr, "port", ifp->if_port);
 }
 
-static void dpdk_eth_if_show_xcvr_info(struct ifnet *ifp, json_writer_t *wr)
+static void xcvr_cache_free(struct rcu_head *head)
 {
-	struct rte_eth_dev_module_info module_info;
-	struct rte_dev_eeprom_info eeprom_info;
-	char *buf;
-	int rv;
+	free(caa_container_of(head, struct xcvr_cache, rcu));
+}
 
-	memset(&module_info, 0, sizeof(module_info));
+static void xcvr_cache_set(portid_t port, struct xcvr_cache *xc)
+{
+	struct xcvr_cache *old;
 
-	rv = rte_eth_dev_get_module_info(ifp->if_port, &module_info);
-	if (rv)
-		return;
+	old = rcu_xchg_pointer(&xcvr_cache[port], xc);
+	if (old)
+		call_rcu(&old->rcu, xcvr_cache_free);
+}
 
-	eeprom_info.length =
-	module_info.eeprom_len < MODULE_SFF_8436_AX_LEN ?
-		module_info.eeprom_len : MODULE_SFF_8436_AX_LEN;
+/* Called with xcvr_lock held; NULL if there is no module to read */
+static struct xcvr_cache *xcvr_read(portid_t port)
+{
+	struct xcvr_cache *xc;
 
-	buf = malloc(eeprom_info.length);
-	if (!buf) {
+	xc = calloc(1, sizeof(*xc));
+	if (!xc) {
 		DP_DEBUG(LINK, ERR, DATAPLANE,
 			"Failed to allocate xcvr eeprom info buffer\n");
-		return;
+		return NULL;
 	}
-	eeprom_info.data = buf;
-	eeprom_info.offset = 0;
 
-	rv = rte_eth_dev_get_module_eeprom(ifp->if_port, &eeprom_info);
-	if (rv) {
-		free(buf);
-		return;
+	if (rte_eth_dev_get_module_info(port, &xc->module_info) ||
+	    !xc->module_info.eeprom_len)
+		goto none;
+
+	xc->eeprom_info.length =
+	xc->module_info.eeprom_len < MODULE_SFF_8436_AX_LEN ?
+		xc->module_info.eeprom_len : MODULE_SFF_8436_AX_LEN;
+	xc->eeprom_info.data = xc->data;
+	xc->eeprom_info.offset = 0;
+
+	if (rte_eth_dev_get_module_eeprom(port, &xc->eeprom_info))
+		goto none;
+
+	return xc;
+
+none:
+	free(xc);
+	return NULL;
+}
+
+/* The next port to poll after the given one, or -1 if there are none */
+static int xcvr_next_port(int last)
+{
+	int i, port;
+
+	for (i = 1; i <= DATAPLANE_MAX_PORTS; i++) {
+		port = (last + i) % DATAPLANE_MAX_PORTS;
+		if (xcvr_polled[port])
+			return port;
 	}
+	return -1;
+}
+
+static void xcvr_thread_cleanup(void *arg __unused)
+{
+	rcu_unregister_thread();
+}
 
-	if (!module_info.eeprom_len) {
-		free(buf);
+static void *xcvr_thread_fn(void *arg __unused)
+{
+	int port = -1;
+
+	pthread_setname_np(pthread_self(), "dataplane/xcvr");
+	pthread_cleanup_push(xcvr_thread_cleanup, NULL);
+
+	/* Only to free old reads, so never online */
+	rcu_register_thread();
+	rcu_thread_offline();
+
+	while (!zsys_interrupted) {
+		usleep(XCVR_POLL_TICK_US);
+
+		/* Not cancelled with the lock held, or in the driver */
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+		pthread_mutex_lock(&xcvr_lock);
+		port = xcvr_next_port(port);
+		if (port >= 0)
+			xcvr_cache_set(port, xcvr_read(port));
+		pthread_mutex_unlock(&xcvr_lock);
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	}
+
+	pthread_cleanup_pop(1);
+	return NULL;
+}
+
+static void xcvr_poll_start(portid_t port)
+{
+	pthread_mutex_lock(&xcvr_lock);
+	xcvr_polled[port] = true;
+	pthread_mutex_unlock(&xcvr_lock);
+
+	if (xcvr_thread_running)
+		return;
+
+	if (pthread_create(&xcvr_thread, NULL, xcvr_thread_fn, NULL) != 0) {
+		RTE_LOG(ERR, DATAPLANE,
+			"xcvr thread creation failed, no transceiver info\n");
 		return;
 	}
+	xcvr_thread_running = true;
+}
+
+/*
+ * Waits for any read of the port in progress, so the port can then
+ * be closed.
+ */
+static void xcvr_poll_stop(portid_t port)
+{
+	pthread_mutex_lock(&xcvr_lock);
+	xcvr_polled[port] = false;
+	xcvr_cache_set(port, NULL);
+	pthread_mutex_unlock(&xcvr_lock);
+}
+
+static void dpdk_eth_if_show_xcvr_info(struct ifnet *ifp, json_writer_t *wr)
+{
+	const struct xcvr_cache *xc;
+
+	xc = rcu_dereference(xcvr_cache[ifp->if_port]);
+	if (!xc)
+		return;
 
 	jsonw_name(wr, "xcvr_info");
 	jsonw_start_object(wr);
-	sfp_status(&module_info, &eeprom_info, wr);
+	sfp_status(&xc->module_info, &xc->eeprom_info, wr);
 	jsonw_end_object(wr);
-	free(buf);
 }
 
 static int
@@ -784,8 +886,27 @@ static void dpdk_eth_init(void)
 			  strerror(-ret));
 }
 
+static void dpdk_eth_uninit(void)
+{
+	if (!xcvr_thread_running)
+		return;
+
+	pthread_cancel(xcvr_thread);
+	pthread_join(xcvr_thread, NULL);
+	xcvr_thread_running = false;
+}
+
+static void
+dpdk_eth_if_index_set(struct ifnet *ifp, uint32_t ifindex __unused)
+{
+	if (if_is_hwport(ifp))
+		xcvr_poll_start(ifp->if_port);
+}
+
 static const struct dp_event_ops dpdk_eth_if_events = {
 	.init = dpdk_eth_init,
+	.uninit = dpdk_eth_uninit,
+	.if_index_set = dpdk_eth_if_index_set,
 };
 
 DP_STARTUP_EVENT_REGISTER(dpdk_eth_if_events);
@@ -58,12 +58,17 @@ static uint8_t ecmp_mode = ECMP_HRW;
 /* Global ECMP max path param */
 uint16_t ecmp_max_path = UINT16_MAX;
 
+/* Use the receive side hash from the NIC as the flow key if present */
+static bool ecmp_rss_hash;
+static uint32_t ecmp_rss_seed;
+
 /* ECMP modes */
 static const char *ecmp_modes[ECMP_MAX] = {
 	[ECMP_DISABLED]		= "disable",
 	[ECMP_HASH_THRESHOLD]	= "hash-threshold",
 	[ECMP_HRW]		= "hrw",
 	[ECMP_MODULO_N]		= "modulo-n",
+	[ECMP_RESILIENT]	= "resilient",
 };
 
 /* Callback to store route attributes */
@@ -614,11 +619,18 @@ union next_hop_v4_or_v6_ptr ecmp_mpls_create(struct nlattr *mpath,
  * All of the common L4 transport protocols (TCP/UDP/SCTP/UDP-Lite/DCCP)
  * have their port numbers at the same offset.  Also ESP has a 32 bit
  * SPI field there which can serve the same purpose.
+ *
+ * Use the ports from the firewall cache if it has parsed this header.
  */
-static uint32_t l4_key(const struct rte_mbuf *m, unsigned int l4offs,
-		       uint8_t proto)
+static uint32_t l4_key(const struct rte_mbuf *m, unsigned int l3offs,
+		       unsigned int l4offs, uint8_t proto)
 {
 	const void *l4hdr = rte_pktmbuf_mtod(m, const char *) + l4offs;
+	const struct pkt_mdata_l4 *ml = pktmbuf_mdata_l4(m, l3offs);
+
+	if (ml && (ml->ml_flags & PKT_MDATA_L4_PORTS) &&
+	    ml->ml_l4_offs == l4offs && ml->ml_proto == proto)
+		return ml->ml_ports;
 
 	if (unlikely(rte_pktmbuf_data_len(m) < l4offs + sizeof(uint32_t)))
 		return 0;
@@ -647,7 +659,7 @@ uint32_t ecmp_ipv4_hash(const struct rte_mbuf *m, unsigned int l3offs)
 	const struct iphdr *ip = (const struct iphdr *)
 		(rte_pktmbuf_mtod(m, const char *) + l3offs);
 	unsigned int l4offs = l3offs + (ip->ihl << 2);
-	uint32_t l4key = ip_is_fragment(ip) ? ip->id : l4_key(m, l4offs,
+	uint32_t l4key = ip_is_fragment(ip) ? ip->id : l4_key(m, l3offs, l4offs,
 							      ip->protocol);
 	return ecmp_iphdr_hash(ip, l4key);
 }
@@ -665,14 +677,32 @@ uint32_t ecmp_ip6hdr_hash(const struct ip6_hdr *ip6, uint32_t l4_key)
 	return rte_jhash_32b(hkey, 9, ip6->ip6_nxt);
 }
 
+/*
+ * Past any extension headers, as found by ipv6-validate or the
+ * firewall.  Fragments are hashed without the L4 key, so that they
+ * all take the path of the first.
+ */
 uint32_t ecmp_ipv6_hash(const struct rte_mbuf *m, unsigned int l3offs)
 {
 	const struct ip6_hdr *ip6 = (const struct ip6_hdr *)
 		(rte_pktmbuf_mtod(m, const char *) + l3offs);
 	unsigned int l4offs = l3offs + sizeof(*ip6);
 	uint32_t flow = ip6->ip6_flow & IPV6_FLOWLABEL_MASK;
+	const struct pkt_mdata_l4 *ml;
+	uint8_t proto = ip6->ip6_nxt;
+
+	if (flow)
+		return ecmp_ip6hdr_hash(ip6, flow);
+
+	if (unlikely(ip6_is_ext_hdr(proto))) {
+		ml = pktmbuf_mdata_l4(m, l3offs);
+		if (!ml || (ml->ml_flags & PKT_MDATA_L4_FRAG))
+			return ecmp_ip6hdr_hash(ip6, 0);
+		l4offs = ml->ml_l4_offs;
+		proto = ml->ml_proto;
+	}
 
-	return ecmp_ip6hdr_hash(ip6, flow ? : l4_key(m, l4offs, ip6->ip6_nxt));
+	return ecmp_ip6hdr_hash(ip6, l4_key(m, l3offs, l4offs, proto));
 }
 
 /*
@@ -716,6 +746,15 @@ ecmp_mbuf_hash(const struct rte_mbuf *m, uint16_t ether_type)
 	if (!m)
 		return 0;
 
+	/*
+	 * The NIC hash covers the same addresses and ports, so save
+	 * parsing the headers. It is of the outer headers though, so
+	 * decapsulated packets of one tunnel all get the same key. Mix
+	 * in the seed so that boxes in series make different choices.
+	 */
+	if (ecmp_rss_hash && (m->ol_flags & PKT_RX_RSS_HASH))
+		return rte_jhash_1word(m->hash.rss, ecmp_rss_seed);
+
 	if (ether_type == ETH_P_MPLS_UC)
 		return mpls_ecmp_hash(m);
 	else if (ether_type == ETHER_TYPE_IPv6)
@@ -732,6 +771,7 @@ ecmp_lookup_alg(enum ecmp_modes ecmp_alg, uint32_t size, uint32_t key)
 		return key / (UINT32_MAX / size);
 
 	case ECMP_HRW:
+	case ECMP_RESILIENT:
 		return ecmp_hrw(key, size);
 
 	case ECMP_MODULO_N:
@@ -743,17 +783,55 @@ ecmp_lookup_alg(enum ecmp_modes ecmp_alg, uint32_t size, uint32_t key)
 }
 
 /*
- * ECMP nexthop lookup based on configured algorithm
+ * ECMP nexthop lookup based on configured algorithm. In resilient mode
+ * this is a single index into the nexthop's bucket table, falling back
+ * to rendezvous hashing when the caller has no table for this size.
  */
-unsigned int ecmp_lookup(uint32_t size, uint32_t key)
+unsigned int ecmp_lookup(uint32_t size, uint32_t key,
+			 const uint16_t *buckets)
 {
+	if (ecmp_mode == ECMP_RESILIENT && buckets)
+		return buckets[key % ECMP_BUCKETS];
+
 	return ecmp_lookup_alg(ecmp_mode, size, key);
 }
 
+/*
+ * Fill a resilient hashing bucket table. Each bucket goes to the path
+ * with the highest weight for it, where the weight comes from the path
+ * identity rather than its position. Adding or removing a path then
+ * only moves the buckets that path gains or loses.
+ */
+void ecmp_buckets_fill(uint16_t *buckets, const uint32_t *path_ids,
+		       uint32_t size)
+{
+	unsigned int b, i;
+
+	if (size > UINT16_MAX + 1)
+		size = UINT16_MAX + 1;
+
+	for (b = 0; b < ECMP_BUCKETS; b++) {
+		uint32_t hweight = rte_jhash_1word(path_ids[0], b);
+		uint16_t selected = 0;
+
+		for (i = 1; i < size; i++) {
+			uint32_t weight = rte_jhash_1word(path_ids[i], b);
+
+			if (weight > hweight) {
+				hweight = weight;
+				selected = i;
+			}
+		}
+		buckets[b] = selected;
+	}
+}
+
 static void ecmp_show(json_writer_t *json)
 {
 	jsonw_string_field(json, "mode", ecmp_modes[ecmp_mode]);
 	jsonw_uint_field(json, "max-path", ecmp_max_path);
+	jsonw_bool_field(json, "rss-hash", ecmp_rss_hash);
+	jsonw_uint_field(json, "rss-seed", ecmp_rss_seed);
 }
 
 static int ecmp_set_mode(const char *mode)
@@ -780,18 +858,20 @@ static int ecmp_set_max_path(int val)
 }
 
 #define ECMP_MODES \
-	"hash-threshold|hrw|modulo-n|disable"
+	"hash-threshold|hrw|modulo-n|resilient|disable"
 
 #define CMD_ECMP_USAGE                     \
 	"Usage: ecmp show\n"               \
 "       ecmp max-path <2-65535>\n" \
-"       ecmp mode <"ECMP_MODES">\n"
+"       ecmp mode <"ECMP_MODES">\n" \
+"       ecmp rss-hash <on|off> [<seed>]\n"
 
 /*
  * Commands:
  *      ecmp show - show ecmp options
  *      ecmp mode - set ecmp mode
  *      ecmp max-path - set ecmp max-path option
+ *      ecmp rss-hash - take the flow key from the NIC hash
  */
 int cmd_ecmp(FILE *f, int argc, char **argv)
 {
@@ -806,6 +886,14 @@ int cmd_ecmp(FILE *f, int argc, char **argv)
 		if (val == 0 || (val >= 2 && val <= 65535))
 			return ecmp_set_max_path(val);
 
+	} else if ((argc == 3 || argc == 4) &&
+		   !strcmp(argv[1], "rss-hash")) {
+		if (!strcmp(argv[2], "on") || !strcmp(argv[2], "off")) {
+			if (argc == 4)
+				ecmp_rss_seed = strtoul(argv[3], NULL, 0);
+			ecmp_rss_hash = !strcmp(argv[2], "on");
+			return 0;
+		}
 	} else if (argc == 2 && !strcmp(argv[1], "show")) {
 		json = jsonw_new(f);
 		jsonw_name(json, "ecmp_show");
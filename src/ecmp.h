@@ -21,12 +21,16 @@ struct nlattr;
 /* Global ECMP max path param */
 extern uint16_t ecmp_max_path;
 
+/* Size of the per nexthop table used for resilient hashing */
+#define ECMP_BUCKETS 256
+
 /* ECMP modes */
 enum ecmp_modes {
 	ECMP_DISABLED,
 	ECMP_HASH_THRESHOLD,
 	ECMP_HRW,
 	ECMP_MODULO_N,
+	ECMP_RESILIENT,
 	ECMP_MAX
 };
 
@@ -36,7 +40,10 @@ uint32_t ecmp_ip6hdr_hash(const struct ip6_hdr *ip6, uint32_t l4_key);
 uint32_t ecmp_ipv6_hash(const struct rte_mbuf *m, unsigned int l3offs);
 uint32_t ecmp_mbuf_hash(const struct rte_mbuf *m, uint16_t ether_type);
 
-unsigned int ecmp_lookup(uint32_t size, uint32_t key);
+unsigned int ecmp_lookup(uint32_t size, uint32_t key,
+			 const uint16_t *buckets);
+void ecmp_buckets_fill(uint16_t *buckets, const uint32_t *path_ids,
+		       uint32_t size);
 
 struct next_hop *ecmp_create(struct nlattr *mpath, uint32_t *count,
 			     bool *missing_ifp);
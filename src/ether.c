@@ -6,6 +6,7 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#include <rte_common.h>
 
 #include "ether.h"
 
@@ -13,6 +14,9 @@
 #include "l2_rx_fltr.h"
 #include "pl_common.h"
 #include "pl_fused.h"
+#include "pl_node.h"
+#include "pl_nodes_common.h"
+#include "pl_trace.h"
 #include "vplane_log.h"
 
 struct ifnet;
@@ -31,8 +35,12 @@ ether_input(struct ifnet *ifp, struct rte_mbuf *m)
 	pkt.mbuf = m;
 	/* Init to null, to aid compiler optimisation*/
 	pkt.nxt.v6 = NULL;
+	pkt.nxt_resolved = false;
+	pkt.rpf_resolved = false;
+	pkt.drop_reason = PL_DROP_UNSPEC;
 	pkt.in_ifp = ifp;
 	pkt.max_data_used = 0;
+	pl_trace_input(ifp, m);
 	pipeline_fused_ether_in(&pkt);
 }
 
@@ -49,11 +57,48 @@ ether_input_no_dyn_feats(struct ifnet *ifp, struct rte_mbuf *m)
 	pkt.mbuf = m;
 	/* Init to null, to aid compiler optimisation*/
 	pkt.nxt.v6 = NULL;
+	pkt.nxt_resolved = false;
+	pkt.rpf_resolved = false;
+	pkt.drop_reason = PL_DROP_UNSPEC;
 	pkt.in_ifp = ifp;
 	pkt.max_data_used = 0;
+	pl_trace_input(ifp, m);
 	pipeline_fused_no_dyn_feats_ether_in(&pkt);
 }
 
+/*
+ * Ether switching input for a burst of packets in vector mode
+ *
+ * Always consumes the mbufs
+ */
+__attribute__((noinline)) void
+ether_input_burst(struct ifnet *ifp, struct rte_mbuf **pkts, uint16_t nb)
+{
+	struct pl_packet pkt[PL_VEC_MAX];
+	struct pl_packet *vec[PL_VEC_MAX];
+	unsigned int i, n;
+
+	while (nb) {
+		n = RTE_MIN(nb, PL_VEC_MAX);
+
+		for (i = 0; i < n; i++) {
+			pkt[i].mbuf = pkts[i];
+			pkt[i].nxt.v6 = NULL;
+			pkt[i].nxt_resolved = false;
+			pkt[i].rpf_resolved = false;
+			pkt[i].drop_reason = PL_DROP_UNSPEC;
+			pkt[i].in_ifp = ifp;
+			pkt[i].max_data_used = 0;
+			vec[i] = &pkt[i];
+			pl_trace_input(ifp, pkts[i]);
+		}
+		pl_graph_walk_vec(ether_in_node_ptr, vec, n);
+
+		pkts += n;
+		nb -= n;
+	}
+}
+
 int ether_if_set_l2_address(struct ifnet *ifp, uint32_t l2_addr_len,
 			    void *l2_addr)
 {
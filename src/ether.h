@@ -40,6 +40,8 @@ void ether_input(struct ifnet *ifp, struct rte_mbuf *m)
 	__hot_func __rte_cache_aligned;
 void ether_input_no_dyn_feats(struct ifnet *ifp, struct rte_mbuf *m)
 	__hot_func __rte_cache_aligned;
+void ether_input_burst(struct ifnet *ifp, struct rte_mbuf **pkts, uint16_t nb)
+	__hot_func __rte_cache_aligned;
 
 static inline struct ether_hdr *ethhdr(struct rte_mbuf *m)
 {
@@ -214,6 +216,12 @@ typedef void (*packet_input_t)(struct ifnet *ifp, struct rte_mbuf *pkt);
 void set_packet_input_func(packet_input_t input_fn);
 extern packet_input_t packet_input_func __hot_data;
 
+typedef void (*packet_burst_input_t)(struct ifnet *ifp,
+				     struct rte_mbuf **pkts, uint16_t nb);
+
+void set_packet_burst_input_func(packet_burst_input_t input_fn);
+extern packet_burst_input_t packet_burst_input_func __hot_data;
+
 int ether_if_set_l2_address(struct ifnet *ifp, uint32_t l2_addr_len,
 			    void *l2_addr);
 int ether_if_set_broadcast(struct ifnet *ifp, bool enable);
@@ -17,6 +17,7 @@
 #include <zmq.h>
 
 #include "event.h"
+#include "rt_tracker.h"
 #include "urcu.h"
 #include "vplane_log.h"
 
@@ -189,10 +190,17 @@ int get_next_event(enum cont_src_en cont_src, long ms, bool cont_src_all)
 
 	rebuild_poll_list();
 
+	/* Deferred work waits for waiting events, but not for new ones */
+	if (rt_tracker_pending())
+		ms = 0;
+
 	rcu_thread_offline();
 	n = zmq_poll(todo.items, todo.list_size, ms * ZMQ_POLL_MSEC);
 	rcu_thread_online();
 
+	if (n == 0 && rt_tracker_pending())
+		rt_tracker_flush();
+
 	if (n < 0) {
 		if (errno == EINTR || errno == EAGAIN)
 			return 0;
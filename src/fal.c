@@ -15,6 +15,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "compiler.h"
 #include "fal.h"
@@ -167,15 +168,24 @@ static struct ip_ops *new_dyn_ip_ops(void *lib)
 	ip_ops->upd_neigh = dlsym(lib, "fal_plugin_ip_upd_neigh");
 	ip_ops->get_neigh_attrs = dlsym(lib, "fal_plugin_ip_get_neigh_attrs");
 	ip_ops->del_neigh = dlsym(lib, "fal_plugin_ip_del_neigh");
+	ip_ops->new_neighs = dlsym(lib, "fal_plugin_ip_new_neighs");
+	ip_ops->del_neighs = dlsym(lib, "fal_plugin_ip_del_neighs");
 	ip_ops->new_route = dlsym(lib, "fal_plugin_ip_new_route");
 	ip_ops->upd_route = dlsym(lib, "fal_plugin_ip_upd_route");
 	ip_ops->del_route = dlsym(lib, "fal_plugin_ip_del_route");
+	ip_ops->new_routes = dlsym(lib, "fal_plugin_ip_new_routes");
+	ip_ops->upd_routes = dlsym(lib, "fal_plugin_ip_upd_routes");
+	ip_ops->del_routes = dlsym(lib, "fal_plugin_ip_del_routes");
 	ip_ops->new_next_hop_group = dlsym(
 		lib, "fal_plugin_ip_new_next_hop_group");
 	ip_ops->upd_next_hop_group = dlsym(
 		lib, "fal_plugin_ip_upd_next_hop_group");
 	ip_ops->del_next_hop_group = dlsym(
 		lib, "fal_plugin_ip_del_next_hop_group");
+	ip_ops->new_next_hop_groups = dlsym(
+		lib, "fal_plugin_ip_new_next_hop_groups");
+	ip_ops->del_next_hop_groups = dlsym(
+		lib, "fal_plugin_ip_del_next_hop_groups");
 	ip_ops->new_next_hops = dlsym(lib, "fal_plugin_ip_new_next_hops");
 	ip_ops->upd_next_hop = dlsym(lib, "fal_plugin_ip_upd_next_hop");
 	ip_ops->del_next_hops = dlsym(lib, "fal_plugin_ip_del_next_hops");
@@ -272,6 +282,8 @@ static struct qos_ops *new_dyn_qos_ops(void *lib)
 	qos_ops->get_queue_stats = dlsym(lib, "fal_plugin_qos_get_queue_stats");
 	qos_ops->get_queue_stats_ext =
 		dlsym(lib, "fal_plugin_qos_get_queue_stats_ext");
+	qos_ops->get_queues_stats =
+		dlsym(lib, "fal_plugin_qos_get_queues_stats");
 	qos_ops->clear_queue_stats =
 		dlsym(lib, "fal_plugin_qos_clear_queue_stats");
 	qos_ops->new_map = dlsym(lib, "fal_plugin_qos_new_map");
@@ -449,6 +461,23 @@ static struct ptp_ops *new_dyn_ptp_ops(void *lib)
 	return ptp_ops;
 }
 
+static struct flow_ops *new_dyn_flow_ops(void *lib)
+{
+	struct flow_ops *flow_ops;
+
+	flow_ops = calloc(1, sizeof(struct flow_ops));
+	if (!flow_ops) {
+		RTE_LOG(ERR, DATAPLANE, "Could not allocate flow ops\n");
+		return NULL;
+	}
+
+	flow_ops->create_entry = dlsym(lib, "fal_plugin_flow_create_entry");
+	flow_ops->delete_entry = dlsym(lib, "fal_plugin_flow_delete_entry");
+	flow_ops->get_stats = dlsym(lib, "fal_plugin_flow_get_stats");
+
+	return flow_ops;
+}
+
 static void register_dyn_msg_handlers(void *lib)
 {
 	struct message_handler *handler =
@@ -477,6 +506,7 @@ static void register_dyn_msg_handlers(void *lib)
 	handler->backplane = new_dyn_backplane_ops(lib);
 	handler->cpp_rl = new_dyn_cpp_rl_ops(lib);
 	handler->ptp = new_dyn_ptp_ops(lib);
+	handler->flow = new_dyn_flow_ops(lib);
 
 	fal_register_message_handler(handler);
 }
@@ -561,6 +591,7 @@ static void free_message_handler(struct message_handler *handler)
 	free(handler->vlan_feat);
 	free(handler->backplane);
 	free(handler->cpp_rl);
+	free(handler->flow);
 	free(handler);
 }
 
@@ -602,6 +633,25 @@ bool fal_plugins_present(void)
 #define call_handler_ret(op_type, fn, args...)				\
 	call_handler_def_ret(op_type, 0, fn, args)
 
+/* Bulk operations fall back to the single ones when not provided */
+#define has_handler(op_type, fn)					\
+	(fal_handler && fal_handler->op_type &&				\
+	 fal_handler->op_type->fn)
+
+/* Without a plugin, bulk operations succeed, as do the single ones */
+static int fal_bulk_no_plugin(uint32_t count, int *results)
+{
+	memset(results, 0, count * sizeof(*results));
+	return 0;
+}
+
+/* The first failure is returned, each being recorded in results */
+static int fal_bulk_result(int *results, uint32_t i, int ret, int first)
+{
+	results[i] = ret;
+	return first < 0 ? first : (ret < 0 ? ret : 0);
+}
+
 /* System operations */
 void fal_cleanup(void)
 {
@@ -1201,6 +1251,61 @@ static int fal_ip_del_neigh(unsigned int if_index,
 		ip, -EOPNOTSUPP, del_neigh, if_index, ipaddr);
 }
 
+int fal_ip_new_neighs(uint32_t neigh_count,
+		      const struct fal_ip_neigh_t *neigh_list,
+		      const uint32_t *attr_count,
+		      const struct fal_attribute_t **attr_list,
+		      int *results)
+{
+	struct fal_ip_neigh_t neigh;
+	uint32_t i;
+	int ret = 0;
+
+	if (!fal_plugins_present())
+		return fal_bulk_no_plugin(neigh_count, results);
+
+	if (has_handler(ip, new_neighs))
+		return call_handler_ret(ip, new_neighs, neigh_count,
+					neigh_list, attr_count, attr_list,
+					results);
+
+	for (i = 0; i < neigh_count; i++) {
+		neigh = neigh_list[i];
+		ret = fal_bulk_result(results, i,
+				      fal_ip_new_neigh(neigh.if_index,
+						       &neigh.ipaddr,
+						       attr_count[i],
+						       attr_list[i]),
+				      ret);
+	}
+	return ret;
+}
+
+int fal_ip_del_neighs(uint32_t neigh_count,
+		      const struct fal_ip_neigh_t *neigh_list,
+		      int *results)
+{
+	struct fal_ip_neigh_t neigh;
+	uint32_t i;
+	int ret = 0;
+
+	if (!fal_plugins_present())
+		return fal_bulk_no_plugin(neigh_count, results);
+
+	if (has_handler(ip, del_neighs))
+		return call_handler_ret(ip, del_neighs, neigh_count,
+					neigh_list, results);
+
+	for (i = 0; i < neigh_count; i++) {
+		neigh = neigh_list[i];
+		ret = fal_bulk_result(results, i,
+				      fal_ip_del_neigh(neigh.if_index,
+						       &neigh.ipaddr),
+				      ret);
+	}
+	return ret;
+}
+
 int fal_ip4_new_neigh(unsigned int if_index,
 		      const struct sockaddr_in *sin,
 		      uint32_t attr_count,
@@ -1640,6 +1745,147 @@ static int fal_ip_del_route(unsigned int vrf_id,
 		tableid);
 }
 
+int fal_ip_new_routes(uint32_t route_count,
+		      const struct fal_ip_route_t *route_list,
+		      const uint32_t *attr_count,
+		      const struct fal_attribute_t **attr_list,
+		      int *results)
+{
+	struct fal_ip_route_t route;
+	uint32_t i;
+	int ret = 0;
+
+	if (!fal_plugins_present())
+		return fal_bulk_no_plugin(route_count, results);
+
+	if (has_handler(ip, new_routes))
+		return call_handler_ret(ip, new_routes, route_count,
+					route_list, attr_count, attr_list,
+					results);
+
+	for (i = 0; i < route_count; i++) {
+		route = route_list[i];
+		ret = fal_bulk_result(results, i,
+				      fal_ip_new_route(route.vrf_id,
+						       &route.ipaddr,
+						       route.prefixlen,
+						       route.tableid,
+						       attr_count[i],
+						       attr_list[i]),
+				      ret);
+	}
+	return ret;
+}
+
+int fal_ip_upd_routes(uint32_t route_count,
+		      const struct fal_ip_route_t *route_list,
+		      const struct fal_attribute_t *attr_list,
+		      int *results)
+{
+	struct fal_ip_route_t route;
+	struct fal_attribute_t attr;
+	uint32_t i;
+	int ret = 0;
+
+	if (!fal_plugins_present())
+		return fal_bulk_no_plugin(route_count, results);
+
+	if (has_handler(ip, upd_routes))
+		return call_handler_ret(ip, upd_routes, route_count,
+					route_list, attr_list, results);
+
+	for (i = 0; i < route_count; i++) {
+		route = route_list[i];
+		attr = attr_list[i];
+		ret = fal_bulk_result(results, i,
+				      fal_ip_upd_route(route.vrf_id,
+						       &route.ipaddr,
+						       route.prefixlen,
+						       route.tableid, &attr),
+				      ret);
+	}
+	return ret;
+}
+
+int fal_ip_del_routes(uint32_t route_count,
+		      const struct fal_ip_route_t *route_list,
+		      int *results)
+{
+	struct fal_ip_route_t route;
+	uint32_t i;
+	int ret = 0;
+
+	if (!fal_plugins_present())
+		return fal_bulk_no_plugin(route_count, results);
+
+	if (has_handler(ip, del_routes))
+		return call_handler_ret(ip, del_routes, route_count,
+					route_list, results);
+
+	for (i = 0; i < route_count; i++) {
+		route = route_list[i];
+		ret = fal_bulk_result(results, i,
+				      fal_ip_del_route(route.vrf_id,
+						       &route.ipaddr,
+						       route.prefixlen,
+						       route.tableid),
+				      ret);
+	}
+	return ret;
+}
+
+int fal_ip_new_next_hop_groups(uint32_t nhg_count,
+			       const uint32_t *attr_count,
+			       const struct fal_attribute_t **attr_list,
+			       fal_object_t *obj_list,
+			       int *results)
+{
+	uint32_t i;
+	int ret = 0;
+
+	if (!fal_plugins_present())
+		return fal_bulk_no_plugin(nhg_count, results);
+
+	if (has_handler(ip, new_next_hop_groups))
+		return call_handler_ret(ip, new_next_hop_groups, nhg_count,
+					attr_count, attr_list, obj_list,
+					results);
+
+	for (i = 0; i < nhg_count; i++)
+		ret = fal_bulk_result(results, i,
+				      call_handler_def_ret(
+					      ip, -EOPNOTSUPP,
+					      new_next_hop_group,
+					      attr_count[i], attr_list[i],
+					      &obj_list[i]),
+				      ret);
+	return ret;
+}
+
+int fal_ip_del_next_hop_groups(uint32_t nhg_count,
+			       const fal_object_t *obj_list,
+			       int *results)
+{
+	uint32_t i;
+	int ret = 0;
+
+	if (!fal_plugins_present())
+		return fal_bulk_no_plugin(nhg_count, results);
+
+	if (has_handler(ip, del_next_hop_groups))
+		return call_handler_ret(ip, del_next_hop_groups, nhg_count,
+					obj_list, results);
+
+	for (i = 0; i < nhg_count; i++)
+		ret = fal_bulk_result(results, i,
+				      call_handler_def_ret(
+					      ip, -EOPNOTSUPP,
+					      del_next_hop_group,
+					      obj_list[i]),
+				      ret);
+	return ret;
+}
+
 static enum fal_packet_action_t
 next_hop_group_packet_action(uint32_t nhops, struct next_hop hops[])
 {
@@ -2917,6 +3163,37 @@ int fal_qos_get_queue_stats_ext(fal_object_t queue_id,
 				    read_and_clear, counters);
 }
 
+int fal_qos_get_queues_stats(uint32_t queue_count,
+			     const fal_object_t *queue_list,
+			     uint32_t number_of_counters,
+			     const uint32_t *counter_ids,
+			     bool read_and_clear, uint64_t *counters,
+			     int *results)
+{
+	uint32_t i;
+	int ret = 0;
+	int rv;
+
+	if (!fal_plugins_present())
+		return fal_bulk_no_plugin(queue_count, results);
+
+	if (has_handler(qos, get_queues_stats))
+		return call_handler_ret(qos, get_queues_stats, queue_count,
+					queue_list, number_of_counters,
+					counter_ids, read_and_clear, counters,
+					results);
+
+	for (i = 0; i < queue_count; i++) {
+		rv = fal_qos_get_queue_stats_ext(queue_list[i],
+						 number_of_counters,
+						 counter_ids, read_and_clear,
+						 counters +
+						 i * number_of_counters);
+		ret = fal_bulk_result(results, i, rv, ret);
+	}
+	return ret;
+}
+
 int fal_qos_clear_queue_stats(fal_object_t queue_id,
 			      uint32_t number_of_counters,
 			      const uint32_t *counter_ids)
@@ -3215,6 +3492,32 @@ int fal_delete_ptp_peer(fal_object_t peer)
 				    peer);
 }
 
+/* Start of flow offload functions */
+
+int fal_flow_create_entry(uint32_t attr_count,
+			  const struct fal_attribute_t *attr_list,
+			  fal_object_t *obj)
+{
+	return call_handler_def_ret(flow, -EOPNOTSUPP,
+			create_entry, attr_count, attr_list, obj);
+}
+
+int fal_flow_delete_entry(fal_object_t obj)
+{
+	return call_handler_def_ret(flow, -EOPNOTSUPP,
+			delete_entry, obj);
+}
+
+int fal_flow_get_stats(fal_object_t obj, uint32_t num_counters,
+		       const enum fal_flow_entry_stat_type *cntr_ids,
+		       uint64_t *cntrs)
+{
+	return call_handler_def_ret(flow, -EOPNOTSUPP,
+			get_stats, obj, num_counters, cntr_ids, cntrs);
+}
+
+/* End of flow offload functions */
+
 /* Start of ACL functions */
 
 int fal_acl_create_table(uint32_t attr_count,
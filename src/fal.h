@@ -64,6 +64,7 @@ struct message_handler {
 	struct backplane_ops *backplane;
 	struct cpp_rl_ops *cpp_rl;
 	struct ptp_ops *ptp;
+	struct flow_ops *flow;
 
 	LIST_ENTRY(message_handler) link;
 };
@@ -208,6 +209,14 @@ struct ip_ops {
 			       const struct fal_attribute_t *attr_list);
 	int (*del_neigh)(unsigned int if_index,
 			 struct fal_ip_address_t *ipaddr);
+	int (*new_neighs)(uint32_t neigh_count,
+			  const struct fal_ip_neigh_t *neigh_list,
+			  const uint32_t *attr_count,
+			  const struct fal_attribute_t **attr_list,
+			  int *results);
+	int (*del_neighs)(uint32_t neigh_count,
+			  const struct fal_ip_neigh_t *neigh_list,
+			  int *results);
 	int (*new_route)(uint32_t vrf_id,
 			 struct fal_ip_address_t *ipaddr,
 			 uint8_t prefixlen,
@@ -223,12 +232,32 @@ struct ip_ops {
 			 struct fal_ip_address_t *ipaddr,
 			 uint8_t prefixlen,
 			 uint32_t tableid);
+	int (*new_routes)(uint32_t route_count,
+			  const struct fal_ip_route_t *route_list,
+			  const uint32_t *attr_count,
+			  const struct fal_attribute_t **attr_list,
+			  int *results);
+	int (*upd_routes)(uint32_t route_count,
+			  const struct fal_ip_route_t *route_list,
+			  const struct fal_attribute_t *attr_list,
+			  int *results);
+	int (*del_routes)(uint32_t route_count,
+			  const struct fal_ip_route_t *route_list,
+			  int *results);
 	int (*new_next_hop_group)(uint32_t attr_count,
 				  const struct fal_attribute_t *attr_list,
 				  fal_object_t *obj);
 	int (*upd_next_hop_group)(fal_object_t obj,
 				  const struct fal_attribute_t *attr);
 	int (*del_next_hop_group)(fal_object_t obj);
+	int (*new_next_hop_groups)(uint32_t nhg_count,
+				   const uint32_t *attr_count,
+				   const struct fal_attribute_t **attr_list,
+				   fal_object_t *obj_list,
+				   int *results);
+	int (*del_next_hop_groups)(uint32_t nhg_count,
+				   const fal_object_t *obj_list,
+				   int *results);
 	int (*new_next_hops)(uint32_t nh_count,
 			     const uint32_t *attr_count,
 			     const struct fal_attribute_t **attr_list,
@@ -360,6 +389,12 @@ struct qos_ops {
 				   uint32_t number_of_counters,
 				   const uint32_t *counter_ids,
 				   bool read_and_clear, uint64_t *counters);
+	int (*get_queues_stats)(uint32_t queue_count,
+				const fal_object_t *queue_list,
+				uint32_t number_of_counters,
+				const uint32_t *counter_ids,
+				bool read_and_clear, uint64_t *counters,
+				int *results);
 	int (*clear_queue_stats)(fal_object_t queue_id,
 				 uint32_t number_of_counters,
 				 const uint32_t *counter_ids);
@@ -514,6 +549,16 @@ struct ptp_ops {
 	int (*delete_ptp_peer)(fal_object_t peer_obj);
 };
 
+struct flow_ops {
+	int (*create_entry)(uint32_t attr_count,
+			    const struct fal_attribute_t *attr_list,
+			    fal_object_t *obj);
+	int (*delete_entry)(fal_object_t obj);
+	int (*get_stats)(fal_object_t obj, uint32_t num_counters,
+			 const enum fal_flow_entry_stat_type *cntr_ids,
+			 uint64_t *cntrs);
+};
+
 void fal_init(void);
 void fal_init_plugins(void);
 void fal_cleanup(void);
@@ -661,6 +706,34 @@ int fal_ip4_upd_route(vrfid_t vrf_id, in_addr_t addr, uint8_t prefixlen,
 		      size_t size, fal_object_t nhg_object);
 int fal_ip4_del_route(vrfid_t vrf_id, in_addr_t addr, uint8_t prefixlen,
 		      uint32_t tableid);
+int fal_ip_new_neighs(uint32_t neigh_count,
+		      const struct fal_ip_neigh_t *neigh_list,
+		      const uint32_t *attr_count,
+		      const struct fal_attribute_t **attr_list,
+		      int *results);
+int fal_ip_del_neighs(uint32_t neigh_count,
+		      const struct fal_ip_neigh_t *neigh_list,
+		      int *results);
+int fal_ip_new_routes(uint32_t route_count,
+		      const struct fal_ip_route_t *route_list,
+		      const uint32_t *attr_count,
+		      const struct fal_attribute_t **attr_list,
+		      int *results);
+int fal_ip_upd_routes(uint32_t route_count,
+		      const struct fal_ip_route_t *route_list,
+		      const struct fal_attribute_t *attr_list,
+		      int *results);
+int fal_ip_del_routes(uint32_t route_count,
+		      const struct fal_ip_route_t *route_list,
+		      int *results);
+int fal_ip_new_next_hop_groups(uint32_t nhg_count,
+			       const uint32_t *attr_count,
+			       const struct fal_attribute_t **attr_list,
+			       fal_object_t *obj_list,
+			       int *results);
+int fal_ip_del_next_hop_groups(uint32_t nhg_count,
+			       const fal_object_t *obj_list,
+			       int *results);
 int fal_create_ipmc_rpf_group(uint32_t *ifindex_list, uint32_t num_int,
 			      fal_object_t *rpf_group_id,
 			      struct fal_object_list_t **rpf_member_list);
@@ -795,6 +868,12 @@ int fal_qos_get_queue_stats_ext(fal_object_t queue_id,
 				uint32_t number_of_counters,
 				const uint32_t *counter_ids,
 				bool read_and_clear, uint64_t *counters);
+int fal_qos_get_queues_stats(uint32_t queue_count,
+			     const fal_object_t *queue_list,
+			     uint32_t number_of_counters,
+			     const uint32_t *counter_ids,
+			     bool read_and_clear, uint64_t *counters,
+			     int *results);
 int fal_qos_clear_queue_stats(fal_object_t queue_id,
 			      uint32_t number_of_counters,
 			      const uint32_t *counter_ids);
@@ -877,6 +956,15 @@ int fal_create_ptp_peer(uint32_t attr_count,
 			fal_object_t *peer);
 int fal_delete_ptp_peer(fal_object_t peer);
 
+/* Flow offload */
+int fal_flow_create_entry(uint32_t attr_count,
+			  const struct fal_attribute_t *attr_list,
+			  fal_object_t *obj);
+int fal_flow_delete_entry(fal_object_t obj);
+int fal_flow_get_stats(fal_object_t obj, uint32_t num_counters,
+		       const enum fal_flow_entry_stat_type *cntr_ids,
+		       uint64_t *cntrs);
+
 /* The various ACL related functions */
 int fal_acl_create_table(uint32_t attr_count,
 			 const struct fal_attribute_t *attr,
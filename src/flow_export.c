@@ -0,0 +1,757 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Sampled flow export
+ *
+ * Interfaces with the flow-sample features enabled pass 1 in N of
+ * their packets here, on average.  Each lcore counts its samples into
+ * its own direct mapped cache of flow records, and expires the records
+ * itself - on the active timeout as they are updated, and on the
+ * inactive timeout as the forwarding loop sweeps the cache a little at
+ * a time.  Expired records are queued on a single producer ring per
+ * lcore, and the master thread periodically drains the rings into
+ * IPFIX (RFC 7011) messages sent to the collector.  Counts are scaled
+ * up by the sampling rate.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <rte_branch_prediction.h>
+#include <rte_byteorder.h>
+#include <rte_cycles.h>
+#include <rte_jhash.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_mbuf.h>
+#include <rte_random.h>
+#include <rte_timer.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+
+#include "commands.h"
+#include "flow_export.h"
+#include "if_var.h"
+#include "json_writer.h"
+#include "pl_node.h"
+#include "pipeline/nodes/pl_nodes_common.h"
+#include "util.h"
+#include "vplane_log.h"
+
+#define FLOW_CACHE_SIZE		2048	/* records per lcore */
+#define FLOW_CACHE_MASK		(FLOW_CACHE_SIZE - 1)
+#define FLOW_RING_SIZE		1024	/* expired records per lcore */
+#define FLOW_RING_MASK		(FLOW_RING_SIZE - 1)
+#define FLOW_SWEEP_BATCH	64	/* records looked at per sweep */
+
+#define FLOW_EXPORT_INTERVAL_MS	100
+#define FLOW_EXPORT_MTU		1400
+#define FLOW_TEMPLATE_INTERVAL	60	/* seconds between templates */
+
+#define FLOW_DEFAULT_RATE	1000
+#define FLOW_DEFAULT_ACTIVE	60
+#define FLOW_DEFAULT_INACTIVE	15
+
+/* IPFIX flowEndReason values */
+enum flow_end_reason {
+	FLOW_END_IDLE = 1,
+	FLOW_END_ACTIVE = 2,
+	FLOW_END_RESOURCES = 5,
+};
+
+/* No implicit padding, so keys compare with memcmp */
+struct flow_key {
+	struct in6_addr	fk_src;		/* IPv4 in the first word */
+	struct in6_addr	fk_dst;
+	uint32_t	fk_ifindex;
+	uint16_t	fk_sport;
+	uint16_t	fk_dport;
+	uint8_t		fk_af;		/* 0 marks a free slot */
+	uint8_t		fk_proto;
+	uint16_t	fk_pad;
+};
+
+struct flow_rec {
+	struct flow_key	fr_key;
+	uint32_t	fr_rate;	/* sampling rate when created */
+	uint64_t	fr_pkts;
+	uint64_t	fr_bytes;
+	uint64_t	fr_first;	/* TSC */
+	uint64_t	fr_last;
+	uint8_t		fr_reason;
+};
+
+/*
+ * The cache is touched only by its lcore.  The ring is single
+ * producer (the lcore) single consumer (the master thread).
+ */
+struct flow_lcore {
+	struct flow_rec	fl_cache[FLOW_CACHE_SIZE];
+	uint32_t	fl_sweep_pos;
+	uint64_t	fl_next_sweep;
+	uint32_t	fl_head;
+	uint32_t	fl_dropped;
+	uint32_t	fl_tail __rte_cache_aligned;
+	struct flow_rec	fl_ring[FLOW_RING_SIZE];
+};
+
+RTE_DEFINE_PER_LCORE(uint32_t, flow_export_skip);
+
+static struct flow_lcore *flow_lcores[RTE_MAX_LCORE];
+
+/* Set on the master thread, read by the lcores */
+static struct {
+	bool			enabled;
+	uint32_t		rate;
+	uint32_t		active;		/* seconds */
+	uint32_t		inactive;
+	uint64_t		active_tsc;
+	uint64_t		inactive_tsc;
+} flow_cfg = {
+	.rate = FLOW_DEFAULT_RATE,
+	.active = FLOW_DEFAULT_ACTIVE,
+	.inactive = FLOW_DEFAULT_INACTIVE,
+};
+
+/* Owned by the master thread */
+static struct {
+	int			fd;
+	struct sockaddr_storage	collector;
+	uint32_t		seq;
+	time_t			next_template;
+	uint8_t			buf[FLOW_EXPORT_MTU];
+	unsigned int		len;
+	unsigned int		set_start;	/* open data set, or 0 */
+	uint16_t		set_id;
+	unsigned int		msg_records;
+	uint64_t		records;
+	uint64_t		messages;
+	uint64_t		send_errors;
+	uint64_t		dropped;
+	struct rte_timer	timer;
+} flow_exp = {
+	.fd = -1,
+};
+
+static void flow_tsc_update(void)
+{
+	uint64_t hz = rte_get_tsc_hz();
+
+	CMM_STORE_SHARED(flow_cfg.active_tsc, flow_cfg.active * hz);
+	CMM_STORE_SHARED(flow_cfg.inactive_tsc, flow_cfg.inactive * hz);
+}
+
+/* Next gap is uniform in [1, 2N - 1], so 1 in N on average */
+static void flow_skip_rearm(void)
+{
+	uint32_t rate = CMM_LOAD_SHARED(flow_cfg.rate);
+
+	RTE_PER_LCORE(flow_export_skip) =
+		rate > 1 ? 1 + rte_rand() % (2 * rate - 1) : 1;
+}
+
+static void flow_emit(struct flow_lcore *fl, struct flow_rec *fr,
+		      enum flow_end_reason reason)
+{
+	uint32_t head = fl->fl_head;
+
+	if (unlikely(head - CMM_LOAD_SHARED(fl->fl_tail) >= FLOW_RING_SIZE)) {
+		CMM_STORE_SHARED(fl->fl_dropped, fl->fl_dropped + 1);
+	} else {
+		fl->fl_ring[head & FLOW_RING_MASK] = *fr;
+		fl->fl_ring[head & FLOW_RING_MASK].fr_reason = reason;
+		cmm_smp_wmb();
+		CMM_STORE_SHARED(fl->fl_head, head + 1);
+	}
+	fr->fr_key.fk_af = 0;
+}
+
+static void flow_rec_start(struct flow_rec *fr, const struct flow_key *key,
+			   uint32_t rate, uint32_t len, uint64_t now)
+{
+	fr->fr_key = *key;
+	fr->fr_rate = rate;
+	fr->fr_pkts = 1;
+	fr->fr_bytes = len;
+	fr->fr_first = now;
+	fr->fr_last = now;
+}
+
+static void flow_sample(const struct flow_key *key, uint32_t len)
+{
+	struct flow_lcore *fl = flow_lcores[dp_lcore_id()];
+	uint32_t rate = CMM_LOAD_SHARED(flow_cfg.rate);
+	struct flow_rec *fr;
+	uint64_t now;
+
+	if (unlikely(!fl))
+		return;
+
+	now = rte_rdtsc();
+	fr = &fl->fl_cache[rte_jhash(key, sizeof(*key), 0) & FLOW_CACHE_MASK];
+	if (fr->fr_key.fk_af) {
+		if (memcmp(&fr->fr_key, key, sizeof(*key)) != 0) {
+			flow_emit(fl, fr, FLOW_END_RESOURCES);
+		} else if (now - fr->fr_first >=
+			   CMM_LOAD_SHARED(flow_cfg.active_tsc)) {
+			flow_emit(fl, fr, FLOW_END_ACTIVE);
+		} else {
+			fr->fr_pkts++;
+			fr->fr_bytes += len;
+			fr->fr_last = now;
+			return;
+		}
+	}
+	flow_rec_start(fr, key, rate, len, now);
+}
+
+static bool flow_sample_start(void)
+{
+	flow_skip_rearm();
+	return CMM_LOAD_SHARED(flow_cfg.enabled);
+}
+
+/* Ports, if the transport header is in the first segment */
+static void flow_key_ports(struct flow_key *key, const struct rte_mbuf *m,
+			   const void *l4)
+{
+	const uint16_t *ports = l4;
+
+	switch (key->fk_proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_UDPLITE:
+	case IPPROTO_SCTP:
+		break;
+	default:
+		return;
+	}
+
+	if ((const char *)l4 + 2 * sizeof(uint16_t) >
+	    rte_pktmbuf_mtod(m, const char *) + rte_pktmbuf_data_len(m))
+		return;
+
+	key->fk_sport = ntohs(ports[0]);
+	key->fk_dport = ntohs(ports[1]);
+}
+
+void flow_export_sample_ipv4(struct ifnet *ifp, const struct iphdr *ip,
+			     const struct rte_mbuf *m)
+{
+	struct flow_key key;
+
+	if (!flow_sample_start())
+		return;
+
+	memset(&key, 0, sizeof(key));
+	key.fk_af = AF_INET;
+	key.fk_proto = ip->protocol;
+	key.fk_ifindex = ifp->if_index;
+	key.fk_src.s6_addr32[0] = ip->saddr;
+	key.fk_dst.s6_addr32[0] = ip->daddr;
+	if (!(ip->frag_off & htons(IP_OFFMASK)))
+		flow_key_ports(&key, m, (const char *)ip + (ip->ihl << 2));
+
+	flow_sample(&key, ntohs(ip->tot_len));
+}
+
+/* Extension headers are not walked, so flows under them lack ports */
+void flow_export_sample_ipv6(struct ifnet *ifp, const struct ip6_hdr *ip6,
+			     const struct rte_mbuf *m)
+{
+	struct flow_key key;
+
+	if (!flow_sample_start())
+		return;
+
+	memset(&key, 0, sizeof(key));
+	key.fk_af = AF_INET6;
+	key.fk_proto = ip6->ip6_nxt;
+	key.fk_ifindex = ifp->if_index;
+	key.fk_src = ip6->ip6_src;
+	key.fk_dst = ip6->ip6_dst;
+	flow_key_ports(&key, m, ip6 + 1);
+
+	flow_sample(&key, sizeof(*ip6) + ntohs(ip6->ip6_plen));
+}
+
+void flow_export_poll(uint64_t now)
+{
+	struct flow_lcore *fl = flow_lcores[dp_lcore_id()];
+	uint64_t active, inactive;
+	unsigned int i;
+
+	if (likely(!fl || now < fl->fl_next_sweep))
+		return;
+
+	/* The whole cache once a second */
+	fl->fl_next_sweep = now + rte_get_tsc_hz() * FLOW_SWEEP_BATCH /
+		FLOW_CACHE_SIZE;
+
+	active = CMM_LOAD_SHARED(flow_cfg.active_tsc);
+	inactive = CMM_LOAD_SHARED(flow_cfg.inactive_tsc);
+	for (i = 0; i < FLOW_SWEEP_BATCH; i++) {
+		struct flow_rec *fr = &fl->fl_cache[fl->fl_sweep_pos];
+
+		fl->fl_sweep_pos = (fl->fl_sweep_pos + 1) & FLOW_CACHE_MASK;
+		if (!fr->fr_key.fk_af)
+			continue;
+		if (now - fr->fr_last >= inactive)
+			flow_emit(fl, fr, FLOW_END_IDLE);
+		else if (now - fr->fr_first >= active)
+			flow_emit(fl, fr, FLOW_END_ACTIVE);
+	}
+}
+
+/*
+ * IPFIX encoding
+ */
+#define IPFIX_VERSION		10
+#define IPFIX_HDR_LEN		16
+#define IPFIX_SET_HDR_LEN	4
+#define IPFIX_TEMPLATE_SET_ID	2
+#define IPFIX_TEMPLATE_V4	256
+#define IPFIX_TEMPLATE_V6	257
+
+struct ipfix_field {
+	uint16_t	ie;
+	uint16_t	len;
+};
+
+#define IPFIX_FIELDS(_src, _dst, _alen)					\
+	{ _src, _alen },	/* source address */			\
+	{ _dst, _alen },	/* destination address */		\
+	{ 7, 2 },		/* sourceTransportPort */		\
+	{ 11, 2 },		/* destinationTransportPort */		\
+	{ 4, 1 },		/* protocolIdentifier */		\
+	{ 10, 4 },		/* ingressInterface */			\
+	{ 2, 8 },		/* packetDeltaCount */			\
+	{ 1, 8 },		/* octetDeltaCount */			\
+	{ 152, 8 },		/* flowStartMilliseconds */		\
+	{ 153, 8 },		/* flowEndMilliseconds */		\
+	{ 136, 1 },		/* flowEndReason */
+
+static const struct ipfix_field ipfix_fields_v4[] = {
+	IPFIX_FIELDS(8, 12, 4)
+};
+
+static const struct ipfix_field ipfix_fields_v6[] = {
+	IPFIX_FIELDS(27, 28, 16)
+};
+
+#define IPFIX_REC_LEN(_alen)	(2 * (_alen) + 2 + 2 + 1 + 4 + 4 * 8 + 1)
+
+static void ipfix_put8(uint8_t val)
+{
+	flow_exp.buf[flow_exp.len++] = val;
+}
+
+static void ipfix_put16(uint16_t val)
+{
+	val = rte_cpu_to_be_16(val);
+	memcpy(&flow_exp.buf[flow_exp.len], &val, sizeof(val));
+	flow_exp.len += sizeof(val);
+}
+
+static void ipfix_put32(uint32_t val)
+{
+	val = rte_cpu_to_be_32(val);
+	memcpy(&flow_exp.buf[flow_exp.len], &val, sizeof(val));
+	flow_exp.len += sizeof(val);
+}
+
+static void ipfix_put64(uint64_t val)
+{
+	val = rte_cpu_to_be_64(val);
+	memcpy(&flow_exp.buf[flow_exp.len], &val, sizeof(val));
+	flow_exp.len += sizeof(val);
+}
+
+static void ipfix_put_bytes(const void *p, unsigned int len)
+{
+	memcpy(&flow_exp.buf[flow_exp.len], p, len);
+	flow_exp.len += len;
+}
+
+static void ipfix_set_close(void)
+{
+	uint16_t len;
+
+	if (!flow_exp.set_start)
+		return;
+
+	len = rte_cpu_to_be_16(flow_exp.len - flow_exp.set_start);
+	memcpy(&flow_exp.buf[flow_exp.set_start + 2], &len, sizeof(len));
+	flow_exp.set_start = 0;
+}
+
+static void ipfix_set_open(uint16_t id)
+{
+	flow_exp.set_start = flow_exp.len;
+	flow_exp.set_id = id;
+	ipfix_put16(id);
+	ipfix_put16(0);		/* length, on close */
+}
+
+static void ipfix_put_template(uint16_t id, const struct ipfix_field *fields,
+			       unsigned int count)
+{
+	unsigned int i;
+
+	ipfix_put16(id);
+	ipfix_put16(count);
+	for (i = 0; i < count; i++) {
+		ipfix_put16(fields[i].ie);
+		ipfix_put16(fields[i].len);
+	}
+}
+
+/* Templates are resent now and then, as UDP may lose them */
+static void ipfix_msg_open(time_t now)
+{
+	flow_exp.len = IPFIX_HDR_LEN;
+	flow_exp.set_start = 0;
+	flow_exp.msg_records = 0;
+
+	if (now < flow_exp.next_template)
+		return;
+
+	flow_exp.next_template = now + FLOW_TEMPLATE_INTERVAL;
+	ipfix_set_open(IPFIX_TEMPLATE_SET_ID);
+	ipfix_put_template(IPFIX_TEMPLATE_V4, ipfix_fields_v4,
+			   ARRAY_SIZE(ipfix_fields_v4));
+	ipfix_put_template(IPFIX_TEMPLATE_V6, ipfix_fields_v6,
+			   ARRAY_SIZE(ipfix_fields_v6));
+	ipfix_set_close();
+}
+
+static void ipfix_msg_send(time_t now)
+{
+	unsigned int len;
+
+	ipfix_set_close();
+	len = flow_exp.len;
+	if (len == IPFIX_HDR_LEN)
+		return;
+
+	flow_exp.len = 0;
+	ipfix_put16(IPFIX_VERSION);
+	ipfix_put16(len);
+	ipfix_put32(now);
+	/* Data records sent before this message */
+	ipfix_put32(flow_exp.seq);
+	ipfix_put32(0);		/* observation domain */
+	flow_exp.len = len;
+
+	flow_exp.seq += flow_exp.msg_records;
+	if (send(flow_exp.fd, flow_exp.buf, len, MSG_DONTWAIT) < 0)
+		flow_exp.send_errors++;
+	else
+		flow_exp.messages++;
+}
+
+/* Lcores may have stamped a record since tsc_now was read */
+static uint64_t ipfix_ms(uint64_t tsc, uint64_t tsc_now, uint64_t ms_now)
+{
+	if (tsc >= tsc_now)
+		return ms_now;
+	return ms_now - (tsc_now - tsc) * 1000 / rte_get_tsc_hz();
+}
+
+static void ipfix_put_record(const struct flow_rec *fr, uint16_t set_id,
+			     uint64_t tsc_now, uint64_t ms_now)
+{
+	const struct flow_key *key = &fr->fr_key;
+
+	if (set_id == IPFIX_TEMPLATE_V4) {
+		ipfix_put_bytes(&key->fk_src.s6_addr32[0], 4);
+		ipfix_put_bytes(&key->fk_dst.s6_addr32[0], 4);
+	} else {
+		ipfix_put_bytes(&key->fk_src, 16);
+		ipfix_put_bytes(&key->fk_dst, 16);
+	}
+	ipfix_put16(key->fk_sport);
+	ipfix_put16(key->fk_dport);
+	ipfix_put8(key->fk_proto);
+	ipfix_put32(key->fk_ifindex);
+	ipfix_put64(fr->fr_pkts * fr->fr_rate);
+	ipfix_put64(fr->fr_bytes * fr->fr_rate);
+	ipfix_put64(ipfix_ms(fr->fr_first, tsc_now, ms_now));
+	ipfix_put64(ipfix_ms(fr->fr_last, tsc_now, ms_now));
+	ipfix_put8(fr->fr_reason);
+}
+
+static void flow_export_record(const struct flow_rec *fr, time_t now,
+			       uint64_t tsc_now, uint64_t ms_now)
+{
+	uint16_t set_id = fr->fr_key.fk_af == AF_INET ?
+		IPFIX_TEMPLATE_V4 : IPFIX_TEMPLATE_V6;
+	unsigned int need = set_id == IPFIX_TEMPLATE_V4 ?
+		IPFIX_REC_LEN(4) : IPFIX_REC_LEN(16);
+	bool new_set = !flow_exp.set_start || flow_exp.set_id != set_id;
+
+	if (flow_exp.len + need + (new_set ? IPFIX_SET_HDR_LEN : 0) >
+	    FLOW_EXPORT_MTU) {
+		ipfix_msg_send(now);
+		ipfix_msg_open(now);
+		new_set = true;
+	}
+	if (new_set) {
+		ipfix_set_close();
+		ipfix_set_open(set_id);
+	}
+
+	ipfix_put_record(fr, set_id, tsc_now, ms_now);
+	flow_exp.msg_records++;
+	flow_exp.records++;
+}
+
+static void flow_lcore_drain(struct flow_lcore *fl, time_t now,
+			     uint64_t tsc_now, uint64_t ms_now)
+{
+	uint32_t head = CMM_LOAD_SHARED(fl->fl_head);
+	uint32_t tail = fl->fl_tail;
+
+	cmm_smp_rmb();
+	for (; tail != head; tail++)
+		if (flow_exp.fd >= 0)
+			flow_export_record(&fl->fl_ring[tail & FLOW_RING_MASK],
+					   now, tsc_now, ms_now);
+
+	/* Finish with the slots before the lcore can reuse them */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(fl->fl_tail, tail);
+}
+
+static void flow_export_timer_cb(struct rte_timer *timer __rte_unused,
+				 void *arg __rte_unused)
+{
+	struct timespec ts;
+	uint64_t tsc_now, ms_now;
+	unsigned int i;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	tsc_now = rte_rdtsc();
+	ms_now = ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+
+	if (flow_exp.fd >= 0)
+		ipfix_msg_open(ts.tv_sec);
+
+	FOREACH_DP_LCORE(i) {
+		if (flow_lcores[i])
+			flow_lcore_drain(flow_lcores[i], ts.tv_sec,
+					 tsc_now, ms_now);
+	}
+
+	if (flow_exp.fd >= 0)
+		ipfix_msg_send(ts.tv_sec);
+}
+
+static int flow_lcores_alloc(void)
+{
+	unsigned int i;
+
+	/* Never freed, as an lcore may be sampling at any time */
+	FOREACH_DP_LCORE(i) {
+		if (flow_lcores[i])
+			continue;
+		flow_lcores[i] = zmalloc_aligned(sizeof(struct flow_lcore));
+		if (!flow_lcores[i])
+			return -ENOMEM;
+	}
+
+	if (!rte_timer_pending(&flow_exp.timer))
+		rte_timer_reset(&flow_exp.timer,
+				FLOW_EXPORT_INTERVAL_MS *
+				rte_get_timer_hz() / 1000,
+				PERIODICAL, rte_get_master_lcore(),
+				flow_export_timer_cb, NULL);
+	return 0;
+}
+
+static void flow_export_collector_close(void)
+{
+	CMM_STORE_SHARED(flow_cfg.enabled, false);
+	if (flow_exp.fd >= 0)
+		close(flow_exp.fd);
+	flow_exp.fd = -1;
+}
+
+static int flow_export_set_collector(const char *addr, const char *port)
+{
+	struct sockaddr_storage ss;
+	struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+	unsigned long portnum;
+	socklen_t sslen;
+	char *end;
+	int fd;
+
+	portnum = strtoul(port, &end, 10);
+	if (*end || portnum == 0 || portnum > UINT16_MAX)
+		return -EINVAL;
+
+	memset(&ss, 0, sizeof(ss));
+	if (inet_pton(AF_INET, addr, &sin->sin_addr) == 1) {
+		sin->sin_family = AF_INET;
+		sin->sin_port = htons(portnum);
+		sslen = sizeof(*sin);
+	} else if (inet_pton(AF_INET6, addr, &sin6->sin6_addr) == 1) {
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_port = htons(portnum);
+		sslen = sizeof(*sin6);
+	} else {
+		return -EINVAL;
+	}
+
+	if (flow_lcores_alloc() < 0)
+		return -ENOMEM;
+
+	fd = socket(ss.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+		    0);
+	if (fd < 0)
+		return -errno;
+
+	if (connect(fd, (struct sockaddr *)&ss, sslen) < 0) {
+		int err = errno;
+
+		RTE_LOG(ERR, DATAPLANE,
+			"flow export: collector %s port %s: %s\n",
+			addr, port, strerror(err));
+		close(fd);
+		return -err;
+	}
+
+	flow_export_collector_close();
+	flow_exp.fd = fd;
+	flow_exp.collector = ss;
+	flow_exp.seq = 0;
+	flow_exp.next_template = 0;
+	CMM_STORE_SHARED(flow_cfg.enabled, true);
+	return 0;
+}
+
+static int flow_export_set_interface(const char *ifname, bool on)
+{
+	struct ifnet *ifp = ifnet_byifname(ifname);
+
+	if (!ifp)
+		return -ENODEV;
+
+	if (on) {
+		pl_node_add_feature_by_inst(&ipv4_flow_sample_feat, ifp);
+		pl_node_add_feature_by_inst(&ipv6_flow_sample_feat, ifp);
+	} else {
+		pl_node_remove_feature_by_inst(&ipv4_flow_sample_feat, ifp);
+		pl_node_remove_feature_by_inst(&ipv6_flow_sample_feat, ifp);
+	}
+	return 0;
+}
+
+static void flow_export_show(json_writer_t *wr)
+{
+	char addr[INET6_ADDRSTRLEN];
+	uint64_t dropped = 0;
+	unsigned int i;
+
+	jsonw_bool_field(wr, "enabled", flow_cfg.enabled);
+	if (flow_exp.fd >= 0) {
+		const struct sockaddr_in *sin =
+			(const struct sockaddr_in *)&flow_exp.collector;
+		const struct sockaddr_in6 *sin6 =
+			(const struct sockaddr_in6 *)&flow_exp.collector;
+
+		if (flow_exp.collector.ss_family == AF_INET) {
+			inet_ntop(AF_INET, &sin->sin_addr, addr, sizeof(addr));
+			jsonw_uint_field(wr, "port", ntohs(sin->sin_port));
+		} else {
+			inet_ntop(AF_INET6, &sin6->sin6_addr, addr,
+				  sizeof(addr));
+			jsonw_uint_field(wr, "port", ntohs(sin6->sin6_port));
+		}
+		jsonw_string_field(wr, "collector", addr);
+	}
+	jsonw_uint_field(wr, "rate", flow_cfg.rate);
+	jsonw_uint_field(wr, "active-timeout", flow_cfg.active);
+	jsonw_uint_field(wr, "inactive-timeout", flow_cfg.inactive);
+
+	FOREACH_DP_LCORE(i) {
+		if (flow_lcores[i])
+			dropped += CMM_LOAD_SHARED(flow_lcores[i]->fl_dropped);
+	}
+	jsonw_uint_field(wr, "records", flow_exp.records);
+	jsonw_uint_field(wr, "messages", flow_exp.messages);
+	jsonw_uint_field(wr, "send-errors", flow_exp.send_errors);
+	jsonw_uint_field(wr, "dropped", dropped);
+}
+
+#define CMD_FLOW_EXPORT_USAGE						\
+	"Usage: flow-export show\n"					\
+"       flow-export collector <address> <port>\n"			\
+"       flow-export collector off\n"					\
+"       flow-export rate <1-65535>\n"					\
+"       flow-export timeout <active> <inactive>\n"			\
+"       flow-export interface <ifname> <on|off>\n"
+
+int cmd_flow_export(FILE *f, int argc, char **argv)
+{
+	json_writer_t *json;
+	unsigned long val, val2;
+
+	if (argc == 3 && !strcmp(argv[1], "collector") &&
+	    !strcmp(argv[2], "off")) {
+		flow_export_collector_close();
+		return 0;
+	} else if (argc == 4 && !strcmp(argv[1], "collector")) {
+		return flow_export_set_collector(argv[2], argv[3]);
+	} else if (argc == 3 && !strcmp(argv[1], "rate")) {
+		val = strtoul(argv[2], NULL, 0);
+		if (val >= 1 && val <= UINT16_MAX) {
+			CMM_STORE_SHARED(flow_cfg.rate, val);
+			return 0;
+		}
+	} else if (argc == 4 && !strcmp(argv[1], "timeout")) {
+		val = strtoul(argv[2], NULL, 0);
+		val2 = strtoul(argv[3], NULL, 0);
+		if (val >= 1 && val <= 3600 && val2 >= 1 && val2 <= 3600) {
+			flow_cfg.active = val;
+			flow_cfg.inactive = val2;
+			flow_tsc_update();
+			return 0;
+		}
+	} else if (argc == 4 && !strcmp(argv[1], "interface")) {
+		if (!strcmp(argv[3], "on") || !strcmp(argv[3], "off"))
+			return flow_export_set_interface(
+				argv[2], !strcmp(argv[3], "on"));
+	} else if (argc == 2 && !strcmp(argv[1], "show")) {
+		json = jsonw_new(f);
+		jsonw_name(json, "flow_export");
+		jsonw_start_object(json);
+		flow_export_show(json);
+		jsonw_end_object(json);
+		jsonw_destroy(&json);
+		return 0;
+	}
+
+	fprintf(f, CMD_FLOW_EXPORT_USAGE);
+	return -1;
+}
+
+void flow_export_init(void)
+{
+	rte_timer_init(&flow_exp.timer);
+	flow_tsc_update();
+}
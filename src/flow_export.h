@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Sampled flow export - 1 in N packets are counted into per-lcore
+ * flow records, which are exported to an IPFIX collector as they
+ * expire.
+ */
+#ifndef FLOW_EXPORT_H
+#define FLOW_EXPORT_H
+
+#include <rte_branch_prediction.h>
+#include <rte_per_lcore.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct ifnet;
+struct ip6_hdr;
+struct iphdr;
+struct rte_mbuf;
+
+/* Packets still to be skipped before the next sample */
+RTE_DECLARE_PER_LCORE(uint32_t, flow_export_skip);
+
+/* Is this packet one to be sampled?  Cheap enough for every packet. */
+static inline bool flow_export_sample_due(void)
+{
+	uint32_t *skip = &RTE_PER_LCORE(flow_export_skip);
+
+	if (likely(*skip > 1)) {
+		(*skip)--;
+		return false;
+	}
+	return true;
+}
+
+void flow_export_sample_ipv4(struct ifnet *ifp, const struct iphdr *ip,
+			     const struct rte_mbuf *m);
+void flow_export_sample_ipv6(struct ifnet *ifp, const struct ip6_hdr *ip6,
+			     const struct rte_mbuf *m);
+
+/* Expire idle and long lived records, from the forwarding loop */
+void flow_export_poll(uint64_t now);
+
+void flow_export_init(void);
+
+#endif /* FLOW_EXPORT_H */
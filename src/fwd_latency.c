@@ -0,0 +1,319 @@
+/*-
+ * Copyright (c) 2019, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Forwarding latency histograms - see fwd_latency.h.
+ *
+ * Each lcore only writes its own table, and the master thread reads
+ * them for "latency show" without stopping the writers, so a pair
+ * being updated at the time may be a packet out between its count and
+ * its histogram.
+ */
+
+#include <errno.h>
+#include <rte_branch_prediction.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_mbuf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler.h"
+#include "fwd_latency.h"
+#include "if_var.h"
+#include "json_writer.h"
+#include "urcu.h"
+#include "util.h"
+
+/* Port pairs tracked per lcore, a power of 2 */
+#define FWD_LAT_PAIRS		64
+
+/* Buckets of 2^n to 2^(n+1) cycles, the last taking everything longer */
+#define FWD_LAT_BUCKETS		32
+
+#define FWD_LAT_TSC_MASK	(UINT64_MAX >> FWD_LAT_PORT_BITS)
+
+struct fwd_lat_pair {
+	uint32_t	key;		/* 0 for an unused slot */
+	uint32_t	pad;
+	uint64_t	count;
+	uint64_t	buckets[FWD_LAT_BUCKETS];
+};
+
+struct fwd_lat_table {
+	struct rcu_head		rcu;
+	uint64_t		untracked;	/* no free slot for the pair */
+	struct fwd_lat_pair	pairs[FWD_LAT_PAIRS];
+} __rte_cache_aligned;
+
+bool fwd_lat_enabled __hot_data;
+
+static struct fwd_lat_table *fwd_lat_tables[RTE_MAX_LCORE];
+
+static inline uint32_t fwd_lat_key(portid_t in, portid_t out)
+{
+	return ((uint32_t)in << FWD_LAT_PORT_BITS | out) + 1;
+}
+
+static struct fwd_lat_pair *
+fwd_lat_pair_get(struct fwd_lat_table *t, uint32_t key)
+{
+	unsigned int i, slot;
+
+	/* Fibonacci hash of the key, then linear probing */
+	slot = (key * 2654435769u) >> (32 - __builtin_ctz(FWD_LAT_PAIRS));
+	for (i = 0; i < FWD_LAT_PAIRS; i++) {
+		struct fwd_lat_pair *pair =
+			&t->pairs[(slot + i) & (FWD_LAT_PAIRS - 1)];
+
+		if (pair->key == key)
+			return pair;
+		if (!pair->key) {
+			CMM_STORE_SHARED(pair->key, key);
+			return pair;
+		}
+	}
+	return NULL;
+}
+
+static inline unsigned int fwd_lat_bucket(uint64_t cycles)
+{
+	unsigned int b = 63 - __builtin_clzll(cycles | 1);
+
+	return b < FWD_LAT_BUCKETS ? b : FWD_LAT_BUCKETS - 1;
+}
+
+/*
+ * Packets are measured as they are offered to the transmit ring,
+ * whether or not the driver then takes them, and the stamp is
+ * dropped so that one left over for a retry isn't counted again.
+ */
+void fwd_lat_tx_slow(portid_t port, struct rte_mbuf **pkts, uint16_t n)
+{
+	struct fwd_lat_table *t;
+	struct fwd_lat_pair *pair;
+	uint64_t now, stamp;
+	uint16_t i;
+
+	t = rcu_dereference(fwd_lat_tables[dp_lcore_id()]);
+
+	if (unlikely(!t))
+		return;
+
+	now = rte_rdtsc() & FWD_LAT_TSC_MASK;
+	for (i = 0; i < n; i++) {
+		struct rte_mbuf *m = pkts[i];
+
+		if (!(m->ol_flags & PKT_RX_TIMESTAMP))
+			continue;
+		m->ol_flags &= ~PKT_RX_TIMESTAMP;
+
+		stamp = m->timestamp;
+		pair = fwd_lat_pair_get(t, fwd_lat_key(stamp & UINT16_MAX,
+						       port));
+		if (unlikely(!pair)) {
+			t->untracked++;
+			continue;
+		}
+		stamp = (now - (stamp >> FWD_LAT_PORT_BITS)) & FWD_LAT_TSC_MASK;
+		pair->count++;
+		pair->buckets[fwd_lat_bucket(stamp)]++;
+	}
+}
+
+static void fwd_lat_table_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct fwd_lat_table, rcu));
+}
+
+/* Start every lcore off with an empty table */
+static int fwd_lat_tables_reset(void)
+{
+	struct fwd_lat_table *tables[RTE_MAX_LCORE] = { NULL };
+	struct fwd_lat_table *old;
+	unsigned int i;
+
+	FOREACH_DP_LCORE(i) {
+		tables[i] = zmalloc_aligned(sizeof(*tables[i]));
+		if (!tables[i])
+			goto nomem;
+	}
+
+	FOREACH_DP_LCORE(i) {
+		old = rcu_xchg_pointer(&fwd_lat_tables[i], tables[i]);
+		if (old)
+			call_rcu(&old->rcu, fwd_lat_table_free);
+	}
+	return 0;
+
+nomem:
+	FOREACH_DP_LCORE(i)
+		free(tables[i]);
+	return -ENOMEM;
+}
+
+/* Sum the lcores' tables into one, for showing */
+static void fwd_lat_tables_sum(struct fwd_lat_table *sum)
+{
+	const struct fwd_lat_table *t;
+	const struct fwd_lat_pair *pair;
+	struct fwd_lat_pair *to;
+	unsigned int i, p, b;
+	uint32_t key;
+
+	FOREACH_DP_LCORE(i) {
+		t = rcu_dereference(fwd_lat_tables[i]);
+		if (!t)
+			continue;
+
+		sum->untracked += t->untracked;
+		for (p = 0; p < FWD_LAT_PAIRS; p++) {
+			pair = &t->pairs[p];
+			key = CMM_LOAD_SHARED(pair->key);
+			if (!key)
+				continue;
+
+			to = fwd_lat_pair_get(sum, key);
+			if (!to) {
+				sum->untracked += pair->count;
+				continue;
+			}
+			to->count += pair->count;
+			for (b = 0; b < FWD_LAT_BUCKETS; b++)
+				to->buckets[b] += pair->buckets[b];
+		}
+	}
+}
+
+/*
+ * Upper bound in nanoseconds of the bucket holding the given quantile,
+ * in parts per ten thousand.
+ */
+static uint64_t fwd_lat_quantile_ns(const struct fwd_lat_pair *pair,
+				    unsigned int q, uint64_t hz)
+{
+	uint64_t want = (pair->count * q + 9999) / 10000;
+	uint64_t seen = 0;
+	unsigned int b;
+
+	for (b = 0; b < FWD_LAT_BUCKETS - 1; b++) {
+		seen += pair->buckets[b];
+		if (seen >= want)
+			break;
+	}
+	return ((2ull << b) * 1000000000ull) / hz;
+}
+
+static void fwd_lat_port_name(json_writer_t *json, const char *name,
+			      portid_t port)
+{
+	struct ifnet *ifp = ifnet_byport(port);
+
+	if (ifp)
+		jsonw_string_field(json, name, ifp->if_name);
+	else
+		jsonw_uint_field(json, name, port);
+}
+
+static void fwd_lat_dump_pair(json_writer_t *json,
+			      const struct fwd_lat_pair *pair, uint64_t hz)
+{
+	uint32_t key = pair->key - 1;
+	unsigned int b;
+
+	jsonw_start_object(json);
+	fwd_lat_port_name(json, "in", key >> FWD_LAT_PORT_BITS);
+	fwd_lat_port_name(json, "out", key & UINT16_MAX);
+	jsonw_uint_field(json, "packets", pair->count);
+	jsonw_uint_field(json, "p50-ns", fwd_lat_quantile_ns(pair, 5000, hz));
+	jsonw_uint_field(json, "p99-ns", fwd_lat_quantile_ns(pair, 9900, hz));
+	jsonw_uint_field(json, "p99.9-ns",
+			 fwd_lat_quantile_ns(pair, 9990, hz));
+
+	/* Counts of 2^n to 2^(n+1) cycles, from n = 0 */
+	jsonw_name(json, "histogram");
+	jsonw_start_array(json);
+	for (b = 0; b < FWD_LAT_BUCKETS; b++)
+		jsonw_uint(json, pair->buckets[b]);
+	jsonw_end_array(json);
+	jsonw_end_object(json);
+}
+
+static int fwd_lat_show(FILE *f)
+{
+	struct fwd_lat_table *sum;
+	json_writer_t *json;
+	uint64_t hz = rte_get_tsc_hz();
+	unsigned int p;
+
+	sum = zmalloc_aligned(sizeof(*sum));
+	if (!sum) {
+		fprintf(f, "out of memory");
+		return -1;
+	}
+	fwd_lat_tables_sum(sum);
+
+	json = jsonw_new(f);
+	if (!json) {
+		free(sum);
+		return -1;
+	}
+
+	jsonw_name(json, "latency");
+	jsonw_start_object(json);
+	jsonw_bool_field(json, "enabled", CMM_LOAD_SHARED(fwd_lat_enabled));
+	jsonw_uint_field(json, "tsc-hz", hz);
+	jsonw_uint_field(json, "untracked", sum->untracked);
+
+	jsonw_name(json, "pairs");
+	jsonw_start_array(json);
+	for (p = 0; p < FWD_LAT_PAIRS; p++)
+		if (sum->pairs[p].count)
+			fwd_lat_dump_pair(json, &sum->pairs[p], hz);
+	jsonw_end_array(json);
+
+	jsonw_end_object(json);
+	jsonw_destroy(&json);
+	free(sum);
+	return 0;
+}
+
+/*
+ * latency <enable|disable|clear|show>
+ *
+ * Enabling starts from empty histograms; disabling keeps them to be
+ * shown.
+ */
+int cmd_fwd_latency(FILE *f, int argc, char **argv)
+{
+	if (argc != 2)
+		goto error;
+
+	if (!strcmp(argv[1], "enable")) {
+		if (fwd_lat_tables_reset() < 0) {
+			fprintf(f, "out of memory");
+			return -1;
+		}
+		CMM_STORE_SHARED(fwd_lat_enabled, true);
+	} else if (!strcmp(argv[1], "disable")) {
+		CMM_STORE_SHARED(fwd_lat_enabled, false);
+	} else if (!strcmp(argv[1], "clear")) {
+		if (fwd_lat_tables_reset() < 0) {
+			fprintf(f, "out of memory");
+			return -1;
+		}
+	} else if (!strcmp(argv[1], "show")) {
+		return fwd_lat_show(f);
+	} else
+		goto error;
+
+	return 0;
+error:
+	fprintf(f, "Usage: latency <enable|disable|clear|show>");
+	return -1;
+}
@@ -0,0 +1,69 @@
+/*-
+ * Copyright (c) 2019, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Forwarding latency histograms
+ */
+
+#ifndef FWD_LATENCY_H
+#define FWD_LATENCY_H
+
+#include <rte_branch_prediction.h>
+#include <rte_cycles.h>
+#include <rte_mbuf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <urcu/system.h>
+
+#include "compiler.h"
+#include "if_var.h"
+
+/*
+ * When enabled, each received burst is stamped with the TSC as it
+ * comes off the receive ring, and each packet is measured again as
+ * it is handed to a transmit ring.  The difference goes into a log2
+ * histogram of cycles for its pair of input and output ports.  Each
+ * lcore has its own table of pairs, so nothing is shared while
+ * forwarding.
+ *
+ * The stamp is kept in the mbuf timestamp field, with the input port
+ * in its low 16 bits, and PKT_RX_TIMESTAMP says it is valid.  QoS
+ * overwrites the field for its own sojourn times when those are on,
+ * and so such packets are left out here.
+ */
+
+#define FWD_LAT_PORT_BITS	16
+
+extern bool fwd_lat_enabled __hot_data;
+
+static ALWAYS_INLINE void
+fwd_lat_rx(portid_t port, struct rte_mbuf **pkts, uint16_t n)
+{
+	uint64_t stamp;
+	uint16_t i;
+
+	if (likely(!CMM_LOAD_SHARED(fwd_lat_enabled)))
+		return;
+
+	stamp = rte_rdtsc() << FWD_LAT_PORT_BITS | port;
+	for (i = 0; i < n; i++) {
+		pkts[i]->timestamp = stamp;
+		pkts[i]->ol_flags |= PKT_RX_TIMESTAMP;
+	}
+}
+
+void fwd_lat_tx_slow(portid_t port, struct rte_mbuf **pkts, uint16_t n);
+
+static ALWAYS_INLINE void
+fwd_lat_tx(portid_t port, struct rte_mbuf **pkts, uint16_t n)
+{
+	if (unlikely(CMM_LOAD_SHARED(fwd_lat_enabled)))
+		fwd_lat_tx_slow(port, pkts, n);
+}
+
+int cmd_fwd_latency(FILE *f, int argc, char **argv);
+
+#endif /* FWD_LATENCY_H */
@@ -51,6 +51,7 @@
 #include "ether.h"
 #include "fal.h"
 #include "gre.h"
+#include "gre_index.h"
 #include "if_var.h"
 #include "in_cksum.h"
 #include "in6.h"
@@ -60,6 +61,7 @@
 #include "iptun_common.h"
 #include "json_writer.h"
 #include "main.h"
+#include "master.h"
 #include "netinet6/ip6_funcs.h"
 #include "pktmbuf.h"
 #include "pl_common.h"
@@ -234,8 +236,20 @@ gre_info_insert(struct gre_infotbl_st *gre_infos, struct gre_info_st *greinfo,
 	ret_node = cds_lfht_add_unique(gre_infos->gi_grehash, hash,
 				       gre_info_match, greinfo,
 				       &greinfo->gre_node);
+	if (ret_node != &greinfo->gre_node)
+		return EEXIST;
 
-	return (ret_node != &greinfo->gre_node) ? EEXIST : 0;
+	if (greinfo->family == AF_INET)
+		gre_index_add(&gre_infos->gi_index, greinfo);
+	return 0;
+}
+
+static void
+gre_info_remove(struct gre_infotbl_st *gre_infos, struct gre_info_st *greinfo)
+{
+	if (greinfo->family == AF_INET)
+		gre_index_del(gre_infos->gi_index, greinfo);
+	cds_lfht_del(gre_infos->gi_grehash, &greinfo->gre_node);
 }
 
 static struct gre_info_st *
@@ -256,6 +270,24 @@ gre_info_lookup(struct gre_infotbl_st *gre_infos,
 		return NULL;
 }
 
+/* Per-packet lookup, through the flat index for IPv4 */
+static struct gre_info_st *
+gre_info_find(struct gre_infotbl_st *gre_infos,
+	      const struct gre_info_hash_key *h_key)
+{
+	const struct gre_index *idx;
+	struct gre_info_st *greinfo;
+
+	if (h_key->family == AF_INET) {
+		idx = rcu_dereference(gre_infos->gi_index);
+		greinfo = gre_index_lookup(idx, h_key->local, h_key->remote,
+					   h_key->flags, h_key->key);
+		if (greinfo || gre_index_complete(idx))
+			return greinfo;
+	}
+	return gre_info_lookup(gre_infos, h_key);
+}
+
 static struct gre_info_st *
 gre_info_init(struct vrf *vrf, const struct gre_info_hash_key *h_key)
 {
@@ -367,10 +399,9 @@ mgre_rt_info_table_init(struct gre_softc *sc)
 	 * This timer should mimic the kernel.  Use base_reachable_time, which
 	 * is the average time a neighbor is valid.
 	 */
-	rte_timer_reset(&sc->scg_rtinfo_timer,
-			rte_get_timer_hz() * RT_INFO_USED_TIMER,
-			PERIODICAL, rte_get_master_lcore(),
-			mgre_timer, sc);
+	master_aging_timer_reset(&sc->scg_rtinfo_timer,
+				 rte_get_timer_hz() * RT_INFO_USED_TIMER,
+				 mgre_timer, sc);
 }
 
 static void
@@ -533,8 +564,7 @@ mgre_rtinfo_delete(struct gre_softc *sc, struct mgre_rt_info *rt_info)
 		return 0;
 	}
 
-	cds_lfht_del(vrf->v_gre_infos->gi_grehash,
-		     &rt_info->greinfo->gre_node);
+	gre_info_remove(vrf->v_gre_infos, rt_info->greinfo);
 	gre_info_destroy(rt_info->greinfo);
 	cds_lfht_del(sc->scg_rtinfo_hash_nbma,
 		     &rt_info->rtinfo_node_nbma);
@@ -1156,7 +1186,7 @@ static void gre_tunnel_delete(struct ifnet *ifp)
 	if (sc->scg_rtinfo_hash_tun)
 		rte_timer_stop(&sc->scg_rtinfo_timer);
 
-	cds_lfht_del(vrf->v_gre_infos->gi_grehash, &greinfo->gre_node);
+	gre_info_remove(vrf->v_gre_infos, greinfo);
 	rcu_assign_pointer(ifp->if_softc, NULL);
 	rcu_assign_pointer(sc->scg_gre_info, NULL);
 	call_rcu(&sc->scg_rcu, gre_softc_free_rcu);
@@ -1502,11 +1532,11 @@ gre_parse(const struct rte_mbuf *m, struct gre_info_hash_key *h_key,
 
 	h_key->flags = gre->flags;
 	*next_prot = ntohs(gre->ptype);
-	greinfo = gre_info_lookup(vrf->v_gre_infos, h_key);
+	greinfo = gre_info_find(vrf->v_gre_infos, h_key);
 	if (!greinfo) {
 		if (h_key->family == AF_INET) {
 			h_key->remote = INADDR_ANY;
-			greinfo = gre_info_lookup(vrf->v_gre_infos, h_key);
+			greinfo = gre_info_find(vrf->v_gre_infos, h_key);
 		}
 	}
 
@@ -2432,6 +2462,9 @@ gre_info_table_init(struct gre_infotbl_st *gre_infos)
 	gre_infos->gi_greseed = random();
 	if (gre_infos->gi_grehash == NULL)
 		rte_panic("Can't allocate rthash for GRE infos\n");
+	gre_infos->gi_index = gre_index_create();
+	if (gre_infos->gi_index == NULL)
+		rte_panic("Can't allocate index for GRE infos\n");
 }
 
 int
@@ -2456,6 +2489,7 @@ gre_table_uninit(struct vrf *vrf)
 		return;
 
 	dp_ht_destroy_deferred(vrf->v_gre_infos->gi_grehash);
+	gre_index_destroy(vrf->v_gre_infos->gi_index);
 	free(vrf->v_gre_infos);
 	vrf->v_gre_infos = NULL;
 }
@@ -92,9 +92,12 @@ struct mgre_rt_info {
 #define RT_INFO_BIT_IS_USED  0x1 /* rt_info is used since timer reset */
 #define RT_INFO_BIT_WAS_USED 0x2 /* rt_info was used when timer reset it. */
 
+struct gre_index;
+
 struct gre_infotbl_st {
-	struct cds_lfht *gi_grehash;
-	unsigned long   gi_greseed;
+	struct cds_lfht  *gi_grehash;
+	unsigned long    gi_greseed;
+	struct gre_index *gi_index;	/* IPv4 tunnels, for demux */
 };
 
 struct mgre_rt_info;
@@ -0,0 +1,307 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * GRE tunnel index - two choice bucketized hash of IPv4 tunnels
+ *
+ * Keys never move once added, but a slot can be freed and reused
+ * while a reader is comparing it, so changes are bracketed by a
+ * sequence count and a reader that matched while it changed looks
+ * again.
+ */
+
+#include <linux/if_tunnel.h>
+#include <rte_branch_prediction.h>
+#include <rte_jhash.h>
+#include <rte_memory.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <urcu/system.h>
+
+#include "gre.h"
+#include "gre_index.h"
+#include "urcu.h"
+#include "util.h"
+
+#define GRE_INDEX_BUCKET_ENTRIES	4	/* keys in a cache line */
+#define GRE_INDEX_MIN_BUCKETS		64
+#define GRE_INDEX_MAX_BUCKETS		16384	/* 64k tunnels */
+
+#define GRE_INDEX_KEYED		0x1
+#define GRE_INDEX_VALID		0x80000000
+
+struct gre_index_key {
+	in_addr_t	remote;
+	in_addr_t	local;
+	uint32_t	key;		/* 0 unless keyed */
+	uint32_t	meta;		/* GRE_INDEX_*, 0 marks a free slot */
+};
+
+struct gre_index_bucket {
+	struct gre_index_key	key[GRE_INDEX_BUCKET_ENTRIES];
+	struct gre_info_st	*info[GRE_INDEX_BUCKET_ENTRIES];
+} __rte_cache_aligned;
+
+struct gre_index {
+	uint32_t		seq;		/* odd while a slot changes */
+	uint32_t		mask;		/* number of buckets - 1 */
+	uint32_t		seed;
+	uint32_t		overflow;	/* entries that did not fit */
+	struct gre_index_bucket	*buckets;
+	struct rcu_head		rcu;
+};
+
+static inline void
+gre_index_make_key(struct gre_index_key *k, in_addr_t local,
+		   in_addr_t remote, uint16_t flags, uint32_t key)
+{
+	k->remote = remote;
+	k->local = local;
+	if (flags & GRE_KEY) {
+		k->key = key;
+		k->meta = GRE_INDEX_KEYED | GRE_INDEX_VALID;
+	} else {
+		k->key = 0;
+		k->meta = GRE_INDEX_VALID;
+	}
+}
+
+static inline void
+gre_index_buckets(const struct gre_index *idx, const struct gre_index_key *k,
+		  uint32_t *b1, uint32_t *b2)
+{
+	uint32_t h = rte_jhash_3words(k->remote, k->local, k->key, idx->seed);
+
+	*b1 = h & idx->mask;
+	*b2 = hash32(h, 32) & idx->mask;
+	if (unlikely(*b2 == *b1))
+		*b2 = *b1 ^ 1;
+}
+
+static inline bool
+gre_index_key_equal(const struct gre_index_key *a,
+		    const struct gre_index_key *b)
+{
+	return a->remote == b->remote && a->local == b->local &&
+		a->key == b->key && a->meta == b->meta;
+}
+
+static inline struct gre_info_st *
+gre_index_bucket_lookup(const struct gre_index_bucket *bkt,
+			const struct gre_index_key *k)
+{
+	unsigned int i;
+
+	for (i = 0; i < GRE_INDEX_BUCKET_ENTRIES; i++)
+		if (gre_index_key_equal(&bkt->key[i], k))
+			return CMM_LOAD_SHARED(bkt->info[i]);
+	return NULL;
+}
+
+struct gre_info_st *
+gre_index_lookup(const struct gre_index *idx, in_addr_t local,
+		 in_addr_t remote, uint16_t flags, uint32_t key)
+{
+	struct gre_index_key k;
+	struct gre_info_st *greinfo;
+	uint32_t b1, b2, seq;
+
+	gre_index_make_key(&k, local, remote, flags, key);
+	gre_index_buckets(idx, &k, &b1, &b2);
+	do {
+		seq = CMM_LOAD_SHARED(idx->seq);
+		cmm_smp_rmb();
+
+		greinfo = gre_index_bucket_lookup(&idx->buckets[b1], &k);
+		if (!greinfo)
+			greinfo = gre_index_bucket_lookup(&idx->buckets[b2],
+							  &k);
+
+		cmm_smp_rmb();
+	} while (unlikely((seq & 1) || seq != CMM_LOAD_SHARED(idx->seq)));
+
+	return greinfo;
+}
+
+bool gre_index_complete(const struct gre_index *idx)
+{
+	return CMM_LOAD_SHARED(idx->overflow) == 0;
+}
+
+static int gre_index_free_slot(const struct gre_index_bucket *bkt)
+{
+	unsigned int i;
+
+	for (i = 0; i < GRE_INDEX_BUCKET_ENTRIES; i++)
+		if (bkt->key[i].meta == 0)
+			return i;
+	return -1;
+}
+
+static void gre_index_seq_begin(struct gre_index *idx)
+{
+	CMM_STORE_SHARED(idx->seq, idx->seq + 1);
+	cmm_smp_wmb();
+}
+
+static void gre_index_seq_end(struct gre_index *idx)
+{
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(idx->seq, idx->seq + 1);
+}
+
+/* Put a key in the emptier of its buckets, if either has room */
+static bool gre_index_insert(struct gre_index *idx,
+			     const struct gre_index_key *k,
+			     struct gre_info_st *greinfo)
+{
+	struct gre_index_bucket *bkt;
+	uint32_t b1, b2;
+	int i1, i2, i;
+
+	gre_index_buckets(idx, k, &b1, &b2);
+	i1 = gre_index_free_slot(&idx->buckets[b1]);
+	i2 = gre_index_free_slot(&idx->buckets[b2]);
+	if (i1 < 0 && i2 < 0)
+		return false;
+
+	/* The first free slot is lower in the emptier bucket */
+	if (i1 >= 0 && (i2 < 0 || i1 <= i2)) {
+		bkt = &idx->buckets[b1];
+		i = i1;
+	} else {
+		bkt = &idx->buckets[b2];
+		i = i2;
+	}
+
+	gre_index_seq_begin(idx);
+	bkt->info[i] = greinfo;
+	bkt->key[i] = *k;
+	gre_index_seq_end(idx);
+	return true;
+}
+
+static struct gre_index *gre_index_alloc(uint32_t nbuckets, uint32_t seed)
+{
+	struct gre_index *idx;
+
+	idx = zmalloc_aligned(sizeof(*idx));
+	if (!idx)
+		return NULL;
+
+	idx->buckets = zmalloc_aligned(nbuckets * sizeof(*idx->buckets));
+	if (!idx->buckets) {
+		free(idx);
+		return NULL;
+	}
+	idx->mask = nbuckets - 1;
+	idx->seed = seed;
+	return idx;
+}
+
+static void gre_index_free(struct gre_index *idx)
+{
+	free(idx->buckets);
+	free(idx);
+}
+
+static void gre_index_free_rcu(struct rcu_head *head)
+{
+	gre_index_free(caa_container_of(head, struct gre_index, rcu));
+}
+
+struct gre_index *gre_index_create(void)
+{
+	return gre_index_alloc(GRE_INDEX_MIN_BUCKETS, random());
+}
+
+void gre_index_destroy(struct gre_index *idx)
+{
+	call_rcu(&idx->rcu, gre_index_free_rcu);
+}
+
+/* Build a larger copy of the index, not yet visible to readers */
+static struct gre_index *
+gre_index_grow(const struct gre_index *old, const struct gre_index_key *k,
+	       struct gre_info_st *greinfo)
+{
+	uint32_t nbuckets = old->mask + 1;
+	struct gre_index *idx;
+	unsigned int i;
+	uint32_t b;
+
+	while ((nbuckets *= 2) <= GRE_INDEX_MAX_BUCKETS) {
+		idx = gre_index_alloc(nbuckets, old->seed);
+		if (!idx)
+			return NULL;
+
+		for (b = 0; b <= old->mask; b++) {
+			const struct gre_index_bucket *bkt = &old->buckets[b];
+
+			for (i = 0; i < GRE_INDEX_BUCKET_ENTRIES; i++)
+				if (bkt->key[i].meta &&
+				    !gre_index_insert(idx, &bkt->key[i],
+						      bkt->info[i]))
+					goto retry;
+		}
+		if (gre_index_insert(idx, k, greinfo)) {
+			idx->overflow = old->overflow;
+			return idx;
+		}
+retry:
+		gre_index_free(idx);
+	}
+	return NULL;
+}
+
+void gre_index_add(struct gre_index **idxp, struct gre_info_st *greinfo)
+{
+	struct gre_index *idx = *idxp;
+	struct gre_index *nidx;
+	struct gre_index_key k;
+
+	gre_index_make_key(&k, greinfo->iph.saddr, greinfo->iph.daddr,
+			   greinfo->flags, greinfo->key);
+	if (likely(gre_index_insert(idx, &k, greinfo)))
+		return;
+
+	nidx = gre_index_grow(idx, &k, greinfo);
+	if (!nidx) {
+		/* Left to be found in the lfht */
+		CMM_STORE_SHARED(idx->overflow, idx->overflow + 1);
+		return;
+	}
+
+	rcu_assign_pointer(*idxp, nidx);
+	gre_index_destroy(idx);
+}
+
+void gre_index_del(struct gre_index *idx, const struct gre_info_st *greinfo)
+{
+	struct gre_index_key k;
+	uint32_t bkts[2];
+	unsigned int b, i;
+
+	gre_index_make_key(&k, greinfo->iph.saddr, greinfo->iph.daddr,
+			   greinfo->flags, greinfo->key);
+	gre_index_buckets(idx, &k, &bkts[0], &bkts[1]);
+	for (b = 0; b < 2; b++) {
+		struct gre_index_bucket *bkt = &idx->buckets[bkts[b]];
+
+		for (i = 0; i < GRE_INDEX_BUCKET_ENTRIES; i++) {
+			if (bkt->info[i] == greinfo &&
+			    gre_index_key_equal(&bkt->key[i], &k)) {
+				gre_index_seq_begin(idx);
+				bkt->key[i].meta = 0;
+				gre_index_seq_end(idx);
+				return;
+			}
+		}
+	}
+
+	if (idx->overflow)
+		CMM_STORE_SHARED(idx->overflow, idx->overflow - 1);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef GRE_INDEX_H
+#define GRE_INDEX_H
+
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct gre_index;
+struct gre_info_st;
+
+/*
+ * GRE tunnel index.
+ *
+ * A flat index of the IPv4 tunnels in a transport VRF by {local,
+ * remote, key}, used to demux received packets. Each key is 16 bytes
+ * and a bucket holds 4 of them in one cache line, with two candidate
+ * buckets per key, so a lookup touches at most 4 cache lines and
+ * makes no indirect calls.
+ *
+ * The cds_lfht in the gre_infotbl_st remains the owner of the
+ * entries. Lookups are safe from any thread inside an RCU read-side
+ * section; changes are only made by the master thread.
+ */
+
+struct gre_index *gre_index_create(void);
+
+/* Free the index after a grace period. The entries are not freed. */
+void gre_index_destroy(struct gre_index *idx);
+
+/*
+ * Find the tunnel for the outer addresses and GRE key of a packet.
+ * flags are the GRE header flags, and key is only used if they have
+ * GRE_KEY set. Returns NULL if not found, in which case the caller
+ * must check gre_index_complete() before trusting it.
+ */
+struct gre_info_st *
+gre_index_lookup(const struct gre_index *idx, in_addr_t local,
+		 in_addr_t remote, uint16_t flags, uint32_t key);
+
+/* Does the index hold every tunnel added to it? */
+bool gre_index_complete(const struct gre_index *idx);
+
+/*
+ * Add an IPv4 tunnel, growing the index if needed. If the index is
+ * replaced, the new one is published through idxp and the old one
+ * freed after a grace period.
+ */
+void gre_index_add(struct gre_index **idxp, struct gre_info_st *greinfo);
+
+/* Remove a tunnel added with gre_index_add() */
+void gre_index_del(struct gre_index *idx, const struct gre_info_st *greinfo);
+
+#endif /* GRE_INDEX_H */
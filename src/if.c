@@ -96,11 +96,13 @@
 #include "netinet6/in6.h"
 #include "netlink.h"
 #include "pipeline/nodes/pl_nodes_common.h"
+#include "pipeline/pl_drop.h"
 #include "pktmbuf.h"
 #include "pl_node.h"
 #include "portmonitor/portmonitor.h"
 #include "pipeline/nodes/pppoe/pppoe.h"
 #include "qos.h"
+#include "stats_segment.h"
 #include "urcu.h"
 #include "util.h"
 #include "vplane_debug.h"
@@ -543,6 +545,43 @@ if_set_vrf(struct ifnet *ifp, vrfid_t vrf_id)
 	dp_event(DP_EVT_IF_VRF_SET, 0, ifp, 0, 0, NULL);
 }
 
+/*
+ * Counters are only needed for the lcores that can run, which is
+ * usually far fewer than RTE_MAX_LCORE, so size them when the
+ * interface is created rather than embedding them in the ifnet.
+ * The main counters go in the stats segment where collectors can
+ * read them, if there is room.
+ */
+static int if_counters_alloc(struct ifnet *ifp, const char *ifname,
+			     int socket)
+{
+	unsigned int nlcores = get_lcore_max() + 1;
+
+	ifp->if_data = stats_seg_if_data_alloc(ifname);
+	if (!ifp->if_data)
+		ifp->if_data = rte_zmalloc_socket(
+			"ifnet_data", nlcores * sizeof(struct if_data),
+			RTE_CACHE_LINE_SIZE, socket);
+	ifp->if_mpls_data = rte_zmalloc_socket(
+		"ifnet_mpls_data", nlcores * sizeof(struct if_mpls_data),
+		RTE_CACHE_LINE_SIZE, socket);
+	ifp->if_drop_stats = rte_zmalloc_socket(
+		"ifnet_drop_stats", nlcores * sizeof(struct pl_drop_stats),
+		RTE_CACHE_LINE_SIZE, socket);
+	if (!ifp->if_data || !ifp->if_mpls_data || !ifp->if_drop_stats)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void if_counters_free(struct ifnet *ifp)
+{
+	if (ifp->if_data && !stats_seg_if_data_free(ifp->if_data))
+		rte_free(ifp->if_data);
+	rte_free(ifp->if_mpls_data);
+	rte_free(ifp->if_drop_stats);
+}
+
 /* Callback from RCU to free interface */
 static void if_free_rcu(struct rcu_head *head)
 {
@@ -560,6 +599,7 @@ static void if_free_rcu(struct rcu_head *head)
 		dp_ht_destroy_deferred(ifp->vlan_feat_table);
 
 	rte_free(ifp->if_vlantbl);
+	if_counters_free(ifp);
 	rte_free(ifp);
 }
 
@@ -600,6 +640,12 @@ struct ifnet *if_alloc(const char *ifname, enum if_type type,
 	if (!ifp)
 		return NULL;
 
+	if (if_counters_alloc(ifp, ifname, socket) < 0) {
+		if_counters_free(ifp);
+		rte_free(ifp);
+		return NULL;
+	}
+
 	if (eth_addr)
 		ether_addr_copy(eth_addr, &ifp->eth_addr);
 
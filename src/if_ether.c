@@ -395,6 +395,16 @@ static void ll_probe(struct lltable *llt, struct llentry *la)
 
 static void ll_age(struct lltable *llt, struct llentry *lle, uint64_t cur_time)
 {
+	/*
+	 * Checking for use costs an atomic on a line the forwarding
+	 * lcores share, plus a FAL query, so rather than every entry on
+	 * each tick only look every ARPT_SAMPLE seconds and on expiry.
+	 */
+	if ((int64_t)(cur_time - lle->ll_expire) < 0 &&
+	    cur_time - lle->ll_sampled < rte_get_timer_hz() * ARPT_SAMPLE)
+		return;
+	lle->ll_sampled = cur_time;
+
 	if (llentry_has_been_used_and_clear(lle)) {
 		lle->ll_expire = cur_time + rte_get_timer_hz() * ARPT_KEEP;
 
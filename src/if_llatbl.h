@@ -52,6 +52,7 @@
 
 /* timer values */
 #define ARPT_KEEP	(20*60)	/* once resolved, good for 20 * minutes */
+#define ARPT_SAMPLE	30	/* seconds between checks for use */
 
 /*
  * Generic neighbor ND/ARP entry
@@ -84,6 +85,7 @@ struct llentry {
 	rte_spinlock_t		ll_lock;
 	struct sockaddr_storage ll_sock;
 	uint64_t		ll_expire;
+	uint64_t		ll_sampled;	/* last checked for use */
 	struct rcu_head		ll_rcu;
 	struct rte_mbuf		*la_held[ARP_MAXHOLD];
 };
@@ -185,12 +187,24 @@ struct in_addr *ll_ipv4_addr(struct llentry *lle);
 /* If the entry is v6 return a ptr to the  v4 addr, otherwise null */
 struct in6_addr *ll_ipv6_addr(struct llentry *lle);
 
+/*
+ * Called per packet on the output path, so take the address and flags
+ * in the single load that ll_addr_set() stores them with, and only
+ * write the shared idle marker when the entry has been marked idle.
+ */
 static ALWAYS_INLINE bool
 llentry_copy_mac(struct llentry *la,  struct ether_addr *desten)
 {
-	if (likely(la && (la->la_flags & LLE_VALID))) {
-		rte_atomic16_clear(&la->ll_idle);
-		ether_addr_copy((struct ether_addr *)&la->ll_addr, desten);
+	union llentry_addr tmp;
+
+	if (unlikely(!la))
+		return false;
+
+	tmp.lu_addr_flags = CMM_LOAD_SHARED(la->ll_u.lu_addr_flags);
+	if (likely(tmp.lu_flags & LLE_VALID)) {
+		if (unlikely(rte_atomic16_read(&la->ll_idle)))
+			rte_atomic16_clear(&la->ll_idle);
+		ether_addr_copy(&tmp.lu_addr, desten);
 		return true;
 	}
 	return false;
@@ -83,6 +83,7 @@ struct bridge_softc;
 struct bridge_port;
 struct sched_info;
 struct flow_counters;
+struct pl_drop_stats;
 struct portmonitor_info;
 struct npf_if;
 
@@ -324,9 +325,10 @@ struct ifnet {
 	struct if_perf	   if_rxbps;	/* bandwidth */
 	struct rte_timer   if_stats_timer; /* update performance */
 
-	struct if_data	   if_data[RTE_MAX_LCORE];
-
-	struct if_mpls_data if_mpls_data[RTE_MAX_LCORE];
+	/* Per-lcore counters, one for each lcore up to get_lcore_max() */
+	struct if_data	   *if_data;
+	struct if_mpls_data *if_mpls_data;
+	struct pl_drop_stats *if_drop_stats;	/* per lcore, by reason */
 
 	/* TCP MSS clamping feature type and value */
 	uint16_t            tcp_mss_type[TCP_MSS_AF_SIZE];
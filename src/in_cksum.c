@@ -4,14 +4,124 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#include <rte_byteorder.h>
 #include <rte_ip.h>
+#include <rte_mbuf.h>
+#include <stdbool.h>
+
+#if defined(RTE_ARCH_X86_64)
+#include <immintrin.h>
+#include <rte_cpuflags.h>
+#define CKSUM_HAVE_SIMD 1
+#endif
+
 #include "in_cksum.h"
 
+#ifdef CKSUM_HAVE_SIMD
+/* Below this the vector setup and fold cost more than they save */
+#define CKSUM_SIMD_MIN		128
+/* 32 byte blocks summed before the 32 bit lanes could overflow */
+#define CKSUM_AVX2_FOLD		16384
+
+static bool cksum_use_avx2;
+
+static void __attribute__ ((constructor)) in_cksum_init(void)
+{
+	cksum_use_avx2 = rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2);
+}
+
+/*
+ * Sum the buffer as 16 bit words, 16 at a time, with each 32 bit lane
+ * taking its low and high word. The order of the words in the sum does
+ * not matter, so this gives the same result as the scalar loop.
+ */
+__attribute__((target("avx2")))
+static uint32_t cksum_raw_avx2(const void *buf, size_t len, uint32_t sum)
+{
+	const __m256i mask = _mm256_set1_epi32(0xffff);
+	const uint8_t *p = buf;
+	uint32_t lanes[8];
+	uint64_t total = sum;
+	unsigned int i;
+
+	while (len >= sizeof(__m256i)) {
+		size_t n = RTE_MIN(len / sizeof(__m256i),
+				   (size_t)CKSUM_AVX2_FOLD);
+		__m256i acc = _mm256_setzero_si256();
+
+		len -= n * sizeof(__m256i);
+		while (n--) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)p);
+
+			acc = _mm256_add_epi32(acc, _mm256_and_si256(v, mask));
+			acc = _mm256_add_epi32(acc, _mm256_srli_epi32(v, 16));
+			p += sizeof(__m256i);
+		}
+
+		_mm256_storeu_si256((__m256i *)lanes, acc);
+		for (i = 0; i < RTE_DIM(lanes); i++)
+			total += lanes[i];
+	}
+
+	total += __rte_raw_cksum(p, len, 0);
+	while (total >> 32)
+		total = (total & UINT32_MAX) + (total >> 32);
+
+	return total;
+}
+#endif
+
+/* Unreduced one's complement sum of the buffer, added to sum */
+static inline uint32_t cksum_raw(const void *buf, size_t len, uint32_t sum)
+{
+#ifdef CKSUM_HAVE_SIMD
+	if (len >= CKSUM_SIMD_MIN && cksum_use_avx2)
+		return cksum_raw_avx2(buf, len, sum);
+#endif
+	return __rte_raw_cksum(buf, len, sum);
+}
+
+static inline uint16_t cksum_raw_reduced(const void *buf, size_t len)
+{
+	return __rte_raw_cksum_reduce(cksum_raw(buf, len, 0));
+}
+
+/*
+ * Sum len bytes at off in an mbuf chain. A segment starting at an odd
+ * offset into the data has its bytes in the other halves of the words,
+ * so its sum is byte swapped.
+ */
+static uint16_t cksum_raw_mbuf(const struct rte_mbuf *m, uint32_t off,
+			       uint32_t len)
+{
+	uint32_t seglen, done = 0;
+	uint32_t sum = 0;
+	uint16_t tmp;
+
+	while (m && off >= rte_pktmbuf_data_len(m)) {
+		off -= rte_pktmbuf_data_len(m);
+		m = m->next;
+	}
+
+	for (; m && done < len; m = m->next, off = 0) {
+		seglen = RTE_MIN(rte_pktmbuf_data_len(m) - off, len - done);
+		tmp = cksum_raw_reduced(rte_pktmbuf_mtod_offset(m, const void *,
+								off),
+					seglen);
+		if (done & 1)
+			tmp = rte_bswap16(tmp);
+		sum += tmp;
+		done += seglen;
+	}
+
+	return __rte_raw_cksum_reduce(sum);
+}
+
 uint16_t in_cksum(const void *addr, int len)
 {
 	uint16_t sum;
 
-	sum = rte_raw_cksum(addr, len);
+	sum = cksum_raw_reduced(addr, len);
 
 	sum = (~sum) & 0xffff;
 	return sum;
@@ -45,7 +155,7 @@ static uint32_t __in6_cksum(const struct ip6_hdr *ip6, uint8_t next,
 	};
 
 	sum = rte_raw_cksum(&uph, sizeof(uph));
-	sum += rte_raw_cksum((const char *)ip6 + off, len);
+	sum += cksum_raw_reduced((const char *)ip6 + off, len);
 
 	return sum;
 }
@@ -102,7 +212,7 @@ in4_cksum_mbuf(const struct rte_mbuf *pak, const struct iphdr *ip,
 	start_offset = (char *)l4_hdr - rte_pktmbuf_mtod(pak, char *);
 	len = pak->pkt_len - start_offset;
 
-	rte_raw_cksum_mbuf(pak, start_offset, len, &hdr_sum);
+	hdr_sum = cksum_raw_mbuf(pak, start_offset, len);
 
 	sum += hdr_sum;
 	sum = __rte_raw_cksum_reduce(sum);
@@ -128,7 +238,7 @@ in6_cksum_mbuf(const struct rte_mbuf *pak, const struct ip6_hdr *ip6,
 	start_offset = (char *)l4_hdr - rte_pktmbuf_mtod(pak, char *);
 	len = pak->pkt_len - start_offset;
 
-	rte_raw_cksum_mbuf(pak, start_offset, len, &hdr_sum);
+	hdr_sum = cksum_raw_mbuf(pak, start_offset, len);
 
 	sum += hdr_sum;
 	sum = __rte_raw_cksum_reduce(sum);
@@ -25,6 +25,19 @@ int cmd_ip(FILE *f, int argc, char **argv)
 		ip_redirects_set(enable);
 		return 0;
 	}
+	if (argc == 4 && !strcmp(argv[1], "icmp-ratelimit")) {
+		char *end1, *end2;
+		unsigned long rate = strtoul(argv[2], &end1, 0);
+		unsigned long burst = strtoul(argv[3], &end2, 0);
+
+		if (*end1 || *end2 || rate > UINT32_MAX ||
+		    burst > UINT32_MAX) {
+			fprintf(f, "ip icmp-ratelimit <rate> <burst>\n");
+			return -1;
+		}
+		icmp_ratelimit_set(rate, burst);
+		return 0;
+	}
 	fprintf(f, "ip command invalid\n");
 	return -1;
 }
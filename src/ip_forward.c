@@ -390,9 +390,13 @@ enum ip_packet_validity ip_validate_packet(
 	pktmbuf_l3_len(m) = hlen;
 
 	/*
-	 * Checksum correct?
+	 * Checksum correct? Take the NIC's word for it if it checked,
+	 * but that was of the outermost header, so clear the flag so
+	 * that any header validated after decapsulation is checked here.
 	 */
-	if (ip_checksum(ip, hlen))
+	if ((m->ol_flags & PKT_RX_IP_CKSUM_MASK) == PKT_RX_IP_CKSUM_GOOD)
+		m->ol_flags &= ~PKT_RX_IP_CKSUM_MASK;
+	else if (ip_checksum(ip, hlen))
 		goto bad_hdr;
 
 	/*
@@ -81,6 +81,9 @@ typedef void (output_t)(struct ifnet *, struct rte_mbuf *, void *);
 
 void ip_fragment(struct ifnet *, struct rte_mbuf *, void *ctx, output_t)
 	__hot_func;
+void ip_fragment_indirect(struct ifnet *, struct rte_mbuf *, void *ctx,
+			  output_t)
+	__hot_func;
 void ip_fragment_mtu(struct ifnet *, unsigned int mtu,
 		 struct rte_mbuf *, void *ctx, output_t)
 	__hot_func;
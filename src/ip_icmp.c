@@ -37,7 +37,9 @@
 #include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
 #include <rte_common.h>
+#include <rte_cycles.h>
 #include <rte_ether.h>
+#include <rte_jhash.h>
 #include <rte_mbuf.h>
 #include <rte_log.h>
 #include <stdbool.h>
@@ -92,6 +94,73 @@ struct icmp_ext_obj_hdr {
 static bool ip_redirects = true;
 uint64_t icmpstats[ICMP_MIB_MAX];
 
+/*
+ * ICMP errors are rate limited per source prefix, per lcore, with a
+ * small table of token buckets indexed by a hash of the prefix. Sources
+ * which collide share a bucket, so one can not be reset by cycling
+ * through addresses.
+ */
+#define ICMP_RL_BUCKETS		256
+#define ICMP_RL_RATE_DEF	100	/* tokens per second */
+#define ICMP_RL_BURST_DEF	50
+
+struct icmp_rl_bucket {
+	uint64_t	tb_last;
+	uint32_t	tb_tokens;
+};
+
+struct icmp_rl_lcore {
+	struct icmp_rl_bucket buckets[ICMP_RL_BUCKETS];
+} __rte_cache_aligned;
+
+static struct icmp_rl_lcore icmp_rl[RTE_MAX_LCORE];
+static uint32_t icmp_rl_rate = ICMP_RL_RATE_DEF;
+static uint32_t icmp_rl_burst = ICMP_RL_BURST_DEF;
+
+void icmp_ratelimit_set(uint32_t rate, uint32_t burst)
+{
+	CMM_STORE_SHARED(icmp_rl_burst, burst ? burst : 1);
+	CMM_STORE_SHARED(icmp_rl_rate, rate);
+}
+
+/*
+ * Returns true if an error to the source prefix should be suppressed.
+ * Tokens are only added once a whole one has accrued, so the rate is
+ * held to the timer resolution at worst.
+ */
+bool icmp_ratelimit(uint32_t prefix)
+{
+	uint32_t rate = CMM_LOAD_SHARED(icmp_rl_rate);
+	uint32_t burst = CMM_LOAD_SHARED(icmp_rl_burst);
+	struct icmp_rl_bucket *b;
+	uint64_t now, elapsed, tokens;
+
+	if (rate == 0)
+		return false;
+
+	b = &icmp_rl[dp_lcore_id()].buckets[rte_jhash_1word(prefix, 0) &
+					     (ICMP_RL_BUCKETS - 1)];
+	now = rte_get_timer_cycles();
+	elapsed = now - b->tb_last;
+
+	/* Idle for long enough to be full, also avoids overflow below */
+	if (b->tb_last == 0 || elapsed >= rte_get_timer_hz() * 64)
+		tokens = burst;
+	else
+		tokens = elapsed * rate / rte_get_timer_hz();
+
+	if (tokens) {
+		b->tb_tokens = RTE_MIN((uint64_t)burst, b->tb_tokens + tokens);
+		b->tb_last = now;
+	}
+
+	if (b->tb_tokens == 0)
+		return true;
+
+	b->tb_tokens--;
+	return false;
+}
+
 static void icmp_out_inc(vrfid_t vrf_id, uint8_t type)
 {
 	switch (type) {
@@ -398,6 +467,13 @@ icmp_do_error(struct rte_mbuf *n, int type, int code, uint32_t info,
 	if (icmplen < sizeof(struct ip))
 		return NULL;
 
+	/* Keep path MTU discovery working regardless */
+	if (!(type == ICMP_DEST_UNREACH && code == ICMP_FRAG_NEEDED) &&
+	    icmp_ratelimit(oip->saddr & htonl(0xffffff00))) {
+		ICMPSTAT_INC(pktmbuf_get_vrf(n), ICMP_MIB_RATELIMITHOST);
+		return NULL;
+	}
+
 	m = pktmbuf_alloc(n->pool, pktmbuf_get_vrf(n));
 	if (m == NULL)
 		return NULL;
@@ -22,6 +22,8 @@ bool ip_same_network(const struct ifnet *ifp, in_addr_t nxt_gateway,
 in_addr_t ip_select_source(const struct ifnet *ifp, in_addr_t dst);
 void ip_redirects_set(bool enable);
 bool ip_redirects_get(void);
+void icmp_ratelimit_set(uint32_t rate, uint32_t burst);
+bool icmp_ratelimit(uint32_t prefix);
 void icmp_error(const struct ifnet *rcvif, struct rte_mbuf *n,
 		   int type, int code, uint32_t info)
 	 __attribute__((cold));
@@ -210,6 +210,109 @@ ip_optcopy(const struct iphdr *ip, struct iphdr *jp)
 	return optlen;
 }
 
+/*
+ * Split a reassembled packet back into fragments along its segment
+ * boundaries, which are normally the fragments it was reassembled from,
+ * instead of copying the payload into new mbufs.  The (possibly rewritten)
+ * header of the first segment is copied into the headroom of each of the
+ * later segments.
+ *
+ * Returns false, with the packet unchanged, if the segments can not be
+ * sent as fragments as they stand.
+ */
+static bool
+ip_fragment_segs(struct ifnet *ifp, unsigned int mtu, struct rte_mbuf *m0,
+		 void *ctx, output_t frag_out)
+{
+	struct iphdr *ip = iphdr(m0);
+	struct vrf *vrf = if_vrf(ifp);
+	unsigned int l2_len = pktmbuf_l2_len(m0);
+	unsigned int hlen = pktmbuf_l3_len(m0);
+	unsigned int iplen = ntohs(ip->tot_len);
+	struct rte_mbuf *seg, *next;
+	unsigned int off, sz;
+	uint16_t frag_off;
+
+	/* Options would need to be filtered by ip_optcopy */
+	if (hlen != sizeof(struct iphdr) || m0->nb_segs < 2 ||
+	    rte_pktmbuf_pkt_len(m0) != l2_len + iplen ||
+	    rte_pktmbuf_data_len(m0) <= l2_len + hlen)
+		return false;
+
+	/*
+	 * Every fragment must fit the mtu, and all but the last must carry a
+	 * multiple of 8 bytes.  The later segments must be ours alone, as we
+	 * write into their headroom.
+	 */
+	sz = rte_pktmbuf_data_len(m0) - l2_len - hlen;
+	if (sz + hlen > mtu || (sz & 7) != 0)
+		return false;
+
+	for (seg = m0->next; seg; seg = seg->next) {
+		sz = rte_pktmbuf_data_len(seg);
+		if (sz == 0 || sz + hlen > mtu ||
+		    (seg->next && (sz & 7) != 0))
+			return false;
+
+		if (!RTE_MBUF_DIRECT(seg) || rte_mbuf_refcnt_read(seg) != 1 ||
+		    rte_pktmbuf_headroom(seg) < l2_len + hlen)
+			return false;
+	}
+
+	frag_off = ntohs(ip->frag_off);
+	off = rte_pktmbuf_data_len(m0) - l2_len - hlen;
+	next = m0->next;
+
+	/* Detach the first fragment, which is sent last */
+	m0->next = NULL;
+	m0->nb_segs = 1;
+	rte_pktmbuf_pkt_len(m0) = rte_pktmbuf_data_len(m0);
+
+	for (seg = next; seg; seg = next) {
+		struct iphdr *mhip;
+
+		next = seg->next;
+		sz = rte_pktmbuf_data_len(seg);
+
+		seg->next = NULL;
+		seg->nb_segs = 1;
+		rte_pktmbuf_prepend(seg, l2_len + hlen);
+		rte_pktmbuf_pkt_len(seg) = rte_pktmbuf_data_len(seg);
+
+		pktmbuf_mdata_clear_all(seg);
+		pktmbuf_set_vrf(seg, pktmbuf_get_vrf(m0));
+		pktmbuf_copy_meta(seg, m0);
+		pktmbuf_l3_len(seg) = hlen;
+
+		memcpy(rte_pktmbuf_mtod(seg, char *),
+		       rte_pktmbuf_mtod(m0, char *), l2_len + hlen);
+
+		mhip = iphdr(seg);
+		mhip->frag_off = htons((off >> 3) + frag_off);
+		if (next)
+			mhip->frag_off |= htons(IP_MF);
+		mhip->tot_len = htons(sz + hlen);
+		mhip->check = 0;
+		mhip->check = in_cksum(mhip, hlen);
+
+		off += sz;
+
+		IPSTAT_INC_VRF(vrf, IPSTATS_MIB_FRAGCREATES);
+		frag_out(ifp, seg, ctx);
+	}
+
+	ip->tot_len = htons(rte_pktmbuf_data_len(m0) - l2_len);
+	ip->frag_off = htons(frag_off | IP_MF);
+	ip->check = 0;
+	ip->check = in_cksum(ip, hlen);
+
+	IPSTAT_INC_VRF(vrf, IPSTATS_MIB_FRAGCREATES);
+	IPSTAT_INC_VRF(vrf, IPSTATS_MIB_FRAGOKS);
+
+	frag_out(ifp, m0, ctx);
+	return true;
+}
+
 /*
  * Copy mbuf that needs to be fragmented into a new packet
  * mbuf to be fragmented.
@@ -220,6 +323,113 @@ void ip_fragment(struct ifnet *ifp, struct rte_mbuf *m0,
 	ip_fragment_mtu(ifp, ifp->if_mtu, m0, ctx, frag_out);
 }
 
+/*
+ * Make a fragment from a copy of the headers, chained to an indirect
+ * mbuf for sz bytes of the original packet's payload at off.
+ */
+static struct rte_mbuf *
+ip_fragment_indirect_seg(struct rte_mbuf *m0, unsigned int off,
+			 unsigned int sz)
+{
+	unsigned int hdr_len = pktmbuf_l2_len(m0) + pktmbuf_l3_len(m0);
+	vrfid_t vrf_id = pktmbuf_get_vrf(m0);
+	struct rte_mbuf *m, *data;
+
+	m = pktmbuf_alloc(m0->pool, vrf_id);
+	data = pktmbuf_alloc(m0->pool, vrf_id);
+	if (unlikely(!m || !data)) {
+		rte_pktmbuf_free(m);
+		rte_pktmbuf_free(data);
+		return NULL;
+	}
+
+	rte_pktmbuf_attach(data, m0);
+	rte_pktmbuf_adj(data, off);
+	rte_pktmbuf_trim(data, rte_pktmbuf_data_len(data) - sz);
+
+	pktmbuf_copy_meta(m, m0);
+	memcpy(rte_pktmbuf_mtod(m, char *),
+	       rte_pktmbuf_mtod(m0, char *), hdr_len);
+	pktmbuf_l3_len(m) = pktmbuf_l3_len(m0);
+	rte_pktmbuf_data_len(m) = hdr_len;
+
+	m->next = data;
+	m->nb_segs = 2;
+	rte_pktmbuf_pkt_len(m) = hdr_len + sz;
+
+	return m;
+}
+
+/*
+ * As ip_fragment, but without copying the payload. Each fragment is a
+ * new header mbuf chained to an indirect mbuf referencing its part of
+ * the original packet. As those all share the original buffer this is
+ * only for output paths that leave the fragments' payload untouched,
+ * so not for anything that encrypts or encapsulates in place.
+ */
+void ip_fragment_indirect(struct ifnet *ifp, struct rte_mbuf *m0,
+			  void *ctx, output_t frag_out)
+{
+	struct iphdr *ip = iphdr(m0);
+	struct vrf *vrf = if_vrf(ifp);
+	unsigned int l2_len = pktmbuf_l2_len(m0);
+	unsigned int hlen = pktmbuf_l3_len(m0);
+	unsigned int plen = ntohs(ip->tot_len) - hlen;
+	unsigned int len = (ifp->if_mtu - hlen) & ~7;
+	uint16_t frag_off = ntohs(ip->frag_off);
+	struct rte_mbuf *m;
+	struct iphdr *mhip;
+	unsigned int off, sz;
+
+	/* Options would need to be filtered by ip_optcopy */
+	if (hlen != sizeof(struct iphdr) || len < 8 || m0->nb_segs != 1 ||
+	    pktmbuf_mdata_exists(m0, PKT_MDATA_DEFRAG) ||
+	    rte_pktmbuf_data_len(m0) < l2_len + hlen + plen) {
+		ip_fragment(ifp, m0, ctx, frag_out);
+		return;
+	}
+
+	/* Fragments are sent as created, then the first one last */
+	for (off = len; off < plen; off += sz) {
+		sz = RTE_MIN(len, plen - off);
+
+		m = ip_fragment_indirect_seg(m0, l2_len + hlen + off, sz);
+		if (unlikely(!m))
+			goto drop;
+
+		mhip = iphdr(m);
+		mhip->frag_off = htons((off >> 3) + frag_off);
+		if (off + sz < plen)
+			mhip->frag_off |= htons(IP_MF);
+		mhip->tot_len = htons(sz + hlen);
+		mhip->check = 0;
+		mhip->check = in_cksum(mhip, hlen);
+
+		IPSTAT_INC_VRF(vrf, IPSTATS_MIB_FRAGCREATES);
+		frag_out(ifp, m, ctx);
+	}
+
+	m = ip_fragment_indirect_seg(m0, l2_len + hlen, len);
+	if (unlikely(!m))
+		goto drop;
+
+	mhip = iphdr(m);
+	mhip->tot_len = htons(hlen + len);
+	mhip->frag_off |= htons(IP_MF);
+	mhip->check = 0;
+	mhip->check = in_cksum(mhip, hlen);
+
+	IPSTAT_INC_VRF(vrf, IPSTATS_MIB_FRAGCREATES);
+	IPSTAT_INC_VRF(vrf, IPSTATS_MIB_FRAGOKS);
+	rte_pktmbuf_free(m0);
+
+	frag_out(ifp, m, ctx);
+	return;
+drop: __cold_label;
+	IPSTAT_INC_VRF(vrf, IPSTATS_MIB_OUTDISCARDS);
+	rte_pktmbuf_free(m0);
+}
+
 void ip_fragment_mtu(struct ifnet *ifp, unsigned int mtu, struct rte_mbuf *m0,
 		     void *ctx, output_t frag_out)
 {
@@ -239,6 +449,14 @@ void ip_fragment_mtu(struct ifnet *ifp, unsigned int mtu, struct rte_mbuf *m0,
 	if (len < 8)
 		goto drop;
 
+	/*
+	 * A reassembled packet can usually be split back into the fragments
+	 * it arrived as without copying.
+	 */
+	if (pktmbuf_mdata_exists(m0, PKT_MDATA_DEFRAG) &&
+	    ip_fragment_segs(ifp, mtu, m0, ctx, frag_out))
+		return;
+
 	/*
 	 * Loop through length of segment after first fragment,
 	 * make new header and copy data of each part and link onto chain.
@@ -17,9 +17,22 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "json_writer.h"
 
+/*
+ * The stream is only ever used by the thread writing it, so the
+ * unlocked stdio calls are used to avoid taking the FILE lock for
+ * every character of large outputs.
+ */
+#define INDENT_STR	"                                                " \
+			"                                                "
+#define INDENT_WIDTH	4
+
+/* Characters written escaped by jsonw_puts() */
+static const char jsonw_special[] = "\t\n\r\f\b\\\"\'";
+
 struct json_writer {
 	FILE		*out;	/* output file */
 	unsigned int depth;  /* nesting */
@@ -30,9 +43,14 @@ struct json_writer {
 /* indentation for pretty print */
 static void jsonw_indent(json_writer_t *self)
 {
-	unsigned int i;
-	for (i = 0; i <= self->depth; ++i)
-		fputs("    ", self->out);
+	size_t len = (self->depth + 1) * INDENT_WIDTH;
+
+	while (len > sizeof(INDENT_STR) - 1) {
+		fwrite_unlocked(INDENT_STR, 1, sizeof(INDENT_STR) - 1,
+				self->out);
+		len -= sizeof(INDENT_STR) - 1;
+	}
+	fwrite_unlocked(INDENT_STR, 1, len, self->out);
 }
 
 /* end current line and indent if pretty printing */
@@ -41,7 +59,7 @@ static void jsonw_eol(json_writer_t *self)
 	if (!self->pretty)
 		return;
 
-	putc('\n', self->out);
+	putc_unlocked('\n', self->out);
 	jsonw_indent(self);
 }
 
@@ -49,7 +67,7 @@ static void jsonw_eol(json_writer_t *self)
 static void jsonw_eor(json_writer_t *self)
 {
 	if (self->sep != '\0')
-		putc(self->sep, self->out);
+		putc_unlocked(self->sep, self->out);
 	self->sep = ',';
 }
 
@@ -58,37 +76,62 @@ static void jsonw_eor(json_writer_t *self)
 /* Handles C escapes, does not do Unicode */
 static void jsonw_puts(json_writer_t *self, const char *str)
 {
-	putc('"', self->out);
-	for (; *str; ++str)
-		switch (*str) {
+	size_t len;
+
+	putc_unlocked('"', self->out);
+	for (;;) {
+		/* Copy out the run up to the next special character */
+		len = strcspn(str, jsonw_special);
+		if (len)
+			fwrite_unlocked(str, 1, len, self->out);
+		str += len;
+		if (!*str)
+			break;
+
+		switch (*str++) {
 		case '\t':
-			fputs("\\t", self->out);
+			fputs_unlocked("\\t", self->out);
 			break;
 		case '\n':
-			fputs("\\n", self->out);
+			fputs_unlocked("\\n", self->out);
 			break;
 		case '\r':
-			fputs("\\r", self->out);
+			fputs_unlocked("\\r", self->out);
 			break;
 		case '\f':
-			fputs("\\f", self->out);
+			fputs_unlocked("\\f", self->out);
 			break;
 		case '\b':
-			fputs("\\b", self->out);
+			fputs_unlocked("\\b", self->out);
 			break;
 		case '\\':
-			fputs("\\n", self->out);
+			fputs_unlocked("\\n", self->out);
 			break;
 		case '"':
-			fputs("\\\"", self->out);
+			fputs_unlocked("\\\"", self->out);
 			break;
 		case '\'':
-			fputs("\\\'", self->out);
+			fputs_unlocked("\\\'", self->out);
 			break;
-		default:
-			putc(*str, self->out);
 		}
-	putc('"', self->out);
+	}
+	putc_unlocked('"', self->out);
+}
+
+/* Output an unsigned decimal, without going through printf */
+static void jsonw_put_u64(json_writer_t *self, uint64_t num, bool neg)
+{
+	char buf[24];
+	char *p = buf + sizeof(buf);
+
+	do {
+		*--p = '0' + num % 10;
+		num /= 10;
+	} while (num);
+	if (neg)
+		*--p = '-';
+
+	fwrite_unlocked(p, 1, buf + sizeof(buf) - p, self->out);
 }
 
 /* Create a new JSON stream */
@@ -100,7 +143,7 @@ json_writer_t *jsonw_new(FILE *f)
 		self->depth = 0;
 		self->pretty = false;
 		self->sep = '\0';
-		putc('{', self->out);
+		putc_unlocked('{', self->out);
 	}
 	return self;
 }
@@ -127,7 +170,7 @@ void jsonw_pretty(json_writer_t *self, bool on)
 static void jsonw_begin(json_writer_t *self, int c)
 {
 	jsonw_eor(self);
-	putc(c, self->out);
+	putc_unlocked(c, self->out);
 	++self->depth;
 	self->sep = '\0';
 }
@@ -139,7 +182,7 @@ static void jsonw_end(json_writer_t *self, int c)
 	--self->depth;
 	if (self->sep != '\0')
 		jsonw_eol(self);
-	putc(c, self->out);
+	putc_unlocked(c, self->out);
 	self->sep = ',';
 }
 
@@ -151,9 +194,9 @@ void jsonw_name(json_writer_t *self, const char *name)
 	jsonw_eol(self);
 	self->sep = '\0';
 	jsonw_puts(self, name);
-	putc(':', self->out);
+	putc_unlocked(':', self->out);
 	if (self->pretty)
-		putc(' ', self->out);
+		putc_unlocked(' ', self->out);
 }
 
 __attribute__((format(printf, 2, 3)))
@@ -197,7 +240,8 @@ void jsonw_string(json_writer_t *self, const char *value)
 
 void jsonw_bool(json_writer_t *self, bool val)
 {
-	jsonw_printf(self, "%s", val ? "true" : "false");
+	jsonw_eor(self);
+	fputs_unlocked(val ? "true" : "false", self->out);
 }
 
 #ifdef notused
@@ -214,12 +258,17 @@ void jsonw_float(json_writer_t *self, double num)
 
 void jsonw_uint(json_writer_t *self, uint64_t num)
 {
-	jsonw_printf(self, "%"PRIu64, num);
+	jsonw_eor(self);
+	jsonw_put_u64(self, num, false);
 }
 
 void jsonw_int(json_writer_t *self, int64_t num)
 {
-	jsonw_printf(self, "%"PRId64, num);
+	jsonw_eor(self);
+	if (num < 0)
+		jsonw_put_u64(self, -(uint64_t)num, true);
+	else
+		jsonw_put_u64(self, num, false);
 }
 
 /* Basic name/value objects */
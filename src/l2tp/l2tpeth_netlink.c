@@ -46,9 +46,27 @@ struct nlmsghdr;
 #define L2TP_TUNNEL_HASH_MAX (1u << L2TP_TUNNEL_HASH_BITS)
 #define L2TP_PAYLOAD_OFFSET GENL_HDRLEN
 
+/*
+ * Session IDs are allocated locally, so tend to be small and dense.
+ * Those below L2TP_SESSION_DIRECT_MAX are also indexed directly for
+ * the receive path, in blocks allocated as they are first used.
+ */
+#define L2TP_SESSION_BLOCK_BITS 12
+#define L2TP_SESSION_BLOCK_SIZE (1u << L2TP_SESSION_BLOCK_BITS)
+#define L2TP_SESSION_BLOCKS 256
+#define L2TP_SESSION_DIRECT_MAX \
+	(L2TP_SESSION_BLOCKS * L2TP_SESSION_BLOCK_SIZE)
+
+struct l2tp_session_block {
+	struct l2tp_session *sb_session[L2TP_SESSION_BLOCK_SIZE];
+	unsigned int sb_count;
+	struct rcu_head sb_rcu;
+};
+
 struct l2tp_session_hash_tbl {
 	struct cds_lfht *sess_hash;
 	unsigned long sess_seed;
+	struct l2tp_session_block *sess_blocks[L2TP_SESSION_BLOCKS];
 };
 static struct l2tp_session_hash_tbl *l2tp_sessions;
 
@@ -89,11 +107,91 @@ l2tp_session_match(struct cds_lfht_node *node,
 	return session->session_id == *(const uint32_t *)key;
 }
 
+static inline struct l2tp_session *
+l2tp_session_direct(uint32_t session_id)
+{
+	const struct l2tp_session_block *blk;
+
+	if (session_id >= L2TP_SESSION_DIRECT_MAX)
+		return NULL;
+
+	blk = rcu_dereference(
+		l2tp_sessions->sess_blocks[session_id >>
+					   L2TP_SESSION_BLOCK_BITS]);
+	if (!blk)
+		return NULL;
+
+	return rcu_dereference(
+		blk->sb_session[session_id & (L2TP_SESSION_BLOCK_SIZE - 1)]);
+}
+
+static void
+l2tp_session_map(struct l2tp_session *sess, uint32_t s_id)
+{
+	struct l2tp_session_block **blkp;
+	struct l2tp_session_block *blk;
+
+	if (s_id >= L2TP_SESSION_DIRECT_MAX)
+		return;
+
+	blkp = &l2tp_sessions->sess_blocks[s_id >> L2TP_SESSION_BLOCK_BITS];
+	blk = *blkp;
+	if (!blk) {
+		/* Not fatal, the session is still found by hash */
+		blk = zmalloc_aligned(sizeof(*blk));
+		if (!blk)
+			return;
+		rcu_assign_pointer(*blkp, blk);
+	}
+
+	blk->sb_count++;
+	rcu_assign_pointer(blk->sb_session[s_id & (L2TP_SESSION_BLOCK_SIZE - 1)],
+			   sess);
+}
+
+static void
+l2tp_session_block_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct l2tp_session_block, sb_rcu));
+}
+
+static void
+l2tp_session_unmap(struct l2tp_session *sess)
+{
+	uint32_t s_id = sess->session_id;
+	struct l2tp_session_block **blkp;
+	struct l2tp_session_block *blk;
+	struct l2tp_session **slot;
+
+	if (s_id >= L2TP_SESSION_DIRECT_MAX)
+		return;
+
+	blkp = &l2tp_sessions->sess_blocks[s_id >> L2TP_SESSION_BLOCK_BITS];
+	blk = *blkp;
+	if (!blk)
+		return;
+
+	slot = &blk->sb_session[s_id & (L2TP_SESSION_BLOCK_SIZE - 1)];
+	if (*slot != sess)
+		return;
+
+	rcu_assign_pointer(*slot, NULL);
+	if (--blk->sb_count == 0) {
+		rcu_assign_pointer(*blkp, NULL);
+		call_rcu(&blk->sb_rcu, l2tp_session_block_free);
+	}
+}
+
 struct l2tp_session *
 l2tp_session_byid(uint32_t session_id)
 {
+	struct l2tp_session *session;
 	struct cds_lfht_iter iter;
 
+	session = l2tp_session_direct(session_id);
+	if (likely(session != NULL))
+		return session;
+
 	cds_lfht_lookup(l2tp_sessions->sess_hash,
 			l2tp_session_hash(session_id,
 					  l2tp_sessions->sess_seed),
@@ -170,8 +268,11 @@ l2tp_session_insert(struct l2tp_session *sess, uint32_t s_id)
 	ret_node = cds_lfht_add_unique(l2tp_sessions->sess_hash, hash,
 				       l2tp_session_match, &s_id,
 				       &sess->session_node);
+	if (ret_node != &sess->session_node)
+		return EEXIST;
 
-	return (ret_node != &sess->session_node) ? EEXIST : 0;
+	l2tp_session_map(sess, s_id);
+	return 0;
 }
 
 static void
@@ -195,6 +296,7 @@ static void
 l2tp_session_delete(struct l2tp_session *session)
 {
 	if (likely(session != NULL)) {
+		l2tp_session_unmap(session);
 		cds_lfht_del(l2tp_sessions->sess_hash, &session->session_node);
 		l2tp_session_dec_refcnt(session);
 	}
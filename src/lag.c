@@ -11,11 +11,13 @@
 #include <netinet/in.h>
 #include <linux/if.h>
 #include <linux/if_link.h>
+#include <rte_atomic.h>
 #include <rte_branch_prediction.h>
 #include <rte_eth_bond.h>
 #include <rte_eth_bond_8023ad.h>
 #include <rte_ethdev.h>
 #include <rte_ether.h>
+#include <rte_jhash.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
 #include <rte_mbuf.h>
@@ -29,6 +31,7 @@
 #include "compiler.h"
 #include "capture.h"
 #include "compat.h"
+#include "ecmp.h"
 #include "ether.h"
 #include "if_var.h"
 #include "json_writer.h"
@@ -47,6 +50,29 @@ struct nlattr;
 /* remember which slaves are collecting/distributing */
 static uint8_t enabled[LAG_MAX_SLAVES];
 
+/*
+ * In 802.3ad mode the dataplane picks the member to transmit on, from
+ * the flow hash shared with ECMP, rather than the bond PMD hashing each
+ * packet.  Each slot of the table holds one of the distributing
+ * members.  When membership changes only the slots of members that
+ * left, or that now have more than their share, move, so flows on the
+ * other members stay put.
+ */
+#define LAG_TX_SLOTS		256
+#define LAG_TX_MAX_MEMBERS	16
+
+struct lag_tx_table {
+	uint8_t			nmembers;
+	portid_t		member[LAG_TX_MAX_MEMBERS];
+	uint8_t			slot[LAG_TX_SLOTS];	/* index to member */
+	struct rcu_head		rcu;
+};
+
+static struct lag_tx_table *lag_tx_tbl[DATAPLANE_MAX_PORTS];
+
+/* Slow protocol frames queued in the bond PMD, to be sent by its tx */
+static rte_atomic16_t lag_slow_pending[DATAPLANE_MAX_PORTS];
+
 struct ifnet *ifnet_byteam(int ifindex)
 {
 	struct ifnet *ifp = ifnet_byifindex(ifindex);
@@ -82,11 +108,180 @@ static void lacp_recv_cb(portid_t slave_id, struct rte_mbuf *lacp_pkt)
 int lag_etype_slow_tx(struct ifnet *master, struct ifnet *ifp,
 		struct rte_mbuf *lacp_pkt)
 {
+	int rv;
+
 	if (ifp->capturing)
 		capture_burst(ifp, &lacp_pkt, 1);
 
-	return rte_eth_bond_8023ad_ext_slowtx(master->if_port, ifp->if_port,
-					lacp_pkt);
+	rv = rte_eth_bond_8023ad_ext_slowtx(master->if_port, ifp->if_port,
+					    lacp_pkt);
+	if (rv == 0)
+		rte_atomic16_set(&lag_slow_pending[master->if_port], 1);
+	return rv;
+}
+
+static inline uint32_t lag_tx_hash(const struct rte_mbuf *m)
+{
+	const struct ether_hdr *eh = rte_pktmbuf_mtod(m, struct ether_hdr *);
+	uint16_t ether_type = ntohs(eh->ether_type);
+
+	switch (ether_type) {
+	case ETHER_TYPE_IPv4:
+	case ETHER_TYPE_IPv6:
+	case ETH_P_MPLS_UC:
+		return ecmp_mbuf_hash(m, ether_type);
+	default:
+		return rte_jhash(eh, 2 * ETHER_ADDR_LEN, 0);
+	}
+}
+
+/*
+ * Transmit a burst on an aggregate, directly on the members' queues.
+ * As for rte_eth_tx_burst(), returns the number sent, and those not
+ * sent are left at the end of tx_pkts.
+ */
+static uint16_t lag_tx_members(const struct lag_tx_table *tbl,
+			       uint16_t queue_id,
+			       struct rte_mbuf **tx_pkts, uint16_t nb_pkts)
+{
+	struct rte_mbuf *bufs[nb_pkts], *unsent[nb_pkts];
+	uint8_t sel[nb_pkts];
+	uint16_t i, n, sent, nunsent = 0;
+	unsigned int m;
+
+	for (i = 0; i < nb_pkts; i++)
+		sel[i] = tbl->slot[lag_tx_hash(tx_pkts[i]) % LAG_TX_SLOTS];
+
+	for (m = 0; m < tbl->nmembers; m++) {
+		n = 0;
+		for (i = 0; i < nb_pkts; i++)
+			if (sel[i] == m)
+				bufs[n++] = tx_pkts[i];
+		if (n == 0)
+			continue;
+
+		sent = rte_eth_tx_burst(tbl->member[m], queue_id, bufs, n);
+		while (sent < n)
+			unsent[nunsent++] = bufs[sent++];
+	}
+
+	if (nunsent)
+		memcpy(&tx_pkts[nb_pkts - nunsent], unsent,
+		       nunsent * sizeof(unsent[0]));
+	return nb_pkts - nunsent;
+}
+
+uint16_t lag_tx_burst(struct ifnet *ifp, uint16_t queue_id,
+		      struct rte_mbuf **tx_pkts, uint16_t nb_pkts)
+{
+	const struct lag_tx_table *tbl = rcu_dereference(
+		lag_tx_tbl[ifp->if_port]);
+
+	if (!tbl || nb_pkts == 0)
+		goto bond;
+
+	/* Let the bond PMD send any queued LACPDUs, along with this burst */
+	if (unlikely(rte_atomic16_read(&lag_slow_pending[ifp->if_port]))) {
+		rte_atomic16_clear(&lag_slow_pending[ifp->if_port]);
+		goto bond;
+	}
+
+	return lag_tx_members(tbl, queue_id, tx_pkts, nb_pkts);
+
+bond:
+	return rte_eth_tx_burst(ifp->if_port, queue_id, tx_pkts, nb_pkts);
+}
+
+static void lag_tx_table_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct lag_tx_table, rcu));
+}
+
+/* Rebuild the transmit table after membership or mode changes */
+static void lag_tx_table_update(struct ifnet *master)
+{
+	struct lag_tx_table *old = lag_tx_tbl[master->if_port];
+	struct lag_tx_table *tbl = NULL;
+	uint8_t old_to_new[LAG_TX_MAX_MEMBERS];
+	unsigned int want[LAG_TX_MAX_MEMBERS], have[LAG_TX_MAX_MEMBERS];
+	portid_t slaves[LAG_MAX_SLAVES];
+	unsigned int i, m, n = 0;
+	int count;
+
+	if (rte_eth_bond_mode_get(master->if_port) != BONDING_MODE_8023AD)
+		goto publish;
+
+	count = rte_eth_bond_slaves_get(master->if_port, slaves,
+					LAG_MAX_SLAVES);
+	if (count <= 0)
+		goto publish;
+
+	tbl = zmalloc_aligned(sizeof(*tbl));
+	if (!tbl)
+		goto publish;
+
+	for (i = 0; i < (unsigned int)count; i++) {
+		struct rte_eth_bond_8023ad_slave_info info;
+
+		if (rte_eth_bond_8023ad_slave_info(master->if_port, slaves[i],
+						   &info) < 0 ||
+		    !(info.actor_state & STATE_DISTRIBUTING))
+			continue;
+
+		/* Too many to index, leave it to the bond PMD */
+		if (n == LAG_TX_MAX_MEMBERS)
+			goto no_table;
+		tbl->member[n++] = slaves[i];
+	}
+	if (n == 0)
+		goto no_table;
+	tbl->nmembers = n;
+
+	for (m = 0; m < n; m++) {
+		want[m] = LAG_TX_SLOTS / n + (m < LAG_TX_SLOTS % n);
+		have[m] = 0;
+	}
+
+	/* Keep the slots of members still distributing, up to a share */
+	if (old) {
+		for (i = 0; i < old->nmembers; i++) {
+			old_to_new[i] = UINT8_MAX;
+			for (m = 0; m < n; m++)
+				if (tbl->member[m] == old->member[i])
+					old_to_new[i] = m;
+		}
+	}
+	for (i = 0; i < LAG_TX_SLOTS; i++) {
+		tbl->slot[i] = UINT8_MAX;
+		if (!old)
+			continue;
+
+		m = old_to_new[old->slot[i]];
+		if (m != UINT8_MAX && have[m] < want[m]) {
+			tbl->slot[i] = m;
+			have[m]++;
+		}
+	}
+
+	/* and share out the rest */
+	m = 0;
+	for (i = 0; i < LAG_TX_SLOTS; i++) {
+		if (tbl->slot[i] != UINT8_MAX)
+			continue;
+		while (have[m] >= want[m])
+			m++;
+		tbl->slot[i] = m;
+		have[m]++;
+	}
+	goto publish;
+
+no_table:
+	free(tbl);
+	tbl = NULL;
+publish:
+	rcu_assign_pointer(lag_tx_tbl[master->if_port], tbl);
+	if (old)
+		call_rcu(&old->rcu, lag_tx_table_free);
 }
 
 /*
@@ -257,6 +452,7 @@ static int slave_add(struct ifnet *master, struct ifnet *ifp)
 	rte_smp_mb();
 
 	rcu_assign_pointer(ifp->aggregator, master);
+	lag_tx_table_update(master);
 
 	return 0;
 }
@@ -285,6 +481,7 @@ static int slave_remove(struct ifnet *master, struct ifnet *ifp)
 
 	/* clear RCU protected aggregator pointer */
 	ifp->aggregator = NULL;
+	lag_tx_table_update(master);
 
 	/*
 	 * Force the port to be stopped since it will have been
@@ -352,6 +549,7 @@ int lag_mode_set_balance(struct ifnet *ifp)
 
 
 	rte_eth_bond_xmit_policy_set(ifp->if_port, BALANCE_XMIT_POLICY_LAYER34);
+	lag_tx_table_update(ifp);
 
 	return 0;
 }
@@ -372,6 +570,7 @@ int lag_mode_set_activebackup(struct ifnet *ifp)
 	if (dev_started)
 		rte_eth_dev_start(ifp->if_port);
 
+	lag_tx_table_update(ifp);
 	return rv;
 }
 
@@ -402,9 +601,11 @@ int lag_select(struct ifnet *ifp, int sel)
 					    ifp->if_port,
 					    enabled[ifp->if_port])) {
 		DP_DEBUG(LAG, ERR, DATAPLANE, "cannot set distributing flag\n");
+		lag_tx_table_update(ifp->aggregator);
 		return -1;
 	}
 
+	lag_tx_table_update(ifp->aggregator);
 	return 0;
 }
 
@@ -603,6 +804,8 @@ static void show_lag_detail(struct ifnet *node, void *arg)
 		policy < (int)ARRAY_SIZE(policy_names))
 		policy_str = policy_names[policy];
 	jsonw_string_field(wr, "hash", policy_str);
+	jsonw_bool_field(wr, "dataplane-hash",
+			 rcu_dereference(lag_tx_tbl[node->if_port]) != NULL);
 
 	num_active = rte_eth_bond_active_slaves_get(node->if_port,
 						active,
@@ -9,6 +9,7 @@
 
 #include <linux/rtnetlink.h>
 #include <rte_config.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include "if_var.h"
@@ -21,6 +22,8 @@ struct rte_mbuf;
 struct ifnet *ifnet_byteam(int ifindex);
 int lag_etype_slow_tx(struct ifnet *master, struct ifnet *ifp,
 		struct rte_mbuf *lacp_pkt);
+uint16_t lag_tx_burst(struct ifnet *ifp, uint16_t queue_id,
+		      struct rte_mbuf **tx_pkts, uint16_t nb_pkts);
 struct ifnet *lag_create(const struct ifinfomsg *ifi, struct nlattr *tb[]);
 int lag_slave_add(struct ifnet *master, struct ifnet *ifp);
 int lag_slave_delete(struct ifnet *master, struct ifnet *ifp);
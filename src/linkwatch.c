@@ -22,6 +22,7 @@
 #include <rte_log.h>
 #include <rte_timer.h>
 #include <rte_version.h>
+#include <rte_vhost.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -32,6 +33,7 @@
 #include "compiler.h"
 #include "config.h"
 #include "control.h"
+#include "ctrl_rxq.h"
 #include "dpdk_eth_if.h"
 #include "dp_event.h"
 #include "event.h"
@@ -40,6 +42,7 @@
 #include "lag.h"
 #include "main.h"
 #include "qos.h"
+#include "tun_offload.h"
 #include "urcu.h"
 #include "vhost.h"
 #include "vplane_debug.h"
@@ -303,10 +306,25 @@ static void reset_port(struct rte_timer *tim, void *arg)
 #endif
 }
 
+/*
+ * The guest's memory may be on another node than the one the vhost
+ * port was created on; copying across nodes halves the throughput.
+ */
+static void vhost_port_numa_update(portid_t port)
+{
+	int vid = rte_eth_vhost_get_vid_from_port_id(port);
+
+	if (vid < 0)
+		return;
+
+	set_port_socket(port, rte_vhost_get_numa_node(vid));
+}
+
 static void update_queue_state(struct ifnet *ifp)
 {
 	unassign_queues(ifp->if_port);
 
+	vhost_port_numa_update(ifp->if_port);
 	set_port_queue_state(ifp->if_port);
 
 	if (bitmask_isset(&started_port_mask, ifp->if_port))
@@ -317,7 +335,8 @@ static void update_queue_state(struct ifnet *ifp)
  * Runs on master thread (via get_next_event)
  *
  * irq_mask is used to debounce events so that only one link
- * state change between timer interval is possible
+ * state change between timer interval is possible, other than a
+ * link going down which is always reported at once
  *
  * For ports that use the queue state events, the queue state was read when
  * the callback was received, so now we need to bring the state into line
@@ -416,6 +435,8 @@ void start_port(portid_t port, unsigned int flags)
 		}
 
 		sc->scd_need_reset = false;
+		ctrl_rxq_start(port);
+		tun_offload_start(port);
 	}
 
 	soft_start_port(port);
@@ -451,6 +472,8 @@ void stop_port(portid_t port)
 		unassign_queues(ifp->aggregator->if_port);
 	}
 
+	tun_offload_stop(port);
+	ctrl_rxq_stop(port);
 	rte_eth_dev_stop(port);
 
 	unassign_queues(port);
@@ -506,18 +529,28 @@ eth_port_event(portid_t port_id, enum rte_eth_event_type type, void *arg,
 
 	/* Notify master thread, and debounce */
 	if (type == RTE_ETH_EVENT_INTR_LSC) {
+		struct rte_eth_link link;
+
+		rte_eth_link_get_nowait(port_id, &link);
+
 		/*
 		 * If the port uses the queue state events, and it is down
 		 * then we have to clear the enabled queues otherwise we
 		 * can get into an inconsistent state.
 		 */
-		if (get_port_uses_queue_state(port_id)) {
-			struct rte_eth_link link;
+		if (get_port_uses_queue_state(port_id) &&
+		    link.link_status == ETH_LINK_DOWN)
+			reset_port_enabled_queue_state(port_id);
+
+		/*
+		 * Loss of link is passed on straight away, even when
+		 * debouncing, so that nexthops over the port are failed
+		 * over without waiting for the next poll. Only the link
+		 * coming back waits, to ride out a flapping port.
+		 */
+		if (link.link_status == ETH_LINK_DOWN && if_port_isup(port_id))
+			bitmask_set(&lsc_irq_mask, port_id);
 
-			rte_eth_link_get_nowait(port_id, &link);
-			if (link.link_status == ETH_LINK_DOWN)
-				reset_port_enabled_queue_state(port_id);
-		}
 		if (bitmask_isset(&lsc_irq_mask, port_id)) {
 			bitmask_clear(&lsc_irq_mask, port_id);
 			bitmask_set(&lsc_irq_pending, port_id);
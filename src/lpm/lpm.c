@@ -46,6 +46,7 @@
 #include <rte_errno.h>
 #include <rte_jhash.h>
 #include <rte_log.h>
+#include <rte_prefetch.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -53,6 +54,7 @@
 #include <urcu/arch.h>
 
 #include "compiler.h"
+#include "dp_mem.h"
 #include "pd_show.h"
 #include "lpm.h"
 #include "util.h"
@@ -87,6 +89,7 @@ struct lpm {
 	/* LPM Tables. */
 	uint32_t tbl8_num_groups;		/* Number of slots */
 	uint32_t tbl8_rover;			/* Next slot to check */
+	uint32_t tbl8_used;			/* Slots in use */
 
 	struct lpm_tbl8_entry *tbl8;	/* Actual table */
 	struct lpm_tbl8_entry tbldflt; /* depth == 0 */
@@ -207,7 +210,7 @@ lpm_create(uint32_t id)
 	RTE_BUILD_BUG_ON(sizeof(struct lpm_tbl8_entry) != 4);
 
 	/* Allocate memory to store the LPM data structures. */
-	lpm = malloc_huge_aligned(sizeof(*lpm));
+	lpm = dp_mem_huge_alloc(DP_MEM_LPM, sizeof(*lpm));
 	if (lpm == NULL) {
 		RTE_LOG(ERR, LPM, "LPM memory allocation failed\n");
 		goto exit;
@@ -223,11 +226,12 @@ lpm_create(uint32_t id)
 	/* Vyatta change to dynamically grow tbl8 */
 	lpm->tbl8_num_groups = LPM_TBL8_INIT_GROUPS;
 	lpm->tbl8_rover = LPM_TBL8_INIT_GROUPS - 1;
-	lpm->tbl8 = malloc_huge_aligned(LPM_TBL8_INIT_ENTRIES *
-					sizeof(struct lpm_tbl8_entry));
+	lpm->tbl8 = dp_mem_huge_alloc(DP_MEM_LPM,
+				      LPM_TBL8_INIT_ENTRIES *
+				      sizeof(struct lpm_tbl8_entry));
 
 	if (lpm->tbl8 == NULL) {
-		free_huge(lpm, sizeof(*lpm));
+		dp_mem_huge_free(DP_MEM_LPM, lpm, sizeof(*lpm));
 		RTE_LOG(ERR, LPM, "LPM tbl8 group allocation failed\n");
 		lpm = NULL;
 		goto exit;
@@ -255,10 +259,11 @@ lpm_free(struct lpm *lpm)
 		return;
 
 	assert(lpm->no_route_rule.tracker_count == 0);
-	free_huge(lpm->tbl8, (lpm->tbl8_num_groups *
-			      LPM_TBL8_GROUP_NUM_ENTRIES *
-			      sizeof(struct lpm_tbl8_entry)));
-	free_huge(lpm, sizeof(*lpm));
+	dp_mem_huge_free(DP_MEM_LPM, lpm->tbl8,
+			 (lpm->tbl8_num_groups *
+			  LPM_TBL8_GROUP_NUM_ENTRIES *
+			  sizeof(struct lpm_tbl8_entry)));
+	dp_mem_huge_free(DP_MEM_LPM, lpm, sizeof(*lpm));
 }
 
 /*
@@ -390,9 +395,9 @@ tbl8_grow(struct lpm *lpm)
 
 	old_size = lpm->tbl8_num_groups;
 	new_size = old_size << 1;
-	new_tbl8 = malloc_huge_aligned(new_size *
-				       LPM_TBL8_GROUP_NUM_ENTRIES *
-				       sizeof(struct lpm_tbl8_entry));
+	new_tbl8 = dp_mem_huge_alloc(DP_MEM_LPM, new_size *
+				     LPM_TBL8_GROUP_NUM_ENTRIES *
+				     sizeof(struct lpm_tbl8_entry));
 
 	if (new_tbl8 == NULL) {
 		RTE_LOG(ERR, LPM, "LPM tbl8 group expand allocation failed\n");
@@ -404,9 +409,9 @@ tbl8_grow(struct lpm *lpm)
 		   * sizeof(struct lpm_tbl8_entry));
 
 	if (lpm->tbl8) {
-		if (defer_rcu_huge(lpm->tbl8, old_size *
-				   LPM_TBL8_GROUP_NUM_ENTRIES *
-				   sizeof(struct lpm_tbl8_entry))) {
+		if (dp_mem_huge_defer_free(DP_MEM_LPM, lpm->tbl8, old_size *
+					   LPM_TBL8_GROUP_NUM_ENTRIES *
+					   sizeof(struct lpm_tbl8_entry))) {
 			RTE_LOG(ERR, LPM, "Failed to free LPM tbl8 group\n");
 			return -1;
 		}
@@ -452,6 +457,7 @@ tbl8_alloc(struct lpm *lpm)
 	       LPM_TBL8_GROUP_NUM_ENTRIES * sizeof(tbl8_entry[0]));
 
 	tbl8_entry->valid_group = VALID;
+	lpm->tbl8_used++;
 
 	/* Remember last slot to start looking there */
 	lpm->tbl8_rover = tbl8_gindex;
@@ -465,6 +471,76 @@ tbl8_free(struct lpm *lpm, uint32_t tbl8_group_start)
 {
 	/* Set tbl8 group invalid*/
 	lpm->tbl8[tbl8_group_start].valid_group = INVALID;
+	lpm->tbl8_used--;
+}
+
+/*
+ * Dynamically decrease size of tbl8, once most of it is unused.
+ *
+ * The groups above the new size are first moved down into free slots,
+ * which is safe as only the tbl24 entry refers to a group.  Readers may
+ * still have the old index though, so must be done with it before the
+ * table can be cut.
+ */
+static void
+tbl8_shrink(struct lpm *lpm)
+{
+	struct lpm_tbl8_entry *new_tbl8, *old_tbl8 = lpm->tbl8;
+	uint32_t old_size = lpm->tbl8_num_groups;
+	uint32_t new_size, slot = 0;
+	struct lpm_rule *r;
+	uint8_t depth;
+
+	if (old_size <= LPM_TBL8_INIT_GROUPS ||
+	    lpm->tbl8_used >= old_size / 4)
+		return;
+
+	new_size = RTE_MAX(rte_align32pow2(lpm->tbl8_used * 2),
+			   (uint32_t)LPM_TBL8_INIT_GROUPS);
+	new_tbl8 = dp_mem_huge_alloc(DP_MEM_LPM, new_size *
+				     LPM_TBL8_GROUP_NUM_ENTRIES *
+				     sizeof(struct lpm_tbl8_entry));
+	if (new_tbl8 == NULL)
+		return;	/* keep the big one */
+
+	/* Only a /25 or longer needs a tbl8 */
+	for (depth = MAX_DEPTH_TBL24 + 1; depth < LPM_MAX_DEPTH; depth++) {
+		RB_FOREACH(r, lpm_rules_tree, &lpm->rules[depth]) {
+			uint32_t tbl24_index = r->ip >> 8;
+			struct lpm_tbl24_entry entry = lpm->tbl24[tbl24_index];
+			struct lpm_tbl8_entry *from;
+
+			if (!entry.valid || !entry.ext_entry ||
+			    entry.tbl8_gindex < new_size)
+				continue;
+
+			while (old_tbl8[slot * LPM_TBL8_GROUP_NUM_ENTRIES]
+			       .valid_group)
+				slot++;
+
+			from = old_tbl8 +
+				entry.tbl8_gindex * LPM_TBL8_GROUP_NUM_ENTRIES;
+			memcpy(old_tbl8 + slot * LPM_TBL8_GROUP_NUM_ENTRIES,
+			       from, LPM_TBL8_GROUP_NUM_ENTRIES *
+			       sizeof(struct lpm_tbl8_entry));
+			entry.tbl8_gindex = slot;
+			_CMM_STORE_SHARED(lpm->tbl24[tbl24_index], entry);
+			from->valid_group = INVALID;
+		}
+	}
+
+	synchronize_rcu();
+
+	memcpy(new_tbl8, old_tbl8, new_size * LPM_TBL8_GROUP_NUM_ENTRIES *
+	       sizeof(struct lpm_tbl8_entry));
+	rcu_assign_pointer(lpm->tbl8, new_tbl8);
+	lpm->tbl8_num_groups = new_size;
+	lpm->tbl8_rover = new_size - 1;
+
+	if (dp_mem_huge_defer_free(DP_MEM_LPM, old_tbl8, old_size *
+				   LPM_TBL8_GROUP_NUM_ENTRIES *
+				   sizeof(struct lpm_tbl8_entry)))
+		RTE_LOG(ERR, LPM, "Failed to free LPM tbl8 group\n");
 }
 
 static void
@@ -1210,6 +1286,7 @@ delete_depth_big(struct lpm *lpm, uint32_t ip_masked, uint8_t depth,
 	if (tbl8_recycle_index == -EINVAL) {
 		CMM_ACCESS_ONCE(lpm->tbl24[tbl24_index]).valid = INVALID;
 		tbl8_free(lpm, tbl8_group_start);
+		tbl8_shrink(lpm);
 	} else if (tbl8_recycle_index > -1) {
 		/* Update tbl24 entry. */
 		struct lpm_tbl24_entry new_tbl24_entry =
@@ -1226,6 +1303,7 @@ delete_depth_big(struct lpm *lpm, uint32_t ip_masked, uint8_t depth,
 		 */
 		_CMM_STORE_SHARED(lpm->tbl24[tbl24_index], new_tbl24_entry);
 		tbl8_free(lpm, tbl8_group_start);
+		tbl8_shrink(lpm);
 	}
 }
 
@@ -1370,6 +1448,7 @@ lpm_delete_all(struct lpm *lpm, lpm_walk_func_t func, void *arg)
 	       lpm->tbl8_num_groups * LPM_TBL8_GROUP_NUM_ENTRIES
 		   * sizeof(struct lpm_tbl8_entry));
 	lpm->tbl8_rover = lpm->tbl8_num_groups - 1;
+	lpm->tbl8_used = 0;
 
 	/* Delete all rules form the rules table. */
 	for (depth = 0; depth < LPM_MAX_DEPTH; ++depth) {
@@ -1384,6 +1463,7 @@ lpm_delete_all(struct lpm *lpm, lpm_walk_func_t func, void *arg)
 		}
 	}
 	del_default_route(lpm);
+	tbl8_shrink(lpm);
 }
 
 /*
@@ -1431,15 +1511,7 @@ lpm_walk(struct lpm *lpm, lpm_walk_func_t func,
 unsigned
 lpm_tbl8_count(const struct lpm *lpm)
 {
-	unsigned int i, count = 0;
-
-	for (i = 0; i < lpm->tbl8_num_groups; i++) {
-		const struct lpm_tbl8_entry *tbl8_entry
-			= lpm->tbl8 + i * LPM_TBL8_GROUP_NUM_ENTRIES;
-		if (tbl8_entry->valid_group)
-			++count;
-	}
-	return count;
+	return lpm->tbl8_used;
 }
 
 int
@@ -1515,6 +1587,76 @@ lpm_lookup(const struct lpm *lpm, uint32_t ip, uint32_t *next_hop)
 	return 0; /* Lookup hit. */
 }
 
+uint64_t
+lpm_lookup_bulk(const struct lpm *lpm, const uint32_t *ips,
+		uint32_t *next_hops, unsigned int n)
+{
+	struct lpm_tbl24_entry tbl24[LPM_LOOKUP_BULK_MAX];
+	uint32_t tbl8_idx[LPM_LOOKUP_BULK_MAX];
+	struct lpm_tbl8_entry tbl8;
+	uint64_t ext_mask = 0;
+	uint64_t hit_mask = 0;
+	uint32_t dflt_hop;
+	unsigned int i;
+
+	if (unlikely(n > LPM_LOOKUP_BULK_MAX))
+		n = LPM_LOOKUP_BULK_MAX;
+
+	/* Start all the tbl24 loads before waiting on any of them */
+	for (i = 0; i < n; i++)
+		rte_prefetch0(&lpm->tbl24[ips[i] >> 8]);
+
+	/*
+	 * Copy the tbl24 entries (to avoid concurrency issues),
+	 * resolving the non-extended ones and starting the tbl8 loads
+	 * for the extended ones.
+	 */
+	for (i = 0; i < n; i++) {
+		tbl24[i] = CMM_ACCESS_ONCE(lpm->tbl24[ips[i] >> 8]);
+
+		if (unlikely(!tbl24[i].valid))
+			continue;
+
+		if (tbl24[i].ext_entry == 0) {
+			next_hops[i] = lpm_tbl24_get_next_hop_idx(&tbl24[i]);
+			hit_mask |= 1ull << i;
+			continue;
+		}
+
+		tbl8_idx[i] = tbl24[i].tbl8_gindex *
+			LPM_TBL8_GROUP_NUM_ENTRIES + (ips[i] & 0xFF);
+		rte_prefetch0(&lpm->tbl8[tbl8_idx[i]]);
+		ext_mask |= 1ull << i;
+	}
+
+	while (ext_mask) {
+		i = __builtin_ctzll(ext_mask);
+		ext_mask &= ext_mask - 1;
+
+		tbl8 = CMM_ACCESS_ONCE(lpm->tbl8[tbl8_idx[i]]);
+		if (likely(tbl8.valid)) {
+			next_hops[i] = tbl8.next_hop;
+			hit_mask |= 1ull << i;
+		}
+	}
+
+	/* Anything not yet matched falls back to the default route */
+	if (unlikely(hit_mask != (n == LPM_LOOKUP_BULK_MAX ?
+				  UINT64_MAX : (1ull << n) - 1))) {
+		if (lpm_lookup_default(lpm, &dflt_hop) != 0)
+			return hit_mask;
+
+		for (i = 0; i < n; i++) {
+			if (!(hit_mask & (1ull << i))) {
+				next_hops[i] = dflt_hop;
+				hit_mask |= 1ull << i;
+			}
+		}
+	}
+
+	return hit_mask;
+}
+
 /*
  * Do a subtree walk of the given rule.
  *
@@ -1566,3 +1708,11 @@ lpm_rule_count(const struct lpm *lpm)
 {
 	return lpm->rule_count;
 }
+
+void
+lpm_memory(const struct lpm *lpm, size_t *tables, size_t *rules)
+{
+	*tables = sizeof(*lpm) + (size_t)lpm->tbl8_num_groups *
+		LPM_TBL8_GROUP_NUM_ENTRIES * sizeof(struct lpm_tbl8_entry);
+	*rules = (size_t)lpm->rule_count * sizeof(struct lpm_rule);
+}
@@ -281,6 +281,31 @@ lpm_delete_all(struct lpm *lpm, lpm_walk_func_t func, void *arg);
 int
 lpm_lookup(const struct lpm *lpm, uint32_t ip, uint32_t *next_hop);
 
+/* Maximum number of IPs that can be looked up in one bulk lookup */
+#define LPM_LOOKUP_BULK_MAX 64
+
+/**
+ * Lookup multiple IPs into the LPM table.
+ *
+ * The tbl24 entries of all the IPs are fetched before any tbl8 entry
+ * is so that the cache misses of the individual lookups overlap.
+ *
+ * @param lpm
+ *   LPM object handle
+ * @param ips
+ *   Array of IPs to be looked up in the LPM table
+ * @param next_hops
+ *   Next hop of the most specific rule found for each IP (valid on
+ *   lookup hit only)
+ * @param n
+ *   Number of IPs to look up, at most LPM_LOOKUP_BULK_MAX
+ * @return
+ *   Mask with bit i set if ips[i] was a lookup hit
+ */
+uint64_t
+lpm_lookup_bulk(const struct lpm *lpm, const uint32_t *ips,
+		uint32_t *next_hops, unsigned int n);
+
 /**
  * Lookup an IP in the LPM table and return exact match
  *
@@ -349,6 +374,19 @@ lpm_is_empty(const struct lpm *lpm);
 unsigned int
 lpm_rule_count(const struct lpm *lpm);
 
+/**
+ * Return the memory used by the LPM, in bytes.
+ *
+ * @param lpm
+ *   LPM object handle
+ * @param tables
+ *   Set to the size of the lookup tables, which are in hugepages
+ * @param rules
+ *   Set to the size of the rules
+ */
+void
+lpm_memory(const struct lpm *lpm, size_t *tables, size_t *rules);
+
 /*
  * Do a subtree walk of the given rule and call the given callback function
  * for each entry found.
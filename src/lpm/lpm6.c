@@ -53,6 +53,7 @@
 #include <urcu/uatomic.h>
 
 #include "compiler.h"
+#include "dp_mem.h"
 #include "lpm6.h"
 #include "rt_tracker.h"
 #include "urcu.h"
@@ -204,7 +205,7 @@ lpm6_create(uint32_t tableid)
 	RTE_BUILD_BUG_ON(sizeof(struct lpm6_tbl_entry) != sizeof(uint32_t));
 
 	/* Allocate memory to store the LPM data structures. */
-	lpm = malloc_huge_aligned(sizeof(*lpm));
+	lpm = dp_mem_huge_alloc(DP_MEM_LPM6, sizeof(*lpm));
 
 	if (lpm == NULL) {
 		RTE_LOG(ERR, LPM, "LPM memory allocation failed\n");
@@ -218,12 +219,13 @@ lpm6_create(uint32_t tableid)
 	lpm->id = tableid;
 	lpm->number_tbl8s = LPM6_TBL8_INIT_GROUPS;
 	lpm->next_tbl8 = LPM6_TBL8_INIT_GROUPS - 1;
-	lpm->tbl8 = malloc_huge_aligned(LPM6_TBL8_INIT_ENTRIES *
-					sizeof(struct lpm6_tbl_entry));
+	lpm->tbl8 = dp_mem_huge_alloc(DP_MEM_LPM6,
+				      LPM6_TBL8_INIT_ENTRIES *
+				      sizeof(struct lpm6_tbl_entry));
 
 	if (lpm->tbl8 == NULL) {
 		RTE_LOG(ERR, LPM, "LPM tbl8 group allocation failed\n");
-		free_huge(lpm, sizeof(*lpm));
+		dp_mem_huge_free(DP_MEM_LPM6, lpm, sizeof(*lpm));
 		lpm = NULL;
 		goto exit;
 	}
@@ -250,10 +252,11 @@ lpm6_free(struct lpm6 *lpm)
 	if (lpm == NULL)
 		return;
 
-	free_huge(lpm->tbl8, (lpm->number_tbl8s *
-			      LPM6_TBL8_GROUP_NUM_ENTRIES *
-			      sizeof(struct lpm6_tbl_entry)));
-	free_huge(lpm, sizeof(*lpm));
+	dp_mem_huge_free(DP_MEM_LPM6, lpm->tbl8,
+			 (lpm->number_tbl8s *
+			  LPM6_TBL8_GROUP_NUM_ENTRIES *
+			  sizeof(struct lpm6_tbl_entry)));
+	dp_mem_huge_free(DP_MEM_LPM6, lpm, sizeof(*lpm));
 }
 
 /*
@@ -400,9 +403,9 @@ tbl8_grow(struct lpm6 *lpm)
 
 	old_size = lpm->number_tbl8s;
 	new_size = old_size << 1;
-	new_tbl8 = malloc_huge_aligned(new_size *
-				       LPM6_TBL8_GROUP_NUM_ENTRIES *
-				       sizeof(struct lpm6_tbl_entry));
+	new_tbl8 = dp_mem_huge_alloc(DP_MEM_LPM6, new_size *
+				     LPM6_TBL8_GROUP_NUM_ENTRIES *
+				     sizeof(struct lpm6_tbl_entry));
 
 	if (new_tbl8 == NULL) {
 		RTE_LOG(ERR, LPM, "LPM6 tbl8 group expand allocation failed\n");
@@ -413,9 +416,9 @@ tbl8_grow(struct lpm6 *lpm)
 	       old_size * LPM6_TBL8_GROUP_NUM_ENTRIES *
 	       sizeof(struct lpm6_tbl_entry));
 
-	if (defer_rcu_huge(lpm->tbl8, old_size *
-			   LPM6_TBL8_GROUP_NUM_ENTRIES *
-			   sizeof(struct lpm6_tbl_entry))) {
+	if (dp_mem_huge_defer_free(DP_MEM_LPM6, lpm->tbl8, old_size *
+				   LPM6_TBL8_GROUP_NUM_ENTRIES *
+				   sizeof(struct lpm6_tbl_entry))) {
 		RTE_LOG(ERR, LPM, "Failed to free v6 LPM tbl8 group\n");
 		return -1;
 	}
@@ -851,6 +854,72 @@ lpm6_lookup(const struct lpm6 *lpm, const uint8_t *ip,
 	return status;
 }
 
+/*
+ * Looks up a vector of IPs, walking the levels in lockstep so that
+ * the fetch of the next level of every lookup is in flight at once.
+ */
+uint64_t
+lpm6_lookup_bulk(const struct lpm6 *lpm, const uint8_t * const *ips,
+		 uint32_t *next_hops, unsigned int n)
+{
+	const struct lpm6_tbl_entry *tbl[LPM6_LOOKUP_BULK_MAX];
+	uint64_t active_mask = 0;
+	uint64_t hit_mask = 0;
+	uint64_t mask;
+	uint8_t first_byte = LOOKUP_FIRST_BYTE;
+	uint32_t dflt_hop;
+	uint32_t tbl24_index;
+	unsigned int i;
+	int status;
+
+	if (unlikely(n > LPM6_LOOKUP_BULK_MAX))
+		n = LPM6_LOOKUP_BULK_MAX;
+
+	for (i = 0; i < n; i++) {
+		tbl24_index = (ips[i][0] << BYTES2_SIZE) |
+			(ips[i][1] << BYTE_SIZE) | ips[i][2];
+		tbl[i] = &lpm->tbl24[tbl24_index];
+		rte_prefetch0(tbl[i]);
+		active_mask |= 1ull << i;
+	}
+
+	while (active_mask) {
+		mask = active_mask;
+		while (mask) {
+			i = __builtin_ctzll(mask);
+			mask &= mask - 1;
+
+			status = lookup_step(lpm, tbl[i], &tbl[i], ips[i],
+					     first_byte, &next_hops[i]);
+			if (status == 1) {
+				rte_prefetch0(tbl[i]);
+				continue;
+			}
+
+			active_mask &= ~(1ull << i);
+			if (status == 0)
+				hit_mask |= 1ull << i;
+		}
+		first_byte++;
+	}
+
+	/* If a more specific route was not found check for a default route. */
+	if (unlikely(hit_mask != (n == LPM6_LOOKUP_BULK_MAX ?
+				  UINT64_MAX : (1ull << n) - 1))) {
+		if (lookup_tbldflt(&lpm->tbldflt, &dflt_hop) != 0)
+			return hit_mask;
+
+		for (i = 0; i < n; i++) {
+			if (!(hit_mask & (1ull << i))) {
+				next_hops[i] = dflt_hop;
+				hit_mask |= 1ull << i;
+			}
+		}
+	}
+
+	return hit_mask;
+}
+
 /*
  * Looks up an next-hop
  */
@@ -216,6 +216,31 @@ int
 lpm6_lookup(const struct lpm6 *lpm, const uint8_t *ip,
 		uint32_t *next_hop);
 
+/* Maximum number of IPs that can be looked up in one bulk lookup */
+#define LPM6_LOOKUP_BULK_MAX 64
+
+/**
+ * Lookup multiple IPs into the LPM table.
+ *
+ * The lookups are stepped through the table levels together so that
+ * their cache misses overlap.
+ *
+ * @param lpm
+ *   LPM object handle
+ * @param ips
+ *   Array of pointers to the IPs to be looked up in the LPM table
+ * @param next_hops
+ *   Next hop of the most specific rule found for each IP (valid on
+ *   lookup hit only)
+ * @param n
+ *   Number of IPs to look up, at most LPM6_LOOKUP_BULK_MAX
+ * @return
+ *   Mask with bit i set if ips[i] was a lookup hit
+ */
+uint64_t
+lpm6_lookup_bulk(const struct lpm6 *lpm, const uint8_t * const *ips,
+		 uint32_t *next_hops, unsigned int n);
+
 /**
  * Iterate over all rules in the LPM table.
  **/
@@ -45,9 +45,21 @@ struct mvl_entry {
 	struct rcu_head		mvl_rcu;    /* for deletion via rcu */
 	struct ifnet		*ifp;
 	int			mode;
+	uint64_t		mvl_key;    /* MAC, as a fast table key */
 };
 
+/*
+ * The first few macvlans on a port are also in a small fixed table, so
+ * that demuxing a packet is a scan of one cache line of keys rather than
+ * a hash lookup.  Only if there are more macvlans than fit does a miss go
+ * on to the hash table.  A key of 0 is an empty slot.
+ */
+#define MACVLAN_FAST_SLOTS 8
+
 struct mvl_tbl {
+	uint64_t	    mvlt_fast_key[MACVLAN_FAST_SLOTS];
+	struct mvl_entry    *mvlt_fast[MACVLAN_FAST_SLOTS];
+	uint32_t	    mvlt_nslow;     /* entries only in the hash */
 	struct cds_lfht	    *mvlt_hash;	    /* hash table linkage */
 	struct ifnet	    *parent_ifp;
 	struct rcu_head	    rcu;
@@ -80,22 +92,56 @@ macvlan_match(struct cds_lfht_node *node, const void *key)
 	return ether_addr_equal(&mvle->ifp->eth_addr, key);
 }
 
+static inline uint64_t
+macvlan_key(const struct ether_addr *addr)
+{
+	uint64_t key = 0;
+
+	memcpy(&key, addr, ETHER_ADDR_LEN);
+	return key;
+}
+
+static struct mvl_entry *
+macvlan_fast_lookup(struct mvl_tbl *mvlt, uint64_t key)
+{
+	struct mvl_entry *mvle;
+	unsigned int i;
+
+	for (i = 0; i < MACVLAN_FAST_SLOTS; i++) {
+		if (CMM_LOAD_SHARED(mvlt->mvlt_fast_key[i]) != key)
+			continue;
+
+		/* Slot may have been reused since the key was read */
+		mvle = rcu_dereference(mvlt->mvlt_fast[i]);
+		if (mvle && mvle->mvl_key == key)
+			return mvle;
+	}
+	return NULL;
+}
+
 static struct ifnet *
 macvlan_lookup(struct mvl_tbl *mvlt, const struct ether_addr *addr,
 	       bool return_parent_if)
 {
-	/* lookup macvlan in hash by dest macaddr */
-	struct cds_lfht_iter iter;
+	struct mvl_entry *mvle;
+
+	mvle = macvlan_fast_lookup(mvlt, macvlan_key(addr));
+	if (!mvle && CMM_LOAD_SHARED(mvlt->mvlt_nslow) != 0) {
+		/* lookup macvlan in hash by dest macaddr */
+		struct cds_lfht_iter iter;
+		struct cds_lfht_node *node;
 
-	cds_lfht_lookup(mvlt->mvlt_hash,
-			macvlan_hash(addr),
-			macvlan_match, addr, &iter);
+		cds_lfht_lookup(mvlt->mvlt_hash,
+				macvlan_hash(addr),
+				macvlan_match, addr, &iter);
 
-	struct cds_lfht_node *node = cds_lfht_iter_get_node(&iter);
-	if (node) {
-		struct mvl_entry *mvle
-			= caa_container_of(node, struct mvl_entry, mvl_node);
+		node = cds_lfht_iter_get_node(&iter);
+		if (node)
+			mvle = caa_container_of(node, struct mvl_entry,
+						mvl_node);
+	}
 
+	if (mvle) {
 		if (mvle->mode == MACVLAN_MODE_VRRP && return_parent_if)
 			return mvle->ifp->if_parent;
 
@@ -105,6 +151,57 @@ macvlan_lookup(struct mvl_tbl *mvlt, const struct ether_addr *addr,
 	return NULL;
 }
 
+/* Put entry in a free fast table slot, if there is one */
+static bool
+macvlan_fast_add(struct mvl_tbl *mvlt, struct mvl_entry *mvle)
+{
+	unsigned int i;
+
+	for (i = 0; i < MACVLAN_FAST_SLOTS; i++) {
+		if (mvlt->mvlt_fast[i])
+			continue;
+
+		rcu_assign_pointer(mvlt->mvlt_fast[i], mvle);
+		CMM_STORE_SHARED(mvlt->mvlt_fast_key[i], mvle->mvl_key);
+		return true;
+	}
+	return false;
+}
+
+static bool
+macvlan_fast_del(struct mvl_tbl *mvlt, struct mvl_entry *mvle)
+{
+	unsigned int i;
+
+	for (i = 0; i < MACVLAN_FAST_SLOTS; i++) {
+		if (mvlt->mvlt_fast[i] != mvle)
+			continue;
+
+		CMM_STORE_SHARED(mvlt->mvlt_fast_key[i], 0);
+		rcu_assign_pointer(mvlt->mvlt_fast[i], NULL);
+		return true;
+	}
+	return false;
+}
+
+/* Move an entry that is only in the hash into the fast table */
+static void
+macvlan_fast_refill(struct mvl_tbl *mvlt)
+{
+	struct mvl_entry *mvle;
+	struct cds_lfht_iter iter;
+
+	cds_lfht_for_each_entry(mvlt->mvlt_hash, &iter, mvle, mvl_node) {
+		if (macvlan_fast_lookup(mvlt, mvle->mvl_key))
+			continue;
+
+		if (macvlan_fast_add(mvlt, mvle))
+			CMM_STORE_SHARED(mvlt->mvlt_nslow,
+					 mvlt->mvlt_nslow - 1);
+		return;
+	}
+}
+
 static void
 macvlan_add_mac(struct ifnet *ifp, struct ether_addr *eth_addr)
 {
@@ -130,9 +227,15 @@ macvlan_entry_insert(struct mvl_tbl *mvlt, struct mvl_entry *mvle)
 		mvle->ifp->if_parent->if_name);
 	unsigned long hash =
 	      macvlan_hash(&mvle->ifp->eth_addr);
+	mvle->mvl_key = macvlan_key(&mvle->ifp->eth_addr);
 	ret_node = cds_lfht_add_unique(mvlt->mvlt_hash, hash,
 			macvlan_match, &mvle->ifp->eth_addr, &mvle->mvl_node);
-	return (ret_node != &mvle->mvl_node) ? EEXIST : 0;
+	if (ret_node != &mvle->mvl_node)
+		return EEXIST;
+
+	if (!macvlan_fast_add(mvlt, mvle))
+		CMM_STORE_SHARED(mvlt->mvlt_nslow, mvlt->mvlt_nslow + 1);
+	return 0;
 }
 
 static void
@@ -145,6 +248,10 @@ static void
 macvlan_entry_destroy(struct mvl_tbl *mvlt, struct mvl_entry *mvle)
 {
 	cds_lfht_del(mvlt->mvlt_hash, &mvle->mvl_node);
+	if (!macvlan_fast_del(mvlt, mvle))
+		CMM_STORE_SHARED(mvlt->mvlt_nslow, mvlt->mvlt_nslow - 1);
+	else if (mvlt->mvlt_nslow)
+		macvlan_fast_refill(mvlt);
 	call_rcu(&mvle->mvl_rcu, macvlan_entry_free);
 }
 
@@ -270,7 +377,7 @@ macvlan_table_init(struct ifnet *ifp)
 {
 	struct mvl_tbl *mvlt;
 
-	mvlt = malloc_aligned(sizeof(struct mvl_tbl));
+	mvlt = zmalloc_aligned(sizeof(struct mvl_tbl));
 	if (!mvlt)
 		rte_panic("Can't allocate mvl_tbl\n");
 
@@ -68,11 +68,13 @@
 #include <rte_branch_prediction.h>
 #include <rte_common.h>
 #include <rte_config.h>
+#include <rte_cycles.h>
 #include <rte_debug.h>
 #include <rte_eal.h>
 #include <rte_errno.h>
 #include <rte_ethdev.h>
 #include <rte_ether.h>
+#include <rte_interrupts.h>
 #include <rte_launch.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
@@ -102,6 +104,8 @@
 #include "ether.h"
 #include "event.h"
 #include "fal.h"
+#include "flow_export.h"
+#include "fwd_latency.h"
 #include "gre.h"
 #include "if_llatbl.h"
 #include "if_var.h"
@@ -117,8 +121,10 @@
 #include "master.h"
 #include "mpls/mpls_label_table.h"
 #include "netinet6/ip6_funcs.h"
+#include "npf/alg/npf_alg_worker.h"
 #include "npf/fragment/ipv4_rsmbl.h"
 #include "npf_shim.h"
+#include "pipeline/pl_fused.h"
 #include "pipeline/pl_internal.h"
 #include "pktmbuf.h"
 #include "portmonitor/portmonitor.h"
@@ -127,6 +133,8 @@
 #include "route.h"
 #include "session/session.h"
 #include "shadow.h"
+#include "stats_segment.h"
+#include "tun_offload.h"
 #include "udp_handler.h"
 #include "urcu.h"
 #include "util.h"
@@ -142,6 +150,8 @@
 #include "dpdk_eth_if.h"
 
 packet_input_t packet_input_func __hot_data = ether_input_no_dyn_feats;
+/* Set when the pipeline is run in vector mode */
+packet_burst_input_t packet_burst_input_func __hot_data;
 
 #define MBUF_OVERHEAD RTE_PKTMBUF_HEADROOM
 #define MIN_MBUF_POOL	4096			/* Minimum number of mbufs */
@@ -149,6 +159,12 @@ packet_input_t packet_input_func __hot_data = ether_input_no_dyn_feats;
 /* per-core cache size for global pools */
 #define NUMA_POOL_MBUF_CACHE_SIZE 256
 
+/*
+ * Most mbufs a per-core mempool cache can hold, as it is only flushed
+ * back to the pool once over 1.5 times its size.
+ */
+#define MBUF_CACHE_HELD(size)	((size) * 3 / 2)
+
 /* Configure how many packets ahead to prefetch, when reading packets */
 #define PREFETCH_OFFSET	3
 
@@ -167,10 +183,16 @@ static struct rxtx_param *driver_param;
 
 #define DEFAULT_FCPAUSE	0xffff	/* see ixgbe.h */
 
-#define RX_PKT_BURST  32
 #define QOS_PKT_BURST 64
 #define TX_PKT_BURST  32
 
+/*
+ * Number of ports each forwarding lcore can batch for at once, so
+ * that replicating a packet over several ports (e.g. multicast)
+ * does not flush the burst on every packet.
+ */
+#define TX_BURST_PORTS 4
+
 /* Number of packets queued between top and bottom half.
  * It has to be big enough that an initial burst of packets
  * can be processed by Tx thread which may be sleeping.
@@ -193,6 +215,7 @@ struct pkt_burst {
 
 RTE_DEFINE_PER_LCORE(unsigned int, _dp_lcore_id) = 0;
 static RTE_DEFINE_PER_LCORE(struct pkt_burst *, pkt_burst);
+static RTE_DEFINE_PER_LCORE(uint8_t, pkt_burst_victim);
 
 enum lcore_state {
 	LCORE_STATE_POLL,
@@ -215,11 +238,16 @@ struct lcore_conf {
 	uint16_t high_txq;    /* highest index assigned to tx_poll */
 	uint8_t tx_qid;	      /* my tx queue for multi-queue devices */
 	uint8_t do_crypto;    /* thread is tasked with doing crypto */
+	bool do_alg;          /* thread services the ALG worker ring */
 
 	/* receive queues this cpu should check for input */
 	struct lcore_rx_queue {
 		portid_t portid;
 		uint8_t queueid;
+		uint16_t burst;	/* adaptive rx burst size */
+		bool intr_armed;	/* in this lcore's rx epoll set */
+		portid_t intr_portid;
+		uint8_t intr_queueid;
 		struct pm_governor gov;
 		uint64_t packets;
 	} rx_poll[MAX_RX_QUEUE_PER_CORE];
@@ -229,6 +257,7 @@ struct lcore_conf {
 		portid_t portid;
 		uint8_t queueid;
 		uint8_t ringid;
+		uint8_t head;	      /* index of first pending packet */
 		uint8_t pending : 7;
 		/*
 		 * Call transmit function even if there are no packets
@@ -247,11 +276,28 @@ struct lcore_conf {
 		struct cds_list_head pmd_list;
 	} crypt;
 
+	struct lcore_alg {
+		struct pm_governor gov;
+		uint64_t packets;
+	} alg;
+
+	/* TSC cycles spent in each part of the forwarding loop */
+	struct lcore_cycles {
+		uint64_t rx;
+		uint64_t crypto;
+		uint64_t alg;
+		uint64_t tx;
+		uint64_t drain;
+		uint64_t idle;
+		uint64_t other;
+	} cycles;
+
 	/* Not touched in forwarding path so at end to avoid false sharing */
 	void *padding[0]   __rte_cache_aligned;
 	struct rate_stats rx_poll_stats[MAX_RX_QUEUE_PER_CORE];
 	struct rate_stats tx_poll_stats[MAX_TX_QUEUE_PER_CORE];
 	struct rate_stats crypt_stats;
+	struct rate_stats alg_stats;
 } __rte_cache_aligned;
 
 static struct lcore_conf *lcore_conf[RTE_MAX_LCORE];
@@ -269,10 +315,12 @@ static struct port_conf {
 	uint8_t		tx_queues;
 	uint8_t		nrings;
 	bool		percoreq;
+	bool		mt_txq;		/* tx queues are MT-safe */
+	bool		ctrl_rxq;	/* last rx queue is for control */
 	uint8_t		max_rings;
 	uint16_t	rx_desc;
 	uint16_t	tx_desc;
-	uint16_t	buffers;
+	uint32_t	buffers;
 	uint32_t	buf_size;
 	bitmask_t	rx_cpu_affinity;
 	bitmask_t	tx_cpu_affinity;
@@ -407,6 +455,9 @@ eth_tx_burst(struct ifnet *ifp, uint16_t queue_id,
 	     struct rte_mbuf **tx_pkts, uint16_t nb_pkts)
 {
 	eth_tx_run_post_qos_features(ifp, tx_pkts, nb_pkts);
+	fwd_lat_tx(ifp->if_port, tx_pkts, nb_pkts);
+	if (unlikely(ifp->if_team))
+		return lag_tx_burst(ifp, queue_id, tx_pkts, nb_pkts);
 	return rte_eth_tx_burst(ifp->if_port, queue_id, tx_pkts, nb_pkts);
 }
 
@@ -434,7 +485,8 @@ master_eth_tx(struct ifnet *ifp, struct rte_mbuf **tx_pkts, uint16_t nb_pkts)
 static inline
 bool __use_directpath(portid_t portid, bool qos_enabled)
 {
-	return CMM_ACCESS_ONCE(port_config[portid].percoreq) && !qos_enabled;
+	return (CMM_ACCESS_ONCE(port_config[portid].percoreq) ||
+		CMM_ACCESS_ONCE(port_config[portid].mt_txq)) && !qos_enabled;
 }
 
 static inline
@@ -449,24 +501,26 @@ static inline bool forwarding_lcore(const struct lcore_conf *conf)
 }
 
 static inline
-bool forwarding_or_crypto_engine_lcore(const struct lcore_conf *conf)
+bool forwarding_or_engine_lcore(const struct lcore_conf *conf)
 {
-	return conf->do_crypto || forwarding_lcore(conf);
+	return conf->do_crypto || conf->do_alg || forwarding_lcore(conf);
 }
 
 /* Free any packets left in the rings or bursts */
 void pkt_ring_empty(portid_t port)
 {
+	struct rte_mbuf *pkts[TX_PKT_BURST];
 	struct rte_ring *ring;
-	struct rte_mbuf *m;
-	unsigned int lcore;
+	unsigned int lcore, n;
 	uint8_t r;
 
 	for (r = 0; r < port_config[port].max_rings; r++) {
 		ring = port_config[port].pkt_ring[r];
 
-		while (rte_ring_sc_dequeue(ring, (void **)&m) == 0)
-			rte_pktmbuf_free(m);
+		while ((n = rte_ring_sc_dequeue_burst(ring, (void **)pkts,
+						      TX_PKT_BURST,
+						      NULL)) != 0)
+			pktmbuf_free_bulk(pkts, n);
 	}
 
 	FOREACH_FORWARD_LCORE(lcore) {
@@ -478,8 +532,10 @@ void pkt_ring_empty(portid_t port)
 
 			/* If port is down then flush pkts */
 			if (txq->portid == NO_OWNER && txq->pending) {
-				pktmbuf_free_bulk(txq->burst, txq->pending);
+				pktmbuf_free_bulk(txq->burst + txq->head,
+						  txq->pending);
 				txq->pending = 0;
+				txq->head = 0;
 			}
 		}
 	}
@@ -488,14 +544,17 @@ void pkt_ring_empty(portid_t port)
 static void pkt_burst_init(unsigned int lcore_id, uint16_t qid)
 {
 	struct pkt_burst *pb;
+	unsigned int i;
 
-	pb = rte_zmalloc_socket("pkt_burst", sizeof(struct pkt_burst),
+	pb = rte_zmalloc_socket("pkt_burst",
+				TX_BURST_PORTS * sizeof(struct pkt_burst),
 				RTE_CACHE_LINE_SIZE,
 				rte_lcore_to_socket_id(lcore_id));
 	if (pb == NULL)
 		rte_panic("no memory for lcore %u pkt_burst\n", lcore_id);
 
-	pb->queue = qid;
+	for (i = 0; i < TX_BURST_PORTS; i++)
+		pb[i].queue = qid;
 	RTE_PER_LCORE(pkt_burst) = pb;
 }
 
@@ -521,22 +580,62 @@ void pkt_burst_setup(void)
 	pkt_burst_init(lcore_id, lcore_conf[lcore_id]->tx_qid);
 }
 
+/* The tx ring of the QoS shard for a packet, or ring 0 */
+static inline uint8_t
+pkt_qos_ring(struct ifnet *ifp, const struct rte_mbuf *m)
+{
+	struct sched_info *qinfo = qos_handle(ifp);
+
+	return qinfo ? qos_dpdk_pkt_shard(qinfo, m) : 0;
+}
+
+/*
+ * The subports of a QoS port may be spread over several schedulers,
+ * each with its own ring. Queue each run of packets for the same one
+ * together, stopping at the first that does not fit.
+ */
+static uint16_t
+pkt_out_qos_burst(struct ifnet *ifp, uint16_t port,
+		  struct rte_mbuf **mbufs, uint16_t nb_pkts)
+{
+	uint16_t i, j, n;
+	uint8_t rid;
+
+	for (i = 0; i < nb_pkts; i = j) {
+		rid = pkt_qos_ring(ifp, mbufs[i]);
+		for (j = i + 1; j < nb_pkts; j++)
+			if (pkt_qos_ring(ifp, mbufs[j]) != rid)
+				break;
+
+		n = rte_ring_mp_enqueue_burst(port_config[port].pkt_ring[rid],
+					      (void **) &mbufs[i], j - i,
+					      NULL);
+		if (n < j - i)
+			return i + n;
+	}
+	return nb_pkts;
+}
+
 static ALWAYS_INLINE uint16_t
 pkt_out_burst_cmn(struct ifnet *ifp, bool qos_enabled, uint16_t port,
 		  uint16_t queue, struct rte_mbuf **mbufs, uint16_t nb_pkts)
 {
 	uint16_t n;
 
-	if (__use_directpath(port, qos_enabled))
+	if (__use_directpath(port, qos_enabled)) {
+		/*
+		 * Without a queue per core, the queues are MT-safe
+		 * and may be shared by the forwarding cores.
+		 */
+		if (!CMM_ACCESS_ONCE(port_config[port].percoreq))
+			queue %= CMM_ACCESS_ONCE(port_config[port].tx_queues);
 		n = eth_tx_burst(ifp, queue, mbufs, nb_pkts);
-	else {
+	} else if (qos_enabled) {
+		n = pkt_out_qos_burst(ifp, port, mbufs, nb_pkts);
+	} else {
 		uint8_t rid;
 
-		if (qos_enabled)
-			rid = 0;	/* always use ringid 0 for QoS */
-		else
-			rid = queue % CMM_ACCESS_ONCE(
-				port_config[port].nrings);
+		rid = queue % CMM_ACCESS_ONCE(port_config[port].nrings);
 
 		n = rte_ring_mp_enqueue_burst(
 					port_config[port].pkt_ring[rid],
@@ -596,17 +695,54 @@ static __hot_func void pkt_ring_drain(void)
 {
 	struct crypto_pkt_buffer *cpb = RTE_PER_LCORE(crypto_pkt_buffer);
 	struct pkt_burst *pb = RTE_PER_LCORE(pkt_burst);
+	unsigned int i;
 
-	if (pb->count > 0)
-		pkt_ring_burst(pb, true);
+	for (i = 0; i < TX_BURST_PORTS; i++)
+		if (pb[i].count > 0)
+			pkt_ring_burst(&pb[i], true);
 	crypto_send(cpb);
 }
 
+/*
+ * Find the burst buffer for a port. A port only ever has packets in
+ * one buffer, the first one naming it. When all the buffers hold
+ * packets for other ports, one of them is sent to make room.
+ */
+static ALWAYS_INLINE struct pkt_burst *
+pkt_burst_for_port(struct pkt_burst *pb, portid_t portid)
+{
+	unsigned int i;
+
+	if (likely(pb->port == portid))
+		return pb;
+
+	for (i = 1; i < TX_BURST_PORTS; i++)
+		if (pb[i].port == portid)
+			return &pb[i];
+
+	for (i = 0; i < TX_BURST_PORTS; i++)
+		if (pb[i].count == 0)
+			goto out;
+
+	i = RTE_PER_LCORE(pkt_burst_victim)++ % TX_BURST_PORTS;
+	pkt_ring_burst(&pb[i], true);
+out:
+	pb[i].port = portid;
+	return &pb[i];
+}
+
 static __hot_func
 void pkt_ring_output(struct ifnet *ifp, struct rte_mbuf *m)
 {
 	portid_t portid = ifp->if_port;
 	struct pkt_burst *pb = RTE_PER_LCORE(pkt_burst);
+	struct sched_info *qinfo = qos_handle(ifp);
+
+	if (unlikely(qinfo && CMM_ACCESS_ONCE(qinfo->fwd_classify)) &&
+	    !qos_dpdk_fwd_classify(ifp, qinfo, &m)) {
+		rte_pktmbuf_free(m);
+		return;
+	}
 
 	/*
 	 * Check poll mask also for non-directpath case since although
@@ -629,18 +765,13 @@ void pkt_ring_output(struct ifnet *ifp, struct rte_mbuf *m)
 	}
 
 	if (likely(pb != NULL)) {
+		pb = pkt_burst_for_port(pb, portid);
+
 		if (unlikely(ifp->portmonitor) &&
 		    __use_directpath(pb->port,
 				     ifp->qos_software_fwd))
 			portmonitor_src_phy_tx_output(ifp, &m, 1);
 
-		/* If changing flows to another port */
-		if (unlikely(portid != pb->port)) {
-			if (pb->count > 0)
-				pkt_ring_burst(pb, true);
-			pb->port = portid;
-		}
-
 		pb->m_tbl[pb->count++] = m;
 
 		/* if burst is ready, send now */
@@ -655,7 +786,9 @@ void pkt_ring_output(struct ifnet *ifp, struct rte_mbuf *m)
 				goto full_hwq;
 		} else {
 			/* must be lcore 0 */
-			struct rte_ring *ring = port_config[portid].pkt_ring[0];
+			uint8_t rid = pkt_qos_ring(ifp, m);
+			struct rte_ring *ring =
+				port_config[portid].pkt_ring[rid];
 
 			if (rte_ring_mp_enqueue(ring, m) != 0)
 				goto full_txring;
@@ -683,9 +816,11 @@ void pkt_burst_flush(void)
 		return;
 
 	struct pkt_burst *pb = RTE_PER_LCORE(pkt_burst);
+	unsigned int i;
 
-	if (pb->count > 0)
-		pkt_ring_burst(pb, true);
+	for (i = 0; i < TX_BURST_PORTS; i++)
+		if (pb[i].count > 0)
+			pkt_ring_burst(&pb[i], true);
 }
 
 static struct rte_mbuf *
@@ -827,13 +962,81 @@ out:
 	}
 }
 
+/* Cross-connect is the only ether-lookup feature on the port */
+#define XCONNECT_ONLY_FEATS \
+	(1u << (PL_ETHER_LOOKUP_FUSED_FEAT_CROSS_CONNECT - 1))
+
+/*
+ * Cross-connect bypass.
+ *
+ * When a port's only input feature is a cross-connect to another
+ * DPDK port that has nothing configured on output, the burst is
+ * handed to the peer's transmit path as a whole instead of being
+ * walked through the pipeline a packet at a time. Returns false if
+ * the burst has to take the normal path.
+ */
+static ALWAYS_INLINE bool
+xconnect_burst(struct ifnet *ifp, struct rte_mbuf *pkts[], uint16_t nb)
+{
+	struct pkt_burst *pb = RTE_PER_LCORE(pkt_burst);
+	struct ifnet *out_ifp;
+	portid_t portid;
+	unsigned int i, n;
+
+	if (CMM_ACCESS_ONCE(ifp->ether_in_features) != XCONNECT_ONLY_FEATS)
+		return false;
+
+	out_ifp = rcu_dereference(ifp->if_xconnect);
+	if (!out_ifp || out_ifp->if_type != IFT_ETHER ||
+	    !(out_ifp->if_flags & IFF_UP))
+		return false;
+
+	if (out_ifp->vlan_modify || out_ifp->portmonitor ||
+	    out_ifp->capturing || qos_handle(out_ifp))
+		return false;
+
+	/* The master thread has no burst buffers */
+	portid = out_ifp->if_port;
+	if (!pb || !bitmask_isset(&active_port_mask, portid))
+		return false;
+
+	for (i = 0; i < nb; i++) {
+		pktmbuf_mdata_clear_all(pkts[i]);
+		pkts[i]->tx_offload = 0;
+	}
+
+	/* Send anything already buffered for the port first */
+	pb = pkt_burst_for_port(pb, portid);
+	if (pb->count)
+		pkt_ring_burst(pb, true);
+
+	n = pkt_out_burst_cmn(out_ifp, out_ifp->qos_software_fwd, portid,
+			       pb->queue, pkts, nb);
+	if (unlikely(n < nb)) {
+		pktmbuf_free_bulk(&pkts[n], nb - n);
+		if (__use_directpath(portid, out_ifp->qos_software_fwd))
+			if_incr_full_hwq(out_ifp, nb - n);
+		else
+			if_incr_full_txring(out_ifp, nb - n);
+	}
+	return true;
+}
+
 static __hot_func void
 process_burst(portid_t portid, struct rte_mbuf *pkts[], uint16_t nb)
 {
 	struct ifnet *ifp = ifport_table[portid];
 	packet_input_t input_func = packet_input_func;
+	packet_burst_input_t burst_input_func = packet_burst_input_func;
 	unsigned int i;
 
+	/* Frames the NIC has decapsulated go straight to their tunnel */
+	if (unlikely(CMM_LOAD_SHARED(tun_offload_enabled))) {
+		nb = tun_offload_rx(pkts, nb);
+		if (nb == 0)
+			return;
+	}
+
 	/* Prefetch first packets */
 	for (i = 0; i < PREFETCH_OFFSET && i < nb; i++) {
 		rte_prefetch0(pkts[i]->cacheline1);
@@ -848,6 +1051,24 @@ process_burst(portid_t portid, struct rte_mbuf *pkts[], uint16_t nb)
 	if (unlikely(ifp->portmonitor))
 		portmonitor_src_phy_rx_output(ifp, pkts, nb);
 
+	if (unlikely(ifp->if_xconnect) && xconnect_burst(ifp, pkts, nb))
+		return;
+
+	/*
+	 * In vector mode each node touches every packet in the burst
+	 * before the next node runs, so prefetch them all up front.
+	 */
+	if (unlikely(burst_input_func != NULL)) {
+		for (; i < nb; i++) {
+			rte_prefetch0(pkts[i]->cacheline1);
+			rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *));
+		}
+		for (i = 0; i < nb; i++)
+			pktmbuf_mdata_clear_all(pkts[i]);
+		burst_input_func(ifp, pkts, nb);
+		return;
+	}
+
 	/* Process already prefetched packets */
 	for (i = 0; i + PREFETCH_OFFSET < nb; i++) {
 		rte_prefetch0(pkts[i + PREFETCH_OFFSET]->cacheline1);
@@ -896,6 +1117,13 @@ lcore_next_state(struct lcore_conf *conf,
 		work_to_do = true;
 	}
 
+	if (CMM_LOAD_SHARED(conf->do_alg)) {
+		us = pm_interval(pm, &conf->alg.gov);
+		if (us < min_us)
+			min_us = us;
+		work_to_do = true;
+	}
+
 	high_txq = CMM_LOAD_SHARED(conf->high_txq);
 	for (i = 0; i < high_txq; i++) {
 		struct lcore_tx_queue *txq = &conf->tx_poll[i];
@@ -954,7 +1182,7 @@ lcore_next_state(struct lcore_conf *conf,
 
 /* Check for packets from network ports */
 static void __hot_func
-poll_receive_queues(struct lcore_conf *conf)
+poll_receive_queues(struct lcore_conf *conf, const struct power_profile *pm)
 {
 	struct crypto_pkt_buffer *cpb = RTE_PER_LCORE(crypto_pkt_buffer);
 	uint16_t high_rxq;
@@ -963,7 +1191,7 @@ poll_receive_queues(struct lcore_conf *conf)
 	high_rxq = CMM_LOAD_SHARED(conf->high_rxq);
 	for (i = 0; i < high_rxq; i++) {
 		struct lcore_rx_queue *rxq = &conf->rx_poll[i];
-		struct rte_mbuf *rx_pkts[RX_PKT_BURST];
+		struct rte_mbuf *rx_pkts[PM_RX_BURST_MAX];
 		portid_t portid;
 		uint16_t nb;
 
@@ -978,15 +1206,26 @@ poll_receive_queues(struct lcore_conf *conf)
 		cmm_smp_rmb();
 
 		/* Check for packets from network */
+		/* profile may have changed since the last poll */
+		if (unlikely(rxq->burst < pm->min_burst ||
+			     rxq->burst > pm->max_burst))
+			rxq->burst = pm->max_burst;
+
 		nb = rte_eth_rx_burst(portid, rxq->queueid,
-				      rx_pkts, RX_PKT_BURST);
+				      rx_pkts, rxq->burst);
+		fwd_lat_rx(portid, rx_pkts, nb);
 
 		pm_update(&rxq->gov, nb);
+		rxq->burst = pm_rx_burst(pm, rxq->burst, nb);
 
 		if (nb > 0) {
 			rxq->packets += nb;
 			process_burst(portid, rx_pkts, nb);
 			crypto_send(cpb);
+
+			/* don't hold packets back waiting for more */
+			if (pm->low_latency)
+				pkt_ring_drain();
 		}
 	}
 }
@@ -1003,20 +1242,21 @@ static void put_transmit(struct ifnet *ifp, uint16_t queue_id,
 {
 	unsigned int sent;
 
-	sent = eth_tx_burst(ifp, queue_id, txq->burst, txq->pending);
+	sent = eth_tx_burst(ifp, queue_id, txq->burst + txq->head,
+			    txq->pending);
 	if (unlikely(sent == 0))
 		return;		/* Device Tx queue full */
 
-	/* if some packet remain, shuffle to front of the queue */
-	if (unlikely(sent < txq->pending)) {
-		unsigned int unsent = txq->pending - sent;
-		memmove(txq->burst,
-			txq->burst + sent,
-			unsent * sizeof(struct rte_mbuf *));
-	}
-
+	/*
+	 * If some packets remain, leave them where they are and
+	 * just move the head past the ones sent.
+	 */
 	txq->pending -= sent;
 	txq->packets += sent;
+	if (txq->pending)
+		txq->head += sent;
+	else
+		txq->head = 0;
 }
 
 /*
@@ -1043,8 +1283,8 @@ static unsigned int pkt_transmit_qos(struct ifnet *ifp,
 
 	pm_update(&txq->gov, n);
 
-	struct rte_mbuf **tx_pkts = txq->burst + txq->pending;
-	return qos_sched(ifp, qinfo, q_pkts, n, tx_pkts, space);
+	struct rte_mbuf **tx_pkts = txq->burst + txq->head + txq->pending;
+	return qos_sched(ifp, qinfo, txq->ringid, q_pkts, n, tx_pkts, space);
 }
 
 /* Fast path, Qos not enabled.
@@ -1059,7 +1299,7 @@ static unsigned int pkt_transmit_direct(struct lcore_tx_queue *txq,
 	if (unlikely(space == 0))
 		return 0;
 
-	struct rte_mbuf **pkts = txq->burst + txq->pending;
+	struct rte_mbuf **pkts = txq->burst + txq->head + txq->pending;
 	return rte_ring_sc_dequeue_burst(ring, (void **) pkts,
 					 space, NULL);
 }
@@ -1094,17 +1334,30 @@ poll_transmit_queues(struct lcore_conf *conf)
 		struct rte_eth_dev *dev = &rte_eth_devices[portid];
 		rte_prefetch0(dev->data->tx_queues[txq->queueid]);
 
-		unsigned int space = TX_PKT_BURST - txq->pending;
+		/*
+		 * Only move leftovers back to the start of the
+		 * burst when they leave no room after them.
+		 */
+		if (unlikely(txq->head + txq->pending == TX_PKT_BURST &&
+			     txq->head)) {
+			memmove(txq->burst, txq->burst + txq->head,
+				txq->pending * sizeof(struct rte_mbuf *));
+			txq->head = 0;
+		}
+
+		unsigned int space = TX_PKT_BURST - txq->head - txq->pending;
 
 		struct sched_info *qinfo = qos_handle(ifp);
-		if (qinfo && txq->ringid == 0) /* QoS only uses ringid 0 */
+		/* QoS uses a ring per scheduler shard */
+		if (qinfo && txq->ringid < qos_dpdk_shards(qinfo))
 			added = pkt_transmit_qos(ifp, qinfo, txq, portid,
 						 space);
 		else
 			added = pkt_transmit_direct(txq, portid, space);
 
 		if (added > 0) {
-			struct rte_mbuf **tx_pkts = txq->burst + txq->pending;
+			struct rte_mbuf **tx_pkts =
+				txq->burst + txq->head + txq->pending;
 
 			if (unlikely(ifp->portmonitor))
 				portmonitor_src_phy_tx_output(ifp,
@@ -1128,6 +1381,121 @@ static void process_crypto(struct lcore_conf *conf)
 	pm_update(&cpq->gov, pkts);
 }
 
+static void process_alg(struct lcore_conf *conf)
+{
+	struct lcore_alg *alg = &conf->alg;
+	unsigned int pkts = npf_alg_worker_poll();
+
+	alg->packets += pkts;
+	pm_update(&alg->gov, pkts);
+}
+
+/* Charge the cycles since *last to counter, and move *last on */
+static ALWAYS_INLINE void lcore_cycles_add(uint64_t *counter, uint64_t *last)
+{
+	uint64_t now = rte_rdtsc();
+
+	*counter += now - *last;
+	*last = now;
+}
+
+/* Take a queue out of this lcore's rx interrupt epoll set */
+static void rx_intr_disarm(struct lcore_rx_queue *rxq)
+{
+	if (!rxq->intr_armed)
+		return;
+
+	rte_eth_dev_rx_intr_ctl_q(rxq->intr_portid, rxq->intr_queueid,
+				  RTE_EPOLL_PER_THREAD, RTE_INTR_EVENT_DEL,
+				  NULL);
+	rxq->intr_armed = false;
+}
+
+/* Add a queue to this lcore's rx interrupt epoll set */
+static bool rx_intr_arm(struct lcore_rx_queue *rxq, portid_t portid)
+{
+	if (rxq->intr_armed && rxq->intr_portid == portid &&
+	    rxq->intr_queueid == rxq->queueid)
+		return true;
+
+	/* queue has been reassigned since it was last armed */
+	rx_intr_disarm(rxq);
+
+	if (rte_eth_dev_rx_intr_ctl_q(portid, rxq->queueid,
+				      RTE_EPOLL_PER_THREAD,
+				      RTE_INTR_EVENT_ADD, NULL) < 0)
+		return false;
+
+	rxq->intr_armed = true;
+	rxq->intr_portid = portid;
+	rxq->intr_queueid = rxq->queueid;
+	return true;
+}
+
+/*
+ * Sleep for up to us microseconds, returning early if a packet is
+ * received on any of the lcore's rx queues.
+ *
+ * Returns false without sleeping if any queue can't be woken by
+ * interrupt, in which case the caller should fall back to usleep.
+ */
+static bool lcore_rx_intr_wait(struct lcore_conf *conf, unsigned int us)
+{
+	struct rte_epoll_event events[MAX_RX_QUEUE_PER_CORE];
+	uint16_t high_rxq = CMM_LOAD_SHARED(conf->high_rxq);
+	bool pending = false;
+	unsigned int i;
+
+	for (i = 0; i < high_rxq; i++) {
+		struct lcore_rx_queue *rxq = &conf->rx_poll[i];
+		portid_t portid = CMM_LOAD_SHARED(rxq->portid);
+
+		if (portid == NO_OWNER ||
+		    !bitmask_isset(&active_port_mask, portid)) {
+			rx_intr_disarm(rxq);
+			continue;
+		}
+
+		cmm_smp_rmb();
+
+		if (!rx_intr_arm(rxq, portid))
+			break;
+	}
+
+	if (i < high_rxq)
+		return false;
+
+	for (i = 0; i < high_rxq; i++) {
+		struct lcore_rx_queue *rxq = &conf->rx_poll[i];
+
+		if (!rxq->intr_armed)
+			continue;
+
+		rte_eth_dev_rx_intr_enable(rxq->intr_portid,
+					   rxq->intr_queueid);
+
+		/* packet may have arrived before the interrupt was enabled */
+		if (rte_eth_rx_queue_count(rxq->intr_portid,
+					   rxq->intr_queueid) > 0)
+			pending = true;
+	}
+
+	/* epoll timeout is in ms, round up so as not to spin */
+	if (!pending)
+		rte_epoll_wait(RTE_EPOLL_PER_THREAD, events,
+			       ARRAY_SIZE(events), (us + 999) / 1000);
+
+	for (i = 0; i < high_rxq; i++) {
+		struct lcore_rx_queue *rxq = &conf->rx_poll[i];
+
+		if (rxq->intr_armed)
+			rte_eth_dev_rx_intr_disable(rxq->intr_portid,
+						    rxq->intr_queueid);
+	}
+
+	return true;
+}
+
 /* main processing loop */
 static int __hot_func
 forwarding_loop(unsigned int lcore_id)
@@ -1136,6 +1504,8 @@ forwarding_loop(unsigned int lcore_id)
 	const struct power_profile *pm;
 	struct lcore_conf *conf = lcore_conf[lcore_id];
 	enum lcore_state state;
+	bool rx_intr;
+	uint64_t now;
 
 	RTE_PER_LCORE(_dp_lcore_id) = lcore_id;
 	dp_crypto_per_lcore_init(lcore_id);
@@ -1154,25 +1524,40 @@ forwarding_loop(unsigned int lcore_id)
 	 * with rcu_register_thread() before calling rcu_read_lock().
 	 */
 	rcu_register_thread();
+	now = rte_rdtsc();
 	do {
 		rcu_read_lock();
 
 		pm = get_current_pm();
 		for (i = 0; i < pm->idle_thresh ; i++) {
-			if (CMM_LOAD_SHARED(conf->num_rxq) > 0)
-				poll_receive_queues(conf);
-			if (CMM_LOAD_SHARED(conf->do_crypto))
+			if (CMM_LOAD_SHARED(conf->num_rxq) > 0) {
+				poll_receive_queues(conf, pm);
+				lcore_cycles_add(&conf->cycles.rx, &now);
+			}
+			if (CMM_LOAD_SHARED(conf->do_crypto)) {
 				process_crypto(conf);
-			if (CMM_LOAD_SHARED(conf->num_txq) > 0)
+				lcore_cycles_add(&conf->cycles.crypto, &now);
+			}
+			if (CMM_LOAD_SHARED(conf->do_alg)) {
+				process_alg(conf);
+				lcore_cycles_add(&conf->cycles.alg, &now);
+			}
+			if (CMM_LOAD_SHARED(conf->num_txq) > 0) {
 				poll_transmit_queues(conf);
+				lcore_cycles_add(&conf->cycles.tx, &now);
+			}
 		}
 
 		/* Move leftover packets */
 		pkt_ring_drain();
+		flow_export_poll(now);
+		lcore_cycles_add(&conf->cycles.drain, &now);
 
 		state = lcore_next_state(conf, pm, &us);
+		rx_intr = pm->rx_intr;
 
 		rcu_read_unlock();
+		lcore_cycles_add(&conf->cycles.other, &now);
 
 		switch (state) {
 		case LCORE_STATE_EXIT:
@@ -1184,6 +1569,13 @@ forwarding_loop(unsigned int lcore_id)
 			break;
 		case LCORE_STATE_POWERSAVE:
 			rcu_quiescent_state();
+			if (rx_intr) {
+				rcu_thread_offline();
+				rx_intr = lcore_rx_intr_wait(conf, us);
+				rcu_thread_online();
+				if (rx_intr)
+					break;
+			}
 			usleep(us);
 			break;
 		case LCORE_STATE_IDLE:
@@ -1192,9 +1584,13 @@ forwarding_loop(unsigned int lcore_id)
 			rcu_thread_online();
 			break;
 		}
+		lcore_cycles_add(&conf->cycles.idle, &now);
 	} while (likely(state != LCORE_STATE_EXIT));
 	rcu_unregister_thread();
 
+	for (i = 0; i < MAX_RX_QUEUE_PER_CORE; i++)
+		rx_intr_disarm(&conf->rx_poll[i]);
+
 	pkt_burst_free();
 
 	RTE_LOG(DEBUG, DATAPLANE,
@@ -1255,6 +1651,7 @@ int reconfigure_queues(portid_t portid,
 
 	port_conf->rx_queues = nb_rx_queues;
 	port_conf->tx_queues = nb_tx_queues;
+	port_conf->ctrl_rxq = false;
 	bitmask_zero(&port_conf->tx_enabled_queues);
 	bitmask_zero(&port_conf->rx_enabled_queues);
 	for (q = 0; q < port_conf->tx_queues; q++)
@@ -1285,6 +1682,15 @@ eth_port_configure(portid_t portid, struct rte_eth_conf *dev_conf)
 
 	ret = rte_eth_dev_configure(portid, port_conf->rx_queues,
 				    port_conf->tx_queues, dev_conf);
+	if (ret < 0 && dev_conf->intr_conf.rxq) {
+		/* e.g. not enough interrupt vectors, just poll */
+		DP_DEBUG(INIT, DEBUG, DATAPLANE,
+			 "port %u: rx interrupts unavailable: err=%d\n",
+			 portid, ret);
+		dev_conf->intr_conf.rxq = 0;
+		ret = rte_eth_dev_configure(portid, port_conf->rx_queues,
+					    port_conf->tx_queues, dev_conf);
+	}
 	if (ret < 0) {
 		RTE_LOG(ERR, DATAPLANE,
 			 "Cannot configure device: err=%d, port=%u\n",
@@ -1418,36 +1824,68 @@ static int reconfigure_pkt_len_cb(struct ifnet *ifp,
 	return err;
 }
 
-/* Change hardware MTU, can only be called if stopped. */
-int reconfigure_pkt_len(struct ifnet *ifp, uint32_t mtu)
+/* Set the port config for an MTU, leaving everything else alone */
+static void pkt_len_dev_conf(portid_t portid __rte_unused, uint32_t mtu,
+			     struct rte_eth_conf *dev_conf)
 {
-	struct rte_eth_conf dev_conf;
-	struct rte_eth_dev *eth_dev = &rte_eth_devices[ifp->if_port];
-
-	memcpy(&dev_conf, &eth_dev->data->dev_conf, sizeof(dev_conf));
-
 #if RTE_VERSION >= RTE_VERSION_NUM(18,8,0,0)
 	if (mtu > ETHER_MTU) {
 		struct rte_eth_dev_info dev_info;
-		rte_eth_dev_info_get(ifp->if_port, &dev_info);
+		rte_eth_dev_info_get(portid, &dev_info);
 		if (dev_info.rx_offload_capa & DEV_RX_OFFLOAD_JUMBO_FRAME)
-			dev_conf.rxmode.offloads |= DEV_RX_OFFLOAD_JUMBO_FRAME;
+			dev_conf->rxmode.offloads |= DEV_RX_OFFLOAD_JUMBO_FRAME;
 		if (dev_info.rx_offload_capa & DEV_RX_OFFLOAD_SCATTER)
-			dev_conf.rxmode.offloads |= DEV_RX_OFFLOAD_SCATTER;
+			dev_conf->rxmode.offloads |= DEV_RX_OFFLOAD_SCATTER;
 	} else {
-		dev_conf.rxmode.offloads &= ~(DEV_RX_OFFLOAD_JUMBO_FRAME |
+		dev_conf->rxmode.offloads &= ~(DEV_RX_OFFLOAD_JUMBO_FRAME |
 			DEV_RX_OFFLOAD_SCATTER);
 	}
 #else
 	if (mtu > ETHER_MTU) {
-		dev_conf.rxmode.jumbo_frame = 1;
-		dev_conf.rxmode.enable_scatter = 1;
+		dev_conf->rxmode.jumbo_frame = 1;
+		dev_conf->rxmode.enable_scatter = 1;
 	} else {
-		dev_conf.rxmode.jumbo_frame = 0;
-		dev_conf.rxmode.enable_scatter = 0;
+		dev_conf->rxmode.jumbo_frame = 0;
+		dev_conf->rxmode.enable_scatter = 0;
 	}
 #endif
-	dev_conf.rxmode.max_rx_pkt_len = mtu + ETHER_HDR_LEN + ETHER_CRC_LEN;
+	dev_conf->rxmode.max_rx_pkt_len = mtu + ETHER_HDR_LEN + ETHER_CRC_LEN;
+}
+
+/*
+ * Change hardware MTU without stopping the port. Drivers that can't
+ * do this while running, e.g. into the jumbo range without scatter,
+ * return an error and the caller must use reconfigure_pkt_len.
+ */
+int set_pkt_len_online(struct ifnet *ifp, uint32_t mtu)
+{
+	struct rte_eth_dev *eth_dev = &rte_eth_devices[ifp->if_port];
+	struct rte_eth_conf dev_conf;
+	int err;
+
+	err = rte_eth_dev_set_mtu(ifp->if_port, mtu);
+	if (err)
+		return err;
+
+	/*
+	 * Not all drivers update the jumbo config, so do it here to
+	 * keep the MTU when the port is next reconfigured.
+	 */
+	memcpy(&dev_conf, &eth_dev->data->dev_conf, sizeof(dev_conf));
+	pkt_len_dev_conf(ifp->if_port, mtu, &dev_conf);
+	eth_dev->data->dev_conf.rxmode = dev_conf.rxmode;
+
+	return 0;
+}
+
+/* Change hardware MTU, can only be called if stopped. */
+int reconfigure_pkt_len(struct ifnet *ifp, uint32_t mtu)
+{
+	struct rte_eth_conf dev_conf;
+	struct rte_eth_dev *eth_dev = &rte_eth_devices[ifp->if_port];
+
+	memcpy(&dev_conf, &eth_dev->data->dev_conf, sizeof(dev_conf));
+	pkt_len_dev_conf(ifp->if_port, mtu, &dev_conf);
 
 	return reconfigure_port(ifp, &dev_conf, reconfigure_pkt_len_cb);
 }
@@ -1750,7 +2188,7 @@ static void stop_cpus(void)
 	FOREACH_FORWARD_LCORE(lcore) {
 		const struct lcore_conf *conf = lcore_conf[lcore];
 
-		if (forwarding_or_crypto_engine_lcore(conf) ||
+		if (forwarding_or_engine_lcore(conf) ||
 		    !conf->running)
 			continue;
 
@@ -1848,27 +2286,89 @@ static bool any_assigned_queues(portid_t portid)
 	return false;
 }
 
+/* CPU topology of each lcore, for placement only */
+static struct lcore_topo {
+	bitmask_t	siblings;	/* SMT siblings, not including itself */
+	int		llc;		/* last level cache id, -1 unknown */
+	bool		secondary;	/* not the first thread of its core */
+} lcore_topo[RTE_MAX_LCORE];
+
+static void lcore_topo_init(unsigned int lcore)
+{
+	struct lcore_topo *topo = &lcore_topo[lcore];
+
+	topo->secondary = secondary_cpu(lcore);
+	if (cpu_siblings(lcore, &topo->siblings) < 0)
+		bitmask_zero(&topo->siblings);
+	topo->llc = cpu_llc_id(lcore);
+}
+
+enum lcore_work {
+	LCORE_WORK_RX,
+	LCORE_WORK_TX,
+	LCORE_WORK_CRYPTO,
+};
+
+/* Heavy work (rx queues, crypto) on the SMT siblings of an lcore */
+static unsigned int lcore_sibling_load(unsigned int lcore)
+{
+	unsigned int i, load = 0;
+
+	RTE_LCORE_FOREACH(i) {
+		const struct lcore_conf *conf = lcore_conf[i];
+
+		if (bitmask_isset(&lcore_topo[lcore].siblings, i))
+			load += conf->num_rxq + conf->do_crypto;
+	}
+
+	return load;
+}
+
+/* Does an lcore share its last level cache with one polling rx? */
+static bool lcore_llc_has_rx(unsigned int lcore)
+{
+	int llc = lcore_topo[lcore].llc;
+	unsigned int i;
+
+	if (llc < 0)
+		return true;
+
+	RTE_LCORE_FOREACH(i) {
+		if (lcore_topo[i].llc == llc && lcore_conf[i]->num_rxq)
+			return true;
+	}
+
+	return false;
+}
+
 /* Compute load based on how much work CPU core is doing
  * Try and put Rx queue on primary HT and Tx on secondary HT
  * Use same NUMA socket if possible.
+ * Keep heavy work off busy SMT siblings, as they share a core, and
+ * Tx near the Rx cores filling its rings, as they share a cache.
  */
 #define HT_PENALTY 1
 #define NUMA_PENALTY 10
 #define CRYPTO_PENALTY 1
+#define ALG_PENALTY 1
+#define SMT_PENALTY 1
+#define LLC_PENALTY 2
 
-static unsigned int lcore_score(unsigned int lcore, int socket_id, bool is_txq)
+static unsigned int lcore_score(unsigned int lcore, int socket_id,
+				enum lcore_work work)
 {
 	const struct lcore_conf *conf = lcore_conf[lcore];
 	unsigned int score;
 
 	score = conf->num_rxq + conf->num_txq +
-		(CRYPTO_PENALTY * conf->do_crypto);
+		(CRYPTO_PENALTY * conf->do_crypto) +
+		(ALG_PENALTY * conf->do_alg);
 	if (socket_id != SOCKET_ID_ANY) {
-		if (is_txq) {
-			if (!secondary_cpu(lcore))
+		if (work == LCORE_WORK_TX) {
+			if (!lcore_topo[lcore].secondary)
 				score += HT_PENALTY;
 		} else {
-			if (secondary_cpu(lcore))
+			if (lcore_topo[lcore].secondary)
 				score += HT_PENALTY;
 		}
 
@@ -1876,12 +2376,19 @@ static unsigned int lcore_score(unsigned int lcore, int socket_id, bool is_txq)
 			score += NUMA_PENALTY;
 	}
 
+	if (work == LCORE_WORK_TX) {
+		if (!lcore_llc_has_rx(lcore))
+			score += LLC_PENALTY;
+	} else {
+		score += SMT_PENALTY * lcore_sibling_load(lcore);
+	}
+
 	return score;
 }
 
 /* Compute least loaded lcore in round-robin fashion */
 static int next_available_lcore(int socket_id,
-				const bitmask_t *allowed, bool is_txq)
+				const bitmask_t *allowed, enum lcore_work work)
 {
 	static int current_lcore = -1;
 	unsigned int start, i, best_score = 0;
@@ -1893,7 +2400,7 @@ static int next_available_lcore(int socket_id,
 		if (!bitmask_isset(allowed, i))
 			continue;
 
-		unsigned int weight = lcore_score(i, socket_id, is_txq);
+		unsigned int weight = lcore_score(i, socket_id, work);
 		if (best < 0 || weight < best_score) {
 			best = i;
 			best_score = weight;
@@ -1905,6 +2412,26 @@ static int next_available_lcore(int socket_id,
 	return best;
 }
 
+/*
+ * Find an empty rx_poll slot on a core, extending the range
+ * of slots polled if needed. Returns -1 if there is none.
+ */
+static int lcore_rx_slot_alloc(struct lcore_conf *conf)
+{
+	int i;
+
+	for (i = 0; i < conf->high_rxq; i++) {
+		if (conf->rx_poll[i].portid == NO_OWNER)
+			return i;
+	}
+
+	if (conf->high_rxq >= MAX_RX_QUEUE_PER_CORE)
+		return -1;
+
+	_CMM_STORE_SHARED(conf->high_rxq, conf->high_rxq + 1);
+	return i;
+}
+
 /* Assign all receive queues for a port */
 static int assign_port_receive_queues(portid_t portid, bitmask_t *allowed)
 {
@@ -1920,7 +2447,7 @@ static int assign_port_receive_queues(portid_t portid, bitmask_t *allowed)
 
 		lcore = next_available_lcore(port_conf->socketid,
 					     allowed,
-					     false);
+					     LCORE_WORK_RX);
 		if (lcore < 0) {
 			RTE_LOG(ERR, DATAPLANE,
 				"no available lcore for rx port %u\n", portid);
@@ -1928,21 +2455,14 @@ static int assign_port_receive_queues(portid_t portid, bitmask_t *allowed)
 		}
 		conf = lcore_conf[lcore];
 
-		/* find empty slot to use */
-		for (i = 0; i < conf->high_rxq; i++) {
-			if (conf->rx_poll[i].portid == NO_OWNER)
-				goto found;
-		}
-
-		if (conf->high_rxq < MAX_RX_QUEUE_PER_CORE)
-			_CMM_STORE_SHARED(conf->high_rxq, conf->high_rxq + 1);
-		else {
+		i = lcore_rx_slot_alloc(conf);
+		if (i < 0) {
 			RTE_LOG(ERR, DATAPLANE,
 				"Socket %d has no unused rx queues\n",
 				port_conf->socketid);
 			return -ENOMEM;
 		}
-found:
+
 		bitmask_clear(allowed, lcore);
 		if (bitmask_isempty(allowed))
 			*allowed = port_conf->rx_cpu_affinity; /* start over */
@@ -1970,11 +2490,34 @@ found:
 	return 0;
 }
 
+/*
+ * The number of rings to service for a port. QoS may spread its
+ * subports over more rings than are otherwise in use.
+ */
+static uint8_t port_tx_rings_wanted(portid_t portid)
+{
+	const struct port_conf *port_conf = &port_config[portid];
+	const struct ifnet *ifp = ifport_table[portid];
+	const struct sched_info *qinfo = ifp ? ifp->if_qos : NULL;
+	uint8_t nrings = port_conf->nrings;
+
+	if (qinfo && qinfo->dev_id == QOS_DPDK_ID && qinfo->shards > nrings)
+		nrings = RTE_MIN(qinfo->shards, port_conf->max_rings);
+
+	return nrings;
+}
+
+uint8_t port_max_tx_rings(portid_t portid)
+{
+	return port_config[portid].max_rings;
+}
+
 /* Assign lcores that will handle transmit queues (bottom half) */
 static int assign_port_transmit_queues(portid_t portid, bitmask_t *allowed)
 {
 	struct port_conf *port_conf = &port_config[portid];
 	struct ifnet *ifp = ifport_table[portid];
+	uint8_t nrings = port_tx_rings_wanted(portid);
 	uint16_t q;
 	uint8_t r;
 
@@ -1983,7 +2526,7 @@ static int assign_port_transmit_queues(portid_t portid, bitmask_t *allowed)
 	 * gaps for not-enabled rings.
 	 */
 	for (r = 0, q = 0;
-	     r < port_conf->nrings && q < port_conf->tx_queues;
+	     r < nrings && q < port_conf->tx_queues;
 	     q++) {
 		struct lcore_conf *conf;
 		int i, lcore;
@@ -1993,7 +2536,7 @@ static int assign_port_transmit_queues(portid_t portid, bitmask_t *allowed)
 
 		lcore = next_available_lcore(port_conf->socketid,
 					     allowed,
-					     true);
+					     LCORE_WORK_TX);
 		if (lcore < 0) {
 			RTE_LOG(ERR, DATAPLANE,
 				"no available lcore for tx port %u\n", portid);
@@ -2092,7 +2635,7 @@ static void start_cpus(void)
 	FOREACH_FORWARD_LCORE(lcore) {
 		const struct lcore_conf *conf = lcore_conf[lcore];
 
-		if (!forwarding_or_crypto_engine_lcore(conf) || conf->running)
+		if (!forwarding_or_engine_lcore(conf) || conf->running)
 			continue;
 
 		(void)start_one_cpu(lcore);
@@ -2119,6 +2662,23 @@ static bool transmit_thread_running(portid_t portid)
 	return false;
 }
 
+/* The number of rings of a port that have a forwarding thread polling */
+static unsigned int transmit_rings_running(portid_t portid)
+{
+	unsigned int lcore, n = 0;
+
+	FOREACH_FORWARD_LCORE(lcore) {
+		const struct lcore_conf *conf = lcore_conf[lcore];
+		unsigned int i;
+
+		for (i = 0; i < conf->high_txq; i++)
+			if (conf->tx_poll[i].portid == portid)
+				n++;
+	}
+
+	return n;
+}
+
 /* Start queues for new port. */
 int assign_queues(portid_t portid)
 {
@@ -2163,8 +2723,15 @@ int enable_transmit_thread(portid_t portid)
 	bitmask_t tmpmask = port_conf->tx_cpu_affinity;
 	int ret;
 
-	if (transmit_thread_running(portid))
-		return 0;
+	if (transmit_thread_running(portid)) {
+		if (!port_conf->percoreq ||
+		    transmit_rings_running(portid) >=
+		    port_tx_rings_wanted(portid))
+			return 0;
+
+		/* QoS wants more shards, so start again with more rings */
+		disable_transmit_thread(portid);
+	}
 
 	ret = assign_port_transmit_queues(portid, &tmpmask);
 	if (ret == 0)
@@ -2193,6 +2760,14 @@ void disable_transmit_thread(portid_t portid)
 	stop_cpus();
 }
 
+/* The rx queue kept for steered control traffic, or -1 if none */
+int port_ctrl_rxq(portid_t portid)
+{
+	const struct port_conf *port_conf = &port_config[portid];
+
+	return port_conf->ctrl_rxq ? port_conf->rx_queues - 1 : -1;
+}
+
 bool port_uses_queue_state(uint16_t portid)
 {
 	struct port_conf *port_conf = &port_config[portid];
@@ -2270,6 +2845,24 @@ void track_port_queue_state(uint16_t portid, uint16_t queue_id, bool rx,
 	}
 }
 
+/*
+ * Prefer lcores on another NUMA node for a port's queues, e.g. the
+ * node of a vhost guest's memory, so virtqueue copies stay local.
+ */
+void set_port_socket(portid_t portid, int socketid)
+{
+	struct port_conf *port_conf = &port_config[portid];
+
+	if (socketid < 0 || socketid >= RTE_MAX_NUMA_NODES ||
+	    socketid == port_conf->socketid)
+		return;
+
+	DP_DEBUG(INIT, DEBUG, DATAPLANE,
+		 "Port %u moving from node %d to node %d\n",
+		 portid, port_conf->socketid, socketid);
+	port_conf->socketid = socketid;
+}
+
 /*
  * The set of queues to be enabled was set in the lsc interrupt
  * thread. Bring the running state into line with that.
@@ -2339,6 +2932,48 @@ struct rte_mempool *mbuf_pool_create(const char *name,
 	return mp;
 }
 
+struct mbuf_pool_job {
+	int		socketid;
+	unsigned int	nbufs;
+	unsigned int	bufsz;
+};
+
+/* Create one socket's mbuf pool, shrinking it until it fits */
+static int mbuf_pool_socket_create(void *arg)
+{
+	const struct mbuf_pool_job *job = arg;
+	unsigned int nbufs = job->nbufs;
+	char name[RTE_MEMPOOL_NAMESIZE];
+	struct rte_mempool *pool;
+
+	snprintf(name, RTE_MEMPOOL_NAMESIZE, "mbuf_node_%d", job->socketid);
+retry:
+	pool = mbuf_pool_create(name, nbufs, NUMA_POOL_MBUF_CACHE_SIZE,
+				job->bufsz, job->socketid);
+	if (pool == NULL) {
+		if (rte_errno != ENOMEM)
+			rte_panic("mbuf  %s create failed: %s\n",
+				  name, rte_strerror(rte_errno));
+
+		if (nbufs <= MIN_MBUF_POOL)
+			rte_panic("mbuf %s no space for %u bufs\n",
+				  name, nbufs);
+
+		RTE_LOG(NOTICE, DATAPLANE,
+			"Not enough memory for pool of %u mbufs size %uM\n",
+			nbufs, (job->bufsz * nbufs) / (1024*1024u));
+		nbufs /= 2;
+		goto retry;
+	}
+
+	DP_DEBUG(INIT, DEBUG, DATAPLANE,
+		 "Created %s mbuf pool size %u %uM\n", name,
+		 nbufs,  (job->bufsz * nbufs) / (1024*1024u));
+
+	numa_pool[job->socketid] = pool;
+	return 0;
+}
+
 /* Initialize per socket mbuf pool. */
 static uint16_t mbuf_pool_init(void)
 {
@@ -2348,7 +2983,6 @@ static uint16_t mbuf_pool_init(void)
 	unsigned int lcore, portid;
 	int socketid;
 	uint16_t max_mbuf_sz = RTE_MBUF_DEFAULT_BUF_SIZE;
-	uint16_t num_fwd_lcores = 0;
 
 	memset(bufs_per_socket, 0, sizeof(bufs_per_socket));
 
@@ -2358,7 +2992,6 @@ static uint16_t mbuf_pool_init(void)
 
 		bufs_per_socket[socketid] += TX_PKT_BURST;
 		buf_size[socketid] = RTE_MBUF_DEFAULT_BUF_SIZE;
-		num_fwd_lcores++;
 	}
 
 	/* How many mbufs are needed for each device? */
@@ -2380,48 +3013,57 @@ static uint16_t mbuf_pool_init(void)
 		}
 	}
 
-	/* Allocate mbuf pool per NUMA socket */
+	/*
+	 * Allocate mbuf pool per NUMA socket. Initialising every mbuf
+	 * in a large pool takes a while, so each socket's pool is
+	 * created by an idle lcore on that socket, all at once.
+	 */
+	unsigned int launched[RTE_MAX_NUMA_NODES];
+	struct mbuf_pool_job jobs[RTE_MAX_NUMA_NODES];
+
 	for (socketid = 0; socketid < RTE_MAX_NUMA_NODES; ++socketid) {
-		unsigned int bufsz = buf_size[socketid];
+		struct mbuf_pool_job *job = &jobs[socketid];
 
+		launched[socketid] = RTE_MAX_LCORE;
 		if (bufs_per_socket[socketid] == 0)
 			continue;
 
-		bufs_per_socket[socketid] +=
-			(num_fwd_lcores + 1) * NUMA_POOL_MBUF_CACHE_SIZE;
-
-		/* Align to optimum size for mempool */
-		unsigned int nbufs = rte_align32pow2(bufs_per_socket[socketid]) - 1;
-
-		char name[RTE_MEMPOOL_NAMESIZE];
-		snprintf(name, RTE_MEMPOOL_NAMESIZE, "mbuf_node_%d",
-			 socketid);
-
-		struct rte_mempool *pool;
-retry:
-		pool = mbuf_pool_create(name, nbufs, NUMA_POOL_MBUF_CACHE_SIZE,
-					bufsz, socketid);
-		if (pool == NULL) {
-			if (rte_errno != ENOMEM)
-				rte_panic("mbuf  %s create failed: %s\n",
-					  name, rte_strerror(rte_errno));
-
-			if (nbufs <= MIN_MBUF_POOL)
-				rte_panic("mbuf %s no space for %u bufs\n",
-					  name, nbufs);
-
-			RTE_LOG(NOTICE, DATAPLANE,
-				"Not enough memory for pool of %u mbufs size %uM\n",
-				nbufs, (bufsz * nbufs) / (1024*1024u));
-			nbufs /= 2;
-			goto retry;
+		/*
+		 * Any lcore may allocate from or free to any pool, so
+		 * every cache can be holding buffers from this one.
+		 * QoS queues and crypto are set up at run time, so what
+		 * they may hold is covered by the configured reserve.
+		 */
+		bufs_per_socket[socketid] += rte_lcore_count() *
+			MBUF_CACHE_HELD(NUMA_POOL_MBUF_CACHE_SIZE);
+		bufs_per_socket[socketid] += config.mbuf_pool_reserve;
+
+		job->socketid = socketid;
+		job->nbufs = RTE_MAX(bufs_per_socket[socketid],
+				     (unsigned int)MIN_MBUF_POOL);
+		/* leave room for an ESP trailer after a full sized frame */
+		job->bufsz = buf_size[socketid] + CRYPTO_MAX_TAILROOM;
+
+		RTE_LCORE_FOREACH_SLAVE(lcore) {
+			if (rte_lcore_to_socket_id(lcore) !=
+			    (unsigned int)socketid)
+				continue;
+			if (rte_eal_remote_launch(mbuf_pool_socket_create,
+						  job, lcore) == 0) {
+				launched[socketid] = lcore;
+				break;
+			}
 		}
+	}
 
-		DP_DEBUG(INIT, DEBUG, DATAPLANE,
-			 "Created %s mbuf pool size %u %uM\n", name,
-			 nbufs,  (bufsz * nbufs) / (1024*1024u));
+	for (socketid = 0; socketid < RTE_MAX_NUMA_NODES; ++socketid) {
+		if (bufs_per_socket[socketid] == 0)
+			continue;
 
-		numa_pool[socketid] = pool;
+		if (launched[socketid] == RTE_MAX_LCORE)
+			mbuf_pool_socket_create(&jobs[socketid]);
+		else
+			rte_eal_wait_lcore(launched[socketid]);
 	}
 
 	/* Assign mbuf pool for each device */
@@ -2453,9 +3095,10 @@ int mbuf_pool_init_portid(const portid_t portid)
 
 		if (port_conf->buf_size > buf_size)
 			buf_size = port_conf->buf_size;
+		buf_size += CRYPTO_MAX_TAILROOM;
 
-		/* Align to optimum size for mempool */
-		unsigned int nbufs = rte_align32pow2(port_conf->buffers) - 1;
+		unsigned int nbufs = port_conf->buffers + rte_lcore_count() *
+			MBUF_CACHE_HELD(MBUF_CACHE_SIZE_DEFAULT);
 
 		char name[RTE_MEMPOOL_NAMESIZE];
 
@@ -2785,6 +3428,9 @@ static int port_initial_conf(portid_t portid, struct rte_eth_conf *dev_conf)
 
 	dev_conf->intr_conf.lsc = (dev->data->dev_flags &
 				   RTE_ETH_DEV_INTR_LSC) ? 1 : 0;
+	/* allow lcores to sleep waiting for rx in the interrupt profile */
+	dev_conf->intr_conf.rxq =
+		dev->dev_ops->rx_queue_intr_enable ? 1 : 0;
 
 	/* DPDK 18.08 errors if offload flags don't match PMD caps */
 #if RTE_VERSION >= RTE_VERSION_NUM(18, 8, 0, 0)
@@ -2792,6 +3438,8 @@ static int port_initial_conf(portid_t portid, struct rte_eth_conf *dev_conf)
 		dev_conf->rxmode.offloads |= DEV_RX_OFFLOAD_VLAN_FILTER;
 	if (dev_info.rx_offload_capa & DEV_RX_OFFLOAD_VLAN_STRIP)
 		dev_conf->rxmode.offloads |= DEV_RX_OFFLOAD_VLAN_STRIP;
+	if (dev_info.rx_offload_capa & DEV_RX_OFFLOAD_IPV4_CKSUM)
+		dev_conf->rxmode.offloads |= DEV_RX_OFFLOAD_IPV4_CKSUM;
 	/* Default in 18.11, flag is gone */
 #if RTE_VERSION < RTE_VERSION_NUM(18, 11, 0, 0)
 	if (dev_info.rx_offload_capa & DEV_RX_OFFLOAD_CRC_STRIP)
@@ -2799,6 +3447,8 @@ static int port_initial_conf(portid_t portid, struct rte_eth_conf *dev_conf)
 #endif
 	dev_conf->rx_adv_conf.rss_conf.rss_hf &=
 					dev_info.flow_type_rss_offloads;
+	if (port_config[portid].mt_txq)
+		dev_conf->txmode.offloads |= DEV_TX_OFFLOAD_MT_LOCKFREE;
 #endif
 
 	/* Want VLAN offload, refcount and multisegment */
@@ -2902,6 +3552,14 @@ static int port_conf_init_portid(portid_t portid)
 	    parm->drv_flags & DRV_PARAM_USE_ALL_RXQ)
 		port_conf->rx_queues = pf_max_rx_queues;
 
+	/* An extra queue for control traffic, steered by ctrl_rxq.c */
+	port_conf->ctrl_rxq = false;
+	if (config.control_rxq && port_conf->rx_queues < pf_max_rx_queues &&
+	    port_conf->rx_queues < MAX_RX_QUEUE_PER_PORT) {
+		port_conf->rx_queues++;
+		port_conf->ctrl_rxq = true;
+	}
+
 	/* Account for worst case Rx buffers */
 	port_conf->buffers = port_conf->rx_queues *
 		(parm->rx_desc + parm->extra);
@@ -2968,11 +3626,23 @@ static int port_conf_init_portid(portid_t portid)
 		}
 		port_conf->tx_queues = port_conf->max_rings;
 		port_conf->percoreq = false;
+#if RTE_VERSION >= RTE_VERSION_NUM(18, 8, 0, 0)
+		/*
+		 * If the device allows the tx queues to be used by
+		 * multiple cores at once then the forwarding cores
+		 * can still bypass the tx thread.
+		 */
+		if (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_MT_LOCKFREE &&
+		    !(parm->drv_flags & DRV_PARAM_NO_DIRECT))
+			port_conf->mt_txq = true;
+#endif
 	} else {
 		port_conf->percoreq = true;
-		port_conf->max_rings = 1;		/* needed for QoS */
+		/* needed for QoS, which may use a ring per shard */
+		port_conf->max_rings = RTE_MIN(port_conf->tx_queues,
+					       QOS_SHARDS_MAX);
 	}
-	port_conf->nrings = port_conf->max_rings;
+	port_conf->nrings = port_conf->percoreq ? 1 : port_conf->max_rings;
 
 	for (q = 0; q < port_conf->tx_queues; q++)
 		bitmask_set(&port_conf->tx_enabled_queues, q);
@@ -3011,6 +3681,9 @@ static int port_conf_init_portid(portid_t portid)
 	/* Overhead of every Tx queue being full */
 	port_conf->buffers +=  port_conf->tx_desc * port_conf->tx_queues;
 
+	/* Local delivery rings being full */
+	port_conf->buffers += shadow_port_buffers();
+
 	/* Want VLAN offload, refcount and multisegment */
 	port_conf->tx_conf = dev_info.default_txconf;
 #if RTE_VERSION < RTE_VERSION_NUM(18, 8, 0, 0)
@@ -3168,7 +3841,8 @@ int crypto_assign_engine(int crypto_dev_id)
 {
 	int lcore;
 
-	lcore = next_available_lcore(SOCKET_ID_ANY, &crypto_cpus, true);
+	lcore = next_available_lcore(SOCKET_ID_ANY, &crypto_cpus,
+				     LCORE_WORK_CRYPTO);
 
 	if (lcore < 0) {
 		RTE_LOG(ERR, DATAPLANE, "no crypto thread found\n");
@@ -3211,13 +3885,79 @@ void crypto_unassign_from_engine(int lcore)
 		if (!conf->do_crypto)
 			bitmask_clear(&crypto_active_cpus, lcore);
 
-		if (!forwarding_or_crypto_engine_lcore(conf)) {
+		if (!forwarding_or_engine_lcore(conf)) {
 			stop_one_cpu(lcore);
 			register_forwarding_cores();
 		}
 	}
 }
 
+static bitmask_t alg_active_cpus;
+
+/*
+ * Parse cpumask expressed as hex bitmask and give the ALG worker role
+ * to exactly those cores, taking it from any others.  "none" or an
+ * empty mask stops ALG packets being steered to workers.
+ */
+int set_alg_workers(const char *str)
+{
+	bitmask_t cores, online;
+	unsigned int lcore;
+	bool changed = false;
+	char tmp[BITMASK_STRSZ];
+
+	if (!str || !strcmp(str, "none"))
+		bitmask_zero(&cores);
+	else if (bitmask_parse(&cores, str))
+		return -EINVAL;
+
+	online = online_slave_mask();
+	bitmask_and(&cores, &cores, &online);
+
+	if (bitmask_isempty(&cores))
+		npf_alg_worker_enable(false);
+
+	FOREACH_FORWARD_LCORE(lcore) {
+		struct lcore_conf *conf = lcore_conf[lcore];
+		bool want = bitmask_isset(&cores, lcore);
+
+		if (want == conf->do_alg)
+			continue;
+
+		changed = true;
+		if (!want) {
+			CMM_STORE_SHARED(conf->do_alg, false);
+			bitmask_clear(&alg_active_cpus, lcore);
+			if (!forwarding_or_engine_lcore(conf))
+				stop_one_cpu(lcore);
+			continue;
+		}
+
+		init_rate_stats(&conf->alg_stats);
+		CMM_STORE_SHARED(conf->do_alg, true);
+		bitmask_set(&alg_active_cpus, lcore);
+		if (!conf->running && !start_one_cpu(lcore)) {
+			RTE_LOG(ERR, DATAPLANE,
+				"Failed to start ALG worker on core %u\n",
+				lcore);
+			CMM_STORE_SHARED(conf->do_alg, false);
+			bitmask_clear(&alg_active_cpus, lcore);
+		}
+	}
+
+	if (changed)
+		register_forwarding_cores();
+
+	if (!bitmask_isempty(&alg_active_cpus) &&
+	    npf_alg_worker_enable(true) < 0)
+		return -ENOMEM;
+
+	bitmask_sprint(&alg_active_cpus, tmp, sizeof(tmp));
+	DP_DEBUG(INIT, INFO, DATAPLANE, "ALG worker cores set: %s\n", tmp);
+
+	return bitmask_numset(&alg_active_cpus);
+}
+
 /* Configure ethernet port */
 int eth_port_config(portid_t portid)
 {
@@ -3284,6 +4024,7 @@ static void lcore_init(void)
 			rte_panic("no memory for lcore %u config\n", i);
 
 		lcore_conf[i] = conf;
+		lcore_topo_init(i);
 
 		for (j = 0; j < MAX_RX_QUEUE_PER_CORE; j++)
 			conf->rx_poll[j].portid = NO_OWNER;
@@ -3726,6 +4467,7 @@ main(int argc, char **argv)
 		"%s version %s - %s\n",
 		DATAPLANE_PROGNAME, DATAPLANE_VERSION, DATAPLANE_COPYRIGHT);
 
+	stats_seg_init();
 	interface_init();
 	incomplete_interface_init();
 
@@ -3789,6 +4531,7 @@ main(int argc, char **argv)
 
 	udp_handler_init();
 	fragment_tables_timer_init();
+	flow_export_init();
 	mcast_init_ipv4();
 	mcast_init_ipv6();
 	mpls_init();
@@ -3801,6 +4544,7 @@ main(int argc, char **argv)
 	capture_init(max_mbuf_sz);
 	bitmask_zero(&crypto_active_cpus);
 	bitmask_zero(&crypto_cpus);
+	bitmask_zero(&alg_active_cpus);
 	crypto_sticky = false;
 	dp_crypto_init();
 	vrf_init();
@@ -3868,9 +4612,277 @@ main(int argc, char **argv)
 	return 0;
 }
 
+/*
+ * Runtime rebalancing of receive queues.
+ *
+ * Every RXQ_REBALANCE_INTERVAL seconds the rx packet rate of each
+ * running forwarding core is compared, and if the busiest is above
+ * RXQ_REBALANCE_MIN_PPS, and it has more than one rx queue, then its
+ * heaviest queue that will fit is moved to the least busy core. A
+ * queue fits if moving it leaves both cores less busy than the
+ * busiest one was, so queues don't ping-pong between cores.
+ */
+#define RXQ_REBALANCE_INTERVAL	10	/* seconds */
+#define RXQ_REBALANCE_MIN_PPS	100000
+
+static bool rxq_rebalance_enabled = true;
+
+void set_rxq_rebalance(bool enable)
+{
+	rxq_rebalance_enabled = enable;
+}
+
+static uint64_t lcore_rx_rate(const struct lcore_conf *conf)
+{
+	uint64_t rate = 0;
+	unsigned int i;
+
+	for (i = 0; i < conf->high_rxq; i++)
+		if (conf->rx_poll[i].portid != NO_OWNER)
+			rate += conf->rx_poll_stats[i].packet_rate;
+
+	return rate;
+}
+
+/*
+ * Move a receive queue from one core to another.
+ *
+ * The queue is removed from the source core first and the move
+ * only completes once the source core is guaranteed to no longer be
+ * polling it, as the rx functions of a queue aren't MT-safe.
+ */
+static int move_rx_queue(unsigned int src_lcore, unsigned int src_idx,
+			 unsigned int dst_lcore)
+{
+	struct lcore_conf *src = lcore_conf[src_lcore];
+	struct lcore_conf *dst = lcore_conf[dst_lcore];
+	struct lcore_rx_queue *rxq = &src->rx_poll[src_idx];
+	portid_t portid = rxq->portid;
+	uint8_t queueid = rxq->queueid;
+	bool port_in_use = false;
+	unsigned int i;
+	int dst_idx;
+
+	dst_idx = lcore_rx_slot_alloc(dst);
+	if (dst_idx < 0)
+		return -ENOMEM;
+
+	_CMM_STORE_SHARED(rxq->portid, NO_OWNER);
+	CMM_STORE_SHARED(src->num_rxq, src->num_rxq - 1);
+
+	for (i = 0; i < MAX_RX_QUEUE_PER_CORE; i++)
+		if (src->rx_poll[i].portid == portid)
+			port_in_use = true;
+	for (i = 0; i < MAX_TX_QUEUE_PER_CORE; i++)
+		if (src->tx_poll[i].portid == portid)
+			port_in_use = true;
+	if (!port_in_use)
+		bitmask_clear(&src->portmask, portid);
+
+	/* wait for the source core to finish any poll of the queue */
+	synchronize_rcu();
+
+	struct lcore_rx_queue *new_rxq = &dst->rx_poll[dst_idx];
+
+	init_rate_stats(&dst->rx_poll_stats[dst_idx]);
+	memset(&new_rxq->gov, 0, sizeof(new_rxq->gov));
+	new_rxq->packets = 0;
+	CMM_STORE_SHARED(new_rxq->queueid, queueid);
+	/* write queueid before writing portid */
+	cmm_smp_wmb();
+	_CMM_STORE_SHARED(new_rxq->portid, portid);
+	CMM_STORE_SHARED(dst->num_rxq, dst->num_rxq + 1);
+	bitmask_set(&dst->portmask, portid);
+
+	RTE_LOG(INFO, DATAPLANE,
+		"Move RX port %u queue %u from core %u to core %u\n",
+		portid, queueid, src_lcore, dst_lcore);
+	return 0;
+}
+
+static bool rxq_rebalance(void)
+{
+	uint64_t max_rate = 0, min_rate = UINT64_MAX;
+	int busiest = -1, idlest = -1, best_idx = -1;
+	uint64_t best_rate = 0;
+	unsigned int id, i;
+
+	FOREACH_FORWARD_LCORE(id) {
+		const struct lcore_conf *conf = lcore_conf[id];
+		uint64_t rate;
+
+		if (!conf->running || conf->num_rxq == 0)
+			continue;
+
+		rate = lcore_rx_rate(conf);
+		if (rate > max_rate) {
+			max_rate = rate;
+			busiest = id;
+		}
+		if (rate < min_rate) {
+			min_rate = rate;
+			idlest = id;
+		}
+	}
+
+	if (busiest < 0 || idlest < 0 || busiest == idlest ||
+	    max_rate < RXQ_REBALANCE_MIN_PPS ||
+	    lcore_conf[busiest]->num_rxq < 2)
+		return false;
+
+	const struct lcore_conf *conf = lcore_conf[busiest];
+
+	for (i = 0; i < conf->high_rxq; i++) {
+		const struct lcore_rx_queue *rxq = &conf->rx_poll[i];
+		uint64_t rate = conf->rx_poll_stats[i].packet_rate;
+
+		if (rxq->portid == NO_OWNER ||
+		    !bitmask_isset(&port_config[rxq->portid].rx_cpu_affinity,
+				   idlest))
+			continue;
+
+		if (min_rate + rate < max_rate && rate > best_rate) {
+			best_rate = rate;
+			best_idx = i;
+		}
+	}
+
+	return best_idx >= 0 && move_rx_queue(busiest, best_idx, idlest) == 0;
+}
+
+/*
+ * Runtime rebalancing of RSS buckets, for when a single queue is too
+ * busy for moving whole queues to help, e.g. it carries an elephant
+ * flow.
+ *
+ * NICs don't report hits per RETA bucket, so the hottest RSS queue of
+ * a port gives up one bucket per interval, the one it has held the
+ * longest, to the port's least busy queue on another core.  This
+ * stops once the queue is down to one bucket or is no longer more
+ * than RETA_REBALANCE_RATIO times the port's average.  A bucket that
+ * has just moved is the last to move again, so an elephant ends up
+ * alone in a queue rather than being passed around.
+ */
+#define RETA_REBALANCE_RATIO	2
+
+static struct reta_state {
+	uint32_t	moved[ETH_RSS_RETA_SIZE_512];	/* move seq, 0 never */
+	bool		unsupported;
+} reta_state[DATAPLANE_MAX_PORTS];
+
+static uint32_t reta_move_seq;
+
+static void reta_rebalance_port(portid_t portid)
+{
+	const struct port_conf *port_conf = &port_config[portid];
+	struct reta_state *rs = &reta_state[portid];
+	struct rte_eth_rss_reta_entry64 reta[ETH_RSS_RETA_SIZE_512 /
+					     RTE_RETA_GROUP_SIZE];
+	uint64_t rate[MAX_RX_QUEUE_PER_PORT] = { 0 };
+	int lcore_of[MAX_RX_QUEUE_PER_PORT];
+	struct rte_eth_dev_info dev_info;
+	uint64_t total = 0;
+	unsigned int nb_rss, nb_hot = 0, id, i;
+	int hot = -1, cold = -1, bucket = -1;
+
+	nb_rss = port_conf->rx_queues;
+	if (port_ctrl_rxq(portid) >= 0)
+		nb_rss--;
+	if (nb_rss < 2 || nb_rss > MAX_RX_QUEUE_PER_PORT || rs->unsupported)
+		return;
+
+	for (i = 0; i < nb_rss; i++)
+		lcore_of[i] = -1;
+
+	FOREACH_FORWARD_LCORE(id) {
+		const struct lcore_conf *conf = lcore_conf[id];
+
+		for (i = 0; i < conf->high_rxq; i++) {
+			const struct lcore_rx_queue *rxq = &conf->rx_poll[i];
+
+			if (rxq->portid != portid || rxq->queueid >= nb_rss)
+				continue;
+			rate[rxq->queueid] = conf->rx_poll_stats[i].packet_rate;
+			lcore_of[rxq->queueid] = id;
+		}
+	}
+
+	for (i = 0; i < nb_rss; i++) {
+		total += rate[i];
+		if (lcore_of[i] >= 0 && (hot < 0 || rate[i] > rate[hot]))
+			hot = i;
+	}
+	if (hot < 0 || rate[hot] < RXQ_REBALANCE_MIN_PPS ||
+	    rate[hot] * nb_rss < RETA_REBALANCE_RATIO * total)
+		return;
+
+	for (i = 0; i < nb_rss; i++)
+		if (lcore_of[i] >= 0 && lcore_of[i] != lcore_of[hot] &&
+		    (cold < 0 || rate[i] < rate[cold]))
+			cold = i;
+	if (cold < 0)
+		return;
+
+	rte_eth_dev_info_get(portid, &dev_info);
+	if (dev_info.reta_size == 0 ||
+	    dev_info.reta_size > ETH_RSS_RETA_SIZE_512) {
+		rs->unsupported = true;
+		return;
+	}
+
+	memset(reta, 0, sizeof(reta));
+	for (i = 0; i < dev_info.reta_size; i++)
+		reta[i / RTE_RETA_GROUP_SIZE].mask |=
+			1ULL << (i % RTE_RETA_GROUP_SIZE);
+	if (rte_eth_dev_rss_reta_query(portid, reta,
+				       dev_info.reta_size) < 0) {
+		rs->unsupported = true;
+		return;
+	}
+
+	for (i = 0; i < dev_info.reta_size; i++) {
+		if (reta[i / RTE_RETA_GROUP_SIZE].reta[i % RTE_RETA_GROUP_SIZE]
+		    != hot)
+			continue;
+		nb_hot++;
+		if (bucket < 0 || rs->moved[i] < rs->moved[bucket])
+			bucket = i;
+	}
+	if (nb_hot < 2)
+		return;
+
+	for (i = 0; i < RTE_DIM(reta); i++)
+		reta[i].mask = 0;
+	reta[bucket / RTE_RETA_GROUP_SIZE].mask =
+		1ULL << (bucket % RTE_RETA_GROUP_SIZE);
+	reta[bucket / RTE_RETA_GROUP_SIZE].reta[bucket % RTE_RETA_GROUP_SIZE] =
+		cold;
+	if (rte_eth_dev_rss_reta_update(portid, reta,
+					dev_info.reta_size) < 0) {
+		rs->unsupported = true;
+		return;
+	}
+	rs->moved[bucket] = ++reta_move_seq;
+
+	RTE_LOG(INFO, DATAPLANE,
+		"Move RSS bucket %d of port %u from queue %d to queue %d\n",
+		bucket, portid, hot, cold);
+}
+
+static void reta_rebalance(void)
+{
+	portid_t portid;
+
+	for (portid = 0; portid < DATAPLANE_MAX_PORTS; ++portid)
+		if (any_assigned_queues(portid))
+			reta_rebalance_port(portid);
+}
+
 /* Update packets per second value */
 void load_estimator(void)
 {
+	static unsigned int rebalance_ticks;
+
 	unsigned int id, i;
 
 	FOREACH_FORWARD_LCORE(id) {
@@ -3906,6 +4918,19 @@ void load_estimator(void)
 			scale_rate_stats(&conf->crypt_stats, &packets, NULL);
 			dp_crypto_periodic(&conf->crypt.pmd_list);
 		}
+
+		if (conf->do_alg) {
+			packets = CMM_ACCESS_ONCE(conf->alg.packets);
+			scale_rate_stats(&conf->alg_stats, &packets, NULL);
+		}
+	}
+
+	if (rxq_rebalance_enabled &&
+	    ++rebalance_ticks >= RXQ_REBALANCE_INTERVAL) {
+		rebalance_ticks = 0;
+		/* Moving a queue changes the rates, so one at a time */
+		if (!rxq_rebalance())
+			reta_rebalance();
 	}
 }
 
@@ -3998,16 +5023,43 @@ void show_per_core(FILE *f)
 			jsonw_uint_field(wr, "idle", cpq->gov.nap);
 			jsonw_end_object(wr);
 		}
+		if (conf->do_alg) {
+			const struct lcore_alg *alg = &conf->alg;
+
+			jsonw_start_object(wr);
+			jsonw_string_field(wr, "interface", "[alg]");
+			jsonw_uint_field(wr, "packets", alg->packets);
+			jsonw_uint_field(wr, "rate",
+					 conf->alg_stats.packet_rate);
+			jsonw_uint_field(wr, "idle", alg->gov.nap);
+			jsonw_end_object(wr);
+		}
 		jsonw_end_array(wr);
+
+		const struct lcore_cycles *cycles = &conf->cycles;
+
+		jsonw_name(wr, "cycles");
+		jsonw_start_object(wr);
+		jsonw_uint_field(wr, "rx", CMM_ACCESS_ONCE(cycles->rx));
+		jsonw_uint_field(wr, "crypto", CMM_ACCESS_ONCE(cycles->crypto));
+		jsonw_uint_field(wr, "alg", CMM_ACCESS_ONCE(cycles->alg));
+		jsonw_uint_field(wr, "tx", CMM_ACCESS_ONCE(cycles->tx));
+		jsonw_uint_field(wr, "drain", CMM_ACCESS_ONCE(cycles->drain));
+		jsonw_uint_field(wr, "idle", CMM_ACCESS_ONCE(cycles->idle));
+		jsonw_uint_field(wr, "other", CMM_ACCESS_ONCE(cycles->other));
+		jsonw_end_object(wr);
 		jsonw_end_object(wr);
 	}
 	jsonw_end_array(wr);
 
+	jsonw_uint_field(wr, "tsc_hz", rte_get_tsc_hz());
 	bitmask_sprint(&crypto_cpus, tmp, sizeof(tmp));
 	jsonw_string_field(wr, "crypto_permitted_cores", tmp);
 	jsonw_uint_field(wr, "crypto_sticky", crypto_sticky);
 	bitmask_sprint(&crypto_active_cpus, tmp, sizeof(tmp));
 	jsonw_string_field(wr, "crypto_active_cores", tmp);
+	bitmask_sprint(&alg_active_cpus, tmp, sizeof(tmp));
+	jsonw_string_field(wr, "alg_active_cores", tmp);
 	fwding_cores = fwding_core_mask();
 	bitmask_sprint(&fwding_cores, tmp, sizeof(tmp));
 	jsonw_string_field(wr, "forwarding_cores", tmp);
@@ -4127,6 +5179,12 @@ void set_packet_input_func(packet_input_t input_fn)
 		packet_input_func = ether_input_no_dyn_feats;
 }
 
+void set_packet_burst_input_func(packet_burst_input_t input_fn)
+{
+	/* NULL means process packets one at a time */
+	packet_burst_input_func = input_fn;
+}
+
 void
 switch_port_process_burst(portid_t portid, struct rte_mbuf *pkts[], uint16_t nb)
 {
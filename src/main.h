@@ -48,6 +48,7 @@ struct rte_mempool *mbuf_pool_create(const char *name,
 
 /* Console interface */
 void load_estimator(void);
+void set_rxq_rebalance(bool enable);
 void show_per_core(FILE *f);
 
 extern const char *console_endpoint;
@@ -98,9 +99,12 @@ int assign_queues(portid_t portid);
 void unassign_queues(portid_t portid);
 int enable_transmit_thread(portid_t portid);
 void disable_transmit_thread(portid_t portid);
+uint8_t port_max_tx_rings(portid_t portid);
 void set_port_queue_state(uint16_t port);
+void set_port_socket(portid_t portid, int socketid);
 void reset_port_all_queue_state(uint16_t port);
 bool port_uses_queue_state(uint16_t port);
+int port_ctrl_rxq(portid_t portid);
 int mbuf_pool_init_portid(const portid_t portid);
 void pkt_ring_empty(portid_t portid);
 int eth_port_init(uint8_t start_id, uint8_t num_ports);
@@ -115,8 +119,10 @@ unsigned int probe_crypto_engines(bool *sticky);
 int set_crypto_engines(const char *str, bool *sticky);
 int crypto_assign_engine(int crypto_dev_id);
 void crypto_unassign_from_engine(int lcore);
+int set_alg_workers(const char *str);
 void register_forwarding_cores(void);
 int reconfigure_queues(portid_t portid, uint16_t nb_rx_qs, uint16_t nb_tx_qs);
+int set_pkt_len_online(struct ifnet *ifp, uint32_t mtu);
 int reconfigure_pkt_len(struct ifnet *ifp, uint32_t mtu);
 typedef int (*reconfigure_port_cb_fn)(struct ifnet *ifp,
 				      struct rte_eth_conf *dev_conf);
@@ -101,6 +101,9 @@ struct master_time_s {
 };
 static struct master_time_s master_time[CONT_SRC_COUNT];
 
+/* Reconnecting with config kept, to resync only the messages missed */
+static bool master_delta[CONT_SRC_COUNT];
+
 /* expected asynchronous responses from controller */
 struct response {
 	unsigned int portid;
@@ -349,6 +352,20 @@ static void load_timer_event(struct rte_timer *tim __rte_unused,
 	load_estimator();
 }
 
+/*
+ * Arm a periodic ageing timer on the master lcore. The period is
+ * stretched by up to 1/16 at random, so that timers started together
+ * drift apart rather than all firing in the same pass.
+ */
+int master_aging_timer_reset(struct rte_timer *tim, uint64_t ticks,
+			     rte_timer_cb_t fn, void *arg)
+{
+	ticks += (ticks / 16) * (random() % 1024) / 1024;
+
+	return rte_timer_reset(tim, ticks, PERIODICAL,
+			       rte_get_master_lcore(), fn, arg);
+}
+
 void enable_soft_clock_override(void)
 {
 	soft_clock_override = 1;
@@ -418,7 +435,12 @@ static void reset_timer_event(struct rte_timer *tim __rte_unused,
 }
 
 /* Force stop of all traffic.
-   Start resynchronization process. */
+   Start resynchronization process.
+
+   Nothing is kept across the reset: next hops hold pointers to the
+   interfaces freed by if_cleanup(), and sessions hold references to
+   the rules and NAT pools that the resync recreates, so the FIB,
+   neighbours and sessions are all rebuilt from the controller. */
 void reset_dataplane(enum cont_src_en cont_src, bool delay)
 {
 	RTE_LOG(NOTICE, DATAPLANE,
@@ -429,6 +451,8 @@ void reset_dataplane(enum cont_src_en cont_src, bool delay)
 		RETRY_MAX_DELAY_SEC);
 
 	master_state_set(cont_src, MASTER_RESET);
+	master_delta[cont_src] = false;
+	controller_forget_config_gen(cont_src);
 
 	/* Flush old state */
 	dp_event(DP_EVT_RESET_CONFIG, cont_src, NULL, 0, 0, NULL);
@@ -450,6 +474,35 @@ void reset_dataplane(enum cont_src_en cont_src, bool delay)
 	}
 }
 
+/*
+ * Lost the controller, but the config we hold is still what it sent
+ * us.  If it can answer a delta resync, keep everything, ports
+ * included, and on reconnect ask only for what we missed.  Otherwise,
+ * or when the process would restart anyway, this is a full reset.
+ */
+static void reconnect_dataplane(enum cont_src_en cont_src)
+{
+	if (is_local_controller() || cont_src == CONT_SRC_UPLINK ||
+	    !controller_has_config_gen(cont_src)) {
+		reset_dataplane(cont_src, true);
+		return;
+	}
+
+	RTE_LOG(NOTICE, DATAPLANE,
+		"master(%s) RECONNECT keeping config, in %lus (max %ds)\n",
+		cont_src_name(cont_src),
+		master_time[cont_src].retry_delay / rte_get_timer_hz(),
+		RETRY_MAX_DELAY_SEC);
+
+	master_state_set(cont_src, MASTER_RESET);
+	master_delta[cont_src] = true;
+
+	rte_timer_reset(&master_time[cont_src].reset_timer,
+			master_time[cont_src].retry_delay,
+			SINGLE, rte_get_master_lcore(),
+			reset_timer_event, (void *)cont_src);
+}
+
 static void handle_port_response(enum cont_src_en cont_src,
 				 struct response *rsp, uint32_t ifindex,
 				 char *ifname)
@@ -609,6 +662,7 @@ static int async_response(void *cont_src_ptr)
 			reset_dataplane(cont_src, true);
 			break;
 		} else if (eof) {
+			master_delta[cont_src] = false;
 			master_state_set(cont_src, MASTER_READY);
 			controller_init_event_handler(cont_src);
 			route_broker_init_event_handler(cont_src);
@@ -766,7 +820,7 @@ static void connect_timeout(struct rte_timer *t __unused, void *cont_src_ptr)
 		RTE_LOG(ERR, DATAPLANE,
 			"master(%s) controller connect timeout\n",
 			cont_src_name(cont_src));
-		reset_dataplane(cont_src, true);
+		reconnect_dataplane(cont_src);
 	}
 }
 
@@ -778,7 +832,7 @@ static void snapshot_timeout(struct rte_timer *t __unused, void *cont_src_ptr)
 		RTE_LOG(ERR, DATAPLANE,
 			"master(%s) controller snapshot timeout\n",
 			cont_src_name(cont_src));
-		reset_dataplane(cont_src, true);
+		reconnect_dataplane(cont_src);
 	}
 }
 
@@ -1280,6 +1334,13 @@ void master_loop(void)
 			/* Connect to publisher */
 			controller_init(cont_src);
 
+			/* Ports kept from before are already registered */
+			if (master_delta[cont_src]) {
+				master_state_set(cont_src,
+						 MASTER_RESYNC_NEEDED);
+				break;
+			}
+
 			/* Connect shadow interfaces to controller */
 			rc = setup_interfaces(0,
 #ifdef HAVE_RTE_ETH_DEV_COUNT_AVAIL
@@ -1305,7 +1366,8 @@ void master_loop(void)
 						async_response,
 						(void *)cont_src, cont_src);
 			/* Get netlink state from controller */
-			rc = controller_snapshot(cont_src);
+			rc = controller_snapshot(cont_src,
+						 master_delta[cont_src]);
 			if (rc < 0) {
 				reset_dataplane(cont_src, true);
 				break;
@@ -13,6 +13,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <rte_timer.h>
 
 #include "control.h"
 #include "compat.h"
@@ -28,6 +29,10 @@ bool dp_test_master_ready(enum cont_src_en cont_src);
 
 int send_dp_event(zmsg_t *msg);
 
+/* Arm a periodic ageing timer, spread away from others of its period */
+int master_aging_timer_reset(struct rte_timer *tim, uint64_t ticks,
+			     rte_timer_cb_t fn, void *arg);
+
 /* For whole dp tests */
 void enable_soft_clock_override(void);
 void disable_soft_clock_override(void);
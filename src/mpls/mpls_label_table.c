@@ -48,6 +48,8 @@ struct cds_lfht;
 #define LABEL_TABLE_LFHT_MIN	32
 /* Max is full label value range */
 #define LABEL_TABLE_LFHT_MAX	(1 << 20)
+/* Labels below this can be looked up by index, rather than hashing */
+#define LABEL_TABLE_DIRECT_MAX	(1 << 18)
 
 struct label_table_node {
 	uint32_t in_label; /* Incoming label */
@@ -70,6 +72,21 @@ static struct cds_list_head label_table_set;
 
 static struct rte_mempool *mpls_oam_pool;
 
+/*
+ * Direct index of the global label table, covering the labels below the
+ * configured table size. Entries are set alongside the hash, which
+ * remains the master copy, so within the range a NULL entry is a miss.
+ */
+struct label_table_direct {
+	struct cds_lfht *label_table;
+	uint32_t size;
+	struct rcu_head rcu_head;
+	struct label_table_node *node[];
+};
+
+static struct label_table_direct *global_label_direct;
+static uint32_t global_label_direct_size;
+
 struct label_table_set_entry {
 	struct cds_list_head entry;
 	int labelspace; /* labelspace indentificator  */
@@ -157,6 +174,63 @@ static void free_label_table_node(struct label_table_node *label_table_entry)
 		 free_label_table_node_rcu);
 }
 
+static void
+mpls_label_direct_set(struct cds_lfht *label_table, uint32_t in_label,
+		      struct label_table_node *node)
+{
+	struct label_table_direct *direct = global_label_direct;
+
+	if (direct && direct->label_table == label_table &&
+	    in_label < direct->size)
+		rcu_assign_pointer(direct->node[in_label], node);
+}
+
+static void
+free_label_table_direct_rcu(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct label_table_direct, rcu_head));
+}
+
+/*
+ * (Re)build the direct index for the global label table from the hash,
+ * or remove it if the table is going away.
+ */
+static void
+mpls_label_direct_build(struct cds_lfht *label_table)
+{
+	struct label_table_direct *direct = NULL, *old;
+	struct label_table_node *entry;
+	struct cds_lfht_iter iter;
+	uint32_t size;
+
+	size = RTE_MIN(global_label_direct_size,
+		       (uint32_t)LABEL_TABLE_DIRECT_MAX);
+	if (label_table && size) {
+		direct = calloc(1, sizeof(*direct) +
+				size * sizeof(direct->node[0]));
+		if (!direct)
+			RTE_LOG(ERR, MPLS,
+				"Failed to allocate label table index\n");
+	}
+
+	if (direct) {
+		direct->label_table = label_table;
+		direct->size = size;
+
+		rcu_read_lock();
+		cds_lfht_for_each_entry(label_table, &iter, entry, node) {
+			if (entry->in_label < size)
+				direct->node[entry->in_label] = entry;
+		}
+		rcu_read_unlock();
+	}
+
+	old = global_label_direct;
+	rcu_assign_pointer(global_label_direct, direct);
+	if (old)
+		call_rcu(&old->rcu_head, free_label_table_direct_rcu);
+}
+
 static void
 free_label_table_set_entry_rcu(struct rcu_head *head)
 {
@@ -248,6 +322,7 @@ mpls_label_table_ins_lbl_internal(struct cds_lfht *label_table,
 					    label_table_node),
 				    mpls_label_table_node_match,
 				    label_table_node, &label_table_node->node);
+	mpls_label_direct_set(label_table, in_label, label_table_node);
 	if (node) {
 		DP_DEBUG(MPLS_CTRL, DEBUG, MPLS,
 			 "Free the old label table entry for label %d\n",
@@ -283,8 +358,10 @@ mpls_label_table_rem_lbl_internal(struct cds_lfht *label_table,
 	node = cds_lfht_iter_get_node(&iter);
 	if (node) {
 		out = caa_container_of(node, struct label_table_node, node);
-		if (!cds_lfht_del(label_table, &out->node))
+		if (!cds_lfht_del(label_table, &out->node)) {
+			mpls_label_direct_set(label_table, in_label, NULL);
 			free_label_table_node(out);
+		}
 		rc = 0;
 	} else {
 		rc = -ENOENT;
@@ -451,6 +528,7 @@ mpls_label_table_get_and_lock(int labelspace)
 		rcu_assign_pointer(global_label_table,
 				   ls_entry->label_table);
 		rcu_read_unlock();
+		mpls_label_direct_build(ls_entry->label_table);
 	}
 	return ls_entry->label_table;
 }
@@ -486,6 +564,7 @@ mpls_label_table_unlock_internal(struct label_table_set_entry *ls_entry)
 		if (ls_entry->labelspace == global_label_space_id) {
 			assert(global_label_table);
 			rcu_assign_pointer(global_label_table, NULL);
+			mpls_label_direct_build(NULL);
 		}
 
 		DP_DEBUG(MPLS_CTRL, DEBUG, MPLS,
@@ -532,12 +611,19 @@ static inline struct label_table_node *
 mpls_label_table_lookup_internal(struct cds_lfht *label_table,
 				 uint32_t in_label)
 {
+	const struct label_table_direct *direct;
 	struct label_table_node in;
 	struct cds_lfht_iter iter;
 	struct cds_lfht_node *node;
 
 	if (unlikely(!label_table))
 		return NULL;
+
+	direct = rcu_dereference(global_label_direct);
+	if (likely(direct && direct->label_table == label_table &&
+		   in_label < direct->size))
+		return rcu_dereference(direct->node[in_label]);
+
 	in.in_label = in_label;
 	cds_lfht_lookup(label_table, mpls_label_table_node_hash(&in),
 			mpls_label_table_node_match, &in, &iter);
@@ -590,6 +676,9 @@ void mpls_label_table_resize(int labelspace, uint32_t max_label)
 	DP_DEBUG(MPLS_CTRL, INFO, MPLS, "mpls label table resize to %u\n",
 		 max_label);
 
+	if (labelspace == global_label_space_id)
+		global_label_direct_size = max_label;
+
 	rcu_read_lock();
 
 	ls_entry = mpls_label_space_entry_get(labelspace);
@@ -603,6 +692,9 @@ void mpls_label_table_resize(int labelspace, uint32_t max_label)
 		if (label_table_entry->in_label >= max_label &&
 		    !cds_lfht_del(ls_entry->label_table,
 				  &label_table_entry->node)) {
+			mpls_label_direct_set(ls_entry->label_table,
+					      label_table_entry->in_label,
+					      NULL);
 			DP_DEBUG(MPLS_CTRL, DEBUG, MPLS,
 				 "purging label %u due to resize\n",
 				 label_table_entry->in_label);
@@ -612,6 +704,11 @@ void mpls_label_table_resize(int labelspace, uint32_t max_label)
 		}
 	}
 
+	/* Unless the purge released the table, index the new range */
+	if (labelspace == global_label_space_id &&
+	    mpls_label_space_entry_get(labelspace))
+		mpls_label_direct_build(ls_entry->label_table);
+
 	rcu_read_unlock();
 }
 
@@ -189,6 +189,18 @@ mstp_msti_flush(struct ifnet *bridge, struct ifnet *port, uint16_t mstid)
 							      vid);
 }
 
+/* After the vlan to MSTI map changes */
+static void
+mstp_vlan_fwd_update(struct ifnet *bridge)
+{
+	struct bridge_softc *sc = bridge->if_softc;
+	struct cds_list_head *entry;
+	struct bridge_port *port;
+
+	bridge_for_each_brport(port, entry, sc)
+		bridge_port_update_vlan_fwd(port);
+}
+
 static void
 mstp_msti_state_change(struct ifnet *bridge, struct ifnet *port, uint16_t mstid,
 		       enum bridge_ifstate state)
@@ -343,6 +355,8 @@ mstp_msti_update(struct ifnet *bridge, uint16_t mstid,
 	if (v2miold != NULL)
 		call_rcu(&v2miold->rcu, mstp_vlan2mstiindex_free);
 
+	mstp_vlan_fwd_update(bridge);
+
 	DP_DEBUG(BRIDGE, INFO, BRIDGE,
 		 "MSTP MSTI %s:%d(%d): %s\n",
 		 bridge->if_name, mstid, mstidindex,
@@ -386,6 +400,7 @@ mstp_bridge_delete(struct ifnet *bridge)
 	if (v2mi != NULL) {
 		rcu_assign_pointer(sc->scbr_vlan2mstiindex, NULL);
 		call_rcu(&v2mi->rcu, mstp_vlan2mstiindex_free);
+		mstp_vlan_fwd_update(bridge);
 	}
 
 	sc->scbr_mstp = NULL;
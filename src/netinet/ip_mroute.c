@@ -137,6 +137,26 @@ static struct rte_meter_srtcm_profile mfc_meter_profile;
 
 static struct cds_lfht *viftable;
 
+/*
+ * Per lcore direct mapped cache of the (S,G) lookup.  Only forwarding
+ * entries are cached, so it is enough to invalidate the whole cache by
+ * bumping the generation whenever one is removed.
+ */
+#define MFC_CACHE_SIZE	256
+
+struct mfc_cache {
+	struct {
+		const struct mcast_vrf *mvrf;
+		struct mfc	*rt;
+		uint32_t	src;
+		uint32_t	grp;
+		uint32_t	gen;
+	} ent[MFC_CACHE_SIZE];
+};
+
+static RTE_DEFINE_PER_LCORE(struct mfc_cache, mfc_cache);
+static uint32_t mfc_cache_gen = 1;
+
 static struct rte_timer mrt_stats_timer;
 static void mrt_stats(struct rte_timer *, void *arg);
 
@@ -267,9 +287,15 @@ static int mfc_match(struct cds_lfht_node *node, const void *_key)
 static void mfc_free(struct rcu_head *head)
 {
 	struct mfc *rt = caa_container_of(head, struct mfc, rcu_head);
+	free(rt->mfc_olist);
 	free(rt);
 }
 
+static void mfc_olist_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct mfc_olist, rcu));
+}
+
 static int vif_match(struct cds_lfht_node *node, const void *_key)
 {
 	struct vif *vifp = caa_container_of(node, struct vif, node);
@@ -308,6 +334,42 @@ static inline struct mfc *mfc_find(struct mcast_vrf *mvrf,
 	return rt;
 }
 
+/* As mfc_find(), but through this lcore's cache */
+static inline struct mfc *mfc_cache_find(struct mcast_vrf *mvrf,
+					 struct in_addr *o,
+					 struct in_addr *g)
+{
+	uint32_t slot = rte_jhash_2words(o->s_addr, g->s_addr, 0) &
+		(MFC_CACHE_SIZE - 1);
+	struct mfc_cache *cache = &RTE_PER_LCORE(mfc_cache);
+	uint32_t gen = CMM_LOAD_SHARED(mfc_cache_gen);
+	struct mfc *rt;
+
+	cmm_smp_rmb();
+	if (cache->ent[slot].gen == gen &&
+	    cache->ent[slot].mvrf == mvrf &&
+	    cache->ent[slot].src == o->s_addr &&
+	    cache->ent[slot].grp == g->s_addr)
+		return cache->ent[slot].rt;
+
+	rt = mfc_find(mvrf, o, g);
+	if (rt && rt->mfc_punt == 0) {
+		cache->ent[slot].mvrf = mvrf;
+		cache->ent[slot].rt = rt;
+		cache->ent[slot].src = o->s_addr;
+		cache->ent[slot].grp = g->s_addr;
+		cache->ent[slot].gen = gen;
+	}
+	return rt;
+}
+
+/* After an mfc is unlinked, so no lcore can keep using it */
+static void mfc_cache_invalidate(void)
+{
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(mfc_cache_gen, mfc_cache_gen + 1);
+}
+
 /*
  * This MUST be called with a rcu_read_lock and only unlocked after vif is
  * no longer used.
@@ -326,6 +388,52 @@ struct vif *get_vif_by_ifindex(unsigned int ifindex)
 	return vifp;
 }
 
+/*
+ * Rebuild the flattened olist from the ifset.  If it can't be
+ * allocated there is no olist, and packets are punted.
+ */
+static void mfc_olist_update(struct mfc *rt)
+{
+	struct mfc_olist *ol, *old;
+	struct cds_lfht_iter iter;
+	struct vif *vifp;
+	unsigned int n = 0;
+
+	cds_lfht_for_each_entry(viftable, &iter, vifp, node)
+		if (IF_ISSET(vifp->v_if_index, &rt->mfc_ifset))
+			n++;
+
+	ol = malloc(sizeof(*ol) + n * sizeof(ol->vifs[0]));
+	if (ol) {
+		ol->parent = get_vif_by_ifindex(rt->mfc_parent);
+		ol->count = 0;
+		cds_lfht_for_each_entry(viftable, &iter, vifp, node)
+			if (IF_ISSET(vifp->v_if_index, &rt->mfc_ifset) &&
+			    vifp->v_ifp && ol->count < n)
+				ol->vifs[ol->count++] = vifp;
+	} else
+		RTE_LOG(ERR, MCAST, "Failure allocating mroute olist\n");
+
+	old = rcu_xchg_pointer(&rt->mfc_olist, ol);
+	if (old)
+		call_rcu(&old->rcu, mfc_olist_free);
+}
+
+/* After the vif table changes */
+static void mfc_olist_update_all(void)
+{
+	struct cds_lfht_iter iter;
+	vrfid_t vrf_id;
+	struct vrf *vrf;
+	struct mfc *rt;
+
+	VRF_FOREACH(vrf, vrf_id) {
+		cds_lfht_for_each_entry(vrf->v_mvrf4.mfchashtbl, &iter,
+					rt, node)
+			mfc_olist_update(rt);
+	}
+}
+
 
 void mrt4_purge(struct ifnet *ifp)
 {
@@ -419,6 +527,7 @@ int add_vif(int ifindex)
 		vifp = caa_container_of(retnode, struct vif, node);
 		call_rcu(&vifp->rcu_head, vif_free);
 	}
+	mfc_olist_update_all();
 	if (ifp) {
 		ip_mcast_fal_int_enable(vifp, viftable);
 		if (!(ifp->if_flags & IFF_MULTICAST))
@@ -448,6 +557,7 @@ int del_vif(vifi_t vifi)
 		if_allmulti(vifp->v_ifp, 0);
 
 	if (!cds_lfht_del(viftable, &vifp->node)) {
+		mfc_olist_update_all();
 		ip_mcast_fal_int_disable(vifp, viftable);
 		call_rcu(&vifp->rcu_head, vif_free);
 	}
@@ -553,6 +663,8 @@ static void update_mfc_params(vrfid_t vrf_id, struct mfc *rt,
 			  &rt->mfc_mcastgrp,
 			  "Cannot forward on this mroute in data plane; punting all packets.");
 	}
+
+	mfc_olist_update(rt);
 }
 
 static inline void init_mfc_counters(struct mfc *rt)
@@ -639,8 +751,10 @@ static void expire_mfc(struct vrf *vrf, struct mfc *rt)
 
 	mroute_hw_stats[old_pd_state]--;
 
-	if (!cds_lfht_del(vrf->v_mvrf4.mfchashtbl, &rt->node))
+	if (!cds_lfht_del(vrf->v_mvrf4.mfchashtbl, &rt->node)) {
+		mfc_cache_invalidate();
 		call_rcu(&rt->rcu_head, mfc_free);
+	}
 }
 
 static void
@@ -782,8 +896,10 @@ int del_mfc(vrfid_t vrf_id, struct vmfcctl *mfccp)
 
 	mroute_hw_stats[old_pd_state]--;
 
-	if (!cds_lfht_del(vrf->v_mvrf4.mfchashtbl, &rt->node))
+	if (!cds_lfht_del(vrf->v_mvrf4.mfchashtbl, &rt->node)) {
+		mfc_cache_invalidate();
 		call_rcu(&rt->rcu_head, mfc_free);
+	}
 
 	/* decrement vrf ref when last mrt is deleted */
 	if (!mvrf_mfc_size(&vrf->v_mvrf4))
@@ -901,7 +1017,7 @@ static int ip_mforward(vrfid_t vrf_id, struct mcast_vrf *mvrf,
 
 	/* Determine forwarding vifs from the forwarding cache table */
 	MRTSTAT_INC(mvrf, mrts_mfc_lookups);
-	rt = mfc_find(mvrf, &ip->ip_src, &ip->ip_dst);
+	rt = mfc_cache_find(mvrf, &ip->ip_src, &ip->ip_dst);
 
 	/* Entry exists, so forward if necessary */
 	if (rt && (rt->mfc_punt == 0))
@@ -985,21 +1101,38 @@ static void expire_upcalls(__attribute__((unused)) struct rte_timer *rtetm,
 }
 #endif
 
-static int mcast_ethernet_send(struct ifnet *in_ifp,
-			       struct vif *out_vifp,
-			       struct rte_mbuf *m, int plen)
+/*
+ * Build the header shared by all Ethernet replications of a packet:
+ * the TTL is decremented and the destination MAC set once, leaving
+ * only the source MAC to be filled in per output interface.
+ */
+static struct rte_mbuf *mcast_ethernet_template(struct rte_mbuf *m,
+						struct rte_mbuf *md)
 {
+	struct rte_mbuf *mt;
 	struct iphdr *ip;
 	struct ether_hdr *eth_hdr;
 
-	ip = iphdr(m);
+	mt = mcast_create_l2l3_header(m, md, sizeof(struct iphdr));
+	if (!mt)
+		return NULL;
+
+	ip = iphdr(mt);
 	decrement_ttl(ip);
 
 	mcast_dst_eth_addr_t eth_daddr = mcast_dst_eth_addr(ip->daddr);
-	eth_hdr = rte_pktmbuf_mtod(m, struct ether_hdr *);
+	eth_hdr = rte_pktmbuf_mtod(mt, struct ether_hdr *);
 	ether_addr_copy(&eth_daddr.as_addr, &eth_hdr->d_addr);
 
-	mc_ip_output(in_ifp, m, out_vifp->v_ifp, ip);
+	return mt;
+}
+
+/* The packet header has been copied from mcast_ethernet_template() */
+static int mcast_ethernet_send(struct ifnet *in_ifp,
+			       struct vif *out_vifp,
+			       struct rte_mbuf *m, int plen)
+{
+	mc_ip_output(in_ifp, m, out_vifp->v_ifp, iphdr(m));
 	out_vifp->v_pkt_out++;
 	out_vifp->v_bytes_out += plen;
 	return 0;
@@ -1089,13 +1222,14 @@ static void vif_send(struct ifnet *in_ifp, struct vif *out_vifp,
 static int ip_mdq(struct mcast_vrf *mvrf, struct rte_mbuf *m, struct ip *ip,
 		  struct ifnet *ifp, struct mfc *rt)
 {
+	struct mfc_olist *ol = rcu_dereference(rt->mfc_olist);
 	struct vif *vifp;
 	int plen = ntohs(ip->ip_len);
-	struct cds_lfht_iter iter;
-	struct rte_mbuf *md, *mh;
+	struct rte_mbuf *md, *mh, *mt = NULL;
+	unsigned int i;
 
 	/* Don't forward if it didn't arrive on parent vif for its origin. */
-	vifp = get_vif_by_ifindex(rt->mfc_parent);
+	vifp = ol ? ol->parent : NULL;
 	if (!vifp || (vifp->v_if_index != ifp->if_index)) {
 		MRTSTAT_INC(mvrf, mrts_wrong_if);
 		++rt->mfc_wrong_if;
@@ -1135,30 +1269,42 @@ static int ip_mdq(struct mcast_vrf *mvrf, struct rte_mbuf *m, struct ip *ip,
 
 	rte_pktmbuf_adj(md, pktmbuf_l2_len(md) + sizeof(struct iphdr));
 
-	/* For each dataplane vif, forward if:
-	 *	- the ifset bit is set for this interface.
+	/* For each dataplane vif in the olist, forward if:
 	 *	- there are group members downstream on interface */
-	cds_lfht_for_each_entry(viftable, &iter, vifp, node) {
-		if (IF_ISSET(vifp->v_if_index, &rt->mfc_ifset) &&
-		    ip->ip_ttl > vifp->v_threshold) {
-			if (!vifp->v_ifp)
-				continue;
-
-			mh = mcast_create_l2l3_header(m, md,
-						      sizeof(struct iphdr));
-			if (mh) {
-				/* send the newly created packet chain */
-				vif_send(ifp, vifp, mh, plen);
+	for (i = 0; i < ol->count; i++) {
+		vifp = ol->vifs[i];
+		if (ip->ip_ttl > vifp->v_threshold) {
+			if (unlikely(vifp->v_flags & VIFF_TUNNEL)) {
+				mh = mcast_create_l2l3_header(
+					m, md, sizeof(struct iphdr));
 			} else {
-				rte_pktmbuf_free(md);
-				return -ENOBUFS;
+				if (!mt) {
+					mt = mcast_ethernet_template(m, md);
+					if (!mt)
+						goto nobufs;
+				}
+				mh = mcast_create_l2l3_header(
+					mt, md, sizeof(struct iphdr));
 			}
+			if (!mh)
+				goto nobufs;
+
+			/* send the newly created packet chain */
+			vif_send(ifp, vifp, mh, plen);
 		}
 	}
 	/* We still hold a lock on the newly created initial data segment and
 	 *  its children, so release that now */
+	if (mt)
+		rte_pktmbuf_free(mt);
 	rte_pktmbuf_free(md);
 	return 0;
+
+nobufs:
+	if (mt)
+		rte_pktmbuf_free(mt);
+	rte_pktmbuf_free(md);
+	return -ENOBUFS;
 }
 
 /*
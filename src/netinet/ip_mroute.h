@@ -148,6 +148,18 @@ struct mfc_key {
 
 #define MFCKEYLEN (sizeof(struct mfc_key)/4)
 
+/*
+ * The forwarding vifs of an mfc, flattened from mfc_ifset so that
+ * forwarding doesn't walk the whole vif table.  Rebuilt whenever the
+ * ifset or the vif table changes.
+ */
+struct mfc_olist {
+	struct rcu_head	rcu;
+	struct vif	*parent;	/* NULL if mfc_parent has no vif */
+	unsigned int	count;
+	struct vif	*vifs[];
+};
+
 /*
  * The kernel's multicast forwarding cache entry structure
  */
@@ -160,6 +172,7 @@ struct mfc {
 	vifi_t		mfc_controller;		/* all packets to controller */
 	struct if_set	mfc_ifset;		/* set of outgoing IFs   */
 	unsigned char   mfc_olist_size;         /* number of intfs in olist  */
+	struct mfc_olist *mfc_olist;		/* ifset as vifs             */
 	struct rte_meter_srtcm meter;		/* punt rate meter           */
 	uint64_t	mfc_pkt_cnt;		/* pkt count for src-grp     */
 	uint64_t	mfc_byte_cnt;		/* byte count for src-grp    */
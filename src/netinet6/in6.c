@@ -303,9 +303,14 @@ bad:
 	return 0;
 }
 
-/* Chase through the headers, jumping over extension headers */
+/*
+ * Chase through the headers, jumping over extension headers.  Starts
+ * from where ipv6-validate or the firewall found the upper layer
+ * header, if they have.
+ */
 uint16_t ip6_findpayload(struct rte_mbuf *m, uint16_t *offset)
 {
+	const struct pkt_mdata_l4 *ml;
 	struct ip6_hdr *ip6 = ip6hdr(m);
 	struct ip6_ext *ip6e;
 	struct ip6_frag *fh;
@@ -313,6 +318,14 @@ uint16_t ip6_findpayload(struct rte_mbuf *m, uint16_t *offset)
 	uint16_t off = pktmbuf_l2_len(m) + sizeof(*ip6);
 	uint16_t proto = ip6->ip6_nxt;
 
+	if (ip6_is_ext_hdr(proto)) {
+		ml = pktmbuf_mdata_l4(m, pktmbuf_l2_len(m));
+		if (ml && ml->ml_proto != IPPROTO_NONE) {
+			off = ml->ml_l4_offs;
+			proto = ml->ml_proto;
+		}
+	}
+
 	for (;;) {
 		switch (proto) {
 		case IPPROTO_IPV6:
@@ -362,3 +375,56 @@ uint16_t ip6_findpayload(struct rte_mbuf *m, uint16_t *offset)
 bad:
 	return IPPROTO_MAX;
 }
+
+/*
+ * Walk the extension headers once on input, and record where the
+ * upper layer header is in the packet metadata for the later
+ * consumers: the firewall, sessions, ECMP and ip6_findpayload.  As
+ * with ip6_findpayload, the walk stops at the fragment header of a
+ * second or later fragment, which has no upper layer header.  Only
+ * needed if ip6_is_ext_hdr(ip6->ip6_nxt).
+ */
+void ip6_ext_hdrs_walk(struct rte_mbuf *m, const struct ip6_hdr *ip6)
+{
+	struct pkt_mdata_l4 *ml;
+	struct ip6_ext *ip6e;
+	struct ip6_frag *fh;
+	uint16_t off = pktmbuf_l2_len(m) + sizeof(*ip6);
+	uint8_t proto = ip6->ip6_nxt;
+	uint8_t flags = 0;
+
+	while (ip6_is_ext_hdr(proto)) {
+		if (proto == IPPROTO_FRAGMENT) {
+			fh = ip6_exthdr(m, off, sizeof(*fh));
+			if (!fh)
+				return;
+
+			flags |= PKT_MDATA_L4_FRAG;
+			if (fh->ip6f_offlg & IP6F_OFF_MASK)
+				break;
+			off += sizeof(*fh);
+			proto = fh->ip6f_nxt;
+			continue;
+		}
+
+		ip6e = ip6_exthdr(m, off, sizeof(*ip6e));
+		if (!ip6e)
+			return;
+
+		if (proto == IPPROTO_AH) {
+			off += (ip6e->ip6e_len + 2) << 2;
+		} else {
+			if (proto == IPPROTO_ROUTING)
+				flags |= PKT_MDATA_L4_ROUTING;
+			off += (ip6e->ip6e_len + 1) << 3;
+		}
+		proto = ip6e->ip6e_nxt;
+	}
+
+	ml = &pktmbuf_mdata(m)->md_l4;
+	ml->ml_l3_offs = pktmbuf_l2_len(m);
+	ml->ml_l4_offs = off;
+	ml->ml_proto = proto;
+	ml->ml_flags = flags;
+	pktmbuf_mdata_set(m, PKT_MDATA_L4);
+}
@@ -75,6 +75,7 @@
 #include <stdint.h>
 
 struct ifnet;
+struct ip6_hdr;
 
 #define IPV6_VERSION            0x60
 #define IPV6_VERSION_MASK       0xf0
@@ -180,6 +181,23 @@ static inline bool in6_is_addr_id_zero(const struct in6_addr *addr)
 	return ((const uint64_t *)(addr))[1] == 0;
 }
 
+/*
+ * The extension headers skipped over to find the upper layer header.
+ * All are below 64, so a packet with none, the common case, is told
+ * apart with a shift and mask and without a walk.
+ */
+#define IP6_EXT_HDR_MASK			\
+	((1ull << IPPROTO_HOPOPTS) |		\
+	 (1ull << IPPROTO_ROUTING) |		\
+	 (1ull << IPPROTO_FRAGMENT) |		\
+	 (1ull << IPPROTO_AH) |			\
+	 (1ull << IPPROTO_DSTOPTS))
+
+static inline bool ip6_is_ext_hdr(uint8_t proto)
+{
+	return proto < 64 && ((IP6_EXT_HDR_MASK >> proto) & 1);
+}
+
 static inline void *ip6_exthdr(struct rte_mbuf *m, uint16_t offs, size_t len)
 {
 	if (offs + len > rte_pktmbuf_data_len(m))
@@ -194,5 +212,6 @@ struct lltable *in6_domifattach(struct ifnet *ifp);
 uint32_t in6_addr_hash(const void *key, uint32_t key_len, uint32_t init_val);
 uint16_t ip6_findprevoff(struct rte_mbuf *m);
 uint16_t ip6_findpayload(struct rte_mbuf *m, uint16_t *offset);
+void ip6_ext_hdrs_walk(struct rte_mbuf *m, const struct ip6_hdr *ip6);
 
 #endif /* IN6_H */
@@ -279,6 +279,14 @@ struct rte_mbuf *icmp6_do_error(struct ifnet *rcvif, struct rte_mbuf *n,
 	if (icmp6_ignore(n))
 		return NULL;
 
+	/* Limit per /64, other than Packet Too Big for path MTU discovery */
+	if (type != ICMP6_PACKET_TOO_BIG &&
+	    icmp_ratelimit(oip6->ip6_src.s6_addr32[0] ^
+			   oip6->ip6_src.s6_addr32[1])) {
+		ICMP6STAT_INC(pktmbuf_get_vrf(n), ICMP6_MIB_RATELIMITHOST);
+		return NULL;
+	}
+
 	/* Find our source address on the interface */
 	const struct in6_addr *saddr
 		= ip6_select_source(rcvif, &oip6->ip6_dst);
@@ -162,6 +162,26 @@ static struct rte_meter_srtcm_profile mfc_meter_profile;
 
 static struct cds_lfht *mif6table;
 
+/*
+ * Per lcore direct mapped cache of the (S,G) lookup.  Only forwarding
+ * entries are cached, so it is enough to invalidate the whole cache by
+ * bumping the generation whenever one is removed.
+ */
+#define MF6C_CACHE_SIZE	256
+
+struct mf6c_cache {
+	struct {
+		struct in6_addr	src;
+		struct in6_addr	grp;
+		const struct mcast6_vrf *mvrf6;
+		struct mf6c	*rt;
+		uint32_t	gen;
+	} ent[MF6C_CACHE_SIZE];
+};
+
+static RTE_DEFINE_PER_LCORE(struct mf6c_cache, mf6c_cache);
+static uint32_t mf6c_cache_gen = 1;
+
 #define UPCALL_TIMER 1
 #ifdef UPCALL_TIMER
 static struct rte_timer expire_upcalls_ch;
@@ -292,9 +312,15 @@ static int mf6c_match(struct cds_lfht_node *node, const void *_key)
 static void mf6c_free(struct rcu_head *head)
 {
 	struct mf6c *rt = caa_container_of(head, struct mf6c, rcu_head);
+	free(rt->mf6c_olist);
 	free(rt);
 }
 
+static void mf6c_olist_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct mf6c_olist, rcu));
+}
+
 static int mif6_match(struct cds_lfht_node *node, const void *_key)
 {
 	struct mif6 *mifp = caa_container_of(node, struct mif6, node);
@@ -334,6 +360,43 @@ static struct mf6c *mf6c_find(struct mcast6_vrf *mvrf6,
 	return rt;
 }
 
+/* As mf6c_find(), but through this lcore's cache */
+static inline struct mf6c *mf6c_cache_find(struct mcast6_vrf *mvrf6,
+					   struct in6_addr *o,
+					   struct in6_addr *g)
+{
+	uint32_t slot = rte_jhash_2words(o->s6_addr32[3], g->s6_addr32[3],
+					 g->s6_addr32[0]) &
+		(MF6C_CACHE_SIZE - 1);
+	struct mf6c_cache *cache = &RTE_PER_LCORE(mf6c_cache);
+	uint32_t gen = CMM_LOAD_SHARED(mf6c_cache_gen);
+	struct mf6c *rt;
+
+	cmm_smp_rmb();
+	if (cache->ent[slot].gen == gen &&
+	    cache->ent[slot].mvrf6 == mvrf6 &&
+	    IN6_ARE_ADDR_EQUAL(&cache->ent[slot].grp, g) &&
+	    IN6_ARE_ADDR_EQUAL(&cache->ent[slot].src, o))
+		return cache->ent[slot].rt;
+
+	rt = mf6c_find(mvrf6, o, g);
+	if (rt && rt->mf6c_punt == 0) {
+		cache->ent[slot].src = *o;
+		cache->ent[slot].grp = *g;
+		cache->ent[slot].mvrf6 = mvrf6;
+		cache->ent[slot].rt = rt;
+		cache->ent[slot].gen = gen;
+	}
+	return rt;
+}
+
+/* After an mf6c is unlinked, so no lcore can keep using it */
+static void mf6c_cache_invalidate(void)
+{
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(mf6c_cache_gen, mf6c_cache_gen + 1);
+}
+
 /*
  * This MUST be called with a rcu_read_lock and only unlocked after mif6 is
  * no longer used.
@@ -352,6 +415,52 @@ struct mif6* get_mif_by_ifindex(unsigned int ifindex)
 	return mifp;
 }
 
+/*
+ * Rebuild the flattened olist from the ifset.  If it can't be
+ * allocated there is no olist, and packets are punted.
+ */
+static void mf6c_olist_update(struct mf6c *rt)
+{
+	struct mf6c_olist *ol, *old;
+	struct cds_lfht_iter iter;
+	struct mif6 *mifp;
+	unsigned int n = 0;
+
+	cds_lfht_for_each_entry(mif6table, &iter, mifp, node)
+		if (IF_ISSET(mifp->m6_if_index, &rt->mf6c_ifset))
+			n++;
+
+	ol = malloc(sizeof(*ol) + n * sizeof(ol->mifs[0]));
+	if (ol) {
+		ol->parent = get_mif_by_ifindex(rt->mf6c_parent);
+		ol->count = 0;
+		cds_lfht_for_each_entry(mif6table, &iter, mifp, node)
+			if (IF_ISSET(mifp->m6_if_index, &rt->mf6c_ifset) &&
+			    ol->count < n)
+				ol->mifs[ol->count++] = mifp;
+	} else
+		RTE_LOG(ERR, MCAST, "Failure allocating mroute6 olist\n");
+
+	old = rcu_xchg_pointer(&rt->mf6c_olist, ol);
+	if (old)
+		call_rcu(&old->rcu, mf6c_olist_free);
+}
+
+/* After the mif table changes */
+static void mf6c_olist_update_all(void)
+{
+	struct cds_lfht_iter iter;
+	vrfid_t vrf_id;
+	struct vrf *vrf;
+	struct mf6c *rt;
+
+	VRF_FOREACH(vrf, vrf_id) {
+		cds_lfht_for_each_entry(vrf->v_mvrf6.mf6ctable, &iter,
+					rt, node)
+			mf6c_olist_update(rt);
+	}
+}
+
 void mrt6_purge(struct ifnet *ifp)
 {
 	struct mif6 *mifp;
@@ -437,6 +546,7 @@ int add_m6if(mifi_t ifindex)
 		mifp = caa_container_of(retnode, struct mif6, node);
 		call_rcu(&mifp->rcu_head, mif6_free);
 	}
+	mf6c_olist_update_all();
 	if (ifp) {
 		ip6_mcast_fal_int_enable(mifp, mif6table);
 		if (!(ifp->if_flags & IFF_MULTICAST))
@@ -556,6 +666,8 @@ static void update_mfc6_params(vrfid_t vrf_id, struct mf6c *rt,
 		mfc6_debug(vrf_id, &rt->mf6c_origin, &rt->mf6c_mcastgrp,
 			   "Cannot forward on this mroute in data plane; punting all packets.");
 	}
+
+	mf6c_olist_update(rt);
 }
 
 /*
@@ -579,6 +691,7 @@ int del_m6if(mifi_t mifi)
 		if_allmulti(ifp, 0);
 
 	if (!cds_lfht_del(mif6table, &mifp->node)) {
+		mf6c_olist_update_all();
 		ip6_mcast_fal_int_disable(mifp, mif6table);
 		call_rcu(&mifp->rcu_head, mif6_free);
 	}
@@ -783,8 +896,10 @@ int del_m6fc(vrfid_t vrf_id, struct vmf6cctl *mfccp)
 
 	mroute6_hw_stats[old_pd_state]--;
 
-	if (!cds_lfht_del(vrf->v_mvrf6.mf6ctable, &rt->node))
+	if (!cds_lfht_del(vrf->v_mvrf6.mf6ctable, &rt->node)) {
+		mf6c_cache_invalidate();
 		call_rcu(&rt->rcu_head, mf6c_free);
+	}
 
 	/* decrement vrf ref cnt when last mrt deleted */
 	if (!mvrf_m6fc_size(&vrf->v_mvrf6))
@@ -857,7 +972,7 @@ static int ip6_mforward(vrfid_t vrf_id, struct mcast6_vrf *mvrf6,
 
 	/* Determine forwarding mifs from the forwarding cache table */
 	MRT6STAT_INC(mvrf6, mrt6s_mfc_lookups);
-	rt = mf6c_find(mvrf6, &ip6->ip6_src, &ip6->ip6_dst);
+	rt = mf6c_cache_find(mvrf6, &ip6->ip6_src, &ip6->ip6_dst);
 
 	if (rt && (rt->mf6c_punt == 0))
 		return ip6_mdq(mvrf6, m, ifp, rt);
@@ -944,27 +1059,49 @@ static void expire_upcalls(__attribute__((unused)) struct rte_timer *rtetm,
 }
 #endif
 
-static int mcast6_ethernet_send(struct mif6 *mifp, struct rte_mbuf *m,
-				struct ifnet *in_ifp)
+/*
+ * Build the header shared by all Ethernet replications of a packet:
+ * the hop limit is decremented and the destination MAC set once,
+ * leaving only the source MAC to be filled in per output interface.
+ */
+static struct rte_mbuf *mcast6_ethernet_template(struct rte_mbuf *m,
+						 struct rte_mbuf *md)
 {
-	struct ifnet *ifp = mifp->m6_ifp;
-	struct ip6_hdr *ip6 = ip6hdr(m);
+	struct rte_mbuf *mt;
+	struct ip6_hdr *ip6;
 	struct ether_hdr *eth_hdr;
 	mcast_dst_eth_addr_t eth_daddr;
 
-	if (unlikely(rte_pktmbuf_pkt_len(m) > ifp->if_mtu))
-		return ICMP6_PACKET_TOO_BIG;
+	mt = mcast_create_l2l3_header(m, md, sizeof(struct ip6_hdr));
+	if (!mt)
+		return NULL;
 
 	/*
 	 * Time to decrement ttl since packet is being forwarded, not
 	 * just punted. It was previously tested to ensure it is greater
 	 * than 1 so there is no need to test for ttl expire here.
 	 */
+	ip6 = ip6hdr(mt);
 	ip6->ip6_hlim--;
 
-	eth_hdr = rte_pktmbuf_mtod(m, struct ether_hdr *);
+	eth_hdr = rte_pktmbuf_mtod(mt, struct ether_hdr *);
 	eth_daddr = mcast6_dst_eth_addr(&ip6->ip6_dst);
 	ether_addr_copy(&eth_daddr.as_addr, &eth_hdr->d_addr);
+
+	return mt;
+}
+
+/* The packet header has been copied from mcast6_ethernet_template() */
+static int mcast6_ethernet_send(struct mif6 *mifp, struct rte_mbuf *m,
+				struct ifnet *in_ifp)
+{
+	struct ifnet *ifp = mifp->m6_ifp;
+	struct ether_hdr *eth_hdr;
+
+	if (unlikely(rte_pktmbuf_pkt_len(m) > ifp->if_mtu))
+		return ICMP6_PACKET_TOO_BIG;
+
+	eth_hdr = rte_pktmbuf_mtod(m, struct ether_hdr *);
 	ether_addr_copy(&ifp->eth_addr, &eth_hdr->s_addr);
 
 	if_output(ifp, m, in_ifp, ETH_P_IPV6);
@@ -1065,15 +1202,16 @@ static void mif6_send(struct ifnet *in_ifp, struct mif6 *out_mifp,
 static int ip6_mdq(struct mcast6_vrf *mvrf6, struct rte_mbuf *m,
 		   struct ifnet *ifp, struct mf6c *rt)
 {
+	struct mf6c_olist *ol = rcu_dereference(rt->mf6c_olist);
 	struct ip6_hdr *ip6 = ip6hdr(m);
 	struct mif6 *mifp;
 	int plen = rte_pktmbuf_pkt_len(m);
 	u_int32_t iszone, idzone;
-	struct cds_lfht_iter iter;
-	struct rte_mbuf *md, *mh;
+	struct rte_mbuf *md, *mh, *mt = NULL;
+	unsigned int i;
 
 	/* Don't forward if it didn't arrive on parent mif* for its origin.  */
-	mifp = get_mif_by_ifindex(rt->mf6c_parent);
+	mifp = ol ? ol->parent : NULL;
 	if (mifp == NULL || mifp->m6_if_index != ifp->if_index) {
 		/* if wrong iif */
 		MRT6STAT_INC(mvrf6, mrt6s_wrong_if);
@@ -1134,28 +1272,43 @@ static int ip6_mdq(struct mcast6_vrf *mvrf6, struct rte_mbuf *m,
 
 	rte_pktmbuf_adj(md, pktmbuf_l2_len(md) + sizeof(struct ip6_hdr));
 
-	/* For each mif, forward a copy of the packet if there are group
-	 * members downstream on the interface. */
-	cds_lfht_for_each_entry(mif6table, &iter, mifp, node) {
-		if (IF_ISSET(mifp->m6_if_index, &rt->mf6c_ifset)) {
-			mifp->m6_pkt_out++;
-			mifp->m6_bytes_out += plen;
-			if (!mifp->m6_ifp)
-				continue;
-
-			mh = mcast_create_l2l3_header(m, md,
-						      sizeof(struct ip6_hdr));
-			if (mh) {
-				/* send the newly created packet chain */
-				mif6_send(ifp, mifp, mh, plen);
-			} else {
-				rte_pktmbuf_free(md);
-				return -ENOBUFS;
+	/* For each mif in the olist, forward a copy of the packet if there
+	 * are group members downstream on the interface. */
+	for (i = 0; i < ol->count; i++) {
+		mifp = ol->mifs[i];
+		mifp->m6_pkt_out++;
+		mifp->m6_bytes_out += plen;
+		if (!mifp->m6_ifp)
+			continue;
+
+		if (unlikely(mifp->m6_flags & VIFF_TUNNEL)) {
+			mh = mcast_create_l2l3_header(
+				m, md, sizeof(struct ip6_hdr));
+		} else {
+			if (!mt) {
+				mt = mcast6_ethernet_template(m, md);
+				if (!mt)
+					goto nobufs;
 			}
+			mh = mcast_create_l2l3_header(
+				mt, md, sizeof(struct ip6_hdr));
 		}
+		if (!mh)
+			goto nobufs;
+
+		/* send the newly created packet chain */
+		mif6_send(ifp, mifp, mh, plen);
 	}
+	if (mt)
+		rte_pktmbuf_free(mt);
 	rte_pktmbuf_free(md);
 	return 0;
+
+nobufs:
+	if (mt)
+		rte_pktmbuf_free(mt);
+	rte_pktmbuf_free(md);
+	return -ENOBUFS;
 }
 
 /*
@@ -1526,8 +1679,10 @@ static void expire_mf6c(struct vrf *vrf, struct mf6c *rt)
 
 	mroute6_hw_stats[old_pd_state]--;
 
-	if (!cds_lfht_del(vrf->v_mvrf6.mf6ctable, &rt->node))
+	if (!cds_lfht_del(vrf->v_mvrf6.mf6ctable, &rt->node)) {
+		mf6c_cache_invalidate();
 		call_rcu(&rt->rcu_head, mf6c_free);
+	}
 }
 
 void mcast_init_ipv6(void)
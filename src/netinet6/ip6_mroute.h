@@ -129,6 +129,18 @@ struct mf6c_key {
 
 #define MF6CKEYLEN (sizeof(struct mf6c_key) / 4)
 
+/*
+ * The forwarding mifs of an mf6c, flattened from mf6c_ifset so that
+ * forwarding doesn't walk the whole mif table.  Rebuilt whenever the
+ * ifset or the mif table changes.
+ */
+struct mf6c_olist {
+	struct rcu_head	rcu;
+	struct mif6	*parent;	/* NULL if mf6c_parent has no mif */
+	unsigned int	count;
+	struct mif6	*mifs[];
+};
+
 /*
  * The kernel's multicast forwarding cache entry structure
  */
@@ -140,6 +152,7 @@ struct mf6c {
 	mifi_t			mf6c_parent;	 /* incoming IF              */
 	struct if_set		mf6c_ifset;	 /* set of outgoing IFs      */
 	unsigned char           mf6c_olist_size; /* number of intfs in olist  */
+	struct mf6c_olist	*mf6c_olist;	 /* ifset as mifs            */
 	struct rte_meter_srtcm  meter;		 /* punt rate meter          */
 	int			mf6c_controller; /* forward via controller   */
 	uint64_t		mf6c_pkt_cnt;	 /* pkt count for src-grp    */
@@ -7,6 +7,7 @@
  */
 
 #include <arpa/inet.h>
+#include <assert.h>
 #include <errno.h>
 #include <linux/netlink.h>
 #include <pthread.h>
@@ -35,6 +36,7 @@
 #include "compat.h"
 #include "control.h"
 #include "dp_event.h"
+#include "dp_mem.h"
 #include "ecmp.h"
 #include "fal.h"
 #include "if_var.h"
@@ -93,6 +95,7 @@ struct next_hop_v6_u {
 	uint32_t             nsiblings; /* size of next_hop array */
 	uint32_t             refcount; /* # of LPM entries referring */
 	uint32_t             index;
+	uint16_t             *buckets; /* resilient hash table, ECMP only */
 	struct next_hop_v6   hop0;     /* optimization for non-ECMP */
 	struct cds_lfht_node nh_node;
 	enum pd_obj_state    pd_state;
@@ -467,7 +470,8 @@ static int rt_lpm_v6_resize(struct route6_head *rt6_head, uint32_t id)
 	if (id < rt6_head->rt6_rtm_max)
 		return 0;
 
-	new_tbl = malloc_huge_aligned((id + 1) * sizeof(struct lpm6 *));
+	new_tbl = dp_mem_huge_alloc(DP_MEM_LPM6,
+				    (id + 1) * sizeof(struct lpm6 *));
 	if (new_tbl == NULL) {
 		RTE_LOG(ERR, ROUTE6,
 			"Can't grow v6 LPM table\n");
@@ -485,8 +489,8 @@ static int rt_lpm_v6_resize(struct route6_head *rt6_head, uint32_t id)
 	rt6_head->rt6_rtm_max = id + 1;
 
 	if (old_tbl) {
-		if (defer_rcu_huge(old_tbl,
-				   (old_id * sizeof(struct lpm6 *)))) {
+		if (dp_mem_huge_defer_free(DP_MEM_LPM6, old_tbl,
+					   (old_id * sizeof(struct lpm6 *)))) {
 			RTE_LOG(ERR, LPM, "Failed to free old v6 LPM tbl\n");
 			return -1;
 		}
@@ -734,8 +738,8 @@ void route_v6_uninit(struct vrf *vrf, struct route6_head *rt6_head)
 			lpm6_free(lpm);
 		}
 	}
-	free_huge(rt6_head->rt6_table, (rt6_head->rt6_rtm_max *
-					sizeof(struct lpm6 *)));
+	dp_mem_huge_free(DP_MEM_LPM6, rt6_head->rt6_table,
+			 (rt6_head->rt6_rtm_max * sizeof(struct lpm6 *)));
 	rt6_head->rt6_table = NULL;
 }
 
@@ -813,18 +817,21 @@ void rt6_prefetch(const struct rte_mbuf *m, const struct in6_addr *dst)
 ALWAYS_INLINE
 struct next_hop_v6 *nexthop6_select_internal(struct next_hop_v6 *next,
 					     uint32_t size,
-					     uint32_t hash)
+					     uint32_t hash,
+					     const uint16_t *buckets)
 {
 	uint32_t path;
 
-	if (ecmp_max_path && ecmp_max_path < size)
+	if (ecmp_max_path && ecmp_max_path < size) {
 		size = ecmp_max_path;
+		buckets = NULL;
+	}
 
-	path = ecmp_lookup(size, hash);
-	if (unlikely(next[path].flags & RTF_DEAD)) {
+	path = ecmp_lookup(size, hash, buckets);
+	if (unlikely(next[path].flags & (RTF_DEAD | RTF_LINKDOWN))) {
 		/* retry to find a good path */
 		for (path = 0; path < size; path++) {
-			if (!(next[path].flags & RTF_DEAD))
+			if (!(next[path].flags & (RTF_DEAD | RTF_LINKDOWN)))
 				break;
 		}
 
@@ -851,7 +858,8 @@ struct next_hop_v6 *nexthop6_select(uint32_t index, const struct rte_mbuf *m,
 		return next;
 
 	return nexthop6_select_internal(next, size,
-					ecmp_mbuf_hash(m, ether_type));
+					ecmp_mbuf_hash(m, ether_type),
+					nextu->buckets);
 }
 
 int nh6_lookup_by_index(uint32_t nhindex, uint32_t hash,
@@ -872,7 +880,8 @@ int nh6_lookup_by_index(uint32_t nhindex, uint32_t hash,
 
 	size = nextu->nsiblings;
 	if (size > 1)
-		next = nexthop6_select_internal(next, size, hash);
+		next = nexthop6_select_internal(next, size, hash,
+						nextu->buckets);
 
 	if (next->flags & RTF_GATEWAY)
 		*nh = next->gateway;
@@ -942,6 +951,43 @@ struct next_hop_v6 *rt6_lookup_fast(struct vrf *vrf,
 	return nh;
 }
 
+/*
+ * Lookup nexthops for a vector of destination addresses sharing the
+ * same VRF and table, overlapping the LPM cache misses.
+ *
+ * Fills nh with RCU protected nexthop structures or NULL.
+ */
+void rt6_lookup_fast_bulk(struct vrf *vrf, const struct in6_addr * const *dst,
+			  uint32_t tbl_id, struct rte_mbuf * const *m,
+			  struct next_hop_v6 **nh, unsigned int n)
+{
+	const uint8_t *ips[LPM6_LOOKUP_BULK_MAX];
+	uint32_t index[LPM6_LOOKUP_BULK_MAX];
+	const struct lpm6 *lpm;
+	uint64_t hit_mask;
+	unsigned int i;
+
+	assert(n <= LPM6_LOOKUP_BULK_MAX);
+
+	lpm = rcu_dereference(vrf->v_rt6_head.rt6_table[tbl_id]);
+
+	for (i = 0; i < n; i++)
+		ips[i] = dst[i]->s6_addr;
+
+	hit_mask = lpm6_lookup_bulk(lpm, ips, index, n);
+
+	for (i = 0; i < n; i++) {
+		if (unlikely(!(hit_mask & (1ull << i)))) {
+			nh[i] = NULL;
+			continue;
+		}
+
+		nh[i] = nexthop6_select(index[i], m[i], ETHER_TYPE_IPv6);
+		if (nh[i] && unlikely(nh[i]->flags & RTF_NOROUTE))
+			nh[i] = NULL;
+	}
+}
+
 /*
  * Modifying a NH in non atomic way, so this must be atomically swapped
  * into the forwarding state when ready
@@ -1205,6 +1251,18 @@ nexthop6_reuse(const struct nexthop6_hash_key *key, uint32_t *slot)
 	return nextu;
 }
 
+/* Memory accounted to a nexthop with the given number of paths */
+static size_t nexthop6_mem_size(unsigned int size)
+{
+	const struct next_hop_v6_u *nextu = NULL;
+	size_t sz = sizeof(*nextu) + size * sizeof(*nextu->nh_fal_obj);
+
+	if (size > 1)
+		sz += size * sizeof(struct next_hop_v6) +
+			ECMP_BUCKETS * sizeof(*nextu->buckets);
+	return sz;
+}
+
 static struct next_hop_v6_u *nexthop6_alloc(int size)
 {
 	struct next_hop_v6_u *nextu;
@@ -1225,16 +1283,39 @@ static struct next_hop_v6_u *nexthop6_alloc(int size)
 		nextu->siblings = &nextu->hop0;
 	} else {
 		nextu->siblings = calloc(1, size * sizeof(struct next_hop_v6));
-		if (unlikely(nextu->siblings == NULL)) {
+		nextu->buckets = calloc(ECMP_BUCKETS, sizeof(*nextu->buckets));
+		if (unlikely(!nextu->siblings || !nextu->buckets)) {
+			free(nextu->buckets);
+			free(nextu->siblings);
 			free(nextu->nh_fal_obj);
 			free(nextu);
 			return NULL;
 		}
 	}
 	nextu->nsiblings = size;
+	dp_mem_account_alloc(DP_MEM_NEXTHOP, nexthop6_mem_size(size));
 	return nextu;
 }
 
+static void nexthop6_buckets_init(struct next_hop_v6_u *nextu)
+{
+	uint32_t path_ids[nextu->nsiblings];
+	const struct ifnet *ifp;
+	unsigned int i;
+
+	if (!nextu->buckets)
+		return;
+
+	for (i = 0; i < nextu->nsiblings; i++) {
+		const struct next_hop_v6 *nh = nextu->siblings + i;
+
+		ifp = nh6_get_ifp(nh);
+		path_ids[i] = rte_jhash(&nh->gateway, sizeof(nh->gateway),
+					ifp ? ifp->if_index : 0);
+	}
+	ecmp_buckets_fill(nextu->buckets, path_ids, nextu->nsiblings);
+}
+
 static void __nexthop6_destroy(struct next_hop_v6_u *nextu)
 {
 	unsigned int i;
@@ -1245,7 +1326,10 @@ static void __nexthop6_destroy(struct next_hop_v6_u *nextu)
 	if (nextu->siblings != &nextu->hop0)
 		free(nextu->siblings);
 
+	free(nextu->buckets);
 	free(nextu->nh_fal_obj);
+	dp_mem_account_free(DP_MEM_NEXTHOP,
+			    nexthop6_mem_size(nextu->nsiblings));
 	free(nextu);
 }
 
@@ -1289,6 +1373,7 @@ nexthop6_new(struct next_hop_v6 *nh, size_t size, uint32_t *slot)
 		nextu->hop0 = *nh;
 	} else {
 		memcpy(nextu->siblings, nh, size * sizeof(struct next_hop_v6));
+		nexthop6_buckets_init(nextu);
 	}
 	if (unlikely(nexthop6_hash_insert(nextu, &key))) {
 		__nexthop6_destroy(nextu);
@@ -1632,6 +1717,9 @@ route6_nh_replace(struct next_hop_v6_u *nextu, uint32_t nh_idx,
 	new_nextu->nhg_fal_obj = nextu->nhg_fal_obj;
 	memcpy(new_nextu->nh_fal_obj, nextu->nh_fal_obj,
 	       new_nextu->nsiblings * sizeof(*new_nextu->nh_fal_obj));
+	if (new_nextu->buckets)
+		memcpy(new_nextu->buckets, nextu->buckets,
+		       ECMP_BUCKETS * sizeof(*new_nextu->buckets));
 
 	assert(nh6_tbl.entry[nh_idx] == nextu);
 	rcu_xchg_pointer(&nh6_tbl.entry[nh_idx], new_nextu);
@@ -2245,6 +2333,8 @@ void rt6_print_nexthop(json_writer_t *json, uint32_t next_hop)
 		} else
 			jsonw_string_field(json, "state", "directly connected");
 
+		if (next->flags & RTF_LINKDOWN)
+			jsonw_bool_field(json, "link_down", true);
 		if (next->flags & RTF_NEIGH_PRESENT)
 			jsonw_bool_field(json, "neigh_present", true);
 		if (next->flags & RTF_NEIGH_CREATED)
@@ -3325,8 +3415,41 @@ int route6_get_pd_subset_data(json_writer_t *json,
 	return 0;
 }
 
+/*
+ * Take paths over a port that has lost link out of ECMP selection at
+ * once, as for IPv4, rather than waiting for the routes to be
+ * withdrawn.
+ */
+static void rt6_if_link_change(struct ifnet *ifp, bool up,
+			       uint32_t speed __unused)
+{
+	struct next_hop_v6_u *nhu;
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+	unsigned int i;
+
+	ASSERT_MASTER();
+
+	cds_lfht_for_each(nexthop6_hash, &iter, node) {
+		nhu = caa_container_of(node, struct next_hop_v6_u, nh_node);
+
+		for (i = 0; i < nhu->nsiblings; i++) {
+			struct next_hop_v6 *nh = nhu->siblings + i;
+
+			if (nh6_get_ifp(nh) != ifp)
+				continue;
+
+			if (up)
+				nh->flags &= ~RTF_LINKDOWN;
+			else
+				nh->flags |= RTF_LINKDOWN;
+		}
+	}
+}
+
 static const struct dp_event_ops route6_events = {
 	.if_index_unset = rt6_if_delete,
+	.if_link_change = rt6_if_link_change,
 };
 
 DP_STARTUP_EVENT_REGISTER(route6_events);
@@ -73,6 +73,9 @@ void rt6_print_nexthop(json_writer_t *json, uint32_t next_hop);
 struct next_hop_v6 *rt6_lookup_fast(struct vrf *vrf,
 				    const struct in6_addr *dst, uint32_t tbl_id,
 				    const struct rte_mbuf *m);
+void rt6_lookup_fast_bulk(struct vrf *vrf, const struct in6_addr * const *dst,
+			  uint32_t tbl_id, struct rte_mbuf * const *m,
+			  struct next_hop_v6 **nh, unsigned int n);
 
 void rt6_prefetch(const struct rte_mbuf *m, const struct in6_addr *dst);
 void rt6_prefetch_fast(const struct rte_mbuf *m, const struct in6_addr *dst)
@@ -37,6 +37,7 @@
 #include <rte_memory.h>
 
 #include "bridge.h"
+#include "bridge_mdb.h"
 #include "compat.h"
 #include "compiler.h"
 #include "config.h"
@@ -1417,6 +1418,10 @@ int rtnl_process(const struct nlmsghdr *nlh, void *data)
 	case RTM_DELNETCONF:
 		return notify_netconf(nlh, cont_src);
 
+	case RTM_NEWMDB:
+	case RTM_DELMDB:
+		return bridge_mdb_change(nlh, cont_src);
+
 	case RTM_NEWCHAIN:
 		/* No need to create a new chain, as we create it
 		 * implicity when the first filter on the chain is
@@ -1573,9 +1578,11 @@ static void process_xfrm_newsa(struct xfrm_usersa_info *sa_info,
 	struct xfrm_algo_auth *auth_algo;
 	struct xfrm_algo *crypto_algo = NULL;
 	struct xfrm_encap_tmpl *tmpl = NULL;
+	struct xfrm_replay_state_esn *esn;
 	struct xfrm_mark *mark;
 	uint32_t mark_val;
 	uint32_t extra_flags = 0;
+	uint32_t replay_window;
 
 	/*
 	 * VRF. Use topic default if no attribute
@@ -1633,6 +1640,16 @@ static void process_xfrm_newsa(struct xfrm_usersa_info *sa_info,
 		}
 	}
 
+	/*
+	 * A window of more than 255 packets can only be given in the
+	 * ESN replay state. Extended sequence numbers themselves are
+	 * not supported, only the window size is taken from it.
+	 */
+	replay_window = sa_info->replay_window;
+	esn = get_nl_attr_payload(attrs[XFRMA_REPLAY_ESN_VAL]);
+	if (esn && esn->replay_window)
+		replay_window = esn->replay_window;
+
 	/* create on-stack xfrm_algo to create the SA */
 	if (aead_algo) {
 		crypto_algo = alloca(sizeof(struct xfrm_algo) +
@@ -1645,7 +1662,7 @@ static void process_xfrm_newsa(struct xfrm_usersa_info *sa_info,
 	}
 
 	crypto_sadb_new_sa(sa_info, crypto_algo, auth_algo, tmpl,
-			   mark_val, extra_flags, vrf_id);
+			   replay_window, mark_val, extra_flags, vrf_id);
 
  scrub:
 	/*
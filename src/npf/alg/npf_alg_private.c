@@ -411,6 +411,10 @@ static struct alg_protocol_tuples *apt_alloc(void)
 	if (!apt->apt_proto.a_ht)
 		goto port;
 
+	apt->apt_any_sport.a_bloom = apt->apt_bloom;
+	apt->apt_all.a_bloom = apt->apt_bloom;
+	apt->apt_port.a_bloom = apt->apt_bloom;
+
 	return apt;
 
 port:
@@ -499,6 +503,39 @@ static int apt_matcher(struct cds_lfht_node *node, const void *key)
 	return 1;
 }
 
+/*
+ * Counting bloom filter over tuple dports.  Most new sessions are not
+ * to a port an ALG expects, and the filter lets them skip the hash
+ * lookups.  Counted while a tuple is in its hash table, expired or not.
+ */
+static inline void apt_bloom_idx(in_port_t dport, uint32_t *i1, uint32_t *i2)
+{
+	uint32_t h = dport * 0x9e3779b1;
+
+	*i1 = (h >> 22) & (APT_BLOOM_SIZE - 1);
+	*i2 = (h >> 12) & (APT_BLOOM_SIZE - 1);
+}
+
+static inline bool apt_bloom_has(rte_atomic16_t *bloom, in_port_t dport)
+{
+	uint32_t i1, i2;
+
+	apt_bloom_idx(dport, &i1, &i2);
+	return rte_atomic16_read(&bloom[i1]) &&
+		rte_atomic16_read(&bloom[i2]);
+}
+
+static void apt_bloom_add(rte_atomic16_t *bloom, in_port_t dport,
+			  int16_t delta)
+{
+	uint32_t i1, i2;
+
+	apt_bloom_idx(dport, &i1, &i2);
+	rte_atomic16_add(&bloom[i1], delta);
+	if (i2 != i1)
+		rte_atomic16_add(&bloom[i2], delta);
+}
+
 /* Hash table node count */
 static inline int64_t apt_ht_count(struct alg_ht *a)
 {
@@ -614,10 +651,12 @@ static struct npf_alg_tuple *alg_lookup(struct npf_alg_instance *ai,
 	alg_fill_match(npc, proto, ifx, &m);
 
 	/* Search on dport */
-	m.m_flag = NPF_TUPLE_MATCH_PROTO_PORT;
-	nt = apt_search_ht(&apt->apt_port, &m);
-	if (nt)
-		return nt;
+	if (apt_bloom_has(apt->apt_bloom, m.m_dport)) {
+		m.m_flag = NPF_TUPLE_MATCH_PROTO_PORT;
+		nt = apt_search_ht(&apt->apt_port, &m);
+		if (nt)
+			return nt;
+	}
 
 	/* Search on proto */
 	m.m_flag = NPF_TUPLE_MATCH_PROTO;
@@ -733,6 +772,8 @@ void apt_expire_tuple(struct npf_alg_tuple *nt)
 static void apt_del_tuple(struct alg_ht *a, struct npf_alg_tuple *nt)
 {
 	if (a && !cds_lfht_del(a->a_ht, &nt->nt_node)) {
+		if (a->a_bloom)
+			apt_bloom_add(a->a_bloom, nt->nt_dport, -1);
 		apt_expire_tuple(nt);
 		apt_release_node(nt);
 	}
@@ -784,6 +825,10 @@ static int apt_insert_tuple(struct npf_alg_instance *ai,
 	 * existing tuple.  Do this by expiring the existing tuple and
 	 * retrying for a limited number of times.
 	 */
+	/* In the filter before it can be found in the table */
+	if (a->a_bloom)
+		apt_bloom_add(a->a_bloom, nt->nt_dport, 1);
+
 	rc = -EEXIST;
 	retry = NPF_ALG_RETRY_COUNT;
 	while (retry--) {
@@ -805,6 +850,8 @@ static int apt_insert_tuple(struct npf_alg_instance *ai,
 	if (!rc) {
 		rte_atomic64_inc(&a->a_cnt);
 		rcu_assign_pointer(nt->nt_aht, a);
+	} else if (a->a_bloom) {
+		apt_bloom_add(a->a_bloom, nt->nt_dport, -1);
 	}
 
 	return rc;
@@ -1714,6 +1761,8 @@ alg_search_all_then_any_sport(struct alg_protocol_tuples *apt,
 		return NULL;
 
 	alg_fill_match(npc, npf_cache_ipproto(npc), ifp->if_index, &m);
+	if (!apt_bloom_has(apt->apt_bloom, m.m_dport))
+		return NULL;
 
 	/* Search 'all' first */
 	if (all_count) {
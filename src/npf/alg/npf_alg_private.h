@@ -47,10 +47,14 @@ struct npf_alg_nat {
 	vrfid_t			an_vrfid;
 };
 
+/* Counting bloom filter size, a power of 2 no larger than 1024 */
+#define APT_BLOOM_SIZE	1024
+
 /* The protocol hash table set */
 struct alg_ht {
 	struct cds_lfht *a_ht;  /* Hash table */
 	rte_atomic64_t  a_cnt;  /* Counter */
+	rte_atomic16_t	*a_bloom; /* dport filter, if keyed on dport */
 };
 
 struct alg_protocol_tuples {
@@ -59,6 +63,8 @@ struct alg_protocol_tuples {
 	struct alg_ht   apt_any_sport;    /* NPF_TUPLE_MATCH_ANY_SPORT */
 	struct alg_ht   apt_port;       /* NPF_TUPLE_MATCH_PROTO_PORT */
 	struct alg_ht   apt_proto;      /* NPF_TUPLE_MATCH_PROTO */
+	/* dports of the tuples in all but apt_proto */
+	rte_atomic16_t	apt_bloom[APT_BLOOM_SIZE];
 };
 
 /* For resetting an alg's config */
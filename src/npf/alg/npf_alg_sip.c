@@ -35,6 +35,7 @@
 #include <rte_cycles.h>
 #include <rte_jhash.h>
 #include <rte_log.h>
+#include <rte_mbuf.h>
 #include <rte_spinlock.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -57,7 +58,6 @@
 #include "vplane_log.h"
 
 struct ifnet;
-struct rte_mbuf;
 struct sip_alg_request;
 
 /* default port */
@@ -555,23 +555,45 @@ static struct sip_alg_request *sip_alg_request_alloc(bool init_sip,
 }
 
 /*
- * Parse a sip packet
+ * sip_alg_payload() - Get the SIP message.
+ *
+ * The message is used in place if it is contiguous in the first mbuf
+ * segment, which is the usual case.  Otherwise it is copied to 'buf',
+ * which must have room for SIP_MESSAGE_MAX_LENGTH + 1 bytes.
  */
-static struct sip_alg_request *sip_alg_parse(const struct npf_alg *sip,
-		npf_cache_t *npc, uint32_t if_idx, struct rte_mbuf *nbuf)
+static const char *sip_alg_payload(npf_cache_t *npc, struct rte_mbuf *nbuf,
+		char *buf, uint16_t *plen)
 {
-	struct sip_alg_request *sr = NULL;
-	uint16_t plen;
-	char payload[SIP_MESSAGE_MAX_LENGTH + 1];
-	int rc;
+	uint16_t len = npf_payload_len(npc);
+	char *payload = (char *)npf_iphdr(nbuf) + npf_hdrlen(npc);
 
-	plen = npf_payload_fetch(npc, nbuf, payload,
+	if (len >= SIP_MSG_MIN_LENGTH && len <= SIP_MESSAGE_MAX_LENGTH &&
+	    payload + len <= rte_pktmbuf_mtod(nbuf, char *) +
+	    rte_pktmbuf_data_len(nbuf)) {
+		*plen = len;
+		return payload;
+	}
+
+	len = npf_payload_fetch(npc, nbuf, buf,
 			SIP_MSG_MIN_LENGTH, SIP_MESSAGE_MAX_LENGTH);
-	if (!plen)
+	if (!len)
 		return NULL;
 
 	/* Make the payload a string */
-	payload[plen] = '\0';
+	buf[len] = '\0';
+	*plen = len;
+	return buf;
+}
+
+/*
+ * Parse a sip packet.  The payload need not be NUL terminated, as
+ * osip_message_parse() takes its own copy.
+ */
+static struct sip_alg_request *sip_alg_parse(const struct npf_alg *sip,
+		const char *payload, uint16_t plen, uint32_t if_idx)
+{
+	struct sip_alg_request *sr = NULL;
+	int rc;
 
 	sr = sip_alg_request_alloc(true, if_idx);
 	if (!sr)
@@ -2969,21 +2991,31 @@ static int sip_alg_manage_sip(npf_session_t *se, npf_cache_t *npc,
 
 /*
  * sip_alg_manage_packet() - manage and translate SIP packets
+ *
+ * If 'rewrite' is false the message does not contain the address being
+ * translated, so translation would not change it.  In that case the
+ * message is managed as-is, as for inspection, and the payload is left
+ * alone.
  */
 static int sip_alg_manage_packet(npf_session_t *se, struct sip_alg_request *sr,
-			npf_cache_t *npc, struct rte_mbuf *nbuf, npf_nat_t *nat)
+			npf_cache_t *npc, struct rte_mbuf *nbuf, npf_nat_t *nat,
+			bool rewrite)
 {
 	struct sip_alg_request *tsr = NULL;
 	const struct npf_alg *sip = npf_alg_session_get_alg(se);
 	int rc;
 	bool consumed = false;
 
-	rc = sip_alg_translate_message(sip, sr, &tsr);
-	if (rc)
-		goto done;
+	if (rewrite) {
+		rc = sip_alg_translate_message(sip, sr, &tsr);
+		if (rc)
+			goto done;
+	} else {
+		tsr = sr;
+	}
 
 	rc = sip_alg_manage_sip(se, npc, sr, tsr, nat, &consumed);
-	if (rc)
+	if (rc || !rewrite)
 		goto done;
 
 	rc = sip_alg_update_payload(se, npc, sip_di(tsr), nbuf, tsr);
@@ -2998,7 +3030,8 @@ done:
 	if (!consumed)
 		sip_alg_request_free(sip, tsr);
 
-	sip_alg_request_free(sip, sr);
+	if (sr != tsr)
+		sip_alg_request_free(sip, sr);
 
 	return rc;
 }
@@ -3054,16 +3087,20 @@ static int sip_alg_translate_packet(npf_session_t *se, npf_cache_t *npc,
 	in_port_t oport;
 	bool forw;
 	struct sip_alg_request *sr;
+	char buf[SIP_MESSAGE_MAX_LENGTH + 1];
+	const char *payload;
+	uint16_t plen;
+	bool rewrite;
 
 	/* Don't manipulate (TCP) packets w/o data */
 	if (!npf_payload_len(npc))
 		return 0;
 
-       /*
-	* Parsed msg may have been placed into session provate data by tuple
-	* inspect
-	*/
-	sr = sip_alg_parse(sip, npc, npf_session_get_if_index(se), nbuf);
+	payload = sip_alg_payload(npc, nbuf, buf, &plen);
+	if (!payload)
+		return -EINVAL;
+
+	sr = sip_alg_parse(sip, payload, plen, npf_session_get_if_index(se));
 	if (!sr)
 		return -EINVAL;
 
@@ -3099,7 +3136,14 @@ static int sip_alg_translate_packet(npf_session_t *se, npf_cache_t *npc,
 
 	sip_init_nat(sr, forw, &taddr, &oaddr, npc->npc_alen, tport, di);
 
-	return sip_alg_manage_packet(se, sr, npc, nbuf, ns);
+	/*
+	 * Every SIP and SDP translation replaces the NAT target address,
+	 * so only rewrite the message if that appears somewhere in it.
+	 */
+	rewrite = memmem(payload, plen, sip_oaddr(sr),
+			 strlen(sip_oaddr(sr))) != NULL;
+
+	return sip_alg_manage_packet(se, sr, npc, nbuf, ns, rewrite);
 }
 
 /*
@@ -3111,8 +3155,15 @@ static void sip_alg_inspect_packet(npf_session_t *se, npf_cache_t *npc,
 	struct sip_alg_request *sr;
 	const struct npf_alg *sip = npf_alg_session_get_alg(se);
 	bool consumed = false;
+	char buf[SIP_MESSAGE_MAX_LENGTH + 1];
+	const char *payload;
+	uint16_t plen;
+
+	payload = sip_alg_payload(npc, nbuf, buf, &plen);
+	if (!payload)
+		return;
 
-	sr = sip_alg_parse(sip, npc, npf_session_get_if_index(se), nbuf);
+	sr = sip_alg_parse(sip, payload, plen, npf_session_get_if_index(se));
 	if (!sr)
 		return;
 
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#include <errno.h>
+#include <netinet/ip.h>
+#include <rte_branch_prediction.h>
+#include <rte_lcore.h>
+#include <rte_mbuf.h>
+#include <rte_memory.h>
+#include <rte_per_lcore.h>
+#include <rte_ring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <urcu/system.h>
+
+#include "compiler.h"
+#include "ip_funcs.h"
+#include "json_writer.h"
+#include "main.h"
+#include "npf/alg/npf_alg_private.h"
+#include "npf/alg/npf_alg_worker.h"
+#include "npf/npf.h"
+#include "npf/npf_session.h"
+#include "pktmbuf.h"
+#include "pl_common.h"
+#include "pl_fused.h"
+#include "urcu.h"
+#include "util.h"
+#include "vplane_log.h"
+
+#define ALG_WORKER_RING_SZ	4096
+#define ALG_WORKER_BURST	32
+
+struct alg_worker_stats {
+	uint64_t	aw_steered;	/* enqueued by a forwarding lcore */
+	uint64_t	aw_inline;	/* ring full, processed in place */
+	uint64_t	aw_processed;	/* dequeued by a worker */
+	uint64_t	aw_dropped;	/* input interface gone */
+} __rte_cache_aligned;
+
+bool npf_alg_workers_on;
+
+static struct rte_ring *alg_worker_ring;
+static struct alg_worker_stats alg_worker_stats[RTE_MAX_LCORE];
+
+/* Set while a worker re-injects packets, so they are not steered again */
+static RTE_DEFINE_PER_LCORE(bool, alg_worker_active);
+
+bool npf_alg_worker_enqueue(struct rte_mbuf *m, struct ifnet *ifp,
+			    enum l2_packet_type l2_pkt_type)
+{
+	struct alg_worker_stats *stats;
+	npf_session_t *se;
+	bool forw;
+
+	if (RTE_PER_LCORE(alg_worker_active))
+		return false;
+
+	/*
+	 * Only established control sessions, the packet which creates
+	 * the session is handled in place.
+	 */
+	se = npf_session_find(m, PFIL_IN, ifp, &forw, NULL);
+	if (!se || !npf_session_uses_alg(se) || !npf_alg_session_inspect(se))
+		return false;
+
+	stats = &alg_worker_stats[dp_lcore_id()];
+
+	/*
+	 * The cached sentry is only good until this lcore next passes
+	 * through a quiescent state, so the worker must look it up again.
+	 */
+	pktmbuf_mdata_clear(m, PKT_MDATA_SESSION_SENTRY);
+	pktmbuf_save_ifp(m, ifp);
+	if (l2_pkt_type != L2_PKT_UNICAST)
+		pkt_mbuf_set_l2_traffic_type(m, l2_pkt_type);
+
+	if (unlikely(rte_ring_mp_enqueue(alg_worker_ring, m) != 0)) {
+		/* Undo the save; ifp is still the interface */
+		pktmbuf_mdata_clear(m, PKT_MDATA_IFINDEX);
+		stats->aw_inline++;
+		return false;
+	}
+
+	stats->aw_steered++;
+	return true;
+}
+
+unsigned int npf_alg_worker_poll(void)
+{
+	struct rte_ring *ring = CMM_LOAD_SHARED(alg_worker_ring);
+	struct rte_mbuf *pkts[ALG_WORKER_BURST];
+	struct alg_worker_stats *stats;
+	unsigned int i, n;
+
+	if (unlikely(!ring))
+		return 0;
+
+	n = rte_ring_mc_dequeue_burst(ring, (void **)pkts,
+				      ALG_WORKER_BURST, NULL);
+	if (n == 0)
+		return 0;
+
+	stats = &alg_worker_stats[dp_lcore_id()];
+	RTE_PER_LCORE(alg_worker_active) = true;
+
+	for (i = 0; i < n; i++) {
+		struct rte_mbuf *m = pkts[i];
+		struct ifnet *ifp = pktmbuf_restore_ifp(m);
+
+		if (unlikely(!ifp)) {
+			rte_pktmbuf_free(m);
+			stats->aw_dropped++;
+			continue;
+		}
+
+		struct pl_packet pl_pkt = {
+			.mbuf = m,
+			.l2_pkt_type = pkt_mbuf_get_l2_traffic_type(m),
+			.in_ifp = ifp,
+		};
+
+		if (iphdr(m)->version == IPVERSION)
+			pipeline_fused_ipv4_validate(&pl_pkt);
+		else
+			pipeline_fused_ipv6_validate(&pl_pkt);
+	}
+
+	RTE_PER_LCORE(alg_worker_active) = false;
+	stats->aw_processed += n;
+	return n;
+}
+
+int npf_alg_worker_enable(bool enable)
+{
+	struct rte_mbuf *m;
+
+	if (enable) {
+		if (!alg_worker_ring) {
+			struct rte_ring *ring;
+
+			ring = rte_ring_create("alg-workers",
+					       ALG_WORKER_RING_SZ,
+					       SOCKET_ID_ANY, 0);
+			if (!ring) {
+				RTE_LOG(ERR, DATAPLANE,
+					"alg workers: ring create failed\n");
+				return -ENOMEM;
+			}
+			CMM_STORE_SHARED(alg_worker_ring, ring);
+		}
+		CMM_STORE_SHARED(npf_alg_workers_on, true);
+		return 0;
+	}
+
+	if (!CMM_LOAD_SHARED(npf_alg_workers_on))
+		return 0;
+
+	/*
+	 * Wait for forwarding lcores to finish any enqueue, then free
+	 * what the workers have not picked up.  The ring is kept, as a
+	 * worker may still be polling it.
+	 */
+	CMM_STORE_SHARED(npf_alg_workers_on, false);
+	synchronize_rcu();
+
+	while (rte_ring_mc_dequeue(alg_worker_ring, (void **)&m) == 0)
+		rte_pktmbuf_free(m);
+
+	return 0;
+}
+
+void npf_alg_worker_dump(FILE *f)
+{
+	struct alg_worker_stats sum = { 0 };
+	json_writer_t *json;
+	unsigned int i;
+
+	FOREACH_DP_LCORE(i) {
+		sum.aw_steered += alg_worker_stats[i].aw_steered;
+		sum.aw_inline += alg_worker_stats[i].aw_inline;
+		sum.aw_processed += alg_worker_stats[i].aw_processed;
+		sum.aw_dropped += alg_worker_stats[i].aw_dropped;
+	}
+
+	json = jsonw_new(f);
+	if (!json)
+		return;
+
+	jsonw_name(json, "alg-workers");
+	jsonw_start_object(json);
+	jsonw_bool_field(json, "enabled",
+			 CMM_LOAD_SHARED(npf_alg_workers_on));
+	jsonw_uint_field(json, "queued",
+			 alg_worker_ring ? rte_ring_count(alg_worker_ring) : 0);
+	jsonw_uint_field(json, "steered", sum.aw_steered);
+	jsonw_uint_field(json, "inline", sum.aw_inline);
+	jsonw_uint_field(json, "processed", sum.aw_processed);
+	jsonw_uint_field(json, "dropped", sum.aw_dropped);
+	jsonw_end_object(json);
+	jsonw_destroy(&json);
+}
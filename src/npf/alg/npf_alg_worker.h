@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef NPF_ALG_WORKER_H
+#define NPF_ALG_WORKER_H
+
+#include <rte_branch_prediction.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <urcu/system.h>
+
+#include "main.h"
+
+struct ifnet;
+struct rte_mbuf;
+
+/*
+ * ALG worker lcores.
+ *
+ * Parsing and rewriting ALG control channel payloads (SIP, FTP, TFTP,
+ * RPC) is far more expensive than forwarding a packet.  When ALG
+ * workers are enabled, inbound packets of established ALG control
+ * sessions are handed off at the firewall to a ring serviced by the
+ * lcores given the ALG role, which put them back through IP input
+ * from where they are forwarded as normal.
+ */
+
+extern bool npf_alg_workers_on;
+
+bool npf_alg_worker_enqueue(struct rte_mbuf *m, struct ifnet *ifp,
+			    enum l2_packet_type l2_pkt_type);
+
+/**
+ * Steer a packet to the ALG workers if it belongs to an ALG control
+ * session.
+ *
+ * @param m The packet
+ * @param ifp The input interface
+ * @param l2_pkt_type The L2 type the packet was received with
+ * @return returns true if the packet has been consumed
+ */
+static inline bool
+npf_alg_worker_steer(struct rte_mbuf *m, struct ifnet *ifp,
+		     enum l2_packet_type l2_pkt_type)
+{
+	if (likely(!CMM_LOAD_SHARED(npf_alg_workers_on)))
+		return false;
+
+	return npf_alg_worker_enqueue(m, ifp, l2_pkt_type);
+}
+
+/**
+ * Service the ALG worker ring.  Called by lcores with the ALG role.
+ *
+ * @return returns the number of packets processed
+ */
+unsigned int npf_alg_worker_poll(void);
+
+/**
+ * Enable or disable steering.  Must be called from the main thread.
+ * Enabling creates the ring if need be; disabling waits for in-flight
+ * packets to be enqueued then frees any left in the ring.
+ *
+ * @param enable true to enable
+ * @return returns 0 on success and a negative errno on failure
+ */
+int npf_alg_worker_enable(bool enable);
+
+void npf_alg_worker_dump(FILE *f);
+
+#endif /* NPF_ALG_WORKER_H */
@@ -64,6 +64,7 @@ int npf_parse_ip_addr(char *value, sa_family_t *fam, npf_addr_t *addr,
 struct apm_port_block {
 	struct cds_list_head	pb_list_node;	/* source list node */
 	struct apm		*pb_apm;	/* back ptr */
+	struct cgn_source	*pb_src;	/* subscriber, back ptr */
 	struct rcu_head		pb_rcu_head;
 	uint64_t		pb_start_time;
 	uint16_t		pb_port_start;  /* first port in block */
@@ -78,6 +79,13 @@ struct apm_port_block {
 	/* Last place port found */
 	uint16_t		pb_cur_bm[NAT_PROTO_COUNT];
 
+	/*
+	 * Per-protocol summary of which bitmaps are full, bit n being set
+	 * when pb_map[proto][n] is all ones.  A block has at most
+	 * PORTS_PER_BITMAP bitmaps, so one word is enough.
+	 */
+	uint64_t		pb_full[NAT_PROTO_COUNT];
+
 	/*
 	 * Per-protocol bitmap array, _pb_map. MUST be last. We setup pb_map[]
 	 * pointers to point into _pb_map.  Used as follows:
@@ -135,6 +143,18 @@ uint16_t apm_block_get_block(struct apm_port_block *pb)
 	return pb ? pb->pb_block : 0;
 }
 
+/* Get subscriber */
+struct cgn_source *apm_block_get_source(struct apm_port_block *pb)
+{
+	return rcu_dereference(pb->pb_src);
+}
+
+/* Set subscriber */
+void apm_block_set_source(struct apm_port_block *pb, struct cgn_source *src)
+{
+	rcu_assign_pointer(pb->pb_src, src);
+}
+
 /* Get ports used count for all protocols */
 uint32_t apm_block_get_ports_used(struct apm_port_block *pb)
 {
@@ -155,6 +175,12 @@ struct cds_list_head *apm_block_get_list_node(struct apm_port_block *pb)
 	return &pb->pb_list_node;
 }
 
+/* Restart the block start time, e.g. when handed out from a cache */
+void apm_block_reset_start_time(struct apm_port_block *pb)
+{
+	pb->pb_start_time = soft_ticks;
+}
+
 /*
  * Allocate a port from a port block.  Returns 0 if it fails to find an
  * available port.
@@ -162,45 +188,48 @@ struct cds_list_head *apm_block_get_list_node(struct apm_port_block *pb)
 uint16_t
 apm_block_alloc_first_free_port(struct apm_port_block *pb, uint8_t proto)
 {
-	uint bit = 0;
-	uint16_t port, i, bm;
+	uint64_t avail, after;
+	uint16_t port, bm;
+	uint bit;
 
 	if (pb->pb_ports_used[proto] == pb->pb_nports)
 		return 0;
 
+	/* Bitmaps with a free port */
+	avail = ~pb->pb_full[proto];
+	if (pb->pb_nmaps < PORTS_PER_BITMAP)
+		avail &= (UINT64_C(1) << pb->pb_nmaps) - 1;
+	if (!avail)
+		return 0;
+
 	/*
 	 * Start at the bitmap from which we last allocated a port for this
-	 * protocol.
+	 * protocol, wrapping to the first bitmap.
 	 */
-	for (i = 0, bm = pb->pb_cur_bm[proto]; i < pb->pb_nmaps; i++) {
+	after = avail & (~UINT64_C(0) << pb->pb_cur_bm[proto]);
+	bm = __builtin_ctzll(after ? after : avail);
 
-		/* Find first clear bit in bitmap, starting with lsb */
-		bit = ffcl(pb->pb_map[proto][bm]);
+	/* Find first clear bit in bitmap, starting with lsb */
+	bit = ffcl(pb->pb_map[proto][bm]);
+	assert(bit != 0);
 
-		if (bit != 0) {
-			/* Subtract 1 since ffcl return 1 for bit 0 etc */
-			bit -= 1;
+	/* Subtract 1 since ffcl return 1 for bit 0 etc */
+	bit -= 1;
 
-			/* Remember where we found a free port */
-			pb->pb_cur_bm[proto] = bm;
-
-			pb->pb_ports_used[proto]++;
-
-			/* convert bit to a port number */
-			port = pb->pb_port_start +
-				(bm * PORTS_PER_BITMAP) + bit;
+	/* Remember where we found a free port */
+	pb->pb_cur_bm[proto] = bm;
 
-			/* Set bit */
-			pb->pb_map[proto][bm] |= (UINT64_C(1) << bit);
+	pb->pb_ports_used[proto]++;
 
-			return port;
-		}
+	/* convert bit to a port number */
+	port = pb->pb_port_start + (bm * PORTS_PER_BITMAP) + bit;
 
-		if (++bm == pb->pb_nmaps)
-			bm = 0;
-	}
+	/* Set bit */
+	pb->pb_map[proto][bm] |= (UINT64_C(1) << bit);
+	if (pb->pb_map[proto][bm] == ~UINT64_C(0))
+		pb->pb_full[proto] |= UINT64_C(1) << bm;
 
-	return 0;
+	return port;
 }
 
 /*
@@ -238,6 +267,8 @@ apm_block_alloc_random_port(struct apm_port_block *pb, uint8_t proto)
 
 		/* Set bit */
 		pb->pb_map[proto][bm] |= (UINT64_C(1) << bit);
+		if (pb->pb_map[proto][bm] == ~UINT64_C(0))
+			pb->pb_full[proto] |= UINT64_C(1) << bm;
 		return port;
 	}
 
@@ -277,6 +308,7 @@ apm_block_release_port(struct apm_port_block *pb, uint8_t proto, uint16_t port)
 	/* Is bit already cleared? */
 	if ((pb->pb_map[proto][bm] & mask) != UINT64_C(0)) {
 		pb->pb_map[proto][bm] &= ~mask;
+		pb->pb_full[proto] &= ~(UINT64_C(1) << bm);
 		pb->pb_ports_used[proto]--;
 		return true;
 	}
@@ -333,6 +365,9 @@ apm_block_create(struct apm *apm, uint16_t block)
 
 	/* How many 64-bit bitmaps do we need? */
 	nmaps = apm->apm_port_block_sz / PORTS_PER_BITMAP;
+
+	/* pb_full has a bit per bitmap */
+	assert(nmaps <= PORTS_PER_BITMAP);
 	sz = sizeof(struct apm_port_block) +
 		(sizeof(pb->_pb_map[0]) * nmaps * NAT_PROTO_COUNT);
 
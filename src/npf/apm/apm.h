@@ -19,6 +19,7 @@
 struct apm;
 struct nat_pool;
 struct apm_port_block;
+struct cgn_source;
 
 #define PORTS_PER_BITMAP	64
 
@@ -139,6 +140,10 @@ struct apm *apm_block_get_apm(struct apm_port_block *pb);
 /* Get block number */
 uint16_t apm_block_get_block(struct apm_port_block *pb);
 
+/* Get and set the subscriber the block is assigned to */
+struct cgn_source *apm_block_get_source(struct apm_port_block *pb);
+void apm_block_set_source(struct apm_port_block *pb, struct cgn_source *src);
+
 /* Get ports used count for all protocols */
 uint32_t apm_block_get_ports_used(struct apm_port_block *pb);
 
@@ -148,6 +153,9 @@ uint16_t apm_block_get_nports(struct apm_port_block *pb);
 /* Get pointer to list node */
 struct cds_list_head *apm_block_get_list_node(struct apm_port_block *pb);
 
+/* Restart the block start time */
+void apm_block_reset_start_time(struct apm_port_block *pb);
+
 /* Get port and blocks used counts from a list of port blocks */
 void apm_source_block_list_get_counts(struct cds_list_head *list,
 				      uint *nports, uint *ports_used);
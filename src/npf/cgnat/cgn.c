@@ -22,6 +22,8 @@
 #include "npf/cgnat/cgn.h"
 #include "npf/apm/apm.h"
 #include "npf/cgnat/cgn_errno.h"
+#include "npf/cgnat/cgn_log.h"
+#include "npf/cgnat/cgn_map.h"
 #include "npf/cgnat/cgn_policy.h"
 #include "npf/cgnat/cgn_session.h"
 #include "npf/cgnat/cgn_source.h"
@@ -97,8 +99,10 @@ char *cgn_addrstr(uint32_t addr, char *str, size_t slen)
  */
 static void cgn_np_inactive(struct nat_pool *np)
 {
-	if (nat_pool_type_is_cgnat(np))
+	if (nat_pool_type_is_cgnat(np)) {
 		cgn_session_expire_pool(true, np, true);
+		cgn_map_cache_flush(np);
+	}
 }
 
 /* NAT pool event handlers */
@@ -132,9 +136,11 @@ static void cgn_init(void)
 static void cgn_uninit(void)
 {
 	cgn_session_uninit();
+	cgn_map_cache_flush(NULL);
 	apm_uninit();
 	cgn_source_uninit();
 	cgn_policy_uninit();
+	cgn_log_ring_uninit();
 }
 
 /*
@@ -155,6 +161,7 @@ DP_STARTUP_EVENT_REGISTER(cgn_event_ops);
 void dp_test_npf_clear_cgnat(void)
 {
 	cgn_session_cleanup();
+	cgn_map_cache_flush(NULL);
 	apm_cleanup();
 	cgn_source_cleanup();
 }
@@ -45,6 +45,8 @@
 #include "npf/cgnat/cgn.h"
 #include "npf/cgnat/cgn_if.h"
 #include "npf/cgnat/cgn_limits.h"
+#include "npf/cgnat/cgn_log.h"
+#include "npf/cgnat/cgn_map.h"
 #include "npf/cgnat/cgn_policy.h"
 #include "npf/cgnat/cgn_sess_state.h"
 #include "npf/cgnat/cgn_session.h"
@@ -483,6 +485,54 @@ usage:
 	return -1;
 }
 
+/*
+ * cgn-cfg block-cache [on|off]
+ */
+static int cgn_block_cache_cfg(FILE *f, int argc, char **argv)
+{
+	if (argc < 3)
+		goto usage;
+
+	if (strcmp(argv[2], "on") == 0)
+		cgn_pb_cache_gbl = true;
+	else {
+		cgn_pb_cache_gbl = false;
+		cgn_map_cache_flush(NULL);
+	}
+
+	return 0;
+usage:
+	if (f)
+		fprintf(f, "%s: cgn-cfg block-cache {on|off}",
+			__func__);
+
+	return -1;
+}
+
+/*
+ * cgn-cfg log-ring [on|off]
+ */
+static int cgn_log_ring_cfg(FILE *f, int argc, char **argv)
+{
+	if (argc < 3)
+		goto usage;
+
+	if (cgn_log_ring_enable(strcmp(argv[2], "on") == 0) < 0) {
+		if (f)
+			fprintf(f, "%s: failed to allocate log rings",
+				__func__);
+		return -1;
+	}
+
+	return 0;
+usage:
+	if (f)
+		fprintf(f, "%s: cgn-cfg log-ring {on|off}",
+			__func__);
+
+	return -1;
+}
+
 /*
  * cgn-cfg max-sessions <num>
  */
@@ -623,6 +673,12 @@ int cmd_cgn(FILE *f, int argc, char **argv)
 	else if (strcmp(argv[1], "hairpinning") == 0)
 		rc = cgn_hairpinning_cfg(f, argc, argv);
 
+	else if (strcmp(argv[1], "block-cache") == 0)
+		rc = cgn_block_cache_cfg(f, argc, argv);
+
+	else if (strcmp(argv[1], "log-ring") == 0)
+		rc = cgn_log_ring_cfg(f, argc, argv);
+
 	else if (strcmp(argv[1], "max-sessions") == 0)
 		rc = cgn_max_sessions_cfg(f, argc, argv);
 
@@ -11,31 +11,267 @@
 #include <errno.h>
 #include <netinet/in.h>
 #include <linux/if.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_timer.h>
 
 #include "compiler.h"
 #include "if_var.h"
+#include "urcu.h"
 #include "util.h"
 #include "soft_ticks.h"
 #include "vplane_log.h"
 
 #include "npf/cgnat/cgn.h"
 #include "npf/cgnat/cgn_log.h"
+#include "npf/cgnat/cgn_sess_state.h"
 #include "npf/cgnat/cgn_source.h"
 #include "npf/cgnat/cgn.h"
 
 #define ADDR_CHARS 16
 
+/*
+ * Deferred logging.
+ *
+ * Formatting log messages is expensive, so when enabled, logs generated
+ * by the forwarding threads are instead written as fixed-size binary
+ * records to a per-lcore single-producer, single-consumer ring.  The master
+ * thread drains the rings every CGN_LOG_RING_MS millisecs, and formats and
+ * emits the records in batches.  The resulting messages are the same as
+ * when logged directly.
+ *
+ * Records are dropped, and counted, if a ring is full.  Logs from the
+ * master thread are never deferred.
+ */
+enum cgn_log_type {
+	CGN_LOG_SUBS_START,
+	CGN_LOG_PB_ALLOC,
+	CGN_LOG_SESS_CREATE,
+};
+
+struct cgn_log_rec {
+	uint8_t			lr_type;
+	union {
+		struct {
+			uint32_t	addr;
+			uint64_t	time;
+		} lr_subs;
+		struct {
+			uint32_t	pvt_addr;
+			uint32_t	pub_addr;
+			uint16_t	port_start;
+			uint16_t	port_end;
+			uint64_t	start_time;
+		} lr_pb;
+		struct cgn_log_sess	lr_sess;
+	};
+};
+
+#define CGN_LOG_RING_SZ		1024	/* Must be a power of 2 */
+#define CGN_LOG_RING_MASK	(CGN_LOG_RING_SZ - 1)
+#define CGN_LOG_RING_MS		10
+
+struct cgn_log_ring {
+	/* Producer */
+	uint32_t		lr_head;
+	uint32_t		lr_drops;
+
+	/* Consumer */
+	uint32_t		lr_tail __rte_cache_aligned;
+	uint32_t		lr_drops_seen;
+
+	struct cgn_log_rec	lr_recs[CGN_LOG_RING_SZ] __rte_cache_aligned;
+};
+
+bool cgn_log_ring_gbl;
+
+static struct cgn_log_ring *cgn_log_rings[RTE_MAX_LCORE];
+static struct rte_timer cgn_log_ring_timer;
+
+/*
+ * Queue a record for the master thread.  Returns false if the caller
+ * should log directly.
+ */
+static bool cgn_log_ring_put(const struct cgn_log_rec *rec)
+{
+	unsigned int lcore = rte_lcore_id();
+	struct cgn_log_ring *lr;
+	uint32_t head;
+
+	if (!cgn_log_ring_gbl || lcore >= RTE_MAX_LCORE ||
+	    lcore == rte_get_master_lcore())
+		return false;
+
+	lr = cgn_log_rings[lcore];
+	if (!lr)
+		return false;
+
+	head = lr->lr_head;
+	if (head - CMM_LOAD_SHARED(lr->lr_tail) >= CGN_LOG_RING_SZ) {
+		CMM_STORE_SHARED(lr->lr_drops, lr->lr_drops + 1);
+		return true;
+	}
+
+	lr->lr_recs[head & CGN_LOG_RING_MASK] = *rec;
+
+	/* Record must be written before it is visible to the consumer */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(lr->lr_head, head + 1);
+
+	return true;
+}
+
+static void cgn_log_subscriber_start_emit(uint32_t addr, uint64_t time);
+static void cgn_log_pb_alloc_emit(uint32_t pvt_addr, uint32_t pub_addr,
+				  uint16_t port_start, uint16_t port_end,
+				  uint64_t start_time);
+static void cgn_log_sess_create_emit(const struct cgn_log_sess *ls);
+
+static void cgn_log_rec_emit(const struct cgn_log_rec *rec)
+{
+	switch (rec->lr_type) {
+	case CGN_LOG_SUBS_START:
+		cgn_log_subscriber_start_emit(rec->lr_subs.addr,
+					      rec->lr_subs.time);
+		break;
+	case CGN_LOG_PB_ALLOC:
+		cgn_log_pb_alloc_emit(rec->lr_pb.pvt_addr,
+				      rec->lr_pb.pub_addr,
+				      rec->lr_pb.port_start,
+				      rec->lr_pb.port_end,
+				      rec->lr_pb.start_time);
+		break;
+	case CGN_LOG_SESS_CREATE:
+		cgn_log_sess_create_emit(&rec->lr_sess);
+		break;
+	}
+}
+
+/* Emit all records queued on a ring */
+static void cgn_log_ring_drain(struct cgn_log_ring *lr)
+{
+	uint32_t head, tail, drops;
+
+	tail = lr->lr_tail;
+	head = CMM_LOAD_SHARED(lr->lr_head);
+
+	/* Read records only after seeing the head */
+	cmm_smp_rmb();
+
+	for (; tail != head; tail++)
+		cgn_log_rec_emit(&lr->lr_recs[tail & CGN_LOG_RING_MASK]);
+
+	/* Finish reading records before the producer may reuse them */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(lr->lr_tail, tail);
+
+	drops = CMM_LOAD_SHARED(lr->lr_drops);
+	if (drops != lr->lr_drops_seen) {
+		RTE_LOG(NOTICE, CGNAT, "LOG_DROPPED count=%u\n",
+			drops - lr->lr_drops_seen);
+		lr->lr_drops_seen = drops;
+	}
+}
+
+static void cgn_log_ring_drain_all(void)
+{
+	unsigned int lcore;
+
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++)
+		if (cgn_log_rings[lcore])
+			cgn_log_ring_drain(cgn_log_rings[lcore]);
+}
+
+static void
+cgn_log_ring_timer_cb(struct rte_timer *timer __rte_unused,
+		      void *arg __rte_unused)
+{
+	cgn_log_ring_drain_all();
+}
+
+/*
+ * Enable or disable deferred logging.  The rings are allocated the first
+ * time it is enabled, and remain until uninit so that forwarding threads
+ * never see them freed.
+ */
+int cgn_log_ring_enable(bool enable)
+{
+	unsigned int lcore;
+
+	if (!enable) {
+		cgn_log_ring_gbl = false;
+		cgn_log_ring_drain_all();
+		return 0;
+	}
+
+	RTE_LCORE_FOREACH_SLAVE(lcore) {
+		if (cgn_log_rings[lcore])
+			continue;
+
+		cgn_log_rings[lcore] = rte_zmalloc_socket(
+			"cgn_log_ring", sizeof(struct cgn_log_ring),
+			RTE_CACHE_LINE_SIZE, rte_lcore_to_socket_id(lcore));
+
+		if (!cgn_log_rings[lcore]) {
+			RTE_LOG(ERR, CGNAT,
+				"Failed to allocate log ring for lcore %u\n",
+				lcore);
+			return -ENOMEM;
+		}
+	}
+
+	if (!rte_timer_pending(&cgn_log_ring_timer)) {
+		rte_timer_init(&cgn_log_ring_timer);
+		rte_timer_reset(&cgn_log_ring_timer,
+				(rte_get_timer_hz() * CGN_LOG_RING_MS) / 1000,
+				PERIODICAL, rte_get_master_lcore(),
+				cgn_log_ring_timer_cb, NULL);
+	}
+
+	cgn_log_ring_gbl = true;
+	return 0;
+}
+
+/* Called once the forwarding threads have stopped */
+void cgn_log_ring_uninit(void)
+{
+	unsigned int lcore;
+
+	cgn_log_ring_gbl = false;
+	rte_timer_stop_sync(&cgn_log_ring_timer);
+
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+		if (!cgn_log_rings[lcore])
+			continue;
+
+		cgn_log_ring_drain(cgn_log_rings[lcore]);
+		rte_free(cgn_log_rings[lcore]);
+		cgn_log_rings[lcore] = NULL;
+	}
+}
+
 /*
  * Log subscriber session start
  */
-void cgn_log_subscriber_start(uint32_t addr)
+static void cgn_log_subscriber_start_emit(uint32_t addr, uint64_t time)
 {
 	char str1[ADDR_CHARS];
 
 	RTE_LOG(NOTICE, CGNAT,
 		"SUBSCRIBER_START subs-addr=%s start-time=%lu\n",
 		cgn_addrstr(addr, str1, ADDR_CHARS),
-		cgn_ticks2timestamp(soft_ticks));
+		cgn_ticks2timestamp(time));
+}
+
+void cgn_log_subscriber_start(uint32_t addr)
+{
+	struct cgn_log_rec rec = {
+		.lr_type = CGN_LOG_SUBS_START,
+		.lr_subs = { .addr = addr, .time = soft_ticks },
+	};
+
+	if (!cgn_log_ring_put(&rec))
+		cgn_log_subscriber_start_emit(addr, rec.lr_subs.time);
 }
 
 /*
@@ -110,9 +346,9 @@ void cgn_log_public_pb_avail(uint32_t addr, uint16_t blocks_used,
 /*
  * Log port block allocation and release
  */
-void cgn_log_pb_alloc(uint32_t pvt_addr, uint32_t pub_addr,
-		      uint16_t port_start, uint16_t port_end,
-		      uint64_t start_time)
+static void cgn_log_pb_alloc_emit(uint32_t pvt_addr, uint32_t pub_addr,
+				  uint16_t port_start, uint16_t port_end,
+				  uint64_t start_time)
 {
 	char str1[ADDR_CHARS];
 	char str2[ADDR_CHARS];
@@ -125,6 +361,26 @@ void cgn_log_pb_alloc(uint32_t pvt_addr, uint32_t pub_addr,
 		port_start, port_end, cgn_ticks2timestamp(start_time));
 }
 
+void cgn_log_pb_alloc(uint32_t pvt_addr, uint32_t pub_addr,
+		      uint16_t port_start, uint16_t port_end,
+		      uint64_t start_time)
+{
+	struct cgn_log_rec rec = {
+		.lr_type = CGN_LOG_PB_ALLOC,
+		.lr_pb = {
+			.pvt_addr = pvt_addr,
+			.pub_addr = pub_addr,
+			.port_start = port_start,
+			.port_end = port_end,
+			.start_time = start_time,
+		},
+	};
+
+	if (!cgn_log_ring_put(&rec))
+		cgn_log_pb_alloc_emit(pvt_addr, pub_addr, port_start,
+				      port_end, start_time);
+}
+
 void cgn_log_pb_release(uint32_t pvt_addr, uint32_t pub_addr,
 			uint16_t port_start, uint16_t port_end,
 			uint64_t start_time, uint64_t end_time)
@@ -140,3 +396,63 @@ void cgn_log_pb_release(uint32_t pvt_addr, uint32_t pub_addr,
 		port_start, port_end, cgn_ticks2timestamp(start_time),
 		cgn_ticks2timestamp(end_time));
 }
+
+/*
+ * Format the common part of a 2-tuple session log
+ */
+uint cgn_log_sess_str(const struct cgn_log_sess *ls, char *log_str,
+		      uint log_str_sz)
+{
+	char str1[ADDR_CHARS];
+	char str2[ADDR_CHARS];
+	char str3[ADDR_CHARS];
+	char state_str[12];
+	struct ifnet *ifp;
+
+	ifp = ifnet_byifindex(ls->ls_ifindex);
+
+	if (ls->ls_proto == NAT_PROTO_TCP)
+		snprintf(state_str, sizeof(state_str), "%s[%u/0x%02X]",
+			 cgn_tcp_state_str_short(ls->ls_state),
+			 ls->ls_state, ls->ls_hist);
+	else
+		snprintf(state_str, sizeof(state_str), "%s[%u]",
+			 cgn_tcp_state_str_short(ls->ls_state),
+			 ls->ls_state);
+
+	return snprintf(log_str, log_str_sz,
+			"ifname=%s session-id=%u.%u proto=%u "
+			"addr=%s->%s port=%u->%u cgn-addr=%s cgn-port=%u "
+			"state=%s start-time=%lu",
+			ifp ? ifp->if_name : "-", ls->ls_id,
+			ls->ls_id2, ls->ls_ipproto,
+			cgn_addrstr(ntohl(ls->ls_int_addr), str1, ADDR_CHARS),
+			cgn_addrstr(ntohl(ls->ls_dst_addr), str2, ADDR_CHARS),
+			ntohs(ls->ls_int_port), ntohs(ls->ls_dst_port),
+			cgn_addrstr(ntohl(ls->ls_ext_addr), str3, ADDR_CHARS),
+			ntohs(ls->ls_ext_port), state_str,
+			cgn_ticks2timestamp(ls->ls_start_time));
+}
+
+/*
+ * SESSION_CREATE
+ */
+static void cgn_log_sess_create_emit(const struct cgn_log_sess *ls)
+{
+#define LOG_STR_SZ 400
+	char log_str[LOG_STR_SZ];
+
+	cgn_log_sess_str(ls, log_str, sizeof(log_str));
+	RTE_LOG(NOTICE, CGNAT, "SESSION_CREATE %s\n", log_str);
+}
+
+void cgn_log_sess_create(const struct cgn_log_sess *ls)
+{
+	struct cgn_log_rec rec = {
+		.lr_type = CGN_LOG_SESS_CREATE,
+		.lr_sess = *ls,
+	};
+
+	if (!cgn_log_ring_put(&rec))
+		cgn_log_sess_create_emit(ls);
+}
@@ -7,6 +7,46 @@
 #ifndef _CGN_LOG_H_
 #define _CGN_LOG_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * 2-tuple session details for logging.  Addresses and ports are in network
+ * byte order.
+ */
+struct cgn_log_sess {
+	uint32_t	ls_ifindex;
+	uint32_t	ls_id;		/* 3-tuple session ID */
+	uint32_t	ls_id2;		/* 2-tuple session ID */
+	uint32_t	ls_int_addr;
+	uint32_t	ls_dst_addr;
+	uint32_t	ls_ext_addr;
+	uint16_t	ls_int_port;
+	uint16_t	ls_dst_port;
+	uint16_t	ls_ext_port;
+	uint8_t		ls_ipproto;
+	uint8_t		ls_proto;	/* enum nat_proto */
+	uint8_t		ls_state;
+	uint8_t		ls_hist;
+	uint64_t	ls_start_time;
+};
+
+/* Format the common part of a 2-tuple session log */
+uint cgn_log_sess_str(const struct cgn_log_sess *ls, char *log_str,
+		      uint log_str_sz);
+
+/* 2-tuple session start, SESSION_CREATE */
+void cgn_log_sess_create(const struct cgn_log_sess *ls);
+
+/*
+ * Defer forwarding-path logs to the master thread via per-lcore rings of
+ * binary records.
+ */
+extern bool cgn_log_ring_gbl;
+
+int cgn_log_ring_enable(bool enable);
+void cgn_log_ring_uninit(void);
+
 /* subscriber session start */
 void cgn_log_subscriber_start(uint32_t addr);
 
@@ -13,9 +13,11 @@
 #include <netinet/in.h>
 #include <linux/if.h>
 #include <dpdk/rte_jhash.h>
+#include <rte_lcore.h>
 
 #include "compiler.h"
 #include "if_var.h"
+#include "soft_ticks.h"
 #include "urcu.h"
 #include "util.h"
 
@@ -34,6 +36,197 @@
 #include "npf/cgnat/cgn_source.h"
 
 
+/*
+ * Per-lcore cache of port-blocks.
+ *
+ * When enabled, a subscriber needing a new port-block is first given one
+ * that this lcore has already reserved.  Reserving blocks in batches from a
+ * public address means that most new subscribers are mapped without
+ * iterating over the pool addresses, or taking the apm lock.
+ *
+ * A cached block is created, and so counted in apm_blocks_used, but not
+ * counted as active in the nat pool until handed out.  Unused blocks are
+ * returned to their apm by the cgnat session GC once they have been cached
+ * for CGN_PB_CACHE_AGE millisecs, or when the cache is flushed.
+ *
+ * The lock is only taken by other threads to return blocks, so is
+ * uncontended in the forwarding path.  Lock order is source, cache, apm.
+ */
+#define CGN_PB_CACHE_SZ		16
+#define CGN_PB_CACHE_FILL	4
+#define CGN_PB_CACHE_AGE	5000
+
+struct cgn_pb_cache {
+	rte_spinlock_t		pc_lock;
+	uint16_t		pc_count;
+	struct apm_port_block	*pc_blocks[CGN_PB_CACHE_SZ];
+	uint64_t		pc_time[CGN_PB_CACHE_SZ];
+} __rte_cache_aligned;
+
+static struct cgn_pb_cache cgn_pb_cache[RTE_MAX_LCORE];
+
+bool cgn_pb_cache_gbl;
+
+static struct cgn_pb_cache *cgn_pb_cache_lcore(void)
+{
+	unsigned int lcore = rte_lcore_id();
+
+	if (unlikely(lcore >= RTE_MAX_LCORE))
+		return NULL;
+	return &cgn_pb_cache[lcore];
+}
+
+/*
+ * Take a cached port-block for this pool and vrf.  If 'addr' is non-zero
+ * then the block must be from that public address.
+ */
+static struct apm_port_block *
+cgn_pb_cache_get(struct nat_pool *np, vrfid_t vrfid, uint32_t addr)
+{
+	struct cgn_pb_cache *pc = cgn_pb_cache_lcore();
+	struct apm_port_block *pb;
+	struct apm *apm;
+	uint16_t i;
+
+	if (!pc || !pc->pc_count)
+		return NULL;
+
+	rte_spinlock_lock(&pc->pc_lock);
+
+	for (i = 0; i < pc->pc_count; i++) {
+		pb = pc->pc_blocks[i];
+		apm = apm_block_get_apm(pb);
+
+		if (apm->apm_np != np || apm->apm_vrfid != vrfid)
+			continue;
+		if (addr && apm->apm_addr != addr)
+			continue;
+		if (nat_pool_is_blacklist_addr(np, htonl(apm->apm_addr)))
+			continue;
+
+		pc->pc_count--;
+		pc->pc_blocks[i] = pc->pc_blocks[pc->pc_count];
+		pc->pc_time[i] = pc->pc_time[pc->pc_count];
+		rte_spinlock_unlock(&pc->pc_lock);
+
+		apm_block_reset_start_time(pb);
+		nat_pool_incr_block_allocs(np);
+		nat_pool_incr_block_active(np);
+
+		return pb;
+	}
+
+	rte_spinlock_unlock(&pc->pc_lock);
+	return NULL;
+}
+
+/*
+ * Reserve further blocks from the apm that a block has just been allocated
+ * from.  At most half of the free blocks on the apm are reserved, so that
+ * caching does not take blocks that other lcores could otherwise use.
+ */
+static void
+cgn_pb_cache_fill(struct apm *apm, uint16_t block_hint)
+{
+	struct cgn_pb_cache *pc = cgn_pb_cache_lcore();
+	struct apm_port_block *pb;
+	uint16_t block, i, n;
+
+	if (!pc || pc->pc_count >= CGN_PB_CACHE_SZ)
+		return;
+
+	rte_spinlock_lock(&pc->pc_lock);
+	rte_spinlock_lock(&apm->apm_lock);
+
+	if ((apm->apm_flags & APM_DEAD) != 0)
+		goto unlock;
+
+	n = RTE_MIN(CGN_PB_CACHE_FILL, CGN_PB_CACHE_SZ - pc->pc_count);
+	n = RTE_MIN(n, (apm->apm_nblocks - apm->apm_blocks_used) / 2);
+
+	for (i = 0, block = block_hint; n > 0 && i < apm->apm_nblocks;
+	     i++, block++) {
+		if (block >= apm->apm_nblocks)
+			block = 0;
+
+		if (apm->apm_blocks[block])
+			continue;
+
+		pb = apm_block_create(apm, block);
+		if (!pb)
+			break;
+
+		pc->pc_blocks[pc->pc_count] = pb;
+		pc->pc_time[pc->pc_count] = soft_ticks;
+		pc->pc_count++;
+		n--;
+	}
+
+unlock:
+	rte_spinlock_unlock(&apm->apm_lock);
+	rte_spinlock_unlock(&pc->pc_lock);
+}
+
+/* Return an unused cached block to its apm */
+static void cgn_pb_cache_release(struct apm_port_block *pb)
+{
+	struct apm *apm = apm_block_get_apm(pb);
+
+	rte_spinlock_lock(&apm->apm_lock);
+	apm_block_destroy(pb);
+	rte_spinlock_unlock(&apm->apm_lock);
+}
+
+/*
+ * Return cached blocks to their apms.  Either all blocks, those from pool
+ * 'np', or those cached for longer than 'age' millisecs are returned.
+ */
+static void cgn_pb_cache_purge(bool all, struct nat_pool *np, uint64_t age)
+{
+	struct cgn_pb_cache *pc;
+	struct apm_port_block *pb;
+	struct apm *apm;
+	unsigned int lcore;
+	uint16_t i;
+
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+		pc = &cgn_pb_cache[lcore];
+		if (!pc->pc_count)
+			continue;
+
+		rte_spinlock_lock(&pc->pc_lock);
+
+		for (i = 0; i < pc->pc_count; ) {
+			pb = pc->pc_blocks[i];
+			apm = apm_block_get_apm(pb);
+
+			if (!all && (!np || apm->apm_np != np) &&
+			    (!age || soft_ticks - pc->pc_time[i] < age)) {
+				i++;
+				continue;
+			}
+
+			pc->pc_count--;
+			pc->pc_blocks[i] = pc->pc_blocks[pc->pc_count];
+			pc->pc_time[i] = pc->pc_time[pc->pc_count];
+			cgn_pb_cache_release(pb);
+		}
+
+		rte_spinlock_unlock(&pc->pc_lock);
+	}
+}
+
+/* Return blocks that have been cached for a while.  Called from the GC. */
+void cgn_map_cache_gc(void)
+{
+	cgn_pb_cache_purge(false, NULL, CGN_PB_CACHE_AGE);
+}
+
+/* Return all cached blocks from a pool, or from all pools if np is NULL */
+void cgn_map_cache_flush(struct nat_pool *np)
+{
+	cgn_pb_cache_purge(!np, np, 0);
+}
 
 /* CGN_BLK_ENOSPC */
 static inline void cgn_alloc_log_pb_full(struct apm *apm)
@@ -60,8 +253,9 @@ static inline void cgn_alloc_pool_full(struct nat_pool *np)
  * Round-robin address allocation.
  *
  * Very simple. Each invocation uses the address after the one allocated by
- * the previous invocation.  After each allocation, we store the address
- * in the pools np_addr_hint object.
+ * the previous invocation on this lcore.  After each allocation, we store
+ * the address in this lcore's hint in the pool, so lcores do not share
+ * the hint.
  *
  * Note that the apm is *not* locked anytime in this function.
  */
@@ -179,6 +373,72 @@ error:
 	return NULL;
 }
 
+/*
+ * Deterministic port-block allocation (RFC 7422).
+ *
+ * The subscribers offset within the policy prefix selects both the public
+ * address and the port-block on that address, so each subscriber only ever
+ * has the one block and no per-block logging is required.
+ */
+static struct apm_port_block *
+cgn_alloc_det(struct nat_pool *np, struct cgn_policy *cp,
+	      struct cgn_source *src, vrfid_t vrfid, int *error)
+{
+	struct apm_port_block *pb;
+	uint32_t n, bpa, addr;
+	uint16_t block;
+	struct apm *apm;
+
+	bpa = np->np_nports / np->np_block_sz;
+	n = src->sr_addr - ntohl(cp->cp_prefix);
+
+	addr = bpa ? nat_pool_nth_addr(np, n / bpa) : 0;
+	if (addr == 0 || nat_pool_is_blacklist_addr(np, htonl(addr))) {
+		*error = -CGN_POOL_ENOSPC;
+		cgn_alloc_pool_full(np);
+		return NULL;
+	}
+	block = n % bpa;
+
+	apm = apm_lookup(addr, vrfid);
+	if (!apm) {
+		apm = apm_create_and_insert(addr, vrfid, np, error);
+		if (unlikely(!apm))
+			return NULL;
+	}
+
+	rte_spinlock_lock(&apm->apm_lock);
+
+	if ((apm->apm_flags & APM_DEAD) != 0) {
+		*error = -CGN_APM_ENOENT;
+		goto error;
+	}
+
+	/* Should only happen if the pool was changed under existing users */
+	if (block >= apm->apm_nblocks || apm->apm_blocks[block]) {
+		*error = -CGN_BLK_ENOSPC;
+		goto error;
+	}
+
+	pb = apm_block_create(apm, block);
+	if (!pb) {
+		*error = -CGN_PB_ENOMEM;
+		goto error;
+	}
+	rte_spinlock_unlock(&apm->apm_lock);
+
+	nat_pool_incr_block_allocs(np);
+	nat_pool_incr_block_active(np);
+
+	return pb;
+
+error:
+	rte_spinlock_unlock(&apm->apm_lock);
+
+	nat_pool_incr_block_fails(np);
+	return NULL;
+}
+
 /*
  * Find a free port in any of the port-blocks already in-use by a subscriber,
  * except the active block (since we will already have checked that).
@@ -253,6 +513,16 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 		uint32_t addr_hint;
 		int rc;
 
+		if (cgn_policy_is_deterministic(cp)) {
+			pb = cgn_alloc_det(np, cp, src, vrfid, &error);
+			if (!pb)
+				goto error;
+
+			apm = apm_block_get_apm(pb);
+			cgn_source_add_block(src, proto, pb, np);
+			goto alloc_port;
+		}
+
 		/* Does subscriber already have a paired address? */
 		if (src->sr_paired_addr) {
 
@@ -262,6 +532,16 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 				src->sr_paired_addr = 0;
 		}
 
+		/* Is there a block reserved by this lcore we can use? */
+		if (cgn_pb_cache_gbl) {
+			pb = cgn_pb_cache_get(np, vrfid, src->sr_paired_addr);
+			if (pb) {
+				apm = apm_block_get_apm(pb);
+				cgn_source_add_block(src, proto, pb, np);
+				goto alloc_port;
+			}
+		}
+
 		addr_hint = src->sr_paired_addr;
 		if (addr_hint == 0) {
 			/*
@@ -290,6 +570,9 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 		if (!pb)
 			goto error;
 
+		if (cgn_pb_cache_gbl)
+			cgn_pb_cache_fill(apm, apm_block_get_block(pb) + 1);
+
 		cgn_source_add_block(src, proto, pb, np);
 	} else {
 		apm = apm_block_get_apm(pb);
@@ -299,6 +582,7 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 			goto error;
 	}
 
+alloc_port:
 	/*
 	 * First we try and allocate a port from the active-block, pb.  This
 	 * will be the most likely case.  Allocation within the port-block is
@@ -331,9 +615,10 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 
 	/*
 	 * Before allocating a new port-block, check max-blocks-per-user
-	 * limit.
+	 * limit.  A deterministic subscriber only ever has the one block.
 	 */
-	if (src->sr_block_count >= nat_pool_get_mbpu(np)) {
+	if (src->sr_block_count >= nat_pool_get_mbpu(np) ||
+	    cgn_policy_is_deterministic(cp)) {
 
 		nat_pool_incr_block_limit(np);
 		error = -CGN_MBU_ENOSPC;
@@ -347,6 +632,25 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 		goto error;
 	}
 
+	/*
+	 * Is there a block reserved by this lcore on the same public address,
+	 * or on any address if pairing is not enabled and this one is full?
+	 */
+	if (cgn_pb_cache_gbl) {
+		struct apm_port_block *cpb;
+
+		cpb = cgn_pb_cache_get(np, vrfid, apm->apm_addr);
+		if (!cpb && !nat_pool_is_ap_paired(np) &&
+		    apm->apm_blocks_used >= apm->apm_nblocks)
+			cpb = cgn_pb_cache_get(np, vrfid, 0);
+
+		if (cpb) {
+			pb = cpb;
+			apm = apm_block_get_apm(pb);
+			goto add_block;
+		}
+	}
+
 	/*
 	 * Are there any available port-blocks on this public address?
 	 */
@@ -377,6 +681,10 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 	if (!pb)
 		goto error;
 
+	if (cgn_pb_cache_gbl)
+		cgn_pb_cache_fill(apm, apm_block_get_block(pb) + 1);
+
+add_block:
 	/* Add block to source's block list, and set as active block */
 	cgn_source_add_block(src, proto, pb, np);
 
@@ -24,4 +24,10 @@ cgn_map_get(struct cgn_policy *cp, vrfid_t vrfid, uint8_t proto,
 int cgn_map_put(struct nat_pool *np, vrfid_t vrfid, int dir, uint8_t proto,
 		uint32_t oaddr, uint32_t taddr, uint16_t tport);
 
+/* Per-lcore port-block cache */
+extern bool cgn_pb_cache_gbl;
+
+void cgn_map_cache_gc(void);
+void cgn_map_cache_flush(struct nat_pool *np);
+
 #endif
@@ -50,7 +50,7 @@ struct match {
  */
 bool cgn_policy_record_dest(struct cgn_policy *cp, uint32_t addr, int dir)
 {
-	if (dir != CGN_DIR_OUT)
+	if (dir != CGN_DIR_OUT || !cp->cp_record_dest)
 		return false;
 
 	if (cp->cp_log_sess_all)
@@ -62,6 +62,16 @@ bool cgn_policy_record_dest(struct cgn_policy *cp, uint32_t addr, int dir)
 	return false;
 }
 
+/*
+ * Are nested 2-tuple sessions enabled?
+ */
+static void cgn_policy_set_sess2(struct cgn_policy *cp)
+{
+	cp->cp_sess2_enabled = cp->cp_record_dest &&
+		(cp->cp_log_sess_all || cp->cp_map_type == CGN_MAP_EDM ||
+		 cp->cp_fltr_type == CGN_FLTR_EDF);
+}
+
 /*
  * Compare two policies.  Returns -1, 0, or 1 is p1 is less than, equal, or
  * greater than p2.
@@ -183,6 +193,18 @@ cgn_policy_attach_pool(struct cgn_policy *cp, const char *pool_name)
 
 	naddrs = npf_prefix_to_useable_naddrs4(cp->cp_prefix_len);
 
+	/*
+	 * A deterministic policy needs a port-block for every address in its
+	 * prefix.  Subscribers beyond that are not mapped.
+	 */
+	if (cgn_policy_is_deterministic(cp) &&
+	    (uint64_t)np->np_ranges->nr_naddrs *
+	    (np->np_nports / np->np_block_sz) <
+	    (UINT64_C(1) << (32 - cp->cp_prefix_len)))
+		RTE_LOG(NOTICE, CGNAT,
+			"Pool %s too small for deterministic policy %s\n",
+			np->np_name, cp->cp_name);
+
 	/* Take reference on pool */
 	cp->cp_pool = nat_pool_get(np);
 	nat_pool_incr_nusers(np, naddrs);
@@ -241,15 +263,14 @@ static struct cgn_policy *cgn_policy_create(struct cgn_policy_cfg *cpc)
 	cp->cp_log_sess_end = cpc->cp_log_sess_end;
 	cp->cp_log_sess_periodic = cpc->cp_log_sess_periodic;
 	cp->cp_log_subs = cpc->cp_log_subs;
+	cp->cp_record_dest = cpc->cp_record_dest;
 
 	if (cpc->cp_log_sess_name) {
 		cp->cp_log_sess_ag =
 			npf_addrgrp_lookup_name(cpc->cp_log_sess_name);
 	}
 
-	if (cp->cp_log_sess_all ||
-	    cp->cp_map_type == CGN_MAP_EDM || cp->cp_fltr_type == CGN_FLTR_EDF)
-		cp->cp_sess2_enabled = true;
+	cgn_policy_set_sess2(cp);
 
 	unsigned long mask;
 
@@ -586,7 +607,7 @@ cgn_policy_cfg_parse_fltr(char *value, struct cgn_policy_cfg *cgn)
 static int
 cgn_policy_cfg_parse_trans(char *value, struct cgn_policy_cfg *cgn)
 {
-	if (!strcmp(value, "napt-det"))
+	if (!strcmp(value, "napt44-det") || !strcmp(value, "napt-det"))
 		cgn->cp_trans_type = CGN_TRANS_NAPT44_DETERMINISTIC;
 	else
 		cgn->cp_trans_type = CGN_TRANS_NAPT44_DYNAMIC;
@@ -634,6 +655,17 @@ cgn_policy_cfg_parse_log_subs(char *item __unused, char *value,
 	return 0;
 }
 
+/*
+ * record-dest=yes
+ * record-dest=no
+ */
+static int
+cgn_policy_cfg_parse_record_dest(char *value, struct cgn_policy_cfg *cgn)
+{
+	cgn->cp_record_dest = !strcasecmp(value, "yes");
+	return 0;
+}
+
 static int
 cgn_policy_cfg_parse_priority(char *value, struct cgn_policy_cfg *cfg)
 {
@@ -689,6 +721,7 @@ int cgn_policy_cfg_add(FILE *f, int argc, char **argv)
 		cfg.cp_log_sess_end = cp->cp_log_sess_end;
 		cfg.cp_log_sess_periodic = cp->cp_log_sess_periodic;
 		cfg.cp_log_subs = cp->cp_log_subs;
+		cfg.cp_record_dest = cp->cp_record_dest;
 	} else {
 		cfg.cp_name = name;
 		cfg.cp_priority = 0;
@@ -704,6 +737,7 @@ int cgn_policy_cfg_add(FILE *f, int argc, char **argv)
 		cfg.cp_log_sess_end = true;
 		cfg.cp_log_sess_periodic = 0;
 		cfg.cp_log_subs = true;
+		cfg.cp_record_dest = true;
 	};
 
 	/*
@@ -747,6 +781,9 @@ int cgn_policy_cfg_add(FILE *f, int argc, char **argv)
 
 		} else if (!strcmp(item, "trans-type")) {
 			rc = cgn_policy_cfg_parse_trans(value, &cfg);
+
+		} else if (!strcmp(item, "record-dest")) {
+			rc = cgn_policy_cfg_parse_record_dest(value, &cfg);
 		}
 
 		if (rc < 0)
@@ -796,6 +833,7 @@ int cgn_policy_cfg_add(FILE *f, int argc, char **argv)
 		cp->cp_log_sess_end = cfg.cp_log_sess_end;
 		cp->cp_log_sess_periodic = cfg.cp_log_sess_periodic;
 		cp->cp_log_subs = cfg.cp_log_subs;
+		cp->cp_record_dest = cfg.cp_record_dest;
 
 		if (cfg.cp_log_sess_name)
 			cp->cp_log_sess_ag =
@@ -803,10 +841,7 @@ int cgn_policy_cfg_add(FILE *f, int argc, char **argv)
 		else
 			cp->cp_log_sess_ag = NULL;
 
-		if (cp->cp_log_sess_all ||
-		    cp->cp_map_type == CGN_MAP_EDM ||
-		    cp->cp_fltr_type == CGN_FLTR_EDF)
-			cp->cp_sess2_enabled = true;
+		cgn_policy_set_sess2(cp);
 	}
 
 	return 0;
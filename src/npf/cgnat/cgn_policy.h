@@ -55,6 +55,8 @@ struct cgn_policy_cfg {
 
 	uint8_t			cp_log_subs;
 
+	/* Allow nested 2-tuple sessions. true or false. */
+	uint8_t			cp_record_dest;
 };
 
 /*
@@ -93,7 +95,12 @@ struct cgn_policy {
 	/* Log subscriber start and end */
 	uint8_t			cp_log_subs;
 
-	/* Control for nested 2-tuple sessions. */
+	/*
+	 * Control for nested 2-tuple sessions.  cp_record_dest is the config,
+	 * and when false the policy is endpoint-independent only: no nested
+	 * sessions are created, whatever the map, filter and log-sess config.
+	 */
+	uint8_t			cp_record_dest;
 	uint8_t			cp_sess2_enabled;
 
 	struct rcu_head		cp_rcu_head;
@@ -127,6 +134,13 @@ void cgn_policy_inc_source_count(struct cgn_policy *cp);
 void cgn_policy_dec_source_count(struct cgn_policy *cp);
 
 struct nat_pool *cgn_policy_get_pool(struct cgn_policy *cp);
+
+/* Are subscribers mapped deterministically? (RFC 7422) */
+static inline bool cgn_policy_is_deterministic(const struct cgn_policy *cp)
+{
+	return cp && cp->cp_trans_type == CGN_TRANS_NAPT44_DETERMINISTIC;
+}
+
 void cgn_policy_stats_sess_created(struct cgn_policy *cp);
 void cgn_policy_stats_sess_destroyed(struct cgn_policy *cp);
 
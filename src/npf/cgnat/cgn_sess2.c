@@ -12,6 +12,8 @@
  *
  * Optionally, each main session may have its own 2-tuple session table
  * ("sess2") whenre each entry contains destination IP and destination port.
+ * The first CGN_SESS2_INLINE entries are held inline in the main session,
+ * and a nested hash table is only created for further entries.
  */
 
 #include <errno.h>
@@ -83,17 +85,62 @@ static inline int time_after(uint32_t t0, uint32_t t1)
 	return (int)(t0 - t1) >= 0;
 }
 
-/* Count hash table nodes */
-ulong cgn_sess2_count(struct cds_lfht *ht)
+/* Count inline entries and hash table nodes */
+ulong cgn_sess2_count(struct cgn_sess2_tbl *st)
 {
-	unsigned long count;
+	unsigned long count = 0;
+	unsigned long ht_count;
+	struct cds_lfht *ht;
 	long dummy;
+	uint i;
+
+	for (i = 0; i < CGN_SESS2_INLINE; i++)
+		if (rcu_dereference(st->st_inline[i]))
+			count++;
+
+	ht = rcu_dereference(st->st_ht);
+	if (ht) {
+		cds_lfht_count_nodes(ht, &dummy, &ht_count, &dummy);
+		count += ht_count;
+	}
+	return count;
+}
 
+/*
+ * Callback for each 2-tuple session of a table.  A non-zero return stops
+ * the walk.  The callback may deactivate the session.
+ */
+typedef int (*cgn_sess2_cb)(struct cgn_sess2_tbl *st, struct cgn_sess2 *s2,
+			    void *data);
+
+static int
+cgn_sess2_walk(struct cgn_sess2_tbl *st, cgn_sess2_cb cb, void *data)
+{
+	struct cds_lfht_iter iter;
+	struct cds_lfht *ht;
+	struct cgn_sess2 *s2;
+	int rc;
+	uint i;
+
+	for (i = 0; i < CGN_SESS2_INLINE; i++) {
+		s2 = rcu_dereference(st->st_inline[i]);
+		if (s2) {
+			rc = cb(st, s2, data);
+			if (rc)
+				return rc;
+		}
+	}
+
+	ht = rcu_dereference(st->st_ht);
 	if (!ht)
 		return 0;
 
-	cds_lfht_count_nodes(ht, &dummy, &count, &dummy);
-	return count;
+	cds_lfht_for_each_entry(ht, &iter, s2, s2_node) {
+		rc = cb(st, s2, data);
+		if (rc)
+			return rc;
+	}
+	return 0;
 }
 
 static ALWAYS_INLINE int
@@ -185,63 +232,51 @@ cgn_sess2_establish(struct cgn_session *cse, struct cgn_packet *cpk,
 	return s2;
 }
 
+/*
+ * Gather the details of a 5-tuple session for logging
+ */
+static void
+cgn_log_sess_get(struct cgn_sess2 *s2, struct cgn_log_sess *ls)
+{
+	struct cgn_session *cse = s2->s2_cse;
+
+	ls->ls_ifindex = cgn_session_ifindex(cse);
+	ls->ls_id = cgn_session_id(cse);
+	ls->ls_id2 = s2->s2_id;
+	ls->ls_int_addr = cgn_session_forw_addr(cse);
+	ls->ls_int_port = cgn_session_forw_id(cse);
+	ls->ls_dst_addr = s2->s2_addr;
+	ls->ls_dst_port = s2->s2_port;
+	ls->ls_ext_addr = cgn_session_back_addr(cse);
+	ls->ls_ext_port = cgn_session_back_id(cse);
+	ls->ls_ipproto = s2->s2_ipproto;
+	ls->ls_proto = s2->s2_state.st_proto;
+	ls->ls_state = s2->s2_state.st_state;
+	ls->ls_hist = s2->s2_state.st_hist;
+	ls->ls_start_time = s2->s2_start_time;
+}
+
 /*
  * Log 5-tuple session
  */
 static uint
 cgn_log_sess_common(struct cgn_sess2 *s2, char *log_str, uint log_str_sz)
 {
-#define ADDR_CHARS 16
-	char str1[ADDR_CHARS];
-	char str2[ADDR_CHARS];
-	char str3[ADDR_CHARS];
-	char state_str[12];
-	struct ifnet *ifp;
-	struct cgn_session *cse = s2->s2_cse;
-	uint32_t pid = cgn_session_id(cse);
-	uint32_t int_src = cgn_session_forw_addr(cse);
-	uint16_t int_port = cgn_session_forw_id(cse);
-	uint32_t ext_src = cgn_session_back_addr(cse);
-	uint16_t ext_port = cgn_session_back_id(cse);
-	uint len;
-
-	ifp = ifnet_byifindex(cgn_session_ifindex(cse));
+	struct cgn_log_sess ls;
 
-	if (s2->s2_state.st_proto == NAT_PROTO_TCP)
-		snprintf(state_str, sizeof(state_str), "%s[%u/0x%02X]",
-			 cgn_sess_state_str_short(&s2->s2_state),
-			 s2->s2_state.st_state, s2->s2_state.st_hist);
-	else
-		snprintf(state_str, sizeof(state_str), "%s[%u]",
-			 cgn_sess_state_str_short(&s2->s2_state),
-			 s2->s2_state.st_state);
-
-	len = snprintf(log_str, log_str_sz,
-		       "ifname=%s session-id=%u.%u proto=%u "
-		       "addr=%s->%s port=%u->%u cgn-addr=%s cgn-port=%u "
-		       "state=%s start-time=%lu",
-		       ifp ? ifp->if_name : "-", pid,
-		       s2->s2_id, s2->s2_ipproto,
-		       cgn_addrstr(ntohl(int_src), str1, ADDR_CHARS),
-		       cgn_addrstr(ntohl(s2->s2_addr), str2, ADDR_CHARS),
-		       ntohs(int_port), ntohs(s2->s2_port),
-		       cgn_addrstr(ntohl(ext_src), str3, ADDR_CHARS),
-		       ntohs(ext_port), state_str,
-		       cgn_ticks2timestamp(s2->s2_start_time));
-
-	return len;
+	cgn_log_sess_get(s2, &ls);
+	return cgn_log_sess_str(&ls, log_str, log_str_sz);
 }
 
 /*
- * SESSION_CREATE
+ * SESSION_CREATE.  This is in the forwarding path, so may be deferred.
  */
 static void cgn_log_sess_start(struct cgn_sess2 *s2)
 {
-#define LOG_STR_SZ 400
-	char log_str[LOG_STR_SZ];
+	struct cgn_log_sess ls;
 
-	cgn_log_sess_common(s2, log_str, sizeof(log_str));
-	RTE_LOG(NOTICE, CGNAT, "SESSION_CREATE %s\n", log_str);
+	cgn_log_sess_get(s2, &ls);
+	cgn_log_sess_create(&ls);
 }
 
 /*
@@ -302,24 +337,125 @@ static void cgn_log_sess_end(struct cgn_sess2 *s2, uint64_t end_time)
 	RTE_LOG(NOTICE, CGNAT, "SESSION_DELETE %s\n", log_str);
 }
 
+static void cgn_sess2_rcu_free(struct rcu_head *head)
+{
+	struct cgn_sess2 *s2 = caa_container_of(head, struct cgn_sess2,
+						s2_rcu_head);
+	free(s2);
+}
+
+static void
+cgn_sess2_destroy(struct cgn_sess2 *s2)
+{
+	call_rcu(&s2->s2_rcu_head, cgn_sess2_rcu_free);
+}
+
+/* Is there an unexpired inline entry, before slot 'end', matching s2? */
+static bool
+cgn_sess2_inline_exists(struct cgn_sess2_tbl *st, struct cgn_sess2 *s2,
+			uint end)
+{
+	struct cgn_sess2 *old;
+	uint i;
+
+	for (i = 0; i < end; i++) {
+		old = rcu_dereference(st->st_inline[i]);
+		if (old && old != s2 && !old->s2_expired &&
+		    cgn_sess2_match(old, s2->s2_port, s2->s2_addr))
+			return true;
+	}
+	return false;
+}
+
 /*
- * Activate a nested session
+ * Insert a nested session into an inline slot.  Returns -CGN_S2_ENOSPC if
+ * all slots are in use, in which case s2 has not been published.
  */
-int
-cgn_sess2_activate(struct cds_lfht *ht, struct cgn_sess2 *s2)
+static int
+cgn_sess2_insert_inline(struct cgn_sess2_tbl *st, struct cgn_sess2 *s2)
+{
+	uint i;
+
+	for (i = 0; i < CGN_SESS2_INLINE; i++) {
+		if (st->st_inline[i] ||
+		    uatomic_cmpxchg(&st->st_inline[i], NULL, s2) != NULL)
+			continue;
+
+		/*
+		 * Did we loose the race with another thread inserting the
+		 * same destination into an earlier slot?  The thread in the
+		 * earlier slot always wins.
+		 */
+		if (cgn_sess2_inline_exists(st, s2, i)) {
+			rcu_assign_pointer(st->st_inline[i], NULL);
+			cgn_sess2_destroy(s2);
+			return -CGN_S2_EEXIST;
+		}
+		return 0;
+	}
+	return -CGN_S2_ENOSPC;
+}
+
+/*
+ * Insert a nested session into the hash table, creating the table if this
+ * is the first session not to fit inline.
+ */
+static int
+cgn_sess2_insert_ht(struct cgn_sess2_tbl *st, struct cgn_sess2 *s2)
 {
-	/* Insert into table */
 	struct cds_lfht_node *node;
+	struct cds_lfht *ht, *old;
 	ulong hash;
 
+	/* Destinations already inline are not unique in the hash table */
+	if (cgn_sess2_inline_exists(st, s2, CGN_SESS2_INLINE)) {
+		free(s2);
+		return -CGN_S2_EEXIST;
+	}
+
+	ht = rcu_dereference(st->st_ht);
+	if (!ht) {
+		ht = cds_lfht_new(CGN_SESS2_HT_INIT, CGN_SESS2_HT_MIN,
+				  CGN_SESS2_HT_MAX, CGN_SESS2_HT_FLAGS, NULL);
+		if (!ht) {
+			free(s2);
+			return -CGN_S2_ENOMEM;
+		}
+
+		/* Did we loose the race to create the table? */
+		old = uatomic_cmpxchg(&st->st_ht, NULL, ht);
+		if (old) {
+			dp_ht_destroy_deferred(ht);
+			ht = old;
+		}
+	}
+
 	hash = rte_jhash_1word(s2->s2_addr, s2->s2_port);
 
 	node = cds_lfht_add_unique(ht, hash, cgn_sess2_node_match,
 				   s2, &s2->s2_node);
 
 	/* Did we loose the race to insert s2? */
-	if (node != &s2->s2_node)
+	if (node != &s2->s2_node) {
+		free(s2);
 		return -CGN_S2_EEXIST;
+	}
+	return 0;
+}
+
+/*
+ * Activate a nested session
+ */
+int
+cgn_sess2_activate(struct cgn_sess2_tbl *st, struct cgn_sess2 *s2)
+{
+	int rc;
+
+	rc = cgn_sess2_insert_inline(st, s2);
+	if (rc == -CGN_S2_ENOSPC)
+		rc = cgn_sess2_insert_ht(st, s2);
+	if (rc < 0)
+		return rc;
 
 	if (cgn_session_log_start(s2->s2_cse))
 		cgn_log_sess_start(s2);
@@ -328,50 +464,44 @@ cgn_sess2_activate(struct cds_lfht *ht, struct cgn_sess2 *s2)
 }
 
 static void
-cgn_sess2_deactivate(struct cds_lfht *ht, struct cgn_sess2 *s2)
+cgn_sess2_deactivate(struct cgn_sess2_tbl *st, struct cgn_sess2 *s2)
 {
-	/* Remove from table */
-	(void)cds_lfht_del(ht, &s2->s2_node);
-
-	/* Release the slot */
-	cgn_sess2_slot_put(s2->s2_cse);
-}
-
-struct cgn_sess2 *
-cgn_sess2_lookup(struct cds_lfht *ht, struct cgn_packet *cpk, int dir)
-{
-	struct s2_lookup_key lkey;
-
-	if (dir == CGN_DIR_OUT) {
-		lkey.s2k_addr = cpk->cpk_daddr;
-		lkey.s2k_id   = cpk->cpk_did;
-	} else {
-		lkey.s2k_addr = cpk->cpk_saddr;
-		lkey.s2k_id   = cpk->cpk_sid;
-	}
+	uint i;
 
-	struct cds_lfht_iter iter;
-	struct cds_lfht_node *node;
-	ulong hash;
-
-	hash = rte_jhash_1word(lkey.s2k_addr, lkey.s2k_id);
+	/* Remove from inline slot or table */
+	for (i = 0; i < CGN_SESS2_INLINE; i++)
+		if (st->st_inline[i] == s2)
+			break;
 
-	cds_lfht_lookup(ht, hash, cgn_sess2_lkey_match,	&lkey, &iter);
-
-	node = cds_lfht_iter_get_node(&iter);
-	if (node)
-		return caa_container_of(node, struct cgn_sess2, s2_node);
+	if (i < CGN_SESS2_INLINE)
+		rcu_assign_pointer(st->st_inline[i], NULL);
+	else
+		(void)cds_lfht_del(st->st_ht, &s2->s2_node);
 
-	return NULL;
+	/* Release the slot */
+	cgn_sess2_slot_put(s2->s2_cse);
 }
 
 static struct cgn_sess2 *
-cgn_sess2_lookup_by_key(struct cds_lfht *ht, struct s2_lookup_key *key)
+cgn_sess2_lookup_by_key(struct cgn_sess2_tbl *st, struct s2_lookup_key *key)
 {
 	struct cds_lfht_iter iter;
 	struct cds_lfht_node *node;
+	struct cds_lfht *ht;
 	struct cgn_sess2 *s2;
 	ulong hash;
+	uint i;
+
+	for (i = 0; i < CGN_SESS2_INLINE; i++) {
+		s2 = rcu_dereference(st->st_inline[i]);
+		if (s2 && !s2->s2_expired &&
+		    cgn_sess2_match(s2, key->s2k_id, key->s2k_addr))
+			return s2;
+	}
+
+	ht = rcu_dereference(st->st_ht);
+	if (!ht)
+		return NULL;
 
 	hash = rte_jhash_1word(key->s2k_addr, key->s2k_id);
 
@@ -386,15 +516,31 @@ cgn_sess2_lookup_by_key(struct cds_lfht *ht, struct s2_lookup_key *key)
 	return NULL;
 }
 
+struct cgn_sess2 *
+cgn_sess2_lookup(struct cgn_sess2_tbl *st, struct cgn_packet *cpk, int dir)
+{
+	struct s2_lookup_key lkey;
+
+	if (dir == CGN_DIR_OUT) {
+		lkey.s2k_addr = cpk->cpk_daddr;
+		lkey.s2k_id   = cpk->cpk_did;
+	} else {
+		lkey.s2k_addr = cpk->cpk_saddr;
+		lkey.s2k_id   = cpk->cpk_sid;
+	}
+
+	return cgn_sess2_lookup_by_key(st, &lkey);
+}
+
 /*
  * Inspect
  */
 struct cgn_sess2 *
-cgn_sess2_inspect(struct cds_lfht *ht, struct cgn_packet *cpk, int dir)
+cgn_sess2_inspect(struct cgn_sess2_tbl *st, struct cgn_packet *cpk, int dir)
 {
 	struct cgn_sess2 *s2;
 
-	s2 = cgn_sess2_lookup(ht, cpk, dir);
+	s2 = cgn_sess2_lookup(st, cpk, dir);
 	if (!s2)
 		return NULL;
 
@@ -451,22 +597,25 @@ static inline uint32_t cgn_sess2_state_expiry_time(struct cgn_state *st)
 	return cgn_sess_state_expiry_time(st->st_proto, st->st_state);
 }
 
+static int
+cgn_sess2_unexpired_cb(struct cgn_sess2_tbl *st __unused,
+		       struct cgn_sess2 *s2, void *data)
+{
+	uint32_t *count = data;
+
+	if (!s2->s2_expired)
+		(*count)++;
+	return 0;
+}
+
 /*
  * Count of unexpired sessions
  */
-uint32_t cgn_sess2_unexpired(struct cds_lfht *ht)
+uint32_t cgn_sess2_unexpired(struct cgn_sess2_tbl *st)
 {
-	struct cds_lfht_iter iter;
-	struct cgn_sess2 *s2;
 	uint32_t count = 0;
 
-	if (!ht)
-		return 0;
-
-	cds_lfht_for_each_entry(ht, &iter, s2, s2_node) {
-		if (!s2->s2_expired)
-			count++;
-	}
+	cgn_sess2_walk(st, cgn_sess2_unexpired_cb, &count);
 	return count;
 }
 
@@ -548,88 +697,88 @@ static inline bool cgn_sess2_expired(struct cgn_sess2 *s2)
 	return false;
 }
 
-static void cgn_sess2_rcu_free(struct rcu_head *head)
-{
-	struct cgn_sess2 *s2 = caa_container_of(head, struct cgn_sess2,
-						s2_rcu_head);
-	free(s2);
-}
+struct cgn_sess2_gc_counts {
+	uint	*unexpd;
+	uint	*expd;
+};
 
-static void
-cgn_sess2_destroy(struct cgn_sess2 *s2)
+static int
+cgn_sess2_gc_inspect(struct cgn_sess2_tbl *st, struct cgn_sess2 *s2,
+		     void *data)
 {
-	call_rcu(&s2->s2_rcu_head, cgn_sess2_rcu_free);
-}
+	struct cgn_sess2_gc_counts *gc = data;
 
-void cgn_sess2_gc_walk(struct cds_lfht *ht, uint *unexpd, uint *expd)
-{
-	struct cds_lfht_iter iter;
-	struct cgn_sess2 *s2;
+	cgn_sess2_stats_periodic(s2, false);
 
-	cds_lfht_for_each_entry(ht, &iter, s2, s2_node) {
+	if (s2->s2_log_countdown) {
+		s2->s2_log_countdown -= 1;
 
-		cgn_sess2_stats_periodic(s2, false);
+		if (s2->s2_log_countdown == 0) {
+			s2->s2_log_countdown =
+				cgn_session_log_periodic(s2->s2_cse);
+			cgn_log_sess_active(s2);
+		}
+	}
 
-		if (s2->s2_log_countdown) {
-			s2->s2_log_countdown -= 1;
+	if (!cgn_sess2_expired(s2)) {
+		(*gc->unexpd)++;
+		return 0;
+	}
 
-			if (s2->s2_log_countdown == 0) {
-				s2->s2_log_countdown =
-					cgn_session_log_periodic(s2->s2_cse);
-				cgn_log_sess_active(s2);
-			}
-		}
+	if (!s2->s2_gc_pass) {
+		s2->s2_gc_pass = true;
+		(*gc->expd)++;
+		return 0;
+	}
 
-		if (!cgn_sess2_expired(s2)) {
-			(*unexpd)++;
-			continue;
-		}
+	/* Remove from inline slot or hash table */
+	cgn_sess2_deactivate(st, s2);
 
-		if (!s2->s2_gc_pass) {
-			s2->s2_gc_pass = true;
-			(*expd)++;
-			continue;
-		}
+	/* Schedule rcu free */
+	cgn_sess2_destroy(s2);
 
-		/* Remove from hash table */
-		cgn_sess2_deactivate(ht, s2);
+	return 0;
+}
 
-		/* Schedule rcu free */
-		cgn_sess2_destroy(s2);
-	}
+void cgn_sess2_gc_walk(struct cgn_sess2_tbl *st, uint *unexpd, uint *expd)
+{
+	struct cgn_sess2_gc_counts gc = { .unexpd = unexpd, .expd = expd };
+
+	cgn_sess2_walk(st, cgn_sess2_gc_inspect, &gc);
 }
 
-uint cgn_sess2_expire_all(struct cds_lfht *ht)
+struct cgn_sess2_expire_arg {
+	uint32_t	id;
+	uint		count;
+};
+
+static int
+cgn_sess2_expire_cb(struct cgn_sess2_tbl *st __unused, struct cgn_sess2 *s2,
+		    void *data)
 {
-	struct cds_lfht_iter iter;
-	struct cgn_sess2 *s2;
-	uint count = 0;
+	struct cgn_sess2_expire_arg *arg = data;
 
-	cds_lfht_for_each_entry(ht, &iter, s2, s2_node) {
-		if (!s2->s2_expired) {
-			cgn_sess2_set_expired(s2, true, false);
-			count++;
-		}
+	if (!s2->s2_expired && (arg->id == 0 || arg->id == s2->s2_id)) {
+		cgn_sess2_set_expired(s2, true, false);
+		arg->count++;
 	}
-	return count;
+	return 0;
+}
+
+uint cgn_sess2_expire_all(struct cgn_sess2_tbl *st)
+{
+	return cgn_sess2_expire_id(st, 0);
 }
 
 /*
  * Expire session by ID
  */
-uint cgn_sess2_expire_id(struct cds_lfht *ht, uint32_t s2_id)
+uint cgn_sess2_expire_id(struct cgn_sess2_tbl *st, uint32_t s2_id)
 {
-	struct cds_lfht_iter iter;
-	struct cgn_sess2 *s2;
-	uint count = 0;
+	struct cgn_sess2_expire_arg arg = { .id = s2_id, .count = 0 };
 
-	cds_lfht_for_each_entry(ht, &iter, s2, s2_node) {
-		if (!s2->s2_expired && (s2_id == 0 || s2_id == s2->s2_id)) {
-			cgn_sess2_set_expired(s2, true, false);
-			count++;
-		}
-	}
-	return count;
+	cgn_sess2_walk(st, cgn_sess2_expire_cb, &arg);
+	return arg.count;
 }
 
 static void
@@ -694,17 +843,34 @@ cgn_sess2_show_fltr(struct cgn_sess2 *s2, struct cgn_sess_fltr *fltr)
 	return true;
 }
 
+struct cgn_sess2_show_arg {
+	json_writer_t		*json;
+	struct cgn_sess_fltr	*fltr;
+	uint			count;
+};
+
+static int
+cgn_sess2_show_cb(struct cgn_sess2_tbl *st __unused, struct cgn_sess2 *s2,
+		  void *data)
+{
+	struct cgn_sess2_show_arg *arg = data;
+
+	if (cgn_sess2_show_fltr(s2, arg->fltr)) {
+		if (arg->json)
+			cgn_sess2_jsonw_one(arg->json, s2);
+		arg->count++;
+	}
+	return 0;
+}
+
 /*
  * Determine how many sessions a filter might match in cgn_sess2_show.
  */
-uint cgn_sess2_show_count(struct cds_lfht *ht, struct cgn_sess_fltr *fltr)
+uint cgn_sess2_show_count(struct cgn_sess2_tbl *st,
+			  struct cgn_sess_fltr *fltr)
 {
-	struct cds_lfht_iter iter;
+	struct cgn_sess2_show_arg arg = { .json = NULL, .fltr = fltr };
 	struct cgn_sess2 *s2;
-	uint32_t count = 0;
-
-	if (!ht)
-		return 0;
 
 	/*
 	 * Are there enough filter params to do a hash lookup?
@@ -712,22 +878,19 @@ uint cgn_sess2_show_count(struct cds_lfht *ht, struct cgn_sess_fltr *fltr)
 	if (fltr->cf_dst_mask == 0xffffffff &&
 	    cgn_s2_key_valid(&fltr->cf_dst)) {
 
-		s2 = cgn_sess2_lookup_by_key(ht, &fltr->cf_dst);
+		s2 = cgn_sess2_lookup_by_key(st, &fltr->cf_dst);
 		if (s2 && cgn_sess2_show_fltr(s2, fltr))
 			return 1;
 	}
 
-	cds_lfht_for_each_entry(ht, &iter, s2, s2_node) {
-		if (cgn_sess2_show_fltr(s2, fltr))
-			count++;
-	}
-	return count;
+	cgn_sess2_walk(st, cgn_sess2_show_cb, &arg);
+	return arg.count;
 }
 
-uint cgn_sess2_show(json_writer_t *json, struct cds_lfht *ht,
+uint cgn_sess2_show(json_writer_t *json, struct cgn_sess2_tbl *st,
 		    struct cgn_sess_fltr *fltr)
 {
-	struct cds_lfht_iter iter;
+	struct cgn_sess2_show_arg arg = { .json = json, .fltr = fltr };
 	struct cgn_sess2 *s2;
 	uint count = 0;
 
@@ -743,7 +906,7 @@ uint cgn_sess2_show(json_writer_t *json, struct cds_lfht *ht,
 	if (fltr->cf_dst_mask == 0xffffffff &&
 	    cgn_s2_key_valid(&fltr->cf_dst)) {
 
-		s2 = cgn_sess2_lookup_by_key(ht, &fltr->cf_dst);
+		s2 = cgn_sess2_lookup_by_key(st, &fltr->cf_dst);
 
 		if (s2 && cgn_sess2_show_fltr(s2, fltr)) {
 			cgn_sess2_jsonw_one(json, s2);
@@ -752,13 +915,8 @@ uint cgn_sess2_show(json_writer_t *json, struct cds_lfht *ht,
 		goto end;
 	}
 
-	cds_lfht_for_each_entry(ht, &iter, s2, s2_node) {
-
-		if (cgn_sess2_show_fltr(s2, fltr)) {
-			cgn_sess2_jsonw_one(json, s2);
-			count++;
-		}
-	}
+	cgn_sess2_walk(st, cgn_sess2_show_cb, &arg);
+	count = arg.count;
 
 end:
 	jsonw_end_array(json);
@@ -767,25 +925,14 @@ end:
 	return count;
 }
 
-struct cds_lfht *cgn_sess2_ht_create(void)
+void cgn_sess2_tbl_destroy(struct cgn_sess2_tbl *st)
 {
-	struct cds_lfht *ht;
-
-	ht = cds_lfht_new(CGN_SESS2_HT_INIT, CGN_SESS2_HT_MIN,
-			  CGN_SESS2_HT_MAX, CGN_SESS2_HT_FLAGS, NULL);
-	return ht;
-}
-
-void cgn_sess2_ht_destroy(struct cds_lfht **htp)
-{
-	struct cds_lfht *ht = *htp;
-
-	if (ht) {
-		assert(cgn_sess2_count(ht) == 0);
+	assert(cgn_sess2_count(st) == 0);
 
+	if (st->st_ht) {
 		/* Destroy sess2 hash table */
-		dp_ht_destroy_deferred(ht);
-		*htp = NULL;
+		dp_ht_destroy_deferred(st->st_ht);
+		st->st_ht = NULL;
 	}
 }
 
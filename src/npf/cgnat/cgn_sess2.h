@@ -19,6 +19,20 @@ struct cgn_packet;
 struct cgn_sess2;
 struct cgn_state;
 
+/*
+ * Nested 2-tuple sessions of a 3-tuple session.
+ *
+ * Most 3-tuple sessions only ever have one or two destinations, so the
+ * first CGN_SESS2_INLINE 2-tuple sessions are held inline in the 3-tuple
+ * session.  A hash table is only created for any beyond that.
+ */
+#define CGN_SESS2_INLINE	2
+
+struct cgn_sess2_tbl {
+	struct cgn_sess2	*st_inline[CGN_SESS2_INLINE];
+	struct cds_lfht		*st_ht;
+};
+
 /* 3-tuple session lookup key */
 struct sess_lookup_key {
 	uint32_t sk_ifindex;
@@ -89,25 +103,26 @@ struct cgn_sess2 *cgn_sess2_establish(struct cgn_session *cse,
 				      struct cgn_packet *cpk,
 				      rte_atomic32_t *id_rsc, int dir);
 
-int cgn_sess2_activate(struct cds_lfht *ht, struct cgn_sess2 *s2);
+/* s2 is freed if activation fails */
+int cgn_sess2_activate(struct cgn_sess2_tbl *st, struct cgn_sess2 *s2);
 
-struct cgn_sess2 *cgn_sess2_inspect(struct cds_lfht *ht,
+struct cgn_sess2 *cgn_sess2_inspect(struct cgn_sess2_tbl *st,
 				    struct cgn_packet *cpk, int dir);
-uint32_t cgn_sess2_unexpired(struct cds_lfht *ht);
+uint32_t cgn_sess2_unexpired(struct cgn_sess2_tbl *st);
 
-struct cgn_sess2 *cgn_sess2_lookup(struct cds_lfht *ht,
+struct cgn_sess2 *cgn_sess2_lookup(struct cgn_sess2_tbl *st,
 				   struct cgn_packet *cpk, int dir);
 
-ulong cgn_sess2_count(struct cds_lfht *ht);
-void cgn_sess2_gc_walk(struct cds_lfht *ht, uint *unexpd, uint *expd);
-uint cgn_sess2_expire_all(struct cds_lfht *ht);
-uint cgn_sess2_expire_id(struct cds_lfht *ht, uint32_t s2_id);
+ulong cgn_sess2_count(struct cgn_sess2_tbl *st);
+void cgn_sess2_gc_walk(struct cgn_sess2_tbl *st, uint *unexpd, uint *expd);
+uint cgn_sess2_expire_all(struct cgn_sess2_tbl *st);
+uint cgn_sess2_expire_id(struct cgn_sess2_tbl *st, uint32_t s2_id);
 
-struct cds_lfht *cgn_sess2_ht_create(void);
-void cgn_sess2_ht_destroy(struct cds_lfht **htp);
+void cgn_sess2_tbl_destroy(struct cgn_sess2_tbl *st);
 
-uint cgn_sess2_show_count(struct cds_lfht *ht, struct cgn_sess_fltr *fltr);
-uint cgn_sess2_show(json_writer_t *json, struct cds_lfht *ht,
+uint cgn_sess2_show_count(struct cgn_sess2_tbl *st,
+			  struct cgn_sess_fltr *fltr);
+uint cgn_sess2_show(json_writer_t *json, struct cgn_sess2_tbl *st,
 		    struct cgn_sess_fltr *fltr);
 
 #endif
@@ -35,6 +35,7 @@
 #include <time.h>
 
 #include "compiler.h"
+#include "dp_mem.h"
 #include "pktmbuf.h"
 #include "if_var.h"
 #include "vplane_log.h"
@@ -96,10 +97,8 @@ struct cgn_session {
 	uint32_t		cs_id;		/* unique identifier */
 	vrfid_t			cs_vrfid;	/* VRF id (uint32_t) */
 	uint32_t		cs_etime;	/* expiry time */
-	struct cds_lfht		*cs_sess2_ht;	/* Nested hash table */
 	struct cgn_source	*cs_src;	/* Back ptr to subscriber */
 	uint64_t		cs_start_time;
-	uint64_t		cs_end_time;
 	rte_atomic32_t		cs_sess2_id;	/* sess2 ID resource */
 	rte_atomic16_t		cs_sess2_used;	/* sess2 count */
 	uint8_t			cs_sess2_full;	/* sess2 full */
@@ -112,19 +111,33 @@ struct cgn_session {
 	uint8_t			cs_pkt_instd:1;
 	uint8_t			cs_map_instd:1;
 
+	/* Nested 2-tuple sessions record destinations */
+	uint8_t			cs_sess2_en:1;
+
 	uint16_t		cs_l3_chk_delta;
 	uint16_t		cs_l4_chk_delta;
 	uint16_t		cs_map_flag;	/* True if mapping exists */
 	rte_atomic16_t		cs_idle;
-	/* --- cacheline 3 boundary (192 bytes) --- */
-
-	struct rcu_head		cs_rcu_head;	/* 16 bytes */
 	uint16_t		cs_log_periodic;
+	uint8_t			cs_pad1[2];
 
 	/* timeout for a map instantiated session */
 	uint32_t		cs_map_timeout;
 
-	uint8_t			cs_pad3[42];	/* pad to cacheline boundary */
+	/*
+	 * Sessions created since the last gc pass.  Rolled-up into the
+	 * subscriber by the master thread so that forwarding threads never
+	 * write to the (widely shared) subscriber structure.
+	 */
+	rte_atomic32_t		cs_sess_created;
+	uint8_t			cs_pad2[4];
+	/* --- cacheline 3 boundary (192 bytes) --- */
+
+	struct rcu_head		cs_rcu_head;	/* 16 bytes */
+	struct cgn_sess2_tbl	cs_sess2;	/* 24 bytes */
+	struct cds_list_head	cs_src_link;	/* subscriber session list */
+
+	uint8_t			cs_pad3[8];	/* pad to cacheline boundary */
 	/* --- cacheline 4 boundary (256 bytes) --- */
 };
 
@@ -236,6 +249,7 @@ static void
 cgn_session_stats_periodic(struct cgn_session *cse)
 {
 	uint64_t pkts_out, pkts_in, bytes_out, bytes_in;
+	uint32_t sess_crtd;
 
 	pkts_out = rte_atomic64_exchange(
 		(volatile uint64_t *)&cse->cs_forw_entry.ce_pkts.cnt, 0UL);
@@ -249,6 +263,9 @@ cgn_session_stats_periodic(struct cgn_session *cse)
 	bytes_in = rte_atomic64_exchange(
 		(volatile uint64_t *)&cse->cs_back_entry.ce_bytes.cnt, 0UL);
 
+	sess_crtd = rte_atomic32_exchange(
+		(volatile uint32_t *)&cse->cs_sess_created.cnt, 0);
+
 	cse->cs_forw_entry.ce_pkts_tot += pkts_out;
 	cse->cs_forw_entry.ce_bytes_tot += bytes_out;
 	cse->cs_back_entry.ce_pkts_tot += pkts_in;
@@ -256,7 +273,7 @@ cgn_session_stats_periodic(struct cgn_session *cse)
 
 	/* Add stats to source totals */
 	cgn_source_update_stats(cse->cs_src, pkts_out, bytes_out,
-				pkts_in, bytes_in);
+				pkts_in, bytes_in, sess_crtd);
 }
 
 /* Count hash table nodes */
@@ -361,7 +378,7 @@ static struct cgn_session *cgn_session_create(int *error)
 		return NULL;
 	}
 
-	cse = zmalloc_aligned(sizeof(struct cgn_session));
+	cse = dp_mem_zmalloc(DP_MEM_CGNAT, sizeof(struct cgn_session));
 	if (unlikely(cse == NULL)) {
 		*error = -CGN_S1_ENOMEM;
 		return NULL;
@@ -378,7 +395,7 @@ static void cgn_session_rcu_free(struct rcu_head *head)
 	struct cgn_session *cse = caa_container_of(head, struct cgn_session,
 						   cs_rcu_head);
 
-	free(cse);
+	dp_mem_free(DP_MEM_CGNAT, cse, sizeof(*cse));
 }
 
 /*
@@ -417,13 +434,13 @@ void cgn_session_destroy(struct cgn_session *cse, bool rcu_free)
 	cgn_source_put(cse->cs_src);
 
 	/* Destroy nested hash table? */
-	if (cse->cs_sess2_ht)
-		cgn_sess2_ht_destroy(&cse->cs_sess2_ht);
+	if (cse->cs_sess2_en)
+		cgn_sess2_tbl_destroy(&cse->cs_sess2);
 
 	if (rcu_free)
 		call_rcu(&cse->cs_rcu_head, cgn_session_rcu_free);
 	else
-		free(cse);
+		dp_mem_free(DP_MEM_CGNAT, cse, sizeof(*cse));
 }
 
 /*
@@ -534,17 +551,11 @@ cgn_session_establish(struct cgn_packet *cpk, int dir,
 	cse->cs_l4_chk_delta = ~ip_fixup16_cksum(0, oid, tid);
 
 	/*
-	 * Does session need nested 2-tuple table?
+	 * Does session need nested 2-tuple sessions?  The first are held
+	 * inline, and a table only created when needed.
 	 */
-	if (cgn_policy_record_dest(cp, oaddr, dir)) {
-		cse->cs_sess2_ht = cgn_sess2_ht_create();
-
-		if (!cse->cs_sess2_ht) {
-			*error = -CGN_S1_ENOMEM;
-			free(cse);
-			return NULL;
-		}
-	}
+	if (cgn_policy_record_dest(cp, oaddr, dir))
+		cse->cs_sess2_en = 1;
 
 	/* Take reference on source */
 	cse->cs_src = cgn_source_get(src);
@@ -649,15 +660,14 @@ cgn_sess2_establish_and_activate(struct cgn_session *cse,
 		return -CGN_S2_ENOMEM;
 	}
 
-	rc = cgn_sess2_activate(cse->cs_sess2_ht, s2);
+	rc = cgn_sess2_activate(&cse->cs_sess2, s2);
 	if (unlikely(rc < 0)) {
-		/* Lost race to insert sess2 */
+		/* Lost race to insert sess2, which has been freed */
 		cgn_sess2_slot_put(cse);
-		free(s2);
 		return rc;
 	}
 
-	cgn_source_stats_sess_created(cse->cs_src);
+	rte_atomic32_inc(&cse->cs_sess_created);
 	return 0;
 }
 
@@ -698,8 +708,13 @@ int cgn_session_activate(struct cgn_session *cse,
 		goto end;
 	}
 
+	/* Add to the subscribers session list */
+	rte_spinlock_lock(&cse->cs_src->sr_lock);
+	cds_list_add_tail_rcu(&cse->cs_src_link, &cse->cs_src->sr_sess_list);
+	rte_spinlock_unlock(&cse->cs_src->sr_lock);
+
 	/* Add a nested 2-tuple session? */
-	if (cse->cs_sess2_ht && cpk->cpk_keepalive) {
+	if (cse->cs_sess2_en && cpk->cpk_keepalive) {
 		rc = cgn_sess2_establish_and_activate(cse, cpk, dir);
 
 		/* Count the error, then ignore it */
@@ -710,7 +725,7 @@ int cgn_session_activate(struct cgn_session *cse,
 	} else {
 		struct cgn_sentry *ce = dir2sentry(cse, dir);
 
-		cgn_source_stats_sess_created(cse->cs_src);
+		rte_atomic32_inc(&cse->cs_sess_created);
 		rte_atomic64_inc(&ce->ce_pkts);
 		rte_atomic64_add(&ce->ce_bytes, cpk->cpk_len);
 	}
@@ -730,11 +745,16 @@ cgn_session_deactivate(struct cgn_session *cse)
 		cgn_sentry_delete(&cse->cs_forw_entry, CGN_DIR_FORW);
 		cgn_sentry_delete(&cse->cs_back_entry, CGN_DIR_BACK);
 
+		/* Remove from the subscribers session list */
+		rte_spinlock_lock(&cse->cs_src->sr_lock);
+		cds_list_del_rcu(&cse->cs_src_link);
+		rte_spinlock_unlock(&cse->cs_src->sr_lock);
+
 		/* Release the slot */
 		cgn_session_slot_put();
 
 		/* If nested sessions are in-use then we count them */
-		if (!cse->cs_sess2_ht)
+		if (!cse->cs_sess2_en)
 			cgn_source_stats_sess_destroyed(cse->cs_src);
 	}
 }
@@ -1048,7 +1068,7 @@ cgn_session_inspect(struct cgn_packet *cpk, int dir)
 	 * If we have nested 2-tuple sessions then they take care of sessions
 	 * idle monitoring and stats.
 	 */
-	if (unlikely(cse->cs_sess2_ht)) {
+	if (unlikely(cse->cs_sess2_en)) {
 		struct cgn_sess2 *s2;
 
 		/*
@@ -1070,7 +1090,7 @@ cgn_session_inspect(struct cgn_packet *cpk, int dir)
 		 * If we fail to find an s2 session here, then that means this
 		 * packet is being sent to a different dest addr and/or port.
 		 */
-		s2 = cgn_sess2_inspect(cse->cs_sess2_ht, cpk, dir);
+		s2 = cgn_sess2_inspect(&cse->cs_sess2, cpk, dir);
 
 		/* Add a nested 2-tuple session? */
 		if (!s2 && cpk->cpk_keepalive) {
@@ -1634,8 +1654,8 @@ cgn_session_jsonw_one(json_writer_t *json, struct cgn_sess_fltr *fltr,
 	 * filter criteria for those sessions then do not display the outer
 	 * 3-tuple session if no 2-tuple sessions match the criteria.
 	 */
-	if (cse->cs_sess2_ht && !fltr->cf_all_sess2 && !fltr->cf_no_sess2) {
-		uint s2_count = cgn_sess2_show_count(cse->cs_sess2_ht, fltr);
+	if (cse->cs_sess2_en && !fltr->cf_all_sess2 && !fltr->cf_no_sess2) {
+		uint s2_count = cgn_sess2_show_count(&cse->cs_sess2, fltr);
 
 		if (s2_count == 0)
 			return 0;
@@ -1690,14 +1710,14 @@ cgn_session_jsonw_one(json_writer_t *json, struct cgn_sess_fltr *fltr,
 	jsonw_bool_field(json, "exprd", cse->cs_forw_entry.ce_expired);
 	jsonw_uint_field(json, "refcnt", rte_atomic16_read(&cse->cs_refcnt));
 
-	if (cse->cs_sess2_ht) {
+	if (cse->cs_sess2_en) {
 		ulong ht_count;
 
 		/* count may be less than ht_count if there are filters */
 		if (!fltr->cf_no_sess2)
-			count = cgn_sess2_show(json, cse->cs_sess2_ht, fltr);
+			count = cgn_sess2_show(json, &cse->cs_sess2, fltr);
 
-		ht_count = cgn_sess2_count(cse->cs_sess2_ht);
+		ht_count = cgn_sess2_count(&cse->cs_sess2);
 		jsonw_uint_field(json, "nsessions", ht_count);
 
 		/*
@@ -1811,6 +1831,148 @@ cgn_session_show_fltr(struct cgn_session *cse, struct cgn_sess_fltr *fltr)
 	return true;
 }
 
+/*
+ * Is the session translated to a port in the given port block?
+ */
+static bool
+cgn_session_in_block(struct cgn_session *cse, struct apm_port_block *pb)
+{
+	struct cgn_sentry *bk = &cse->cs_back_entry;
+	struct apm *apm = apm_block_get_apm(pb);
+
+	return ntohl(bk->ce_addr) == apm->apm_addr &&
+		apm_block(ntohs(bk->ce_port), apm->apm_port_start,
+			  apm->apm_port_block_sz) == apm_block_get_block(pb);
+}
+
+/*
+ * Show sessions from a subscribers session list, starting after 'from' if
+ * set.  If pb is set, then only sessions in that port block are shown.
+ * Returns true when the requested count has been reached.
+ */
+static bool
+cgn_session_show_src(json_writer_t *json, struct cgn_sess_fltr *fltr,
+		     struct cgn_source *src, struct cgn_session *from,
+		     struct apm_port_block *pb, uint *count)
+{
+	struct cds_list_head *head = &src->sr_sess_list;
+	struct cds_list_head *pos;
+	struct cgn_session *cse;
+
+	pos = from ? &from->cs_src_link : head;
+
+	for (pos = rcu_dereference(pos->next); pos != head;
+	     pos = rcu_dereference(pos->next)) {
+		cse = caa_container_of(pos, struct cgn_session, cs_src_link);
+
+		if (pb && !cgn_session_in_block(cse, pb))
+			continue;
+
+		if (cgn_session_show_fltr(cse, fltr))
+			*count += cgn_session_jsonw_one(json, fltr, cse);
+
+		/* Have we added enough sessions yet? */
+		if (fltr->cf_count > 0 && *count >= fltr->cf_count)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Find the target session of a batch request, if it is still in the
+ * subscriber session lists.  Only the master thread removes sessions from
+ * those lists, so it remains a valid place to continue from.
+ */
+static int
+cgn_session_show_tgt(struct cgn_sess_fltr *fltr, struct cgn_session **tgt)
+{
+	struct cgn_session *cse;
+
+	*tgt = NULL;
+	if (!cgn_sess_key_valid(&fltr->cf_tgt))
+		return 0;
+
+	cse = cgn_session_lookup_by_key(&fltr->cf_tgt, CGN_DIR_OUT);
+	if (!cse || !cse->cs_forw_entry.ce_active)
+		return -ENOENT;
+
+	*tgt = cse;
+	return 0;
+}
+
+/*
+ * Show the sessions of one subscriber address, using its session list
+ * instead of walking the session table.  Returns false if a batch target
+ * was given but has since gone, in which case the caller walks the table.
+ */
+static bool
+cgn_session_show_subs(json_writer_t *json, struct cgn_sess_fltr *fltr)
+{
+	struct cgn_session *tgt;
+	struct cgn_source *src;
+	uint count = 0;
+
+	if (cgn_session_show_tgt(fltr, &tgt) < 0)
+		return false;
+
+	src = cgn_source_lookup(ntohl(fltr->cf_subs.sk_addr), VRF_DEFAULT_ID);
+	if (!src)
+		return true;
+
+	if (tgt && tgt->cs_src != src)
+		return false;
+
+	cgn_session_show_src(json, fltr, src, tgt, NULL, &count);
+	return true;
+}
+
+/*
+ * Show the sessions of one public address.  Each port block in use belongs
+ * to one subscriber, so visit the blocks in order and show the sessions of
+ * each that use that block.  Returns false as for cgn_session_show_subs.
+ */
+static bool
+cgn_session_show_pub(json_writer_t *json, struct cgn_sess_fltr *fltr)
+{
+	struct apm_port_block *pb;
+	struct cgn_session *tgt;
+	struct cgn_source *src;
+	struct apm *apm;
+	uint16_t block = 0;
+	uint count = 0;
+
+	if (cgn_session_show_tgt(fltr, &tgt) < 0)
+		return false;
+
+	apm = apm_lookup(ntohl(fltr->cf_pub.sk_addr), VRF_DEFAULT_ID);
+	if (!apm)
+		return true;
+
+	if (tgt) {
+		struct cgn_sentry *bk = &tgt->cs_back_entry;
+
+		if (ntohl(bk->ce_addr) != apm->apm_addr)
+			return false;
+
+		block = apm_block(ntohs(bk->ce_port), apm->apm_port_start,
+				  apm->apm_port_block_sz);
+	}
+
+	for (; block < apm->apm_nblocks; block++, tgt = NULL) {
+		pb = rcu_dereference(apm->apm_blocks[block]);
+		if (!pb)
+			continue;
+
+		src = apm_block_get_source(pb);
+		if (!src)
+			continue;
+
+		if (cgn_session_show_src(json, fltr, src, tgt, pb, &count))
+			break;
+	}
+	return true;
+}
+
 /*
  * cgn-op show session ...
  */
@@ -1870,6 +2032,19 @@ void cgn_session_show(FILE *f, int argc, char **argv)
 		goto end;
 	}
 
+	/*
+	 * A single subscriber or public address?  Then only visit the
+	 * sessions of that subscriber, or of the subscribers with port blocks
+	 * on that public address.
+	 */
+	if (fltr.cf_subs_mask == 0xffffffff &&
+	    cgn_session_show_subs(json, &fltr))
+		goto end;
+
+	if (fltr.cf_pub_mask == 0xffffffff &&
+	    cgn_session_show_pub(json, &fltr))
+		goto end;
+
 	struct cds_lfht_iter iter;
 	struct cds_lfht_node *node;
 	struct cgn_sentry *ce;
@@ -1942,7 +2117,6 @@ cgn_session_set_expired(struct cgn_session *cse)
 {
 	cse->cs_forw_entry.ce_expired = true;
 	cse->cs_back_entry.ce_expired = true;
-	cse->cs_end_time = soft_ticks;
 	cse->cs_etime = 0;
 
 	/* Add stats to source totals */
@@ -2051,16 +2225,16 @@ cgn_session_clear_fltr(struct cgn_sess_fltr *fltr, bool clear_map,
 				continue;
 
 			/* Expire one or all 2-tuple sessions */
-			if (cse->cs_sess2_ht)
-				count += cgn_sess2_expire_id(cse->cs_sess2_ht,
+			if (cse->cs_sess2_en)
+				count += cgn_sess2_expire_id(&cse->cs_sess2,
 							     fltr->cf_id2);
 
 			/*
 			 * If no unexpired 2-tuple sessions remain then expire
 			 * 3-tuple session and clear mapping.
 			 */
-			if (!cse->cs_sess2_ht ||
-			    cgn_sess2_unexpired(cse->cs_sess2_ht) == 0) {
+			if (!cse->cs_sess2_en ||
+			    cgn_sess2_unexpired(&cse->cs_sess2) == 0) {
 
 				if (!ce->ce_expired)
 					cgn_session_set_expired(cse);
@@ -2083,8 +2257,8 @@ cgn_session_clear_fltr(struct cgn_sess_fltr *fltr, bool clear_map,
 			continue;
 
 		if (!ce->ce_expired) {
-			if (cse->cs_sess2_ht)
-				count += cgn_sess2_expire_all(cse->cs_sess2_ht);
+			if (cse->cs_sess2_en)
+				count += cgn_sess2_expire_all(&cse->cs_sess2);
 
 			cgn_session_set_expired(cse);
 		}
@@ -2159,8 +2333,8 @@ cgn_session_expire_all(bool clear_map, bool restart_timer)
 		cse = caa_container_of(ce, struct cgn_session, cs_forw_entry);
 
 		if (!ce->ce_expired) {
-			if (cse->cs_sess2_ht)
-				count += cgn_sess2_expire_all(cse->cs_sess2_ht);
+			if (cse->cs_sess2_en)
+				count += cgn_sess2_expire_all(&cse->cs_sess2);
 
 			cgn_session_set_expired(cse);
 		}
@@ -2210,8 +2384,8 @@ void cgn_session_expire_pool(bool restart_timer, struct nat_pool *np,
 			continue;
 
 		if (!ce->ce_expired) {
-			if (cse->cs_sess2_ht)
-				count += cgn_sess2_expire_all(cse->cs_sess2_ht);
+			if (cse->cs_sess2_en)
+				count += cgn_sess2_expire_all(&cse->cs_sess2);
 
 			cgn_session_set_expired(cse);
 		}
@@ -2262,8 +2436,8 @@ void cgn_session_expire_policy(bool restart_timer, struct cgn_policy *cp)
 		if (cse->cs_src && cse->cs_src->sr_policy != cp)
 			continue;
 
-		if (cse->cs_sess2_ht)
-			count += cgn_sess2_expire_all(cse->cs_sess2_ht);
+		if (cse->cs_sess2_en)
+			count += cgn_sess2_expire_all(&cse->cs_sess2);
 
 		cgn_session_set_expired(cse);
 	}
@@ -2341,11 +2515,11 @@ static inline void
 cgn_session_gc_inspect(struct cgn_session *cse)
 {
 
-	if (cse->cs_sess2_ht) {
+	if (cse->cs_sess2_en) {
 		uint unexpd = 0, expd = 0;
 
 		/* Are there any unexpired 2-tuple sessions? */
-		cgn_sess2_gc_walk(cse->cs_sess2_ht, &unexpd, &expd);
+		cgn_sess2_gc_walk(&cse->cs_sess2, &unexpd, &expd);
 
 		/*
 		 * sentry pkt and bytes counts will have been updated by the
@@ -2442,6 +2616,9 @@ cgn_session_gc(struct rte_timer *timer __rte_unused, void *arg __rte_unused)
 	/* Walk the session table. */
 	cgn_session_gc_walk();
 
+	/* Return port-blocks left unused in the per-lcore caches */
+	cgn_map_cache_gc();
+
 	/* Restart timer if dataplane still running. */
 	if (running)
 		cgn_session_start_timer();
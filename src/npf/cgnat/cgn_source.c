@@ -57,7 +57,8 @@ static bool cgn_src_table_full;
  */
 void cgn_source_update_stats(struct cgn_source *src,
 			     uint64_t pkts_out, uint64_t bytes_out,
-			     uint64_t pkts_in, uint64_t bytes_in)
+			     uint64_t pkts_in, uint64_t bytes_in,
+			     uint32_t sess_crtd)
 {
 	assert(src);
 	if (src) {
@@ -65,6 +66,7 @@ void cgn_source_update_stats(struct cgn_source *src,
 		src->sr_bytes_out += bytes_out;
 		src->sr_pkts_in += pkts_in;
 		src->sr_bytes_in += bytes_in;
+		src->sr_sess_created += sess_crtd;
 	}
 }
 
@@ -80,16 +82,11 @@ void cgn_source_put(struct cgn_source *src)
 	rte_atomic32_dec(&src->sr_refcnt);
 }
 
-void cgn_source_stats_sess_created(struct cgn_source *src)
-{
-	if (src)
-		rte_atomic32_inc(&src->sr_sess_created);
-}
-
+/* Only called by the master thread */
 void cgn_source_stats_sess_destroyed(struct cgn_source *src)
 {
 	if (src)
-		rte_atomic32_inc(&src->sr_sess_destroyed);
+		src->sr_sess_destroyed++;
 }
 
 struct nat_pool *cgn_source_get_pool(struct cgn_source *src)
@@ -110,6 +107,7 @@ cgn_source_add_block(struct cgn_source *src, uint8_t proto,
 	assert(rte_spinlock_is_locked(&src->sr_lock));
 
 	cds_list_add_tail(apm_block_get_list_node(pb), &src->sr_block_list);
+	apm_block_set_source(pb, src);
 
 	src->sr_block_count++;
 
@@ -137,7 +135,8 @@ cgn_source_add_block(struct cgn_source *src, uint8_t proto,
 			src->sr_paired_addr = apm->apm_addr;
 	}
 
-	if (nat_pool_log_pba(np))
+	/* Deterministic mappings are known from config, so are not logged */
+	if (nat_pool_log_pba(np) && !cgn_policy_is_deterministic(src->sr_policy))
 		apm_log_block_alloc(pb, src->sr_addr);
 
 	return 0;
@@ -163,10 +162,11 @@ cgn_source_del_block(struct cgn_source *src, struct apm_port_block *pb,
 		return -1;
 	}
 
-	if (nat_pool_log_pba(np))
+	if (nat_pool_log_pba(np) && !cgn_policy_is_deterministic(src->sr_policy))
 		apm_log_block_release(pb, src->sr_addr);
 
 	cds_list_del_rcu(apm_block_get_list_node(pb));
+	apm_block_set_source(pb, NULL);
 	src->sr_block_count--;
 
 	/* Release reference on source */
@@ -262,6 +262,7 @@ cgn_source_create(struct cgn_policy *cp, uint32_t addr, vrfid_t vrfid,
 
 	CDS_INIT_LIST_HEAD(&src->sr_block_list);
 	src->sr_block_count = 0;
+	CDS_INIT_LIST_HEAD(&src->sr_sess_list);
 
 	for (proto = NAT_PROTO_FIRST; proto < NAT_PROTO_COUNT; proto++)
 		src->sr_active_block[proto] = NULL;
@@ -614,8 +615,8 @@ cgn_source_jsonw_one(json_writer_t *json, uint detail __unused,
 	/* Sessions stats */
 	uint32_t sess_crtd, sess_dstrd;
 
-	sess_crtd = rte_atomic32_read(&src->sr_sess_created);
-	sess_dstrd = rte_atomic32_read(&src->sr_sess_destroyed);
+	sess_crtd = src->sr_sess_created;
+	sess_dstrd = src->sr_sess_destroyed;
 
 	jsonw_uint_field(json, "sess_crtd",
 			 src->sr_sess_created_tot + sess_crtd);
@@ -902,10 +903,10 @@ cgn_source_stats_periodic(struct cgn_source *src)
 	 */
 	uint32_t sess_crtd, sess_dstd;
 
-	sess_crtd = rte_atomic32_exchange(
-		(volatile uint32_t *)&src->sr_sess_created.cnt, 0);
-	sess_dstd = rte_atomic32_exchange(
-		(volatile uint32_t *)&src->sr_sess_destroyed.cnt, 0);
+	sess_crtd = src->sr_sess_created;
+	sess_dstd = src->sr_sess_destroyed;
+	src->sr_sess_created = 0;
+	src->sr_sess_destroyed = 0;
 
 	src->sr_sess_created_tot += sess_crtd;
 	src->sr_sess_destroyed_tot += sess_dstd;
@@ -36,6 +36,11 @@ struct apm_port_block;
  * limit.  It is used to gate log messages.  Note thats its possible (and
  * likely) that one protocol will cause max-blocks to be reached, and that
  * this should not prevent allocations for other protocols.
+ *
+ * sr_sess_list holds the subscribers active 3-tuple sessions, so that
+ * operational queries for one subscriber need not walk the whole session
+ * table.  Forwarding threads add to it under sr_lock, and only the master
+ * thread removes from it.
  */
 struct cgn_source {
 	struct cds_lfht_node	sr_node;        /* hash table node */
@@ -49,6 +54,7 @@ struct cgn_source {
 	struct cds_list_head	sr_block_list;
 	uint16_t		sr_block_count;   /* blocks in sr_block_list */
 	uint8_t			sr_mbpu_full;     /* mbpu reached */
+	struct cds_list_head	sr_sess_list;     /* active sessions */
 
 	vrfid_t			sr_vrfid;
 	rte_spinlock_t		sr_lock;
@@ -64,9 +70,12 @@ struct cgn_source {
 	struct cgn_policy	*sr_policy;     /* Back ptr to policy */
 	uint64_t		sr_start_time;  /* millisecs */
 
-	/* Sessions created and destroyed in current interval */
-	rte_atomic32_t		sr_sess_created;
-	rte_atomic32_t		sr_sess_destroyed;
+	/*
+	 * Sessions created and destroyed in current interval.  Only written
+	 * by the master thread, when session stats are rolled-up.
+	 */
+	uint32_t		sr_sess_created;
+	uint32_t		sr_sess_destroyed;
 
 	/* Total sessions created/destroyed since src start */
 	uint64_t		sr_sess_created_tot;
@@ -98,7 +107,6 @@ int cgn_source_del_block(struct cgn_source *src, struct apm_port_block *pb,
 
 struct cgn_source *cgn_source_get(struct cgn_source *src);
 void cgn_source_put(struct cgn_source *src);
-void cgn_source_stats_sess_created(struct cgn_source *src);
 void cgn_source_stats_sess_destroyed(struct cgn_source *src);
 struct nat_pool *cgn_source_get_pool(struct cgn_source *src);
 
@@ -114,7 +122,8 @@ struct cgn_source *cgn_source_find_and_lock(struct cgn_policy *cp,
 
 void cgn_source_update_stats(struct cgn_source *src,
 			     uint64_t pkts_out, uint64_t bytes_out,
-			     uint64_t pkts_in, uint64_t bytes_in);
+			     uint64_t pkts_in, uint64_t bytes_in,
+			     uint32_t sess_crtd);
 
 /* Get subscriber hash table used and max counts */
 int32_t cgn_source_get_used(void);
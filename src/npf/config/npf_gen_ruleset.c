@@ -80,6 +80,7 @@ npf_cfg_create_ruleset_group_cb(const struct npf_attpt_group *rsg, void *ctx)
 	const struct npf_rlgrp_key *rgk = npf_attpt_group_key(rsg);
 	struct create_ruleset_info *info = ctx;
 	npf_rule_group_t *rg;
+	int ret;
 
 	/* Determine the match direction for this group */
 	uint8_t dir = 0;
@@ -111,8 +112,13 @@ npf_cfg_create_ruleset_group_cb(const struct npf_attpt_group *rsg, void *ctx)
 	if (info->num_rules_in_group == 0)
 		/* no rules in the group or does no exist, so discard it */
 		npf_free_group(rg);
-	else
-		npf_grouper_optimize(rg);
+	else {
+		ret = npf_grouper_optimize(rg);
+		if (ret) {
+			info->error = ret;
+			return false;
+		}
+	}
 
 	info->num_rules_in_group = 0;
 	info->dp_rule_group = NULL;
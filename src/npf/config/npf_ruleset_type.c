@@ -224,3 +224,41 @@ const char *npf_get_ruleset_type_log_name(enum npf_ruleset_type type)
 		return NULL;
 	return npf_ruleset_features[type].log_name;
 }
+
+/* Per ruleset type classifier, grouper2 unless configured otherwise */
+static enum npf_classifier npf_ruleset_classifier[NPF_RS_TYPE_COUNT];
+
+static const char * const npf_classifier_names[NPF_CLASSIFIER_COUNT] = {
+	[NPF_CLASSIFIER_GROUPER] = "grouper",
+	[NPF_CLASSIFIER_TSS] = "tuple-space",
+};
+
+enum npf_classifier npf_get_ruleset_type_classifier(enum npf_ruleset_type type)
+{
+	if (type >= NPF_RS_TYPE_COUNT)
+		return NPF_CLASSIFIER_GROUPER;
+	return npf_ruleset_classifier[type];
+}
+
+int npf_set_ruleset_type_classifier(enum npf_ruleset_type type,
+				    enum npf_classifier classifier)
+{
+	if (type >= NPF_RS_TYPE_COUNT || classifier >= NPF_CLASSIFIER_COUNT)
+		return -EINVAL;
+	npf_ruleset_classifier[type] = classifier;
+	return 0;
+}
+
+int npf_get_classifier(const char *name, enum npf_classifier *classifier)
+{
+	enum npf_classifier c;
+
+	for (c = 0; c < NPF_CLASSIFIER_COUNT; c++) {
+		if (strcmp(name, npf_classifier_names[c]) == 0) {
+			*classifier = c;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
@@ -50,6 +50,16 @@ enum npf_rs_flag {
 	NPF_RS_FLAG_FEAT_GBL =       1 << 6, /* feats enabled on all intfs */
 };
 
+/**
+ * Classifier used to select candidate rules in a rule group before
+ * their n-code is run.
+ */
+enum npf_classifier {
+	NPF_CLASSIFIER_GROUPER,		/* grouper2 bit patterns (default) */
+	NPF_CLASSIFIER_TSS,		/* tuple space search */
+	NPF_CLASSIFIER_COUNT /* Must be last */
+};
+
 /**
  * Get the flags associated with the given ruleset type
  *
@@ -108,4 +118,34 @@ uint32_t npf_get_ruleset_type_log_level(enum npf_ruleset_type type);
  */
 const char *npf_get_ruleset_type_log_name(enum npf_ruleset_type type);
 
+/**
+ * Get the classifier used by rule groups of the given ruleset type
+ *
+ * @param type The type of the ruleset
+ * @return returns the classifier - NPF_CLASSIFIER_GROUPER will be
+ *         returned if an invalid type is passed in.
+ */
+enum npf_classifier npf_get_ruleset_type_classifier(enum npf_ruleset_type type);
+
+/**
+ * Set the classifier used by rule groups of the given ruleset type.
+ * Takes effect when rulesets of that type are next built.
+ *
+ * @param type The type of the ruleset
+ * @param classifier The classifier to use
+ * @return returns 0 on success and a negative errno on failure
+ */
+int npf_set_ruleset_type_classifier(enum npf_ruleset_type type,
+				    enum npf_classifier classifier);
+
+/**
+ * Get the classifier associated with a given name
+ *
+ * @param name the name to look up ("grouper" or "tuple-space")
+ * @param classifier a pointer which will be filled in on success.
+ *
+ * @return returns 0 on success and a negative errno on failure
+ */
+int npf_get_classifier(const char *name, enum npf_classifier *classifier);
+
 #endif /* _NPF_RULE_SET_TYPE_H_ */
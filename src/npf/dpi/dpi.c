@@ -7,22 +7,32 @@
  */
 
 #include <errno.h>
+#include <inttypes.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
+#include <pthread.h>
 #include <qmdpi.h>
+#include <rte_atomic.h>
 #include <rte_branch_prediction.h>
 #include <rte_config.h>
+#include <rte_jhash.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
 #include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_ring.h>
 #include <rte_spinlock.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
 #include <time.h>
+#include <unistd.h>
 #include <dpi/protodef.h>       /* For Q_PROTO_BASE and Q_PROTO_MAX */
 
+#include "config.h"
 #include "npf/dpi/dpi.h"
 #include "npf/dpi/dpi_private.h"
 #include "npf/npf.h" /* For get_time_uptime() */
@@ -60,13 +70,75 @@ _Static_assert(Q_PROTO_MAX < APP_ID_Q, "Q_PROTO_MAX is too high");
 /* Index within the qosmos 'path',  e.g. base.ip.tcp.http */
 #define DPI_L5_INDEX 3
 
-static uint64_t dpi_app_id_to_type_bitfield(uint32_t app_id);
+/*
+ * With "dpi-cpus" configured, packets are not inspected inline.  Their
+ * payload is copied into a job and queued to one of a set of DPI
+ * threads, each pinned to one of the CPUs and owning its own engine
+ * worker, after those of the lcores.
+ */
+#define DPI_THREADS_MAX		16
+#define DPI_WORKERS_MAX		(RTE_MAX_LCORE + DPI_THREADS_MAX)
+#define DPI_JOB_DATA		2048	/* payload bytes inspected */
+#define DPI_JOB_RING_SZ		4096	/* jobs queued per thread */
+#define DPI_JOB_BURST		32
+#define DPI_THREAD_IDLE_US	100
+
+struct dpi_job {
+	struct dpi_flow	*flow;
+	uint32_t	ifindex;
+	uint16_t	len;
+	bool		forw;
+	char		data[DPI_JOB_DATA];
+};
+
+struct dpi_thread {
+	pthread_t	dt_thread;
+	struct rte_ring	*dt_ring;
+	unsigned int	dt_cpu;
+};
+
+/*
+ * Results learned from completed classifications, keyed by the server
+ * end of the flow.  Most traffic goes to a few service endpoints, so
+ * new flows to one already seen take its application without running
+ * the engine.  Every DPI_CACHE_VERIFY'th such flow is classified anyway,
+ * refreshing the entry.
+ */
+#define DPI_CACHE_SETS		4096
+#define DPI_CACHE_WAYS		4
+#define DPI_CACHE_VERIFY	16
+
+struct dpi_cache_entry {
+	struct dpi_cache_key	key;
+	uint32_t		app_proto;
+	uint32_t		app_name;
+	uint64_t		app_type;
+	uint32_t		used;		/* set clock at last use */
+	uint16_t		hits;
+	bool			valid;
+};
+
+struct dpi_cache_set {
+	rte_spinlock_t		lock;
+	uint32_t		clock;
+	struct dpi_cache_entry	way[DPI_CACHE_WAYS];
+} __rte_cache_aligned;
+
+static uint64_t dpi_app_id_to_type_bitfield(struct qmdpi_worker *worker,
+					    uint32_t app_id);
+static int dpi_threads_start(void);
 
 /* Local variables. */
 static struct qmdpi_engine *dpi_engine;
 static struct qmdpi_bundle *dpi_bundle;
-static struct qmdpi_worker *dpi_worker[RTE_MAX_LCORE];
-static rte_spinlock_t dpi_worker_lock[RTE_MAX_LCORE];
+static struct qmdpi_worker *dpi_worker[DPI_WORKERS_MAX];
+static rte_spinlock_t dpi_worker_lock[DPI_WORKERS_MAX];
+
+static struct dpi_thread dpi_threads[DPI_THREADS_MAX];
+static unsigned int dpi_nthreads;
+static struct rte_mempool *dpi_job_pool;
+static rte_atomic64_t dpi_jobs_dropped;
+static struct dpi_cache_set *dpi_cache;
 
 
 /* Get flow key tuple elements */
@@ -117,7 +189,7 @@ dpi_init(void)
 {
 	char sys_ini_str[DPI_INI_STR_LEN];
 	int ret;
-	unsigned int lcore;
+	unsigned int lcore, i;
 	static bool initialised;
 	static bool run_already;
 
@@ -130,9 +202,11 @@ dpi_init(void)
 	 * Appened the user init string (if any) to the system init string.
 	 * The last value is taken for each parameter.
 	 */
+	dpi_nthreads = RTE_MIN(bitmask_numset(&config.dpi_cpus),
+			       DPI_THREADS_MAX);
 	snprintf(sys_ini_str, DPI_INI_STR_LEN,
 		 "injection_mode=stream;nb_workers=%d;nb_flows=1",
-		 rte_lcore_count());
+		 rte_lcore_count() + dpi_nthreads);
 
 	/* Create DPI engine instance. */
 	dpi_engine = qmdpi_engine_create(sys_ini_str);
@@ -166,6 +240,13 @@ dpi_init(void)
 		goto error_bundle;
 	}
 
+	/* Without the cache, every flow is simply classified */
+	dpi_cache = zmalloc_aligned(DPI_CACHE_SETS * sizeof(*dpi_cache));
+	if (dpi_cache) {
+		for (i = 0; i < DPI_CACHE_SETS; i++)
+			rte_spinlock_init(&dpi_cache[i].lock);
+	}
+
 	/* Start a DPI worker for each core. */
 	RTE_LCORE_FOREACH(lcore) {
 		struct qmdpi_worker *worker = qmdpi_worker_create(dpi_engine);
@@ -178,8 +259,27 @@ dpi_init(void)
 		rte_spinlock_init(&dpi_worker_lock[lcore]);
 	}
 
-	RTE_LOG(INFO, DATAPLANE, "Initialised DPI (%d workers)\n",
-		rte_lcore_count());
+	/* And one for each DPI thread */
+	for (i = 0; i < dpi_nthreads; i++) {
+		struct qmdpi_worker *worker = qmdpi_worker_create(dpi_engine);
+		if (!worker) {
+			RTE_LOG(ERR, DATAPLANE,
+				"Failed to instantiate DPI worker %d\n",
+				RTE_MAX_LCORE + i);
+			goto error_bundle;
+		}
+		dpi_worker[RTE_MAX_LCORE + i] = worker;
+		rte_spinlock_init(&dpi_worker_lock[RTE_MAX_LCORE + i]);
+	}
+
+	if (dpi_nthreads && dpi_threads_start() < 0) {
+		RTE_LOG(ERR, DATAPLANE,
+			"Failed to start DPI threads, inspecting inline\n");
+		dpi_nthreads = 0;
+	}
+
+	RTE_LOG(INFO, DATAPLANE, "Initialised DPI (%d workers, %u threads)\n",
+		rte_lcore_count() + dpi_nthreads, dpi_nthreads);
 
 	initialised = true;
 
@@ -193,25 +293,106 @@ error:
 	return false;
 }
 
+static struct dpi_cache_set *
+dpi_cache_set(const struct dpi_cache_key *key)
+{
+	uint32_t hash = rte_jhash_32b((const uint32_t *)key,
+				      sizeof(*key) / sizeof(uint32_t), 0);
+
+	return &dpi_cache[hash % DPI_CACHE_SETS];
+}
+
+static struct dpi_cache_entry *
+dpi_cache_find(struct dpi_cache_set *set, const struct dpi_cache_key *key)
+{
+	unsigned int i;
+
+	for (i = 0; i < DPI_CACHE_WAYS; i++) {
+		struct dpi_cache_entry *e = &set->way[i];
+
+		if (e->valid && memcmp(&e->key, key, sizeof(*key)) == 0)
+			return e;
+	}
+	return NULL;
+}
+
 /*
- * Do all the DPI processing.
+ * Give the flow the cached result for its server, if any.
+ *
+ * Returns true if the flow can go without the engine.
  */
 static bool
-dpi_process(struct qmdpi_worker *worker, npf_cache_t *npc,
-	    struct rte_mbuf *mbuf, bool forw,
-	    uint32_t ifindex, struct dpi_flow *dpi_flow)
+dpi_cache_lookup(struct dpi_flow *dpi_flow)
 {
-	/* This should be impossible */
-	if (unlikely(!worker))
+	struct dpi_cache_set *set;
+	struct dpi_cache_entry *e;
+	bool hit = false;
+
+	if (!dpi_cache)
 		return false;
 
-	/*
-	 * Find the start of the transport payload.
-	 *
-	 * We can eventually pretend that other payloads (UDP-Lite, DCCP, SCTP)
-	 * are actually UDP, and handle them here with the appropriate
-	 * adjustment.
-	 */
+	set = dpi_cache_set(&dpi_flow->ckey);
+	rte_spinlock_lock(&set->lock);
+	e = dpi_cache_find(set, &dpi_flow->ckey);
+	if (e) {
+		e->used = ++set->clock;
+		dpi_flow->app_proto = e->app_proto;
+		dpi_flow->app_name = e->app_name;
+		dpi_flow->app_type = e->app_type;
+		hit = (++e->hits % DPI_CACHE_VERIFY) != 0;
+	}
+	rte_spinlock_unlock(&set->lock);
+
+	return hit;
+}
+
+/* Remember the result of a completed classification */
+static void
+dpi_cache_learn(const struct dpi_flow *dpi_flow)
+{
+	struct dpi_cache_set *set;
+	struct dpi_cache_entry *e;
+	unsigned int i;
+
+	if (!dpi_cache || !dpi_flow->ckey.alen)
+		return;
+
+	set = dpi_cache_set(&dpi_flow->ckey);
+	rte_spinlock_lock(&set->lock);
+	e = dpi_cache_find(set, &dpi_flow->ckey);
+	if (!e) {
+		/* Replace the least recently used */
+		e = &set->way[0];
+		for (i = 1; i < DPI_CACHE_WAYS && e->valid; i++) {
+			struct dpi_cache_entry *way = &set->way[i];
+
+			if (!way->valid || way->used < e->used)
+				e = way;
+		}
+		e->key = dpi_flow->ckey;
+		e->hits = 0;
+		e->valid = true;
+	}
+	e->app_proto = dpi_flow->app_proto;
+	e->app_name = dpi_flow->app_name;
+	e->app_type = dpi_flow->app_type;
+	e->used = ++set->clock;
+	rte_spinlock_unlock(&set->lock);
+}
+
+/*
+ * Find the start and length of the transport payload.
+ *
+ * We can eventually pretend that other payloads (UDP-Lite, DCCP, SCTP)
+ * are actually UDP, and handle them here with the appropriate
+ * adjustment.
+ *
+ * Returns false if there is nothing for the engine to look at.
+ */
+static bool
+dpi_payload(npf_cache_t *npc, struct rte_mbuf *mbuf,
+	    char **data, uint16_t *len)
+{
 	uint16_t data_offset = pktmbuf_l2_len(mbuf) + pktmbuf_l3_len(mbuf);
 	uint16_t data_len = rte_pktmbuf_data_len(mbuf) - data_offset;
 	switch (npf_cache_ipproto(npc)) {
@@ -226,7 +407,7 @@ dpi_process(struct qmdpi_worker *worker, npf_cache_t *npc,
 
 		/* Ignore UDP with invalid (out of spec) length */
 		if (l4_len > data_len || l4_len < sizeof(struct udphdr))
-			return true;
+			return false;
 		/* Use the UDP header length */
 		data_offset += sizeof(struct udphdr);
 		data_len = l4_len - sizeof(struct udphdr);
@@ -236,11 +417,24 @@ dpi_process(struct qmdpi_worker *worker, npf_cache_t *npc,
 		break;
 	}
 
-	char *data_ptr = rte_pktmbuf_mtod(mbuf, char *) + data_offset;
+	*data = rte_pktmbuf_mtod(mbuf, char *) + data_offset;
+	*len = data_len;
 
 	/* We need some payload to process */
-	if (data_len == 0)
-		return true;
+	return data_len != 0;
+}
+
+/*
+ * Feed a payload to the engine, with the worker locked.
+ */
+static bool
+dpi_process_data(struct qmdpi_worker *worker, char *data_ptr,
+		 uint16_t data_len, bool forw, uint32_t ifindex,
+		 struct dpi_flow *dpi_flow)
+{
+	/* This should be impossible */
+	if (unlikely(!worker))
+		return false;
 
 	/* Update stats and possibly offload */
 	if (dpi_flow->update_stats) {
@@ -290,21 +484,58 @@ dpi_process(struct qmdpi_worker *worker, npf_cache_t *npc,
 		dpi_flow->app_name =
 			DPI_ENGINE_QOSMOS | path->qp_value[path->qp_len-1];
 		dpi_flow->app_type =
-			dpi_app_id_to_type_bitfield(dpi_flow->app_name);
+			dpi_app_id_to_type_bitfield(worker,
+						    dpi_flow->app_name);
 	}
 
 	/* Does the engine suggest that we should offload now? */
-	if (qmdpi_flow_is_offloaded(dpi_flow->key))
+	if (qmdpi_flow_is_offloaded(dpi_flow->key)) {
 		dpi_flow->offloaded = true;
+		if (dpi_flow->app_name != DPI_APP_UNDETERMINED)
+			dpi_cache_learn(dpi_flow);
+	}
 
 	return true;
 }
 
+/*
+ * Do all the DPI processing.
+ */
+static bool
+dpi_process(struct qmdpi_worker *worker, npf_cache_t *npc,
+	    struct rte_mbuf *mbuf, bool forw,
+	    uint32_t ifindex, struct dpi_flow *dpi_flow)
+{
+	char *data_ptr;
+	uint16_t data_len;
+
+	if (!dpi_payload(npc, mbuf, &data_ptr, &data_len))
+		return true;
+
+	return dpi_process_data(worker, data_ptr, data_len, forw,
+				ifindex, dpi_flow);
+}
+
+/*
+ * In the event of an engine error we stop processing the flow,
+ * leaving it in an error state.
+ */
+static void
+dpi_flow_set_error(struct dpi_flow *dpi_flow)
+{
+	dpi_flow->app_name = DPI_APP_ERROR;
+	dpi_flow->app_proto = DPI_APP_ERROR;
+	dpi_flow->app_type = DPI_APP_TYPE_NONE;
+	dpi_flow->offloaded = true;
+	dpi_flow->error = true;
+	dpi_flow->update_stats = false;
+}
+
 /*
  * Clean up any per session flow information.
  */
 static void
-dpi_flow_key_destroy(struct qmdpi_flow *flow_key, uint8_t wrkr_id)
+dpi_flow_key_destroy(struct qmdpi_flow *flow_key, uint16_t wrkr_id)
 {
 	rte_spinlock_t *worker_lock = &dpi_worker_lock[wrkr_id];
 	struct qmdpi_worker *worker = dpi_worker[wrkr_id];
@@ -322,10 +553,11 @@ dpi_flow_key_destroy(struct qmdpi_flow *flow_key, uint8_t wrkr_id)
 			err);
 }
 
-void
-dpi_session_flow_destroy(struct dpi_flow *dpi_flow)
+/* Drop a reference, the last one frees the flow */
+static void
+dpi_flow_put(struct dpi_flow *dpi_flow)
 {
-	if (!dpi_flow)
+	if (!rte_atomic16_dec_and_test(&dpi_flow->refcnt))
 		return;
 
 	struct qmdpi_flow *flow_key = dpi_flow->key;
@@ -335,6 +567,146 @@ dpi_session_flow_destroy(struct dpi_flow *dpi_flow)
 	free(dpi_flow);
 }
 
+void
+dpi_session_flow_destroy(struct dpi_flow *dpi_flow)
+{
+	if (!dpi_flow)
+		return;
+
+	dpi_flow_put(dpi_flow);
+}
+
+/*
+ * Queue a copy of the payload to the flow's DPI thread.  The packet
+ * carries on with whatever result the flow has so far; if the thread
+ * is behind, the payload is not inspected at all.
+ */
+static void
+dpi_queue(struct dpi_flow *dpi_flow, npf_cache_t *npc,
+	  struct rte_mbuf *mbuf, bool forw, uint32_t ifindex)
+{
+	struct dpi_thread *dt = &dpi_threads[dpi_flow->wrkr_id -
+					     RTE_MAX_LCORE];
+	struct dpi_job *job;
+	char *data_ptr;
+	uint16_t data_len;
+
+	if (!dpi_payload(npc, mbuf, &data_ptr, &data_len))
+		return;
+
+	if (unlikely(rte_mempool_get(dpi_job_pool, (void **)&job) < 0))
+		goto drop;
+
+	job->flow = dpi_flow;
+	job->ifindex = ifindex;
+	job->forw = forw;
+	job->len = RTE_MIN(data_len, DPI_JOB_DATA);
+	memcpy(job->data, data_ptr, job->len);
+
+	/* The session holds a reference, so this is never the last */
+	rte_atomic16_inc(&dpi_flow->refcnt);
+	if (unlikely(rte_ring_mp_enqueue(dt->dt_ring, job) != 0)) {
+		rte_atomic16_dec(&dpi_flow->refcnt);
+		rte_mempool_put(dpi_job_pool, job);
+		goto drop;
+	}
+	return;
+
+drop:
+	rte_atomic64_inc(&dpi_jobs_dropped);
+	if (net_ratelimit())
+		RTE_LOG(NOTICE, DATAPLANE,
+			"DPI: threads behind, %"PRIu64" payloads not inspected\n",
+			rte_atomic64_read(&dpi_jobs_dropped));
+}
+
+static void *
+dpi_thread_run(void *arg)
+{
+	struct dpi_thread *dt = arg;
+	unsigned int wrkr_id = RTE_MAX_LCORE + (dt - dpi_threads);
+	struct qmdpi_worker *worker = dpi_worker[wrkr_id];
+	rte_spinlock_t *worker_lock = &dpi_worker_lock[wrkr_id];
+	struct dpi_job *jobs[DPI_JOB_BURST];
+	unsigned int i, n;
+
+	for (;;) {
+		n = rte_ring_sc_dequeue_burst(dt->dt_ring, (void **)jobs,
+					      DPI_JOB_BURST, NULL);
+		if (n == 0) {
+			usleep(DPI_THREAD_IDLE_US);
+			continue;
+		}
+
+		rte_spinlock_lock(worker_lock);
+		for (i = 0; i < n; i++) {
+			struct dpi_flow *dpi_flow = jobs[i]->flow;
+
+			if (dpi_flow->offloaded)
+				continue;
+			if (!dpi_process_data(worker, jobs[i]->data,
+					      jobs[i]->len, jobs[i]->forw,
+					      jobs[i]->ifindex, dpi_flow))
+				dpi_flow_set_error(dpi_flow);
+		}
+		rte_spinlock_unlock(worker_lock);
+
+		/* Outside the lock, as the last put destroys the key */
+		for (i = 0; i < n; i++)
+			dpi_flow_put(jobs[i]->flow);
+		rte_mempool_put_bulk(dpi_job_pool, (void **)jobs, n);
+	}
+
+	return NULL;
+}
+
+static int
+dpi_threads_start(void)
+{
+	char name[RTE_RING_NAMESIZE];
+	unsigned int cpu, i = 0;
+
+	dpi_job_pool = rte_mempool_create("dpi-jobs",
+					  dpi_nthreads * DPI_JOB_RING_SZ,
+					  sizeof(struct dpi_job), 0, 0,
+					  NULL, NULL, NULL, NULL,
+					  SOCKET_ID_ANY, 0);
+	if (!dpi_job_pool)
+		return -ENOMEM;
+
+	for (cpu = 0; cpu < BITMASK_BITS && i < dpi_nthreads; cpu++) {
+		struct dpi_thread *dt = &dpi_threads[i];
+		cpu_set_t cpuset;
+
+		if (!bitmask_isset(&config.dpi_cpus, cpu))
+			continue;
+
+		snprintf(name, sizeof(name), "dpi-jobs-%u", i);
+		dt->dt_ring = rte_ring_create(name, DPI_JOB_RING_SZ,
+					      SOCKET_ID_ANY, RING_F_SC_DEQ);
+		if (!dt->dt_ring)
+			return -ENOMEM;
+		dt->dt_cpu = cpu;
+
+		if (pthread_create(&dt->dt_thread, NULL, dpi_thread_run, dt))
+			return -errno;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu, &cpuset);
+		if (pthread_setaffinity_np(dt->dt_thread, sizeof(cpuset),
+					   &cpuset))
+			RTE_LOG(NOTICE, DATAPLANE,
+				"DPI thread %u: can not bind to cpu %u\n",
+				i, cpu);
+
+		snprintf(name, sizeof(name), "dataplane/dpi%u", i);
+		pthread_setname_np(dt->dt_thread, name);
+		i++;
+	}
+
+	return 0;
+}
+
 /*
  * This processes each packet within a session, updating the
  * information cached upon the session.
@@ -363,6 +735,12 @@ dpi_session_pkt(npf_session_t *se, npf_cache_t *npc,
 	bool forw = npf_session_forward_dir(se, dir);
 	uint32_t ifindex = npf_session_get_if_index(se);
 
+	if (dpi_nthreads) {
+		dpi_queue(dpi_flow, npc, mbuf, forw, ifindex);
+		pktmbuf_mdata_set(mbuf, PKT_MDATA_DPI_SEEN);
+		return true;
+	}
+
 	/* Access the correct worker, with exclusion */
 	unsigned int wrkr_id = dpi_flow->wrkr_id;
 	rte_spinlock_t *worker_lock = &dpi_worker_lock[wrkr_id];
@@ -373,14 +751,8 @@ dpi_session_pkt(npf_session_t *se, npf_cache_t *npc,
 	 * processing this flow, leaving it in an error state.
 	 */
 	rte_spinlock_lock(worker_lock);
-	if (!dpi_process(worker, npc, mbuf, forw, ifindex, dpi_flow)) {
-		dpi_flow->app_name = DPI_APP_ERROR;
-		dpi_flow->app_proto = DPI_APP_ERROR;
-		dpi_flow->app_type = DPI_APP_TYPE_NONE;
-		dpi_flow->offloaded = true;
-		dpi_flow->error = true;
-		dpi_flow->update_stats = false;
-	}
+	if (!dpi_process(worker, npc, mbuf, forw, ifindex, dpi_flow))
+		dpi_flow_set_error(dpi_flow);
 	rte_spinlock_unlock(worker_lock);
 
 	/* Unhook the handler when flow is offloaded */
@@ -421,6 +793,11 @@ dpi_session_first_packet(npf_session_t *se, npf_cache_t *npc,
 	dpi_flow->app_name = DPI_APP_UNDETERMINED;
 	dpi_flow->app_type = DPI_APP_TYPE_NONE;
 	dpi_flow->wrkr_id = dp_lcore_id();
+	if (dpi_nthreads)
+		dpi_flow->wrkr_id = RTE_MAX_LCORE +
+			((uintptr_t)dpi_flow / RTE_CACHE_LINE_SIZE) %
+			dpi_nthreads;
+	rte_atomic16_set(&dpi_flow->refcnt, 1);
 	dpi_flow->offloaded = false;
 	dpi_flow->error = false;
 	dpi_flow->update_stats = true;
@@ -465,16 +842,25 @@ dpi_session_first_packet(npf_session_t *se, npf_cache_t *npc,
 
 	dpi_flow_get_params(se, npc, &srcip, &sport, &dstip, &dport);
 
+	/* The first packet is towards the server */
+	memcpy(&dpi_flow->ckey.addr, &dstip, npc->npc_alen);
+	dpi_flow->ckey.port = dport;
+	dpi_flow->ckey.proto = ip_proto;
+	dpi_flow->ckey.alen = npc->npc_alen;
+
+	if (dpi_cache_lookup(dpi_flow)) {
+		dpi_flow->offloaded = true;
+		dpi_flow->update_stats = false;
+		return 0;
+	}
+
+	rte_spinlock_lock(&dpi_worker_lock[dpi_flow->wrkr_id]);
 	struct qmdpi_flow *flow_key =
 		qmdpi_flow_create(dpi_worker[dpi_flow->wrkr_id], l3proto,
 				l4proto, &srcip, &sport, &dstip, &dport);
+	rte_spinlock_unlock(&dpi_worker_lock[dpi_flow->wrkr_id]);
 	if (!flow_key) {
-		dpi_flow->app_proto = DPI_APP_ERROR;
-		dpi_flow->app_name = DPI_APP_ERROR;
-		dpi_flow->app_type = DPI_APP_TYPE_NONE;
-		dpi_flow->offloaded = true;
-		dpi_flow->error = true;
-		dpi_flow->update_stats = false;
+		dpi_flow_set_error(dpi_flow);
 
 		if (net_ratelimit())
 			RTE_LOG(ERR, DATAPLANE, "DPI: flow creation failed\n");
@@ -612,12 +998,12 @@ dpi_app_type_name_to_id(const char *type_name)
  * with different types in different rules.
  */
 static uint64_t
-dpi_app_id_to_type_bitfield(uint32_t app_id)
+dpi_app_id_to_type_bitfield(struct qmdpi_worker *worker, uint32_t app_id)
 {
 	assert(APP_ID_QOSMOS(app_id));
 
 	struct qmdpi_signature *signature =
-		qmdpi_worker_signature_get_byid(dpi_worker[dp_lcore_id()],
+		qmdpi_worker_signature_get_byid(worker,
 						dpi_bundle,
 						app_id & DPI_APP_MASK);
 
@@ -739,14 +1125,13 @@ dpi_info_json(struct dpi_flow *dpi_flow, json_writer_t *json)
 }
 
 /*
- * This logs into a string the DPI information associated with the flow.
+ * This logs into a string the DPI information given by app name and proto.
  */
 void
-dpi_info_log(struct dpi_flow *dpi_flow, char *buf, size_t buf_len)
+dpi_app_info_log(uint32_t app_name, uint32_t app_proto, char *buf,
+		 size_t buf_len)
 {
 	size_t used_buf_len = 0;
-	const uint32_t app_name = dpi_flow_get_app_name(dpi_flow);
-	const uint32_t app_proto = dpi_flow_get_app_proto(dpi_flow);
 
 	buf_app_printf(buf, &used_buf_len, buf_len, "app-name=");
 	dpi_app_name_to_str(buf, &used_buf_len, buf_len, app_name);
@@ -757,3 +1142,13 @@ dpi_info_log(struct dpi_flow *dpi_flow, char *buf, size_t buf_len)
 				 app_proto);
 	}
 }
+
+/*
+ * This logs into a string the DPI information associated with the flow.
+ */
+void
+dpi_info_log(struct dpi_flow *dpi_flow, char *buf, size_t buf_len)
+{
+	dpi_app_info_log(dpi_flow_get_app_name(dpi_flow),
+			 dpi_flow_get_app_proto(dpi_flow), buf, buf_len);
+}
@@ -145,6 +145,8 @@ int appdb_id_entry_to_json(json_writer_t *json, void *data);
 /* The recommended minimum size to pass as buf_len to dpi_info_log() */
 #define MAX_DPI_LOG_SIZE 256
 void dpi_info_log(struct dpi_flow *dpi_flow, char *buf, size_t buf_len);
+void dpi_app_info_log(uint32_t app_name, uint32_t app_proto, char *buf,
+		      size_t buf_len);
 
 uint32_t appdb_name_to_id(const char *name);
 char *appdb_id_to_name(uint32_t app_id);
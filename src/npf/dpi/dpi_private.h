@@ -7,6 +7,19 @@
 #ifndef DPI_PRIVATE_H
 #define DPI_PRIVATE_H
 
+#include <rte_atomic.h>
+#include <stdint.h>
+
+#include "npf/npf_addr.h"
+
+/* Server end of a flow, keying the result cache */
+struct dpi_cache_key {
+	npf_addr_t addr;
+	uint16_t port;
+	uint8_t proto;
+	uint8_t alen;
+};
+
 /* Per session DPI information */
 struct dpi_flow {
 	struct qmdpi_flow *key;
@@ -14,7 +27,9 @@ struct dpi_flow {
 	uint32_t app_name;	/* L7 */
 	uint64_t app_type;	/* Type bitfield */
 	struct dpi_flow_stats stats[2];
-	uint8_t wrkr_id;
+	struct dpi_cache_key ckey;
+	rte_atomic16_t refcnt;	/* session, and packets queued for DPI */
+	uint16_t wrkr_id;
 	uint8_t offloaded: 1;
 	uint8_t error: 1;
 	uint8_t update_stats: 1;
@@ -147,6 +147,12 @@ dpi_info_log(struct dpi_flow *dpi_flow __unused, char *buf __unused,
 {
 }
 
+void
+dpi_app_info_log(uint32_t app_name __unused, uint32_t app_proto __unused,
+		 char *buf __unused, size_t buf_len __unused)
+{
+}
+
 const npf_rproc_ops_t npf_appfw_ops = {
 	.ro_name   = "app-firewall",
 	.ro_type   = NPF_RPROC_TYPE_ACTION,
@@ -41,6 +41,7 @@
  */
 
 #include <linux/snmp.h>
+#include <rte_atomic.h>
 #include <rte_common.h>
 #include <rte_cycles.h>
 #include <rte_jhash.h>
@@ -53,6 +54,7 @@
 
 #include "ipv4_frag_tbl.h"
 #include "ipv4_rsmbl.h"
+#include "master.h"
 #include "snmp_mib.h"
 #include "util.h"
 #include "vplane_log.h"
@@ -92,10 +94,30 @@ static void ipv4_frag_timeout_stats(struct ipv4_frag_pkt *pkt)
 }
 
 /* Delete a frag packet struct from the hash table */
-void ipv4_frag_free(struct cds_lfht *frag_table, struct ipv4_frag_pkt *pkt)
+void ipv4_frag_free(struct ipv4_frag_tbl *frag_tbl, struct ipv4_frag_pkt *pkt)
 {
-	if (!cds_lfht_del(frag_table, &pkt->pkt_node))
+	struct ipv4_frag_lcore *fl = &frag_tbl->ft_lcore[pkt->pkt_lcore];
+
+	pkt->pkt_dead = true;
+	if (!cds_lfht_del(fl->fl_table, &pkt->pkt_node)) {
+		rte_atomic32_dec(&fl->fl_count);
 		call_rcu(&pkt->pkt_rcu_head, ipv4_frag_free_pkt);
+	}
+}
+
+/* Clean out expired frag pkts from one lcore's table */
+static void ipv4_frag_expire(struct ipv4_frag_tbl *frag_tbl,
+			     struct ipv4_frag_lcore *fl, uint64_t current)
+{
+	struct cds_lfht_iter iter;
+	struct ipv4_frag_pkt *pkt;
+
+	cds_lfht_for_each_entry(fl->fl_table, &iter, pkt, pkt_node) {
+		if (pkt->pkt_expire < current) {
+			ipv4_frag_timeout_stats(pkt);
+			ipv4_frag_free(frag_tbl, pkt);
+		}
+	}
 }
 
 /*
@@ -106,19 +128,20 @@ void ipv4_frag_free(struct cds_lfht *frag_table, struct ipv4_frag_pkt *pkt)
  */
 static void ipv4_gc(struct rte_timer *t __rte_unused, void *arg __rte_unused)
 {
-	struct cds_lfht_iter iter;
-	struct ipv4_frag_pkt *pkt;
 	uint64_t current = rte_get_timer_cycles();
+	struct ipv4_frag_tbl *frag_tbl;
+	struct ipv4_frag_lcore *fl;
 	vrfid_t vrfid;
 	struct vrf *vrf;
+	unsigned int i;
 
 	VRF_FOREACH(vrf, vrfid) {
-		cds_lfht_for_each_entry(vrf->v_ipv4_frag_table, &iter, pkt,
-					pkt_node) {
-			if (pkt->pkt_expire < current) {
-				ipv4_frag_timeout_stats(pkt);
-				ipv4_frag_free(vrf->v_ipv4_frag_table, pkt);
-			}
+		frag_tbl = vrf->v_ipv4_frag_tbl;
+
+		for (i = 0; i < frag_tbl->ft_nlcores; i++) {
+			fl = &frag_tbl->ft_lcore[frag_tbl->ft_lcores[i]];
+			if (rte_atomic32_read(&fl->fl_count) != 0)
+				ipv4_frag_expire(frag_tbl, fl, current);
 		}
 	}
 }
@@ -160,35 +183,77 @@ static int ipv4_match(struct cds_lfht_node *node, const void *data)
 	return rc;
 }
 
-/* Count nodes */
-static unsigned long ipv4_frag_count(struct cds_lfht *frag_table)
+/* Lookup a 'pkt' in the hash table */
+static struct ipv4_frag_pkt *
+ipv4_frag_lookup(struct cds_lfht *frag_table, unsigned long hash,
+		 const struct ipv4_frag_key *key)
 {
-	unsigned long count;
-	long dummy;
+	struct ipv4_frag_pkt *pkt;
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+
+	cds_lfht_lookup(frag_table, hash, ipv4_match, key, &iter);
+	node = cds_lfht_iter_get_node(&iter);
+	if (node)
+		pkt = caa_container_of(node, struct ipv4_frag_pkt, pkt_node);
+	else
+		pkt = NULL;
 
-	cds_lfht_count_nodes(frag_table, &dummy, &count, &dummy);
-	return count;
+	return pkt;
 }
 
-/* Add a new pkt if max not reached */
+/*
+ * Lookup a 'pkt' in the tables of lcores other than 'lcore'.  The
+ * tables are searched in lcore order.
+ */
 static struct ipv4_frag_pkt *
-ipv4_frag_create(struct cds_lfht *frag_table, unsigned long hash,
-		 const struct ipv4_frag_key *key)
+ipv4_frag_lookup_stray(struct ipv4_frag_tbl *frag_tbl, unsigned int lcore,
+		       unsigned long hash, const struct ipv4_frag_key *key)
 {
+	struct ipv4_frag_lcore *fl;
 	struct ipv4_frag_pkt *pkt;
+	unsigned int i;
+
+	for (i = 0; i < frag_tbl->ft_nlcores; i++) {
+		if (frag_tbl->ft_lcores[i] == lcore)
+			continue;
+
+		fl = &frag_tbl->ft_lcore[frag_tbl->ft_lcores[i]];
+		if (rte_atomic32_read(&fl->fl_count) == 0)
+			continue;
+
+		pkt = ipv4_frag_lookup(fl->fl_table, hash, key);
+		if (pkt)
+			return pkt;
+	}
+	return NULL;
+}
+
+/* Add a new pkt to the table for 'lcore', if max not reached */
+static struct ipv4_frag_pkt *
+ipv4_frag_create(struct ipv4_frag_tbl *frag_tbl, unsigned int lcore,
+		 unsigned long hash, const struct ipv4_frag_key *key)
+{
+	struct ipv4_frag_lcore *fl = &frag_tbl->ft_lcore[lcore];
+	struct ipv4_frag_pkt *pkt, *other;
 	struct cds_lfht_node *node;
-	unsigned long count;
 
-	/* Max packets reached? */
-	count = ipv4_frag_count(frag_table);
-	if (count >= IPV4_MAX_FRAG_SETS)
-		return NULL;
+	/*
+	 * Max packets reached?  Expire stale entries from our own table
+	 * rather than waiting for the gc timer.
+	 */
+	if (rte_atomic32_read(&fl->fl_count) >= IPV4_MAX_FRAG_SETS) {
+		ipv4_frag_expire(frag_tbl, fl, rte_get_timer_cycles());
+		if (rte_atomic32_read(&fl->fl_count) >= IPV4_MAX_FRAG_SETS)
+			return NULL;
+	}
 
 	pkt = calloc(1, sizeof(struct ipv4_frag_pkt));
 	if (!pkt)
 		return NULL;
 
 	rte_spinlock_init(&pkt->pkt_lock);
+	pkt->pkt_lcore = lcore;
 	pkt->pkt_key.src_dst = key->src_dst;
 	pkt->pkt_key.id = key->id;
 	pkt->last_idx = FIRST_INTERMEDIATE_FRAG_IDX;
@@ -200,96 +265,155 @@ ipv4_frag_create(struct cds_lfht *frag_table, unsigned long hash,
 	 * Now try to add the new pkt, if somebody beat us to it,
 	 * use that one.
 	 */
-	node = cds_lfht_add_unique(frag_table, hash, ipv4_match,
+	node = cds_lfht_add_unique(fl->fl_table, hash, ipv4_match,
 				key, &pkt->pkt_node);
 	if (node != &pkt->pkt_node) {
 		free(pkt);
-		pkt = caa_container_of(node, struct ipv4_frag_pkt, pkt_node);
+		return caa_container_of(node, struct ipv4_frag_pkt, pkt_node);
 	}
+	rte_atomic32_inc(&fl->fl_count);
 
-	return pkt;
-}
-
-/* Lookup a 'pkt' in the hash table */
-static struct ipv4_frag_pkt *
-ipv4_frag_lookup(struct cds_lfht *frag_table, unsigned long hash,
-		 const struct ipv4_frag_key *key)
-{
-	struct ipv4_frag_pkt *pkt;
-	struct cds_lfht_iter iter;
-	struct cds_lfht_node *node;
-
-	cds_lfht_lookup(frag_table, hash, ipv4_match, key, &iter);
-	node = cds_lfht_iter_get_node(&iter);
-	if (node)
-		pkt = caa_container_of(node, struct ipv4_frag_pkt, pkt_node);
-	else
-		pkt = NULL;
+	/*
+	 * Fragments of the same datagram arriving at the same time on two
+	 * lcores may each have created a set.  The set on the lowest lcore
+	 * wins, so give ours up if nothing has been added to it yet.
+	 */
+	other = ipv4_frag_lookup_stray(frag_tbl, lcore, hash, key);
+	if (other && other->pkt_lcore < lcore) {
+		rte_spinlock_lock(&pkt->pkt_lock);
+		if (pkt->frag_size == 0) {
+			ipv4_frag_free(frag_tbl, pkt);
+			rte_spinlock_unlock(&pkt->pkt_lock);
+			return other;
+		}
+		rte_spinlock_unlock(&pkt->pkt_lock);
+	}
 
 	return pkt;
 }
 
 /*
- * Find an entry in the table for the corresponding fragment.
- * If such entry is not present, then allocate a new one.
+ * Find an entry in the tables for the corresponding fragment.
+ * If such entry is not present, then allocate a new one in the table
+ * for this lcore.
+ *
+ * The entry is returned locked.
  */
 struct ipv4_frag_pkt *ipv4_frag_find(struct vrf *vrf,
 				     const struct ipv4_frag_key *key)
 {
-	struct ipv4_frag_pkt *pkt;
+	struct ipv4_frag_tbl *frag_tbl = vrf->v_ipv4_frag_tbl;
 	unsigned long hash = ipv4_hash(key);
-	struct cds_lfht *frag_table = vrf->v_ipv4_frag_table;
+	unsigned int lcore = rte_lcore_id();
+	struct ipv4_frag_pkt *pkt;
+	int retries = 2;
 
-	pkt = ipv4_frag_lookup(frag_table, hash, key);
-	if (!pkt)
-		pkt = ipv4_frag_create(frag_table, hash, key);
-	return pkt;
+	/* Threads without a table of their own share the master's */
+	if (lcore >= RTE_MAX_LCORE || !frag_tbl->ft_lcore[lcore].fl_table)
+		lcore = rte_get_master_lcore();
+
+	/*
+	 * An entry may be removed between the lookup and taking its lock,
+	 * e.g. when it completes on another lcore, so try again.
+	 */
+	while (retries--) {
+		pkt = ipv4_frag_lookup(frag_tbl->ft_lcore[lcore].fl_table,
+				       hash, key);
+		if (!pkt)
+			pkt = ipv4_frag_lookup_stray(frag_tbl, lcore,
+						     hash, key);
+		if (!pkt)
+			pkt = ipv4_frag_create(frag_tbl, lcore, hash, key);
+		if (!pkt)
+			return NULL;
+
+		rte_spinlock_lock(&pkt->pkt_lock);
+		if (!pkt->pkt_dead)
+			return pkt;
+		rte_spinlock_unlock(&pkt->pkt_lock);
+	}
+
+	return NULL;
+}
+
+static void ipv4_fragment_table_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct ipv4_frag_tbl, ft_rcu));
 }
 
 static void
 ipv4_fragment_table_uninit(struct vrf *vrf)
 {
+	struct ipv4_frag_tbl *frag_tbl = vrf->v_ipv4_frag_tbl;
+	struct ipv4_frag_lcore *fl;
 	struct cds_lfht_iter iter;
 	struct ipv4_frag_pkt *pkt;
+	unsigned int lcore;
 
-	if (!vrf->v_ipv4_frag_table)
+	if (!frag_tbl)
 		return;
 
-	cds_lfht_for_each_entry(vrf->v_ipv4_frag_table, &iter, pkt,
-				pkt_node) {
-		ipv4_frag_free(vrf->v_ipv4_frag_table, pkt);
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++) {
+		fl = &frag_tbl->ft_lcore[lcore];
+		if (!fl->fl_table)
+			continue;
+
+		cds_lfht_for_each_entry(fl->fl_table, &iter, pkt, pkt_node)
+			ipv4_frag_free(frag_tbl, pkt);
+
+		dp_ht_destroy_deferred(fl->fl_table);
 	}
 
-	dp_ht_destroy_deferred(vrf->v_ipv4_frag_table);
-	vrf->v_ipv4_frag_table = NULL;
+	vrf->v_ipv4_frag_tbl = NULL;
+	call_rcu(&frag_tbl->ft_rcu, ipv4_fragment_table_free);
 }
 
 /*
- * Create a new IPV4 Frag table.
+ * Create a new IPV4 Frag table, with a hash table per lcore.
  */
 static int
 ipv4_fragment_table_init(struct vrf *vrf)
 {
-	/*
-	 * Create a RCU hash table.  Since we only support a
-	 * (relatively) small number of frag pkt's at any given time,
-	 * allow to grow but not shrink.  We can save cycles by not doing
-	 * accounting for splits.
-	 */
-	vrf->v_ipv4_frag_table = cds_lfht_new(IPV4_FRAG_HT_INIT,
-					      IPV4_FRAG_HT_MIN,
-					      IPV4_FRAG_HT_MAX,
-					      CDS_LFHT_AUTO_RESIZE, NULL);
-	if (!vrf->v_ipv4_frag_table) {
+	struct ipv4_frag_tbl *frag_tbl;
+	struct cds_lfht *table;
+	unsigned int lcore;
+
+	frag_tbl = zmalloc_aligned(sizeof(*frag_tbl));
+	if (!frag_tbl) {
 		DP_LOG_W_VRF(ERR, DATAPLANE, vrf->v_id,
-			     "Unable to create ipv4 frag hash table\n");
+			     "Unable to allocate ipv4 frag table\n");
 		return -1;
 	}
+	vrf->v_ipv4_frag_tbl = frag_tbl;
+
+	RTE_LCORE_FOREACH(lcore) {
+		/*
+		 * Create a RCU hash table.  Since we only support a
+		 * (relatively) small number of frag pkt's at any given
+		 * time, allow to grow but not shrink.  We can save cycles
+		 * by not doing accounting for splits.
+		 */
+		table = cds_lfht_new(IPV4_FRAG_HT_INIT, IPV4_FRAG_HT_MIN,
+				     IPV4_FRAG_HT_MAX, CDS_LFHT_AUTO_RESIZE,
+				     NULL);
+		if (!table) {
+			DP_LOG_W_VRF(ERR, DATAPLANE, vrf->v_id,
+				     "Unable to create ipv4 frag hash table\n");
+			ipv4_fragment_table_uninit(vrf);
+			return -1;
+		}
+
+		frag_tbl->ft_lcore[lcore].fl_table = table;
+		rte_atomic32_init(&frag_tbl->ft_lcore[lcore].fl_count);
+		frag_tbl->ft_lcores[frag_tbl->ft_nlcores++] = lcore;
+	}
 
 	/*
-	 * Create a seed for hashing
+	 * Create a seed for hashing.  This is shared by all tables, so
+	 * only set it once.
 	 */
-	hash_seed = random();
+	if (!hash_seed)
+		hash_seed = random();
 	return 0;
 }
 
@@ -320,8 +444,9 @@ ipv4_fragment_tables_timer_init(void)
 	 * Creat a timer for cleanup of stale entries.
 	 */
 	rte_timer_init(&ipv4_timer);
-	rte_timer_reset(&ipv4_timer, IPV4_FRAG_INTERVAL * rte_get_timer_hz(),
-			PERIODICAL, rte_get_master_lcore(), ipv4_gc, NULL);
+	master_aging_timer_reset(&ipv4_timer,
+				 IPV4_FRAG_INTERVAL * rte_get_timer_hz(),
+				 ipv4_gc, NULL);
 }
 
 void fragment_tables_timer_init(void)
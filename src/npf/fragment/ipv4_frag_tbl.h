@@ -44,8 +44,11 @@
 #ifndef IPV4_FRAG_TBL_H
 #define IPV4_FRAG_TBL_H
 
+#include <rte_atomic.h>
+#include <rte_config.h>
 #include <rte_memory.h>
 #include <rte_spinlock.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <urcu.h>
 
@@ -67,7 +70,7 @@ struct vrf;
 #define IPV4_FRAG_HT_MIN	64
 #define IPV4_FRAG_HT_MAX	512
 
-/* Max number of fragment sets we support */
+/* Max number of fragment sets we support per lcore */
 #define IPV4_MAX_FRAG_SETS	1024
 
 /* Max number of fragments per fragment set */
@@ -101,6 +104,8 @@ struct ipv4_frag_pkt {
 	struct rcu_head		pkt_rcu_head;	/* for call_rcu */
 	struct cds_lfht_node	pkt_node;	/* For hash table */
 	rte_spinlock_t		pkt_lock;	/* lock for this pkt */
+	bool			pkt_dead;	/* removed from table */
+	uint16_t		pkt_lcore;	/* table holding this pkt */
 	struct ipv4_frag_key	pkt_key;	/* src_dst/id key */
 	uint64_t		pkt_expire;	/* expiration timestamp */
 	uint32_t		total_size;	/* expected reassembled size */
@@ -110,8 +115,27 @@ struct ipv4_frag_pkt {
 } __rte_cache_aligned;
 
 
+/*
+ * Fragment sets are held in the table of the lcore that received the
+ * first fragment of the datagram to arrive.  Fragments of the same
+ * datagram normally arrive on the same queue, so each table is mostly
+ * written by one lcore only.  Strays from other lcores find the set by
+ * looking in the other tables, and then add to it under pkt_lock.
+ */
+struct ipv4_frag_lcore {
+	struct cds_lfht		*fl_table;
+	rte_atomic32_t		fl_count;	/* fragment sets in table */
+} __rte_cache_aligned;
+
+struct ipv4_frag_tbl {
+	struct rcu_head		ft_rcu;
+	unsigned int		ft_nlcores;
+	uint16_t		ft_lcores[RTE_MAX_LCORE];  /* lcores with tables */
+	struct ipv4_frag_lcore	ft_lcore[RTE_MAX_LCORE];
+};
+
 void ipv4_frag_tbl_create(void);
-void ipv4_frag_free(struct cds_lfht *frag_table, struct ipv4_frag_pkt *);
+void ipv4_frag_free(struct ipv4_frag_tbl *frag_tbl, struct ipv4_frag_pkt *);
 void ipv4_frag_clear(struct ipv4_frag_pkt *);
 struct ipv4_frag_pkt *ipv4_frag_find(struct vrf *vrf,
 				     const struct ipv4_frag_key *);
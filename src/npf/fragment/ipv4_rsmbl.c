@@ -59,8 +59,6 @@
 #include "util.h"
 #include "vrf.h"
 
-struct cds_lfht;
-
 /*
  * Helper function.
  * Takes 2 mbufs that represents two fragments of the same packet and
@@ -161,6 +159,8 @@ static struct rte_mbuf *ipv4_frag_reassemble(struct ipv4_frag_pkt *fp)
 }
 
 /*
+ * Called with the frag pkt locked; the lock is released on return.
+ *
  * Return Values:
  *    If fragment reassembled returns the new mbuf
  *    Otherwise NULL
@@ -169,16 +169,13 @@ static struct rte_mbuf *ipv4_frag_reassemble(struct ipv4_frag_pkt *fp)
  *	 - mbuf was added to the table, and held for later
  */
 static struct rte_mbuf *
-ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
+ipv4_frag_process(struct ipv4_frag_tbl *frag_tbl, struct ipv4_frag_pkt *fp,
 		  struct rte_mbuf *mb, uint16_t ofs, uint16_t len,
 		  uint16_t more_frags)
 {
 	uint32_t idx = 0;
 	vrfid_t vrf_id = pktmbuf_get_vrf(mb);
 
-	/* Lock the frag pkt */
-	rte_spinlock_lock(&fp->pkt_lock);
-
 	fp->frag_size += len;
 
 	if (ofs == 0) {
@@ -203,7 +200,7 @@ ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
 	 * TODO: Could issue ICMP Packet Too Big. Probably not necessary
 	 */
 	if (idx >= ARRAY_SIZE(fp->frags)) {
-		ipv4_frag_free(frag_tables, fp);
+		ipv4_frag_free(frag_tbl, fp);
 		IPSTAT_INC(vrf_id, IPSTATS_MIB_REASMFAILS);
 		rte_pktmbuf_free(mb);	/* drop bad packet as well */
 		mb = NULL;
@@ -233,7 +230,7 @@ ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
 		mb = ipv4_frag_reassemble(fp);
 		if (!mb) {
 			IPSTAT_INC(vrf_id, IPSTATS_MIB_REASMFAILS);
-			ipv4_frag_free(frag_tables, fp);
+			ipv4_frag_free(frag_tbl, fp);
 		} else {
 			/*
 			 * On successful reassembly, NULL out the
@@ -242,7 +239,7 @@ ipv4_frag_process(struct cds_lfht *frag_tables, struct ipv4_frag_pkt *fp,
 			ipv4_frag_clear(fp);
 
 			/* Delete this pkt from the table */
-			ipv4_frag_free(frag_tables, fp);
+			ipv4_frag_free(frag_tbl, fp);
 			IPSTAT_INC(vrf_id, IPSTATS_MIB_REASMOKS);
 		}
 	}
@@ -286,7 +283,7 @@ static struct rte_mbuf *ipv4_frag_mbuf(struct rte_mbuf *mb)
 	ip_len = (uint16_t)(ntohs(ipv4_hdr->tot_len) -
 	mb->l3_len);
 
-	/* try to find/add entry into the fragment's table. */
+	/* try to find/add entry into the fragment's tables. */
 	fp = ipv4_frag_find(vrf, &key);
 	if (fp == NULL) {
 		IPSTAT_INC(pktmbuf_get_vrf(mb), IPSTATS_MIB_REASMFAILS);
@@ -295,7 +292,7 @@ static struct rte_mbuf *ipv4_frag_mbuf(struct rte_mbuf *mb)
 	}
 
 	/* process the fragmented packet. */
-	mb = ipv4_frag_process(vrf->v_ipv4_frag_table,
+	mb = ipv4_frag_process(vrf->v_ipv4_frag_tbl,
 			       fp, mb, ip_ofs, ip_len, ip_flag);
 
 	return mb;
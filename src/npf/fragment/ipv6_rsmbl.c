@@ -479,11 +479,13 @@ ipv6_handle_fragment(struct rte_mbuf *m, uint16_t *npf_flag)
 		 *
 		 * Mark the packet as being a reassembled packet so
 		 * that we can re-fragment it on output using the
-		 * gleaned mtu.
+		 * gleaned mtu.  The L4 header found by ipv6-validate was
+		 * past the fragmentation header, which is now gone.
 		 */
 		uint32_t from_us = *npf_flag & NPF_FLAG_FROM_US;
 		*npf_flag = NPF_FLAG_CACHE_EMPTY | from_us;
 		pktmbuf_mdata_set(m, PKT_MDATA_DEFRAG);
+		pktmbuf_mdata_clear(m, PKT_MDATA_L4);
 	}
 	return m;
 }
@@ -16,6 +16,7 @@
 #include <stdlib.h>
 
 #include "compiler.h"
+#include "master.h"
 #include "npf/fragment/ipv4_rsmbl.h"
 #include "npf/npf.h"
 #include "npf/fragment/ipv6_rsmbl_tbl.h"
@@ -310,7 +311,7 @@ void ipv6_fragment_tables_timer_init(void)
 	 * Create a timer for cleanup of stale entries.
 	 */
 	rte_timer_init(&ipv6_timer);
-	rte_timer_reset(&ipv6_timer,
-			IPV6_FRAG_INTERVAL * rte_get_timer_hz(),
-			PERIODICAL, rte_get_master_lcore(), ipv6_gc, NULL);
+	master_aging_timer_reset(&ipv6_timer,
+				 IPV6_FRAG_INTERVAL * rte_get_timer_hz(),
+				 ipv6_gc, NULL);
 }
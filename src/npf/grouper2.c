@@ -7,6 +7,8 @@
  */
 
 #include <rte_branch_prediction.h>
+#include <rte_common.h>
+#include <rte_cpuflags.h>
 #include <rte_log.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -15,6 +17,13 @@
 #include <string.h>
 #include <util.h>
 
+#if defined(RTE_ARCH_X86_64)
+#include <immintrin.h>
+#define G2_HAVE_SIMD 1
+static void g2_simd_init(void);
+#endif
+
+#include "compiler.h"
 #include "npf/grouper2.h"
 #include "npf/npf_ruleset.h"
 #include "vplane_log.h"
@@ -46,9 +55,6 @@
  *
  * 1.  possible 2 byte comparison on smaller rulesets
  * 2.  extend matching to support additional types?
- * 3.  support dynamic updates
- * 4.  single global table per table name (reduce footprint)
- * 5.  support arbritrary rule number insertion
  *
  * The following conditions are not supported by the grouper, and result in a
  * "match all" for the relevant tables:
@@ -160,7 +166,7 @@ struct g2_config {
  * is added, this is increased to four 64-bit words per bit pattern etc.
  */
 static bool
-g2_alloc_match_table(g2_config_t *conf, uint table)
+g2_alloc_table(const g2_config_t *conf, uint64_t ***tablep)
 {
 	size_t array_bytes, bitp_bytes_tot;
 	uint bitp_bytes;
@@ -177,7 +183,7 @@ g2_alloc_match_table(g2_config_t *conf, uint table)
 	/* bytes for all bit patterns */
 	bitp_bytes_tot = bitp_bytes * PATTERN_PER_TABLE;
 
-	old_table = (uint8_t *)conf->_match_table[table];
+	old_table = (uint8_t *)*tablep;
 	new_table = malloc_aligned(array_bytes + bitp_bytes_tot);
 
 	if (!new_table)
@@ -186,7 +192,7 @@ g2_alloc_match_table(g2_config_t *conf, uint table)
 	/* Zero bit patterns */
 	memset(new_table + array_bytes, 0, bitp_bytes_tot);
 
-	conf->_match_table[table] = (uint64_t **)new_table;
+	*tablep = (uint64_t **)new_table;
 
 	/*
 	 * Set array elements to point into bit patterns.
@@ -195,9 +201,8 @@ g2_alloc_match_table(g2_config_t *conf, uint table)
 	 * jth bit pattern offset is "j * bitp_bytes".
 	 */
 	for (j = 0; j < PATTERN_PER_TABLE; j++)
-		conf->_match_table[table][j] =
-			(uint64_t *)(new_table + array_bytes +
-				     (j * bitp_bytes));
+		(*tablep)[j] = (uint64_t *)(new_table + array_bytes +
+					    (j * bitp_bytes));
 
 	/*
 	 * If there is an old table, then copy bitmaps from it to the new table.
@@ -217,6 +222,12 @@ g2_alloc_match_table(g2_config_t *conf, uint table)
 	return true;
 }
 
+static bool
+g2_alloc_match_table(g2_config_t *conf, uint table)
+{
+	return g2_alloc_table(conf, &conf->_match_table[table]);
+}
+
 
 /*
  * Grouper initialization.
@@ -240,6 +251,10 @@ g2_config_t *g2_init(uint num_tables)
 	if (num_tables < 1)
 		return NULL;
 
+#ifdef G2_HAVE_SIMD
+	g2_simd_init();
+#endif
+
 	/*
 	 * Alloc conf structure and table pointer array
 	 */
@@ -280,9 +295,27 @@ g2_realloc_bit_pattern(g2_config_t *conf)
 {
 	uint i;
 
-	for (i = 0; i < conf->_num_tables; ++i)
+	/*
+	 * Tables sharing the "match all" table are pointed at its
+	 * replacement rather than reallocated individually.
+	 */
+	for (i = 0; i < conf->_num_tables; ++i) {
+		if (conf->_match_all &&
+		    conf->_match_table[i] == conf->_match_all)
+			continue;
 		if (!g2_alloc_match_table(conf, i))
 			return false;
+	}
+
+	if (conf->_match_all) {
+		uint64_t **old_all = conf->_match_all;
+
+		if (!g2_alloc_table(conf, &conf->_match_all))
+			return false;
+		for (i = 0; i < conf->_num_tables; ++i)
+			if (conf->_match_table[i] == old_all)
+				conf->_match_table[i] = conf->_match_all;
+	}
 	return true;
 }
 
@@ -536,6 +569,297 @@ g2_add(g2_config_t *conf, uint table, uint ntables,
 	return g2_add_eval(conf, table, ntables, match_mask_eval, &mm);
 }
 
+/*
+ * Dynamic updates.
+ *
+ * A published grouper is read-only, so updates are made to a copy which is
+ * then swapped in by the caller with rcu_xchg_pointer(), the old copy being
+ * destroyed after a grace period.  Inserting or deleting a rule moves the
+ * bit columns of all later rules by one position in every bit pattern,
+ * which is far cheaper than re-evaluating every rule against every pattern.
+ */
+
+/* Copy a match table, or the "match all" table */
+static uint64_t **
+g2_clone_table(const g2_config_t *conf, uint64_t * const *src)
+{
+	uint64_t **table = NULL;
+	uint bitp_bytes = g_size_alloc[conf->_rs_size_idx] / NBITS(uint8_t);
+	uint j;
+
+	if (!g2_alloc_table(conf, &table))
+		return NULL;
+
+	for (j = 0; j < PATTERN_PER_TABLE; j++)
+		memcpy(table[j], src[j], bitp_bytes);
+
+	return table;
+}
+
+g2_config_t *
+g2_clone(const g2_config_t *conf)
+{
+	g2_config_t *new;
+	uint i;
+
+	if (!conf)
+		return NULL;
+
+	new = zmalloc_aligned(sizeof(g2_config_t) +
+			      conf->_num_tables * sizeof(uint64_t *));
+	if (!new)
+		goto error;
+
+	new->_num_tables = conf->_num_tables;
+	new->_num_rules = conf->_num_rules;
+	new->_num_chunks = conf->_num_chunks;
+	new->_rs_size_idx = conf->_rs_size_idx;
+
+	if (conf->_num_rules) {
+		new->_rule_no = malloc(conf->_num_rules * sizeof(rule_no_t));
+		new->_md = malloc(conf->_num_rules * sizeof(void *));
+		if (!new->_rule_no || !new->_md)
+			goto error;
+		memcpy(new->_rule_no, conf->_rule_no,
+		       conf->_num_rules * sizeof(rule_no_t));
+		memcpy(new->_md, conf->_md, conf->_num_rules * sizeof(void *));
+	}
+
+	new->_mask = malloc(conf->_num_tables);
+	if (!new->_mask)
+		goto error;
+	memcpy(new->_mask, conf->_mask, conf->_num_tables);
+
+	if (conf->_match_all) {
+		new->_match_all = g2_clone_table(conf, conf->_match_all);
+		if (!new->_match_all)
+			goto error;
+	}
+
+	for (i = 0; i < conf->_num_tables; i++) {
+		if (conf->_match_table[i] == conf->_match_all) {
+			new->_match_table[i] = new->_match_all;
+			continue;
+		}
+		new->_match_table[i] = g2_clone_table(conf,
+						      conf->_match_table[i]);
+		if (!new->_match_table[i])
+			goto error;
+	}
+	return new;
+
+error:
+	RTE_LOG(ERR, FIREWALL, "Error in grouper clone\n");
+	g2_destroy(&new);
+	return NULL;
+}
+
+/*
+ * Open a gap at bit 'idx' of a bit pattern, moving all higher bits up one.
+ */
+static void
+g2_bits_insert(uint64_t *bitp, uint nwords, uint idx, bool set)
+{
+	uint word = idx / NBITS(uint64_t);
+	uint shift = idx % NBITS(uint64_t);
+	uint64_t low = (1ul << shift) - 1;
+	uint64_t carry = bitp[word] >> 63;
+	uint w;
+
+	bitp[word] = (bitp[word] & low) | ((bitp[word] & ~low) << 1) |
+		((uint64_t)set << shift);
+
+	for (w = word + 1; w < nwords; w++) {
+		uint64_t next = bitp[w] >> 63;
+
+		bitp[w] = (bitp[w] << 1) | carry;
+		carry = next;
+	}
+}
+
+/*
+ * Close the gap at bit 'idx' of a bit pattern, moving all higher bits down.
+ */
+static void
+g2_bits_remove(uint64_t *bitp, uint nwords, uint idx)
+{
+	uint word = idx / NBITS(uint64_t);
+	uint shift = idx % NBITS(uint64_t);
+	uint64_t low = (1ul << shift) - 1;
+	uint64_t high = shift == 63 ? 0 : (bitp[word] >> (shift + 1)) << shift;
+	uint w;
+
+	bitp[word] = (bitp[word] & low) | high;
+
+	for (w = word + 1; w < nwords; w++) {
+		bitp[w - 1] |= (bitp[w] & 1) << 63;
+		bitp[w] >>= 1;
+	}
+}
+
+static uint
+g2_rule_index(const g2_config_t *conf, rule_no_t rule_no, bool *found)
+{
+	uint i;
+
+	*found = false;
+	for (i = 0; i < conf->_num_rules; i++) {
+		if (conf->_rule_no[i] == rule_no) {
+			*found = true;
+			break;
+		}
+		if (conf->_rule_no[i] > rule_no)
+			break;
+	}
+	return i;
+}
+
+/*
+ * Insert a rule into an unpublished grouper at the position given by its
+ * rule number, in place of g2_create_rule() followed by g2_add().
+ */
+bool
+g2_insert_rule(g2_config_t *conf, rule_no_t rule_no, void *match_data,
+	       uint table, uint ntables,
+	       const uint8_t *match, const uint8_t *mask)
+{
+	uint nwords, idx, i, j;
+	bool found;
+
+	if (!conf || !match || !mask || table + ntables > conf->_num_tables)
+		return false;
+
+	idx = g2_rule_index(conf, rule_no, &found);
+	if (found)
+		return false;
+
+	if (conf->_num_rules >= g_size_alloc[conf->_rs_size_idx]) {
+		if (conf->_rs_size_idx >= MAX_RULESET_IDX)
+			return false;
+
+		conf->_rs_size_idx++;
+		if (!g2_realloc_bit_pattern(conf)) {
+			RTE_LOG(ERR, FIREWALL,
+				"grouper rule bit pattern "
+				"reallocation failed\n");
+			return false;
+		}
+	}
+
+	rule_no_t *rule_nos = realloc(conf->_rule_no,
+				      (conf->_num_rules + 1) *
+				      sizeof(rule_no_t));
+	if (!rule_nos)
+		return false;
+	conf->_rule_no = rule_nos;
+
+	void **md = realloc(conf->_md, (conf->_num_rules + 1) * sizeof(void *));
+	if (!md)
+		return false;
+	conf->_md = md;
+
+	/*
+	 * A table that was "match all" can only remain so if the new rule
+	 * does not care about it either.  Otherwise give it a private copy.
+	 */
+	for (i = table; i < table + ntables; i++) {
+		if (conf->_match_table[i] != conf->_match_all ||
+		    mask[i - table] == 0xFF)
+			continue;
+
+		conf->_match_table[i] = g2_clone_table(conf, conf->_match_all);
+		if (!conf->_match_table[i]) {
+			conf->_match_table[i] = conf->_match_all;
+			return false;
+		}
+	}
+
+	nwords = g_size_alloc[conf->_rs_size_idx] / STRIDE_BITS;
+
+	const struct match_mask mm = {
+		._match = match,
+		._mask = mask,
+	};
+
+	for (i = 0; i < conf->_num_tables; i++) {
+		if (conf->_match_table[i] == conf->_match_all)
+			continue;
+
+		bool in_range = i >= table && i < table + ntables;
+
+		for (j = 0; j < PATTERN_PER_TABLE; j++) {
+			const uint8_t j2 = j;
+			bool set = in_range &&
+				!match_mask_eval(&j2, i - table, &mm);
+
+			g2_bits_insert(conf->_match_table[i][j], nwords,
+				       idx, set);
+		}
+		if (in_range)
+			conf->_mask[i] &= mask[i - table];
+	}
+
+	if (conf->_match_all) {
+		for (j = 0; j < PATTERN_PER_TABLE; j++)
+			g2_bits_insert(conf->_match_all[j], nwords, idx, true);
+	}
+
+	memmove(&conf->_rule_no[idx + 1], &conf->_rule_no[idx],
+		(conf->_num_rules - idx) * sizeof(rule_no_t));
+	memmove(&conf->_md[idx + 1], &conf->_md[idx],
+		(conf->_num_rules - idx) * sizeof(void *));
+	conf->_rule_no[idx] = rule_no;
+	conf->_md[idx] = match_data;
+
+	conf->_num_rules++;
+	conf->_num_chunks = 1 + (conf->_num_rules - 1) / STRIDE_BITS;
+
+	return true;
+}
+
+/*
+ * Delete a rule from an unpublished grouper.  The cumulative mask is left
+ * as is, so a table only becomes "match all" again on a full rebuild.
+ */
+bool
+g2_delete_rule(g2_config_t *conf, rule_no_t rule_no)
+{
+	uint nwords, idx, i, j;
+	bool found;
+
+	if (!conf)
+		return false;
+
+	idx = g2_rule_index(conf, rule_no, &found);
+	if (!found)
+		return false;
+
+	nwords = g_size_alloc[conf->_rs_size_idx] / STRIDE_BITS;
+
+	for (i = 0; i < conf->_num_tables; i++) {
+		if (conf->_match_table[i] == conf->_match_all)
+			continue;
+		for (j = 0; j < PATTERN_PER_TABLE; j++)
+			g2_bits_remove(conf->_match_table[i][j], nwords, idx);
+	}
+
+	if (conf->_match_all) {
+		for (j = 0; j < PATTERN_PER_TABLE; j++)
+			g2_bits_remove(conf->_match_all[j], nwords, idx);
+	}
+
+	conf->_num_rules--;
+	memmove(&conf->_rule_no[idx], &conf->_rule_no[idx + 1],
+		(conf->_num_rules - idx) * sizeof(rule_no_t));
+	memmove(&conf->_md[idx], &conf->_md[idx + 1],
+		(conf->_num_rules - idx) * sizeof(void *));
+
+	conf->_num_chunks = conf->_num_rules ?
+		1 + (conf->_num_rules - 1) / STRIDE_BITS : 0;
+
+	return true;
+}
+
 /*
  * Optimize the grouper after all rules have been evaluated.
  */
@@ -585,6 +909,159 @@ g2_optimize(g2_config_t **confp)
 	}
 }
 
+/*
+ * Check the rules whose bits are set in one 64-bit chunk of the
+ * intersected bit patterns, in rule order.  *stop is set when the chunk
+ * runs past the last rule.
+ */
+static ALWAYS_INLINE void *
+g2_match_chunk(const g2_config_t *conf, uint64_t rule_match, uint32_t j,
+	       const void *data, bool *stop)
+{
+	while (rule_match) {
+		uint32_t loc;
+		uint32_t idx_match;
+
+		loc = ffsl(rule_match);
+		idx_match = loc + (j * STRIDE_BITS);
+
+		if (unlikely(idx_match > conf->_num_rules)) {
+			*stop = true;
+			return NULL;
+		}
+
+		void *r = conf->_md[idx_match - 1];
+
+		if (npf_rule_proc(data, r))
+			return r;
+
+		rule_match ^= (1ull << (loc - 1ull));
+	}
+	return NULL;
+}
+
+#ifdef G2_HAVE_SIMD
+/*
+ * Vector intersection of the bit patterns.
+ *
+ * Once a ruleset has grown past the first size step, each bit pattern is a
+ * multiple of 4 (256 rules) or 8 (1024 rules and up) 64-bit words, so the
+ * per-table AND can be done 256 or 512 bits at a time.  Bits beyond the
+ * last rule are always zero, so whole vectors may be read up to the
+ * allocated size.  The instruction set is chosen once at runtime.
+ */
+enum g2_simd_level {
+	G2_SIMD_NONE,
+	G2_SIMD_AVX2,
+	G2_SIMD_AVX512,
+};
+
+static enum g2_simd_level g2_simd_level = G2_SIMD_NONE;
+
+static void
+g2_simd_init(void)
+{
+	static bool done;
+
+	if (done)
+		return;
+	done = true;
+
+	if (rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512F))
+		g2_simd_level = G2_SIMD_AVX512;
+	else if (rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2))
+		g2_simd_level = G2_SIMD_AVX2;
+}
+
+__attribute__((target("avx2")))
+static void *
+g2_eval_avx2(const g2_config_t *conf, const uint8_t *packet,
+	     const void *data, uint ntables)
+{
+	uint32_t nchunks = RTE_ALIGN_CEIL(conf->_num_chunks, 4);
+	uint64_t words[4] __rte_aligned(32);
+	uint32_t j, w;
+	uint i;
+
+	for (j = 0; j < nchunks; j += 4) {
+		__m256i v = _mm256_loadu_si256(
+			(const __m256i *)&conf->_match_table[0][packet[0]][j]);
+
+		for (i = 1; i < ntables && !_mm256_testz_si256(v, v); i++)
+			v = _mm256_and_si256(v, _mm256_loadu_si256(
+				(const __m256i *)
+				&conf->_match_table[i][packet[i]][j]));
+
+		if (_mm256_testz_si256(v, v))
+			continue;
+
+		_mm256_store_si256((__m256i *)words, v);
+		for (w = 0; w < 4; w++) {
+			bool stop = false;
+			void *r = g2_match_chunk(conf, words[w], j + w,
+						 data, &stop);
+			if (r || stop)
+				return r;
+		}
+	}
+	return NULL;
+}
+
+__attribute__((target("avx512f")))
+static void *
+g2_eval_avx512(const g2_config_t *conf, const uint8_t *packet,
+	       const void *data, uint ntables)
+{
+	uint32_t nchunks = RTE_ALIGN_CEIL(conf->_num_chunks, 8);
+	uint64_t words[8] __rte_aligned(64);
+	uint32_t j, w;
+	uint i;
+
+	for (j = 0; j < nchunks; j += 8) {
+		__m512i v = _mm512_loadu_si512(
+			&conf->_match_table[0][packet[0]][j]);
+
+		for (i = 1; i < ntables && _mm512_test_epi64_mask(v, v); i++)
+			v = _mm512_and_si512(v, _mm512_loadu_si512(
+				&conf->_match_table[i][packet[i]][j]));
+
+		if (!_mm512_test_epi64_mask(v, v))
+			continue;
+
+		_mm512_store_si512(words, v);
+		for (w = 0; w < 8; w++) {
+			bool stop = false;
+			void *r = g2_match_chunk(conf, words[w], j + w,
+						 data, &stop);
+			if (r || stop)
+				return r;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Returns true, and the match in *rp, if the ruleset is large enough for a
+ * vector kernel to be used.
+ */
+static ALWAYS_INLINE bool
+g2_eval_simd(const g2_config_t *conf, const uint8_t *packet,
+	     const void *data, uint ntables, void **rp)
+{
+	uint nwords = g_size_alloc[conf->_rs_size_idx] / STRIDE_BITS;
+
+	if (g2_simd_level == G2_SIMD_AVX512 && nwords >= 8) {
+		*rp = g2_eval_avx512(conf, packet, data, ntables);
+		return true;
+	}
+	if (g2_simd_level >= G2_SIMD_AVX2 && nwords >= 4) {
+		*rp = g2_eval_avx2(conf, packet, data, ntables);
+		return true;
+	}
+	return false;
+}
+#endif /* G2_HAVE_SIMD */
+
 /*
  * g2_eval4()
  * conf:     ptr to configuration structure
@@ -598,6 +1075,13 @@ void *g2_eval4(const g2_config_t *conf, const uint8_t *packet,
 {
 	uint32_t j;
 
+#ifdef G2_HAVE_SIMD
+	void *r;
+
+	if (g2_eval_simd(conf, packet, data, 13, &r))
+		return r;
+#endif
+
 	/*
 	 * for each chunk of rules, i.e. 64 at a time
 	 */
@@ -651,6 +1135,13 @@ void *g2_eval6(const g2_config_t *conf, const uint8_t *packet,
 {
 	uint32_t j;
 
+#ifdef G2_HAVE_SIMD
+	void *r;
+
+	if (g2_eval_simd(conf, packet, data, 37, &r))
+		return r;
+#endif
+
 	/*
 	 * for each chunk of rules, i.e. 64 at a time
 	 */
@@ -24,6 +24,11 @@ g2_config_t *g2_init(uint num_tables);
 bool g2_create_rule(g2_config_t *conf, rule_no_t rule_no, void *match_data);
 bool g2_add(g2_config_t *conf, uint table, uint ntables,
 	    const uint8_t *match, const uint8_t *mask);
+g2_config_t *g2_clone(const g2_config_t *conf);
+bool g2_insert_rule(g2_config_t *conf, rule_no_t rule_no, void *match_data,
+		    uint table, uint ntables,
+		    const uint8_t *match, const uint8_t *mask);
+bool g2_delete_rule(g2_config_t *conf, rule_no_t rule_no);
 void g2_optimize(g2_config_t **confp);
 void *g2_eval4(const g2_config_t *conf, const uint8_t *packet,
 	       const void *data);
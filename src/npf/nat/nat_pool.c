@@ -243,17 +243,53 @@ struct nat_pool *nat_pool_lookup(const char *name)
 	return NULL;
 }
 
+static uint32_t
+nat_pool_ranges_nth_addr(const struct nat_pool_ranges *nr, uint32_t n)
+{
+	uint range;
+
+	for (range = 0; range < nr->nr_nranges; range++) {
+		if (n < nr->nr_range[range].pr_naddrs)
+			return nr->nr_range[range].pr_addr_start + n;
+		n -= nr->nr_range[range].pr_naddrs;
+	}
+	return 0;
+}
+
+/*
+ * Reset the address hints.  Each enabled lcore starts at a different
+ * offset into the pool, spread evenly over it, so that lcores allocating
+ * at the same time do not all try the same addresses first.
+ */
+static void nat_pool_reset_hints(struct nat_pool_ranges *nr)
+{
+	uint nlcores = rte_lcore_count();
+	uint lcore, i;
+	uint32_t addr;
+	int index;
+
+	for (lcore = 0; lcore < NAT_POOL_NHINTS; lcore++) {
+		addr = 0;
+		index = lcore < RTE_MAX_LCORE ? rte_lcore_index(lcore) : -1;
+		if (index > 0 && nlcores)
+			addr = nat_pool_ranges_nth_addr(
+				nr, (uint64_t)index * nr->nr_naddrs / nlcores);
+
+		for (i = NAT_PROTO_FIRST; i <= NAT_PROTO_LAST; i++)
+			CMM_STORE_SHARED(nr->nr_hints[lcore].nh_addr[i],
+					 addr);
+	}
+}
+
 /* Clear address hints */
 void nat_pool_clear_addr_hints(struct nat_pool *np)
 {
 	struct nat_pool_ranges *nr = np->np_ranges;
-	uint i;
 
 	if (!nr)
 		return;
 
-	for (i = NAT_PROTO_FIRST; i <= NAT_PROTO_LAST; i++)
-		rte_atomic32_set(&nr->nr_addr_hint[i], 0);
+	nat_pool_reset_hints(nr);
 }
 
 static struct nat_pool_ranges *
@@ -290,8 +326,7 @@ nat_pool_create_ranges(struct nat_pool_cfg *cfg, int *error)
 				strdup(cfg->np_range[i].pr_name);
 	}
 
-	for (i = NAT_PROTO_FIRST; i <= NAT_PROTO_LAST; i++)
-		rte_atomic32_set(&nr->nr_addr_hint[i], 0);
+	nat_pool_reset_hints(nr);
 
 	return nr;
 }
@@ -593,6 +628,14 @@ uint32_t nat_pool_next_addr(struct nat_pool *np, uint32_t addr)
 	return addr;
 }
 
+/*
+ * Get the address at index 'n' of an address pool
+ */
+uint32_t nat_pool_nth_addr(struct nat_pool *np, uint32_t n)
+{
+	return nat_pool_ranges_nth_addr(np->np_ranges, n);
+}
+
 /*
  * NAT pool range string
  */
@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <rte_atomic.h>
+#include <rte_lcore.h>
 #include <netinet/in.h>
 
 #include "urcu.h"
@@ -96,15 +97,24 @@ struct nat_pool_range {
 	uint32_t		pr_naddrs;
 };
 
+/*
+ * Record of last allocated address per differentiated protocol, for one
+ * lcore.  Each lcore has its own, on its own cache line, so that lcores
+ * creating mappings from the same pool do not share a line they all
+ * write.  Threads that are not lcores share the last one.
+ */
+struct nat_pool_hints {
+	uint32_t		nh_addr[NAT_PROTO_COUNT];
+} __rte_cache_aligned;
+
+#define NAT_POOL_NHINTS		(RTE_MAX_LCORE + 1)
+
 struct nat_pool_ranges {
 	uint8_t			nr_nranges;	/* number of addr ranges */
 	uint32_t		nr_naddrs;	/* total address count */
 	struct nat_pool_range	nr_range[NAT_POOL_MAX_RANGES];
 
-	/*
-	 * Record of last allocated address per differentiated protocol.
-	 */
-	rte_atomic32_t		nr_addr_hint[NAT_PROTO_COUNT];
+	struct nat_pool_hints	nr_hints[NAT_POOL_NHINTS];
 };
 
 /*
@@ -175,6 +185,12 @@ struct nat_pool {
  */
 uint32_t nat_pool_next_addr(struct nat_pool *np, uint32_t addr);
 
+/*
+ * Get the address at index 'n' of an address pool, counting through each
+ * range in turn.  Returns 0 if the pool has fewer addresses.
+ */
+uint32_t nat_pool_nth_addr(struct nat_pool *np, uint32_t n);
+
 /*
  * Get the range index that an address is in.  Returns -1 if address is not in
  * any range.
@@ -201,20 +217,30 @@ static inline uint16_t nat_pool_get_mbpu(const struct nat_pool *np)
 	return np->np_mbpu;
 }
 
+static inline struct nat_pool_hints *
+nat_pool_hints_lcore(struct nat_pool *np)
+{
+	unsigned int lcore = rte_lcore_id();
+
+	if (lcore >= RTE_MAX_LCORE)
+		lcore = RTE_MAX_LCORE;
+	return &np->np_ranges->nr_hints[lcore];
+}
+
 /*
- * Remember the last address allocated from a pool.  We start looking from the
- * address after this one when doing the next allocation.
+ * Remember the last address this lcore allocated from a pool.  We start
+ * looking from the address after this one when doing its next allocation.
  */
 static inline void
 nat_pool_hint_set(struct nat_pool *np, uint32_t addr, uint8_t proto)
 {
-	rte_atomic32_set(&np->np_ranges->nr_addr_hint[proto], addr);
+	CMM_STORE_SHARED(nat_pool_hints_lcore(np)->nh_addr[proto], addr);
 }
 
 static inline uint32_t
 nat_pool_hint(struct nat_pool *np, uint8_t proto)
 {
-	return rte_atomic32_read(&np->np_ranges->nr_addr_hint[proto]);
+	return CMM_LOAD_SHARED(nat_pool_hints_lcore(np)->nh_addr[proto]);
 }
 
 static inline void
@@ -72,6 +72,11 @@ struct ptree_table;
  *
  * Changes to an address-groups ptree are protected by a read-write lock.
  *
+ * Large IPv4 address-groups (e.g. blocklists) are also compiled on commit to
+ * a read-only, 16-8-8 stride multibit trie (struct ag_compiled_v4) which is
+ * published via rcu and looked up lock-free.  The ptree remains the source,
+ * and any change to it retires the compiled form until the next commit.
+ *
  *
  * g_addrgrp_table[]
  *      |
@@ -208,6 +213,44 @@ struct npf_addrgrp {
 	bool                ag_any[AG_MAX];  /* 0.0.0.0/0 or ::/0 */
 	zlist_t            *ag_list[AG_MAX];
 	struct ptree_table *ag_tree[AG_MAX];
+	struct ag_compiled_v4 *ag_c4;
+};
+
+/*
+ * Compiled IPv4 address-group.
+ *
+ * c4_dir is indexed by the top 16 bits of the address.  Each entry is either
+ * empty, AG_C4_FULL (the whole /16 matches), or the index plus one of a node.
+ *
+ * A node covers the 256 /24s of a /16.  Bits in 'full' are /24s that match
+ * entirely, and bits in 'partial' are /24s with a leaf bitmap of host
+ * addresses.  The leaves of a node are contiguous, so the leaf of a /24 is
+ * found from the node's leaf_base and the number of partial bits below it
+ * (as per poptrie).
+ */
+#define AG_C4_FULL		UINT32_MAX
+#define AG_C4_DIR_SZ		(1 << 16)
+
+/* Smaller groups are left to the ptree */
+#define AG_C4_MIN_PREFIXES	1024
+
+struct ag_c4_node {
+	uint64_t	full[4];
+	uint64_t	partial[4];
+	uint32_t	leaf_base;
+};
+
+struct ag_c4_leaf {
+	uint64_t	bits[4];
+};
+
+struct ag_compiled_v4 {
+	struct rcu_head		c4_rcu;
+	struct ag_c4_node	*c4_nodes;
+	struct ag_c4_leaf	*c4_leaves;
+	uint32_t		c4_nnodes;
+	uint32_t		c4_nleaves;
+	uint32_t		c4_dir[AG_C4_DIR_SZ];
 };
 
 #define AG_KLEN_IPv4 4
@@ -256,6 +299,48 @@ static inline uint8_t *ap_prefix(struct npf_addrgrp_entry *ae)
 	return (uint8_t *)ae->ae_addrs;
 }
 
+static inline bool ag_c4_isset(const uint64_t *bits, uint8_t b)
+{
+	return (bits[b >> 6] & (1ull << (b & 63))) != 0;
+}
+
+static inline void ag_c4_set(uint64_t *bits, uint8_t b)
+{
+	bits[b >> 6] |= 1ull << (b & 63);
+}
+
+/*
+ * Lookup in a compiled IPv4 address-group.  addr in host byte order.
+ */
+static bool
+ag_c4_lookup(const struct ag_compiled_v4 *c4, uint32_t addr)
+{
+	const struct ag_c4_node *node;
+	uint32_t ent = c4->c4_dir[addr >> 16];
+	uint8_t b = addr >> 8;
+	uint32_t idx;
+	uint i;
+
+	if (ent == AG_C4_FULL)
+		return true;
+	if (ent == 0)
+		return false;
+
+	node = &c4->c4_nodes[ent - 1];
+	if (ag_c4_isset(node->full, b))
+		return true;
+	if (!ag_c4_isset(node->partial, b))
+		return false;
+
+	idx = node->leaf_base;
+	for (i = 0; i < (uint)(b >> 6); i++)
+		idx += __builtin_popcountll(node->partial[i]);
+	idx += __builtin_popcountll(node->partial[b >> 6] &
+				   ((1ull << (b & 63)) - 1));
+
+	return ag_c4_isset(c4->c4_leaves[idx].bits, addr & 0xff);
+}
+
 /*
  * Get the address-group for an address family and table ID
  */
@@ -292,6 +377,17 @@ npf_addrgrp_lookup(enum npf_addrgrp_af af, struct npf_addrgrp *ag,
 	if (ag->ag_any[af])
 		return 0;
 
+	if (af == AG_IPv4) {
+		struct ag_compiled_v4 *c4 = rcu_dereference(ag->ag_c4);
+
+		if (c4) {
+			uint32_t addr4;
+
+			memcpy(&addr4, addr->s6_addr, sizeof(addr4));
+			return ag_c4_lookup(c4, ntohl(addr4)) ? 0 : -ENOENT;
+		}
+	}
+
 	rte_rwlock_read_lock(&ag->ag_lock);
 
 	pn = ptree_shortest_match(ag->ag_tree[af], addr->s6_addr);
@@ -303,6 +399,7 @@ npf_addrgrp_lookup(enum npf_addrgrp_af af, struct npf_addrgrp *ag,
 
 int npf_addrgrp_lookup_v4(struct npf_addrgrp *ag, uint32_t addr)
 {
+	struct ag_compiled_v4 *c4;
 	struct ptree_node *pn;
 
 	if (unlikely(!ag))
@@ -312,6 +409,10 @@ int npf_addrgrp_lookup_v4(struct npf_addrgrp *ag, uint32_t addr)
 	if (ag->ag_any[AG_IPv4])
 		return 0;
 
+	c4 = rcu_dereference(ag->ag_c4);
+	if (c4)
+		return ag_c4_lookup(c4, ntohl(addr)) ? 0 : -ENOENT;
+
 	rte_rwlock_read_lock(&ag->ag_lock);
 
 	pn = ptree_shortest_match(ag->ag_tree[AG_IPv4], (uint8_t *)&addr);
@@ -341,6 +442,214 @@ int npf_addrgrp_lookup_v6(struct npf_addrgrp *ag, uint8_t *addr)
 	return (pn != NULL) ? 0 : -ENOENT;
 }
 
+static void ag_c4_free(struct ag_compiled_v4 *c4)
+{
+	free(c4->c4_nodes);
+	free(c4->c4_leaves);
+	free(c4);
+}
+
+static void ag_c4_free_rcu(struct rcu_head *head)
+{
+	ag_c4_free(caa_container_of(head, struct ag_compiled_v4, c4_rcu));
+}
+
+/*
+ * The ptree is about to change, so the compiled form (if any) no longer
+ * reflects it.  Lookups fall back to the ptree until the next commit.
+ */
+static void npf_addrgrp_uncompile(struct npf_addrgrp *ag, uint8_t af)
+{
+	struct ag_compiled_v4 *c4 = ag->ag_c4;
+
+	if (af != AG_IPv4 || !c4)
+		return;
+
+	rcu_assign_pointer(ag->ag_c4, NULL);
+	call_rcu(&c4->c4_rcu, ag_c4_free_rcu);
+}
+
+struct ag_c4_pfx {
+	uint32_t	addr;	/* host byte order */
+	uint8_t		mask;
+};
+
+struct ag_c4_collect_ctx {
+	struct ag_c4_pfx	*pfx;
+	uint32_t		n;
+	uint32_t		max;
+};
+
+static int ag_c4_collect_cb(struct ptree_node *n, void *data)
+{
+	struct ag_c4_collect_ctx *ctx = data;
+	uint8_t mask = ptree_get_mask(n);
+	uint32_t addr;
+
+	if (ctx->n == ctx->max)
+		return -1;
+
+	memcpy(&addr, ptree_get_key(n), sizeof(addr));
+	addr = ntohl(addr);
+	if (mask < 32)
+		addr &= ~(UINT32_MAX >> mask);
+
+	ctx->pfx[ctx->n].addr = addr;
+	ctx->pfx[ctx->n].mask = mask;
+	ctx->n++;
+	return 0;
+}
+
+/* By address, then shortest mask first */
+static int ag_c4_pfx_cmp(const void *a, const void *b)
+{
+	const struct ag_c4_pfx *p1 = a, *p2 = b;
+
+	if (p1->addr != p2->addr)
+		return p1->addr < p2->addr ? -1 : 1;
+	return (int)p1->mask - (int)p2->mask;
+}
+
+/* Double the capacity of an array if it is full */
+static int ag_c4_grow(void **array, uint32_t n, uint32_t *max, size_t sz)
+{
+	uint32_t new_max;
+	void *new;
+
+	if (n < *max)
+		return 0;
+
+	new_max = *max ? *max * 2 : 64;
+	new = realloc(*array, new_max * sz);
+	if (!new)
+		return -ENOMEM;
+
+	*array = new;
+	*max = new_max;
+	return 0;
+}
+
+/*
+ * Compile the IPv4 ptree of an address-group.
+ *
+ * The prefixes are sorted so that any prefix covered by an earlier one can
+ * be skipped, after which the remainder are disjoint and ascending.  Nodes
+ * and leaves are therefore appended in address order, which is what allows
+ * a node's leaves to be contiguous.
+ */
+static struct ag_compiled_v4 *npf_addrgrp_compile_v4(struct npf_addrgrp *ag)
+{
+	struct ag_c4_collect_ctx ctx;
+	struct ag_compiled_v4 *c4;
+	uint32_t max_nodes = 0, max_leaves = 0;
+	uint64_t covered = 0;
+	uint32_t i;
+
+	ctx.max = ptree_get_table_leaf_count(ag->ag_tree[AG_IPv4]);
+	ctx.n = 0;
+	ctx.pfx = malloc(ctx.max * sizeof(*ctx.pfx));
+	if (!ctx.pfx)
+		return NULL;
+
+	ptree_walk(ag->ag_tree[AG_IPv4], PT_UP, ag_c4_collect_cb, &ctx);
+	qsort(ctx.pfx, ctx.n, sizeof(*ctx.pfx), ag_c4_pfx_cmp);
+
+	c4 = calloc(1, sizeof(*c4));
+	if (!c4)
+		goto error;
+
+	for (i = 0; i < ctx.n; i++) {
+		uint32_t first = ctx.pfx[i].addr;
+		uint8_t mask = ctx.pfx[i].mask;
+		uint32_t last = first | (mask < 32 ? UINT32_MAX >> mask : 0);
+		struct ag_c4_node *node;
+		uint32_t *ent;
+		uint32_t j;
+
+		if (first < covered)
+			continue;
+		covered = (uint64_t)last + 1;
+
+		if (mask <= 16) {
+			for (j = first >> 16; j <= last >> 16; j++)
+				c4->c4_dir[j] = AG_C4_FULL;
+			continue;
+		}
+
+		ent = &c4->c4_dir[first >> 16];
+		if (*ent == 0) {
+			if (ag_c4_grow((void **)&c4->c4_nodes, c4->c4_nnodes,
+				       &max_nodes, sizeof(*c4->c4_nodes)) < 0)
+				goto error;
+			memset(&c4->c4_nodes[c4->c4_nnodes], 0,
+			       sizeof(*c4->c4_nodes));
+			*ent = ++c4->c4_nnodes;
+		}
+		node = &c4->c4_nodes[*ent - 1];
+
+		if (mask <= 24) {
+			for (j = (first >> 8) & 0xff; j <= ((last >> 8) & 0xff);
+			     j++)
+				ag_c4_set(node->full, j);
+			continue;
+		}
+
+		/* Leaves are appended in order, so ours is the last one */
+		if (!ag_c4_isset(node->partial, first >> 8)) {
+			if (ag_c4_grow((void **)&c4->c4_leaves, c4->c4_nleaves,
+				       &max_leaves, sizeof(*c4->c4_leaves)) < 0)
+				goto error;
+			if (!node->partial[0] && !node->partial[1] &&
+			    !node->partial[2] && !node->partial[3])
+				node->leaf_base = c4->c4_nleaves;
+			ag_c4_set(node->partial, first >> 8);
+			memset(&c4->c4_leaves[c4->c4_nleaves], 0,
+			       sizeof(*c4->c4_leaves));
+			c4->c4_nleaves++;
+		}
+
+		for (j = first & 0xff; j <= (last & 0xff); j++)
+			ag_c4_set(c4->c4_leaves[c4->c4_nleaves - 1].bits, j);
+	}
+
+	free(ctx.pfx);
+	return c4;
+
+error:
+	free(ctx.pfx);
+	if (c4)
+		ag_c4_free(c4);
+	return NULL;
+}
+
+static int
+npf_addrgrp_commit_cb(const char *name __unused, uint id __unused,
+		      void *data, void *ctx __unused)
+{
+	struct npf_addrgrp *ag = data;
+	struct ag_compiled_v4 *c4;
+
+	if (ag->ag_c4 || ag->ag_any[AG_IPv4] ||
+	    ptree_get_table_leaf_count(ag->ag_tree[AG_IPv4]) <
+	    AG_C4_MIN_PREFIXES)
+		return 0;
+
+	/* On failure lookups simply stay with the ptree */
+	c4 = npf_addrgrp_compile_v4(ag);
+	if (c4)
+		rcu_assign_pointer(ag->ag_c4, c4);
+	return 0;
+}
+
+/*
+ * Compile any large address-groups that have changed since the last commit
+ */
+void npf_addrgrp_commit(void)
+{
+	if (g_addrgrp_table)
+		npf_tbl_walk(g_addrgrp_table, npf_addrgrp_commit_cb, NULL);
+}
+
 /*
  * Create an address-group tableset
  */
@@ -501,9 +810,9 @@ char *npf_addrgrp_handle2name(struct npf_addrgrp *ag)
 }
 
 /*
- * Create an address-group, and insert it into address-group tableset
+ * Create an address-group, but do not insert it into the tableset
  */
-struct npf_addrgrp *npf_addrgrp_create(const char *name)
+static struct npf_addrgrp *npf_addrgrp_alloc(const char *name)
 {
 	struct npf_addrgrp *ag;
 	int rc;
@@ -513,10 +822,6 @@ struct npf_addrgrp *npf_addrgrp_create(const char *name)
 	if (rc < 0)
 		return NULL;
 
-	/* Is name already in address-group tableset? */
-	if (npf_tbl_name_lookup(g_addrgrp_table, name) != NULL)
-		return NULL;
-
 	/* Create address-group */
 	ag = npf_tbl_entry_create(g_addrgrp_table, name);
 	if (!ag)
@@ -541,12 +846,6 @@ struct npf_addrgrp *npf_addrgrp_create(const char *name)
 
 	ag->ag_name = strdup(name);
 
-	/* Add entry to tableset */
-	ag->ag_tid = npf_tbl_entry_insert(g_addrgrp_table, ag);
-
-	if (ag->ag_tid < 0)
-		goto error;
-
 	return ag;
 
 error:
@@ -559,6 +858,33 @@ error:
 	return NULL;
 }
 
+/*
+ * Create an address-group, and insert it into address-group tableset
+ */
+struct npf_addrgrp *npf_addrgrp_create(const char *name)
+{
+	struct npf_addrgrp *ag;
+
+	/* Is name already in address-group tableset? */
+	if (npf_tbl_name_lookup(g_addrgrp_table, name) != NULL)
+		return NULL;
+
+	ag = npf_addrgrp_alloc(name);
+	if (!ag)
+		return NULL;
+
+	/* Add entry to tableset */
+	ag->ag_tid = npf_tbl_entry_insert(g_addrgrp_table, ag);
+
+	if (ag->ag_tid < 0) {
+		npf_addrgrp_data_destroy(ag);
+		npf_tbl_entry_destroy(ag);
+		return NULL;
+	}
+
+	return ag;
+}
+
 /*
  * Destroy the address-group specific data of an address-group
  *
@@ -585,6 +911,8 @@ npf_addrgrp_data_destroy(struct npf_addrgrp *ag)
 
 	rte_rwlock_write_lock(&ag->ag_lock);
 
+	npf_addrgrp_uncompile(ag, AG_IPv4);
+
 	if (ag->ag_tree[AG_IPv4])
 		ptree_table_destroy(ag->ag_tree[AG_IPv4]);
 
@@ -703,6 +1031,7 @@ npf_addrgrp_prefix_mask_insert(struct npf_addrgrp_entry *ae, uint8_t mask)
 		 * the different mask.
 		 */
 		rte_rwlock_write_lock(&ag->ag_lock);
+		npf_addrgrp_uncompile(ag, ae->ae_af);
 
 		ptree_remove(ag->ag_tree[ae->ae_af], ap_prefix(ae),
 			     ag_ptree_mask(ae->ae_af, ae->ap_mask[1]));
@@ -750,6 +1079,7 @@ npf_addrgrp_prefix_mask_remove(struct npf_addrgrp_entry *ae, uint8_t mask)
 		 * the different mask.
 		 */
 		rte_rwlock_write_lock(&ag->ag_lock);
+		npf_addrgrp_uncompile(ag, ae->ae_af);
 
 		ptree_remove(ag->ag_tree[ae->ae_af], ap_prefix(ae),
 			     ag_ptree_mask(ae->ae_af, ae->ap_mask[0]));
@@ -1021,6 +1351,7 @@ static void npf_addrgrp_entry_free(void *item)
 		 * Remove prefix from ptree
 		 */
 		rte_rwlock_write_lock(&ag->ag_lock);
+		npf_addrgrp_uncompile(ag, ae->ae_af);
 
 		rc = ptree_remove(ag->ag_tree[ae->ae_af], ap_prefix(ae),
 				  ag_ptree_mask(ae->ae_af, ae->ap_mask[0]));
@@ -1164,15 +1495,9 @@ is_addr_zero(uint8_t *addr, uint8_t alen)
  * mask value.  (The multiple-mask mechanism allows for both 10.0.0.1/32 and
  * 10.0.0.1 to be entered via the cli.)
  */
-int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
-			      uint8_t alen, uint8_t mask)
+static int
+npf_addrgrp_prefix_validate(npf_addr_t *addr, uint8_t alen, uint8_t mask)
 {
-	struct npf_addrgrp_entry *ae;
-	struct npf_addrgrp *ag;
-	enum npf_addrgrp_af af;
-	bool new = false;
-	int rc;
-
 	if (alen != AG_KLEN_IPv4 && alen != AG_KLEN_IPv6)
 		return -EINVAL;
 
@@ -1196,15 +1521,17 @@ int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
 		if (host_bits_set(addr->s6_addr, alen, mm))
 			return -EINVAL;
 	}
+	return 0;
+}
+
+static int
+_npf_addrgrp_prefix_insert(struct npf_addrgrp *ag, npf_addr_t *addr,
+			   uint8_t alen, uint8_t mask)
+{
+	struct npf_addrgrp_entry *ae;
+	enum npf_addrgrp_af af;
+	int rc;
 
-	/* Create an address-group if one doesn't already exist */
-	ag = npf_addrgrp_lookup_name(name);
-	if (!ag) {
-		ag = npf_addrgrp_create(name);
-		if (!ag)
-			return -EINVAL;
-		new = true;
-	}
 	af = AG_ALEN2AF(alen);
 
 	/* Only one 0.0.0.0/0 (or ::/0) allowed */
@@ -1217,8 +1544,6 @@ int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
 	 */
 	ae = npf_addrgrp_list_prefix_lookup(ag, addr->s6_addr, mask, alen);
 	if (ae) {
-		assert(!new);
-
 		if (ae->ae_type == NPF_ADDRGRP_TYPE_RANGE)
 			return -EEXIST;
 
@@ -1236,11 +1561,8 @@ int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
 
 	ae = npf_addrgrp_prefix_insert_list(list, npf_addrgrp_entry_free,
 					    addr->s6_addr, alen, mask, ag);
-	if (!ae) {
-		if (new)
-			_npf_addrgrp_destroy(ag);
+	if (!ae)
 		return -ENOMEM;
-	}
 
 	/*
 	 * Special case of 0.0.0.0/0 (or ::/0).  We just set a boolean, and do
@@ -1255,6 +1577,7 @@ int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
 	 * Add prefix to ptree
 	 */
 	rte_rwlock_write_lock(&ag->ag_lock);
+	npf_addrgrp_uncompile(ag, af);
 
 	rc = ptree_insert(ag->ag_tree[af], addr->s6_addr,
 			  ag_ptree_mask(af, mask));
@@ -1265,6 +1588,31 @@ int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
 
 	assert(rc == 0);
 
+	return rc;
+}
+
+int npf_addrgrp_prefix_insert(const char *name, npf_addr_t *addr,
+			      uint8_t alen, uint8_t mask)
+{
+	struct npf_addrgrp *ag;
+	bool new = false;
+	int rc;
+
+	rc = npf_addrgrp_prefix_validate(addr, alen, mask);
+	if (rc < 0)
+		return rc;
+
+	/* Create an address-group if one doesn't already exist */
+	ag = npf_addrgrp_lookup_name(name);
+	if (!ag) {
+		ag = npf_addrgrp_create(name);
+		if (!ag)
+			return -EINVAL;
+		new = true;
+	}
+
+	rc = _npf_addrgrp_prefix_insert(ag, addr, alen, mask);
+
 	if (rc < 0 && new)
 		_npf_addrgrp_destroy(ag);
 
@@ -1330,6 +1678,7 @@ npf_addrgrp_range_pfx_list_ptree_insert(struct npf_addrgrp *ag,
 	int rc;
 
 	rte_rwlock_write_lock(&ag->ag_lock);
+	npf_addrgrp_uncompile(ag, ae->ae_af);
 
 	for (ap = zlist_first(ae->ar_list); ap != NULL;
 	     ap = zlist_next(ae->ar_list)) {
@@ -1489,6 +1838,7 @@ npf_addrgrp_range_update(struct npf_addrgrp *ag,
 				ap_prefix(new), alen, new->ap_mask[0], ag);
 
 			/* .. add to ptree */
+			npf_addrgrp_uncompile(ag, af);
 			rc = ptree_insert(ag->ag_tree[af], ap_prefix(tmp),
 					  ag_ptree_mask(af, tmp->ap_mask[0]));
 			if (rc == 0)
@@ -1508,13 +1858,9 @@ npf_addrgrp_range_update(struct npf_addrgrp *ag,
  * Insert an address range into an address group.  Addresses should be in
  * network byte order.
  */
-int npf_addrgrp_range_insert(const char *name, npf_addr_t *start,
-			     npf_addr_t *end, uint8_t alen)
+static int
+npf_addrgrp_range_validate(npf_addr_t *start, npf_addr_t *end, uint8_t alen)
 {
-	struct npf_addrgrp_entry *ae, *cur_ae = NULL;
-	struct npf_addrgrp *ag;
-	bool new = false;
-
 	if (alen != AG_KLEN_IPv4 && alen != AG_KLEN_IPv6)
 		return -EINVAL;
 
@@ -1522,14 +1868,14 @@ int npf_addrgrp_range_insert(const char *name, npf_addr_t *start,
 	if (npf_addrgrp_addr_cmp(start->s6_addr, end->s6_addr, alen) >= 0)
 		return -EINVAL;
 
-	/* Create an address-group if one doesn't already exist */
-	ag = npf_addrgrp_lookup_name(name);
-	if (!ag) {
-		ag = npf_addrgrp_create(name);
-		if (!ag)
-			return -EINVAL;
-		new = true;
-	}
+	return 0;
+}
+
+static int
+_npf_addrgrp_range_insert(struct npf_addrgrp *ag, npf_addr_t *start,
+			  npf_addr_t *end, uint8_t alen)
+{
+	struct npf_addrgrp_entry *ae, *cur_ae = NULL;
 
 	/*
 	 * Does the new range overlap with an existing prefix entry or range
@@ -1568,11 +1914,8 @@ int npf_addrgrp_range_insert(const char *name, npf_addr_t *start,
 
 	ae = npf_addrgrp_range_insert_list(list, start->s6_addr, end->s6_addr,
 					   alen, ag);
-	if (!ae) {
-		if (new)
-			_npf_addrgrp_destroy(ag);
+	if (!ae)
 		return -ENOMEM;
-	}
 
 	/*
 	 * Convert range to minimal set of CIDR notation blocks, and add to
@@ -1608,6 +1951,143 @@ int npf_addrgrp_range_insert(const char *name, npf_addr_t *start,
 	return 0;
 }
 
+int npf_addrgrp_range_insert(const char *name, npf_addr_t *start,
+			     npf_addr_t *end, uint8_t alen)
+{
+	struct npf_addrgrp *ag;
+	bool new = false;
+	int rc;
+
+	rc = npf_addrgrp_range_validate(start, end, alen);
+	if (rc < 0)
+		return rc;
+
+	/* Create an address-group if one doesn't already exist */
+	ag = npf_addrgrp_lookup_name(name);
+	if (!ag) {
+		ag = npf_addrgrp_create(name);
+		if (!ag)
+			return -EINVAL;
+		new = true;
+	}
+
+	rc = _npf_addrgrp_range_insert(ag, start, end, alen);
+
+	if (rc < 0 && new)
+		_npf_addrgrp_destroy(ag);
+
+	return rc;
+}
+
+/*
+ * Bulk load.  An address-group is built offline from a list of entries, then
+ * swapped with the named group in one step.  This avoids the config message
+ * per entry, and means lookups never see a partially loaded group.
+ */
+struct npf_addrgrp *npf_addrgrp_load_begin(const char *name)
+{
+	return npf_addrgrp_alloc(name);
+}
+
+int npf_addrgrp_load_prefix(struct npf_addrgrp *staging, npf_addr_t *addr,
+			    uint8_t alen, uint8_t mask)
+{
+	int rc;
+
+	rc = npf_addrgrp_prefix_validate(addr, alen, mask);
+	if (rc < 0)
+		return rc;
+
+	return _npf_addrgrp_prefix_insert(staging, addr, alen, mask);
+}
+
+int npf_addrgrp_load_range(struct npf_addrgrp *staging, npf_addr_t *start,
+			   npf_addr_t *end, uint8_t alen)
+{
+	int rc;
+
+	rc = npf_addrgrp_range_validate(start, end, alen);
+	if (rc < 0)
+		return rc;
+
+	return _npf_addrgrp_range_insert(staging, start, end, alen);
+}
+
+void npf_addrgrp_load_abort(struct npf_addrgrp *staging)
+{
+	npf_addrgrp_data_destroy(staging);
+	npf_tbl_entry_destroy(staging);
+}
+
+/* Point the entries of an address-group back at the group that holds them */
+static void npf_addrgrp_set_owner(struct npf_addrgrp *ag)
+{
+	struct npf_addrgrp_entry *ae, *ap;
+	uint af;
+
+	for (af = 0; af < AG_MAX; af++) {
+		for (ae = zlist_first(ag->ag_list[af]); ae != NULL;
+		     ae = zlist_next(ag->ag_list[af])) {
+			ae->ae_ag = ag;
+			if (ae->ae_type != NPF_ADDRGRP_TYPE_RANGE)
+				continue;
+			for (ap = zlist_first(ae->ar_list); ap != NULL;
+			     ap = zlist_next(ae->ar_list))
+				ap->ae_ag = ag;
+		}
+	}
+}
+
+int npf_addrgrp_load_commit(const char *name, struct npf_addrgrp *staging)
+{
+	struct ag_compiled_v4 *c4 = NULL;
+	struct npf_addrgrp *ag;
+	uint af;
+
+	ag = npf_addrgrp_lookup_name(name);
+	if (!ag) {
+		ag = npf_addrgrp_create(name);
+		if (!ag) {
+			npf_addrgrp_load_abort(staging);
+			return -ENOSPC;
+		}
+	}
+
+	/* Compile up front, so it is published along with the new tree */
+	if (!staging->ag_any[AG_IPv4] &&
+	    ptree_get_table_leaf_count(staging->ag_tree[AG_IPv4]) >=
+	    AG_C4_MIN_PREFIXES)
+		c4 = npf_addrgrp_compile_v4(staging);
+
+	rte_rwlock_write_lock(&ag->ag_lock);
+	npf_addrgrp_uncompile(ag, AG_IPv4);
+
+	for (af = 0; af < AG_MAX; af++) {
+		bool any = ag->ag_any[af];
+		zlist_t *list = ag->ag_list[af];
+		struct ptree_table *tree = ag->ag_tree[af];
+
+		ag->ag_any[af] = staging->ag_any[af];
+		ag->ag_list[af] = staging->ag_list[af];
+		ag->ag_tree[af] = staging->ag_tree[af];
+
+		staging->ag_any[af] = any;
+		staging->ag_list[af] = list;
+		staging->ag_tree[af] = tree;
+	}
+	if (c4)
+		rcu_assign_pointer(ag->ag_c4, c4);
+
+	rte_rwlock_write_unlock(&ag->ag_lock);
+
+	npf_addrgrp_set_owner(ag);
+	npf_addrgrp_set_owner(staging);
+
+	/* staging now holds the old entries */
+	npf_addrgrp_load_abort(staging);
+	return 0;
+}
+
 /*
  * Remove a prefix from an address group.  Address should be in network byte
  * order.  mask will be NPF_NO_NETMASK if no mask was specified in the
@@ -154,6 +154,14 @@ int npf_addrgrp_destroy(const char *name);
  */
 int npf_addrgrp_tbl_destroy(void);
 
+/**
+ * @brief Compile large IPv4 address-groups for lock-free lookup
+ *
+ * Called on npf commit.  Groups whose ptree has changed since they were last
+ * compiled are recompiled, and the result published via rcu.
+ */
+void npf_addrgrp_commit(void);
+
 
 /*************************************************************************
  * Address-group management api
@@ -230,6 +238,50 @@ int npf_addrgrp_prefix_remove(const char *name, npf_addr_t *addr,
 int npf_addrgrp_range_remove(const char *name, npf_addr_t *start,
 			     npf_addr_t *end, uint8_t alen);
 
+/**
+ * @brief Start a bulk load of an address-group
+ *
+ * Creates an empty staging address-group, not visible to lookups, to which
+ * entries are added with npf_addrgrp_load_prefix and npf_addrgrp_load_range.
+ * The load is then finished with either npf_addrgrp_load_commit or
+ * npf_addrgrp_load_abort.
+ *
+ * @param name Address group name
+ * @return Staging address-group, or NULL on failure
+ */
+struct npf_addrgrp *npf_addrgrp_load_begin(const char *name);
+
+/**
+ * @brief Add a prefix to a staging address-group
+ *
+ * Arguments as per npf_addrgrp_prefix_insert.
+ */
+int npf_addrgrp_load_prefix(struct npf_addrgrp *staging, npf_addr_t *addr,
+			    uint8_t alen, uint8_t mask);
+
+/**
+ * @brief Add an address range to a staging address-group
+ *
+ * Arguments as per npf_addrgrp_range_insert.
+ */
+int npf_addrgrp_load_range(struct npf_addrgrp *staging, npf_addr_t *start,
+			   npf_addr_t *end, uint8_t alen);
+
+/**
+ * @brief Replace the contents of an address-group with a staging group
+ *
+ * The named group is created if it does not exist.  Its previous entries
+ * are destroyed, as is the staging group.
+ *
+ * @return 0 if successful, else < 0.
+ */
+int npf_addrgrp_load_commit(const char *name, struct npf_addrgrp *staging);
+
+/**
+ * @brief Discard a staging address-group
+ */
+void npf_addrgrp_load_abort(struct npf_addrgrp *staging);
+
 
 /********************************************************************
  * Address group walks
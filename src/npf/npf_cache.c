@@ -51,6 +51,7 @@
 #include <netinet/ip.h>
 #include <rte_branch_prediction.h>
 #include <rte_ether.h>
+#include <rte_ip.h>
 #include <rte_mbuf.h>
 #include <rte_per_lcore.h>
 #include <stdint.h>
@@ -450,6 +451,17 @@ npf_fetch_ipv6(npf_cache_t *npc, struct rte_mbuf *nbuf, void *n_ptr)
 	 */
 	last_unfrg_hlen = hlen;
 
+	/*
+	 * Without extension headers, the common case, there is nothing
+	 * to walk, so long as the fetch the walk would make is within the
+	 * first segment.
+	 */
+	if (likely(!ip6_is_ext_hdr(npc->npc_next_proto) &&
+		   (char *)n_ptr + hlen + sizeof(struct ip6_ext) <=
+		   rte_pktmbuf_mtod(nbuf, char *) +
+		   rte_pktmbuf_data_len(nbuf)))
+		goto done;
+
 	/*
 	 * Advance by the length of the current header and
 	 * prefetch the extension header.
@@ -528,6 +540,7 @@ npf_fetch_ipv6(npf_cache_t *npc, struct rte_mbuf *nbuf, void *n_ptr)
 		hlen = next_hlen;
 	}
 
+done:
 	/* Store the l3_len, if not calculated earlier. */
 	if (pktmbuf_l3_len(nbuf) == 0)
 		pktmbuf_l3_len(nbuf) = npc->npc_hlen;
@@ -775,9 +788,52 @@ static inline bool npf_fetch_icmp(npf_cache_t *npc, struct rte_mbuf *nbuf,
  *
  * returns true if packet is OK.
  */
+/*
+ * Save the parsed L4 header in the packet metadata, for the session and
+ * ECMP layers.  Not for fragments, as only the first has the L4 header.
+ */
+static void
+npf_cache_mdata_l4(const npf_cache_t *npc, struct rte_mbuf *nbuf)
+{
+	struct pkt_mdata_l4 *ml;
+
+	if (!npf_iscached(npc, NPC_IP46) || npf_iscached(npc, NPC_IPFRAG)) {
+		pktmbuf_mdata_clear(nbuf, PKT_MDATA_L4);
+		return;
+	}
+
+	ml = &pktmbuf_mdata(nbuf)->md_l4;
+	ml->ml_l3_offs = pktmbuf_l2_len(nbuf);
+	ml->ml_l4_offs = ml->ml_l3_offs + npf_cache_hlen(npc);
+	ml->ml_proto = npf_cache_ipproto(npc);
+	ml->ml_flags = npf_iscached(npc, NPC_IPV6_ROUTING) ?
+		PKT_MDATA_L4_ROUTING : 0;
+
+	if (npf_iscached(npc, NPC_L4PORTS)) {
+		ml->ml_sport = npc->npc_l4.ports.s_port;
+		ml->ml_dport = npc->npc_l4.ports.d_port;
+		ml->ml_flags |= PKT_MDATA_L4_PORTS;
+	} else if (npf_iscached(npc, NPC_ICMP_ECHO)) {
+		if (ml->ml_proto == IPPROTO_ICMP)
+			ml->ml_id = npc->npc_l4.icmp.icmp_id;
+		else
+			ml->ml_id = npc->npc_l4.icmp6.icmp6_id;
+		ml->ml_flags |= PKT_MDATA_L4_ECHO;
+	}
+
+	pktmbuf_mdata_set(nbuf, PKT_MDATA_L4);
+}
+
 bool npf_cache_all(npf_cache_t *npc, struct rte_mbuf *nbuf, uint16_t eth_proto)
 {
-	return npf_cache_all_at(npc, nbuf, npf_iphdr(nbuf), eth_proto, false);
+	if (unlikely(!npf_cache_all_at(npc, nbuf, npf_iphdr(nbuf),
+				       eth_proto, false))) {
+		pktmbuf_mdata_clear(nbuf, PKT_MDATA_L4);
+		return false;
+	}
+
+	npf_cache_mdata_l4(npc, nbuf);
+	return true;
 }
 
 bool npf_cache_all_at(npf_cache_t *npc, struct rte_mbuf *nbuf, void *n_ptr,
@@ -1138,6 +1194,24 @@ static int npf_rw_udp_len(npf_cache_t *npc, struct rte_mbuf *nbuf, uint16_t len)
 	return 0;
 }
 
+/*
+ * Pseudo-header checksum for a packet whose L4 checksum is offloaded.  The
+ * L3 offload flags are set to match, as nat64 may have changed the family.
+ */
+static uint16_t
+npf_phdr_cksum(struct rte_mbuf *nbuf, const void *l3hdr, bool v4)
+{
+	if (v4) {
+		nbuf->ol_flags &= ~PKT_TX_IPV6;
+		nbuf->ol_flags |= PKT_TX_IPV4;
+		return rte_ipv4_phdr_cksum(l3hdr, nbuf->ol_flags);
+	}
+
+	nbuf->ol_flags &= ~(PKT_TX_IPV4 | PKT_TX_IP_CKSUM);
+	nbuf->ol_flags |= PKT_TX_IPV6;
+	return rte_ipv6_phdr_cksum(l3hdr, nbuf->ol_flags);
+}
+
 /*
  * Calculate a UDP cksum and update the UDP header and cache
  */
@@ -1150,6 +1224,15 @@ void npf_udp_cksum(npf_cache_t *npc, struct rte_mbuf *nbuf)
 	l3hdr = pktmbuf_mtol3(nbuf, void *);
 	udp = (struct udphdr *)(rte_pktmbuf_mtod(nbuf, char *) +
 				nbuf->l2_len + npf_cache_hlen(npc));
+
+	/* Payload length may have changed, so redo the pseudo-header */
+	if (npf_l4_cksum_offloaded(nbuf)) {
+		cksum = npf_phdr_cksum(nbuf, l3hdr,
+				       npf_iscached(npc, NPC_IP4));
+		npf_rw_proto_cksum(npc, nbuf, cksum);
+		return;
+	}
+
 	udp->check = 0;
 
 	if (npf_iscached(npc, NPC_IP4))
@@ -1178,6 +1261,15 @@ void npf_tcp_cksum(npf_cache_t *npc, struct rte_mbuf *nbuf)
 	l3hdr = pktmbuf_mtol3(nbuf, void *);
 	tcp = (struct tcphdr *)(rte_pktmbuf_mtod(nbuf, char *) +
 				nbuf->l2_len + npf_cache_hlen(npc));
+
+	/* Payload length may have changed, so redo the pseudo-header */
+	if (npf_l4_cksum_offloaded(nbuf)) {
+		cksum = npf_phdr_cksum(nbuf, l3hdr,
+				       npf_iscached(npc, NPC_IP4));
+		npf_rw_proto_cksum(npc, nbuf, cksum);
+		return;
+	}
+
 	tcp->check = 0;
 
 	if (npf_iscached(npc, NPC_IP4))
@@ -1211,11 +1303,19 @@ npf_ipv4_cksum(struct rte_mbuf *nbuf, int proto, char *l4hdr)
 	switch (proto) {
 	case IPPROTO_TCP:
 		tcp = (struct tcphdr *)l4hdr;
+		if (npf_l4_cksum_offloaded(nbuf)) {
+			tcp->check = npf_phdr_cksum(nbuf, l3hdr, true);
+			break;
+		}
 		tcp->check = 0;
 		tcp->check = in4_cksum_mbuf(nbuf, l3hdr, tcp);
 		break;
 	case IPPROTO_UDP:
 		udp = (struct udphdr *)l4hdr;
+		if (npf_l4_cksum_offloaded(nbuf)) {
+			udp->check = npf_phdr_cksum(nbuf, l3hdr, true);
+			break;
+		}
 		udp->check = 0;
 		udp->check = in4_cksum_mbuf(nbuf, l3hdr, udp);
 		/* Do not encode the 'no checksum' value */
@@ -1251,11 +1351,19 @@ void npf_ipv6_cksum(struct rte_mbuf *nbuf, int proto, char *l4hdr)
 	switch (proto) {
 	case IPPROTO_TCP:
 		tcp = (struct tcphdr *)l4hdr;
+		if (npf_l4_cksum_offloaded(nbuf)) {
+			tcp->check = npf_phdr_cksum(nbuf, l3hdr, false);
+			break;
+		}
 		tcp->check = 0;
 		tcp->check = in6_cksum_mbuf(nbuf, l3hdr, tcp);
 		break;
 	case IPPROTO_UDP:
 		udp = (struct udphdr *)l4hdr;
+		if (npf_l4_cksum_offloaded(nbuf)) {
+			udp->check = npf_phdr_cksum(nbuf, l3hdr, false);
+			break;
+		}
 		udp->check = 0;
 		udp->check = in6_cksum_mbuf(nbuf, l3hdr, udp);
 		/* Do not encode the 'no checksum' value */
@@ -1301,6 +1409,10 @@ int npf_update_tcp_cksum(npf_cache_t *npc, struct rte_mbuf *nbuf,
 	struct tcphdr *th = &npc->npc_l4.tcp;
 	uint16_t sum = th->check;
 
+	/* Sequence numbers are not in the pseudo-header */
+	if (npf_l4_cksum_offloaded(nbuf))
+		return 0;
+
 	sum = ip_fixup32_cksum(sum, htonl(old_val), htonl(new_val));
 
 	return npf_rw_proto_cksum(npc, nbuf, sum);
@@ -1401,6 +1513,9 @@ bool npf_rwrport(npf_cache_t *npc, struct rte_mbuf *nbuf, void *n_ptr,
 		}
 	}
 
+	/* The saved L4 header is stale from here on */
+	pktmbuf_mdata_clear(nbuf, PKT_MDATA_L4);
+
 	/* Advance and rewrite the port. */
 	if (nbuf_advstore(&nbuf, &n_ptr, offby, sizeof(in_port_t), &port))
 		return false;
@@ -1432,6 +1547,8 @@ bool npf_rwricmpid(npf_cache_t *npc, struct rte_mbuf *nbuf, void *n_ptr,
 	u_int offby = npf_cache_hlen(npc)
 		    + offsetof(struct icmp, icmp_id);
 
+	pktmbuf_mdata_clear(nbuf, PKT_MDATA_L4);
+
 	/* Advance and rewrite the ICMP id. */
 	if (nbuf_advstore(&nbuf, &n_ptr, offby, sizeof(new_id), &new_id))
 		return false;
@@ -1450,6 +1567,7 @@ bool
 npf_v4_rwrcksums(npf_cache_t *npc, struct rte_mbuf *nbuf, void *n_ptr,
 		 uint16_t l3_chk_delta, uint16_t l4_chk_delta)
 {
+	bool offloaded = npf_l4_cksum_offloaded(nbuf);
 	uint16_t *cksum;
 	u_int offby;
 
@@ -1483,7 +1601,7 @@ npf_v4_rwrcksums(npf_cache_t *npc, struct rte_mbuf *nbuf, void *n_ptr,
 		struct udphdr *uh = &npc->npc_l4.udp;
 
 		cksum = &uh->check;
-		if (*cksum == 0) {
+		if (*cksum == 0 && !offloaded) {
 			/* No need to update. */
 			return true;
 		}
@@ -1518,8 +1636,14 @@ npf_v4_rwrcksums(npf_cache_t *npc, struct rte_mbuf *nbuf, void *n_ptr,
 		return true;
 	}
 
-	/* Update the checksum in the cache */
-	*cksum = ip_fixup16_cksum(*cksum, ~l3_chk_delta, l4_chk_delta);
+	/*
+	 * Update the checksum in the cache.  An offloaded checksum holds the
+	 * uncomplemented pseudo-header sum, which ports are not part of.
+	 */
+	if (offloaded)
+		*cksum = ip_partial_chksum_adjust(*cksum, ~l3_chk_delta, 0);
+	else
+		*cksum = ip_fixup16_cksum(*cksum, ~l3_chk_delta, l4_chk_delta);
 
 	/* Update the checksum in the mbuf */
 	if (nbuf_advstore(&nbuf, &n_ptr, offby, sizeof(uint16_t), cksum))
@@ -299,6 +299,17 @@ int npf_payload_update(npf_session_t *se, npf_cache_t *npc,
 		       struct rte_mbuf *nbuf, void *pl,
 		       const int di, uint16_t nlen);
 uint16_t npf_get_ip_size(npf_cache_t *npc);
+/*
+ * Is the L4 checksum to be completed by the NIC (checksum or TCP segmentation
+ * offload)?  If so, the checksum field only holds the pseudo-header sum, so
+ * must not be computed in software, and port or payload changes do not
+ * affect it.
+ */
+static inline bool npf_l4_cksum_offloaded(const struct rte_mbuf *m)
+{
+	return (m->ol_flags & (PKT_TX_L4_MASK | PKT_TX_TCP_SEG)) != 0;
+}
+
 void npf_udp_cksum(npf_cache_t *npc, struct rte_mbuf *nbuf);
 void npf_tcp_cksum(npf_cache_t *npc, struct rte_mbuf *nbuf);
 void npf_ipv4_cksum(struct rte_mbuf *nbuf, int proto, char *l4hdr);
@@ -25,6 +25,7 @@
 #include "commands.h"
 #include "compiler.h"
 #include "config.h"
+#include "main.h"
 #include "npf/npf.h"
 #include "npf/alg/npf_alg_public.h"
 #include "npf/config/npf_attach_point.h"
@@ -36,9 +37,11 @@
 #include "npf/npf_addrgrp.h"
 #include "npf/npf_cache.h"
 #include "npf/npf_cmd.h"
+#include "npf/npf_flow_cache.h"
 #include "npf/npf_rule_gen.h"
 #include "npf/npf_session.h"
 #include "npf/npf_state.h"
+#include "npf/npf_syncookie.h"
 #include "npf/npf_timeouts.h"
 #include "npf/rproc/npf_ext_session_limit.h"
 #include "util.h"
@@ -254,6 +257,94 @@ end:
 	return rc;
 }
 
+/*
+ * Replace the entries of an address-group with those from a file
+ *
+ *   npf fw table load <name> <file>
+ *
+ * The file has one entry per line, as per "fw table add", i.e. either
+ * "<prefix>" or "<addr1> <addr2>".  Blank lines and lines starting with '#'
+ * are ignored.  If any entry is invalid the address-group is unchanged.
+ */
+static int
+cmd_npf_addrgrp_load(FILE *f, int argc, char **argv)
+{
+	struct npf_addrgrp *staging;
+	npf_netmask_t masklen;
+	npf_addr_t addr1, addr2;
+	sa_family_t af;
+	char *line = NULL;
+	size_t len = 0;
+	uint lineno = 0;
+	FILE *fp;
+	int alen;
+	int rc = 0;
+
+	if (argc < 2) {
+		npf_cmd_err(f, "%s", npf_cmd_str_missing);
+		return -EINVAL;
+	}
+
+	fp = fopen(argv[1], "r");
+	if (!fp) {
+		rc = -errno;
+		npf_cmd_err(f, "failed to open %s (errno %d)", argv[1], -rc);
+		return rc;
+	}
+
+	staging = npf_addrgrp_load_begin(argv[0]);
+	if (!staging) {
+		fclose(fp);
+		npf_cmd_err(f, "Could not create npf address-group \"%s\"",
+			    argv[0]);
+		return -ENOSPC;
+	}
+
+	while (getline(&line, &len, fp) >= 0) {
+		char *saveptr = NULL;
+		char *tok1, *tok2;
+
+		lineno++;
+		tok1 = strtok_r(line, " \t\r\n", &saveptr);
+		if (!tok1 || *tok1 == '#')
+			continue;
+		tok2 = strtok_r(NULL, " \t\r\n", &saveptr);
+
+		rc = cmd_npf_parse_addrgrp_addr(tok1, &af, &addr1, &masklen);
+		if (rc < 0)
+			break;
+		alen = rc;
+
+		if (!tok2) {
+			rc = npf_addrgrp_load_prefix(staging, &addr1, alen,
+						     masklen);
+		} else {
+			rc = cmd_npf_parse_addrgrp_addr(tok2, &af, &addr2,
+							&masklen);
+			if (rc < 0)
+				break;
+			rc = npf_addrgrp_load_range(staging, &addr1, &addr2,
+						    alen);
+		}
+		if (rc < 0)
+			break;
+	}
+	free(line);
+	fclose(fp);
+
+	if (rc < 0) {
+		npf_addrgrp_load_abort(staging);
+		npf_cmd_err(f, "failed to load table item at line %u (errno %d)",
+			    lineno, -rc);
+		return rc;
+	}
+
+	rc = npf_addrgrp_load_commit(argv[0], staging);
+	if (rc < 0)
+		npf_cmd_err(f, "failed to load table (errno %d)", -rc);
+	return rc;
+}
+
 /*
  * Remove an entry from an address-group
  *
@@ -342,6 +433,97 @@ cmd_npf_global_tcp_strict_disable(FILE *f __unused,
 	return 0;
 }
 
+/* "fw global tcp-window full|fast|loose" */
+static int
+cmd_npf_global_tcp_window(FILE *f, int argc, char **argv)
+{
+	if (argc < 1) {
+		npf_cmd_err(f, "%s", npf_cmd_str_missing_arg);
+		return -1;
+	}
+
+	if (!strcmp(argv[0], "full"))
+		npf_state_set_tcp_window(NPF_TCP_WINDOW_FULL);
+	else if (!strcmp(argv[0], "fast"))
+		npf_state_set_tcp_window(NPF_TCP_WINDOW_FAST);
+	else if (!strcmp(argv[0], "loose"))
+		npf_state_set_tcp_window(NPF_TCP_WINDOW_LOOSE);
+	else {
+		npf_cmd_err(f, "invalid tcp-window mode: %s", argv[0]);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+cmd_npf_global_alg_workers(FILE *f, int argc, char **argv)
+{
+	if (argc < 1) {
+		npf_cmd_err(f, "%s", npf_cmd_str_missing_arg);
+		return -1;
+	}
+
+	if (set_alg_workers(argv[0]) < 0) {
+		npf_cmd_err(f, "invalid ALG worker cores: %s", argv[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/* "fw global session-offload <min-age-secs>|off" */
+static int
+cmd_npf_global_session_offload(FILE *f, int argc, char **argv)
+{
+	unsigned long min_age;
+	char *endp;
+
+	if (argc < 1) {
+		npf_cmd_err(f, "%s", npf_cmd_str_missing_arg);
+		return -1;
+	}
+
+	if (!strcmp(argv[0], "off")) {
+		npf_session_offload_set(0);
+		return 0;
+	}
+
+	min_age = strtoul(argv[0], &endp, 10);
+	if (*endp || min_age == 0 || min_age > UINT32_MAX) {
+		npf_cmd_err(f, "invalid session offload age: %s", argv[0]);
+		return -1;
+	}
+
+	npf_session_offload_set(min_age);
+	return 0;
+}
+
+/* "fw global syn-cookies off|<percent of sessions-max>" */
+static int
+cmd_npf_global_syn_cookies(FILE *f, int argc, char **argv)
+{
+	unsigned long pct;
+	char *endp;
+
+	if (argc < 1) {
+		npf_cmd_err(f, "%s", npf_cmd_str_missing_arg);
+		return -1;
+	}
+
+	if (!strcmp(argv[0], "off")) {
+		npf_syncookie_set(0);
+		return 0;
+	}
+
+	pct = strtoul(argv[0], &endp, 10);
+	if (*endp || pct == 0 || pct > 100) {
+		npf_cmd_err(f, "invalid syn-cookies threshold: %s", argv[0]);
+		return -1;
+	}
+
+	npf_syncookie_set(pct);
+	return 0;
+}
+
 static int
 cmd_npf_global_timeout(FILE *f, int argc, char **argv)
 {
@@ -644,6 +826,80 @@ cmd_detach_group(FILE *f, int argc, char **argv)
 	return 0;
 }
 
+/*
+ * classifier <ruleset-type> <grouper|tuple-space>
+ */
+static int
+cmd_classifier(FILE *f, int argc, char **argv)
+{
+	enum npf_ruleset_type ruleset_type;
+	enum npf_classifier classifier;
+	int ret;
+
+	if (argc < 2) {
+		npf_cmd_err(f, "%s", npf_cmd_str_missing);
+		return -1;
+	}
+
+	ret = npf_get_ruleset_type(argv[0], &ruleset_type);
+	if (ret < 0) {
+		npf_cmd_err(f, "invalid ruleset type: %s (%d)", argv[0], ret);
+		return -1;
+	}
+
+	ret = npf_get_classifier(argv[1], &classifier);
+	if (ret < 0) {
+		npf_cmd_err(f, "invalid classifier: %s (%d)", argv[1], ret);
+		return -1;
+	}
+
+	npf_set_ruleset_type_classifier(ruleset_type, classifier);
+	return 0;
+}
+
+/*
+ * <acl|pbr> flow-cache <on|off>
+ */
+static int
+cmd_flow_cache(FILE *f, int argc, char **argv, enum npf_flow_cache_id id)
+{
+	bool enable;
+	int ret;
+
+	if (argc < 1) {
+		npf_cmd_err(f, "%s", npf_cmd_str_missing);
+		return -1;
+	}
+
+	if (!strcmp(argv[0], "on"))
+		enable = true;
+	else if (!strcmp(argv[0], "off"))
+		enable = false;
+	else {
+		npf_cmd_err(f, "invalid flow-cache option: %s", argv[0]);
+		return -1;
+	}
+
+	ret = npf_flow_cache_enable(id, enable);
+	if (ret < 0) {
+		npf_cmd_err(f, "failed to set flow-cache: %s", strerror(-ret));
+		return -1;
+	}
+	return 0;
+}
+
+static int
+cmd_acl_flow_cache(FILE *f, int argc, char **argv)
+{
+	return cmd_flow_cache(f, argc, argv, NPF_FLOW_CACHE_ACL);
+}
+
+static int
+cmd_pbr_flow_cache(FILE *f, int argc, char **argv)
+{
+	return cmd_flow_cache(f, argc, argv, NPF_FLOW_CACHE_PBR);
+}
+
 static int
 cmd_commit(FILE *f, int argc, char **argv __unused)
 {
@@ -653,6 +909,7 @@ cmd_commit(FILE *f, int argc, char **argv __unused)
 	}
 
 	pmf_arlg_commit();
+	npf_addrgrp_commit();
 	npf_cfg_commit_all();
 	return 0;
 }
@@ -663,6 +920,7 @@ enum {
 	FW_TABLE_DELETE,
 	FW_TABLE_ADD,
 	FW_TABLE_REMOVE,
+	FW_TABLE_LOAD,
 	FW_SESSION_LIMIT_PARAM_ADD,
 	FW_SESSION_LIMIT_PARAM_DELETE,
 	FW_SESSIONLOG_ADD,
@@ -672,10 +930,17 @@ enum {
 	FW_GLOBAL_TCPSTRICT_ENABLE,
 	FW_GLOBAL_TCPSTRICT_DISABLE,
 	FW_GLOBAL_TIMEOUT,
+	FW_GLOBAL_TCP_WINDOW,
+	FW_GLOBAL_ALG_WORKERS,
+	FW_GLOBAL_SESSION_OFFLOAD,
+	FW_GLOBAL_SYN_COOKIES,
 	ADD_RULE,
 	DELETE_RULE,
 	ATTACH_GROUP,
 	DETACH_GROUP,
+	CLASSIFIER,
+	ACL_FLOW_CACHE,
+	PBR_FLOW_CACHE,
 	COMMIT,
 	NUM_NPF_CMDS,
 };
@@ -713,6 +978,10 @@ static const struct npf_command npf_cmd_cfg[] = {
 		.tokens = "fw table remove",
 		.handler = cmd_npf_addrgrp_entry_del,
 	},
+	[FW_TABLE_LOAD] = {
+		.tokens = "fw table load",
+		.handler = cmd_npf_addrgrp_load,
+	},
 	[FW_SESSION_LIMIT_PARAM_ADD] = {
 		.tokens = "fw session-limit param add",
 		.handler = cmd_npf_sess_limit_param_add,
@@ -749,6 +1018,22 @@ static const struct npf_command npf_cmd_cfg[] = {
 		.tokens = "fw global timeout",
 		.handler = cmd_npf_global_timeout,
 	},
+	[FW_GLOBAL_TCP_WINDOW] = {
+		.tokens = "fw global tcp-window",
+		.handler = cmd_npf_global_tcp_window,
+	},
+	[FW_GLOBAL_ALG_WORKERS] = {
+		.tokens = "fw global alg-workers",
+		.handler = cmd_npf_global_alg_workers,
+	},
+	[FW_GLOBAL_SESSION_OFFLOAD] = {
+		.tokens = "fw global session-offload",
+		.handler = cmd_npf_global_session_offload,
+	},
+	[FW_GLOBAL_SYN_COOKIES] = {
+		.tokens = "fw global syn-cookies",
+		.handler = cmd_npf_global_syn_cookies,
+	},
 	[ADD_RULE] = {
 		.tokens = "add",
 		.handler = cmd_add_rule,
@@ -765,6 +1050,18 @@ static const struct npf_command npf_cmd_cfg[] = {
 		.tokens = "detach",
 		.handler = cmd_detach_group,
 	},
+	[CLASSIFIER] = {
+		.tokens = "classifier",
+		.handler = cmd_classifier,
+	},
+	[ACL_FLOW_CACHE] = {
+		.tokens = "acl flow-cache",
+		.handler = cmd_acl_flow_cache,
+	},
+	[PBR_FLOW_CACHE] = {
+		.tokens = "pbr flow-cache",
+		.handler = cmd_pbr_flow_cache,
+	},
 	[COMMIT] = {
 		.tokens = "commit",
 		.handler = cmd_commit,
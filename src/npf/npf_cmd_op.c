@@ -22,6 +22,7 @@
 #include "control.h"
 #include "compiler.h"
 #include "npf/alg/npf_alg_public.h"
+#include "npf/alg/npf_alg_worker.h"
 #include "npf/config/npf_attach_point.h"
 #include "npf/config/npf_config.h"
 #include "npf/config/npf_config_state.h"
@@ -106,6 +107,31 @@ cmd_acl_clear_counters(FILE *f, int argc, char **argv)
 	return pmf_arlg_cmd_clear_counters(ifname, dir, rgname);
 }
 
+/*
+ * profile <on|off>
+ *
+ * Count how often each rule's n-code is run, and the cycles spent running
+ * it.  The counts are shown with the rule's packet and byte counts.
+ */
+static int
+cmd_npf_profile(FILE *f, int argc, char **argv)
+{
+	if (argc < 1) {
+		npf_cmd_err(f, "%s", npf_cmd_str_missing_arg);
+		return -1;
+	}
+
+	if (strcmp(argv[0], "on") == 0)
+		npf_rule_set_profiling(true);
+	else if (strcmp(argv[0], "off") == 0)
+		npf_rule_set_profiling(false);
+	else {
+		npf_cmd_err(f, "invalid profile option: %s", argv[0]);
+		return -1;
+	}
+	return 0;
+}
+
 static int
 cmd_dump_portmap(FILE *f, int argc __unused, char **argv __unused)
 {
@@ -127,6 +153,13 @@ cmd_dump_alg(FILE *f, int argc __unused, char **argv __unused)
 	return 0;
 }
 
+static int
+cmd_show_alg_workers(FILE *f, int argc __unused, char **argv __unused)
+{
+	npf_alg_worker_dump(f);
+	return 0;
+}
+
 static int
 cmd_dump_groups(FILE *f, int argc __unused, char **argv __unused)
 {
@@ -483,6 +516,10 @@ cmd_reset_config(FILE *f, int argc, char **argv)
 			npf_state_set_tcp_strict(false);
 			continue;
 		}
+		if (strcmp(argv[0], "tcp-window") == 0) {
+			npf_state_set_tcp_window(NPF_TCP_WINDOW_FULL);
+			continue;
+		}
 		if (strcmp(argv[0], "session-log") == 0) {
 			npf_reset_session_log();
 			continue;
@@ -517,10 +554,12 @@ enum {
 	PORTMAP_CLEAR,
 	PORTMAP_DUMP,
 	DUMPALG,
+	SHOW_ALG_WORKERS,
 	DUMP_GROUPS,
 	DUMP_ACLS,
 	DUMP_ATTACH_POINTS,
 	SHOW_STATE,
+	PROFILE,
 	SHOW,
 	CLEAR,
 	FLUSH,
@@ -577,6 +616,10 @@ static const struct npf_command npf_cmd_op[] = {
 		.tokens = "fw dump-alg",
 		.handler = cmd_dump_alg,
 	},
+	[SHOW_ALG_WORKERS] = {
+		.tokens = "fw show alg-workers",
+		.handler = cmd_show_alg_workers,
+	},
 	[DUMP_GROUPS] = {
 		.tokens = "dump groups",
 		.handler = cmd_dump_groups,
@@ -593,6 +636,10 @@ static const struct npf_command npf_cmd_op[] = {
 		.tokens = "state",
 		.handler = cmd_show_ruleset_state,
 	},
+	[PROFILE] = {
+		.tokens = "profile",
+		.handler = cmd_npf_profile,
+	},
 	[SHOW] = {
 		.tokens = "show",
 		.handler = cmd_show_rulesets,
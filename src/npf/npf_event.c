@@ -6,6 +6,16 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#include <rte_branch_prediction.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_timer.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+
 #include "if_var.h"
 #include "dp_event.h"
 
@@ -13,6 +23,8 @@
 #include "npf/npf_if.h"
 #include "npf/npf_vrf.h"
 #include "npf_shim.h"
+#include "util.h"
+#include "vplane_log.h"
 
 
 static const struct dp_event_ops npf_event_ops = {
@@ -26,7 +38,130 @@ static const struct dp_event_ops npf_event_ops = {
 	.vrf_delete = npf_vrf_delete,
 };
 
+/* Events queued per lcore, and how often they are delivered */
+#define NPF_EVENT_QUEUE_SIZE	1024
+#define NPF_EVENT_QUEUE_MASK	(NPF_EVENT_QUEUE_SIZE - 1)
+#define NPF_EVENT_INTERVAL_MS	100
+
+/*
+ * Single producer (the lcore) single consumer (the master thread) ring.
+ */
+struct npf_event_queue {
+	uint32_t		eq_head;	/* written by the lcore */
+	uint32_t		eq_dropped;
+	uint32_t		eq_tail __rte_cache_aligned;
+	uint32_t		eq_dropped_seen;
+	struct npf_event	eq_ev[NPF_EVENT_QUEUE_SIZE];
+};
+
+static struct npf_event_queue *npf_event_queues[RTE_MAX_LCORE];
+static npf_event_handler_t *npf_event_handlers[NPF_EVENT_TYPE_COUNT];
+static struct rte_timer npf_event_timer;
+
+bool npf_event_post(const struct npf_event *ev)
+{
+	struct npf_event_queue *q = npf_event_queues[dp_lcore_id()];
+	uint32_t head;
+
+	if (unlikely(!q))
+		return false;
+
+	head = q->eq_head;
+	if (unlikely(head - CMM_LOAD_SHARED(q->eq_tail) >=
+		     NPF_EVENT_QUEUE_SIZE)) {
+		CMM_STORE_SHARED(q->eq_dropped, q->eq_dropped + 1);
+		return false;
+	}
+
+	q->eq_ev[head & NPF_EVENT_QUEUE_MASK] = *ev;
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(q->eq_head, head + 1);
+	return true;
+}
+
+static void npf_event_queue_flush(struct npf_event_queue *q,
+				  unsigned int lcore)
+{
+	uint32_t head = CMM_LOAD_SHARED(q->eq_head);
+	uint32_t tail = q->eq_tail;
+	uint32_t dropped;
+
+	cmm_smp_rmb();
+	for (; tail != head; tail++) {
+		const struct npf_event *ev = &q->eq_ev[tail &
+						       NPF_EVENT_QUEUE_MASK];
+		npf_event_handler_t *fn = npf_event_handlers[ev->ev_type];
+
+		if (fn)
+			fn(ev);
+	}
+
+	/* Finish with the slots before the lcore can reuse them */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(q->eq_tail, tail);
+
+	dropped = CMM_LOAD_SHARED(q->eq_dropped);
+	if (unlikely(dropped != q->eq_dropped_seen)) {
+		RTE_LOG(NOTICE, FIREWALL,
+			"npf events: lcore %u dropped %u events\n",
+			lcore, dropped - q->eq_dropped_seen);
+		q->eq_dropped_seen = dropped;
+	}
+}
+
+void npf_event_flush(void)
+{
+	unsigned int i;
+
+	FOREACH_DP_LCORE(i) {
+		if (npf_event_queues[i])
+			npf_event_queue_flush(npf_event_queues[i], i);
+	}
+}
+
+static void npf_event_timer_cb(struct rte_timer *timer __rte_unused,
+			       void *arg __rte_unused)
+{
+	npf_event_flush();
+}
+
+bool npf_event_subscribed(enum npf_event_type type)
+{
+	return CMM_LOAD_SHARED(npf_event_handlers[type]) != NULL;
+}
+
+void npf_event_subscribe(enum npf_event_type type, npf_event_handler_t *fn)
+{
+	unsigned int i;
+
+	if (fn) {
+		/* Never freed, as an lcore may be posting at any time */
+		FOREACH_DP_LCORE(i) {
+			if (npf_event_queues[i])
+				continue;
+			npf_event_queues[i] = zmalloc_aligned(
+				sizeof(struct npf_event_queue));
+			if (!npf_event_queues[i]) {
+				RTE_LOG(ERR, FIREWALL,
+					"npf events: no memory for lcore %u\n",
+					i);
+				return;
+			}
+		}
+
+		if (!rte_timer_pending(&npf_event_timer))
+			rte_timer_reset(&npf_event_timer,
+					NPF_EVENT_INTERVAL_MS *
+					rte_get_timer_hz() / 1000,
+					PERIODICAL, rte_get_master_lcore(),
+					npf_event_timer_cb, NULL);
+	}
+
+	CMM_STORE_SHARED(npf_event_handlers[type], fn);
+}
+
 void npf_event_init(void)
 {
 	dp_event_register(&npf_event_ops);
+	rte_timer_init(&npf_event_timer);
 }
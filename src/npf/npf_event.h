@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2018, AT&T Intellectual Property.  All rights reserved.
+ * Copyright (c) 2017-2019, AT&T Intellectual Property.  All rights reserved.
  * Copyright (c) 2015-2016 by Brocade Communications Systems, Inc.
  * All rights reserved.
  *
@@ -9,6 +9,69 @@
 #ifndef NPF_EVENT_H
 #define NPF_EVENT_H
 
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+
 void npf_event_init(void);
 
+/*
+ * Deferred events.
+ *
+ * Events raised on a forwarding thread for subscribers that need not
+ * run in the packet path, such as logging.  The event is copied to a
+ * queue of the raising lcore and delivered to the subscriber of its
+ * type in batches on the master thread.  Events are dropped, and
+ * counted, if the queue is full.
+ */
+enum npf_event_type {
+	NPF_EVENT_SESSION_STATE,
+	NPF_EVENT_TYPE_COUNT
+};
+
+/* A session has changed state */
+struct npf_event_session_state {
+	uint64_t	ss_id;
+	uint32_t	ss_if_index;
+	int		ss_timeout;
+	uint8_t		ss_af;
+	uint8_t		ss_proto;
+	uint8_t		ss_proto_idx;
+	uint8_t		ss_state;
+	uint16_t	ss_sid;
+	uint16_t	ss_did;
+	struct in6_addr	ss_saddr;
+	struct in6_addr	ss_daddr;
+	bool		ss_dpi;
+	uint32_t	ss_dpi_app_name;
+	uint32_t	ss_dpi_app_proto;
+};
+
+struct npf_event {
+	enum npf_event_type	ev_type;
+	union {
+		struct npf_event_session_state	ev_session_state;
+	};
+};
+
+typedef void (npf_event_handler_t)(const struct npf_event *ev);
+
+/*
+ * Set the subscriber for events of a type.  Called on the master
+ * thread; NULL unsubscribes.
+ */
+void npf_event_subscribe(enum npf_event_type type, npf_event_handler_t *fn);
+
+/* Is there a subscriber for events of a type? */
+bool npf_event_subscribed(enum npf_event_type type);
+
+/*
+ * Queue an event for delivery on the master thread.  Returns false
+ * if it was dropped.
+ */
+bool npf_event_post(const struct npf_event *ev);
+
+/* Deliver the events queued so far.  Called on the master thread. */
+void npf_event_flush(void);
+
 #endif /* NPF_EVENT_H */
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#include <errno.h>
+#include <rte_branch_prediction.h>
+#include <rte_jhash.h>
+#include <rte_lcore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <urcu/system.h>
+
+#include "compiler.h"
+#include "npf/npf_cache.h"
+#include "npf/npf_flow_cache.h"
+#include "npf/npf_ruleset.h"
+#include "util.h"
+
+/* Direct mapped, one cache line per entry */
+#define NPF_FLOW_CACHE_SIZE	1024
+#define NPF_FLOW_CACHE_MASK	(NPF_FLOW_CACHE_SIZE - 1)
+
+struct npf_flow_cache_ent {
+	uint64_t	fc_gen;		/* ruleset generation, 0 is empty */
+	npf_rule_t	*fc_rule;
+	uint8_t		fc_dir;
+	uint8_t		fc_len;
+	uint8_t		fc_key[NPC_GPR_SIZE_v6];
+} __rte_cache_aligned;
+
+/* Bit per enabled cache */
+static uint8_t npf_flow_cache_enabled;
+static struct npf_flow_cache_ent *
+npf_flow_cache[NPF_FLOW_CACHE_COUNT][RTE_MAX_LCORE];
+
+int npf_flow_cache_enable(enum npf_flow_cache_id id, bool enable)
+{
+	uint8_t enabled = npf_flow_cache_enabled;
+	unsigned int i;
+
+	if (enable) {
+		FOREACH_DP_LCORE(i) {
+			if (npf_flow_cache[id][i])
+				continue;
+			npf_flow_cache[id][i] = zmalloc_aligned(
+				NPF_FLOW_CACHE_SIZE *
+				sizeof(struct npf_flow_cache_ent));
+			if (!npf_flow_cache[id][i])
+				return -ENOMEM;
+		}
+		enabled |= 1 << id;
+	} else
+		enabled &= ~(1 << id);
+
+	/*
+	 * The per-lcore tables are never freed, so that a forwarding
+	 * thread which has just seen the cache enabled can keep using it.
+	 */
+	CMM_STORE_SHARED(npf_flow_cache_enabled, enabled);
+	return 0;
+}
+
+static ALWAYS_INLINE int npf_flow_cache_id(const npf_ruleset_t *rs)
+{
+	switch (npf_type_of_ruleset(rs)) {
+	case NPF_RS_ACL_IN:
+	case NPF_RS_ACL_OUT:
+		return NPF_FLOW_CACHE_ACL;
+	case NPF_RS_PBR:
+		return NPF_FLOW_CACHE_PBR;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Only whole, non-fragment packets have a complete key.
+ */
+static ALWAYS_INLINE struct npf_flow_cache_ent *
+npf_flow_cache_slot(const npf_ruleset_t *rs, const npf_cache_t *npc,
+		    int dir, uint64_t *gen, uint8_t *len)
+{
+	struct npf_flow_cache_ent *cache;
+	uint8_t enabled = CMM_LOAD_SHARED(npf_flow_cache_enabled);
+	int id;
+
+	if (likely(!enabled))
+		return NULL;
+
+	id = npf_flow_cache_id(rs);
+	if (id < 0 || !(enabled & (1 << id)))
+		return NULL;
+
+	if (!npf_ruleset_flow_cacheable(rs, gen))
+		return NULL;
+
+	if (!npf_iscached(npc, NPC_GROUPER) || npf_iscached(npc, NPC_IPFRAG))
+		return NULL;
+
+	cache = npf_flow_cache[id][dp_lcore_id()];
+	if (unlikely(!cache))
+		return NULL;
+
+	*len = npf_iscached(npc, NPC_IP4) ? NPC_GPR_SIZE_v4 : NPC_GPR_SIZE_v6;
+
+	return &cache[rte_jhash(npc->npc_grouper, *len, *gen ^ dir) &
+		      NPF_FLOW_CACHE_MASK];
+}
+
+bool npf_flow_cache_lookup(const npf_ruleset_t *rs, const npf_cache_t *npc,
+			   int dir, npf_rule_t **rlp)
+{
+	struct npf_flow_cache_ent *ent;
+	uint64_t gen;
+	uint8_t len;
+
+	ent = npf_flow_cache_slot(rs, npc, dir, &gen, &len);
+	if (!ent)
+		return false;
+
+	if (ent->fc_gen != gen || ent->fc_dir != dir || ent->fc_len != len ||
+	    memcmp(ent->fc_key, npc->npc_grouper, len) != 0)
+		return false;
+
+	*rlp = ent->fc_rule;
+	return true;
+}
+
+void npf_flow_cache_insert(const npf_ruleset_t *rs, const npf_cache_t *npc,
+			   int dir, npf_rule_t *rl)
+{
+	struct npf_flow_cache_ent *ent;
+	uint64_t gen;
+	uint8_t len;
+
+	ent = npf_flow_cache_slot(rs, npc, dir, &gen, &len);
+	if (!ent)
+		return;
+
+	ent->fc_gen = gen;
+	ent->fc_rule = rl;
+	ent->fc_dir = dir;
+	ent->fc_len = len;
+	memcpy(ent->fc_key, npc->npc_grouper, len);
+}
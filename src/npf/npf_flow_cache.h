@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef NPF_FLOW_CACHE_H
+#define NPF_FLOW_CACHE_H
+
+#include <stdbool.h>
+
+#include "npf/npf_ruleset.h"
+
+typedef struct npf_cache npf_cache_t;
+
+/*
+ * Per-lcore cache of stateless ruleset verdicts.
+ *
+ * Maps the grouper key of a packet (protocol, addresses, and ports or
+ * ICMP type/code) to the rule returned by npf_ruleset_inspect().  Entries
+ * are tagged with the ruleset generation, so any ruleset change
+ * invalidates them without the cache having to be flushed.
+ *
+ * Each feature has its own cache, chosen by the type of the ruleset,
+ * so that one feature's flows do not evict another's.  Rulesets of
+ * other types are never cached.
+ */
+enum npf_flow_cache_id {
+	NPF_FLOW_CACHE_ACL,
+	NPF_FLOW_CACHE_PBR,
+	NPF_FLOW_CACHE_COUNT
+};
+
+/**
+ * Enable or disable a cache.  Must be called from the main thread.
+ *
+ * @param id The cache
+ * @param enable true to enable
+ * @return returns 0 on success and a negative errno on failure
+ */
+int npf_flow_cache_enable(enum npf_flow_cache_id id, bool enable);
+
+/**
+ * Look up a packet in the cache.
+ *
+ * @param rs The ruleset being inspected
+ * @param npc The packet cache
+ * @param dir The direction, PFIL_IN or PFIL_OUT
+ * @param rlp Set to the cached rule (NULL if unmatched) on a hit
+ * @return returns true on a hit
+ */
+bool npf_flow_cache_lookup(const npf_ruleset_t *rs, const npf_cache_t *npc,
+			   int dir, npf_rule_t **rlp);
+
+/**
+ * Record the result of npf_ruleset_inspect() for a packet whose lookup
+ * missed.
+ */
+void npf_flow_cache_insert(const npf_ruleset_t *rs, const npf_cache_t *npc,
+			   int dir, npf_rule_t *rl);
+
+#endif /* NPF_FLOW_CACHE_H */
@@ -22,6 +22,7 @@
 
 #include "compiler.h"
 #include "if_var.h"
+#include "master.h"
 #include "npf/config/npf_attach_point.h"
 #include "npf/config/npf_config.h"
 #include "npf/config/npf_ruleset_type.h"
@@ -605,8 +606,8 @@ npf_if_apev_if_del_rlset(enum npf_attpt_ev_type ev __unused,
 void npf_if_init(void)
 {
 	rte_timer_init(&npf_if_timer);
-	rte_timer_reset(&npf_if_timer, NPF_IF_GC * rte_get_timer_hz(),
-			PERIODICAL, rte_get_master_lcore(), npf_if_gc, NULL);
+	master_aging_timer_reset(&npf_if_timer, NPF_IF_GC * rte_get_timer_hz(),
+				 npf_if_gc, NULL);
 
 	npf_attpt_ev_listen(NPF_ATTACH_TYPE_INTERFACE,
 			    (1 << NPF_ATTPT_EV_RLSET_ADD_COMMIT),
@@ -15,6 +15,9 @@
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 #include <netinet/ip_icmp.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <rte_atomic.h>
 #include <rte_branch_prediction.h>
 #include <rte_ether.h>
 #include <rte_log.h>
@@ -61,6 +64,23 @@ struct nat64_sess_stats {
 #define NAT64_STATS_SIZE	(sizeof(struct nat64_sess_stats) *	\
 				 (get_lcore_max() + 1))
 
+/*
+ * Translation for one direction of a nat64 session.
+ *
+ * Filled in from the peer session by the first packet translated in that
+ * direction.  After that the peer session is not consulted, and the TCP/UDP
+ * checksum is adjusted by the cached pseudo-header and port delta rather
+ * than being recomputed over the whole payload.
+ */
+struct nat64_xlate {
+	npf_addr_t		nx_saddr;
+	npf_addr_t		nx_daddr;
+	uint16_t		nx_sid;
+	uint16_t		nx_did;
+	uint16_t		nx_cksum_delta;
+	bool			nx_valid;
+};
+
 /*
  * NAT64 session data
  *
@@ -88,6 +108,9 @@ struct npf_nat64 {
 	/* session stats - per-core arrays */
 	struct nat64_sess_stats	*n64_stats_in;
 	struct nat64_sess_stats	*n64_stats_out;
+
+	/* Cached translations, indexed by npf_session_forward_dir */
+	struct nat64_xlate	n64_xlate[2];
 };
 
 npf_rule_t *
@@ -324,22 +347,92 @@ nat64_get_map_v6(uint16_t *id, struct nat64_map *nm, npf_addr_t *v6_addr,
 	return 0;
 }
 
+/*
+ * Accumulate the 16-bit words of 'data' into a ones-complement sum, or
+ * subtract them if 'sub' is set (RFC 1624).
+ */
+static inline uint32_t
+nat64_cksum_acc(uint32_t sum, const void *data, uint len, bool sub)
+{
+	const uint16_t *w = data;
+	uint i;
+
+	for (i = 0; i < len / 2; i++)
+		sum += sub ? (uint16_t)~w[i] : w[i];
+
+	return sum;
+}
+
+static inline uint16_t
+nat64_cksum_fold(uint32_t sum)
+{
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return sum;
+}
+
+/*
+ * Apply a cached checksum delta to a TCP or UDP header.  The pseudo-header
+ * length and protocol fields sum the same for IPv4 and IPv6, so only the
+ * addresses and ports contribute to the delta.
+ *
+ * Returns false if the checksum must be computed in full instead, e.g. an
+ * IPv4 UDP packet without a checksum, or one left to the hardware.
+ */
+static bool
+nat64_l4_cksum_adjust(struct rte_mbuf *m, uint16_t proto, char *l4hdr,
+		      uint16_t delta)
+{
+	uint16_t *cksum;
+
+	if (npf_l4_cksum_offloaded(m))
+		return false;
+
+	switch (proto) {
+	case IPPROTO_TCP:
+		cksum = &((struct tcphdr *)l4hdr)->check;
+		break;
+	case IPPROTO_UDP:
+		cksum = &((struct udphdr *)l4hdr)->check;
+		if (*cksum == 0)
+			return false;
+		break;
+	default:
+		return false;
+	}
+
+	*cksum = ~nat64_cksum_fold((uint16_t)~*cksum + delta);
+
+	/* Do not encode the 'no checksum' value */
+	if (proto == IPPROTO_UDP && *cksum == 0)
+		*cksum = 0xffff;
+
+	return true;
+}
+
 /*
  * Conversion utility to go from v4 to v6 space. Only supports tcp/udp and
  * icmp echos.
  */
 static bool
 npf_4to6_convert(struct rte_mbuf **m, npf_cache_t *npc,
-		 npf_addr_t *src, uint16_t sid,
-		 npf_addr_t *dst, uint16_t did)
+		 struct nat64_xlate *nx)
 {
 	if (!*m || !npc)
 		return false;
 
+	/* Ports and ids are rewritten */
+	pktmbuf_mdata_clear(*m, PKT_MDATA_L4);
+
 	struct iphdr *ip = iphdr(*m);
 	uint16_t proto = npf_cache_ipproto(npc);
 	uint16_t ttl = ip->ttl;
 	uint hlen = npf_cache_hlen(npc);
+	uint32_t sum = 0;
+
+	/* Old addresses are overwritten below, so take them into account now */
+	if (!nx->nx_valid)
+		sum = nat64_cksum_acc(sum, &ip->saddr, 8, true);
 
 	/* ip->tot_len is length of packet, including IP header */
 	uint32_t data_len = ntohs(ip->tot_len) - hlen;
@@ -387,8 +480,15 @@ npf_4to6_convert(struct rte_mbuf **m, npf_cache_t *npc,
 	{
 		struct tcphdr *th = (struct tcphdr *)l4hdr;
 
-		th->th_sport = sid;
-		th->th_dport = did;
+		if (!nx->nx_valid) {
+			sum = nat64_cksum_acc(sum, &th->th_sport, 4, true);
+			sum = nat64_cksum_acc(sum, &nx->nx_saddr, 16, false);
+			sum = nat64_cksum_acc(sum, &nx->nx_daddr, 16, false);
+			sum = nat64_cksum_acc(sum, &nx->nx_sid, 4, false);
+			nx->nx_cksum_delta = nat64_cksum_fold(sum);
+		}
+		th->th_sport = nx->nx_sid;
+		th->th_dport = nx->nx_did;
 		break;
 	}
 	case IPPROTO_ICMP:
@@ -401,16 +501,22 @@ npf_4to6_convert(struct rte_mbuf **m, npf_cache_t *npc,
 
 		icmp->icmp6_type = v6_icmp;
 		icmp->icmp6_code = 0;
-		icmp->icmp6_id = sid;
+		icmp->icmp6_id = nx->nx_sid;
 		break;
 	}
 
 	ip6->ip6_nxt = proto;
-	memcpy(&ip6->ip6_src, src, 16);
-	memcpy(&ip6->ip6_dst, dst, 16);
+	memcpy(&ip6->ip6_src, &nx->nx_saddr, 16);
+	memcpy(&ip6->ip6_dst, &nx->nx_daddr, 16);
 
-	/* now recompute checksum */
-	npf_ipv6_cksum(*m, proto, l4hdr);
+	if (!nx->nx_valid) {
+		rte_smp_wmb();
+		nx->nx_valid = true;
+	}
+
+	/* Adjust or recompute the L4 checksum */
+	if (!nat64_l4_cksum_adjust(*m, proto, l4hdr, nx->nx_cksum_delta))
+		npf_ipv6_cksum(*m, proto, l4hdr);
 
 	return true;
 }
@@ -421,16 +527,23 @@ npf_4to6_convert(struct rte_mbuf **m, npf_cache_t *npc,
  */
 static bool
 npf_6to4_convert(struct rte_mbuf **m, npf_cache_t *npc,
-		 uint32_t v4_saddr, uint16_t sid,
-		 uint32_t v4_daddr, uint16_t did)
+		 struct nat64_xlate *nx)
 {
 	if (!*m || !npc)
 		return false;
 
+	/* Ports and ids are rewritten */
+	pktmbuf_mdata_clear(*m, PKT_MDATA_L4);
+
 	struct ip6_hdr *ip6 = ip6hdr(*m);
 	uint16_t proto = npf_cache_ipproto(npc);
 	uint16_t hlim = ip6->ip6_hlim;
 	uint hlen = npf_cache_hlen(npc);
+	uint32_t sum = 0;
+
+	/* Old addresses are overwritten below, so take them into account now */
+	if (!nx->nx_valid)
+		sum = nat64_cksum_acc(sum, &ip6->ip6_src, 32, true);
 
 	/*
 	 * ip6_plen is length of packet, including extension hdrs,
@@ -485,8 +598,15 @@ npf_6to4_convert(struct rte_mbuf **m, npf_cache_t *npc,
 	{
 		struct tcphdr *th = (struct tcphdr *)l4hdr;
 
-		th->th_sport = sid;
-		th->th_dport = did;
+		if (!nx->nx_valid) {
+			sum = nat64_cksum_acc(sum, &th->th_sport, 4, true);
+			sum = nat64_cksum_acc(sum, &nx->nx_saddr, 4, false);
+			sum = nat64_cksum_acc(sum, &nx->nx_daddr, 4, false);
+			sum = nat64_cksum_acc(sum, &nx->nx_sid, 4, false);
+			nx->nx_cksum_delta = nat64_cksum_fold(sum);
+		}
+		th->th_sport = nx->nx_sid;
+		th->th_dport = nx->nx_did;
 		break;
 	}
 	case IPPROTO_ICMPV6:
@@ -499,20 +619,26 @@ npf_6to4_convert(struct rte_mbuf **m, npf_cache_t *npc,
 
 		icmp->icmp_type = v4_icmp;
 		icmp->icmp_code = 0;
-		icmp->icmp_id = sid;
+		icmp->icmp_id = nx->nx_sid;
 		break;
 	}
 
 	ip->protocol = proto;
-	ip->saddr = v4_saddr;
-	ip->daddr = v4_daddr;
+	ip->saddr = nx->nx_saddr.s6_addr32[0];
+	ip->daddr = nx->nx_daddr.s6_addr32[0];
+
+	if (!nx->nx_valid) {
+		rte_smp_wmb();
+		nx->nx_valid = true;
+	}
 
 	/* now recompute checksum */
 	ip->check = 0;
-	ip->check = in_cksum(ip, sizeof(struct iphdr));
+	ip->check = ip_checksum(ip, sizeof(struct iphdr));
 
-	/* now fixup proto cksums */
-	npf_ipv4_cksum(*m, proto, l4hdr);
+	/* Adjust or recompute the L4 checksum */
+	if (!nat64_l4_cksum_adjust(*m, proto, l4hdr, nx->nx_cksum_delta))
+		npf_ipv4_cksum(*m, proto, l4hdr);
 
 	return true;
 }
@@ -880,6 +1006,41 @@ npf_nat64_session_json(json_writer_t *json, npf_session_t *se)
 	jsonw_end_object(json);
 }
 
+/*
+ * Fill in a nat64 translation from the addrs and IDs of the peer session.
+ * The checksum delta is added, and the translation marked valid, by the
+ * first packet that is converted with it.
+ */
+static int
+nat64_xlate_from_peer(struct nat64_xlate *nx, npf_session_t *peer,
+		      bool forw, int peer_af)
+{
+	npf_addr_t *src, *dst;
+	uint32_t if_index;
+	int rc, af;
+
+	if (forw)
+		rc = npf_session_sentry_extract(peer, &if_index, &af,
+						&src, &nx->nx_sid,
+						&dst, &nx->nx_did);
+	else
+		rc = npf_session_sentry_extract(peer, &if_index, &af,
+						&dst, &nx->nx_did,
+						&src, &nx->nx_sid);
+
+	if (rc || af != peer_af)
+		return -EINVAL;
+
+	if (af == AF_INET) {
+		nx->nx_saddr.s6_addr32[0] = src->s6_addr32[0];
+		nx->nx_daddr.s6_addr32[0] = dst->s6_addr32[0];
+	} else {
+		nx->nx_saddr = *src;
+		nx->nx_daddr = *dst;
+	}
+	return 0;
+}
+
 /*
  * v6-to-v4 Ingress.  Packet is v6.
  *
@@ -912,14 +1073,13 @@ npf_nat64_6to4_in(npf_action_t *action, const struct npf_config *npf_config,
 		  struct rte_mbuf **m, uint16_t *npf_flag)
 {
 	npf_decision_t decision = NPF_DECISION_PASS;
-	npf_addr_t saddr = NPF_ADDR_ZERO, daddr = NPF_ADDR_ZERO;
-	npf_addr_t *src = &saddr, *dst = &daddr;
+	struct nat64_xlate lnx = { .nx_valid = false };
+	struct nat64_xlate *nx = &lnx;
 	npf_session_t *se6 = *sep;
 	npf_session_t *se4 = NULL;
 	struct npf_nat64 *n64;
 	npf_rule_t *rl = NULL;
 	bool new_flow = false;
-	uint16_t sid, did;
 	int rc;
 
 	/*
@@ -995,7 +1155,7 @@ npf_nat64_6to4_in(npf_action_t *action, const struct npf_config *npf_config,
 		vrfid_t vrfid = npf_session_get_vrfid(se6);
 
 		/* Get src and dst ports from cache */
-		npf_cache_extract_ids(npc, &sid, &did);
+		npf_cache_extract_ids(npc, &lnx.nx_sid, &lnx.nx_did);
 		ip6 = ip6hdr(*m);
 
 		n64 = npf_session_get_nat64(se6);
@@ -1006,18 +1166,18 @@ npf_nat64_6to4_in(npf_action_t *action, const struct npf_config *npf_config,
 		}
 
 		/* Get mapping for v4 src addr */
-		rc = nat64_get_map_v4(n64, rl, &sid, &rproc->n6_src,
-				      saddr.s6_addr32, (char *)&ip6->ip6_src,
-				      vrfid);
+		rc = nat64_get_map_v4(n64, rl, &lnx.nx_sid, &rproc->n6_src,
+				      lnx.nx_saddr.s6_addr32,
+				      (char *)&ip6->ip6_src, vrfid);
 		if (rc) {
 			decision = NPF_DECISION_UNMATCHED;
 			goto error;
 		}
 
 		/* Get mapping for v4 dst addr */
-		rc = nat64_get_map_v4(n64, rl, &did, &rproc->n6_dst,
-				      daddr.s6_addr32, (char *)&ip6->ip6_dst,
-				      vrfid);
+		rc = nat64_get_map_v4(n64, rl, &lnx.nx_did, &rproc->n6_dst,
+				      lnx.nx_daddr.s6_addr32,
+				      (char *)&ip6->ip6_dst, vrfid);
 		if (rc) {
 			decision = NPF_DECISION_UNMATCHED;
 			goto error;
@@ -1035,35 +1195,25 @@ npf_nat64_6to4_in(npf_action_t *action, const struct npf_config *npf_config,
 		new_flow = true;
 	} else {
 		/*
-		 * Session is a nat64 session.  Get v4 addrs from v4 peer
-		 * session.
-		 */
-		uint32_t if_index;
-		bool forw;
-		int rc, af;
-
-		forw = npf_session_forward_dir(se6, PFIL_IN);
-
-		/*
-		 * Extract v4 addrs and IDs from the peer v4 session.
+		 * Session is a nat64 session.  Get v4 addrs from the cached
+		 * translation, else from v4 peer session.
 		 */
-		if (forw)
-			rc = npf_session_sentry_extract(se4, &if_index, &af,
-							&src, &sid, &dst, &did);
-		else
-			rc = npf_session_sentry_extract(se4, &if_index, &af,
-							&dst, &did, &src, &sid);
+		bool forw = npf_session_forward_dir(se6, PFIL_IN);
 
-		if (unlikely(rc || af != AF_INET))
-			return NPF_DECISION_BLOCK;
+		nx = &n64->n64_xlate[forw];
+		if (unlikely(!nx->nx_valid)) {
+			rc = nat64_xlate_from_peer(nx, se4, forw, AF_INET);
+			if (unlikely(rc))
+				return NPF_DECISION_BLOCK;
+		}
+		rte_smp_rmb();
 	}
 
 	/*
 	 * Do the 6-to-4 conversion
 	 */
 	uint64_t bytes = rte_pktmbuf_pkt_len(*m);
-	bool ok = npf_6to4_convert(m, npc, src->s6_addr32[0], sid,
-				   dst->s6_addr32[0], did);
+	bool ok = npf_6to4_convert(m, npc, nx);
 
 	if (likely(ok)) {
 		/*
@@ -1219,14 +1369,13 @@ npf_nat64_4to6_in(npf_action_t *action, const struct npf_config *npf_config,
 		  struct rte_mbuf **m, uint16_t *npf_flag)
 {
 	npf_decision_t decision = NPF_DECISION_PASS;
-	npf_addr_t saddr = NPF_ADDR_ZERO, daddr = NPF_ADDR_ZERO;
-	npf_addr_t *src = &saddr, *dst = &daddr;
+	struct nat64_xlate lnx = { .nx_valid = false };
+	struct nat64_xlate *nx = &lnx;
 	npf_session_t *se4 = *sep;
 	npf_session_t *se6 = NULL;
 	struct npf_nat64 *n64;
 	npf_rule_t *rl = NULL;
 	bool new_flow = false;
-	uint16_t sid, did;
 	int rc;
 
 	/*
@@ -1300,7 +1449,7 @@ npf_nat64_4to6_in(npf_action_t *action, const struct npf_config *npf_config,
 			return NPF_DECISION_BLOCK;
 
 		/* Get src and dst ports from cache */
-		npf_cache_extract_ids(npc, &sid, &did);
+		npf_cache_extract_ids(npc, &lnx.nx_sid, &lnx.nx_did);
 		ip = iphdr(*m);
 
 		n64 = npf_session_get_nat64(se4);
@@ -1311,7 +1460,8 @@ npf_nat64_4to6_in(npf_action_t *action, const struct npf_config *npf_config,
 		}
 
 		/* Get mapping for v4 src addr */
-		rc = nat64_get_map_v6(NULL, &rproc->n6_src, src, ip->saddr);
+		rc = nat64_get_map_v6(NULL, &rproc->n6_src, &lnx.nx_saddr,
+				      ip->saddr);
 		if (rc) {
 			decision = NPF_DECISION_UNMATCHED;
 			goto error;
@@ -1320,7 +1470,8 @@ npf_nat64_4to6_in(npf_action_t *action, const struct npf_config *npf_config,
 		/*
 		 * Get v6 dst addr from the rproc and/or pkt
 		 */
-		rc = nat64_get_map_v6(&did, &rproc->n6_dst, dst, ip->daddr);
+		rc = nat64_get_map_v6(&lnx.nx_did, &rproc->n6_dst,
+				      &lnx.nx_daddr, ip->daddr);
 		if (rc) {
 			decision = NPF_DECISION_UNMATCHED;
 			goto error;
@@ -1338,34 +1489,25 @@ npf_nat64_4to6_in(npf_action_t *action, const struct npf_config *npf_config,
 		new_flow = true;
 	} else {
 		/*
-		 * Session is a nat46 session.  Get v6 addrs from v6 peer
-		 * session.
+		 * Session is a nat46 session.  Get v6 addrs from the cached
+		 * translation, else from v6 peer session.
 		 */
-		uint32_t if_index;
-		bool forw;
-		int rc, af;
-
-		forw = npf_session_forward_dir(se4, PFIL_IN);
+		bool forw = npf_session_forward_dir(se4, PFIL_IN);
 
-		/*
-		 * Extract v6 addrs and IDs from the peer v6 session.
-		 */
-		if (forw)
-			rc = npf_session_sentry_extract(se6, &if_index, &af,
-							&src, &sid, &dst, &did);
-		else
-			rc = npf_session_sentry_extract(se6, &if_index, &af,
-							&dst, &did, &src, &sid);
-
-		if (unlikely(rc || af != AF_INET6))
-			return NPF_DECISION_BLOCK;
+		nx = &n64->n64_xlate[forw];
+		if (unlikely(!nx->nx_valid)) {
+			rc = nat64_xlate_from_peer(nx, se6, forw, AF_INET6);
+			if (unlikely(rc))
+				return NPF_DECISION_BLOCK;
+		}
+		rte_smp_rmb();
 	}
 
 	/*
 	 * Do the 4-to-6 conversion
 	 */
 	uint64_t bytes = rte_pktmbuf_pkt_len(*m);
-	bool ok = npf_4to6_convert(m, npc, src, sid, dst, did);
+	bool ok = npf_4to6_convert(m, npc, nx);
 
 	if (likely(ok)) {
 		/*
@@ -42,16 +42,23 @@
  */
 
 #include <assert.h>
+#include <netinet/in.h>
+#include <rte_common.h>
 #include <rte_ether.h>
 #include <rte_log.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
 
 #include "compiler.h"
 #include "npf/npf.h"
+#include "npf/npf_disassemble.h"
 #include "npf/npf_ncgen.h"
 #include "npf/npf_ncode.h"
+#include "util.h"
 #include "vplane_log.h"
 
 /* Reduce re-allocations by expanding in 64 byte blocks. */
@@ -180,6 +187,430 @@ npf_ncgen_size(nc_ctx_t *ctx)
 	return (uintptr_t)ctx->nc_iptr - (uintptr_t)ctx->nc_buf;
 }
 
+/*
+ * N-code optimisation.
+ *
+ * Generated n-code is a run of blocks, each either a single test and a
+ * BNE to the failure return, or an OR group of tests each with a BEQ
+ * past the group, ended by a RET 1.  Tests only look at the packet, so
+ * the blocks of a rule may be put in any order, as may the tests in a
+ * group.  The blocks are parsed back out of the n-code, and then:
+ *
+ * - a test repeated in the rule, or in a group, is dropped, as is a
+ *   family or protocol test implied by another test of the rule;
+ * - port ranges are merged: overlapping or adjacent ranges in a group,
+ *   and the intersection of ranges on the same port across the rule;
+ * - cheaper blocks are put first, with rproc matches kept last.
+ *
+ * Anything not of the expected shape is left as generated, as is any
+ * result which fails npf_ncode_validate().
+ */
+#define NC_OPT_MAX_TESTS	64
+
+struct nc_opt_test {
+	uint32_t	t_words[1 + NPF_NOPERANDS_MAX];
+	uint32_t	t_nwords;	/* 0 once dropped */
+};
+
+struct nc_opt_block {
+	uint32_t	b_first;	/* index of first test */
+	uint32_t	b_ntests;
+	uint32_t	b_cost;
+};
+
+struct nc_opt {
+	struct nc_opt_test	o_test[NC_OPT_MAX_TESTS];
+	struct nc_opt_block	o_block[NC_OPT_MAX_TESTS];
+	uint32_t		o_ntests;
+	uint32_t		o_nblocks;
+};
+
+/* Rough relative cost of each test */
+static const uint8_t nc_opt_cost[_NPF_OPCODE_LAST] = {
+	[NPF_OPCODE_ADDRFAM]	= 1,
+	[NPF_OPCODE_PROTO]	= 1,
+	[NPF_OPCODE_FRAGMENT]	= 1,
+	[NPF_OPCODE_TTL]	= 2,
+	[NPF_OPCODE_PORTS]	= 2,
+	[NPF_OPCODE_ICMP4]	= 2,
+	[NPF_OPCODE_ICMP6]	= 2,
+	[NPF_OPCODE_TCP_FLAGS]	= 2,
+	[NPF_OPCODE_IP6_RT]	= 2,
+	[NPF_OPCODE_MATCHDSCP]	= 2,
+	[NPF_OPCODE_IP4MASK]	= 3,
+	[NPF_OPCODE_ETHERTYPE]	= 3,
+	[NPF_OPCODE_ETHERPCP]	= 3,
+	[NPF_OPCODE_IP6MASK]	= 4,
+	[NPF_OPCODE_ETHERADDR]	= 4,
+	[NPF_OPCODE_TABLE]	= 8,
+	[NPF_OPCODE_RPROC]	= UINT8_MAX,
+};
+
+static bool
+nc_opt_parse_test(struct nc_opt *o, const uint32_t *w, uint32_t end,
+		  uint32_t *offp)
+{
+	struct nc_opt_test *t;
+	uint32_t off = *offp;
+	uint32_t opcode = w[off];
+
+	if (o->o_ntests == NC_OPT_MAX_TESTS || opcode > NPF_OPCODE_MAX ||
+	    opcode == NPF_OPCODE_RET || opcode == NPF_OPCODE_BEQ ||
+	    opcode == NPF_OPCODE_BNE)
+		return false;
+
+	t = &o->o_test[o->o_ntests++];
+	t->t_nwords = 1 + npf_ncode_opcode_noperands(opcode);
+	if (t->t_nwords > ARRAY_SIZE(t->t_words) || off + t->t_nwords > end)
+		return false;
+
+	memcpy(t->t_words, &w[off], t->t_nwords * sizeof(uint32_t));
+	*offp = off + t->t_nwords;
+	return true;
+}
+
+static bool
+nc_opt_parse(struct nc_opt *o, const uint32_t *w, uint32_t nwords)
+{
+	struct nc_opt_block *b;
+	uint32_t end, fail, off = 0;
+	uint32_t target;
+
+	/* Ends with the success and failure returns */
+	if (nwords < 4)
+		return false;
+	end = nwords - 4;
+	fail = nwords - 2;
+	if (w[end] != NPF_OPCODE_RET || w[end + 1] != 0 ||
+	    w[fail] != NPF_OPCODE_RET || w[fail + 1] != 1)
+		return false;
+
+	while (off < end) {
+		if (o->o_nblocks == NC_OPT_MAX_TESTS)
+			return false;
+		b = &o->o_block[o->o_nblocks++];
+		b->b_first = o->o_ntests;
+		target = 0;
+
+		for (;;) {
+			if (!nc_opt_parse_test(o, w, end, &off) ||
+			    off + 2 > end)
+				return false;
+			b->b_ntests++;
+
+			if (w[off] == NPF_OPCODE_BNE) {
+				if (b->b_ntests != 1 || off + w[off + 1] != fail)
+					return false;
+				off += 2;
+				break;
+			}
+			if (w[off] != NPF_OPCODE_BEQ)
+				return false;
+
+			/* Every test of a group jumps to its end */
+			if (target && off + w[off + 1] != target)
+				return false;
+			target = off + w[off + 1];
+			off += 2;
+
+			if (off + 2 <= end && w[off] == NPF_OPCODE_RET) {
+				if (w[off + 1] != 1 || b->b_ntests < 2 ||
+				    off + 2 != target)
+					return false;
+				off += 2;
+				break;
+			}
+		}
+	}
+	return off == end;
+}
+
+static bool
+nc_opt_test_equal(const struct nc_opt_test *a, const struct nc_opt_test *b)
+{
+	return a->t_nwords && a->t_nwords == b->t_nwords &&
+		!memcmp(a->t_words, b->t_words, a->t_nwords * sizeof(uint32_t));
+}
+
+static bool
+nc_opt_is_ports(const struct nc_opt_test *t)
+{
+	return t->t_nwords && t->t_words[0] == NPF_OPCODE_PORTS &&
+		!NCODE_IS_INVERTED(t->t_words[1]);
+}
+
+/* Widen 'a' to cover 'b' too, if their port ranges meet */
+static bool
+nc_opt_ports_union(struct nc_opt_test *a, const struct nc_opt_test *b)
+{
+	uint32_t alo = a->t_words[2] >> 16, ahi = a->t_words[2] & 0xffff;
+	uint32_t blo = b->t_words[2] >> 16, bhi = b->t_words[2] & 0xffff;
+
+	if (a->t_words[1] != b->t_words[1] || blo > ahi + 1 || alo > bhi + 1)
+		return false;
+
+	a->t_words[2] = (RTE_MIN(alo, blo) << 16) | RTE_MAX(ahi, bhi);
+	return true;
+}
+
+/* Narrow 'a' to where it overlaps 'b', if it does */
+static bool
+nc_opt_ports_intersect(struct nc_opt_test *a, const struct nc_opt_test *b)
+{
+	uint32_t lo = RTE_MAX(a->t_words[2] >> 16, b->t_words[2] >> 16);
+	uint32_t hi = RTE_MIN(a->t_words[2] & 0xffff, b->t_words[2] & 0xffff);
+
+	if (a->t_words[1] != b->t_words[1] || lo > hi)
+		return false;
+
+	a->t_words[2] = (lo << 16) | hi;
+	return true;
+}
+
+/* Does a test of the rule already require what 't' tests for? */
+static bool
+nc_opt_implied(const struct nc_opt_test *t, const struct nc_opt_test *by)
+{
+	if (!by->t_nwords)
+		return false;
+
+	if (t->t_words[0] == NPF_OPCODE_ADDRFAM) {
+		if (t->t_words[1] == AF_INET)
+			return by->t_words[0] == NPF_OPCODE_IP4MASK;
+		if (t->t_words[1] == AF_INET6)
+			return by->t_words[0] == NPF_OPCODE_IP6MASK;
+		return false;
+	}
+	if (t->t_words[0] == NPF_OPCODE_PROTO) {
+		switch (t->t_words[1]) {
+		case IPPROTO_TCP:
+			return by->t_words[0] == NPF_OPCODE_TCP_FLAGS;
+		case IPPROTO_ICMP:
+			return by->t_words[0] == NPF_OPCODE_ICMP4;
+		case IPPROTO_ICMPV6:
+			return by->t_words[0] == NPF_OPCODE_ICMP6;
+		}
+	}
+	return false;
+}
+
+static void
+nc_opt_group(struct nc_opt *o, struct nc_opt_block *b)
+{
+	struct nc_opt_test *ti, *tj;
+	uint32_t i, j;
+	bool merged;
+
+	do {
+		merged = false;
+		for (i = b->b_first; i < b->b_first + b->b_ntests; i++) {
+			ti = &o->o_test[i];
+			for (j = i + 1; ti->t_nwords &&
+				     j < b->b_first + b->b_ntests; j++) {
+				tj = &o->o_test[j];
+				if (nc_opt_test_equal(ti, tj) ||
+				    (nc_opt_is_ports(ti) && nc_opt_is_ports(tj) &&
+				     nc_opt_ports_union(ti, tj))) {
+					tj->t_nwords = 0;
+					merged = true;
+				}
+			}
+		}
+	} while (merged);
+}
+
+/* The test of a block with only one left, which must pass */
+static struct nc_opt_test *
+nc_opt_single(struct nc_opt *o, const struct nc_opt_block *b)
+{
+	struct nc_opt_test *t = NULL;
+	uint32_t k;
+
+	for (k = b->b_first; k < b->b_first + b->b_ntests; k++) {
+		if (!o->o_test[k].t_nwords)
+			continue;
+		if (t)
+			return NULL;
+		t = &o->o_test[k];
+	}
+	return t;
+}
+
+static void
+nc_opt_rule(struct nc_opt *o)
+{
+	struct nc_opt_test *ti, *tj;
+	uint32_t i, j;
+
+	for (i = 0; i < o->o_nblocks; i++) {
+		ti = nc_opt_single(o, &o->o_block[i]);
+
+		for (j = 0; ti && ti->t_nwords && j < o->o_nblocks; j++) {
+			if (j == i)
+				continue;
+			tj = nc_opt_single(o, &o->o_block[j]);
+			if (!tj)
+				continue;
+
+			if (j > i && (nc_opt_test_equal(ti, tj) ||
+				      (nc_opt_is_ports(ti) &&
+				       nc_opt_is_ports(tj) &&
+				       nc_opt_ports_intersect(ti, tj))))
+				tj->t_nwords = 0;
+			else if (nc_opt_implied(ti, tj))
+				ti->t_nwords = 0;
+		}
+	}
+}
+
+/* Stable sort of the blocks by cost, up to the first rproc match */
+static void
+nc_opt_order(struct nc_opt *o)
+{
+	struct nc_opt_block tmp;
+	uint32_t i, j, k, n;
+
+	for (n = 0; n < o->o_nblocks; n++) {
+		struct nc_opt_block *b = &o->o_block[n];
+		bool rproc = false;
+
+		b->b_cost = 0;
+		for (k = b->b_first; k < b->b_first + b->b_ntests; k++) {
+			if (!o->o_test[k].t_nwords)
+				continue;
+			b->b_cost += nc_opt_cost[o->o_test[k].t_words[0]];
+			if (o->o_test[k].t_words[0] == NPF_OPCODE_RPROC)
+				rproc = true;
+		}
+		if (rproc)
+			break;
+	}
+
+	for (i = 1; i < n; i++) {
+		tmp = o->o_block[i];
+		for (j = i; j > 0 && o->o_block[j - 1].b_cost > tmp.b_cost; j--)
+			o->o_block[j] = o->o_block[j - 1];
+		o->o_block[j] = tmp;
+	}
+}
+
+static uint32_t
+nc_opt_block_live(const struct nc_opt *o, const struct nc_opt_block *b,
+		  uint32_t *nwords)
+{
+	uint32_t k, live = 0;
+
+	*nwords = 0;
+	for (k = b->b_first; k < b->b_first + b->b_ntests; k++) {
+		if (o->o_test[k].t_nwords) {
+			live++;
+			*nwords += o->o_test[k].t_nwords + 2;
+		}
+	}
+	if (live > 1)
+		*nwords += 2;	/* RET 1 ending the group */
+	return live;
+}
+
+static uint32_t *
+nc_opt_emit(const struct nc_opt *o, uint32_t *nwordsp)
+{
+	const struct nc_opt_block *b;
+	const struct nc_opt_test *t;
+	uint32_t i, k, len, live, off, group_end;
+	uint32_t nwords = 4;
+	uint32_t fail;
+	uint32_t *w;
+
+	for (i = 0; i < o->o_nblocks; i++) {
+		nc_opt_block_live(o, &o->o_block[i], &len);
+		nwords += len;
+	}
+	fail = nwords - 2;
+
+	w = malloc(nwords * sizeof(uint32_t));
+	if (!w)
+		return NULL;
+
+	for (i = 0, off = 0; i < o->o_nblocks; i++) {
+		b = &o->o_block[i];
+		live = nc_opt_block_live(o, b, &len);
+		group_end = off + len;
+
+		for (k = b->b_first; k < b->b_first + b->b_ntests; k++) {
+			t = &o->o_test[k];
+			if (!t->t_nwords)
+				continue;
+			memcpy(&w[off], t->t_words,
+			       t->t_nwords * sizeof(uint32_t));
+			off += t->t_nwords;
+			if (live == 1) {
+				w[off] = NPF_OPCODE_BNE;
+				w[off + 1] = fail - off;
+			} else {
+				w[off] = NPF_OPCODE_BEQ;
+				w[off + 1] = group_end - off;
+			}
+			off += 2;
+		}
+		if (live > 1) {
+			w[off++] = NPF_OPCODE_RET;
+			w[off++] = 1;
+		}
+	}
+
+	w[off++] = NPF_OPCODE_RET;
+	w[off++] = 0;
+	w[off++] = NPF_OPCODE_RET;
+	w[off++] = 1;
+
+	*nwordsp = nwords;
+	return w;
+}
+
+/*
+ * npf_ncgen_optimize: replace generated n-code with an optimised
+ * equivalent, where there is one.
+ */
+static void
+npf_ncgen_optimize(void **ncp, uint32_t *sz)
+{
+	uint32_t i, nwords;
+	struct nc_opt *o;
+	uint32_t *nc;
+	int errat;
+
+	o = calloc(1, sizeof(*o));
+	if (!o)
+		return;
+
+	if (!nc_opt_parse(o, *ncp, *sz / sizeof(uint32_t)))
+		goto out;
+
+	for (i = 0; i < o->o_nblocks; i++)
+		if (o->o_block[i].b_ntests > 1)
+			nc_opt_group(o, &o->o_block[i]);
+	nc_opt_rule(o);
+	nc_opt_order(o);
+
+	nc = nc_opt_emit(o, &nwords);
+	if (!nc)
+		goto out;
+
+	if (npf_ncode_validate(nc, nwords * sizeof(uint32_t), &errat)) {
+		RTE_LOG(ERR, FIREWALL, "optimised n-code invalid at word %d, "
+			"using it as generated\n", errat);
+		free(nc);
+		goto out;
+	}
+
+	free(*ncp);
+	*ncp = nc;
+	*sz = nwords * sizeof(uint32_t);
+out:
+	free(o);
+}
+
 /*
  * npf_ncgen_complete: complete generation, destroy the context and
  * return a pointer to the final buffer containing n-code.
@@ -222,6 +653,8 @@ npf_ncgen_complete(nc_ctx_t *ctx, uint32_t *sz)
 	*sz = (uintptr_t)ctx->nc_iptr - (uintptr_t)ctx->nc_buf;
 	free(ctx->nc_jmp_list);
 	free(ctx);
+
+	npf_ncgen_optimize(&buf, sz);
 	return buf;
 }
 
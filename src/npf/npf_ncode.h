@@ -44,6 +44,9 @@
 #ifndef NPF_NCODE_H
 #define NPF_NCODE_H
 
+#include <stdbool.h>
+#include <stddef.h>
+
 /* Forward Declarations */
 struct rte_mbuf;
 typedef struct npf_cache npf_cache_t;
@@ -58,6 +61,20 @@ int npf_ncode_process(npf_cache_t *npc, const npf_rule_t *rl,
 		      const struct ifnet *ifp, int dir,
 		      npf_session_t *se, struct rte_mbuf *nbuf);
 int npf_ncode_validate(const void *nc, size_t sz, int *errat);
+bool npf_ncode_flow_invariant(const void *nc, size_t sz);
+
+/*
+ * Pre-decoded n-code, built once per rule and run in place of
+ * npf_ncode_process() when available.
+ */
+struct npf_ncode_prog;
+int npf_ncode_compile(const void *nc, size_t sz,
+		      struct npf_ncode_prog **progp);
+void npf_ncode_prog_free(struct npf_ncode_prog *prog);
+int npf_ncode_exec(const struct npf_ncode_prog *prog,
+		   npf_cache_t *npc, const npf_rule_t *rl,
+		   const struct ifnet *ifp, int dir,
+		   npf_session_t *se, struct rte_mbuf *nbuf);
 
 /* Error codes. */
 #define	NPF_ERR_OPCODE		-1	/* Invalid instruction. */
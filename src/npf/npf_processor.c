@@ -58,11 +58,14 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <netinet/in.h>
 #include <rte_branch_prediction.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
@@ -520,3 +523,295 @@ npf_ncode_validate(const void *nc, size_t sz, int *errat)
 	*errat = (iptr - (uintptr_t)nc) / sizeof(uint32_t);
 	return error;
 }
+
+/*
+ * npf_ncode_flow_invariant: does the n-code only look at fields which are
+ * the same for every non-fragment packet of a flow, i.e. the protocol,
+ * addresses, and ports or ICMP type/code held in the grouper key?
+ */
+bool
+npf_ncode_flow_invariant(const void *nc, size_t sz)
+{
+	const uint32_t *words = nc;
+	size_t nwords = sz / sizeof(uint32_t);
+	size_t off = 0;
+
+	while (off < nwords) {
+		switch (words[off]) {
+		case NPF_OPCODE_RET:
+		case NPF_OPCODE_BEQ:
+		case NPF_OPCODE_BNE:
+		case NPF_OPCODE_PROTO:
+		case NPF_OPCODE_IP4MASK:
+		case NPF_OPCODE_IP6MASK:
+		case NPF_OPCODE_PORTS:
+		case NPF_OPCODE_ICMP4:
+		case NPF_OPCODE_ICMP6:
+		case NPF_OPCODE_ADDRFAM:
+		case NPF_OPCODE_FRAGMENT:
+			break;
+		default:
+			return false;
+		}
+		off += 1 + npf_ncode_opcode_noperands(words[off]);
+	}
+	return true;
+}
+
+/*
+ * Pre-decoded n-code.
+ *
+ * At rule build time validated n-code is translated into an array of
+ * fixed-size instructions with their operands already extracted and
+ * branch offsets resolved to instruction indices.  The executor then
+ * dispatches directly on each decoded instruction (direct threading)
+ * rather than fetching and decoding words on every packet.
+ */
+struct npf_ncode_insn {
+	uint32_t		ni_opcode;
+	uint32_t		ni_a;
+	uint32_t		ni_b;
+	uint16_t		ni_jmp;		/* branch target index */
+	bool			ni_back;	/* branch target is backwards */
+	union {
+		npf_addr_t	ni_addr;
+		uint32_t	ni_mac[2];
+	};
+};
+
+struct npf_ncode_prog {
+	uint32_t		np_count;
+	struct npf_ncode_insn	np_insns[];
+};
+
+/*
+ * npf_ncode_compile: validate n-code and translate it into its
+ * pre-decoded form.  On failure the caller should keep using
+ * npf_ncode_process() with the original n-code.
+ */
+int
+npf_ncode_compile(const void *nc, size_t sz, struct npf_ncode_prog **progp)
+{
+	const uint32_t *words = nc;
+	size_t nwords = sz / sizeof(uint32_t);
+	struct npf_ncode_prog *prog;
+	int16_t *index;
+	size_t off;
+	uint32_t count = 0;
+	int errat;
+	int error;
+
+	*progp = NULL;
+
+	error = npf_ncode_validate(nc, sz, &errat);
+	if (error)
+		return error;
+
+	/* Map each instruction word offset to its instruction index */
+	index = malloc(nwords * sizeof(*index));
+	if (!index)
+		return -ENOMEM;
+
+	for (off = 0; off < nwords; off++)
+		index[off] = -1;
+
+	for (off = 0; off < nwords; count++) {
+		if (count > INT16_MAX) {
+			free(index);
+			return NPF_ERR_RANGE;
+		}
+		index[off] = count;
+		off += 1 + npf_ncode_opcode_noperands(words[off]);
+	}
+
+	prog = malloc(sizeof(*prog) + count * sizeof(prog->np_insns[0]));
+	if (!prog) {
+		free(index);
+		return -ENOMEM;
+	}
+	prog->np_count = count;
+
+	for (off = 0, count = 0; off < nwords; count++) {
+		struct npf_ncode_insn *insn = &prog->np_insns[count];
+		const uint32_t *op = &words[off + 1];
+		size_t target;
+
+		memset(insn, 0, sizeof(*insn));
+		insn->ni_opcode = words[off];
+
+		switch (insn->ni_opcode) {
+		case NPF_OPCODE_BEQ:
+		case NPF_OPCODE_BNE:
+			/* Jumps are relative to the start of the branch */
+			target = off + op[0];
+			if (target >= nwords || index[target] < 0) {
+				free(prog);
+				free(index);
+				return NPF_ERR_JUMP;
+			}
+			insn->ni_jmp = index[target];
+			insn->ni_back = insn->ni_jmp <= count;
+			break;
+		case NPF_OPCODE_IP4MASK:
+			insn->ni_a = op[0];
+			insn->ni_addr.s6_addr32[0] = op[1];
+			insn->ni_b = op[2];
+			break;
+		case NPF_OPCODE_IP6MASK:
+			insn->ni_a = op[0];
+			memcpy(&insn->ni_addr, &op[1], sizeof(insn->ni_addr));
+			insn->ni_b = op[5];
+			break;
+		case NPF_OPCODE_ETHERADDR:
+			insn->ni_a = op[0];
+			insn->ni_mac[0] = op[1];
+			insn->ni_mac[1] = op[2];
+			break;
+		case NPF_OPCODE_TABLE:
+		case NPF_OPCODE_PORTS:
+		case NPF_OPCODE_MATCHDSCP:
+			insn->ni_a = op[0];
+			insn->ni_b = op[1];
+			break;
+		case NPF_OPCODE_FRAGMENT:
+			break;
+		default:
+			insn->ni_a = op[0];
+			break;
+		}
+		off += 1 + npf_ncode_opcode_noperands(insn->ni_opcode);
+	}
+
+	free(index);
+	*progp = prog;
+	return 0;
+}
+
+void
+npf_ncode_prog_free(struct npf_ncode_prog *prog)
+{
+	free(prog);
+}
+
+/*
+ * npf_ncode_exec: run pre-decoded n-code against the specified packet.
+ * Same semantics and return values as npf_ncode_process().
+ */
+int
+npf_ncode_exec(const struct npf_ncode_prog *prog,
+	       npf_cache_t *npc, const npf_rule_t *rl,
+	       const struct ifnet *ifp, int dir,
+	       npf_session_t *se, struct rte_mbuf *nbuf)
+{
+	static const void * const dispatch[_NPF_OPCODE_LAST + 1] = {
+		[NPF_OPCODE_RET]	= &&op_ret,
+		[NPF_OPCODE_BEQ]	= &&op_beq,
+		[NPF_OPCODE_BNE]	= &&op_bne,
+		[NPF_OPCODE_PROTO]	= &&op_proto,
+		[NPF_OPCODE_ETHERADDR]	= &&op_etheraddr,
+		[NPF_OPCODE_ETHERPCP]	= &&op_etherpcp,
+		[NPF_OPCODE_IP4MASK]	= &&op_ip4mask,
+		[NPF_OPCODE_TABLE]	= &&op_table,
+		[NPF_OPCODE_ICMP4]	= &&op_icmp4,
+		[NPF_OPCODE_IP6MASK]	= &&op_ip6mask,
+		[NPF_OPCODE_ICMP6]	= &&op_icmp6,
+		[NPF_OPCODE_FRAGMENT]	= &&op_fragment,
+		[NPF_OPCODE_ADDRFAM]	= &&op_addrfam,
+		[NPF_OPCODE_IP6_RT]	= &&op_ip6_rt,
+		[NPF_OPCODE_PORTS]	= &&op_ports,
+		[NPF_OPCODE_TTL]	= &&op_ttl,
+		[NPF_OPCODE_TCP_FLAGS]	= &&op_tcp_flags,
+		[NPF_OPCODE_MATCHDSCP]	= &&op_matchdscp,
+		[NPF_OPCODE_ETHERTYPE]	= &&op_ethertype,
+		[NPF_OPCODE_RPROC]	= &&op_rproc,
+		[_NPF_OPCODE_LAST]	= &&fail,
+	};
+	const struct npf_ncode_insn *insn = prog->np_insns;
+	u_int lcount = NPF_LOOP_LIMIT;
+	int cmpval = 0;
+
+#define NC_DISPATCH()	goto *dispatch[insn->ni_opcode]
+#define NC_NEXT()	do { insn++; NC_DISPATCH(); } while (0)
+
+	NC_DISPATCH();
+
+op_beq:
+	if (cmpval == 0)
+		goto do_jump;
+	NC_NEXT();
+op_bne:
+	if (cmpval == 0)
+		NC_NEXT();
+do_jump:
+	/* Only backward branches can loop */
+	if (unlikely(insn->ni_back)) {
+		if (unlikely(lcount == 0))
+			goto fail;
+		lcount--;
+	}
+	insn = &prog->np_insns[insn->ni_jmp];
+	NC_DISPATCH();
+op_ret:
+	return insn->ni_a;
+op_ip4mask:
+	cmpval = npf_match_ip4mask(npc, insn->ni_a,
+				   insn->ni_addr.s6_addr32[0],
+				   (npf_netmask_t)insn->ni_b);
+	NC_NEXT();
+op_ip6mask:
+	cmpval = npf_match_ip6mask(npc, insn->ni_a, &insn->ni_addr,
+				   (npf_netmask_t)insn->ni_b);
+	NC_NEXT();
+op_table:
+	cmpval = npf_match_table(npc, insn->ni_a, insn->ni_b);
+	NC_NEXT();
+op_ports:
+	cmpval = npf_match_ports(npc, insn->ni_a, insn->ni_b);
+	NC_NEXT();
+op_ttl:
+	cmpval = npf_match_ttl(npc, insn->ni_a);
+	NC_NEXT();
+op_tcp_flags:
+	cmpval = npf_match_tcpfl(npc, insn->ni_a);
+	NC_NEXT();
+op_icmp4:
+	cmpval = npf_match_icmp4(npc, insn->ni_a);
+	NC_NEXT();
+op_icmp6:
+	cmpval = npf_match_icmp6(npc, insn->ni_a);
+	NC_NEXT();
+op_ip6_rt:
+	cmpval = npf_match_ip6_rt(npc, insn->ni_a);
+	NC_NEXT();
+op_proto:
+	cmpval = npf_match_proto(npc, insn->ni_a);
+	NC_NEXT();
+op_etherpcp:
+	cmpval = npf_match_pcp(nbuf, insn->ni_a);
+	NC_NEXT();
+op_etheraddr:
+	cmpval = npf_match_mac(nbuf, insn->ni_a,
+			       (const char *)insn->ni_mac);
+	NC_NEXT();
+op_addrfam:
+	cmpval = npf_match_ip_fam(npc, insn->ni_a);
+	NC_NEXT();
+op_fragment:
+	cmpval = npf_match_ip_frag(npc);
+	NC_NEXT();
+op_matchdscp:
+	cmpval = npf_match_dscp(npc, ((uint64_t) insn->ni_b) << 32 |
+				insn->ni_a);
+	NC_NEXT();
+op_ethertype:
+	cmpval = npf_match_etype(nbuf, insn->ni_a);
+	NC_NEXT();
+op_rproc:
+	cmpval = npf_match_rproc(npc, nbuf, rl, ifp, dir, se);
+	NC_NEXT();
+
+#undef NC_NEXT
+#undef NC_DISPATCH
+fail:
+	return -1;
+}
@@ -64,6 +64,7 @@
 #include "compiler.h"
 #include "if_var.h"
 #include "json_writer.h"
+#include "master.h"
 #include "npf/npf.h"
 #include "npf/config/npf_attach_point.h"
 #include "npf/config/npf_config.h"
@@ -76,6 +77,7 @@
 #include "npf/rproc/npf_rproc.h"
 #include "npf/npf_cache.h"
 #include "npf/npf_session.h"
+#include "npf/npf_tss.h"
 #include "urcu.h"
 #include "util.h"
 #include "vplane_debug.h"
@@ -91,8 +93,78 @@ struct npf_attpt_item;
 #define NPF_RULE_STATS_SIZE	(sizeof(struct npf_rule_stats) * \
 				(get_lcore_max() + 1))
 
+/* Ruleset generation, only updated from the main thread */
+static uint64_t npf_ruleset_gen_next = 1;
+
+/* Count rule evaluations and the cycles spent in them */
+static bool npf_rule_profiling;
+
 /* For GC of rulesets */
 static CDS_LIST_HEAD(ruleset_reap);
+
+/*
+ * For GC of groupers and rules replaced by an incremental update to a
+ * rule group.
+ */
+struct npf_grouper_reap {
+	struct cds_list_head	gr_entry;
+	g2_config_t		*gr_grouper;
+	g2_config_t		*gr_grouper6;
+	struct npf_grouper_share *gr_share;	/* instead of the groupers */
+	struct npf_rule_slots	*gr_slots;
+	npf_rule_t		*gr_rule;
+	bool			gr_is_dead;
+};
+static CDS_LIST_HEAD(grouper_reap);
+
+/*
+ * A group's rules, indexed by the slot its groupers and tuple space
+ * tables hold for each rule in place of the rule itself.  Slots are in
+ * rule order when the group is built, and never change once published;
+ * a rule inserted later takes a new slot at the end, and a deleted
+ * rule leaves a NULL slot.
+ */
+struct npf_rule_slots {
+	uint32_t		rsl_count;
+	npf_rule_t		*rsl_rule[];
+};
+
+/*
+ * n-code shared by the same rule in copies of a group.  Rules can
+ * outlive their group, so each rule using it holds a reference.
+ */
+struct npf_ncode_share {
+	rte_atomic32_t		ns_refcnt;
+	uint32_t		ns_size;
+	void			*ns_ncode;
+	struct npf_ncode_prog	*ns_prog;
+};
+
+/* What a shared grouper was built from, for each slot */
+struct npf_grouper_share_rule {
+	rule_no_t			sr_rule_no;
+	struct npf_rule_grouper_info	sr_info;
+	struct npf_ncode_share		*sr_ncode;
+};
+
+/*
+ * Groupers built once for every group whose rules have the same
+ * numbers and grouper inputs, typically the same rule group attached
+ * to many interfaces.  As the groupers hold slots, each attach point
+ * keeps its own rules, counters and rprocs.  Master thread only.
+ */
+struct npf_grouper_share {
+	struct cds_list_head		gs_entry;
+	uint32_t			gs_hash;
+	uint32_t			gs_refcnt;	/* groups using it */
+	g2_config_t			*gs_grouper;
+	g2_config_t			*gs_grouper6;
+	uint32_t			gs_nrules;
+	struct npf_grouper_share_rule	gs_rule[];
+};
+
+/* Few distinct groups are in use at once, so a list will do */
+static CDS_LIST_HEAD(grouper_shares);
 static struct rte_timer ruleset_gc_timer;
 #define RULESET_GC_INTERVAL	30
 
@@ -104,6 +176,8 @@ struct npf_ruleset {
 	enum npf_ruleset_type	rs_type;
 	bool			rs_is_stateful;
 	bool			rs_is_dead;
+	bool			rs_flow_invariant; /* all rules flow invariant */
+	uint64_t		rs_gen;		/* changes on any rule change */
 };
 
 /* Rproc definitions */
@@ -127,6 +201,9 @@ struct npf_rule_group {
 
 	g2_config_t *rg_grouper;
 	g2_config_t *rg_grouper6;
+	tss_config_t *rg_tss;		/* used instead of the groupers */
+	tss_config_t *rg_tss6;
+	struct npf_rule_slots *rg_slots; /* rules by classifier slot */
 
 	struct cds_list_head rg_rules;	/* rules in this group */
 
@@ -139,6 +216,9 @@ struct npf_rule_group {
 	char *rg_name;			/* name of this rule group */
 
 	npf_ruleset_t *rg_ruleset;	/* ruleset this group is in */
+
+	/* Where the groupers came from, if shared with other groups */
+	struct npf_grouper_share *rg_share;
 };
 
 /* Struct containing rule generation and state data.  */
@@ -157,6 +237,8 @@ struct npf_rule_state {
 struct npf_rule {
 	struct cds_list_head		r_entry;
 	void				*r_ncode;	/* pointer to ncode */
+	struct npf_ncode_prog		*r_nc_prog;	/* pre-decoded ncode */
+	struct npf_ncode_share		*r_nc_share;	/* owner of the above */
 	npf_natpolicy_t			*r_natp;	/* nat policy */
 	struct npf_rule_stats		*r_stats;	/* rule stats */
 	struct npf_rule_state		*r_state;	/* generation state */
@@ -172,6 +254,7 @@ struct npf_rule {
 
 /* Only used for grouper to callback into the processor */
 struct npf_grouper_cb_data {
+	const struct npf_rule_slots *slots;
 	npf_cache_t *npc;
 	struct rte_mbuf *mbuf;
 	const struct ifnet *ifp;
@@ -192,6 +275,8 @@ npf_ruleset_create(enum npf_ruleset_type ruleset_type,
 		ruleset->rs_type = ruleset_type;
 		ruleset->rs_attach_type = attach_type;
 		ruleset->rs_attach_point = strdup(attach_point);
+		ruleset->rs_flow_invariant = true;
+		ruleset->rs_gen = npf_ruleset_gen_next++;
 
 		if (!ruleset->rs_attach_point) {
 			free(ruleset);
@@ -239,6 +324,15 @@ bad_stats:
 	return NULL;
 }
 
+static void npf_ncode_share_put(struct npf_ncode_share *ns)
+{
+	if (ns && rte_atomic32_dec_and_test(&ns->ns_refcnt)) {
+		npf_ncode_prog_free(ns->ns_prog);
+		free(ns->ns_ncode);
+		free(ns);
+	}
+}
+
 static void rule_free(npf_rule_t *rl)
 {
 	unsigned int i;
@@ -258,7 +352,12 @@ static void rule_free(npf_rule_t *rl)
 	free(rl->r_state->rs_rproc);
 	free(rl->r_state);
 	free(rl->r_stats);
-	free(rl->r_ncode);
+	if (rl->r_nc_share)
+		npf_ncode_share_put(rl->r_nc_share);
+	else {
+		npf_ncode_prog_free(rl->r_nc_prog);
+		free(rl->r_ncode);
+	}
 	free(rl);
 }
 
@@ -288,6 +387,22 @@ npf_free_rules(struct cds_list_head *rules)
 	}
 }
 
+static void
+npf_grouper_share_put(struct npf_grouper_share *gs)
+{
+	uint32_t i;
+
+	if (--gs->gs_refcnt)
+		return;
+
+	cds_list_del(&gs->gs_entry);
+	for (i = 0; i < gs->gs_nrules; i++)
+		npf_ncode_share_put(gs->gs_rule[i].sr_ncode);
+	g2_destroy(&gs->gs_grouper);
+	g2_destroy(&gs->gs_grouper6);
+	free(gs);
+}
+
 void
 npf_free_group(npf_rule_group_t *rg)
 {
@@ -298,9 +413,17 @@ npf_free_group(npf_rule_group_t *rg)
 	cds_list_del_rcu(&rg->rg_entry);
 
 	/* Release groupers */
+	if (rg->rg_share) {
+		npf_grouper_share_put(rg->rg_share);
+		rg->rg_grouper = NULL;
+		rg->rg_grouper6 = NULL;
+	}
 	g2_destroy(&rg->rg_grouper);
 	g2_destroy(&rg->rg_grouper6);
+	tss_destroy(&rg->rg_tss);
+	tss_destroy(&rg->rg_tss6);
 
+	free(rg->rg_slots);
 	free(rg->rg_name);
 	free(rg);
 }
@@ -331,8 +454,25 @@ npf_ruleset_free(npf_ruleset_t *rs)
 /* GC for rulesets. Ensures no access at time of free. */
 static void ruleset_gc(struct rte_timer *t __rte_unused, void *arg __unused)
 {
+	struct npf_grouper_reap *gr, *tmp_gr;
 	npf_ruleset_t *rs, *tmp_rs;
 
+	cds_list_for_each_entry_safe(gr, tmp_gr, &grouper_reap, gr_entry) {
+		if (gr->gr_is_dead) {
+			cds_list_del(&gr->gr_entry);
+			if (gr->gr_share)
+				npf_grouper_share_put(gr->gr_share);
+			else {
+				g2_destroy(&gr->gr_grouper);
+				g2_destroy(&gr->gr_grouper6);
+			}
+			free(gr->gr_slots);
+			npf_rule_put(gr->gr_rule);
+			free(gr);
+		} else
+			gr->gr_is_dead = true;
+	}
+
 	cds_list_for_each_entry_safe(rs, tmp_rs, &ruleset_reap, rs_reap) {
 		if (rs->rs_is_dead) {
 			cds_list_del(&rs->rs_reap);
@@ -356,9 +496,9 @@ int npf_flush_rulesets(void)
 void npf_ruleset_gc_init(void)
 {
 	rte_timer_init(&ruleset_gc_timer);
-	rte_timer_reset(&ruleset_gc_timer,
-			(RULESET_GC_INTERVAL * rte_get_timer_hz()),
-			PERIODICAL, rte_get_master_lcore(), ruleset_gc, NULL);
+	master_aging_timer_reset(&ruleset_gc_timer,
+				 RULESET_GC_INTERVAL * rte_get_timer_hz(),
+				 ruleset_gc, NULL);
 }
 
 /*
@@ -470,6 +610,8 @@ static void rule_clear_stats(npf_rule_t *rl)
 	FOREACH_DP_LCORE(i) {
 		rl->r_stats[i].pkts_ct = 0;
 		rl->r_stats[i].bytes_ct = 0;
+		rl->r_stats[i].eval_ct = 0;
+		rl->r_stats[i].eval_cycles = 0;
 	}
 
 	rproc_clear_stats(rl);
@@ -486,6 +628,8 @@ void rule_sum_stats(const npf_rule_t *rl,
 		rs->bytes_ct += rl->r_stats[i].bytes_ct;
 		rs->pkts_ct += rl->r_stats[i].pkts_ct;
 		rs->map_ports += rl->r_stats[i].map_ports;
+		rs->eval_ct += rl->r_stats[i].eval_ct;
+		rs->eval_cycles += rl->r_stats[i].eval_cycles;
 	}
 }
 
@@ -540,6 +684,8 @@ static void rule_copy_stats(npf_rule_t *from, npf_rule_t *to)
 		to->r_stats[i].pkts_ct += from->r_stats[i].pkts_ct;
 		to->r_stats[i].bytes_ct += from->r_stats[i].bytes_ct;
 		to->r_stats[i].map_ports += from->r_stats[i].map_ports;
+		to->r_stats[i].eval_ct += from->r_stats[i].eval_ct;
+		to->r_stats[i].eval_cycles += from->r_stats[i].eval_cycles;
 	}
 }
 
@@ -576,30 +722,30 @@ npf_copy_stats_if_rule_unchanged(npf_rule_t *rl_from, npf_rule_t *rl_to)
 	rule_copy_stats(rl_from, rl_to);
 }
 
-static npf_rule_t *
-npf_find_rule(struct cds_list_head *from_rules, npf_rule_t *match)
-{
-	npf_rule_t *rl;
-
-	cds_list_for_each_entry(rl, from_rules, r_entry) {
-		if (match->r_state->rs_rule_no == rl->r_state->rs_rule_no)
-			return rl;
-		else if (match->r_state->rs_rule_no < rl->r_state->rs_rule_no)
-			return NULL;
-	}
-	return NULL;
-}
-
+/*
+ * Both rule lists are kept in rule number order, so walk them together
+ * rather than searching the old list from the start for every rule.
+ */
 static void
 npf_copy_stats_group(npf_rule_group_t *rg_from,
 			 npf_rule_group_t *rg_to)
 {
+	struct cds_list_head *pos = rg_from->rg_rules.next;
 	npf_rule_t *rl_from, *rl_to;
+	rule_no_t rule_no;
 
 	cds_list_for_each_entry(rl_to, &rg_to->rg_rules, r_entry) {
-		rl_from = npf_find_rule(&rg_from->rg_rules, rl_to);
+		rule_no = rl_to->r_state->rs_rule_no;
+
+		for (; pos != &rg_from->rg_rules; pos = pos->next) {
+			rl_from = cds_list_entry(pos, npf_rule_t, r_entry);
+			if (rl_from->r_state->rs_rule_no >= rule_no)
+				break;
+		}
+		if (pos == &rg_from->rg_rules)
+			return;
 
-		if (rl_from)
+		if (rl_from->r_state->rs_rule_no == rule_no)
 			npf_copy_stats_if_rule_unchanged(rl_from, rl_to);
 	}
 }
@@ -627,11 +773,8 @@ npf_find_rule_group(struct cds_list_head *from_groups, npf_rule_group_t *match)
  * When a rule has a non-filter change, i.e. log the statistics
  * are still cleared.
  *
- * Finally, this is a list walk from the beginning--expensive on
- * large sets. Marking last match would improve performance, but
- * this is tricky in getting right when there's a number of rule
- * changes. Or moderately tricky--should be done once this technique
- * has been validated.
+ * Rules within a group are matched up in a single merged walk, so
+ * this is linear in the size of the rulesets.
  */
 void
 npf_copy_stats(npf_ruleset_t *from, npf_ruleset_t *to)
@@ -1020,6 +1163,10 @@ npf_json_rule(npf_rule_t *rl, bool is_nat, json_writer_t *json)
 		rule_sum_stats(rl, &rs);
 		jsonw_uint_field(json, "bytes", rs.bytes_ct);
 		jsonw_uint_field(json, "packets", rs.pkts_ct);
+		if (npf_rule_profiling || rs.eval_ct) {
+			jsonw_uint_field(json, "evaluations", rs.eval_ct);
+			jsonw_uint_field(json, "eval_cycles", rs.eval_cycles);
+		}
 	}
 
 	if (rl->r_natp) {
@@ -1268,36 +1415,257 @@ npf_process_rule_rprocs(npf_rule_t *rl, enum npf_rproc_type ro_type)
 	return 0;
 }
 
+/* Classifiers hold slot + 1, so that no rule is NULL */
+static ALWAYS_INLINE void *
+npf_rule_slot_md(uint32_t slot)
+{
+	return (void *)(uintptr_t)(slot + 1);
+}
+
+/*
+ * A reader may see a newer grouper with older slots, so a slot beyond
+ * them is no match, as it would be had the rule not been added yet.
+ */
+static ALWAYS_INLINE npf_rule_t *
+npf_rule_slot_get(const struct npf_rule_slots *slots, const void *md)
+{
+	uintptr_t slot = (uintptr_t)md - 1;
+
+	if (unlikely(!slots || slot >= slots->rsl_count))
+		return NULL;
+	return slots->rsl_rule[slot];
+}
+
+/* A copy of a group's slots, with room for 'extra' more */
+static struct npf_rule_slots *
+npf_rule_slots_copy(const struct npf_rule_slots *from, uint32_t extra)
+{
+	uint32_t count = (from ? from->rsl_count : 0) + extra;
+	struct npf_rule_slots *slots;
+
+	slots = zmalloc_aligned(sizeof(*slots) + count * sizeof(npf_rule_t *));
+	if (!slots)
+		return NULL;
+
+	slots->rsl_count = count;
+	if (from)
+		memcpy(slots->rsl_rule, from->rsl_rule,
+		       from->rsl_count * sizeof(npf_rule_t *));
+	return slots;
+}
+
 static int
-npf_add_rule_to_grouper(npf_rule_t *rl)
+npf_rule_slot_find(const struct npf_rule_slots *slots, const npf_rule_t *rl)
 {
-	struct npf_rule_grouper_info *info = &rl->r_state->rs_grouper_info;
+	uint32_t i;
 
-	/*
-	 * Insert the grouper entries for this rule into the grouper
-	 * associated with this group of rules.
-	 */
-	if (info->g_family != AF_INET6) {
-		if (!g2_create_rule(rl->r_state->rs_rule_group->rg_grouper,
-				    rl->r_state->rs_rule_no, rl))
+	for (i = 0; slots && i < slots->rsl_count; i++)
+		if (slots->rsl_rule[i] == rl)
+			return i;
+	return -1;
+}
+
+static int
+npf_tss_build(npf_rule_group_t *rg)
+{
+	const struct npf_rule_slots *slots = rg->rg_slots;
+	struct npf_rule_grouper_info *info;
+	uint32_t i;
+
+	for (i = 0; i < slots->rsl_count; i++) {
+		info = &slots->rsl_rule[i]->r_state->rs_grouper_info;
+
+		if (info->g_family != AF_INET6 &&
+		    !tss_add(rg->rg_tss, npf_rule_slot_md(i),
+			     info->g_v4_match, info->g_v4_mask))
+			return -ENOMEM;
+		if (info->g_family != AF_INET &&
+		    !tss_add(rg->rg_tss6, npf_rule_slot_md(i),
+			     info->g_v6_match, info->g_v6_mask))
 			return -ENOMEM;
-		if (!g2_add(rl->r_state->rs_rule_group->rg_grouper, 0,
-			NPC_GPR_SIZE_v4, info->g_v4_match, info->g_v4_mask))
-			return -EINVAL;
 	}
+	return 0;
+}
 
-	/*
-	 * NAT64 might have a natpolicy, so always add IPv6 rule
-	 */
-	if (info->g_family != AF_INET) {
-		if (!g2_create_rule(rl->r_state->rs_rule_group->rg_grouper6,
-				    rl->r_state->rs_rule_no, rl))
-			return -ENOMEM;
-		if (!g2_add(rl->r_state->rs_rule_group->rg_grouper6, 0,
-			NPC_GPR_SIZE_v6, info->g_v6_match, info->g_v6_mask))
-			return -EINVAL;
+static uint32_t
+npf_grouper_share_hash(const struct npf_rule_slots *slots)
+{
+	const npf_rule_t *rl;
+	uint32_t hash = slots->rsl_count;
+	uint32_t i;
+
+	for (i = 0; i < slots->rsl_count; i++) {
+		rl = slots->rsl_rule[i];
+		hash = rte_jhash(&rl->r_state->rs_grouper_info,
+				 sizeof(struct npf_rule_grouper_info),
+				 rte_jhash_1word(rl->r_state->rs_rule_no, hash));
+	}
+	return hash;
+}
+
+static bool
+npf_grouper_share_match(const struct npf_grouper_share *gs,
+			const struct npf_rule_slots *slots, uint32_t hash)
+{
+	const struct npf_grouper_share_rule *sr;
+	const npf_rule_t *rl;
+	uint32_t i;
+
+	if (gs->gs_hash != hash || gs->gs_nrules != slots->rsl_count)
+		return false;
+
+	for (i = 0; i < slots->rsl_count; i++) {
+		sr = &gs->gs_rule[i];
+		rl = slots->rsl_rule[i];
+		if (sr->sr_rule_no != rl->r_state->rs_rule_no ||
+		    memcmp(&sr->sr_info, &rl->r_state->rs_grouper_info,
+			   sizeof(sr->sr_info)))
+			return false;
 	}
+	return true;
+}
+
+/*
+ * Build the groupers for a group's rules.  The n-code of each rule
+ * moves to the share, for copies of the group to use too.
+ */
+static int
+npf_grouper_share_create(const struct npf_rule_slots *slots, uint32_t hash,
+			 struct npf_grouper_share **gsp)
+{
+	struct npf_grouper_share_rule *sr;
+	struct npf_rule_grouper_info *info;
+	struct npf_grouper_share *gs;
+	struct npf_ncode_share *ns;
+	npf_rule_t *rl;
+	uint32_t i;
+	int ret = -ENOMEM;
+
+	gs = zmalloc_aligned(sizeof(*gs) +
+			     slots->rsl_count * sizeof(gs->gs_rule[0]));
+	if (!gs)
+		return -ENOMEM;
+
+	gs->gs_hash = hash;
+	gs->gs_nrules = slots->rsl_count;
+	gs->gs_grouper = g2_init(NPC_GPR_SIZE_v4);
+	gs->gs_grouper6 = g2_init(NPC_GPR_SIZE_v6);
+
+	for (i = 0; i < slots->rsl_count; i++) {
+		rl = slots->rsl_rule[i];
+		info = &rl->r_state->rs_grouper_info;
+		sr = &gs->gs_rule[i];
+
+		sr->sr_rule_no = rl->r_state->rs_rule_no;
+		sr->sr_info = *info;
+
+		if (info->g_family != AF_INET6) {
+			if (!g2_create_rule(gs->gs_grouper, sr->sr_rule_no,
+					    npf_rule_slot_md(i)))
+				goto error;
+			ret = -EINVAL;
+			if (!g2_add(gs->gs_grouper, 0, NPC_GPR_SIZE_v4,
+				    info->g_v4_match, info->g_v4_mask))
+				goto error;
+			ret = -ENOMEM;
+		}
 
+		/*
+		 * NAT64 might have a natpolicy, so always add IPv6 rule
+		 */
+		if (info->g_family != AF_INET) {
+			if (!g2_create_rule(gs->gs_grouper6, sr->sr_rule_no,
+					    npf_rule_slot_md(i)))
+				goto error;
+			ret = -EINVAL;
+			if (!g2_add(gs->gs_grouper6, 0, NPC_GPR_SIZE_v6,
+				    info->g_v6_match, info->g_v6_mask))
+				goto error;
+			ret = -ENOMEM;
+		}
+	}
+
+	g2_optimize(&gs->gs_grouper);
+	g2_optimize(&gs->gs_grouper6);
+
+	/* Nothing can fail from here, so hand over the n-code */
+	for (i = 0; i < slots->rsl_count; i++) {
+		rl = slots->rsl_rule[i];
+		if (!rl->r_ncode || rl->r_nc_share)
+			continue;
+
+		ns = zmalloc_aligned(sizeof(*ns));
+		if (!ns)
+			continue;	/* the rule keeps its own */
+
+		rte_atomic32_set(&ns->ns_refcnt, 2);	/* share and rule */
+		ns->ns_size = rl->r_nc_size;
+		ns->ns_ncode = rl->r_ncode;
+		ns->ns_prog = rl->r_nc_prog;
+		rl->r_nc_share = ns;
+		gs->gs_rule[i].sr_ncode = ns;
+	}
+
+	*gsp = gs;
+	return 0;
+
+error:
+	g2_destroy(&gs->gs_grouper);
+	g2_destroy(&gs->gs_grouper6);
+	free(gs);
+	return ret;
+}
+
+/* Use the n-code of a share in place of a rule's identical own copy */
+static void
+npf_ncode_share_use(npf_rule_t *rl, struct npf_ncode_share *ns)
+{
+	if (!ns || rl->r_nc_share ||
+	    !npf_ncode_equal(ns->ns_ncode, ns->ns_size,
+			     rl->r_ncode, rl->r_nc_size))
+		return;
+
+	npf_ncode_prog_free(rl->r_nc_prog);
+	free(rl->r_ncode);
+
+	rte_atomic32_inc(&ns->ns_refcnt);
+	rl->r_ncode = ns->ns_ncode;
+	rl->r_nc_prog = ns->ns_prog;
+	rl->r_nc_share = ns;
+}
+
+/*
+ * Find or build the groupers for a group, sharing them with any
+ * other group of the same rules.
+ */
+static int
+npf_grouper_share_get(npf_rule_group_t *rg)
+{
+	const struct npf_rule_slots *slots = rg->rg_slots;
+	uint32_t hash = npf_grouper_share_hash(slots);
+	struct npf_grouper_share *gs;
+	uint32_t i;
+	int ret;
+
+	cds_list_for_each_entry(gs, &grouper_shares, gs_entry) {
+		if (npf_grouper_share_match(gs, slots, hash)) {
+			for (i = 0; i < slots->rsl_count; i++)
+				npf_ncode_share_use(slots->rsl_rule[i],
+						    gs->gs_rule[i].sr_ncode);
+			goto found;
+		}
+	}
+
+	ret = npf_grouper_share_create(slots, hash, &gs);
+	if (ret)
+		return ret;
+	cds_list_add(&gs->gs_entry, &grouper_shares);
+
+found:
+	gs->gs_refcnt++;
+	rg->rg_share = gs;
+	rg->rg_grouper = gs->gs_grouper;
+	rg->rg_grouper6 = gs->gs_grouper6;
 	return 0;
 }
 
@@ -1392,6 +1760,16 @@ npf_process_rule_config(npf_rule_t *rl)
 	if (ret)
 		return ret;
 
+	/*
+	 * Failure to pre-decode is not fatal, the interpreter is used
+	 * for this rule instead.
+	 */
+	if (rl->r_ncode &&
+	    npf_ncode_compile(rl->r_ncode, rl->r_nc_size, &rl->r_nc_prog))
+		RTE_LOG(NOTICE, FIREWALL,
+			"NPF: rule %u n-code not pre-decoded, interpreting\n",
+			rl->r_state->rs_rule_no);
+
 #ifdef NPF_RULE_DEBUG
 	printf("Attach Type: %s, Attach Name: %s, Group: %s, Rule Number: %u\n",
 		npf_get_attach_type_name(
@@ -1407,18 +1785,19 @@ npf_process_rule_config(npf_rule_t *rl)
 	if (ret)
 		return ret;
 
-	ret = npf_add_rule_to_grouper(rl);
-	if (ret)
-		return ret;
-
 	if (rl->r_stateful)
 		npf_ruleset_set_stateful(rl->r_state->rs_rule_group, true);
 
 	return 0;
 }
 
-int
-npf_make_rule(npf_rule_group_t *rg, uint32_t rule_no, const char *rule_line)
+/*
+ * Allocate and parse a rule for a group.  The rule is not yet in the
+ * group's rule list or groupers.
+ */
+static int
+npf_rule_build(npf_rule_group_t *rg, uint32_t rule_no, const char *rule_line,
+	       npf_rule_t **rlp)
 {
 	npf_rule_t *rl;
 	int ret;
@@ -1449,12 +1828,8 @@ npf_make_rule(npf_rule_group_t *rg, uint32_t rule_no, const char *rule_line)
 	zhashx_set_duplicator(rl->r_state->rs_config_ht,
 				(zhashx_duplicator_fn *)strdup);
 
-	/*
-	 * Add a back reference to the group and insert in the rule into
-	 * its group.
-	 */
+	/* Add a back reference to the group */
 	rl->r_state->rs_rule_group = rg;
-	cds_list_add_tail(&rl->r_entry, &rg->rg_rules);
 
 	/*
 	 * NB: this is truncated down to 16-bits, storing a rule as
@@ -1479,12 +1854,237 @@ npf_make_rule(npf_rule_group_t *rg, uint32_t rule_no, const char *rule_line)
 
 	rl->r_state->rs_hash = npf_rule_hash(rl);
 
+	/*
+	 * A rule whose result could differ between packets of the same
+	 * flow stops the ruleset's verdicts from being cached per flow.
+	 */
+	if (rl->r_rproc_match ||
+	    (rl->r_ncode &&
+	     !npf_ncode_flow_invariant(rl->r_ncode, rl->r_nc_size)))
+		rg->rg_ruleset->rs_flow_invariant = false;
+
+	*rlp = rl;
 	return 0;
 error:
-	cds_list_del(&rl->r_entry);
 	npf_rule_put(rl);
 	return ret;
+}
+
+int
+npf_make_rule(npf_rule_group_t *rg, uint32_t rule_no, const char *rule_line)
+{
+	npf_rule_t *rl;
+	int ret;
+
+	ret = npf_rule_build(rg, rule_no, rule_line, &rl);
+	if (ret)
+		return ret;
+
+	/*
+	 * Insert the rule into its group.  The classifiers are built by
+	 * npf_grouper_optimize() once the group is complete.
+	 */
+	cds_list_add_tail(&rl->r_entry, &rg->rg_rules);
+	return 0;
+}
+
+static npf_rule_t *
+npf_rule_group_find_rule(npf_rule_group_t *rg, uint32_t rule_no)
+{
+	npf_rule_t *rl;
+
+	cds_list_for_each_entry(rl, &rg->rg_rules, r_entry) {
+		if (rl->r_state->rs_rule_no == rule_no)
+			return rl;
+	}
+	return NULL;
+}
 
+/*
+ * Publish replacement slots and groupers for a rule group.  The old ones,
+ * and any rule being removed, are released by the GC timer once no
+ * forwarding thread can still be using them.  The slots go first, see
+ * npf_rule_slot_get().
+ */
+static void
+npf_rule_group_publish(npf_rule_group_t *rg, g2_config_t *g4,
+		       g2_config_t *g6, struct npf_rule_slots *slots,
+		       npf_rule_t *old_rl, struct npf_grouper_reap *gr)
+{
+	g2_config_t *old4, *old6;
+
+	gr->gr_slots = rcu_xchg_pointer(&rg->rg_slots, slots);
+	old4 = g4 ? rcu_xchg_pointer(&rg->rg_grouper, g4) : NULL;
+	old6 = g6 ? rcu_xchg_pointer(&rg->rg_grouper6, g6) : NULL;
+
+	/* Shared groupers are released along with the share */
+	gr->gr_share = rg->rg_share;
+	rg->rg_share = NULL;
+	if (!gr->gr_share) {
+		gr->gr_grouper = old4;
+		gr->gr_grouper6 = old6;
+	}
+
+	gr->gr_rule = old_rl;
+	gr->gr_is_dead = false;
+	cds_list_add(&gr->gr_entry, &grouper_reap);
+}
+
+/*
+ * Copy one of a group's groupers to be changed.  A shared grouper is
+ * copied even if the change is not to it, as a changed group no longer
+ * uses the share.
+ */
+static bool
+npf_rule_group_grouper_copy(const npf_rule_group_t *rg, const g2_config_t *g,
+			    bool changed, g2_config_t **copy)
+{
+	*copy = NULL;
+	if (!g || (!changed && !rg->rg_share))
+		return true;
+
+	*copy = g2_clone(g);
+	return *copy != NULL;
+}
+
+/*
+ * Insert a single rule into a live rule group, updating copies of its
+ * groupers rather than rebuilding them from every rule in the group.
+ */
+int
+npf_rule_group_insert_rule(npf_rule_group_t *rg, uint32_t rule_no,
+			   const char *rule_line)
+{
+	struct npf_rule_grouper_info *info;
+	struct npf_rule_slots *slots = NULL;
+	struct npf_grouper_reap *gr;
+	g2_config_t *g4 = NULL;
+	g2_config_t *g6 = NULL;
+	npf_rule_t *rl, *pos;
+	uint32_t slot;
+	int ret;
+
+	/* Tuple space tables are only built from the complete group */
+	if (rg->rg_tss || rg->rg_tss6)
+		return -EOPNOTSUPP;
+
+	if (npf_rule_group_find_rule(rg, rule_no))
+		return -EEXIST;
+
+	gr = zmalloc_aligned(sizeof(*gr));
+	if (!gr)
+		return -ENOMEM;
+
+	ret = npf_rule_build(rg, rule_no, rule_line, &rl);
+	if (ret) {
+		free(gr);
+		return ret;
+	}
+
+	ret = -ENOMEM;
+	slots = npf_rule_slots_copy(rg->rg_slots, 1);
+	if (!slots)
+		goto error;
+	slot = slots->rsl_count - 1;
+	slots->rsl_rule[slot] = rl;
+
+	info = &rl->r_state->rs_grouper_info;
+	if (!npf_rule_group_grouper_copy(rg, rg->rg_grouper,
+					 info->g_family != AF_INET6, &g4) ||
+	    !npf_rule_group_grouper_copy(rg, rg->rg_grouper6,
+					 info->g_family != AF_INET, &g6))
+		goto error;
+
+	if (g4 && info->g_family != AF_INET6 &&
+	    !g2_insert_rule(g4, rule_no, npf_rule_slot_md(slot), 0,
+			    NPC_GPR_SIZE_v4, info->g_v4_match,
+			    info->g_v4_mask))
+		goto error;
+	if (g6 && info->g_family != AF_INET &&
+	    !g2_insert_rule(g6, rule_no, npf_rule_slot_md(slot), 0,
+			    NPC_GPR_SIZE_v6, info->g_v6_match,
+			    info->g_v6_mask))
+		goto error;
+	g2_optimize(&g4);
+	g2_optimize(&g6);
+
+	/* Keep the rule list in evaluation order */
+	cds_list_for_each_entry(pos, &rg->rg_rules, r_entry) {
+		if (pos->r_state->rs_rule_no > rule_no)
+			break;
+	}
+	cds_list_add_tail_rcu(&rl->r_entry, &pos->r_entry);
+
+	npf_rule_group_publish(rg, g4, g6, slots, NULL, gr);
+	CMM_STORE_SHARED(rg->rg_ruleset->rs_gen, npf_ruleset_gen_next++);
+	return 0;
+
+error:
+	g2_destroy(&g4);
+	g2_destroy(&g6);
+	free(slots);
+	npf_rule_put(rl);
+	free(gr);
+	return ret;
+}
+
+/*
+ * Delete a single rule from a live rule group.
+ */
+int
+npf_rule_group_delete_rule(npf_rule_group_t *rg, uint32_t rule_no)
+{
+	struct npf_rule_grouper_info *info;
+	struct npf_rule_slots *slots;
+	struct npf_grouper_reap *gr;
+	g2_config_t *g4 = NULL;
+	g2_config_t *g6 = NULL;
+	npf_rule_t *rl;
+	int slot;
+
+	if (rg->rg_tss || rg->rg_tss6)
+		return -EOPNOTSUPP;
+
+	rl = npf_rule_group_find_rule(rg, rule_no);
+	if (!rl)
+		return -ENOENT;
+
+	gr = zmalloc_aligned(sizeof(*gr));
+	if (!gr)
+		return -ENOMEM;
+
+	slots = npf_rule_slots_copy(rg->rg_slots, 0);
+	if (!slots)
+		goto error;
+	slot = npf_rule_slot_find(slots, rl);
+	if (slot >= 0)
+		slots->rsl_rule[slot] = NULL;
+
+	info = &rl->r_state->rs_grouper_info;
+	if (!npf_rule_group_grouper_copy(rg, rg->rg_grouper,
+					 info->g_family != AF_INET6, &g4) ||
+	    !npf_rule_group_grouper_copy(rg, rg->rg_grouper6,
+					 info->g_family != AF_INET, &g6))
+		goto error;
+
+	if (g4 && info->g_family != AF_INET6 && !g2_delete_rule(g4, rule_no))
+		goto error;
+	if (g6 && info->g_family != AF_INET && !g2_delete_rule(g6, rule_no))
+		goto error;
+
+	cds_list_del_rcu(&rl->r_entry);
+	rl->r_state->rs_rule_group = NULL;
+
+	npf_rule_group_publish(rg, g4, g6, slots, rl, gr);
+	CMM_STORE_SHARED(rg->rg_ruleset->rs_gen, npf_ruleset_gen_next++);
+	return 0;
+
+error:
+	g2_destroy(&g4);
+	g2_destroy(&g6);
+	free(slots);
+	free(gr);
+	return -ENOMEM;
 }
 
 /*
@@ -1575,39 +2175,123 @@ npf_rproc_match(npf_cache_t *npc, struct rte_mbuf *m, const npf_rule_t *rl,
 void
 npf_grouper_init(npf_rule_group_t *rg)
 {
-	rg->rg_grouper = g2_init(NPC_GPR_SIZE_v4);
-	rg->rg_grouper6 = g2_init(NPC_GPR_SIZE_v6);
+	if (npf_get_ruleset_type_classifier(rg->rg_ruleset->rs_type) !=
+	    NPF_CLASSIFIER_TSS)
+		return;
+
+	rg->rg_tss = tss_init(NPC_GPR_SIZE_v4);
+	rg->rg_tss6 = tss_init(NPC_GPR_SIZE_v6);
+	if (rg->rg_tss && rg->rg_tss6)
+		return;
+	tss_destroy(&rg->rg_tss);
+	tss_destroy(&rg->rg_tss6);
 }
 
-void
+/*
+ * Build the classifiers for a complete group.  The groupers are shared
+ * with other groups of the same rules where possible.
+ */
+int
 npf_grouper_optimize(npf_rule_group_t *rg)
 {
-	g2_optimize(&rg->rg_grouper);
-	g2_optimize(&rg->rg_grouper6);
+	struct npf_rule_slots *slots;
+	npf_rule_t *rl;
+	uint32_t count = 0;
+	int ret;
+
+	cds_list_for_each_entry(rl, &rg->rg_rules, r_entry)
+		count++;
+
+	slots = npf_rule_slots_copy(NULL, count);
+	if (!slots)
+		return -ENOMEM;
+
+	count = 0;
+	cds_list_for_each_entry(rl, &rg->rg_rules, r_entry)
+		slots->rsl_rule[count++] = rl;
+	rg->rg_slots = slots;
+
+	if (!rg->rg_tss && !rg->rg_tss6)
+		ret = npf_grouper_share_get(rg);
+	else
+		ret = npf_tss_build(rg);
+	if (ret) {
+		RTE_LOG(ERR, FIREWALL, "Error: building classifier for "
+			"group %s - %s\n", rg->rg_name, strerror(-ret));
+		return ret;
+	}
+	if (!rg->rg_tss && !rg->rg_tss6)
+		return 0;
+
+	/* On failure fall back to a linear search of the rules */
+	if (rg->rg_tss && !tss_optimize(rg->rg_tss))
+		tss_destroy(&rg->rg_tss);
+	if (rg->rg_tss6 && !tss_optimize(rg->rg_tss6))
+		tss_destroy(&rg->rg_tss6);
+	return 0;
+}
+
+void
+npf_rule_set_profiling(bool enable)
+{
+	CMM_STORE_SHARED(npf_rule_profiling, enable);
+}
+
+bool
+npf_rule_get_profiling(void)
+{
+	return npf_rule_profiling;
 }
 
 static ALWAYS_INLINE
-bool npf_rule_match(npf_cache_t *npc, struct rte_mbuf *nbuf,
-		    const struct ifnet *ifp, int dir,
-		    npf_session_t *se, const npf_rule_t *rl)
+bool npf_rule_match_ncode(npf_cache_t *npc, struct rte_mbuf *nbuf,
+			  const struct ifnet *ifp, int dir,
+			  npf_session_t *se, const npf_rule_t *rl)
 {
 	/*
 	 * Process the n-code, if any
 	 * NB: 'match all' generates no ncode
 	 */
-	if (rl->r_ncode && npf_ncode_process(npc, rl, ifp, dir, se, nbuf))
+	if (likely(rl->r_nc_prog)) {
+		if (npf_ncode_exec(rl->r_nc_prog, npc, rl, ifp, dir, se, nbuf))
+			return false;
+	} else if (rl->r_ncode &&
+		   npf_ncode_process(npc, rl, ifp, dir, se, nbuf))
 		return false;
 
 	return true;
 }
 
+static ALWAYS_INLINE
+bool npf_rule_match(npf_cache_t *npc, struct rte_mbuf *nbuf,
+		    const struct ifnet *ifp, int dir,
+		    npf_session_t *se, const npf_rule_t *rl)
+{
+	struct npf_rule_stats *rs;
+	uint64_t start;
+	bool match;
+
+	if (likely(!CMM_LOAD_SHARED(npf_rule_profiling)))
+		return npf_rule_match_ncode(npc, nbuf, ifp, dir, se, rl);
+
+	start = rte_rdtsc();
+	match = npf_rule_match_ncode(npc, nbuf, ifp, dir, se, rl);
+
+	rs = &rl->r_stats[dp_lcore_id()];
+	rs->eval_ct++;
+	rs->eval_cycles += rte_rdtsc() - start;
+
+	return match;
+}
+
 bool
 npf_rule_proc(const void *d, const void *r)
 {
 	const struct npf_grouper_cb_data *pd = d;
-	const npf_rule_t *rl = r;
+	const npf_rule_t *rl = npf_rule_slot_get(pd->slots, r);
 
-	return npf_rule_match(pd->npc, pd->mbuf, pd->ifp, pd->dir, pd->se, rl);
+	return rl &&
+		npf_rule_match(pd->npc, pd->mbuf, pd->ifp, pd->dir, pd->se, rl);
 }
 
 /*
@@ -1640,20 +2324,44 @@ npf_ruleset_inspect(npf_cache_t *npc, struct rte_mbuf *nbuf,
 
 		if (likely(npf_iscached(npc, NPC_GROUPER))) {
 			uint8_t *pkt = (uint8_t *)npc->npc_grouper;
+			void *md;
 
 			if (likely(npf_iscached(npc, NPC_IP4))) {
-				if (rg->rg_grouper) {
-					rl = g2_eval4(rg->rg_grouper, pkt, &pd);
-					if (rl)
-						return rl;
+				const g2_config_t *g4 =
+					rcu_dereference(rg->rg_grouper);
+
+				pd.slots = rcu_dereference(rg->rg_slots);
+				if (g4) {
+					md = g2_eval4(g4, pkt, &pd);
+					if (md)
+						return npf_rule_slot_get(pd.slots,
+									 md);
+					continue;
+				}
+				if (rg->rg_tss) {
+					md = tss_eval(rg->rg_tss, pkt, &pd);
+					if (md)
+						return npf_rule_slot_get(pd.slots,
+									 md);
 					continue;
 				}
 			} else if (npf_iscached(npc, NPC_IP6)) {
-				if (rg->rg_grouper6) {
-					rl = g2_eval6(rg->rg_grouper6, pkt,
-						      &pd);
-					if (rl)
-						return rl;
+				const g2_config_t *g6 =
+					rcu_dereference(rg->rg_grouper6);
+
+				pd.slots = rcu_dereference(rg->rg_slots);
+				if (g6) {
+					md = g2_eval6(g6, pkt, &pd);
+					if (md)
+						return npf_rule_slot_get(pd.slots,
+									 md);
+					continue;
+				}
+				if (rg->rg_tss6) {
+					md = tss_eval(rg->rg_tss6, pkt, &pd);
+					if (md)
+						return npf_rule_slot_get(pd.slots,
+									 md);
 					continue;
 				}
 			}
@@ -1701,6 +2409,17 @@ npf_ruleset_set_stateful(npf_rule_group_t *rg, bool value)
 	rg->rg_ruleset->rs_is_stateful = value;
 }
 
+/*
+ * Can the result of inspecting this ruleset be cached per flow?  If so
+ * return the generation to record alongside the cached result.
+ */
+bool
+npf_ruleset_flow_cacheable(const npf_ruleset_t *ruleset, uint64_t *gen)
+{
+	*gen = CMM_LOAD_SHARED(ruleset->rs_gen);
+	return ruleset->rs_flow_invariant;
+}
+
 bool
 npf_ruleset_is_stateful(const npf_ruleset_t *ruleset)
 {
@@ -75,7 +75,9 @@ struct npf_rule_stats {
 	uint64_t	pkts_ct;
 	uint64_t	bytes_ct;
 	uint64_t	map_ports; /* NAT mapped ports stats */
-	uint64_t	pad[5];
+	uint64_t	eval_ct;   /* times the rule's n-code was run */
+	uint64_t	eval_cycles; /* TSC cycles spent running it */
+	uint64_t	pad[3];
 };
 
 /**
@@ -106,6 +108,9 @@ void rule_sum_stats(const npf_rule_t *rl,
 		    struct npf_rule_stats *rs);
 
 void npf_ruleset_gc_init(void);
+bool npf_ruleset_flow_cacheable(const npf_ruleset_t *ruleset, uint64_t *gen);
+void npf_rule_set_profiling(bool enable);
+bool npf_rule_get_profiling(void);
 npf_ruleset_t *npf_ruleset_create(enum npf_ruleset_type ruleset_type,
 				  enum npf_attach_type attach_type,
 				  const char *attach_point);
@@ -142,6 +147,9 @@ npf_rule_group_t *npf_rule_group_create(npf_ruleset_t *ruleset,
 					const char *group, uint8_t dir);
 int npf_make_rule(npf_rule_group_t *rg, uint32_t rule_no,
 		  const char *rule_line);
+int npf_rule_group_insert_rule(npf_rule_group_t *rg, uint32_t rule_no,
+			       const char *rule_line);
+int npf_rule_group_delete_rule(npf_rule_group_t *rg, uint32_t rule_no);
 void *npf_rule_rproc_handle_for_logger(npf_rule_t *rl);
 bool npf_rule_has_rproc_actions(npf_rule_t *rl);
 bool npf_rule_has_rproc_logger(npf_rule_t *rl);
@@ -151,7 +159,7 @@ bool npf_rproc_action(npf_cache_t *npc, struct rte_mbuf **nbuf,
 bool npf_rproc_match(npf_cache_t *npc, struct rte_mbuf *m, const npf_rule_t *rl,
 		     const struct ifnet *ifp, int dir, npf_session_t *se);
 void npf_grouper_init(npf_rule_group_t *rg);
-void npf_grouper_optimize(npf_rule_group_t *rg);
+int npf_grouper_optimize(npf_rule_group_t *rg);
 bool npf_rule_proc(const void *d, const void *r);
 npf_rule_t *npf_ruleset_inspect(npf_cache_t *npc, struct rte_mbuf *nbuf,
 				const npf_ruleset_t *ruleset,
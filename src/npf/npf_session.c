@@ -48,8 +48,11 @@
 #include <rte_branch_prediction.h>
 #include <rte_debug.h>
 #include <rte_jhash.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
 #include <rte_log.h>
 #include <rte_spinlock.h>
+#include <rte_timer.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -59,8 +62,10 @@
 #include <time.h>
 #include <urcu/list.h>
 #include <urcu/uatomic.h>
+#include <urcu/wfcqueue.h>
 
 #include "compiler.h"
+#include "fal.h"
 #include "if_var.h"
 #include "json_writer.h"
 #include "npf/npf.h"
@@ -71,6 +76,7 @@
 #include "npf/rproc/npf_rproc.h"
 #include "npf/rproc/npf_ext_session_limit.h"
 #include "npf/npf_dataplane_session.h"
+#include "npf/npf_event.h"
 #include "npf/npf_icmp.h"
 #include "npf/npf_if.h"
 #include "npf/npf_nat.h"
@@ -83,6 +89,7 @@
 #include "npf/npf_rule_gen.h"
 #include "npf_shim.h"
 #include "pktmbuf.h"
+#include "session/session_pool.h"
 #include "urcu.h"
 #include "vplane_log.h"
 
@@ -111,6 +118,7 @@ struct npf_session {
 	struct npf_session	*s_parent;	/* NULL if this == parent */
 	uint8_t			s_proto;
 	uint8_t			s_proto_idx;
+	struct npf_sess_offload	*s_offload;	/* Only set by master */
 };
 
 /*
@@ -141,9 +149,22 @@ static uint64_t npf_log_flag;
 #define NPF_TST_SESSION_LOG_FLAG(p, f) (npf_log_flag &   (1ull << ((p<<4) + f)))
 #define NPF_SESSION_LOG_MASK(p) (0x000000000000ffffull << (p<<4))
 
+/* NUMA-local pool of npf sessions, objects per socket */
+#define NPF_SESSION_POOL_SIZE	65536
+
+static struct se_pool *npf_session_pool;
+
 /* Forward reference */
 static void sess_clear_nat64_peer(npf_session_t *se);
 
+void npf_session_pool_init(void)
+{
+	npf_session_pool = se_pool_create("npf_session",
+					  sizeof(npf_session_t),
+					  NPF_SESSION_POOL_SIZE,
+					  DP_MEM_SESSION);
+}
+
 /*
  * Get the dataplane session ID given an npf session.  If se or se->s_session
  * are NULL then 0 is returned.
@@ -196,9 +217,52 @@ void npf_reset_session_log(void)
 	npf_log_flag = 0;
 }
 
+/*
+ * Session state logging runs on the master thread, from a snapshot of
+ * the session taken when it changed state.
+ */
+static void
+npf_session_state_log(const struct npf_event *ev)
+{
+	const struct npf_event_session_state *ss = &ev->ev_session_state;
+	char srcip_str[INET6_ADDRSTRLEN];
+	char dstip_str[INET6_ADDRSTRLEN];
+	char dpi_info_str[MAX_DPI_LOG_SIZE];
+	const char *state_name =
+		npf_state_get_state_name(ss->ss_state, ss->ss_proto_idx);
+	const char *proto_name =
+		npf_get_protocol_name_from_idx(ss->ss_proto_idx);
+
+	inet_ntop(ss->ss_af, &ss->ss_saddr, srcip_str, sizeof(srcip_str));
+	inet_ntop(ss->ss_af, &ss->ss_daddr, dstip_str, sizeof(dstip_str));
+
+	dpi_info_str[0] = '\0';
+	if (ss->ss_dpi)
+		dpi_app_info_log(ss->ss_dpi_app_name, ss->ss_dpi_app_proto,
+				 dpi_info_str, MAX_DPI_LOG_SIZE);
+
+	RTE_LOG(NOTICE, FIREWALL,
+		"session table: id(%lu) [%s] %s(%d)"
+		" timeout=%d src=%s(%d) dst=%s(%d) ifname=%s%s%s\n",
+		ss->ss_id, state_name, proto_name, ss->ss_proto,
+		ss->ss_timeout,
+		srcip_str,
+		ntohs(ss->ss_sid),
+		dstip_str,
+		ntohs(ss->ss_did), ifnet_indextoname_safe(ss->ss_if_index),
+		(dpi_info_str[0] == '\0') ? "" : " ",
+		dpi_info_str);
+}
+
 static void __cold_func
 npf_session_log(npf_session_t *se, uint8_t state)
 {
+	struct npf_event ev = { .ev_type = NPF_EVENT_SESSION_STATE };
+	struct npf_event_session_state *ss = &ev.ev_session_state;
+	const void *saddr;
+	const void *daddr;
+	int af;
+
 	/* return immediately if the flag is not set */
 	if (!npf_test_session_log_flag(state, se->s_proto_idx))
 		return;
@@ -213,42 +277,25 @@ npf_session_log(npf_session_t *se, uint8_t state)
 	if (!sen)
 		return;
 
-	const void *saddr;
-	const void *daddr;
-	int af;
-	uint32_t if_index;
-	uint16_t sid;
-	uint16_t did;
-	char srcip_str[INET6_ADDRSTRLEN];
-	char dstip_str[INET6_ADDRSTRLEN];
-	char dpi_info_str[MAX_DPI_LOG_SIZE];
-	uint8_t proto = se->s_proto;
-	int timeout = npf_session_get_timeout(se);
-	const char *state_name =
-		npf_state_get_state_name(state, se->s_proto_idx);
-	const char *proto_name =
-		npf_get_protocol_name_from_idx(se->s_proto_idx);
-
-	session_sentry_extract(sen, &if_index, &af, &saddr, &sid, &daddr, &did);
-
-
-	inet_ntop(af, saddr, srcip_str, sizeof(srcip_str));
-	inet_ntop(af, daddr, dstip_str, sizeof(dstip_str));
-
-	dpi_info_str[0] = '\0';
-	if (se->s_dpi)
-		dpi_info_log(se->s_dpi, dpi_info_str, MAX_DPI_LOG_SIZE);
+	session_sentry_extract(sen, &ss->ss_if_index, &af, &saddr,
+			       &ss->ss_sid, &daddr, &ss->ss_did);
+
+	ss->ss_id = se->s_session->se_id;
+	ss->ss_timeout = npf_session_get_timeout(se);
+	ss->ss_af = af;
+	ss->ss_proto = se->s_proto;
+	ss->ss_proto_idx = se->s_proto_idx;
+	ss->ss_state = state;
+	memcpy(&ss->ss_saddr, saddr, af == AF_INET ? 4 : 16);
+	memcpy(&ss->ss_daddr, daddr, af == AF_INET ? 4 : 16);
+
+	if (se->s_dpi) {
+		ss->ss_dpi = true;
+		ss->ss_dpi_app_name = dpi_flow_get_app_name(se->s_dpi);
+		ss->ss_dpi_app_proto = dpi_flow_get_app_proto(se->s_dpi);
+	}
 
-	RTE_LOG(NOTICE, FIREWALL,
-		"session table: id(%lu) [%s] %s(%d)"
-		" timeout=%d src=%s(%d) dst=%s(%d) ifname=%s%s%s\n",
-		se->s_session->se_id, state_name, proto_name, proto, timeout,
-		srcip_str,
-		ntohs(sid),
-		dstip_str,
-		ntohs(did), ifnet_indextoname_safe(if_index),
-		(dpi_info_str[0] == '\0') ? "" : " ",
-		dpi_info_str);
+	npf_event_post(&ev);
 }
 
 /*
@@ -922,7 +969,7 @@ npf_session_create(npf_cache_t *npc, struct rte_mbuf *nbuf,
 	}
 
 	/* Allocate and initialize new state. */
-	se = zmalloc_aligned(sizeof(npf_session_t));
+	se = se_pool_zalloc(npf_session_pool);
 	if (unlikely(se == NULL)) {
 		*error = -ENOMEM;
 		return NULL;
@@ -984,7 +1031,7 @@ npf_session_establish(npf_cache_t *npc, struct rte_mbuf *nbuf,
 	return se;
 
 fail:
-	free(se);
+	se_pool_free(npf_session_pool, se);
 	return NULL;
 }
 
@@ -1062,6 +1109,256 @@ void npf_session_disassoc_nif(unsigned int if_index)
 			   (void *)(uintptr_t)if_index);
 }
 
+/*
+ * Hardware offload of established sessions.
+ *
+ * When enabled, the master thread periodically walks the sessions and
+ * hands those that have been established for a while to the FAL flow
+ * API.  The walk also reads back the counts of packets the plugin has
+ * forwarded, marking the session as not idle when they move so that it
+ * ages as if the dataplane had seen them.  The entry is deleted when
+ * the session is no longer established or is expired.
+ */
+#define NPF_OFFLOAD_INTERVAL	5	/* seconds */
+
+struct npf_sess_offload {
+	fal_object_t		so_obj;
+	uint64_t		so_cntrs[FAL_FLOW_ENTRY_STAT_MAX];
+	struct cds_wfcq_node	so_qnode;
+	struct rcu_head		so_rcu;
+};
+
+static const enum fal_flow_entry_stat_type npf_offload_cntr_ids[] = {
+	FAL_FLOW_ENTRY_STAT_FORW_PACKETS,
+	FAL_FLOW_ENTRY_STAT_FORW_BYTES,
+	FAL_FLOW_ENTRY_STAT_BACK_PACKETS,
+	FAL_FLOW_ENTRY_STAT_BACK_BYTES,
+};
+
+/* Minimum age in seconds before a session is offloaded, 0 if disabled */
+static uint32_t npf_offload_min_age;
+static bool npf_offload_unsupported;
+static struct rte_timer npf_offload_timer;
+
+/* Entries of sessions destroyed while offloaded, freed by master */
+static struct cds_wfcq_head npf_offload_dead_head;
+static struct cds_wfcq_tail npf_offload_dead_tail;
+
+static bool npf_session_offload_eligible(const npf_session_t *se,
+					 uint64_t min_cycles)
+{
+	if ((se->s_flags & (SE_ACTIVE | SE_PASS | SE_EXPIRE)) !=
+	    (SE_ACTIVE | SE_PASS))
+		return false;
+
+	/* Features that need to see every packet */
+	if (se->s_alg || se->s_nat64 || se->s_dpi || se->s_hook ||
+	    se->s_rproc_rule)
+		return false;
+
+	if (!npf_state_is_established(se->s_proto, se->s_state.nst_state))
+		return false;
+
+	return rte_get_timer_cycles() - se->s_session->se_create_time >=
+		min_cycles;
+}
+
+static void npf_session_offload_create(npf_session_t *se)
+{
+	struct fal_attribute_t attrs[11];
+	struct npf_sess_offload *so;
+	npf_addr_t *src, *dst;
+	uint16_t sid, did;
+	uint32_t if_index;
+	unsigned int n = 0;
+	int af, rc;
+
+	if (npf_session_sentry_extract(se, &if_index, &af, &src, &sid,
+				       &dst, &did) < 0)
+		return;
+
+	so = calloc(1, sizeof(*so));
+	if (!so)
+		return;
+
+	attrs[n].id = FAL_FLOW_ENTRY_ATTR_IFINDEX;
+	attrs[n++].value.u32 = se->s_if_idx;
+	attrs[n].id = FAL_FLOW_ENTRY_ATTR_VRF_ID;
+	attrs[n++].value.u32 = se->s_vrfid;
+	attrs[n].id = FAL_FLOW_ENTRY_ATTR_DIRECTION;
+	attrs[n++].value.u8 = (se->s_flags & PFIL_IN) ?
+		FAL_FLOW_DIR_IN : FAL_FLOW_DIR_OUT;
+	attrs[n].id = FAL_FLOW_ENTRY_ATTR_IP_PROTO;
+	attrs[n++].value.u8 = se->s_proto;
+
+	attrs[n].id = FAL_FLOW_ENTRY_ATTR_SRC_IP;
+	attrs[n+1].id = FAL_FLOW_ENTRY_ATTR_DST_IP;
+	if (af == AF_INET) {
+		attrs[n].value.ipaddr.addr_family = FAL_IP_ADDR_FAMILY_IPV4;
+		memcpy(&attrs[n].value.ipaddr.addr.addr4, src, 4);
+		attrs[n+1].value.ipaddr.addr_family = FAL_IP_ADDR_FAMILY_IPV4;
+		memcpy(&attrs[n+1].value.ipaddr.addr.addr4, dst, 4);
+	} else {
+		attrs[n].value.ipaddr.addr_family = FAL_IP_ADDR_FAMILY_IPV6;
+		memcpy(&attrs[n].value.ipaddr.addr.addr6, src, 16);
+		attrs[n+1].value.ipaddr.addr_family = FAL_IP_ADDR_FAMILY_IPV6;
+		memcpy(&attrs[n+1].value.ipaddr.addr.addr6, dst, 16);
+	}
+	n += 2;
+
+	attrs[n].id = FAL_FLOW_ENTRY_ATTR_SRC_PORT;
+	attrs[n++].value.u16 = sid;
+	attrs[n].id = FAL_FLOW_ENTRY_ATTR_DST_PORT;
+	attrs[n++].value.u16 = did;
+
+	if (se->s_nat) {
+		npf_addr_t taddr;
+		in_port_t tport;
+		u_int masq;
+		int type;
+
+		npf_nat_info(se->s_nat, &type, &taddr, &tport, &masq);
+
+		attrs[n].id = FAL_FLOW_ENTRY_ATTR_NAT_TYPE;
+		attrs[n++].value.u8 = (type == NPF_NATOUT) ?
+			FAL_FLOW_NAT_SNAT : FAL_FLOW_NAT_DNAT;
+		attrs[n].id = FAL_FLOW_ENTRY_ATTR_NAT_IP;
+		attrs[n].value.ipaddr.addr_family = FAL_IP_ADDR_FAMILY_IPV4;
+		memcpy(&attrs[n++].value.ipaddr.addr.addr4, &taddr, 4);
+		attrs[n].id = FAL_FLOW_ENTRY_ATTR_NAT_PORT;
+		attrs[n++].value.u16 = tport;
+	}
+
+	rc = fal_flow_create_entry(n, attrs, &so->so_obj);
+	if (rc < 0) {
+		/* Stop walking for a plugin without the flow API */
+		if (rc == -EOPNOTSUPP)
+			npf_offload_unsupported = true;
+		free(so);
+		return;
+	}
+
+	se->s_offload = so;
+}
+
+static void npf_session_offload_rcu_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct npf_sess_offload, so_rcu));
+}
+
+/* Freed after a grace period, as a show may be looking at the counts */
+static void npf_session_offload_free(struct npf_sess_offload *so)
+{
+	fal_flow_delete_entry(so->so_obj);
+	call_rcu(&so->so_rcu, npf_session_offload_rcu_free);
+}
+
+static void npf_session_offload_remove(npf_session_t *se)
+{
+	struct npf_sess_offload *so = se->s_offload;
+
+	CMM_STORE_SHARED(se->s_offload, NULL);
+	npf_session_offload_free(so);
+}
+
+/* Read back the plugin counts, and age the session by them */
+static void npf_session_offload_sync(npf_session_t *se)
+{
+	struct npf_sess_offload *so = se->s_offload;
+	uint64_t cntrs[FAL_FLOW_ENTRY_STAT_MAX];
+
+	if (fal_flow_get_stats(so->so_obj, FAL_FLOW_ENTRY_STAT_MAX,
+			       npf_offload_cntr_ids, cntrs) < 0)
+		return;
+
+	if (cntrs[FAL_FLOW_ENTRY_STAT_FORW_PACKETS] !=
+	    so->so_cntrs[FAL_FLOW_ENTRY_STAT_FORW_PACKETS] ||
+	    cntrs[FAL_FLOW_ENTRY_STAT_BACK_PACKETS] !=
+	    so->so_cntrs[FAL_FLOW_ENTRY_STAT_BACK_PACKETS])
+		se->s_session->se_idle = 0;
+
+	memcpy(so->so_cntrs, cntrs, sizeof(cntrs));
+}
+
+static int npf_session_offload_feat_cb(struct session *s __unused,
+				       struct session_feature *sf,
+				       void *data)
+{
+	npf_session_t *se = sf->sf_data;
+	uint64_t min_cycles = *(uint64_t *)data;
+
+	if (se->s_offload) {
+		if (!min_cycles ||
+		    (se->s_flags & SE_EXPIRE) ||
+		    !npf_state_is_established(se->s_proto,
+					      se->s_state.nst_state))
+			npf_session_offload_remove(se);
+		else
+			npf_session_offload_sync(se);
+		return 0;
+	}
+
+	if (min_cycles && !npf_offload_unsupported &&
+	    npf_session_offload_eligible(se, min_cycles))
+		npf_session_offload_create(se);
+
+	return 0;
+}
+
+static int npf_session_offload_cb(struct session *s, void *data)
+{
+	return session_feature_walk_session(s, SESSION_FEATURE_NPF,
+		npf_session_offload_feat_cb, data);
+}
+
+/* Only on master, within the read side of the session table */
+static void npf_session_offload_walk(uint64_t min_cycles)
+{
+	struct cds_wfcq_node *node;
+
+	while ((node = __cds_wfcq_dequeue_blocking(&npf_offload_dead_head,
+						   &npf_offload_dead_tail)))
+		npf_session_offload_free(caa_container_of(
+			node, struct npf_sess_offload, so_qnode));
+
+	session_table_walk(npf_session_offload_cb, &min_cycles);
+}
+
+static void npf_session_offload_timer(struct rte_timer *timer __unused,
+				      void *arg __unused)
+{
+	npf_session_offload_walk(npf_offload_min_age * rte_get_timer_hz());
+}
+
+/*
+ * Set the minimum age in seconds of an established session before it
+ * is offloaded, or 0 to disable offload and delete all the entries.
+ */
+void npf_session_offload_set(uint32_t min_age)
+{
+	static bool init;
+
+	if (!init) {
+		cds_wfcq_init(&npf_offload_dead_head, &npf_offload_dead_tail);
+		rte_timer_init(&npf_offload_timer);
+		init = true;
+	}
+
+	npf_offload_min_age = min_age;
+	npf_offload_unsupported = false;
+
+	if (min_age) {
+		rte_timer_reset(&npf_offload_timer,
+				NPF_OFFLOAD_INTERVAL * rte_get_timer_hz(),
+				PERIODICAL, rte_get_master_lcore(),
+				npf_session_offload_timer, NULL);
+		return;
+	}
+
+	rte_timer_stop_sync(&npf_offload_timer);
+	npf_session_offload_walk(0);
+}
+
 /*
  * Destroy a session.  Free various attachments and the handle itself.
  */
@@ -1099,9 +1396,16 @@ void npf_session_destroy(npf_session_t *se)
 	/* Destroy the state. */
 	npf_state_destroy(&se->s_state, se->s_proto_idx);
 
+	/* The master thread deletes any hardware entry */
+	if (se->s_offload) {
+		cds_wfcq_node_init(&se->s_offload->so_qnode);
+		cds_wfcq_enqueue(&npf_offload_dead_head, &npf_offload_dead_tail,
+				 &se->s_offload->so_qnode);
+	}
+
 	dpi_session_flow_destroy(se->s_dpi);
 	free(se->s_alg);
-	free(se);
+	se_pool_free(npf_session_pool, se);
 }
 
 /* Get vrfid */
@@ -1333,6 +1637,10 @@ npf_enable_session_log(const char *proto, const char *state)
 	}
 	NPF_SET_SESSION_LOG_FLAG(proto_idx, state_index);
 
+	if (!npf_event_subscribed(NPF_EVENT_SESSION_STATE))
+		npf_event_subscribe(NPF_EVENT_SESSION_STATE,
+				    npf_session_state_log);
+
 	return 0;
 }
 
@@ -1411,6 +1719,23 @@ void npf_session_feature_json(json_writer_t *json, npf_session_t *se)
 	/* DPI json */
 	if (se->s_dpi)
 		dpi_info_json(se->s_dpi, json);
+
+	/* Hardware offload json */
+	struct npf_sess_offload *so = CMM_LOAD_SHARED(se->s_offload);
+
+	if (so) {
+		jsonw_name(json, "offload");
+		jsonw_start_object(json);
+		jsonw_uint_field(json, "forw_packets",
+			so->so_cntrs[FAL_FLOW_ENTRY_STAT_FORW_PACKETS]);
+		jsonw_uint_field(json, "forw_bytes",
+			so->so_cntrs[FAL_FLOW_ENTRY_STAT_FORW_BYTES]);
+		jsonw_uint_field(json, "back_packets",
+			so->so_cntrs[FAL_FLOW_ENTRY_STAT_BACK_PACKETS]);
+		jsonw_uint_field(json, "back_bytes",
+			so->so_cntrs[FAL_FLOW_ENTRY_STAT_BACK_BYTES]);
+		jsonw_end_object(json);
+	}
 }
 
 static inline const char *npf_session_log_event(
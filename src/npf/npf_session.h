@@ -128,6 +128,7 @@ int npf_session_sentry_extract(npf_session_t *se, uint32_t *if_index, int *af,
 void npf_session_expire(npf_session_t *se);
 bool npf_session_is_expired(const npf_session_t *se);
 void npf_session_destroy(npf_session_t *se);
+void npf_session_pool_init(void);
 bool npf_session_is_pass(const npf_session_t *se, npf_rule_t **rl);
 bool npf_session_is_nat_pinhole(const npf_session_t *se, int dir);
 bool npf_session_forward_dir(npf_session_t *se, int di);
@@ -154,4 +155,10 @@ void *npf_session_get_dpi(npf_session_t *se);
 void npf_session_set_pkt_hook(npf_session_t *se, session_pkt_hook *fn);
 
 void npf_session_disassoc_nif(unsigned int if_index);
+
+/*
+ * Offload sessions established for at least min_age seconds to
+ * hardware via the FAL, or disable offload if min_age is 0.
+ */
+void npf_session_offload_set(uint32_t min_age);
 #endif /* NPF_SESSION_H */
@@ -234,6 +234,10 @@ bool npf_state_inspect(const npf_cache_t *npc, struct rte_mbuf *nbuf,
 	uint8_t state;
 	uint8_t old_state;
 
+	if (proto_idx == NPF_PROTO_IDX_TCP &&
+	    npf_state_tcp_fast(npc, nst, di))
+		return true;
+
 	rte_spinlock_lock(&nst->nst_lock);
 
 	old_state = nst->nst_state;
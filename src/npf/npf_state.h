@@ -242,4 +242,20 @@ uint32_t npf_state_get_tcp_seq(int di, npf_state_t *nst);
 
 void npf_state_set_tcp_strict(bool value);
 
+/* Window tracking of established TCP sessions */
+enum npf_tcp_window_mode {
+	NPF_TCP_WINDOW_FULL,	/* Every packet, under the state lock */
+	NPF_TCP_WINDOW_FAST,	/* Lock free check of in order ACKs */
+	NPF_TCP_WINDOW_LOOSE,	/* Not tracked once established */
+};
+
+void npf_state_set_tcp_window(enum npf_tcp_window_mode mode);
+
+/*
+ * Returns true if a TCP packet of an established session can be passed
+ * without taking the state lock.
+ */
+bool npf_state_tcp_fast(const npf_cache_t *npc, const npf_state_t *nst,
+			int di);
+
 #endif  /* NPF_STATE_H */
@@ -40,6 +40,7 @@
 #include <assert.h>
 #include <netinet/tcp.h>
 #include <rte_branch_prediction.h>
+#include <rte_common.h>
 #include <stdbool.h>
 #include <stdint.h>
 /*
@@ -48,6 +49,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <urcu/system.h>
 
 #include "npf/npf_cache.h"
 #include "npf/npf_state.h"
@@ -60,9 +62,16 @@ struct rte_mbuf;
 
 static bool npf_strict_order_rst;
 static bool npf_state_tcp_strict;
+static enum npf_tcp_window_mode npf_state_tcp_window;
 
 #define	NPF_TCP_MAXACKWIN	66000
 
+/*
+ * In fast mode, how far behind the highest sequence seen nst_end may be
+ * left, as a shift of the lesser of the peer window and NPF_TCP_MAXACKWIN.
+ */
+#define	NPF_TCP_FAST_LAG_SHIFT	2
+
 /*
  * List of TCP flag cases and conversion of flags to a case (index).
  */
@@ -588,6 +597,91 @@ npf_tcp_inwindow(const npf_cache_t *npc, struct rte_mbuf *nbuf, npf_state_t *nst
 	return true;
 }
 
+/*
+ * npf_state_tcp_fast: check an in order ACK of an established session
+ * without taking the state lock.
+ *
+ * Returns true if the packet is within the window and needs no state
+ * to be written, in which case the locked path may be skipped.  Plain
+ * ACKs of an established session never change its state, so the only
+ * writes are those of the window tracking.  Of those, the forward
+ * nst_end is allowed to lag by a fraction of the window, which the
+ * lower bound (II) and the acknowledgment bounds (III, IV) tolerate,
+ * so that a sender only takes the lock every few segments.  A raised
+ * window bound (nst_maxend) is always written, as the peer's upper
+ * bound (I) depends upon it.
+ *
+ * In loose mode window tracking is dropped for good the first time the
+ * locked path sees such a packet, after which no check is made.
+ */
+bool
+npf_state_tcp_fast(const npf_cache_t *npc, const npf_state_t *nst, int di)
+{
+	const enum npf_tcp_window_mode mode =
+		CMM_LOAD_SHARED(npf_state_tcp_window);
+	const struct tcphdr * const th = &npc->npc_l4.tcp;
+	const npf_tcpstate_t *fstate, *tstate;
+	uint32_t fend, tend, maxend, lag;
+	int tcpdlen, ackskew;
+	tcp_seq seq, ack, end;
+	uint32_t win;
+
+	if (likely(mode == NPF_TCP_WINDOW_FULL))
+		return false;
+
+	if ((th->th_flags & CORE_TCP_FLAGS) != TH_ACK ||
+	    CMM_LOAD_SHARED(nst->nst_state) != NPF_TCPS_ESTABLISHED)
+		return false;
+
+	fstate = &nst->nst_tcpst[di];
+	tstate = &nst->nst_tcpst[!di];
+	fend = CMM_LOAD_SHARED(fstate->nst_end);
+	tend = CMM_LOAD_SHARED(tstate->nst_end);
+
+	/* Untracked, as after a loose mode packet or a missed handshake */
+	if (!fend || !tend)
+		return true;
+
+	if (mode == NPF_TCP_WINDOW_LOOSE)
+		return false;
+
+	tcpdlen = npf_tcpsaw(npc, &seq, &ack, &win);
+	end = seq + tcpdlen;
+	win = win ? (win << fstate->nst_wscale) : 1;
+	maxend = CMM_LOAD_SHARED(fstate->nst_maxend);
+
+	/* Upper boundary (I) */
+	if (!SEQ_LEQ(end, maxend))
+		return false;
+
+	/* Lower boundary (II) */
+	if (!SEQ_GEQ(seq, fend - tstate->nst_maxwin))
+		return false;
+
+	/*
+	 * Acknowledgment boundaries (III, IV).  The peer's nst_end may
+	 * itself be lagging, so a negative skew of up to the lag is fine.
+	 */
+	lag = RTE_MIN(tstate->nst_maxwin, (uint32_t)NPF_TCP_MAXACKWIN) >>
+		NPF_TCP_FAST_LAG_SHIFT;
+	ackskew = tend - ack;
+	if (ackskew < -(int)lag ||
+	    ackskew > (NPF_TCP_MAXACKWIN << fstate->nst_wscale))
+		return false;
+
+	/* Writes which can not be deferred */
+	if (fstate->nst_maxwin < win ||
+	    SEQ_GT(ack + win, CMM_LOAD_SHARED(tstate->nst_maxend)))
+		return false;
+
+	return !SEQ_GT(end, fend + lag);
+}
+
+void npf_state_set_tcp_window(enum npf_tcp_window_mode mode)
+{
+	CMM_STORE_SHARED(npf_state_tcp_window, mode);
+}
+
 /*
  * Return a TCP sequence number to be used for spoofed TCP resets
  */
@@ -630,6 +724,15 @@ npf_state_tcp(const npf_cache_t *npc, struct rte_mbuf *nbuf, npf_state_t *nst,
 			return NPF_TCPS_ERR;
 	}
 
+	/* Stop tracking the window once established, in loose mode */
+	if (npf_state_tcp_window == NPF_TCP_WINDOW_LOOSE &&
+	    state == NPF_TCPS_ESTABLISHED &&
+	    (tcpfl & CORE_TCP_FLAGS) == TH_ACK) {
+		nst->nst_tcpst[NPF_FLOW_FORW].nst_end = 0;
+		nst->nst_tcpst[NPF_FLOW_BACK].nst_end = 0;
+		return nstate;
+	}
+
 	/* Determine whether TCP packet really belongs to this connection. */
 	if (!npf_tcp_inwindow(npc, nbuf, nst, di))
 		return NPF_TCPS_ERR;
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * SYN authentication - see npf_syncookie.h.
+ *
+ * Cookies are keyed on a random secret and a coarse clock, and the
+ * validated sources are kept in a fixed, lossy table, so neither an
+ * attack nor its end allocates or frees anything.
+ */
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <rte_ether.h>
+#include <rte_jhash.h>
+#include <rte_mbuf.h>
+#include <rte_random.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ether.h"
+#include "in_cksum.h"
+#include "ip_funcs.h"
+#include "ip_ttl.h"
+#include "netinet6/in6.h"
+#include "netinet6/ip6_funcs.h"
+#include "npf/npf_cache.h"
+#include "npf/npf_syncookie.h"
+#include "pktmbuf.h"
+#include "urcu.h"
+#include "util.h"
+
+/* Cookies stay valid for one to two of these */
+#define SYNCOOKIE_SLOT_SHIFT	4	/* 16s */
+
+/* How long a source stays validated */
+#define SYNCOOKIE_VALID_SECS	300
+
+#define SYNCOOKIE_SRC_BITS	16
+#define SYNCOOKIE_SRC_SIZE	(1u << SYNCOOKIE_SRC_BITS)
+
+uint32_t npf_syncookie_pct;
+
+static uint32_t syncookie_secret;
+
+/*
+ * Validated sources, as a tag from a second hash of the address in
+ * the top half and the expiry time in the bottom.  Colliding sources
+ * just replace each other.
+ */
+static uint64_t syncookie_src[SYNCOOKIE_SRC_SIZE];
+
+static uint32_t syncookie_src_hash(const npf_cache_t *npc, uint32_t seed)
+{
+	return rte_jhash(npf_cache_srcip(npc), npc->npc_alen,
+			 syncookie_secret ^ seed);
+}
+
+static bool syncookie_src_valid(const npf_cache_t *npc, uint32_t now)
+{
+	uint32_t h = syncookie_src_hash(npc, 0);
+	uint64_t e = CMM_LOAD_SHARED(
+		syncookie_src[h & (SYNCOOKIE_SRC_SIZE - 1)]);
+
+	return (uint32_t)(e >> 32) == syncookie_src_hash(npc, 1) &&
+		(int32_t)((uint32_t)e - now) > 0;
+}
+
+static void syncookie_src_add(const npf_cache_t *npc, uint32_t now)
+{
+	uint32_t h = syncookie_src_hash(npc, 0);
+	uint64_t e = (uint64_t)syncookie_src_hash(npc, 1) << 32 |
+		(uint32_t)(now + SYNCOOKIE_VALID_SECS);
+
+	CMM_STORE_SHARED(syncookie_src[h & (SYNCOOKIE_SRC_SIZE - 1)], e);
+}
+
+/* Over both addresses and ports, in the client to server direction */
+static uint32_t syncookie_make(const npf_cache_t *npc, uint32_t slot)
+{
+	const struct tcphdr *th = &npc->npc_l4.tcp;
+	uint32_t h;
+
+	h = rte_jhash(npf_cache_srcip(npc), 2 * npc->npc_alen,
+		      syncookie_secret);
+	return rte_jhash_2words(h, (uint32_t)th->th_sport << 16 |
+				th->th_dport, syncookie_secret + slot);
+}
+
+static void syncookie_challenge(const npf_cache_t *npc,
+				struct rte_mbuf *n, uint32_t cookie)
+{
+	const struct tcphdr *oth = &npc->npc_l4.tcp;
+	bool v4 = npf_iscached(npc, NPC_IP4);
+	uint16_t l3_len = v4 ? sizeof(struct iphdr) : sizeof(struct ip6_hdr);
+	struct rte_mbuf *m;
+	struct tcphdr *th;
+
+	m = pktmbuf_alloc(n->pool, pktmbuf_get_vrf(n));
+	if (!m)
+		return;
+
+	m->port = n->port;
+	pktmbuf_l2_len(m) = ETHER_HDR_LEN;
+	rte_pktmbuf_pkt_len(m) = rte_pktmbuf_data_len(m) =
+		ETHER_HDR_LEN + l3_len + sizeof(*th);
+
+	th = rte_pktmbuf_mtod_offset(m, struct tcphdr *,
+				     ETHER_HDR_LEN + l3_len);
+	memset(th, 0, sizeof(*th));
+	th->th_sport = oth->th_dport;
+	th->th_dport = oth->th_sport;
+	th->th_seq = rte_rand();
+	th->th_ack = htonl(cookie);
+	th->th_off = sizeof(*th) >> 2;
+	th->th_flags = TH_SYN | TH_ACK;
+	th->th_win = htons(1024);
+
+	if (v4) {
+		const struct ip *oip = &npc->npc_ip.v4;
+		struct iphdr *ip = iphdr(m);
+
+		ip->version = IPVERSION;
+		ip->ihl = sizeof(*ip) >> 2;
+		ip->tos = 0;
+		ip->tot_len = htons(l3_len + sizeof(*th));
+		ip->id = 0;
+		ip->frag_off = htons(IP_DF);
+		ip->ttl = IPDEFTTL;
+		ip->protocol = IPPROTO_TCP;
+		ip->saddr = oip->ip_dst.s_addr;
+		ip->daddr = oip->ip_src.s_addr;
+		ip->check = 0;
+		ip->check = ip_checksum(ip, sizeof(*ip));
+		th->th_sum = in4_cksum_mbuf(m, ip, th);
+
+		ethhdr(m)->ether_type = htons(ETHER_TYPE_IPv4);
+		pktmbuf_mdata_set(m, PKT_MDATA_FROM_US);
+		ip_output(m, false);
+	} else {
+		const struct ip6_hdr *oip6 = &npc->npc_ip.v6;
+		struct ip6_hdr *ip6 = ip6hdr(m);
+
+		ip6->ip6_flow = htonl(6 << 28);
+		ip6->ip6_plen = htons(sizeof(*th));
+		ip6->ip6_nxt = IPPROTO_TCP;
+		ip6->ip6_hlim = IPV6_DEFAULT_HOPLIMIT;
+		ip6->ip6_src = oip6->ip6_dst;
+		ip6->ip6_dst = oip6->ip6_src;
+		th->th_sum = in6_cksum_mbuf(m, ip6, th);
+
+		ethhdr(m)->ether_type = htons(ETHER_TYPE_IPv6);
+		pktmbuf_mdata_set(m, PKT_MDATA_FROM_US);
+		ip6_output(m, false);
+	}
+}
+
+bool npf_syncookie_check(const npf_cache_t *npc, struct rte_mbuf *m)
+{
+	const struct tcphdr *th = &npc->npc_l4.tcp;
+	uint8_t flags = th->th_flags & (TH_SYN | TH_ACK | TH_RST | TH_FIN);
+	uint32_t now = get_dp_uptime();
+	uint32_t slot = now >> SYNCOOKIE_SLOT_SHIFT;
+	uint32_t cookie;
+
+	if (flags == TH_SYN) {
+		if (syncookie_src_valid(npc, now))
+			return true;
+
+		/* An ack the client would accept can't be told from it */
+		cookie = syncookie_make(npc, slot);
+		if (cookie != ntohl(th->th_seq) + 1)
+			syncookie_challenge(npc, m, cookie);
+		return false;
+	}
+
+	if (flags == TH_RST) {
+		uint32_t seq = ntohl(th->th_seq);
+
+		if (seq == syncookie_make(npc, slot) ||
+		    seq == syncookie_make(npc, slot - 1)) {
+			syncookie_src_add(npc, now);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void npf_syncookie_set(uint32_t pct)
+{
+	if (!syncookie_secret)
+		syncookie_secret = rte_rand() | 1;
+
+	CMM_STORE_SHARED(npf_syncookie_pct, pct);
+}
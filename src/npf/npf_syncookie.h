@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef NPF_SYNCOOKIE_H
+#define NPF_SYNCOOKIE_H
+
+#include <rte_mbuf.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "npf/npf_cache.h"
+#include "session/session.h"
+#include "urcu.h"
+
+/*
+ * SYN authentication.
+ *
+ * Once the session table is filled past a configured share of its
+ * limit, an inbound SYN from a source not yet seen to complete a
+ * handshake gets no session.  Instead it is answered with a SYN-ACK
+ * whose ack is a cookie, not the client's ISN + 1.  A real client
+ * stack answers that with a RST carrying the cookie as its seq
+ * (RFC 793 3.4), which marks the source as validated for a while;
+ * its SYN retransmit then goes through as normal.  Spoofed sources
+ * never answer, so they cost a reply but no session state.
+ *
+ * The firewall sits between client and server, so unlike a SYN proxy
+ * this needs no sequence translation for the life of the session.
+ */
+
+/* Share of sessions-max, 0 when disabled */
+extern uint32_t npf_syncookie_pct;
+
+static inline bool npf_syncookie_active(void)
+{
+	uint32_t pct = CMM_LOAD_SHARED(npf_syncookie_pct);
+
+	return pct && session_table_above(pct);
+}
+
+/*
+ * For a TCP packet inbound with no session.  Returns false if the
+ * packet was a challenge or its answer, and so should be dropped.
+ */
+bool npf_syncookie_check(const npf_cache_t *npc, struct rte_mbuf *m);
+
+/* 0 disables, else the session table share to start challenging at */
+void npf_syncookie_set(uint32_t pct);
+
+#endif /* NPF_SYNCOOKIE_H */
@@ -33,10 +33,10 @@
  *
  * RCU protection is in place for:
  *
- * 1. Setting the table array pointer, nt_table
- * 2. Freeing the table array memory,
- * 2. Setting table entry pointers
- * 3. Freeing table entry memory (rcu callback)
+ * 1. Setting segment pointers in the segment array, nt_segs
+ * 2. Freeing the segment array and segments
+ * 3. Setting table entry pointers
+ * 4. Freeing table entry memory (rcu callback)
  *
  * The user is responsible for rcu-assigning their "struct npf_tbl" pointer.
  *
@@ -44,6 +44,11 @@
  *
  * A table may be re-sized if it reaches its maximum size and the
  * TS_TBL_RESIZE flag is set.
+ *
+ * The entry array is in fixed size segments.  The segment array is sized
+ * for the maximum table size when the table is created, so growing a table
+ * only allocates and adds one more segment.  Existing entries are never
+ * copied, and an entry ID always refers to the same slot.
  */
 
 
@@ -68,13 +73,15 @@ struct npf_tbl_entry {
 };
 
 #define TS_MEMGUARD 0xDEADBEEF
-#define TS_RESIZE_INCR_MAX 1024
+
+/* Most segments a table is split into */
+#define TS_SEGS_MAX 64
 
 /*
  * Table
  */
 struct npf_tbl {
-	struct npf_tbl_entry **nt_table;
+	struct npf_tbl_entry ***nt_segs; /* segment array */
 	zhash_t               *nt_hash;
 	struct rcu_head        nt_rcu;	/* rcu for freeing struct npf_tbl */
 	uint8_t                nt_flags;
@@ -85,6 +92,8 @@ struct npf_tbl {
 	uint                   nt_sz;     /* cur max entries */
 	uint                   nt_sz_max; /* absolute max entries */
 	uint                   nt_nentries; /* number of entries */
+	uint                   nt_nsegs;  /* segments allocated */
+	uint                   nt_seg_shift; /* log2 entries per segment */
 };
 
 /*
@@ -111,48 +120,90 @@ static struct npf_tbl_entry *npf_tbl_data2entry(void *data)
 }
 
 /*
- * Short lived structure used to rcu-free an nt_table array
+ * Get pointer to the array slot for an entry ID.  id must be less than
+ * nt_sz.
+ */
+static struct npf_tbl_entry **
+npf_tbl_slot(struct npf_tbl *nt, uint id)
+{
+	struct npf_tbl_entry **seg;
+
+	seg = rcu_dereference(nt->nt_segs[id >> nt->nt_seg_shift]);
+	return &seg[id & ((1u << nt->nt_seg_shift) - 1)];
+}
+
+/*
+ * Short lived structure used to rcu-free the segment array
  */
 struct npf_tbl_rcu {
-	struct rcu_head        tr_rcu;
-	struct npf_tbl_entry **tr_table;
+	struct rcu_head         tr_rcu;
+	struct npf_tbl_entry ***tr_segs;
+	uint                    tr_nsegs;
 };
 
 static void
-npf_tbl_table_free_rcu(struct rcu_head *head)
+npf_tbl_segs_free_rcu(struct rcu_head *head)
 {
 	struct npf_tbl_rcu *tr;
+	uint i;
 
 	tr = caa_container_of(head, struct npf_tbl_rcu, tr_rcu);
 
-	free(tr->tr_table);
+	for (i = 0; i < tr->tr_nsegs; i++)
+		free(tr->tr_segs[i]);
+	free(tr->tr_segs);
 	free(tr);
 }
 
 /*
- * RCU assign nt->nt_table pointer; and free old table if one exists
+ * Unset nt->nt_segs pointer, and rcu free the segment array and segments
  */
 static void
-npf_tbl_table_rcu_assign(struct npf_tbl *nt, struct npf_tbl_entry **ptr)
+npf_tbl_segs_rcu_free(struct npf_tbl *nt)
 {
-	struct npf_tbl_rcu *tr = NULL;
-
-	if (nt->nt_table) {
-		/*
-		 * If we fail to malloc tr then we will leak the old table
-		 * memory.  There is no good way to recover for this.  However
-		 * if that ever happens then the box is likely unusable
-		 * anyway.
-		 */
-		tr = malloc(sizeof(*tr));
-		if (tr)
-			tr->tr_table = nt->nt_table;
+	struct npf_tbl_rcu *tr;
+
+	if (!nt->nt_segs)
+		return;
+
+	/*
+	 * If we fail to malloc tr then we will leak the table memory.  There
+	 * is no good way to recover for this.  However if that ever happens
+	 * then the box is likely unusable anyway.
+	 */
+	tr = malloc(sizeof(*tr));
+	if (tr) {
+		tr->tr_segs = nt->nt_segs;
+		tr->tr_nsegs = nt->nt_nsegs;
 	}
 
-	rcu_assign_pointer(nt->nt_table, ptr);
+	rcu_assign_pointer(nt->nt_segs, NULL);
 
 	if (tr)
-		call_rcu(&tr->tr_rcu, npf_tbl_table_free_rcu);
+		call_rcu(&tr->tr_rcu, npf_tbl_segs_free_rcu);
+}
+
+/*
+ * Add a segment to the table, and make its entries visible
+ */
+static int npf_tbl_seg_add(struct npf_tbl *nt)
+{
+	struct npf_tbl_entry **seg;
+	uint seg_sz = 1u << nt->nt_seg_shift;
+
+	seg = zmalloc_aligned(seg_sz * sizeof(void *));
+	if (!seg)
+		return -ENOMEM;
+
+	rcu_assign_pointer(nt->nt_segs[nt->nt_nsegs], seg);
+	nt->nt_nsegs++;
+
+	/* Segment must be visible before the new size */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(nt->nt_sz,
+			 MIN(nt->nt_nsegs * seg_sz, nt->nt_sz_max));
+
+	return 0;
 }
 
 /*
@@ -162,39 +213,56 @@ struct npf_tbl *
 npf_tbl_create(uint32_t id, uint tbl_sz, uint tbl_sz_max, uint data_sz,
 	       uint8_t flags)
 {
-	struct npf_tbl_entry **table;
 	struct npf_tbl *nt;
+	uint shift, nsegs;
 
 	if (tbl_sz == 0 || data_sz == 0)
 		return NULL;
 
+	tbl_sz_max = MAX(tbl_sz, tbl_sz_max);
+
+	/*
+	 * Segments are at least the initial table size, and large enough
+	 * that no more than TS_SEGS_MAX are needed for the maximum size.
+	 */
+	for (shift = 0; (1u << shift) < tbl_sz; shift++)
+		;
+	while (((tbl_sz_max - 1) >> shift) >= TS_SEGS_MAX)
+		shift++;
+	nsegs = ((tbl_sz_max - 1) >> shift) + 1;
+
 	/* table container */
 	nt = zmalloc_aligned(sizeof(*nt));
 	if (!nt)
 		return NULL;
 
-	/* table */
-	table = zmalloc_aligned(tbl_sz * sizeof(void *));
-	if (!table) {
+	/* segment array */
+	nt->nt_segs = zmalloc_aligned(nsegs * sizeof(void *));
+	if (!nt->nt_segs) {
 		free(nt);
 		return NULL;
 	}
 
 	nt->nt_hash = zhash_new();
 	if (!nt->nt_hash) {
-		free(table);
+		free(nt->nt_segs);
 		free(nt);
 		return NULL;
 	}
 
 	nt->nt_id = id;
 	nt->nt_entry_data_sz = data_sz;
-	nt->nt_sz = tbl_sz;
-	nt->nt_sz_max = MAX(nt->nt_sz, tbl_sz_max);
+	nt->nt_sz_max = tbl_sz_max;
+	nt->nt_seg_shift = shift;
 	nt->nt_flags = TS_TBL_ACTIVE | (flags & TS_TBL_USER_MASK);
 
-	/* rcu assign nt->nt_table */
-	npf_tbl_table_rcu_assign(nt, table);
+	/* first segment */
+	if (npf_tbl_seg_add(nt) < 0) {
+		zhash_destroy(&nt->nt_hash);
+		free(nt->nt_segs);
+		free(nt);
+		return NULL;
+	}
 
 	return nt;
 }
@@ -206,7 +274,7 @@ npf_tbl_destroy_rcu(struct rcu_head *head)
 
 	nt = caa_container_of(head, struct npf_tbl, nt_rcu);
 
-	assert(nt->nt_table == NULL);
+	assert(nt->nt_segs == NULL);
 	free(nt);
 }
 
@@ -231,8 +299,8 @@ npf_tbl_destroy(struct npf_tbl *nt)
 
 	zhash_destroy(&nt->nt_hash);
 
-	/* rcu free nt_table */
-	npf_tbl_table_rcu_assign(nt, NULL);
+	/* rcu free nt_segs */
+	npf_tbl_segs_rcu_free(nt);
 
 	/* rcu free of nt */
 	call_rcu(&nt->nt_rcu, npf_tbl_destroy_rcu);
@@ -263,44 +331,16 @@ uint npf_tbl_size(struct npf_tbl *nt)
 /*
  * Resize a table
  *
- * If TS_TBL_RESIZE flag is set, then resize table when tables becomes full.
- * If the table size is less than 1024 then it is doubled in size, else it is
- * increased in size by 1024 entries.  Both are subject to an absolute maximum
- * of nt_sz_max entries.
+ * If TS_TBL_RESIZE flag is set, then add a segment when the table becomes
+ * full, subject to an absolute maximum of nt_sz_max entries.
  */
 static int npf_tbl_resize(struct npf_tbl *nt)
 {
-	struct npf_tbl_entry **old, **new;
-	uint i, new_sz;
-
 	if ((nt->nt_flags & TS_TBL_RESIZE) == 0 ||
 	    nt->nt_sz == nt->nt_sz_max)
 		return -ENOSPC;
 
-	/* Double in size up until 1024 entries, then increase by 1024 */
-	new_sz = nt->nt_sz + MIN(nt->nt_sz, TS_RESIZE_INCR_MAX);
-
-	/* But dont exceed the absolute maximum, nt_sz_max */
-	new_sz = MIN(new_sz, nt->nt_sz_max);
-
-	/* Allocate new table */
-	new = zmalloc_aligned(new_sz * sizeof(void *));
-	if (!new)
-		return -ENOMEM;
-
-	/* Copy across existing entries */
-	old = nt->nt_table;
-
-	for (i = 0; i < nt->nt_sz; i++)
-		new[i] = old[i];
-
-	/* rcu assign new nt_table, and rcu free old table */
-	npf_tbl_table_rcu_assign(nt, new);
-
-	/* finally make new space visible */
-	nt->nt_sz = new_sz;
-
-	return 0;
+	return npf_tbl_seg_add(nt);
 }
 
 /*
@@ -320,7 +360,7 @@ npf_tbl_entry_id_alloc(struct npf_tbl *nt, uint hint)
 		return -ENOSPC;
 
 	for (i = 0; i < nt->nt_sz; i++) {
-		if (!nt->nt_table[id])
+		if (!*npf_tbl_slot(nt, id))
 			return id;
 
 		if (++id >= nt->nt_sz)
@@ -456,7 +496,7 @@ npf_tbl_entry_insert(struct npf_tbl *nt, void *td)
 
 	/* Insert into table array */
 	te->te_id = id;
-	rcu_assign_pointer(nt->nt_table[te->te_id], te);
+	rcu_assign_pointer(*npf_tbl_slot(nt, te->te_id), te);
 
 	nt->nt_nentries++;
 	nt->nt_hint = id + 1;
@@ -487,11 +527,11 @@ npf_tbl_entry_remove(struct npf_tbl *nt, void *td)
 		return -EINVAL;
 
 	/* Don't remove and destroy an entry twice! */
-	if (!nt->nt_table[te->te_id] || te->te_tbl == NULL)
+	if (te->te_tbl == NULL || !*npf_tbl_slot(nt, te->te_id))
 		return -EEXIST;
 
 	assert(nt->nt_nentries > 0);
-	rcu_assign_pointer(nt->nt_table[te->te_id], NULL);
+	rcu_assign_pointer(*npf_tbl_slot(nt, te->te_id), NULL);
 	nt->nt_nentries--;
 
 	if (te->te_id < nt->nt_hint)
@@ -518,7 +558,7 @@ npf_tbl_walk(struct npf_tbl *nt, npf_tbl_walk_cb *cb, void *ctx)
 	int rc = 0;
 
 	for (i = 0; i < nt->nt_sz; i++) {
-		te = nt->nt_table[i];
+		te = *npf_tbl_slot(nt, i);
 		if (te) {
 			rc = (*cb)(te->te_name, te->te_id, te->te_data, ctx);
 			if (rc)
@@ -551,11 +591,11 @@ npf_tbl_id2name(struct npf_tbl *nt, uint id)
 {
 	struct npf_tbl_entry *te;
 
-	if (unlikely(nt == NULL || nt->nt_table == NULL ||
+	if (unlikely(nt == NULL || nt->nt_segs == NULL ||
 		     id >= nt->nt_sz))
 		return NULL;
 
-	te = nt->nt_table[id];
+	te = *npf_tbl_slot(nt, id);
 	if (te)
 		return te->te_name;
 
@@ -588,11 +628,11 @@ npf_tbl_id_lookup(struct npf_tbl *nt, uint id)
 {
 	struct npf_tbl_entry *te;
 
-	if (unlikely(nt == NULL || nt->nt_table == NULL ||
+	if (unlikely(nt == NULL || nt->nt_segs == NULL ||
 		     (nt->nt_flags & TS_TBL_ACTIVE) == 0 ||
-		     id >= nt->nt_sz))
+		     id >= CMM_LOAD_SHARED(nt->nt_sz)))
 		return NULL;
 
-	te = rcu_dereference(nt->nt_table[id]);
+	te = rcu_dereference(*npf_tbl_slot(nt, id));
 	return te ? te->te_data : NULL;
 }
@@ -21,10 +21,10 @@
  *
  * RCU protection is in place for:
  *
- * 1. Setting the table array pointer, nt_table
- * 2. Freeing the table array memory, nt_table
- * 2. Setting table entry pointers
- * 3. Freeing table entry memory (rcu callback)
+ * 1. Setting table segment pointers
+ * 2. Freeing the table segments
+ * 3. Setting table entry pointers
+ * 4. Freeing table entry memory (rcu callback)
  *
  * The user is responsible for rcu-assigning their "struct npf_tbl" pointer.
  *
@@ -51,10 +51,10 @@
 /*
  * User flags.
  *
- * TS_TBL_RESIZE Resize table when tables becomes full.  If the table size is
- * less than 1024 then it is doubled in size, else it is increased in size by
- * 1024 entries.  Both are subject to an absolute maximum of tbl_sz_max
- * entries.
+ * TS_TBL_RESIZE Resize table when tables becomes full.  The table grows by
+ * one segment at a time, without copying existing entries, subject to an
+ * absolute maximum of tbl_sz_max entries.  Segments are at least tbl_sz
+ * entries, and a table has at most 64 of them.
  */
 #define TS_TBL_RESIZE     0x01
 #define TS_TBL_USER_MASK  0x0F
@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#include <rte_branch_prediction.h>
+#include <rte_common.h>
+#include <rte_jhash.h>
+#include <rte_log.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "npf/npf_cache.h"
+#include "npf/npf_ruleset.h"
+#include "npf/npf_tss.h"
+#include "vplane_log.h"
+
+/*
+ * Rules are added in evaluation order, so a rule's index is its priority.
+ *
+ * At optimize time each distinct mask becomes a tuple.  A lookup masks the
+ * packet once per tuple and probes that tuple's hash table.  Tuples are
+ * sorted by their highest priority rule, so the search stops as soon as no
+ * remaining tuple can hold a better match than the one already found.
+ */
+
+#define TSS_MAX_TABLES	NPC_GPR_SIZE_v6
+
+struct tss_entry {
+	struct tss_entry	*te_next;
+	uint32_t		te_hash;
+	uint32_t		te_nrules;
+	uint32_t		*te_rules;	/* rule indices, ascending */
+	uint8_t			te_key[];
+};
+
+struct tss_tuple {
+	uint8_t			tt_care[TSS_MAX_TABLES];
+	uint32_t		tt_min_index;
+	uint32_t		tt_nentries;
+	uint32_t		tt_bucket_mask;
+	struct tss_entry	**tt_buckets;
+};
+
+struct tss_config {
+	uint			tc_num_tables;
+	uint32_t		tc_num_rules;
+	uint32_t		tc_alloc_rules;
+	uint32_t		tc_num_tuples;
+	void			**tc_md;	/* datum returned on a match */
+	uint8_t			*tc_match;	/* num_rules x num_tables */
+	uint8_t			*tc_care;	/* num_rules x num_tables */
+	uint32_t		*tc_tuple;	/* rule to tuple index */
+	struct tss_tuple	*tc_tuples;
+};
+
+tss_config_t *tss_init(uint num_tables)
+{
+	tss_config_t *conf;
+
+	if (num_tables < 1 || num_tables > TSS_MAX_TABLES)
+		return NULL;
+
+	conf = calloc(1, sizeof(*conf));
+	if (!conf) {
+		RTE_LOG(ERR, FIREWALL, "Error in tss allocation\n");
+		return NULL;
+	}
+	conf->tc_num_tables = num_tables;
+	return conf;
+}
+
+/*
+ * Add a rule.  Rules must be added in the order they are evaluated.
+ */
+bool
+tss_add(tss_config_t *conf, void *match_data,
+	const uint8_t *match, const uint8_t *mask)
+{
+	uint n, i;
+
+	if (!conf || !match || !mask || conf->tc_tuples)
+		return false;
+
+	n = conf->tc_num_tables;
+
+	if (conf->tc_num_rules == conf->tc_alloc_rules) {
+		uint32_t alloc = conf->tc_alloc_rules ?
+			conf->tc_alloc_rules * 2 : 64;
+		void **md = realloc(conf->tc_md, alloc * sizeof(void *));
+
+		if (!md)
+			return false;
+		conf->tc_md = md;
+
+		uint8_t *m = realloc(conf->tc_match, alloc * n);
+		if (!m)
+			return false;
+		conf->tc_match = m;
+
+		m = realloc(conf->tc_care, alloc * n);
+		if (!m)
+			return false;
+		conf->tc_care = m;
+
+		conf->tc_alloc_rules = alloc;
+	}
+
+	uint8_t *r_match = &conf->tc_match[conf->tc_num_rules * n];
+	uint8_t *r_care = &conf->tc_care[conf->tc_num_rules * n];
+
+	for (i = 0; i < n; i++) {
+		r_care[i] = ~mask[i];
+		r_match[i] = match[i] & r_care[i];
+	}
+	conf->tc_md[conf->tc_num_rules++] = match_data;
+
+	return true;
+}
+
+static struct tss_entry *
+tss_entry_find(const struct tss_tuple *tt, const uint8_t *key, uint n,
+	       uint32_t hash)
+{
+	struct tss_entry *te;
+
+	for (te = tt->tt_buckets[hash & tt->tt_bucket_mask]; te;
+	     te = te->te_next) {
+		if (te->te_hash == hash && memcmp(te->te_key, key, n) == 0)
+			return te;
+	}
+	return NULL;
+}
+
+/*
+ * Build the tuples and their hash tables once all rules have been added.
+ */
+bool
+tss_optimize(tss_config_t *conf)
+{
+	uint n = conf ? conf->tc_num_tables : 0;
+	uint32_t r, t;
+
+	if (!conf || conf->tc_tuples || !conf->tc_num_rules)
+		return conf != NULL;
+
+	conf->tc_tuple = malloc(conf->tc_num_rules * sizeof(uint32_t));
+	if (!conf->tc_tuple)
+		goto error;
+
+	/*
+	 * Assign each rule to a tuple.  Tuples are created in rule order,
+	 * so they are already sorted by their highest priority rule.
+	 */
+	for (r = 0; r < conf->tc_num_rules; r++) {
+		const uint8_t *care = &conf->tc_care[r * n];
+
+		for (t = 0; t < conf->tc_num_tuples; t++)
+			if (!memcmp(conf->tc_tuples[t].tt_care, care, n))
+				break;
+
+		if (t == conf->tc_num_tuples) {
+			struct tss_tuple *tuples;
+
+			tuples = realloc(conf->tc_tuples,
+					 (t + 1) * sizeof(*tuples));
+			if (!tuples)
+				goto error;
+			conf->tc_tuples = tuples;
+			memset(&tuples[t], 0, sizeof(*tuples));
+			memcpy(tuples[t].tt_care, care, n);
+			tuples[t].tt_min_index = r;
+			conf->tc_num_tuples++;
+		}
+		conf->tc_tuples[t].tt_nentries++;
+		conf->tc_tuple[r] = t;
+	}
+
+	for (t = 0; t < conf->tc_num_tuples; t++) {
+		struct tss_tuple *tt = &conf->tc_tuples[t];
+		uint32_t nbuckets = rte_align32pow2(tt->tt_nentries * 2);
+
+		tt->tt_buckets = calloc(nbuckets, sizeof(*tt->tt_buckets));
+		if (!tt->tt_buckets)
+			goto error;
+		tt->tt_bucket_mask = nbuckets - 1;
+		tt->tt_nentries = 0;
+	}
+
+	/* Populate.  Rules are visited in order, so lists stay sorted */
+	for (r = 0; r < conf->tc_num_rules; r++) {
+		struct tss_tuple *tt = &conf->tc_tuples[conf->tc_tuple[r]];
+		const uint8_t *key = &conf->tc_match[r * n];
+		uint32_t hash = rte_jhash(key, n, 0);
+		struct tss_entry *te;
+		uint32_t *rules;
+
+		te = tss_entry_find(tt, key, n, hash);
+		if (!te) {
+			te = calloc(1, sizeof(*te) + n);
+			if (!te)
+				goto error;
+			te->te_hash = hash;
+			memcpy(te->te_key, key, n);
+			te->te_next = tt->tt_buckets[hash & tt->tt_bucket_mask];
+			tt->tt_buckets[hash & tt->tt_bucket_mask] = te;
+			tt->tt_nentries++;
+		}
+
+		rules = realloc(te->te_rules,
+				(te->te_nrules + 1) * sizeof(uint32_t));
+		if (!rules)
+			goto error;
+		te->te_rules = rules;
+		te->te_rules[te->te_nrules++] = r;
+	}
+
+	/* The staging arrays are no longer needed */
+	free(conf->tc_match);
+	free(conf->tc_care);
+	free(conf->tc_tuple);
+	conf->tc_match = NULL;
+	conf->tc_care = NULL;
+	conf->tc_tuple = NULL;
+
+	return true;
+
+error:
+	RTE_LOG(ERR, FIREWALL, "Error in tss table allocation\n");
+	return false;
+}
+
+/*
+ * Returns the datum of the first rule, in evaluation order, which both
+ * matches the packet and passes npf_rule_proc().
+ */
+void *
+tss_eval(const tss_config_t *conf, const uint8_t *packet, const void *data)
+{
+	uint n = conf->tc_num_tables;
+	uint32_t best = UINT32_MAX;
+	uint8_t key[TSS_MAX_TABLES];
+	uint32_t t, i;
+
+	for (t = 0; t < conf->tc_num_tuples; t++) {
+		const struct tss_tuple *tt = &conf->tc_tuples[t];
+		const struct tss_entry *te;
+
+		if (tt->tt_min_index >= best)
+			break;
+
+		for (i = 0; i < n; i++)
+			key[i] = packet[i] & tt->tt_care[i];
+
+		te = tss_entry_find(tt, key, n, rte_jhash(key, n, 0));
+		if (!te)
+			continue;
+
+		for (i = 0; i < te->te_nrules; i++) {
+			uint32_t r = te->te_rules[i];
+
+			if (r >= best)
+				break;
+
+			if (npf_rule_proc(data, conf->tc_md[r])) {
+				best = r;
+				break;
+			}
+		}
+	}
+	return best == UINT32_MAX ? NULL : conf->tc_md[best];
+}
+
+void
+tss_destroy(tss_config_t **confp)
+{
+	tss_config_t *conf;
+	uint32_t t, b;
+
+	if (!confp || !*confp)
+		return;
+
+	conf = *confp;
+
+	for (t = 0; t < conf->tc_num_tuples; t++) {
+		struct tss_tuple *tt = &conf->tc_tuples[t];
+
+		if (!tt->tt_buckets)
+			continue;
+
+		for (b = 0; b <= tt->tt_bucket_mask; b++) {
+			struct tss_entry *te, *next;
+
+			for (te = tt->tt_buckets[b]; te; te = next) {
+				next = te->te_next;
+				free(te->te_rules);
+				free(te);
+			}
+		}
+		free(tt->tt_buckets);
+	}
+
+	free(conf->tc_tuples);
+	free(conf->tc_tuple);
+	free(conf->tc_match);
+	free(conf->tc_care);
+	free(conf->tc_md);
+	free(conf);
+	*confp = NULL;
+}
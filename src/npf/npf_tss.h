@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef NPF_TSS_H
+#define NPF_TSS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Tuple space search classifier.
+ *
+ * An alternative to grouper2 for large rule groups.  Rules are grouped
+ * into tuples by their grouper mask, and each tuple holds a hash table of
+ * the masked match values.  Memory is proportional to the number of
+ * rules rather than to rules x 256 x tables.
+ *
+ * Uses the same match/mask byte layout as grouper2 (a mask bit of 1 is
+ * "don't care"), and the same npf_rule_proc() callback to verify a
+ * candidate rule.
+ */
+typedef struct tss_config tss_config_t;
+
+tss_config_t *tss_init(uint num_tables);
+bool tss_add(tss_config_t *conf, void *match_data,
+	     const uint8_t *match, const uint8_t *mask);
+bool tss_optimize(tss_config_t *conf);
+void *tss_eval(const tss_config_t *conf, const uint8_t *packet,
+	       const void *data);
+void tss_destroy(tss_config_t **confp);
+
+#endif /* NPF_TSS_H */
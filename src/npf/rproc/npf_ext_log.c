@@ -47,15 +47,25 @@
 #include <netinet/ip_icmp.h>
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <rte_atomic.h>
 #include <rte_ether.h>
+#include <rte_lcore.h>
 #include <rte_log.h>
 #include <rte_mbuf.h>
+#include <rte_mempool.h>
+#include <rte_memory.h>
+#include <rte_ring.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <urcu/system.h>
 
 #include "compiler.h"
 #include "if_var.h"
@@ -68,7 +78,9 @@
 #include "npf/npf_session.h"
 #include "npf/rproc/npf_ext_log.h"
 #include "pktmbuf.h"
+#include "soft_ticks.h"
 #include "util.h"
+#include "vplane_log.h"
 
 #define BUF_SIZE        64
 #define PRBUF_SIZE      128
@@ -84,17 +96,11 @@ static char const *ecn_txt[] = {
 };
 
 static void
-npf_log_mac_fields(const struct rte_mbuf *mbuf,
-		   char const *mprefix, char *macs_buf,
-		   char const *eprefix, char *etype_buf)
+npf_log_mac_str(const struct ether_addr *s_addr,
+		const struct ether_addr *d_addr, uint16_t etype,
+		char const *mprefix, char *macs_buf,
+		char const *eprefix, char *etype_buf)
 {
-	if (pktmbuf_l2_len(mbuf) != ETHER_HDR_LEN &&
-	    pktmbuf_l2_len(mbuf) != VLAN_HDR_LEN)
-		return;
-
-	const struct ether_hdr *eth
-		= rte_pktmbuf_mtod(mbuf, struct ether_hdr *);
-
 	unsigned int pl;
 	char *bp;
 
@@ -105,24 +111,45 @@ npf_log_mac_fields(const struct rte_mbuf *mbuf,
 	memcpy(bp, mprefix, pl + 1);
 	bp += pl;
 
-	ether_ntoa_r(&eth->s_addr, bp);
+	ether_ntoa_r(s_addr, bp);
 	bp += strlen(bp);
 
 	*bp++ = '-';
 	*bp++ = '>';
 
-	ether_ntoa_r(&eth->d_addr, bp);
+	ether_ntoa_r(d_addr, bp);
 	bp += strlen(bp);
 
 	*bp++ = ' ';
 	*bp++ = '\0';
 
 	/* Now the ethertype */
-	uint16_t etype = ntohs(ethtype(mbuf, ETHER_TYPE_VLAN));
-
 	snprintf(etype_buf, BUF_SIZE, "%s%04X", eprefix, etype);
 }
 
+static bool
+npf_log_has_mac(const struct rte_mbuf *mbuf)
+{
+	return pktmbuf_l2_len(mbuf) == ETHER_HDR_LEN ||
+		pktmbuf_l2_len(mbuf) == VLAN_HDR_LEN;
+}
+
+static void
+npf_log_mac_fields(const struct rte_mbuf *mbuf,
+		   char const *mprefix, char *macs_buf,
+		   char const *eprefix, char *etype_buf)
+{
+	if (!npf_log_has_mac(mbuf))
+		return;
+
+	const struct ether_hdr *eth
+		= rte_pktmbuf_mtod(mbuf, struct ether_hdr *);
+
+	npf_log_mac_str(&eth->s_addr, &eth->d_addr,
+			ntohs(ethtype(mbuf, ETHER_TYPE_VLAN)),
+			mprefix, macs_buf, eprefix, etype_buf);
+}
+
 static void
 npf_log_ipv4_header(const struct ip *ip, char *ip_buf, uint32_t buf_size)
 {
@@ -273,6 +300,13 @@ npf_log_icmpv6_header(const struct icmp6_hdr *icmp6,
 		class, type, icmp6->icmp6_code);
 }
 
+/* Per-lcore state for rate limited rules */
+struct npf_log_lcore {
+	uint64_t    ll_window;	/* start of current second (soft_ticks) */
+	uint32_t    ll_count;	/* lines logged in current second */
+	uint32_t    ll_suppressed;	/* lines not logged since last one */
+} __rte_cache_aligned;
+
 /*
  * Log action data structure
  */
@@ -281,6 +315,14 @@ struct npf_log_data {
 	uint32_t    ld_type;
 	bool        ld_is_l2;
 	bool        ld_is_nat44;
+	bool        ld_async;
+
+	/* Log lines per second per lcore, 0 for no limit */
+	uint32_t    ld_rate;
+	struct npf_log_lcore *ld_lcore;
+
+	/* Held by the rule and by each queued async record */
+	rte_atomic32_t ld_refcnt;
 
 	/* The following are only set if rule attach point is an interface */
 	bool        ld_has_ether;
@@ -292,13 +334,67 @@ struct npf_log_data {
 	char        ld_ifname[IFNAMSIZ];
 };
 
+static int npf_log_async_init(void);
+
+/*
+ * Optional comma separated params:
+ *   async          - snapshot packets to a ring drained by the logger thread
+ *   rate-limit=<n> - log at most n lines per second on each lcore
+ */
+static int
+npf_log_parse_params(struct npf_log_data *ld, const char *params)
+{
+	char *args, *tok, *saveptr = NULL;
+
+	if (!params)
+		return 0;
+
+	args = strdupa(params);
+	for (tok = strtok_r(args, ",", &saveptr); tok;
+	     tok = strtok_r(NULL, ",", &saveptr)) {
+		char *end;
+
+		if (!strcmp(tok, "async")) {
+			ld->ld_async = true;
+		} else if (!strncmp(tok, "rate-limit=", 11)) {
+			ld->ld_rate = strtoul(tok + 11, &end, 10);
+			if (*end != '\0' || ld->ld_rate == 0)
+				return -EINVAL;
+		} else if (*tok != '\0') {
+			return -EINVAL;
+		}
+	}
+
+	if (ld->ld_rate) {
+		ld->ld_lcore = zmalloc_aligned((get_lcore_max() + 1) *
+					       sizeof(*ld->ld_lcore));
+		if (!ld->ld_lcore)
+			return -ENOMEM;
+	}
+
+	/* Log synchronously if the logger can not be started */
+	if (ld->ld_async && npf_log_async_init() < 0)
+		ld->ld_async = false;
+
+	return 0;
+}
+
+static void
+npf_log_data_put(struct npf_log_data *ld)
+{
+	if (!rte_atomic32_dec_and_test(&ld->ld_refcnt))
+		return;
+
+	free(ld->ld_lcore);
+	free(ld->ld_rule_buf);
+	free(ld);
+}
+
 /*
  * Log creator
- *
- * Pre-compute as much as possible from the rule and its attach point.
  */
 static int
-npf_log_create(npf_rule_t *rl, const char *args __unused, void **handle)
+npf_log_create(npf_rule_t *rl, const char *args, void **handle)
 {
 	struct npf_log_data *ld;
 	enum npf_ruleset_type rlset_type;
@@ -339,6 +435,14 @@ npf_log_create(npf_rule_t *rl, const char *args __unused, void **handle)
 		return -ENOMEM;
 	}
 
+	rte_atomic32_set(&ld->ld_refcnt, 1);
+
+	cc = npf_log_parse_params(ld, args);
+	if (cc < 0) {
+		npf_log_data_put(ld);
+		return cc;
+	}
+
 	ifp = npf_rule_get_ifp(rl);
 
 	if (ifp) {
@@ -364,10 +468,8 @@ npf_log_destroy(void *handle)
 {
 	struct npf_log_data *ld = handle;
 
-	if (ld) {
-		free(ld->ld_rule_buf);
-		free(ld);
-	}
+	if (ld)
+		npf_log_data_put(ld);
 }
 
 /*
@@ -490,43 +592,30 @@ npf_log_ip_pkt(npf_cache_t *npc, char *out_buf, uint32_t buf_size,
  *
  *    "Out:dp0s5 PASS fw rule stPassAllIn:10 "
  *
- * followed by the per packet information as shown above.
+ * followed by the per packet information as shown above.  For an ICMP
+ * error, enpc is the embedded packet (if it could be parsed).  The
+ * extra string is appended as is.
  */
-void
-npf_log_pkt(npf_cache_t *npc, struct rte_mbuf *mbuf, npf_rule_t *rl,
-	    int dir)
+static void
+npf_log_emit(const struct npf_log_data *ld, bool pass, int dir,
+	     npf_cache_t *npc, char const *macs, char const *etype,
+	     npf_cache_t *enpc, char const *extra)
 {
-	struct npf_log_data *ld = npf_rule_rproc_handle_for_logger(rl);
-	if (!ld)
-		return;
-
 	char const *rule = ld->ld_rule_buf;
 	uint32_t log_type = ld->ld_type;
 	char const *if_name = ld->ld_ifname;
-	char const *fate = npf_rule_get_pass(rl) ?
+	char const *fate = pass ?
 				(ld->ld_is_nat44 ? "TRAN" : "PASS") :
 				(ld->ld_is_nat44 ? "EXCL" : "DROP");
-	bool const want_mac =
-		ld->ld_has_ether && (dir == PFIL_IN || ld->ld_is_l2);
-
-	/* Get the MAC fields */
-	char macs[ETH_ADDR_STR_LEN*2 + sizeof("-> ") + sizeof("macs=")];
-	char etype[BUF_SIZE];
-	macs[0] = '\0';
-	etype[0] = '\0';
-
-	if (want_mac)
-		npf_log_mac_fields(mbuf, "macs=", macs, "etype=", etype);
-
 	char const *dirn = (dir == PFIL_IN) ? " In" : "Out";
 
 	/* Non IP packets handled here */
 	if (!npf_iscached(npc, NPC_IP46)) {
 		NPF_LOG(log_type,
 			"%s:%s %s %s "
-			"%s %s",
+			"%s %s%s",
 			dirn, if_name, fate, rule,
-			macs, etype);
+			macs, etype, extra);
 		return;
 	}
 
@@ -540,13 +629,12 @@ npf_log_pkt(npf_cache_t *npc, struct rte_mbuf *mbuf, npf_rule_t *rl,
 	npf_log_ip_pkt(npc, main_buf, sizeof(main_buf), macs, icmp_err);
 
 	/* The simple IP case, not an ICMP error */
-	if (!icmp_err) {
-simple_ip:
+	if (!icmp_err || !enpc) {
 		NPF_LOG(log_type,
 			"%s:%s %s %s "
-			"%s",
+			"%s%s",
 			dirn, if_name, fate, rule,
-			main_buf);
+			main_buf, extra);
 
 		return;
 	}
@@ -555,6 +643,20 @@ simple_ip:
 	char err_buf[1024];
 	err_buf[0] = '\0';
 
+	npf_log_ip_pkt(enpc, err_buf, sizeof(err_buf), "",
+		       npf_iscached(enpc, NPC_ICMP_ERR));
+
+	NPF_LOG(log_type,
+		"%s:%s %s %s "
+		"%s >TRIGGER> %s%s",
+		dirn, if_name, fate, rule,
+		main_buf, err_buf, extra);
+}
+
+/* Parse the packet embedded in an ICMP error */
+static bool
+npf_log_embedded(npf_cache_t *npc, struct rte_mbuf *mbuf, npf_cache_t *enpc)
+{
 	uint16_t ether_proto;
 	if (npf_iscached(npc, NPC_IP4))
 		ether_proto = htons(ETHER_TYPE_IPv4);
@@ -566,24 +668,308 @@ simple_ip:
 	/* Find the start of the packet embedded in the ICMP error. */
 	n_ptr = nbuf_advance(&mbuf, n_ptr, ICMP_MINLEN);
 	if (!n_ptr)
-		goto simple_ip;
+		return false;
 
 	/* Init the embedded npc. */
-	npf_cache_t enpc;
-	npf_cache_init(&enpc);
+	npf_cache_init(enpc);
 
 	/* Inspect the embedded packet. */
-	if (!npf_cache_all_at(&enpc, mbuf, n_ptr, ether_proto, true))
-		goto simple_ip;
+	return npf_cache_all_at(enpc, mbuf, n_ptr, ether_proto, true);
+}
 
-	npf_log_ip_pkt(&enpc, err_buf, sizeof(err_buf), "",
-		       npf_iscached(&enpc, NPC_ICMP_ERR));
+/*
+ * Rate limit check.  Returns false if the line is to be suppressed,
+ * otherwise returns the number suppressed since the last line logged
+ * on this lcore.  Non dataplane threads share lcore 0, the counts are
+ * only approximate for them.
+ */
+static bool
+npf_log_rate_check(struct npf_log_data *ld, uint32_t *suppressed)
+{
+	struct npf_log_lcore *ll = &ld->ld_lcore[dp_lcore_id()];
+	uint64_t now = soft_ticks;
 
-	NPF_LOG(log_type,
-		"%s:%s %s %s "
-		"%s >TRIGGER> %s",
-		dirn, if_name, fate, rule,
-		main_buf, err_buf);
+	if (now - ll->ll_window >= 1000) {
+		ll->ll_window = now;
+		ll->ll_count = 0;
+	}
+
+	if (ll->ll_count >= ld->ld_rate) {
+		ll->ll_suppressed++;
+		return false;
+	}
+
+	ll->ll_count++;
+	*suppressed = ll->ll_suppressed;
+	ll->ll_suppressed = 0;
+	return true;
+}
+
+/*
+ * Asynchronous logging.
+ *
+ * Formatting a log line and handing it to the logging subsystem costs
+ * far more than forwarding the packet.  For rules with the "async"
+ * param, a forwarding lcore copies the parsed packet into a record
+ * from a mempool and enqueues it on its own ring.  The logger thread
+ * drains the rings, formats and logs the records.  If a ring or the
+ * pool is exhausted the record is dropped and counted, rather than
+ * stalling the forwarding lcore.
+ */
+#define NPF_LOG_POOL_SZ		8191
+#define NPF_LOG_POOL_CACHE	32
+#define NPF_LOG_RING_SZ		1024
+#define NPF_LOG_BURST		32
+#define NPF_LOG_IDLE_US		10000	/* 10ms */
+
+struct npf_log_rec {
+	struct npf_log_data *lr_ld;
+	struct timespec	lr_ts;
+	uint32_t	lr_suppressed;
+	int		lr_dir;
+	bool		lr_pass;
+	bool		lr_has_mac;
+	bool		lr_has_enpc;
+	uint16_t	lr_etype;
+	struct ether_addr lr_src;
+	struct ether_addr lr_dst;
+	npf_cache_t	lr_npc;
+	npf_cache_t	lr_enpc;
+};
+
+static struct rte_mempool *npf_log_pool;
+static struct rte_ring *npf_log_ring[RTE_MAX_LCORE];
+static uint64_t npf_log_drops[RTE_MAX_LCORE];
+static pthread_t npf_log_thread;
+static bool npf_log_thread_running;
+
+/* Copy an npc, keeping the address pointer within the copy */
+static void
+npf_log_cache_copy(npf_cache_t *to, const npf_cache_t *from)
+{
+	*to = *from;
+	to->npc_tuple = NULL;
+
+	if (npf_iscached(from, NPC_IP46))
+		to->npc_srcdst = (npf_srcdst_t *)
+			((char *)&to->npc_ip +
+			 ((const char *)from->npc_srcdst -
+			  (const char *)&from->npc_ip));
+}
+
+static void
+npf_log_rec_emit(struct npf_log_rec *lr)
+{
+	char macs[ETH_ADDR_STR_LEN*2 + sizeof("-> ") + sizeof("macs=")];
+	char etype[BUF_SIZE];
+	char extra[BUF_SIZE];
+	int len = 0;
+
+	macs[0] = '\0';
+	etype[0] = '\0';
+	extra[0] = '\0';
+
+	if (lr->lr_has_mac)
+		npf_log_mac_str(&lr->lr_src, &lr->lr_dst, lr->lr_etype,
+				"macs=", macs, "etype=", etype);
+
+	if (lr->lr_suppressed)
+		len = snprintf(extra, sizeof(extra), " suppressed=%u",
+			       lr->lr_suppressed);
+	snprintf(extra + len, sizeof(extra) - len, " ts=%ld.%06ld",
+		 (long)lr->lr_ts.tv_sec, lr->lr_ts.tv_nsec / 1000);
+
+	npf_log_emit(lr->lr_ld, lr->lr_pass, lr->lr_dir, &lr->lr_npc,
+		     macs, etype, lr->lr_has_enpc ? &lr->lr_enpc : NULL,
+		     extra);
+}
+
+static void *
+npf_log_thread_fn(void *arg __unused)
+{
+	struct npf_log_rec *recs[NPF_LOG_BURST];
+	uint64_t reported[RTE_MAX_LCORE] = { 0 };
+	unsigned int lcore, i, n;
+	bool idle;
+
+	pthread_setname_np(pthread_self(), "dataplane/log");
+
+	for (;;) {
+		idle = true;
+
+		FOREACH_DP_LCORE(lcore) {
+			struct rte_ring *ring = npf_log_ring[lcore];
+			uint64_t drops;
+
+			if (!ring)
+				continue;
+
+			drops = CMM_LOAD_SHARED(npf_log_drops[lcore]);
+			if (drops != reported[lcore]) {
+				RTE_LOG(NOTICE, DATAPLANE,
+					"npf log: %"PRIu64" lines dropped on lcore %u\n",
+					drops - reported[lcore], lcore);
+				reported[lcore] = drops;
+			}
+
+			n = rte_ring_sc_dequeue_burst(ring, (void **)recs,
+						      NPF_LOG_BURST, NULL);
+			if (n)
+				idle = false;
+
+			for (i = 0; i < n; i++) {
+				struct npf_log_data *ld = recs[i]->lr_ld;
+
+				npf_log_rec_emit(recs[i]);
+				rte_mempool_put(npf_log_pool, recs[i]);
+				npf_log_data_put(ld);
+			}
+		}
+
+		if (idle)
+			usleep(NPF_LOG_IDLE_US);
+	}
+
+	return NULL;
+}
+
+/*
+ * Create the pool, rings and logger thread on first use.  Called
+ * from the rproc ctor on the master thread.
+ */
+static int
+npf_log_async_init(void)
+{
+	char name[RTE_RING_NAMESIZE];
+	unsigned int lcore;
+
+	if (npf_log_thread_running)
+		return 0;
+
+	if (!npf_log_pool) {
+		npf_log_pool = rte_mempool_create("npf-log", NPF_LOG_POOL_SZ,
+						  sizeof(struct npf_log_rec),
+						  NPF_LOG_POOL_CACHE, 0,
+						  NULL, NULL, NULL, NULL,
+						  SOCKET_ID_ANY, 0);
+		if (!npf_log_pool)
+			goto fail;
+	}
+
+	FOREACH_DP_LCORE(lcore) {
+		if (npf_log_ring[lcore])
+			continue;
+
+		/* Non dataplane threads share lcore 0, so multi producer */
+		snprintf(name, sizeof(name), "npf-log-%u", lcore);
+		npf_log_ring[lcore] = rte_ring_create(name, NPF_LOG_RING_SZ,
+						      rte_lcore_to_socket_id(lcore),
+						      RING_F_SC_DEQ);
+		if (!npf_log_ring[lcore])
+			goto fail;
+	}
+
+	if (pthread_create(&npf_log_thread, NULL, npf_log_thread_fn,
+			   NULL) != 0)
+		goto fail;
+
+	npf_log_thread_running = true;
+	return 0;
+
+fail:
+	RTE_LOG(ERR, DATAPLANE,
+		"npf log: async logging unavailable, logging inline\n");
+	return -ENOMEM;
+}
+
+static void
+npf_log_enqueue(struct npf_log_data *ld, npf_cache_t *npc,
+		struct rte_mbuf *mbuf, int dir, bool pass, bool want_mac,
+		uint32_t suppressed)
+{
+	unsigned int lcore = dp_lcore_id();
+	struct npf_log_rec *lr;
+
+	if (unlikely(rte_mempool_get(npf_log_pool, (void **)&lr) != 0)) {
+		npf_log_drops[lcore]++;
+		return;
+	}
+
+	clock_gettime(CLOCK_REALTIME_COARSE, &lr->lr_ts);
+	lr->lr_ld = ld;
+	lr->lr_suppressed = suppressed;
+	lr->lr_dir = dir;
+	lr->lr_pass = pass;
+	lr->lr_has_mac = want_mac && npf_log_has_mac(mbuf);
+	if (lr->lr_has_mac) {
+		const struct ether_hdr *eth
+			= rte_pktmbuf_mtod(mbuf, struct ether_hdr *);
+
+		ether_addr_copy(&eth->s_addr, &lr->lr_src);
+		ether_addr_copy(&eth->d_addr, &lr->lr_dst);
+		lr->lr_etype = ntohs(ethtype(mbuf, ETHER_TYPE_VLAN));
+	}
+
+	npf_log_cache_copy(&lr->lr_npc, npc);
+
+	/* The embedded packet is only in the mbuf, so parse it now */
+	lr->lr_has_enpc = npf_iscached(npc, NPC_IP46) &&
+		npf_iscached(npc, NPC_ICMP_ERR) &&
+		npf_log_embedded(npc, mbuf, &lr->lr_enpc);
+
+	rte_atomic32_inc(&ld->ld_refcnt);
+
+	if (unlikely(rte_ring_mp_enqueue(npf_log_ring[lcore], lr) != 0)) {
+		rte_atomic32_dec(&ld->ld_refcnt);
+		rte_mempool_put(npf_log_pool, lr);
+		npf_log_drops[lcore]++;
+	}
+}
+
+void
+npf_log_pkt(npf_cache_t *npc, struct rte_mbuf *mbuf, npf_rule_t *rl,
+	    int dir)
+{
+	struct npf_log_data *ld = npf_rule_rproc_handle_for_logger(rl);
+	uint32_t suppressed = 0;
+
+	if (!ld)
+		return;
+
+	if (ld->ld_rate && !npf_log_rate_check(ld, &suppressed))
+		return;
+
+	bool const pass = npf_rule_get_pass(rl);
+	bool const want_mac =
+		ld->ld_has_ether && (dir == PFIL_IN || ld->ld_is_l2);
+
+	if (ld->ld_async) {
+		npf_log_enqueue(ld, npc, mbuf, dir, pass, want_mac,
+				suppressed);
+		return;
+	}
+
+	/* Get the MAC fields */
+	char macs[ETH_ADDR_STR_LEN*2 + sizeof("-> ") + sizeof("macs=")];
+	char etype[BUF_SIZE];
+	char extra[BUF_SIZE];
+	macs[0] = '\0';
+	etype[0] = '\0';
+	extra[0] = '\0';
+
+	if (want_mac)
+		npf_log_mac_fields(mbuf, "macs=", macs, "etype=", etype);
+
+	if (suppressed)
+		snprintf(extra, sizeof(extra), " suppressed=%u", suppressed);
+
+	npf_cache_t enpc;
+	bool has_enpc = npf_iscached(npc, NPC_IP46) &&
+		npf_iscached(npc, NPC_ICMP_ERR) &&
+		npf_log_embedded(npc, mbuf, &enpc);
+
+	npf_log_emit(ld, pass, dir, npc, macs, etype,
+		     has_enpc ? &enpc : NULL, extra);
 }
 
 static bool
@@ -82,6 +82,12 @@ struct nptv6 {
 	/* Calculated once at rproc creation */
 	uint16_t	np_adjustment;
 	uint8_t		np_adj_prefixlen;
+	uint8_t		np_adj_word;	/* first word that may be adjusted */
+	uint16_t	np_adj_dir;	/* adjustment to add in np_dir */
+
+	/* Prefix written by np_dir, and its mask, as 64-bit words */
+	uint64_t	np_xlate_pfx[2];
+	uint64_t	np_xlate_mask[2];
 
 	/*
 	 * Valid for inside to outside rproc when inside prefix is shorter
@@ -346,6 +352,37 @@ nptv6_calc_adjustment(struct nptv6 *np)
 					     np->np_in_prefixlen,
 					     &np->np_out_prefix,
 					     np->np_out_prefixlen);
+	np->np_adj_word = nptv6_adj_word(np->np_adj_prefixlen);
+}
+
+/*
+ * Outbound translation writes the outside prefix and adds the
+ * adjustment, inbound writes the inside prefix and subtracts it.  As
+ * subtracting is adding the complement, each direction reduces to a
+ * masked write of two 64-bit words and a single one's complement add.
+ */
+static void
+nptv6_calc_xlate(struct nptv6 *np)
+{
+	const struct in6_addr *pfx;
+	struct in6_addr mask;
+	uint i;
+
+	if (np->np_dir == PFIL_OUT) {
+		pfx = &np->np_out_prefix;
+		np->np_adj_dir = np->np_adjustment;
+	} else {
+		pfx = &np->np_in_prefix;
+		np->np_adj_dir = ~np->np_adjustment;
+	}
+
+	in6_prefixlen2mask(&mask, np->np_adj_prefixlen);
+
+	for (i = 0; i < 2; i++) {
+		np->np_xlate_mask[i] = ((uint64_t *)&mask)[i];
+		np->np_xlate_pfx[i] = ((const uint64_t *)pfx)[i] &
+			np->np_xlate_mask[i];
+	}
 }
 
 /*
@@ -432,6 +469,8 @@ nptv6_create(struct nptv6 **npp, char *rg_name, npf_rule_t *rl)
 	/* Calculate adjustment value once */
 	nptv6_calc_adjustment(new);
 
+	nptv6_calc_xlate(new);
+
 	if (new->np_dir == PFIL_OUT &&
 	    new->np_in_prefixlen < new->np_out_prefixlen)
 		nptv6_non_overlapping_mask(&new->np_non_overlapping_mask,
@@ -609,12 +648,10 @@ nptv6_is_addr_translatable(struct in6_addr *addr, uint *adj_word)
  * type.
  */
 static int
-nptv6_translate_addr(const struct nptv6 *np, struct in6_addr *addr,
-		     const struct in6_addr *pfx, uint dir)
+nptv6_translate_addr(const struct nptv6 *np, struct in6_addr *addr)
 {
-	uint adj_word;
-
-	adj_word = nptv6_adj_word(np->np_adj_prefixlen);
+	uint64_t *a = (uint64_t *)addr;
+	uint adj_word = np->np_adj_word;
 
 	/*
 	 * Is the address translatable? If so, which word do we apply the
@@ -624,15 +661,12 @@ nptv6_translate_addr(const struct nptv6 *np, struct in6_addr *addr,
 		return ICMP6_DST_UNREACH;
 
 	/* Change prefix */
-	in6_prefix_cpy(addr, pfx, np->np_adj_prefixlen);
+	a[0] = (a[0] & ~np->np_xlate_mask[0]) | np->np_xlate_pfx[0];
+	a[1] = (a[1] & ~np->np_xlate_mask[1]) | np->np_xlate_pfx[1];
 
 	/* Write adjustment word */
-	if (dir == PFIL_OUT)
-		addr->s6_addr16[adj_word] = add1(addr->s6_addr16[adj_word],
-						 np->np_adjustment);
-	else
-		addr->s6_addr16[adj_word] = sub1(addr->s6_addr16[adj_word],
-						 np->np_adjustment);
+	addr->s6_addr16[adj_word] = add1(addr->s6_addr16[adj_word],
+					 np->np_adj_dir);
 
 	/* Change 0xffff to 0 */
 	if (unlikely(addr->s6_addr16[adj_word] == 0xFFFF))
@@ -653,8 +687,7 @@ nptv6_translate_addr(const struct nptv6 *np, struct in6_addr *addr,
  * Translate ICMPv6 inner packet.
  */
 static void
-nptv6_translate_icmp(const struct nptv6 *np, const struct in6_addr *pfx,
-		     struct rte_mbuf *mbuf, uint dir)
+nptv6_translate_icmp(const struct nptv6 *np, struct rte_mbuf *mbuf)
 {
 	const struct in6_addr *match;
 	struct in6_addr addr;
@@ -664,7 +697,7 @@ nptv6_translate_icmp(const struct nptv6 *np, const struct in6_addr *pfx,
 
 	n_ptr = rte_pktmbuf_mtod_offset(mbuf, char *, pktmbuf_l2_len(mbuf));
 
-	if (dir == PFIL_IN) {
+	if (np->np_dir == PFIL_IN) {
 		/*
 		 * External-to-internal: Translate inner src if its
 		 * prefix matches the external network prefix
@@ -703,7 +736,7 @@ nptv6_translate_icmp(const struct nptv6 *np, const struct in6_addr *pfx,
 	 * Do the translation.  We do not care if the inner address is
 	 * translatable or not.
 	 */
-	(void)nptv6_translate_addr(np, &addr, pfx, dir);
+	(void)nptv6_translate_addr(np, &addr);
 
 	/* Write translated address back to packet */
 	nbuf_advstore(&mbuf, &n_ptr, 0, sizeof(addr), &addr);
@@ -719,7 +752,6 @@ nptv6_translate(npf_cache_t *npc, struct rte_mbuf **nbuf, void *arg,
 	struct nptv6 *np = arg;
 	struct ip6_hdr *ip6 = &npc->npc_ip.v6;
 	struct rte_mbuf *mbuf;
-	const struct in6_addr *pfx;
 	struct in6_addr *addr;
 	struct in6_addr trans;
 	int icmp;
@@ -741,7 +773,6 @@ nptv6_translate(npf_cache_t *npc, struct rte_mbuf **nbuf, void *arg,
 	if (np->np_dir == PFIL_OUT) {
 		/* Source prefix translation */
 		addr = &ip6->ip6_src;
-		pfx = &np->np_out_prefix;
 
 		/*
 		 * If inside prefix is shorter than outside prefix then check
@@ -763,7 +794,6 @@ nptv6_translate(npf_cache_t *npc, struct rte_mbuf **nbuf, void *arg,
 	} else {
 		/* Destination prefix translation */
 		addr = &ip6->ip6_dst;
-		pfx = &np->np_in_prefix;
 	}
 
 	/*
@@ -771,7 +801,7 @@ nptv6_translate(npf_cache_t *npc, struct rte_mbuf **nbuf, void *arg,
 	 */
 	memcpy(trans.s6_addr, addr->s6_addr, 16);
 
-	icmp = nptv6_translate_addr(np, &trans, pfx, np->np_dir);
+	icmp = nptv6_translate_addr(np, &trans);
 
 	if (unlikely(icmp != 0)) {
 		nptv6_drops_inc(np);
@@ -800,7 +830,7 @@ nptv6_translate(npf_cache_t *npc, struct rte_mbuf **nbuf, void *arg,
 	 * Packet Too Big, Time Exceeded, and Parameter Problem messages.
 	 */
 	if (unlikely(npf_iscached(npc, NPC_ICMP_ERR)))
-		nptv6_translate_icmp(np, pfx, mbuf, np->np_dir);
+		nptv6_translate_icmp(np, mbuf);
 
 	return NPF_DECISION_PASS;
 }
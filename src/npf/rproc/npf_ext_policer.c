@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <rte_atomic.h>
 #include <rte_branch_prediction.h>
+#include <rte_common.h>
 #include <rte_ether.h>
 #include <rte_log.h>
 #include <rte_mbuf.h>
@@ -34,7 +35,8 @@ struct ifnet;
 struct policer_cntrs {
 	uint64_t excess;
 	uint64_t bytes_excess;
-	uint64_t pad[6];
+	int64_t shard_credit;	/* sharded mode: credit held by this lcore */
+	uint64_t pad[5];
 };
 
 struct npf_policer {
@@ -45,7 +47,9 @@ struct npf_policer {
 	struct policer_cntrs  *cntrs;
 	uint32_t rate;		/* Packets/bytes per interval */
 	uint32_t burst;		/* burst bytes */
+	uint32_t chunk;		/* sharded mode: credit borrowed at a time */
 	int16_t overhead;	/* L2 overhead per packet */
+	bool sharded;
 
 	enum {
 		ACTION_DROP,
@@ -62,11 +66,20 @@ struct npf_policer {
 };
 
 #define	ONE_SECOND		1000
-#define	POLICE_PARAMS		8
+#define	POLICE_PARAMS		9
 #define	POLICE_ENABLE_INNER	0x80
 #define	POLICE_PCP_MASK		0x07
 
-/* Expect "pps,rate,burst,action" */
+/*
+ * In sharded mode each lcore polices against credit it has borrowed from the
+ * policer in chunks, so the shared credit is only touched once per chunk
+ * rather than once per packet.  Credit held by lcores is in addition to that
+ * left in the policer, so the policer may admit up to one chunk per lcore
+ * more than the configured rate plus burst.
+ */
+#define	POLICE_SHARD_CHUNKS	32
+
+/* Expect "pps,rate,burst,action,val,overhead,tc[,inner[,sharded]]" */
 static int
 npf_policer_create(npf_rule_t *rl, const char *params, void **handle)
 {
@@ -87,6 +100,7 @@ npf_policer_create(npf_rule_t *rl, const char *params, void **handle)
 			char *overhead;
 			char *tc;
 			char *inner;
+			char *mode;
 		};
 		char *ptrs[POLICE_PARAMS];
 	} police_info;
@@ -115,7 +129,7 @@ npf_policer_create(npf_rule_t *rl, const char *params, void **handle)
 	 */
 	no_vars = rte_strsplit(args, strlen(args), police_info.ptrs,
 			       POLICE_PARAMS, ',');
-	if (no_vars < (POLICE_PARAMS - 1)) {
+	if (no_vars < (POLICE_PARAMS - 2)) {
 		RTE_LOG(ERR, QOS,
 			"Invalid input argument string for policer\n");
 		free(po);
@@ -197,6 +211,15 @@ npf_policer_create(npf_rule_t *rl, const char *params, void **handle)
 		rte_atomic32_set(&po->credit, po->rate);
 	}
 
+	if (no_vars == POLICE_PARAMS &&
+	    strcmp(police_info.mode, "sharded") == 0) {
+		uint32_t min_chunk = (po->type == POLICE_BYTES) ?
+			ETHER_MAX_VLAN_FRAME_LEN : 1;
+
+		po->sharded = true;
+		po->chunk = RTE_MAX(po->rate / POLICE_SHARD_CHUNKS, min_chunk);
+	}
+
 	if (strcmp(police_info.action, "pass") == 0)
 		po->action = ACTION_PASS;
 	else if (strcmp(police_info.action, "drop") == 0)
@@ -206,7 +229,8 @@ npf_policer_create(npf_rule_t *rl, const char *params, void **handle)
 		po->mark_val = strtoul(police_info.val, NULL, 10);
 	} else if (strcmp(police_info.action, "markpcp") == 0) {
 		po->mark_val = strtoul(police_info.val, NULL, 10);
-		if (strcmp(police_info.inner, "inner") == 0) {
+		if (no_vars > POLICE_PARAMS - 2 &&
+		    strcmp(police_info.inner, "inner") == 0) {
 			po->action = ACTION_MARKPCP_INNER;
 			qos_save_mark_v_pol(rl, po);
 		} else
@@ -245,6 +269,80 @@ update_tokens(int32_t credit, struct npf_policer *po, const uint64_t ticks)
 	rte_atomic32_set(&po->credit, credit);
 }
 
+/*
+ * Sharded mode refill.  Lcores needing credit just try the lock, as only
+ * one of them has to do the refill.
+ */
+static void
+npf_policer_shard_refill(struct npf_policer *po)
+{
+	uint64_t intervals;
+	int32_t max, credit;
+	uint64_t add;
+
+	if (soft_ticks - po->time < po->tc)
+		return;
+
+	if (!rte_spinlock_trylock(&po->lock))
+		return;
+
+	intervals = (soft_ticks - po->time) / po->tc;
+	if (intervals) {
+		max = po->rate;
+		if (po->type == POLICE_BYTES)
+			max += po->burst;
+
+		credit = rte_atomic32_read(&po->credit);
+		add = intervals * po->rate;
+		if (credit < max)
+			rte_atomic32_add(&po->credit,
+					 RTE_MIN(add, (uint64_t)(max - credit)));
+		po->time += intervals * po->tc;
+	}
+
+	rte_spinlock_unlock(&po->lock);
+}
+
+/* Take up to one chunk of the policer's credit */
+static int32_t
+npf_policer_shard_borrow(struct npf_policer *po)
+{
+	int32_t avail, take;
+
+	do {
+		avail = rte_atomic32_read(&po->credit);
+		if (avail <= 0)
+			return 0;
+		take = RTE_MIN(avail, (int32_t)po->chunk);
+	} while (!rte_atomic32_cmpset((volatile uint32_t *)&po->credit.cnt,
+				      avail, avail - take));
+
+	return take;
+}
+
+static bool
+npf_policer_shard_take(struct npf_policer *po, uint32_t tokens)
+{
+	struct policer_cntrs *pc = &po->cntrs[dp_lcore_id()];
+	int32_t need = 1;
+
+	if (po->type == POLICE_BYTES) {
+		need = tokens + po->overhead;
+		if (need < 0)
+			need = 1;
+	}
+
+	if (pc->shard_credit < need) {
+		npf_policer_shard_refill(po);
+		pc->shard_credit += npf_policer_shard_borrow(po);
+		if (pc->shard_credit < need)
+			return false;
+	}
+
+	pc->shard_credit -= need;
+	return true;
+}
+
 static bool
 npf_policer(npf_cache_t *npc, struct rte_mbuf **nbuf, void *arg,
 	    npf_session_t *se __unused, npf_rproc_result_t *result)
@@ -264,7 +362,11 @@ npf_policer(npf_cache_t *npc, struct rte_mbuf **nbuf, void *arg,
 		return true;
 	}
 
-	if (po->type == POLICE_BYTES) {
+	if (po->sharded) {
+		tokens = rte_pktmbuf_pkt_len(*nbuf) - pktmbuf_l2_len(*nbuf);
+		if (npf_policer_shard_take(po, tokens))
+			return true;
+	} else if (po->type == POLICE_BYTES) {
 		uint64_t	lapsed;
 		int		intervals;
 
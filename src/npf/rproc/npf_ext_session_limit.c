@@ -13,12 +13,17 @@
 #include <errno.h>
 #include <limits.h>
 #include <rte_atomic.h>
-#include <rte_spinlock.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_memory.h>
+#include <rte_timer.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <urcu/list.h>
+#include <urcu/system.h>
 
 #include "compiler.h"
 #include "json_writer.h"
@@ -29,6 +34,7 @@
 #include "npf/npf_state.h"
 #include "npf/rproc/npf_ext_session_limit.h"
 #include "npf/rproc/npf_rproc.h"
+#include "soft_ticks.h"
 #include "util.h"
 
 struct ifnet;
@@ -50,12 +56,12 @@ struct npf_sess_limit_inst {
 };
 
 /*
- * Monitor session creation or block rates.
+ * Monitor session creation or block rates.  Evaluated by the master
+ * thread from the sum of the per-lcore counts.
  */
 struct npf_sess_rate {
-	/* Count events that occur during interval */
-	uint32_t	sr_count;
-	uint32_t	sr_pad;
+	/* Total event count at the start of the interval */
+	uint64_t	sr_base;
 
 	/* Set to soft_ticks every sr_interval */
 	uint64_t	sr_time;
@@ -75,7 +81,7 @@ struct npf_sess_rate {
  * Limit session creation rate
  */
 struct npf_sess_rate_limit {
-	/* timestamp at start of interval */
+	/* timestamp at start of interval, updated with cmpset */
 	uint64_t	rl_time;
 	/* duration of interval in ticks (millisecs) */
 	uint64_t	rl_interval;
@@ -84,14 +90,33 @@ struct npf_sess_rate_limit {
 	/* max burst, or sessions per interval */
 	uint32_t	rl_burst;
 	/* tokens remaining for current interval */
-	int32_t		rl_tokens;
+	rte_atomic32_t	rl_tokens;
+};
+
+/*
+ * Per-lcore counts.  Only written by the owning lcore, and summed by
+ * the master thread.  Non dataplane threads share lcore 0.
+ */
+struct npf_sess_limit_lcore {
+	uint64_t	sl_allowed_ct;
+	uint64_t	sl_ho_block_ct;
+	uint64_t	sl_rl_block_ct;
+	uint64_t	sl_last_sess_created;
+	uint64_t	sl_last_sess_blocked;
+} __rte_cache_aligned;
+
+struct npf_sess_limit_totals {
+	uint64_t	allowed_ct;
+	uint64_t	ho_block_ct;
+	uint64_t	rl_block_ct;
+	uint64_t	last_sess_created;
+	uint64_t	last_sess_blocked;
 };
 
 /* session limit parameter */
 struct npf_sess_limit_param_t {
 	struct cds_list_head	lp_node;
 	char			*lp_name;
-	rte_spinlock_t		lp_lock;
 
 	/*
 	 * Incremented once when added to instance list, and once for each
@@ -106,27 +131,25 @@ struct npf_sess_limit_param_t {
 	uint32_t		lp_ratelimit_burst;
 
 	/* Counters */
-	uint32_t		lp_new_ct;	/* new */
-	uint32_t		lp_estab_ct;	/* established */
-	uint32_t		lp_term_ct;	/* terminating */
+	rte_atomic32_t		lp_new_ct;	/* new */
+	rte_atomic32_t		lp_estab_ct;	/* established */
+	rte_atomic32_t		lp_term_ct;	/* terminating */
 
 	/* Max values since last clear */
 	uint32_t		lp_max_new_ct;
 	uint32_t		lp_max_estab_ct;
 	uint32_t		lp_max_term_ct;
 
-	/* Sessions blocked by max-halfopen */
-	uint64_t		lp_ho_block_ct;
-	/* Sessions blocked by rate-limit */
-	uint64_t		lp_rl_block_ct;
-	/* Sessions allowed */
-	uint64_t		lp_allowed_ct;
-
-	/* Timestamp (ticks) when last session created */
-	uint64_t		lp_last_sess_created;
+	/*
+	 * Sessions allowed and blocked, and the timestamps (ticks) of the
+	 * last session created and blocked.
+	 */
+	struct npf_sess_limit_lcore *lp_lcore;
 
-	/* Timestamp (ticks) when last session blocked */
-	uint64_t		lp_last_sess_blocked;
+	/* Totals at the last clear */
+	uint64_t		lp_clear_allowed_ct;
+	uint64_t		lp_clear_ho_block_ct;
+	uint64_t		lp_clear_rl_block_ct;
 
 	/*
 	 * Monitored session creation rates.  Average sessions/second
@@ -152,9 +175,14 @@ struct npf_sess_limit_param_t {
 /* Single, global session limit instance */
 static struct npf_sess_limit_inst *limit_inst;
 
+/* Master thread timer that evaluates the monitored rates */
+static struct rte_timer limit_rate_timer;
+
 /* Forward reference */
 static void
 npf_sess_limit_param_remove_all(struct npf_sess_limit_inst *li);
+static void
+npf_sess_limit_rate_timer(struct rte_timer *timer, void *arg);
 
 
 /***************************   instance   **********************************/
@@ -173,6 +201,12 @@ npf_sess_limit_inst_create(void)
 
 	CDS_INIT_LIST_HEAD(&li->li_param_list);
 
+	rte_timer_init(&limit_rate_timer);
+	rte_timer_reset(&limit_rate_timer,
+			rte_get_timer_hz(),
+			PERIODICAL, rte_get_master_lcore(),
+			npf_sess_limit_rate_timer, NULL);
+
 	return li;
 }
 
@@ -191,6 +225,7 @@ npf_sess_limit_inst_destroy(void)
 	if (!limit_inst)
 		return;
 
+	rte_timer_stop_sync(&limit_rate_timer);
 	npf_sess_limit_param_remove_all(limit_inst);
 	free(limit_inst);
 	limit_inst = NULL;
@@ -203,24 +238,27 @@ npf_sess_limit_init_rate(struct npf_sess_rate *sr, uint64_t interval,
 			 uint64_t ticks)
 {
 	sr->sr_interval = interval;
-	sr->sr_count = 0;
+	sr->sr_base = 0;
 	sr->sr_time = ticks;
 	sr->sr_rate = 0;
 	sr->sr_max_rate_time = 0;
 	sr->sr_max_rate = 0;
 }
 
+/*
+ * Called by the master thread with the current event total.
+ */
 static void
-npf_sess_limit_update_rate(struct npf_sess_rate *sr, uint64_t ticks)
+npf_sess_limit_update_rate(struct npf_sess_rate *sr, uint64_t total,
+			   uint64_t ticks)
 {
 	uint64_t lapsed;
 
-	sr->sr_count++;
 	lapsed = ticks - sr->sr_time;
 
 	if (lapsed >= sr->sr_interval) {
 		/* Calculate sessions per second */
-		sr->sr_rate = sr->sr_count / (lapsed/ONE_SECOND);
+		sr->sr_rate = ((total - sr->sr_base) * ONE_SECOND) / lapsed;
 
 		if (sr->sr_rate > 0 && sr->sr_rate >= sr->sr_max_rate) {
 			sr->sr_max_rate = sr->sr_rate;
@@ -229,7 +267,7 @@ npf_sess_limit_update_rate(struct npf_sess_rate *sr, uint64_t ticks)
 
 		/* Start new period */
 		sr->sr_time = ticks;
-		sr->sr_count = 0;
+		sr->sr_base = total;
 	}
 }
 
@@ -248,7 +286,7 @@ npf_sess_limit_init_rate_limit(struct npf_sess_rate_limit *rl,
 	rl->rl_rate = rate;
 	rl->rl_burst = burst;
 	rl->rl_interval = ((burst * ONE_SECOND) / rate);
-	rl->rl_tokens = rl->rl_burst;
+	rte_atomic32_set(&rl->rl_tokens, rl->rl_burst);
 
 	if (init)
 		rl->rl_time = soft_ticks;
@@ -262,20 +300,76 @@ npf_sess_limit_init_rate_limit(struct npf_sess_rate_limit *rl,
 static bool
 npf_sess_rate_limit(struct npf_sess_rate_limit *rl, uint64_t ticks)
 {
-	uint64_t lapsed;
+	uint64_t start = CMM_LOAD_SHARED(rl->rl_time);
 
-	lapsed = ticks - rl->rl_time;
+	/*
+	 * Start new interval.  Replenish tokens and reset time.  Only
+	 * the lcore that moves the interval on does the replenish.
+	 */
+	if (ticks - start >= rl->rl_interval &&
+	    rte_atomic64_cmpset(&rl->rl_time, start, ticks))
+		rte_atomic32_set(&rl->rl_tokens, rl->rl_burst);
 
-	if (lapsed >= rl->rl_interval) {
-		/*
-		 * Start new interval.  Replenish tokens and reset time
-		 */
-		rl->rl_time = ticks;
-		rl->rl_tokens = rl->rl_burst;
+	/* rl_tokens is decremented in the session_activate callback */
+	return rte_atomic32_read(&rl->rl_tokens) <= 0;
+}
+
+/* Sum the per-lcore counts */
+static void
+npf_sess_limit_totals(struct npf_sess_limit_param_t *lp,
+		      struct npf_sess_limit_totals *t)
+{
+	unsigned int i;
+
+	memset(t, 0, sizeof(*t));
+
+	FOREACH_DP_LCORE(i) {
+		const struct npf_sess_limit_lcore *sl = &lp->lp_lcore[i];
+
+		t->allowed_ct += CMM_LOAD_SHARED(sl->sl_allowed_ct);
+		t->ho_block_ct += CMM_LOAD_SHARED(sl->sl_ho_block_ct);
+		t->rl_block_ct += CMM_LOAD_SHARED(sl->sl_rl_block_ct);
+		t->last_sess_created = RTE_MAX(t->last_sess_created,
+				CMM_LOAD_SHARED(sl->sl_last_sess_created));
+		t->last_sess_blocked = RTE_MAX(t->last_sess_blocked,
+				CMM_LOAD_SHARED(sl->sl_last_sess_blocked));
 	}
+}
 
-	/* rl_tokens is decremented in the session_activate callback */
-	return rl->rl_tokens <= 0;
+/*
+ * Evaluate the monitored rates of every parameter.  Runs on the master
+ * thread once a second, so the forwarding threads only ever bump their
+ * own counters.
+ */
+static void
+npf_sess_limit_rate_timer(struct rte_timer *timer __unused, void *arg __unused)
+{
+	struct npf_sess_limit_param_t *lp;
+	struct npf_sess_limit_totals t;
+	uint64_t ticks = soft_ticks;
+	uint64_t blocks;
+
+	if (!limit_inst)
+		return;
+
+	cds_list_for_each_entry(lp, &limit_inst->li_param_list, lp_node) {
+		npf_sess_limit_totals(lp, &t);
+		blocks = t.ho_block_ct + t.rl_block_ct;
+
+		npf_sess_limit_update_rate(&lp->lp_rate_1sec,
+					   t.allowed_ct, ticks);
+		npf_sess_limit_update_rate(&lp->lp_rate_1min,
+					   t.allowed_ct, ticks);
+		npf_sess_limit_update_rate(&lp->lp_rate_5min,
+					   t.allowed_ct, ticks);
+
+		npf_sess_limit_update_rate(&lp->lp_rate_blocks_1sec,
+					   blocks, ticks);
+		npf_sess_limit_update_rate(&lp->lp_rate_blocks_1min,
+					   blocks, ticks);
+		npf_sess_limit_update_rate(&lp->lp_rate_blocks_5min,
+					   blocks, ticks);
+	}
 }
 
 /****************************  parameter  **********************************/
@@ -314,7 +408,13 @@ npf_sess_limit_param_create(const char *name)
 	if (!lp)
 		return NULL;
 
-	rte_spinlock_init(&lp->lp_lock);
+	lp->lp_lcore = zmalloc_aligned((get_lcore_max() + 1) *
+				       sizeof(*lp->lp_lcore));
+	if (!lp->lp_lcore) {
+		free(lp);
+		return NULL;
+	}
+
 	lp->lp_name = strdup(name);
 
 	npf_sess_limit_init_rate(&lp->lp_rate_1sec, ONE_SECOND, ticks);
@@ -334,6 +434,7 @@ npf_sess_limit_param_destroy(struct npf_sess_limit_param_t **lpp)
 	struct npf_sess_limit_param_t *lp = *lpp;
 
 	*lpp = NULL;
+	free(lp->lp_lcore);
 	free(lp->lp_name);
 	free(lp);
 }
@@ -581,15 +682,20 @@ npf_sess_limit_param_show_one(json_writer_t *json,
 			      struct npf_sess_limit_param_t *lp,
 			      uint64_t ticks)
 {
+	struct npf_sess_limit_totals t;
+
+	npf_sess_limit_totals(lp, &t);
+
 	jsonw_name(json, lp->lp_name);
 	jsonw_start_object(json);
 
 	jsonw_name(json, "summary");
 	jsonw_start_object(json);
 
-	jsonw_uint_field(json, "new_ct", lp->lp_new_ct);
-	jsonw_uint_field(json, "estab_ct", lp->lp_estab_ct);
-	jsonw_uint_field(json, "term_ct", lp->lp_term_ct);
+	jsonw_uint_field(json, "new_ct", rte_atomic32_read(&lp->lp_new_ct));
+	jsonw_uint_field(json, "estab_ct",
+			 rte_atomic32_read(&lp->lp_estab_ct));
+	jsonw_uint_field(json, "term_ct", rte_atomic32_read(&lp->lp_term_ct));
 
 	jsonw_uint_field(json, "max_new_ct", lp->lp_max_new_ct);
 	jsonw_uint_field(json, "max_estab_ct", lp->lp_max_estab_ct);
@@ -606,26 +712,27 @@ npf_sess_limit_param_show_one(json_writer_t *json,
 	npf_sess_limit_jsonw_rate(json, "rate_blocks_5min",
 				   &lp->lp_rate_blocks_5min, ticks);
 
-	jsonw_uint_field(json, "allowed_ct", lp->lp_allowed_ct);
+	jsonw_uint_field(json, "allowed_ct",
+			 t.allowed_ct - lp->lp_clear_allowed_ct);
 
-	if (lp->lp_last_sess_created == 0)
+	if (t.last_sess_created == 0)
 		/* never */
 		jsonw_uint_field(json, "last_sess_created", UINT_MAX);
 	else {
 		uint64_t elapsed;
 
-		elapsed = ticks - lp->lp_last_sess_created;
+		elapsed = ticks - t.last_sess_created;
 		jsonw_uint_field(json, "last_sess_created",
 				 (uint32_t)(elapsed / ONE_SECOND));
 	}
 
-	if (lp->lp_last_sess_blocked == 0)
+	if (t.last_sess_blocked == 0)
 		/* never */
 		jsonw_uint_field(json, "last_sess_blocked", UINT_MAX);
 	else {
 		uint64_t elapsed;
 
-		elapsed = ticks - lp->lp_last_sess_blocked;
+		elapsed = ticks - t.last_sess_blocked;
 		jsonw_uint_field(json, "last_sess_blocked",
 				 (uint32_t)(elapsed / ONE_SECOND));
 	}
@@ -639,7 +746,7 @@ npf_sess_limit_param_show_one(json_writer_t *json,
 		jsonw_uint_field(json, "ratelimit_burst",
 				 lp->lp_rate_limit.rl_burst);
 		jsonw_uint_field(json, "blocked_ct",
-				 lp->lp_rl_block_ct);
+				 t.rl_block_ct - lp->lp_clear_rl_block_ct);
 
 		jsonw_end_object(json);	/* ratelimit */
 	}
@@ -652,7 +759,7 @@ npf_sess_limit_param_show_one(json_writer_t *json,
 				 lp->lp_halfopen_max);
 
 		jsonw_uint_field(json, "blocked_ct",
-				 lp->lp_ho_block_ct);
+				 t.ho_block_ct - lp->lp_clear_ho_block_ct);
 
 		jsonw_end_object(json);	/* halfopen */
 	}
@@ -703,13 +810,17 @@ end:
 static void
 npf_sess_limit_param_clear_one(struct npf_sess_limit_param_t *lp)
 {
+	struct npf_sess_limit_totals t;
+
 	lp->lp_max_new_ct   = 0;
 	lp->lp_max_estab_ct = 0;
 	lp->lp_max_term_ct  = 0;
 
-	lp->lp_ho_block_ct = 0;
-	lp->lp_rl_block_ct = 0;
-	lp->lp_allowed_ct = 0;
+	/* The per-lcore counts are not ours to reset */
+	npf_sess_limit_totals(lp, &t);
+	lp->lp_clear_ho_block_ct = t.ho_block_ct;
+	lp->lp_clear_rl_block_ct = t.rl_block_ct;
+	lp->lp_clear_allowed_ct = t.allowed_ct;
 
 	lp->lp_rate_1sec.sr_max_rate = 0;
 	lp->lp_rate_1min.sr_max_rate = 0;
@@ -1085,51 +1196,33 @@ bool npf_sess_limit_check(npf_rule_t *rl)
 	     (SESS_LIMIT_RATELIMIT_RATE | SESS_LIMIT_HALFOPEN_MAX)) == 0)
 		return false;
 
-	rte_spinlock_lock(&lp->lp_lock);
+	struct npf_sess_limit_lcore *sl = &lp->lp_lcore[dp_lcore_id()];
 
 	if ((lp->lp_flags & SESS_LIMIT_RATELIMIT_RATE) != 0) {
 
 		if (npf_sess_rate_limit(&lp->lp_rate_limit, ticks)) {
 
-			lp->lp_rl_block_ct++;
-			lp->lp_last_sess_blocked = ticks;
-
-			/* Update session block rates */
-			npf_sess_limit_update_rate(&lp->lp_rate_blocks_1sec,
-						   ticks);
-			npf_sess_limit_update_rate(&lp->lp_rate_blocks_1min,
-						   ticks);
-			npf_sess_limit_update_rate(&lp->lp_rate_blocks_5min,
-						   ticks);
+			sl->sl_rl_block_ct++;
+			sl->sl_last_sess_blocked = ticks;
 
 			/* block session creation */
-			rte_spinlock_unlock(&lp->lp_lock);
 			return true;
 		}
 	}
 
 	if ((lp->lp_flags & SESS_LIMIT_HALFOPEN_MAX) != 0) {
 
-		if (lp->lp_new_ct >= lp->lp_halfopen_max) {
+		if ((uint32_t)rte_atomic32_read(&lp->lp_new_ct) >=
+		    lp->lp_halfopen_max) {
 
-			lp->lp_ho_block_ct++;
-			lp->lp_last_sess_blocked = ticks;
-
-			/* Update session block rates */
-			npf_sess_limit_update_rate(&lp->lp_rate_blocks_1sec,
-						   ticks);
-			npf_sess_limit_update_rate(&lp->lp_rate_blocks_1min,
-						   ticks);
-			npf_sess_limit_update_rate(&lp->lp_rate_blocks_5min,
-						   ticks);
+			sl->sl_ho_block_ct++;
+			sl->sl_last_sess_blocked = ticks;
 
 			/* block session creation */
-			rte_spinlock_unlock(&lp->lp_lock);
 			return true;
 		}
 	}
 
-	rte_spinlock_unlock(&lp->lp_lock);
 	return false;
 }
 
@@ -1139,19 +1232,24 @@ bool npf_sess_limit_check(npf_rule_t *rl)
 static void
 npf_sess_limit_update_rates(struct npf_sess_limit_param_t *lp)
 {
-	uint64_t ticks = soft_ticks;
+	struct npf_sess_limit_lcore *sl = &lp->lp_lcore[dp_lcore_id()];
 
-	lp->lp_allowed_ct++;
-	lp->lp_last_sess_created = ticks;
-
-	/* Update session creation rates */
-	npf_sess_limit_update_rate(&lp->lp_rate_1sec, ticks);
-	npf_sess_limit_update_rate(&lp->lp_rate_1min, ticks);
-	npf_sess_limit_update_rate(&lp->lp_rate_5min, ticks);
+	sl->sl_allowed_ct++;
+	sl->sl_last_sess_created = soft_ticks;
 
 	/* Only decrement the rl tokens when a session is activated. */
 	if ((lp->lp_flags & SESS_LIMIT_RATELIMIT_RATE) != 0)
-		lp->lp_rate_limit.rl_tokens--;
+		rte_atomic32_dec(&lp->lp_rate_limit.rl_tokens);
+}
+
+/* Max values are only a high water mark, so a lost race is harmless */
+static void
+npf_sess_limit_inc(rte_atomic32_t *ct, uint32_t *max)
+{
+	uint32_t val = rte_atomic32_add_return(ct, 1);
+
+	if (val > CMM_LOAD_SHARED(*max))
+		CMM_STORE_SHARED(*max, val);
 }
 
 /*
@@ -1173,24 +1271,22 @@ void npf_sess_limit_state_change(void *handle, uint8_t proto_idx,
 	if (state == prev_state)
 		return;
 
-	rte_spinlock_lock(&lp->lp_lock);
-
 	switch (prev_state) {
 	case NPF_ANY_SESSION_NONE:
 		/* do nothing */
 		break;
 
 	case NPF_ANY_SESSION_NEW:
-		lp->lp_new_ct--;
+		rte_atomic32_dec(&lp->lp_new_ct);
 		break;
 
 	case NPF_ANY_SESSION_ESTABLISHED:
-		lp->lp_estab_ct--;
+		rte_atomic32_dec(&lp->lp_estab_ct);
 		break;
 
 	case NPF_ANY_SESSION_TERMINATING:
 		/* Only occurs for TCP sessions */
-		lp->lp_term_ct--;
+		rte_atomic32_dec(&lp->lp_term_ct);
 		break;
 
 	case NPF_ANY_SESSION_CLOSED:
@@ -1204,34 +1300,22 @@ void npf_sess_limit_state_change(void *handle, uint8_t proto_idx,
 		break;
 
 	case NPF_ANY_SESSION_NEW:
-		lp->lp_new_ct++;
-
-		if (lp->lp_new_ct >= lp->lp_max_new_ct)
-			lp->lp_max_new_ct = lp->lp_new_ct;
-
+		npf_sess_limit_inc(&lp->lp_new_ct, &lp->lp_max_new_ct);
 		npf_sess_limit_update_rates(lp);
 		break;
 
 	case NPF_ANY_SESSION_ESTABLISHED:
-		lp->lp_estab_ct++;
-
-		if (lp->lp_estab_ct >= lp->lp_max_estab_ct)
-			lp->lp_max_estab_ct = lp->lp_estab_ct;
+		npf_sess_limit_inc(&lp->lp_estab_ct, &lp->lp_max_estab_ct);
 		break;
 
 	case NPF_ANY_SESSION_TERMINATING:
 		/* Only occurs for TCP sessions */
-		lp->lp_term_ct++;
-
-		if (lp->lp_term_ct >= lp->lp_max_term_ct)
-			lp->lp_max_term_ct = lp->lp_term_ct;
+		npf_sess_limit_inc(&lp->lp_term_ct, &lp->lp_max_term_ct);
 		break;
 
 	case NPF_ANY_SESSION_CLOSED:
 		break;
 	};
-
-	rte_spinlock_unlock(&lp->lp_lock);
 }
 
 const npf_rproc_ops_t npf_session_limiter_ops = {
@@ -17,18 +17,25 @@
 #include "npf/rproc/npf_rproc.h"
 #include "npf/npf_ruleset.h"
 #include "pktmbuf.h"
+#include "vrf.h"
 #include "vplane_log.h"
 
 struct ifnet;
 struct rte_mbuf;
 
+struct setvrf_handle {
+	vrfid_t		sh_external_id;
+	vrfid_t		sh_vrf_id;	/* internal id last found */
+};
+
 /*
  * Extract and store the vrf value to set
  */
 static int
 npf_setvrf_create(npf_rule_t *rl __unused, const char *params, void **handle)
 {
-	uintptr_t vrf = 0;
+	struct setvrf_handle *sh;
+	unsigned long long vrf;
 	char *endp;
 
 	if (!params) {
@@ -44,22 +51,34 @@ npf_setvrf_create(npf_rule_t *rl __unused, const char *params, void **handle)
 		return -EINVAL;
 	}
 
-	*handle = (void *)vrf;
+	sh = malloc(sizeof(*sh));
+	if (!sh)
+		return -ENOMEM;
+
+	sh->sh_external_id = vrf;
+	sh->sh_vrf_id = VRF_INVALID_ID;
+	*handle = sh;
 	return 0;
 }
 
+static void
+npf_setvrf_destroy(void *handle)
+{
+	free(handle);
+}
+
 static bool
 npf_setvrf(npf_cache_t *npc __unused, struct rte_mbuf **m, void *arg,
 	   npf_session_t *se __unused, npf_rproc_result_t *result)
 {
-	vrfid_t vrfid;
+	struct setvrf_handle *sh = arg;
 	struct vrf *vrf;
 
 	if (result->decision == NPF_DECISION_BLOCK)
 		return true;
 
-	vrfid = (uintptr_t)arg;
-	vrf = vrf_get_rcu_from_external(vrfid);
+	vrf = vrf_get_rcu_from_external_hint(sh->sh_external_id,
+					     &sh->sh_vrf_id);
 	pktmbuf_set_vrf(*m, vrf ? vrf->v_id : VRF_INVALID_ID);
 	return true;
 }
@@ -70,5 +89,6 @@ const npf_rproc_ops_t npf_setvrf_ops = {
 	.ro_id     = NPF_RPROC_ID_SETVRF,
 	.ro_bidir  = false,
 	.ro_ctor   = npf_setvrf_create,
+	.ro_dtor   = npf_setvrf_destroy,
 	.ro_action = npf_setvrf,
 };
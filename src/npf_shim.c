@@ -28,6 +28,7 @@
 #include "npf/npf_addrgrp.h"
 #include "npf/npf_cache.h"
 #include "npf/npf_event.h"
+#include "npf/npf_flow_cache.h"
 #include "npf/npf_if.h"
 #include "npf/npf_if_feat.h"
 #include "npf/npf_nat64.h"
@@ -35,6 +36,7 @@
 #include "npf/npf_ruleset.h"
 #include "npf/npf_session.h"
 #include "npf/npf_state.h"
+#include "npf/npf_syncookie.h"
 #include "npf/npf_timeouts.h"
 #include "npf/rproc/npf_rproc.h"
 #include "npf/rproc/npf_ext_session_limit.h"
@@ -88,7 +90,11 @@ npf_hook_notrack(const npf_ruleset_t *rlset, struct rte_mbuf **m,
 			goto result;
 	}
 
-	rl = npf_ruleset_inspect(n, *m, rlset, NULL, ifp, dir);
+	/* Run the ruleset, unless the flow's verdict is cached */
+	if (!npf_flow_cache_lookup(rlset, n, dir, &rl)) {
+		rl = npf_ruleset_inspect(n, *m, rlset, NULL, ifp, dir);
+		npf_flow_cache_insert(rlset, n, dir, rl);
+	}
 
 	npf_rproc_result_t rproc_result = {
 		.decision = npf_rule_decision(rl),
@@ -269,6 +275,15 @@ npf_hook_track(struct ifnet *in_ifp, struct rte_mbuf **m,
 		goto result;
 	}
 
+	/* Under session pressure, only validated handshakes get state */
+	if (!se && dir == PFIL_IN &&
+	    npf_cache_ipproto(npc) == IPPROTO_TCP &&
+	    unlikely(npf_syncookie_active()) &&
+	    !npf_syncookie_check(npc, *m)) {
+		decision = NPF_DECISION_BLOCK;
+		goto result;
+	}
+
 	/* SNAT forward (OUT), DNAT reply */
 	if (dir == PFIL_OUT) {
 		npf_nat_t *nt = npf_session_get_nat(se);
@@ -471,6 +486,7 @@ npf_init(void)
 	npf_config_init();
 	pmf_arlg_init();
 	npf_state_tcp_init();
+	npf_session_pool_init();
 	npf_ruleset_gc_init();
 	npf_state_stats_create();
 	nat_pool_init();
@@ -9,6 +9,7 @@
 #define NSH_H
 
 #include <endian.h>
+#include <netinet/in.h>
 #include <rte_mbuf.h>
 #include <stdint.h>
 #include <sys/types.h>
@@ -225,4 +226,34 @@ int nsh_extract(struct rte_mbuf *pak, struct nsh **nsh_start,
  * Parse hdr, return payload proto and pointer to payload */
 int nsh_get_payload(struct nsh *nsh_start, enum nsh_np *nxtproto,
 		    void **nsh_payload);
+
+/*
+ * Accessors for a header left in network order in the packet, for
+ * forwarding on the service path without extracting the metadata.
+ */
+#define NSH_SPH_SPI(sph)	((sph) >> 8)
+#define NSH_SPH_SI(sph)		((sph) & 0xff)
+
+/* Length of the header including metadata, in bytes */
+static inline unsigned int nsh_hdr_len(const struct nsh *nsh)
+{
+	return (ntohl(nsh->bh_u.bh) >> 16 & 0x3f) * NSH_LEN_UNIT;
+}
+
+static inline enum nsh_np nsh_nxt_proto(const struct nsh *nsh)
+{
+	return ntohl(nsh->bh_u.bh) & 0xff;
+}
+
+/* Service path header in host order, SPI above SI */
+static inline uint32_t nsh_sph(const struct nsh *nsh)
+{
+	return ntohl(nsh->sph_u.sph);
+}
+
+/* The service index must be non-zero */
+static inline void nsh_dec_si(struct nsh *nsh)
+{
+	nsh->sph_u.sph = htonl(ntohl(nsh->sph_u.sph) - 1);
+}
 #endif
@@ -0,0 +1,171 @@
+/*-
+ * Copyright (c) 2019, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * NSH service function forwarder - see nsh_sff.h.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "json_writer.h"
+#include "nsh_sff.h"
+#include "urcu.h"
+#include "util.h"
+
+struct nsh_sff_path *nsh_sff_paths[NSH_SFF_MAX_SPI];
+
+static void nsh_sff_path_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct nsh_sff_path, rcu));
+}
+
+static bool nsh_sff_path_empty(const struct nsh_sff_path *path)
+{
+	unsigned int si;
+
+	for (si = 0; si < NSH_SFF_MAX_SI; si++)
+		if (path->hops[si].action != NSH_SFF_NONE)
+			return false;
+	return true;
+}
+
+/* Replace a hop of a path, by replacing the path */
+static int nsh_sff_hop_set(uint32_t spi, uint8_t si,
+			   const struct nsh_sff_hop *hop)
+{
+	struct nsh_sff_path *old = nsh_sff_paths[spi];
+	struct nsh_sff_path *path;
+
+	path = malloc(sizeof(*path));
+	if (!path)
+		return -ENOMEM;
+
+	if (old)
+		memcpy(path->hops, old->hops, sizeof(path->hops));
+	else
+		memset(path->hops, 0, sizeof(path->hops));
+	path->hops[si] = *hop;
+
+	if (nsh_sff_path_empty(path)) {
+		free(path);
+		path = NULL;
+	}
+
+	rcu_assign_pointer(nsh_sff_paths[spi], path);
+	if (old)
+		call_rcu(&old->rcu, nsh_sff_path_free);
+	return 0;
+}
+
+static void nsh_sff_show(FILE *f)
+{
+	const struct nsh_sff_path *path;
+	const struct nsh_sff_hop *hop;
+	char addr[INET6_ADDRSTRLEN];
+	json_writer_t *json;
+	unsigned int spi, si;
+
+	json = jsonw_new(f);
+	if (!json)
+		return;
+
+	jsonw_name(json, "nsh-sff");
+	jsonw_start_array(json);
+	for (spi = 0; spi < NSH_SFF_MAX_SPI; spi++) {
+		path = rcu_dereference(nsh_sff_paths[spi]);
+		if (!path)
+			continue;
+
+		for (si = 0; si < NSH_SFF_MAX_SI; si++) {
+			hop = &path->hops[si];
+			if (hop->action == NSH_SFF_NONE)
+				continue;
+
+			jsonw_start_object(json);
+			jsonw_uint_field(json, "spi", spi);
+			jsonw_uint_field(json, "si", si);
+			if (hop->action == NSH_SFF_DECAP) {
+				jsonw_string_field(json, "action", "decap");
+			} else {
+				jsonw_string_field(json, "action", "forward");
+				jsonw_uint_field(json, "vni", hop->vni);
+				inet_ntop(hop->dst.type, &hop->dst.address,
+					  addr, sizeof(addr));
+				jsonw_string_field(json, "dst", addr);
+			}
+			jsonw_end_object(json);
+		}
+	}
+	jsonw_end_array(json);
+	jsonw_destroy(&json);
+}
+
+/*
+ * vxlan nsh-sff add <spi> <si> forward <vni> <addr>
+ * vxlan nsh-sff add <spi> <si> decap
+ * vxlan nsh-sff delete <spi> <si>
+ * vxlan nsh-sff show
+ */
+int cmd_nsh_sff(FILE *f, int argc, char **argv)
+{
+	struct nsh_sff_hop hop = { .action = NSH_SFF_NONE };
+	unsigned int spi;
+	unsigned char si;
+
+	if (argc == 2 && !strcmp(argv[1], "show")) {
+		nsh_sff_show(f);
+		return 0;
+	}
+
+	if (argc < 4)
+		goto error;
+
+	if (get_unsigned(argv[2], &spi) < 0 || spi >= NSH_SFF_MAX_SPI) {
+		fprintf(f, "spi must be below %u", NSH_SFF_MAX_SPI);
+		return -1;
+	}
+	if (get_unsigned_char(argv[3], &si) < 0) {
+		fprintf(f, "invalid si %s", argv[3]);
+		return -1;
+	}
+
+	if (!strcmp(argv[1], "add")) {
+		if (argc == 5 && !strcmp(argv[4], "decap")) {
+			hop.action = NSH_SFF_DECAP;
+		} else if (argc == 7 && !strcmp(argv[4], "forward")) {
+			hop.action = NSH_SFF_FORWARD;
+			if (get_unsigned(argv[5], &hop.vni) < 0 ||
+			    hop.vni >= 1 << 24) {
+				fprintf(f, "invalid vni %s", argv[5]);
+				return -1;
+			}
+			if (parse_ipaddress(&hop.dst, argv[6]) != 1) {
+				fprintf(f, "invalid address %s", argv[6]);
+				return -1;
+			}
+		} else
+			goto error;
+	} else if (strcmp(argv[1], "delete") || argc != 4)
+		goto error;
+
+	if (nsh_sff_hop_set(spi, si, &hop) < 0) {
+		fprintf(f, "out of memory");
+		return -1;
+	}
+	return 0;
+
+error:
+	fprintf(f, "Usage: vxlan nsh-sff add <spi> <si> "
+		"<forward <vni> <addr>|decap> | "
+		"delete <spi> <si> | show");
+	return -1;
+}
@@ -0,0 +1,71 @@
+/*-
+ * Copyright (c) 2019, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * NSH service function forwarder
+ */
+
+#ifndef NSH_SFF_H
+#define NSH_SFF_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ip_addr.h"
+#include "urcu.h"
+
+/*
+ * Forwarding of NSH packets arriving over VXLAN-GPE by their service
+ * path and index.  Each hop either sends the packet on to the next
+ * VXLAN-GPE tunnel with the service index decremented, or ends the
+ * path here and passes on the payload.  The header is changed in
+ * place, and the metadata is never extracted.
+ *
+ * The table is indexed directly by SPI, and then SI, for the SPIs
+ * below NSH_SFF_MAX_SPI.  Each path is replaced whole on a change.
+ */
+#define NSH_SFF_MAX_SPI		4096
+#define NSH_SFF_MAX_SI		256
+
+enum nsh_sff_action {
+	NSH_SFF_NONE,		/* no hop, drop */
+	NSH_SFF_FORWARD,	/* decrement SI and send over vni to dst */
+	NSH_SFF_DECAP,		/* end of the path, remove the NSH */
+};
+
+struct nsh_sff_hop {
+	uint8_t		action;
+	uint32_t	vni;
+	struct ip_addr	dst;
+};
+
+struct nsh_sff_path {
+	struct rcu_head		rcu;
+	struct nsh_sff_hop	hops[NSH_SFF_MAX_SI];
+};
+
+extern struct nsh_sff_path *nsh_sff_paths[NSH_SFF_MAX_SPI];
+
+/* The hop for a service path and index, or NULL if there is none */
+static inline const struct nsh_sff_hop *
+nsh_sff_lookup(uint32_t spi, uint8_t si)
+{
+	const struct nsh_sff_path *path;
+	const struct nsh_sff_hop *hop;
+
+	if (spi >= NSH_SFF_MAX_SPI)
+		return NULL;
+
+	path = rcu_dereference(nsh_sff_paths[spi]);
+	if (!path)
+		return NULL;
+
+	hop = &path->hops[si];
+	return hop->action != NSH_SFF_NONE ? hop : NULL;
+}
+
+int cmd_nsh_sff(FILE *f, int argc, char **argv);
+
+#endif /* NSH_SFF_H */
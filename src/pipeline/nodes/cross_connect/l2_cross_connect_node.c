@@ -26,12 +26,12 @@ cross_connect_process(struct pl_packet *pkt)
 
 	if (unlikely(out_ifp == NULL)) {
 		if_incr_dropped(ifp);
-		return CROSS_CONNECT_DROP;
+		return pl_drop(pkt, PL_DROP_XCONNECT, CROSS_CONNECT_DROP);
 	}
 
 	if (unlikely(!(out_ifp->if_flags & IFF_UP))) {
 		if_incr_full_proto(out_ifp, 1);
-		return CROSS_CONNECT_DROP;
+		return pl_drop(pkt, PL_DROP_XCONNECT, CROSS_CONNECT_DROP);
 	}
 
 	if (out_ifp->if_type == IFT_L2TPETH) {
@@ -47,7 +47,8 @@ ether_forward_process(struct pl_packet *pkt)
 		if (unlikely(ntohs(et) > ETH_P_802_3_MIN)) {
 			/* Drop unknown protocols */
 			if_incr_unknown(pkt->in_ifp);
-			return ETHER_FORWARD_DROP;
+			return pl_drop(pkt, PL_DROP_UNKNOWN_PROTO,
+				       ETHER_FORWARD_DROP);
 		} else
 			return ETHER_FORWARD_LOCAL;
 	} else {
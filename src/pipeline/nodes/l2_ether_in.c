@@ -16,6 +16,7 @@
 #include "pktmbuf.h"
 #include "pl_common.h"
 #include "pl_fused.h"
+#include "pl_nodes_common.h"
 
 ALWAYS_INLINE unsigned int
 ether_in_process(struct pl_packet *pkt)
@@ -40,3 +41,5 @@ PL_REGISTER_NODE(ether_in_node) = {
 		[ETHER_IN_ACCEPT] = "ether-lookup",
 	}
 };
+
+struct pl_node_registration *const ether_in_node_ptr = &ether_in_node;
@@ -214,6 +214,14 @@ ether_lookup_feat_iterate(struct pl_node *node, bool first,
 					feature_id, context);
 }
 
+ALWAYS_INLINE unsigned int
+ether_lookup_feat_mask(struct pl_node *node)
+{
+	struct ifnet *ifp = ether_lookup_node_to_ifp(node);
+
+	return pl_node_feat_mask_u16(&ifp->ether_in_features);
+}
+
 static struct pl_node *
 ether_lookup_node_lookup(const char *name)
 {
@@ -228,6 +236,7 @@ PL_REGISTER_NODE(ether_lookup_node) = {
 	.handler = ether_lookup_process,
 	.feat_change = ether_lookup_feat_change,
 	.feat_iterate = ether_lookup_feat_iterate,
+	.feat_mask = ether_lookup_feat_mask,
 	.lookup_by_name = ether_lookup_node_lookup,
 	.num_next = ETHER_LOOKUP_NUM,
 	.next = {
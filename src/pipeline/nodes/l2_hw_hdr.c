@@ -174,7 +174,7 @@ l2_hw_hdr_rx_process(struct pl_packet *pkt)
 	}
 drop:
 	if_incr_dropped(pkt->in_ifp);
-	return HW_HDR_IN_DROP;
+	return pl_drop(pkt, PL_DROP_L2_HDR, HW_HDR_IN_DROP);
 }
 
 ALWAYS_INLINE unsigned int
@@ -37,7 +37,7 @@ portmonitor_hw_in_process(struct pl_packet *pkt)
 
 drop:
 	if_incr_dropped(pkt->in_ifp);
-	return PORTMONITOR_HW_IN_DROP;
+	return pl_drop(pkt, PL_DROP_PORTMONITOR, PORTMONITOR_HW_IN_DROP);
 }
 
 /* Register Node */
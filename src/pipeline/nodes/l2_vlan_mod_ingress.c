@@ -63,7 +63,7 @@ vlan_modify_in_check_process(struct pl_packet *pkt)
 		pkt->mbuf = ret;
 		return VLAN_MOD_IN_ACCEPT;
 	}
-	return VLAN_MOD_IN_DROP;
+	return pl_drop(pkt, PL_DROP_VLAN_MODIFY, VLAN_MOD_IN_DROP);
 }
 
 /* Register Node */
@@ -19,6 +19,7 @@
 #include "npf/npf.h"
 #include "npf/npf_if.h"
 #include "npf/npf_cache.h"
+#include "npf/npf_flow_cache.h"
 #include "npf/rproc/npf_ext_log.h"
 #include "npf/config/npf_config.h"
 #include "npf/config/npf_ruleset_type.h"
@@ -82,9 +83,13 @@ ip_acl_process_common(struct pl_packet *pkt, bool v4, int dir)
 	if (unlikely(!npf_cache_all(&npc, m, ethertype)))
 		goto drop;
 
-	/* Run the ruleset, get the decision */
-	npf_rule_t *rl =
-		npf_ruleset_inspect(&npc, m, npf_ruleset, NULL, ifp, dir);
+	/* Run the ruleset, unless the flow's verdict is cached */
+	npf_rule_t *rl;
+
+	if (!npf_flow_cache_lookup(npf_ruleset, &npc, dir, &rl)) {
+		rl = npf_ruleset_inspect(&npc, m, npf_ruleset, NULL, ifp, dir);
+		npf_flow_cache_insert(npf_ruleset, &npc, dir, rl);
+	}
 	npf_decision_t decision = npf_rule_decision(rl);
 
 	/* Optimise for specific drops, and implicit accept */
@@ -117,9 +122,11 @@ accept:
 
 drop:
 	if (dir == PFIL_IN)
-		return v4 ? IPV4_ACL_IN_DROP : IPV6_ACL_IN_DROP;
+		return pl_drop(pkt, PL_DROP_ACL_IN,
+			       v4 ? IPV4_ACL_IN_DROP : IPV6_ACL_IN_DROP);
 
-	return v4 ? IPV4_ACL_OUT_DROP : IPV6_ACL_OUT_DROP;
+	return pl_drop(pkt, PL_DROP_ACL_OUT,
+		       v4 ? IPV4_ACL_OUT_DROP : IPV6_ACL_OUT_DROP);
 }
 
 
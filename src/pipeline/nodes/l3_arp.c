@@ -231,7 +231,7 @@ arp_in_nothot_process(struct pl_packet *pkt)
 	ARPSTAT_INC(if_vrfid(ifp), received);
 
 	if (!arp_input_validate(ifp, m))
-		return ARP_IN_NOTHOT_DROP;
+		return pl_drop(pkt, PL_DROP_ARP, ARP_IN_NOTHOT_DROP);
 
 	ah = (struct ether_arp *) (eh + 1);
 	op = ntohs(ah->arp_op);
@@ -286,7 +286,7 @@ arp_in_nothot_process(struct pl_packet *pkt)
 				    addrb, sizeof(addrb)), ifp->if_name);
 
 		ARPSTAT_INC(if_vrfid(ifp), rxignored);
-		return ARP_IN_NOTHOT_DROP;
+		return pl_drop(pkt, PL_DROP_ARP, ARP_IN_NOTHOT_DROP);
 	}
 
 	/* RFC 2131 - IPv4 duplicate address detection */
@@ -294,7 +294,7 @@ arp_in_nothot_process(struct pl_packet *pkt)
 		goto reply;
 
 	if (ifp->if_flags & IFF_NOARP)
-		return ARP_IN_NOTHOT_DROP;
+		return pl_drop(pkt, PL_DROP_ARP, ARP_IN_NOTHOT_DROP);
 
 	garp = (isaddr == itaddr);
 
@@ -302,13 +302,13 @@ arp_in_nothot_process(struct pl_packet *pkt)
 		if (op == ARPOP_REQUEST &&
 		    ifp->ip_garp_op.garp_req_action == GARP_PKT_DROP) {
 			ARPSTAT_INC(if_vrfid(ifp), garp_reqs_dropped);
-			return ARP_IN_NOTHOT_DROP;
+			return pl_drop(pkt, PL_DROP_ARP, ARP_IN_NOTHOT_DROP);
 		}
 
 		if (op == ARPOP_REPLY &&
 		    ifp->ip_garp_op.garp_rep_action == GARP_PKT_DROP) {
 			ARPSTAT_INC(if_vrfid(ifp), garp_reps_dropped);
-			return ARP_IN_NOTHOT_DROP;
+			return pl_drop(pkt, PL_DROP_ARP, ARP_IN_NOTHOT_DROP);
 		}
 	}
 
@@ -331,19 +331,19 @@ arp_in_nothot_process(struct pl_packet *pkt)
 			if (is_local_controller() || if_is_uplink(ifp))
 				return ARP_IN_NOTHOT_LOCAL;
 			/* Remote controller does not maintain an arp cache */
-			return ARP_IN_NOTHOT_DROP;
+			return pl_drop(pkt, PL_DROP_ARP, ARP_IN_NOTHOT_DROP);
 		}
 	} else if (garp) {
 		if (op == ARPOP_REQUEST)
 			ARPSTAT_INC(if_vrfid(ifp), garp_reqs_dropped);
 		else
 			ARPSTAT_INC(if_vrfid(ifp), garp_reps_dropped);
-		return ARP_IN_NOTHOT_DROP;
+		return pl_drop(pkt, PL_DROP_ARP, ARP_IN_NOTHOT_DROP);
 	}
 
 reply:
 	if (op != ARPOP_REQUEST)
-		return ARP_IN_NOTHOT_DROP;
+		return pl_drop(pkt, PL_DROP_ARP, ARP_IN_NOTHOT_DROP);
 
 	ARPSTAT_INC(if_vrfid(ifp), rxrequests);
 
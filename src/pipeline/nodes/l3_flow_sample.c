@@ -0,0 +1,79 @@
+/*
+ * IPv4/IPv6 flow sample features
+ *
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <rte_branch_prediction.h>
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "flow_export.h"
+
+#include "pl_common.h"
+#include "pl_fused.h"
+#include "pl_node.h"
+#include "pl_nodes_common.h"
+
+ALWAYS_INLINE unsigned int
+ipv4_flow_sample_process(struct pl_packet *pkt)
+{
+	if (unlikely(flow_export_sample_due()))
+		flow_export_sample_ipv4(pkt->in_ifp, pkt->l3_hdr, pkt->mbuf);
+
+	return IPV4_FLOW_SAMPLE_ACCEPT;
+}
+
+ALWAYS_INLINE unsigned int
+ipv6_flow_sample_process(struct pl_packet *pkt)
+{
+	if (unlikely(flow_export_sample_due()))
+		flow_export_sample_ipv6(pkt->in_ifp, pkt->l3_hdr, pkt->mbuf);
+
+	return IPV6_FLOW_SAMPLE_ACCEPT;
+}
+
+/* Register Node */
+PL_REGISTER_NODE(ipv4_flow_sample_node) = {
+	.name = "vyatta:ipv4-flow-sample",
+	.type = PL_PROC,
+	.handler = ipv4_flow_sample_process,
+	.num_next = IPV4_FLOW_SAMPLE_NUM,
+	.next = {
+		[IPV4_FLOW_SAMPLE_ACCEPT] = "term-noop",
+	}
+};
+
+PL_REGISTER_NODE(ipv6_flow_sample_node) = {
+	.name = "vyatta:ipv6-flow-sample",
+	.type = PL_PROC,
+	.handler = ipv6_flow_sample_process,
+	.num_next = IPV6_FLOW_SAMPLE_NUM,
+	.next = {
+		[IPV6_FLOW_SAMPLE_ACCEPT] = "term-noop",
+	}
+};
+
+/*
+ * Register Features
+ *
+ * After PBR, so the packets sampled are those accepted on input.
+ */
+PL_REGISTER_FEATURE(ipv4_flow_sample_feat) = {
+	.name = "vyatta:ipv4-flow-sample",
+	.node_name = "ipv4-flow-sample",
+	.feature_point = "ipv4-validate",
+	.visit_after = "ipv4-pbr",
+	.id = PL_L3_V4_IN_FUSED_FEAT_FLOW_SAMPLE,
+};
+
+PL_REGISTER_FEATURE(ipv6_flow_sample_feat) = {
+	.name = "vyatta:ipv6-flow-sample",
+	.node_name = "ipv6-flow-sample",
+	.feature_point = "ipv6-validate",
+	.visit_after = "ipv6-pbr",
+	.id = PL_L3_V6_IN_FUSED_FEAT_FLOW_SAMPLE,
+};
@@ -9,12 +9,16 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 #include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
 #include <rte_branch_prediction.h>
 #include <rte_ether.h>
 #include <stdbool.h>
 
 #include "compiler.h"
 #include "if_var.h"
+#include "ip_funcs.h"
+#include "npf/alg/npf_alg_worker.h"
 #include "npf/config/npf_config.h"
 #include "npf/npf.h"
 #include "npf/npf_cmd.h"
@@ -23,6 +27,8 @@
 #include "pktmbuf.h"
 #include "pl_common.h"
 #include "pl_fused.h"
+#include "pl_nodes_common.h"
+#include "session/session.h"
 #include "urcu.h"
 
 enum {
@@ -47,6 +53,9 @@ ip_fw_in_process_common(struct pl_packet *pkt, bool v4)
 	if (npf_if_active(nif, bitmask)) {
 		struct rte_mbuf *m = pkt->mbuf;
 
+		if (unlikely(npf_alg_worker_steer(m, ifp, pkt->l2_pkt_type)))
+			return v4 ? IPV4_FW_IN_CONSUME : IPV6_FW_IN_CONSUME;
+
 		npf_result_t result =
 			npf_hook_track(ifp, &m, nif, PFIL_IN,
 				       pkt->npf_flags,
@@ -59,7 +68,8 @@ ip_fw_in_process_common(struct pl_packet *pkt, bool v4)
 		}
 
 		if (unlikely(result.decision != NPF_DECISION_PASS))
-			return v4 ? IPV4_FW_IN_DROP : IPV6_FW_IN_DROP;
+			return pl_drop(pkt, PL_DROP_FW_IN,
+				       v4 ? IPV4_FW_IN_DROP : IPV6_FW_IN_DROP);
 
 		pkt->npf_flags = result.flags;
 
@@ -85,17 +95,93 @@ ipv6_fw_in_process(struct pl_packet *pkt)
 	return ip_fw_in_process_common(pkt, V6_PKT);
 }
 
+/*
+ * Look up the sessions of the vector in bulk, leaving the matches
+ * cached on the packets for npf_hook_track().  Fragments and ICMP
+ * are left to the per-packet lookup, as are packets that NPTv6 may
+ * yet translate ahead of the firewall.
+ */
+static ALWAYS_INLINE void
+ip_fw_in_vec_prepare(struct pl_packet **pkts, unsigned int n, bool v4)
+{
+	struct rte_mbuf *lkup_mbufs[PL_VEC_MAX];
+	uint32_t if_index[PL_VEC_MAX];
+	struct ifnet *last_ifp = NULL;
+	bool last_ok = false;
+	unsigned int lkup_n = 0;
+	unsigned long bitmask;
+	unsigned int i;
+
+	if (v4)
+		bitmask = NPF_IF_SESSION | NPF_V4_TRACK_IN;
+	else
+		bitmask = NPF_IF_SESSION | NPF_V6_TRACK_IN;
+
+	for (i = 0; i < n; i++) {
+		struct pl_packet *pkt = pkts[i];
+		struct ifnet *ifp = pkt->in_ifp;
+
+		if (ifp != last_ifp) {
+			struct npf_if *nif = rcu_dereference(ifp->if_npf);
+
+			last_ifp = ifp;
+			last_ok = npf_if_active(nif, bitmask) &&
+				(v4 || !pl_node_is_feature_enabled(
+					&nptv6_in_feat, ifp));
+		}
+		if (!last_ok)
+			continue;
+
+		if (v4) {
+			struct iphdr *ip = pkt->l3_hdr;
+
+			if (ip_is_fragment(ip) || ip->protocol == IPPROTO_ICMP)
+				continue;
+		} else {
+			struct ip6_hdr *ip6 = pkt->l3_hdr;
+
+			if (ip6->ip6_nxt == IPPROTO_FRAGMENT ||
+			    ip6->ip6_nxt == IPPROTO_ICMPV6)
+				continue;
+		}
+
+		lkup_mbufs[lkup_n] = pkt->mbuf;
+		if_index[lkup_n] = ifp->if_index;
+		lkup_n++;
+	}
+
+	/* nothing to be gained over the per-packet lookup */
+	if (lkup_n < 2)
+		return;
+
+	session_lookup_bulk(lkup_mbufs, if_index, lkup_n);
+}
+
+static void
+ipv4_fw_in_vec_prepare(struct pl_packet **pkts, unsigned int n)
+{
+	ip_fw_in_vec_prepare(pkts, n, V4_PKT);
+}
+
+static void
+ipv6_fw_in_vec_prepare(struct pl_packet **pkts, unsigned int n)
+{
+	ip_fw_in_vec_prepare(pkts, n, V6_PKT);
+}
+
 /* Register Node */
 PL_REGISTER_NODE(ipv4_fw_in_node) = {
 	.name = "vyatta:ipv4-fw-in",
 	.type = PL_PROC,
 	.handler = ipv4_fw_in_process,
+	.vec_prepare = ipv4_fw_in_vec_prepare,
 	.num_next = IPV4_FW_NUM,
 	.next = {
 		[IPV4_FW_IN_ACCEPT] = "term-noop",
 		[IPV4_FW_IN_TO_V6]  = "term-v4-to-v6",
 		[IPV4_FW_IN_TO_LOCAL] = "ipv4-local",
 		[IPV4_FW_IN_DROP]   = "term-drop",
+		[IPV4_FW_IN_CONSUME] = "term-finish",
 	}
 };
 
@@ -103,11 +189,13 @@ PL_REGISTER_NODE(ipv6_fw_in_node) = {
 	.name = "vyatta:ipv6-fw-in",
 	.type = PL_PROC,
 	.handler = ipv6_fw_in_process,
+	.vec_prepare = ipv6_fw_in_vec_prepare,
 	.num_next = IPV6_FW_NUM,
 	.next = {
 		[IPV6_FW_IN_ACCEPT] = "term-noop",
 		[IPV6_FW_IN_TO_V4]  = "term-v6-to-v4",
-		[IPV6_FW_IN_DROP]   = "ipv6-drop"
+		[IPV6_FW_IN_DROP]   = "ipv6-drop",
+		[IPV6_FW_IN_CONSUME] = "term-finish",
 	}
 };
 
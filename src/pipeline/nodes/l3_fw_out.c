@@ -5,12 +5,15 @@
  *
  */
 #include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
 #include <rte_branch_prediction.h>
 #include <rte_ether.h>
 #include <stdbool.h>
 
 #include "compiler.h"
 #include "if_var.h"
+#include "ip_funcs.h"
 #include "npf/config/npf_config.h"
 #include "npf/npf.h"
 #include "npf/npf_if.h"
@@ -18,6 +21,8 @@
 #include "pktmbuf.h"
 #include "pl_common.h"
 #include "pl_fused.h"
+#include "pl_nodes_common.h"
+#include "session/session.h"
 #include "urcu.h"
 
 enum {
@@ -54,7 +59,8 @@ ip_fw_out_process_common(struct pl_packet *pkt, bool v4)
 			pkt->l3_hdr = pktmbuf_mtol3(m, void *);
 		}
 		if (unlikely(result.decision != NPF_DECISION_PASS))
-			return v4 ? IPV4_FW_OUT_DROP : IPV6_FW_OUT_DROP;
+			return pl_drop(pkt, PL_DROP_FW_OUT,
+				       v4 ? IPV4_FW_OUT_DROP : IPV6_FW_OUT_DROP);
 		/* Discard result.flags as no change can happen */
 	}
 
@@ -73,11 +79,87 @@ ipv6_fw_out_process(struct pl_packet *pkt)
 	return ip_fw_out_process_common(pkt, V6_PKT);
 }
 
+/*
+ * Look up the sessions of the vector in bulk, leaving the matches
+ * cached on the packets for npf_hook_track().  Fragments and ICMP
+ * are left to the per-packet lookup, as are packets that CGNAT or
+ * NPTv6 may yet translate ahead of the firewall.
+ */
+static ALWAYS_INLINE void
+ip_fw_out_vec_prepare(struct pl_packet **pkts, unsigned int n, bool v4)
+{
+	struct rte_mbuf *lkup_mbufs[PL_VEC_MAX];
+	uint32_t if_index[PL_VEC_MAX];
+	struct ifnet *last_ifp = NULL;
+	bool last_ok = false;
+	unsigned int lkup_n = 0;
+	unsigned long bitmask;
+	unsigned int i;
+
+	if (v4)
+		bitmask = NPF_IF_SESSION | NPF_V4_TRACK_OUT;
+	else
+		bitmask = NPF_IF_SESSION | NPF_V6_TRACK_OUT;
+
+	for (i = 0; i < n; i++) {
+		struct pl_packet *pkt = pkts[i];
+		struct ifnet *ifp = pkt->out_ifp;
+
+		if (ifp != last_ifp) {
+			struct npf_if *nif = rcu_dereference(ifp->if_npf);
+
+			last_ifp = ifp;
+			last_ok = npf_if_active(nif, bitmask) &&
+				!pl_node_is_feature_enabled(
+					v4 ? &ipv4_cgnat_out_feat :
+					&nptv6_out_feat, ifp);
+		}
+		if (!last_ok)
+			continue;
+
+		if (v4) {
+			struct iphdr *ip = pkt->l3_hdr;
+
+			if (ip_is_fragment(ip) || ip->protocol == IPPROTO_ICMP)
+				continue;
+		} else {
+			struct ip6_hdr *ip6 = pkt->l3_hdr;
+
+			if (ip6->ip6_nxt == IPPROTO_FRAGMENT ||
+			    ip6->ip6_nxt == IPPROTO_ICMPV6)
+				continue;
+		}
+
+		lkup_mbufs[lkup_n] = pkt->mbuf;
+		if_index[lkup_n] = ifp->if_index;
+		lkup_n++;
+	}
+
+	/* nothing to be gained over the per-packet lookup */
+	if (lkup_n < 2)
+		return;
+
+	session_lookup_bulk(lkup_mbufs, if_index, lkup_n);
+}
+
+static void
+ipv4_fw_out_vec_prepare(struct pl_packet **pkts, unsigned int n)
+{
+	ip_fw_out_vec_prepare(pkts, n, V4_PKT);
+}
+
+static void
+ipv6_fw_out_vec_prepare(struct pl_packet **pkts, unsigned int n)
+{
+	ip_fw_out_vec_prepare(pkts, n, V6_PKT);
+}
+
 /* Register Node */
 PL_REGISTER_NODE(ipv4_fw_out_node) = {
 	.name = "vyatta:ipv4-fw-out",
 	.type = PL_PROC,
 	.handler = ipv4_fw_out_process,
+	.vec_prepare = ipv4_fw_out_vec_prepare,
 	.num_next = IPV4_FW_OUT_NUM,
 	.next = {
 		[IPV4_FW_OUT_ACCEPT]       = "term-noop",
@@ -89,6 +171,7 @@ PL_REGISTER_NODE(ipv6_fw_out_node) = {
 	.name = "vyatta:ipv6-fw-out",
 	.type = PL_PROC,
 	.handler = ipv6_fw_out_process,
+	.vec_prepare = ipv6_fw_out_vec_prepare,
 	.num_next = IPV6_FW_OUT_NUM,
 	.next = {
 		[IPV6_FW_OUT_ACCEPT]       = "term-noop",
@@ -95,7 +95,8 @@ ip_pbr_process_common(struct pl_packet *pkt, bool v4)
 	}
 
 	if (unlikely(result.decision == NPF_DECISION_BLOCK))
-		return v4 ? IPV4_PBR_DROP : IPV6_PBR_DROP;
+		return pl_drop(pkt, PL_DROP_PBR,
+			       v4 ? IPV4_PBR_DROP : IPV6_PBR_DROP);
 
 	if (result.tag_set)
 		pkt->tblid = result.tag;
@@ -111,12 +112,14 @@ ip_pbr_process_common(struct pl_packet *pkt, bool v4)
 		if (vrf && vrf->v_pbrtablemap[pkt->tblid])
 			pkt->tblid = vrf->v_pbrtablemap[pkt->tblid];
 		else
-			return v4 ? IPV4_PBR_DROP : IPV6_PBR_DROP;
+			return pl_drop(pkt, PL_DROP_PBR,
+				       v4 ? IPV4_PBR_DROP : IPV6_PBR_DROP);
 	}
 
 	if (unlikely(!ip_pbr_is_tblid_valid(pkt->mbuf,
 					    pkt->tblid, v4)))
-		return v4 ? IPV4_PBR_DROP : IPV6_PBR_DROP;
+		return pl_drop(pkt, PL_DROP_PBR,
+			       v4 ? IPV4_PBR_DROP : IPV6_PBR_DROP);
 
 	return v4 ? IPV4_PBR_ACCEPT : IPV6_PBR_ACCEPT;
 }
@@ -15,6 +15,7 @@
 #include <linux/if.h>
 #include <rte_branch_prediction.h>
 #include <rte_mbuf.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -279,62 +280,105 @@ tcp_mss_process_common(struct rte_mbuf **mbuf, uint8_t *l3_hdr,
 			      mss_offset + sizeof(struct tcphdr));
 }
 
+/* Offset of the flags byte in the TCP header */
+#define TCP_FLAGS_OFF 13
+
 /*
- * IPv4 input node
+ * Only a SYN can carry the MSS option.  Test its flags byte in place
+ * when the TCP header is in the first segment, so that all other
+ * segments are passed over without the out of line parse.
  */
-ALWAYS_INLINE unsigned int
-ipv4_tcp_mss_in_process(struct pl_packet *pkt)
+static ALWAYS_INLINE bool
+tcp_mss_not_syn(const struct rte_mbuf *mbuf, const uint8_t *l3_hdr,
+		uint16_t l3_len)
+{
+	const uint8_t *end = rte_pktmbuf_mtod(mbuf, const uint8_t *) +
+		rte_pktmbuf_data_len(mbuf);
+	const uint8_t *tcp = l3_hdr + l3_len;
+
+	return tcp + sizeof(struct tcphdr) <= end &&
+		!(tcp[TCP_FLAGS_OFF] & TH_SYN);
+}
+
+static ALWAYS_INLINE void
+ipv4_tcp_mss_process(struct pl_packet *pkt, struct ifnet *ifp)
 {
 	struct rte_mbuf *mbuf = pkt->mbuf;
 	struct iphdr *ip = pkt->l3_hdr;
 	uint16_t l3_len;
 
-	if (likely(pkt->in_ifp->tcp_mss_type[TCP_MSS_V4] == TCP_MSS_NONE))
-		return IPV4_TCP_MSS_IN_CONTINUE;
-
 	if (ip->protocol != IPPROTO_TCP)
-		return IPV4_TCP_MSS_IN_CONTINUE;
+		return;
 
 	l3_len = ip->ihl << 2;
-	tcp_mss_process_common(&mbuf, pkt->l3_hdr, TCP_MSS_V4, pkt->in_ifp,
-			       l3_len);
+	if (likely(tcp_mss_not_syn(mbuf, pkt->l3_hdr, l3_len)))
+		return;
+
+	tcp_mss_process_common(&mbuf, pkt->l3_hdr, TCP_MSS_V4, ifp, l3_len);
 
 	/* mbuf may have changed */
 	if (mbuf != pkt->mbuf) {
 		pkt->mbuf = mbuf;
 		pkt->l3_hdr = pktmbuf_mtol3(mbuf, void *);
 	}
-
-	return IPV4_TCP_MSS_IN_CONTINUE;
 }
 
-/*
- * IPv6 input node
- */
-ALWAYS_INLINE unsigned int
-ipv6_tcp_mss_in_process(struct pl_packet *pkt)
+static ALWAYS_INLINE void
+ipv6_tcp_mss_process(struct pl_packet *pkt, struct ifnet *ifp)
 {
 	struct rte_mbuf *mbuf = pkt->mbuf;
+	struct ip6_hdr *ip6 = pkt->l3_hdr;
 	uint8_t ipproto;
 	uint16_t l3_len;
 
-	if (likely(pkt->in_ifp->tcp_mss_type[TCP_MSS_V6] == TCP_MSS_NONE))
-		return IPV6_TCP_MSS_IN_CONTINUE;
+	/* Without extension headers, TCP follows the fixed header */
+	if (likely(ip6->ip6_nxt == IPPROTO_TCP)) {
+		l3_len = sizeof(*ip6);
+	} else {
+		ipproto = ip6_findpayload(mbuf, &l3_len);
 
-	ipproto = ip6_findpayload(pkt->mbuf, &l3_len);
+		if (ipproto != IPPROTO_TCP)
+			return;
 
-	if (ipproto != IPPROTO_TCP)
-		return IPV6_TCP_MSS_IN_CONTINUE;
+		l3_len -= pktmbuf_l2_len(mbuf);
+	}
 
-	l3_len -= pktmbuf_l2_len(pkt->mbuf);
-	tcp_mss_process_common(&mbuf, pkt->l3_hdr, TCP_MSS_V6, pkt->in_ifp,
-			       l3_len);
+	if (likely(tcp_mss_not_syn(mbuf, pkt->l3_hdr, l3_len)))
+		return;
+
+	tcp_mss_process_common(&mbuf, pkt->l3_hdr, TCP_MSS_V6, ifp, l3_len);
 
 	/* mbuf may have changed */
 	if (mbuf != pkt->mbuf) {
 		pkt->mbuf = mbuf;
 		pkt->l3_hdr = pktmbuf_mtol3(mbuf, void *);
 	}
+}
+
+/*
+ * IPv4 input node
+ */
+ALWAYS_INLINE unsigned int
+ipv4_tcp_mss_in_process(struct pl_packet *pkt)
+{
+	if (likely(pkt->in_ifp->tcp_mss_type[TCP_MSS_V4] == TCP_MSS_NONE))
+		return IPV4_TCP_MSS_IN_CONTINUE;
+
+	ipv4_tcp_mss_process(pkt, pkt->in_ifp);
+
+	return IPV4_TCP_MSS_IN_CONTINUE;
+}
+
+/*
+ * IPv6 input node
+ */
+ALWAYS_INLINE unsigned int
+ipv6_tcp_mss_in_process(struct pl_packet *pkt)
+{
+	if (likely(pkt->in_ifp->tcp_mss_type[TCP_MSS_V6] == TCP_MSS_NONE))
+		return IPV6_TCP_MSS_IN_CONTINUE;
+
+	ipv6_tcp_mss_process(pkt, pkt->in_ifp);
 
 	return IPV6_TCP_MSS_IN_CONTINUE;
 }
@@ -381,25 +425,10 @@ PL_REGISTER_FEATURE(ipv6_tcp_mss_in_feat) = {
 ALWAYS_INLINE unsigned int
 ipv4_tcp_mss_out_process(struct pl_packet *pkt)
 {
-	struct rte_mbuf *mbuf = pkt->mbuf;
-	struct iphdr *ip = pkt->l3_hdr;
-	uint16_t l3_len;
-
 	if (likely(pkt->out_ifp->tcp_mss_type[TCP_MSS_V4] == TCP_MSS_NONE))
 		return IPV4_TCP_MSS_OUT_CONTINUE;
 
-	if (ip->protocol != IPPROTO_TCP)
-		return IPV4_TCP_MSS_OUT_CONTINUE;
-
-	l3_len = ip->ihl << 2;
-	tcp_mss_process_common(&mbuf, pkt->l3_hdr, TCP_MSS_V4, pkt->out_ifp,
-			       l3_len);
-
-	/* mbuf may have changed */
-	if (mbuf != pkt->mbuf) {
-		pkt->mbuf = mbuf;
-		pkt->l3_hdr = pktmbuf_mtol3(mbuf, void *);
-	}
+	ipv4_tcp_mss_process(pkt, pkt->out_ifp);
 
 	return IPV4_TCP_MSS_OUT_CONTINUE;
 }
@@ -410,27 +439,10 @@ ipv4_tcp_mss_out_process(struct pl_packet *pkt)
 ALWAYS_INLINE unsigned int
 ipv6_tcp_mss_out_process(struct pl_packet *pkt)
 {
-	struct rte_mbuf *mbuf = pkt->mbuf;
-	uint8_t ipproto;
-	uint16_t l3_len;
-
 	if (likely(pkt->out_ifp->tcp_mss_type[TCP_MSS_V6] == TCP_MSS_NONE))
 		return IPV6_TCP_MSS_OUT_CONTINUE;
 
-	ipproto = ip6_findpayload(pkt->mbuf, &l3_len);
-
-	if (ipproto != IPPROTO_TCP)
-		return IPV6_TCP_MSS_OUT_CONTINUE;
-
-	l3_len -= pktmbuf_l2_len(pkt->mbuf);
-	tcp_mss_process_common(&mbuf, pkt->l3_hdr, TCP_MSS_V6, pkt->out_ifp,
-			       l3_len);
-
-	/* mbuf may have changed */
-	if (mbuf != pkt->mbuf) {
-		pkt->mbuf = mbuf;
-		pkt->l3_hdr = pktmbuf_mtol3(mbuf, void *);
-	}
+	ipv6_tcp_mss_process(pkt, pkt->out_ifp);
 
 	return IPV6_TCP_MSS_OUT_CONTINUE;
 }
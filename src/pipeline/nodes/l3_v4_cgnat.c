@@ -557,6 +557,7 @@ translate:
 
 	/* Translate */
 	cgn_translate_at(cpk, cse, dir, n_ptr, false, false);
+	pktmbuf_mdata_clear(mbuf, PKT_MDATA_L4);
 
 	/* Mark as CGNAT for the rest of the packet path */
 	uint32_t pkt_flags;
@@ -743,6 +744,9 @@ ipv4_cgnat_in_process(struct pl_packet *pkt)
 	if (unlikely(error))
 		_cgn_error_inc(error, CGN_DIR_IN);
 
+	if (rc == IPV4_CGNAT_IN_DROP)
+		pkt->drop_reason = PL_DROP_CGNAT;
+
 	return rc;
 }
 
@@ -817,6 +821,9 @@ ipv4_cgnat_out_process(struct pl_packet *pkt)
 	if (unlikely(error))
 		_cgn_error_inc(error, CGN_DIR_OUT);
 
+	if (rc == IPV4_CGNAT_OUT_DROP)
+		pkt->drop_reason = PL_DROP_CGNAT;
+
 	return rc;
 }
 
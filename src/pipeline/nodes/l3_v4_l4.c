@@ -31,7 +31,7 @@ ipv4_l4_process_common(struct pl_packet *pkt, enum pl_mode mode __unused)
 		pkt->mbuf = m;
 		return IPV4_L4_ACCEPT;
 	} else
-		return IPV4_L4_DROP;
+		return pl_drop(pkt, PL_DROP_L4, IPV4_L4_DROP);
 }
 
 ALWAYS_INLINE unsigned int
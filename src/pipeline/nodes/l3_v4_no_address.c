@@ -52,6 +52,6 @@ PL_REGISTER_FEATURE(ipv4_in_no_address_feat) = {
 	.name = "vyatta:ipv4-in-no-address",
 	.node_name = "ipv4-in-no-address",
 	.feature_point = "ipv4-validate",
-	.visit_after = "ipv4-pbr",
+	.visit_after = "ipv4-flow-sample",
 	.id = PL_L3_V4_IN_FUSED_FEAT_NO_ADDRESS,
 };
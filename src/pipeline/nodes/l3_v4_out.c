@@ -119,7 +119,7 @@ ipv4_out_process_common(struct pl_packet *pkt, enum pl_mode mode)
 				       ICMP_FRAG_NEEDED, htons(out_ifp->if_mtu),
 				       out_ifp);
 			/* The error preserved the original; make caller drop */
-			return IPV4_OUT_DROP;
+			return pl_drop(pkt, PL_DROP_TOO_BIG, IPV4_OUT_DROP);
 		}
 	}
 
@@ -129,7 +129,7 @@ ipv4_out_process_common(struct pl_packet *pkt, enum pl_mode mode)
 		return IPV4_OUT_ENCAP;
 	} else {
 		struct ipv4_out_frag_ctx ctx = {nxt, in_ifp, pkt->l2_pkt_type};
-		ip_fragment(out_ifp, pkt->mbuf, &ctx, ipv4_out_frag);
+		ip_fragment_indirect(out_ifp, pkt->mbuf, &ctx, ipv4_out_frag);
 	}
 
 	return IPV4_OUT_FINISH;
@@ -162,6 +162,14 @@ ipv4_out_feat_iterate(struct pl_node *node, bool first,
 					feature_id, context);
 }
 
+ALWAYS_INLINE unsigned int
+ipv4_out_feat_mask(struct pl_node *node)
+{
+	struct ifnet *ifp = ipv4_out_node_to_ifp(node);
+
+	return pl_node_feat_mask_u16(&ifp->ip_out_features);
+}
+
 static struct pl_node *
 ipv4_out_node_lookup(const char *name)
 {
@@ -176,6 +184,7 @@ PL_REGISTER_NODE(ipv4_out_node) = {
 	.handler = ipv4_out_process,
 	.feat_change = ipv4_out_feat_change,
 	.feat_iterate = ipv4_out_feat_iterate,
+	.feat_mask = ipv4_out_feat_mask,
 	.lookup_by_name = ipv4_out_node_lookup,
 	.num_next = IPV4_OUT_NUM,
 	.next = {
@@ -44,7 +44,8 @@ ipv4_post_route_lookup_process(struct pl_packet *pkt)
 		IPSTAT_INC_IFP(ifp, IPSTATS_MIB_INNOROUTES);
 		icmp_error(ifp, pkt->mbuf, ICMP_DEST_UNREACH,
 			   ICMP_NET_UNREACH, 0);
-		return IPV4_POST_ROUTE_LOOKUP_DROP;
+		return pl_drop(pkt, PL_DROP_NO_ROUTE,
+			       IPV4_POST_ROUTE_LOOKUP_DROP);
 	} else if (unlikely(nxt->flags & (RTF_SLOWPATH | RTF_LOCAL))) {
 		return IPV4_POST_ROUTE_LOOKUP_LOCAL;
 	}
@@ -64,7 +65,8 @@ ipv4_post_route_lookup_process(struct pl_packet *pkt)
 		if (unlikely(IN_LOOPBACK(ntohl(ip->daddr))))
 			IPSTAT_INC(if_vrfid(ifp), IPSTATS_MIB_INADDRERRORS);
 
-		return IPV4_POST_ROUTE_LOOKUP_DROP;
+		return pl_drop(pkt, PL_DROP_BLACKHOLE,
+			       IPV4_POST_ROUTE_LOOKUP_DROP);
 	}
 
 	/* MPLS imposition required because nh has given us a label */
@@ -83,7 +85,8 @@ ipv4_post_route_lookup_process(struct pl_packet *pkt)
 	if (unlikely(!nxt_ifp || !(nxt_ifp->if_flags & IFF_UP))) {
 		icmp_error(ifp, pkt->mbuf, ICMP_DEST_UNREACH,
 			   ICMP_HOST_UNREACH, 0);
-		return IPV4_POST_ROUTE_LOOKUP_DROP;
+		return pl_drop(pkt, PL_DROP_NH_DOWN,
+			       IPV4_POST_ROUTE_LOOKUP_DROP);
 	}
 
 	pktmbuf_clear_rx_vlan(pkt->mbuf);
@@ -67,7 +67,7 @@ _ipv4_route_lookup_process_common(struct pl_packet *pkt, enum pl_mode mode,
 
 		/* RFC 1122 disallow broadcast sent to L3 unicast */
 		IPSTAT_INC(if_vrfid(ifp), IPSTATS_MIB_INADDRERRORS);
-		return IPV4_ROUTE_LOOKUP_DROP;
+		return pl_drop(pkt, PL_DROP_IP_ADDR, IPV4_ROUTE_LOOKUP_DROP);
 	}
 
 	/* Is it a IP multicast? */
@@ -78,10 +78,15 @@ _ipv4_route_lookup_process_common(struct pl_packet *pkt, enum pl_mode mode,
 	}
 
 	vrf = vrf_get_rcu_fast(pktmbuf_get_vrf(pkt->mbuf));
-	struct next_hop *nxt = rt_lookup_fast(vrf, ip->daddr,
-					      pkt->tblid, pkt->mbuf);
+	struct next_hop *nxt;
 
-	pkt->nxt.v4 = nxt;
+	if (pkt->nxt_resolved) {
+		nxt = pkt->nxt.v4;
+		pkt->nxt_resolved = false;
+	} else {
+		nxt = rt_lookup_fast(vrf, ip->daddr, pkt->tblid, pkt->mbuf);
+		pkt->nxt.v4 = nxt;
+	}
 
 	/*
 	 * if nxt == NULL, postpone sending icmp err
@@ -98,7 +103,8 @@ _ipv4_route_lookup_process_common(struct pl_packet *pkt, enum pl_mode mode,
 		break;
 	case IPV4_LKUP_MODE_HOST:
 		IPSTAT_INC_IFP(ifp, IPSTATS_MIB_INADDRERRORS);
-		return IPV4_ROUTE_LOOKUP_DROP;
+		return pl_drop(pkt, PL_DROP_NOT_FORWARDING,
+			       IPV4_ROUTE_LOOKUP_DROP);
 	}
 
 	/* needs slow path */
@@ -112,13 +118,13 @@ _ipv4_route_lookup_process_common(struct pl_packet *pkt, enum pl_mode mode,
 		IPSTAT_INC_IFP(ifp, IPSTATS_MIB_INHDRERRORS);
 		icmp_error(ifp, pkt->mbuf, ICMP_TIME_EXCEEDED,
 			   ICMP_EXC_TTL, 0);
-		return IPV4_ROUTE_LOOKUP_DROP;
+		return pl_drop(pkt, PL_DROP_TTL, IPV4_ROUTE_LOOKUP_DROP);
 	}
 
 	/* Don't forward packets with unspecified source address */
 	if (unlikely(!ip->saddr)) {
 		IPSTAT_INC_IFP(ifp, IPSTATS_MIB_INADDRERRORS);
-		return IPV4_ROUTE_LOOKUP_DROP;
+		return pl_drop(pkt, PL_DROP_IP_ADDR, IPV4_ROUTE_LOOKUP_DROP);
 	}
 
 	switch (mode) {
@@ -167,6 +173,57 @@ ipv4_route_lookup_host_process(struct pl_packet *pkt)
 						 IPV4_LKUP_MODE_HOST);
 }
 
+/*
+ * Resolve the routes for the unicast packets of the vector that share
+ * the VRF and table of the first one in a single bulk lookup. The
+ * rest are left to the per-packet lookup.
+ */
+static void
+ipv4_route_lookup_vec_prepare(struct pl_packet **pkts, unsigned int n)
+{
+	struct pl_packet *lkup_pkts[PL_VEC_MAX];
+	struct rte_mbuf *lkup_mbufs[PL_VEC_MAX];
+	struct next_hop *nxt[PL_VEC_MAX];
+	in_addr_t dst[PL_VEC_MAX];
+	vrfid_t vrfid = VRF_INVALID_ID;
+	uint32_t tblid = 0;
+	unsigned int lkup_n = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		struct pl_packet *pkt = pkts[i];
+		struct iphdr *ip = pkt->l3_hdr;
+
+		if (unlikely(pkt->l2_pkt_type == L2_PKT_BROADCAST ||
+			     IN_MULTICAST(ntohl(ip->daddr))))
+			continue;
+
+		if (!lkup_n) {
+			vrfid = pktmbuf_get_vrf(pkt->mbuf);
+			tblid = pkt->tblid;
+		} else if (unlikely(pktmbuf_get_vrf(pkt->mbuf) != vrfid ||
+				    pkt->tblid != tblid))
+			continue;
+
+		lkup_pkts[lkup_n] = pkt;
+		lkup_mbufs[lkup_n] = pkt->mbuf;
+		dst[lkup_n] = ip->daddr;
+		lkup_n++;
+	}
+
+	/* nothing to be gained over the per-packet lookup */
+	if (lkup_n < 2)
+		return;
+
+	rt_lookup_fast_bulk(vrf_get_rcu_fast(vrfid), dst, tblid, lkup_mbufs,
+			    nxt, lkup_n);
+
+	for (i = 0; i < lkup_n; i++) {
+		lkup_pkts[i]->nxt.v4 = nxt[i];
+		lkup_pkts[i]->nxt_resolved = true;
+	}
+}
+
 static int
 ipv4_route_lookup_feat_change(struct pl_node *node,
 				   struct pl_feature_registration *feat,
@@ -188,13 +245,23 @@ ipv4_route_lookup_feat_iterate(struct pl_node *node, bool first,
 					feature_id, context);
 }
 
+ALWAYS_INLINE unsigned int
+ipv4_route_lookup_feat_mask(struct pl_node *node)
+{
+	struct vrf *vrf = ipv4_route_lookup_node_to_vrf(node);
+
+	return pl_node_feat_mask_u16(&vrf->v_ip_post_rlkup_features);
+}
+
 /* Register Node */
 PL_REGISTER_NODE(ipv4_route_lookup_node) = {
 	.name = "vyatta:ipv4-route-lookup",
 	.type = PL_PROC,
 	.handler = ipv4_route_lookup_process,
+	.vec_prepare = ipv4_route_lookup_vec_prepare,
 	.feat_change = ipv4_route_lookup_feat_change,
 	.feat_iterate = ipv4_route_lookup_feat_iterate,
+	.feat_mask = ipv4_route_lookup_feat_mask,
 	.num_next = IPV4_ROUTE_LOOKUP_NUM,
 	.next = {
 		[IPV4_ROUTE_LOOKUP_ACCEPT] = "ipv4-post-route-lookup",
@@ -19,28 +19,23 @@
 #include "compiler.h"
 #include "if_var.h"
 #include "nh.h"
+#include "pktmbuf.h"
 #include "pl_common.h"
 #include "pl_fused.h"
+#include "pl_node.h"
+#include "pl_nodes_common.h"
 #include "route.h"
 #include "route_flags.h"
 #include "snmp_mib.h"
+#include "urcu.h"
+#include "vrf.h"
 
 struct rte_mbuf;
 
-/*
- * Validate source address matches to prevent IP spoofing per RFC3704.
- */
-static __attribute__((noinline)) bool
-verify_path(in_addr_t src, struct ifnet *ifp, uint32_t tbl,
-	    struct rte_mbuf *m)
+/* Does the route to the source allow it to arrive on ifp? */
+static ALWAYS_INLINE bool
+verify_path_nh(const struct next_hop *nxt, const struct ifnet *ifp)
 {
-	struct next_hop *nxt;
-
-	/* Always allow unspecified such that e.g. DHCP requests are received */
-	if (!src)
-		return true;
-
-	nxt = rt_lookup(src, tbl, m);
 	if (nxt == NULL)
 		return false;
 
@@ -58,26 +53,111 @@ verify_path(in_addr_t src, struct ifnet *ifp, uint32_t tbl,
 	return true;
 }
 
+/*
+ * Validate source address matches to prevent IP spoofing per RFC3704.
+ */
+static __attribute__((noinline)) bool
+verify_path(in_addr_t src, struct ifnet *ifp, uint32_t tbl,
+	    struct rte_mbuf *m)
+{
+	/* Always allow unspecified such that e.g. DHCP requests are received */
+	if (!src)
+		return true;
+
+	return verify_path_nh(rt_lookup(src, tbl, m), ifp);
+}
+
 ALWAYS_INLINE unsigned int
 ipv4_rpf_process(struct pl_packet *pkt)
 {
 	struct iphdr *ip = pkt->l3_hdr;
 	struct ifnet *ifp = pkt->in_ifp;
+	bool ok;
+
+	if (pkt->rpf_resolved) {
+		ok = pkt->rpf_ok;
+		pkt->rpf_resolved = false;
+	} else
+		ok = verify_path(ip->saddr, ifp, RT_TABLE_MAIN, pkt->mbuf);
 
 	/* Ingress unicast Reverse Path Filter check */
-	if (unlikely(!verify_path(ip->saddr, ifp, RT_TABLE_MAIN, pkt->mbuf))) {
+	if (unlikely(!ok)) {
 		IPSTAT_INC_IFP(ifp, IPSTATS_MIB_INADDRERRORS);
-		return IPV4_RPF_DROP;
+		return pl_drop(pkt, PL_DROP_RPF, IPV4_RPF_DROP);
 	}
 
 	return IPV4_RPF_ACCEPT;
 }
 
+/*
+ * Check the sources of the packets of the vector arriving on
+ * interfaces with RPF enabled, and sharing the VRF of the first
+ * of them, in a single bulk lookup. The rest are left to the
+ * per-packet lookup.
+ *
+ * RPF is the first feature at the validate feature point, so the
+ * source and VRF are still those seen here when it runs.
+ */
+static void
+ipv4_rpf_vec_prepare(struct pl_packet **pkts, unsigned int n)
+{
+	struct pl_packet *lkup_pkts[PL_VEC_MAX];
+	struct rte_mbuf *lkup_mbufs[PL_VEC_MAX];
+	struct next_hop *nxt[PL_VEC_MAX];
+	in_addr_t src[PL_VEC_MAX];
+	vrfid_t vrfid = VRF_INVALID_ID;
+	struct ifnet *last_ifp = NULL;
+	bool last_ok = false;
+	unsigned int lkup_n = 0;
+	struct vrf *vrf;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		struct pl_packet *pkt = pkts[i];
+		struct iphdr *ip = pkt->l3_hdr;
+
+		if (pkt->in_ifp != last_ifp) {
+			last_ifp = pkt->in_ifp;
+			last_ok = pl_node_is_feature_enabled(&ipv4_rpf_feat,
+							     last_ifp);
+		}
+		if (!last_ok || !ip->saddr)
+			continue;
+
+		if (!lkup_n)
+			vrfid = pktmbuf_get_vrf(pkt->mbuf);
+		else if (unlikely(pktmbuf_get_vrf(pkt->mbuf) != vrfid))
+			continue;
+
+		lkup_pkts[lkup_n] = pkt;
+		lkup_mbufs[lkup_n] = pkt->mbuf;
+		src[lkup_n] = ip->saddr;
+		lkup_n++;
+	}
+
+	/* nothing to be gained over the per-packet lookup */
+	if (lkup_n < 2)
+		return;
+
+	vrf = vrf_get_rcu(vrfid);
+	if (!vrf)
+		return;
+
+	rt_lookup_fast_bulk(vrf, src, RT_TABLE_MAIN, lkup_mbufs, nxt, lkup_n);
+
+	for (i = 0; i < lkup_n; i++) {
+		lkup_pkts[i]->rpf_ok = verify_path_nh(nxt[i],
+						      lkup_pkts[i]->in_ifp);
+		lkup_pkts[i]->rpf_resolved = true;
+	}
+}
+
 /* Register Node */
 PL_REGISTER_NODE(ipv4_rpf_node) = {
 	.name = "vyatta:ipv4-rpf",
 	.type = PL_PROC,
 	.handler = ipv4_rpf_process,
+	.vec_prepare = ipv4_rpf_vec_prepare,
 	.num_next = IPV4_RPF_NUM,
 	.next = {
 		[IPV4_RPF_ACCEPT]  = "term-noop",
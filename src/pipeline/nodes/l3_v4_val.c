@@ -54,7 +54,7 @@ ipv4_validate_process_common(struct pl_packet *pkt, enum pl_mode mode)
 
 	if (unlikely(!ip_validate_packet_and_count(pkt->mbuf, ip, ifp,
 						   &needs_slow_path)))
-		return IPV4_VAL_DROP;
+		return pl_drop(pkt, PL_DROP_IP_HDR, IPV4_VAL_DROP);
 
 	pkt->val_flags = needs_slow_path ?
 		NEEDS_SLOWPATH : NEEDS_EMPTY;
@@ -113,6 +113,14 @@ ipv4_validate_feat_iterate(struct pl_node *node, bool first,
 					feature_id, context);
 }
 
+ALWAYS_INLINE unsigned int
+ipv4_validate_feat_mask(struct pl_node *node)
+{
+	struct ifnet *ifp = ipv4_val_node_to_ifp(node);
+
+	return pl_node_feat_mask_u16(&ifp->ip_in_features);
+}
+
 static struct pl_node *
 ipv4_validate_node_lookup(const char *name)
 {
@@ -127,6 +135,7 @@ PL_REGISTER_NODE(ipv4_validate_node) = {
 	.handler = ipv4_validate_process,
 	.feat_change = ipv4_validate_feat_change,
 	.feat_iterate = ipv4_validate_feat_iterate,
+	.feat_mask = ipv4_validate_feat_mask,
 	.lookup_by_name = ipv4_validate_node_lookup,
 	.num_next = IPV4_VAL_NUM,
 	.next = {
@@ -49,6 +49,6 @@ PL_REGISTER_FEATURE(ipv6_in_no_address_feat) = {
 	.name = "vyatta:ipv6-in-no-address",
 	.node_name = "ipv6-in-no-address",
 	.feature_point = "ipv6-validate",
-	.visit_after = "ipv6-pbr",
+	.visit_after = "ipv6-flow-sample",
 	.id = PL_L3_V6_IN_FUSED_FEAT_NO_ADDRESS,
 };
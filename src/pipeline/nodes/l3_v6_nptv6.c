@@ -73,7 +73,8 @@ nptv6_process_common(struct pl_packet *pkt, int dir)
 	if (pktmbuf_mdata_exists(m, PKT_MDATA_DEFRAG)) {
 		npc = npf_get_cache(&npf_flags, m, htons(ETHER_TYPE_IPv6));
 		if (!npc)
-			return in ? NPTV6_IN_DROP : NPTV6_OUT_DROP;
+			return pl_drop(pkt, PL_DROP_NPTV6,
+				       in ? NPTV6_IN_DROP : NPTV6_OUT_DROP);
 	} else {
 		npc = &npc_local;
 		/* Initialize packet information cache.	 */
@@ -81,7 +82,8 @@ nptv6_process_common(struct pl_packet *pkt, int dir)
 
 		/* Cache everything. drop if junk. */
 		if (unlikely(!npf_cache_all(npc, m, htons(ETHER_TYPE_IPv6))))
-			return in ? NPTV6_IN_DROP : NPTV6_OUT_DROP;
+			return pl_drop(pkt, PL_DROP_NPTV6,
+				       in ? NPTV6_IN_DROP : NPTV6_OUT_DROP);
 	}
 
 	rl = npf_ruleset_inspect(npc, m, rlset, NULL, ifp, dir);
@@ -97,7 +99,8 @@ nptv6_process_common(struct pl_packet *pkt, int dir)
 	handle = npf_rule_rproc_handle_from_id(rl, NPF_RPROC_ID_NPTV6);
 	if (!handle)
 		/* Should never happen */
-		return in ? NPTV6_IN_DROP : NPTV6_OUT_DROP;
+		return pl_drop(pkt, PL_DROP_NPTV6,
+			       in ? NPTV6_IN_DROP : NPTV6_OUT_DROP);
 
 	/* Do the nptv6 translation */
 	decision = nptv6_translate(npc, &m, handle, &icmp_type, &icmp_code);
@@ -114,7 +117,8 @@ nptv6_process_common(struct pl_packet *pkt, int dir)
 
 			return in ? NPTV6_IN_CONSUME : NPTV6_OUT_CONSUME;
 		}
-		return in ? NPTV6_IN_DROP : NPTV6_OUT_DROP;
+		return pl_drop(pkt, PL_DROP_NPTV6,
+			       in ? NPTV6_IN_DROP : NPTV6_OUT_DROP);
 	}
 
 	return in ? NPTV6_IN_ACCEPT : NPTV6_OUT_ACCEPT;
@@ -170,6 +170,14 @@ ipv6_out_feat_iterate(struct pl_node *node, bool first,
 					feature_id, context);
 }
 
+ALWAYS_INLINE unsigned int
+ipv6_out_feat_mask(struct pl_node *node)
+{
+	struct ifnet *ifp = ipv6_out_node_to_ifp(node);
+
+	return pl_node_feat_mask_u16(&ifp->ip6_out_features);
+}
+
 static struct pl_node *
 ipv6_out_node_lookup(const char *name)
 {
@@ -184,6 +192,7 @@ PL_REGISTER_NODE(ipv6_out_node) = {
 	.handler = ipv6_out_process,
 	.feat_change = ipv6_out_feat_change,
 	.feat_iterate = ipv6_out_feat_iterate,
+	.feat_mask = ipv6_out_feat_mask,
 	.lookup_by_name = ipv6_out_node_lookup,
 	.num_next = IPV6_OUT_NUM,
 	.next = {
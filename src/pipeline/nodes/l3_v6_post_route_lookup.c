@@ -57,7 +57,8 @@ ipv6_post_route_lookup_process(struct pl_packet *pkt)
 	ip6->ip6_hlim -= IPV6_HLIMDEC;
 	/* Immediately drop blackholed traffic. */
 	if (unlikely(nxt->flags & RTF_BLACKHOLE))
-		return IPV6_POST_ROUTE_LOOKUP_DROP;
+		return pl_drop(pkt, PL_DROP_BLACKHOLE,
+			       IPV6_POST_ROUTE_LOOKUP_DROP);
 
 	if (unlikely(nxt->flags & RTF_REJECT)) {
 		icmp6_error(ifp, pkt->mbuf, ICMP6_DST_UNREACH,
@@ -70,9 +70,14 @@ _ipv6_route_lookup_process_common(struct pl_packet *pkt, enum pl_mode mode,
 	}
 
 	vrf = vrf_get_rcu_fast(pktmbuf_get_vrf(pkt->mbuf));
-	nxt = rt6_lookup_fast(vrf, &ip6->ip6_dst, pkt->tblid, pkt->mbuf);
-
-	pkt->nxt.v6 = nxt;
+	if (pkt->nxt_resolved) {
+		nxt = pkt->nxt.v6;
+		pkt->nxt_resolved = false;
+	} else {
+		nxt = rt6_lookup_fast(vrf, &ip6->ip6_dst, pkt->tblid,
+				      pkt->mbuf);
+		pkt->nxt.v6 = nxt;
+	}
 
 	/*
 	 * if nxt == NULL, postpone sending icmp6 err
@@ -104,7 +109,8 @@ _ipv6_route_lookup_process_common(struct pl_packet *pkt, enum pl_mode mode,
 	case IPV6_LKUP_MODE_ROUTER:
 		break;
 	case IPV6_LKUP_MODE_HOST:
-		return IPV6_ROUTE_LOOKUP_DROP;
+		return pl_drop(pkt, PL_DROP_NOT_FORWARDING,
+			       IPV6_ROUTE_LOOKUP_DROP);
 	}
 
 	/*
@@ -112,7 +118,7 @@ _ipv6_route_lookup_process_common(struct pl_packet *pkt, enum pl_mode mode,
 	 */
 	if (unlikely(IN6_IS_ADDR_UNSPECIFIED(&ip6->ip6_src))) {
 		IP6STAT_INC_IFP(ifp, IPSTATS_MIB_INADDRERRORS);
-		return IPV6_ROUTE_LOOKUP_DROP;
+		return pl_drop(pkt, PL_DROP_IP_ADDR, IPV6_ROUTE_LOOKUP_DROP);
 	}
 
 	switch (mode) {
@@ -160,6 +166,56 @@ ipv6_route_lookup_host_process(struct pl_packet *pkt)
 						 IPV6_LKUP_MODE_HOST);
 }
 
+/*
+ * Resolve the routes for the packets of the vector that share the VRF
+ * and table of the first one in a single bulk lookup. The rest, and
+ * those with hop-by-hop options, are left to the per-packet lookup.
+ */
+static void
+ipv6_route_lookup_vec_prepare(struct pl_packet **pkts, unsigned int n)
+{
+	struct pl_packet *lkup_pkts[PL_VEC_MAX];
+	struct rte_mbuf *lkup_mbufs[PL_VEC_MAX];
+	const struct in6_addr *dst[PL_VEC_MAX];
+	struct next_hop_v6 *nxt[PL_VEC_MAX];
+	vrfid_t vrfid = VRF_INVALID_ID;
+	uint32_t tblid = 0;
+	unsigned int lkup_n = 0;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		struct pl_packet *pkt = pkts[i];
+		struct ip6_hdr *ip6 = pkt->l3_hdr;
+
+		if (unlikely(ip6->ip6_nxt == IPPROTO_HOPOPTS))
+			continue;
+
+		if (!lkup_n) {
+			vrfid = pktmbuf_get_vrf(pkt->mbuf);
+			tblid = pkt->tblid;
+		} else if (unlikely(pktmbuf_get_vrf(pkt->mbuf) != vrfid ||
+				    pkt->tblid != tblid))
+			continue;
+
+		lkup_pkts[lkup_n] = pkt;
+		lkup_mbufs[lkup_n] = pkt->mbuf;
+		dst[lkup_n] = &ip6->ip6_dst;
+		lkup_n++;
+	}
+
+	/* nothing to be gained over the per-packet lookup */
+	if (lkup_n < 2)
+		return;
+
+	rt6_lookup_fast_bulk(vrf_get_rcu_fast(vrfid), dst, tblid, lkup_mbufs,
+			     nxt, lkup_n);
+
+	for (i = 0; i < lkup_n; i++) {
+		lkup_pkts[i]->nxt.v6 = nxt[i];
+		lkup_pkts[i]->nxt_resolved = true;
+	}
+}
+
 static int
 ipv6_route_lookup_feat_change(struct pl_node *node,
 			      struct pl_feature_registration *feat,
@@ -181,13 +237,23 @@ ipv6_route_lookup_feat_iterate(struct pl_node *node, bool first,
 					first, feature_id, context);
 }
 
+ALWAYS_INLINE unsigned int
+ipv6_route_lookup_feat_mask(struct pl_node *node)
+{
+	struct vrf *vrf = ipv6_route_lookup_node_to_vrf(node);
+
+	return pl_node_feat_mask_u16(&vrf->v_ipv6_post_rlkup_features);
+}
+
 /* Register Node */
 PL_REGISTER_NODE(ipv6_route_lookup_node) = {
 	.name = "vyatta:ipv6-route-lookup",
 	.type = PL_PROC,
 	.handler = ipv6_route_lookup_process,
+	.vec_prepare = ipv6_route_lookup_vec_prepare,
 	.feat_change = ipv6_route_lookup_feat_change,
 	.feat_iterate = ipv6_route_lookup_feat_iterate,
+	.feat_mask = ipv6_route_lookup_feat_mask,
 	.num_next = IPV6_ROUTE_LOOKUP_NUM,
 	.next = {
 		[IPV6_ROUTE_LOOKUP_ACCEPT] = "ipv6-post-route-lookup",
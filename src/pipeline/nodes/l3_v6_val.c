@@ -17,6 +17,7 @@
 #include "compat.h"
 #include "compiler.h"
 #include "if_var.h"
+#include "in6.h"
 #include "ip6_funcs.h"
 #include "npf/npf.h"
 #include "pktmbuf.h"
@@ -53,7 +54,10 @@ ipv6_validate_process_common(struct pl_packet *pkt, enum pl_mode mode)
 	IP6STAT_INC_VRF(vrf_get_rcu_fast(vrf_id), IPSTATS_MIB_INPKTS);
 
 	if (unlikely(!ip6_validate_packet_and_count(pkt->mbuf, ip6, ifp)))
-		return IPV6_VAL_DROP;
+		return pl_drop(pkt, PL_DROP_IP_HDR, IPV6_VAL_DROP);
+
+	if (unlikely(ip6_is_ext_hdr(ip6->ip6_nxt)))
+		ip6_ext_hdrs_walk(pkt->mbuf, ip6);
 
 	pktmbuf_set_vrf(pkt->mbuf, vrf_id);
 	pkt->l3_hdr = ip6;
@@ -112,6 +116,14 @@ ipv6_validate_feat_iterate(struct pl_node *node, bool first,
 					feature_id, context);
 }
 
+ALWAYS_INLINE unsigned int
+ipv6_validate_feat_mask(struct pl_node *node)
+{
+	struct ifnet *ifp = ipv6_val_node_to_ifp(node);
+
+	return pl_node_feat_mask_u16(&ifp->ip6_in_features);
+}
+
 static struct pl_node *
 ipv6_validate_node_lookup(const char *name)
 {
@@ -126,6 +138,7 @@ PL_REGISTER_NODE(ipv6_validate_node) = {
 	.handler = ipv6_validate_process,
 	.feat_change = ipv6_validate_feat_change,
 	.feat_iterate = ipv6_validate_feat_iterate,
+	.feat_mask = ipv6_validate_feat_mask,
 	.lookup_by_name = ipv6_validate_node_lookup,
 	.num_next = IPV6_VAL_NUM,
 	.next = {
@@ -9,6 +9,7 @@
 
 #include "pl_common.h"
 
+extern struct pl_node_registration *const ether_in_node_ptr;
 extern struct pl_node_registration *const ether_lookup_node_ptr;
 
 extern struct pl_node_registration *const ipv4_validate_node_ptr;
@@ -22,6 +23,8 @@ extern struct pl_node_registration *const ipv6_encap_node_ptr;
 extern struct pl_node_registration *const ipv6_route_lookup_node_ptr;
 
 PL_DECLARE_FEATURE(ipv4_rpf_feat);
+PL_DECLARE_FEATURE(ipv4_flow_sample_feat);
+PL_DECLARE_FEATURE(ipv6_flow_sample_feat);
 PL_DECLARE_FEATURE(ipv4_in_no_address_feat);
 PL_DECLARE_FEATURE(ipv6_in_no_address_feat);
 PL_DECLARE_FEATURE(ipv4_in_no_forwarding_feat);
@@ -103,6 +103,7 @@ _pppoe_cmd_handler(PPPOEConfig *pppoe_msg, struct pb_msg *msg)
 	conn->session = pppoe_msg->session;
 	conn->my_eth = my_eth;
 	conn->peer_eth = peer_eth;
+	pppoe_conn_init_hdr(conn);
 	snprintf(conn->underlying_name, IFNAMSIZ, "%s", under_name);
 	conn->ifp = ppp_inter;
 
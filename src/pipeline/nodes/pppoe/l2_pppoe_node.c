@@ -26,7 +26,7 @@ pppoe_in_process(struct pl_packet *pkt)
 
 		if (rte_pktmbuf_data_len(m) < sizeof(*pppoe_hdr)) {
 			if_incr_error(pkt->in_ifp);
-			return PPP_FORWARD_DROP;
+			return pl_drop(pkt, PL_DROP_L2_HDR, PPP_FORWARD_DROP);
 		}
 
 		inner_proto = ntohs(pppoe_hdr->protocol);
@@ -68,7 +68,8 @@ pppoe_in_process(struct pl_packet *pkt)
 		default:
 			/* Unsupported inner protocol */
 			if_incr_unknown(pkt->in_ifp);
-			return PPP_FORWARD_DROP;
+			return pl_drop(pkt, PL_DROP_UNKNOWN_PROTO,
+				       PPP_FORWARD_DROP);
 		}
 	}
 
@@ -5,6 +5,7 @@
  *
  */
 #include <limits.h>
+#include <stddef.h>
 #include <linux/if_ether.h>
 #include <inttypes.h>
 #include <rte_jhash.h>
@@ -191,6 +192,69 @@ pppoe_classify_map_match(struct cds_lfht_node *node, const void *_key)
 		key->underlying_ifindex == conn->underlying_ifindex;
 }
 
+static struct pppoe_map_node *
+pppoe_session_direct(struct pppoe_map_tbl *tbl, uint16_t session)
+{
+	struct pppoe_session_block *blk;
+
+	blk = rcu_dereference(tbl->blocks[session >> PPPOE_SESSION_BLOCK_BITS]);
+	if (!blk)
+		return NULL;
+	return rcu_dereference(
+		blk->node[session & (PPPOE_SESSION_BLOCK_SIZE - 1)]);
+}
+
+static void
+pppoe_session_map(struct pppoe_map_tbl *tbl, struct pppoe_map_node *pnode)
+{
+	unsigned int b = pnode->session >> PPPOE_SESSION_BLOCK_BITS;
+	unsigned int i = pnode->session & (PPPOE_SESSION_BLOCK_SIZE - 1);
+	struct pppoe_session_block *blk = tbl->blocks[b];
+
+	if (!blk) {
+		blk = zmalloc_aligned(sizeof(*blk));
+		if (!blk)
+			goto overflow;
+		rcu_assign_pointer(tbl->blocks[b], blk);
+	}
+	if (blk->node[i])
+		goto overflow;
+
+	blk->count++;
+	pnode->mapped = true;
+	rcu_assign_pointer(blk->node[i], pnode);
+	return;
+
+overflow:
+	CMM_STORE_SHARED(tbl->overflow, tbl->overflow + 1);
+}
+
+static void
+pppoe_session_block_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct pppoe_session_block, rcu));
+}
+
+static void
+pppoe_session_unmap(struct pppoe_map_tbl *tbl, struct pppoe_map_node *pnode)
+{
+	unsigned int b = pnode->session >> PPPOE_SESSION_BLOCK_BITS;
+	unsigned int i = pnode->session & (PPPOE_SESSION_BLOCK_SIZE - 1);
+	struct pppoe_session_block *blk = tbl->blocks[b];
+
+	if (!pnode->mapped) {
+		CMM_STORE_SHARED(tbl->overflow, tbl->overflow - 1);
+		return;
+	}
+
+	CMM_STORE_SHARED(blk->node[i], NULL);
+	pnode->mapped = false;
+	if (--blk->count == 0) {
+		rcu_assign_pointer(tbl->blocks[b], NULL);
+		call_rcu(&blk->rcu, pppoe_session_block_free);
+	}
+}
+
 struct ifnet *
 ppp_lookup_ses(struct ifnet *underlying_interface, uint16_t session)
 {
@@ -198,11 +262,19 @@ ppp_lookup_ses(struct ifnet *underlying_interface, uint16_t session)
 		.session = session,
 		.underlying_ifindex = underlying_interface->if_index,
 	};
+	struct pppoe_map_tbl *tbl = rcu_dereference(pppoe_map_tbl);
+	struct pppoe_map_node *pnode;
 
-	struct cds_lfht *p_map_htbl = pppoe_map_get_ht();
-	if (!p_map_htbl)
+	if (!tbl)
 		return NULL;
 
+	pnode = pppoe_session_direct(tbl, session);
+	if (likely(pnode && pnode->ifindex == key.underlying_ifindex))
+		return CMM_LOAD_SHARED(pnode->ppp);
+	if (likely(!CMM_LOAD_SHARED(tbl->overflow)))
+		return NULL;
+
+	struct cds_lfht *p_map_htbl = rcu_dereference(tbl->ht);
 	struct cds_lfht_iter iter;
 
 	rcu_read_lock();
@@ -211,8 +283,7 @@ ppp_lookup_ses(struct ifnet *underlying_interface, uint16_t session)
 	struct cds_lfht_node *node = cds_lfht_iter_get_node(&iter);
 
 	if (node) {
-		struct pppoe_map_node *pnode =
-			caa_container_of(node, struct pppoe_map_node, pnode);
+		pnode = caa_container_of(node, struct pppoe_map_node, pnode);
 		if (pnode->ppp) {
 			rcu_read_unlock();
 			return pnode->ppp;
@@ -253,6 +324,7 @@ ppp_remove_ses(uint32_t ifindex, uint16_t session)
 			caa_container_of(node, struct pppoe_map_node, pnode);
 
 		cds_lfht_del(p_map_htbl, node);
+		pppoe_session_unmap(pppoe_map_tbl, pnode);
 		call_rcu(&pnode->pppoe_rcu, pppoe_entry_free);
 	}
 
@@ -305,9 +377,11 @@ pppoe_init_session(struct ifnet *ppp_dev, uint16_t session)
 		if (pnode) {
 			cds_lfht_node_init(&pnode->pnode);
 			pnode->session = session;
+			pnode->ifindex = conn->underlying_ifindex;
 			pnode->ppp = ppp_dev;
 			cds_lfht_add(pppoe_tbl, pppoe_classify_map_hash(&key),
 					&pnode->pnode);
+			pppoe_session_map(pppoe_map_tbl, pnode);
 		}
 	}
 	rcu_read_unlock();
@@ -316,6 +390,20 @@ pppoe_init_session(struct ifnet *ppp_dev, uint16_t session)
 }
 
 
+/* Build the output header, once the session and addresses are set */
+void pppoe_conn_init_hdr(struct pppoe_connection *conn)
+{
+	struct pppoe_packet *hdr = &conn->out_hdr;
+
+	memset(hdr, 0, sizeof(*hdr));
+	ether_addr_copy(&conn->peer_eth, &hdr->eth_hdr.d_addr);
+	ether_addr_copy(&conn->my_eth, &hdr->eth_hdr.s_addr);
+	hdr->eth_hdr.ether_type = htons(ETH_P_PPP_SES);
+	hdr->vertype = PPPOE_VER_TYPE(1, 1);
+	hdr->code = 0x00;
+	hdr->session = htons(conn->session);
+}
+
 /* Global PPPoE encap function. Generally you want to set output = true
  * as this is the defacto way this encap function should work, however
  * there is a corner case where we have to re-encap a pipeline packet after
@@ -329,6 +417,19 @@ ppp_do_encap(struct rte_mbuf *m, struct pppoe_connection *conn,
 	if (!conn->valid)
 		return false;
 
+	uint16_t ppp_proto;
+
+	switch (proto) {
+	case ETH_P_IP:
+		ppp_proto = htons(PPP_IP);
+		break;
+	case ETH_P_IPV6:
+		ppp_proto = htons(PPP_IPV6);
+		break;
+	default:
+		return false;
+	}
+
 	/* Add some extra space to the front of the packet, enough for the pppoe
 	 * header plus existing ether.
 	 */
@@ -338,35 +439,24 @@ ppp_do_encap(struct rte_mbuf *m, struct pppoe_connection *conn,
 			sizeof(struct ether_hdr));
 	if (unlikely(!pheader))
 		return false;
-	pheader->session = htons(conn->session);
-	if (output) {
-		memcpy(&pheader->eth_hdr.d_addr, &conn->peer_eth,
-				sizeof(struct ether_addr));
-		memcpy(&pheader->eth_hdr.s_addr, &conn->my_eth,
-				sizeof(struct ether_addr));
+	if (likely(output)) {
+		/* Everything up to the length is fixed for the session */
+		memcpy(pheader, &conn->out_hdr,
+		       offsetof(struct pppoe_packet, length));
 	} else {
+		pheader->session = htons(conn->session);
 		memcpy(&pheader->eth_hdr.d_addr, &conn->my_eth,
 				sizeof(struct ether_addr));
 		memcpy(&pheader->eth_hdr.s_addr, &conn->peer_eth,
 				sizeof(struct ether_addr));
+		pheader->eth_hdr.ether_type = htons(ETH_P_PPP_SES);
+		pheader->vertype = PPPOE_VER_TYPE(1, 1);
+		pheader->code = 0x00;
 	}
-	pheader->eth_hdr.ether_type = htons(ETH_P_PPP_SES);
-	pheader->vertype = PPPOE_VER_TYPE(1, 1);
-	pheader->code = 0x00;
 	/* +2 for PPPoE Proto field */
 	pheader->length = htons(rte_pktmbuf_pkt_len(m) -
 			sizeof(struct pppoe_packet) + 2);
-
-	switch (proto) {
-	case ETH_P_IP:
-		pheader->protocol = htons(PPP_IP);
-		break;
-	case ETH_P_IPV6:
-		pheader->protocol = htons(PPP_IPV6);
-		break;
-	default:
-		return false;
-	}
+	pheader->protocol = ppp_proto;
 	return true;
 }
 
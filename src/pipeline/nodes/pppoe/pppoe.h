@@ -55,31 +55,52 @@ struct pppoe_connection {
 	char underlying_name[IFNAMSIZ];
 	struct cds_list_head list_node;
 	struct ifnet *ifp; /* pointer back to containing ifp */
+	struct pppoe_packet out_hdr;	/* Prebuilt output header */
 };
 
 /* cds_lfht_hash helpers follow */
 #define PPPOE_HASH_MIN_BUCKETS 4
-#define PPPOE_HASH_MAX_BUCKETS 16
+#define PPPOE_HASH_MAX_BUCKETS 65536
 
 struct pppoe_session_key {
 	uint16_t session;
 	uint32_t underlying_ifindex;
 };
 
+/*
+ * Sessions are also found directly by session ID. A session whose ID
+ * is already mapped for another underlying interface is only in the
+ * hash table, and counted in overflow.
+ */
+#define PPPOE_SESSION_BLOCK_BITS 8
+#define PPPOE_SESSION_BLOCK_SIZE (1 << PPPOE_SESSION_BLOCK_BITS)
+#define PPPOE_SESSION_BLOCKS (1 << (16 - PPPOE_SESSION_BLOCK_BITS))
+
+struct pppoe_session_block {
+	struct pppoe_map_node *node[PPPOE_SESSION_BLOCK_SIZE];
+	unsigned int count;
+	struct rcu_head rcu;
+};
+
 struct pppoe_map_tbl {
 	struct rcu_head rcu_head;
 	struct cds_lfht *ht;
+	uint32_t overflow;
+	struct pppoe_session_block *blocks[PPPOE_SESSION_BLOCKS];
 };
 
 struct pppoe_map_tbl *pppoe_map_tbl;
 
 struct pppoe_map_node {
 	uint16_t session;
+	bool mapped;		/* In the direct session map */
+	uint32_t ifindex;	/* Underlying interface */
 	struct rcu_head pppoe_rcu;
 	struct ifnet *ppp;
 	struct cds_lfht_node pnode;
 };
 
+void pppoe_conn_init_hdr(struct pppoe_connection *conn);
 bool ppp_do_encap(struct rte_mbuf *m,
 		struct pppoe_connection *conn, uint16_t proto, bool output);
 void ppp_tunnel_output(struct ifnet *ifp, struct rte_mbuf *m,
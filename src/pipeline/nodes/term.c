@@ -21,6 +21,7 @@
 #include "ip_funcs.h"
 #include "npf/npf.h"
 #include "pl_common.h"
+#include "pl_drop.h"
 #include "pl_fused.h"
 #include "route.h"
 #include "route_flags.h"
@@ -65,6 +66,7 @@ PL_REGISTER_NODE(term_v6_to_v4_node) = {
 ALWAYS_INLINE unsigned int
 term_drop_process(struct pl_packet *pkt)
 {
+	pl_drop_count(pkt);
 	rte_pktmbuf_free(pkt->mbuf);
 	pkt->mbuf = NULL;
 	return 0;
@@ -83,6 +85,7 @@ ipv6_drop_process(struct pl_packet *pkt)
 {
 	if (pkt->in_ifp)
 		IP6STAT_INC_IFP(pkt->in_ifp, IPSTATS_MIB_INDISCARDS);
+	pl_drop_count(pkt);
 	rte_pktmbuf_free(pkt->mbuf);
 	pkt->mbuf = NULL;
 	return 0;
@@ -13,6 +13,7 @@
 #include <string.h>
 
 #include "commands.h"
+#include "ether.h"
 #include "pl_commands.h"
 #include "pl_common.h"
 #include "pl_internal.h"
@@ -21,6 +22,7 @@
 
 #include "protobuf.h"
 #include "protobuf/PipelineStatsConfig.pb-c.h"
+#include "protobuf/PipelineModeConfig.pb-c.h"
 
 struct pl_cmd_entry {
 	zhash_t *next;
@@ -137,6 +139,8 @@ cmd_pipeline_show_nodes(struct pl_command *cmd)
 	jsonw_name(json, "pl-framework");
 	jsonw_start_object(json);
 
+	jsonw_bool_field(json, "vector-mode",
+			 packet_burst_input_func != NULL);
 	pl_dump_nodes(json);
 
 	jsonw_end_object(json);
@@ -191,3 +195,38 @@ PB_REGISTER_CMD(pipeline_stats_cmd) = {
 	.cmd = "vyatta:pipeline-stats",
 	.handler = cmd_pipeline_stats_cfg,
 };
+
+/* pipeline execution mode config commands
+ */
+static int cmd_pipeline_mode_cfg(struct pb_msg *msg)
+{
+	void *payload = (void *)((char *)msg->msg);
+	int len = msg->msg_len;
+
+	PipelineModeConfig *smsg =
+		pipeline_mode_config__unpack(NULL, len, payload);
+	if (!smsg) {
+		RTE_LOG(ERR, DATAPLANE,
+			"failed to read pipeline mode protobuf command\n");
+		return -1;
+	}
+
+	switch (smsg->mode) {
+	case PIPELINE_MODE_CONFIG__MODE__VECTOR:
+		set_packet_burst_input_func(ether_input_burst);
+		break;
+	case PIPELINE_MODE_CONFIG__MODE__SCALAR:
+	default:
+		set_packet_burst_input_func(NULL);
+		break;
+	}
+
+	pipeline_mode_config__free_unpacked(smsg, NULL);
+
+	return 0;
+}
+
+PB_REGISTER_CMD(pipeline_mode_cmd) = {
+	.cmd = "vyatta:pipeline-mode",
+	.handler = cmd_pipeline_mode_cfg,
+};
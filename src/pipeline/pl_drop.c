@@ -0,0 +1,142 @@
+/*
+ * pl_drop.c
+ *
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#include <rte_common.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "if_var.h"
+#include "json_writer.h"
+#include "pl_common.h"
+#include "pl_drop.h"
+#include "util.h"
+
+struct pl_drop_stats pl_drop_stats[RTE_MAX_LCORE];
+
+static const char *const pl_drop_names[PL_DROP_MAX] = {
+	[PL_DROP_UNSPEC]		= "unspecified",
+	[PL_DROP_L2_HDR]		= "l2-header",
+	[PL_DROP_UNKNOWN_PROTO]		= "unknown-protocol",
+	[PL_DROP_VLAN_MODIFY]		= "vlan-modify",
+	[PL_DROP_PORTMONITOR]		= "portmonitor",
+	[PL_DROP_XCONNECT]		= "cross-connect",
+	[PL_DROP_ARP]			= "arp",
+	[PL_DROP_IP_HDR]		= "ip-header",
+	[PL_DROP_IP_ADDR]		= "ip-address",
+	[PL_DROP_NOT_FORWARDING]	= "not-forwarding",
+	[PL_DROP_TTL]			= "ttl-exceeded",
+	[PL_DROP_RPF]			= "rpf",
+	[PL_DROP_NO_ROUTE]		= "no-route",
+	[PL_DROP_BLACKHOLE]		= "blackhole",
+	[PL_DROP_NH_DOWN]		= "nexthop-down",
+	[PL_DROP_FW_IN]			= "firewall-in",
+	[PL_DROP_FW_OUT]		= "firewall-out",
+	[PL_DROP_ACL_IN]		= "acl-in",
+	[PL_DROP_ACL_OUT]		= "acl-out",
+	[PL_DROP_PBR]			= "pbr",
+	[PL_DROP_CGNAT]			= "cgnat",
+	[PL_DROP_NPTV6]			= "nptv6",
+	[PL_DROP_L4]			= "l4",
+	[PL_DROP_TOO_BIG]		= "too-big",
+};
+
+/* Sum over the lcores, returning false if there were no drops */
+static bool pl_drop_sum(const struct pl_drop_stats *pcpu,
+			struct pl_drop_stats *sum)
+{
+	unsigned int lcore, r;
+	bool any = false;
+
+	memset(sum, 0, sizeof(*sum));
+	FOREACH_DP_LCORE(lcore)
+		for (r = 0; r < PL_DROP_MAX; r++) {
+			sum->drops[r] += pcpu[lcore].drops[r];
+			any |= sum->drops[r] != 0;
+		}
+	return any;
+}
+
+static void pl_drop_dump(json_writer_t *json, const struct pl_drop_stats *sum)
+{
+	unsigned int r;
+
+	jsonw_name(json, "reasons");
+	jsonw_start_object(json);
+	for (r = 0; r < PL_DROP_MAX; r++)
+		if (sum->drops[r])
+			jsonw_uint_field(json, pl_drop_names[r], sum->drops[r]);
+	jsonw_end_object(json);
+}
+
+static void pl_drop_dump_if(struct ifnet *ifp, void *arg)
+{
+	json_writer_t *json = arg;
+	struct pl_drop_stats sum;
+
+	if (!ifp->if_drop_stats || !pl_drop_sum(ifp->if_drop_stats, &sum))
+		return;
+
+	jsonw_start_object(json);
+	jsonw_string_field(json, "name", ifp->if_name);
+	pl_drop_dump(json, &sum);
+	jsonw_end_object(json);
+}
+
+/*
+ * pipeline drops show [<ifname>]
+ *
+ * Only the interfaces and reasons with drops are shown.
+ */
+static int cmd_pl_drops_show(struct pl_command *cmd)
+{
+	struct pl_drop_stats sum;
+	struct ifnet *ifp = NULL;
+	json_writer_t *json;
+
+	if (cmd->argc > 1) {
+		pl_cmd_err(cmd, "usage: drops show [<ifname>]");
+		return -1;
+	}
+	if (cmd->argc == 1) {
+		ifp = ifnet_byifname(cmd->argv[0]);
+		if (!ifp) {
+			pl_cmd_err(cmd, "unknown interface %s",
+				   cmd->argv[0]);
+			return -1;
+		}
+	}
+
+	json = jsonw_new(cmd->fp);
+	if (!json)
+		return -1;
+
+	jsonw_name(json, "drops");
+	jsonw_start_object(json);
+
+	if (!ifp) {
+		pl_drop_sum(pl_drop_stats, &sum);
+		pl_drop_dump(json, &sum);
+	}
+
+	jsonw_name(json, "interfaces");
+	jsonw_start_array(json);
+	if (ifp)
+		pl_drop_dump_if(ifp, json);
+	else
+		ifnet_walk(pl_drop_dump_if, json);
+	jsonw_end_array(json);
+
+	jsonw_end_object(json);
+	jsonw_destroy(&json);
+	return 0;
+}
+
+PL_REGISTER_OPCMD(pl_drops_show) = {
+	.cmd = "drops show",
+	.handler = cmd_pl_drops_show,
+};
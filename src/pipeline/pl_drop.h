@@ -0,0 +1,45 @@
+/*
+ * pl_drop.h
+ *
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#ifndef PL_DROP_H
+#define PL_DROP_H
+
+#include <rte_common.h>
+#include <rte_config.h>
+#include <stdint.h>
+
+#include "compiler.h"
+#include "if_var.h"
+#include "pl_common.h"
+#include "util.h"
+
+/*
+ * Drop counters by enum pl_drop_reason, kept per lcore both in total
+ * and for the input interface, and shown by "pipeline drops show".
+ */
+struct pl_drop_stats {
+	uint64_t drops[PL_DROP_MAX];
+} __rte_cache_aligned;
+
+extern struct pl_drop_stats pl_drop_stats[RTE_MAX_LCORE];
+
+/* For the drop nodes, with the packet about to be freed */
+static ALWAYS_INLINE void
+pl_drop_count(const struct pl_packet *pkt)
+{
+	unsigned int lcore = dp_lcore_id();
+	unsigned int reason = pkt->drop_reason;
+
+	if (unlikely(reason >= PL_DROP_MAX))
+		reason = PL_DROP_UNSPEC;
+
+	pl_drop_stats[lcore].drops[reason]++;
+	if (pkt->in_ifp)
+		pkt->in_ifp->if_drop_stats[lcore].drops[reason]++;
+}
+
+#endif /* PL_DROP_H */
@@ -38,6 +38,7 @@ enum pl_l3_v4_in_fused_feat {
 	PL_L3_V4_IN_FUSED_FEAT_CGNAT,
 	PL_L3_V4_IN_FUSED_FEAT_DPI,
 	PL_L3_V4_IN_FUSED_FEAT_PBR,
+	PL_L3_V4_IN_FUSED_FEAT_FLOW_SAMPLE,
 	/*
 	 * no-address feature should be near the end to give other
 	 * features a chance to see the packet first.
@@ -54,6 +55,7 @@ enum pl_l3_v6_in_fused_feat {
 	PL_L3_V6_IN_FUSED_FEAT_NPTV6,
 	PL_L3_V6_IN_FUSED_FEAT_DPI,
 	PL_L3_V6_IN_FUSED_FEAT_PBR,
+	PL_L3_V6_IN_FUSED_FEAT_FLOW_SAMPLE,
 	/*
 	 * no-address feature should be near the end to give other
 	 * features a chance to see the packet first.
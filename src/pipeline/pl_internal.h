@@ -12,6 +12,7 @@
 #define PL_INTERNAL_H
 
 #include "compiler.h"
+#include "pl_trace.h"
 #include "util.h"
 
 extern int g_stats_enabled __hot_data;
@@ -31,9 +32,87 @@ pl_inc_node_stat(int node_id)
 		     pl_node_stats_id(node_id, dp_lcore_id())));
 }
 
+/*
+ * Times a node was run for a vector of packets, so that with the
+ * packet count the mean vector size reaching each node can be seen.
+ */
+extern uint64_t *g_pl_node_calls;
+
+static ALWAYS_INLINE void
+pl_inc_node_calls(int node_id)
+{
+	if (unlikely(g_stats_enabled))
+		++(*(g_pl_node_calls +
+		     pl_node_stats_id(node_id, dp_lcore_id())));
+}
+
+#ifdef HAVE_PL_NODE_CYCLES
+#include <rte_cycles.h>
+
+/* buckets of the cycles per packet histogram, each a power of 2 */
+#define PL_NODE_CYCLES_BUCKETS 16
+
+struct pl_node_cycles {
+	uint64_t cycles;
+	uint64_t pkts;
+	uint64_t hist[PL_NODE_CYCLES_BUCKETS];
+};
+
+extern struct pl_node_cycles *g_pl_node_cycles;
+
+static ALWAYS_INLINE uint64_t
+pl_node_cycles_start(void)
+{
+	if (unlikely(g_stats_enabled))
+		return rte_rdtsc();
+	return 0;
+}
+
+/*
+ * Account the cycles spent in a node for one packet. For feature
+ * point nodes this is inclusive of the features invoked.
+ */
+static ALWAYS_INLINE void
+pl_node_cycles_end(int node_id, uint64_t start)
+{
+	struct pl_node_cycles *nc;
+	uint64_t cycles;
+	unsigned int bucket;
+
+	if (likely(!g_stats_enabled))
+		return;
+
+	cycles = rte_rdtsc() - start;
+	bucket = 63 - __builtin_clzll(cycles | 1);
+	if (bucket >= PL_NODE_CYCLES_BUCKETS)
+		bucket = PL_NODE_CYCLES_BUCKETS - 1;
+
+	nc = g_pl_node_cycles + pl_node_stats_id(node_id, dp_lcore_id());
+	nc->cycles += cycles;
+	nc->pkts++;
+	nc->hist[bucket]++;
+}
+#else
+static ALWAYS_INLINE uint64_t
+pl_node_cycles_start(void)
+{
+	return 0;
+}
+
+static ALWAYS_INLINE void
+pl_node_cycles_end(int node_id __unused, uint64_t start __unused)
+{
+}
+#endif /* HAVE_PL_NODE_CYCLES */
+
+struct json_writer;
+
 void pl_load_plugins(void);
 void pl_graph_validate(void);
 
 uint64_t pl_get_node_stats(int id);
+uint64_t pl_get_node_calls(int id);
+const char *pl_node_name_by_id(int id);
+void pl_dump_node_cycles(struct json_writer *json, int id);
 
 #endif /* PL_INTERNAL_H */
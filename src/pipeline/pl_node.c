@@ -11,13 +11,16 @@
 #include <errno.h>
 #include <limits.h>
 #include <rte_branch_prediction.h>
+#include <rte_common.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <urcu/uatomic.h>
 
 #include "compiler.h"
 #include "ether.h"
+#include "json_writer.h"
 #include "pl_common.h"
 #include "pl_internal.h"
 #include "pl_node.h"
@@ -36,6 +39,11 @@ static uint32_t dyn_feat_inst_count;
 int g_stats_enabled __hot_data;
 /* packet counter per node */
 uint64_t *g_pl_node_stats __hot_data;
+uint64_t *g_pl_node_calls __hot_data;
+#ifdef HAVE_PL_NODE_CYCLES
+/* cycle accounting per node */
+struct pl_node_cycles *g_pl_node_cycles __hot_data;
+#endif
 
 ALWAYS_INLINE void
 pl_release_storage(struct pl_packet *p)
@@ -53,6 +61,9 @@ pl_release_storage(struct pl_packet *p)
 void
 pl_register_storage(struct pl_node_storage *storage)
 {
+	RTE_BUILD_BUG_ON(offsetof(struct pl_packet, data[1]) >
+			 RTE_CACHE_LINE_SIZE);
+
 	if (g_pl_storage_ct < PL_NODE_STORE_MAX && !storage->disable) {
 		storage->id = g_pl_storage_ct++;
 		g_pl_storage_func[storage->id] = storage->release;
@@ -230,11 +241,15 @@ bool
 pl_graph_walk(struct pl_node_registration *node_reg,
 	      struct pl_packet *pkt)
 {
+	uint64_t start;
 	int resp;
 
 	while (true) {
+		start = pl_node_cycles_start();
 		pl_inc_node_stat(node_reg->node_decl_id);
+		pl_trace_node(pkt, node_reg->node_decl_id);
 		resp = node_reg->handler(pkt);
+		pl_node_cycles_end(node_reg->node_decl_id, start);
 
 		switch (node_reg->type) {
 		case PL_OUTPUT:
@@ -252,6 +267,114 @@ pl_graph_walk(struct pl_node_registration *node_reg,
 	return true;
 }
 
+/*
+ * Features are invoked from their feature point's handler one packet
+ * at a time, so give those which want to see the whole vector the
+ * chance to do so before the feature point is run.  As this is ahead
+ * of all of the features, the preparation must not rely on the
+ * packets having been seen by any earlier feature.
+ */
+static ALWAYS_INLINE void
+pl_node_feat_vec_prepare(struct pl_node_registration *node_reg,
+			 struct pl_packet **pkts, unsigned int n)
+{
+	struct pl_feature_registration *feat;
+	unsigned int i;
+
+	for (i = 0; i < node_reg->max_feature_reg_idx; i++) {
+		feat = node_reg->feature_regs[i];
+		if (feat && feat->node->vec_prepare)
+			feat->node->vec_prepare(pkts, n);
+	}
+}
+
+/*
+ * Walk the graph with a vector of packets
+ *
+ * Each node is run for every packet in the vector before moving on,
+ * so that the node's code and data stay warm in the cache. The
+ * packets are then split by disposition and each next node is
+ * walked with its own sub-vector, preserving the relative order of
+ * the packets within it.
+ *
+ * The fused handler is used where one has been generated for the
+ * node, so that features are invoked in fused-mode.
+ *
+ * Packets reaching an output node are consumed and have their
+ * storage released.
+ */
+void
+pl_graph_walk_vec(struct pl_node_registration *node_reg,
+		  struct pl_packet **pkts, unsigned int n)
+{
+	struct pl_packet *sub_vec[PL_VEC_MAX];
+	uint8_t resp[PL_VEC_MAX];
+	uint64_t disp_mask;
+	unsigned int disp;
+	unsigned int sub_n;
+	unsigned int i;
+
+	assert(n <= PL_VEC_MAX);
+
+	while (n) {
+		pl_inc_node_calls(node_reg->node_decl_id);
+		if (node_reg->vec_prepare)
+			node_reg->vec_prepare(pkts, n);
+		pl_node_feat_vec_prepare(node_reg, pkts, n);
+
+		if (node_reg->fused_handler) {
+			for (i = 0; i < n; i++)
+				resp[i] = node_reg->fused_handler(pkts[i]);
+		} else {
+			for (i = 0; i < n; i++) {
+				uint64_t start = pl_node_cycles_start();
+
+				pl_inc_node_stat(node_reg->node_decl_id);
+				pl_trace_node(pkts[i], node_reg->node_decl_id);
+				resp[i] = node_reg->handler(pkts[i]);
+				pl_node_cycles_end(node_reg->node_decl_id,
+						   start);
+			}
+		}
+
+		switch (node_reg->type) {
+		case PL_OUTPUT:
+			for (i = 0; i < n; i++)
+				pl_release_storage(pkts[i]);
+			return;
+		case PL_CONTINUE:
+			return;
+		case PL_PROC:
+			break;
+		}
+
+		disp_mask = 0;
+		for (i = 0; i < n; i++) {
+			assert(resp[i] < node_reg->num_next);
+			disp_mask |= 1ull << resp[i];
+		}
+
+		/* common case - the whole vector goes to the same node */
+		if (likely(!(disp_mask & (disp_mask - 1)))) {
+			node_reg = node_reg->next_nodes[resp[0]];
+			continue;
+		}
+
+		while (disp_mask) {
+			disp = __builtin_ctzll(disp_mask);
+			disp_mask &= disp_mask - 1;
+
+			for (i = 0, sub_n = 0; i < n; i++)
+				if (resp[i] == disp)
+					sub_vec[sub_n++] = pkts[i];
+
+			pl_graph_walk_vec(node_reg->next_nodes[disp],
+					  sub_vec, sub_n);
+		}
+		return;
+	}
+}
+
 int
 pl_node_feat_change_u16(uint16_t *bitmask,
 			struct pl_feature_registration *feat,
@@ -294,6 +417,12 @@ pl_node_feat_iterate_u16(const uint16_t *bitmask, bool first,
 	return true;
 }
 
+ALWAYS_INLINE unsigned int
+pl_node_feat_mask_u16(const uint16_t *bitmask)
+{
+	return CMM_ACCESS_ONCE(*bitmask);
+}
+
 int
 pl_node_feat_change_u8(uint8_t *bitmask,
 			struct pl_feature_registration *feat,
@@ -346,3 +475,71 @@ pl_get_node_stats(int id)
 		ct +=  *(g_pl_node_stats + pl_node_stats_id(id, i));
 	return ct;
 }
+
+uint64_t
+pl_get_node_calls(int id)
+{
+	unsigned int i;
+	uint64_t ct = 0;
+
+	for (i = 0; i <= get_lcore_max(); ++i)
+		ct += *(g_pl_node_calls + pl_node_stats_id(id, i));
+	return ct;
+}
+
+#ifdef HAVE_PL_NODE_CYCLES
+static void
+pl_dump_cycles_entry(json_writer_t *json, const struct pl_node_cycles *nc)
+{
+	unsigned int i;
+
+	jsonw_uint_field(json, "cycles", nc->cycles);
+	jsonw_uint_field(json, "packets", nc->pkts);
+	jsonw_uint_field(json, "cycles-per-pkt",
+			 nc->pkts ? nc->cycles / nc->pkts : 0);
+	/* bucket i counts packets taking [2^i, 2^(i+1)) cycles */
+	jsonw_name(json, "histogram");
+	jsonw_start_array(json);
+	for (i = 0; i < PL_NODE_CYCLES_BUCKETS; i++)
+		jsonw_uint(json, nc->hist[i]);
+	jsonw_end_array(json);
+}
+
+void
+pl_dump_node_cycles(json_writer_t *json, int id)
+{
+	struct pl_node_cycles total = { 0 };
+	const struct pl_node_cycles *nc;
+	unsigned int i, b;
+
+	jsonw_name(json, "cycles");
+	jsonw_start_object(json);
+
+	jsonw_name(json, "lcores");
+	jsonw_start_array(json);
+	for (i = 0; i <= get_lcore_max(); ++i) {
+		nc = g_pl_node_cycles + pl_node_stats_id(id, i);
+		if (!nc->pkts)
+			continue;
+
+		jsonw_start_object(json);
+		jsonw_uint_field(json, "lcore", i);
+		pl_dump_cycles_entry(json, nc);
+		jsonw_end_object(json);
+
+		total.cycles += nc->cycles;
+		total.pkts += nc->pkts;
+		for (b = 0; b < PL_NODE_CYCLES_BUCKETS; b++)
+			total.hist[b] += nc->hist[b];
+	}
+	jsonw_end_array(json);
+
+	pl_dump_cycles_entry(json, &total);
+	jsonw_end_object(json);
+}
+#else
+void
+pl_dump_node_cycles(json_writer_t *json __unused, int id __unused)
+{
+}
+#endif /* HAVE_PL_NODE_CYCLES */
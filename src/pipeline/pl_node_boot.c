@@ -277,6 +277,11 @@ pl_graph_validate(void)
 					node->name);
 			break;
 		case PL_PROC:
+			/* vector mode tracks dispositions in a 64-bit mask */
+			if (node->num_next > 64)
+				rte_panic(
+					"pipeline node %s has too many next nodes\n",
+					node->name);
 			break;
 		default:
 			rte_panic("invalid type %d for pipeline node %s\n",
@@ -375,6 +380,20 @@ pl_graph_validate(void)
 					  next_dyn_node_id);
 	if (!g_pl_node_stats)
 		rte_panic("out of memory allocating pipeline stats\n");
+
+	g_pl_node_calls = zmalloc_aligned(sizeof(uint64_t) *
+					  RTE_MAX_LCORE *
+					  next_dyn_node_id);
+	if (!g_pl_node_calls)
+		rte_panic("out of memory allocating pipeline stats\n");
+
+#ifdef HAVE_PL_NODE_CYCLES
+	g_pl_node_cycles = zmalloc_aligned(sizeof(*g_pl_node_cycles) *
+					   RTE_MAX_LCORE *
+					   next_dyn_node_id);
+	if (!g_pl_node_cycles)
+		rte_panic("out of memory allocating pipeline cycle stats\n");
+#endif
 }
 
 void
@@ -388,6 +407,17 @@ pl_add_node_command(struct pl_node_command *cmd)
 	pl_recurse_cmds(g_pl_opcmds, cmd, toks);
 }
 
+const char *
+pl_node_name_by_id(int id)
+{
+	struct pl_node_registration *node;
+
+	TAILQ_FOREACH(node, &pl_node_reg_list, links)
+		if (node->node_decl_id == id)
+			return node->name;
+	return NULL;
+}
+
 void
 pl_add_feature_registration(struct pl_feature_registration *feat)
 {
@@ -405,6 +435,7 @@ pl_dump_nodes(json_writer_t *json)
 {
 	struct pl_feature_registration *feat;
 	struct pl_node_registration *node;
+	uint64_t calls;
 
 	jsonw_name(json, "node");
 	jsonw_start_object(json);
@@ -413,6 +444,12 @@ pl_dump_nodes(json_writer_t *json)
 		jsonw_start_object(json);
 		jsonw_uint_field(json, "pkt-count",
 				 pl_get_node_stats(node->node_decl_id));
+		calls = pl_get_node_calls(node->node_decl_id);
+		jsonw_uint_field(json, "vector-calls", calls);
+		jsonw_uint_field(json, "pkts-per-call",
+				 calls ? pl_get_node_stats(node->node_decl_id) /
+				 calls : 0);
+		pl_dump_node_cycles(json, node->node_decl_id);
 		jsonw_string_field(json, "disable",
 				   node->disable ? "true" : "false");
 		jsonw_name(json, "next");
@@ -0,0 +1,381 @@
+/*
+ * pl_trace.c
+ *
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Per-packet pipeline trace - see pl_trace.h.
+ *
+ * Each lcore only writes its own ring, so recording is a store and a
+ * timestamp.  The rings are read by the master thread for dumping
+ * without stopping the writers, so a dump taken while packets are
+ * still being traced may show a partly written record.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pcap/pcap.h>
+#include <rte_branch_prediction.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_mbuf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <urcu/uatomic.h>
+
+#include "compiler.h"
+#include "if_var.h"
+#include "json_writer.h"
+#include "pktmbuf.h"
+#include "pl_common.h"
+#include "pl_internal.h"
+#include "pl_trace.h"
+#include "urcu.h"
+#include "util.h"
+
+/* Records kept per lcore, a power of 2 */
+#define PL_TRACE_RECS		1024
+
+/* Most packets a single arm can ask for */
+#define PL_TRACE_MAX_PKTS	PL_TRACE_RECS
+
+/* Longest filter accepted, as for the kernel's socket filters */
+#define PL_TRACE_MAX_INSNS	4096
+
+struct pl_trace_rec {
+	uint64_t	tsc;
+	uint32_t	id;	/* of the packet, in the order marked */
+	uint16_t	node;	/* node_decl_id */
+	uint16_t	pad;
+};
+
+struct pl_trace_ring {
+	uint32_t		head;
+	struct pl_trace_rec	recs[PL_TRACE_RECS];
+} __rte_cache_aligned;
+
+struct pl_trace_filter {
+	struct rcu_head		rcu;
+	unsigned int		ifindex;	/* 0 for any interface */
+	unsigned int		count;		/* as armed */
+	unsigned int		len;		/* 0 to match everything */
+	struct bpf_insn		insns[];
+};
+
+uint32_t g_pl_trace_left __hot_data;
+bool g_pl_trace_enabled __hot_data;
+
+static struct pl_trace_filter *pl_trace_filter;
+static struct pl_trace_ring *pl_trace_rings[RTE_MAX_LCORE];
+static uint32_t pl_trace_next_id;
+
+static bool pl_trace_match(const struct pl_trace_filter *tf,
+			   const struct ifnet *ifp, struct rte_mbuf *m)
+{
+	if (tf->ifindex && tf->ifindex != ifp->if_index)
+		return false;
+
+	/* Only the first segment is looked at */
+	return !tf->len ||
+		bpf_filter(tf->insns, rte_pktmbuf_mtod(m, u_char *),
+			   rte_pktmbuf_pkt_len(m), rte_pktmbuf_data_len(m));
+}
+
+/* Take one of the packets still wanted, if any are left */
+static bool pl_trace_take(void)
+{
+	uint32_t left = CMM_LOAD_SHARED(g_pl_trace_left);
+	uint32_t old;
+
+	do {
+		if (!left)
+			return false;
+		old = left;
+		left = uatomic_cmpxchg(&g_pl_trace_left, old, old - 1);
+	} while (left != old);
+
+	return true;
+}
+
+void pl_trace_input_slow(struct ifnet *ifp, struct rte_mbuf *m)
+{
+	const struct pl_trace_filter *tf;
+
+	/* Already marked on an earlier pass, e.g. before a decap */
+	if (pktmbuf_mdata_invar_exists(m, PKT_MDATA_INVAR_TRACE))
+		return;
+
+	tf = rcu_dereference(pl_trace_filter);
+	if (!tf || !pl_trace_match(tf, ifp, m) || !pl_trace_take())
+		return;
+
+	pktmbuf_mdata(m)->md_trace_id = uatomic_add_return(&pl_trace_next_id,
+							   1);
+	pktmbuf_mdata_invar_set(m, PKT_MDATA_INVAR_TRACE);
+}
+
+void pl_trace_node_slow(struct rte_mbuf *m, int node_id)
+{
+	struct pl_trace_ring *ring = pl_trace_rings[dp_lcore_id()];
+	struct pl_trace_rec *rec;
+
+	if (unlikely(!ring))
+		return;
+
+	rec = &ring->recs[ring->head & (PL_TRACE_RECS - 1)];
+	rec->tsc = rte_rdtsc();
+	rec->id = pktmbuf_mdata(m)->md_trace_id;
+	rec->node = node_id;
+	CMM_STORE_SHARED(ring->head, ring->head + 1);
+}
+
+static void pl_trace_filter_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct pl_trace_filter, rcu));
+}
+
+static void pl_trace_filter_set(struct pl_trace_filter *tf)
+{
+	struct pl_trace_filter *old;
+
+	old = rcu_xchg_pointer(&pl_trace_filter, tf);
+	if (old)
+		call_rcu(&old->rcu, pl_trace_filter_free);
+}
+
+/*
+ * Rings are allocated on first use and then kept, as the forwarding
+ * threads look them up without any synchronisation.
+ */
+static int pl_trace_rings_alloc(void)
+{
+	struct pl_trace_ring *ring;
+	unsigned int i;
+
+	FOREACH_DP_LCORE(i) {
+		if (pl_trace_rings[i])
+			continue;
+		ring = zmalloc_aligned(sizeof(*ring));
+		if (!ring)
+			return -ENOMEM;
+		pl_trace_rings[i] = ring;
+	}
+	return 0;
+}
+
+static void pl_trace_rings_reset(void)
+{
+	unsigned int i;
+
+	FOREACH_DP_LCORE(i)
+		if (pl_trace_rings[i])
+			CMM_STORE_SHARED(pl_trace_rings[i]->head, 0);
+}
+
+/*
+ * Parse a filter in the "tcpdump -ddd" format, with the lines joined
+ * by commas: the instruction count followed by "code jt jf k" for
+ * each instruction.
+ */
+static struct pl_trace_filter *pl_trace_filter_parse(const char *str)
+{
+	struct pl_trace_filter *tf;
+	struct bpf_insn *insn;
+	unsigned long len, i;
+	char *end;
+
+	len = strtoul(str, &end, 10);
+	if (end == str || *end != ',' || !len || len > PL_TRACE_MAX_INSNS)
+		return NULL;
+
+	tf = calloc(1, sizeof(*tf) + len * sizeof(tf->insns[0]));
+	if (!tf)
+		return NULL;
+
+	for (i = 0; i < len; i++) {
+		unsigned int code, jt, jf, k;
+		int n;
+
+		str = end + 1;
+		if (sscanf(str, "%u %u %u %u%n", &code, &jt, &jf, &k, &n) != 4 ||
+		    code > UINT16_MAX || jt > UINT8_MAX || jf > UINT8_MAX)
+			goto bad;
+
+		end = (char *)str + n;
+		if (*end != (i == len - 1 ? '\0' : ','))
+			goto bad;
+
+		insn = &tf->insns[i];
+		insn->code = code;
+		insn->jt = jt;
+		insn->jf = jf;
+		insn->k = k;
+	}
+
+	if (!bpf_validate(tf->insns, len))
+		goto bad;
+
+	tf->len = len;
+	return tf;
+
+bad:
+	free(tf);
+	return NULL;
+}
+
+/*
+ * pipeline trace arm <ifname>|any <count> [<filter>]
+ */
+static int cmd_pl_trace_arm(struct pl_command *cmd)
+{
+	struct pl_trace_filter *tf;
+	struct ifnet *ifp = NULL;
+	unsigned long count;
+	char *end;
+
+	if (cmd->argc < 2 || cmd->argc > 3) {
+		pl_cmd_err(cmd,
+			   "usage: trace arm <ifname>|any <count> [<filter>]");
+		return -1;
+	}
+
+	if (strcmp(cmd->argv[0], "any") != 0) {
+		ifp = ifnet_byifname(cmd->argv[0]);
+		if (!ifp) {
+			pl_cmd_err(cmd, "unknown interface %s",
+				   cmd->argv[0]);
+			return -1;
+		}
+	}
+
+	count = strtoul(cmd->argv[1], &end, 10);
+	if (*end || !count || count > PL_TRACE_MAX_PKTS) {
+		pl_cmd_err(cmd, "count must be 1 to %u",
+			   PL_TRACE_MAX_PKTS);
+		return -1;
+	}
+
+	if (cmd->argc == 3) {
+		tf = pl_trace_filter_parse(cmd->argv[2]);
+		if (!tf) {
+			pl_cmd_err(cmd, "bad filter");
+			return -1;
+		}
+	} else {
+		tf = calloc(1, sizeof(*tf));
+		if (!tf) {
+			pl_cmd_err(cmd, "out of memory");
+			return -1;
+		}
+	}
+	tf->ifindex = ifp ? ifp->if_index : 0;
+	tf->count = count;
+
+	if (pl_trace_rings_alloc() < 0) {
+		free(tf);
+		pl_cmd_err(cmd, "out of memory");
+		return -1;
+	}
+
+	/* Start with empty rings, so that only this arm's packets show */
+	CMM_STORE_SHARED(g_pl_trace_left, 0);
+	pl_trace_rings_reset();
+	pl_trace_filter_set(tf);
+	CMM_STORE_SHARED(g_pl_trace_enabled, true);
+	CMM_STORE_SHARED(g_pl_trace_left, count);
+	return 0;
+}
+
+PL_REGISTER_OPCMD(pl_trace_arm) = {
+	.cmd = "trace arm",
+	.handler = cmd_pl_trace_arm,
+};
+
+static int cmd_pl_trace_clear(struct pl_command *cmd __unused)
+{
+	CMM_STORE_SHARED(g_pl_trace_left, 0);
+	CMM_STORE_SHARED(g_pl_trace_enabled, false);
+	pl_trace_filter_set(NULL);
+	pl_trace_rings_reset();
+	return 0;
+}
+
+PL_REGISTER_OPCMD(pl_trace_clear) = {
+	.cmd = "trace clear",
+	.handler = cmd_pl_trace_clear,
+};
+
+static void pl_trace_dump_ring(json_writer_t *json, unsigned int lcore,
+			       const struct pl_trace_ring *ring)
+{
+	uint32_t head = CMM_LOAD_SHARED(ring->head);
+	uint32_t i = head > PL_TRACE_RECS ? head - PL_TRACE_RECS : 0;
+	const struct pl_trace_rec *rec;
+	const char *name;
+
+	cmm_smp_rmb();
+	for (; i != head; i++) {
+		rec = &ring->recs[i & (PL_TRACE_RECS - 1)];
+		name = pl_node_name_by_id(rec->node);
+
+		jsonw_start_object(json);
+		jsonw_uint_field(json, "lcore", lcore);
+		jsonw_uint_field(json, "packet", rec->id);
+		jsonw_string_field(json, "node", name ? name : "unknown");
+		jsonw_uint_field(json, "tsc", rec->tsc);
+		jsonw_end_object(json);
+	}
+}
+
+/*
+ * Records are in the order visited on each lcore, with a TSC
+ * timestamp comparable across lcores.
+ */
+static int cmd_pl_trace_show(struct pl_command *cmd)
+{
+	const struct pl_trace_filter *tf;
+	struct ifnet *ifp;
+	json_writer_t *json;
+	unsigned int i;
+
+	json = jsonw_new(cmd->fp);
+	if (!json)
+		return -1;
+
+	jsonw_name(json, "trace");
+	jsonw_start_object(json);
+
+	jsonw_bool_field(json, "enabled", CMM_LOAD_SHARED(g_pl_trace_enabled));
+	jsonw_uint_field(json, "tsc-hz", rte_get_tsc_hz());
+	tf = rcu_dereference(pl_trace_filter);
+	if (tf) {
+		ifp = tf->ifindex ? ifnet_byifindex(tf->ifindex) : NULL;
+		jsonw_string_field(json, "interface",
+				   ifp ? ifp->if_name : "any");
+		jsonw_bool_field(json, "filter", tf->len != 0);
+		jsonw_uint_field(json, "armed", tf->count);
+		jsonw_uint_field(json, "left",
+				 CMM_LOAD_SHARED(g_pl_trace_left));
+	}
+
+	jsonw_name(json, "records");
+	jsonw_start_array(json);
+	FOREACH_DP_LCORE(i)
+		if (pl_trace_rings[i])
+			pl_trace_dump_ring(json, i, pl_trace_rings[i]);
+	jsonw_end_array(json);
+
+	jsonw_end_object(json);
+	jsonw_destroy(&json);
+	return 0;
+}
+
+PL_REGISTER_OPCMD(pl_trace_show) = {
+	.cmd = "trace show",
+	.handler = cmd_pl_trace_show,
+};
@@ -0,0 +1,63 @@
+/*
+ * pl_trace.h
+ *
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#ifndef PL_TRACE_H
+#define PL_TRACE_H
+
+#include <rte_branch_prediction.h>
+#include <rte_mbuf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <urcu/system.h>
+
+#include "compiler.h"
+#include "pktmbuf.h"
+#include "pl_common.h"
+
+struct ifnet;
+
+/*
+ * Per-packet pipeline trace
+ *
+ * A trace is armed for the next N packets arriving on an interface,
+ * or on any interface, that match an optional BPF filter.  Those
+ * packets are marked on input and every node they then visit is
+ * recorded in a small ring per lcore, to be dumped with "pipeline
+ * trace show".
+ *
+ * Untraced packets cost a test of a global per node, and another on
+ * input while packets are still wanted.
+ */
+
+/* Packets still to be marked on input */
+extern uint32_t g_pl_trace_left __hot_data;
+/* Nodes visited by marked packets are being recorded */
+extern bool g_pl_trace_enabled __hot_data;
+
+void pl_trace_input_slow(struct ifnet *ifp, struct rte_mbuf *m);
+void pl_trace_node_slow(struct rte_mbuf *m, int node_id);
+
+static ALWAYS_INLINE void
+pl_trace_input(struct ifnet *ifp, struct rte_mbuf *m)
+{
+	if (unlikely(CMM_LOAD_SHARED(g_pl_trace_left)))
+		pl_trace_input_slow(ifp, m);
+}
+
+/*
+ * Called before the node's handler, as an output node may have freed
+ * the mbuf by the time it returns.
+ */
+static ALWAYS_INLINE void
+pl_trace_node(struct pl_packet *pkt, int node_id)
+{
+	if (unlikely(g_pl_trace_enabled) &&
+	    pktmbuf_mdata_invar_exists(pkt->mbuf, PKT_MDATA_INVAR_TRACE))
+		pl_trace_node_slow(pkt->mbuf, node_id);
+}
+
+#endif /* PL_TRACE_H */
@@ -10,8 +10,10 @@
 
 #include <errno.h>
 #include <rte_ether.h>
+#include <rte_branch_prediction.h>
 #include <rte_mbuf.h>
 #include <rte_memcpy.h>
+#include <rte_mempool.h>
 #include <string.h>
 
 #include "if_var.h"
@@ -21,12 +23,43 @@
 
 struct rte_mempool;
 
-void pktmbuf_free_bulk(struct rte_mbuf *pkts[], unsigned int n)
+/* Segments put back to their pool at once by pktmbuf_free_bulk */
+#define PKTMBUF_FREE_BULK_SZ 64
+
+static inline void
+pktmbuf_free_bulk_put(struct rte_mbuf **segs, unsigned int *count)
 {
-	unsigned int i;
+	if (*count) {
+		rte_mempool_put_bulk(segs[0]->pool, (void **)segs, *count);
+		*count = 0;
+	}
+}
 
-	for (i = 0; i < n; i++)
-		rte_pktmbuf_free(pkts[i]);
+/*
+ * Packets from a burst mostly come from the same pool, so gather the
+ * segments that are free to go back for each run of a pool, rather
+ * than putting them back one at a time.
+ */
+void pktmbuf_free_bulk(struct rte_mbuf *pkts[], unsigned int n)
+{
+	struct rte_mbuf *segs[PKTMBUF_FREE_BULK_SZ];
+	struct rte_mbuf *m, *next;
+	unsigned int i, count = 0;
+
+	for (i = 0; i < n; i++) {
+		for (m = pkts[i]; m; m = next) {
+			next = m->next;
+			m = rte_pktmbuf_prefree_seg(m);
+			if (unlikely(!m))
+				continue;
+
+			if (count == PKTMBUF_FREE_BULK_SZ ||
+			    (count && m->pool != segs[0]->pool))
+				pktmbuf_free_bulk_put(segs, &count);
+			segs[count++] = m;
+		}
+	}
+	pktmbuf_free_bulk_put(segs, &count);
 }
 
 struct rte_mbuf *pktmbuf_allocseg(struct rte_mempool *mpool, vrfid_t vrf_id,
@@ -224,6 +257,33 @@ struct rte_mbuf *pktmbuf_copy(const struct rte_mbuf *ms, struct rte_mempool *mp)
 }
 
 
+int pktmbuf_clone_bulk(struct rte_mbuf *md, struct rte_mempool *mp,
+		       struct rte_mbuf **mc, unsigned int n)
+{
+	unsigned int i;
+
+	if (unlikely(md->nb_segs > 1)) {
+		for (i = 0; i < n; i++) {
+			mc[i] = pktmbuf_clone(md, mp);
+			if (unlikely(mc[i] == NULL)) {
+				pktmbuf_free_bulk(mc, i);
+				return -ENOMEM;
+			}
+		}
+		return 0;
+	}
+
+	if (unlikely(rte_pktmbuf_alloc_bulk(mp, mc, n) != 0))
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		rte_pktmbuf_attach(mc[i], md);
+		pktmbuf_mdata_clear_all(mc[i]);
+		pktmbuf_set_vrf(mc[i], pktmbuf_get_vrf(md));
+	}
+	return 0;
+}
+
 int pktmbuf_prepare_for_header_change(struct rte_mbuf **m, uint16_t header_len)
 {
 	struct rte_mbuf *mdir;
@@ -67,6 +67,32 @@ struct pkt_mdata_ifindex {
 	uint32_t ifindex;
 } __attribute__ ((__packed__));
 
+#define PKT_MDATA_L4_PORTS	0x01	/* ml_sport and ml_dport are set */
+#define PKT_MDATA_L4_ECHO	0x02	/* ml_id is an ICMP echo query id */
+#define PKT_MDATA_L4_FRAG	0x04	/* IPv6 fragment header present */
+#define PKT_MDATA_L4_ROUTING	0x08	/* IPv6 routing header present */
+
+/*
+ * The L3 and L4 headers as parsed by the firewall cache, or for IPv6
+ * with extension headers by ipv6-validate, so that the session and
+ * ECMP layers need not parse them again.  Offsets are from the start
+ * of the packet data.
+ */
+struct pkt_mdata_l4 {
+	union {
+		uint32_t ml_ports;	/* As the first word of the header */
+		struct {
+			uint16_t ml_sport;
+			uint16_t ml_dport;
+		};
+	};
+	uint16_t ml_id;
+	uint16_t ml_l3_offs;
+	uint16_t ml_l4_offs;
+	uint8_t  ml_proto;	/* After any IPv6 extension headers */
+	uint8_t  ml_flags;
+};
+
 /*
  * Packet metadata that is invariant for the lifetime of the packet,
  * i.e. even if encapped or decapped, or reswitched through another
@@ -83,6 +109,7 @@ enum pkt_mdata_invar_type {
 	 */
 	PKT_MDATA_INVAR_BRIDGE		= (1 << 3),
 	PKT_MDATA_INVAR_NAT64		= (1 << 4),
+	PKT_MDATA_INVAR_TRACE		= (1 << 5), /* Pipeline trace */
 };
 
 /*
@@ -105,10 +132,18 @@ enum pkt_mdata_type {
 	PKT_MDATA_CGNAT_OUT		= (1 << 11),
 	PKT_MDATA_CGNAT_IN		= (1 << 12),
 	PKT_MDATA_CGNAT_SESSION		= (1 << 13),
+	PKT_MDATA_L4			= (1 << 14),
+	PKT_MDATA_QOS_CLASSIFIED	= (1 << 15), /* QoS sched set */
 };
 
 struct npf_session;
 
+/*
+ * Each field is only valid while its flag is set in m->udata64, so
+ * the flags word is the only thing cleared per packet.  It is in
+ * mbuf cacheline1, which is written for every packet anyway (VRF,
+ * tx_offload), so the clear never touches the private area.
+ */
 struct pktmbuf_mdata {
 	/* PKT_MDATA_INVAR_FLOW */
 	struct flow_data *md_flowp;
@@ -142,6 +177,12 @@ struct pktmbuf_mdata {
 
 	/* PKT_MDATA_L2_RCV_TYPE */
 	enum l2_packet_type md_l2_rcv_type;
+
+	/* PKT_MDATA_L4 */
+	struct pkt_mdata_l4 md_l4;
+
+	/* PKT_MDATA_INVAR_TRACE */
+	uint32_t md_trace_id;
 } __rte_aligned(RTE_CACHE_LINE_SIZE * 2);
 
 static inline struct pktmbuf_mdata *
@@ -200,6 +241,25 @@ pktmbuf_mdata_clear(struct rte_mbuf *m, enum pkt_mdata_type pkt_meta_flags)
 	m->udata64 &= ~((uint64_t)(pkt_meta_flags & UINT16_MAX));
 }
 
+/*
+ * Get the parsed L4 headers of a packet, if the firewall has cached
+ * them for the L3 header at l3_offs.
+ */
+static inline const struct pkt_mdata_l4 *
+pktmbuf_mdata_l4(const struct rte_mbuf *m, unsigned int l3_offs)
+{
+	const struct pkt_mdata_l4 *ml;
+
+	if (!pktmbuf_mdata_exists(m, PKT_MDATA_L4))
+		return NULL;
+
+	ml = &pktmbuf_mdata((struct rte_mbuf *)m)->md_l4;
+	if (ml->ml_l3_offs != l3_offs)
+		return NULL;
+	return ml;
+}
+
+/* Invalidates all metadata fields, without writing them */
 static inline void
 pktmbuf_mdata_clear_all(struct rte_mbuf *m)
 {
@@ -411,6 +471,27 @@ static inline struct rte_mbuf *pktmbuf_clone(struct rte_mbuf *md,
 	return m;
 }
 
+/**
+ * Creates several "clones" of the given packet mbuf.
+ *
+ * Equivalent to calling pktmbuf_clone() n times, but for a single
+ * segment packet the clones are allocated from the pool in one go.
+ *
+ * @param md
+ *   The packet mbuf to be cloned.
+ * @param mp
+ *   The mempool from which the "clone" mbufs are allocated.
+ * @param mc
+ *   Array filled in with the "clone" mbufs.
+ * @param n
+ *   The number of "clones" to create.
+ * @return
+ *   - 0 on success.
+ *   - -ENOMEM if allocation fails, in which case no clones are created.
+ */
+int pktmbuf_clone_bulk(struct rte_mbuf *md, struct rte_mempool *mp,
+		       struct rte_mbuf **mc, unsigned int n);
+
 /**
  * Prepare for changing a possibly shared mbuf.
  *
@@ -42,6 +42,8 @@
 
 #define ERSPAN_HARDWARE_ID	0x33	/* unique ID */
 
+#define ERSPAN_TRUNCATED		0x0400	/* frame was truncated */
+
 #define ERSPAN_VERSION(ver_vlan)	((ver_vlan) >> 12)
 #define ERSPAN_VLAN(ver_vlan)		((ver_vlan) & 0xFFF)
 #define ERSPAN_ID(cos_en_t_id)		((cos_en_t_id) & 0x03FF)
@@ -119,6 +121,8 @@ struct portmonitor_session {
 	uint16_t		erspan_id;		/* erspan id */
 	uint8_t			erspan_hdr_type;	/* erspan hdr type */
 	uint16_t		gre_proto;		/* GRE protocol */
+	uint16_t		snap_len;		/* bytes mirrored, 0=all */
+	uint32_t		sample_rate;		/* mirror 1 in N, 0=all */
 	struct ifnet		*dest_ifp;		/* destination ifp */
 	char			dest_ifname[IFNAMSIZ];	/* destination ifname */
 	zlist_t			*filter_list;		/* in and out filters */
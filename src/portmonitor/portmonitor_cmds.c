@@ -12,6 +12,7 @@
 #include <errno.h>
 #include <linux/if.h>
 #include <rte_config.h>
+#include <rte_ether.h>
 #include <rte_log.h>
 #include <rte_malloc.h>
 #include <stdbool.h>
@@ -883,6 +884,10 @@ static void show_one_session(struct portmonitor_session *s, json_writer_t *wr)
 		jsonw_string_field(wr, "state", "enabled");
 	if (s->erspan_id)
 		jsonw_int_field(wr, "erspanid", s->erspan_id);
+	if (s->sample_rate)
+		jsonw_uint_field(wr, "sample_rate", s->sample_rate);
+	if (s->snap_len)
+		jsonw_uint_field(wr, "snaplen", s->snap_len);
 	if (s->erspan_hdr_type == ERSPAN_TYPE_II)
 		jsonw_int_field(wr, "erspanhdr", ERSPAN_TYPE_II);
 	else if (s->erspan_hdr_type == ERSPAN_TYPE_III)
@@ -984,6 +989,8 @@ int cmd_portmonitor(FILE *f, int argc, char **argv)
 	uint32_t direction;
 	uint32_t erspan_id;
 	uint32_t erspan_hdr_type;
+	uint32_t sample_rate;
+	uint32_t snap_len;
 	struct portmonitor_session *pmsess;
 	int rc;
 
@@ -1061,6 +1068,10 @@ int cmd_portmonitor(FILE *f, int argc, char **argv)
 					"PM : Set session state failed(%d)\n",
 					rc);
 
+			} else if (strcmp(argv[4], "sample") == 0) {
+				CMM_STORE_SHARED(pmsess->sample_rate, 0);
+			} else if (strcmp(argv[4], "snaplen") == 0) {
+				CMM_STORE_SHARED(pmsess->snap_len, 0);
 			} else if (strcmp(argv[4], "filter-in") == 0) {
 				if (portmonitor_session_config_filter(
 					pmsess, argv[5], PORTMONITOR_IN_FILTER,
@@ -1230,6 +1241,22 @@ int cmd_portmonitor(FILE *f, int argc, char **argv)
 			}
 			portmonitor_session_set_erspan_hdr_type(pmsess,
 								erspan_hdr_type);
+		} else if (strcmp(argv[4], "sample") == 0) {
+			if (!get_value(argv[5], &sample_rate)) {
+				fprintf(f, "Invalid sample rate %s\n",
+						argv[5]);
+				return -1;
+			}
+			CMM_STORE_SHARED(pmsess->sample_rate, sample_rate);
+		} else if (strcmp(argv[4], "snaplen") == 0) {
+			if (!get_value(argv[5], &snap_len) ||
+			    (snap_len && snap_len < ETHER_HDR_LEN) ||
+			    snap_len > UINT16_MAX) {
+				fprintf(f, "Invalid snap length %s\n",
+						argv[5]);
+				return -1;
+			}
+			CMM_STORE_SHARED(pmsess->snap_len, snap_len);
 		} else if (strcmp(argv[4], "disable") == 0) {
 			pmsess->disabled = true;
 			struct fal_attribute_t attr[] = {
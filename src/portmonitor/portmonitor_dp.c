@@ -13,6 +13,8 @@
 #include <rte_branch_prediction.h>
 #include <rte_ether.h>
 #include <rte_mbuf.h>
+#include <rte_memcpy.h>
+#include <rte_per_lcore.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
@@ -34,6 +36,88 @@
 #include "portmonitor/portmonitor_hw.h"
 #include "urcu.h"
 
+/*
+ * Bytes of a mirrored packet that are copied, the rest is shared with
+ * the original through an indirect mbuf. This covers the headers the
+ * forwarding path rewrites in place.
+ */
+#define PORTMONITOR_COPY_LEN	128
+
+/* Packets left to skip before the next sample, per session */
+static RTE_DEFINE_PER_LCORE(uint32_t, pm_sample_skip[UINT8_MAX + 1]);
+
+static inline bool portmonitor_sample(const struct portmonitor_session *pmsess)
+{
+	uint32_t *skip = &RTE_PER_LCORE(pm_sample_skip)[pmsess->session_id];
+	uint32_t rate = CMM_ACCESS_ONCE(pmsess->sample_rate);
+
+	if (likely(rate <= 1))
+		return true;
+
+	/* The rate may have been lowered since the last sample */
+	if (unlikely(*skip >= rate))
+		*skip = rate - 1;
+
+	if (*skip) {
+		(*skip)--;
+		return false;
+	}
+	*skip = rate - 1;
+	return true;
+}
+
+/*
+ * Build the packet to mirror, at most snap_len bytes of it if set.
+ *
+ * Only the start of the packet is copied; the rest refers to the
+ * original's data, which the forwarding path must then not change
+ * without first un-sharing it (see pktmbuf_prepare_for_header_change).
+ * Chained packets are copied in full.
+ */
+static struct rte_mbuf *portmonitor_mirror_pkt(struct rte_mbuf *m,
+					       uint16_t snap_len)
+{
+	uint32_t len = rte_pktmbuf_pkt_len(m);
+	struct rte_mbuf *mirror, *tail;
+	uint16_t hlen;
+	char *hdr;
+
+	if (unlikely(!rte_pktmbuf_is_contiguous(m)))
+		return pktmbuf_copy(m, m->pool);
+
+	if (snap_len && snap_len < len)
+		len = snap_len;
+	hlen = RTE_MIN(len, (uint32_t)PORTMONITOR_COPY_LEN);
+
+	mirror = pktmbuf_alloc(m->pool, pktmbuf_get_vrf(m));
+	if (!mirror)
+		return NULL;
+
+	hdr = rte_pktmbuf_append(mirror, hlen);
+	if (!hdr)
+		goto fail;
+	rte_memcpy(hdr, rte_pktmbuf_mtod(m, char *), hlen);
+	pktmbuf_copy_meta(mirror, m);
+
+	if (len == hlen)
+		return mirror;
+
+	tail = pktmbuf_clone(m, m->pool);
+	if (!tail)
+		goto fail;
+	rte_pktmbuf_adj(tail, hlen);
+	rte_pktmbuf_trim(tail, rte_pktmbuf_pkt_len(m) - len);
+	if (rte_pktmbuf_chain(mirror, tail) < 0) {
+		rte_pktmbuf_free(tail);
+		goto fail;
+	}
+	return mirror;
+
+fail:
+	rte_pktmbuf_free(mirror);
+	return NULL;
+}
+
 /* Forward packet to SPAN port.
  * Returns 1 if packet was consumed.
  *         0 if span not enabled on port.
@@ -126,8 +210,10 @@ drop:
 
 static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 					struct portmonitor_session *pmsess,
-					struct rte_mbuf *m, uint8_t direction)
+					struct rte_mbuf *m, uint8_t direction,
+					bool truncated)
 {
+	uint16_t t = truncated ? ERSPAN_TRUNCATED : 0;
 	struct erspan_v2_hdr *v2_hdr;
 	struct erspan_v3_hdr *v3_hdr;
 	struct timespec ts;
@@ -161,7 +247,7 @@ static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 			en = ERSPAN_ORIG_FRAME_NO_VLAN;
 		}
 		v2_hdr->cos_en_t_id = htons((pktmbuf_get_vlan_pcp(m) << 13) |
-					    (en << 11) | pmsess->erspan_id);
+					    (en << 11) | t | pmsess->erspan_id);
 		v2_hdr->index = htonl((ifp->if_port << 4) | direction);
 	} else if (pmsess->erspan_hdr_type == ERSPAN_TYPE_III) {
 		if (clock_gettime(CLOCK_REALTIME, &ts))
@@ -188,16 +274,16 @@ static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 			v3_hdr->cos_bso_t_id =
 				htons((pktmbuf_get_vlan_pcp(m) << 13) |
 				      (ERSPAN_ORIG_FRAME_SHORT << 11) |
-				      pmsess->erspan_id);
+				      t | pmsess->erspan_id);
 		} else if (frame_size > ETHER_MAX_LEN) {
 			v3_hdr->cos_bso_t_id =
 				htons((pktmbuf_get_vlan_pcp(m) << 13) |
 				      (ERSPAN_ORIG_FRAME_OVERSIZED << 11) |
-				      pmsess->erspan_id);
+				      t | pmsess->erspan_id);
 		} else {
 			v3_hdr->cos_bso_t_id =
 				htons((pktmbuf_get_vlan_pcp(m) << 13) |
-				      pmsess->erspan_id);
+				      t | pmsess->erspan_id);
 		}
 		v3_hdr->p_ft_hwid_d_gra_o = htons((1 << 15) |
 						(ERSPAN_HARDWARE_ID << 4) |
@@ -222,6 +308,7 @@ static void portmonitor_source_output(struct ifnet *ifp,
 	struct rte_mbuf *mirror_pkt;
 	struct ifnet *dest_ifp;
 	struct portmonitor_session *pmsess;
+	bool truncated;
 
 	if (!pminfo || pminfo->hw_mirroring)
 		return;
@@ -255,9 +342,14 @@ static void portmonitor_source_output(struct ifnet *ifp,
 			return;
 	}
 
-	mirror_pkt = pktmbuf_copy(*m, (*m)->pool);
+	if (!portmonitor_sample(pmsess))
+		return;
+
+	mirror_pkt = portmonitor_mirror_pkt(*m,
+					    CMM_ACCESS_ONCE(pmsess->snap_len));
 	if (!mirror_pkt)
 		return;
+	truncated = rte_pktmbuf_pkt_len(mirror_pkt) < rte_pktmbuf_pkt_len(*m);
 
 	if (((*m)->ol_flags & PKT_RX_VLAN) && ifp->qinq_inner) {
 		if (unlikely(vid_encap(ifp->if_vlan, &mirror_pkt,
@@ -281,7 +373,7 @@ static void portmonitor_source_output(struct ifnet *ifp,
 		if (unlikely(dest_ifp->capturing))
 			capture_burst(dest_ifp, &mirror_pkt, 1);
 		if (!portmonitor_encap_erspan_hdr(ifp, pmsess, mirror_pkt,
-							direction)) {
+						  direction, truncated)) {
 			rte_pktmbuf_free(mirror_pkt);
 			return;
 		}
@@ -19,10 +19,11 @@
 
 /* pre-defined power profiles */
 static struct power_profile pm_profiles[] __hot_data = {
-	/* name          thresh min     max */
-	{ "balanced",	 100,	10,	250  },	/* default */
-	{ "low-latency", 1000,	20,	20   },
-	{ "power-save",	 10,	10,	1000 },
+	/* name          thresh min     max   burst      low-lat rx-intr */
+	{ "balanced",	 100,	10,	250,  8,  32, false, false },	/* default */
+	{ "low-latency", 1000,	20,	20,   1,  8,  true,  false },
+	{ "power-save",	 10,	10,	1000, 16, 64, false, false },
+	{ "interrupt",	 10,	10,	1000, 16, 64, false, true  },
 };
 
 static struct power_profile *cur_pm __hot_data = pm_profiles;
@@ -37,6 +38,10 @@ static void show_power_mode(FILE *f)
 	jsonw_uint_field(wr, "idle_thresh", cur_pm->idle_thresh);
 	jsonw_uint_field(wr, "min_sleep", cur_pm->min_sleep);
 	jsonw_uint_field(wr, "max_sleep", cur_pm->max_sleep);
+	jsonw_uint_field(wr, "min_burst", cur_pm->min_burst);
+	jsonw_uint_field(wr, "max_burst", cur_pm->max_burst);
+	jsonw_bool_field(wr, "low_latency", cur_pm->low_latency);
+	jsonw_bool_field(wr, "rx_interrupt", cur_pm->rx_intr);
 	jsonw_end_object(wr);
 	jsonw_destroy(&wr);
 }
@@ -81,7 +86,7 @@ int cmd_power_cfg(FILE *f, int argc, char **argv)
 	}
 
 	if (strcmp(argv[0], "custom") == 0) {
-		if (argc != 4) {
+		if (argc != 4 && argc != 7) {
 			fprintf(f, "custom wrong number of args\n");
 			return -1;
 		}
@@ -96,6 +101,22 @@ int cmd_power_cfg(FILE *f, int argc, char **argv)
 		pm->idle_thresh = strtoul(argv[1], NULL, 0);
 		pm->min_sleep = strtoul(argv[2], NULL, 0);
 		pm->max_sleep = strtoul(argv[3], NULL, 0);
+		if (argc == 7) {
+			pm->min_burst = strtoul(argv[4], NULL, 0);
+			pm->max_burst = strtoul(argv[5], NULL, 0);
+			pm->low_latency = strtoul(argv[6], NULL, 0) != 0;
+		} else {
+			pm->min_burst = pm_profiles[0].min_burst;
+			pm->max_burst = pm_profiles[0].max_burst;
+		}
+
+		if (pm->min_burst == 0 || pm->min_burst > pm->max_burst ||
+		    pm->max_burst > PM_RX_BURST_MAX) {
+			fprintf(f, "custom invalid burst range %u-%u\n",
+				pm->min_burst, pm->max_burst);
+			free(pm);
+			return -1;
+		}
 
 		change_power_mode(pm);
 		return 0;
@@ -9,6 +9,7 @@
 #define POWER_H
 
 
+#include <rte_common.h>
 #include <rte_memory.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -20,11 +21,18 @@ struct power_profile {
 	unsigned int idle_thresh;   /* number of misses before sleeping */
 	unsigned int min_sleep;	  /* min us of sleep */
 	unsigned int max_sleep;	  /* max us of sleep */
+	uint16_t min_burst;	  /* min rx burst size */
+	uint16_t max_burst;	  /* max rx burst size */
+	bool low_latency;	  /* flush tx after every rx burst */
+	bool rx_intr;		  /* nap waiting on rx interrupts */
 } __rte_cache_aligned;
 
 /* Power management and poll loop parameters */
 #define USLEEP_MAX		10000u	/* 10ms i.e. all links down */
 
+/* Largest rx burst size a profile can use */
+#define PM_RX_BURST_MAX		64u
+
 /* Time to sleep for when all links down */
 #define LCORE_IDLE_SLEEP_SECS		1
 
@@ -50,6 +58,27 @@ static inline void pm_update(struct pm_governor *g, unsigned int n)
 	}
 }
 
+/*
+ * Compute the rx burst size to use for the next poll of a queue
+ * based on the result of the last one.
+ *
+ * if the burst was filled, then grow it (double)
+ * if less than half the burst was used, then shrink it (halve)
+ */
+static inline uint16_t pm_rx_burst(const struct power_profile *pm,
+				   uint16_t burst, unsigned int n)
+{
+	if (n == burst) {
+		if (burst < pm->max_burst)
+			burst = RTE_MIN(burst * 2, pm->max_burst);
+	} else if (n < burst / 2u) {
+		if (burst > pm->min_burst)
+			burst = RTE_MAX(burst / 2u, pm->min_burst);
+	}
+
+	return burst;
+}
+
 /*
  * Compute optimum sleep interval based on poll results
  *
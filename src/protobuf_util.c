@@ -5,9 +5,17 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#include <string.h>
+#include <sys/socket.h>
+#include <urcu/compiler.h>
+
 #include "protobuf_util.h"
 #include "stdio.h"
 
+#define PB_WIRE_VARINT		0
+#define PB_WIRE_LENGTH		2
+#define PB_VARINT_MAX		10
+
 int protobuf_get_ipaddr(IPAddress *addr_msg, struct ip_addr *addr)
 {
 	if (addr_msg->address_oneof_case ==
@@ -29,3 +37,71 @@ int protobuf_get_ipaddr(IPAddress *addr_msg, struct ip_addr *addr)
 	return -1;
 }
 
+
+void protobuf_set_ipaddr(IPAddress *addr_msg, int af, const void *addr)
+{
+	ipaddress__init(addr_msg);
+	if (af == AF_INET) {
+		addr_msg->address_oneof_case =
+			IPADDRESS__ADDRESS_ONEOF_IPV4_ADDR;
+		memcpy(&addr_msg->ipv4_addr, addr,
+		       sizeof(addr_msg->ipv4_addr));
+	} else {
+		addr_msg->address_oneof_case =
+			IPADDRESS__ADDRESS_ONEOF_IPV6_ADDR;
+		addr_msg->ipv6_addr.data = (uint8_t *)addr;
+		addr_msg->ipv6_addr.len = sizeof(struct in6_addr);
+	}
+}
+
+static void protobuf_file_append(ProtobufCBuffer *buffer, size_t len,
+				 const uint8_t *data)
+{
+	struct protobuf_file_buffer *buf =
+		caa_container_of(buffer, struct protobuf_file_buffer, base);
+
+	fwrite(data, 1, len, buf->fp);
+}
+
+void protobuf_file_buffer_init(struct protobuf_file_buffer *buf, FILE *fp)
+{
+	buf->base.append = protobuf_file_append;
+	buf->fp = fp;
+}
+
+static size_t protobuf_varint(uint8_t *out, uint64_t val)
+{
+	size_t n = 0;
+
+	while (val >= 0x80) {
+		out[n++] = val | 0x80;
+		val >>= 7;
+	}
+	out[n++] = val;
+	return n;
+}
+
+static void protobuf_file_put_key(struct protobuf_file_buffer *buf,
+				  uint32_t field, uint8_t wire, uint64_t val)
+{
+	uint8_t hdr[2 * PB_VARINT_MAX];
+	size_t n;
+
+	n = protobuf_varint(hdr, (uint64_t)field << 3 | wire);
+	n += protobuf_varint(hdr + n, val);
+	fwrite(hdr, 1, n, buf->fp);
+}
+
+void protobuf_file_put_message(struct protobuf_file_buffer *buf,
+			       uint32_t field, const ProtobufCMessage *msg)
+{
+	protobuf_file_put_key(buf, field, PB_WIRE_LENGTH,
+			      protobuf_c_message_get_packed_size(msg));
+	protobuf_c_message_pack_to_buffer(msg, &buf->base);
+}
+
+void protobuf_file_put_varint(struct protobuf_file_buffer *buf,
+			      uint32_t field, uint64_t val)
+{
+	protobuf_file_put_key(buf, field, PB_WIRE_VARINT, val);
+}
@@ -8,9 +8,34 @@
 #ifndef PROTOBUF_UTIL_H
 #define PROTOBUF_UTIL_H
 
+#include <stdint.h>
+#include <stdio.h>
+
 #include "ip_addr.h"
 #include "protobuf/IPAddress.pb-c.h"
 
 int protobuf_get_ipaddr(IPAddress *addr_msg, struct ip_addr *addr);
 
+/* Fill in an address message, pointing at addr for IPv6 */
+void protobuf_set_ipaddr(IPAddress *addr_msg, int af, const void *addr);
+
+/*
+ * Streamed output of a message to a file, one field at a time, so
+ * that large repeated fields need not be built in memory first.
+ */
+struct protobuf_file_buffer {
+	ProtobufCBuffer	base;
+	FILE		*fp;
+};
+
+void protobuf_file_buffer_init(struct protobuf_file_buffer *buf, FILE *fp);
+
+/* Append a message as a length-delimited field of the outer message */
+void protobuf_file_put_message(struct protobuf_file_buffer *buf,
+			       uint32_t field, const ProtobufCMessage *msg);
+
+/* Append a varint field of the outer message */
+void protobuf_file_put_varint(struct protobuf_file_buffer *buf,
+			      uint32_t field, uint64_t val);
+
 #endif
@@ -11,11 +11,13 @@
 
 
 #include <rte_sched.h>
+#include <urcu/system.h>
 
 #include "if_var.h"
 #include "npf/npf_ruleset.h"
 #include "fal_plugin.h"
 #include "json_writer.h"
+#include "pktmbuf.h"
 
 struct rte_sched_port;
 
@@ -55,6 +57,17 @@ struct queue_wred_info {
 	uint8_t filter_weight;
 	uint8_t num_maps;
 	enum wred_unit unit;
+	uint32_t codel_target;	/* CoDel target sojourn in usecs, 0 for off */
+	uint32_t codel_interval; /* CoDel interval in usecs */
+};
+
+/* CoDel state (one per queue) */
+struct qos_codel {
+	uint64_t first_above;	/* TSC the sojourn must stay above until */
+	uint64_t drop_next;	/* TSC of the next drop when dropping */
+	uint32_t count;		/* Drops since entering dropping state */
+	uint32_t lastcount;
+	bool	 dropping;
 };
 
 struct profile_wred_info {
@@ -82,6 +95,25 @@ struct qos_tc_rate_info {
 	struct qos_rate_info tc_rate[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
 };
 
+/*
+ * Latency stats, kept per subport TC when enabled on the port. Both
+ * are log2 histograms: bucket 0 counts values of 0, bucket n values
+ * from 2^(n-1) to 2^n - 1, and the last bucket everything above.
+ */
+#define QOS_LAT_BUCKETS		20	/* usecs in the queue, up to ~0.5s */
+#define QOS_QLEN_BUCKETS	15	/* packets queued, up to MAX_QSIZE */
+
+struct qos_tc_latency {
+	uint64_t sojourn[QOS_LAT_BUCKETS];	/* per dequeued packet */
+	uint64_t qlen[QOS_QLEN_BUCKETS];	/* sampled each msec */
+};
+
+struct qos_latency {
+	struct qos_tc_latency tc[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
+	struct qos_tc_latency tc_lc[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
+						/* Counts at last clear */
+};
+
 /* Qos Scheduler sub port (one per vlan) */
 struct subport_info {
 	char attach_name[IFNAMSIZ + sizeof("/4294967295")];
@@ -103,6 +135,7 @@ struct subport_info {
 					[e_RTE_METER_COLORS];
 	bool pipe_configured[MAX_PIPES];
 	struct qos_mark_map *mark_map;
+	struct qos_latency *latency;	/* NULL unless latency-stats */
 };
 
 /* DSCP and PCP maps (per profile) */
@@ -130,6 +163,7 @@ struct queue_stats {
 	uint64_t n_pkts_dropped;
 	uint64_t n_pkts_red_dropped;
 	uint64_t n_pkts_red_dscp_dropped[RTE_NUM_DSCP_MAPS];
+	uint64_t n_pkts_codel_dropped;		/* Counted by the tx lcore */
 	/* The values of the ever-increasing counts at the last clear */
 	uint64_t n_bytes_lc;
 	uint64_t n_bytes_dropped_lc;
@@ -137,18 +171,31 @@ struct queue_stats {
 	uint64_t n_pkts_dropped_lc;
 	uint64_t n_pkts_red_dropped_lc;
 	uint64_t n_pkts_red_dscp_dropped_lc[RTE_NUM_DSCP_MAPS];
+	uint64_t n_pkts_codel_dropped_lc;
 };
 
+/*
+ * Most DPDK schedulers the subports of a port can be spread over, each
+ * run by its own tx lcore.
+ */
+#define QOS_SHARDS_MAX 8
+
 /* Qos Scheduler handles (one per physical port) */
 struct sched_info {
 	int dev_id;			/* Device ID - DPDK or FAL */
 	union _dev_info {
 		struct _dpdk {
-			struct rte_sched_port *port;	/* DPDK object */
+			/* DPDK object per shard, subport s in shard s % n */
+			struct rte_sched_port *port[QOS_SHARDS_MAX];
+			unsigned int n_shards;
+			uint32_t q_array_size[QOS_SHARDS_MAX];
+			unsigned int update;	/* Shards to update in place */
+			bool ports_moved;	/* Taken over by replacement */
 		} dpdk;
 		struct _fal {
 			fal_object_t hw_port_sched_group; /* FAL object */
 			uint32_t hw_port_id;              /* FAL id */
+			struct qos_hw_snap *stats_snap;   /* Cached counters */
 		} fal;
 	} dev_info;
 	struct subport_info *subport;	/* Subport's */
@@ -158,14 +205,22 @@ struct sched_info {
 	struct qos_rate_info port_rate;
 	bool    enabled;
 	struct rcu_head rcu;
+	struct sched_info *reconfig;	/* Replacement being configured */
+	struct sched_info *replaces;	/* Config being taken over on start */
 
 	/* subports and pipes as configured, actual size is in port_params */
 	uint32_t n_subports;		/* Original values */
 	uint32_t n_pipes;
+	uint32_t shards;		/* Schedulers asked for */
+	bool	fwd_classify;		/* Classify on forwarding lcores */
+	bool	latency_stats;		/* Timestamp packets on enqueue */
+	uint64_t tsc_per_us;
+	uint64_t qlen_sample[QOS_SHARDS_MAX]; /* TSC of next qlen sample */
 
 	uint16_t vlan_map[VLAN_N_VID];	/* Vlan vid to sub-port policy */
 	struct queue_map *queue_map;
 	struct queue_stats *queue_stats;
+	struct qos_codel *codel;	/* Per queue, if any profile has CoDel */
 	rte_spinlock_t stats_lock;      /* To control access to queue-stats */
 	struct profile_wred_info *wred_profiles;
 };
@@ -235,7 +290,7 @@ extern struct qos_dev qos_devices[];
 #define QOS_DSCP_RESGRP_JSON(qinfo) \
 			qos_devices[qinfo->dev_id].qos_dscp_resgrp_json
 #define QOS_CONFIGURED(qinfo) \
-	(qinfo->dev_info.dpdk.port || qinfo->dev_info.fal.hw_port_id)
+	(qinfo->dev_info.dpdk.port[0] || qinfo->dev_info.fal.hw_port_id)
 
 /*
  * Given an interface walk back to the parent device (if a vlan)
@@ -249,6 +304,52 @@ static inline struct sched_info *qos_handle(const struct ifnet *ifp)
 	return rcu_dereference(ifp->if_qos);
 }
 
+/* The number of DPDK schedulers, and so tx rings, in use for a port */
+static inline unsigned int qos_dpdk_shards(const struct sched_info *qinfo)
+{
+	unsigned int n = CMM_ACCESS_ONCE(qinfo->dev_info.dpdk.n_shards);
+
+	return n ? n : 1;
+}
+
+static inline unsigned int
+qos_dpdk_subport_shard(const struct sched_info *qinfo, uint32_t subport)
+{
+	return subport % qos_dpdk_shards(qinfo);
+}
+
+/*
+ * The config that commands apply to.  That is the one being built to
+ * replace the running config, if there is one.
+ */
+static inline struct sched_info *qos_cfg_info(const struct ifnet *ifp)
+{
+	struct sched_info *qinfo = ifp->if_qos;
+
+	return qinfo && qinfo->reconfig ? qinfo->reconfig : qinfo;
+}
+
+/* The subport of a packet, which only depends on the vlan */
+static inline uint32_t
+qos_pkt_subport(const struct sched_info *qinfo, const struct rte_mbuf *m)
+{
+	return qinfo->vlan_map[pktmbuf_get_txvlanid(m)];
+}
+
+/*
+ * The shard a packet is to be scheduled by. This only needs the
+ * subport, so the forwarding lcores can pick the ring without running
+ * the full classification.
+ */
+static inline unsigned int
+qos_dpdk_pkt_shard(const struct sched_info *qinfo, const struct rte_mbuf *m)
+{
+	if (likely(qos_dpdk_shards(qinfo) == 1))
+		return 0;
+
+	return qos_dpdk_subport_shard(qinfo, qos_pkt_subport(qinfo, m));
+}
+
 /*
  * The bottom RTE_SCHED_TC_BITS bits is the TC.
  * The next RTE_SCHED_WRR_BITS is the q index.
@@ -341,12 +442,16 @@ static inline void qos_sched_pipe_check(struct sched_info *qinfo,
 
 void qos_init(void);
 int qos_sched_start(struct ifnet *ifp, uint64_t link_speed);
+int qos_sched_start_qinfo(struct ifnet *ifp, struct sched_info *qinfo,
+			  uint64_t link_speed);
 void qos_sched_stop(struct ifnet *ifp);
 uint32_t qos_sched_calc_qindex(struct sched_info *qinfo, unsigned int subport,
 			       unsigned int pipe, unsigned int tc,
 			       unsigned int q);
 struct sched_info;
-int qos_sched(struct ifnet *ifp, struct sched_info *info,
+bool qos_dpdk_fwd_classify(struct ifnet *ifp, struct sched_info *qinfo,
+			   struct rte_mbuf **m);
+int qos_sched(struct ifnet *ifp, struct sched_info *info, unsigned int shard,
 	      struct rte_mbuf **in, uint32_t n_in,
 	      struct rte_mbuf **out, uint32_t n_out);
 struct subport_info *qos_get_subport(const char *name, struct ifnet **ifp);
@@ -395,7 +500,9 @@ int qos_dpdk_queue_clear_stats(struct sched_info *qinfo,
 void qos_dpdk_free(struct sched_info *qinfo);
 int qos_dpdk_port(struct ifnet *ifp,
 		  unsigned int subports, unsigned int pipes,
-		  unsigned int profiles, unsigned int overhead);
+		  unsigned int profiles, unsigned int overhead,
+		  unsigned int shards, bool fwd_classify,
+		  bool latency_stats);
 int qos_dpdk_disable(struct ifnet *ifp, struct sched_info *qinfo);
 int qos_dpdk_enable(struct ifnet *ifp,
 		    struct sched_info *qinfo);
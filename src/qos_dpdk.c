@@ -5,6 +5,8 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#include <math.h>
+#include <rte_cycles.h>
 #include <rte_ethdev.h>
 #include <rte_ether.h>
 #include <rte_lcore.h>
@@ -12,11 +14,14 @@
 #include <rte_mbuf.h>
 #include <rte_red.h>
 #include <rte_sched.h>
+#include <urcu/uatomic.h>
+
 #include "qos.h"
 #include "json_writer.h"
 #include "netinet6/ip6_funcs.h"
 #include "npf/config/npf_config.h"
 #include "npf_shim.h"
+#include "util.h"
 #include "vplane_debug.h"
 #include "vplane_log.h"
 #include "ether.h"
@@ -25,14 +30,14 @@
  * Return the DSCP wred resource group name associated with a map entry
  * in a queue index.
  */
-static char *qos_get_dscp_grp(struct sched_info *qinfo, uint32_t qid, int i)
+static char *qos_get_dscp_grp(struct sched_info *qinfo,
+			      struct rte_sched_port *port, uint32_t qid, int i)
 {
 	struct rte_sched_pipe_params *pp;
 	struct rte_red_pipe_params *wred_params;
 	int profile;
 
-	profile = rte_sched_get_profile_for_pipe(qinfo->dev_info.dpdk.port,
-						 qid);
+	profile = rte_sched_get_profile_for_pipe(port, qid);
 	if (profile < 0)
 		return NULL;
 
@@ -44,23 +49,31 @@ static char *qos_get_dscp_grp(struct sched_info *qinfo, uint32_t qid, int i)
 	return NULL;
 }
 
+static struct rte_sched_port *
+qos_dpdk_subport_port(const struct sched_info *qinfo, uint32_t subport)
+{
+	return qinfo->dev_info.dpdk.port[qos_dpdk_subport_shard(qinfo,
+								subport)];
+}
+
 void qos_dpdk_dscp_resgrp_json(struct sched_info *qinfo, uint32_t subport,
 			       uint32_t pipe, uint32_t tc, uint32_t q,
 			       uint64_t *random_dscp_drop, json_writer_t *wr)
 {
+	struct rte_sched_port *port = qos_dpdk_subport_port(qinfo, subport);
 	uint32_t qid;
 	int i, num_maps;
 
 	qid = qos_sched_calc_qindex(qinfo, subport, pipe, tc, q);
 
-	num_maps = rte_red_queue_num_maps(qinfo->dev_info.dpdk.port, qid);
+	num_maps = rte_red_queue_num_maps(port, qid);
 	if (num_maps) {
 		char *grp_name;
 
 		jsonw_name(wr, "wred_map");
 		jsonw_start_array(wr);
 		for (i = 0; i < num_maps; i++) {
-			grp_name = qos_get_dscp_grp(qinfo, qid, i);
+			grp_name = qos_get_dscp_grp(qinfo, port, qid, i);
 			if (grp_name == NULL)
 				break;
 			jsonw_start_object(wr);
@@ -78,7 +91,7 @@ int qos_dpdk_subport_read_stats(struct sched_info *qinfo,
 				struct rte_sched_subport_stats64 *queue_stats)
 {
 	uint32_t over[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
-	struct rte_sched_port *port = qinfo->dev_info.dpdk.port;
+	struct rte_sched_port *port = qos_dpdk_subport_port(qinfo, subport);
 	struct rte_sched_subport_stats64 stats;
 	int ret, i;
 
@@ -143,7 +156,7 @@ int qos_dpdk_queue_read_stats(struct sched_info *qinfo,
 			      uint64_t *qlen, bool *qlen_in_pkts)
 {
 	struct rte_sched_queue_stats64 stats;
-	struct rte_sched_port *port = qinfo->dev_info.dpdk.port;
+	struct rte_sched_port *port = qos_dpdk_subport_port(qinfo, subport);
 	uint32_t qid = qos_sched_calc_qindex(qinfo, subport, pipe, tc, q);
 	uint16_t qlen_16;
 	int ret, i;
@@ -193,6 +206,8 @@ int qos_dpdk_queue_clear_stats(struct sched_info *qinfo,
 		queue_stats->n_pkts_dropped_lc = queue_stats->n_pkts_dropped;
 		queue_stats->n_pkts_red_dropped_lc =
 			queue_stats->n_pkts_red_dropped;
+		queue_stats->n_pkts_codel_dropped_lc =
+			queue_stats->n_pkts_codel_dropped;
 		for (i = 0; i < RTE_NUM_DSCP_MAPS; i++)
 			queue_stats->n_pkts_red_dscp_dropped_lc[i] =
 				queue_stats->n_pkts_red_dscp_dropped[i];
@@ -203,13 +218,21 @@ int qos_dpdk_queue_clear_stats(struct sched_info *qinfo,
 
 void qos_dpdk_free(struct sched_info *qinfo)
 {
-	if (qinfo->dev_info.dpdk.port)
-		rte_sched_port_free(qinfo->dev_info.dpdk.port);
+	unsigned int shard;
+
+	if (qinfo->dev_info.dpdk.ports_moved)
+		return;
+
+	for (shard = 0; shard < QOS_SHARDS_MAX; shard++)
+		if (qinfo->dev_info.dpdk.port[shard])
+			rte_sched_port_free(qinfo->dev_info.dpdk.port[shard]);
 }
 
 int qos_dpdk_port(struct ifnet *ifp,
 		  unsigned int subports, unsigned int pipes,
-		  unsigned int profiles, unsigned int overhead)
+		  unsigned int profiles, unsigned int overhead,
+		  unsigned int shards, bool fwd_classify,
+		  bool latency_stats)
 {
 	unsigned int n_subports, n_pipes;
 
@@ -243,13 +266,35 @@ int qos_dpdk_port(struct ifnet *ifp,
 		 "Rounded to subports %u pipes %u profiles %u\n",
 		 subports, pipes, profiles);
 
-	/* Drop old config if any */
-	struct sched_info *qinfo = ifp->if_qos;
+	/*
+	 * Drop old config if any.  If the new one is the same shape, the
+	 * old keeps running until the new one is enabled, and can then
+	 * hand its schedulers over.  Its classification rules go now, as
+	 * the new subports take over their attach points.
+	 */
+	struct sched_info *old = ifp->if_qos;
+	struct sched_info *qinfo;
+	bool replace = false;
+
+	if (old) {
+		if (old->reconfig) {
+			qos_subport_npf_free(old->reconfig);
+			qos_sched_free(old->reconfig);
+			old->reconfig = NULL;
+		} else {
+			qos_subport_npf_free(old);
+		}
 
-	if (qinfo) {
-		qos_subport_npf_free(qinfo);
-		rcu_assign_pointer(ifp->if_qos, NULL);
-		call_rcu(&qinfo->rcu, qos_sched_free_rcu);
+		replace = old->dev_id == QOS_DPDK_ID && old->enabled &&
+			old->port_params.n_subports_per_port == subports &&
+			old->port_params.n_pipes_per_subport == pipes &&
+			old->port_params.n_pipe_profiles == profiles &&
+			old->port_params.frame_overhead == (int)overhead &&
+			old->shards == shards;
+		if (!replace) {
+			rcu_assign_pointer(ifp->if_qos, NULL);
+			call_rcu(&old->rcu, qos_sched_free_rcu);
+		}
 	}
 
 	qinfo = qos_sched_new(ifp, subports,
@@ -261,8 +306,34 @@ int qos_dpdk_port(struct ifnet *ifp,
 
 	qinfo->n_subports = n_subports;
 	qinfo->n_pipes = n_pipes;
+	qinfo->shards = shards;
+	qinfo->fwd_classify = fwd_classify;
 	qinfo->dev_id = QOS_DPDK_ID;
 
+	if (latency_stats) {
+		unsigned int i;
+
+		for (i = 0; i < n_subports; i++) {
+			qinfo->subport[i].latency =
+				calloc(1, sizeof(struct qos_latency));
+			if (!qinfo->subport[i].latency) {
+				DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+					 "out of memory for qos latency\n");
+				qos_subport_npf_free(qinfo);
+				qos_sched_free(qinfo);
+				return -ENOMEM;
+			}
+		}
+		qinfo->latency_stats = true;
+	}
+	qinfo->tsc_per_us = RTE_MAX(rte_get_tsc_hz() / USEC_PER_SEC, 1ul);
+
+	if (replace) {
+		/* Commands now configure this, see qos_cfg_info() */
+		old->reconfig = qinfo;
+		return 0;
+	}
+
 	rcu_assign_pointer(ifp->if_qos, qinfo);
 	return 0;
 }
@@ -273,18 +344,60 @@ int qos_dpdk_disable(struct ifnet *ifp, struct sched_info *qinfo)
 
 	disable_transmit_thread(ifp->if_port);
 
-	qos_subport_npf_free(qinfo);
+	/* If being replaced, its rules have already gone */
+	qos_subport_npf_free(qinfo->reconfig ? qinfo->reconfig : qinfo);
 	call_rcu(&qinfo->rcu, qos_sched_free_rcu);
 
 	return 0;
 }
 
+/*
+ * Enable the config built to replace the running one.  If the link is
+ * up, the new config takes over the running schedulers where it can,
+ * and they are updated in place so queued packets are kept.
+ */
+static int qos_dpdk_replace(struct ifnet *ifp, struct sched_info *old,
+			    struct sched_info *qinfo)
+{
+	struct if_link_status link;
+
+	old->reconfig = NULL;
+
+	if_get_link_status(ifp, &link);
+	if (link.link_status) {
+		qinfo->replaces = old;
+		if (qos_sched_start_qinfo(ifp, qinfo, link.link_speed) < 0) {
+			DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+				 "Qos start failed, keeping old config\n");
+			qos_subport_npf_free(qinfo);
+			qos_sched_free(qinfo);
+			return -ENODEV;
+		}
+		qinfo->replaces = NULL;
+	}
+
+	rcu_assign_pointer(ifp->if_qos, qinfo);
+	call_rcu(&old->rcu, qos_sched_free_rcu);
+
+	if (enable_transmit_thread(ifp->if_port) < 0) {
+		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+			 "Transmit thread setup failed\n");
+		qinfo->enabled = false;
+		return -ENODEV;
+	}
+
+	return 0;
+}
+
 int qos_dpdk_enable(struct ifnet *ifp,
 		    struct sched_info *qinfo)
 {
 	/* If link is already up, then start now */
 	struct if_link_status link;
 
+	if (ifp->if_qos != qinfo)
+		return qos_dpdk_replace(ifp, ifp->if_qos, qinfo);
+
 	if_get_link_status(ifp, &link);
 
 	if (link.link_status &&
@@ -336,24 +449,156 @@ static uint32_t qos_sched_subport_qsize(struct rte_sched_port_params *pp,
 /* Allocate and initialize a handle to QoS scheduler.
  * Only called by master thread.
  */
+/*
+ * Configure a subport, and its pipes, in a scheduler.  This does not
+ * touch the queues, so can also be used to change a running one.
+ */
+static int qos_dpdk_subport_config(struct sched_info *qinfo,
+				   struct rte_sched_port *port,
+				   unsigned int subport)
+{
+	struct subport_info *sinfo = &qinfo->subport[subport];
+	struct rte_sched_subport_params *params = &sinfo->params;
+	uint16_t qsize[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
+	unsigned int pipe;
+	int i, ret;
+
+	for (i = 0; i < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; i++)
+		qsize[i] = (uint16_t)sinfo->qsize[i];
+
+	ret = rte_sched_subport_config_v2(port, subport, params,
+					  &qsize[0], sinfo->red_params);
+	if (ret != 0) {
+		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+			 "Qos config subport %u failed: %d\n",
+			 subport, ret);
+		return ret;
+	}
+
+	for (pipe = 0; pipe < qinfo->n_pipes; pipe++) {
+		uint8_t profile = sinfo->profile_map[pipe];
+
+		ret = rte_sched_pipe_config_v2(port, subport,
+					       pipe, profile,
+					       &qinfo->port_params);
+		if  (ret != 0) {
+			DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+				 "Qos config pipe subport %u pipe %u"
+				 " profile %u failed: %d\n",
+				 subport, pipe, profile, ret);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Create the scheduler for one shard, configuring only the subports
+ * (and their pipes) that are in it.
+ */
+static struct rte_sched_port *
+qos_dpdk_shard_config(struct sched_info *qinfo, unsigned int shard,
+		      unsigned int n_shards, uint32_t q_array_size)
+{
+	struct rte_sched_port *port;
+	unsigned int subport;
+
+	port = rte_sched_port_config_v2(&qinfo->port_params, q_array_size);
+	if (port == NULL) {
+		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+			 "QoS config port failed\n");
+		return NULL;
+	}
+
+	for (subport = shard; subport < qinfo->n_subports;
+	     subport += n_shards) {
+		if (qos_dpdk_subport_config(qinfo, port, subport) != 0)
+			goto out_free_sched;
+
+		/* Update NPF rules */
+		npf_cfg_commit_all();
+	}
+
+	return port;
+
+ out_free_sched:
+	rte_sched_port_free(port);
+	return NULL;
+}
+
+static bool qos_dpdk_codel_configured(const struct sched_info *qinfo)
+{
+	unsigned int profile, q;
+
+	for (profile = 0; profile < qinfo->port_params.n_pipe_profiles;
+	     profile++) {
+		const struct profile_wred_info *wred =
+			&qinfo->wred_profiles[profile];
+
+		for (q = 0; q < RTE_SCHED_QUEUES_PER_PIPE; q++)
+			if (wred->queue_wred[q].codel_target)
+				return true;
+	}
+	return false;
+}
+
+/*
+ * Take over the running schedulers of the config being replaced, if
+ * they have the same layout, so that the queued packets are kept.  The
+ * subports and pipes are then updated in place by the tx lcores.
+ */
+static bool qos_dpdk_take_over(struct sched_info *qinfo,
+			       struct sched_info *old, unsigned int n_shards,
+			       const uint32_t *q_array_size)
+{
+	struct _dpdk *dpdk = &qinfo->dev_info.dpdk;
+	unsigned int shard;
+
+	if (!old || !QOS_CONFIGURED(old) ||
+	    old->dev_info.dpdk.n_shards != n_shards ||
+	    memcmp(old->dev_info.dpdk.q_array_size, q_array_size,
+		   sizeof(dpdk->q_array_size)) != 0)
+		return false;
+
+	for (shard = 0; shard < QOS_SHARDS_MAX; shard++)
+		dpdk->port[shard] = old->dev_info.dpdk.port[shard];
+	dpdk->n_shards = n_shards;
+	memcpy(dpdk->q_array_size, q_array_size, sizeof(dpdk->q_array_size));
+	dpdk->update = (1u << n_shards) - 1;
+
+	/* Freed with this config now */
+	old->dev_info.dpdk.ports_moved = true;
+	return true;
+}
+
 int qos_dpdk_start(struct ifnet *ifp, struct sched_info *qinfo,
 		   uint64_t bps, uint16_t max_pkt_len)
 {
-	struct rte_sched_port *port, *old_port = NULL;
-	unsigned int subport, pipe;
-	int ret;
-	uint32_t q_array_size;
+	struct rte_sched_port *port[QOS_SHARDS_MAX] = { NULL };
+	struct rte_sched_port *old_port;
+	unsigned int subport, shard, n_shards;
+	uint32_t q_array_size[QOS_SHARDS_MAX] = { 0 };
+
+	/*
+	 * Each shard needs its own tx ring. As the whole of a subport
+	 * is in one shard its rates are kept, and as each shard is
+	 * limited to the port rate they can not exceed it by more than
+	 * the link can take.
+	 */
+	n_shards = RTE_MIN(RTE_MAX(qinfo->shards, 1U),
+			   port_max_tx_rings(ifp->if_port));
+	n_shards = RTE_MIN(n_shards, RTE_MAX(qinfo->n_subports, 1U));
 
 	/*
 	 * Allow subports to inherit their queue sizes from the port, and
-	 * calculate the total size of queue array this port will need.
+	 * calculate the total size of queue array each shard will need.
 	 */
-	q_array_size = 0;
 	for (subport = 0; subport < qinfo->n_subports; subport++) {
 		struct subport_info *sinfo = &qinfo->subport[subport];
 
-		q_array_size += qos_sched_subport_qsize(&qinfo->port_params,
-							sinfo->qsize);
+		q_array_size[subport % n_shards] +=
+			qos_sched_subport_qsize(&qinfo->port_params,
+						sinfo->qsize);
 
 		/*
 		 * Establish subport rates before checking pipes so that the
@@ -366,74 +611,74 @@ int qos_dpdk_start(struct ifnet *ifp, struct sched_info *qinfo,
 
 	qos_sched_pipe_check(qinfo, max_pkt_len, bps);
 
-	port = rte_sched_port_config_v2(&qinfo->port_params, q_array_size);
-	if (port == NULL) {
-		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
-			 "QoS config port failed\n");
-		return -1;
-	}
+	if (!qinfo->codel && qos_dpdk_codel_configured(qinfo)) {
+		struct rte_sched_port_params *pp = &qinfo->port_params;
+		struct qos_codel *codel;
 
-	for (subport = 0; subport < qinfo->n_subports; subport++) {
-		struct subport_info *sinfo = &qinfo->subport[subport];
-		struct rte_sched_subport_params *params = &sinfo->params;
-		uint16_t qsize[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE];
-		int i;
-
-		for (i = 0; i < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; i++)
-			qsize[i] = (uint16_t)sinfo->qsize[i];
-
-		ret = rte_sched_subport_config_v2(port, subport, params,
-						  &qsize[0], sinfo->red_params);
-		if (ret != 0) {
+		/* Kept until the port is freed, the tx lcore may be using it */
+		codel = calloc(RTE_SCHED_QUEUES_PER_PIPE *
+			       pp->n_pipes_per_subport *
+			       pp->n_subports_per_port, sizeof(*codel));
+		if (!codel) {
 			DP_DEBUG(QOS_DP, ERR, DATAPLANE,
-				 "Qos config subport %u failed: %d\n",
-				 subport, ret);
-			goto out_free_sched;
-		}
-
-		for (pipe = 0; pipe < qinfo->n_pipes; pipe++) {
-			uint8_t profile = sinfo->profile_map[pipe];
-
-			ret = rte_sched_pipe_config_v2(port, subport,
-						       pipe, profile,
-						       &qinfo->port_params);
-			if  (ret != 0) {
-				DP_DEBUG(QOS_DP, ERR, DATAPLANE,
-					 "Qos config pipe subport %u pipe %u"
-					 " profile %u failed: %d\n",
-					 subport, pipe, profile, ret);
-				goto out_free_sched;
-			}
+				 "out of memory for qos codel\n");
+			return -1;
 		}
+		rcu_assign_pointer(qinfo->codel, codel);
+	}
 
-		/* Update NPF rules */
+	if (qos_dpdk_take_over(qinfo, qinfo->replaces, n_shards,
+			       q_array_size)) {
+		DP_DEBUG(QOS_DP, DEBUG, DATAPLANE,
+			 "QoS on port %s updated in place\n", ifp->if_name);
 		npf_cfg_commit_all();
+		return 0;
+	}
+
+	for (shard = 0; shard < n_shards; shard++) {
+		port[shard] = qos_dpdk_shard_config(qinfo, shard, n_shards,
+						    q_array_size[shard]);
+		if (port[shard] == NULL)
+			goto out_free_sched;
 	}
 
 	/* Use RCU to set the pointer because changed by master thread
 	 * but referenced by Tx thread
 	 */
-	DP_DEBUG(QOS_DP, DEBUG, DATAPLANE,  "QoS on port %s enabled\n",
-		 ifp->if_name);
-	old_port = qinfo->dev_info.dpdk.port;
-	rcu_assign_pointer(qinfo->dev_info.dpdk.port, port);
-	defer_rcu(qos_dpdk_port_free_rcu, old_port);
+	DP_DEBUG(QOS_DP, DEBUG, DATAPLANE,
+		 "QoS on port %s enabled, %u shards\n",
+		 ifp->if_name, n_shards);
+	for (shard = 0; shard < QOS_SHARDS_MAX; shard++) {
+		old_port = qinfo->dev_info.dpdk.port[shard];
+		rcu_assign_pointer(qinfo->dev_info.dpdk.port[shard],
+				   port[shard]);
+		if (old_port)
+			defer_rcu(qos_dpdk_port_free_rcu, old_port);
+	}
+	CMM_STORE_SHARED(qinfo->dev_info.dpdk.n_shards, n_shards);
+	memcpy(qinfo->dev_info.dpdk.q_array_size, q_array_size,
+	       sizeof(q_array_size));
 	return 0;
 
  out_free_sched:
-	rte_sched_port_free(port);
+	while (shard--)
+		rte_sched_port_free(port[shard]);
 	return -1;
 }
 
 int qos_dpdk_stop(__unused struct ifnet *ifp, struct sched_info *qinfo)
 {
-	struct rte_sched_port *port = qinfo->dev_info.dpdk.port;
+	struct rte_sched_port *port;
+	unsigned int shard;
 
-	if (port == NULL)
-		return 0; /* qos not started */
+	for (shard = 0; shard < QOS_SHARDS_MAX; shard++) {
+		port = qinfo->dev_info.dpdk.port[shard];
+		if (port == NULL)
+			continue; /* qos not started */
 
-	rcu_assign_pointer(qinfo->dev_info.dpdk.port, NULL);
-	defer_rcu(qos_dpdk_port_free_rcu, port);
+		rcu_assign_pointer(qinfo->dev_info.dpdk.port[shard], NULL);
+		defer_rcu(qos_dpdk_port_free_rcu, port);
+	}
 
 	return 0;
 }
@@ -448,7 +693,7 @@ int qos_dpdk_stop(__unused struct ifnet *ifp, struct sched_info *qinfo)
  */
 static
 int qos_npf_classify(struct ifnet *ifp, const struct sched_info *qinfo,
-		     struct rte_mbuf **m)
+		     struct rte_mbuf **m, uint32_t *subportp)
 {
 	uint16_t ether_type = ethtype(*m, ETHER_TYPE_VLAN);
 	uint32_t subport, pipe = 0, q = DEFAULT_Q;
@@ -456,15 +701,8 @@ int qos_npf_classify(struct ifnet *ifp, const struct sched_info *qinfo,
 
 	uint16_t vlan = pktmbuf_get_txvlanid(*m);
 
-	if (vlan) {
-		struct ifnet *vlan_ifp;
-
-		vlan_ifp = if_vlan_lookup(ifp, vlan);
-		if (vlan_ifp)
-			ifp = vlan_ifp;
-	}
-
 	subport = qinfo->vlan_map[vlan];
+	*subportp = subport;
 	struct subport_info *sinfo = &qinfo->subport[subport];
 
 	/* Do stateless classification */
@@ -472,6 +710,15 @@ int qos_npf_classify(struct ifnet *ifp, const struct sched_info *qinfo,
 				rcu_dereference(sinfo->npf_config);
 
 	if (npf_active(npf_config, NPF_QOS)) {
+		/* The sub-interface is only needed to match the rules */
+		if (vlan) {
+			struct ifnet *vlan_ifp;
+
+			vlan_ifp = if_vlan_lookup(ifp, vlan);
+			if (vlan_ifp)
+				ifp = vlan_ifp;
+		}
+
 		result = npf_hook_notrack(npf_get_ruleset(npf_config,
 					  NPF_RS_QOS), m, ifp, PFIL_OUT, 0,
 					  ether_type);
@@ -528,9 +775,10 @@ int qos_npf_classify(struct ifnet *ifp, const struct sched_info *qinfo,
 }
 
 static int qos_classify(struct ifnet *ifp, struct sched_info *qinfo,
+			unsigned int shard,
 			struct rte_mbuf *enq_pkts[], uint32_t n_pkts)
 {
-	uint32_t i, j;
+	uint32_t i, j, subport;
 
 	/*
 	 * Classify the packets to the Qos queues.
@@ -539,8 +787,23 @@ static int qos_classify(struct ifnet *ifp, struct sched_info *qinfo,
 	 * dropped via policing and repack the array.
 	 */
 	for (i = j = 0; i < n_pkts; i++) {
-		if (qos_npf_classify(ifp, qinfo,
-				     &(enq_pkts[i])) == NPF_DECISION_BLOCK) {
+		if (pktmbuf_mdata_exists(enq_pkts[i],
+					 PKT_MDATA_QOS_CLASSIFIED)) {
+			/* Already done by the forwarding lcore */
+			pktmbuf_mdata_clear(enq_pkts[i],
+					    PKT_MDATA_QOS_CLASSIFIED);
+			subport = qos_pkt_subport(qinfo, enq_pkts[i]);
+		} else if (qos_npf_classify(ifp, qinfo, &(enq_pkts[i]),
+					    &subport) == NPF_DECISION_BLOCK) {
+			rte_pktmbuf_free(enq_pkts[i]);
+			continue;
+		}
+
+		/*
+		 * The shards were changed since the packet was queued,
+		 * and its subport is not in this scheduler.
+		 */
+		if (unlikely(qos_dpdk_subport_shard(qinfo, subport) != shard)) {
 			rte_pktmbuf_free(enq_pkts[i]);
 			continue;
 		}
@@ -556,13 +819,203 @@ static int qos_classify(struct ifnet *ifp, struct sched_info *qinfo,
 	return j;
 }
 
+/*
+ * Classify a packet for QoS before it is queued for the tx lcore,
+ * leaving that with only the scheduling to do.
+ *
+ * Returns false if the packet is to be dropped.
+ */
+bool qos_dpdk_fwd_classify(struct ifnet *ifp, struct sched_info *qinfo,
+			   struct rte_mbuf **m)
+{
+	uint32_t subport;
+
+	if (qos_npf_classify(ifp, qinfo, m, &subport) == NPF_DECISION_BLOCK)
+		return false;
+
+	pktmbuf_mdata_clear(*m, PKT_MDATA_SESSION_SENTRY);
+	pktmbuf_mdata_set(*m, PKT_MDATA_QOS_CLASSIFIED);
+	return true;
+}
+
+static inline unsigned int qos_log2_bucket(uint64_t value,
+					   unsigned int n_buckets)
+{
+	unsigned int bucket = value ? 64 - __builtin_clzll(value) : 0;
+
+	return RTE_MIN(bucket, n_buckets - 1);
+}
+
+/*
+ * Account the time the dequeued packets spent in the scheduler, and
+ * now and then the depth of the queue the first one came from.  Only
+ * the shard's tx lcore updates its subports, so no locking is needed.
+ */
+static void qos_latency_record(struct sched_info *qinfo, unsigned int shard,
+			       struct rte_mbuf *pkts[], uint32_t n_pkts)
+{
+	uint32_t subport, pipe, tc, q;
+	struct qos_latency *lat;
+	uint64_t now = rte_rdtsc();
+	uint32_t i;
+
+	for (i = 0; i < n_pkts; i++) {
+		rte_sched_port_pkt_read_tree_path(pkts[i], &subport, &pipe,
+						  &tc, &q);
+		lat = qinfo->subport[subport].latency;
+		if (unlikely(!lat))
+			continue;
+
+		lat->tc[tc].sojourn[qos_log2_bucket(
+			(now - pkts[i]->timestamp) / qinfo->tsc_per_us,
+			QOS_LAT_BUCKETS)]++;
+	}
+
+	if (n_pkts == 0 || now < qinfo->qlen_sample[shard])
+		return;
+
+	qinfo->qlen_sample[shard] = now + qinfo->tsc_per_us * US_PER_MS;
+
+	rte_sched_port_pkt_read_tree_path(pkts[0], &subport, &pipe, &tc, &q);
+	lat = qinfo->subport[subport].latency;
+	if (lat) {
+		uint32_t qid = qos_sched_calc_qindex(qinfo, subport, pipe,
+						     tc, q);
+		bool qlen_in_pkts;
+		uint64_t qlen;
+
+		/* Counters are accumulated, so reading them here is safe */
+		if (qos_dpdk_queue_read_stats(qinfo, subport, pipe, tc, q,
+					      qinfo->queue_stats + qid,
+					      &qlen, &qlen_in_pkts) == 0)
+			lat->tc[tc].qlen[qos_log2_bucket(qlen,
+							 QOS_QLEN_BUCKETS)]++;
+	}
+}
+
+/*
+ * The CoDel control law: the next drop is interval / sqrt(count) on.
+ */
+static inline uint64_t qos_codel_next(uint64_t t, uint64_t interval,
+				      uint32_t count)
+{
+	return t + (uint64_t)(interval / sqrt(count));
+}
+
+/*
+ * CoDel (RFC 8289) run as packets leave the scheduler, so it is the
+ * head of the queue that is dropped.  Returns true if the packet is
+ * to be dropped.
+ */
+static bool qos_codel_drop(struct qos_codel *cd,
+			   const struct queue_wred_info *qw,
+			   uint64_t tsc_per_us, uint64_t now, uint64_t sojourn)
+{
+	uint64_t interval = qw->codel_interval * tsc_per_us;
+	bool ok_to_drop = false;
+
+	if (sojourn < qw->codel_target * tsc_per_us) {
+		cd->first_above = 0;
+	} else if (cd->first_above == 0) {
+		cd->first_above = now + interval;
+	} else if (now >= cd->first_above) {
+		ok_to_drop = true;
+	}
+
+	if (cd->dropping) {
+		if (!ok_to_drop) {
+			cd->dropping = false;
+			return false;
+		}
+		if (now < cd->drop_next)
+			return false;
+		cd->count++;
+		cd->drop_next = qos_codel_next(cd->drop_next, interval,
+					       cd->count);
+		return true;
+	}
+
+	if (!ok_to_drop)
+		return false;
+
+	/*
+	 * Start dropping, at the rate dropping ended with if that was
+	 * recent, as the queue probably still needs it.
+	 */
+	cd->dropping = true;
+	if (cd->count - cd->lastcount > 1 &&
+	    now - cd->drop_next < 16 * interval)
+		cd->count = cd->count - cd->lastcount;
+	else
+		cd->count = 1;
+	cd->lastcount = cd->count;
+	cd->drop_next = qos_codel_next(now, interval, cd->count);
+	return true;
+}
+
+/*
+ * Drop the dequeued packets that CoDel says to, packing the array.
+ * Only the shard's tx lcore runs the queues of its subports.
+ */
+static uint32_t qos_codel(struct sched_info *qinfo, struct qos_codel *codel,
+			  struct rte_mbuf *pkts[], uint32_t n_pkts)
+{
+	uint32_t subport, pipe, tc, q, qid;
+	const struct queue_wred_info *qw;
+	uint64_t now = rte_rdtsc();
+	uint32_t i, j;
+
+	for (i = j = 0; i < n_pkts; i++) {
+		rte_sched_port_pkt_read_tree_path(pkts[i], &subport, &pipe,
+						  &tc, &q);
+		qw = &qinfo->wred_profiles[
+			qinfo->subport[subport].profile_map[pipe]]
+			.queue_wred[tc * RTE_SCHED_QUEUES_PER_TRAFFIC_CLASS + q];
+
+		if (qw->codel_target) {
+			qid = qos_sched_calc_qindex(qinfo, subport, pipe,
+						    tc, q);
+			if (qos_codel_drop(&codel[qid], qw, qinfo->tsc_per_us,
+					   now, now - pkts[i]->timestamp)) {
+				qinfo->queue_stats[qid].n_pkts_codel_dropped++;
+				rte_pktmbuf_free(pkts[i]);
+				continue;
+			}
+		}
+
+		if (i != j)
+			pkts[j] = pkts[i];
+		j++;
+	}
+	return j;
+}
+
+/*
+ * Apply a new config to the subports of a running scheduler.  This is
+ * done by the shard's tx lcore, as the scheduler is not thread safe.
+ */
+static void qos_dpdk_shard_update(struct sched_info *qinfo,
+				  struct rte_sched_port *port,
+				  unsigned int shard)
+{
+	unsigned int n_shards = qos_dpdk_shards(qinfo);
+	unsigned int subport;
+
+	for (subport = shard; subport < qinfo->n_subports;
+	     subport += n_shards)
+		qos_dpdk_subport_config(qinfo, port, subport);
+
+	uatomic_and(&qinfo->dev_info.dpdk.update, ~(1u << shard));
+}
+
 /* Put/get packets currently ready to send from DPDK */
-int qos_sched(struct ifnet *ifp, struct sched_info *qinfo,
+int qos_sched(struct ifnet *ifp, struct sched_info *qinfo, unsigned int shard,
 	      struct rte_mbuf *enq_pkts[], uint32_t n_pkts,
 	      struct rte_mbuf *deq_pkts[], uint32_t space)
 {
 	struct rte_sched_port *port =
-		rcu_dereference(qinfo->dev_info.dpdk.port);
+		rcu_dereference(qinfo->dev_info.dpdk.port[shard]);
+	struct qos_codel *codel = rcu_dereference(qinfo->codel);
 
 	if (unlikely(port == NULL)) {
 		/* qos not started, because link down or race */
@@ -570,19 +1023,39 @@ int qos_sched(struct ifnet *ifp, struct sched_info *qinfo,
 		return 0;
 	}
 
+	if (unlikely(CMM_LOAD_SHARED(qinfo->dev_info.dpdk.update) &
+		     (1u << shard)))
+		qos_dpdk_shard_update(qinfo, port, shard);
+
 	if (n_pkts > 0) {
-		n_pkts = qos_classify(ifp, qinfo, enq_pkts, n_pkts);
+		n_pkts = qos_classify(ifp, qinfo, shard, enq_pkts, n_pkts);
 
 		/*
 		 * In case we've dropped the packets whilst policing
 		 */
+		if (n_pkts && (qinfo->latency_stats || codel)) {
+			uint64_t now = rte_rdtsc();
+			uint32_t i;
+
+			/* Not a forwarding latency stamp any more */
+			for (i = 0; i < n_pkts; i++) {
+				enq_pkts[i]->timestamp = now;
+				enq_pkts[i]->ol_flags &= ~PKT_RX_TIMESTAMP;
+			}
+		}
 		if (n_pkts)
 			rte_sched_port_enqueue(port, enq_pkts, n_pkts);
 	}
 
 	/* Get what is available to send */
-	if (space > 0)
-		return rte_sched_port_dequeue(port, deq_pkts, space);
-	else
-		return 0;
+	if (space > 0) {
+		int n = rte_sched_port_dequeue(port, deq_pkts, space);
+
+		if (codel)
+			n = qos_codel(qinfo, codel, deq_pkts, n);
+		if (qinfo->latency_stats)
+			qos_latency_record(qinfo, shard, deq_pkts, n);
+		return n;
+	}
+	return 0;
 }
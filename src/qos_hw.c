@@ -11,6 +11,7 @@
 #include <rte_mbuf.h>
 #include <rte_red.h>
 #include <rte_sched.h>
+#include <rte_timer.h>
 #include "qos.h"
 #include "qos_obj_db.h"
 #include "json_writer.h"
@@ -152,313 +153,525 @@ void qos_hw_dscp_resgrp_json(struct sched_info *qinfo, uint32_t subport,
 
 /*
  * The order of the counter-ids in this array defines the order of the
- * returned counter values in the results array returned by the fal call:
- * fal_qos_get_queue_stats
+ * returned counter values in the results array returned by the fal calls:
+ * fal_qos_get_queues_stats and fal_qos_get_queue_stats
  */
-static uint32_t qos_subport_hw_counter_ids[] = {
+static uint32_t qos_queue_hw_counter_ids[] = {
 	FAL_QOS_QUEUE_STAT_PACKETS,
 	FAL_QOS_QUEUE_STAT_DROPPED_PACKETS,
 	FAL_QOS_QUEUE_STAT_BYTES,
-	FAL_QOS_QUEUE_STAT_DROPPED_BYTES
+	FAL_QOS_QUEUE_STAT_DROPPED_BYTES,
+	FAL_QOS_QUEUE_STAT_GREEN_DROPPED_PACKETS,
+	FAL_QOS_QUEUE_STAT_YELLOW_DROPPED_PACKETS,
+	FAL_QOS_QUEUE_STAT_RED_DROPPED_PACKETS
 };
 
-static int
-qos_hw_process_queue_stats(struct sched_info *qinfo, uint32_t subport,
-			   uint32_t pipe, uint32_t tc, uint32_t q,
-			   struct rte_sched_subport_stats64 *subport_stats)
+static uint32_t qos_queue_length_counter_ids[] = {
+	FAL_QOS_QUEUE_STAT_CURR_OCCUPANCY_BYTES
+};
+
+/*
+ * Queues read all of the first four counters, and one more for each
+ * WRED colour configured.
+ */
+#define QOS_HW_MIN_COUNTERS	4
+#define QOS_HW_MAX_COUNTERS	ARRAY_SIZE(qos_queue_hw_counter_ids)
+
+/*
+ * The hardware queue counters of a port are read together, with one
+ * bulk FAL call for each number of counters in use and one for the
+ * queue lengths, every QOS_HW_STATS_INTERVAL seconds from a timer on
+ * the master thread.  The shows and the telemetry read the snapshot
+ * this leaves, rather than going to the FAL for each queue, so it may
+ * be that much out of date.
+ */
+#define QOS_HW_STATS_INTERVAL	5	/* seconds */
+
+struct qos_hw_snap_queue {
+	fal_object_t	queue;
+	uint32_t	qid;
+	uint32_t	subport;
+	uint8_t		tc;
+	uint8_t		n_counters;
+	bool		wred;
+};
+
+struct qos_hw_snap {
+	bool		valid;		/* refreshed since the link came up */
+	uint32_t	n_queues;	/* entries in the by-qid arrays */
+	uint64_t	*qlen;		/* by qid, in bytes */
+	fal_object_t	*wred;		/* by qid, that n_counters is for */
+	uint8_t		*n_counters;	/* by qid, 0 if not known */
+	struct rte_sched_subport_stats64 *subport;
+
+	/* Scratch space for the bulk reads */
+	struct qos_hw_snap_queue *queues;
+	uint32_t	*index;
+	fal_object_t	*ids;
+	uint64_t	*values;
+	int		*results;
+};
+
+static struct rte_timer qos_hw_stats_timer;
+
+static void qos_hw_snap_free(struct sched_info *qinfo)
+{
+	struct qos_hw_snap *snap = qinfo->dev_info.fal.stats_snap;
+
+	if (!snap)
+		return;
+
+	free(snap->qlen);
+	free(snap->wred);
+	free(snap->n_counters);
+	free(snap->subport);
+	free(snap->queues);
+	free(snap->index);
+	free(snap->ids);
+	free(snap->values);
+	free(snap->results);
+	free(snap);
+	qinfo->dev_info.fal.stats_snap = NULL;
+}
+
+static struct qos_hw_snap *qos_hw_snap_alloc(struct sched_info *qinfo)
+{
+	struct qos_hw_snap *snap;
+	uint32_t n;
+
+	snap = calloc(1, sizeof(*snap));
+	if (!snap)
+		return NULL;
+	qinfo->dev_info.fal.stats_snap = snap;
+
+	n = qinfo->n_subports * qinfo->port_params.n_pipes_per_subport *
+		RTE_SCHED_QUEUES_PER_PIPE;
+	snap->n_queues = n;
+	snap->qlen = calloc(n, sizeof(*snap->qlen));
+	snap->wred = calloc(n, sizeof(*snap->wred));
+	snap->n_counters = calloc(n, sizeof(*snap->n_counters));
+	snap->subport = calloc(qinfo->n_subports, sizeof(*snap->subport));
+	snap->queues = calloc(n, sizeof(*snap->queues));
+	snap->index = calloc(n, sizeof(*snap->index));
+	snap->ids = calloc(n, sizeof(*snap->ids));
+	snap->values = calloc(n * QOS_HW_MAX_COUNTERS, sizeof(*snap->values));
+	snap->results = calloc(n, sizeof(*snap->results));
+
+	if (!snap->qlen || !snap->wred || !snap->n_counters ||
+	    !snap->subport || !snap->queues || !snap->index || !snap->ids ||
+	    !snap->values || !snap->results) {
+		qos_hw_snap_free(qinfo);
+		return NULL;
+	}
+	return snap;
+}
+
+/*
+ * The number of counters to read for a queue, depending on how many
+ * colours its WRED has.  WRED objects are only ever replaced, never
+ * changed, so this is looked up again only when the queue's changes.
+ */
+static uint8_t
+qos_hw_snap_n_counters(struct qos_hw_snap *snap, uint32_t qid,
+		       fal_object_t wred_id)
 {
+	uint8_t n_counters = QOS_HW_MIN_COUNTERS;
+	int ret;
+
+	if (snap->n_counters[qid] && snap->wred[qid] == wred_id)
+		return snap->n_counters[qid];
+
+	if (wred_id != FAL_QOS_NULL_OBJECT_ID) {
+		struct fal_attribute_t attr_list[] = {
+			{ .id = FAL_QOS_WRED_ATTR_GREEN_ENABLE,
+			  .value.booldata = 0 },
+			{ .id = FAL_QOS_WRED_ATTR_YELLOW_ENABLE,
+			  .value.booldata = 0 },
+			{ .id = FAL_QOS_WRED_ATTR_RED_ENABLE,
+			  .value.booldata = 0 },
+		};
+
+		ret = fal_qos_get_wred_attrs(wred_id, ARRAY_SIZE(attr_list),
+					     attr_list);
+		if (ret) {
+			DP_DEBUG(QOS, ERR, DATAPLANE,
+				 "FAL failed to get wred attributes, "
+				 "status: %d\n", ret);
+			return n_counters;
+		}
+		/*
+		 * Increase the number of counter-ids if coloured WRED is
+		 * configured
+		 */
+		n_counters += attr_list[0].value.booldata;
+		n_counters += attr_list[1].value.booldata;
+		n_counters += attr_list[2].value.booldata;
+	}
+
+	snap->wred[qid] = wred_id;
+	snap->n_counters[qid] = n_counters;
+	return n_counters;
+}
+
+static void
+qos_hw_snap_add_queue(struct sched_info *qinfo, struct qos_hw_snap *snap,
+		      uint32_t *count, uint32_t subport, uint32_t pipe,
+		      uint32_t tc, uint32_t q)
+{
+	uint32_t port_obj_id = qinfo->dev_info.fal.hw_port_id;
+	struct qos_hw_snap_queue *sq;
 	fal_object_t queue_id;
 	fal_object_t wred_id;
-	uint32_t port_obj_id;
-	uint64_t values[5];
 	uint32_t qid;
-	int ret = 0;
-
-	port_obj_id = qinfo->dev_info.fal.hw_port_id;
 
+	/*
+	 * We only create queue objects that have DSCP values assigned
+	 * to them and queue objects disappear temporarily during
+	 * link-flaps.
+	 */
 	queue_id = qos_hw_get_queue(port_obj_id, subport, pipe, tc, q);
-
 	if (queue_id == FAL_QOS_NULL_OBJECT_ID)
-		/*
-		 * We only create queue objects that have DSCP values assigned
-		 * to them and queue objects disappear temporarily during
-		 * link-flaps.
-		 */
-		return 0;
+		return;
+
+	qid = qos_sched_calc_qindex(qinfo, subport, pipe, tc, q);
+	if (qid >= snap->n_queues)
+		return;
 
 	wred_id = qos_hw_get_wred(port_obj_id, subport, pipe, tc, q);
+
+	sq = &snap->queues[(*count)++];
+	sq->queue = queue_id;
+	sq->qid = qid;
+	sq->subport = subport;
+	sq->tc = tc;
+	sq->wred = wred_id != FAL_QOS_NULL_OBJECT_ID;
+	sq->n_counters = qos_hw_snap_n_counters(snap, qid, wred_id);
+}
+
+/* Find the port's queues that are in the FAL */
+static uint32_t
+qos_hw_snap_gather(struct sched_info *qinfo, struct qos_hw_snap *snap)
+{
+	uint32_t subport, pipe, tc, q;
+	uint32_t count = 0;
+
+	for (subport = 0; subport < qinfo->n_subports; subport++)
+		for (pipe = 0; pipe < qinfo->n_pipes; pipe++)
+			for (tc = 0; tc < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE;
+			     tc++)
+				for (q = 0;
+				     q < RTE_SCHED_QUEUES_PER_TRAFFIC_CLASS;
+				     q++)
+					qos_hw_snap_add_queue(qinfo, snap,
+							      &count, subport,
+							      pipe, tc, q);
+	return count;
+}
+
+/*
+ * Update the platform agnostic counters of a queue from those read from
+ * the FAL, which are either the differences since the previous read or,
+ * where the platform can't read and clear, the absolute values.
+ */
+static void
+qos_hw_snap_update(struct sched_info *qinfo,
+		   const struct qos_hw_snap_queue *sq,
+		   const uint64_t *values, bool absolute)
+{
+	struct queue_stats *stats = qinfo->queue_stats + sq->qid;
+	uint32_t i;
+
+	rte_spinlock_lock(&qinfo->stats_lock);
+	if (absolute) {
+		stats->n_pkts = 0;
+		stats->n_pkts_dropped = 0;
+		stats->n_bytes = 0;
+		stats->n_bytes_dropped = 0;
+		if (sq->wred)
+			stats->n_pkts_red_dropped = 0;
+		for (i = 0; i < RTE_NUM_DSCP_MAPS; i++)
+			stats->n_pkts_red_dscp_dropped[i] = 0;
+	}
+
+	stats->n_pkts += values[0];
+	stats->n_pkts_dropped += values[1];
+	stats->n_bytes += values[2];
+	stats->n_bytes_dropped += values[3];
 	/*
-	 * The order of the counters returned by fal_qos_get_queue_stats_ext is
-	 * defined by the order of counter-ids in qos_subport_hw_counter_ids
+	 * 'red' isn't a packet-colour, but means 'wred'.  Some platforms
+	 * do not count tail-drops and wred-drops separately, when WRED is
+	 * configured they are wred-drops.
 	 */
-	ret = fal_qos_get_queue_stats_ext(queue_id,
-				      ARRAY_SIZE(qos_subport_hw_counter_ids),
-				      qos_subport_hw_counter_ids, true, values);
-	if (!ret) {
-		struct queue_stats *queue_stats;
+	if (sq->wred)
+		stats->n_pkts_red_dropped += values[1];
 
-		/*
-		 * Get the platform-agnostic queue counters block for the queue
-		 * in question.
-		 */
-		qid = qos_sched_calc_qindex(qinfo, subport, pipe, tc, q);
-		queue_stats = qinfo->queue_stats + qid;
+	/*
+	 * Get the coloured WRED drop counts
+	 */
+	for (i = QOS_HW_MIN_COUNTERS; i < sq->n_counters; i++)
+		stats->n_pkts_red_dscp_dropped[i - QOS_HW_MIN_COUNTERS] +=
+			values[i];
+	rte_spinlock_unlock(&qinfo->stats_lock);
+}
 
-		/*
-		 * Every time we read the FAL's queue counters, we just get
-		 * given the differences between the current read and the
-		 * previous one.  So whenever we read them, we must update the
-		 * platform agnostic queue counters.
-		 */
-		queue_stats->n_pkts += values[0];
-		queue_stats->n_pkts_dropped += values[1];
-		queue_stats->n_bytes += values[2];
-		queue_stats->n_bytes_dropped += values[3];
-		/*
-		 * 'red' isn't a packet-colour here, it means 'wred'.
-		 * Some platforms do not count tail-drops and wred-drops
-		 * separately, when WRED is configured they are wred-drops.
-		 */
-		if (wred_id != FAL_QOS_NULL_OBJECT_ID)
-			queue_stats->n_pkts_red_dropped += values[1];
+/* Read the counters of all the queues with the given number of them */
+static void
+qos_hw_snap_read_counters(struct sched_info *qinfo, struct qos_hw_snap *snap,
+			  uint32_t count, uint8_t n_counters)
+{
+	uint64_t values[QOS_HW_MAX_COUNTERS];
+	struct qos_hw_snap_queue *sq;
+	uint32_t i, n = 0;
+	int ret;
 
-		/*
-		 * Now we have updated the platform agnostic queue counters,
-		 * accumulate the subport's TC counters.  We must allow for
-		 * the queue counters having been cleared at some point in the
-		 * past.
-		 */
-		subport_stats->n_pkts_tc[tc] +=
-			(queue_stats->n_pkts - queue_stats->n_pkts_lc);
-		subport_stats->n_pkts_tc_dropped[tc] +=
-			(queue_stats->n_pkts_dropped -
-			 queue_stats->n_pkts_dropped_lc);
-		subport_stats->n_bytes_tc[tc] +=
-			(queue_stats->n_bytes - queue_stats->n_bytes_lc);
-		subport_stats->n_bytes_tc_dropped[tc] +=
-			(queue_stats->n_bytes_dropped -
-			 queue_stats->n_bytes_dropped_lc);
-		if (wred_id != FAL_QOS_NULL_OBJECT_ID)
-			subport_stats->n_pkts_red_dropped[tc] +=
-				(queue_stats->n_pkts_red_dropped -
-				 queue_stats->n_pkts_red_dropped_lc);
+	for (i = 0; i < count; i++) {
+		if (snap->queues[i].n_counters != n_counters)
+			continue;
+		snap->index[n] = i;
+		snap->ids[n++] = snap->queues[i].queue;
+	}
+	if (!n)
+		return;
+
+	memset(snap->values, 0, n * n_counters * sizeof(*snap->values));
+	ret = fal_qos_get_queues_stats(n, snap->ids, n_counters,
+				       qos_queue_hw_counter_ids, true,
+				       snap->values, snap->results);
+	if (ret && ret != -EOPNOTSUPP)
+		DP_DEBUG(QOS_HW, ERR, DATAPLANE,
+			 "FAL failed to get queue stats, status: %d\n", ret);
+
+	for (i = 0; i < n; i++) {
+		sq = &snap->queues[snap->index[i]];
+		if (!snap->results[i]) {
+			qos_hw_snap_update(qinfo, sq,
+					   snap->values + i * n_counters,
+					   false);
+		} else if (snap->results[i] == -EOPNOTSUPP) {
+			memset(values, 0, sizeof(values));
+			if (!fal_qos_get_queue_stats(sq->queue, n_counters,
+						     qos_queue_hw_counter_ids,
+						     values))
+				qos_hw_snap_update(qinfo, sq, values, true);
+		}
 	}
-	return ret;
 }
 
-int qos_hw_subport_read_stats(struct sched_info *qinfo, uint32_t subport,
-			      struct rte_sched_subport_stats64 *stats)
+/*
+ * The queue lengths are read without clearing, as an incremental
+ * version of the queue length doesn't make a lot of sense.
+ */
+static void
+qos_hw_snap_read_qlen(struct qos_hw_snap *snap, uint32_t count)
 {
-	struct rte_sched_subport_stats64 local_stats;
-	int ret = 0;
-	uint32_t pipe;
-	uint32_t tc;
-	uint32_t q;
+	struct qos_hw_snap_queue *sq;
+	uint64_t value;
+	uint32_t i;
+
+	memset(snap->qlen, 0, snap->n_queues * sizeof(*snap->qlen));
+	if (!count)
+		return;
+
+	for (i = 0; i < count; i++)
+		snap->ids[i] = snap->queues[i].queue;
+	memset(snap->values, 0, count * sizeof(*snap->values));
+	fal_qos_get_queues_stats(count, snap->ids,
+				 ARRAY_SIZE(qos_queue_length_counter_ids),
+				 qos_queue_length_counter_ids, false,
+				 snap->values, snap->results);
+
+	for (i = 0; i < count; i++) {
+		sq = &snap->queues[i];
+		if (!snap->results[i])
+			snap->qlen[sq->qid] = snap->values[i];
+		else if (snap->results[i] == -EOPNOTSUPP &&
+			 !fal_qos_get_queue_stats(
+				 sq->queue,
+				 ARRAY_SIZE(qos_queue_length_counter_ids),
+				 qos_queue_length_counter_ids, &value))
+			snap->qlen[sq->qid] = value;
+	}
+}
+
+/*
+ * The subports' TC counters are synthesized from those of their queues,
+ * allowing for the queue counters having been cleared at some point in
+ * the past.
+ */
+static void
+qos_hw_snap_sum_subports(struct sched_info *qinfo, struct qos_hw_snap *snap,
+			 uint32_t count)
+{
+	struct rte_sched_subport_stats64 *subport_stats;
+	const struct qos_hw_snap_queue *sq;
+	const struct queue_stats *qs;
+	uint32_t i;
+
+	memset(snap->subport, 0,
+	       qinfo->n_subports * sizeof(*snap->subport));
+
+	rte_spinlock_lock(&qinfo->stats_lock);
+	for (i = 0; i < count; i++) {
+		sq = &snap->queues[i];
+		qs = qinfo->queue_stats + sq->qid;
+		subport_stats = &snap->subport[sq->subport];
+
+		subport_stats->n_pkts_tc[sq->tc] +=
+			qs->n_pkts - qs->n_pkts_lc;
+		subport_stats->n_pkts_tc_dropped[sq->tc] +=
+			qs->n_pkts_dropped - qs->n_pkts_dropped_lc;
+		subport_stats->n_bytes_tc[sq->tc] +=
+			qs->n_bytes - qs->n_bytes_lc;
+		subport_stats->n_bytes_tc_dropped[sq->tc] +=
+			qs->n_bytes_dropped - qs->n_bytes_dropped_lc;
+		if (sq->wred)
+			subport_stats->n_pkts_red_dropped[sq->tc] +=
+				qs->n_pkts_red_dropped -
+				qs->n_pkts_red_dropped_lc;
+	}
+	rte_spinlock_unlock(&qinfo->stats_lock);
+}
+
+static int qos_hw_snap_refresh(struct sched_info *qinfo)
+{
+	struct qos_hw_snap *snap = qinfo->dev_info.fal.stats_snap;
+	uint8_t n_counters;
+	uint32_t count;
 
 	/*
-	 * If we have a qinfo, but no hw_port_sched_group, the link must have
-	 * gone down, so we won't be able to read the queue counters.
+	 * If we have a qinfo, but no hw_port_sched_group, the link must
+	 * have gone down, so we won't be able to read the queue counters.
 	 */
 	if (qinfo->dev_info.fal.hw_port_sched_group == FAL_QOS_NULL_OBJECT_ID)
 		return 0;
 
-	/*
-	 * Zero the local counters before we start accumulating in them.
-	 */
-	memset(&local_stats, 0, sizeof(local_stats));
-
-	for (pipe = 0; pipe <= qinfo->n_pipes; pipe++) {
-		for (tc = 0; tc < RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE; tc++) {
-			for (q = 0;
-			     !ret && q < RTE_SCHED_QUEUES_PER_TRAFFIC_CLASS;
-			     q++) {
-				ret = qos_hw_process_queue_stats(qinfo, subport,
-								 pipe, tc, q,
-								 &local_stats);
-			}
+	if (!snap) {
+		snap = qos_hw_snap_alloc(qinfo);
+		if (!snap) {
+			DP_DEBUG(QOS_HW, ERR, DATAPLANE,
+				 "out of memory for qos stats\n");
+			return -ENOMEM;
 		}
 	}
-	if (!ret) {
-		/*
-		 * Copy the accumulated values back into the dataplane's stats.
-		 */
-		rte_spinlock_lock(&qinfo->stats_lock);
-		memcpy(stats, &local_stats, sizeof(local_stats));
-		rte_spinlock_unlock(&qinfo->stats_lock);
-	}
 
+	count = qos_hw_snap_gather(qinfo, snap);
+	for (n_counters = QOS_HW_MIN_COUNTERS;
+	     n_counters <= QOS_HW_MAX_COUNTERS; n_counters++)
+		qos_hw_snap_read_counters(qinfo, snap, count, n_counters);
+	qos_hw_snap_read_qlen(snap, count);
+	qos_hw_snap_sum_subports(qinfo, snap, count);
+
+	snap->valid = true;
 	return 0;
 }
 
-int qos_hw_subport_clear_stats(struct sched_info *qinfo __unused,
-			       uint32_t subport __unused)
+/* The snapshot, taking it now if the timer hasn't yet */
+static struct qos_hw_snap *qos_hw_snap_get(struct sched_info *qinfo)
+{
+	struct qos_hw_snap *snap = qinfo->dev_info.fal.stats_snap;
+
+	if (snap && snap->valid)
+		return snap;
+
+	if (qos_hw_snap_refresh(qinfo) < 0)
+		return NULL;
+	return qinfo->dev_info.fal.stats_snap;
+}
+
+static void qos_hw_stats_refresh_if(struct ifnet *ifp, void *arg __unused)
 {
+	struct sched_info *qinfo = rcu_dereference(ifp->if_qos);
+
+	if (qinfo && qinfo->dev_id == QOS_HW_ID && QOS_CONFIGURED(qinfo))
+		qos_hw_snap_refresh(qinfo);
+}
+
+static void qos_hw_stats_timer_cb(struct rte_timer *timer __unused,
+				  void *arg __unused)
+{
+	ifnet_walk(qos_hw_stats_refresh_if, NULL);
+}
+
+static void qos_hw_stats_timer_start(void)
+{
+	static bool started;
+
+	if (started)
+		return;
+
+	rte_timer_init(&qos_hw_stats_timer);
+	rte_timer_reset(&qos_hw_stats_timer,
+			QOS_HW_STATS_INTERVAL * rte_get_timer_hz(),
+			PERIODICAL, rte_get_master_lcore(),
+			qos_hw_stats_timer_cb, NULL);
+	started = true;
+}
+
+int qos_hw_subport_read_stats(struct sched_info *qinfo, uint32_t subport,
+			      struct rte_sched_subport_stats64 *stats)
+{
+	struct qos_hw_snap *snap;
+
+	if (qinfo->dev_info.fal.hw_port_sched_group == FAL_QOS_NULL_OBJECT_ID)
+		return 0;
+
+	snap = qos_hw_snap_get(qinfo);
+	if (!snap)
+		return -ENOMEM;
+
 	/*
-	 * For the hardware-platforms we synthesize the subport
-	 * counters from the queue counters, so we have nothing to do
-	 * here.
+	 * Copy the accumulated values back into the dataplane's stats.
 	 */
+	rte_spinlock_lock(&qinfo->stats_lock);
+	memcpy(stats, &snap->subport[subport], sizeof(*stats));
+	rte_spinlock_unlock(&qinfo->stats_lock);
+
 	return 0;
 }
 
-/*
- * The order of the counter-ids in this array defines the order of the
- * returned counter values in the results array returned by the fal call:
- * fal_qos_get_queue_stats_ext
- */
-static uint32_t qos_queue_hw_counter_ids[] = {
-	FAL_QOS_QUEUE_STAT_PACKETS,
-	FAL_QOS_QUEUE_STAT_DROPPED_PACKETS,
-	FAL_QOS_QUEUE_STAT_BYTES,
-	FAL_QOS_QUEUE_STAT_DROPPED_BYTES,
-	FAL_QOS_QUEUE_STAT_GREEN_DROPPED_PACKETS,
-	FAL_QOS_QUEUE_STAT_YELLOW_DROPPED_PACKETS,
-	FAL_QOS_QUEUE_STAT_RED_DROPPED_PACKETS
-};
-
-static uint32_t qos_queue_length_counter_ids[] = {
-	FAL_QOS_QUEUE_STAT_CURR_OCCUPANCY_BYTES
-};
+int qos_hw_subport_clear_stats(struct sched_info *qinfo,
+			       uint32_t subport __unused)
+{
+	/*
+	 * For the hardware-platforms we synthesize the subport
+	 * counters from the queue counters, so we have nothing to
+	 * clear here.  But bring the queue counters up to date, so
+	 * that clearing them next doesn't leave what was counted
+	 * since the last refresh to be counted after the clear.
+	 */
+	return qos_hw_snap_refresh(qinfo);
+}
 
 int qos_hw_queue_read_stats(struct sched_info *qinfo, uint32_t subport,
 			    uint32_t pipe, uint32_t tc, uint32_t q,
-			    struct queue_stats *stats,
+			    struct queue_stats *stats __unused,
 			    uint64_t *qlen, bool *qlen_in_pkts)
 {
-	int ret = -1;
-	uint64_t values[9] = { 0 };
-	uint32_t port_obj_id;
-	fal_object_t queue_id;
+	struct qos_hw_snap *snap;
+	uint32_t qid;
 
 	/*
 	 * Currently all the hardware platforms that support QoS return
 	 * queue-length in bytes.
 	 */
 	*qlen_in_pkts = false;
+	*qlen = 0;
 
-	port_obj_id = qinfo->dev_info.fal.hw_port_id;
-	queue_id = qos_hw_get_queue(port_obj_id, subport, pipe, tc, q);
-	if (queue_id == FAL_QOS_NULL_OBJECT_ID) {
-		/*
-		 * We only populate the FAL with queues that are being used.
-		 * The queues also disappears when a link flaps.
-		 * In both cases don't update the stats, just return success.
-		 */
-		*qlen = 0;
-		ret = 0;
-	} else {
-		/*
-		 * Find out if this queue has WRED configured and if so
-		 * how many colours are configured.
-		 */
-		fal_object_t wred_id;
-		uint32_t counter_ids = 4;
-
-		wred_id = qos_hw_get_wred(port_obj_id, subport, pipe, tc, q);
-		if (wred_id != FAL_QOS_NULL_OBJECT_ID) {
-			struct fal_attribute_t attr_list[] = {
-				{ .id = FAL_QOS_WRED_ATTR_GREEN_ENABLE,
-				  .value.booldata = 0 },
-				{ .id = FAL_QOS_WRED_ATTR_YELLOW_ENABLE,
-				  .value.booldata = 0 },
-				{ .id = FAL_QOS_WRED_ATTR_RED_ENABLE,
-				  .value.booldata = 0 },
-			};
-
-			ret = fal_qos_get_wred_attrs(wred_id,
-						     ARRAY_SIZE(attr_list),
-						     attr_list);
-			if (ret) {
-				DP_DEBUG(QOS, ERR, DATAPLANE,
-					 "FAL failed to get wred attributes, "
-					 "status: %d\n",
-					 ret);
-			} else {
-				/*
-				 * Increase the number of counter-ids if
-				 * coloured WRED is configured
-				 */
-				counter_ids += attr_list[0].value.booldata;
-				counter_ids += attr_list[1].value.booldata;
-				counter_ids += attr_list[2].value.booldata;
-			}
-
-		}
-		ret = fal_qos_get_queue_stats_ext(queue_id, counter_ids,
-						  qos_queue_hw_counter_ids,
-						  true, values);
-		if (!ret) {
-			rte_spinlock_lock(&qinfo->stats_lock);
-
-			stats->n_pkts += values[0];
-			stats->n_pkts_dropped += values[1];
-			stats->n_bytes += values[2];
-			stats->n_bytes_dropped += values[3];
-			/*
-			 * 'red' isn't a packet-colour, but means 'wred'
-			 * Some platforms do not count tail-drops and
-			 * wred-drops separately, when WRED is configured
-			 * they are wred-drops.
-			 */
-			if (counter_ids > 4)
-				stats->n_pkts_red_dropped += values[1];
-
-			/*
-			 * Get the coloured WRED drop counts
-			 */
-			stats->n_pkts_red_dscp_dropped[0] += values[4];
-			stats->n_pkts_red_dscp_dropped[1] += values[5];
-			stats->n_pkts_red_dscp_dropped[2] += values[6];
-			rte_spinlock_unlock(&qinfo->stats_lock);
-		} else if (ret == -EOPNOTSUPP) {
-			ret = fal_qos_get_queue_stats(queue_id, counter_ids,
-						      qos_queue_hw_counter_ids,
-						      values);
-			if (!ret) {
-				rte_spinlock_lock(&qinfo->stats_lock);
-
-				stats->n_pkts = values[0];
-				stats->n_pkts_dropped = values[1];
-				stats->n_bytes = values[2];
-				stats->n_bytes_dropped = values[3];
-
-				/*
-				 * 'red' isn't a packet-colour, but means 'wred'
-				 * Some platforms do not count tail-drops
-				 * and wred-drops separately, when WRED is
-				 * configured they are wred-drops.
-				 */
-				if (counter_ids > 4)
-					stats->n_pkts_red_dropped = values[1];
-
-				/*
-				 * Get the coloured WRED drop counts
-				 */
-				stats->n_pkts_red_dscp_dropped[0] = values[4];
-				stats->n_pkts_red_dscp_dropped[1] = values[5];
-				stats->n_pkts_red_dscp_dropped[2] = values[6];
-				rte_spinlock_unlock(&qinfo->stats_lock);
-			}
-		}
+	/*
+	 * The counters of the queue, kept in qinfo->queue_stats, are
+	 * already as up to date as the snapshot.
+	 */
+	if (qinfo->dev_info.fal.hw_port_sched_group == FAL_QOS_NULL_OBJECT_ID)
+		return 0;
 
-		/*
-		 * Finally try to get the current queue length.  This call
-		 * will have to remain separate from the other get-queue-stats
-		 * calls as an incremental version of the queue length doesn't
-		 * make a lot of sense.
-		 */
-		ret = fal_qos_get_queue_stats(queue_id, 1,
-					      qos_queue_length_counter_ids,
-					      values);
-		if (ret) {
-			*qlen = 0;
-			ret = 0;
-		} else {
-			*qlen = values[0];
-		}
-	}
+	snap = qos_hw_snap_get(qinfo);
+	if (!snap)
+		return -ENOMEM;
 
-	return ret;
+	qid = qos_sched_calc_qindex(qinfo, subport, pipe, tc, q);
+	if (qid < snap->n_queues)
+		*qlen = snap->qlen[qid];
+	return 0;
 }
 
 int qos_hw_queue_clear_stats(struct sched_info *qinfo, uint32_t subport,
@@ -492,9 +705,11 @@ int qos_hw_queue_clear_stats(struct sched_info *qinfo, uint32_t subport,
 	return rv;
 }
 
-void qos_hw_free(__unused struct sched_info *qinfo)
+void qos_hw_free(struct sched_info *qinfo)
 {
 	DP_DEBUG(QOS_HW, DEBUG, DATAPLANE, "%s\n", __func__);
+
+	qos_hw_snap_free(qinfo);
 }
 
 int qos_hw_port(struct ifnet *ifp, unsigned int subports, unsigned int pipes,
@@ -529,6 +744,7 @@ int qos_hw_port(struct ifnet *ifp, unsigned int subports, unsigned int pipes,
 
 	qinfo->dev_id = QOS_HW_ID;
 	ifp->if_qos = qinfo;
+	qos_hw_stats_timer_start();
 	DP_DEBUG(QOS_HW, DEBUG, DATAPLANE,
 		 "ifp %s hardware forwarding enabled\n", ifp->if_name);
 
@@ -617,6 +833,7 @@ int qos_hw_stop(struct ifnet *ifp, struct sched_info *qinfo)
 		 */
 		qinfo->dev_info.fal.hw_port_sched_group =
 			FAL_QOS_NULL_OBJECT_ID;
+		qos_hw_snap_free(qinfo);
 	}
 	return 0;
 }
@@ -258,6 +258,7 @@ static void qos_subport_free(struct sched_info *qinfo)
 		struct subport_info *sinfo = qinfo->subport + i;
 
 		free(sinfo->profile_map);
+		free(sinfo->latency);
 	}
 	free(qinfo->subport);
 }
@@ -294,6 +295,9 @@ void qos_sched_free(struct sched_info *qinfo)
 
 	free(qinfo->queue_map);
 	free(qinfo->queue_stats);
+	free(qinfo->codel);
+	if (qinfo->reconfig)
+		qos_sched_free(qinfo->reconfig);
 	QOS_FREE(qinfo)(qinfo);
 	free(qinfo);
 }
@@ -515,7 +519,12 @@ void qos_sched_subport_params_check(
  */
 int qos_sched_start(struct ifnet *ifp, uint64_t speed)
 {
-	struct sched_info *qinfo = ifp->if_qos;
+	return qos_sched_start_qinfo(ifp, ifp->if_qos, speed);
+}
+
+int qos_sched_start_qinfo(struct ifnet *ifp, struct sched_info *qinfo,
+			  uint64_t speed)
+{
 	uint32_t bps;
 	uint16_t max_pkt_len;
 
@@ -571,6 +580,53 @@ void qos_sched_stop(struct ifnet *ifp)
 }
 
 /* Operational mode display functions */
+
+/*
+ * Show a log2 histogram since it was last cleared, along with the
+ * 50th, 90th and 99th percentiles.  A percentile is given as the top of
+ * the bucket it falls in, so is an upper bound.
+ */
+static void qos_show_histogram(json_writer_t *wr, const char *name,
+			       const uint64_t *counts, const uint64_t *lc,
+			       unsigned int n_buckets)
+{
+	static const unsigned int pct[] = { 50, 90, 99 };
+	uint64_t total = 0, sum = 0;
+	unsigned int i, p = 0;
+	char pname[16];
+
+	jsonw_name(wr, name);
+	jsonw_start_object(wr);
+	jsonw_name(wr, "buckets");
+	jsonw_start_array(wr);
+	for (i = 0; i < n_buckets; i++) {
+		jsonw_uint(wr, counts[i] - lc[i]);
+		total += counts[i] - lc[i];
+	}
+	jsonw_end_array(wr);
+
+	for (i = 0; i < n_buckets && total && p < ARRAY_SIZE(pct); i++) {
+		sum += counts[i] - lc[i];
+		while (p < ARRAY_SIZE(pct) && sum * 100 >= total * pct[p]) {
+			snprintf(pname, sizeof(pname), "p%u", pct[p++]);
+			jsonw_uint_field(wr, pname, (UINT64_C(1) << i) - 1);
+		}
+	}
+	jsonw_end_object(wr);
+}
+
+static void qos_show_latency(json_writer_t *wr,
+			     const struct qos_latency *lat, unsigned int tc)
+{
+	jsonw_name(wr, "latency");
+	jsonw_start_object(wr);
+	qos_show_histogram(wr, "sojourn-us", lat->tc[tc].sojourn,
+			   lat->tc_lc[tc].sojourn, QOS_LAT_BUCKETS);
+	qos_show_histogram(wr, "qlen", lat->tc[tc].qlen,
+			   lat->tc_lc[tc].qlen, QOS_QLEN_BUCKETS);
+	jsonw_end_object(wr);
+}
+
 static void qos_show_subport(json_writer_t *wr,
 			     struct sched_info *qinfo,
 			     uint32_t subport)
@@ -609,6 +665,8 @@ static void qos_show_subport(json_writer_t *wr,
 		jsonw_uint_field(wr, "bytes", bytes);
 		jsonw_uint_field(wr, "dropped", dropped);
 		jsonw_uint_field(wr, "random_drop", random_drop);
+		if (sinfo->latency)
+			qos_show_latency(wr, sinfo->latency, i);
 		jsonw_end_object(wr);
 	}
 	rte_spinlock_unlock(&qinfo->stats_lock);
@@ -778,6 +836,7 @@ static void qos_show_stats(json_writer_t *wr, struct sched_info *qinfo,
 			uint64_t bytes;
 			uint64_t dropped;
 			uint64_t random_drop;
+			uint64_t codel_drop;
 			uint64_t random_dscp_drop[RTE_NUM_DSCP_MAPS];
 
 			/*
@@ -792,6 +851,8 @@ static void qos_show_stats(json_writer_t *wr, struct sched_info *qinfo,
 				queue_stats->n_pkts_dropped_lc;
 			random_drop = queue_stats->n_pkts_red_dropped -
 				queue_stats->n_pkts_red_dropped_lc;
+			codel_drop = queue_stats->n_pkts_codel_dropped -
+				queue_stats->n_pkts_codel_dropped_lc;
 			qos_do_random_dscp_stats(random_dscp_drop,
 						 queue_stats);
 
@@ -801,6 +862,10 @@ static void qos_show_stats(json_writer_t *wr, struct sched_info *qinfo,
 			jsonw_uint_field(wr, "bytes", bytes);
 			jsonw_uint_field(wr, "dropped", dropped);
 			jsonw_uint_field(wr, "random_drop", random_drop);
+			if (qinfo->wred_profiles[profile].queue_wred[
+				    tc * RTE_SCHED_QUEUES_PER_TRAFFIC_CLASS +
+				    q].codel_target)
+				jsonw_uint_field(wr, "codel_drop", codel_drop);
 
 			QOS_DSCP_RESGRP_JSON(qinfo)(qinfo, subport, pipe, tc, q,
 						    random_dscp_drop, wr);
@@ -1156,6 +1221,10 @@ static void qos_clear_subport_stats(struct sched_info *qinfo, uint32_t subport)
 	if (rlset)
 		npf_clear_stats(rlset, NPF_RULE_CLASS_COUNT, NULL, 0);
 
+	if (sinfo->latency)
+		memcpy(sinfo->latency->tc_lc, sinfo->latency->tc,
+		       sizeof(sinfo->latency->tc_lc));
+
 	for (pipe = 0; pipe < qinfo->n_pipes; pipe++)
 		qos_clear_pipe_stats(qinfo, subport, pipe);
 }
@@ -1357,20 +1426,25 @@ static int cmd_qos_obj_db(FILE *f)
 
 static int cmd_qos_port(struct ifnet *ifp, int argc, char **argv)
 {
-	unsigned int subports = 0, pipes = 0, profiles = 1;
+	unsigned int subports = 0, pipes = 0, profiles = 1, shards = 1;
+	bool fwd_classify = false, latency_stats = false;
 	int32_t overhead = RTE_SCHED_FRAME_OVERHEAD_DEFAULT;
 	int ret;
 
 	/*
 	 * Expected command format:
 	 *
-	 * "port <a> subports <b> pipes <c> profiles <d> [overhead <e>]"
+	 * "port <a> subports <b> pipes <c> profiles <d> [overhead <e>]
+	 *  [shards <f>] [fwd-classify <g>] [latency-stats <h>]"
 	 *
 	 * <a> - port-id
 	 * <b> - number of configured subports
 	 * <c> - number of configured pipes
 	 * <d> - number of configured profiles
 	 * <e> - frame-overhead
+	 * <f> - number of schedulers, and tx lcores, to spread subports over
+	 * <g> - 1 to classify on the forwarding lcores, not the tx lcore
+	 * <h> - 1 to keep per TC queueing delay and depth histograms
 	 */
 	--argc, ++argv;	/* skip "port" */
 	while (argc > 0) {
@@ -1404,6 +1478,12 @@ static int cmd_qos_port(struct ifnet *ifp, int argc, char **argv)
 				pipes = value;
 			else if (strcmp(argv[0], "profiles") == 0)
 				profiles = value;
+			else if (strcmp(argv[0], "shards") == 0)
+				shards = value;
+			else if (strcmp(argv[0], "fwd-classify") == 0)
+				fwd_classify = value;
+			else if (strcmp(argv[0], "latency-stats") == 0)
+				latency_stats = value;
 			else {
 				DP_DEBUG(QOS, ERR, DATAPLANE,
 					 "unknown port parameter: '%s'\n",
@@ -1420,12 +1500,19 @@ static int cmd_qos_port(struct ifnet *ifp, int argc, char **argv)
 		return -EINVAL;
 	}
 
+	if (shards == 0 || shards > QOS_SHARDS_MAX) {
+		DP_DEBUG(QOS, ERR, DATAPLANE,
+			 "bad shards value: %u\n", shards);
+		return -EINVAL;
+	}
+
 	/*
 	 * ENODEV means there's no hardware support for this device
 	 */
 	ret = qos_hw_port(ifp, subports, pipes, profiles, overhead);
 	if (ret == -ENODEV)
-		return qos_dpdk_port(ifp, subports, pipes, profiles, overhead);
+		return qos_dpdk_port(ifp, subports, pipes, profiles, overhead,
+				     shards, fwd_classify, latency_stats);
 
 
 	return ret;
@@ -1503,7 +1590,7 @@ static int cmd_qos_subport_queue(struct subport_info *sinfo, unsigned int qid,
 /* Per VLAN QoS characteristics */
 static int cmd_qos_subport(struct ifnet *ifp, int argc, char **argv)
 {
-	struct sched_info *qinfo = ifp->if_qos;
+	struct sched_info *qinfo = qos_cfg_info(ifp);
 	unsigned int subport;
 
 	if (!qinfo) {
@@ -1593,7 +1680,7 @@ static int cmd_qos_subport(struct ifnet *ifp, int argc, char **argv)
 				params->tb_rate =
 				       qos_rate_set(&sinfo->subport_rate,
 						value, true,
-						ifp->if_qos->port_params.rate);
+						qinfo->port_params.rate);
 			} else if (strcmp(argv[0], "size") == 0) {
 				/* credits (bytes) */
 				params->tb_size = sinfo->subport_rate.burst =
@@ -1620,7 +1707,7 @@ static int cmd_qos_subport(struct ifnet *ifp, int argc, char **argv)
 
 static int cmd_qos_pipe(struct ifnet *ifp, int argc, char **argv)
 {
-	struct sched_info *qinfo = ifp->if_qos;
+	struct sched_info *qinfo = qos_cfg_info(ifp);
 	unsigned int pipe, subport, profile;
 
 	if (!qinfo) {
@@ -1707,6 +1794,7 @@ static int cmd_qos_profile_queue(struct sched_info *qinfo, unsigned int profile,
 	 * "queue <d> wrr-weight <e>"
 	 * "queue <d> dscp-group <f> <g> <h> <i>"
 	 * "queue <d> wred-weight <j>"
+	 * "queue <d> codel <l> <m>"
 	 *
 	 * <a> - traffic-class-id (0..3)
 	 * <b> - traffic-class shaper bandwidth rate
@@ -1719,6 +1807,8 @@ static int cmd_qos_profile_queue(struct sched_info *qinfo, unsigned int profile,
 	 * <i> - wred mark probability (1..255)
 	 * <j> - wred filter weight (1..12)
 	 * <k> - traffic-class shaper percentage bandwidth rate
+	 * <l> - codel target sojourn time in usecs, 0 to disable
+	 * <m> - codel interval in usecs
 	 */
 	struct rte_sched_pipe_params *pipe
 		= qinfo->port_params.pipe_profiles + profile;
@@ -1919,6 +2009,22 @@ static int cmd_qos_profile_queue(struct sched_info *qinfo, unsigned int profile,
 			 */
 			queue_wred->filter_weight = wred_weight;
 		}
+	} else if (strcmp(argv[2], "codel") == 0) {
+		unsigned int target, interval;
+		struct queue_wred_info *queue_wred;
+
+		if (argc < 5 || get_unsigned(argv[3], &target) < 0 ||
+		    get_unsigned(argv[4], &interval) < 0 ||
+		    (target && interval < target)) {
+			DP_DEBUG(QOS, ERR, DATAPLANE,
+				 "Invalid per queue codel input\n");
+			return -EINVAL;
+		}
+
+		queue_wred = &qinfo->wred_profiles[profile].queue_wred[
+			q_from_mask(value)];
+		queue_wred->codel_target = target;
+		queue_wred->codel_interval = interval;
 	} else {
 		DP_DEBUG(QOS, ERR, DATAPLANE,
 			 "unknown profile queue parameter: '%s'\n", argv[2]);
@@ -1929,7 +2035,7 @@ static int cmd_qos_profile_queue(struct sched_info *qinfo, unsigned int profile,
 
 static int cmd_qos_profile(struct ifnet *ifp, int argc, char **argv)
 {
-	struct sched_info *qinfo = ifp->if_qos;
+	struct sched_info *qinfo = qos_cfg_info(ifp);
 	unsigned int profile;
 
 	if (!qinfo) {
@@ -2101,7 +2207,7 @@ static int cmd_qos_profile(struct ifnet *ifp, int argc, char **argv)
 
 static int cmd_qos_vlan(struct ifnet *ifp, int argc, char **argv)
 {
-	struct sched_info *qinfo = ifp->if_qos;
+	struct sched_info *qinfo = qos_cfg_info(ifp);
 	unsigned int tci, subport;
 
 	if (!qinfo) {
@@ -2143,7 +2249,7 @@ static int cmd_qos_vlan(struct ifnet *ifp, int argc, char **argv)
 /* process "qos IF match SUBPORT CLASS proto P from ... to ... */
 static int cmd_qos_match(struct ifnet *ifp, int argc, char **argv)
 {
-	struct sched_info *qinfo = ifp->if_qos;
+	struct sched_info *qinfo = qos_cfg_info(ifp);
 	unsigned int i, pipe;
 
 	if (!qinfo) {
@@ -2257,7 +2363,7 @@ static int cmd_qos_red(struct rte_red_params red_params[][e_RTE_METER_COLORS],
 /* at port level, allow per traffic class parameters */
 static int cmd_qos_params(struct ifnet *ifp, int argc, char **argv)
 {
-	struct sched_info *qinfo = ifp->if_qos;
+	struct sched_info *qinfo = qos_cfg_info(ifp);
 	unsigned int subport_id = 0;
 	unsigned int tc_id;
 
@@ -2394,7 +2500,7 @@ static int cmd_qos_disable(struct ifnet *ifp,
 static int cmd_qos_enable(struct ifnet *ifp,
 			  int argc __unused, char **argv __unused)
 {
-	struct sched_info *qinfo = ifp->if_qos;
+	struct sched_info *qinfo = qos_cfg_info(ifp);
 
 	/*
 	 * Expected command format:
@@ -2648,7 +2754,7 @@ struct subport_info *qos_get_subport(const char *name, struct ifnet **ifp)
 	subport_str = qos_extract_attachpoint(name, ifp);
 	if (!(*ifp) || !subport_str)
 		return NULL;
-	qinfo = (*ifp)->if_qos;
+	qinfo = qos_cfg_info(*ifp);
 	if (!qinfo)
 		return NULL;
 	index = atoi(subport_str);
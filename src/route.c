@@ -35,6 +35,7 @@
 #include "compiler.h"
 #include "compat.h"
 #include "dp_event.h"
+#include "dp_mem.h"
 #include "ecmp.h"
 #include "fal.h"
 #include "if_var.h"
@@ -88,6 +89,7 @@ struct next_hop_u {
 	uint8_t              proto;	/* routing protocol */
 	uint32_t             index;
 	uint32_t             refcount;	/* # of LPM's referring */
+	uint16_t             *buckets;	/* resilient hash table, ECMP only */
 	struct next_hop      hop0;      /* optimization for non-ECMP */
 	struct cds_lfht_node nh_node;
 	enum pd_obj_state    pd_state;
@@ -372,7 +374,8 @@ static int rt_lpm_resize(struct route_head *rt_head, uint32_t id)
 	if (id < rt_head->rt_rtm_max)
 		return 0;
 
-	new_tbl = malloc_huge_aligned((id + 1) * sizeof(struct lpm *));
+	new_tbl = dp_mem_huge_alloc(DP_MEM_LPM,
+				    (id + 1) * sizeof(struct lpm *));
 	if (new_tbl == NULL) {
 		RTE_LOG(ERR, ROUTE,
 			"Can't grow LPM table to %u entries\n", id);
@@ -390,8 +393,8 @@ static int rt_lpm_resize(struct route_head *rt_head, uint32_t id)
 	rt_head->rt_rtm_max = id + 1;
 
 	if (old_tbl) {
-		if (defer_rcu_huge(old_tbl,
-				   (old_id * sizeof(struct lpm *)))) {
+		if (dp_mem_huge_defer_free(DP_MEM_LPM, old_tbl,
+					   (old_id * sizeof(struct lpm *)))) {
 			RTE_LOG(ERR, LPM, "Failed to free old LPM tbl\n");
 			return -1;
 		}
@@ -572,18 +575,21 @@ static struct lpm *rt_get_lpm(struct route_head *rt_head, uint32_t id)
 
 static struct next_hop *nexthop_mp_select(struct next_hop *next,
 					  uint32_t size,
-					  uint32_t hash)
+					  uint32_t hash,
+					  const uint16_t *buckets)
 {
 	uint16_t path;
 
-	if (ecmp_max_path && ecmp_max_path < size)
+	if (ecmp_max_path && ecmp_max_path < size) {
 		size = ecmp_max_path;
+		buckets = NULL;
+	}
 
-	path = ecmp_lookup(size, hash);
-	if (unlikely(next[path].flags & RTF_DEAD)) {
+	path = ecmp_lookup(size, hash, buckets);
+	if (unlikely(next[path].flags & (RTF_DEAD | RTF_LINKDOWN))) {
 		/* retry to find a good path */
 		for (path = 0; path < size; path++) {
-			if (!(next[path].flags & RTF_DEAD))
+			if (!(next[path].flags & (RTF_DEAD | RTF_LINKDOWN)))
 				break;
 		}
 
@@ -614,7 +620,8 @@ inline struct next_hop *nexthop_select(uint32_t nh_idx,
 	if (likely(size == 1))
 		return next;
 
-	return nexthop_mp_select(next, size, ecmp_mbuf_hash(m, ether_type));
+	return nexthop_mp_select(next, size, ecmp_mbuf_hash(m, ether_type),
+				 nextu->buckets);
 }
 
 struct next_hop *nexthop_get(uint32_t nh_idx, uint8_t *size)
@@ -682,6 +689,45 @@ struct next_hop *rt_lookup_fast(struct vrf *vrf, in_addr_t dst,
 	return nh;
 }
 
+/*
+ * Lookup nexthops for a vector of destination addresses sharing the
+ * same VRF and table, overlapping the LPM cache misses.
+ *
+ * Assumes both the VRF ID is valid and the VRF exists.
+ *
+ * Fills nh with RCU protected nexthop structures or NULL.
+ */
+void rt_lookup_fast_bulk(struct vrf *vrf, const in_addr_t *dst,
+			 uint32_t tblid, struct rte_mbuf * const *m,
+			 struct next_hop **nh, unsigned int n)
+{
+	uint32_t ips[LPM_LOOKUP_BULK_MAX];
+	uint32_t idx[LPM_LOOKUP_BULK_MAX];
+	uint64_t hit_mask;
+	struct lpm *lpm;
+	unsigned int i;
+
+	assert(n <= LPM_LOOKUP_BULK_MAX);
+
+	lpm = rcu_dereference(vrf->v_rt4_head.rt_table[tblid]);
+
+	for (i = 0; i < n; i++)
+		ips[i] = ntohl(dst[i]);
+
+	hit_mask = lpm_lookup_bulk(lpm, ips, idx, n);
+
+	for (i = 0; i < n; i++) {
+		if (unlikely(!(hit_mask & (1ull << i)))) {
+			nh[i] = NULL;
+			continue;
+		}
+
+		nh[i] = nexthop_select(idx[i], m[i], ETHER_TYPE_IPv4);
+		if (nh[i] && unlikely(nh[i]->flags & RTF_NOROUTE))
+			nh[i] = NULL;
+	}
+}
+
 inline bool is_local_ipv4(vrfid_t vrf_id, in_addr_t dst)
 {
 	struct vrf *vrf = vrf_get_rcu(vrf_id);
@@ -830,6 +876,18 @@ nexthop_hash_insert(struct next_hop_u *nu,
 	return (ret_node != &nu->nh_node) ? EEXIST : 0;
 }
 
+/* Memory accounted to a nexthop with the given number of paths */
+static size_t nexthop_mem_size(unsigned int size)
+{
+	const struct next_hop_u *nextu = NULL;
+	size_t sz = sizeof(*nextu) + size * sizeof(*nextu->nh_fal_obj);
+
+	if (size > 1)
+		sz += size * sizeof(struct next_hop) +
+			ECMP_BUCKETS * sizeof(*nextu->buckets);
+	return sz;
+}
+
 static struct next_hop_u *nexthop_alloc(int size)
 {
 	struct next_hop_u *nextu;
@@ -851,16 +909,39 @@ static struct next_hop_u *nexthop_alloc(int size)
 		nextu->siblings = &nextu->hop0;
 	} else {
 		nextu->siblings = calloc(1, size * sizeof(struct next_hop));
-		if (unlikely(nextu->siblings == NULL)) {
+		nextu->buckets = calloc(ECMP_BUCKETS, sizeof(*nextu->buckets));
+		if (unlikely(!nextu->siblings || !nextu->buckets)) {
+			free(nextu->buckets);
+			free(nextu->siblings);
 			free(nextu->nh_fal_obj);
 			free(nextu);
 			return NULL;
 		}
 	}
 	nextu->nsiblings = size;
+	dp_mem_account_alloc(DP_MEM_NEXTHOP, nexthop_mem_size(size));
 	return nextu;
 }
 
+static void nexthop_buckets_init(struct next_hop_u *nextu)
+{
+	uint32_t path_ids[nextu->nsiblings];
+	const struct ifnet *ifp;
+	unsigned int i;
+
+	if (!nextu->buckets)
+		return;
+
+	for (i = 0; i < nextu->nsiblings; i++) {
+		const struct next_hop *nh = nextu->siblings + i;
+
+		ifp = nh4_get_ifp(nh);
+		path_ids[i] = rte_jhash_2words(nh->gateway,
+					       ifp ? ifp->if_index : 0, 0);
+	}
+	ecmp_buckets_fill(nextu->buckets, path_ids, nextu->nsiblings);
+}
+
 static void __nexthop_destroy(struct next_hop_u *nextu)
 {
 	unsigned int i;
@@ -870,7 +951,10 @@ static void __nexthop_destroy(struct next_hop_u *nextu)
 	if (nextu->siblings != &nextu->hop0)
 		free(nextu->siblings);
 
+	free(nextu->buckets);
 	free(nextu->nh_fal_obj);
+	dp_mem_account_free(DP_MEM_NEXTHOP,
+			    nexthop_mem_size(nextu->nsiblings));
 	free(nextu);
 }
 
@@ -963,6 +1047,7 @@ int nexthop_new(const struct next_hop *nh, uint16_t size, uint8_t proto,
 		nextu->hop0 = *nh;
 	} else {
 		memcpy(nextu->siblings, nh, size * sizeof(struct next_hop));
+		nexthop_buckets_init(nextu);
 	}
 	if (unlikely(nexthop_hash_insert(nextu, &key))) {
 		__nexthop_destroy(nextu);
@@ -1265,6 +1350,9 @@ route_nh_replace(struct next_hop_u *nextu, uint32_t nh_idx, struct llentry *lle,
 	new_nextu->nhg_fal_obj = nextu->nhg_fal_obj;
 	memcpy(new_nextu->nh_fal_obj, nextu->nh_fal_obj,
 	       new_nextu->nsiblings * sizeof(*new_nextu->nh_fal_obj));
+	if (new_nextu->buckets)
+		memcpy(new_nextu->buckets, nextu->buckets,
+		       ECMP_BUCKETS * sizeof(*new_nextu->buckets));
 
 	assert(nh_tbl.entry[nh_idx] == nextu);
 	rcu_xchg_pointer(&nh_tbl.entry[nh_idx], new_nextu);
@@ -1352,10 +1440,27 @@ static void subtree_walk_route_cleanup_cb(struct lpm *lpm,
 	nexthop_put(idx);
 }
 
+/* Prefix, in host order, whose neighbours need relinking */
+struct lle_relink_arg {
+	uint32_t ip;
+	uint8_t depth;
+};
+
 static unsigned int lle_routing_insert_arp_cb(struct lltable *llt __unused,
 					  struct llentry *lle,
-					  void *arg __unused)
+					  void *arg)
 {
+	const struct lle_relink_arg *prefix = arg;
+	const struct in_addr *addr = ll_ipv4_addr(lle);
+	uint32_t mask = prefix->depth ? ~0u << (32 - prefix->depth) : 0;
+
+	/*
+	 * Only neighbours inside the changed prefix can have their /32
+	 * or its cover affected, so skip the rest without the lookups.
+	 */
+	if (!addr || ((ntohl(addr->s_addr) ^ prefix->ip) & mask))
+		return 0;
+
 	pthread_mutex_unlock(&route_mutex);
 	routing_insert_arp_safe(lle, false);
 	pthread_mutex_lock(&route_mutex);
@@ -1470,6 +1575,10 @@ route_change_link_arp(struct vrf *vrf, struct lpm *lpm,
 		.delete = false,
 		.vrf = vrf,
 	};
+	struct lle_relink_arg relink_arg = {
+		.ip = ip,
+		.depth = depth,
+	};
 	uint32_t cover_ip;
 	uint8_t cover_depth;
 	uint32_t cover_idx;
@@ -1512,7 +1621,8 @@ route_change_link_arp(struct vrf *vrf, struct lpm *lpm,
 			/* happens for local routes */
 			continue;
 
-		lltable_walk(ifp->if_lltable, lle_routing_insert_arp_cb, NULL);
+		lltable_walk(ifp->if_lltable, lle_routing_insert_arp_cb,
+			     &relink_arg);
 	}
 
 	/* Now do the gateway processing. */
@@ -1587,6 +1697,10 @@ route_delete_relink_arp(struct lpm *lpm, uint32_t ip, uint8_t depth)
 	uint8_t cover_depth;
 	uint32_t cover_nh_idx;
 	const struct next_hop *array;
+	struct lle_relink_arg relink_arg = {
+		.ip = ip,
+		.depth = depth,
+	};
 	int i;
 
 	/*
@@ -1611,7 +1725,7 @@ route_delete_relink_arp(struct lpm *lpm, uint32_t ip, uint8_t depth)
 
 		if (nh_is_connected(next))
 			lltable_walk(ifp->if_lltable,
-				     lle_routing_insert_arp_cb, NULL);
+				     lle_routing_insert_arp_cb, &relink_arg);
 	}
 
 	/* Now do the gateway processing. */
@@ -1808,45 +1922,89 @@ int rt_delete(vrfid_t vrf_id, in_addr_t dst, uint8_t depth,
 	return 0;
 }
 
-/* cleaner for the next hop */
-static void flush_cleanup(struct lpm *lpm __rte_unused,
-			  uint32_t ip,
-			  uint8_t depth,
-			  int16_t scope __rte_unused,
-			  uint32_t idx,
-			  struct pd_obj_state_and_flags pd_state,
-			  void *arg)
+/*
+ * Routes being flushed are deleted from the platform in batches, and
+ * their next hops only released once the batch has gone.
+ * Protected by route_mutex.
+ */
+#define RT_FLUSH_BATCH	256
+
+static struct {
+	uint32_t		count;
+	struct fal_ip_route_t	routes[RT_FLUSH_BATCH];
+	uint32_t		nh_idx[RT_FLUSH_BATCH];
+	enum pd_obj_state	state[RT_FLUSH_BATCH];
+	int			results[RT_FLUSH_BATCH];
+} rt_flush_batch;
+
+static void rt_flush_batch_send(void)
 {
-	struct vrf *vrf = arg;
-	int ret;
+	uint32_t i;
 
-	route_sw_stats[PD_OBJ_STATE_FULL]--;
+	if (!rt_flush_batch.count)
+		return;
+
+	fal_ip_del_routes(rt_flush_batch.count, rt_flush_batch.routes,
+			  rt_flush_batch.results);
+
+	for (i = 0; i < rt_flush_batch.count; i++) {
+		const struct fal_ip_route_t *route = &rt_flush_batch.routes[i];
+		int ret = rt_flush_batch.results[i];
 
-	if (pd_state.created) {
-		ret = fal_ip4_del_route(vrf->v_id, htonl(ip), depth,
-					lpm_get_id(lpm));
 		switch (ret) {
 		case 0:
-			route_hw_stats[pd_state.state]--;
+			route_hw_stats[rt_flush_batch.state[i]]--;
 			break;
 		default:
 			/* General failure */
 			if (ret < 0) {
 				char b[INET_ADDRSTRLEN];
-				in_addr_t dst = htonl(ip);
 
 				DP_LOG_W_VRF(
-					ERR, ROUTE, vrf->v_id,
+					ERR, ROUTE, route->vrf_id,
 					"route delete %s/%d failed via FAL (%d)\n",
-					inet_ntop(AF_INET, &dst, b, sizeof(b)),
-					depth, ret);
+					inet_ntop(AF_INET, &route->ipaddr.addr.ip4,
+						  b, sizeof(b)),
+					route->prefixlen, ret);
 			}
 			break;
 		}
-	} else
+		nexthop_put(rt_flush_batch.nh_idx[i]);
+	}
+	rt_flush_batch.count = 0;
+}
+
+/* cleaner for the next hop */
+static void flush_cleanup(struct lpm *lpm __rte_unused,
+			  uint32_t ip,
+			  uint8_t depth,
+			  int16_t scope __rte_unused,
+			  uint32_t idx,
+			  struct pd_obj_state_and_flags pd_state,
+			  void *arg)
+{
+	struct vrf *vrf = arg;
+	struct fal_ip_route_t *route;
+
+	route_sw_stats[PD_OBJ_STATE_FULL]--;
+
+	if (!pd_state.created) {
 		route_hw_stats[pd_state.state]--;
+		nexthop_put(idx);
+		return;
+	}
 
-	nexthop_put(idx);
+	route = &rt_flush_batch.routes[rt_flush_batch.count];
+	route->vrf_id = vrf->v_id;
+	route->ipaddr.addr_family = FAL_IP_ADDR_FAMILY_IPV4;
+	route->ipaddr.addr.ip4 = htonl(ip);
+	route->prefixlen = depth;
+	route->tableid = lpm_get_id(lpm);
+	rt_flush_batch.nh_idx[rt_flush_batch.count] = idx;
+	rt_flush_batch.state[rt_flush_batch.count] = pd_state.state;
+
+	if (++rt_flush_batch.count == RT_FLUSH_BATCH)
+		rt_flush_batch_send();
 }
 
 void rt_flush(struct vrf *vrf)
@@ -1868,6 +2026,7 @@ void rt_flush(struct vrf *vrf)
 
 		if (lpm && !rt_lpm_is_empty(lpm)) {
 			lpm_delete_all(lpm, flush_cleanup, vrf);
+			rt_flush_batch_send();
 			/* decrement ref cnt for empty LPM */
 			if (!rt_lpm_add_reserved_routes(lpm, vrf)) {
 				DP_LOG_W_VRF(ERR, ROUTE, vrf->v_id,
@@ -1997,8 +2156,8 @@ void route_uninit(struct vrf *vrf, struct route_head *rt_head)
 			lpm_free(lpm);
 		}
 	}
-	free_huge(rt_head->rt_table, (rt_head->rt_rtm_max *
-				      sizeof(struct lpm *)));
+	dp_mem_huge_free(DP_MEM_LPM, rt_head->rt_table,
+			 (rt_head->rt_rtm_max * sizeof(struct lpm *)));
 	rt_head->rt_table = NULL;
 }
 
@@ -2081,6 +2240,8 @@ void rt_print_nexthop(json_writer_t *json, uint32_t next_hop)
 
 		if (next->flags & RTF_DEAD)
 			jsonw_bool_field(json, "dead", true);
+		if (next->flags & RTF_LINKDOWN)
+			jsonw_bool_field(json, "link_down", true);
 		if (next->flags & RTF_NEIGH_PRESENT)
 			jsonw_bool_field(json, "neigh_present", true);
 		if (next->flags & RTF_NEIGH_CREATED)
@@ -2579,6 +2740,15 @@ int rt_stats(struct route_head *rt_head, json_writer_t *json, uint32_t id)
 	jsonw_uint_field(json, "used", lpm_tbl8_count(lpm));
 	jsonw_uint_field(json, "free", lpm_tbl8_free_count(lpm));
 
+	size_t tables, rules;
+
+	lpm_memory(lpm, &tables, &rules);
+	jsonw_name(json, "memory");
+	jsonw_start_object(json);
+	jsonw_uint_field(json, "tables", tables);
+	jsonw_uint_field(json, "rules", rules);
+	jsonw_end_object(json);
+
 	jsonw_name(json, "nexthop");
 	jsonw_start_object(json);
 	jsonw_uint_field(json, "used", nh_tbl.in_use);
@@ -2656,7 +2826,7 @@ int nh_lookup_by_index(uint32_t nhindex, uint32_t hash, in_addr_t *nh,
 
 	size = nextu->nsiblings;
 	if (size > 1)
-		next = nexthop_mp_select(next, size, hash);
+		next = nexthop_mp_select(next, size, hash, nextu->buckets);
 
 	if (next->flags & RTF_GATEWAY)
 		*nh = next->gateway;
@@ -3043,8 +3213,42 @@ int route_get_pd_subset_data(json_writer_t *json, enum pd_obj_state subset)
 	return 0;
 }
 
+/*
+ * Routes share nexthop objects, so on a link change mark the paths
+ * through the interface in each nexthop once, rather than walking every
+ * route. Multipath selection then moves traffic to the remaining paths
+ * until the routing daemon reconverges.
+ */
+static void rt_if_link_change(struct ifnet *ifp, bool up,
+			      uint32_t speed __unused)
+{
+	struct next_hop_u *nhu;
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+	unsigned int i;
+
+	ASSERT_MASTER();
+
+	cds_lfht_for_each(nexthop_hash, &iter, node) {
+		nhu = caa_container_of(node, struct next_hop_u, nh_node);
+
+		for (i = 0; i < nhu->nsiblings; i++) {
+			struct next_hop *nh = nhu->siblings + i;
+
+			if (nh4_get_ifp(nh) != ifp)
+				continue;
+
+			if (up)
+				nh->flags &= ~RTF_LINKDOWN;
+			else
+				nh->flags |= RTF_LINKDOWN;
+		}
+	}
+}
+
 static const struct dp_event_ops route_events = {
 	.if_index_unset = rt_if_purge,
+	.if_link_change = rt_if_link_change,
 };
 
 DP_STARTUP_EVENT_REGISTER(route_events);
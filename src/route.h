@@ -78,6 +78,9 @@ struct next_hop *rt_lookup(in_addr_t dst, uint32_t tbl_id,
 struct next_hop *rt_lookup_fast(struct vrf *vrf, in_addr_t dst,
 				uint32_t tblid,
 				const struct rte_mbuf *m);
+void rt_lookup_fast_bulk(struct vrf *vrf, const in_addr_t *dst,
+			 uint32_t tblid, struct rte_mbuf * const *m,
+			 struct next_hop **nh, unsigned int n);
 
 int rt_insert(vrfid_t vrf_id, in_addr_t dst, uint8_t depth, uint32_t id,
 	      uint8_t scope, uint8_t proto, struct next_hop hops[],
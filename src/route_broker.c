@@ -6,12 +6,18 @@
 
 #include <czmq.h>
 #include <libmnl/libmnl.h>
+#include <linux/rtnetlink.h>
 #include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_jhash.h>
 #include <rte_log.h>
 #include <rte_timer.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 #include "config.h"
 #include "control.h"
@@ -19,24 +25,70 @@
 #include "master.h"
 #include "netlink.h"
 #include "route_broker.h"
+#include "util.h"
 #include "vplane_debug.h"
 #include "vplane_log.h"
 #include "zmq_dp.h"
 
 #define BROKER_KEEPALIVE_TIMER_SEC 10
+
+/*
+ * Most route messages handled per wakeup.  A full table download
+ * arrives as one message per route, so going back to poll for each
+ * one costs more than the install.  Bounded so other events are not
+ * held up for long.
+ */
+#define ROUTE_RECV_BATCH 256
+#define ROUTE_COALESCE_SLOTS (2 * ROUTE_RECV_BATCH)
+
+/*
+ * Most time spent installing routes before going back to the master
+ * loop, so that timers, neighbour updates and commands are not held
+ * up by a route download. The rest of the batch is picked up on the
+ * next pass through the loop.
+ */
+#define ROUTE_BATCH_BUDGET_US	2000
+#define ROUTE_BATCH_CHECK	16	/* messages between clock reads */
+
 static struct rte_timer broker_keepalive_timer[CONT_SRC_COUNT];
 
+/* Identity of a unicast route, for finding updates to the same one */
+struct route_key {
+	uint32_t	table;
+	uint8_t		family;
+	uint8_t		dst_len;
+	uint8_t		scope;
+	uint8_t		tos;
+	uint8_t		dst[16];
+};
+
+/* A batch of messages, only touched by the master thread */
+static struct route_batch {
+	zmq_msg_t	msg[ROUTE_RECV_BATCH];
+	struct route_key key[ROUTE_RECV_BATCH];
+	bool		skip[ROUTE_RECV_BATCH];
+	/* index + 1 of a later message replacing the route, by hash */
+	uint16_t	slot[ROUTE_COALESCE_SLOTS];
+	uint16_t	slot_gen[ROUTE_COALESCE_SLOTS];
+	uint16_t	gen;
+	unsigned int	count;		/* messages in the batch */
+	unsigned int	next;		/* next one to process */
+	int		resume_fd;	/* to come back to the batch */
+} route_batch = {
+	.resume_fd = -1,
+};
+
 /*
  * Receive netlink message from rib:
  *
  * dpmsg must be already allocated, and caller is responsible for destroying it.
  * Return 0 on success, -1 on error.
  */
-static int dp_rt_msg_recv(zsock_t *sock, zmq_msg_t *route_msg)
+static int dp_rt_msg_recv(zsock_t *sock, zmq_msg_t *route_msg, int flags)
 {
 	zmq_msg_init(route_msg);
 
-	if (zmq_msg_recv(route_msg, zsock_resolve(sock), 0) <= 0)
+	if (zmq_msg_recv(route_msg, zsock_resolve(sock), flags) <= 0)
 		goto error;
 
 	int more = zmq_msg_get(route_msg, ZMQ_MORE);
@@ -54,28 +106,223 @@ error:
 	return -1;
 }
 
+static int route_key_attr(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	int type = mnl_attr_get_type(attr);
+
+	if (type == RTA_DST || type == RTA_TABLE)
+		tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+/*
+ * Get the key of a message holding a single IPv4 or IPv6 unicast
+ * route change. Sets *replaces if the result of the change does not
+ * depend on what was there before, i.e. a delete or a replace.
+ */
+static bool route_msg_key(const void *buf, size_t len,
+			  struct route_key *key, bool *replaces)
+{
+	const struct nlattr *tb[RTA_MAX + 1] = { NULL };
+	const struct nlmsghdr *nlh = buf;
+	const struct rtmsg *rtm;
+	int rem = len;
+
+	if (!mnl_nlmsg_ok(nlh, rem))
+		return false;
+	if (mnl_nlmsg_ok(mnl_nlmsg_next(nlh, &rem), rem))
+		return false;
+	if (nlh->nlmsg_type != RTM_NEWROUTE &&
+	    nlh->nlmsg_type != RTM_DELROUTE)
+		return false;
+	if (nlh->nlmsg_len < mnl_nlmsg_size(sizeof(*rtm)))
+		return false;
+
+	rtm = mnl_nlmsg_get_payload(nlh);
+	if ((rtm->rtm_family != AF_INET && rtm->rtm_family != AF_INET6) ||
+	    rtm->rtm_type == RTN_MULTICAST)
+		return false;
+
+	if (mnl_attr_parse(nlh, sizeof(*rtm), route_key_attr, tb) !=
+	    MNL_CB_OK)
+		return false;
+
+	memset(key, 0, sizeof(*key));
+	key->family = rtm->rtm_family;
+	key->dst_len = rtm->rtm_dst_len;
+	key->scope = rtm->rtm_scope;
+	key->tos = rtm->rtm_tos;
+	key->table = rtm->rtm_table;
+
+	if (tb[RTA_TABLE]) {
+		if (mnl_attr_validate(tb[RTA_TABLE], MNL_TYPE_U32) < 0)
+			return false;
+		key->table = mnl_attr_get_u32(tb[RTA_TABLE]);
+	}
+	if (tb[RTA_DST]) {
+		if (mnl_attr_get_payload_len(tb[RTA_DST]) > sizeof(key->dst))
+			return false;
+		memcpy(key->dst, mnl_attr_get_payload(tb[RTA_DST]),
+		       mnl_attr_get_payload_len(tb[RTA_DST]));
+	}
+
+	*replaces = nlh->nlmsg_type == RTM_DELROUTE ||
+		(nlh->nlmsg_flags & NLM_F_REPLACE);
+	return true;
+}
+
+/* Empty the hash of routes seen */
+static void route_batch_forget(struct route_batch *b)
+{
+	if (++b->gen == 0) {
+		memset(b->slot_gen, 0, sizeof(b->slot_gen));
+		b->gen = 1;
+	}
+}
+
+/*
+ * Mark the route messages in the batch that a later delete or replace
+ * of the same route makes redundant. Any other kind of message may
+ * depend on the state before it, so nothing is coalesced across one.
+ */
+static void route_batch_coalesce(struct route_batch *b, unsigned int n)
+{
+	struct route_key *key;
+	unsigned int i, h, j;
+	bool replaces;
+
+	route_batch_forget(b);
+
+	for (i = n; i-- > 0; ) {
+		key = &b->key[i];
+		b->skip[i] = false;
+
+		if (!route_msg_key(zmq_msg_data(&b->msg[i]),
+				   zmq_msg_size(&b->msg[i]), key, &replaces)) {
+			/* Barrier, forget everything seen after it */
+			route_batch_forget(b);
+			continue;
+		}
+
+		h = rte_jhash(key, sizeof(*key), 0) % ROUTE_COALESCE_SLOTS;
+		for (;;) {
+			if (b->slot_gen[h] != b->gen) {
+				if (replaces) {
+					b->slot_gen[h] = b->gen;
+					b->slot[h] = i + 1;
+				}
+				break;
+			}
+
+			j = b->slot[h] - 1;
+			if (memcmp(&b->key[j], key, sizeof(*key)) == 0) {
+				b->skip[i] = true;
+				break;
+			}
+			h = (h + 1) % ROUTE_COALESCE_SLOTS;
+		}
+	}
+}
+
+/*
+ * Process the batch in order until done or out of time. Returns true
+ * if there are messages left.
+ */
+static bool route_batch_run(struct route_batch *b)
+{
+	uint64_t end = rte_get_timer_cycles() +
+		ROUTE_BATCH_BUDGET_US * rte_get_timer_hz() / USEC_PER_SEC;
+	unsigned int i;
+	int rc;
+
+	for (i = b->next; i < b->count; i++) {
+		if (i != b->next && (i - b->next) % ROUTE_BATCH_CHECK == 0 &&
+		    rte_get_timer_cycles() > end)
+			break;
+
+		if (b->skip[i]) {
+			DP_DEBUG(ROUTE, DEBUG, DATAPLANE,
+				 "route message superseded in batch\n");
+			zmq_msg_close(&b->msg[i]);
+			continue;
+		}
+
+		rc = mnl_cb_run(zmq_msg_data(&b->msg[i]),
+				zmq_msg_size(&b->msg[i]),
+				0, 0, rtnl_process, (void *)CONT_SRC_MAIN);
+
+		if (rc != MNL_CB_OK)
+			DP_DEBUG(ROUTE, NOTICE, DATAPLANE,
+				 "route message not handled\n");
+
+		zmq_msg_close(&b->msg[i]);
+	}
+
+	b->next = i;
+	if (i < b->count)
+		return true;
+
+	b->count = b->next = 0;
+	return false;
+}
+
+/* Make the master loop come back to an unfinished batch */
+static void route_batch_defer(struct route_batch *b)
+{
+	static const uint64_t incr = 1;
+
+	if (write(b->resume_fd, &incr, sizeof(incr)) < 0)
+		RTE_LOG(NOTICE, DATAPLANE,
+			"route batch event write failed: %s\n",
+			strerror(errno));
+}
+
+static int route_batch_resume(void *arg)
+{
+	struct route_batch *b = arg;
+	uint64_t seqno;
+
+	if (read(b->resume_fd, &seqno, sizeof(seqno)) < 0 &&
+	    errno != EAGAIN && errno != EINTR)
+		return -1;
+
+	if (route_batch_run(b))
+		route_batch_defer(b);
+	return 0;
+}
+
 static int route_recv(void *arg)
 {
-	zmq_msg_t route_msg;
+	struct route_batch *b = &route_batch;
 	zsock_t *sock = arg;
+	unsigned int n;
+	int rc;
 
-	errno = 0;
-	int rc = dp_rt_msg_recv(sock, &route_msg);
-	if (rc != 0) {
-		if (errno == 0)
-			return 0;
-		return -1;
-	}
+	/* Messages must be handled in order, so finish the last batch */
+	if (b->next < b->count)
+		return 0;
 
-	rc = mnl_cb_run(zmq_msg_data(&route_msg),
-			zmq_msg_size(&route_msg),
-			0, 0, rtnl_process, (void *)CONT_SRC_MAIN);
+	for (n = 0; n < ROUTE_RECV_BATCH; n++) {
+		errno = 0;
+		rc = dp_rt_msg_recv(sock, &b->msg[n], n ? ZMQ_DONTWAIT : 0);
+		if (rc != 0) {
+			/* Nothing more queued */
+			if (n || errno == 0)
+				break;
+			return -1;
+		}
+	}
 
-	if (rc != MNL_CB_OK)
-		DP_DEBUG(ROUTE, NOTICE, DATAPLANE,
-			 "route message not handled\n");
+	if (n > 1)
+		route_batch_coalesce(b, n);
+	else
+		b->skip[0] = false;
 
-	zmq_msg_close(&route_msg);
+	b->count = n;
+	b->next = 0;
+	if (route_batch_run(b))
+		route_batch_defer(b);
 
 	return 0;
 }
@@ -98,6 +345,14 @@ open_route_broker_data_sock(enum cont_src_en cont_src,
 
 	cont_src_set_broker_data(cont_src, data_sock);
 
+	if (route_batch.resume_fd < 0) {
+		route_batch.resume_fd = eventfd(0, EFD_NONBLOCK);
+		if (route_batch.resume_fd < 0)
+			rte_panic("Could not open route batch event fd\n");
+		register_event_fd(route_batch.resume_fd, route_batch_resume,
+				  &route_batch);
+	}
+
 	register_event_socket(zsock_resolve(data_sock), route_recv,
 			      data_sock);
 	return 0;
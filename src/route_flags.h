@@ -54,14 +54,17 @@
 #define	RTF_MULTICAST	0x100	/* route represents a mcast address */
 #define	RTF_OUTLABEL	0x200	/* output label rather than local label */
 #define	RTF_NOROUTE	0x400	/* trigger no-route behaviour */
+#define RTF_LINKDOWN	0x800	/* nexthop interface link is down */
 
 #define RTF_NEIGH_CREATED  0x10000 /* Nexthop was created to store neigh info */
 #define RTF_NEIGH_PRESENT  0x20000 /* Nexthop contains neigh info */
 
 /*
  * When comparing NHs for equality, mask the flags as the NEIGH_ ones are
- * local optimisations.
+ * local optimisations, and LINKDOWN is set in place on shared nexthops
+ * while they are in the hash.
  */
-#define NH_FLAGS_CMP_MASK ~(RTF_NEIGH_CREATED | RTF_NEIGH_PRESENT)
+#define NH_FLAGS_CMP_MASK \
+	~(RTF_NEIGH_CREATED | RTF_NEIGH_PRESENT | RTF_LINKDOWN)
 
 #endif /* ROUTE_FLAGS_H */
@@ -10,7 +10,10 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <rte_cycles.h>
 #include <rte_jhash.h>
+#include <rte_lcore.h>
+#include <rte_timer.h>
 
 #include "lpm/lpm.h"
 #include "lpm/lpm6.h"
@@ -20,8 +23,16 @@
 #define RT_TRACKER_HASH_MIN  8
 #define RT_TRACKER_HASH_MAX  4096
 
+/* Longest a notification is deferred while events keep arriving */
+#define RT_TRACKER_DEFER_MS  50
+
 static unsigned long rt_tracker_table_seed;
 
+/* Trackers with notifications to send */
+static CDS_LIST_HEAD(rt_tracker_dirty);
+static struct rte_timer rt_tracker_timer;
+static bool rt_tracker_timer_inited;
+
 static int rt_tracker_init(struct vrf *vrf)
 {
 	vrf->v_rt_tracker_tbl = cds_lfht_new(RT_TRACKER_HASH_MIN,
@@ -147,15 +158,11 @@ rt_tracker_client_count(struct rt_tracker_info *tracker)
 }
 
 static void
-rt_tracker_update(void *ctx)
+rt_tracker_notify(struct rt_tracker_info *ti_info)
 {
-	struct rt_tracker_info *ti_info = (struct rt_tracker_info *)ctx;
 	struct rt_tracker_client_t *client;
 	struct cds_list_head *entry;
 
-	if (!ti_info)
-		return;
-
 	cds_list_for_each(entry, &ti_info->rti_client_list) {
 		client = cds_list_entry(entry, struct rt_tracker_client_t,
 					rtc_client_links);
@@ -163,6 +170,64 @@ rt_tracker_update(void *ctx)
 	}
 }
 
+bool rt_tracker_pending(void)
+{
+	return !cds_list_empty(&rt_tracker_dirty);
+}
+
+void rt_tracker_flush(void)
+{
+	struct rt_tracker_info *ti_info;
+
+	if (rt_tracker_timer_inited)
+		rte_timer_stop(&rt_tracker_timer);
+
+	/* Clients may change routes, and so mark trackers, as we go */
+	while (!cds_list_empty(&rt_tracker_dirty)) {
+		ti_info = cds_list_entry(rt_tracker_dirty.next,
+					 struct rt_tracker_info,
+					 rti_dirty_link);
+		cds_list_del(&ti_info->rti_dirty_link);
+		ti_info->rti_dirty = false;
+
+		rt_tracker_notify(ti_info);
+	}
+}
+
+static void
+rt_tracker_timer_cb(struct rte_timer *timer __rte_unused,
+		    void *arg __rte_unused)
+{
+	rt_tracker_flush();
+}
+
+/*
+ * Called from the lpm when the cover of a tracked address changes.  Mark
+ * the tracker, and notify its clients later.
+ */
+static void
+rt_tracker_update(void *ctx)
+{
+	struct rt_tracker_info *ti_info = (struct rt_tracker_info *)ctx;
+
+	if (!ti_info || ti_info->rti_dirty)
+		return;
+
+	ti_info->rti_dirty = true;
+	cds_list_add_tail(&ti_info->rti_dirty_link, &rt_tracker_dirty);
+
+	if (!rt_tracker_timer_inited) {
+		rte_timer_init(&rt_tracker_timer);
+		rt_tracker_timer_inited = true;
+	}
+
+	if (!rte_timer_pending(&rt_tracker_timer))
+		rte_timer_reset(&rt_tracker_timer,
+				RT_TRACKER_DEFER_MS * rte_get_timer_hz() / 1000,
+				SINGLE, rte_get_master_lcore(),
+				rt_tracker_timer_cb, NULL);
+}
+
 static inline unsigned long
 rt_tracker_hash(struct ip_addr *addr)
 {
@@ -325,6 +390,8 @@ rt_tracker_delete(const struct vrf *vrf, struct ip_addr *ip, void *cb_ctx)
 			lpm6_tracker_delete(ti_info);
 			break;
 		}
+		if (ti_info->rti_dirty)
+			cds_list_del(&ti_info->rti_dirty_link);
 		cds_lfht_del(vrf->v_rt_tracker_tbl, &ti_info->rti_node);
 		rt_tracker_destroy(ti_info);
 	}
@@ -34,8 +34,10 @@ struct rt_tracker_info {
 	uint32_t             nhindex;
 	void                 *rule;
 	struct rcu_head      rti_rcu;
+	struct cds_list_head rti_dirty_link;
 	uint8_t              r_depth;
 	bool                 tracking;
+	bool                 rti_dirty;
 };
 
 
@@ -49,6 +51,15 @@ void rt_tracker_uninit(struct vrf *vrf);
 uint32_t
 rt_tracker_client_count(struct rt_tracker_info *ti_info);
 
+/*
+ * Client notifications are deferred, so that a tracker whose cover changes
+ * many times in a burst of route updates notifies its clients once.  They are
+ * sent when the master event loop has no more events waiting, or after
+ * a short delay at most.
+ */
+bool rt_tracker_pending(void);
+void rt_tracker_flush(void);
+
 int cmd_rt_tracker_op(FILE *f, int argc, char **argv);
 
 /* For test only */
@@ -29,16 +29,22 @@
 #include <urcu/uatomic.h>
 
 #include "compiler.h"
+#include "config.h"
 #include "dp_event.h"
 #include "if_var.h"
 #include "main.h"
 #include "netinet6/in6.h"
+#include "npf/npf_state.h"
 #include "npf_shim.h"
 #include "netinet6/ip6_funcs.h"
 #include "pktmbuf.h"
 #include "session.h"
 #include "session_feature.h"
+#include "session_pool.h"
+#include "session_private.h"
+#include "session_sync.h"
 #include "urcu.h"
+#include "util.h"
 #include "vplane_log.h"
 
 /*
@@ -158,20 +164,82 @@ struct ports {
  * Session hash table buckets.
  * Must be powers of 2.
  */
-#define SENTRY_HT_INIT	4096
 #define SENTRY_HT_MIN	4096
 #define SENTRY_HT_MAX	1048576
 
 /* GC Interval (seconds) */
 #define SENTRY_GC_INTERVAL	5
 
+/*
+ * The sentry table may be split into shards, each a separate hash
+ * table, to spread out the contention between cores adding sentries.
+ * The shard is chosen from the top bits of the sentry hash, and so is
+ * fixed by the packet and needs no fallback search.
+ */
+#define SENTRY_HT_SHARDS_MAX	64
+#define SENTRY_HT_SHARD_SHIFT	26	/* sentry hashes are 32 bits */
+
 /* Sentry and session hash tables */
-struct cds_lfht *sentry_ht;
+static struct cds_lfht *sentry_ht[SENTRY_HT_SHARDS_MAX];
+static unsigned int sentry_ht_shards = 1;
 struct cds_lfht *session_ht;
 
+#define FOREACH_SENTRY_SHARD(_i) \
+	for ((_i) = 0; (_i) < sentry_ht_shards; (_i)++)
+
+/*
+ * The tables are not auto-resized, as that is triggered by adds in
+ * the forwarding threads and can stall them while a resize runs.
+ * Instead they are sized on the master for the configured session
+ * limit, at two sentries per session, whenever that is set.
+ */
+static struct session_ht_stats se_ht_stats;
+
 /* GC Timer */
 struct rte_timer session_gc_timer;
 
+/*
+ * Rather than the GC walking every session on each run, sessions are
+ * kept on a hierarchical timing wheel keyed by the uptime second at
+ * which they are next due to be inspected.  Level 0 has a slot per
+ * second, and the slots of each higher level are 64 times as long,
+ * being cascaded down a level as the wheel turns over.
+ *
+ * Only the GC touches the wheel.  New sessions, and those needing
+ * attention before they are due (expired, or with features requesting
+ * expiry), are queued by the forwarding threads and the queue drained
+ * at the start of each run.  Holding se_gc_queued is the right to
+ * queue or inspect a session, and a session reclaimed by the GC keeps
+ * it so that it can never be queued again.
+ */
+#define SE_WHEEL_BITS	6
+#define SE_WHEEL_SLOTS	(1u << SE_WHEEL_BITS)
+#define SE_WHEEL_MASK	(SE_WHEEL_SLOTS - 1)
+#define SE_WHEEL_LEVELS	4
+#define SE_WHEEL_SPAN	((1ul << (SE_WHEEL_BITS * SE_WHEEL_LEVELS)) - 1)
+
+static struct {
+	uint64_t		sw_base;	/* next second to run */
+	struct cds_list_head	sw_slot[SE_WHEEL_LEVELS][SE_WHEEL_SLOTS];
+} se_wheel;
+
+/*
+ * Early drop.  Once slot_get() has failed, each GC run reclaims up to
+ * a batch of sessions that are least likely to be missed - any not
+ * an established TCP connection, and not an ALG parent - soonest due
+ * first, so new flows are not refused while idle ones wait out long
+ * timeouts.  Off when the batch is 0.
+ */
+static uint32_t		session_early_drop_batch;
+static bool		session_table_full;
+static uint64_t		session_early_drops;
+
+/* UT cleanup, bounded in case of a never unlinked child */
+#define SESSION_DESTROY_PASSES	16
+
+static struct cds_wfcq_head	se_gc_queue_head;
+static struct cds_wfcq_tail	se_gc_queue_tail;
+
 /* For GC... */
 static inline int time_after(time_t t0, time_t t1)
 {
@@ -187,13 +255,41 @@ static rte_atomic32_t	sessions_used;
 static int32_t		sessions_max = DEFAULT_MAX_SESSIONS;
 static bool		session_gc_run = true;
 
+/*
+ * When sharded, session slots are also moved between the global count
+ * and a per-lcore cache in batches, so that the shared counter is only
+ * touched once per batch of creations or deletions.  sessions_used
+ * then includes the cached slots, which are subtracted when reporting.
+ */
+#define SESSION_SLOT_BATCH	64
+
+struct session_slot_cache {
+	int32_t		ssc_avail;
+} __rte_cache_aligned;
+
+static struct session_slot_cache session_slots[RTE_MAX_LCORE];
+static bool session_slot_cache_enabled;
+
 /* Global session logging configuration */
 static struct session_log_cfg session_global_log_cfg;
 
+/*
+ * Sessions and sentries come from NUMA-local pools, per socket, of
+ * this many objects.  Sentries are all sized for IPv6.
+ */
+#define SESSION_POOL_SIZE	65536
+#define SENTRY_POOL_SIZE	(2 * SESSION_POOL_SIZE)
+#define SENTRY_POOL_OBJ_SIZE	\
+	(sizeof(struct sentry) + SENTRY_LEN_IPV6 * sizeof(uint32_t))
+
+static struct se_pool *session_pool;
+static struct se_pool *sentry_pool;
+
 static void sentry_rcu_free(struct rcu_head *h)
 {
 	rte_atomic32_dec(&session_rcu_counter);
-	free(caa_container_of(h, struct sentry, sen_rcu_head));
+	se_pool_free(sentry_pool,
+		     caa_container_of(h, struct sentry, sen_rcu_head));
 }
 
 static void session_rcu_free(struct rcu_head *h)
@@ -209,7 +305,7 @@ static void session_rcu_free(struct rcu_head *h)
 
 	rte_atomic32_dec(&session_rcu_counter);
 	free(s->se_link);
-	free(s);
+	se_pool_free(session_pool, s);
 }
 
 /* Walk function for counting features */
@@ -285,18 +381,59 @@ static void session_log(struct session *s, enum session_log_event log_event)
 				     &log_event);
 }
 
+/* Count of slots in use, excluding those cached by the lcores */
+static uint32_t slots_used(void)
+{
+	int32_t used = rte_atomic32_read(&sessions_used);
+	unsigned int i;
+
+	if (session_slot_cache_enabled)
+		for (i = 0; i < RTE_MAX_LCORE; i++)
+			used -= CMM_LOAD_SHARED(session_slots[i].ssc_avail);
+
+	return used > 0 ? used : 0;
+}
+
+/* Take slots from the global count, check against max limit */
+static ALWAYS_INLINE bool slot_take(int32_t n)
+{
+	if (rte_atomic32_add_return(&sessions_used, n) <= sessions_max)
+		return true;
+
+	rte_atomic32_sub(&sessions_used, n);
+	return false;
+}
+
 /* Get an entry for a new session, check against max limit */
 static ALWAYS_INLINE int slot_get(void)
 {
-	if (rte_atomic32_add_return(&sessions_used, 1) <= sessions_max)
+	unsigned int lcore = rte_lcore_id();
+
+	if (session_slot_cache_enabled && lcore < RTE_MAX_LCORE) {
+		struct session_slot_cache *ssc = &session_slots[lcore];
+
+		if (likely(ssc->ssc_avail > 0)) {
+			ssc->ssc_avail--;
+			return 0;
+		}
+		if (slot_take(SESSION_SLOT_BATCH)) {
+			ssc->ssc_avail = SESSION_SLOT_BATCH - 1;
+			return 0;
+		}
+	}
+
+	/* No cache, or too close to the limit to fill it */
+	if (slot_take(1))
 		return 0;
 
-	rte_atomic32_dec(&sessions_used);
+	if (!CMM_LOAD_SHARED(session_table_full))
+		CMM_STORE_SHARED(session_table_full, true);
+
 	if (net_ratelimit() && session_gc_run) {
 		session_gc_run = false;
 		RTE_LOG(ERR, DATAPLANE,
 			"Session table limit reached. Used: %u Max: %u\n",
-			rte_atomic32_read(&sessions_used), sessions_max);
+			slots_used(), sessions_max);
 	}
 	return -ENOSPC;
 }
@@ -329,9 +466,35 @@ static inline void cache_sentry(struct rte_mbuf *m, struct sentry *sen)
 /* Return entry to max limit */
 static ALWAYS_INLINE void slot_put(void)
 {
+	unsigned int lcore = rte_lcore_id();
+
+	if (session_slot_cache_enabled && lcore < RTE_MAX_LCORE) {
+		struct session_slot_cache *ssc = &session_slots[lcore];
+
+		/* Keep a batch in hand, return the excess */
+		if (++ssc->ssc_avail >= 2 * SESSION_SLOT_BATCH) {
+			ssc->ssc_avail -= SESSION_SLOT_BATCH;
+			rte_atomic32_sub(&sessions_used, SESSION_SLOT_BATCH);
+		}
+		return;
+	}
+
 	rte_atomic32_dec(&sessions_used);
 }
 
+/* Queue a session for the GC, unless already queued or being inspected */
+void session_gc_kick(struct session *s)
+{
+	if (!(s->se_flags & SESSION_INSERTED))
+		return;
+
+	if (rte_atomic16_test_and_set(&s->se_gc_queued)) {
+		cds_wfcq_node_init(&s->se_gc_qnode);
+		cds_wfcq_enqueue(&se_gc_queue_head, &se_gc_queue_tail,
+				 &s->se_gc_qnode);
+	}
+}
+
 static void expire_kids(struct session *s);
 
 /* Expire a session */
@@ -342,6 +505,7 @@ void se_expire(struct session *s)
 
 	if (rte_atomic16_cmpset(&s->se_flags, exp, (exp | SESSION_EXPIRED))) {
 		session_feature_session_expire(s);
+		session_gc_kick(s);
 	}
 }
 
@@ -398,11 +562,15 @@ static void session_reclaim(struct session *s)
 	}
 }
 
-/* Unlink a sentry from the hash tables and reclaim. */
+/*
+ * Unlink a sentry from the hash tables and reclaim.
+ * The session se_sen_lock must be held.
+ */
 static ALWAYS_INLINE
-void sentry_delete(struct sentry *sen)
+void sentry_delete_locked(struct sentry *sen)
 {
-	if (!cds_lfht_del(sentry_ht, &sen->sen_node)) {
+	if (!cds_lfht_del(sentry_ht[sen->sen_shard], &sen->sen_node)) {
+		cds_list_del(&sen->sen_link);
 		if (sen->sen_session->se_sen == sen) {
 			/* Clear INIT sentry cache */
 			sen->sen_session->se_sen = NULL;
@@ -413,6 +581,27 @@ void sentry_delete(struct sentry *sen)
 	}
 }
 
+static void sentry_delete(struct sentry *sen)
+{
+	struct session *s = sen->sen_session;
+
+	rte_spinlock_lock(&s->se_sen_lock);
+	sentry_delete_locked(sen);
+	rte_spinlock_unlock(&s->se_sen_lock);
+}
+
+/* Unlink and reclaim all of the sentries of a session */
+static void se_sentries_delete(struct session *s)
+{
+	struct sentry *sen;
+	struct sentry *tmp;
+
+	rte_spinlock_lock(&s->se_sen_lock);
+	cds_list_for_each_entry_safe(sen, tmp, &s->se_sentries, sen_link)
+		sentry_delete_locked(sen);
+	rte_spinlock_unlock(&s->se_sen_lock);
+}
+
 /* Get etime based on config */
 static inline uint32_t se_timeout(struct session *s)
 {
@@ -446,10 +635,42 @@ int reclaim_session(struct session *s, uint64_t uptime)
 	return rc;
 }
 
-/* GC worker routine, Reclaim expired/timedout sessions */
-static void sentry_gc_inspect(struct sentry *sen, uint64_t uptime)
+/* Place a session on the wheel, no earlier than the next second run */
+static void se_wheel_add(struct session *s, uint64_t due)
 {
-	struct session *s = sen->sen_session;
+	uint64_t delta;
+	unsigned int level;
+
+	if (due < se_wheel.sw_base)
+		due = se_wheel.sw_base;
+
+	delta = due - se_wheel.sw_base;
+	if (delta > SE_WHEEL_SPAN) {
+		delta = SE_WHEEL_SPAN;
+		due = se_wheel.sw_base + delta;
+	}
+
+	for (level = 0; level < SE_WHEEL_LEVELS - 1; level++)
+		if (delta < (1ul << (SE_WHEEL_BITS * (level + 1))))
+			break;
+
+	s->se_gc_due = due;
+	cds_list_add_tail(&s->se_gc_link,
+			  &se_wheel.sw_slot[level][(due >> (SE_WHEEL_BITS *
+							   level)) &
+						   SE_WHEEL_MASK]);
+}
+
+/*
+ * GC worker routine, reclaim expired/timedout sessions.
+ *
+ * Called holding the se_gc_queued token, with the session off the
+ * wheel.  Either reclaims the session, keeping the token, or puts it
+ * back on the wheel for when it is next due and releases the token.
+ */
+static void session_gc_inspect(struct session *s, uint64_t uptime)
+{
+	uint64_t due;
 
 	if (s->se_log_creation) {
 		s->se_log_creation = 0;
@@ -461,59 +682,194 @@ static void sentry_gc_inspect(struct sentry *sen, uint64_t uptime)
 		session_log(s, SESSION_LOG_PERIODIC);
 	}
 
+	if (s->se_sync_state != s->se_protocol_state &&
+	    !(s->se_flags & SESSION_EXPIRED) && session_sync_enabled()) {
+		s->se_sync_state = s->se_protocol_state;
+		session_sync_update(s);
+	}
+
 	/*
 	 * Expire features that requested it.
 	 */
 	if (rte_atomic16_read(&s->se_feature_exp_count))
 		session_feature_session_expire_requested(s);
 
-	/*
-	 * If we have children then do nothing, a parent session
-	 * must exist until children are removed.
-	 */
-	if (rte_atomic16_read(&s->se_link_cnt))
-		return;
-
-	/*
-	 * Session reclaimed after all children are unlinked,
-	 * and all sentries reclaimed
-	 */
-	if (reclaim_session(s, uptime)) {
+	if (rte_atomic16_read(&s->se_link_cnt)) {
+		/*
+		 * If we have children then do nothing, a parent session
+		 * must exist until children are removed.
+		 */
+		due = uptime + SENTRY_GC_INTERVAL;
+	} else if (reclaim_session(s, uptime)) {
+		/*
+		 * Session reclaimed after all children are unlinked,
+		 * and all sentries reclaimed
+		 */
 		s->se_log_periodic = 0;
-		sentry_delete(sen);
+		if (s->se_sync_state != SESSION_SYNC_NONE)
+			session_sync_delete(s);
+		se_sentries_delete(s);
 		session_reclaim(s);
+		return;
+	} else {
+		/* Due once the idle session would have timed out */
+		due = s->se_etime + 1;
+		if (s->se_log_periodic && s->se_ltime + 1 < due)
+			due = s->se_ltime + 1;
 	}
+
+	se_wheel_add(s, RTE_MAX(due, uptime + 1));
+	rte_atomic16_clear(&s->se_gc_queued);
+
+	/* Catch any request made while we held the token */
+	if ((s->se_flags & SESSION_EXPIRED) ||
+	    rte_atomic16_read(&s->se_feature_exp_count))
+		session_gc_kick(s);
 }
 
-static void sentry_gc_walk(uint64_t uptime)
+/* Inspect the sessions queued since the last run */
+static void session_gc_drain(uint64_t uptime)
 {
-	struct cds_lfht_iter iter;
-	struct sentry *sen;
+	struct cds_wfcq_head head;
+	struct cds_wfcq_tail tail;
+	struct cds_wfcq_node *node;
+	struct session *s;
 
-	/* No point */
-	if (!rte_atomic32_read(&sessions_used))
+	/* Sessions requeued by the inspection wait for the next run */
+	cds_wfcq_init(&head, &tail);
+	__cds_wfcq_splice_blocking(&head, &tail, &se_gc_queue_head,
+				   &se_gc_queue_tail);
+
+	while ((node = __cds_wfcq_dequeue_blocking(&head, &tail))) {
+		s = caa_container_of(node, struct session, se_gc_qnode);
+		cds_list_del_init(&s->se_gc_link);
+		session_gc_inspect(s, uptime);
+	}
+}
+
+/* Move the sessions of a higher level slot down the wheel */
+static unsigned int se_wheel_cascade(unsigned int level)
+{
+	unsigned int idx = (se_wheel.sw_base >> (SE_WHEEL_BITS * level)) &
+		SE_WHEEL_MASK;
+	struct cds_list_head *slot = &se_wheel.sw_slot[level][idx];
+	struct session *s;
+
+	while (!cds_list_empty(slot)) {
+		s = cds_list_entry(slot->next, struct session, se_gc_link);
+		cds_list_del_init(&s->se_gc_link);
+		se_wheel_add(s, s->se_gc_due);
+	}
+
+	return idx;
+}
+
+/* Turn the wheel up to and including uptime, inspecting due sessions */
+static void se_wheel_run(uint64_t uptime)
+{
+	struct cds_list_head *slot;
+	struct session *s;
+	unsigned int level;
+	uint64_t base;
+
+	while (se_wheel.sw_base <= uptime) {
+		base = se_wheel.sw_base;
+
+		if (!(base & SE_WHEEL_MASK))
+			for (level = 1; level < SE_WHEEL_LEVELS; level++)
+				if (se_wheel_cascade(level))
+					break;
+
+		slot = &se_wheel.sw_slot[0][base & SE_WHEEL_MASK];
+		while (!cds_list_empty(slot)) {
+			s = cds_list_entry(slot->next, struct session,
+					   se_gc_link);
+			cds_list_del_init(&s->se_gc_link);
+
+			/* If queued, it is inspected on the next drain */
+			if (rte_atomic16_test_and_set(&s->se_gc_queued))
+				session_gc_inspect(s, base);
+		}
+
+		se_wheel.sw_base++;
+	}
+}
+
+static bool se_early_drop_ok(const struct session *s)
+{
+	if (s->se_alg || rte_atomic16_read(&s->se_link_cnt) ||
+	    (s->se_flags & SESSION_EXPIRED))
+		return false;
+
+	if (s->se_protocol == IPPROTO_TCP)
+		return s->se_protocol_state != NPF_TCPS_ESTABLISHED;
+
+	return true;
+}
+
+/* Walk the wheel from now, reclaiming up to a batch of sessions */
+static void session_early_drop(uint64_t uptime)
+{
+	uint32_t todo = CMM_LOAD_SHARED(session_early_drop_batch);
+	struct cds_list_head *slot;
+	struct session *s, *tmp;
+	unsigned int level, i;
+	uint64_t idx;
+
+	if (!todo || !CMM_LOAD_SHARED(session_table_full))
 		return;
 
-	/* Clean the sentry table */
-	cds_lfht_for_each_entry(sentry_ht, &iter, sen, sen_node)
-		sentry_gc_inspect(sen, uptime);
+	CMM_STORE_SHARED(session_table_full, false);
+
+	for (level = 0; level < SE_WHEEL_LEVELS && todo; level++) {
+		idx = se_wheel.sw_base >> (SE_WHEEL_BITS * level);
+
+		for (i = 0; i < SE_WHEEL_SLOTS && todo; i++) {
+			slot = &se_wheel.sw_slot[level][(idx + i) &
+							 SE_WHEEL_MASK];
+
+			cds_list_for_each_entry_safe(s, tmp, slot,
+						     se_gc_link) {
+				if (!se_early_drop_ok(s))
+					continue;
+
+				/* Queued, so it is being looked at anyway */
+				if (!rte_atomic16_test_and_set(
+					    &s->se_gc_queued))
+					continue;
+
+				cds_list_del_init(&s->se_gc_link);
+				se_expire(s);
+				session_gc_inspect(s, uptime);
+				session_early_drops++;
+				if (!--todo)
+					break;
+			}
+		}
+	}
+}
+
+static void session_gc_tick(uint64_t uptime)
+{
+	session_gc_drain(uptime);
+	se_wheel_run(uptime);
+	session_early_drop(uptime);
+	session_sync_flush();
 
 	/*
 	 * Reduce msg flood on a full session table.
 	 * See if we cleared some slots.  This will only limit
 	 * the number of error msgs until the next time GC is run.
 	 */
-	if (rte_atomic32_read(&sessions_used) < sessions_max)
+	if (slots_used() < (uint32_t)sessions_max)
 		session_gc_run = true;
 }
 
 static void
 sentry_gc(struct rte_timer *timer __rte_unused, void *arg __rte_unused)
 {
-	uint64_t uptime = get_dp_uptime();
-
-	/* Walk the sentry table */
-	sentry_gc_walk(uptime);
+	/* Inspect the sessions that are due */
+	session_gc_tick(get_dp_uptime());
 
 	/* Do it again, as long as we are running */
 	if (running)
@@ -564,6 +920,12 @@ unsigned long sentry_hash(const struct sentry_packet *sp)
 	return rte_jhash_32b(sp->sp_addrids, sp->sp_len, hash);
 }
 
+static ALWAYS_INLINE
+unsigned int sentry_shard(unsigned long hash)
+{
+	return (hash >> SENTRY_HT_SHARD_SHIFT) & (sentry_ht_shards - 1);
+}
+
 /*
  * sentry_table_lookup - Lookup a session based on a
  * packet decomp.
@@ -580,7 +942,8 @@ static int sentry_table_lookup(const struct sentry_packet *sp,
 		return -ENOENT;
 
 	hash = sentry_hash(sp);
-	cds_lfht_lookup(sentry_ht, hash, sentry_match, sp, &iter);
+	cds_lfht_lookup(sentry_ht[sentry_shard(hash)], hash, sentry_match, sp,
+			&iter);
 	snode = cds_lfht_iter_get_node(&iter);
 	if (!snode)
 		return -ENOENT;
@@ -595,17 +958,27 @@ static int sentry_insert(const struct sentry_packet *sp, struct sentry *sen,
 {
 	struct cds_lfht_node *node;
 	struct session *s = sen->sen_session;
+	unsigned long hash = sentry_hash(sp);
 
-	node = cds_lfht_add_unique(sentry_ht, sentry_hash(sp), sentry_match,
-			sp, &sen->sen_node);
+	/* Serialised with the GC reclaiming the sentries of the session */
+	rte_spinlock_lock(&s->se_sen_lock);
+
+	sen->sen_shard = sentry_shard(hash);
+	node = cds_lfht_add_unique(sentry_ht[sen->sen_shard], hash,
+			sentry_match, sp, &sen->sen_node);
 	if (node != &sen->sen_node) {
+		rte_spinlock_unlock(&s->se_sen_lock);
 		*old = caa_container_of(node, struct sentry, sen_node);
 		return -EEXIST;
 	}
 
+	cds_list_add(&sen->sen_link, &s->se_sentries);
+
 	/* session sentry count */
 	rte_atomic16_inc(&s->se_sen_cnt);
 
+	rte_spinlock_unlock(&s->se_sen_lock);
+
 	return 0;
 }
 
@@ -632,15 +1005,18 @@ int sentry_table_walk(sentry_walk_t cb, void *data)
 {
 	struct cds_lfht_iter iter;
 	struct sentry *sen;
+	unsigned int i;
 	int rc = 0;
 
 	if (!cb)
 		return -ENOENT;
 
-	cds_lfht_for_each_entry(sentry_ht, &iter, sen, sen_node) {
-		rc = cb(sen, data);
-		if (rc)
-			break;
+	FOREACH_SENTRY_SHARD(i) {
+		cds_lfht_for_each_entry(sentry_ht[i], &iter, sen, sen_node) {
+			rc = cb(sen, data);
+			if (rc)
+				return rc;
+		}
 	}
 	return rc;
 }
@@ -698,8 +1074,10 @@ int session_table_destroy_all(void)
 {
 	long dummy;
 	unsigned long count;
+	unsigned long total = 0;
 	struct cds_lfht_iter iter;
-	struct sentry *sen;
+	struct session *s;
+	unsigned int i;
 
 	/*
 	 * Forcibly delete all existing sessions by
@@ -709,11 +1087,20 @@ int session_table_destroy_all(void)
 	 * perform cleanup correctly.
 	 */
 	if (rte_atomic32_read(&sessions_used)) {
-		cds_lfht_for_each_entry(sentry_ht, &iter, sen, sen_node) {
-			se_expire(sen->sen_session);
-			sentry_gc_inspect(sen, 0);
+		cds_lfht_for_each_entry(session_ht, &iter, s, se_node) {
+			se_expire(s);
+			session_gc_kick(s);
 		}
 
+		/*
+		 * Parents are requeued until their children unlink, so
+		 * allow a pass per level of nesting.
+		 */
+		for (i = 0; i < SESSION_DESTROY_PASSES &&
+			     !cds_wfcq_empty(&se_gc_queue_head,
+					     &se_gc_queue_tail); i++)
+			session_gc_drain(0);
+
 		/*
 		 * Poll the rcu counter to ensure that all
 		 * call_rcu items have been cleaned up.
@@ -723,17 +1110,26 @@ int session_table_destroy_all(void)
 	}
 
 	/* For UT purposes, ensure we have nothing left. */
-	cds_lfht_count_nodes(sentry_ht, &dummy, &count, &dummy);
-	return count;
+	FOREACH_SENTRY_SHARD(i) {
+		cds_lfht_count_nodes(sentry_ht[i], &dummy, &count, &dummy);
+		total += count;
+	}
+	return total;
 }
 
 /* Get counts of nodes in sentry and session ht's - for UTs */
 void session_table_counts(unsigned long *sen_ht, unsigned long *sess_ht)
 
 {
+	unsigned long count;
+	unsigned int i;
 	long dummy;
 
-	cds_lfht_count_nodes(sentry_ht, &dummy, sen_ht, &dummy);
+	*sen_ht = 0;
+	FOREACH_SENTRY_SHARD(i) {
+		cds_lfht_count_nodes(sentry_ht[i], &dummy, &count, &dummy);
+		*sen_ht += count;
+	}
 	cds_lfht_count_nodes(session_ht, &dummy, sess_ht, &dummy);
 }
 
@@ -742,16 +1138,78 @@ void session_table_counts(unsigned long *sen_ht, unsigned long *sess_ht)
  */
 void session_counts(uint32_t *used, uint32_t *max, struct session_counts *sc)
 {
-	*used = rte_atomic32_read(&sessions_used);
+	*used = slots_used();
 	*max = sessions_max;
+	sc->sc_early_drop = session_early_drops;
 
 	session_table_walk(se_counts, sc);
 }
 
+/* Buckets for a table of up to this many entries */
+static unsigned long se_ht_buckets(unsigned long entries, unsigned int tables)
+{
+	unsigned long size = rte_align64pow2(entries) / tables;
+
+	return RTE_MIN(RTE_MAX(size, RTE_MAX(SENTRY_HT_MIN / tables, 256ul)),
+		       SENTRY_HT_MAX / tables);
+}
+
+/* Size the tables to hold the session limit */
+static void se_ht_resize(void)
+{
+	unsigned long sess_size = se_ht_buckets(sessions_max, 1);
+	unsigned long sen_size = se_ht_buckets(2ul * sessions_max,
+					       sentry_ht_shards);
+	uint64_t start;
+	unsigned int i;
+
+	if (!session_ht)
+		return;
+
+	if (sess_size == se_ht_stats.sh_sess_buckets &&
+	    sen_size == se_ht_stats.sh_sen_buckets)
+		return;
+
+	if (sess_size > se_ht_stats.sh_sess_buckets)
+		se_ht_stats.sh_grows++;
+	else
+		se_ht_stats.sh_shrinks++;
+
+	start = rte_get_timer_cycles();
+	cds_lfht_resize(session_ht, sess_size);
+	FOREACH_SENTRY_SHARD(i)
+		cds_lfht_resize(sentry_ht[i], sen_size);
+	se_ht_stats.sh_last_us = (rte_get_timer_cycles() - start) *
+		USEC_PER_SEC / rte_get_timer_hz();
+
+	se_ht_stats.sh_sess_buckets = sess_size;
+	se_ht_stats.sh_sen_buckets = sen_size;
+}
+
+void session_ht_stats(struct session_ht_stats *st)
+{
+	*st = se_ht_stats;
+	st->sh_sen_shards = sentry_ht_shards;
+}
+
 /* Set the max session limit */
 void session_set_max_sessions(uint32_t count)
 {
 	sessions_max = count ? count : DEFAULT_MAX_SESSIONS;
+	se_ht_resize();
+}
+
+/* Set the number of sessions to reclaim per GC run once full */
+void session_set_early_drop(uint32_t batch)
+{
+	CMM_STORE_SHARED(session_early_drop_batch, batch);
+}
+
+/* Cached slots are counted as used, which errs towards pressure */
+bool session_table_above(uint32_t percent)
+{
+	return (uint64_t)rte_atomic32_read(&sessions_used) * 100 >=
+		(uint64_t)sessions_max * percent;
 }
 
 void session_set_global_logging_cfg(struct session_log_cfg *scfg)
@@ -762,16 +1220,45 @@ void session_set_global_logging_cfg(struct session_log_cfg *scfg)
 /* Init the hash tables */
 static void init_tables(void)
 {
-	sentry_ht = cds_lfht_new(SENTRY_HT_INIT, SENTRY_HT_MIN, SENTRY_HT_MAX,
-			CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING, NULL);
+	unsigned int i;
+
+	/* Round the configured number of shards down to a power of 2 */
+	if (config.session_shards > 1) {
+		sentry_ht_shards = rte_align32pow2(
+			RTE_MIN(config.session_shards,
+				SENTRY_HT_SHARDS_MAX) + 1) >> 1;
+		session_slot_cache_enabled = true;
+	}
+
+	/* The shards share the sizing of the unsharded table */
+	FOREACH_SENTRY_SHARD(i) {
+		sentry_ht[i] = cds_lfht_new(
+			se_ht_buckets(2ul * sessions_max, sentry_ht_shards),
+			RTE_MAX(SENTRY_HT_MIN / sentry_ht_shards, 256u),
+			SENTRY_HT_MAX / sentry_ht_shards, 0, NULL);
+		if (!sentry_ht[i])
+			rte_panic("Can't allocate sentry hash table\n");
+	}
+
+	for (i = 0; i < SE_WHEEL_LEVELS * SE_WHEEL_SLOTS; i++)
+		CDS_INIT_LIST_HEAD(&se_wheel.sw_slot[i / SE_WHEEL_SLOTS]
+				   [i % SE_WHEEL_SLOTS]);
+	se_wheel.sw_base = get_dp_uptime();
+	cds_wfcq_init(&se_gc_queue_head, &se_gc_queue_tail);
 
 	rte_timer_init(&session_gc_timer);
 	rte_timer_reset(&session_gc_timer,
 			SENTRY_GC_INTERVAL * rte_get_timer_hz(),
 			SINGLE, rte_get_master_lcore(), sentry_gc, NULL);
 
-	session_ht = cds_lfht_new(SENTRY_HT_INIT, SENTRY_HT_MIN, SENTRY_HT_MAX,
-			CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING, NULL);
+	session_ht = cds_lfht_new(se_ht_buckets(sessions_max, 1),
+				  SENTRY_HT_MIN, SENTRY_HT_MAX, 0, NULL);
+	if (!session_ht)
+		rte_panic("Can't allocate session hash table\n");
+
+	se_ht_stats.sh_sess_buckets = se_ht_buckets(sessions_max, 1);
+	se_ht_stats.sh_sen_buckets = se_ht_buckets(2ul * sessions_max,
+						   sentry_ht_shards);
 }
 
 static ALWAYS_INLINE
@@ -868,6 +1355,31 @@ static int se_parse_ids(struct rte_mbuf *m,
 	return 0;
 }
 
+/*
+ * Take the ids from the L4 header parsed by the firewall, if it has
+ * parsed the header at this offset.  Returns false if the packet must
+ * be parsed.
+ */
+static ALWAYS_INLINE
+bool se_mdata_ids(const struct pkt_mdata_l4 *ml, uint16_t off,
+		  uint8_t ipproto, uint16_t *sid, uint16_t *did)
+{
+	if (!ml || ml->ml_l4_offs != off || ml->ml_proto != ipproto)
+		return false;
+
+	if (ml->ml_flags & PKT_MDATA_L4_PORTS) {
+		*sid = ml->ml_sport;
+		*did = ml->ml_dport;
+		return true;
+	}
+	if (ml->ml_flags & PKT_MDATA_L4_ECHO) {
+		*sid = ml->ml_id;
+		*did = ml->ml_id;
+		return true;
+	}
+	return false;
+}
+
 static int pkt_parse_ipv4(struct rte_mbuf *m, uint32_t if_index,
 		struct sentry_packet *sp)
 {
@@ -895,9 +1407,12 @@ static int pkt_parse_ipv4(struct rte_mbuf *m, uint32_t if_index,
 	sp->sp_len = SENTRY_LEN_IPV4;
 
 	off = pktmbuf_l2_len(m) + pktmbuf_l3_len(m);
-	rc = se_parse_ids(m, off, ip->protocol, &sid, &did);
-	if (rc)
-		return rc;
+	if (!se_mdata_ids(pktmbuf_mdata_l4(m, pktmbuf_l2_len(m)), off,
+			  ip->protocol, &sid, &did)) {
+		rc = se_parse_ids(m, off, ip->protocol, &sid, &did);
+		if (rc)
+			return rc;
+	}
 
 	/*
 	 * Now pack the 'addrids' array:
@@ -915,6 +1430,7 @@ static int pkt_parse_ipv4(struct rte_mbuf *m, uint32_t if_index,
 static int pkt_parse_ipv6(struct rte_mbuf *m, uint32_t if_index,
 		struct sentry_packet *sp)
 {
+	const struct pkt_mdata_l4 *ml;
 	uint16_t off;
 	uint8_t ipproto;
 	uint16_t sid;
@@ -923,9 +1439,18 @@ static int pkt_parse_ipv6(struct rte_mbuf *m, uint32_t if_index,
 
 	/*
 	 * Skip to the payload header and copy the two words
-	 * we need for the sentry ids.
+	 * we need for the sentry ids.  The firewall cache does not
+	 * look into IPv6 in IPv6, so parse those ourselves.
 	 */
-	ipproto = ip6_findpayload(m, &off);
+	ml = pktmbuf_mdata_l4(m, pktmbuf_l2_len(m));
+	if (ml && ml->ml_proto != IPPROTO_IPV6 &&
+	    ml->ml_proto != IPPROTO_NONE) {
+		ipproto = ml->ml_proto;
+		off = ml->ml_l4_offs;
+	} else {
+		ml = NULL;
+		ipproto = ip6_findpayload(m, &off);
+	}
 
 	sp->sp_ifindex = if_index;
 	sp->sp_protocol = ipproto;
@@ -937,9 +1462,11 @@ static int pkt_parse_ipv6(struct rte_mbuf *m, uint32_t if_index,
 
 	struct ip6_hdr *ip6 = ip6hdr(m);
 
-	rc = se_parse_ids(m, off, ipproto, &sid, &did);
-	if (rc)
-		return rc;
+	if (!se_mdata_ids(ml, off, ipproto, &sid, &did)) {
+		rc = se_parse_ids(m, off, ipproto, &sid, &did);
+		if (rc)
+			return rc;
+	}
 
 	/*
 	 * Now pack 'addrids':
@@ -1046,15 +1573,86 @@ int session_lookup(struct rte_mbuf *m, uint32_t if_index,
 	return 0;
 }
 
+/* Is a usable sentry already cached on the packet? */
+static ALWAYS_INLINE bool sentry_cached(struct rte_mbuf *m, uint32_t if_index)
+{
+	struct sentry *sen;
+
+	if (!pktmbuf_mdata_exists(m, PKT_MDATA_SESSION_SENTRY))
+		return false;
+
+	sen = pktmbuf_mdata(m)->md_sentry;
+	return !(sen->sen_session->se_flags & SESSION_EXPIRED) &&
+		sen->sen_ifindex == if_index;
+}
+
+/*
+ * Find the sessions of a burst of packets.
+ *
+ * All of the sentry packets are decomposed and hashed up front, so
+ * that the table lookups run back to back and their bucket misses
+ * can overlap, rather than each waiting on the parsing of its own
+ * packet.  Matches are cached on the packet, where session_lookup()
+ * will pick them up.  Packets which do not match are left for
+ * session_lookup() to retry.
+ */
+void session_lookup_bulk(struct rte_mbuf **m, const uint32_t *if_index,
+			 unsigned int n)
+{
+	struct sentry_packet sp[SESSION_LOOKUP_BULK_MAX];
+	unsigned long hash[SESSION_LOOKUP_BULK_MAX];
+	bool valid[SESSION_LOOKUP_BULK_MAX];
+	struct cds_lfht_node *snode;
+	struct cds_lfht_iter iter;
+	struct sentry *sen;
+	unsigned int i;
+
+	/* Any? */
+	if (!rte_atomic32_read(&sessions_used))
+		return;
+
+	while (n) {
+		unsigned int burst = RTE_MIN(n, SESSION_LOOKUP_BULK_MAX);
+
+		for (i = 0; i < burst; i++) {
+			valid[i] = !sentry_cached(m[i], if_index[i]) &&
+				!sentry_packet_from_mbuf(m[i], if_index[i],
+							 &sp[i]);
+			if (valid[i])
+				hash[i] = sentry_hash(&sp[i]);
+		}
+
+		for (i = 0; i < burst; i++) {
+			if (!valid[i])
+				continue;
+
+			cds_lfht_lookup(sentry_ht[sentry_shard(hash[i])],
+					hash[i], sentry_match, &sp[i], &iter);
+			snode = cds_lfht_iter_get_node(&iter);
+			if (!snode)
+				continue;
+
+			sen = caa_container_of(snode, struct sentry, sen_node);
+			cache_sentry(m[i], sen);
+
+			struct session *s = sen->sen_session;
+			if (s->se_idle)
+				s->se_idle = 0;
+		}
+
+		m += burst;
+		if_index += burst;
+		n -= burst;
+	}
+}
+
 static struct sentry *sentry_create(struct session *s,
 		uint16_t flag, struct sentry_packet *sp)
 {
 	struct sentry *sen;
-	size_t sz;
 	int i;
 
-	sz = sizeof(struct sentry) + (sp->sp_len * sizeof(uint32_t));
-	sen = malloc(sz);
+	sen = se_pool_zalloc(sentry_pool);
 	if (!sen)
 		return NULL;
 
@@ -1069,7 +1667,7 @@ static struct sentry *sentry_create(struct session *s,
 	     sp->sp_len > SENTRY_LEN_IPV6) ||
 	    (sp->sp_sentry_flags & SENTRY_IPv4 &&
 	     sp->sp_len > SENTRY_LEN_IPV4)) {
-		free(sen);
+		se_pool_free(sentry_pool, sen);
 		return NULL;
 	}
 
@@ -1190,9 +1788,13 @@ static struct session *se_alloc(void)
 {
 	struct session *s;
 
-	s = zmalloc_aligned(sizeof(struct session));
+	s = se_pool_zalloc(session_pool);
 	if (s) {
 		cds_lfht_node_init(&s->se_node);
+		rte_spinlock_init(&s->se_sen_lock);
+		CDS_INIT_LIST_HEAD(&s->se_sentries);
+		CDS_INIT_LIST_HEAD(&s->se_gc_link);
+		s->se_sync_state = SESSION_SYNC_NONE;
 		s->se_id = rte_atomic64_add_return(&session_id, 1);
 	}
 
@@ -1266,8 +1868,13 @@ int session_establish(struct rte_mbuf *m, const struct ifnet *ifp,
 void session_set_protocol_state_timeout(struct session *s, uint8_t state,
 		uint32_t timeout)
 {
+	/* The GC may not otherwise look at the session until the old timeout */
+	bool sooner = timeout < s->se_timeout;
+
 	s->se_timeout = timeout;
 	s->se_protocol_state = state;
+	if (sooner)
+		session_gc_kick(s);
 }
 
 /* Insert forw/back sentries based on packet. */
@@ -1622,6 +2229,7 @@ int session_create_from_sentry_packets(struct rte_mbuf *m,
 	/* Add the session to the session hash table.  */
 	cds_lfht_add(session_ht, s->se_id, &s->se_node);
 	s->se_flags = SESSION_INSERTED;
+	session_gc_kick(s);
 
 	cache_sentry(m, sen_forw);
 
@@ -1645,16 +2253,36 @@ int session_lookup_by_sentry_packet(const struct sentry_packet *sp,
 	return rc;
 }
 
+/*
+ * Inspect every session, regardless of when it is due.  The wheel is
+ * not turned, so that a simulated time does not skew it.
+ */
+static void session_gc_walk_all(uint64_t uptime)
+{
+	struct cds_lfht_iter iter;
+	struct session *s;
+
+	session_gc_drain(uptime);
+
+	cds_lfht_for_each_entry(session_ht, &iter, s, se_node) {
+		if (!rte_atomic16_test_and_set(&s->se_gc_queued))
+			continue;
+		cds_list_del_init(&s->se_gc_link);
+		session_gc_inspect(s, uptime);
+	}
+	session_sync_flush();
+}
+
 /* Used by session UTs to simulate the GC clearing out idle sessions */
 void session_gc(void)
 {
 	uint64_t uptime = get_dp_uptime();
 
 	/* Sets the idle flag on each session */
-	sentry_gc_walk(uptime);
+	session_gc_walk_all(uptime);
 
 	/* Simulate time into the future */
-	sentry_gc_walk(uptime + (10 * SENTRY_GC_INTERVAL));
+	session_gc_walk_all(uptime + (10 * SENTRY_GC_INTERVAL));
 }
 
 /* Allocate/init a session struct (for session syncing) */
@@ -1665,6 +2293,10 @@ struct session *session_alloc(void)
 
 void session_init(void)
 {
+	session_pool = se_pool_create("session", sizeof(struct session),
+				      SESSION_POOL_SIZE, DP_MEM_SESSION);
+	sentry_pool = se_pool_create("sentry", SENTRY_POOL_OBJ_SIZE,
+				     SENTRY_POOL_SIZE, DP_MEM_SESSION);
 	init_tables();
 	session_feature_init();
 }
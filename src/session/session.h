@@ -15,6 +15,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <urcu/list.h>
+#include <urcu/wfcqueue.h>
 
 #include "if_var.h"
 #include "urcu.h"
@@ -55,6 +56,9 @@ enum session_feature_type {
 #define SESSION_NAT		0x02	/* This session was natted */
 #define SESSION_INSERTED	0x04	/* Inserted in session ht */
 
+/* se_sync_state of a session never sent to the standby */
+#define SESSION_SYNC_NONE	0xff
+
 enum session_log_event {
 	SESSION_LOG_CREATION,
 	SESSION_LOG_DELETION,
@@ -128,6 +132,8 @@ struct sentry {
 	uint16_t		sen_flags;
 	uint8_t			sen_len;
 	uint8_t			sen_protocol;
+	uint8_t			sen_shard;	/* sentry table shard */
+	struct cds_list_head	sen_link;	/* on session se_sentries */
 	uint32_t		sen_addrids[];	/* ids/addrs, must be last */
 };
 
@@ -170,7 +176,7 @@ struct session {
 	rte_atomic16_t		se_sen_cnt;	/* Sentry count */
 	uint16_t		se_flags;
 	uint8_t			se_protocol;
-	uint8_t			pad[1];
+	uint8_t			se_sync_state;	/* state last synced */
 	struct session_link	*se_link;	/* For linking of sessions */
 	struct sentry		*se_sen;	/* Cached INIT sentry */
 	uint64_t		se_id;		/* id of this session */
@@ -188,9 +194,20 @@ struct session {
 	uint8_t			se_log_creation:1;
 	uint8_t			se_log_deletion:1;
 	uint8_t			se_log_periodic:1;
+	rte_atomic16_t		se_feature_overflow; /* # not in se_feat */
 	uint32_t		se_log_interval;
 	uint64_t		se_ltime;	/* time of next periodic log */
 	uint64_t		se_create_time;	/* time session was created */
+	rte_spinlock_t		se_sen_lock;	/* Protects se_sentries */
+	struct cds_list_head	se_sentries;	/* Hashed sentries */
+	/* GC timing wheel, only accessed by the GC */
+	struct cds_list_head	se_gc_link;
+	uint64_t		se_gc_due;	/* Time next due for the GC */
+	/* Queued for the GC, and the token for reclaiming by it */
+	struct cds_wfcq_node	se_gc_qnode;
+	rte_atomic16_t		se_gc_queued;
+	/* First feature datum of each type, the rest are only hashed */
+	struct session_feature	*se_feat[SESSION_FEATURE_END];
 };
 
 /* For UTs, counts of various sessions */
@@ -203,6 +220,7 @@ struct session_counts {
 	uint32_t	sc_icmp;	/* icmp sessions */
 	uint32_t	sc_icmp6;	/* icmp-v6 sessions */
 	uint32_t	sc_other;	/* All else */
+	uint64_t	sc_early_drop;	/* reclaimed to make room */
 	/* Counts of various feature types */
 	uint32_t	sc_feature_counts[SESSION_FEATURE_END+1];
 };
@@ -357,6 +375,25 @@ int session_establish(struct rte_mbuf *m, const struct ifnet *ifp,
 int session_lookup(struct rte_mbuf *m, uint32_t if_index, struct session **s,
 		bool *forw);
 
+/* Maximum burst handled by one pass of session_lookup_bulk() */
+#define SESSION_LOOKUP_BULK_MAX 32
+
+/**
+ * Lookup the sessions of a burst of packets.
+ *
+ * @param m
+ * The packets to match.
+ * @param if_index
+ * The interface index to match each packet against.
+ * @param n
+ * The number of packets.
+ *
+ * Matched sentries are cached on the packets, so that a subsequent
+ * session_lookup() of each is satisfied without a table lookup.
+ */
+void session_lookup_bulk(struct rte_mbuf **m, const uint32_t *if_index,
+			 unsigned int n);
+
 /**
  * Expire a session.
  *
@@ -437,6 +474,29 @@ int session_sentry_insert(struct session *m, uint32_t if_index, uint16_t flags,
  */
 void session_set_max_sessions(uint32_t max);
 
+/**
+ * Early drop
+ *
+ * Called by CLI only.  Once the table is full, sessions other than
+ * established TCP are reclaimed by the GC to make room.
+ *
+ * @param batch
+ * Sessions reclaimed per GC run, 0 to disable.
+ */
+void session_set_early_drop(uint32_t batch);
+
+/**
+ * Session table pressure
+ *
+ * Called on the forwarding path, so only reads the shared count.
+ *
+ * @param percent
+ * Share of the max session limit.
+ *
+ * @return true if at least that share of the sessions is in use.
+ */
+bool session_table_above(uint32_t percent);
+
 /**
  * Set global logging configuration
  *
@@ -463,6 +523,27 @@ void session_set_global_logging_cfg(struct session_log_cfg *scfg);
  */
 void session_counts(uint32_t *used, uint32_t *max, struct session_counts *sc);
 
+/* Sizing of the session and sentry hash tables */
+struct session_ht_stats {
+	unsigned long	sh_sess_buckets;
+	unsigned long	sh_sen_buckets;		/* in each shard */
+	unsigned int	sh_sen_shards;
+	uint32_t	sh_grows;
+	uint32_t	sh_shrinks;
+	uint64_t	sh_last_us;		/* time the last resize took */
+};
+
+/**
+ * Hash table sizing.
+ *
+ * The tables are sized for the session limit rather than resized as
+ * they fill, so only change when the limit is set.
+ *
+ * @param st
+ * Filled in with the current sizes and resize counts.
+ */
+void session_ht_stats(struct session_ht_stats *st);
+
 /**
  * hash table counts.
  *
@@ -22,10 +22,13 @@
 #include "compiler.h"
 #include "json_writer.h"
 #include "npf_shim.h"
+#include "protobuf/SessionDump.pb-c.h"
+#include "protobuf_util.h"
 #include "session.h"
 #include "session_cmds.h"
 #include "session_feature.h"
 #include "session_private.h"
+#include "session_sync.h"
 #include "urcu.h"
 #include "util.h"
 #include "vplane_log.h"
@@ -59,6 +62,7 @@ struct session_dump {
 	int	sd_count;
 	void	*sd_data;
 	bool	sd_features;
+	bool	sd_more;	/* stopped with sessions left */
 	uint8_t sd_filter;
 };
 
@@ -148,6 +152,16 @@ static int cmd_feature_json(struct session *s __unused,
 	return 0;
 }
 
+static int session_time_to_expire(const struct session *s)
+{
+	if (s->se_flags & SESSION_EXPIRED)
+		return 0;
+	if (!s->se_etime)
+		return s->se_custom_timeout ?
+			s->se_custom_timeout : s->se_timeout;
+	return (int) (s->se_etime - get_dp_uptime());
+}
+
 static int cmd_session_json(struct session *s, void *data)
 {
 	struct session_dump *sd = data;
@@ -207,15 +221,7 @@ static int cmd_session_json(struct session *s, void *data)
 	jsonw_uint_field(json, "proto", s->se_protocol);
 	jsonw_string_field(json, "interface", ifnet_indextoname_safe(if_index));
 
-	if (s->se_flags & SESSION_EXPIRED)
-		tmp = 0;
-	else if (!s->se_etime)
-		tmp = s->se_custom_timeout ?
-			s->se_custom_timeout : s->se_timeout;
-	else
-		tmp = (int) (s->se_etime - get_dp_uptime());
-
-	jsonw_int_field(json, "time_to_expire", tmp);
+	jsonw_int_field(json, "time_to_expire", session_time_to_expire(s));
 	jsonw_int_field(json, "state_expire_window", s->se_timeout);
 	jsonw_int_field(json, "state", s->se_protocol_state);
 
@@ -284,6 +290,7 @@ static void cmd_session_show_summary(FILE *fp)
 	uint32_t sessions_used;
 	uint32_t sessions_max;
 	struct session_counts sc = { 0 };
+	struct session_ht_stats st;
 
 	json = jsonw_new(fp);
 	if (!json)
@@ -302,6 +309,18 @@ static void cmd_session_show_summary(FILE *fp)
 	jsonw_uint_field(json, "nat", sc.sc_nat);
 	jsonw_uint_field(json, "nat64", sc.sc_nat64);
 	jsonw_uint_field(json, "nat46", sc.sc_nat46);
+	jsonw_uint_field(json, "early_drop", sc.sc_early_drop);
+
+	session_ht_stats(&st);
+	jsonw_name(json, "hash_tables");
+	jsonw_start_object(json);
+	jsonw_uint_field(json, "session_buckets", st.sh_sess_buckets);
+	jsonw_uint_field(json, "sentry_buckets", st.sh_sen_buckets);
+	jsonw_uint_field(json, "sentry_shards", st.sh_sen_shards);
+	jsonw_uint_field(json, "grows", st.sh_grows);
+	jsonw_uint_field(json, "shrinks", st.sh_shrinks);
+	jsonw_uint_field(json, "last_resize_us", st.sh_last_us);
+	jsonw_end_object(json);
 
 	npf_print_state_stats(json);
 
@@ -341,6 +360,102 @@ static void cmd_session_show(FILE *fp, bool features, uint8_t filter,
 	jsonw_destroy(&json);
 }
 
+/* Fill in the message for a session, false if it has no sentry */
+bool session_pb_fill(struct session *s, SessionDump__Session *msg,
+		     IPAddress *src_addr, IPAddress *dst_addr)
+{
+	struct sentry *init_sen = rcu_dereference(s->se_sen);
+	uint32_t if_index;
+	const void *saddr;
+	const void *daddr;
+	uint16_t sid;
+	uint16_t did;
+	int af;
+
+	/* No sentry?  (racing with expiration) */
+	if (!init_sen)
+		return false;
+
+	session_sentry_extract(init_sen, &if_index, &af, &saddr, &sid, &daddr,
+			&did);
+	protobuf_set_ipaddr(src_addr, af, saddr);
+	protobuf_set_ipaddr(dst_addr, af, daddr);
+
+	session_dump__session__init(msg);
+	msg->has_id = true;
+	msg->id = s->se_id;
+	msg->has_vrf_id = true;
+	msg->vrf_id = s->se_vrfid;
+	msg->has_protocol = true;
+	msg->protocol = s->se_protocol;
+	msg->src_addr = src_addr;
+	msg->has_src_port = true;
+	msg->src_port = ntohs(sid);
+	msg->dst_addr = dst_addr;
+	msg->has_dst_port = true;
+	msg->dst_port = ntohs(did);
+	msg->has_if_index = true;
+	msg->if_index = if_index;
+	msg->has_time_to_expire = true;
+	msg->time_to_expire = session_time_to_expire(s);
+	msg->has_state_expire_window = true;
+	msg->state_expire_window = s->se_timeout;
+	msg->has_state = true;
+	msg->state = s->se_protocol_state;
+	if (s->se_link && s->se_link->sl_parent) {
+		msg->has_parent = true;
+		msg->parent = s->se_link->sl_parent->se_id;
+	}
+	return true;
+}
+
+static int cmd_session_pb(struct session *s, void *data)
+{
+	struct session_dump *sd = data;
+	SessionDump__Session msg;
+	IPAddress src_addr, dst_addr;
+
+	/* Skip? */
+	if (sd->sd_start-- > 0)
+		return 0;
+
+	/* Filled? */
+	if (sd->sd_count-- <= 0) {
+		sd->sd_more = true;
+		return -1;  /* Stop walk we are full */
+	}
+
+	if (session_pb_fill(s, &msg, &src_addr, &dst_addr))
+		protobuf_file_put_message(sd->sd_data, 1, &msg.base);
+	return 0;
+}
+
+/*
+ * Binary dump of the session table, as a SessionDump message. The
+ * sessions are written straight out one by one rather than built up
+ * as a repeated field first.
+ */
+static void cmd_session_show_pb(FILE *fp, int start, int count)
+{
+	struct protobuf_file_buffer buf;
+	struct session_dump sd = {
+		.sd_fp = fp,
+		.sd_start = start,
+		.sd_count = count,
+		.sd_data = &buf,
+	};
+
+	if (count <= 0 || count >= MAX_JSON_SESSIONS)
+		sd.sd_count = MAX_JSON_SESSIONS;
+	count = sd.sd_count;
+
+	protobuf_file_buffer_init(&buf, fp);
+	session_table_walk(cmd_session_pb, &sd);
+
+	if (sd.sd_more)
+		protobuf_file_put_varint(&buf, 2, start + count);
+}
+
 static void cmd_sentries_show(FILE *fp, int start, int count)
 {
 	struct session_dump sd;
@@ -783,6 +898,20 @@ static int cmd_op_walk_sessions(FILE *f, int argc, char **argv)
 	return 0;
 }
 
+static int cmd_op_walk_sessions_pb(FILE *f, int argc, char **argv)
+{
+	int start = 0;
+	int count = 0;
+	int rc;
+
+	rc = cmd_parse_limits(f, argc, argv, &start, &count);
+	if (rc)
+		return rc;
+
+	cmd_session_show_pb(f, start, count);
+	return 0;
+}
+
 static int cmd_op_walk_sessions_full(FILE *f, int argc, char **argv)
 {
 	int start = 0;
@@ -866,6 +995,30 @@ static int cmd_cfg_max_sessions(FILE *f, int argc, char **argv)
 	return 0;
 }
 
+/* "early-drop off|<sessions per GC run>" */
+static int cmd_cfg_early_drop(FILE *f, int argc, char **argv)
+{
+	long batch;
+
+	if (!argc) {
+		cmd_err(f, "missing early-drop batch");
+		return -EINVAL;
+	}
+
+	if (!strcmp(argv[0], "off")) {
+		session_set_early_drop(0);
+		return 0;
+	}
+
+	batch = arg_to_long(argv[0]);
+	if (batch <= 0 || batch > UINT_MAX) {
+		cmd_err(f, "invalid early-drop batch: %s", argv[0]);
+		return -EINVAL;
+	}
+	session_set_early_drop(batch);
+	return 0;
+}
+
 /*
  * Parse a session log item with optional value. Currently supported are:
  * "creation=on|off", "deletion=on|off", "periodic=<time-in-seconds>".
@@ -953,8 +1106,29 @@ static int cmd_cfg_session_logging(FILE *f, int argc, char **argv)
 	return 0;
 }
 
+/*
+ * Stream session changes to a standby: "sync <endpoint>" to publish
+ * on a ZMQ endpoint, e.g. tcp://10.0.0.1:5910, or "sync off".
+ */
+static int cmd_cfg_session_sync(FILE *f, int argc, char **argv)
+{
+	int rc;
+
+	if (argc != 1) {
+		cmd_err(f, "session: sync needs an endpoint or off");
+		return -EINVAL;
+	}
+
+	rc = session_sync_set_endpoint(strcmp(argv[0], "off") ?
+				       argv[0] : NULL);
+	if (rc)
+		cmd_err(f, "session: sync to %s failed", argv[0]);
+	return rc;
+}
+
 enum cmd_op {
 	OP_SHOW_SESSIONS_SUMMARY,
+	OP_SHOW_SESSIONS_PB,
 	OP_SHOW_SESSIONS_NAT,
 	OP_SHOW_SESSIONS_NAT64,
 	OP_SHOW_SESSIONS_NAT46,
@@ -966,6 +1140,8 @@ enum cmd_op {
 enum cmd_cfg {
 	CFG_MAX_SESSIONS,
 	CFG_LOGGING,
+	CFG_SYNC,
+	CFG_EARLY_DROP,
 };
 
 static const struct session_command session_cmd_op[] = {
@@ -973,6 +1149,10 @@ static const struct session_command session_cmd_op[] = {
 		.tokens = "show sessions summary",
 		.handler = cmd_op_walk_sessions_summary,
 	},
+	[OP_SHOW_SESSIONS_PB] = {
+		.tokens = "show sessions pb",
+		.handler = cmd_op_walk_sessions_pb,
+	},
 	[OP_SHOW_SESSIONS_NAT] = {
 		.tokens = "show sessions full",
 		.handler = cmd_op_walk_sessions_full,
@@ -1007,7 +1187,15 @@ static const struct session_command session_cmd_cfg[] = {
 	[CFG_LOGGING] = {
 		.tokens = "logging",
 		.handler = cmd_cfg_session_logging,
-	}
+	},
+	[CFG_SYNC] = {
+		.tokens = "sync",
+		.handler = cmd_cfg_session_sync,
+	},
+	[CFG_EARLY_DROP] = {
+		.tokens = "early-drop",
+		.handler = cmd_cfg_early_drop,
+	},
 };
 
 static __attribute__((constructor)) void
@@ -9,10 +9,19 @@
 #ifndef SESSION_CMDS_H
 #define SESSION_CMDS_H
 
+#include <stdbool.h>
 #include <stdio.h>
 
+#include "protobuf/SessionDump.pb-c.h"
+
+struct session;
+
 int cmd_session_op(FILE *f, int argc, char **argv);
 int cmd_session_ut(FILE *f, int argc, char **argv);
 int cmd_session_cfg(FILE *f, int argc, char **argv);
 
+/* Fill in the message for a session, false if it has no sentry */
+bool session_pb_fill(struct session *s, SessionDump__Session *msg,
+		     IPAddress *src_addr, IPAddress *dst_addr);
+
 #endif /* SESSION_CMDS_H */
@@ -8,9 +8,11 @@
 
 #include <errno.h>
 #include <rte_atomic.h>
+#include <rte_branch_prediction.h>
 #include <rte_jhash.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <urcu/uatomic.h>
 
 #include "compiler.h"
 #include "if_var.h"
@@ -48,6 +50,12 @@
  * the other for searching features by session.  See the comments in
  * session_table.c for the rational.
  *
+ * The first datum of each type added to a session is also kept in a
+ * slot in the session, so the usual lookup needs no hash lookup at all.
+ * Only a session with several interface-specific datums of one type
+ * counts any in se_feature_overflow, and only then is the feature hash
+ * searched when the slot does not match.
+ *
  * NOTE:
  * Although tempting, we cannot safely walk the feature hash table due to a
  * possible race.  The session GC will destroy features in a call_rcu context,
@@ -133,11 +141,17 @@ static void sf_rcu_destroy(struct rcu_head *h)
 /* Expire a feature */
 static void sf_expire(struct session_feature *sf)
 {
+	struct session *s = sf->sf_session;
+
 	/* Delete the feature from the feature tables, but only once.  */
 	if (cds_lfht_del(feature_ht, &sf->sf_node))
 		return;
 
-	rte_atomic16_dec(&sf->sf_session->se_feature_count);
+	rte_atomic16_dec(&s->se_feature_count);
+
+	/* Readers may still have it from the slot until the grace period */
+	if (uatomic_cmpxchg(&s->se_feat[sf->sf_type], sf, NULL) != sf)
+		rte_atomic16_dec(&s->se_feature_overflow);
 
 	cds_lfht_del(session_ht, &sf->sf_session_node);
 
@@ -165,6 +179,7 @@ static void sf_request_expiry(struct session_feature *sf)
 				(exp | SESS_FEAT_REQ_EXPIRY))) {
 		rte_atomic16_inc(&sf->sf_session->se_feature_exp_count);
 		sf->sf_expire_time = rte_get_timer_cycles();
+		session_gc_kick(sf->sf_session);
 	}
 }
 
@@ -175,12 +190,20 @@ static struct session_feature *sf_lookup(struct session *s,
 	struct cds_lfht_node *node;
 	struct cds_lfht_iter iter;
 	struct session_feature sf;
+	struct session_feature *slot;
 	unsigned long hash;
 
 	/*
 	 * For session-specific feature lookups, if_index == 0.
 	 * For interface-specific feature lookups, if_index != 0.
 	 */
+	slot = rcu_dereference(s->se_feat[type]);
+	if (likely(slot && (!if_index || slot->sf_idx == if_index)))
+		return slot;
+
+	if (likely(!rte_atomic16_read(&s->se_feature_overflow)))
+		return NULL;
+
 	sf.sf_idx = if_index;
 	sf.sf_session = s;
 	sf.sf_type = type;
@@ -229,6 +252,10 @@ int session_feature_add(struct session *s, uint32_t if_index,
 
 	cds_lfht_add(session_ht, s->se_id, &sf->sf_session_node);
 
+	/* Found from its slot, or through the hash as overflow */
+	if (uatomic_cmpxchg(&s->se_feat[type], NULL, sf) != NULL)
+		rte_atomic16_inc(&s->se_feature_overflow);
+
 	/* Possible race with session expiration, deal with it now */
 	if (s->se_flags & SESSION_EXPIRED)
 		sf_request_expiry(sf);
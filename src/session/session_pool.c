@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#include <rte_branch_prediction.h>
+#include <rte_debug.h>
+#include <rte_errno.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_mempool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dp_mem.h"
+#include "session_pool.h"
+#include "util.h"
+#include "vplane_log.h"
+
+/* Objects kept by each lcore before going to the shared ring */
+#define SE_POOL_CACHE_SIZE	256
+
+struct se_pool {
+	size_t			sp_size;
+	enum dp_mem_tag		sp_tag;
+	struct rte_mempool	*sp_mp[RTE_MAX_NUMA_NODES];
+};
+
+struct se_pool *se_pool_create(const char *name, size_t size,
+			       unsigned int count, enum dp_mem_tag tag)
+{
+	char mp_name[RTE_MEMPOOL_NAMESIZE];
+	struct se_pool *pool;
+	unsigned int socket;
+	unsigned int lcore;
+
+	pool = zmalloc_aligned(sizeof(*pool));
+	if (!pool)
+		rte_panic("Can't allocate %s pool\n", name);
+
+	pool->sp_size = size;
+	pool->sp_tag = tag;
+
+	RTE_LCORE_FOREACH(lcore) {
+		socket = rte_lcore_to_socket_id(lcore);
+		if (socket >= RTE_MAX_NUMA_NODES || pool->sp_mp[socket])
+			continue;
+
+		snprintf(mp_name, sizeof(mp_name), "%s_%u", name, socket);
+		pool->sp_mp[socket] = rte_mempool_create(
+			mp_name, count, size, SE_POOL_CACHE_SIZE, 0,
+			NULL, NULL, NULL, NULL, socket, 0);
+		if (!pool->sp_mp[socket])
+			RTE_LOG(NOTICE, DATAPLANE,
+				"%s pool on socket %u not created: %s\n",
+				name, socket, rte_strerror(rte_errno));
+	}
+
+	return pool;
+}
+
+/* Find the mempool that an object was allocated from, if any */
+static struct rte_mempool *se_pool_owner(struct se_pool *pool, void *obj)
+{
+	struct rte_mempool_memhdr *hdr;
+	struct rte_mempool *mp;
+	unsigned int socket;
+
+	for (socket = 0; socket < RTE_MAX_NUMA_NODES; socket++) {
+		mp = pool->sp_mp[socket];
+		if (!mp)
+			continue;
+
+		STAILQ_FOREACH(hdr, &mp->mem_list, next)
+			if ((char *)obj >= (char *)hdr->addr &&
+			    (char *)obj < (char *)hdr->addr + hdr->len)
+				return mp;
+	}
+
+	return NULL;
+}
+
+void *se_pool_zalloc(struct se_pool *pool)
+{
+	unsigned int socket = rte_socket_id();
+	struct rte_mempool *mp = NULL;
+	void *obj;
+
+	if (likely(socket < RTE_MAX_NUMA_NODES))
+		mp = pool->sp_mp[socket];
+
+	if (likely(mp && rte_mempool_get(mp, &obj) == 0)) {
+		memset(obj, 0, pool->sp_size);
+		dp_mem_account_alloc(pool->sp_tag, pool->sp_size);
+		return obj;
+	}
+
+	return dp_mem_zmalloc(pool->sp_tag, pool->sp_size);
+}
+
+void se_pool_free(struct se_pool *pool, void *obj)
+{
+	struct rte_mempool *mp;
+
+	if (!obj)
+		return;
+
+	/*
+	 * Off an lcore, e.g. from call_rcu, there is no cache and this
+	 * goes straight back to the shared ring of the owning socket.
+	 */
+	mp = se_pool_owner(pool, obj);
+	if (mp) {
+		dp_mem_account_free(pool->sp_tag, pool->sp_size);
+		rte_mempool_put(mp, obj);
+	} else
+		dp_mem_free(pool->sp_tag, obj, pool->sp_size);
+}
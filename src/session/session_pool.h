@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * NUMA-local object pools for session state.
+ *
+ * Each pool is a set of per-socket mempools, with a per-lcore cache,
+ * so that allocation from the forwarding threads neither takes the
+ * allocator lock nor crosses sockets.  When the pool of a socket is
+ * exhausted, or could not be created, objects come from the heap.
+ */
+
+#ifndef SESSION_POOL_H
+#define SESSION_POOL_H
+
+#include <stddef.h>
+
+#include "dp_mem.h"
+
+struct se_pool;
+
+/**
+ * Create a pool on every socket with an enabled lcore.
+ *
+ * @param name Name of the pool, used to name the mempools
+ * @param size Size of each object
+ * @param count Number of objects on each socket
+ * @param tag Subsystem that the objects in use are accounted to
+ * @return the pool, which is never NULL
+ */
+struct se_pool *se_pool_create(const char *name, size_t size,
+			       unsigned int count, enum dp_mem_tag tag);
+
+/**
+ * Allocate a zeroed, cache aligned, object from the local socket.
+ */
+void *se_pool_zalloc(struct se_pool *pool);
+
+/**
+ * Return an object to the pool it came from.  May be called from any
+ * thread, including call_rcu callbacks.
+ */
+void se_pool_free(struct se_pool *pool, void *obj);
+
+#endif /* SESSION_POOL_H */
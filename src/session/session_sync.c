@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Session sync - publish batches of session changes to a standby
+ */
+
+#include <czmq.h>
+#include <errno.h>
+#include <rte_log.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "protobuf/SessionDump.pb-c.h"
+#include "protobuf_util.h"
+#include "session.h"
+#include "session_cmds.h"
+#include "session_sync.h"
+#include "vplane_log.h"
+
+/* Changes sent in one message, at most */
+#define SESSION_SYNC_BATCH	1024
+
+static struct {
+	zsock_t				*ss_pub;
+	uint64_t			ss_seq;
+	/* The batch being built, as the fields of a SessionSync */
+	FILE				*ss_fp;
+	char				*ss_buf;
+	size_t				ss_len;
+	struct protobuf_file_buffer	ss_pb;
+	unsigned int			ss_count;
+} sync;
+
+bool session_sync_enabled(void)
+{
+	return sync.ss_pub != NULL;
+}
+
+static int session_sync_batch_open(void)
+{
+	sync.ss_fp = open_memstream(&sync.ss_buf, &sync.ss_len);
+	if (!sync.ss_fp)
+		return -ENOMEM;
+
+	protobuf_file_buffer_init(&sync.ss_pb, sync.ss_fp);
+	protobuf_file_put_varint(&sync.ss_pb, 1, ++sync.ss_seq);
+	sync.ss_count = 0;
+	return 0;
+}
+
+void session_sync_flush(void)
+{
+	zframe_t *frame;
+
+	if (!sync.ss_fp || !sync.ss_count)
+		return;
+
+	fclose(sync.ss_fp);
+	sync.ss_fp = NULL;
+
+	frame = zframe_new(sync.ss_buf, sync.ss_len);
+	if (!frame || zframe_send(&frame, sync.ss_pub, ZFRAME_DONTWAIT) < 0) {
+		/* The gap in seq tells the standby to resync */
+		RTE_LOG(NOTICE, DATAPLANE,
+			"session sync: dropped batch %lu of %u changes\n",
+			sync.ss_seq, sync.ss_count);
+		zframe_destroy(&frame);
+	}
+	free(sync.ss_buf);
+	sync.ss_buf = NULL;
+}
+
+/* Make room for another change, sending the batch if it is full */
+static bool session_sync_batch_add(void)
+{
+	if (sync.ss_fp && sync.ss_count >= SESSION_SYNC_BATCH)
+		session_sync_flush();
+
+	if (!sync.ss_fp && session_sync_batch_open() < 0)
+		return false;
+
+	sync.ss_count++;
+	return true;
+}
+
+void session_sync_update(struct session *s)
+{
+	SessionDump__Session msg;
+	IPAddress src_addr, dst_addr;
+
+	if (!session_sync_enabled())
+		return;
+
+	if (!session_pb_fill(s, &msg, &src_addr, &dst_addr))
+		return;
+
+	if (session_sync_batch_add())
+		protobuf_file_put_message(&sync.ss_pb, 2, &msg.base);
+}
+
+void session_sync_delete(struct session *s)
+{
+	if (!session_sync_enabled())
+		return;
+
+	if (session_sync_batch_add())
+		protobuf_file_put_varint(&sync.ss_pb, 3, s->se_id);
+}
+
+int session_sync_set_endpoint(const char *endpoint)
+{
+	zsock_t *pub = NULL;
+
+	if (endpoint) {
+		pub = zsock_new(ZMQ_PUB);
+		if (!pub)
+			return -ENOMEM;
+
+		if (zsock_bind(pub, "%s", endpoint) < 0) {
+			RTE_LOG(ERR, DATAPLANE,
+				"session sync: bind to %s failed: %s\n",
+				endpoint, strerror(errno));
+			zsock_destroy(&pub);
+			return -EINVAL;
+		}
+	}
+
+	session_sync_flush();
+	if (sync.ss_fp) {
+		fclose(sync.ss_fp);
+		sync.ss_fp = NULL;
+		free(sync.ss_buf);
+		sync.ss_buf = NULL;
+	}
+	zsock_destroy(&sync.ss_pub);
+	sync.ss_pub = pub;
+	return 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef SESSION_SYNC_H
+#define SESSION_SYNC_H
+
+#include <stdbool.h>
+
+struct session;
+
+/*
+ * Session sync.
+ *
+ * Streams session changes to a standby as SessionSync messages on a
+ * ZMQ PUB socket. Changes are picked up by the session GC rather than
+ * in the forwarding path, so a session is sent when the GC first
+ * looks at it and again whenever its protocol state has changed by
+ * the next look. All of these are only called on the master thread.
+ */
+
+/* Publish on the given endpoint, or stop if NULL */
+int session_sync_set_endpoint(const char *endpoint);
+
+bool session_sync_enabled(void);
+
+/* Queue a new or changed session, or the deletion of a synced one */
+void session_sync_update(struct session *s);
+void session_sync_delete(struct session *s);
+
+/* Send whatever is queued */
+void session_sync_flush(void);
+
+#endif /* SESSION_SYNC_H */
@@ -24,8 +24,11 @@
 #include <linux/if.h>
 #include <linux/if_ether.h>
 #include <linux/if_tun.h>
+#include <netinet/icmp6.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/udp.h>
 #include <pthread.h>
 #include <rte_branch_prediction.h>
 #include <rte_common.h>
@@ -72,8 +75,43 @@
 
 /* Number of buffers queued from dataplane to slowpath thread  */
 #define SHADOW_IO_RING_SIZE	256
-#define SHADOW_IO_RING_HWM	32
-#define SHADOW_IO_RING_BURST	8
+#define SHADOW_IO_RING_MAX	16384
+#define SHADOW_IO_RING_BURST	32
+
+/* Size of each of the rings for the classes above SHADOW_PRIO_OTHER */
+#define SHADOW_PRIO_RING_SIZE	64
+
+/* Well known ports of the traffic given priority */
+#define SHADOW_PORT_SSH		22
+#define SHADOW_PORT_TACACS	49
+#define SHADOW_PORT_NTP		123
+#define SHADOW_PORT_SNMP	161
+#define SHADOW_PORT_BGP		179
+#define SHADOW_PORT_RIP		520
+#define SHADOW_PORT_RIPNG	521
+#define SHADOW_PORT_LDP		646
+#define SHADOW_PORT_NETCONF	830
+#define SHADOW_PORT_RADIUS	1812
+#define SHADOW_PORT_BFD		3784
+#define SHADOW_PORT_BFD_ECHO	3785
+#define SHADOW_PORT_BFD_MHOP	4784
+
+#ifndef IPPROTO_VRRP
+#define IPPROTO_VRRP		112
+#endif
+#ifndef IPPROTO_OSPF
+#define IPPROTO_OSPF		89
+#endif
+
+static const char * const shadow_prio_names[SHADOW_PRIO_MAX] = {
+	[SHADOW_PRIO_PROTO]	= "protocol",
+	[SHADOW_PRIO_RESOLVE]	= "resolve",
+	[SHADOW_PRIO_MGMT]	= "management",
+	[SHADOW_PRIO_OTHER]	= "other",
+};
+
+/* Packets read from a TAP device per wakeup */
+#define SHADOW_TAP_READ_BURST	16
 
 /* to be fair with the tun/tap reader */
 #define SHADOW_WRITE_POLLS 1
@@ -142,6 +180,186 @@ local_shadow_if(struct rte_mbuf *m, struct ifnet *inp_ifp)
 	return NULL;
 }
 
+/* Ring size for local delivery, from config if set */
+static unsigned int shadow_ring_size(void)
+{
+	unsigned int size = config.slowpath_ring_size;
+
+	if (size == 0)
+		return SHADOW_IO_RING_SIZE;
+
+	return rte_align32pow2(RTE_MIN(RTE_MAX(size, SHADOW_PRIO_RING_SIZE),
+				       SHADOW_IO_RING_MAX));
+}
+
+unsigned int shadow_port_buffers(void)
+{
+	return shadow_ring_size() - 1 +
+		(SHADOW_PRIO_MAX - 1) * (SHADOW_PRIO_RING_SIZE - 1);
+}
+
+static void shadow_rings_free(struct shadow_if_info *sii)
+{
+	unsigned int prio;
+
+	for (prio = 0; prio < SHADOW_PRIO_MAX; prio++)
+		rte_ring_free(sii->rx_ring[prio]);
+}
+
+/*
+ * Create the rings for each class, named after the ring for
+ * SHADOW_PRIO_OTHER.
+ */
+static int shadow_rings_create(struct shadow_if_info *sii,
+			       const char *name, int socket_id)
+{
+	char ring_name[RTE_RING_NAMESIZE];
+	unsigned int size = shadow_ring_size();
+	unsigned int prio;
+
+	for (prio = 0; prio < SHADOW_PRIO_MAX; prio++) {
+		if (prio == SHADOW_PRIO_OTHER) {
+			sii->rx_ring[prio] = rte_ring_create(name, size,
+							     socket_id,
+							     RING_F_SC_DEQ);
+		} else {
+			snprintf(ring_name, RTE_RING_NAMESIZE, "%.26s.%u",
+				 name, prio);
+			sii->rx_ring[prio] = rte_ring_create(
+				ring_name, SHADOW_PRIO_RING_SIZE, socket_id,
+				RING_F_SC_DEQ);
+		}
+		if (!sii->rx_ring[prio]) {
+			shadow_rings_free(sii);
+			return -ENOMEM;
+		}
+	}
+
+	/* Mark congestion once more than an eighth of the ring is used */
+	sii->congest_space = size - size / 8 - 1;
+	return 0;
+}
+
+static bool shadow_port_is(uint16_t port, uint16_t a, uint16_t b)
+{
+	return a == htons(port) || b == htons(port);
+}
+
+/* Classify by transport port, either end of the session */
+static enum shadow_prio
+shadow_classify_l4(uint8_t proto, const void *l4, uint16_t len)
+{
+	const struct udphdr *uh = l4;
+	uint16_t sp, dp;
+
+	switch (proto) {
+	case IPPROTO_OSPF:
+	case IPPROTO_VRRP:
+	case IPPROTO_PIM:
+		return SHADOW_PRIO_PROTO;
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+		break;
+	default:
+		return SHADOW_PRIO_OTHER;
+	}
+
+	/* Ports are at the same offset in TCP and UDP */
+	if (len < sizeof(*uh))
+		return SHADOW_PRIO_OTHER;
+
+	sp = uh->uh_sport;
+	dp = uh->uh_dport;
+
+	if (proto == IPPROTO_TCP) {
+		if (shadow_port_is(SHADOW_PORT_BGP, sp, dp) ||
+		    shadow_port_is(SHADOW_PORT_LDP, sp, dp))
+			return SHADOW_PRIO_PROTO;
+		if (shadow_port_is(SHADOW_PORT_SSH, sp, dp) ||
+		    shadow_port_is(SHADOW_PORT_TACACS, sp, dp) ||
+		    shadow_port_is(SHADOW_PORT_NETCONF, sp, dp))
+			return SHADOW_PRIO_MGMT;
+		return SHADOW_PRIO_OTHER;
+	}
+
+	if (dp == htons(SHADOW_PORT_BFD) ||
+	    dp == htons(SHADOW_PORT_BFD_ECHO) ||
+	    dp == htons(SHADOW_PORT_BFD_MHOP) ||
+	    dp == htons(SHADOW_PORT_RIP) ||
+	    dp == htons(SHADOW_PORT_RIPNG) ||
+	    dp == htons(SHADOW_PORT_LDP))
+		return SHADOW_PRIO_PROTO;
+	if (shadow_port_is(SHADOW_PORT_NTP, sp, dp) ||
+	    shadow_port_is(SHADOW_PORT_SNMP, sp, dp) ||
+	    shadow_port_is(SHADOW_PORT_RADIUS, sp, dp))
+		return SHADOW_PRIO_MGMT;
+	return SHADOW_PRIO_OTHER;
+}
+
+/*
+ * Work out the class of a packet to be sent to the kernel. Only the
+ * headers in the first segment are looked at, and IPv6 extension
+ * headers are not followed. IP precedence 6 and 7 (network control)
+ * is trusted, as routing protocols and BFD are sent with it.
+ */
+static enum shadow_prio shadow_classify(const struct rte_mbuf *m)
+{
+	const struct ether_hdr *eh = rte_pktmbuf_mtod(m, struct ether_hdr *);
+	uint16_t len = rte_pktmbuf_data_len(m);
+
+	if (len < ETHER_HDR_LEN)
+		return SHADOW_PRIO_OTHER;
+	len -= ETHER_HDR_LEN;
+
+	switch (ntohs(eh->ether_type)) {
+	case ETHER_TYPE_SLOW:
+		return SHADOW_PRIO_PROTO;
+
+	case ETHER_TYPE_ARP:
+		return SHADOW_PRIO_RESOLVE;
+
+	case ETHER_TYPE_IPv4: {
+		const struct ip *ip = (const struct ip *)(eh + 1);
+		uint16_t hlen;
+
+		if (len < sizeof(*ip))
+			break;
+		if (ip->ip_tos >= IPTOS_PREC_INTERNETCONTROL)
+			return SHADOW_PRIO_PROTO;
+
+		/* Only the first fragment has the transport header */
+		hlen = ip->ip_hl << 2;
+		if ((ip->ip_off & htons(IP_OFFMASK)) || len < hlen)
+			break;
+
+		return shadow_classify_l4(ip->ip_p, (const char *)ip + hlen,
+					  len - hlen);
+	}
+	case ETHER_TYPE_IPv6: {
+		const struct ip6_hdr *ip6 = (const struct ip6_hdr *)(eh + 1);
+		const struct icmp6_hdr *icmp6;
+
+		if (len < sizeof(*ip6))
+			break;
+		if (((ntohl(ip6->ip6_flow) >> 20) & 0xff) >=
+		    IPTOS_PREC_INTERNETCONTROL)
+			return SHADOW_PRIO_PROTO;
+
+		len -= sizeof(*ip6);
+		if (ip6->ip6_nxt != IPPROTO_ICMPV6)
+			return shadow_classify_l4(ip6->ip6_nxt, ip6 + 1, len);
+
+		icmp6 = (const struct icmp6_hdr *)(ip6 + 1);
+		if (len >= sizeof(*icmp6) &&
+		    icmp6->icmp6_type >= ND_ROUTER_SOLICIT &&
+		    icmp6->icmp6_type <= ND_REDIRECT)
+			return SHADOW_PRIO_RESOLVE;
+		break;
+	}
+	}
+	return SHADOW_PRIO_OTHER;
+}
+
 /*
  * Pass received packets  into the Linux TCP/IP stack.
  * Use ring to pass packets to master thread.
@@ -150,7 +368,9 @@ local_shadow_if(struct rte_mbuf *m, struct ifnet *inp_ifp)
  */
 void local_packet(struct ifnet *ifp, struct rte_mbuf *m)
 {
+	enum shadow_prio prio = SHADOW_PRIO_OTHER;
 	unsigned int free_space;
+	int ret;
 
 	if (!local_packet_filter(ifp, m))
 		goto drop;
@@ -177,21 +397,44 @@ void local_packet(struct ifnet *ifp, struct rte_mbuf *m)
 			ifp = member_ifp;
 	}
 	pktmbuf_save_ifp(m, ifp);
+
+	/* The spath device carries no ethernet header to look at */
+	if (sii->port != IF_PORT_ID_INVALID)
+		prio = shadow_classify(m);
+
+	if (prio != SHADOW_PRIO_OTHER) {
+		ret = rte_ring_mp_enqueue_bulk(sii->rx_ring[prio],
+					       (void **) &m, 1, NULL);
+		if (ret == 0)
+			goto full;
+
+		++sii->rs_queued[prio];
+		goto wake;
+	}
+
 	if (sii->congested)
 		pktmbuf_ecn_set_ce(m);
 
-	int ret = rte_ring_mp_enqueue_bulk(sii->rx_slow_ring,
-					   (void **) &m, 1, &free_space);
+	ret = rte_ring_mp_enqueue_bulk(sii->rx_ring[prio],
+				       (void **) &m, 1, &free_space);
 	if (ret == 0)
 		goto full;
 
-	if (free_space < (SHADOW_IO_RING_SIZE - SHADOW_IO_RING_HWM - 1)) {
+	++sii->rs_queued[prio];
+
+	if (free_space < sii->congest_space) {
 		++sii->rs_congested;
 		sii->congested = true;
 	} else
 		sii->congested = false;
 
-	if (CMM_LOAD_SHARED(sii->wake_me)) {
+wake:
+	/* Pairs with the barrier in shadow_writer() */
+	cmm_smp_mb();
+
+	/* Only the first thread to find the writer idle wakes it */
+	if (CMM_LOAD_SHARED(sii->wake_me) &&
+	    uatomic_xchg(&sii->wake_me, false)) {
 		/* wake up slowpath thread on the master. */
 		static const uint64_t incr = 1;
 
@@ -204,6 +447,7 @@ void local_packet(struct ifnet *ifp, struct rte_mbuf *m)
 
 full:   __cold_label;
 	++sii->rs_infull;
+	++sii->rs_full[prio];
 
 drop:	__cold_label;
 	if_incr_dropped(ifp);
@@ -232,12 +476,13 @@ static void shadow_io_write(struct shadow_if_info *sii, struct rte_mbuf *m)
 }
 
 /* Get a burst of packets from ring and forward them to kernel */
-static unsigned int shadow_io_burst(struct shadow_if_info *sii)
+static unsigned int shadow_io_burst(struct shadow_if_info *sii,
+				    struct rte_ring *r)
 {
 	struct rte_mbuf *s_pkts[SHADOW_IO_RING_BURST];
 	unsigned int i, n;
 
-	n = rte_ring_sc_dequeue_burst(sii->rx_slow_ring,
+	n = rte_ring_sc_dequeue_burst(r,
 				      (void **)s_pkts,
 				      SHADOW_IO_RING_BURST,
 				      NULL);
@@ -248,9 +493,34 @@ static unsigned int shadow_io_burst(struct shadow_if_info *sii)
 	return n;
 }
 
+/* Shadow interface for a port, if it still exists */
+static struct shadow_if_info *shadow_writer_if(unsigned int port)
+{
+	/* Check for hotplug removal */
+	if (port < DATAPLANE_MAX_PORTS &&
+	    unlikely(!rte_eth_dev_is_valid_port(port)))
+		return NULL;
+
+	return rcu_dereference(shadow_if[port]);
+}
+
+static bool shadow_rings_empty(const struct shadow_if_info *sii)
+{
+	unsigned int prio;
+
+	for (prio = 0; prio < SHADOW_PRIO_MAX; prio++)
+		if (!rte_ring_empty(sii->rx_ring[prio]))
+			return false;
+	return true;
+}
+
 /* Callback from event_fd
  * Processes all packets for all receive rings.
  * Keeps going until all rings are empty.
+ *
+ * The classes are serviced in strict priority: if a class still has
+ * packets queued after a burst on any port, the lower classes wait
+ * for the next wakeup.
  */
 static int shadow_writer(zloop_t *loop __rte_unused,
 			 zmq_pollitem_t *item,
@@ -258,7 +528,8 @@ static int shadow_writer(zloop_t *loop __rte_unused,
 {
 	struct shadow_if_info *sii;
 	unsigned int npkts = 0;
-	unsigned int port;
+	unsigned int port, prio, n;
+	bool backlog;
 	uint64_t seqno;
 	int i;
 
@@ -278,27 +549,35 @@ static int shadow_writer(zloop_t *loop __rte_unused,
 	for (i = 0; i < SHADOW_WRITE_POLLS; i++) {
 		npkts = 0;
 
-		/* Check for packets to send over tunnel */
 		for (port = 0; port <= DATAPLANE_MAX_PORTS; port++) {
-
-			/* Check for hotplug removal */
-			if (port < DATAPLANE_MAX_PORTS &&
-			    unlikely(!rte_eth_dev_is_valid_port(port)))
-				continue;
-
-			sii = rcu_dereference(shadow_if[port]);
+			sii = shadow_writer_if(port);
 			if (!sii)
 				continue;
 
 			/* Enable doorbell only if not busy */
-			if (rte_ring_empty(sii->rx_slow_ring)) {
+			if (shadow_rings_empty(sii)) {
 				sii->congested = false;
 				CMM_STORE_SHARED(sii->wake_me, true);
 			} else {
 				CMM_STORE_SHARED(sii->wake_me, false);
 			}
+		}
+		/* Recheck rings after enabling doorbells */
+		cmm_smp_mb();
 
-			npkts += shadow_io_burst(sii);
+		/* Check for packets to send over tunnel */
+		backlog = false;
+		for (prio = 0; prio < SHADOW_PRIO_MAX && !backlog; prio++) {
+			for (port = 0; port <= DATAPLANE_MAX_PORTS; port++) {
+				sii = shadow_writer_if(port);
+				if (!sii)
+					continue;
+
+				n = shadow_io_burst(sii, sii->rx_ring[prio]);
+				if (n == SHADOW_IO_RING_BURST)
+					backlog = true;
+				npkts += n;
+			}
 		}
 
 		if (npkts == 0)
@@ -350,10 +629,7 @@ void shadow_init_spath_ring(int tun_fd)
 		rte_panic("can't allocate slowpath interface\n");
 
 	snprintf(ring_name, RTE_RING_NAMESIZE, "spathintf");
-	sii->rx_slow_ring = rte_ring_create(ring_name,
-					    SHADOW_IO_RING_SIZE, 0,
-					    RING_F_SC_DEQ);
-	if (!sii->rx_slow_ring)
+	if (shadow_rings_create(sii, ring_name, 0) < 0)
 		rte_panic("spathintf ring %s create failed\n", ring_name);
 
 	sii->port = IF_PORT_ID_INVALID;
@@ -452,25 +728,25 @@ int tap_reader(zloop_t *loop, zmq_pollitem_t *item, void *arg)
 	struct shadow_if_info *sii = arg;
 	struct ifnet *ifp = ifport_table[sii->port];
 	struct rte_mbuf *m = NULL;
+	unsigned int i;
+	int ret;
 
-	int ret = tap_receive(loop, item, sii, &m);
-
-	if (ret <= 0)
-		return ret;
-
-	rcu_thread_online();
+	/* Drain what the kernel has queued, up to a burst */
+	for (i = 0; i < SHADOW_TAP_READ_BURST; i++) {
+		ret = tap_receive(loop, item, sii, &m);
+		if (ret <= 0)
+			return ret;
 
-	if (shadow_output(sii, m, ifp) < 0)
-		goto drop;
+		rcu_thread_online();
 
-	++sii->ts_packets;
-	rcu_thread_offline();
-	return 0;
- drop:
-	++sii->ts_errors;
-	rte_pktmbuf_free(m);
+		if (shadow_output(sii, m, ifp) < 0) {
+			++sii->ts_errors;
+			rte_pktmbuf_free(m);
+		} else
+			++sii->ts_packets;
 
-	rcu_thread_offline();
+		rcu_thread_offline();
+	}
 	return 0;
 }
 
@@ -783,15 +1059,10 @@ int shadow_add_event(zloop_t *loop, portid_t port, const char *ifname)
 	snprintf(ring_name, RTE_RING_NAMESIZE, "shadow%u-%016"PRIx64,
 		 port, shadow_next_ring_id++);
 
-	sii->rx_slow_ring = rte_ring_create(ring_name,
-					    SHADOW_IO_RING_SIZE,
-					    socket_id,
-					    RING_F_SC_DEQ);
-
-	if (!sii->rx_slow_ring) {
+	ret = shadow_rings_create(sii, ring_name, socket_id);
+	if (ret < 0) {
 		RTE_LOG(ERR, DATAPLANE,
 			"shadow ring %s create failed\n", ring_name);
-		ret = -ENOMEM;
 		goto fail_free;
 	}
 
@@ -815,7 +1086,7 @@ int shadow_add_event(zloop_t *loop, portid_t port, const char *ifname)
 fail_close:
 	close(sii->fd);
 fail_ring_free:
-	rte_ring_free(sii->rx_slow_ring);
+	shadow_rings_free(sii);
 fail_free:
 	rte_free(sii);
 	return ret;
@@ -827,13 +1098,14 @@ static void shadow_free_rcu(struct rcu_head *head)
 		caa_container_of(head, struct shadow_if_info, rcu);
 
 	close(sii->fd);
-	rte_ring_free(sii->rx_slow_ring);
+	shadow_rings_free(sii);
 	rte_free(sii);
 }
 
 static void shadow_remove_event(zloop_t *loop, portid_t port)
 {
 	struct shadow_if_info *sii;
+	unsigned int prio;
 	struct rte_mbuf *m;
 
 	sii = shadow_if[port];
@@ -849,8 +1121,10 @@ static void shadow_remove_event(zloop_t *loop, portid_t port)
 	/*
 	 * Drain ring
 	 */
-	while (rte_ring_sc_dequeue(sii->rx_slow_ring, (void **) &m) == 0)
-		rte_pktmbuf_free(m);
+	for (prio = 0; prio < SHADOW_PRIO_MAX; prio++)
+		while (rte_ring_sc_dequeue(sii->rx_ring[prio],
+					   (void **) &m) == 0)
+			rte_pktmbuf_free(m);
 
 	call_rcu(&sii->rcu, shadow_free_rcu);
 }
@@ -1001,14 +1275,14 @@ void shadow_destroy(void)
 	zsock_destroy(&shadow_server_sock);
 	close(shadow_fd);
 	sii = shadow_if[DATAPLANE_SPATH_PORT];
-	rte_ring_free(sii->rx_slow_ring);
+	shadow_rings_free(sii);
 }
 
 /* Display shadow interface statistics */
 void shadow_show_summary(FILE *f, const char *name)
 {
 	json_writer_t *wr = jsonw_new(f);
-	unsigned int port;
+	unsigned int port, prio;
 	bool is_spathintf;
 
 	if (!wr)
@@ -1047,12 +1321,27 @@ void shadow_show_summary(FILE *f, const char *name)
 		jsonw_uint_field(wr, "tx_nobufs", sii->ts_nobufs);
 
 		jsonw_name(wr, "rx_ring");
-		const struct rte_ring *r = sii->rx_slow_ring;
+		const struct rte_ring *r = sii->rx_ring[SHADOW_PRIO_OTHER];
 		jsonw_start_object(wr);
 		jsonw_uint_field(wr, "used", rte_ring_count(r));
 		jsonw_uint_field(wr, "avail", rte_ring_free_count(r));
 		jsonw_end_object(wr);
 
+		jsonw_name(wr, "rx_classes");
+		jsonw_start_array(wr);
+		for (prio = 0; prio < SHADOW_PRIO_MAX; prio++) {
+			r = sii->rx_ring[prio];
+			jsonw_start_object(wr);
+			jsonw_string_field(wr, "class",
+					   shadow_prio_names[prio]);
+			jsonw_uint_field(wr, "queued", sii->rs_queued[prio]);
+			jsonw_uint_field(wr, "dropped", sii->rs_full[prio]);
+			jsonw_uint_field(wr, "used", rte_ring_count(r));
+			jsonw_uint_field(wr, "avail", rte_ring_free_count(r));
+			jsonw_end_object(wr);
+		}
+		jsonw_end_array(wr);
+
 		jsonw_end_object(wr);
 		if (name)
 			break;
@@ -26,15 +26,28 @@ struct rte_mbuf;
 struct tun_meta;
 struct tun_pi;
 
+/*
+ * Classes of locally destined traffic, highest priority first. Each
+ * has its own ring and the writer services them in strict priority.
+ */
+enum shadow_prio {
+	SHADOW_PRIO_PROTO,	/* routing protocols, BFD, LACP */
+	SHADOW_PRIO_RESOLVE,	/* ARP and IPv6 neighbour discovery */
+	SHADOW_PRIO_MGMT,	/* management sessions */
+	SHADOW_PRIO_OTHER,	/* everything else */
+	SHADOW_PRIO_MAX
+};
+
 /* per interface data structure
  *   rx - packets received on NIC and going to kernel
  *   tx - packets from kernel going to NIC
  */
 struct shadow_if_info {
-	struct rte_ring *rx_slow_ring;	/* pkts going to tunnel */
+	struct rte_ring *rx_ring[SHADOW_PRIO_MAX]; /* pkts going to tunnel */
 	unsigned int	 port;
+	unsigned int	 congest_space;	/* free slots below which to mark CE */
 	int		 fd;
-	bool		 wake_me;
+	int		 wake_me;
 	bool		 congested;
 
 	uint64_t rs_packets;	/* pkts sent over tunnel */
@@ -42,6 +55,8 @@ struct shadow_if_info {
 	uint64_t rs_errors;	/* pkts dropped on write to tun dev */
 	uint64_t rs_overrun;	/* pkts dropped because of socket queue full */
 	uint64_t rs_congested;  /* pkts marked with congestion experienced */
+	uint64_t rs_queued[SHADOW_PRIO_MAX]; /* pkts queued per class */
+	uint64_t rs_full[SHADOW_PRIO_MAX];   /* drops per class, ring full */
 	uint64_t ts_packets;	/* pkts from tunnel */
 	uint64_t ts_errors;	/* pkts dropped on read */
 	uint64_t ts_nobufs;	/* pkts dropped because no mbufs */
@@ -58,6 +73,9 @@ int shadow_init_port(portid_t portid, const char *ifname,
 		     const struct ether_addr *eth_addr);
 void shadow_uninit_port(portid_t port);
 
+/* Most mbufs that the local delivery rings of one port can hold */
+unsigned int shadow_port_buffers(void);
+
 /* Initialize state for shadow tunnel commnication */
 void shadow_init(void);
 void shadow_destroy(void);
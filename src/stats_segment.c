@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Stats segment - see stats_segment.h for the layout collectors read.
+ *
+ * Blocks are allocated on the master thread but freed from the RCU
+ * callback thread, so the free list and directory are under a mutex.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <rte_common.h>
+#include <rte_log.h>
+#include <rte_memory.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+
+#include "dp_event.h"
+#include "if_var.h"
+#include "stats_segment.h"
+#include "util.h"
+#include "vplane_log.h"
+
+#define STATS_SEG_MAX_ENTRIES	16384
+
+static struct {
+	struct stats_seg_hdr	*hdr;
+	struct stats_seg_entry	*dir;
+	char			*data;
+	uint32_t		*free_list;	/* stack of free entries */
+	uint32_t		nfree;
+	uint32_t		next_unused;
+	pthread_mutex_t		lock;
+} seg = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void stats_seg_dir_begin(void)
+{
+	CMM_STORE_SHARED(seg.hdr->epoch, seg.hdr->epoch + 1);
+	cmm_smp_wmb();
+}
+
+static void stats_seg_dir_end(void)
+{
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(seg.hdr->epoch, seg.hdr->epoch + 1);
+}
+
+static int stats_seg_index(const struct if_data *data)
+{
+	const char *p = (const char *)data;
+
+	if (!seg.hdr || p < seg.data ||
+	    p >= seg.data + (size_t)seg.hdr->max_entries *
+	    seg.hdr->block_size)
+		return -1;
+
+	return (p - seg.data) / seg.hdr->block_size;
+}
+
+static void stats_seg_entry_set(const struct ifnet *ifp)
+{
+	int i = stats_seg_index(ifp->if_data);
+
+	if (i < 0)
+		return;
+
+	pthread_mutex_lock(&seg.lock);
+	stats_seg_dir_begin();
+	snprintf(seg.dir[i].name, IFNAMSIZ, "%s", ifp->if_name);
+	seg.dir[i].ifindex = ifp->if_index;
+	stats_seg_dir_end();
+	pthread_mutex_unlock(&seg.lock);
+}
+
+static void stats_seg_if_index_set(struct ifnet *ifp,
+				   uint32_t idx __rte_unused)
+{
+	stats_seg_entry_set(ifp);
+}
+
+static void stats_seg_if_index_unset(struct ifnet *ifp,
+				     uint32_t idx __rte_unused)
+{
+	stats_seg_entry_set(ifp);
+}
+
+static void stats_seg_if_rename(struct ifnet *ifp,
+				const char *old_name __rte_unused)
+{
+	stats_seg_entry_set(ifp);
+}
+
+static const struct dp_event_ops stats_seg_event_ops = {
+	.if_index_set = stats_seg_if_index_set,
+	.if_index_unset = stats_seg_if_index_unset,
+	.if_rename = stats_seg_if_rename,
+};
+
+struct if_data *stats_seg_if_data_alloc(const char *ifname)
+{
+	struct if_data *data;
+	uint32_t i;
+
+	if (!seg.hdr)
+		return NULL;
+
+	pthread_mutex_lock(&seg.lock);
+	if (seg.nfree)
+		i = seg.free_list[--seg.nfree];
+	else if (seg.next_unused < seg.hdr->max_entries)
+		i = seg.next_unused++;
+	else {
+		pthread_mutex_unlock(&seg.lock);
+		return NULL;
+	}
+
+	data = (struct if_data *)(seg.data + (size_t)i * seg.hdr->block_size);
+	memset(data, 0, seg.hdr->block_size);
+
+	stats_seg_dir_begin();
+	snprintf(seg.dir[i].name, IFNAMSIZ, "%s", ifname);
+	seg.dir[i].ifindex = 0;
+	seg.dir[i].in_use = 1;
+	stats_seg_dir_end();
+	pthread_mutex_unlock(&seg.lock);
+
+	return data;
+}
+
+bool stats_seg_if_data_free(struct if_data *data)
+{
+	int i = stats_seg_index(data);
+
+	if (i < 0)
+		return false;
+
+	pthread_mutex_lock(&seg.lock);
+	stats_seg_dir_begin();
+	seg.dir[i].in_use = 0;
+	stats_seg_dir_end();
+	seg.free_list[seg.nfree++] = i;
+	pthread_mutex_unlock(&seg.lock);
+	return true;
+}
+
+/*
+ * Without the segment, counters fall back to hugepage memory, and
+ * are only visible through the show commands.
+ */
+void stats_seg_init(void)
+{
+	uint32_t nlcores = get_lcore_max() + 1;
+	uint32_t block_size = nlcores * sizeof(struct if_data);
+	size_t dir_offset = RTE_ALIGN_CEIL(sizeof(struct stats_seg_hdr),
+					   RTE_CACHE_LINE_SIZE);
+	size_t data_offset = RTE_ALIGN_CEIL(dir_offset +
+		STATS_SEG_MAX_ENTRIES * sizeof(struct stats_seg_entry),
+		RTE_CACHE_LINE_SIZE);
+	size_t size = data_offset + (size_t)STATS_SEG_MAX_ENTRIES * block_size;
+	void *base;
+	int fd;
+
+	seg.free_list = calloc(STATS_SEG_MAX_ENTRIES, sizeof(uint32_t));
+	if (!seg.free_list)
+		goto fail;
+
+	/* A fresh segment, so a previous instance's readers see no change */
+	shm_unlink(STATS_SEG_NAME);
+	fd = shm_open(STATS_SEG_NAME, O_RDWR | O_CREAT | O_EXCL, 0644);
+	if (fd < 0)
+		goto fail;
+
+	/* Sparse, so only the blocks in use take memory */
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		shm_unlink(STATS_SEG_NAME);
+		goto fail;
+	}
+
+	base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		shm_unlink(STATS_SEG_NAME);
+		goto fail;
+	}
+
+	seg.hdr = base;
+	seg.dir = (struct stats_seg_entry *)((char *)base + dir_offset);
+	seg.data = (char *)base + data_offset;
+
+	seg.hdr->version = STATS_SEG_VERSION;
+	seg.hdr->nlcores = nlcores;
+	seg.hdr->max_entries = STATS_SEG_MAX_ENTRIES;
+	seg.hdr->block_size = block_size;
+	seg.hdr->dir_offset = dir_offset;
+	seg.hdr->data_offset = data_offset;
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(seg.hdr->magic, STATS_SEG_MAGIC);
+
+	dp_event_register(&stats_seg_event_ops);
+	return;
+
+fail:
+	RTE_LOG(NOTICE, DATAPLANE,
+		"stats segment %s unavailable: %s\n",
+		STATS_SEG_NAME, strerror(errno));
+	free(seg.free_list);
+	seg.free_list = NULL;
+}
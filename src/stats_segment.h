@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Stats segment - interface counters kept in shared memory, so that
+ * collectors can map it read-only and read them without asking the
+ * dataplane.
+ *
+ * Layout: a header, a directory of max_entries entries, and then one
+ * block of block_size bytes per directory entry.  A block holds
+ * nlcores consecutive struct if_data, one per lcore, to be summed by
+ * the reader.  Counters are 64 bit and updated without locks, so a
+ * reader sees each one whole but not a snapshot of all of them.
+ *
+ * The directory changes only with epoch odd.  A reader copies the
+ * entries it wants, then uses them only if epoch was even and the
+ * same before and after.
+ */
+#ifndef STATS_SEGMENT_H
+#define STATS_SEGMENT_H
+
+#include <linux/if.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define STATS_SEG_NAME		"/vyatta-dataplane-stats"
+#define STATS_SEG_MAGIC		0x56445353	/* "VDSS" */
+#define STATS_SEG_VERSION	1
+
+struct stats_seg_hdr {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	epoch;		/* odd while the directory changes */
+	uint32_t	nlcores;
+	uint32_t	max_entries;
+	uint32_t	block_size;
+	uint64_t	dir_offset;
+	uint64_t	data_offset;
+};
+
+struct stats_seg_entry {
+	char		name[IFNAMSIZ];
+	uint32_t	ifindex;
+	uint32_t	in_use;
+};
+
+struct ifnet;
+struct if_data;
+
+void stats_seg_init(void);
+
+/* Per-lcore interface counters, or NULL if the segment is unavailable */
+struct if_data *stats_seg_if_data_alloc(const char *ifname);
+/* Returns false if the counters were not from the segment */
+bool stats_seg_if_data_free(struct if_data *data);
+
+#endif /* STATS_SEGMENT_H */
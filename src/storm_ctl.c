@@ -14,6 +14,8 @@
 #include <vplane_log.h>
 #include <if_var.h>
 #include <fal.h>
+#include <rte_atomic.h>
+#include <rte_cycles.h>
 #include <rte_jhash.h>
 #include <rte_timer.h>
 #include <zmq_dp.h>
@@ -62,6 +64,25 @@ struct storm_ctl_profile {
 
 #define STORM_CTL_ACTION_SHUTDOWN_INTF    0x01
 
+/*
+ * Software policer, used in place of a policer the platform could not
+ * create. One token bucket in bytes, shared by all forwarding threads.
+ */
+struct storm_ctl_sw_policer {
+	rte_atomic64_t             scs_tokens;
+	uint64_t                   scs_last;     /* tsc of last refill */
+	uint64_t                   scs_rate;     /* bytes/sec, 0 if unused */
+	uint64_t                   scs_burst;    /* bytes */
+	rte_atomic64_t             scs_drops;
+	rte_atomic64_t             scs_drop_bytes;
+};
+
+/* Burst is 10ms at the policed rate, but at least a few jumbo frames */
+#define STORM_CTL_SW_BURST_MIN   (32 * 1024)
+#define STORM_CTL_SW_BURST_DIV   100
+/* Smallest refill, so threads don't fight over the bucket every frame */
+#define STORM_CTL_SW_REFILL_MIN  64
+
 /* State for storm control applied to an interface, or a vlan on interface */
 struct storm_ctl_instance {
 	struct cds_lfht_node       sci_node;     /* node in instance table */
@@ -69,6 +90,7 @@ struct storm_ctl_instance {
 	uint64_t                   sci_pkt_drops[FAL_TRAFFIC_MAX];
 	struct dp_storm_ctl_policy sci_policy[FAL_TRAFFIC_MAX];
 	fal_object_t               sci_fal_obj[FAL_TRAFFIC_MAX];
+	struct storm_ctl_sw_policer sci_sw[FAL_TRAFFIC_MAX];
 	struct storm_ctl_profile   *sci_profile;
 	struct ifnet               *sci_ifp;
 	struct rcu_head            sci_rcu;
@@ -79,6 +101,7 @@ struct if_storm_ctl_info {
 	struct rcu_head            sc_rcu;
 	struct rte_timer           sc_recovery_tmr;
 	struct cds_lfht            *sc_instance_tbl;
+	uint32_t                   sc_sw_policers; /* active software policers */
 };
 
 static struct cfg_if_list *cfg_list_storm;
@@ -182,18 +205,22 @@ static void storm_ctl_compare_stats(struct ifnet *ifp, void *arg __rte_unused)
 				continue;
 
 			fal_obj = instance->sci_fal_obj[tr_type];
-			if (fal_obj == FAL_NULL_OBJECT_ID)
-				continue;
-
-			rv = fal_policer_get_stats_ext(fal_obj, 1, &stat,
-						       FAL_STATS_MODE_READ,
-						       &cntr);
-			if (rv != 0) {
-				RTE_LOG(ERR, DATAPLANE,
-					"Could not retrieve %s storm control stats for %s\n",
-					fal_traffic_type_to_str(tr_type),
-					ifp->if_name);
-				continue;
+			if (fal_obj == FAL_NULL_OBJECT_ID) {
+				if (!instance->sci_sw[tr_type].scs_rate)
+					continue;
+				cntr = rte_atomic64_read(
+					&instance->sci_sw[tr_type].scs_drops);
+			} else {
+				rv = fal_policer_get_stats_ext(
+					fal_obj, 1, &stat,
+					FAL_STATS_MODE_READ, &cntr);
+				if (rv != 0) {
+					RTE_LOG(ERR, DATAPLANE,
+						"Could not retrieve %s storm control stats for %s\n",
+						fal_traffic_type_to_str(tr_type),
+						ifp->if_name);
+					continue;
+				}
 			}
 
 			if (cntr != instance->sci_pkt_drops[tr_type]) {
@@ -348,10 +375,19 @@ static void storm_ctl_free_instance(struct rcu_head *head)
 	free(instance);
 }
 
+static void storm_ctl_sw_policer_set(struct storm_ctl_instance *instance,
+				     enum fal_traffic_type traf,
+				     uint64_t rate);
+
 static void
 storm_ctl_del_instance_internal(struct cds_lfht *sc_instance_tbl,
 				struct storm_ctl_instance *instance)
 {
+	enum fal_traffic_type i;
+
+	for (i = FAL_TRAFFIC_UCAST; i < FAL_TRAFFIC_MAX; i++)
+		storm_ctl_sw_policer_set(instance, i, 0);
+
 	cds_list_del(&instance->sci_profile_list);
 	cds_lfht_del(sc_instance_tbl, &instance->sci_node);
 	if (storm_ctl_policy_cnt == 1)
@@ -412,10 +448,17 @@ static void fal_policer_get_sc_stats(struct storm_ctl_instance *instance,
 				     uint64_t cntrs[],
 				     enum fal_traffic_type traf)
 {
+	struct storm_ctl_sw_policer *pol = &instance->sci_sw[traf];
 	int rv;
 
-	if (!instance->sci_fal_obj[traf])
+	if (!instance->sci_fal_obj[traf]) {
+		/* Only drops are counted in software */
+		cntrs[FAL_POLICER_STAT_RED_PACKETS] =
+			rte_atomic64_read(&pol->scs_drops);
+		cntrs[FAL_POLICER_STAT_RED_BYTES] =
+			rte_atomic64_read(&pol->scs_drop_bytes);
 		return;
+	}
 
 	rv = fal_policer_get_stats_ext(instance->sci_fal_obj[traf],
 				       FAL_POLICER_STAT_MAX,
@@ -437,8 +480,11 @@ static int fal_policer_get_cfg(struct storm_ctl_instance *instance,
 	struct fal_attribute_t policer_attr[2] = {};
 	int rv;
 
-	if (!instance->sci_fal_obj[traf])
+	if (!instance->sci_fal_obj[traf]) {
+		*max_rate = instance->sci_sw[traf].scs_rate * 8 / 1024;
+		*max_burst = instance->sci_sw[traf].scs_burst * 8 / 1024;
 		return 0;
+	}
 
 	policer_attr[0].id = FAL_POLICER_ATTR_CIR;
 	policer_attr[1].id = FAL_POLICER_ATTR_CBS;
@@ -475,6 +521,101 @@ storm_ctl_policy_get_fal_rate(struct dp_storm_ctl_policy *policy,
 	return 0;
 }
 
+/*
+ * Start, change or (with a rate of 0) stop policing a traffic type in
+ * software. Only called from the master thread.
+ */
+static void storm_ctl_sw_policer_set(struct storm_ctl_instance *instance,
+				     enum fal_traffic_type traf,
+				     uint64_t rate)
+{
+	struct storm_ctl_sw_policer *pol = &instance->sci_sw[traf];
+	struct if_storm_ctl_info *sc_info = instance->sci_ifp->sc_info;
+	uint64_t burst;
+
+	if (!rate) {
+		if (pol->scs_rate)
+			CMM_STORE_SHARED(sc_info->sc_sw_policers,
+					 sc_info->sc_sw_policers - 1);
+		CMM_STORE_SHARED(pol->scs_rate, 0);
+		return;
+	}
+
+	burst = RTE_MAX(rate / STORM_CTL_SW_BURST_DIV,
+			(uint64_t)STORM_CTL_SW_BURST_MIN);
+	if (!pol->scs_rate) {
+		rte_atomic64_set(&pol->scs_tokens, burst);
+		pol->scs_last = rte_get_timer_cycles();
+		CMM_STORE_SHARED(sc_info->sc_sw_policers,
+				 sc_info->sc_sw_policers + 1);
+	}
+	CMM_STORE_SHARED(pol->scs_burst, burst);
+	CMM_STORE_SHARED(pol->scs_rate, rate);
+}
+
+static bool storm_ctl_sw_conform(struct storm_ctl_sw_policer *pol,
+				 uint32_t len)
+{
+	uint64_t rate = CMM_LOAD_SHARED(pol->scs_rate);
+	uint64_t hz = rte_get_timer_hz();
+	uint64_t now, last, add;
+	int64_t tokens;
+
+	if (!rate)
+		return true;
+
+	/*
+	 * Refill for the time since the last refill. Long idle periods
+	 * are clamped so the product can't overflow; the bucket is full
+	 * by then anyway.
+	 */
+	last = CMM_LOAD_SHARED(pol->scs_last);
+	now = rte_get_timer_cycles();
+	if (now > last) {
+		add = RTE_MIN(now - last, hz / 16) * rate / hz;
+		if (add >= STORM_CTL_SW_REFILL_MIN &&
+		    rte_atomic64_cmpset(&pol->scs_last, last, now)) {
+			tokens = rte_atomic64_add_return(&pol->scs_tokens,
+							 add);
+			if (tokens > (int64_t)pol->scs_burst)
+				rte_atomic64_set(&pol->scs_tokens,
+						 pol->scs_burst);
+		}
+	}
+
+	if (rte_atomic64_read(&pol->scs_tokens) < len) {
+		rte_atomic64_inc(&pol->scs_drops);
+		rte_atomic64_add(&pol->scs_drop_bytes, len);
+		return false;
+	}
+	rte_atomic64_sub(&pol->scs_tokens, len);
+	return true;
+}
+
+bool storm_ctl_police(struct ifnet *ifp, uint16_t vlan,
+		      enum fal_traffic_type tr_type, uint32_t len)
+{
+	struct if_storm_ctl_info *sc_info = rcu_dereference(ifp->sc_info);
+	struct storm_ctl_instance *instance;
+
+	if (!sc_info || !CMM_LOAD_SHARED(sc_info->sc_sw_policers))
+		return false;
+
+	if (vlan) {
+		instance = storm_ctl_find_instance(sc_info, vlan);
+		if (instance &&
+		    !storm_ctl_sw_conform(&instance->sci_sw[tr_type], len))
+			return true;
+	}
+
+	instance = storm_ctl_find_instance(sc_info, 0);
+	if (instance &&
+	    !storm_ctl_sw_conform(&instance->sci_sw[tr_type], len))
+		return true;
+
+	return false;
+}
+
 static int fal_policer_apply_profile(struct storm_ctl_profile *profile,
 				     uint16_t vlan,
 				     struct storm_ctl_instance *instance,
@@ -516,7 +657,11 @@ static int fal_policer_apply_profile(struct storm_ctl_profile *profile,
 	rv = fal_policer_create(ARRAY_SIZE(policer_attr),
 				policer_attr,
 				&instance->sci_fal_obj[traf]);
-	if (rv && rv != -EOPNOTSUPP) {
+	if (rv == -EOPNOTSUPP)
+		/* No policer in the platform, police in software instead */
+		storm_ctl_sw_policer_set(instance, traf,
+					 policer_attr[4].value.u64);
+	else if (rv) {
 		RTE_LOG(ERR, STORM_CTL,
 			"Could not create policer for %s %d in fal (%d)\n",
 			instance->sci_ifp->if_name, vlan, rv);
@@ -557,7 +702,7 @@ static int fal_policer_apply_profile(struct storm_ctl_profile *profile,
 		} else {
 			rv = fal_vlan_feature_set_attr(vlan_feat->fal_vlan_feat,
 						       &vlan_attr[2]);
-			if (rv) {
+			if (rv && rv != -EOPNOTSUPP) {
 				RTE_LOG(ERR, STORM_CTL,
 					"Could not associate %s policer for intf %s vlan %d\n",
 					fal_traffic_type_to_str(traf),
@@ -587,15 +732,24 @@ static int fal_policer_modify_profile(struct storm_ctl_profile *profile,
 	struct fal_attribute_t policer_bind_attr = {};
 	int rv;
 
-	if (!instance->sci_fal_obj[traf])
-		fal_policer_apply_profile(profile, vlan,
-					  instance, traf);
-
 	policer_bind_attr.id = FAL_POLICER_ATTR_CIR;
 	policer_bind_attr.value.u64 = storm_ctl_policy_get_fal_rate(
 		&profile->scp_policies[traf], instance->sci_ifp)
 		* (1024 / 8);	/* convert from kilobits into bytes */
 
+	if (instance->sci_sw[traf].scs_rate) {
+		storm_ctl_sw_policer_set(instance, traf,
+					 policer_bind_attr.value.u64);
+		return 0;
+	}
+
+	if (!instance->sci_fal_obj[traf]) {
+		rv = fal_policer_apply_profile(profile, vlan,
+					       instance, traf);
+		if (!instance->sci_fal_obj[traf])
+			return rv == -EOPNOTSUPP ? 0 : rv;
+	}
+
 	rv = fal_policer_set_attr(instance->sci_fal_obj[traf],
 				  &policer_bind_attr);
 	if (rv && rv != -EOPNOTSUPP) {
@@ -620,6 +774,8 @@ static int fal_policer_unapply_profile(struct ifnet *ifp,
 		  .value.u16 = vlan }
 	};
 
+	storm_ctl_sw_policer_set(instance, traf, 0);
+
 	if (vlan) {
 		vlan_feat = if_vlan_feat_get(ifp, vlan);
 		if (!vlan_feat) {
@@ -1376,7 +1532,8 @@ int storm_ctl_set_profile_on_intf(bool set, struct ifnet *ifp,
 
 		for (i = FAL_TRAFFIC_UCAST; i < FAL_TRAFFIC_MAX; i++) {
 			/* Delete only if there was a create */
-			if (instance->sci_fal_obj[i])
+			if (instance->sci_fal_obj[i] ||
+			    instance->sci_sw[i].scs_rate)
 				fal_policer_unapply_profile(ifp, vlan,
 							    instance, i);
 		}
@@ -1797,8 +1954,13 @@ static void storm_ctl_clear_intf_stats(struct ifnet *ifp, void *ctx __unused)
 		memset(instance->sci_pkt_drops, 0,
 		       sizeof(instance->sci_pkt_drops));
 		for (i = 0; i < FAL_TRAFFIC_MAX; i++) {
-			if (!instance->sci_fal_obj[i])
+			if (!instance->sci_fal_obj[i]) {
+				rte_atomic64_clear(
+					&instance->sci_sw[i].scs_drops);
+				rte_atomic64_clear(
+					&instance->sci_sw[i].scs_drop_bytes);
 				continue;
+			}
 
 			rc = fal_policer_clear_stats(instance->sci_fal_obj[i],
 						     FAL_POLICER_STAT_MAX,
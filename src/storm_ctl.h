@@ -9,10 +9,24 @@
 #ifndef STORM_CTL_H
 #define STORM_CTL_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "urcu.h"
 
+struct ifnet;
+
 int cmd_storm_ctl_cfg(FILE *f, int argc, char **argv);
 int cmd_storm_ctl_op(FILE *f, int argc, char **argv);
 const char *storm_ctl_traffic_type_to_str(enum fal_traffic_type tr_type);
 
+/*
+ * Police a frame received on ifp against the storm control that could
+ * not be offloaded to the platform. Returns true if it is to be dropped.
+ * Only interfaces with storm control configured (ifp->sc_info) need be
+ * checked.
+ */
+bool storm_ctl_police(struct ifnet *ifp, uint16_t vlan,
+		      enum fal_traffic_type tr_type, uint32_t len);
+
 #endif
@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Tunnel offload - see tun_offload.h.
+ *
+ * The flow mark is the index of the VNI's slot, and the rx path maps
+ * it back to the interface through the slot, under RCU.  Freed slots
+ * are reused round robin, so that a frame still in a ring when its VNI
+ * goes is dropped rather than input on a newer tunnel.
+ *
+ * Flows are only added and removed on the master thread.
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <rte_branch_prediction.h>
+#include <rte_byteorder.h>
+#include <rte_ethdev.h>
+#include <rte_flow.h>
+#include <rte_log.h>
+#include <rte_mbuf.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "config.h"
+#include "if_var.h"
+#include "pktmbuf.h"
+#include "tun_offload.h"
+#include "urcu.h"
+#include "vplane_log.h"
+#include "vrf.h"
+#include "vxlan.h"
+
+#define TUN_OFFLOAD_SLOTS	1024
+
+struct tun_offload_slot {
+	struct ifnet	*ifp;		/* read by the rx path */
+	uint32_t	vni;
+	in_addr_t	local;
+	vrfid_t		vrfid;
+	struct rte_flow	*flows[DATAPLANE_MAX_PORTS];
+};
+
+bool tun_offload_enabled __hot_data;
+
+static struct tun_offload_slot tun_offload_slots[TUN_OFFLOAD_SLOTS];
+static bool tun_offload_started[DATAPLANE_MAX_PORTS];
+static unsigned int tun_offload_next_slot;
+
+static struct rte_flow *
+tun_offload_flow_create(portid_t port, uint32_t mark,
+			const struct tun_offload_slot *s)
+{
+	const struct rte_flow_attr attr = { .ingress = 1 };
+	const struct rte_flow_action_mark act_mark = { .id = mark };
+	/* No fate action, so the frame is spread by RSS as before */
+	const struct rte_flow_action actions[] = {
+		{ .type = RTE_FLOW_ACTION_TYPE_VXLAN_DECAP },
+		{ .type = RTE_FLOW_ACTION_TYPE_MARK, .conf = &act_mark },
+		{ .type = RTE_FLOW_ACTION_TYPE_END },
+	};
+	struct rte_flow_item_ipv4 ip4_spec, ip4_mask;
+	struct rte_flow_item_udp udp_spec, udp_mask;
+	struct rte_flow_item_vxlan vx_spec, vx_mask;
+	struct rte_flow_item pattern[5];
+	struct rte_flow_error error;
+
+	memset(pattern, 0, sizeof(pattern));
+	memset(&ip4_spec, 0, sizeof(ip4_spec));
+	memset(&ip4_mask, 0, sizeof(ip4_mask));
+	memset(&udp_spec, 0, sizeof(udp_spec));
+	memset(&udp_mask, 0, sizeof(udp_mask));
+	memset(&vx_spec, 0, sizeof(vx_spec));
+	memset(&vx_mask, 0, sizeof(vx_mask));
+
+	pattern[0].type = RTE_FLOW_ITEM_TYPE_ETH;
+
+	ip4_spec.hdr.dst_addr = s->local;
+	ip4_mask.hdr.dst_addr = RTE_BE32(0xffffffff);
+	pattern[1].type = RTE_FLOW_ITEM_TYPE_IPV4;
+	pattern[1].spec = &ip4_spec;
+	pattern[1].mask = &ip4_mask;
+
+	udp_spec.hdr.dst_port = RTE_BE16(VXLAN_PORT);
+	udp_mask.hdr.dst_port = RTE_BE16(0xffff);
+	pattern[2].type = RTE_FLOW_ITEM_TYPE_UDP;
+	pattern[2].spec = &udp_spec;
+	pattern[2].mask = &udp_mask;
+
+	vx_spec.vni[0] = s->vni >> 16;
+	vx_spec.vni[1] = s->vni >> 8;
+	vx_spec.vni[2] = s->vni;
+	memset(vx_mask.vni, 0xff, sizeof(vx_mask.vni));
+	pattern[3].type = RTE_FLOW_ITEM_TYPE_VXLAN;
+	pattern[3].spec = &vx_spec;
+	pattern[3].mask = &vx_mask;
+
+	pattern[4].type = RTE_FLOW_ITEM_TYPE_END;
+
+	return rte_flow_create(port, &attr, pattern, actions, &error);
+}
+
+/* Only where the tunnel's transport VRF is the port's own */
+static void tun_offload_slot_install(unsigned int id, portid_t port)
+{
+	struct tun_offload_slot *s = &tun_offload_slots[id];
+	struct ifnet *pifp = ifnet_byport(port);
+
+	if (!s->ifp || s->flows[port] || !pifp || pifp->if_vrfid != s->vrfid)
+		return;
+
+	s->flows[port] = tun_offload_flow_create(port, id, s);
+	if (!s->flows[port])
+		RTE_LOG(INFO, DATAPLANE,
+			"port %u: vxlan vni %u decap not offloaded\n",
+			port, s->vni);
+}
+
+static void tun_offload_slot_uninstall(unsigned int id, portid_t port)
+{
+	struct tun_offload_slot *s = &tun_offload_slots[id];
+	struct rte_flow_error error;
+
+	if (s->flows[port]) {
+		rte_flow_destroy(port, s->flows[port], &error);
+		s->flows[port] = NULL;
+	}
+}
+
+void tun_offload_start(portid_t port)
+{
+	unsigned int id;
+
+	if (!config.tunnel_offload)
+		return;
+
+	CMM_STORE_SHARED(tun_offload_enabled, true);
+	tun_offload_started[port] = true;
+	for (id = 0; id < TUN_OFFLOAD_SLOTS; id++)
+		tun_offload_slot_install(id, port);
+}
+
+void tun_offload_stop(portid_t port)
+{
+	unsigned int id;
+
+	if (!tun_offload_started[port])
+		return;
+
+	tun_offload_started[port] = false;
+	for (id = 0; id < TUN_OFFLOAD_SLOTS; id++)
+		tun_offload_slot_uninstall(id, port);
+}
+
+static int tun_offload_slot_find(const struct ifnet *ifp)
+{
+	unsigned int id;
+
+	for (id = 0; id < TUN_OFFLOAD_SLOTS; id++)
+		if (tun_offload_slots[id].ifp == ifp)
+			return id;
+	return -ENOENT;
+}
+
+static int tun_offload_slot_alloc(void)
+{
+	unsigned int i, id;
+
+	for (i = 0; i < TUN_OFFLOAD_SLOTS; i++) {
+		id = (tun_offload_next_slot + i) % TUN_OFFLOAD_SLOTS;
+		if (!tun_offload_slots[id].ifp) {
+			tun_offload_next_slot = id + 1;
+			return id;
+		}
+	}
+	return -ENOSPC;
+}
+
+static void tun_offload_slot_free(unsigned int id)
+{
+	struct tun_offload_slot *s = &tun_offload_slots[id];
+	portid_t port;
+
+	for (port = 0; port < DATAPLANE_MAX_PORTS; port++)
+		tun_offload_slot_uninstall(id, port);
+
+	/* The interface outlives any reader, it is freed after RCU */
+	rcu_assign_pointer(s->ifp, NULL);
+}
+
+void tun_offload_vxlan_del(const struct vxlan_vninode *vnode)
+{
+	int id = tun_offload_slot_find(vnode->ifp);
+
+	if (id >= 0)
+		tun_offload_slot_free(id);
+}
+
+void tun_offload_vxlan_update(const struct vxlan_vninode *vnode)
+{
+	struct tun_offload_slot *s;
+	portid_t port;
+	int id;
+
+	if (!config.tunnel_offload)
+		return;
+
+	/* Reprogram from scratch, the address or VRF may have changed */
+	tun_offload_vxlan_del(vnode);
+
+	if (vnode->l_addr == 0 || vnode->learning ||
+	    (vnode->flags & VXLAN_FLAG_GPE) ||
+	    vnode->t_vrfid == VRF_INVALID_ID)
+		return;
+
+	id = tun_offload_slot_alloc();
+	if (id < 0) {
+		RTE_LOG(NOTICE, DATAPLANE,
+			"vxlan vni %u decap not offloaded: no free slot\n",
+			vnode->vni);
+		return;
+	}
+
+	s = &tun_offload_slots[id];
+	s->vni = vnode->vni;
+	s->local = vnode->l_addr;
+	s->vrfid = vnode->t_vrfid;
+	rcu_assign_pointer(s->ifp, vnode->ifp);
+
+	for (port = 0; port < DATAPLANE_MAX_PORTS; port++)
+		if (tun_offload_started[port])
+			tun_offload_slot_install(id, port);
+}
+
+uint16_t tun_offload_rx(struct rte_mbuf *pkts[], uint16_t nb)
+{
+	struct rte_mbuf *m;
+	struct ifnet *ifp;
+	uint16_t i, n = 0;
+	uint32_t id;
+
+	for (i = 0; i < nb; i++) {
+		m = pkts[i];
+		if (likely(!(m->ol_flags & PKT_RX_FDIR_ID))) {
+			pkts[n++] = m;
+			continue;
+		}
+
+		id = m->hash.fdir.hi;
+		m->ol_flags &= ~(PKT_RX_FDIR | PKT_RX_FDIR_ID);
+		ifp = id < TUN_OFFLOAD_SLOTS ?
+			rcu_dereference(tun_offload_slots[id].ifp) : NULL;
+		if (unlikely(!ifp)) {
+			rte_pktmbuf_free(m);
+			continue;
+		}
+
+		pktmbuf_mdata_clear_all(m);
+		vxlan_offload_input(ifp, m);
+	}
+	return n;
+}
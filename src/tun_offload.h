@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+/*
+ * Tunnel offload - with tunnel-offload set in the config, VXLAN
+ * tunnels terminating here are decapsulated by the NIC.  Each
+ * offloaded VNI gets an rte_flow rule on every started port, matching
+ * its local address and VNI, which strips the outer headers and marks
+ * the frame with the VNI's slot.  The rx path then hands marked frames
+ * straight to the vxlan interface, without the outer IP and UDP
+ * lookups.
+ *
+ * Only VNIs with a local IPv4 address and with learning off are
+ * offloaded, since learning needs the outer source address.  Anything
+ * a PMD won't take stays with the software decap.
+ */
+#ifndef TUN_OFFLOAD_H
+#define TUN_OFFLOAD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "compat.h"
+#include "compiler.h"
+
+struct rte_mbuf;
+struct vxlan_vninode;
+
+extern bool tun_offload_enabled __hot_data;
+
+/* After the port is started, since some PMDs drop flows on stop */
+void tun_offload_start(portid_t port);
+void tun_offload_stop(portid_t port);
+
+/* Offload the VNI, or stop doing so if it no longer qualifies */
+void tun_offload_vxlan_update(const struct vxlan_vninode *vnode);
+void tun_offload_vxlan_del(const struct vxlan_vninode *vnode);
+
+/*
+ * Input the frames of the burst the NIC has decapsulated, and return
+ * how many are left, moved up to the front.
+ */
+uint16_t tun_offload_rx(struct rte_mbuf *pkts[], uint16_t nb);
+
+#endif /* TUN_OFFLOAD_H */
@@ -100,6 +100,9 @@ const char *nlmsg_type(unsigned int type)
 	case RTM_GETADDRLABEL:	return "RTM_GETADDRLABEL";
 	case RTM_GETDCB:	return "RTM_GETDCB";
 	case RTM_SETDCB:	return "RTM_SETDCB";
+	case RTM_NEWMDB:	return "RTM_NEWMDB";
+	case RTM_DELMDB:	return "RTM_DELMDB";
+	case RTM_GETMDB:	return "RTM_GETMDB";
 	default:
 		sprintf(buf, "%u", type);
 		return buf;
@@ -288,6 +291,99 @@ bool secondary_cpu(unsigned int core_id)
 	return false;
 }
 
+/*
+ * Read the leading number of a sysfs file, e.g. a cache level or the
+ * first cpu of a list such as '0-3,8'. Returns -1 if there is none.
+ */
+static int sysfs_read_first(const char *path)
+{
+	char buf[64];
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+
+	if (fgets(buf, sizeof(buf), f) == NULL || !isdigit(buf[0])) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+
+	return atoi(buf);
+}
+
+/* SMT siblings of a CPU, not including itself */
+int cpu_siblings(unsigned int core_id, bitmask_t *siblings)
+{
+	char path[PATH_MAX];
+	char list[1024];
+	char *cp = list;
+	FILE *f;
+
+	bitmask_zero(siblings);
+
+	snprintf(path, PATH_MAX,
+		 "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list",
+		 core_id);
+
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -errno;
+	if (fgets(list, sizeof(list), f) == NULL) {
+		fclose(f);
+		return -EINVAL;
+	}
+	fclose(f);
+
+	while (isdigit(*cp)) {
+		unsigned long lo, hi;
+
+		lo = hi = strtoul(cp, &cp, 10);
+		if (*cp == '-')
+			hi = strtoul(cp + 1, &cp, 10);
+		for (; lo <= hi && lo < RTE_MAX_LCORE; lo++)
+			if (lo != core_id)
+				bitmask_set(siblings, lo);
+		if (*cp == ',')
+			cp++;
+	}
+
+	return 0;
+}
+
+/*
+ * Identify the last level cache of a CPU by the first CPU sharing
+ * it, or -1 if unknown.
+ */
+int cpu_llc_id(unsigned int core_id)
+{
+	char path[PATH_MAX];
+	int level, best_level = -1, best = -1;
+	unsigned int idx;
+
+	for (idx = 0; ; idx++) {
+		snprintf(path, PATH_MAX,
+			 "/sys/devices/system/cpu/cpu%u/cache/index%u/level",
+			 core_id, idx);
+		level = sysfs_read_first(path);
+		if (level < 0)
+			break;
+		if (level >= best_level) {
+			best_level = level;
+			best = idx;
+		}
+	}
+
+	if (best < 0)
+		return -1;
+
+	snprintf(path, PATH_MAX,
+		 "/sys/devices/system/cpu/cpu%u/cache/index%d/shared_cpu_list",
+		 core_id, best);
+	return sysfs_read_first(path);
+}
+
 /* Convert from argv set of strings to one long string separated
  * by spaces. Does not do quoting!.
  * Returns 0 on success, -1 if out of space.
@@ -521,7 +617,13 @@ unsigned int get_lcore_max(void)
 	return max;
 }
 
-/* Allocate memory aligned on cache line boundary */
+/* Threshold at which a mapping is worth backing with huge pages */
+#define HUGE_ADVISE_SIZE (2 * 1024 * 1024)
+
+/*
+ * Allocate memory aligned on a page boundary, backed by transparent
+ * huge pages where big enough, to save TLB misses on the large tables.
+ */
 void *malloc_huge_aligned(size_t sz)
 {
 	void *ptr = NULL;
@@ -532,6 +634,10 @@ void *malloc_huge_aligned(size_t sz)
 	if (ptr == MAP_FAILED)
 		return NULL;
 
+	/* Only advice, so failure e.g. with THP disabled is harmless */
+	if (sz >= HUGE_ADVISE_SIZE)
+		(void)madvise(ptr, sz, MADV_HUGEPAGE);
+
 	return ptr;
 }
 
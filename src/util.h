@@ -171,6 +171,9 @@ int get_unsigned_short(const char *str, unsigned short *ptr);
 int get_unsigned_char(const char *str, unsigned char *ptr);
 int net_ratelimit(void);
 bool secondary_cpu(unsigned int id);
+struct bitmask;
+int cpu_siblings(unsigned int id, struct bitmask *siblings);
+int cpu_llc_id(unsigned int id);
 int str_unsplit(char *, size_t, int, char **);
 size_t snprintfcat(char *buf, size_t size, const char *fmt, ...)
 	__attribute__ ((__format__(__printf__, 3, 4)));
@@ -31,6 +31,12 @@
  *  A filter classification is the compound of all the
  *  classify_entries attached.  A filter action is the compound of all
  *  the action_entries attached.
+ *
+ *  Filters are compiled into a per interface table indexed by vlan, so
+ *  the forwarding path does a single lookup however many filters there
+ *  are.  A filter on an exact vlan owns its table slot.  A filter with a
+ *  partial vlan mask is also kept on the chain's masked list, ordered by
+ *  priority, and fills each slot it matches that no exact filter owns.
  */
 
 #include <stdbool.h>
@@ -90,10 +96,14 @@ struct  vlan_mod_chain_list_entry {
 	struct vlan_mod_tbl_entry *tbl;
 	struct vlan_mod_tbl_entry *vlan_mod_default;
 	void *lookup_table;
+	struct cds_list_head masked_head;
+	uint64_t exact[VLAN_N_VID / 64]; /* slots owned by exact filters */
 };
 
 struct  vlan_mod_filter_list_entry {
 	struct cds_list_head list_next;
+	struct cds_list_head masked_next;
+	bool masked;
 	struct vlan_mod_tc_filter_key key;
 	struct vlan_mod_chain_list_entry *parent;
 	struct rcu_head list_rcu;
@@ -425,6 +435,12 @@ vlan_mod_flt_get_classify_vlan(struct vlan_mod_filter_list_entry *entry,
 	return MNL_CB_OK;
 }
 
+static uint16_t
+vlan_mod_flt_get_classify_mask(struct vlan_mod_filter_list_entry *entry)
+{
+	return ntohs(entry->classify->mask) & 0xFFF;
+}
+
 static bool
 vlan_mod_enable_fwding(struct vlan_mod_chain_list_entry *entry)
 {
@@ -516,6 +532,104 @@ vlan_mod_flt_add_fwd_tbl_entry(uint16_t vlan,
 
 }
 
+static bool
+vlan_mod_flt_exact_test(struct vlan_mod_chain_list_entry *chain, uint16_t vlan)
+{
+	return chain->exact[vlan / 64] & (1ul << (vlan % 64));
+}
+
+static void
+vlan_mod_flt_exact_set(struct vlan_mod_chain_list_entry *chain, uint16_t vlan,
+		       bool set)
+{
+	if (set)
+		chain->exact[vlan / 64] |= 1ul << (vlan % 64);
+	else
+		chain->exact[vlan / 64] &= ~(1ul << (vlan % 64));
+}
+
+/*
+ * Action for a slot no exact filter owns, from the first masked filter
+ * that matches.  The last vlan is the default entry, which is only set
+ * by an exact filter.
+ */
+static struct vlan_mod_ft_cls_action *
+vlan_mod_flt_masked_action(struct vlan_mod_chain_list_entry *chain,
+			   uint16_t vlan)
+{
+	struct vlan_mod_filter_list_entry *entry;
+	uint16_t value;
+
+	if (vlan == VLAN_N_VID - 1)
+		return NULL;
+
+	cds_list_for_each_entry(entry, &chain->masked_head, masked_next) {
+		vlan_mod_flt_get_classify_vlan(entry, &value);
+		if ((vlan & vlan_mod_flt_get_classify_mask(entry)) == value)
+			return entry->actions;
+	}
+	return NULL;
+}
+
+/*
+ * Recompute the slots a masked filter matches, other than those owned by
+ * exact filters.
+ */
+static void
+vlan_mod_flt_masked_refresh(struct vlan_mod_filter_list_entry *entry)
+{
+	struct vlan_mod_chain_list_entry *chain = entry->parent;
+	uint16_t vlan, value, mask;
+
+	if (!chain->tbl)
+		return;
+
+	vlan_mod_flt_get_classify_vlan(entry, &value);
+	mask = vlan_mod_flt_get_classify_mask(entry);
+
+	for (vlan = 0; vlan < VLAN_N_VID - 1; vlan++) {
+		if ((vlan & mask) != value ||
+		    vlan_mod_flt_exact_test(chain, vlan))
+			continue;
+
+		vlan_mod_flt_add_fwd_tbl_entry(
+			vlan, entry, vlan_mod_flt_masked_action(chain, vlan));
+	}
+}
+
+static void
+vlan_mod_flt_masked_insert(struct vlan_mod_filter_list_entry *entry)
+{
+	struct vlan_mod_chain_list_entry *chain = entry->parent;
+	struct vlan_mod_filter_list_entry *pos;
+
+	cds_list_for_each_entry(pos, &chain->masked_head, masked_next) {
+		if (pos->key.priority > entry->key.priority)
+			break;
+	}
+	cds_list_add_tail(&entry->masked_next, &pos->masked_next);
+	entry->masked = true;
+}
+
+/*
+ * Compile a filter into the forwarding table
+ */
+static void
+vlan_mod_flt_fwd_tbl_add(struct vlan_mod_filter_list_entry *entry)
+{
+	uint16_t vlan;
+
+	if (vlan_mod_flt_get_classify_mask(entry) != 0xFFF) {
+		vlan_mod_flt_masked_insert(entry);
+		vlan_mod_flt_masked_refresh(entry);
+		return;
+	}
+
+	vlan_mod_flt_get_classify_vlan(entry, &vlan);
+	vlan_mod_flt_exact_set(entry->parent, vlan, true);
+	vlan_mod_flt_add_fwd_tbl_entry(vlan, entry, entry->actions);
+}
+
 static struct vlan_mod_filter_list_head *
 vlan_mod_flt_head_init(struct vlan_mod_filter_list_head *head)
 {
@@ -676,6 +790,7 @@ vlan_mod_flt_lookup_chain(struct vlan_mod_tc_filter_key *key,
 	 * setting the key to the less specific key.
 	 */
 	vlan_mod_flt_head_init(&entry->filter_head);
+	CDS_INIT_LIST_HEAD(&entry->masked_head);
 	entry->key = s_key;
 
 	RTE_LOG(INFO, DATAPLANE, "vlan_mod: new chain entry: %s\n",
@@ -695,6 +810,9 @@ vlan_mod_flt_lookup_chain(struct vlan_mod_tc_filter_key *key,
 	return entry;
 }
 
+static void
+vlan_mod_flt_del_fwd_tbl_entry(struct vlan_mod_filter_list_entry *entry);
+
 static int vlan_mod_flt_add_entry(struct vlan_mod_tc_filter_key *key,
 			    struct tcmsg *tcm,
 			    struct nlattr *tb[])
@@ -703,7 +821,6 @@ static int vlan_mod_flt_add_entry(struct vlan_mod_tc_filter_key *key,
 	struct vlan_mod_filter_list_entry *old, *new;
 	struct vlan_mod_filter_list_head *list_head;
 	char key_string[VLAN_MOD_FLT_KEY_STR_LEN + 1];
-	uint16_t old_vlan, new_vlan;
 
 	if (!filter_chain_head) {
 		filter_chain_head = vlan_mod_flt_create_chain_head();
@@ -749,20 +866,9 @@ static int vlan_mod_flt_add_entry(struct vlan_mod_tc_filter_key *key,
 		return MNL_CB_OK;
 	}
 
-	if (vlan_mod_flt_get_classify_vlan(new, &new_vlan) != MNL_CB_OK) {
-		free(new);
-		return MNL_CB_ERROR;
-	}
-
-	if (old) {
-		if (vlan_mod_flt_get_classify_vlan(old,
-						   &old_vlan) != MNL_CB_OK) {
-			free(new);
-			return MNL_CB_ERROR;
-		}
-		vlan_mod_flt_add_fwd_tbl_entry(old_vlan, old, NULL);
-	}
-	vlan_mod_flt_add_fwd_tbl_entry(new_vlan, new, new->actions);
+	if (old)
+		vlan_mod_flt_del_fwd_tbl_entry(old);
+	vlan_mod_flt_fwd_tbl_add(new);
 
 	if (!old) {
 		cds_list_add_tail_rcu(&new->list_next, &list_head->list_head);
@@ -789,7 +895,17 @@ vlan_mod_flt_del_fwd_tbl_entry(struct vlan_mod_filter_list_entry *entry)
 		return;
 	}
 
-	vlan_mod_flt_add_fwd_tbl_entry(vlan, entry, NULL);
+	if (entry->masked) {
+		cds_list_del(&entry->masked_next);
+		entry->masked = false;
+		vlan_mod_flt_masked_refresh(entry);
+		return;
+	}
+
+	/* Uncover any masked filter the exact one was hiding */
+	vlan_mod_flt_exact_set(entry->parent, vlan, false);
+	vlan_mod_flt_add_fwd_tbl_entry(
+		vlan, entry, vlan_mod_flt_masked_action(entry->parent, vlan));
 }
 
 static void
@@ -830,8 +946,6 @@ static int vlan_mod_flt_delete_entry(struct vlan_mod_tc_filter_key *key)
 	if (!filter_entry)
 		return MNL_CB_OK;
 
-	vlan_mod_flt_del_fwd_tbl_entry(filter_entry);
-
 	vlan_mod_flt_delete_entry_common(filter_entry, list_head);
 
 	return MNL_CB_OK;
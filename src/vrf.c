@@ -8,6 +8,7 @@
 
 #include <libmnl/libmnl.h>
 #include <rte_debug.h>
+#include <rte_jhash.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
 #include <stdint.h>
@@ -17,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <urcu/rculfhash.h>
 #include <urcu/uatomic.h>
 
 #include "compiler.h"
@@ -42,6 +44,12 @@ struct nlattr;
 
 struct vrf *vrf_table[VRF_ID_MAX] __hot_data = {NULL};
 
+/* vrfmasters by kernel table id, so route updates avoid an ifnet walk */
+#define VRFMASTER_TABLEID_HASH_MIN 64
+#define VRFMASTER_TABLEID_HASH_MAX 8192
+
+static struct cds_lfht *vrfmaster_tableid_ht;
+
 /*
  * Infrastructure to handle table maps received out of order
  * w.r.t netlink.
@@ -378,6 +386,10 @@ struct ifnet *vrfmaster_create(const char *ifname, uint32_t if_index,
 		return NULL;
 	}
 	vrsc->vrfsc_tableid = vrf_tableid;
+	vrsc->vrfsc_ifp = ifp;
+	cds_lfht_node_init(&vrsc->vrfsc_tableid_node);
+	cds_lfht_add(vrfmaster_tableid_ht, rte_jhash_1word(vrf_tableid, 0),
+		     &vrsc->vrfsc_tableid_node);
 	ifp->if_softc = vrsc;
 
 	if_set_ifindex(ifp, if_index);
@@ -401,6 +413,7 @@ static void vrfmaster_delete(struct ifnet *ifp)
 	route_unlink_vrf_from_table(vrf);
 	route6_unlink_vrf_from_table(vrf);
 
+	cds_lfht_del(vrfmaster_tableid_ht, &vrsc->vrfsc_tableid_node);
 	call_rcu(&vrsc->vrfsc_rcu, vrfmaster_free_rcu);
 }
 
@@ -461,28 +474,29 @@ vrfid_t vrfmaster_get_tableid(struct ifnet *ifp)
 	return vrsc->vrfsc_tableid;
 }
 
-struct vrfmaster_lookup_by_tableid_ctx {
-	uint32_t tableid;
-	struct ifnet *ifp;
-};
-
-static void vrfmaster_lookup_by_tableid_worker(struct ifnet *ifp, void *arg)
+static int vrfmaster_tableid_match(struct cds_lfht_node *node,
+				   const void *key)
 {
-	struct vrfmaster_lookup_by_tableid_ctx *ctx = arg;
+	const struct vrf_softc *vrsc =
+		caa_container_of(node, const struct vrf_softc,
+				 vrfsc_tableid_node);
 
-	if (ifp->if_type == IFT_VRFMASTER &&
-	    vrfmaster_get_tableid(ifp) == ctx->tableid)
-		ctx->ifp = ifp;
+	return vrsc->vrfsc_tableid == *(const uint32_t *)key;
 }
 
 struct ifnet *vrfmaster_lookup_by_tableid(uint32_t tableid)
 {
-	struct vrfmaster_lookup_by_tableid_ctx ctx = {
-		.tableid = tableid,
-		.ifp = NULL,
-	};
-	ifnet_walk(vrfmaster_lookup_by_tableid_worker, &ctx);
-	return ctx.ifp;
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+
+	cds_lfht_lookup(vrfmaster_tableid_ht, rte_jhash_1word(tableid, 0),
+			vrfmaster_tableid_match, &tableid, &iter);
+	node = cds_lfht_iter_get_node(&iter);
+	if (!node)
+		return NULL;
+
+	return caa_container_of(node, struct vrf_softc,
+				vrfsc_tableid_node)->vrfsc_ifp;
 }
 
 struct vrf *vrf_get_rcu_from_external(vrfid_t external_id)
@@ -575,6 +589,13 @@ void vrf_init(void)
 		rte_panic("Failed to register VRF Master type: %s",
 			  strerror(-ret));
 
+	vrfmaster_tableid_ht = cds_lfht_new(VRFMASTER_TABLEID_HASH_MIN,
+					    VRFMASTER_TABLEID_HASH_MIN,
+					    VRFMASTER_TABLEID_HASH_MAX,
+					    CDS_LFHT_AUTO_RESIZE, NULL);
+	if (!vrfmaster_tableid_ht)
+		rte_panic("Can't allocate VRF table id hash\n");
+
 	/*
 	 * Take an extra refcount on the default and invalid vrf as
 	 * they should never be destroyed. The invalid VRF
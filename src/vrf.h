@@ -28,6 +28,7 @@
 #include "urcu.h"
 #include "util.h"
 
+struct ipv4_frag_tbl;
 struct npf_config;
 struct npf_alg_instance;
 struct npf_timeout;
@@ -54,7 +55,7 @@ struct vrf {
 	char SPARE[4];
 	/* --- cacheline 1 boundary (64 bytes) --- */
 	uint32_t  *v_pbrtablemap;
-	struct cds_lfht *v_ipv4_frag_table;
+	struct ipv4_frag_tbl *v_ipv4_frag_tbl;
 	struct cds_lfht *v_ipv6_frag_table;
 	struct mcast_vrf v_mvrf4;
 	struct mcast6_vrf v_mvrf6;
@@ -164,6 +165,29 @@ vrfid_t vrf_get_external_id(vrfid_t internal_id);
 void vrf_set_external_id(struct vrf *vrf, uint32_t external_id);
 struct vrf *vrf_get_rcu_from_external(vrfid_t external_id);
 
+/*
+ * As vrf_get_rcu_from_external, for per-packet use.  The internal id
+ * last found is kept in *hint, so that only a miss looks up the
+ * vrfmaster.
+ */
+static inline struct vrf *
+vrf_get_rcu_from_external_hint(vrfid_t external_id, vrfid_t *hint)
+{
+	struct vrf *vrf;
+
+	if (!is_nondefault_vrf(external_id))
+		return vrf_get_rcu(external_id);
+
+	vrf = vrf_get_rcu(CMM_LOAD_SHARED(*hint));
+	if (likely(vrf && vrf->v_external_id == external_id))
+		return vrf;
+
+	vrf = vrf_get_rcu_from_external(external_id);
+	if (vrf)
+		CMM_STORE_SHARED(*hint, vrf->v_id);
+	return vrf;
+}
+
 /*
  * Set up PBR tablemap in vrf to map PBR tables (1-128)
  * to kernel tableid.
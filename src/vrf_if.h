@@ -17,6 +17,8 @@ struct ifnet;
 
 struct vrf_softc {
 	uint32_t        vrfsc_tableid;
+	struct ifnet	*vrfsc_ifp;
+	struct cds_lfht_node vrfsc_tableid_node;
 	struct rcu_head	vrfsc_rcu;
 };
 
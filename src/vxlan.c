@@ -58,11 +58,13 @@
 #include "ip_icmp.h"
 #include "json_writer.h"
 #include "main.h"
+#include "master.h"
 #include "mpls/mpls.h"
 #include "netinet6/ip6_funcs.h"
 #include "netinet6/route_v6.h"
 #include "nh.h"
 #include "nsh.h"
+#include "nsh_sff.h"
 #include "pktmbuf.h"
 #include "pl_common.h"
 #include "pl_fused.h"
@@ -70,6 +72,7 @@
 #include "route_flags.h"
 #include "shadow.h"
 #include "snmp_mib.h"
+#include "tun_offload.h"
 #include "udp_handler.h"
 #include "urcu.h"
 #include "util.h"
@@ -120,6 +123,8 @@ enum VXLAN_STATS {
 	VXLAN_STATS_OUTDISCARDS_ENCAP_FAILED,
 	VXLAN_STATS_OUTDISCARDS_ND_FAILED,
 	VXLAN_STATS_OUTDISCARDS_UNKNOWN_PAYLOAD,
+	VXLAN_STATS_NSH_FORWARDED,
+	VXLAN_STATS_INDISCARDS_NSH_NOPATH,
 	VXLAN_STATS_MAX
 };
 
@@ -138,6 +143,8 @@ static const char *vxlan_cntr_names[VXLAN_STATS_MAX] = {
 	[VXLAN_STATS_OUTDISCARDS_ENCAP_FAILED] = "OutDiscardsEncapFailed",
 	[VXLAN_STATS_OUTDISCARDS_ND_FAILED] = "NDFailed",
 	[VXLAN_STATS_OUTDISCARDS_UNKNOWN_PAYLOAD] = "OutDiscardsUnknownPayload",
+	[VXLAN_STATS_NSH_FORWARDED] = "NshForwarded",
+	[VXLAN_STATS_INDISCARDS_NSH_NOPATH] = "InDiscardsNshNoPath",
 };
 
 unsigned long vxlan_stats[RTE_MAX_LCORE][VXLAN_STATS_MAX] __rte_cache_aligned;
@@ -147,6 +154,25 @@ unsigned long vxlan_stats[RTE_MAX_LCORE][VXLAN_STATS_MAX] __rte_cache_aligned;
 /* Table of active VNIs */
 static struct vxlan_vnitbl *vxlans;
 
+/*
+ * Prebuilt outer headers for a remote IPv4 VTEP, so that encap is a
+ * copy plus patching the lengths, TOS, source port and checksum.
+ * Templates are immutable and replaced whole; one is stale once the
+ * route to the VTEP resolves differently or the generation moves on.
+ */
+struct vxlan_ipv4_tmpl {
+	in_addr_t		vt_dst;
+	in_addr_t		vt_nh;		/* next hop address */
+	struct ifnet		*vt_dif;	/* output interface */
+	uint32_t		vt_gen;
+	uint32_t		vt_sum;		/* sum of the fixed IP words */
+	struct vxlan_ipv4_encap	vt_hdr;
+	struct rcu_head		vt_rcu;
+};
+
+/* Bumped when source address selection may give a different answer */
+static uint32_t vxlan_tmpl_gen;
+
 /*
  * Forward references
  */
@@ -176,7 +202,7 @@ static inline int vxlan_vni_match(struct cds_lfht_node *node, const void *key)
 }
 
 static struct vxlan_vninode *
-vxlan_vni_lookup(uint32_t vni)
+vxlan_vni_hash_lookup(uint32_t vni)
 {
 	struct cds_lfht_iter iter;
 
@@ -191,6 +217,74 @@ vxlan_vni_lookup(uint32_t vni)
 		return NULL;
 }
 
+/* Per-packet lookup, through the direct map for any valid VNI */
+static struct vxlan_vninode *
+vxlan_vni_lookup(uint32_t vni)
+{
+	const struct vxlan_vni_block *blk;
+
+	if (unlikely(vni >> VXLAN_VNI_BITS))
+		return vxlan_vni_hash_lookup(vni);
+
+	blk = rcu_dereference(vxlans->vtbl_vnimap[vni >> VXLAN_VNI_BLOCK_BITS]);
+	if (!blk)
+		return NULL;
+
+	return rcu_dereference(blk->vnb_node[vni & (VXLAN_VNI_BLOCK_SIZE - 1)]);
+}
+
+static int
+vxlan_vni_map(struct vxlan_vninode *vni)
+{
+	struct vxlan_vni_block **blkp;
+	struct vxlan_vni_block *blk;
+
+	if (vni->vni >> VXLAN_VNI_BITS)
+		return 0;
+
+	blkp = &vxlans->vtbl_vnimap[vni->vni >> VXLAN_VNI_BLOCK_BITS];
+	blk = *blkp;
+	if (!blk) {
+		blk = zmalloc_aligned(sizeof(*blk));
+		if (!blk)
+			return ENOMEM;
+		rcu_assign_pointer(*blkp, blk);
+	}
+
+	blk->vnb_count++;
+	rcu_assign_pointer(blk->vnb_node[vni->vni & (VXLAN_VNI_BLOCK_SIZE - 1)],
+			   vni);
+	return 0;
+}
+
+static void
+vxlan_vni_block_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct vxlan_vni_block, vnb_rcu));
+}
+
+static void
+vxlan_vni_unmap(struct vxlan_vninode *vni)
+{
+	struct vxlan_vni_block **blkp;
+	struct vxlan_vni_block *blk;
+
+	if (vni->vni >> VXLAN_VNI_BITS)
+		return;
+
+	blkp = &vxlans->vtbl_vnimap[vni->vni >> VXLAN_VNI_BLOCK_BITS];
+	blk = *blkp;
+	if (!blk)
+		return;
+
+	rcu_assign_pointer(blk->vnb_node[vni->vni & (VXLAN_VNI_BLOCK_SIZE - 1)],
+			   NULL);
+	if (--blk->vnb_count == 0) {
+		rcu_assign_pointer(*blkp, NULL);
+		call_rcu(&blk->vnb_rcu, vxlan_vni_block_free);
+	}
+}
+
 /* Insert the specified vxlan node into the VNI table. */
 static int
 vxlan_vni_insert(struct vxlan_vninode *vni)
@@ -203,14 +297,26 @@ vxlan_vni_insert(struct vxlan_vninode *vni)
 	ret_node = cds_lfht_add_unique(vxlans->vtbl_vnihash, hash,
 				       vxlan_vni_match, &vni->vni,
 				       &vni->vni_node);
+	if (ret_node != &vni->vni_node)
+		return EEXIST;
 
-	return (ret_node != &vni->vni_node) ? EEXIST : 0;
+	if (vxlan_vni_map(vni) != 0) {
+		cds_lfht_del(vxlans->vtbl_vnihash, &vni->vni_node);
+		return ENOMEM;
+	}
+	return 0;
 }
 
 static void
 vxlan_vni_free(struct rcu_head *head)
 {
-	free(caa_container_of(head, struct vxlan_vninode, vni_rcu));
+	struct vxlan_vninode *vni =
+		caa_container_of(head, struct vxlan_vninode, vni_rcu);
+	unsigned int i;
+
+	for (i = 0; i < VXLAN_TMPL_SLOTS; i++)
+		free(vni->tmpl[i]);
+	free(vni);
 }
 
 /* Destroy a vxlan rtnode. */
@@ -613,6 +719,140 @@ int vxlan_select_src(struct vxlan_vninode *vnode,
 	return err;
 }
 
+static void
+vxlan_ipv4_tmpl_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct vxlan_ipv4_tmpl, vt_rcu));
+}
+
+/* Sum of the IP header words other than version/tos, length and checksum */
+static uint32_t vxlan_ipv4_fixed_sum(const struct iphdr *iph)
+{
+	const uint16_t *w = (const uint16_t *)iph;
+	uint32_t sum = 0;
+	unsigned int i;
+
+	for (i = 2; i < sizeof(*iph) / sizeof(*w); i++)
+		if (i != offsetof(struct iphdr, check) / sizeof(*w))
+			sum += w[i];
+	return sum;
+}
+
+static struct vxlan_ipv4_tmpl *
+vxlan_ipv4_tmpl_build(struct vxlan_vninode *vnode, struct ip_addr *dip,
+		      struct rte_mbuf *m, uint32_t gen)
+{
+	struct vxlan_ipv4_tmpl *tmpl;
+	struct ip_addr sip, nhip;
+	struct ifnet *dif;
+	struct iphdr *iph;
+
+	sip.type = nhip.type = AF_INET;
+	if (vxlan_select_ipv4_src(vnode, dip, m, &dif, &sip, &nhip) != 0)
+		return NULL;
+
+	tmpl = zmalloc_aligned(sizeof(*tmpl));
+	if (!tmpl)
+		return NULL;
+
+	tmpl->vt_dst = dip->address.ip_v4.s_addr;
+	tmpl->vt_nh = nhip.address.ip_v4.s_addr;
+	tmpl->vt_dif = dif;
+	tmpl->vt_gen = gen;
+
+	tmpl->vt_hdr.ether_header.ether_type = htons(ETHER_TYPE_IPv4);
+
+	iph = &tmpl->vt_hdr.ip_header;
+	iph->ihl = 5;
+	iph->version = 4;
+	iph->ttl = vnode->ttl ? vnode->ttl : IPDEFTTL;
+	iph->frag_off = htons(IP_DF);
+	iph->protocol = IPPROTO_UDP;
+	iph->saddr = sip.address.ip_v4.s_addr;
+	iph->daddr = dip->address.ip_v4.s_addr;
+	tmpl->vt_sum = vxlan_ipv4_fixed_sum(iph);
+
+	tmpl->vt_hdr.udp_header.dst_port = htons(VXLAN_PORT);
+	vxlan_vhdr_encap(vnode, &tmpl->vt_hdr.vxlan_header, VXLAN_L2,
+			 VGPE_NXT_NONE, false);
+	return tmpl;
+}
+
+/*
+ * Encapsulate an L2 frame for an IPv4 VTEP from the template for it,
+ * building the template first if needed. The route is still looked
+ * up per packet, and a template that no longer matches it is rebuilt.
+ */
+static int
+vxlan_ipv4_tmpl_encap(struct vxlan_vninode *vnode, struct ip_addr *dip,
+		      struct rte_mbuf *m, uint8_t tos, uint8_t *entropy,
+		      uint32_t entropy_len, struct ifnet **oifp,
+		      struct ip_addr *nhip)
+{
+	uint16_t orig_len = rte_pktmbuf_pkt_len(m);
+	in_addr_t dst = dip->address.ip_v4.s_addr;
+	struct vxlan_ipv4_tmpl *tmpl, *old;
+	struct vxlan_ipv4_encap *vhdr;
+	struct vxlan_ipv4_tmpl **slot;
+	const uint16_t *w;
+	struct next_hop *nxt;
+	struct ifnet *dif;
+	in_addr_t nh;
+	uint32_t gen, sum;
+
+	nxt = rt_lookup(dst, RT_TABLE_MAIN, m);
+	if (unlikely(nxt == NULL))
+		return -ENOENT;
+
+	dif = nh4_get_ifp(nxt);
+	if (unlikely(dif == NULL || !(dif->if_flags & IFF_UP)))
+		return -ENOENT;
+	nh = (nxt->flags & RTF_GATEWAY) ? nxt->gateway : dst;
+
+	gen = CMM_LOAD_SHARED(vxlan_tmpl_gen);
+	slot = &vnode->tmpl[hash32(dst, VXLAN_TMPL_BITS)];
+	tmpl = rcu_dereference(*slot);
+	if (unlikely(!tmpl || tmpl->vt_dst != dst || tmpl->vt_nh != nh ||
+		     tmpl->vt_dif != dif || tmpl->vt_gen != gen)) {
+		tmpl = vxlan_ipv4_tmpl_build(vnode, dip, m, gen);
+		if (!tmpl)
+			return -ENOENT;
+		old = rcu_xchg_pointer(slot, tmpl);
+		if (old)
+			call_rcu(&old->vt_rcu, vxlan_ipv4_tmpl_free);
+	}
+
+	vhdr = (struct vxlan_ipv4_encap *)
+		rte_pktmbuf_prepend(m, sizeof(*vhdr));
+	if (unlikely(vhdr == NULL))
+		return -ENOMEM;
+
+	/* Update L2 length in packet as vxlan_ipv4_encap includes ether_hdr */
+	pktmbuf_l2_len(m) = ETHER_HDR_LEN;
+	memcpy(vhdr, &tmpl->vt_hdr, sizeof(*vhdr));
+
+	vhdr->ip_header.tos = vnode->tos ? vnode->tos : tos;
+	vhdr->ip_header.tot_len = htons(sizeof(struct iphdr) +
+					sizeof(struct udp_hdr) +
+					sizeof(struct vxlan_hdr) + orig_len);
+	w = (const uint16_t *)&vhdr->ip_header;
+	sum = tmpl->vt_sum + w[0] + w[1];
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	vhdr->ip_header.check = ~sum;
+
+	vhdr->udp_header.src_port =
+		htons(vxlan_get_src_port(vnode, entropy, entropy_len, m));
+	vhdr->udp_header.dgram_len = htons(sizeof(struct udp_hdr) +
+					   sizeof(struct vxlan_hdr) +
+					   orig_len);
+
+	*oifp = tmpl->vt_dif;
+	nhip->type = AF_INET;
+	nhip->address.ip_v4.s_addr = tmpl->vt_nh;
+	return 0;
+}
+
 static
 void vxlan_query_payload_mpls(uint32_t *hdr, uint8_t *tc,
 			      uint8_t **entropy, uint32_t *entropy_len)
@@ -829,6 +1069,18 @@ vxlan_send_packet(struct ifnet *ifp, uint32_t vni, struct ip_addr *dip,
 	pktmbuf_set_vrf(m, vnode->t_vrfid);
 	pktmbuf_prepare_encap_out(m);
 
+	if (likely(dip->type == AF_INET && vxl_type == VXLAN_L2 && !oam)) {
+		err = vxlan_ipv4_tmpl_encap(vnode, dip, m, tos_tc, entropy,
+					    entropy_len, &dif, &nhip);
+		if (unlikely(err != 0)) {
+			VXLAN_STAT_INC(err == -ENOMEM ?
+				       VXLAN_STATS_OUTDISCARDS_ENCAP_FAILED :
+				       VXLAN_STATS_OUTDISCARDS_NO_VTEP_SRC);
+			goto drop;
+		}
+		return vxlan_resolve_send_pak(m, &nhip, dip, ifp, dif);
+	}
+
 	err = vxlan_select_src(vnode, dip, m, &dif, &sip, &nhip);
 	if (unlikely(err != 0)) {
 		VXLAN_STAT_INC(VXLAN_STATS_OUTDISCARDS_NO_VTEP_SRC);
@@ -951,6 +1203,79 @@ vxlan_snoop(enum vgpe_nxt_proto nxtproto, struct ifnet *ifp,
 	vxlan_rtupdate(ifp, &ipaddr, &eh->s_addr);
 }
 
+/*
+ * Forward an NSH packet on its service path.  Returns 0 once it is
+ * sent on, or 1 if the path ends here, with the NSH removed and the
+ * payload protocol in nxtproto.  The header is read and updated in
+ * network order, and the metadata is left alone.
+ */
+static int vxlan_nsh_sff(struct rte_mbuf *m, uint8_t *nxtproto, int *cntr)
+{
+	const struct nsh_sff_hop *hop;
+	struct ifnet *out_ifp;
+	struct ip_addr dip;
+	struct nsh *nsh;
+	unsigned int len;
+	uint32_t sph;
+
+	*cntr = VXLAN_STATS_INDISCARDS_SHORTPAYLOAD;
+	if (rte_pktmbuf_data_len(m) < sizeof(*nsh))
+		return -EINVAL;
+	nsh = rte_pktmbuf_mtod(m, struct nsh *);
+	len = nsh_hdr_len(nsh);
+	if (len < sizeof(*nsh) || rte_pktmbuf_data_len(m) < len)
+		return -EINVAL;
+
+	*cntr = VXLAN_STATS_INDISCARDS_NSH_NOPATH;
+	sph = nsh_sph(nsh);
+	hop = nsh_sff_lookup(NSH_SPH_SPI(sph), NSH_SPH_SI(sph));
+	if (!hop)
+		return -ENOENT;
+
+	if (hop->action == NSH_SFF_DECAP) {
+		*cntr = VXLAN_STATS_INDISCARDS_BADPAYLOAD;
+		*nxtproto = nsh_nxt_proto(nsh);
+		if (*nxtproto == NSH_NP_NONE || *nxtproto >= NSH_NP_MAX)
+			return -EINVAL;
+		rte_pktmbuf_adj(m, len);
+		return 1;
+	}
+
+	/* An index of 0 means the packet has gone round a loop */
+	if (NSH_SPH_SI(sph) == 0)
+		return -ELOOP;
+	out_ifp = vxlan_find_if(hop->vni);
+	if (!out_ifp)
+		return -ENOENT;
+
+	nsh_dec_si(nsh);
+	dip = hop->dst;
+	VXLAN_STAT_INC(VXLAN_STATS_NSH_FORWARDED);
+	vxlan_send_packet(out_ifp, hop->vni, &dip, m, VXLAN_GPE,
+			  VGPE_NXT_NSH, false, false);
+	return 0;
+}
+
+/*
+ * A frame the NIC matched to a VNI on our local address and stripped of
+ * its outer headers, so validated as vxlan_recv_encap would have.
+ */
+void vxlan_offload_input(struct ifnet *ifp, struct rte_mbuf *m)
+{
+	if (rte_pktmbuf_data_len(m) < sizeof(struct ether_hdr)) {
+		VXLAN_STAT_INC(VXLAN_STATS_INDISCARDS_SHORTPAYLOAD);
+		rte_pktmbuf_free(m);
+		return;
+	}
+
+	VXLAN_STAT_INC(VXLAN_STATS_INPKTS);
+	if_incr_in(ifp, m);
+
+	pktmbuf_prepare_decap_reswitch(m);
+	set_spath_rx_meta_data(m, ifp, ETHER_TYPE_TEB, TUN_META_FLAGS_DEFAULT);
+	ether_input(ifp, m);
+}
+
 static void
 vxlan_recv_encap(struct rte_mbuf *m, uint16_t ether_type,
 		 void *l3hdr, struct udphdr *udp)
@@ -1035,6 +1360,7 @@ vxlan_recv_encap(struct rte_mbuf *m, uint16_t ether_type,
 		ether_input(ifp, m);
 		return;
 	case VXLAN_GPE:
+gpe_payload:
 		switch (nxtproto) {
 		case VGPE_NXT_ETHER:
 			if (rte_pktmbuf_data_len(m) <
@@ -1083,6 +1409,14 @@ vxlan_recv_encap(struct rte_mbuf *m, uint16_t ether_type,
 			return;
 		}
 		case VGPE_NXT_NSH:
+			switch (vxlan_nsh_sff(m, &nxtproto, &cntr)) {
+			case 0:
+				return;
+			case 1:
+				goto gpe_payload;
+			default:
+				goto drop;
+			}
 		case VGPE_NXT_NONE:
 		default:
 			cntr = VXLAN_STATS_INDISCARDS_BADPAYLOAD;
@@ -1287,17 +1621,30 @@ vxlan_rtupdate(struct ifnet *ifp,
 			return;
 		}
 	} else if ((vxlrt->vxlrt_flags & IFBAF_TYPEMASK) == IFBAF_DYNAMIC) {
+		/*
+		 * Only write when the VTEP has moved, so that the entry's
+		 * cache line isn't bounced between cores for every frame.
+		 */
 		if (addr->type == AF_INET) {
-			vxlrt->vxlrt_dst = addr->address.ip_v4;
-			vxlrt->vxlrt_flags |= IFBAF_ADDR_V4;
+			if (!(vxlrt->vxlrt_flags & IFBAF_ADDR_V4) ||
+			    vxlrt->vxlrt_dst.s_addr !=
+			    addr->address.ip_v4.s_addr) {
+				vxlrt->vxlrt_dst = addr->address.ip_v4;
+				vxlrt->vxlrt_flags |= IFBAF_ADDR_V4;
+			}
 		} else {
-			vxlrt->vxlrt_dst_v6 = addr->address.ip_v6;
-			vxlrt->vxlrt_flags |= IFBAF_ADDR_V6;
+			if (!(vxlrt->vxlrt_flags & IFBAF_ADDR_V6) ||
+			    !IN6_ARE_ADDR_EQUAL(&vxlrt->vxlrt_dst_v6,
+						&addr->address.ip_v6)) {
+				vxlrt->vxlrt_dst_v6 = addr->address.ip_v6;
+				vxlrt->vxlrt_flags |= IFBAF_ADDR_V6;
+			}
 		}
 	}
 
 	/* Entry is marked used */
-	rte_atomic32_clear(&vxlrt->vxlrt_unused);
+	if (rte_atomic32_read(&vxlrt->vxlrt_unused))
+		rte_atomic32_clear(&vxlrt->vxlrt_unused);
 }
 
 static void
@@ -1473,6 +1820,10 @@ static void set_vxlan_params(struct ifnet *ifp,
 	else
 		vninode->g_addr = 0;
 	vninode->s_addr = 0;
+	if (vxlaninfo[IFLA_VXLAN_LOCAL])
+		vninode->l_addr = mnl_attr_get_u32(vxlaninfo[IFLA_VXLAN_LOCAL]);
+	else
+		vninode->l_addr = 0;
 
 	if (vxlaninfo[IFLA_VXLAN_LINK]) {
 		uint32_t pifi = mnl_attr_get_u32(vxlaninfo[IFLA_VXLAN_LINK]);
@@ -1518,6 +1869,11 @@ static void set_vxlan_params(struct ifnet *ifp,
 	/* TODO: dynamically allocate source port range */
 	vninode->port_low = VXLAN_PORT_LOW;
 	vninode->port_high = VXLAN_PORT_HIGH;
+
+	/* Header templates may have the old source, TTL or TOS */
+	CMM_STORE_SHARED(vxlan_tmpl_gen, vxlan_tmpl_gen + 1);
+
+	tun_offload_vxlan_update(vninode);
 }
 
 /* Handle RTM_NEWLINK netlink on existing vxlan interface */
@@ -1704,10 +2060,9 @@ static int vxlan_if_init(struct ifnet *ifp)
 	vxlan_rtable_init(sc);
 
 	rte_timer_init(&sc->scvx_timer);
-	rte_timer_reset(&sc->scvx_timer,
-			rte_get_timer_hz() * VXLAN_RTABLE_PRUNE_HZ,
-			PERIODICAL, rte_get_master_lcore(),
-			vxlan_timer, sc);
+	master_aging_timer_reset(&sc->scvx_timer,
+				 rte_get_timer_hz() * VXLAN_RTABLE_PRUNE_HZ,
+				 vxlan_timer, sc);
 
 	ifp->if_softc = sc;
 
@@ -1731,6 +2086,8 @@ static void vxlan_if_uninit(struct ifnet *ifp)
 	struct vxlan_vninode *vni = vxlan_vni_lookup(sc->scvx_vni);
 
 	if (vni) {
+		tun_offload_vxlan_del(vni);
+		vxlan_vni_unmap(vni);
 		cds_lfht_del(vxlans->vtbl_vnihash, &vni->vni_node);
 
 		vrf_delete(vni->t_vrfid);
@@ -2000,6 +2357,8 @@ void vxlan_set_t_vrfid(struct ifnet *ifp, vrfid_t t_vrfid)
 			ifp->if_name, ifp->if_index, t_vrfid);
 	} else
 		vnode->t_vrfid = t_vrfid;
+
+	tun_offload_vxlan_update(vnode);
 }
 
 /*
@@ -2209,6 +2568,8 @@ int cmd_vxlan(FILE *f, int argc, char **argv)
 		vxlan_stats_cmd(f, argc, argv);
 	else if (strcmp(argv[0], "macs") == 0)
 		vxlan_macs_cmd(f, argc, argv);
+	else if (strcmp(argv[0], "nsh-sff") == 0)
+		return cmd_nsh_sff(f, argc, argv);
 	else
 		fprintf(f, "Invalid command %s", argv[0]);
 	return 0;
@@ -2243,8 +2604,20 @@ static void vxlan_type_init(void)
 		rte_panic("Failed to register VXLAN type: %s", strerror(-ret));
 }
 
+/* Source address selection may change, so rebuild header templates */
+static void
+vxlan_if_addr_change(enum cont_src_en cont_src __unused,
+		     struct ifnet *ifp __unused, uint32_t ifindex __unused,
+		     int af, const void *addr __unused)
+{
+	if (af == AF_INET)
+		CMM_STORE_SHARED(vxlan_tmpl_gen, vxlan_tmpl_gen + 1);
+}
+
 static const struct dp_event_ops vxlan_events = {
 	.init = vxlan_type_init,
+	.if_addr_add = vxlan_if_addr_change,
+	.if_addr_delete = vxlan_if_addr_change,
 };
 
 DP_STARTUP_EVENT_REGISTER(vxlan_events);
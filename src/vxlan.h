@@ -87,6 +87,13 @@ struct vxlan_rtnode {
 
 /* VXLAN FLAGS */
 #define VXLAN_FLAG_GPE        0x00000001
+
+/* Outer header templates cached per VNI, indexed by remote VTEP */
+#define VXLAN_TMPL_BITS       4
+#define VXLAN_TMPL_SLOTS      (1 << VXLAN_TMPL_BITS)
+
+struct vxlan_ipv4_tmpl;
+
 /*
  * Store vni to ifp relationship
  */
@@ -97,6 +104,7 @@ struct vxlan_vninode {
 	uint32_t		vni;
 	in_addr_t		g_addr;
 	in_addr_t		s_addr;
+	in_addr_t		l_addr;		/* configured local, or 0 */
 	struct in6_addr         s_addr_v6;
 	uint16_t		port_low;
 	uint16_t		port_high;
@@ -105,11 +113,29 @@ struct vxlan_vninode {
 	uint8_t			ttl;
 	uint32_t                flags;
 	vrfid_t                 t_vrfid; /* Transport VRF ID */
+	struct vxlan_ipv4_tmpl  *tmpl[VXLAN_TMPL_SLOTS];
+};
+
+/*
+ * VNIs are 24 bits and sparse, so the per-packet map from VNI to node
+ * is a two level table: the top bits pick a block of node pointers,
+ * allocated when the first VNI in it is added.
+ */
+#define VXLAN_VNI_BITS		24
+#define VXLAN_VNI_BLOCK_BITS	12
+#define VXLAN_VNI_BLOCK_SIZE	(1 << VXLAN_VNI_BLOCK_BITS)
+#define VXLAN_VNI_BLOCKS	(1 << (VXLAN_VNI_BITS - VXLAN_VNI_BLOCK_BITS))
+
+struct vxlan_vni_block {
+	struct vxlan_vninode	*vnb_node[VXLAN_VNI_BLOCK_SIZE];
+	unsigned int		vnb_count;
+	struct rcu_head		vnb_rcu;
 };
 
 struct vxlan_vnitbl {
 	struct cds_lfht		*vtbl_vnihash;	/* vni hash table linkage */
 	unsigned long		vtbl_vniseed;
+	struct vxlan_vni_block	*vtbl_vnimap[VXLAN_VNI_BLOCKS];
 };
 
 struct vxlan_ipv4_encap {
@@ -163,6 +189,8 @@ void vxlan_set_device(struct ifnet *vxl_ifp, struct ifnet *ifp);
 void vxlan_set_t_vrfid(struct ifnet *ifp, vrfid_t t_vrfid);
 /* Send already l3 encapped packet for vxlan */
 void vxlan_send_encapped(struct rte_mbuf *m, struct ifnet *ifp, uint8_t af);
+/* Input a frame the NIC has already decapsulated, see tun_offload.h */
+void vxlan_offload_input(struct ifnet *ifp, struct rte_mbuf *m);
 
 uint32_t vxlan_get_vni(struct ifnet *ifp);
 
@@ -148,7 +148,9 @@ dp_test_usage(int status)
 
 	       " CK_RUN_SUITE          Run a single suite\n"
 	       " CK_RUN_CASE           Run a single test\n"
-	       "  eg CK_RUN_CASE=bridge_unicast dp_test\n",
+	       "  eg CK_RUN_CASE=bridge_unicast dp_test\n"
+	       " DP_TEST_CRYPTO_PERF   Run the ESP throughput test, timing\n"
+	       "                       the given number of bursts\n",
 	       dp_test_pname);
 
 	exit(status);
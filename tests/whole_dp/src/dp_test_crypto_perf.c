@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Throughput of the ESP encrypt and decrypt paths.
+ *
+ * Drives esp_output() and esp_input() directly with synthetic packets
+ * for each cipher suite and packet size, and reports packets per
+ * second and cycles per byte. As it takes a while, and the numbers
+ * are only of use on the target, it is only run when
+ * DP_TEST_CRYPTO_PERF is set to the number of bursts to time, eg
+ *
+ *   DP_TEST_CRYPTO_PERF=1000 CK_RUN_SUITE=dp_test_crypto_perf.c dp_test
+ */
+
+#include <rte_cycles.h>
+
+#include "dp_test.h"
+#include "dp_test_lib.h"
+#include "dp_test_crypto_utils.h"
+#include "dp_test_pktmbuf_lib.h"
+#include "crypto/crypto_internal.h"
+#include "crypto/crypto_sadb.h"
+#include "crypto/esp.h"
+
+#define PERF_BURST      32
+#define PERF_SPI_OUT    0xd43d87c7
+#define PERF_SPI_IN     0x10
+#define PERF_LOCAL      "10.10.2.2"
+#define PERF_PEER       "10.10.2.3"
+#define PERF_INNER_SRC  "10.10.1.1"
+#define PERF_INNER_DST  "10.10.3.4"
+
+struct perf_suite {
+	const char *name;
+	enum dp_test_crypo_cipher_algo cipher_algo;
+	enum dp_test_crypo_auth_algo auth_algo;
+};
+
+static const struct perf_suite perf_suites[] = {
+	{ "aes-cbc/sha1", CRYPTO_CIPHER_AES_CBC, CRYPTO_AUTH_HMAC_SHA1 },
+	{ "aes128gcm", CRYPTO_CIPHER_AES128GCM, CRYPTO_AUTH_HMAC_SHA1 },
+	{ "null/sha1", CRYPTO_CIPHER_NULL, CRYPTO_AUTH_HMAC_SHA1 },
+};
+
+/* UDP payload lengths, giving 64 to 1400 byte IP packets */
+static const int perf_sizes[] = { 36, 228, 484, 996, 1372 };
+
+struct perf_result {
+	uint64_t cycles;
+	uint64_t packets;
+	uint64_t bytes;
+};
+
+static void perf_report(const char *suite, const char *dir, int size,
+			const struct perf_result *r)
+{
+	double secs = (double)r->cycles / rte_get_tsc_hz();
+
+	printf("%-14s %-8s %5d %8.3f Mpps %8.2f cycles/byte\n",
+	       suite, dir, size,
+	       secs ? r->packets / secs / 1e6 : 0.0,
+	       r->bytes ? (double)r->cycles / r->bytes : 0.0);
+}
+
+static void perf_run_size(const char *suite, struct sadb_sa *out_sa,
+			  struct sadb_sa *in_sa, int len,
+			  unsigned int bursts)
+{
+	struct perf_result enc = { 0 }, dec = { 0 };
+	struct rte_mbuf *pkts[PERF_BURST];
+	unsigned int i, n;
+	uint8_t family;
+	uint32_t bytes;
+	uint64_t start;
+	int rc;
+
+	for (n = 0; n < bursts; n++) {
+		for (i = 0; i < PERF_BURST; i++) {
+			pkts[i] = dp_test_create_ipv4_pak(PERF_INNER_SRC,
+							  PERF_INNER_DST,
+							  1, &len);
+			dp_test_fail_unless(pkts[i], "failed to create packet");
+		}
+
+		start = rte_rdtsc();
+		for (i = 0; i < PERF_BURST; i++) {
+			rc = esp_output(pkts[i], AF_INET, iphdr(pkts[i]),
+					out_sa, NULL, &bytes);
+			dp_test_fail_unless(rc >= 0 && rc != ESP_PENDING,
+					    "esp_output failed %d", rc);
+			enc.bytes += bytes;
+		}
+		enc.cycles += rte_rdtsc() - start;
+		enc.packets += PERF_BURST;
+
+		start = rte_rdtsc();
+		for (i = 0; i < PERF_BURST; i++) {
+			family = AF_INET;
+			rc = esp_input(pkts[i], in_sa, &bytes, &family);
+			dp_test_fail_unless(rc >= 0 && rc != ESP_PENDING,
+					    "esp_input failed %d", rc);
+			dec.bytes += bytes;
+		}
+		dec.cycles += rte_rdtsc() - start;
+		dec.packets += PERF_BURST;
+
+		for (i = 0; i < PERF_BURST; i++)
+			rte_pktmbuf_free(pkts[i]);
+	}
+
+	perf_report(suite, "encrypt", len, &enc);
+	perf_report(suite, "decrypt", len, &dec);
+}
+
+static void perf_run_suite(const struct perf_suite *suite,
+			   unsigned int bursts)
+{
+	struct dp_test_crypto_sa out = {
+		.cipher_algo = suite->cipher_algo,
+		.auth_algo = suite->auth_algo,
+		.spi = PERF_SPI_OUT,
+		.d_addr = PERF_PEER,
+		.s_addr = PERF_LOCAL,
+		.family = AF_INET,
+		.mode = XFRM_MODE_TUNNEL,
+		.vrfid = VRF_DEFAULT_ID,
+	};
+	struct dp_test_crypto_sa in = out;
+	struct sadb_sa *out_sa, *in_sa;
+	xfrm_address_t dst = { 0 };
+	unsigned int i;
+
+	in.spi = PERF_SPI_IN;
+	in.d_addr = PERF_LOCAL;
+	in.s_addr = PERF_PEER;
+
+	dp_test_crypto_create_sa(&out);
+	dp_test_crypto_create_sa(&in);
+
+	inet_pton(AF_INET, PERF_PEER, &dst.a4);
+	out_sa = sadb_lookup_sa_outbound(VRF_DEFAULT_ID, &dst, AF_INET,
+					 PERF_SPI_OUT);
+	in_sa = sadb_lookup_inbound(PERF_SPI_IN);
+	dp_test_fail_unless(out_sa && in_sa, "%s: SA lookup failed",
+			    suite->name);
+
+	for (i = 0; i < ARRAY_SIZE(perf_sizes); i++)
+		perf_run_size(suite->name, out_sa, in_sa, perf_sizes[i],
+			      bursts);
+
+	dp_test_crypto_delete_sa(&in);
+	dp_test_crypto_delete_sa(&out);
+}
+
+DP_DECL_TEST_SUITE(crypto_perf_suite);
+
+DP_DECL_TEST_CASE(crypto_perf_suite, crypto_perf_esp, NULL, NULL);
+DP_START_TEST(crypto_perf_esp, ipv4_tunnel)
+{
+	const char *env = getenv("DP_TEST_CRYPTO_PERF");
+	unsigned long bursts;
+	unsigned int i;
+
+	if (!env)
+		return;
+
+	bursts = strtoul(env, NULL, 10);
+	if (!bursts)
+		bursts = 1000;
+
+	printf("%-14s %-8s %5s\n", "suite", "dir", "payload");
+	for (i = 0; i < ARRAY_SIZE(perf_suites); i++)
+		perf_run_suite(&perf_suites[i], bursts);
+
+	dp_test_crypto_check_sa_count(VRF_DEFAULT_ID, 0);
+} DP_END_TEST;
@@ -31,12 +31,11 @@ DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_check, NULL, NULL);
  */
 DP_START_TEST(sequence_number_check, sequence_number_check)
 {
-	struct sadb_sa sa;
+	struct sadb_sa sa = { 0 };
 	struct esp_header hdr;
 	unsigned int i;
 
-	sa.replay_window = 0;
-	sa.replay_bitmap = 0;
+	esp_replay_init(&sa, 0);
 	sa.seq = 0;
 	hdr.spi = 0;
 	hdr.seq = 1;
@@ -45,7 +44,8 @@ DP_START_TEST(sequence_number_check, sequence_number_check)
 			    "check defaults if no replay window is set");
 
 	hdr.seq = 0;
-	sa.replay_window = 32;
+	dp_test_fail_unless((esp_replay_init(&sa, 32) == 0),
+			    "failed to allocate replay window");
 
 	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -1),
 			    "check should fail if sequence number is zero");
@@ -70,7 +70,6 @@ DP_START_TEST(sequence_number_check, sequence_number_check)
 			    "check should fail if sequence number "
 			    "is to the left of the window");
 
-	sa.replay_bitmap = 0;
 	sa.seq = 128;
 	hdr.seq = htonl(sa.seq - 31);
 
@@ -81,26 +80,32 @@ DP_START_TEST(sequence_number_check, sequence_number_check)
 				    "is new and within window", ntohl(hdr.seq));
 		hdr.seq = htonl(ntohl(hdr.seq) + 1);
 	}
+	esp_replay_fini(&sa);
 
-	sa.replay_bitmap = 5;
+	esp_replay_init(&sa, 32);
+	sa.seq = 0;
 	hdr.seq = htonl(1);
-	sa.seq = 3;
+	esp_replay_advance((uint8_t *) &hdr, &sa);
+	hdr.seq = htonl(3);
+	esp_replay_advance((uint8_t *) &hdr, &sa);
 
+	hdr.seq = htonl(1);
 	dp_test_fail_unless(esp_replay_check((uint8_t *) &hdr, &sa) == -3,
 			    "check should fail if sequence number (%d) "
-			    "is _not_ new and within window", i);
+			    "is _not_ new and within window", 1);
 
 	hdr.seq = htonl(2);
 
 	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == 0),
 			    "check should pass if sequence number (%d) "
-			    "is new and within window", i);
+			    "is new and within window", 2);
 
 	hdr.seq = htonl(3);
 
 	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -3),
 			    "check should fail if sequence number (%d) "
-			    "Is _not_ new and within window", i);
+			    "Is _not_ new and within window", 3);
+	esp_replay_fini(&sa);
 } DP_END_TEST;
 
 DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_advance, NULL, NULL);
@@ -111,47 +116,107 @@ DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_advance, NULL, NULL);
  */
 DP_START_TEST(sequence_number_advance, sequence_number_advance)
 {
-	struct sadb_sa sa;
+	static const uint32_t seqs[] = { 1, 2, 4, 3, 5, 7 };
+	struct sadb_sa sa = { 0 };
 	struct esp_header hdr;
+	unsigned int i;
 
-	sa.replay_window = 3;
-	sa.replay_bitmap = 0;
+	esp_replay_init(&sa, 3);
 	sa.seq = 0;
 	hdr.spi = 0;
-	hdr.seq = htonl(1);
 
-	esp_replay_advance((uint8_t *) &hdr, &sa);
+	hdr.seq = htonl(1);
+	dp_test_fail_unless((esp_replay_advance((uint8_t *) &hdr, &sa) == 0),
+			    "advance should accept 1");
 	dp_test_fail_unless((sa.seq == 1),
 			    "sequence number failed to advance to 1");
-	dp_test_fail_unless((sa.replay_bitmap == 1), "bitmap should be 1");
+	dp_test_fail_unless((esp_replay_advance((uint8_t *) &hdr, &sa) == -3),
+			    "advance should reject 1 a second time");
 
 	hdr.seq = htonl(2);
 	esp_replay_advance((uint8_t *) &hdr, &sa);
 	dp_test_fail_unless((sa.seq == 2),
 			    "sequence number failed to advance to 2");
-	dp_test_fail_unless((sa.replay_bitmap == 3), "bitmap should be 3");
 
 	hdr.seq = htonl(4);
 	esp_replay_advance((uint8_t *) &hdr, &sa);
 	dp_test_fail_unless((sa.seq == 4),
 			    "sequence number failed to advance to 4");
-	dp_test_fail_unless((sa.replay_bitmap == 13), "bitmap should be 13");
 
 	hdr.seq = htonl(3);
-	esp_replay_advance((uint8_t *) &hdr, &sa);
+	dp_test_fail_unless((esp_replay_advance((uint8_t *) &hdr, &sa) == 0),
+			    "advance should accept 3");
 	dp_test_fail_unless((sa.seq == 4),
 			    "sequence number should still be 4");
-	dp_test_fail_unless((sa.replay_bitmap == 15), "bitmap should be 15");
 
 	hdr.seq = htonl(5);
 	esp_replay_advance((uint8_t *) &hdr, &sa);
 	dp_test_fail_unless((sa.seq == 5),
 			    "sequence number failed to advance to 5");
-	dp_test_fail_unless((sa.replay_bitmap == 31), "bitmap should be 31");
 
 	hdr.seq = htonl(7);
 	esp_replay_advance((uint8_t *) &hdr, &sa);
 	dp_test_fail_unless((sa.seq == 7),
 			    "sequence number failed to advance to 7");
-	dp_test_fail_unless((sa.replay_bitmap == 125), "bitmap should be 125");
+
+	for (i = 0; i < ARRAY_SIZE(seqs); i++) {
+		hdr.seq = htonl(seqs[i]);
+		dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr,
+						      &sa) < 0),
+				    "check should fail for %u", seqs[i]);
+	}
+
+	hdr.seq = htonl(6);
+	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == 0),
+			    "check should pass for 6");
+	esp_replay_fini(&sa);
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(esp_replay_suite, sequence_number_large_window, NULL, NULL);
+
+/*
+ * Does a window larger than the 32 sequence numbers held by one word
+ * of the bitmap remember each of them, and forget the oldest once the
+ * window moves past them?
+ */
+DP_START_TEST(sequence_number_large_window, sequence_number_large_window)
+{
+	const uint32_t window = ESP_REPLAY_WINDOW_MAX;
+	struct sadb_sa sa = { 0 };
+	struct esp_header hdr;
+	uint32_t seq;
+
+	dp_test_fail_unless((esp_replay_init(&sa, window) == 0),
+			    "failed to allocate replay window");
+	sa.seq = 0;
+	hdr.spi = 0;
+
+	for (seq = window; seq > 0; seq -= 2) {
+		hdr.seq = htonl(seq);
+		dp_test_fail_unless((esp_replay_advance((uint8_t *) &hdr,
+							&sa) == 0),
+				    "advance should accept %u", seq);
+	}
+
+	for (seq = 1; seq <= window; seq++) {
+		hdr.seq = htonl(seq);
+		dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr,
+						      &sa) ==
+				     (seq % 2 ? 0 : -3)),
+				    "check gave wrong result for %u", seq);
+	}
+
+	hdr.seq = htonl(window + 64);
+	esp_replay_advance((uint8_t *) &hdr, &sa);
+
+	hdr.seq = htonl(63);
+	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -2),
+			    "check should fail for 63 after window moved");
+	hdr.seq = htonl(65);
+	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == 0),
+			    "check should pass for 65 after window moved");
+	hdr.seq = htonl(66);
+	dp_test_fail_unless((esp_replay_check((uint8_t *) &hdr, &sa) == -3),
+			    "check should fail for 66 after window moved");
+	esp_replay_fini(&sa);
 } DP_END_TEST;
@@ -108,6 +108,18 @@ DP_START_TEST(ip_cfg, route_add_del_scale)
 		dp_test_wait_for_route_lookup(route_str, true);
 	}
 
+	/* Now verify that we did indeed grow the LPM */
+	expected_json = dp_test_json_create(
+		"{"
+		"    \"route_stats\": {"
+		"        \"free\": 254,"
+		"    }"
+		"}");
+	dp_test_check_json_state(summary_cmd, expected_json,
+				 DP_TEST_JSON_CHECK_SUBSET,
+				 false);
+	json_object_put(expected_json);
+
 	for (i = 0; i < 258; i++) {
 		/* loopback is special, so skip */
 		if (i == 127)
@@ -121,11 +133,11 @@ DP_START_TEST(ip_cfg, route_add_del_scale)
 
 	dp_test_nl_del_ip_addr_and_connected("dp1T0", "2.2.2.2/32");
 
-	/* Now verify that we did indeed grow the LPM */
+	/* And that it shrank back once the routes were gone */
 	expected_json = dp_test_json_create(
 		"{"
 		"    \"route_stats\": {"
-		"        \"free\": 511,"
+		"        \"free\": 255,"
 		"    }"
 		"}");
 	dp_test_check_json_state(summary_cmd, expected_json,
@@ -19,6 +19,7 @@
 #include <netinet/ip.h>
 #include <netinet/tcp.h>
 
+#include <rte_cycles.h>
 #include <rte_ip.h>
 #include <rte_mbuf.h>
 #include <rte_mempool.h>
@@ -1276,6 +1277,86 @@ void dp_test_intf_wait_until_processed(struct rte_ring *ring)
 	dp_test_fail("RX ring not emptied");
 }
 
+/* Free whatever has been transmitted, returning how many there were */
+static uint32_t dp_test_tx_discard(void)
+{
+	struct rte_mbuf *bufs[64];
+	struct rte_ring *ring;
+	struct ifnet *ifp;
+	uint32_t total = 0;
+	int i, j, count;
+
+	for (i = 0; i < dp_test_intf_count_local(); i++) {
+		ifp = ifnet_byport(i);
+		ring = dp_test_intf_name2tx_ring(ifp->if_name);
+		count = rte_ring_mc_dequeue_burst(ring, (void **)bufs, 64,
+						  NULL);
+		for (j = 0; j < count; j++)
+			rte_pktmbuf_free(bufs[j]);
+		total += count;
+	}
+	return total;
+}
+
+/*
+ * Stream packets in through an interface without checking what comes
+ * out, for timing the forwarding path. The rx ring is kept topped up
+ * and the tx rings drained as it goes, rather than waiting for each
+ * burst to complete. Packets that are not forwarded are only waited
+ * for until the rx ring has been empty for a millisecond.
+ *
+ * Returns the TSC cycles from the first enqueue to the last packet
+ * transmitted (or to the rx ring draining if none were), and sets
+ * num_tx to the number transmitted.
+ */
+uint64_t
+dp_test_pak_replay(struct rte_mbuf **paks, uint32_t num_paks,
+		   const char *iif_name, uint32_t *num_tx)
+{
+	uint64_t idle = rte_get_tsc_hz() / 1000;
+	uint64_t start, last, quiet, now;
+	struct rte_ring *ring;
+	uint32_t sent = 0, tx = 0, n;
+	uint8_t port;
+
+	ring = dp_test_intf_name2rx_ring(iif_name);
+	dp_test_assert_internal(ring);
+
+	port = dp_test_intf_name2port(iif_name);
+	for (n = 0; n < num_paks; n++)
+		paks[n]->port = port;
+
+	start = last = rte_rdtsc();
+	while (sent < num_paks) {
+		sent += rte_ring_mp_enqueue_burst(ring, (void **)&paks[sent],
+						  num_paks - sent, NULL);
+		n = dp_test_tx_discard();
+		if (n) {
+			tx += n;
+			last = rte_rdtsc();
+		}
+	}
+
+	quiet = rte_rdtsc();
+	while (tx < num_paks) {
+		n = dp_test_tx_discard();
+		now = rte_rdtsc();
+		if (n) {
+			tx += n;
+			last = quiet = now;
+		} else if (!rte_ring_empty(ring)) {
+			quiet = now;
+		} else if (now - quiet > idle) {
+			break;
+		}
+	}
+	if (!tx)
+		last = quiet;
+
+	*num_tx = tx;
+	return last - start;
+}
+
 static void
 dp_test_wait_until_local_processed(struct dp_test_expected *expected,
 		uint32_t num_paks, uint32_t local_paks)
@@ -305,6 +305,10 @@ dp_test_pak_inject(struct rte_mbuf **paks_to_send, uint32_t num_paks,
 		   struct dp_test_expected *expected, const char *test_type);
 void
 dp_test_intf_wait_until_processed(struct rte_ring *ring);
+
+uint64_t
+dp_test_pak_replay(struct rte_mbuf **paks, uint32_t num_paks,
+		   const char *iif_name, uint32_t *num_tx);
 /*
  * Simulate injection of packet into the dataplane from the kernel
  */
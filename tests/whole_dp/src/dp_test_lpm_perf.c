@@ -0,0 +1,432 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Insert, lookup and delete rates, and memory use, of the route
+ * tables (lpm and lpm6) and of the address group tables (npf_ptree),
+ * driven directly with a large set of prefixes.
+ *
+ * The prefixes are read from the file named by DP_TEST_LPM_PERF_RIB,
+ * or DP_TEST_LPM_PERF_RIB6 for IPv6. Each line contributes the first
+ * field that parses as a prefix, with fields split on white space and
+ * '|', so a plain list of prefixes or the output of "bgpdump -m" from
+ * an MRT RIB dump can be used as is. Without a file, prefixes are
+ * generated with roughly the length mix of a full table.
+ *
+ * As it takes a while, it is only run when DP_TEST_LPM_PERF is set to
+ * the number of prefixes to generate (or at most load), eg
+ *
+ *   DP_TEST_LPM_PERF=1000000 CK_RUN_SUITE=dp_test_lpm_perf.c dp_test
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/rtnetlink.h>
+#include <rte_cycles.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dp_test.h"
+#include "lpm/lpm.h"
+#include "lpm/lpm6.h"
+#include "npf/npf_ptree.h"
+
+#define PERF_LOOKUPS	(1 << 20)
+#define PERF_SEED	0x5eed
+
+typedef uint8_t perf_addr_t[16];
+
+struct perf_prefix {
+	uint8_t addr[16];	/* network byte order */
+	uint8_t len;
+};
+
+struct perf_set {
+	struct perf_prefix *pfx;
+	unsigned int count;
+	int family;
+	const char *source;
+};
+
+/* Length mix of a full table, as cumulative parts per thousand */
+struct perf_len_mix {
+	uint8_t len;
+	unsigned int cum;
+};
+
+static const struct perf_len_mix perf_mix4[] = {
+	{ 16, 15 }, { 19, 60 }, { 20, 110 }, { 21, 160 }, { 22, 280 },
+	{ 23, 400 }, { 24, 1000 },
+};
+
+static const struct perf_len_mix perf_mix6[] = {
+	{ 29, 30 }, { 32, 250 }, { 36, 300 }, { 40, 400 }, { 44, 500 },
+	{ 48, 1000 },
+};
+
+static uint64_t perf_rand(void)
+{
+	return ((uint64_t)random() << 31) ^ random();
+}
+
+static void perf_prefix_mask(struct perf_prefix *p, unsigned int bytes)
+{
+	unsigned int i;
+
+	for (i = 0; i < bytes; i++) {
+		int bits = (int)p->len - (int)i * 8;
+
+		if (bits >= 8)
+			continue;
+		p->addr[i] &= bits <= 0 ? 0 : (uint8_t)(0xff << (8 - bits));
+	}
+}
+
+static void perf_generate(struct perf_set *set, unsigned int count)
+{
+	const struct perf_len_mix *mix;
+	unsigned int i, j, nmix, bytes, r;
+
+	if (set->family == AF_INET) {
+		mix = perf_mix4;
+		nmix = ARRAY_SIZE(perf_mix4);
+		bytes = 4;
+	} else {
+		mix = perf_mix6;
+		nmix = ARRAY_SIZE(perf_mix6);
+		bytes = 16;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct perf_prefix *p = &set->pfx[i];
+		uint64_t v;
+
+		r = random() % 1000;
+		for (j = 0; j < nmix - 1 && r >= mix[j].cum; j++)
+			;
+		p->len = mix[j].len;
+
+		v = perf_rand();
+		memcpy(p->addr, &v, sizeof(v));
+		v = perf_rand();
+		memcpy(p->addr + 8, &v, sizeof(v));
+
+		/* keep to unicast space */
+		if (set->family == AF_INET)
+			p->addr[0] = 1 + p->addr[0] % 223;
+		else
+			p->addr[0] = 0x20 | (p->addr[0] & 0x0f);
+
+		perf_prefix_mask(p, bytes);
+	}
+	set->count = count;
+	set->source = "generated";
+}
+
+static bool perf_parse_prefix(char *tok, int family, struct perf_prefix *p)
+{
+	unsigned int maxlen = family == AF_INET ? 32 : 128;
+	char *slash, *end;
+	unsigned long len;
+
+	slash = strchr(tok, '/');
+	if (!slash)
+		return false;
+	*slash = '\0';
+
+	len = strtoul(slash + 1, &end, 10);
+	if (end == slash + 1 || *end || len > maxlen)
+		return false;
+
+	memset(p->addr, 0, sizeof(p->addr));
+	if (inet_pton(family, tok, p->addr) != 1)
+		return false;
+
+	p->len = len;
+	perf_prefix_mask(p, maxlen / 8);
+	return true;
+}
+
+static bool perf_load(struct perf_set *set, const char *path,
+		      unsigned int max)
+{
+	char line[1024], *tok, *save;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		printf("cannot open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	set->count = 0;
+	while (set->count < max && fgets(line, sizeof(line), f)) {
+		for (tok = strtok_r(line, " \t|\n", &save); tok;
+		     tok = strtok_r(NULL, " \t|\n", &save)) {
+			if (perf_parse_prefix(tok, set->family,
+					      &set->pfx[set->count])) {
+				set->count++;
+				break;
+			}
+		}
+	}
+	fclose(f);
+
+	set->source = path;
+	return set->count != 0;
+}
+
+static void perf_set_init(struct perf_set *set, int family,
+			  unsigned int count)
+{
+	const char *path = getenv(family == AF_INET ? "DP_TEST_LPM_PERF_RIB" :
+				  "DP_TEST_LPM_PERF_RIB6");
+
+	set->family = family;
+	set->pfx = calloc(count, sizeof(*set->pfx));
+	dp_test_fail_unless(set->pfx, "no memory for %u prefixes", count);
+
+	srandom(PERF_SEED);
+	if (!path || !perf_load(set, path, count))
+		perf_generate(set, count);
+}
+
+/*
+ * Addresses to look up, each in a random one of the prefixes with
+ * random host bits, so that most lookups hit the table and go as
+ * deep as the prefix does.
+ */
+static perf_addr_t *perf_lookup_addrs(const struct perf_set *set)
+{
+	perf_addr_t *addrs;
+	unsigned int i, b, bytes = set->family == AF_INET ? 4 : 16;
+
+	addrs = malloc(PERF_LOOKUPS * sizeof(*addrs));
+	dp_test_fail_unless(addrs, "no memory for lookups");
+
+	for (i = 0; i < PERF_LOOKUPS; i++) {
+		const struct perf_prefix *p =
+			&set->pfx[perf_rand() % set->count];
+		uint64_t host = perf_rand();
+
+		for (b = 0; b < bytes; b++) {
+			int bits = (int)p->len - (int)b * 8;
+			uint8_t keep = bits >= 8 ? 0xff :
+				bits <= 0 ? 0 : (uint8_t)(0xff << (8 - bits));
+
+			addrs[i][b] = (p->addr[b] & keep) |
+				((host >> (b % 8) * 8) & ~keep);
+		}
+	}
+	return addrs;
+}
+
+static void perf_report(const char *what, const char *op, uint64_t n,
+			uint64_t cycles)
+{
+	double secs = (double)cycles / rte_get_tsc_hz();
+
+	printf("%-8s %-14s %10"PRIu64" %10.3f M/s %8.1f cycles\n",
+	       what, op, n, secs ? n / secs / 1e6 : 0.0,
+	       n ? (double)cycles / n : 0.0);
+}
+
+static void perf_lpm(const struct perf_set *set)
+{
+	struct pd_obj_state_and_flags *pd_state, *old_pd_state;
+	struct pd_obj_state_and_flags del_state;
+	uint32_t ips[LPM_LOOKUP_BULK_MAX], nhs[LPM_LOOKUP_BULK_MAX];
+	uint32_t ip, nh, old_nh, added = 0;
+	perf_addr_t *addrs;
+	size_t tables, rules;
+	uint64_t start, hits = 0;
+	struct lpm *lpm;
+	unsigned int i, j;
+
+	lpm = lpm_create(0);
+	dp_test_fail_unless(lpm, "lpm create failed");
+
+	start = rte_rdtsc();
+	for (i = 0; i < set->count; i++) {
+		memcpy(&ip, set->pfx[i].addr, sizeof(ip));
+		if (lpm_add(lpm, ntohl(ip), set->pfx[i].len, i + 1,
+			    RT_SCOPE_UNIVERSE, &pd_state, &old_nh,
+			    &old_pd_state) == LPM_SUCCESS)
+			added++;
+	}
+	perf_report("lpm", "insert", set->count, rte_rdtsc() - start);
+
+	lpm_memory(lpm, &tables, &rules);
+	printf("lpm      %u rules, %u tbl8 groups, tables %zuM rules %zuM\n",
+	       lpm_rule_count(lpm), lpm_tbl8_count(lpm),
+	       tables >> 20, rules >> 20);
+
+	addrs = perf_lookup_addrs(set);
+
+	start = rte_rdtsc();
+	for (i = 0; i < PERF_LOOKUPS; i++) {
+		memcpy(&ip, addrs[i], sizeof(ip));
+		hits += lpm_lookup(lpm, ntohl(ip), &nh) == 0;
+	}
+	perf_report("lpm", "lookup", PERF_LOOKUPS, rte_rdtsc() - start);
+
+	start = rte_rdtsc();
+	for (i = 0; i < PERF_LOOKUPS; i += LPM_LOOKUP_BULK_MAX) {
+		for (j = 0; j < LPM_LOOKUP_BULK_MAX; j++) {
+			memcpy(&ip, addrs[i + j], sizeof(ip));
+			ips[j] = ntohl(ip);
+		}
+		lpm_lookup_bulk(lpm, ips, nhs, LPM_LOOKUP_BULK_MAX);
+	}
+	perf_report("lpm", "lookup bulk", PERF_LOOKUPS, rte_rdtsc() - start);
+
+	start = rte_rdtsc();
+	for (i = 0; i < set->count; i++) {
+		memcpy(&ip, set->pfx[i].addr, sizeof(ip));
+		lpm_delete(lpm, ntohl(ip), set->pfx[i].len, &nh,
+			   RT_SCOPE_UNIVERSE, &del_state, &old_nh,
+			   &old_pd_state);
+	}
+	perf_report("lpm", "delete", set->count, rte_rdtsc() - start);
+
+	printf("lpm      %u of %u unique, %"PRIu64" of %u lookups hit\n",
+	       added, set->count, hits, PERF_LOOKUPS);
+
+	free(addrs);
+	lpm_free(lpm);
+}
+
+static void perf_lpm6(const struct perf_set *set)
+{
+	struct pd_obj_state_and_flags *pd_state, *old_pd_state;
+	struct pd_obj_state_and_flags del_state;
+	const uint8_t *ips[LPM6_LOOKUP_BULK_MAX];
+	uint32_t nhs[LPM6_LOOKUP_BULK_MAX];
+	uint32_t nh, old_nh, added = 0;
+	perf_addr_t *addrs;
+	uint64_t start, hits = 0;
+	struct lpm6 *lpm;
+	unsigned int i, j;
+
+	lpm = lpm6_create(0);
+	dp_test_fail_unless(lpm, "lpm6 create failed");
+
+	start = rte_rdtsc();
+	for (i = 0; i < set->count; i++)
+		if (lpm6_add(lpm, set->pfx[i].addr, set->pfx[i].len, i + 1,
+			     RT_SCOPE_UNIVERSE, &pd_state, &old_nh,
+			     &old_pd_state) == LPM_SUCCESS)
+			added++;
+	perf_report("lpm6", "insert", set->count, rte_rdtsc() - start);
+
+	printf("lpm6     %u rules, %u tbl8 groups used\n",
+	       lpm6_rule_count(lpm), lpm6_tbl8_used_count(lpm));
+
+	addrs = perf_lookup_addrs(set);
+
+	start = rte_rdtsc();
+	for (i = 0; i < PERF_LOOKUPS; i++)
+		hits += lpm6_lookup(lpm, addrs[i], &nh) == 0;
+	perf_report("lpm6", "lookup", PERF_LOOKUPS, rte_rdtsc() - start);
+
+	start = rte_rdtsc();
+	for (i = 0; i < PERF_LOOKUPS; i += LPM6_LOOKUP_BULK_MAX) {
+		for (j = 0; j < LPM6_LOOKUP_BULK_MAX; j++)
+			ips[j] = addrs[i + j];
+		lpm6_lookup_bulk(lpm, ips, nhs, LPM6_LOOKUP_BULK_MAX);
+	}
+	perf_report("lpm6", "lookup bulk", PERF_LOOKUPS, rte_rdtsc() - start);
+
+	start = rte_rdtsc();
+	for (i = 0; i < set->count; i++)
+		lpm6_delete(lpm, set->pfx[i].addr, set->pfx[i].len, &nh,
+			    RT_SCOPE_UNIVERSE, &del_state, &old_nh,
+			    &old_pd_state);
+	perf_report("lpm6", "delete", set->count, rte_rdtsc() - start);
+
+	printf("lpm6     %u of %u unique, %"PRIu64" of %u lookups hit\n",
+	       added, set->count, hits, PERF_LOOKUPS);
+
+	free(addrs);
+	lpm6_free(lpm);
+}
+
+/* An address group holding the same prefixes */
+static void perf_ptree(const struct perf_set *set)
+{
+	unsigned int keylen = set->family == AF_INET ? 4 : 16;
+	const char *what = set->family == AF_INET ? "ptree" : "ptree6";
+	struct ptree_table *pt;
+	perf_addr_t *addrs;
+	uint64_t start, hits = 0;
+	unsigned int i;
+
+	pt = ptree_table_create(keylen);
+	dp_test_fail_unless(pt, "ptree create failed");
+
+	start = rte_rdtsc();
+	for (i = 0; i < set->count; i++)
+		ptree_insert(pt, set->pfx[i].addr, set->pfx[i].len);
+	perf_report(what, "insert", set->count, rte_rdtsc() - start);
+
+	printf("%-8s %u leaves, %u branches\n", what,
+	       ptree_get_table_leaf_count(pt),
+	       ptree_get_table_branch_count(pt));
+
+	addrs = perf_lookup_addrs(set);
+
+	start = rte_rdtsc();
+	for (i = 0; i < PERF_LOOKUPS; i++)
+		hits += ptree_longest_match(pt, addrs[i]) != NULL;
+	perf_report(what, "longest match", PERF_LOOKUPS,
+		    rte_rdtsc() - start);
+
+	start = rte_rdtsc();
+	for (i = 0; i < set->count; i++)
+		ptree_remove(pt, set->pfx[i].addr, set->pfx[i].len);
+	perf_report(what, "remove", set->count, rte_rdtsc() - start);
+
+	printf("%-8s %"PRIu64" of %u lookups hit\n", what, hits,
+	       PERF_LOOKUPS);
+
+	free(addrs);
+	ptree_table_destroy(pt);
+}
+
+static void perf_run_family(int family, unsigned int count)
+{
+	struct perf_set set;
+
+	perf_set_init(&set, family, count);
+	printf("%s: %u prefixes from %s\n",
+	       family == AF_INET ? "IPv4" : "IPv6", set.count, set.source);
+
+	if (family == AF_INET)
+		perf_lpm(&set);
+	else
+		perf_lpm6(&set);
+	perf_ptree(&set);
+
+	free(set.pfx);
+}
+
+DP_DECL_TEST_SUITE(lpm_perf_suite);
+
+DP_DECL_TEST_CASE(lpm_perf_suite, lpm_perf, NULL, NULL);
+DP_START_TEST(lpm_perf, tables)
+{
+	const char *env = getenv("DP_TEST_LPM_PERF");
+	unsigned long count;
+
+	if (!env)
+		return;
+
+	count = strtoul(env, NULL, 10);
+	if (!count)
+		count = 1000000;
+
+	perf_run_family(AF_INET, count);
+	perf_run_family(AF_INET6, count);
+} DP_END_TEST;
@@ -3288,7 +3288,7 @@ label_swap_monitor(const struct rte_mbuf *mpls_pak,
 	 * hash the packet
 	 */
 	hash_val = mpls_ecmp_hash(mpls_pak);
-	nh_idx = ecmp_lookup(lswap->nh_cnt, hash_val);
+	nh_idx = ecmp_lookup(lswap->nh_cnt, hash_val, NULL);
 	expected_oif = lswap->nh[nh_idx].nh_int;
 
 	/*
@@ -3438,7 +3438,7 @@ label_imp_monitor(const struct rte_mbuf *ip_pak,
 	 * hash the mpls packet
 	 */
 	hash_val = ecmp_mbuf_hash(payload_pak, ETHER_TYPE_IPv4);
-	nh_idx = ecmp_lookup(lswap->nh_cnt, hash_val);
+	nh_idx = ecmp_lookup(lswap->nh_cnt, hash_val, NULL);
 	expected_oif = lswap->nh[nh_idx].nh_int;
 
 	/*
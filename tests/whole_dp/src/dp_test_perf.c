@@ -0,0 +1,715 @@
+/*
+ * Copyright (c) 2019, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Forwarding throughput for a set of canned traffic profiles.
+ *
+ * Each profile sets up its state, then streams rounds of packets in
+ * through the fake interfaces with dp_test_pak_replay() and reports
+ * packets per second and cycles per packet through the forwarding
+ * thread. DP_TEST_PERF_CLASSBENCH names a ClassBench filter set to
+ * add as a firewall profile, for the grouper's evaluation rate with a
+ * realistic ruleset. With DP_TEST_PERF_NODES set, the pipeline node
+ * counts (and cycles, if built with --enable-pl_cycles) are also
+ * reported per profile, though sampling them slows the forwarding
+ * path down.
+ *
+ * With DP_TEST_PERF_HWC set, the forwarding threads' hardware counters
+ * (instructions, cycles, L1 data and last level cache misses) are
+ * also read around each round and reported per packet. This needs
+ * perf_event_open() on the test's own threads, so perf_event_paranoid
+ * of 2 or less. DP_TEST_PERF_BUDGET names a file of per packet
+ * ceilings, one per line as
+ *
+ *   <counter> <max> <profile>
+ *
+ * eg "instructions 1200 ipv4 route", and the test fails if any is
+ * exceeded, or if a counter with a budget could not be read. Lines
+ * in that format are printed for each profile that is counted, for
+ * starting a budget file from a known good build. The numbers include
+ * the forwarding loop's polling while a round is in flight, so are
+ * only comparable for the same round size and machine.
+ *
+ * As with the crypto perf suite, it is only run when DP_TEST_PERF is
+ * set to the number of rounds to time, or DP_TEST_PERF_BUDGET is set,
+ * eg
+ *
+ *   DP_TEST_PERF=100 CK_RUN_SUITE=dp_test_perf.c dataplane_test
+ *
+ * or "make bench", which runs it and the crypto perf suite from an
+ * optimised build.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <netinet/udp.h>
+#include <rte_cycles.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "dp_test.h"
+#include "dp_test_cmd_check.h"
+#include "dp_test_lib.h"
+#include "dp_test_lib_intf.h"
+#include "dp_test_json_utils.h"
+#include "dp_test_netlink_state.h"
+#include "dp_test_npf_lib.h"
+#include "dp_test_pktmbuf_lib.h"
+#include "npf/cgnat/cgn_session.h"
+#include "pipeline/pl_internal.h"
+
+#define PERF_ROUND	1024	/* packets per round */
+#define PERF_NH_MAC	"aa:bb:cc:dd:ee:ff"
+
+/* Firewall ruleset sizes, each ending in the rule that accepts */
+static const unsigned int perf_fw_rules[] = { 1, 10, 100, 1000 };
+
+/* Most forwarding threads counted, and budget lines read */
+#define PERF_HWC_THREADS	16
+#define PERF_BUDGETS		64
+
+enum perf_hwc_event {
+	PERF_HWC_INSNS,
+	PERF_HWC_CYCLES,
+	PERF_HWC_L1D_MISSES,
+	PERF_HWC_LLC_MISSES,
+	PERF_HWC_MAX
+};
+
+static const struct perf_hwc_def {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+} perf_hwc_defs[PERF_HWC_MAX] = {
+	[PERF_HWC_INSNS] = { "instructions", PERF_TYPE_HARDWARE,
+			     PERF_COUNT_HW_INSTRUCTIONS },
+	[PERF_HWC_CYCLES] = { "cycles", PERF_TYPE_HARDWARE,
+			      PERF_COUNT_HW_CPU_CYCLES },
+	[PERF_HWC_L1D_MISSES] = { "l1d-misses", PERF_TYPE_HW_CACHE,
+				  PERF_COUNT_HW_CACHE_L1D |
+				  PERF_COUNT_HW_CACHE_OP_READ << 8 |
+				  PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+	[PERF_HWC_LLC_MISSES] = { "llc-misses", PERF_TYPE_HARDWARE,
+				  PERF_COUNT_HW_CACHE_MISSES },
+};
+
+/* Counters on each forwarding thread, -1 for any that did not open */
+struct perf_hwc {
+	int fd[PERF_HWC_THREADS][PERF_HWC_MAX];
+	unsigned int nthreads;
+};
+
+struct perf_budget {
+	char profile[32];
+	enum perf_hwc_event event;
+	double max;
+};
+
+static struct perf_budget perf_budgets[PERF_BUDGETS];
+static unsigned int perf_nbudgets;
+static unsigned int perf_over;
+
+struct perf_result {
+	uint64_t cycles;
+	uint64_t packets;
+	uint64_t forwarded;
+	uint64_t hwc[PERF_HWC_MAX];
+	bool hwc_valid[PERF_HWC_MAX];
+};
+
+/* Packets made from the template may be altered, eg to be new flows */
+typedef void (*perf_vary_fn)(struct rte_mbuf *m, uint32_t seq);
+
+static void perf_report(const char *profile, const struct perf_result *r)
+{
+	double secs = (double)r->cycles / rte_get_tsc_hz();
+
+	printf("%-22s %8.3f Mpps %8.1f cycles/pkt %10"PRIu64" of %"PRIu64
+	       " forwarded\n", profile,
+	       secs ? r->forwarded / secs / 1e6 : 0.0,
+	       r->packets ? (double)r->cycles / r->packets : 0.0,
+	       r->forwarded, r->packets);
+}
+
+/* The forwarding threads, named dataplane/<lcore> */
+static unsigned int perf_hwc_threads(pid_t *tids, unsigned int max)
+{
+	char path[64], comm[32];
+	unsigned int n = 0;
+	struct dirent *de;
+	FILE *f;
+	DIR *d;
+
+	d = opendir("/proc/self/task");
+	if (!d)
+		return 0;
+
+	while (n < max && (de = readdir(d)) != NULL) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "/proc/self/task/%s/comm",
+			 de->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (fgets(comm, sizeof(comm), f) &&
+		    !strncmp(comm, "dataplane/", 10) &&
+		    isdigit((unsigned char)comm[10]))
+			tids[n++] = atoi(de->d_name);
+		fclose(f);
+	}
+	closedir(d);
+	return n;
+}
+
+static bool perf_hwc_open(struct perf_hwc *hwc)
+{
+	pid_t tids[PERF_HWC_THREADS];
+	struct perf_event_attr attr;
+	bool any = false;
+	unsigned int t, e;
+
+	hwc->nthreads = perf_hwc_threads(tids, PERF_HWC_THREADS);
+	for (t = 0; t < hwc->nthreads; t++) {
+		for (e = 0; e < PERF_HWC_MAX; e++) {
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = perf_hwc_defs[e].type;
+			attr.config = perf_hwc_defs[e].config;
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+				PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+			hwc->fd[t][e] = syscall(__NR_perf_event_open, &attr,
+						tids[t], -1, -1, 0);
+			any |= hwc->fd[t][e] >= 0;
+		}
+	}
+	return any;
+}
+
+static void perf_hwc_close(struct perf_hwc *hwc)
+{
+	unsigned int t, e;
+
+	for (t = 0; t < hwc->nthreads; t++)
+		for (e = 0; e < PERF_HWC_MAX; e++)
+			if (hwc->fd[t][e] >= 0)
+				close(hwc->fd[t][e]);
+}
+
+static void perf_hwc_ioctl(const struct perf_hwc *hwc, unsigned long req)
+{
+	unsigned int t, e;
+
+	for (t = 0; t < hwc->nthreads; t++)
+		for (e = 0; e < PERF_HWC_MAX; e++)
+			if (hwc->fd[t][e] >= 0)
+				ioctl(hwc->fd[t][e], req, 0);
+}
+
+/*
+ * Add the counts since the last reset to the result, scaled up for
+ * any time the counter was multiplexed out.
+ */
+static void perf_hwc_add(const struct perf_hwc *hwc, struct perf_result *r)
+{
+	uint64_t val[3];	/* value, time enabled, time running */
+	unsigned int t, e;
+
+	for (t = 0; t < hwc->nthreads; t++) {
+		for (e = 0; e < PERF_HWC_MAX; e++) {
+			if (hwc->fd[t][e] < 0 ||
+			    read(hwc->fd[t][e], val, sizeof(val)) !=
+			    sizeof(val))
+				continue;
+			if (val[2])
+				r->hwc[e] += (double)val[0] * val[1] / val[2];
+			r->hwc_valid[e] = true;
+		}
+	}
+}
+
+static bool perf_budget_load(const char *path)
+{
+	char line[128], counter[32], profile[32];
+	struct perf_budget *b;
+	unsigned int e;
+	double max;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return false;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' ||
+		    sscanf(line, "%31s %lf %31[^\n]", counter, &max,
+			   profile) != 3)
+			continue;
+
+		for (e = 0; e < PERF_HWC_MAX; e++)
+			if (!strcmp(counter, perf_hwc_defs[e].name))
+				break;
+		dp_test_fail_unless(e < PERF_HWC_MAX,
+				    "unknown counter %s in %s", counter, path);
+		dp_test_fail_unless(perf_nbudgets < PERF_BUDGETS,
+				    "more than %u budgets in %s",
+				    PERF_BUDGETS, path);
+
+		b = &perf_budgets[perf_nbudgets++];
+		snprintf(b->profile, sizeof(b->profile), "%s", profile);
+		b->event = e;
+		b->max = max;
+	}
+	fclose(f);
+	return true;
+}
+
+/*
+ * Print the per packet counts in the budget file format, and check
+ * them against any budgets for the profile.
+ */
+static void perf_hwc_report(const char *profile, const struct perf_result *r)
+{
+	const struct perf_budget *b;
+	unsigned int e, i;
+	double val;
+
+	for (e = 0; e < PERF_HWC_MAX; e++) {
+		if (!r->hwc_valid[e] || !r->packets)
+			continue;
+		printf("    %s %.1f %s\n", perf_hwc_defs[e].name,
+		       (double)r->hwc[e] / r->packets, profile);
+	}
+
+	for (i = 0; i < perf_nbudgets; i++) {
+		b = &perf_budgets[i];
+		if (strcmp(b->profile, profile) != 0)
+			continue;
+
+		if (!r->hwc_valid[b->event] || !r->packets) {
+			printf("    OVER BUDGET %s not counted\n",
+			       perf_hwc_defs[b->event].name);
+			perf_over++;
+			continue;
+		}
+		val = (double)r->hwc[b->event] / r->packets;
+		if (val > b->max) {
+			printf("    OVER BUDGET %s %.1f > %.1f\n",
+			       perf_hwc_defs[b->event].name, val, b->max);
+			perf_over++;
+		}
+	}
+}
+
+static json_object *perf_nodes_snapshot(void)
+{
+	struct dp_test_json_mismatches *mismatches = NULL;
+	json_object *jresp, *jfw, *jnodes;
+
+	jresp = dp_test_json_do_show_cmd("pipeline framework dump nodes",
+					 &mismatches, false);
+	dp_test_json_mismatch_free(mismatches);
+	if (!jresp)
+		return NULL;
+
+	if (!json_object_object_get_ex(jresp, "pl-framework", &jfw) ||
+	    !json_object_object_get_ex(jfw, "node", &jnodes)) {
+		json_object_put(jresp);
+		return NULL;
+	}
+	json_object_get(jnodes);
+	json_object_put(jresp);
+	return jnodes;
+}
+
+static int64_t perf_node_value(json_object *jnode, const char *name)
+{
+	json_object *jcycles, *jval;
+
+	if (!strcmp(name, "pkt-count")) {
+		if (!json_object_object_get_ex(jnode, name, &jval))
+			return 0;
+		return json_object_get_int64(jval);
+	}
+	if (!json_object_object_get_ex(jnode, "cycles", &jcycles) ||
+	    !json_object_object_get_ex(jcycles, name, &jval))
+		return 0;
+	return json_object_get_int64(jval);
+}
+
+/* Report what each node did between the two snapshots */
+static void perf_nodes_report(json_object *before, json_object *after)
+{
+	json_object *jprev;
+	int64_t pkts, cycles, sampled;
+
+	json_object_object_foreach(after, name, jnode) {
+		if (!json_object_object_get_ex(before, name, &jprev))
+			continue;
+
+		pkts = perf_node_value(jnode, "pkt-count") -
+			perf_node_value(jprev, "pkt-count");
+		if (pkts <= 0)
+			continue;
+
+		cycles = perf_node_value(jnode, "cycles") -
+			perf_node_value(jprev, "cycles");
+		sampled = perf_node_value(jnode, "packets") -
+			perf_node_value(jprev, "packets");
+
+		if (sampled > 0)
+			printf("    %-36s %10"PRId64" pkts %8.1f cycles/pkt\n",
+			       name, pkts, (double)cycles / sampled);
+		else
+			printf("    %-36s %10"PRId64" pkts\n", name, pkts);
+	}
+}
+
+/*
+ * Time rounds of copies of a packet in through an interface, freeing
+ * the template once done. If given, vary is called on each copy with
+ * its number in the run.
+ */
+static void perf_run(const char *profile, struct rte_mbuf *pak,
+		     const char *iif, unsigned int rounds, perf_vary_fn vary)
+{
+	struct rte_mbuf *paks[PERF_ROUND];
+	json_object *before = NULL, *after;
+	struct perf_result res = { 0 };
+	bool nodes = getenv("DP_TEST_PERF_NODES") != NULL;
+	bool counted = getenv("DP_TEST_PERF_HWC") != NULL || perf_nbudgets;
+	struct perf_hwc hwc;
+	unsigned int n, i;
+	uint32_t tx;
+
+	if (nodes) {
+		g_stats_enabled = 1;
+		before = perf_nodes_snapshot();
+	}
+
+	if (counted && !perf_hwc_open(&hwc)) {
+		printf("    hardware counters unavailable\n");
+		perf_hwc_close(&hwc);
+		counted = false;
+	}
+
+	for (n = 0; n < rounds; n++) {
+		for (i = 0; i < PERF_ROUND; i++) {
+			paks[i] = dp_test_cp_pak(pak);
+			dp_test_fail_unless(paks[i], "failed to copy packet");
+			if (vary)
+				vary(paks[i], n * PERF_ROUND + i);
+		}
+
+		if (counted) {
+			perf_hwc_ioctl(&hwc, PERF_EVENT_IOC_RESET);
+			perf_hwc_ioctl(&hwc, PERF_EVENT_IOC_ENABLE);
+		}
+		res.cycles += dp_test_pak_replay(paks, PERF_ROUND, iif, &tx);
+		if (counted) {
+			perf_hwc_ioctl(&hwc, PERF_EVENT_IOC_DISABLE);
+			perf_hwc_add(&hwc, &res);
+		}
+		res.packets += PERF_ROUND;
+		res.forwarded += tx;
+	}
+
+	perf_report(profile, &res);
+	perf_hwc_report(profile, &res);
+	if (counted)
+		perf_hwc_close(&hwc);
+
+	if (nodes) {
+		g_stats_enabled = 0;
+		after = perf_nodes_snapshot();
+		if (before && after)
+			perf_nodes_report(before, after);
+		json_object_put(before);
+		json_object_put(after);
+	}
+
+	rte_pktmbuf_free(pak);
+}
+
+static void perf_setup_ipv4(void)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", PERF_NH_MAC);
+}
+
+static void perf_teardown_ipv4(void)
+{
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", PERF_NH_MAC);
+	dp_test_netlink_del_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+}
+
+static struct rte_mbuf *perf_ipv4_pak(void)
+{
+	struct rte_mbuf *pak;
+	int len = 22;	/* 64 byte frames */
+
+	pak = dp_test_create_udp_ipv4_pak("10.73.1.1", "10.73.2.1",
+					  41000, 1000, 1, &len);
+	dp_test_fail_unless(pak, "failed to create packet");
+	dp_test_pktmbuf_eth_init(pak, dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC, ETHER_TYPE_IPv4);
+	return pak;
+}
+
+static void perf_ipv4_route(unsigned int rounds)
+{
+	perf_setup_ipv4();
+	perf_run("ipv4 route", perf_ipv4_pak(), "dp1T0", rounds, NULL);
+	perf_teardown_ipv4();
+}
+
+static void perf_ipv6_route(unsigned int rounds)
+{
+	struct rte_mbuf *pak;
+	int len = 2;	/* 64 byte frames */
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "2001:1:1::1/64");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2002:2:2::2/64");
+	dp_test_netlink_add_route("2010:73:2::/48 nh 2002:2:2::1 int:dp2T1");
+	dp_test_netlink_add_neigh("dp2T1", "2002:2:2::1", PERF_NH_MAC);
+
+	pak = dp_test_create_udp_ipv6_pak("2010:73:1::1", "2010:73:2::1",
+					  41000, 1000, 1, &len);
+	dp_test_fail_unless(pak, "failed to create packet");
+	dp_test_pktmbuf_eth_init(pak, dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC, ETHER_TYPE_IPv6);
+
+	perf_run("ipv6 route", pak, "dp1T0", rounds, NULL);
+
+	dp_test_netlink_del_neigh("dp2T1", "2002:2:2::1", PERF_NH_MAC);
+	dp_test_netlink_del_route("2010:73:2::/48 nh 2002:2:2::1 int:dp2T1");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "2001:1:1::1/64");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2002:2:2::2/64");
+}
+
+/* Time the ruleset fw:PERF as the input firewall of dp1T0 */
+static void perf_fw_run(const char *profile, unsigned int rounds)
+{
+	char real_ifname[IFNAMSIZ];
+
+	perf_setup_ipv4();
+	dp_test_intf_real("dp1T0", real_ifname);
+
+	dp_test_npf_cmd_fmt(false, "npf-ut attach interface:%s fw-in fw:PERF",
+			    real_ifname);
+	dp_test_npf_commit();
+
+	perf_run(profile, perf_ipv4_pak(), "dp1T0", rounds, NULL);
+
+	dp_test_npf_cmd_fmt(false, "npf-ut detach interface:%s fw-in fw:PERF",
+			    real_ifname);
+	dp_test_npf_cmd_fmt(false, "npf-ut delete fw:PERF");
+	dp_test_npf_commit();
+	dp_test_npf_cleanup();
+
+	perf_teardown_ipv4();
+}
+
+/*
+ * A ruleset of which only the last rule matches, so that each packet
+ * is checked against them all. With stateful set, only the first
+ * packet of the flow is, and the rest are matched to its session.
+ */
+static void perf_ipv4_fw(unsigned int nrules, bool stateful,
+			 unsigned int rounds)
+{
+	char profile[32];
+	unsigned int i;
+
+	for (i = 1; i < nrules; i++)
+		dp_test_npf_cmd_fmt(false,
+				    "npf-ut add fw:PERF %u action=drop "
+				    "proto=17 dst-port=%u", i, 2000 + i);
+	dp_test_npf_cmd_fmt(false, "npf-ut add fw:PERF %u action=accept %s",
+			    nrules, stateful ? "stateful=y" : "");
+
+	snprintf(profile, sizeof(profile), "ipv4 fw %u%s", nrules,
+		 stateful ? " stateful" : "");
+	perf_fw_run(profile, rounds);
+}
+
+/*
+ * Add a rule from a ClassBench filter set line, eg
+ *
+ *   @10.1.0.0/16	192.168.3.0/24	0 : 65535	80 : 80	0x06/0xFF ...
+ *
+ * Returns false if the line is not a filter.
+ */
+static bool perf_classbench_rule(unsigned int rule, const char *line)
+{
+	unsigned int sa[5], da[5], sp[2], dp[2], proto, pmask;
+	char match[48] = "";
+	int l = 0;
+
+	if (sscanf(line, "@%u.%u.%u.%u/%u %u.%u.%u.%u/%u "
+		   "%u : %u %u : %u %x/%x",
+		   &sa[0], &sa[1], &sa[2], &sa[3], &sa[4],
+		   &da[0], &da[1], &da[2], &da[3], &da[4],
+		   &sp[0], &sp[1], &dp[0], &dp[1], &proto, &pmask) != 16)
+		return false;
+
+	if (pmask == 0xff)
+		l += snprintf(match + l, sizeof(match) - l, " proto=%u", proto);
+
+	/* npf only matches ports for a given TCP or UDP protocol */
+	if (pmask == 0xff && (proto == IPPROTO_TCP || proto == IPPROTO_UDP)) {
+		if (sp[0] != 0 || sp[1] != 65535)
+			l += snprintf(match + l, sizeof(match) - l,
+				      " src-port=%u-%u", sp[0], sp[1]);
+		if (dp[0] != 0 || dp[1] != 65535)
+			snprintf(match + l, sizeof(match) - l,
+				 " dst-port=%u-%u", dp[0], dp[1]);
+	}
+
+	dp_test_npf_cmd_fmt(false,
+			    "npf-ut add fw:PERF %u action=drop "
+			    "src-addr=%u.%u.%u.%u/%u dst-addr=%u.%u.%u.%u/%u%s",
+			    rule, sa[0], sa[1], sa[2], sa[3], sa[4],
+			    da[0], da[1], da[2], da[3], da[4], match);
+	return true;
+}
+
+/*
+ * A ClassBench filter set as drop rules, ahead of a final accept.
+ * The test packet is unlikely to match any of the filters, so this
+ * is close to the worst case for the set.
+ */
+static void perf_ipv4_fw_classbench(const char *path, unsigned int rounds)
+{
+	unsigned int nrules = 0;
+	char line[256];
+	char profile[32];
+	FILE *f;
+
+	f = fopen(path, "r");
+	dp_test_fail_unless(f, "cannot open %s", path);
+
+	while (fgets(line, sizeof(line), f))
+		if (perf_classbench_rule(nrules + 1, line))
+			nrules++;
+	fclose(f);
+
+	dp_test_npf_cmd_fmt(false, "npf-ut add fw:PERF %u action=accept",
+			    nrules + 1);
+
+	snprintf(profile, sizeof(profile), "ipv4 fw classbench %u", nrules);
+	perf_fw_run(profile, rounds);
+}
+
+/* One subscriber for each block of source ports, from 100.64.0.1 */
+#define PERF_CGNAT_SUB		0x64400001
+#define PERF_CGNAT_PORTS	512
+
+/* Every packet a new flow, so a new session and mapping */
+static void perf_cgnat_vary(struct rte_mbuf *m, uint32_t seq)
+{
+	struct iphdr *ip = rte_pktmbuf_mtod_offset(m, struct iphdr *,
+						   ETHER_HDR_LEN);
+	struct udphdr *udp = (struct udphdr *)(ip + 1);
+
+	dp_test_set_pak_ip_field(ip, DP_TEST_SET_SRC_ADDR_IPV4,
+				 htonl(PERF_CGNAT_SUB +
+				       seq / PERF_CGNAT_PORTS));
+	udp->source = htons(1024 + seq % PERF_CGNAT_PORTS);
+	udp->check = 0;
+	udp->check = dp_test_ipv4_udptcp_cksum(m, ip, udp);
+}
+
+/*
+ * CGNAT of flows that each need a new session, with a new subscriber
+ * and port block every PERF_CGNAT_PORTS packets. The pool has room
+ * for some 30,000 subscribers, so the rounds are capped to fit.
+ */
+static void perf_ipv4_cgnat(unsigned int rounds)
+{
+	char real_ifname[IFNAMSIZ];
+
+	rounds = RTE_MIN(rounds, 10000u);
+
+	perf_setup_ipv4();
+	dp_test_intf_real("dp2T1", real_ifname);
+
+	dp_test_npf_cmd_fmt(false, "nat-ut pool add PERF type=cgnat "
+			    "prefix=RANGE1/2.2.3.0/24");
+	dp_test_npf_cmd_fmt(false, "cgn-ut policy add PERF priority=10 "
+			    "src-addr=100.64.0.0/10 pool=PERF "
+			    "log-sess-all=no");
+	dp_test_npf_cmd_fmt(false, "cgn-ut policy attach name=PERF intf=%s",
+			    real_ifname);
+	dp_test_wait_for_pl_feat("dp2T1", "vyatta:ipv4-cgnat-out",
+				 "ipv4-out");
+
+	perf_run("ipv4 cgnat new session", perf_ipv4_pak(), "dp1T0", rounds,
+		 perf_cgnat_vary);
+
+	cgn_session_gc_pass();
+	dp_test_npf_cmd_fmt(false, "cgn-op clear session pool PERF");
+	dp_test_npf_cmd_fmt(false, "cgn-ut policy detach name=PERF intf=%s",
+			    real_ifname);
+	dp_test_npf_cmd_fmt(false, "cgn-ut policy delete PERF");
+	dp_test_npf_cmd_fmt(false, "nat-ut pool delete PERF");
+	dp_test_wait_for_pl_feat_gone("dp2T1", "vyatta:ipv4-cgnat-out",
+				      "ipv4-out");
+
+	perf_teardown_ipv4();
+}
+
+DP_DECL_TEST_SUITE(perf_suite);
+
+DP_DECL_TEST_CASE(perf_suite, perf_fwd, NULL, NULL);
+DP_START_TEST(perf_fwd, profiles)
+{
+	const char *env = getenv("DP_TEST_PERF");
+	const char *budget = getenv("DP_TEST_PERF_BUDGET");
+	unsigned long rounds;
+	unsigned int i;
+
+	if (budget && !*budget)
+		budget = NULL;
+	if (!env && !budget)
+		return;
+
+	rounds = env ? strtoul(env, NULL, 10) : 0;
+	if (!rounds)
+		rounds = 100;
+
+	perf_nbudgets = 0;
+	perf_over = 0;
+	if (budget)
+		dp_test_fail_unless(perf_budget_load(budget),
+				    "cannot read budget file %s", budget);
+
+	printf("%u packet rounds x %lu\n", PERF_ROUND, rounds);
+
+	perf_ipv4_route(rounds);
+	perf_ipv6_route(rounds);
+
+	for (i = 0; i < ARRAY_SIZE(perf_fw_rules); i++)
+		perf_ipv4_fw(perf_fw_rules[i], false, rounds);
+	perf_ipv4_fw(perf_fw_rules[ARRAY_SIZE(perf_fw_rules) - 1], true,
+		     rounds);
+	perf_ipv4_cgnat(rounds);
+
+	env = getenv("DP_TEST_PERF_CLASSBENCH");
+	if (env)
+		perf_ipv4_fw_classbench(env, rounds);
+
+	dp_test_fail_unless(!perf_over, "%u hardware counter budgets exceeded",
+			    perf_over);
+} DP_END_TEST;
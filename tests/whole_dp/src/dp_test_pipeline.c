@@ -20,6 +20,7 @@
 
 #include "src/pipeline/nodes/sample/SampleFeatConfig.pb-c.h"
 #include "protobuf/DataplaneEnvelope.pb-c.h"
+#include "protobuf/PipelineModeConfig.pb-c.h"
 
 DP_DECL_TEST_SUITE(pipeline);
 
@@ -168,3 +169,105 @@ DP_START_TEST(dyn_feat, dyn_feat_ipv4)
 	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
 
 } DP_END_TEST;
+
+DP_DECL_TEST_CASE(pipeline, vector_mode, NULL, NULL);
+
+static void
+dp_test_create_and_send_pl_mode_msg(PipelineModeConfig__Mode mode)
+{
+	int len;
+	void *buf;
+
+	PipelineModeConfig modecfg = PIPELINE_MODE_CONFIG__INIT;
+
+	modecfg.mode = mode;
+	modecfg.has_mode = true;
+	len = pipeline_mode_config__get_packed_size(&modecfg);
+	void *buf2 = malloc(len);
+	dp_test_assert_internal(buf2);
+
+	pipeline_mode_config__pack(&modecfg, buf2);
+
+	DataplaneEnvelope msg = DATAPLANE_ENVELOPE__INIT;
+	msg.type = strdup("vyatta:pipeline-mode");
+	msg.msg.data = buf2;
+	msg.msg.len = len;
+
+	len = dataplane_envelope__get_packed_size(&msg);
+
+	buf = malloc(len);
+	dp_test_assert_internal(buf);
+
+	dataplane_envelope__pack(&msg, buf);
+
+	dp_test_send_config_src_pb(dp_test_cont_src_get(), buf, len);
+
+	free(buf2);
+	free(msg.type);
+	free(buf);
+}
+
+DP_START_TEST(vector_mode, vector_mode_ipv4)
+{
+	const char *nh_mac_str = "aa:bb:cc:dd:2:b1";
+	struct dp_test_expected *exp;
+	json_object *expected_json;
+	struct rte_mbuf *test_pak;
+	int len = 22;
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", nh_mac_str);
+
+	dp_test_create_and_send_pl_mode_msg(PIPELINE_MODE_CONFIG__MODE__VECTOR);
+	expected_json = dp_test_json_create(
+		"{ \"pl-framework\": { \"vector-mode\": true } }");
+	dp_test_check_json_state("pipeline framework dump nodes",
+				 expected_json,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected_json);
+
+	/* Forwarded packet walks the graph in vector mode */
+	test_pak = dp_test_create_ipv4_pak("1.1.1.2", "2.2.2.1",
+					   1, &len);
+	dp_test_pktmbuf_eth_init(test_pak,
+				 dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC,
+				 ETHER_TYPE_IPv4);
+
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, "dp2T1");
+	dp_test_pktmbuf_eth_init(dp_test_exp_get_pak(exp),
+				 nh_mac_str,
+				 dp_test_intf_name2mac_str("dp2T1"),
+				 ETHER_TYPE_IPv4);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak(exp));
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+
+	/* Packet with no route is dropped by a different node */
+	test_pak = dp_test_create_ipv4_pak("1.1.1.2", "3.3.3.3",
+					   1, &len);
+	dp_test_pktmbuf_eth_init(test_pak,
+				 dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC,
+				 ETHER_TYPE_IPv4);
+
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_fwd_status(exp, DP_TEST_FWD_DROPPED);
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+
+	dp_test_create_and_send_pl_mode_msg(PIPELINE_MODE_CONFIG__MODE__SCALAR);
+	expected_json = dp_test_json_create(
+		"{ \"pl-framework\": { \"vector-mode\": false } }");
+	dp_test_check_json_state("pipeline framework dump nodes",
+				 expected_json,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected_json);
+
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", nh_mac_str);
+
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+} DP_END_TEST;
@@ -592,6 +592,25 @@ int fal_plugin_ip_del_route(unsigned int vrfid,
 	return 0;
 }
 
+int fal_plugin_ip_del_routes(uint32_t route_count,
+			     const struct fal_ip_route_t *route_list,
+			     int *results)
+{
+	uint32_t i;
+
+	DEBUG("%s() routes %d\n", __func__, route_count);
+	for (i = 0; i < route_count; i++) {
+		struct fal_ip_route_t route = route_list[i];
+
+		results[i] = fal_plugin_ip_del_route(route.vrf_id,
+						     &route.ipaddr,
+						     route.prefixlen,
+						     route.tableid);
+	}
+
+	return 0;
+}
+
 #define STP_INST_CHECK(_inst)						\
 	dp_test_fail_unless((_inst >= 0) && (_inst < STP_INST_COUNT),	\
 			    "invalid STP instance value: %u", _inst)